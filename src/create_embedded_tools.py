@@ -59,6 +59,11 @@ output_paths = [
     ('*openjdk_*/file/*.zip', lambda x: 'jdk.zip'),
     ('*src/minimal_jdk.tar.gz', lambda x: 'jdk.tar.gz'),
     ('*src/minimal_jdk.zip', lambda x: 'jdk.zip'),
+    # The zstd sources zstd-jni bundles, see third_party/zstd/BUILD.
+    (
+        '*zstd-jni*/src/main/native/*',
+        lambda x: 'third_party/zstd/' + x.split('/src/main/native/', 1)[1],
+    ),
     ('*.bzl.tools', lambda x: x[:-6]),
     ('*', lambda x: re.sub(r'^.*bazel-out/[^/]*/bin/', '', x, count=1)),
 ]
@@ -13,8 +13,15 @@
 // limitations under the License.
 #include "src/main/cpp/archive_utils.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
 #include <functional>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <optional>
 #include <set>
 #include <string>
@@ -30,7 +37,13 @@
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/logging.h"
 #include "src/main/cpp/util/path_platform.h"
+#include "src/main/cpp/util/strings.h"
+#include "src/main/cpp/util/trace.h"
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/mapped_file.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
+#include "third_party/ijar/zstd_client.h"
 
 namespace blaze {
 
@@ -38,20 +51,133 @@ using std::set;
 using std::string;
 using std::vector;
 
+using MemberCallback =
+    std::function<void(const char *name, const char *data, size_t size)>;
+
+// The number of threads extracting and blessing the install base.
+static int ExtractionThreads() {
+  return std::clamp<int>(std::thread::hardware_concurrency(), 1, 8);
+}
+
+// Decompresses zip members on a pool of threads and hands them to a
+// callback, one call at a time.
+class ParallelInflater {
+ public:
+  ParallelInflater(int threads, const MemberCallback &callback)
+      : callback_(callback), finishing_(false), max_queued_(4 * threads) {
+    for (int i = 0; i < threads; ++i) {
+      workers_.emplace_back(&ParallelInflater::WorkerLoop, this);
+    }
+  }
+
+  ~ParallelInflater() { Finish(); }
+
+  // Queues the compressed member, waiting for room if there are many
+  // already. The data are copied.
+  void Submit(const char *name, const devtools_ijar::u1 *data,
+              size_t compressed_size, size_t uncompressed_size, bool zstd) {
+    Member member;
+    member.name = name;
+    member.data.assign(data, data + compressed_size);
+    member.uncompressed_size = uncompressed_size;
+    member.zstd = zstd;
+    std::unique_lock<std::mutex> lock(mutex_);
+    dequeued_.wait(lock, [this] { return queue_.size() < max_queued_; });
+    queue_.push_back(std::move(member));
+    queued_.notify_one();
+  }
+
+  // Waits for all the members to be processed. Returns the first
+  // decompression error, or the empty string.
+  string Finish() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      finishing_ = true;
+    }
+    queued_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+    workers_.clear();
+    return error_;
+  }
+
+ private:
+  struct Member {
+    string name;
+    vector<devtools_ijar::u1> data;
+    size_t uncompressed_size;
+    bool zstd;
+  };
+
+  void WorkerLoop() {
+    // The decompressors reuse their buffers, so each thread has its own.
+    devtools_ijar::Decompressor inflater;
+    devtools_ijar::ZstdDecompressor zstd_decompressor;
+    for (;;) {
+      Member member;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queued_.wait(lock, [this] { return finishing_ || !queue_.empty(); });
+        if (queue_.empty()) {
+          return;
+        }
+        member = std::move(queue_.front());
+        queue_.pop_front();
+      }
+      dequeued_.notify_one();
+      devtools_ijar::DecompressedFile *file =
+          member.zstd ? zstd_decompressor.UncompressFile(
+                            member.data.data(), member.data.size(),
+                            member.uncompressed_size)
+                      : inflater.UncompressFile(member.data.data(),
+                                                member.data.size());
+      std::lock_guard<std::mutex> lock(callback_lock_);
+      if (file == nullptr) {
+        if (error_.empty()) {
+          const char *err = member.zstd ? zstd_decompressor.GetError()
+                                        : inflater.GetError();
+          error_ = member.name + ": " + (err ? err : "cannot decompress");
+        }
+        continue;
+      }
+      callback_(member.name.c_str(),
+                reinterpret_cast<const char *>(file->uncompressed_data),
+                file->uncompressed_size);
+      free(file);
+    }
+  }
+
+  const MemberCallback &callback_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::condition_variable dequeued_;
+  std::deque<Member> queue_;
+  bool finishing_;
+  const size_t max_queued_;
+
+  // Serializes the callback calls and guards error_.
+  std::mutex callback_lock_;
+  string error_;
+};
+
 struct PartialZipExtractor : public devtools_ijar::ZipExtractorProcessor {
-  using CallbackType =
-      std::function<void(const char *name, const char *data, size_t size)>;
+  using CallbackType = MemberCallback;
 
   // Scan the zip file "archive_path" until a file named "stop_entry" is seen,
   // then stop.
   // If entry_names is not nullptr, it receives a list of all file members
   // up to and including "stop_entry".
   // If a callback is given, it is run with the name and contents of
-  // each such member.
+  // each such member. With more than one thread, the members are
+  // decompressed and the callback is run on those threads, one call at a
+  // time.
   // Returns the contents of the "stop_entry" member.
   string UnzipUntil(const string &archive_path, const string &stop_entry,
                     vector<string> *entry_names = nullptr,
-                    CallbackType &&callback = {}) {
+                    CallbackType &&callback = {}, int threads = 1) {
     std::unique_ptr<devtools_ijar::ZipExtractor> extractor(
         devtools_ijar::ZipExtractor::Create(archive_path.c_str(), this));
     if (!extractor) {
@@ -63,9 +189,20 @@ struct PartialZipExtractor : public devtools_ijar::ZipExtractorProcessor {
     seen_names_.clear();
     callback_ = callback;
     done_ = false;
+    if (callback_ && threads > 1) {
+      inflater_.reset(new ParallelInflater(threads, callback_));
+    }
     while (!done_ && extractor->ProcessNext()) {
       // Scan zip until EOF, an error, or Accept() has seen stop_entry.
     }
+    if (inflater_) {
+      string err = inflater_->Finish();
+      inflater_.reset();
+      if (!err.empty()) {
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "Error reading zip file '" << archive_path << "': " << err;
+      }
+    }
     if (const char *err = extractor->GetError()) {
       BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
           << "Error reading zip file '" << archive_path << "': " << err;
@@ -99,13 +236,64 @@ struct PartialZipExtractor : public devtools_ijar::ZipExtractorProcessor {
     }
   }
 
+  bool WantsCompressed() override { return inflater_ != nullptr; }
+
+  void ProcessCompressed(const char *filename, devtools_ijar::u4 attr,
+                         const devtools_ijar::u1 *data, size_t compressed_size,
+                         size_t uncompressed_size, bool zstd) override {
+    if (done_) {
+      // The stop entry is needed right away.
+      devtools_ijar::Decompressor inflater;
+      devtools_ijar::ZstdDecompressor zstd_decompressor;
+      devtools_ijar::DecompressedFile *file =
+          zstd ? zstd_decompressor.UncompressFile(data, compressed_size,
+                                                  uncompressed_size)
+               : inflater.UncompressFile(data, compressed_size);
+      if (file == nullptr) {
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "Error decompressing '" << filename << "': "
+            << (zstd ? zstd_decompressor.GetError() : inflater.GetError());
+      }
+      Process(filename, attr, file->uncompressed_data, file->uncompressed_size);
+      free(file);
+      return;
+    }
+    inflater_->Submit(filename, data, compressed_size, uncompressed_size, zstd);
+  }
+
   string stop_name_;
   string stop_value_;
   vector<string> seen_names_;
   CallbackType callback_;
+  std::unique_ptr<ParallelInflater> inflater_;
   bool done_ = false;
 };
 
+// Returns the file recording that the install base was found to be complete,
+// which lives next to it like the install base lock.
+static blaze_util::Path GetVerifiedStampPath(
+    const blaze_util::Path &install_base) {
+  return install_base.GetParent().GetRelative(install_base.GetBaseName() +
+                                              ".verified");
+}
+
+// Returns the expected contents of the verified stamp: the install MD5 and
+// the fingerprints of the install base and its install_base_key, which change
+// if either is replaced (the client updates the mtime of the install base on
+// every run, so that is not part of it). Returns the empty string if they
+// cannot be queried.
+static string GetVerifiedStamp(const blaze_util::Path &install_base,
+                               const string &install_md5) {
+  string base_fingerprint = blaze_util::GetFileFingerprint(install_base);
+  string key_fingerprint = blaze_util::GetFileFingerprint(
+      install_base.GetRelative("install_base_key"));
+  if (base_fingerprint.empty() || key_fingerprint.empty()) {
+    return "";
+  }
+  return install_md5 + "\n" + base_fingerprint + "\n" + key_fingerprint +
+         "\n";
+}
+
 // Installs Blaze by extracting the embedded data files, iff necessary.
 // The MD5-named install_base directory on disk is trusted; we assume
 // no-one has modified the extracted files beneath this directory once
@@ -116,6 +304,7 @@ std::optional<DurationMillis> ExtractData(
     const string &self_path, const vector<string> &archive_contents,
     const string &expected_install_md5, const StartupOptions &startup_options,
     LoggingInfo *logging_info) {
+  blaze_util::TraceSpan span("ExtractData");
   const blaze_util::Path &install_base = startup_options.install_base;
   // If the install dir doesn't exist, create it, if it does, we know it's good.
   if (!blaze_util::PathExists(install_base)) {
@@ -171,6 +360,16 @@ std::optional<DurationMillis> ExtractData(
           << "' could not be created. It exists but is not a directory.";
     }
     blaze_util::Path install_dir(install_base);
+    // If an earlier run verified this very install base, skip checking each
+    // file, which costs one stat() per file on every startup.
+    blaze_util::Path stamp_path = GetVerifiedStampPath(install_dir);
+    string expected_stamp =
+        GetVerifiedStamp(install_dir, expected_install_md5);
+    string stamp;
+    if (!expected_stamp.empty() &&
+        blaze_util::ReadFile(stamp_path, &stamp) && stamp == expected_stamp) {
+      return std::nullopt;
+    }
     // Check that all files are present and have timestamps from BlessFiles().
     for (const auto &it : archive_contents) {
       blaze_util::Path path = install_dir.GetRelative(it);
@@ -199,12 +398,102 @@ std::optional<DurationMillis> ExtractData(
           << expected_install_md5
           << ").  Remove it or specify a different --install_base.";
     }
+    // Failing to write the stamp only means checking again next time, e.g.
+    // if the directory holding the install base is not writable.
+    if (!expected_stamp.empty()) {
+      blaze_util::WriteFile(expected_stamp, stamp_path);
+    }
     return std::nullopt;
   }
 }
 
+// package-bazel.sh stores an "archive_index" member right before the central
+// directory of the archive. It lists the members up to install_base_key and
+// then the install MD5, one per line, and ends with a fixed size footer
+// giving the length of that list.
+static const char kArchiveIndexMagic[] = " bazel-archive-index\n";
+static const size_t kArchiveIndexLengthDigits = 10;
+static const size_t kArchiveIndexFooterSize =
+    kArchiveIndexLengthDigits + sizeof(kArchiveIndexMagic) - 1;
+
+// Reads the archive index, so that the archive needs not be scanned.
+// Returns false if the archive has no (usable) index.
+static bool ReadArchiveIndex(const string &archive_path, vector<string> *files,
+                             string *install_md5) {
+  devtools_ijar::MappedInputFile archive(archive_path.c_str());
+  if (!archive.Opened()) {
+    return false;
+  }
+  const devtools_ijar::u1 *data = archive.Buffer();
+  const size_t length = archive.Length();
+
+  // Find the end of central directory record, which may be followed by an
+  // archive comment.
+  static const devtools_ijar::u4 kEndOfCentralDirectorySignature = 0x06054b50;
+  static const size_t kEndOfCentralDirectorySize = 22;
+  static const size_t kMaxCommentSize = 0xFFFF;
+  if (length < kEndOfCentralDirectorySize) {
+    return false;
+  }
+  const devtools_ijar::u1 *eocd = data + length - kEndOfCentralDirectorySize;
+  const devtools_ijar::u1 *eocd_min =
+      length > kEndOfCentralDirectorySize + kMaxCommentSize
+          ? eocd - kMaxCommentSize
+          : data;
+  for (;; --eocd) {
+    const devtools_ijar::u1 *p = eocd;
+    if (devtools_ijar::get_u4le(p) == kEndOfCentralDirectorySignature) {
+      break;
+    }
+    if (eocd == eocd_min) {
+      return false;
+    }
+  }
+  const devtools_ijar::u1 *p = eocd + 16;
+  // The offset is relative to the start of the file once the client binary
+  // has been prepended and "zip -A" adjusted the offsets. A zip64 archive
+  // has 0xFFFFFFFF here; it has no index either.
+  size_t central_directory = devtools_ijar::get_u4le(p);
+  if (central_directory > length ||
+      central_directory < kArchiveIndexFooterSize) {
+    return false;
+  }
+
+  const char *footer = reinterpret_cast<const char *>(data) +
+                       central_directory - kArchiveIndexFooterSize;
+  if (memcmp(footer + kArchiveIndexLengthDigits, kArchiveIndexMagic,
+             sizeof(kArchiveIndexMagic) - 1) != 0) {
+    return false;
+  }
+  size_t index_length = 0;
+  for (size_t i = 0; i < kArchiveIndexLengthDigits; ++i) {
+    if (footer[i] < '0' || footer[i] > '9') {
+      return false;
+    }
+    index_length = index_length * 10 + (footer[i] - '0');
+  }
+  if (index_length > central_directory - kArchiveIndexFooterSize) {
+    return false;
+  }
+
+  vector<string> lines = blaze_util::Split(
+      string(footer - index_length, index_length), '\n');
+  // The members, which end with install_base_key, and the install MD5.
+  if (lines.size() < 2 || lines[lines.size() - 2] != "install_base_key") {
+    return false;
+  }
+  *install_md5 = lines.back();
+  lines.pop_back();
+  *files = std::move(lines);
+  return true;
+}
+
 void DetermineArchiveContents(const string &archive_path, vector<string> *files,
                               string *install_md5) {
+  blaze_util::TraceSpan span("DetermineArchiveContents");
+  if (ReadArchiveIndex(archive_path, files, install_md5)) {
+    return;
+  }
   PartialZipExtractor pze;
   *install_md5 = pze.UnzipUntil(archive_path, "install_base_key", files);
 }
@@ -232,7 +521,8 @@ void ExtractArchiveOrDie(const string &archive_path, const string &product_name,
       pze.UnzipUntil(archive_path, "install_base_key", nullptr,
                      [&](const char *name, const char *data, size_t size) {
                        dumper->Dump(data, size, output_dir.GetRelative(name));
-                     });
+                     },
+                     ExtractionThreads());
 
   if (!dumper->Finish(&error)) {
     BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
@@ -260,24 +550,40 @@ void BlessFiles(const blaze_util::Path &embedded_binaries) {
   // Walks the temporary directory recursively and collects full file paths.
   blaze_util::GetAllFilesUnder(embedded_binaries, &extracted_files);
 
-  set<blaze_util::Path> synced_directories;
-  for (const auto &file : extracted_files) {
-    // Set the time to a distantly futuristic value so we can observe tampering.
-    // Note that keeping a static, deterministic timestamp, such as the default
-    // timestamp set by unzip (1970-01-01) and using that to detect tampering is
-    // not enough, because we also need the timestamp to change between Bazel
-    // releases so that the metadata cache knows that the files may have
-    // changed. This is essential for the correctness of actions that use
-    // embedded binaries as artifacts.
-    if (!SetMtimeToDistantFuture(file)) {
-      string err = blaze_util::GetLastErrorString();
-      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
-          << "failed to set timestamp on '" << file.AsPrintablePath()
-          << "': " << err;
-    }
+  // The files are blessed on several threads, since most of the time goes
+  // into waiting for the syncs, and their directories are synced afterwards.
+  std::atomic<size_t> next_file(0);
+  auto bless_files = [&] {
+    for (size_t i; (i = next_file++) < extracted_files.size();) {
+      const blaze_util::Path &file = extracted_files[i];
+      // Set the time to a distantly futuristic value so we can observe
+      // tampering. Note that keeping a static, deterministic timestamp, such
+      // as the default timestamp set by unzip (1970-01-01) and using that to
+      // detect tampering is not enough, because we also need the timestamp to
+      // change between Bazel releases so that the metadata cache knows that
+      // the files may have changed. This is essential for the correctness of
+      // actions that use embedded binaries as artifacts.
+      if (!SetMtimeToDistantFuture(file)) {
+        string err = blaze_util::GetLastErrorString();
+        BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+            << "failed to set timestamp on '" << file.AsPrintablePath()
+            << "': " << err;
+      }
 
-    blaze_util::SyncFile(file);
+      blaze_util::SyncFile(file);
+    }
+  };
+  vector<std::thread> threads;
+  for (int i = 1; i < ExtractionThreads(); ++i) {
+    threads.emplace_back(bless_files);
+  }
+  bless_files();
+  for (auto &thread : threads) {
+    thread.join();
+  }
 
+  set<blaze_util::Path> synced_directories;
+  for (const auto &file : extracted_files) {
     blaze_util::Path directory = file.GetParent();
 
     // Now walk up until embedded_binaries and sync every directory in between.
@@ -26,7 +26,9 @@
 namespace blaze {
 
 // Determines the contents of the archive, storing the names of the contained
-// files into `files` and the install md5 key into `install_md5`.
+// files into `files` and the install md5 key into `install_md5`. They are read
+// from the index at the end of the archive if there is one, otherwise the
+// archive is scanned.
 void DetermineArchiveContents(const std::string &archive_path,
                               std::vector<std::string> *files,
                               std::string *install_md5);
@@ -72,8 +74,9 @@ struct LoggingInfo {
 
 // Extracts the archive and ensures success via calls to ExtractArchiveOrDie and
 // BlessFiles. If the install base, the location the archive is unpacked,
-// already exists, extraction is skipped. Kills the client if an error is
-// encountered.
+// already exists, extraction is skipped, and so is checking its files if a
+// "<install base>.verified" stamp shows that an earlier run already checked
+// this very install base. Kills the client if an error is encountered.
 std::optional<DurationMillis> ExtractData(
     const std::string &self_path,
     const std::vector<std::string> &archive_contents,
@@ -84,6 +87,7 @@ std::optional<DurationMillis> ExtractData(
 // It's expected that `output_dir` already exists and that it's a directory.
 // Fails if `expected_install_md5` doesn't match that contained in the archive,
 // as this could indicate that the contents has unexpectedly changed.
+// The files are decompressed and written on several threads.
 void ExtractArchiveOrDie(const std::string &archive_path,
                          const std::string &product_name,
                          const std::string &expected_install_md5,
@@ -93,7 +97,8 @@ void ExtractArchiveOrDie(const std::string &archive_path,
 // blaze_util::IFileMtime::SetToDistanceFuture and ensures that the files we
 // have written are actually on the disk. Later, the blaze client calls
 // blaze_util::IFileMtime::IsUntampered to ensure the files were "blessed" with
-// these distant mtimes.
+// these distant mtimes. The files are blessed on several threads, and each
+// directory is synced once, after its files.
 void BlessFiles(const blaze_util::Path &embedded_binaries);
 
 // Retrieves the build label (version string) from `archive_path` into
@@ -40,6 +40,9 @@
 #include <string.h>
 
 #include <chrono>  // NOLINT (gRPC requires this)
+#include <condition_variable>  // NOLINT
+#include <fstream>
+#include <iostream>
 #include <map>
 #include <memory>
 #include <mutex>  // NOLINT
@@ -60,6 +63,7 @@
 #include "src/main/cpp/archive_utils.h"
 #include "src/main/cpp/blaze_util.h"
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/info_cache.h"
 #include "src/main/cpp/option_processor.h"
 #include "src/main/cpp/server_process_info.h"
 #include "src/main/cpp/startup_options.h"
@@ -69,11 +73,14 @@
 #include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/md5.h"
 #include "src/main/cpp/util/numbers.h"
+#include "src/main/cpp/util/output_forwarder.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/path_platform.h"
 #include "src/main/cpp/util/port.h"
 #include "src/main/cpp/util/strings.h"
+#include "src/main/cpp/util/trace.h"
 #include "src/main/cpp/workspace_layout.h"
 #include "src/main/protobuf/command_server.grpc.pb.h"
 
@@ -201,9 +208,18 @@ class BlazeServer final {
  public:
   explicit BlazeServer(const StartupOptions &startup_options);
 
-  // Acquires locks for the install and output bases this server is running in.
-  // Returns the time spent waiting for locks.
-  DurationMillis AcquireLocks();
+  // Acquire locks for the install and output bases this server is running in,
+  // the install base first. The lock on the output base is shared if
+  // `read_only_command` is true, and exclusive otherwise. Both return the time
+  // spent waiting for the lock.
+  DurationMillis AcquireInstallBaseLock();
+  DurationMillis AcquireOutputBaseLock(bool read_only_command);
+
+  // Trades a shared lock on the output base for an exclusive one, which is
+  // needed to start or kill a server. Returns false if the lock was exclusive
+  // already. Otherwise the lock was released in between, so another client may
+  // have started or killed the server meanwhile.
+  bool UpgradeOutputBaseLock();
 
   // Whether there is an active connection to a server.
   bool Connected() const { return client_.get(); }
@@ -225,7 +241,8 @@ class BlazeServer final {
       std::optional<DurationMillis> command_wait_duration);
 
   // Disconnects and kills an existing server. Only call this when this object
-  // is in connected state.
+  // is in connected state. If the output base lock has to be upgraded first,
+  // the server is connected to again, as it may have changed meanwhile.
   void KillRunningServer();
 
   // Cancel the currently running command. If there is no command currently
@@ -239,8 +256,14 @@ class BlazeServer final {
  private:
   std::optional<LockHandle> install_base_lock_;
   std::optional<LockHandle> output_base_lock_;
+  LockMode output_base_lock_mode_ = LockMode::kExclusive;
 
-  enum CancelThreadAction { NOTHING, JOIN, CANCEL, COMMAND_ID_RECEIVED };
+  enum CancelThreadAction {
+    NOTHING,
+    COMMAND_FINISHED,
+    CANCEL,
+    COMMAND_ID_RECEIVED
+  };
 
   std::unique_ptr<CommandServer::Stub> client_;
   std::string request_cookie_;
@@ -256,6 +279,17 @@ class BlazeServer final {
   // actions from.
   std::unique_ptr<blaze_util::IPipe> pipe_;
 
+  // Whether the cancel thread is running. It is started by the first command
+  // and kept until the client exits, so that the commands of --command_file
+  // don't each start their own.
+  bool cancel_thread_started_ = false;
+
+  // Signaled by the cancel thread once it has handled COMMAND_FINISHED, i.e.
+  // once no cancel request of the command can still be in flight. Protected by
+  // cancel_thread_mutex_.
+  std::condition_variable command_finished_cv_;
+  bool command_finished_ = false;
+
   void ReleaseLocks();
   bool TryConnect(CommandServer::Stub *client);
   void CancelThread();
@@ -282,7 +316,8 @@ static BlazeServer *blaze_server;
 // _exit(2) (attributed with ATTRIBUTE_NORETURN) meaning we have to delete the
 // objects before those.
 
-DurationMillis BlazeServer::AcquireLocks() {
+DurationMillis BlazeServer::AcquireInstallBaseLock() {
+  blaze_util::TraceSpan span("AcquireInstallBaseLock");
   DurationMillis wait_time;
 
   if (lock_install_base_) {
@@ -295,7 +330,8 @@ DurationMillis BlazeServer::AcquireLocks() {
     // currently being garbage collected, we want to recreate it.
     if (install_base_lock_.has_value()) {
       BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
-          << "AcquireLocks() called but the install base lock is already held.";
+          << "AcquireInstallBaseLock() called but the install base lock is "
+             "already held.";
     }
     blaze_util::Path install_base_parent = install_base_.GetParent();
     blaze_util::MakeDirectories(install_base_parent, 0777);
@@ -304,22 +340,53 @@ DurationMillis BlazeServer::AcquireLocks() {
         install_base_parent.GetRelative(install_base_.GetBaseName() + ".lock"),
         LockMode::kShared, batch_, /* block= */ true);
     install_base_lock_ = install_base_result.first;
-    wait_time += install_base_result.second;
+    wait_time = install_base_result.second;
   }
 
+  return wait_time;
+}
+
+DurationMillis BlazeServer::AcquireOutputBaseLock(bool read_only_command) {
+  blaze_util::TraceSpan span("AcquireOutputBaseLock");
+
   // Take an exclusive lock on the output base, because two simultaneous
-  // commands may not run against the same output base.
+  // commands may not run against the same output base. Clients of read-only
+  // commands only share it, as they don't start or kill the server unless they
+  // upgrade the lock first; the server still runs one command at a time.
   if (output_base_lock_.has_value()) {
     BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
-        << "AcquireLocks() called but the output base lock is already held.";
+        << "AcquireOutputBaseLock() called but the output base lock is "
+           "already held.";
   }
+  output_base_lock_mode_ =
+      read_only_command ? LockMode::kShared : LockMode::kExclusive;
   auto output_base_result =
       blaze::AcquireLock("output base", output_base_.GetRelative("lock"),
-                         LockMode::kExclusive, batch_, block_for_lock_);
+                         output_base_lock_mode_, batch_, block_for_lock_);
   output_base_lock_ = output_base_result.first;
-  wait_time += output_base_result.second;
+  return output_base_result.second;
+}
 
-  return wait_time;
+bool BlazeServer::UpgradeOutputBaseLock() {
+  if (!output_base_lock_.has_value()) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "UpgradeOutputBaseLock() called but the output base lock is not "
+           "held.";
+  }
+  if (output_base_lock_mode_ == LockMode::kExclusive) {
+    return false;
+  }
+  // The lock file is open for reading only, so the lock cannot be converted
+  // in place.
+  blaze::ReleaseLock(*output_base_lock_);
+  auto output_base_result =
+      blaze::AcquireLock("output base", output_base_.GetRelative("lock"),
+                         LockMode::kExclusive, batch_, block_for_lock_);
+  output_base_lock_ = output_base_result.first;
+  output_base_lock_mode_ = LockMode::kExclusive;
+  BAZEL_LOG(INFO) << "Upgraded the output base lock to exclusive, waited "
+                  << output_base_result.second.millis << " milliseconds";
+  return true;
 }
 
 void BlazeServer::ReleaseLocks() {
@@ -356,6 +423,68 @@ static string EscapeForOptionSource(const string &input) {
   return result;
 }
 
+// Lets the server JVM create a dynamic class data sharing archive of the
+// classes it has loaded when it exits, and map it on the next starts, which
+// saves most of the class loading of a cold start. Like the lock, the archive
+// is a sibling of the install base, so it is shared by all the output bases of
+// the install base and garbage collected with it. The JVM discards an archive
+// that does not match it or the class path anymore, and JVMs too old for
+// -XX:+AutoCreateSharedArchive ignore the options.
+static void AddClassDataSharingArgs(const StartupOptions &startup_options,
+                                    vector<string> *result) {
+  const blaze_util::Path install_base_parent =
+      startup_options.install_base.GetParent();
+  const blaze_util::Path archive = install_base_parent.GetRelative(
+      startup_options.install_base.GetBaseName() + ".jsa");
+  const bool writable = blaze_util::CanAccessDirectory(install_base_parent);
+  if (!writable && !blaze_util::PathExists(archive)) {
+    return;
+  }
+  result->push_back("-XX:+IgnoreUnrecognizedVMOptions");
+  if (writable) {
+    result->push_back("-XX:+AutoCreateSharedArchive");
+  }
+  result->push_back("-XX:SharedArchiveFile=" + archive.AsJvmArgument());
+  result->push_back("-XX:-IgnoreUnrecognizedVMOptions");
+}
+
+// Lets a JDK 25 or later server JVM record an ahead-of-time cache when it
+// exits, holding the classes it loaded and linked along with their method
+// profiles, and start from that cache on the next starts. This takes more of
+// the JVM and server initialization off a cold start than a class data sharing
+// archive, which it replaces. The JVM starts normally without the cache if it
+// cannot use it, but unlike the archive it never replaces such a cache, so
+// the caches are keyed by the JVM and the --host_jvm_args, which are what
+// would make one unusable. They live in a directory next to the install base,
+// and are garbage collected with it. Older JVMs ignore the options.
+static void AddAotCacheArgs(const blaze_util::Path &jvm_path,
+                            const StartupOptions &startup_options,
+                            vector<string> *result) {
+  const blaze_util::Path cache_dir =
+      startup_options.install_base.GetParent().GetRelative(
+          startup_options.install_base.GetBaseName() + ".aot");
+  blaze_util::Md5Digest digest;
+  const string jvm = jvm_path.AsNativePath();
+  digest.Update(jvm.data(), jvm.size() + 1);
+  for (const string &arg : startup_options.host_jvm_args) {
+    digest.Update(arg.data(), arg.size() + 1);
+  }
+  unsigned char md5[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(md5);
+  const blaze_util::Path cache = cache_dir.GetRelative(digest.String());
+  const bool exists = blaze_util::PathExists(cache);
+  if (!exists && !blaze_util::MakeDirectories(cache_dir, 0755)) {
+    return;
+  }
+  result->push_back("-XX:+IgnoreUnrecognizedVMOptions");
+  if (exists) {
+    result->push_back("-XX:AOTCache=" + cache.AsJvmArgument());
+  } else {
+    result->push_back("-XX:AOTCacheOutput=" + cache.AsJvmArgument());
+  }
+  result->push_back("-XX:-IgnoreUnrecognizedVMOptions");
+}
+
 // Returns the JVM command argument array.
 static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
                                        const string &server_jar_path,
@@ -364,6 +493,7 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
                                        const WorkspaceLayout &workspace_layout,
                                        const string &workspace,
                                        const StartupOptions &startup_options) {
+  blaze_util::TraceSpan span("GetServerExeArgs");
   vector<string> result;
 
   // e.g. A Blaze server process running in ~/src/build_root (where there's a
@@ -440,6 +570,20 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
   result.push_back("-XX:-IgnoreUnrecognizedVMOptions");
 #endif
 
+  if (startup_options.server_aot_cache) {
+    AddAotCacheArgs(jvm_path, startup_options, &result);
+  } else if (startup_options.server_class_data_sharing) {
+    AddClassDataSharingArgs(startup_options, &result);
+  }
+
+#ifdef __linux__
+  if (startup_options.server_transparent_huge_pages) {
+    // Makes the JVM madvise() its heap for huge pages, which takes effect when
+    // /sys/kernel/mm/transparent_hugepage/enabled is "madvise".
+    result.push_back("-XX:+UseTransparentHugePages");
+  }
+#endif
+
   if (startup_options.host_jvm_debug) {
     BAZEL_LOG(USER)
         << "Running host JVM under debugger (listening on TCP port 5005).";
@@ -477,6 +621,9 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     result.push_back("--command_port=" +
                      blaze_util::ToString(startup_options.command_port));
   }
+  if (startup_options.command_server_unix_socket) {
+    result.push_back("--experimental_command_server_unix_socket");
+  }
 
   result.push_back("--connect_timeout_secs=" +
                    blaze_util::ToString(startup_options.connect_timeout_secs));
@@ -521,6 +668,11 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
     result.push_back("--unix_digest_hash_attribute_name=" +
                      startup_options.unix_digest_hash_attribute_name);
   }
+  if (!startup_options.experimental_unix_digest_cache_attribute_name.empty()) {
+    result.push_back(
+        "--experimental_unix_digest_cache_attribute_name=" +
+        startup_options.experimental_unix_digest_cache_attribute_name);
+  }
   if (startup_options.idle_server_tasks) {
     result.push_back("--idle_server_tasks");
   } else {
@@ -589,6 +741,20 @@ static vector<string> GetServerExeArgs(const blaze_util::Path &jvm_path,
   if (startup_options.run_in_user_cgroup) {
     result.push_back("--experimental_run_in_user_cgroup");
   }
+
+  if (!startup_options.server_cpus.empty()) {
+    result.push_back("--experimental_server_cpus=" +
+                     startup_options.server_cpus);
+  }
+
+  if (startup_options.server_numa_node >= 0) {
+    result.push_back("--experimental_server_numa_node=" +
+                     blaze_util::ToString(startup_options.server_numa_node));
+  }
+
+  if (startup_options.server_transparent_huge_pages) {
+    result.push_back("--experimental_server_transparent_huge_pages");
+  }
 #endif
 
   startup_options.AddExtraOptions(&result);
@@ -672,6 +838,16 @@ static const void GoToWorkspace(const WorkspaceLayout &workspace_layout,
   }
 }
 
+// Applies the scheduling and placement startup options to this process, from
+// where the server inherits them.
+static void SetServerScheduling(const StartupOptions &startup_options) {
+  SetScheduling(startup_options.batch_cpu_scheduling,
+                startup_options.io_nice_level);
+#ifdef __linux__
+  SetPlacement(startup_options.server_cpus, startup_options.server_numa_node);
+#endif
+}
+
 static const bool IsServerMode(const string &command) {
   return "exec-server" == command;
 }
@@ -699,13 +875,16 @@ static void RunServerMode(
 
   blaze_util::WriteFile(blaze::GetProcessIdAsString(),
                         server_dir.GetRelative("server.pid.txt"));
+  // The info cache and the read-only commands describe the previous server, if
+  // any.
+  (void)blaze_util::UnlinkPath(server_dir.GetRelative("info_cache"));
+  (void)blaze_util::UnlinkPath(server_dir.GetRelative("read_only_commands"));
   blaze_util::WriteFile(GetArgumentString(server_exe_args),
                         server_dir.GetRelative("cmdline"));
 
   GoToWorkspace(workspace_layout, workspace);
 
-  SetScheduling(startup_options.batch_cpu_scheduling,
-                startup_options.io_nice_level);
+  SetServerScheduling(startup_options);
 
   {
     WithEnvVars env_obj(PrepareEnvironmentForJvm());
@@ -714,6 +893,7 @@ static void RunServerMode(
 #else
     bool run_in_user_cgroup = false;
 #endif
+    blaze_util::WriteTrace();
     ExecuteServerJvm(server_exe, server_exe_args, run_in_user_cgroup);
   }
 }
@@ -767,8 +947,7 @@ static void RunBatchMode(
 
   GoToWorkspace(workspace_layout, workspace);
 
-  SetScheduling(startup_options.batch_cpu_scheduling,
-                startup_options.io_nice_level);
+  SetServerScheduling(startup_options);
 
   {
     WithEnvVars env_obj(PrepareEnvironmentForJvm());
@@ -777,6 +956,7 @@ static void RunBatchMode(
 #else
     bool run_in_user_cgroup = false;
 #endif
+    blaze_util::WriteTrace();
     ExecuteServerJvm(server_exe, jvm_args_vector, run_in_user_cgroup);
   }
 }
@@ -843,8 +1023,11 @@ static void ConnectOrDie(const OptionProcessor &option_processor,
     const auto next_attempt_time =
         attempt_time + std::chrono::milliseconds(100);
 
-    if (server->Connect()) {
-      return;
+    {
+      blaze_util::TraceSpan span("Connect attempt");
+      if (server->Connect()) {
+        return;
+      }
     }
 
     if (attempt_time >= (last_message_time + min_message_interval)) {
@@ -857,7 +1040,13 @@ static void ConnectOrDie(const OptionProcessor &option_processor,
       last_message_time = attempt_time;
     }
 
-    std::this_thread::sleep_until(next_attempt_time);
+    // Wake up early if the server gets ready or dies in the meantime.
+    const auto now = std::chrono::system_clock::now();
+    if (now < next_attempt_time) {
+      server_startup->WaitForReadiness(
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              next_attempt_time - now));
+    }
     if (!server_startup->IsStillAlive()) {
       option_processor.PrintStartupOptionsProvenanceMessage();
       if (server->ProcessInfo().jvm_log_file_append_) {
@@ -928,6 +1117,11 @@ static void StartServerAndConnect(
   EnsurePreviousServerProcessTerminated(server_dir, startup_options,
                                         logging_info);
 
+  // The info cache and the read-only commands describe the previous server, if
+  // any.
+  (void)blaze_util::UnlinkPath(server_dir.GetRelative("info_cache"));
+  (void)blaze_util::UnlinkPath(server_dir.GetRelative("read_only_commands"));
+
   // cmdline file is used to validate the server running in this server_dir.
   // There's no server running now so we're safe to unconditionally write this.
   blaze_util::WriteFile(GetArgumentString(server_exe_args),
@@ -938,18 +1132,22 @@ static void StartServerAndConnect(
 
   logging_info->SetRestartReasonIfNotSet(NO_DAEMON);
 
-  SetScheduling(startup_options.batch_cpu_scheduling,
-                startup_options.io_nice_level);
+  SetServerScheduling(startup_options);
 
   BAZEL_LOG(USER) << "Starting local " << startup_options.product_name
                   << " server (" << build_label << ")"
                   << " and connecting to it...";
   BlazeServerStartup *server_startup;
-  const int server_pid = ExecuteDaemon(
-      server_exe, server_exe_args, PrepareEnvironmentForJvm(),
-      server->ProcessInfo().jvm_log_file_,
-      server->ProcessInfo().jvm_log_file_append_, startup_options.install_base,
-      server_dir, startup_options, &server_startup);
+  int server_pid;
+  {
+    blaze_util::TraceSpan span("Start server");
+    server_pid = ExecuteDaemon(
+        server_exe, server_exe_args, PrepareEnvironmentForJvm(),
+        server->ProcessInfo().jvm_log_file_,
+        server->ProcessInfo().jvm_log_file_append_,
+        startup_options.install_base, server_dir, startup_options,
+        &server_startup);
+  }
 
   ConnectOrDie(option_processor, startup_options, server_pid, server_startup,
                server);
@@ -1046,6 +1244,12 @@ static bool AreStartupOptionsDifferent(
 
 // Kills the running Blaze server, if any, if the startup options do not match.
 // Returns true if the server has been killed.
+//
+// The replacement is a cold JVM. A spare server started ahead of time could not
+// take over: the JVM is bound to its output base and startup options when it
+// starts, and the client sets up the server directory before that. Only the
+// class loading is sped up, by the class data sharing archive of the install
+// base.
 static bool KillRunningServerIfDifferentStartupOptions(
     const StartupOptions &startup_options,
     const vector<string> &server_exe_args, LoggingInfo *logging_info,
@@ -1130,6 +1334,69 @@ static void EnsureCorrectRunningVersion(const StartupOptions &startup_options,
 
 static void CancelServer() { blaze_server->Cancel(); }
 
+// Runs the commands of --command_file one after the other over the connection
+// to the server, so that the client starts, takes the locks and connects only
+// once for all of them. The file is read as the commands run, so a tool can
+// write them to stdin one at a time. Stops after a command was interrupted or
+// shut the server down. Returns the first non-zero exit code of the commands.
+static unsigned int RunCommandFile(
+    const OptionProcessor &option_processor,
+    const StartupOptions &startup_options, LoggingInfo logging_info,
+    std::optional<DurationMillis> extract_data_duration,
+    std::optional<DurationMillis> command_wait_duration, BlazeServer *server) {
+  std::ifstream file;
+  std::istream *input = &std::cin;
+  if (startup_options.command_file != "-") {
+    file.open(startup_options.command_file);
+    if (!file) {
+      BAZEL_DIE(blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR)
+          << "cannot read the command file '" << startup_options.command_file
+          << "': " << GetLastErrorString();
+    }
+    input = &file;
+  }
+
+  unsigned int exit_code = blaze_exit_code::SUCCESS;
+  // The first command accounts for the startup of the client.
+  uint64_t command_start_ms = logging_info.start_time_ms;
+  string line;
+  while (server->Connected() && std::getline(*input, line)) {
+    vector<string> words;
+    blaze_util::Tokenize(line, '#', &words);
+    if (words.empty()) {
+      continue;
+    }
+    const string command = words[0];
+    words.erase(words.begin());
+
+    BAZEL_LOG(INFO) << "Running command from the command file: " << line;
+    unsigned int command_exit_code;
+    {
+      blaze_util::TraceSpan span("Run command");
+      command_exit_code = server->Communicate(
+          command, option_processor.GetCommandArguments(words),
+          startup_options.invocation_policy,
+          startup_options.original_startup_options_, logging_info,
+          DurationMillis(command_start_ms, GetMillisecondsMonotonic()),
+          extract_data_duration, command_wait_duration);
+    }
+    if (exit_code == blaze_exit_code::SUCCESS) {
+      exit_code = command_exit_code;
+    }
+    if (command_exit_code == blaze_exit_code::INTERRUPTED) {
+      break;
+    }
+
+    // Only the first command waited for the locks, the extraction and the
+    // restart of the server.
+    extract_data_duration = std::nullopt;
+    command_wait_duration = std::nullopt;
+    logging_info.restart_reason = NO_RESTART;
+    command_start_ms = GetMillisecondsMonotonic();
+  }
+  return exit_code;
+}
+
 // Runs the launcher in client/server mode. Ensures that there's indeed a
 // running server, then forwards the user's command to the server and the
 // server's response back to the user. Does not return - exits via exit or
@@ -1189,17 +1456,27 @@ static ATTRIBUTE_NORETURN void RunClientServerMode(
   SignalHandler::Get().Install(startup_options.product_name,
                                startup_options.output_base,
                                &server->ProcessInfo(), CancelServer);
-  SignalHandler::Get().PropagateSignalOrExit(server->Communicate(
-      option_processor.GetCommand(), option_processor.GetCommandArguments(),
-      startup_options.invocation_policy,
-      startup_options.original_startup_options_, *logging_info,
-      client_startup_duration, extract_data_duration, command_wait_duration));
+  unsigned int exit_code;
+  if (!startup_options.command_file.empty()) {
+    exit_code = RunCommandFile(option_processor, startup_options, *logging_info,
+                               extract_data_duration, command_wait_duration,
+                               server);
+  } else {
+    blaze_util::TraceSpan span("Run command");
+    exit_code = server->Communicate(
+        option_processor.GetCommand(), option_processor.GetCommandArguments(),
+        startup_options.invocation_policy,
+        startup_options.original_startup_options_, *logging_info,
+        client_startup_duration, extract_data_duration, command_wait_duration);
+  }
+  SignalHandler::Get().PropagateSignalOrExit(exit_code);
 }
 
 // Parse the options.
 static void ParseOptionsOrDie(const string &cwd, const string &workspace,
                               OptionProcessor &option_processor, int argc,
                               const char *const *argv) {
+  blaze_util::TraceSpan span("Parse options");
   std::string error;
   std::vector<std::string> args(argv, argv + argc);
   const blaze_exit_code::ExitCode parse_exit_code =
@@ -1451,6 +1728,90 @@ void PrintVersionInfo(const string &self_path, const string &product_name) {
   printf("%s %s\n", product_name.c_str(), build_label.c_str());
 }
 
+// Answers `info` without a round trip to the server if every requested key is
+// one that the server caches in the info_cache file of `server_dir` after each
+// command. The cache describes the running server, so it is only used once the
+// client has connected to a server with the right version and startup options,
+// and only if no invocation policy or rc file option could change the output.
+static bool RunInfoFromCache(const OptionProcessor &option_processor,
+                             const StartupOptions &startup_options,
+                             const blaze_util::Path &server_dir,
+                             BlazeServer *server) {
+  if (!server->Connected() || !startup_options.invocation_policy.empty()) {
+    return false;
+  }
+
+  const vector<string> keys = option_processor.GetExplicitCommandArguments();
+  for (const string &key : keys) {
+    if (key.empty() || key[0] == '-') {
+      return false;
+    }
+  }
+  for (const BlazercOption &option :
+       option_processor.GetParsedBlazercOptions()) {
+    if (option.option.find("show_make_env") != string::npos ||
+        option.option.find("info_output_type") != string::npos) {
+      return false;
+    }
+  }
+
+  string content;
+  string output;
+  if (!blaze_util::ReadFile(server_dir.GetRelative("info_cache"), &content) ||
+      !AnswerInfoFromCache(content, keys, &output)) {
+    return false;
+  }
+  BAZEL_LOG(INFO) << "Answered info from the server's info cache";
+  fwrite(output.data(), 1, output.size(), stdout);
+  fflush(stdout);
+  return true;
+}
+
+// Returns whether the server last started in the output base declared
+// `command` read-only in the read_only_commands file of its server directory,
+// so that a shared lock on the output base is enough for the client. The file
+// is read before the lock is taken, so it may be stale; if it is, the client
+// upgrades the lock anyway before starting or killing a server. Commands run
+// with --batch or --command_file always take an exclusive lock.
+static bool IsReadOnlyCommand(const OptionProcessor &option_processor,
+                              const StartupOptions &startup_options) {
+  if (startup_options.batch || !startup_options.command_file.empty()) {
+    return false;
+  }
+  string content;
+  if (!blaze_util::ReadFile(startup_options.output_base.GetRelative("server")
+                                .GetRelative("read_only_commands"),
+                            &content)) {
+    return false;
+  }
+  for (const string &line : blaze_util::Split(content, '\n')) {
+    if (line == option_processor.GetCommand()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Starts reading the files the server JVM loads first into the file system
+// cache, so that the disk reads overlap the work of the client until the JVM
+// starts. The files are missing until the install base is extracted: then
+// nothing is read.
+static void StartServerReadAhead(const vector<string> &archive_contents,
+                                 const StartupOptions &startup_options) {
+  vector<blaze_util::Path> paths = {startup_options.install_base.GetRelative(
+      GetServerJarPath(archive_contents))};
+  // Not GetServerJavabase(), which dies if there is no JDK to be found.
+  blaze_util::Path javabase = startup_options.GetExplicitServerJavabase();
+  if (javabase.IsEmpty()) {
+    javabase = startup_options.GetEmbeddedJavabase();
+  }
+  if (!javabase.IsEmpty()) {
+    // The classes of the JDK.
+    paths.push_back(javabase.GetRelative("lib").GetRelative("modules"));
+  }
+  ReadAheadFiles(paths);
+}
+
 static void RunLauncher(const string &self_path,
                         const vector<string> &archive_contents,
                         const string &install_md5,
@@ -1460,19 +1821,56 @@ static void RunLauncher(const string &self_path,
                         const string &workspace, LoggingInfo *logging_info) {
   blaze_server = new BlazeServer(startup_options);
 
+  StartServerReadAhead(archive_contents, startup_options);
+
+  DurationMillis lock_wait_duration = blaze_server->AcquireInstallBaseLock();
+
+  // Extracting or checking the install base only needs the install base lock,
+  // so it runs while this client waits for the output base lock and connects
+  // to a running server, neither of which looks at the install base. Its
+  // errors still exit the client as before. Without --block_for_lock, a client
+  // finding the output base locked must say so rather than race that with an
+  // extraction error, so it extracts afterwards as before.
+  std::optional<DurationMillis> extract_data_duration;
+  std::thread extract_data_thread;
+  if (startup_options.block_for_lock) {
+    extract_data_thread = std::thread([&] {
+      extract_data_duration =
+          ExtractData(self_path, archive_contents, install_md5,
+                      startup_options, logging_info);
+    });
+  }
+
+  DurationMillis output_base_wait_duration =
+      blaze_server->AcquireOutputBaseLock(
+          IsReadOnlyCommand(option_processor, startup_options));
+  lock_wait_duration += output_base_wait_duration;
   const std::optional<DurationMillis> command_wait_duration =
-      blaze_server->AcquireLocks();
-  const uint64_t wait_ms =
-      command_wait_duration.has_value() ? command_wait_duration->millis : 0;
-  BAZEL_LOG(INFO) << "Acquired the client lock, waited " << wait_ms
-                  << " milliseconds";
+      lock_wait_duration;
+  BAZEL_LOG(INFO) << "Acquired the client lock, waited "
+                  << lock_wait_duration.millis << " milliseconds";
 
   WarnFilesystemType(startup_options.output_base);
 
-  const std::optional<DurationMillis> extract_data_duration = ExtractData(
-      self_path, archive_contents, install_md5, startup_options, logging_info);
+  if (!extract_data_thread.joinable()) {
+    extract_data_duration = ExtractData(self_path, archive_contents,
+                                        install_md5, startup_options,
+                                        logging_info);
+  }
+
+  {
+    blaze_util::TraceSpan span("Connect");
+    if (!blaze_server->Connect() && blaze_server->UpgradeOutputBaseLock()) {
+      // A server has to be started, but another client may have done so while
+      // this one waited for the exclusive lock.
+      blaze_server->Connect();
+    }
+  }
 
-  blaze_server->Connect();
+  if (extract_data_thread.joinable()) {
+    blaze_util::TraceSpan span("Wait for ExtractData");
+    extract_data_thread.join();
+  }
 
   if (!startup_options.batch && "shutdown" == option_processor.GetCommand() &&
       !blaze_server->Connected()) {
@@ -1527,6 +1925,10 @@ static void RunLauncher(const string &self_path,
     RunBatchMode(server_exe, server_exe_args, workspace_layout, workspace,
                  option_processor, startup_options, logging_info,
                  extract_data_duration, command_wait_duration, blaze_server);
+  } else if ("info" == option_processor.GetCommand() &&
+             RunInfoFromCache(option_processor, startup_options, server_dir,
+                              blaze_server)) {
+    return;
   } else {
     string build_label;
     ExtractBuildLabel(self_path, &build_label);
@@ -1592,6 +1994,10 @@ int Main(int argc, const char *const *argv, WorkspaceLayout *workspace_layout,
   StartupOptions *startup_options = option_processor->GetParsedStartupOptions();
   startup_options->MaybeLogStartupOptionWarnings();
 
+  if (!startup_options->client_trace.IsEmpty()) {
+    blaze_util::SetTraceFile(startup_options->client_trace);
+  }
+
   if (startup_options->client_debug) {
     SetDebugLog(blaze_util::LOGGINGDETAIL_DEBUG);
   } else if (startup_options->quiet) {
@@ -1620,6 +2026,20 @@ int Main(int argc, const char *const *argv, WorkspaceLayout *workspace_layout,
                        << " MODULE.bazel file).";
   }
 
+  if (!startup_options->command_file.empty()) {
+    if (startup_options->batch) {
+      BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+          << "--command_file requires a server, it cannot be used in batch "
+             "mode.";
+    }
+    if (!option_processor->GetCommand().empty()) {
+      BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+          << "--command_file cannot be combined with a command on the command "
+             "line, found '"
+          << option_processor->GetCommand() << "'.";
+    }
+  }
+
   vector<string> archive_contents;
   string install_md5;
   DetermineArchiveContents(self_path, &archive_contents, &install_md5);
@@ -1691,11 +2111,16 @@ bool BlazeServer::Connect() {
   const std::string ipv4_prefix = "127.0.0.1:";
   const std::string ipv6_prefix_1 = "[0:0:0:0:0:0:0:1]:";
   const std::string ipv6_prefix_2 = "[::1]:";
+  // With --experimental_command_server_unix_socket, the server listens on a
+  // socket in the server directory, which only the user can access.
+  const std::string unix_socket =
+      "unix:" + server_dir.GetRelative("command.socket").AsNativePath();
 
   // Make sure that we are being directed to localhost
   if (port.compare(0, ipv4_prefix.size(), ipv4_prefix) &&
       port.compare(0, ipv6_prefix_1.size(), ipv6_prefix_1) &&
-      port.compare(0, ipv6_prefix_2.size(), ipv6_prefix_2)) {
+      port.compare(0, ipv6_prefix_2.size(), ipv6_prefix_2) &&
+      port != unix_socket) {
     return false;
   }
 
@@ -1741,7 +2166,8 @@ bool BlazeServer::Connect() {
 // the cancel thread. These commands are available:
 //
 // - NOP
-// - JOIN. The cancel thread needs to be terminated.
+// - COMMAND_FINISHED. The command is over; a pending cancellation request and
+//   the command ID are forgotten.
 // - CANCEL. If the command ID is already available, a cancel request is sent.
 // - COMMAND_ID_RECEIVED. The client learned the command ID from the server.
 //   If there is a pending cancellation request, it is acted upon.
@@ -1750,9 +2176,10 @@ bool BlazeServer::Connect() {
 // file descriptor for receiving commands and command_id_, the latter of which
 // is protected by a mutex, which mainly serves as a memory fence.
 //
-// The cancellation thread is joined at the end of the execution of the command.
-// The main thread wakes it up just so that it can finish (using the JOIN
-// action)
+// The cancellation thread is started by the first command and then waits for
+// the next one, as starting a thread for each command of --command_file would
+// be wasted work. It is never joined, since the client exits or execs once it
+// is done with the server.
 //
 // It's conceivable that the server is busy and thus it cannot service the
 // cancellation request. In that case, we simply ignore the failure and the both
@@ -1760,10 +2187,9 @@ bool BlazeServer::Connect() {
 // Ctrl-C still counts as a SIGINT, three of which result in a SIGKILL being
 // delivered to the server)
 void BlazeServer::CancelThread() {
-  bool running = true;
   bool cancel = false;
   bool command_id_received = false;
-  while (running) {
+  while (true) {
     char buf;
 
     int error;
@@ -1779,9 +2205,14 @@ void BlazeServer::CancelThread() {
       case CancelThreadAction::NOTHING:
         break;
 
-      case CancelThreadAction::JOIN:
-        running = false;
+      case CancelThreadAction::COMMAND_FINISHED: {
+        cancel = false;
+        command_id_received = false;
+        std::lock_guard<std::mutex> lock(cancel_thread_mutex_);
+        command_finished_ = true;
+        command_finished_cv_.notify_one();
         break;
+      }
 
       case CancelThreadAction::COMMAND_ID_RECEIVED:
         command_id_received = true;
@@ -1823,6 +2254,16 @@ void BlazeServer::SendCancelMessage() {
 // This will wait indefinitely until the server shuts down
 void BlazeServer::KillRunningServer() {
   assert(Connected());
+  if (UpgradeOutputBaseLock()) {
+    // The lock was released while it was upgraded, so another client may have
+    // shut this server down, or replaced it, in the meantime. Connect again so
+    // that the server now running, if any, is the one that is shut down, and
+    // its pid the one that is waited for.
+    client_.reset();
+    if (!Connect()) {
+      return;
+    }
+  }
 
   std::unique_ptr<grpc::ClientContext> context(new grpc::ClientContext);
   command_server::RunRequest request;
@@ -1939,16 +2380,23 @@ unsigned int BlazeServer::Communicate(
   // must implement its own locking of the install and output bases.
   // This may result in two "waiting for lock" messages, one emitted by client
   // during server startup, and another emitted by the server. This is harmless.
-  BAZEL_LOG(INFO)
-      << "Released the client-side locks on the install and output bases";
-  ReleaseLocks();
+  // With --command_file, the locks are only held until the first command.
+  if (output_base_lock_.has_value()) {
+    BAZEL_LOG(INFO)
+        << "Released the client-side locks on the install and output bases";
+    ReleaseLocks();
+  }
 
-  std::thread cancel_thread(&BlazeServer::CancelThread, this);
+  if (!cancel_thread_started_) {
+    std::thread(&BlazeServer::CancelThread, this).detach();
+    cancel_thread_started_ = true;
+  }
   bool command_id_set = false;
   bool pipe_broken = false;
   command_server::RunResponse final_response;
   bool finished = false;
   bool finished_warning_emitted = false;
+  blaze_util::OutputForwarder output;
 
   while (reader->Read(&response)) {
     if (finished && !finished_warning_emitted) {
@@ -1961,31 +2409,19 @@ unsigned int BlazeServer::Communicate(
       return blaze_exit_code::INTERNAL_ERROR;
     }
 
-    const char *broken_pipe_name = nullptr;
+    // Hand the output over without copying it; `response` is cleared by the
+    // next Read anyway.
+    output.Write(std::move(*response.mutable_standard_output()),
+                 /* to_stdout */ true);
+    output.Write(std::move(*response.mutable_standard_error()),
+                 /* to_stdout */ false);
 
     if (response.finished()) {
       final_response = response;
       finished = true;
     }
 
-    if (!response.standard_output().empty()) {
-      size_t size = response.standard_output().size();
-      if (blaze_util::WriteToStdOutErr(response.standard_output().c_str(), size,
-                                       /* to_stdout */ true) ==
-          blaze_util::WriteResult::BROKEN_PIPE) {
-        broken_pipe_name = "standard output";
-      }
-    }
-
-    if (!response.standard_error().empty()) {
-      size_t size = response.standard_error().size();
-      if (blaze_util::WriteToStdOutErr(response.standard_error().c_str(), size,
-                                       /* to_stdout */ false) ==
-          blaze_util::WriteResult::BROKEN_PIPE) {
-        broken_pipe_name = "standard error";
-      }
-    }
-
+    const char *broken_pipe_name = output.BrokenPipeName();
     if (broken_pipe_name != nullptr && !pipe_broken) {
       pipe_broken = true;
       BAZEL_LOG(USER) << "\nCannot write to " << broken_pipe_name
@@ -2004,6 +2440,12 @@ unsigned int BlazeServer::Communicate(
   grpc::Status status = reader->Finish();
   reader.reset();
   context.reset();  // necessary for destroying client_ below to be effective
+  output.Flush();
+  if (!pipe_broken && output.BrokenPipeName() != nullptr) {
+    pipe_broken = true;
+    BAZEL_LOG(USER) << "\nCannot write to " << output.BrokenPipeName()
+                    << "; exiting...\n";
+  }
 
   // If the server claims it is shutting down (eg the command was "shutdown"),
   // wait for it to exit.
@@ -2018,8 +2460,14 @@ unsigned int BlazeServer::Communicate(
     }
   }
 
-  SendAction(CancelThreadAction::JOIN);
-  cancel_thread.join();
+  // Wait for the cancel thread to catch up, so that the client doesn't exit
+  // while it sends a cancel request.
+  {
+    std::unique_lock<std::mutex> lock(cancel_thread_mutex_);
+    command_finished_ = false;
+    SendAction(CancelThreadAction::COMMAND_FINISHED);
+    command_finished_cv_.wait(lock, [this] { return command_finished_; });
+  }
 
   if (!status.ok()) {
     BAZEL_LOG(USER) << "\nServer terminated abruptly (error code: "
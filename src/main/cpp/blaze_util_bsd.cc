@@ -50,6 +50,7 @@
 #include "src/main/cpp/util/exit_code.h"
 #include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/filesystem_capabilities.h"
 #include "src/main/cpp/util/logging.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/port.h"
@@ -81,18 +82,15 @@ string GetCacheDir() {
 }
 
 void WarnFilesystemType(const blaze_util::Path &output_base) {
-  struct statfs buf = {};
-  if (statfs(output_base.AsNativePath().c_str(), &buf) < 0) {
-    BAZEL_LOG(WARNING) << "couldn't get file system type information for '"
-                       << output_base.AsPrintablePath()
-                       << "': " << strerror(errno);
-    return;
-  }
-
-  if (strcmp(buf.f_fstypename, "nfs") == 0) {
+  const blaze_util::FilesystemCapabilities &capabilities =
+      blaze_util::GetFilesystemCapabilities(
+          output_base.AsNativePath().c_str());
+  if (capabilities.remote()) {
     BAZEL_LOG(WARNING) << "Output base '" << output_base.AsPrintablePath()
-                       << "' is on NFS. This may lead to surprising failures "
-                          "and undetermined behavior.";
+                       << "' is on a network file system ("
+                       << capabilities.type()
+                       << "). This may lead to surprising failures and "
+                          "undetermined behavior.";
   }
 }
 
@@ -14,8 +14,9 @@
 
 #include <errno.h>
 #include <limits.h>
-#include <linux/magic.h>
+#include <linux/mempolicy.h>
 #include <pwd.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
@@ -23,7 +24,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
-#include <sys/statfs.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -31,7 +32,9 @@
 #include "src/main/cpp/util/errors.h"
 #include "src/main/cpp/util/exit_code.h"
 #include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/filesystem_capabilities.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/numbers.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/port.h"
 #include "src/main/cpp/util/strings.h"
@@ -68,18 +71,15 @@ string GetCacheDir() {
 }
 
 void WarnFilesystemType(const blaze_util::Path &output_base) {
-  struct statfs buf = {};
-  if (statfs(output_base.AsNativePath().c_str(), &buf) < 0) {
-    BAZEL_LOG(WARNING) << "couldn't get file system type information for '"
-                       << output_base.AsPrintablePath()
-                       << "': " << strerror(errno);
-    return;
-  }
-
-  if (buf.f_type == NFS_SUPER_MAGIC) {
+  const blaze_util::FilesystemCapabilities &capabilities =
+      blaze_util::GetFilesystemCapabilities(
+          output_base.AsNativePath().c_str());
+  if (capabilities.remote()) {
     BAZEL_LOG(WARNING) << "Output base '" << output_base.AsPrintablePath()
-                       << "' is on NFS. This may lead to surprising failures "
-                          "and undetermined behavior.";
+                       << "' is on a network file system ("
+                       << capabilities.type()
+                       << "). This may lead to surprising failures and "
+                          "undetermined behavior.";
   }
 }
 
@@ -113,6 +113,83 @@ void SetScheduling(bool batch_cpu_scheduling, int io_nice_level) {
   }
 }
 
+// Parses a CPU list in the format of cpuset(7), e.g. "0-3,8,10-11", into
+// 'result'. Returns false if the list is malformed.
+static bool ParseCpuList(const string& list, cpu_set_t* result) {
+  CPU_ZERO(result);
+  for (const string& range : blaze_util::Split(list, ',')) {
+    std::vector<string> bounds = blaze_util::Split(range, '-');
+    int first, last;
+    if (bounds.empty() || bounds.size() > 2 ||
+        !blaze_util::safe_strto32(bounds[0], &first) ||
+        !blaze_util::safe_strto32(bounds.back(), &last) || first < 0 ||
+        last < first || last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      CPU_SET(cpu, result);
+    }
+  }
+  return true;
+}
+
+void SetPlacement(const string& cpus, int numa_node) {
+  if (cpus.empty() && numa_node < 0) {
+    return;
+  }
+
+  cpu_set_t cpu_set;
+  if (cpus.empty()) {
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set)) {
+      BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+          << "sched_getaffinity() failed: " << GetLastErrorString();
+    }
+  } else if (!ParseCpuList(cpus, &cpu_set)) {
+    BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+        << "Invalid argument to --experimental_server_cpus: '" << cpus
+        << "'. Must be a list of CPUs like '0-7,16-23'.";
+  }
+
+  if (numa_node >= 0) {
+    string node_cpus;
+    cpu_set_t node_cpu_set;
+    bool valid = blaze_util::ReadFile(
+        "/sys/devices/system/node/node" + blaze_util::ToString(numa_node) +
+            "/cpulist",
+        &node_cpus);
+    if (valid) {
+      blaze_util::StripWhitespace(&node_cpus);
+      valid = ParseCpuList(node_cpus, &node_cpu_set);
+    }
+    if (!valid) {
+      BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+          << "Invalid argument to --experimental_server_numa_node: "
+          << numa_node << " is not a NUMA node of this machine.";
+    }
+    CPU_AND(&cpu_set, &cpu_set, &node_cpu_set);
+
+    constexpr int kBitsPerLong = 8 * sizeof(unsigned long);  // NOLINT
+    std::vector<unsigned long> nodemask(numa_node / kBitsPerLong + 1);  // NOLINT
+    nodemask[numa_node / kBitsPerLong] = 1UL << (numa_node % kBitsPerLong);
+    if (syscall(SYS_set_mempolicy, MPOL_BIND, nodemask.data(),
+                nodemask.size() * kBitsPerLong + 1) < 0) {
+      BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+          << "set_mempolicy(MPOL_BIND) for NUMA node " << numa_node
+          << " failed: " << GetLastErrorString();
+    }
+  }
+
+  if (CPU_COUNT(&cpu_set) == 0) {
+    BAZEL_DIE(blaze_exit_code::BAD_ARGV)
+        << "--experimental_server_cpus and --experimental_server_numa_node "
+           "leave no CPU to run the server on.";
+  }
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set)) {
+    BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
+        << "sched_setaffinity() failed: " << GetLastErrorString();
+  }
+}
+
 std::unique_ptr<blaze_util::Path> GetProcessCWD(int pid) {
   char server_cwd[PATH_MAX] = {};
   if (readlink(
@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 
+#include <chrono>  // NOLINT
 #include <map>
 #include <memory>
 #include <optional>
@@ -128,6 +129,12 @@ std::string GetHomeDir();
 // Warn about dubious filesystem types, such as NFS, case-insensitive (?).
 void WarnFilesystemType(const blaze_util::Path& output_base);
 
+// Asks the OS to start reading the files into the file system cache in the
+// background, so that a process reading them later does not wait for the
+// disk. Returns without waiting for the reads. Files that cannot be opened are
+// skipped.
+void ReadAheadFiles(const std::vector<blaze_util::Path>& paths);
+
 // Returns elapsed milliseconds since some unspecified start of time.
 // The results are monotonic, i.e. subsequent calls to this method never return
 // a value less than a previous result.
@@ -137,6 +144,14 @@ uint64_t GetMillisecondsMonotonic();
 // on Linux, so it should only be called when necessary.
 void SetScheduling(bool batch_cpu_scheduling, int io_nice_level);
 
+#ifdef __linux__
+// Restricts the CPUs and memory of this process and its future children.
+// 'cpus' is a CPU list like "0-7,16-23", or empty for all CPUs. If 'numa_node'
+// is not negative, then memory is allocated only from that NUMA node, and only
+// its CPUs are used.
+void SetPlacement(const std::string& cpus, int numa_node);
+#endif
+
 // Returns the current working directory of the specified process, or nullptr
 // if the directory is unknown.
 std::unique_ptr<blaze_util::Path> GetProcessCWD(int pid);
@@ -175,6 +190,11 @@ class BlazeServerStartup {
  public:
   virtual ~BlazeServerStartup() {}
   virtual bool IsStillAlive() = 0;
+  // Waits until the server may have become ready to accept connections, it
+  // may have died, or the timeout elapsed, whichever comes first. Where the
+  // platform cannot tell when the server gets ready, this only returns early
+  // when it dies.
+  virtual void WaitForReadiness(std::chrono::milliseconds timeout) = 0;
 };
 
 // Starts a daemon process with its standard output and standard error
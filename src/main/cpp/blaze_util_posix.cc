@@ -38,15 +38,23 @@
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include <algorithm>
 #include <cassert>
+#include <condition_variable>  // NOLINT
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <iterator>
 #include <map>
+#include <memory>
+#include <mutex>  // NOLINT
 #include <set>
 #include <string>
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
@@ -73,6 +81,8 @@ using std::vector;
 
 namespace embedded_binaries {
 
+// Writes the files on a pool of threads. Each file is preallocated where
+// the platform supports it, so that it does not grow write by write.
 class PosixDumper : public Dumper {
  public:
   static PosixDumper* Create(string* error);
@@ -82,53 +92,168 @@ class PosixDumper : public Dumper {
   bool Finish(string* error) override;
 
  private:
-  PosixDumper() : was_error_(false) {}
+  struct Job {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+    blaze_util::Path path;
+  };
+
+  // 8 threads, like the Windows implementation, are plenty for the few
+  // hundred files of the install base.
+  static constexpr int kThreads = 8;
+
+  PosixDumper() : finishing_(false) {}
 
+  void WorkerLoop();
+  void Write(const Job& job);
+  void SignalError(const string& msg);
+
+  std::vector<std::thread> workers_;
+
+  std::mutex queue_lock_;
+  std::condition_variable queued_;
+  std::deque<Job> queue_;
+  bool finishing_;
+
+  // Held while creating a directory, so that no file is written into it
+  // before it exists.
+  std::mutex dir_cache_lock_;
   set<blaze_util::Path> dir_cache_;
+
+  std::mutex error_lock_;
   string error_msg_;
-  bool was_error_;
 };
 
 Dumper* Create(string* error) { return PosixDumper::Create(error); }
 
-PosixDumper* PosixDumper::Create(string* error) { return new PosixDumper(); }
+PosixDumper* PosixDumper::Create(string* error) {
+  PosixDumper* result = new PosixDumper();
+  for (int i = 0; i < kThreads; ++i) {
+    result->workers_.emplace_back(&PosixDumper::WorkerLoop, result);
+  }
+  return result;
+}
 
 void PosixDumper::Dump(const void* data, const size_t size,
                        const blaze_util::Path& path) {
-  if (was_error_) {
-    return;
+  {
+    std::lock_guard<std::mutex> g(error_lock_);
+    if (!error_msg_.empty()) {
+      return;
+    }
   }
 
-  blaze_util::Path parent = path.GetParent();
-  // Performance optimization: memoize the paths we already created a
-  // directory for, to spare a stat in attempting to recreate an already
-  // existing directory.
-  if (dir_cache_.insert(parent).second) {
-    if (!blaze_util::MakeDirectories(parent, 0777)) {
-      was_error_ = true;
-      string msg = GetLastErrorString();
-      error_msg_ =
-          string("couldn't create '") + path.AsPrintablePath() + "': " + msg;
+  Job job;
+  job.data.reset(new uint8_t[size]);
+  memcpy(job.data.get(), data, size);
+  job.size = size;
+  job.path = path;
+  {
+    std::lock_guard<std::mutex> g(queue_lock_);
+    if (finishing_) {
+      return;
     }
+    queue_.push_back(std::move(job));
   }
+  queued_.notify_one();
+}
 
-  if (was_error_) {
-    return;
+void PosixDumper::WorkerLoop() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> g(queue_lock_);
+      queued_.wait(g, [this] { return finishing_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    Write(job);
+  }
+}
+
+void PosixDumper::Write(const Job& job) {
+  {
+    std::lock_guard<std::mutex> g(error_lock_);
+    if (!error_msg_.empty()) {
+      return;
+    }
+  }
+
+  blaze_util::Path parent = job.path.GetParent();
+  {
+    std::lock_guard<std::mutex> g(dir_cache_lock_);
+    // Performance optimization: memoize the paths we already created a
+    // directory for, to spare a stat in attempting to recreate an already
+    // existing directory.
+    if (dir_cache_.insert(parent).second &&
+        !blaze_util::MakeDirectories(parent, 0777)) {
+      string msg = GetLastErrorString();
+      SignalError(string("couldn't create '") + job.path.AsPrintablePath() +
+                  "': " + msg);
+      return;
+    }
   }
 
-  if (!blaze_util::WriteFile(data, size, path, 0755)) {
-    was_error_ = true;
+  const string path = job.path.AsNativePath();
+  unlink(path.c_str());  // We don't care about the success of this.
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0755);
+  bool ok = fd >= 0;
+#ifdef __linux__
+  if (ok && job.size > 0) {
+    // Best effort, the writes below allocate what this does not.
+    (void)posix_fallocate(fd, 0, job.size);
+  }
+#endif
+  const char* const data = reinterpret_cast<const char*>(job.data.get());
+  size_t written = 0;
+  while (ok && written < job.size) {
+    // write fails with EINVAL on MacOs for count > INT32_MAX.
+    ssize_t result = write(fd, data + written,
+                           std::min<size_t>(INT32_MAX, job.size - written));
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    ok = result >= 0;
+    written += ok ? result : 0;
+  }
+  if (!ok) {
     string msg = GetLastErrorString();
-    error_msg_ = string("Failed to write zipped file '") +
-                 path.AsPrintablePath() + "': " + msg;
+    SignalError(string("Failed to write zipped file '") +
+                job.path.AsPrintablePath() + "': " + msg);
+  }
+  if (fd >= 0 && close(fd) != 0 && ok) {  // Can fail on NFS.
+    string msg = GetLastErrorString();
+    SignalError(string("Failed to write zipped file '") +
+                job.path.AsPrintablePath() + "': " + msg);
+  }
+}
+
+void PosixDumper::SignalError(const string& msg) {
+  std::lock_guard<std::mutex> g(error_lock_);
+  if (error_msg_.empty()) {
+    error_msg_ = msg;
   }
 }
 
 bool PosixDumper::Finish(string* error) {
-  if (was_error_ && error) {
+  {
+    std::lock_guard<std::mutex> g(queue_lock_);
+    finishing_ = true;
+  }
+  queued_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+
+  std::lock_guard<std::mutex> g(error_lock_);
+  if (!error_msg_.empty() && error) {
     *error = error_msg_;
   }
-  return !was_error_;
+  return error_msg_.empty();
 }
 
 }  // namespace embedded_binaries
@@ -325,6 +450,7 @@ ATTRIBUTE_NORETURN static void ExecuteProgram(const blaze_util::Path& exe,
   // priority of Bazel on macOS from a QoS perspective, this could have
   // adverse scheduling effects on any tools invoked via ExecuteProgram.
   CharPP argv(args_vector);
+  blaze_util::FlushLogging();
   execv(exe.AsNativePath().c_str(), argv.get());
   string err = GetLastErrorString();
   BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
@@ -357,19 +483,50 @@ bool SymlinkDirectories(const blaze_util::Path& target,
 // Notifies the client about the death of the server process by keeping a socket
 // open in the server. If the server dies for any reason, the socket will be
 // closed, which can be detected by the client.
+// On Linux, it also learns when the server has written its info file, which
+// it does once it accepts connections, through an inotify descriptor.
 class SocketBlazeServerStartup : public BlazeServerStartup {
  public:
-  SocketBlazeServerStartup(int pipe_fd);
+  SocketBlazeServerStartup(int pipe_fd, int watch_fd);
   virtual ~SocketBlazeServerStartup();
   virtual bool IsStillAlive();
+  virtual void WaitForReadiness(std::chrono::milliseconds timeout);
 
  private:
   int fd;
+  // Watches the server directory, or -1.
+  int watch_fd;
 };
 
-SocketBlazeServerStartup::SocketBlazeServerStartup(int fd) : fd(fd) {}
+SocketBlazeServerStartup::SocketBlazeServerStartup(int fd, int watch_fd)
+    : fd(fd), watch_fd(watch_fd) {}
 
-SocketBlazeServerStartup::~SocketBlazeServerStartup() { close(fd); }
+SocketBlazeServerStartup::~SocketBlazeServerStartup() {
+  close(fd);
+  if (watch_fd >= 0) {
+    close(watch_fd);
+  }
+}
+
+void SocketBlazeServerStartup::WaitForReadiness(
+    std::chrono::milliseconds timeout) {
+  struct pollfd pfds[2];
+  pfds[0].fd = fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = watch_fd;
+  pfds[1].events = POLLIN;
+  const nfds_t nfds = watch_fd >= 0 ? 2 : 1;
+  int result;
+  do {
+    result = poll(pfds, nfds, timeout.count());
+  } while (result < 0 && errno == EINTR);
+  if (result > 0 && nfds == 2 && (pfds[1].revents & POLLIN)) {
+    // Drain the events, which file changed does not matter.
+    char events[4096];
+    while (read(watch_fd, events, sizeof(events)) > 0) {
+    }
+  }
+}
 
 bool SocketBlazeServerStartup::IsStillAlive() {
   struct pollfd pfd;
@@ -421,8 +578,6 @@ int ExecuteDaemon(
   }
   if (options.run_in_user_cgroup) {
     daemonize_args.push_back("-s");
-    daemonize_args.push_back(
-        server_dir.GetRelative("systemd-wrapper.sh").AsNativePath());
   }
 #endif
   daemonize_args.push_back("--");
@@ -430,6 +585,19 @@ int ExecuteDaemon(
   std::copy(args_vector.begin(), args_vector.end(),
             std::back_inserter(daemonize_args));
 
+  int watch_fd = -1;
+#ifdef __linux__
+  // The server renames its info file into place once it is listening. The
+  // watch is set up before the server starts so that the event is not missed.
+  watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch_fd >= 0 &&
+      inotify_add_watch(watch_fd, server_dir.AsNativePath().c_str(),
+                        IN_MOVED_TO) < 0) {
+    close(watch_fd);
+    watch_fd = -1;
+  }
+#endif
+
   int fds[2];
 
   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
@@ -497,7 +665,7 @@ int ExecuteDaemon(
 
   WriteSystemSpecificProcessIdentifier(server_dir, server_pid);
 
-  *server_startup = new SocketBlazeServerStartup(fds[0]);
+  *server_startup = new SocketBlazeServerStartup(fds[0], watch_fd);
   return server_pid;
 }
 
@@ -772,6 +940,30 @@ bool KillServerProcess(int pid, const blaze_util::Path& output_base) {
   return true;
 }
 
+void ReadAheadFiles(const vector<blaze_util::Path>& paths) {
+  for (const blaze_util::Path& path : paths) {
+    int fd = open(path.AsNativePath().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+#if defined(__APPLE__)
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      // The count is an int: ask for as much of a larger file as it allows.
+      struct radvisory advice = {};
+      advice.ra_offset = 0;
+      advice.ra_count = static_cast<int>(
+          std::min<off_t>(st.st_size, INT_MAX));
+      fcntl(fd, F_RDADVISE, &advice);
+    }
+#else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    // The reads go on once the file is closed.
+    close(fd);
+  }
+}
+
 void TrySleep(unsigned int milliseconds) {
   time_t seconds_part = (time_t)(milliseconds / 1000);
   long nanoseconds_part = ((long)(milliseconds % 1000)) * 1000 * 1000;
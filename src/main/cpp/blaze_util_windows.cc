@@ -625,6 +625,11 @@ class ProcessHandleBlazeServerStartup : public BlazeServerStartup {
            exit_time.dwHighDateTime == 0 && exit_time.dwLowDateTime == 0;
   }
 
+  void WaitForReadiness(std::chrono::milliseconds timeout) override {
+    // The process handle is signaled when the server exits.
+    WaitForSingleObject(proc, static_cast<DWORD>(timeout.count()));
+  }
+
  private:
   AutoHandle proc;
 };
@@ -876,6 +881,37 @@ bool KillServerProcess(int pid, const blaze_util::Path& output_base) {
   return result;
 }
 
+void ReadAheadFiles(const std::vector<blaze_util::Path>& paths) {
+  for (const blaze_util::Path& path : paths) {
+    AutoHandle file(::CreateFileW(
+        path.AsNativePath().c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!file.IsValid()) {
+      continue;
+    }
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+      continue;
+    }
+    AutoHandle mapping(
+        ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr));
+    if (!mapping.IsValid()) {
+      continue;
+    }
+    void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+      continue;
+    }
+    // This only queues the reads. The pages stay in the standby list of the
+    // file once the view is unmapped, for the server to find.
+    WIN32_MEMORY_RANGE_ENTRY range = {view,
+                                      static_cast<SIZE_T>(size.QuadPart)};
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+    ::UnmapViewOfFile(view);
+  }
+}
+
 void TrySleep(unsigned int milliseconds) { Sleep(milliseconds); }
 
 // Not supported.
@@ -0,0 +1,58 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/main/cpp/archive_utils.h"
+#include "src/main/cpp/info_cache.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/strings.h"
+
+namespace blaze {
+
+using std::string;
+using std::vector;
+
+bool AnswerInfoFromCache(const string &cache_content,
+                         const vector<string> &keys, string *output) {
+  if (keys.empty()) {
+    return false;
+  }
+
+  std::map<string, string> values;
+  for (const string &line : blaze_util::Split(cache_content, '\n')) {
+    string::size_type eq = line.find('=');
+    if (eq != string::npos) {
+      values[line.substr(0, eq)] = line.substr(eq + 1);
+    }
+  }
+
+  string result;
+  for (const string &key : keys) {
+    auto it = values.find(key);
+    if (it == values.end()) {
+      return false;
+    }
+    // Mirrors InfoCommand: a single key prints just its value.
+    if (keys.size() > 1) {
+      result += key + ": ";
+    }
+    result += it->second + "\n";
+  }
+  *output = result;
+  return true;
+}
+
+}  // namespace blaze
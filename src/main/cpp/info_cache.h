@@ -0,0 +1,35 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/main/cpp/archive_utils.h"
+#ifndef BAZEL_SRC_MAIN_CPP_INFO_CACHE_H_
+#define BAZEL_SRC_MAIN_CPP_INFO_CACHE_H_
+
+#include <string>
+#include <vector>
+
+namespace blaze {
+
+// Answers `info` for `keys` from the contents of <output_base>/server/info_cache,
+// which the server rewrites after every command with one "key=value" line for
+// each info key that only depends on the startup options. On success, sets
+// `output` to exactly what the server would have printed and returns true.
+// Returns false if `keys` is empty or any key isn't in the cache, in which case
+// the command has to go to the server.
+bool AnswerInfoFromCache(const std::string &cache_content,
+                         const std::vector<std::string> &keys,
+                         std::string *output);
+
+}  // namespace blaze
+
+#endif  // BAZEL_SRC_MAIN_CPP_INFO_CACHE_H_
@@ -23,6 +23,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
@@ -31,9 +32,11 @@
 #include "src/main/cpp/option_processor-internal.h"
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/md5.h"
 #include "src/main/cpp/util/path.h"
 #include "src/main/cpp/util/path_platform.h"
 #include "src/main/cpp/util/strings.h"
+#include "src/main/cpp/util/trace.h"
 #include "src/main/cpp/workspace_layout.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/str_cat.h"
@@ -250,10 +253,29 @@ std::set<std::string> GetOldRcPaths(
 // Returns the unique paths in their original form (not the canonical one).
 std::vector<std::string> DedupeBlazercPaths(
     const std::vector<std::string>& paths) {
+  // Canonicalizing a path also checks that it exists, which is slow on network
+  // file systems, so do all of them at once.
+  std::vector<std::string> canonical_forms(paths.size());
+  if (paths.size() > 1) {
+    std::vector<std::thread> threads;
+    threads.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+      threads.emplace_back([&paths, &canonical_forms, i] {
+        canonical_forms[i] = blaze_util::MakeCanonical(paths[i].c_str());
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  } else if (paths.size() == 1) {
+    canonical_forms[0] = blaze_util::MakeCanonical(paths[0].c_str());
+  }
+
   std::set<std::string> canonical_paths;
   std::vector<std::string> result;
-  for (const std::string& path : paths) {
-    const std::string canonical_path = blaze_util::MakeCanonical(path.c_str());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    const std::string& path = paths[i];
+    const std::string& canonical_path = canonical_forms[i];
     if (canonical_path.empty()) {
       // MakeCanonical returns an empty string when it fails. We ignore this
       // failure since blazerc paths may point to invalid locations.
@@ -358,6 +380,24 @@ std::vector<std::string> GetLostFiles(
 
 }  // namespace internal
 
+std::string OptionProcessor::GetRcFileCachePath(
+    const std::string& workspace,
+    const std::vector<std::string>& rc_files) const {
+  // The rc files are read before the startup options are known, so the cache
+  // lives in the default output user root whatever --output_user_root says.
+  blaze_util::Md5Digest digest;
+  digest.Update(workspace.data(), workspace.size() + 1);
+  for (const std::string& rc_file : rc_files) {
+    digest.Update(rc_file.data(), rc_file.size() + 1);
+  }
+  unsigned char md5[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(md5);
+  return startup_options_->GetDefaultOutputUserRoot()
+      .GetRelative("rc_cache")
+      .GetRelative(digest.String())
+      .AsNativePath();
+}
+
 // TODO(#4502) Consider simplifying result_rc_files to a vector of RcFiles, no
 // unique_ptrs.
 blaze_exit_code::ExitCode OptionProcessor::GetRcFiles(
@@ -431,16 +471,31 @@ blaze_exit_code::ExitCode OptionProcessor::GetRcFiles(
   // that don't point to real files.
   rc_files = internal::DedupeBlazercPaths(rc_files);
 
-  std::set<std::string> read_files_canonical_paths;
-  // Parse these potential files, in priority order;
-  for (const std::string& top_level_bazelrc_path : rc_files) {
-    std::unique_ptr<RcFile> parsed_rc;
-    blaze_exit_code::ExitCode parse_rcfile_exit_code = ParseRcFile(
-        workspace_layout, workspace, top_level_bazelrc_path, &parsed_rc, error);
-    if (parse_rcfile_exit_code != blaze_exit_code::SUCCESS) {
-      return parse_rcfile_exit_code;
+  // Unless the rc files or what they import have changed, the result of
+  // parsing them is in the cache since the previous invocation.
+  const std::string cache_path = GetRcFileCachePath(workspace, rc_files);
+  std::vector<std::unique_ptr<RcFile>> parsed_rcs;
+  if (RcFile::ReadCache(cache_path, &parsed_rcs) &&
+      parsed_rcs.size() == rc_files.size()) {
+    BAZEL_LOG(INFO) << "Using the parsed rc files from " << cache_path;
+  } else {
+    parsed_rcs.clear();
+    // Parse these potential files, in priority order;
+    for (const std::string& top_level_bazelrc_path : rc_files) {
+      std::unique_ptr<RcFile> parsed_rc;
+      blaze_exit_code::ExitCode parse_rcfile_exit_code =
+          ParseRcFile(workspace_layout, workspace, top_level_bazelrc_path,
+                      &parsed_rc, error);
+      if (parse_rcfile_exit_code != blaze_exit_code::SUCCESS) {
+        return parse_rcfile_exit_code;
+      }
+      parsed_rcs.push_back(std::move(parsed_rc));
     }
+    RcFile::WriteCache(cache_path, parsed_rcs);
+  }
 
+  std::set<std::string> read_files_canonical_paths;
+  for (auto& parsed_rc : parsed_rcs) {
     // Check that none of the rc files loaded this time are duplicate.
     const auto& sources = parsed_rc->canonical_source_paths();
     internal::WarnAboutDuplicateRcFiles(read_files_canonical_paths, sources);
@@ -510,6 +565,7 @@ blaze_exit_code::ExitCode OptionProcessor::ParseOptions(
   std::vector<std::unique_ptr<RcFile>> rc_files;
   if (!SearchNullaryOption(cmd_line_->startup_args, "ignore_all_rc_files",
                            false)) {
+    blaze_util::TraceSpan span("Read rc files");
     const blaze_exit_code::ExitCode rc_parsing_exit_code = GetRcFiles(
         workspace_layout_, workspace, cwd, cmd_line_.get(), &rc_files, error);
     if (rc_parsing_exit_code != blaze_exit_code::SUCCESS) {
@@ -682,10 +738,15 @@ std::vector<std::string> OptionProcessor::GetCommandArguments() const {
     return {};
   }
 
+  return GetCommandArguments(cmd_line_->command_args);
+}
+
+std::vector<std::string> OptionProcessor::GetCommandArguments(
+    const std::vector<std::string>& explicit_command_args) const {
+  assert(parse_options_called_);
   std::vector<std::string> command_args = blazerc_and_env_command_args_;
-  command_args.insert(command_args.end(),
-                      cmd_line_->command_args.begin(),
-                      cmd_line_->command_args.end());
+  command_args.insert(command_args.end(), explicit_command_args.begin(),
+                      explicit_command_args.end());
   return command_args;
 }
 
@@ -111,6 +111,12 @@ class OptionProcessor {
   // executed in.
   std::vector<std::string> GetCommandArguments() const;
 
+  // Gets the arguments to send to the server for a command whose explicit
+  // arguments are `explicit_command_args`, as GetCommandArguments does for the
+  // command line. Used for the commands read from --command_file.
+  std::vector<std::string> GetCommandArguments(
+      const std::vector<std::string>& explicit_command_args) const;
+
   // Gets the arguments explicitly provided by the user's command line.
   std::vector<std::string> GetExplicitCommandArguments() const;
 
@@ -152,6 +158,12 @@ class OptionProcessor {
       std::string* error) const;
 
  private:
+  // Returns the file caching the result of parsing the given top level rc
+  // files for the workspace.
+  std::string GetRcFileCachePath(
+      const std::string& workspace,
+      const std::vector<std::string>& rc_files) const;
+
   blaze_exit_code::ExitCode ParseStartupOptions(
       const std::vector<RcFile*>& rc_files, std::string* error);
 
@@ -17,18 +17,24 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
 #include "src/main/cpp/blaze_util_platform.h"
+#include "src/main/cpp/util/errors.h"
+#include "src/main/cpp/util/file.h"
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/logging.h"
+#include "src/main/cpp/util/path.h"
+#include "src/main/cpp/util/path_platform.h"
 #include "src/main/cpp/util/strings.h"
 #include "src/main/cpp/workspace_layout.h"
 #include "absl/algorithm/container.h"
 #include "absl/functional/function_ref.h"
 #include "absl/memory/memory.h"
 #include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_split.h"
@@ -40,15 +46,22 @@ namespace blaze {
 static constexpr absl::string_view kCommandImport = "import";
 static constexpr absl::string_view kCommandTryImport = "try-import";
 
+// Bump this whenever the cache format or the parsing changes.
+static constexpr absl::string_view kCacheVersion = "rc-cache-1";
+// Files modified more recently than this are not cached, because their
+// fingerprint may not change if they are modified again.
+static constexpr int kMinCachedFileAgeSeconds = 2;
+
 /*static*/ std::unique_ptr<RcFile> RcFile::Parse(
     const std::string& filename, const WorkspaceLayout* workspace_layout,
     const std::string& workspace, ParseError* error, std::string* error_text,
     ReadFileFn read_file, CanonicalizePathFn canonicalize_path) {
   auto rcfile = absl::WrapUnique(new RcFile());
   std::vector<std::string> initial_import_stack = {filename};
+  PrefetchedFiles prefetched;
   *error = rcfile->ParseFile(filename, workspace, *workspace_layout, read_file,
                              canonicalize_path, initial_import_stack,
-                             error_text);
+                             &prefetched, error_text);
   return (*error == ParseError::NONE) ? std::move(rcfile) : nullptr;
 }
 
@@ -58,14 +71,28 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
                                      ReadFileFn read_file,
                                      CanonicalizePathFn canonicalize_path,
                                      std::vector<std::string>& import_stack,
+                                     PrefetchedFiles* prefetched,
                                      std::string* error_text) {
   BAZEL_LOG(INFO) << "Parsing the RcFile " << filename;
-  std::string contents;
-  if (std::string error_msg; !read_file(filename, &contents, &error_msg)) {
-    *error_text = absl::StrFormat(
-        "Unexpected error reading config file '%s': %s", filename, error_msg);
+  PrefetchedFile file;
+  if (auto it = prefetched->find(filename); it != prefetched->end()) {
+    file = std::move(it->second);
+    prefetched->erase(it);
+  } else {
+    // Take the fingerprint first, so that a change while reading the file is
+    // noticed next time.
+    file.fingerprint =
+        blaze_util::GetFileFingerprint(blaze_util::Path(filename));
+    file.ok = read_file(filename, &file.contents, &file.error_msg);
+  }
+  dependencies_.emplace_back(filename, std::move(file.fingerprint));
+  if (!file.ok) {
+    *error_text =
+        absl::StrFormat("Unexpected error reading config file '%s': %s",
+                        filename, file.error_msg);
     return ParseError::UNREADABLE_FILE;
   }
+  std::string& contents = file.contents;
   const std::string canonical_filename = canonicalize_path(filename);
 
   int rcfile_index = canonical_rcfile_paths_.size();
@@ -76,22 +103,51 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
   blaze_util::Replace("\\\n", "", &contents);
 
   std::vector<std::string> lines = absl::StrSplit(contents, '\n');
-  for (std::string& line : lines) {
-    blaze_util::StripWhitespace(&line);
+  std::vector<std::vector<std::string>> lines_words(lines.size());
+  // The imports are read in parallel before any of them is parsed, as reading
+  // them one after the other is slow on network file systems.
+  std::vector<std::string> imports;
+  for (size_t i = 0; i < lines.size(); ++i) {
+    blaze_util::StripWhitespace(&lines[i]);
 
     // Check for an empty line.
-    if (line.empty()) continue;
-
-    std::vector<std::string> words;
+    if (lines[i].empty()) continue;
 
     // This will treat "#" as a comment, and properly
     // quote single and double quotes, and treat '\'
     // as an escape character.
     // TODO(bazel-team): This function silently ignores
     // dangling backslash escapes and missing end-quotes.
-    blaze_util::Tokenize(line, '#', &words);
+    std::vector<std::string>& words = lines_words[i];
+    blaze_util::Tokenize(lines[i], '#', &words);
+    if (words.size() != 2 ||
+        (words[0] != kCommandImport && words[0] != kCommandTryImport)) {
+      continue;
+    }
 
-    // Could happen if line starts with "#"
+    // Resolve the workspace prefix here, so that the file is only looked up
+    // once. A path that still has the prefix below couldn't be resolved.
+    std::string& import_filename = words[1];
+    if (absl::StartsWith(import_filename, WorkspaceLayout::kWorkspacePrefix)) {
+      const auto resolved_filename =
+          workspace_layout.ResolveWorkspaceRelativeRcFilePath(workspace,
+                                                              import_filename);
+      if (!resolved_filename.has_value()) continue;
+      import_filename = resolved_filename.value();
+    }
+    if (!absl::c_linear_search(import_stack, import_filename)) {
+      imports.push_back(import_filename);
+    }
+  }
+  if (imports.size() > 1) {
+    PrefetchFiles(imports, read_file, prefetched);
+  }
+
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const std::string& line = lines[i];
+    std::vector<std::string>& words = lines_words[i];
+
+    // Could happen if line is empty or starts with "#"
     if (words.empty()) continue;
 
     const absl::string_view command = words[0];
@@ -109,27 +165,26 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
       return ParseError::INVALID_FORMAT;
     }
 
-    std::string& import_filename = words[1];
+    const std::string& import_filename = words[1];
     if (absl::StartsWith(import_filename, WorkspaceLayout::kWorkspacePrefix)) {
-      const auto resolved_filename =
-          workspace_layout.ResolveWorkspaceRelativeRcFilePath(workspace,
-                                                              import_filename);
-      if (!resolved_filename.has_value()) {
-        if (command == kCommandImport) {
-          *error_text = absl::StrFormat(
-              "Nonexistent path in import declaration in config file '%s': '%s'"
-              " (are you in your source checkout/WORKSPACE?)",
-              canonical_filename, line);
-          return ParseError::INVALID_FORMAT;
-        }
-        // For try-import, we ignore it if we couldn't find a file.
-        BAZEL_LOG(INFO) << "Skipped optional import of " << import_filename
-                        << ", the specified rc file either does not exist or"
-                        << "is not readable.";
-        continue;
+      // Record the file as missing so that creating it invalidates the
+      // cache.
+      std::string relative_path =
+          import_filename.substr(WorkspaceLayout::kWorkspacePrefixLength);
+      dependencies_.emplace_back(
+          blaze_util::JoinPath(workspace, relative_path), "");
+      if (command == kCommandImport) {
+        *error_text = absl::StrFormat(
+            "Nonexistent path in import declaration in config file '%s': '%s'"
+            " (are you in your source checkout/WORKSPACE?)",
+            canonical_filename, line);
+        return ParseError::INVALID_FORMAT;
       }
-
-      import_filename = resolved_filename.value();
+      // For try-import, we ignore it if we couldn't find a file.
+      BAZEL_LOG(INFO) << "Skipped optional import of " << import_filename
+                      << ", the specified rc file either does not exist or"
+                      << "is not readable.";
+      continue;
     }
 
     if (absl::c_linear_search(import_stack, import_filename)) {
@@ -145,7 +200,7 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
     import_stack.push_back(import_filename);
     if (ParseError parse_error =
             ParseFile(import_filename, workspace, workspace_layout, read_file,
-                      canonicalize_path, import_stack, error_text);
+                      canonicalize_path, import_stack, prefetched, error_text);
         parse_error != ParseError::NONE) {
       if (parse_error == ParseError::UNREADABLE_FILE &&
           command == kCommandTryImport) {
@@ -167,6 +222,34 @@ RcFile::ParseError RcFile::ParseFile(const std::string& filename,
   return ParseError::NONE;
 }
 
+/*static*/ void RcFile::PrefetchFiles(const std::vector<std::string>& filenames,
+                                      ReadFileFn read_file,
+                                      PrefetchedFiles* prefetched) {
+  // Insert all entries before starting the threads, as inserting into the
+  // map may move its elements.
+  std::vector<std::string> to_read;
+  for (const std::string& filename : filenames) {
+    if (prefetched->try_emplace(filename).second) {
+      to_read.push_back(filename);
+    }
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(to_read.size());
+  for (const std::string& filename : to_read) {
+    PrefetchedFile* file = &(*prefetched)[filename];
+    threads.emplace_back([&filename, file, read_file] {
+      // Take the fingerprint first, so that a change while reading the file
+      // is noticed next time.
+      file->fingerprint =
+          blaze_util::GetFileFingerprint(blaze_util::Path(filename));
+      file->ok = read_file(filename, &file->contents, &file->error_msg);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
 bool RcFile::ReadFileDefault(const std::string& filename, std::string* contents,
                              std::string* error_msg) {
   return blaze_util::ReadFile(filename, contents, error_msg);
@@ -176,4 +259,166 @@ std::string RcFile::CanonicalizePathDefault(const std::string& filename) {
   return blaze_util::MakeCanonical(filename.c_str());
 }
 
+bool RcFile::IsUpToDate() const {
+  for (const auto& [path, fingerprint] : dependencies_) {
+    if (blaze_util::GetFileFingerprint(blaze_util::Path(path)) != fingerprint) {
+      BAZEL_LOG(INFO) << "The rc file " << path << " has changed";
+      return false;
+    }
+  }
+  return true;
+}
+
+// The cache is a sequence of length-prefixed fields, "<length>:<value>".
+static void AppendField(absl::string_view value, std::string* output) {
+  absl::StrAppend(output, value.size(), ":", value);
+}
+
+static bool ConsumeField(absl::string_view* input, absl::string_view* value) {
+  size_t colon = input->find(':');
+  size_t length;
+  if (colon == absl::string_view::npos ||
+      !absl::SimpleAtoi(input->substr(0, colon), &length) ||
+      length > input->size() - colon - 1) {
+    return false;
+  }
+  *value = input->substr(colon + 1, length);
+  input->remove_prefix(colon + 1 + length);
+  return true;
+}
+
+static bool ConsumeField(absl::string_view* input, std::string* value) {
+  absl::string_view field;
+  if (!ConsumeField(input, &field)) {
+    return false;
+  }
+  *value = std::string(field);
+  return true;
+}
+
+static bool ConsumeField(absl::string_view* input, size_t* value) {
+  absl::string_view field;
+  return ConsumeField(input, &field) && absl::SimpleAtoi(field, value);
+}
+
+void RcFile::Serialize(std::string* output) const {
+  AppendField(absl::StrCat(canonical_rcfile_paths_.size()), output);
+  for (const std::string& path : canonical_rcfile_paths_) {
+    AppendField(path, output);
+  }
+  AppendField(absl::StrCat(options_.size()), output);
+  for (const auto& [command, options] : options_) {
+    AppendField(command, output);
+    AppendField(absl::StrCat(options.size()), output);
+    for (const RcOption& option : options) {
+      AppendField(option.option, output);
+      AppendField(absl::StrCat(option.source_index), output);
+    }
+  }
+  AppendField(absl::StrCat(dependencies_.size()), output);
+  for (const auto& [path, fingerprint] : dependencies_) {
+    AppendField(path, output);
+    AppendField(fingerprint, output);
+  }
+}
+
+/*static*/ std::unique_ptr<RcFile> RcFile::Deserialize(
+    absl::string_view* input) {
+  auto rcfile = absl::WrapUnique(new RcFile());
+  size_t count;
+  if (!ConsumeField(input, &count)) {
+    return nullptr;
+  }
+  rcfile->canonical_rcfile_paths_.resize(count);
+  for (std::string& path : rcfile->canonical_rcfile_paths_) {
+    if (!ConsumeField(input, &path)) {
+      return nullptr;
+    }
+  }
+  if (!ConsumeField(input, &count)) {
+    return nullptr;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    std::string command;
+    size_t option_count;
+    if (!ConsumeField(input, &command) ||
+        !ConsumeField(input, &option_count)) {
+      return nullptr;
+    }
+    std::vector<RcOption>& options = rcfile->options_[command];
+    options.resize(option_count);
+    for (RcOption& option : options) {
+      size_t source_index;
+      if (!ConsumeField(input, &option.option) ||
+          !ConsumeField(input, &source_index) ||
+          source_index >= rcfile->canonical_rcfile_paths_.size()) {
+        return nullptr;
+      }
+      option.source_index = source_index;
+    }
+  }
+  if (!ConsumeField(input, &count)) {
+    return nullptr;
+  }
+  rcfile->dependencies_.resize(count);
+  for (auto& [path, fingerprint] : rcfile->dependencies_) {
+    if (!ConsumeField(input, &path) || !ConsumeField(input, &fingerprint)) {
+      return nullptr;
+    }
+  }
+  return rcfile;
+}
+
+/*static*/ void RcFile::WriteCache(
+    const std::string& cache_path,
+    const std::vector<std::unique_ptr<RcFile>>& rc_files) {
+  std::string contents;
+  AppendField(kCacheVersion, &contents);
+  AppendField(absl::StrCat(rc_files.size()), &contents);
+  for (const auto& rc_file : rc_files) {
+    for (const auto& [path, fingerprint] : rc_file->dependencies_) {
+      if (!fingerprint.empty() &&
+          blaze_util::IsRecentlyModified(blaze_util::Path(path),
+                                         kMinCachedFileAgeSeconds)) {
+        return;
+      }
+    }
+    rc_file->Serialize(&contents);
+  }
+  if (!blaze_util::MakeDirectories(blaze_util::Dirname(cache_path), 0755) ||
+      !blaze_util::WriteFile(contents, cache_path)) {
+    BAZEL_LOG(INFO) << "Could not write the rc file cache " << cache_path
+                    << ": " << blaze_util::GetLastErrorString();
+  }
+}
+
+/*static*/ bool RcFile::ReadCache(
+    const std::string& cache_path,
+    std::vector<std::unique_ptr<RcFile>>* rc_files) {
+  std::string contents;
+  if (!blaze_util::ReadFile(cache_path, &contents)) {
+    return false;
+  }
+  absl::string_view input = contents;
+  absl::string_view version;
+  size_t count;
+  if (!ConsumeField(&input, &version) || version != kCacheVersion ||
+      !ConsumeField(&input, &count)) {
+    return false;
+  }
+  std::vector<std::unique_ptr<RcFile>> result;
+  for (size_t i = 0; i < count; ++i) {
+    std::unique_ptr<RcFile> rc_file = Deserialize(&input);
+    if (rc_file == nullptr || !rc_file->IsUpToDate()) {
+      return false;
+    }
+    result.push_back(std::move(rc_file));
+  }
+  if (!input.empty()) {
+    return false;
+  }
+  *rc_files = std::move(result);
+  return true;
+}
+
 }  // namespace blaze
@@ -16,11 +16,13 @@
 
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "src/main/cpp/workspace_layout.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
 
 namespace blaze {
 
@@ -36,7 +38,8 @@ struct RcOption {
 class RcFile {
  public:
   // Constructs a parsed rc file object, or returns a nullptr and sets the
-  // error and error text on failure.
+  // error and error text on failure. The imports of a file are read in
+  // parallel, so `read_file` may be called from several threads at once.
   using ReadFileFn =
       absl::FunctionRef<bool(const std::string&, std::string*, std::string*)>;
   using CanonicalizePathFn = absl::FunctionRef<std::string(const std::string&)>;
@@ -62,9 +65,39 @@ class RcFile {
   using OptionMap = absl::flat_hash_map<std::string, std::vector<RcOption>>;
   const OptionMap& options() const { return options_; }
 
+  // The files looked at while parsing, with their fingerprints from
+  // blaze_util::GetFileFingerprint, which are empty for the files that were
+  // missing.
+  using Dependencies = std::vector<std::pair<std::string, std::string>>;
+  const Dependencies& dependencies() const { return dependencies_; }
+
+  // Returns true if none of the dependencies has changed since parsing.
+  bool IsUpToDate() const;
+
+  // Writes the parsed rc files into `cache_path`, so that ReadCache can return
+  // them as long as they are up to date. Does nothing if a dependency has been
+  // modified so recently that a change may go unnoticed. Failures are ignored,
+  // as the cache is only an optimization.
+  static void WriteCache(const std::string& cache_path,
+                         const std::vector<std::unique_ptr<RcFile>>& rc_files);
+
+  // Reads the parsed rc files from `cache_path`. Returns false if there is no
+  // cache, or if it is out of date.
+  static bool ReadCache(const std::string& cache_path,
+                        std::vector<std::unique_ptr<RcFile>>* rc_files);
+
  private:
   RcFile() = default;
 
+  // A file read ahead of parsing it, keyed by its name.
+  struct PrefetchedFile {
+    std::string fingerprint;
+    bool ok = false;
+    std::string contents;
+    std::string error_msg;
+  };
+  using PrefetchedFiles = absl::flat_hash_map<std::string, PrefetchedFile>;
+
   // Recursive call to parse a file and its imports.
   ParseError ParseFile(const std::string& filename,
                        const std::string& workspace,
@@ -72,18 +105,26 @@ class RcFile {
                        ReadFileFn read_file,
                        CanonicalizePathFn canonicalize_path,
                        std::vector<std::string>& import_stack,
-                       std::string* error_text);
+                       PrefetchedFiles* prefetched, std::string* error_text);
+
+  // Reads the files that aren't in `prefetched` yet on one thread each.
+  static void PrefetchFiles(const std::vector<std::string>& filenames,
+                            ReadFileFn read_file, PrefetchedFiles* prefetched);
 
   static bool ReadFileDefault(const std::string& filename,
                               std::string* contents, std::string* error_msg);
   static std::string CanonicalizePathDefault(const std::string& filename);
 
+  void Serialize(std::string* output) const;
+  static std::unique_ptr<RcFile> Deserialize(absl::string_view* input);
+
   // Full closure of rcfile paths imported from this file (including itself).
   // These are all canonical paths, created with blaze_util::MakeCanonical.
   // This also means all of these paths should exist.
   std::vector<std::string> canonical_rcfile_paths_;
   // All options parsed from the file.
   OptionMap options_;
+  Dependencies dependencies_;
 };
 
 }  // namespace blaze
@@ -76,12 +76,15 @@ StartupOptions::StartupOptions(const string &product_name,
       batch_cpu_scheduling(false),
       io_nice_level(-1),
       shutdown_on_low_sys_mem(false),
+      server_class_data_sharing(true),
+      server_aot_cache(false),
       oom_more_eagerly(false),
       oom_more_eagerly_threshold(100),
       write_command_log(true),
       watchfs(false),
       fatal_event_bus_exceptions(false),
       command_port(0),
+      command_server_unix_socket(false),
       connect_timeout_secs(30),
       local_startup_timeout_secs(120),
       have_invocation_policy_(false),
@@ -100,6 +103,9 @@ StartupOptions::StartupOptions(const string &product_name,
 #ifdef __linux__
       cgroup_parent(),
       run_in_user_cgroup(false),
+      server_cpus(),
+      server_numa_node(-1),
+      server_transparent_huge_pages(false),
 #endif
       windows_enable_symlinks(false) {
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -121,6 +127,8 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterNullaryStartupFlag("block_for_lock", &block_for_lock);
   RegisterNullaryStartupFlag("quiet", &quiet);
   RegisterNullaryStartupFlag("client_debug", &client_debug);
+  RegisterNullaryStartupFlag("experimental_command_server_unix_socket",
+                             &command_server_unix_socket);
   RegisterNullaryStartupFlag("preemptible", &preemptible);
   RegisterNullaryStartupFlag("fatal_event_bus_exceptions",
                              &fatal_event_bus_exceptions);
@@ -130,6 +138,10 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterNullaryStartupFlag("idle_server_tasks", &idle_server_tasks);
   RegisterNullaryStartupFlag("shutdown_on_low_sys_mem",
                              &shutdown_on_low_sys_mem);
+  RegisterNullaryStartupFlag("server_class_data_sharing",
+                             &server_class_data_sharing);
+  RegisterNullaryStartupFlag("experimental_server_aot_cache",
+                             &server_aot_cache);
   RegisterNullaryStartupFlagNoRc("ignore_all_rc_files", &ignore_all_rc_files);
   RegisterNullaryStartupFlag("unlimit_coredumps", &unlimit_coredumps);
   RegisterNullaryStartupFlag("watchfs", &watchfs);
@@ -139,12 +151,15 @@ StartupOptions::StartupOptions(const string &product_name,
 #ifdef __linux__
   RegisterNullaryStartupFlag("experimental_run_in_user_cgroup",
                              &run_in_user_cgroup);
+  RegisterNullaryStartupFlag("experimental_server_transparent_huge_pages",
+                             &server_transparent_huge_pages);
 #endif
   RegisterUnaryStartupFlag("command_port");
   RegisterUnaryStartupFlag("connect_timeout_secs");
   RegisterUnaryStartupFlag("local_startup_timeout_secs");
   RegisterUnaryStartupFlag("digest_function");
   RegisterUnaryStartupFlag("unix_digest_hash_attribute_name");
+  RegisterUnaryStartupFlag("experimental_unix_digest_cache_attribute_name");
   RegisterUnaryStartupFlag("server_javabase");
   RegisterUnaryStartupFlag("host_jvm_args");
   RegisterUnaryStartupFlag("host_jvm_profile");
@@ -157,7 +172,11 @@ StartupOptions::StartupOptions(const string &product_name,
   RegisterUnaryStartupFlag("output_user_root");
   RegisterUnaryStartupFlag("server_jvm_out");
   RegisterUnaryStartupFlag("failure_detail_out");
+  RegisterUnaryStartupFlag("client_trace");
+  RegisterUnaryStartupFlag("command_file");
   RegisterUnaryStartupFlag("experimental_cgroup_parent");
+  RegisterUnaryStartupFlag("experimental_server_cpus");
+  RegisterUnaryStartupFlag("experimental_server_numa_node");
 }
 
 StartupOptions::~StartupOptions() {}
@@ -270,6 +289,16 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(const string &argstr,
              nullptr) {
     failure_detail_out = blaze_util::Path(blaze::AbsolutePathFromFlag(value));
     option_sources["failure_detail_out"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg, "--client_trace")) !=
+             nullptr) {
+    client_trace = blaze_util::Path(blaze::AbsolutePathFromFlag(value));
+    option_sources["client_trace"] = rcfile;
+  } else if ((value = GetUnaryOption(arg, next_arg, "--command_file")) !=
+             nullptr) {
+    command_file = strcmp(value, "-") == 0
+                       ? value
+                       : blaze::AbsolutePathFromFlag(value);
+    option_sources["command_file"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg, "--server_javabase")) !=
              nullptr) {
     // TODO(bazel-team): Consider examining the javabase and re-execing in case
@@ -352,6 +381,12 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(const string &argstr,
              nullptr) {
     unix_digest_hash_attribute_name = value;
     option_sources["unix_digest_hash_attribute_name"] = rcfile;
+  } else if ((value = GetUnaryOption(
+                  arg, next_arg,
+                  "--experimental_unix_digest_cache_attribute_name")) !=
+             nullptr) {
+    experimental_unix_digest_cache_attribute_name = value;
+    option_sources["experimental_unix_digest_cache_attribute_name"] = rcfile;
   } else if ((value = GetUnaryOption(arg, next_arg, "--command_port")) !=
              nullptr) {
     if (!blaze_util::safe_strto32(value, &command_port) || command_port < 0 ||
@@ -380,6 +415,27 @@ blaze_exit_code::ExitCode StartupOptions::ProcessArg(const string &argstr,
 #ifdef __linux__
     cgroup_parent = value;
     option_sources["cgroup_parent"] = rcfile;
+#endif
+  } else if ((value = GetUnaryOption(arg, next_arg,
+                                     "--experimental_server_cpus")) != nullptr) {
+#ifdef __linux__
+    server_cpus = value;
+    option_sources["server_cpus"] = rcfile;
+#endif
+  } else if ((value = GetUnaryOption(
+                  arg, next_arg, "--experimental_server_numa_node")) !=
+             nullptr) {
+#ifdef __linux__
+    if (!blaze_util::safe_strto32(value, &server_numa_node) ||
+        server_numa_node < -1) {
+      blaze_util::StringPrintf(error,
+                               "Invalid argument to "
+                               "--experimental_server_numa_node: '%s'. Must "
+                               "be a NUMA node number, or -1 for none.",
+                               value);
+      return blaze_exit_code::BAD_ARGV;
+    }
+    option_sources["server_numa_node"] = rcfile;
 #endif
   } else {
     bool extra_argument_processed;
@@ -641,20 +697,24 @@ blaze_exit_code::ExitCode StartupOptions::AddJVMMemoryArguments(
   return blaze_exit_code::SUCCESS;
 }
 
+blaze_util::Path StartupOptions::GetDefaultOutputUserRoot() const {
+  // The default production output_user_root is
+  // <default_output_root>/_<product_name>_<username>.
+  // In a test, use a subdirectory of TEST_TMPDIR to be hermetic.
+  blaze_util::Path output_root =
+      blaze::IsRunningWithinTest()
+          ? blaze_util::Path(blaze::GetPathEnv("TEST_TMPDIR"))
+          : GetDefaultOutputRoot();
+
+  return output_root.GetRelative("_" + GetLowercaseProductName() + "_" +
+                                 GetUserName());
+}
+
 void StartupOptions::UpdateConfiguration(const string &install_md5,
                                          const string &workspace,
                                          const bool server_mode) {
   if (output_user_root.IsEmpty()) {
-    // The default production output_user_root is
-    // <default_output_root>/_<product_name>_<username>.
-    // In a test, use a subdirectory of TEST_TMPDIR to be hermetic.
-    blaze_util::Path output_root =
-        blaze::IsRunningWithinTest()
-            ? blaze_util::Path(blaze::GetPathEnv("TEST_TMPDIR"))
-            : GetDefaultOutputRoot();
-
-    output_user_root = output_root.GetRelative("_" + GetLowercaseProductName() +
-                                               "_" + GetUserName());
+    output_user_root = GetDefaultOutputUserRoot();
   }
 
   if (install_base.IsEmpty()) {
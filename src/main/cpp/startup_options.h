@@ -124,6 +124,9 @@ class StartupOptions {
 
   std::string GetLowercaseProductName() const;
 
+  // Returns the output user root used unless --output_user_root is given.
+  blaze_util::Path GetDefaultOutputUserRoot() const;
+
   // The capitalized name of this binary.
   const std::string product_name;
 
@@ -135,6 +138,14 @@ class StartupOptions {
   // Otherwise a default path in the output base is used.
   blaze_util::Path failure_detail_out;
 
+  // If supplied, the location to write a Chrome trace of the client's work.
+  blaze_util::Path client_trace;
+
+  // If supplied, a file with one command line per line, or "-" for stdin.
+  // The commands are run one after the other over a single connection to the
+  // server instead of the command given on the command line.
+  std::string command_file;
+
   // A directory suitable for storing cached files.
   // This contains the default locations of the install and output bases, as
   // well as the repository cache.
@@ -187,6 +198,15 @@ class StartupOptions {
 
   bool shutdown_on_low_sys_mem;
 
+  // Whether the server JVM maps and maintains a class data sharing archive
+  // next to the install base.
+  bool server_class_data_sharing;
+
+  // Whether the server JVM starts from, or else records, an ahead-of-time
+  // cache next to the install base. Takes precedence over
+  // server_class_data_sharing.
+  bool server_aot_cache;
+
   bool oom_more_eagerly;
 
   int oom_more_eagerly_threshold;
@@ -239,6 +259,10 @@ class StartupOptions {
   // Port to start up the gRPC command server on. If 0, let the kernel choose.
   int command_port;
 
+  // Whether the gRPC command server listens on a unix domain socket in the
+  // server directory instead of a port on localhost, where supported.
+  bool command_server_unix_socket;
+
   // Connection timeout for each gRPC connection attempt.
   int connect_timeout_secs;
 
@@ -268,6 +292,10 @@ class StartupOptions {
 
   std::string unix_digest_hash_attribute_name;
 
+  // The extended attribute in which the server remembers the digests it
+  // computes.
+  std::string experimental_unix_digest_cache_attribute_name;
+
   bool idle_server_tasks;
 
   // The startup options as received from the user and rc files, tagged with
@@ -285,9 +313,20 @@ class StartupOptions {
 #ifdef __linux__
   std::string cgroup_parent;
 
-  // If enabled, the Bazel server will be run with systemd-run, and the user
-  // will own the cgroup.
+  // If enabled, the Bazel server will be run in a transient systemd scope, and
+  // the user will own the cgroup.
   bool run_in_user_cgroup;
+
+  // The CPUs the server may run on, as a list like "0-7,16-23". Empty means
+  // no restriction.
+  std::string server_cpus;
+
+  // If not negative, the NUMA node whose memory and CPUs the server is bound
+  // to.
+  int server_numa_node;
+
+  // Whether the server JVM should back its heap with transparent huge pages.
+  bool server_transparent_huge_pages;
 #endif
 
   // Whether to create symbolic links on Windows for files. Requires
@@ -15,38 +15,31 @@
 #include "src/main/cpp/util/bazel_log_handler.h"
 
 #include <chrono>  // NOLINT -- for windows portability
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
+#include <mutex>  // NOLINT -- for windows portability
 #include <sstream>
 #include <string>
+#include <thread>  // NOLINT -- for windows portability
 #include <utility>
 
 #include "src/main/cpp/util/logging.h"
 
 namespace blaze_util {
 
-BazelLogHandler::BazelLogHandler()
-    : debug_stream_(nullptr),
+BazelLogHandler::BazelLogHandler(size_t max_buffered_bytes)
+    : max_buffered_bytes_(max_buffered_bytes),
+      debug_stream_(nullptr),
       debug_stream_set_(false),
       detail_(LOGGINGDETAIL_DEBUG),
-      debug_buffer_stream_(new std::stringstream()) {}
-
-BazelLogHandler::~BazelLogHandler() {
-  if (detail_ == LOGGINGDETAIL_DEBUG) {
-    // If SetLoggingOutputStream was never called, dump the buffer to stderr,
-    // otherwise, flush the stream.
-    if (debug_stream_ != nullptr) {
-      debug_stream_->flush();
-    } else if (debug_buffer_stream_ != nullptr) {
-      std::cerr << debug_buffer_stream_->rdbuf();
-    } else {
-      std::cerr << "Illegal state - neither a logfile nor a logbuffer "
-                << "existed at program end." << '\n';
-    }
-  }
-}
+      debug_buffer_bytes_(0),
+      dropped_(0),
+      writing_(false),
+      stop_writer_(false) {}
 
 // Messages intended for the user (level USER, along with WARNINGs an ERRORs)
 // should be printed even if debug level logging was not requested.
@@ -89,6 +82,42 @@ void PrintDebugLevelMessageToStream(std::ostream* stream,
             << filename << ":" << line << "] " << message << '\n';
 }
 
+static std::string FormatDebugLevelMessage(const std::string& filename,
+                                           int line, LogLevel level,
+                                           const std::string& message) {
+  std::ostringstream result;
+  PrintDebugLevelMessageToStream(&result, filename, line, level, message);
+  return result.str();
+}
+
+static std::string FormatDroppedMessages(uint64_t dropped) {
+  return FormatDebugLevelMessage(
+      __FILE__, __LINE__, LOGLEVEL_WARNING,
+      std::to_string(dropped) +
+          " log message(s) dropped because the log buffer was full");
+}
+
+BazelLogHandler::~BazelLogHandler() {
+  StopWriter();
+  if (detail_ == LOGGINGDETAIL_DEBUG) {
+    // If SetLoggingOutputStream was never called, dump the buffer to stderr,
+    // otherwise, flush the stream.
+    if (debug_stream_ != nullptr) {
+      debug_stream_->flush();
+    } else if (!debug_stream_set_) {
+      if (dropped_ > 0) {
+        std::cerr << FormatDroppedMessages(dropped_);
+      }
+      for (const std::string& line : debug_buffer_) {
+        std::cerr << line;
+      }
+    } else {
+      std::cerr << "Illegal state - neither a logfile nor a logbuffer "
+                << "existed at program end." << '\n';
+    }
+  }
+}
+
 void BazelLogHandler::HandleMessage(LogLevel level, const std::string& filename,
                                     int line, const std::string& message,
                                     int exit_code) {
@@ -108,31 +137,104 @@ void BazelLogHandler::HandleMessage(LogLevel level, const std::string& filename,
     return;
   }
 
-  if (debug_stream_ == nullptr) {
-    // If we haven't decided whether messages should be logged to debug levels
-    // or not, buffer each version. This is redundant for USER levels and above,
-    // but is to make sure we can provide the right output to the user once we
-    // know that they do or do not want debug level information.
-    user_messages_.push_back(std::pair<LogLevel, std::string>(level, message));
-    PrintDebugLevelMessageToStream(debug_buffer_stream_.get(), filename, line,
-                                   level, message);
-  } else {
+  // Format outside of the lock, the writer thread only has to copy the bytes.
+  std::string debug_line =
+      FormatDebugLevelMessage(filename, line, level, message);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (debug_stream_ == nullptr && level >= LOGLEVEL_USER) {
+      // If we haven't decided whether messages should be logged to debug
+      // levels or not, buffer each version. This is redundant for USER levels
+      // and above, but is to make sure we can provide the right output to the
+      // user once we know that they do or do not want debug level information.
+      // INFO messages are only ever printed as debug lines.
+      user_messages_.push_back(
+          std::pair<LogLevel, std::string>(level, message));
+    }
     // If an output stream has been specifically set, it is for the full suite
-    // of log messages. We don't print the user messages separately here as they
-    // are included.
-    PrintDebugLevelMessageToStream(debug_stream_, filename, line, level,
-                                   message);
+    // of log messages. We don't print the user messages separately here as
+    // they are included.
+    BufferDebugLine(std::move(debug_line));
   }
 
   // If we have a fatal message, exit with the provided error code.
   if (level == LOGLEVEL_FATAL) {
     if (debug_stream_ != nullptr) {
+      StopWriter();
       PrintUserLevelMessageToStream(&std::cerr, level, message);
     }
     std::exit(exit_code);
   }
 }
 
+void BazelLogHandler::BufferDebugLine(std::string line) {
+  if (debug_stream_ == nullptr) {
+    // Keep the most recent messages, they are the most likely to explain what
+    // went wrong.
+    debug_buffer_bytes_ += line.size();
+    debug_buffer_.push_back(std::move(line));
+    while (debug_buffer_bytes_ > max_buffered_bytes_) {
+      debug_buffer_bytes_ -= debug_buffer_.front().size();
+      debug_buffer_.pop_front();
+      ++dropped_;
+    }
+  } else if (stop_writer_) {
+    // The writer thread is shutting down, e.g. because another thread logged
+    // a fatal message; write the line directly so that it isn't lost.
+    *debug_stream_ << line;
+  } else if (pending_.size() + line.size() > max_buffered_bytes_) {
+    // The stream can't keep up. Rather than blocking the client, drop the
+    // message; the writer thread reports how many were dropped.
+    ++dropped_;
+    pending_cv_.notify_one();
+  } else {
+    pending_ += line;
+    pending_cv_.notify_one();
+  }
+}
+
+void BazelLogHandler::WriterLoop(std::ostream* stream) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    pending_cv_.wait(lock, [this] {
+      return stop_writer_ || !pending_.empty() || dropped_ > 0;
+    });
+    if (pending_.empty() && dropped_ == 0) {
+      break;
+    }
+    std::string lines;
+    lines.swap(pending_);
+    uint64_t dropped = dropped_;
+    dropped_ = 0;
+    writing_ = true;
+    lock.unlock();
+
+    // Messages are only dropped once the queue is full, so they came after
+    // the queued ones.
+    *stream << lines;
+    if (dropped > 0) {
+      *stream << FormatDroppedMessages(dropped);
+    }
+    stream->flush();
+
+    lock.lock();
+    writing_ = false;
+    idle_cv_.notify_all();
+  }
+}
+
+void BazelLogHandler::StopWriter() {
+  if (!writer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_writer_ = true;
+  }
+  pending_cv_.notify_one();
+  writer_.join();
+}
+
 void BazelLogHandler::SetLoggingDetail(LoggingDetail detail,
                                        std::ostream* debug_stream) {
   // Disallow second calls to this, we only intend to support setting the output
@@ -140,19 +242,20 @@ void BazelLogHandler::SetLoggingDetail(LoggingDetail detail,
   // fragmented.
   BAZEL_CHECK(!debug_stream_set_) << "Tried to set log output a second time";
   debug_stream_set_ = true;
-  debug_stream_ = debug_stream;
   detail_ = detail;
 
   if (detail == LOGGINGDETAIL_DEBUG) {
     // The user asked for debug level information, which includes the user
     // messages. We can discard the separate buffer at this point.
     user_messages_.clear();
-    FlushBufferToNewStreamAndSet(debug_buffer_stream_.get(), debug_stream_);
-    debug_buffer_stream_ = nullptr;
+    FlushBufferToNewStreamAndSet(debug_stream);
     return;
   }
 
-  debug_buffer_stream_ = nullptr;
+  debug_stream_ = debug_stream;
+  debug_buffer_.clear();
+  debug_buffer_bytes_ = 0;
+  dropped_ = 0;
   LogLevel min_log_level =
       detail == LOGGINGDETAIL_QUIET ? LOGLEVEL_ERROR : LOGLEVEL_USER;
 
@@ -162,9 +265,12 @@ void BazelLogHandler::SetLoggingDetail(LoggingDetail detail,
                                     log_entry.second);
     }
   }
+  user_messages_.clear();
 }
 
 void BazelLogHandler::Close() {
+  StopWriter();
+  std::lock_guard<std::mutex> lock(mutex_);
   if (debug_stream_ != nullptr) {
     debug_stream_->flush();
   }
@@ -172,14 +278,36 @@ void BazelLogHandler::Close() {
   debug_stream_ = nullptr;
 }
 
+void BazelLogHandler::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // Without a debug stream there is no writer thread and nothing to wait for.
+  idle_cv_.wait(lock, [this] {
+    return debug_stream_ == nullptr ||
+           (pending_.empty() && dropped_ == 0 && !writing_);
+  });
+  if (debug_stream_ != nullptr) {
+    debug_stream_->flush();
+  }
+}
+
 void BazelLogHandler::FlushBufferToNewStreamAndSet(
-    std::stringstream* buffer, std::ostream* new_debug_stream) {
-  // Flush the buffer to the new stream, and print new log lines to it.
+    std::ostream* new_debug_stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Hand the contents of the buffer to the writer thread, which also writes
+  // all following log lines to the new stream, then remove the buffer.
   debug_stream_ = new_debug_stream;
-  // Transfer the contents of the buffer to the new stream, then remove the
-  // buffer.
-  *debug_stream_ << buffer->str();
-  debug_stream_->flush();
+  if (dropped_ > 0) {
+    pending_ = FormatDroppedMessages(dropped_);
+    dropped_ = 0;
+  }
+  for (const std::string& line : debug_buffer_) {
+    pending_ += line;
+  }
+  debug_buffer_.clear();
+  debug_buffer_bytes_ = 0;
+  if (debug_stream_ != nullptr) {
+    writer_ = std::thread(&BazelLogHandler::WriterLoop, this, debug_stream_);
+  }
 }
 
 }  // namespace blaze_util
@@ -15,10 +15,14 @@
 #ifndef BAZEL_SRC_MAIN_CPP_BAZEL_LOG_HANDLER_H_
 #define BAZEL_SRC_MAIN_CPP_BAZEL_LOG_HANDLER_H_
 
+#include <condition_variable>  // NOLINT -- for windows portability
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <iostream>
-#include <memory>
-#include <sstream>
+#include <mutex>  // NOLINT -- for windows portability
 #include <string>
+#include <thread>  // NOLINT -- for windows portability
 #include <utility>
 #include <vector>
 
@@ -31,9 +35,19 @@ namespace blaze_util {
 // startup, logs are buffered until SetOutputStream is called. At that point,
 // all past log statements are dumped in the appropriate stream, and all
 // following statements are logged directly.
+//
+// Debug logs are written to the stream by a background thread, so that a slow
+// stream (e.g. a terminal being scrolled) doesn't hold up the client. Both the
+// startup buffer and the queue of the background thread hold at most
+// `max_buffered_bytes` of debug logs; once that is exceeded, messages are
+// dropped and a line with the number of dropped messages is written instead.
+// Messages of level USER and above are never dropped.
 class BazelLogHandler : public blaze_util::LogHandler {
  public:
-  BazelLogHandler();
+  static constexpr size_t kDefaultMaxBufferedBytes = 4 * 1024 * 1024;
+
+  explicit BazelLogHandler(
+      size_t max_buffered_bytes = kDefaultMaxBufferedBytes);
   ~BazelLogHandler() override;
 
   void HandleMessage(blaze_util::LogLevel level, const std::string& filename,
@@ -42,10 +56,18 @@ class BazelLogHandler : public blaze_util::LogHandler {
   void SetLoggingDetail(blaze_util::LoggingDetail detail,
                         std::ostream* stream) override;
   void Close() override;
+  void Flush() override;
 
  private:
-  void FlushBufferToNewStreamAndSet(std::stringstream* buffer,
-                                    std::ostream* new_output_stream);
+  void FlushBufferToNewStreamAndSet(std::ostream* new_output_stream);
+  // Appends a formatted debug line to the startup buffer or, once the debug
+  // stream is set, to the queue of the writer thread. Must hold `mutex_`.
+  void BufferDebugLine(std::string line);
+  void WriterLoop(std::ostream* stream);
+  // Writes out the queued lines and joins the writer thread.
+  void StopWriter();
+
+  const size_t max_buffered_bytes_;
 
   // The stream to which debug logs are sent (if logging detail is not
   // LOGGINGDETAIL_DEBUG, everything goes to stderr)
@@ -54,11 +76,27 @@ class BazelLogHandler : public blaze_util::LogHandler {
   LoggingDetail detail_;
 
   // Buffers for messages received before the logging detail was determined.
-  // non-debug messages are buffered alongside their log level so that we can
-  // use the log level to filter them based on the eventual logging detail,
-  // debug messages are simply buffered as a stream.
+  // Messages of level USER and above are buffered alongside their log level so
+  // that we can use the log level to filter them based on the eventual logging
+  // detail; all messages are also buffered as formatted debug lines, dropping
+  // the oldest ones once `max_buffered_bytes_` is exceeded.
   std::vector<std::pair<blaze_util::LogLevel, std::string>> user_messages_;
-  std::unique_ptr<std::stringstream> debug_buffer_stream_;
+  std::deque<std::string> debug_buffer_;
+  size_t debug_buffer_bytes_;
+
+  // Guards the debug lines shared with the writer thread.
+  std::mutex mutex_;
+  // Signalled when there is something for the writer thread to do.
+  std::condition_variable pending_cv_;
+  // Signalled when the writer thread has written out everything it had.
+  std::condition_variable idle_cv_;
+  // Lines that the writer thread has yet to write.
+  std::string pending_;
+  // Number of debug lines dropped and not reported on the stream yet.
+  uint64_t dropped_;
+  bool writing_;
+  bool stop_writer_;
+  std::thread writer_;
 };
 }  // namespace blaze_util
 
@@ -18,7 +18,11 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <condition_variable>  // NOLINT -- for windows portability
+#include <mutex>               // NOLINT -- for windows portability
 #include <string>
+#include <thread>  // NOLINT -- for windows portability
+#include <utility>
 #include <vector>
 
 #include "src/main/cpp/util/file_platform.h"
@@ -92,22 +96,108 @@ bool WriteFile(const std::string &content, const Path &path,
   return WriteFile(content.c_str(), content.size(), path, perm);
 }
 
-class DirectoryTreeWalker : public DirectoryEntryConsumer {
+// Sorts the entries of a directory into subdirectories and files.
+class DirectoryEntryCollector : public DirectoryEntryConsumer {
  public:
-  explicit DirectoryTreeWalker(vector<Path> *files) : files(files) {}
+  DirectoryEntryCollector(vector<Path> *directories, vector<Path> *files)
+      : directories(directories), files(files) {}
 
   void Consume(const Path &path, bool is_directory) override {
     if (is_directory) {
-      Walk(path);
+      directories->push_back(path);
     } else {
       files->push_back(path);
     }
   }
 
-  void Walk(const Path &path) { ForEachDirectoryEntry(path, this); }
+ private:
+  vector<Path> *directories;
+  vector<Path> *files;
+};
+
+// Walks a directory tree on several threads. Listing a directory mostly waits
+// for the file system, so on slow disks (and on Windows in particular) several
+// directories are listed at a time. The directories that are yet to be listed
+// are kept in a shared queue, each thread collects the files it finds
+// separately.
+class DirectoryTreeWalker {
+ public:
+  explicit DirectoryTreeWalker(vector<Path> *files) : files(files), busy(0) {}
+
+  void Walk(const Path &path) {
+    // Small trees are common, so directories are listed on the calling thread
+    // until there are several to list at once.
+    queue.push_back(path);
+    while (queue.size() == 1) {
+      ListNext(files);
+    }
+    if (queue.empty()) {
+      return;
+    }
+
+    int thread_count = std::min<int>(
+        std::max<int>(std::thread::hardware_concurrency(), 1), kMaxThreads);
+    vector<vector<Path>> thread_files(thread_count - 1);
+    vector<std::thread> threads;
+    for (auto &result : thread_files) {
+      threads.emplace_back([this, &result] { Work(&result); });
+    }
+    Work(files);
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    for (auto &result : thread_files) {
+      files->insert(files->end(), result.begin(), result.end());
+    }
+  }
 
  private:
+  static constexpr int kMaxThreads = 8;
+
+  // Lists the last queued directory on the calling thread. Only used before
+  // the other threads are started.
+  void ListNext(vector<Path> *result) {
+    Path directory = std::move(queue.back());
+    queue.pop_back();
+    DirectoryEntryCollector collector(&queue, result);
+    ForEachDirectoryEntry(directory, &collector);
+  }
+
+  void Work(vector<Path> *result) {
+    vector<Path> directories;
+    DirectoryEntryCollector collector(&directories, result);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      // Wait until there is a directory to list, or until every thread is idle
+      // with nothing left to list, which means the walk is over.
+      cv.wait(lock, [this] { return !queue.empty() || busy == 0; });
+      if (queue.empty()) {
+        break;
+      }
+      Path directory = std::move(queue.back());
+      queue.pop_back();
+      ++busy;
+      lock.unlock();
+
+      ForEachDirectoryEntry(directory, &collector);
+
+      lock.lock();
+      --busy;
+      for (auto &d : directories) {
+        queue.push_back(std::move(d));
+      }
+      directories.clear();
+      cv.notify_all();
+    }
+  }
+
   vector<Path> *files;
+  std::mutex mutex;
+  std::condition_variable cv;
+  // Directories that are yet to be listed.
+  vector<Path> queue;
+  // Number of threads currently listing a directory.
+  int busy;
 };
 
 void GetAllFilesUnder(const Path &path, vector<Path> *result) {
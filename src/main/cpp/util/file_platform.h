@@ -49,6 +49,19 @@ bool SetMtimeToNowIfPossible(const Path &path);
 // Returns true if the mtime was changed successfully.
 bool SetMtimeToDistantFuture(const Path &path);
 
+// Returns a string identifying the current version of `path`, which changes
+// when `path` is replaced. For files it also changes when they are modified,
+// and on POSIX, for directories when subdirectories are added or removed; the
+// mtime of a directory is not taken into account.
+// Returns the empty string if querying the information failed.
+std::string GetFileFingerprint(const Path &path);
+
+// Returns true if `path` was modified less than `seconds` seconds ago, or if
+// querying the information failed.
+// A fingerprint of a file modified this recently may not change if the file
+// is modified again, as file systems keep the mtime at a limited precision.
+bool IsRecentlyModified(const Path &path, int seconds);
+
 #if defined(_WIN32) || defined(__CYGWIN__)
 // We cannot include <windows.h> because it #defines many symbols that conflict
 // with our function names, e.g. GetUserName, SendMessage.
@@ -130,6 +143,10 @@ void InitializeStdOutErrForUtf8();
 // and awareness of pipes (i.e. in case stderr/stdout is connected to a pipe).
 int WriteToStdOutErr(const void *data, size_t size, bool to_stdout);
 
+// Writes the `chunks` in order into stdout/stderr, with as few system calls as
+// the platform allows. Returns one of `WriteResult::Errors`.
+int WriteToStdOutErr(const std::vector<std::string> &chunks, bool to_stdout);
+
 enum RenameDirectoryResult {
   kRenameDirectorySuccess = 0,
   kRenameDirectoryFailureNotEmpty = 1,
@@ -20,11 +20,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 #include <utime.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "src/main/cpp/util/errors.h"
 #include "src/main/cpp/util/exit_code.h"
@@ -335,6 +338,45 @@ int WriteToStdOutErr(const void *data, size_t size, bool to_stdout) {
                                          : WriteResult::OTHER_ERROR);
 }
 
+int WriteToStdOutErr(const std::vector<std::string> &chunks, bool to_stdout) {
+  FILE *stream = to_stdout ? stdout : stderr;
+  // The chunks bypass stdio, so write out what it has buffered first.
+  if (fflush(stream) != 0) {
+    return errno == EPIPE ? WriteResult::BROKEN_PIPE : WriteResult::OTHER_ERROR;
+  }
+  std::vector<struct iovec> iov;
+  iov.reserve(chunks.size());
+  for (const std::string &chunk : chunks) {
+    if (!chunk.empty()) {
+      iov.push_back({const_cast<char *>(chunk.data()), chunk.size()});
+    }
+  }
+  const int fd = fileno(stream);
+  size_t next = 0;
+  while (next < iov.size()) {
+    int count = static_cast<int>(std::min<size_t>(iov.size() - next, IOV_MAX));
+    ssize_t written = writev(fd, &iov[next], count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EPIPE ? WriteResult::BROKEN_PIPE
+                            : WriteResult::OTHER_ERROR;
+    }
+    // Skip what has been written, which may end in the middle of a chunk.
+    size_t remaining = written;
+    while (remaining > 0 && remaining >= iov[next].iov_len) {
+      remaining -= iov[next].iov_len;
+      ++next;
+    }
+    if (remaining > 0) {
+      iov[next].iov_base = static_cast<char *>(iov[next].iov_base) + remaining;
+      iov[next].iov_len -= remaining;
+    }
+  }
+  return WriteResult::SUCCESS;
+}
+
 int RenameDirectory(const Path &old_path, const Path &new_path) {
   if (rename(old_path.AsNativePath().c_str(),
              new_path.AsNativePath().c_str()) == 0) {
@@ -503,6 +545,29 @@ bool SetMtimeToDistantFuture(const Path &path) {
   return SetMtime(path, kDistantFuture);
 }
 
+string GetFileFingerprint(const Path &path) {
+  struct stat buf;
+  if (stat(path.AsNativePath().c_str(), &buf)) {
+    return "";
+  }
+  string result = std::to_string(buf.st_dev) + ":" +
+                  std::to_string(buf.st_ino) + ":" +
+                  std::to_string(buf.st_nlink);
+  if (!S_ISDIR(buf.st_mode)) {
+    result += ":" + std::to_string(buf.st_size) + ":" +
+              std::to_string(buf.st_mtime);
+  }
+  return result;
+}
+
+bool IsRecentlyModified(const Path &path, int seconds) {
+  struct stat buf;
+  if (stat(path.AsNativePath().c_str(), &buf)) {
+    return true;
+  }
+  return buf.st_mtime > GetNow() - seconds;
+}
+
 // mkdir -p path. Returns true if the path was created or already exists and
 // could
 // be chmod-ed to exactly the given permissions. If final part of the path is a
@@ -554,8 +619,10 @@ void ForEachDirectoryEntry(const Path &path, DirectoryEntryConsumer *consumer) {
     } else  // NOLINT (the brace is on the next line)
 #endif
       {
+        // Stat relative to the open directory, which saves resolving the
+        // whole path again.
         struct stat buf;
-        if (lstat(child_path.AsNativePath().c_str(), &buf) == -1) {
+        if (fstatat(dirfd(dir), ent->d_name, &buf, AT_SYMLINK_NOFOLLOW) == -1) {
           BAZEL_DIE(blaze_exit_code::INTERNAL_ERROR)
               << "stat failed for filename '" << child_path.AsPrintablePath()
               << "': " << GetLastErrorString();
@@ -214,6 +214,51 @@ bool SetMtimeToDistantFuture(const Path& path) {
   return SetMtime(path, kDistantFuture);
 }
 
+string GetFileFingerprint(const Path& path) {
+  if (path.IsEmpty() || path.IsNull()) {
+    return "";
+  }
+  AutoHandle handle(CreateFileW(
+      /* lpFileName */ path.AsNativePath().c_str(),
+      /* dwDesiredAccess */ 0,
+      /* dwShareMode */ kAllShare,
+      /* lpSecurityAttributes */ nullptr,
+      /* dwCreationDisposition */ OPEN_EXISTING,
+      /* dwFlagsAndAttributes */ FILE_FLAG_BACKUP_SEMANTICS,
+      /* hTemplateFile */ nullptr));
+  BY_HANDLE_FILE_INFORMATION info;
+  if (!handle.IsValid() || !GetFileInformationByHandle(handle, &info)) {
+    return "";
+  }
+  string result = std::to_string(info.dwVolumeSerialNumber) + ":" +
+                  std::to_string(info.nFileIndexHigh) + ":" +
+                  std::to_string(info.nFileIndexLow) + ":" +
+                  std::to_string(info.nNumberOfLinks);
+  if (!(info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+    result += ":" + std::to_string(info.nFileSizeHigh) + ":" +
+              std::to_string(info.nFileSizeLow) + ":" +
+              std::to_string(info.ftLastWriteTime.dwHighDateTime) + ":" +
+              std::to_string(info.ftLastWriteTime.dwLowDateTime);
+  }
+  return result;
+}
+
+bool IsRecentlyModified(const Path& path, int seconds) {
+  WIN32_FILE_ATTRIBUTE_DATA info;
+  if (!GetFileAttributesExW(path.AsNativePath().c_str(), GetFileExInfoStandard,
+                            &info)) {
+    return true;
+  }
+  FILETIME now = GetNow();
+  ULARGE_INTEGER now_value, mtime_value;
+  now_value.LowPart = now.dwLowDateTime;
+  now_value.HighPart = now.dwHighDateTime;
+  mtime_value.LowPart = info.ftLastWriteTime.dwLowDateTime;
+  mtime_value.HighPart = info.ftLastWriteTime.dwHighDateTime;
+  // FILETIME counts 100 nanosecond intervals.
+  return mtime_value.QuadPart + seconds * 10000000ULL > now_value.QuadPart;
+}
+
 static bool OpenFileForReading(const Path& path, HANDLE* result) {
   *result = ::CreateFileW(
       /* lpFileName */ path.AsNativePath().c_str(),
@@ -357,6 +402,17 @@ int WriteToStdOutErr(const void* data, size_t size, bool to_stdout) {
   }
 }
 
+int WriteToStdOutErr(const std::vector<std::string>& chunks, bool to_stdout) {
+  // WriteFile has no gather variant for pipes and consoles.
+  for (const std::string& chunk : chunks) {
+    int result = WriteToStdOutErr(chunk.data(), chunk.size(), to_stdout);
+    if (result != WriteResult::SUCCESS) {
+      return result;
+    }
+  }
+  return WriteResult::SUCCESS;
+}
+
 int RenameDirectory(const Path& old_path, const Path& new_path) {
   if (!::MoveFileExW(old_path.AsNativePath().c_str(),
                      new_path.AsNativePath().c_str(),
@@ -739,6 +795,16 @@ bool ChangeDirectory(const string& path) {
   }
   return ::SetCurrentDirectoryA(spath.c_str()) == TRUE;
 }
+// Starts listing the directory `wpath`, which must end with a backslash.
+// Skips the short (8.3) names, which nobody here needs, and fetches the
+// entries in larger batches, which makes listing large directories faster.
+static HANDLE FindFirstDirectoryEntry(const wstring& wpath,
+                                      WIN32_FIND_DATAW* metadata) {
+  return ::FindFirstFileExW((wpath + L"*").c_str(), FindExInfoBasic, metadata,
+                            FindExSearchNameMatch, nullptr,
+                            FIND_FIRST_EX_LARGE_FETCH);
+}
+
 static void ForEachDirectoryEntryW(const wstring& path,
                                    DirectoryEntryConsumerW* consumer) {
   wstring wpath;
@@ -765,7 +831,7 @@ static void ForEachDirectoryEntryW(const wstring& path,
   // normalized (see NormalizeWindowsPath).
   wpath.append(L"\\");
   WIN32_FIND_DATAW metadata;
-  HANDLE handle = ::FindFirstFileW((wpath + L"*").c_str(), &metadata);
+  HANDLE handle = FindFirstDirectoryEntry(wpath, &metadata);
   if (handle == INVALID_HANDLE_VALUE) {
     return;  // directory does not exist or is empty
   }
@@ -824,7 +890,7 @@ void ForEachDirectoryEntry(const Path& path, DirectoryEntryConsumer* consumer) {
   // normalized (see NormalizeWindowsPath).
   wpath.append(L"\\");
   WIN32_FIND_DATAW metadata;
-  HANDLE handle = ::FindFirstFileW((wpath + L"*").c_str(), &metadata);
+  HANDLE handle = FindFirstDirectoryEntry(wpath, &metadata);
   if (handle == INVALID_HANDLE_VALUE) {
     return;  // directory does not exist or is empty
   }
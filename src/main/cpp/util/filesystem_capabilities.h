@@ -0,0 +1,107 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_FILESYSTEM_CAPABILITIES_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_FILESYSTEM_CAPABILITIES_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <utility>
+
+// What the file system holding a file can do, so that the fast paths of the
+// client, the tools and the JNI library (copy-on-write clones, copies within
+// the kernel, digests kept in extended attributes, ...) go straight to the
+// fastest safe way rather than each trying and failing on every file. POSIX
+// only.
+
+namespace blaze_util {
+
+enum FilesystemCapability : uint32_t {
+  // Copy-on-write clones of files: FICLONE on Linux, clonefile(2) on macOS.
+  kFsCloneFile = 1 << 0,
+  // Copies within the kernel with copy_file_range(2).
+  kFsCopyFileRange = 1 << 1,
+  // Extended attributes: of the "user." namespace on Linux.
+  kFsExtendedAttributes = 1 << 2,
+  // readdir(3) tells the type of most entries in d_type, rather than
+  // DT_UNKNOWN. Readers must still handle DT_UNKNOWN.
+  kFsDirentType = 1 << 3,
+  // Names that differ only by case are different files.
+  kFsCaseSensitive = 1 << 4,
+  kFsSymlinks = 1 << 5,
+};
+
+// The capabilities of one file system. The probe cannot tell some of them,
+// e.g. whether an XFS file system was made with reflinks: those whose use
+// fails harmlessly are assumed until the code trying them reports otherwise
+// with SetUnsupported.
+class FilesystemCapabilities {
+ public:
+  FilesystemCapabilities(std::string type, bool remote, bool read_only,
+                         uint32_t capabilities)
+      : type_(std::move(type)),
+        remote_(remote),
+        read_only_(read_only),
+        capabilities_(capabilities) {}
+
+  FilesystemCapabilities(const FilesystemCapabilities &) = delete;
+  FilesystemCapabilities &operator=(const FilesystemCapabilities &) = delete;
+
+  // The type of the file system as the OS names it, e.g. "ext4", "apfs" or
+  // "fuse.sshfs", or "" if unknown.
+  const std::string &type() const { return type_; }
+
+  // Whether the files are on another machine, e.g. on NFS.
+  bool remote() const { return remote_; }
+
+  bool read_only() const { return read_only_; }
+
+  bool Has(FilesystemCapability capability) const {
+    return (capabilities_.load(std::memory_order_relaxed) & capability) != 0;
+  }
+
+  // Records that the file system turned out not to support capability, as
+  // told by an errno such as EOPNOTSUPP, so that Has returns false from then
+  // on in the whole process. Not for errors about particular files, such as
+  // EXDEV.
+  void SetUnsupported(FilesystemCapability capability) const {
+    capabilities_.fetch_and(~static_cast<uint32_t>(capability),
+                            std::memory_order_relaxed);
+  }
+
+ private:
+  const std::string type_;
+  const bool remote_;
+  const bool read_only_;
+  mutable std::atomic<uint32_t> capabilities_;
+};
+
+// Returns the capabilities of the file system of the open file fd, or of the
+// file at path. They are probed with statfs(2) and the mount table the first
+// time a device is seen, and kept for the life of the process; the reference
+// stays valid as long. Thread-safe. If the file cannot be stat-ed, returns
+// the capabilities of an unknown file system, which has none.
+const FilesystemCapabilities &GetFilesystemCapabilities(int fd);
+const FilesystemCapabilities &GetFilesystemCapabilities(const char *path);
+
+// Like GetFilesystemCapabilities(fd), for callers that have the st_dev of fd
+// from fstat(2) already.
+const FilesystemCapabilities &GetFilesystemCapabilities(int fd, dev_t dev);
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_FILESYSTEM_CAPABILITIES_H_
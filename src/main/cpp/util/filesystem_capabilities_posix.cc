@@ -0,0 +1,282 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/filesystem_capabilities.h"
+
+#include <sys/mount.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#endif
+
+#include <fstream>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+namespace blaze_util {
+
+namespace {
+
+// What a file system with the POSIX semantics can do, besides cloning files.
+const uint32_t kPosixCapabilities = kFsCopyFileRange | kFsExtendedAttributes |
+                                    kFsDirentType | kFsCaseSensitive |
+                                    kFsSymlinks;
+
+struct KnownFilesystem {
+  const char *type;
+#if defined(__linux__)
+  // The f_type of statfs(2).
+  uint32_t magic;
+  bool remote;
+#endif
+  uint32_t capabilities;
+};
+
+// The file systems whose capabilities are known, unknown ones are assumed to
+// be local and to have kUnknownCapabilities.
+#if defined(__linux__)
+const uint32_t kUnknownCapabilities = kFsCopyFileRange |
+                                      kFsExtendedAttributes |
+                                      kFsCaseSensitive | kFsSymlinks;
+
+const KnownFilesystem kKnownFilesystems[] = {
+    {"ext4", 0xef53, false, kPosixCapabilities},
+    // Reflinks are the default since xfsprogs 5.1.
+    {"xfs", 0x58465342, false, kPosixCapabilities | kFsCloneFile},
+    {"btrfs", 0x9123683e, false, kPosixCapabilities | kFsCloneFile},
+    {"bcachefs", 0xca451a4e, false, kPosixCapabilities | kFsCloneFile},
+    // Block cloning is there since OpenZFS 2.2.
+    {"zfs", 0x2fc12fc1, false, kPosixCapabilities | kFsCloneFile},
+    {"ocfs2", 0x7461636f, false, kPosixCapabilities | kFsCloneFile},
+    {"f2fs", 0xf2f52010, false, kPosixCapabilities},
+    // User extended attributes are there since Linux 6.6.
+    {"tmpfs", 0x01021994, false, kPosixCapabilities},
+    {"overlay", 0x794c7630, false, kPosixCapabilities | kFsCloneFile},
+    {"squashfs", 0x73717368, false, kPosixCapabilities},
+    {"vfat", 0x4d44, false, kFsCopyFileRange | kFsDirentType},
+    {"exfat", 0x2011bab0, false, kFsCopyFileRange | kFsDirentType},
+    {"ntfs3", 0x7366746e, false, kPosixCapabilities},
+    // NFS 4.2 copies and clones on the server.
+    {"nfs", 0x6969, true, kPosixCapabilities | kFsCloneFile},
+    {"ceph", 0x00c36400, true, kPosixCapabilities},
+    {"afs", 0x5346414f, true,
+     kFsCopyFileRange | kFsCaseSensitive | kFsSymlinks},
+    // Whether names are case-sensitive and symlinks are supported depends on
+    // the server and the mount options.
+    {"cifs", 0xff534d42, true,
+     kFsCloneFile | kFsCopyFileRange | kFsExtendedAttributes | kFsDirentType},
+    {"smb3", 0xfe534d42, true,
+     kFsCloneFile | kFsCopyFileRange | kFsExtendedAttributes | kFsDirentType},
+    // E.g. the Windows drives of WSL, which are not case-sensitive.
+    {"9p", 0x01021997, true,
+     kFsCopyFileRange | kFsExtendedAttributes | kFsSymlinks},
+    {"fuse", 0x65735546, false, kUnknownCapabilities},
+    // copy_file_range(2) copies nothing from these before Linux 5.3.
+    {"proc", 0x9fa0, false, kFsDirentType | kFsCaseSensitive | kFsSymlinks},
+    {"sysfs", 0x62656572, false,
+     kFsDirentType | kFsCaseSensitive | kFsSymlinks},
+};
+
+// The FUSE file systems whose files are on another machine.
+const char *const kRemoteFuseTypes[] = {
+    "fuse.sshfs", "fuse.s3fs", "fuse.gcsfuse", "fuse.rclone", "fuse.davfs",
+};
+#else
+#if defined(__FreeBSD__) && __FreeBSD_version >= 1300000
+const uint32_t kUnknownCapabilities =
+    kFsCopyFileRange | kFsCaseSensitive | kFsSymlinks;
+#else
+const uint32_t kUnknownCapabilities = kFsCaseSensitive | kFsSymlinks;
+#endif
+
+// Whether names are case-sensitive and extended attributes are supported is
+// asked from the file system on macOS.
+const KnownFilesystem kKnownFilesystems[] = {
+    {"apfs", kUnknownCapabilities | kFsCloneFile | kFsDirentType},
+    {"hfs", kUnknownCapabilities | kFsDirentType},
+    {"ufs", kUnknownCapabilities | kFsDirentType},
+    {"zfs", kUnknownCapabilities | kFsDirentType},
+    {"tmpfs", kUnknownCapabilities | kFsDirentType},
+    {"msdos", kUnknownCapabilities & ~(kFsCaseSensitive | kFsSymlinks)},
+    {"msdosfs", kUnknownCapabilities & ~(kFsCaseSensitive | kFsSymlinks)},
+    {"exfat", kUnknownCapabilities & ~(kFsCaseSensitive | kFsSymlinks)},
+};
+#endif
+
+#if defined(__linux__)
+// Returns the type of the file system of device dev and its options as given
+// by the mount table, e.g. "fuse.sshfs", which statfs(2) only knows as FUSE.
+bool ReadMountInfo(dev_t dev, std::string *type, std::string *options) {
+  std::ifstream mountinfo("/proc/self/mountinfo");
+  if (!mountinfo) {
+    return false;
+  }
+  // The lines look like
+  //   36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 - ext3 /dev/root rw,errors=...
+  // with optional fields before the "-".
+  const std::string device =
+      std::to_string(major(dev)) + ":" + std::to_string(minor(dev));
+  std::string line;
+  while (std::getline(mountinfo, line)) {
+    std::istringstream fields(line);
+    std::string id, parent_id, major_minor;
+    if (!(fields >> id >> parent_id >> major_minor) || major_minor != device) {
+      continue;
+    }
+    std::string field;
+    while (fields >> field && field != "-") {
+    }
+    std::string source;
+    if (fields >> *type >> source >> *options) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns whether the comma-separated options contain option.
+bool HasOption(const std::string &options, const char *option) {
+  std::istringstream stream(options);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (item == option) {
+      return true;
+    }
+  }
+  return false;
+}
+#endif
+
+FilesystemCapabilities *Probe(int fd, const char *path, dev_t dev) {
+  struct statvfs vfs;
+  bool read_only = (fd >= 0 ? fstatvfs(fd, &vfs) : statvfs(path, &vfs)) == 0 &&
+                   (vfs.f_flag & ST_RDONLY) != 0;
+  struct statfs fs;
+  if ((fd >= 0 ? fstatfs(fd, &fs) : statfs(path, &fs)) != 0) {
+    return new FilesystemCapabilities("", false, read_only,
+                                      kUnknownCapabilities);
+  }
+  std::string type;
+  bool remote = false;
+  uint32_t capabilities = kUnknownCapabilities;
+#if defined(__linux__)
+  for (const KnownFilesystem &known : kKnownFilesystems) {
+    if (static_cast<uint32_t>(fs.f_type) == known.magic) {
+      type = known.type;
+      remote = known.remote;
+      capabilities = known.capabilities;
+      break;
+    }
+  }
+  std::string mount_type, options;
+  if (ReadMountInfo(dev, &mount_type, &options)) {
+    type = mount_type;
+    for (const char *fuse_type : kRemoteFuseTypes) {
+      remote = remote || type == fuse_type;
+    }
+    if (HasOption(options, "nouser_xattr")) {
+      capabilities &= ~kFsExtendedAttributes;
+    }
+    if ((type == "cifs" || type == "smb3") &&
+        HasOption(options, "mfsymlinks")) {
+      capabilities |= kFsSymlinks;
+    }
+  }
+#else
+  type = fs.f_fstypename;
+  remote = (fs.f_flags & MNT_LOCAL) == 0;
+  for (const KnownFilesystem &known : kKnownFilesystems) {
+    if (type == known.type) {
+      capabilities = known.capabilities;
+      break;
+    }
+  }
+#if defined(__APPLE__)
+  long case_sensitive = fd >= 0 ? fpathconf(fd, _PC_CASE_SENSITIVE)
+                                : pathconf(path, _PC_CASE_SENSITIVE);
+  if (case_sensitive == 0) {
+    capabilities &= ~kFsCaseSensitive;
+  }
+  long xattr_size_bits = fd >= 0 ? fpathconf(fd, _PC_XATTR_SIZE_BITS)
+                                 : pathconf(path, _PC_XATTR_SIZE_BITS);
+  if (xattr_size_bits > 0) {
+    capabilities |= kFsExtendedAttributes;
+  }
+#endif
+#endif
+  return new FilesystemCapabilities(type, remote, read_only, capabilities);
+}
+
+class Cache {
+ public:
+  const FilesystemCapabilities &Get(int fd, const char *path) {
+    struct stat st;
+    if ((fd >= 0 ? fstat(fd, &st) : stat(path, &st)) != 0) {
+      return unknown_;
+    }
+    return Get(fd, path, st.st_dev);
+  }
+
+  const FilesystemCapabilities &Get(int fd, const char *path, dev_t dev) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = capabilities_.find(dev);
+      if (it != capabilities_.end()) {
+        return *it->second;
+      }
+    }
+    // Probed without the lock: another thread may probe the same device, and
+    // the first one to be done wins.
+    std::unique_ptr<FilesystemCapabilities> probed(Probe(fd, path, dev));
+    std::lock_guard<std::mutex> lock(mutex_);
+    return *capabilities_.emplace(dev, std::move(probed)).first->second;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::unordered_map<dev_t, std::unique_ptr<FilesystemCapabilities>>
+      capabilities_;
+  FilesystemCapabilities unknown_{"", false, false, 0};
+};
+
+Cache &GetCache() {
+  // Never destroyed: other threads may still use it at exit.
+  static Cache *cache = new Cache();
+  return *cache;
+}
+
+}  // namespace
+
+const FilesystemCapabilities &GetFilesystemCapabilities(int fd) {
+  return GetCache().Get(fd, nullptr);
+}
+
+const FilesystemCapabilities &GetFilesystemCapabilities(const char *path) {
+  return GetCache().Get(-1, path);
+}
+
+const FilesystemCapabilities &GetFilesystemCapabilities(int fd, dev_t dev) {
+  return GetCache().Get(fd, nullptr, dev);
+}
+
+}  // namespace blaze_util
@@ -110,4 +110,10 @@ void CloseLogging() {
   }
 }
 
+void FlushLogging() {
+  if (internal::log_handler_ != nullptr) {
+    internal::log_handler_->Flush();
+  }
+}
+
 }  // namespace blaze_util
@@ -166,6 +166,9 @@ class LogHandler {
 
   // See ::CloseLogging()
   virtual void Close() = 0;
+
+  // See ::FlushLogging()
+  virtual void Flush() {}
 };
 
 // Sets the log handler that routes all log messages.
@@ -182,6 +185,11 @@ void SetLoggingDetail(LoggingDetail detail, std::ostream* debug_stream);
 // printed.
 void CloseLogging();
 
+// Blocks until all log messages handled so far have been written out. Call
+// this before replacing the process image, e.g. with execv, which would
+// otherwise discard messages that are still queued.
+void FlushLogging();
+
 }  // namespace blaze_util
 
 #endif  // BAZEL_SRC_MAIN_CPP_LOGGING_H_
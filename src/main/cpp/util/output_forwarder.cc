@@ -0,0 +1,114 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/output_forwarder.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/main/cpp/util/file_platform.h"
+
+namespace blaze_util {
+
+static int WriteToStdOutErrDefault(const std::vector<std::string> &chunks,
+                                   bool to_stdout) {
+  return WriteToStdOutErr(chunks, to_stdout);
+}
+
+OutputForwarder::OutputForwarder(size_t max_pending_bytes)
+    : OutputForwarder(max_pending_bytes, &WriteToStdOutErrDefault) {}
+
+OutputForwarder::OutputForwarder(size_t max_pending_bytes, WriteFn write)
+    : max_pending_bytes_(max_pending_bytes),
+      write_(std::move(write)),
+      pending_bytes_(0),
+      writing_(false),
+      shutdown_(false),
+      stdout_broken_(false),
+      stderr_broken_(false),
+      writer_(&OutputForwarder::WriterLoop, this) {}
+
+OutputForwarder::~OutputForwarder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  queued_.notify_one();
+  writer_.join();
+}
+
+void OutputForwarder::Write(std::string chunk, bool to_stdout) {
+  if (chunk.empty()) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (to_stdout ? stdout_broken_ : stderr_broken_) {
+      return;
+    }
+    written_.wait(lock,
+                  [this] { return pending_bytes_ < max_pending_bytes_; });
+    pending_bytes_ += chunk.size();
+    chunks_.push_back({std::move(chunk), to_stdout});
+  }
+  queued_.notify_one();
+}
+
+void OutputForwarder::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_.wait(lock, [this] { return chunks_.empty() && !writing_; });
+}
+
+const char *OutputForwarder::BrokenPipeName() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (stdout_broken_) {
+    return "standard output";
+  }
+  return stderr_broken_ ? "standard error" : nullptr;
+}
+
+void OutputForwarder::WriterLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    queued_.wait(lock, [this] { return shutdown_ || !chunks_.empty(); });
+    if (chunks_.empty()) {
+      return;
+    }
+
+    // Take all the chunks queued for the same stream as the first one.
+    const bool to_stdout = chunks_.front().to_stdout;
+    std::vector<std::string> batch;
+    size_t batch_bytes = 0;
+    while (!chunks_.empty() && chunks_.front().to_stdout == to_stdout) {
+      batch_bytes += chunks_.front().data.size();
+      batch.push_back(std::move(chunks_.front().data));
+      chunks_.pop_front();
+    }
+    writing_ = true;
+
+    lock.unlock();
+    int result = write_(batch, to_stdout);
+    lock.lock();
+
+    if (result == WriteResult::BROKEN_PIPE) {
+      (to_stdout ? stdout_broken_ : stderr_broken_) = true;
+    }
+    pending_bytes_ -= batch_bytes;
+    writing_ = false;
+    written_.notify_all();
+  }
+}
+
+}  // namespace blaze_util
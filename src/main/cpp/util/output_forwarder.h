@@ -0,0 +1,97 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_OUTPUT_FORWARDER_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_OUTPUT_FORWARDER_H_
+
+#include <stddef.h>
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace blaze_util {
+
+// Writes the output the server streams to the client into stdout and stderr
+// from a thread of its own, so that the next chunks can be received while the
+// previous ones are written. The chunks of a stream that queue up while a
+// write is in progress are written together by the next one, so a large
+// output takes a fraction of the system calls it would take chunk by chunk.
+// Write() blocks while more than `max_pending_bytes` are queued, so a slow
+// reader of the output still slows the server down rather than making the
+// client buffer the whole output.
+class OutputForwarder {
+ public:
+  // Writes the chunks in order to stdout or stderr and returns one of
+  // `WriteResult::Errors`, like WriteToStdOutErr.
+  using WriteFn =
+      std::function<int(const std::vector<std::string> &, bool to_stdout)>;
+
+  explicit OutputForwarder(size_t max_pending_bytes = kMaxPendingBytes);
+  OutputForwarder(size_t max_pending_bytes, WriteFn write);
+
+  // Writes out the queued chunks.
+  ~OutputForwarder();
+
+  OutputForwarder(const OutputForwarder &) = delete;
+  OutputForwarder &operator=(const OutputForwarder &) = delete;
+
+  // Queues `chunk` to be written to stdout or stderr. The chunks are written
+  // in the order they are queued, whatever their stream. Chunks for a stream
+  // whose pipe is broken are dropped.
+  void Write(std::string chunk, bool to_stdout);
+
+  // Waits until all the queued chunks have been written.
+  void Flush();
+
+  // Returns "standard output" or "standard error" if writing to it failed with
+  // a broken pipe, or nullptr.
+  const char *BrokenPipeName();
+
+  static constexpr size_t kMaxPendingBytes = 4 * 1024 * 1024;
+
+ private:
+  struct Chunk {
+    std::string data;
+    bool to_stdout;
+  };
+
+  void WriterLoop();
+
+  const size_t max_pending_bytes_;
+  const WriteFn write_;
+
+  std::mutex mutex_;
+  // Signalled when chunks are queued or when shutting down.
+  std::condition_variable queued_;
+  // Signalled when chunks have been written.
+  std::condition_variable written_;
+  std::deque<Chunk> chunks_;
+  // The bytes queued or being written.
+  size_t pending_bytes_;
+  bool writing_;
+  bool shutdown_;
+  bool stdout_broken_;
+  bool stderr_broken_;
+
+  std::thread writer_;
+};
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_OUTPUT_FORWARDER_H_
@@ -0,0 +1,163 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/trace.h"
+
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <mutex>   // NOLINT
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path_platform.h"
+
+namespace blaze_util {
+
+namespace {
+
+struct Span {
+  const char *name;
+  int tid;
+  int64_t start_micros;
+  int64_t end_micros;
+};
+
+struct Trace {
+  Trace()
+      : start(std::chrono::steady_clock::now()),
+        start_epoch_millis(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count()) {}
+
+  const std::chrono::steady_clock::time_point start;
+  const int64_t start_epoch_millis;
+
+  std::mutex mutex;
+  std::vector<Span> spans;
+  Path path;
+};
+
+// Leaked, so that it is still there for the spans that end during exit.
+Trace *GetTrace() {
+  static Trace *trace = new Trace();
+  return trace;
+}
+
+// Make the client start time the start of the trace.
+Trace *const kTraceAtStartup = GetTrace();
+
+int64_t NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - GetTrace()->start)
+      .count();
+}
+
+// The threads are numbered in the order they record their first span.
+int GetThreadIndex() {
+  static std::atomic<int> next_index(1);
+  thread_local int index = next_index++;
+  return index;
+}
+
+int GetPid() {
+#if defined(_WIN32)
+  return _getpid();
+#else
+  return getpid();
+#endif
+}
+
+void AppendJsonString(const char *s, std::string *out) {
+  out->push_back('"');
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') {
+      out->push_back('\\');
+    }
+    out->push_back(*s);
+  }
+  out->push_back('"');
+}
+
+void AtExit() { WriteTrace(); }
+
+}  // namespace
+
+TraceSpan::TraceSpan(const char *name)
+    : name_(name), start_micros_(NowMicros()) {}
+
+TraceSpan::~TraceSpan() {
+  Span span = {name_, GetThreadIndex(), start_micros_, NowMicros()};
+  Trace *trace = GetTrace();
+  std::lock_guard<std::mutex> lock(trace->mutex);
+  trace->spans.push_back(span);
+}
+
+void SetTraceFile(const Path &path) {
+  Trace *trace = GetTrace();
+  bool first;
+  {
+    std::lock_guard<std::mutex> lock(trace->mutex);
+    first = trace->path.IsEmpty();
+    trace->path = path;
+  }
+  if (first) {
+    atexit(AtExit);
+  }
+}
+
+std::string GetTraceJson() {
+  Trace *trace = GetTrace();
+  std::lock_guard<std::mutex> lock(trace->mutex);
+  const std::string pid = std::to_string(GetPid());
+  std::string json = "{\"otherData\":{\"profile_start_ts\":" +
+                     std::to_string(trace->start_epoch_millis) +
+                     "},\"traceEvents\":[\n";
+  json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid +
+          ",\"args\":{\"name\":\"client\"}}";
+  for (const Span &span : trace->spans) {
+    json += ",\n{\"name\":";
+    AppendJsonString(span.name, &json);
+    json += ",\"cat\":\"client\",\"ph\":\"X\",\"ts\":" +
+            std::to_string(span.start_micros) +
+            ",\"dur\":" + std::to_string(span.end_micros - span.start_micros) +
+            ",\"pid\":" + pid + ",\"tid\":" + std::to_string(span.tid) + "}";
+  }
+  json += "\n]}\n";
+  return json;
+}
+
+void WriteTrace() {
+  Path path;
+  {
+    Trace *trace = GetTrace();
+    std::lock_guard<std::mutex> lock(trace->mutex);
+    path = trace->path;
+  }
+  if (!path.IsEmpty()) {
+    // There is nothing to be done if this fails, the trace is best effort.
+    WriteFile(GetTraceJson(), path);
+  }
+}
+
+}  // namespace blaze_util
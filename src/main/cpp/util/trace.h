@@ -0,0 +1,63 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_MAIN_CPP_UTIL_TRACE_H_
+#define BAZEL_SRC_MAIN_CPP_UTIL_TRACE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace blaze_util {
+
+class Path;
+
+// Records what the client spends its time on as spans, which are written out
+// in the Chrome trace event format, like the server's JSON profile:
+//   {
+//     TraceSpan span("ExtractData");
+//     ...
+//   }
+// The spans are always recorded, because the trace file is only known once
+// the startup options have been parsed, but they are only written out if
+// SetTraceFile is called. The timestamps are relative to the start of the
+// client, which is given as "profile_start_ts" like in the server's profile,
+// so the two can be lined up.
+class TraceSpan {
+ public:
+  explicit TraceSpan(const char *name);
+  ~TraceSpan();
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+ private:
+  const char *name_;
+  int64_t start_micros_;
+};
+
+// Writes the trace to `path` when the client exits, including all the spans
+// recorded so far.
+void SetTraceFile(const Path &path);
+
+// Writes the trace now, if there is a trace file. The client must call this
+// before it replaces itself with another process, as it does not exit then.
+void WriteTrace();
+
+// Returns the recorded spans in the Chrome trace event format.
+std::string GetTraceJson();
+
+}  // namespace blaze_util
+
+#endif  // BAZEL_SRC_MAIN_CPP_UTIL_TRACE_H_
@@ -790,22 +790,25 @@ public interface SpawnResult {
     /** Adds execution statistics based on a {@code execution_statistics.proto} file. */
     @CanIgnoreReturnValue
     public Builder setResourceUsageFromProto(Path statisticsPath) throws IOException {
-      ExecutionStatistics.getResourceUsage(statisticsPath)
-          .ifPresent(
-              resourceUsage -> {
-                setUserTimeInMs((int) resourceUsage.getUserExecutionTime().toMillis());
-                setSystemTimeInMs((int) resourceUsage.getSystemExecutionTime().toMillis());
-                setNumBlockOutputOperations(resourceUsage.getBlockOutputOperations());
-                setNumBlockInputOperations(resourceUsage.getBlockInputOperations());
-                setNumInvoluntaryContextSwitches(resourceUsage.getInvoluntaryContextSwitches());
-                // The memory usage of the largest child process. For Darwin maxrss returns size in
-                // bytes.
-                if (OS.getCurrent() == OS.DARWIN) {
-                  setMemoryInKb(resourceUsage.getMaximumResidentSetSize() / 1000);
-                } else {
-                  setMemoryInKb(resourceUsage.getMaximumResidentSetSize());
-                }
-              });
+      ExecutionStatistics.getResourceUsage(statisticsPath).ifPresent(this::setResourceUsage);
+      return this;
+    }
+
+    /** Adds execution statistics collected for the subprocess that ran the spawn. */
+    @CanIgnoreReturnValue
+    public Builder setResourceUsage(ExecutionStatistics.ResourceUsage resourceUsage) {
+      setUserTimeInMs((int) resourceUsage.getUserExecutionTime().toMillis());
+      setSystemTimeInMs((int) resourceUsage.getSystemExecutionTime().toMillis());
+      setNumBlockOutputOperations(resourceUsage.getBlockOutputOperations());
+      setNumBlockInputOperations(resourceUsage.getBlockInputOperations());
+      setNumInvoluntaryContextSwitches(resourceUsage.getInvoluntaryContextSwitches());
+      // The memory usage of the largest child process. For Darwin maxrss returns size in
+      // bytes.
+      if (OS.getCurrent() == OS.DARWIN) {
+        setMemoryInKb(resourceUsage.getMaximumResidentSetSize() / 1000);
+      } else {
+        setMemoryInKb(resourceUsage.getMaximumResidentSetSize());
+      }
       return this;
     }
   }
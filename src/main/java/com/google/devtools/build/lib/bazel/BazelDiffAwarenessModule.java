@@ -20,7 +20,9 @@ import com.google.devtools.build.lib.runtime.BlazeRuntime;
 import com.google.devtools.build.lib.runtime.WorkspaceBuilder;
 import com.google.devtools.build.lib.skyframe.DiffAwareness;
 import com.google.devtools.build.lib.skyframe.LocalDiffAwareness;
+import com.google.devtools.build.lib.util.StringEncoding;
 import com.google.devtools.common.options.OptionsBase;
+import java.nio.file.Path;
 
 /**
  * Provides the {@link DiffAwareness} implementation that uses the Java watch service.
@@ -30,7 +32,13 @@ public class BazelDiffAwarenessModule extends BlazeModule {
   public void workspaceInit(
       BlazeRuntime runtime, BlazeDirectories directories, WorkspaceBuilder builder) {
     // Order here is important - LocalDiffAwareness creation always succeeds, so it must be last.
-    builder.addDiffAwarenessFactory(new LocalDiffAwareness.Factory(ImmutableList.<String>of()));
+    // Its journal lives in the output base, so that it outlives the server.
+    Path journalDirectory =
+        Path.of(
+            StringEncoding.internalToPlatform(
+                directories.getOutputBase().getRelative("fsevents").getPathString()));
+    builder.addDiffAwarenessFactory(
+        new LocalDiffAwareness.Factory(ImmutableList.<String>of(), journalDirectory));
   }
 
   @Override
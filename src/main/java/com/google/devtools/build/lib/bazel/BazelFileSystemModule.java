@@ -22,6 +22,7 @@ import com.google.devtools.build.lib.runtime.BlazeServerStartupOptions;
 import com.google.devtools.build.lib.server.FailureDetails.FailureDetail;
 import com.google.devtools.build.lib.server.FailureDetails.Filesystem;
 import com.google.devtools.build.lib.server.FailureDetails.Filesystem.Code;
+import com.google.devtools.build.lib.unix.NativeWorkerPool;
 import com.google.devtools.build.lib.unix.UnixFileSystem;
 import com.google.devtools.build.lib.util.AbruptExitException;
 import com.google.devtools.build.lib.util.DetailedExitCode;
@@ -32,6 +33,7 @@ import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.JavaIoFileSystem;
 import com.google.devtools.build.lib.vfs.PathFragment;
 import com.google.devtools.build.lib.vfs.bazel.BazelHashFunctions;
+import com.google.devtools.build.lib.windows.WindowsFileOperations;
 import com.google.devtools.build.lib.windows.WindowsFileSystem;
 import com.google.devtools.common.options.OptionsParsingException;
 import com.google.devtools.common.options.OptionsParsingResult;
@@ -89,11 +91,35 @@ public class BazelFileSystemModule extends BlazeModule {
       fs = new WindowsFileSystem(digestHashFunction, options.enableWindowsSymlinks);
     } else {
       if (JniLoader.isJniAvailable()) {
-        fs = new UnixFileSystem(digestHashFunction, options.unixDigestHashAttributeName);
+        fs =
+            new UnixFileSystem(
+                digestHashFunction,
+                options.unixDigestHashAttributeName,
+                options.unixDigestCacheAttributeName);
       } else {
         fs = new JavaIoFileSystem(digestHashFunction);
       }
     }
     return ModuleFileSystem.create(fs);
   }
+
+  @Override
+  public void blazeShutdown() {
+    removeProjectedTrees();
+    NativeWorkerPool.shutdown();
+  }
+
+  @Override
+  public void blazeShutdownOnCrash(DetailedExitCode exitCode) {
+    removeProjectedTrees();
+  }
+
+  private static void removeProjectedTrees() {
+    // Trees presented by the Projected File System (see --experimental_projected_symlink_trees)
+    // can't be read without this process. Deleting them also deletes their output manifests, so
+    // that the next server creates them anew.
+    if (OS.getCurrent() == OS.WINDOWS && JniLoader.isJniAvailable()) {
+      WindowsFileOperations.removeProjectedTrees();
+    }
+  }
 }
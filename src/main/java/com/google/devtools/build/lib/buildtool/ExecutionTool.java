@@ -96,6 +96,7 @@ import com.google.devtools.build.lib.skyframe.BuildResultListener;
 import com.google.devtools.build.lib.skyframe.Builder;
 import com.google.devtools.build.lib.skyframe.ConfiguredTargetKey;
 import com.google.devtools.build.lib.skyframe.IncrementalPackageRoots;
+import com.google.devtools.build.lib.skyframe.OutputTreeWatcher;
 import com.google.devtools.build.lib.skyframe.SkyframeExecutor;
 import com.google.devtools.build.lib.skyframe.TopLevelStatusEvents.SomeExecutionStartedEvent;
 import com.google.devtools.build.lib.util.AbruptExitException;
@@ -148,6 +149,9 @@ public class ExecutionTool {
 
   private boolean informedOutputServiceToStartTheBuild = false;
 
+  /** Watches the output tree between builds, if enabled. */
+  @Nullable private OutputTreeWatcher outputTreeWatcher;
+
   ExecutionTool(CommandEnvironment env, BuildRequest request)
       throws AbruptExitException, InterruptedException {
     this.env = env;
@@ -188,7 +192,9 @@ public class ExecutionTool {
             env.getOutputService(),
             env.getExecRoot(),
             env.getBlazeWorkspace().getBinTools(),
-            env.getWorkspaceName()));
+            env.getWorkspaceName(),
+            request.getOptions(ExecutionOptions.class).projectedSymlinkTrees,
+            request.getOptions(ExecutionOptions.class).runfilesIndex));
     // TODO(philwo) - the ExecutionTool should not add arbitrary dependencies on its own, instead
     // these dependencies should be added to the ActionContextConsumer of the module that actually
     // depends on them.
@@ -524,6 +530,17 @@ public class ExecutionTool {
         return ModifiedFileSet.NOTHING_MODIFIED;
       }
     }
+    // Outputs that are not on the local disk do not change behind our back.
+    outputTreeWatcher =
+        env.getBlazeWorkspace()
+            .getOutputTreeWatcher(
+                env.getDirectories().getOutputPath(env.getWorkspaceName()),
+                request.getPackageOptions().watchOutputTree && outputService.isLocalOnly());
+    if (outputTreeWatcher != null && modifiedOutputFiles == ModifiedFileSet.EVERYTHING_MODIFIED) {
+      try (SilentCloseable c = Profiler.instance().profile("outputTreeWatcher.getModifiedFiles")) {
+        modifiedOutputFiles = outputTreeWatcher.getModifiedFiles(env.getExecRoot());
+      }
+    }
     return modifiedOutputFiles;
   }
 
@@ -589,6 +606,16 @@ public class ExecutionTool {
         // Ignored
       }
     }
+    // The output tree was checked at the start of a completed build, and the changes since are the
+    // build's own.
+    if (outputTreeWatcher != null && buildCompleted && !outputTreeWatcher.reset()) {
+      getReporter()
+          .handle(
+              Event.warning(
+                  "The output tree has more directories than fs.inotify.max_user_watches allows"
+                      + " to watch, ignoring --experimental_watch_output_tree"));
+      env.getBlazeWorkspace().stopWatchingOutputTree();
+    }
     // Finalize the output service last if required, so that if we do throw an exception, we know
     // that all the other code has already run.
     if (informedOutputServiceToStartTheBuild) {
@@ -146,6 +146,10 @@ public final class IgnoredSubdirectories {
     return prefixes;
   }
 
+  public ImmutableList<String> patterns() {
+    return patterns;
+  }
+
   public boolean isEmpty() {
     return this.prefixes.isEmpty();
   }
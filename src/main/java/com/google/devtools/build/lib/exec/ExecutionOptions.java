@@ -381,6 +381,36 @@ public class ExecutionOptions extends OptionsBase {
       converter = ResourceConverter.AssignmentConverter.class)
   public List<Map.Entry<String, Double>> localResources;
 
+  @Option(
+      name = "experimental_projected_symlink_trees",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      metadataTags = OptionMetadataTag.EXPERIMENTAL,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If enabled, runfiles and fileset trees that Bazel would create in-process are instead"
+              + " presented virtually by the file system, where it supports that: on Windows, via"
+              + " the Projected File System if that optional feature is enabled. Entries then only"
+              + " come into existence, as copies of their targets, when they are first accessed,"
+              + " which makes creating the trees nearly free and needs no symlink privileges. The"
+              + " trees can only be read while the Bazel server that created them runs. Where the"
+              + " file system does not support it, the trees are created as usual.")
+  public boolean projectedSymlinkTrees;
+
+  @Option(
+      name = "experimental_runfiles_index",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.EXECUTION_STRATEGY,
+      metadataTags = OptionMetadataTag.EXPERIMENTAL,
+      effectTags = {OptionEffectTag.EXECUTION},
+      help =
+          "If enabled, Bazel writes a MANIFEST.index next to the MANIFEST of each runfiles"
+              + " directory it sets up locally, including with --nobuild_runfile_links. The index"
+              + " is a sorted, binary-searchable form of the manifest that the Windows launcher"
+              + " and the Python runfiles library look runfiles up in instead of parsing the"
+              + " manifest. They ignore it if the manifest changed after it was written.")
+  public boolean runfilesIndex;
+
   @Option(
       name = "experimental_cpu_load_scheduling",
       defaultValue = "false",
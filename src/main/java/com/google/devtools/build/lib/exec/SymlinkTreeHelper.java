@@ -13,11 +13,14 @@
 // limitations under the License.
 package com.google.devtools.build.lib.exec;
 
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+
 import com.google.common.annotations.VisibleForTesting;
 import com.google.common.base.Preconditions;
 import com.google.common.collect.ImmutableList;
 import com.google.common.collect.ImmutableMap;
 import com.google.common.collect.Lists;
+import com.google.common.collect.Maps;
 import com.google.devtools.build.lib.actions.Artifact;
 import com.google.devtools.build.lib.actions.EnvironmentalExecException;
 import com.google.devtools.build.lib.actions.ExecException;
@@ -40,10 +43,15 @@ import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
 import com.google.devtools.build.lib.vfs.SnapshottingFileSystem;
 import com.google.devtools.build.lib.vfs.Symlinks;
+import java.io.BufferedOutputStream;
 import java.io.IOException;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.HashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.TreeMap;
 import javax.annotation.Nullable;
 
 /**
@@ -54,6 +62,8 @@ public final class SymlinkTreeHelper {
   @VisibleForTesting
   public static final String BUILD_RUNFILES = "build-runfiles" + OsUtils.executableExtension();
 
+  private static final byte[] RUNFILES_INDEX_MAGIC = "RFINDEX2".getBytes(ISO_8859_1);
+
   private final Path execRoot;
   private final Path inputManifest;
   private final Path outputManifest;
@@ -119,6 +129,40 @@ public final class SymlinkTreeHelper {
                 : artifact.getPath().asFragment());
   }
 
+  /**
+   * Presents a runfiles tree virtually instead of creating it, if the file system supports that;
+   * see {@link FileSystemUtils#createProjectedTree}. Returns false, having done nothing, if it
+   * doesn't.
+   */
+  public boolean projectRunfilesTree(Map<PathFragment, Artifact> symlinkMap) throws IOException {
+    // Unresolved symlinks present what they point to, like any other entry.
+    return projectTree(
+        Maps.transformValues(
+            symlinkMap, (artifact) -> artifact == null ? null : artifact.getPath().asFragment()));
+  }
+
+  /** Like {@link #projectRunfilesTree}, for a fileset. */
+  public boolean projectFilesetTree(Map<PathFragment, PathFragment> symlinkMap)
+      throws IOException {
+    return projectTree(symlinkMap);
+  }
+
+  private boolean projectTree(Map<PathFragment, PathFragment> symlinkMap) throws IOException {
+    for (PathFragment target : symlinkMap.values()) {
+      if (target != null && !target.isAbsolute()) {
+        // Only symlinks can have relative targets.
+        return false;
+      }
+    }
+    try (SilentCloseable c = Profiler.instance().profile("Project symlink tree")) {
+      if (!FileSystemUtils.createProjectedTree(symlinkTreeRoot, symlinkMap)) {
+        return false;
+      }
+      createWorkspaceSubdirectory();
+      return true;
+    }
+  }
+
   /** Creates a symlink tree by making VFS calls. */
   private <T> void createSymlinksDirectly(
       Map<PathFragment, T> symlinkMap, TargetPathFunction<T> targetPathFn) throws IOException {
@@ -199,6 +243,68 @@ public final class SymlinkTreeHelper {
     }
   }
 
+  /**
+   * Writes MANIFEST.index next to the output manifest, which must be in place already. The index
+   * maps the same paths to the same targets, but can be binary-searched in place by the Windows
+   * launcher and the runfiles libraries instead of being parsed; see build-runfiles.cc for the
+   * format. It records the size and modification time of the output manifest, and readers ignore
+   * it once the manifest no longer has them.
+   */
+  public void writeRunfilesIndex(Map<PathFragment, Artifact> symlinkMap) throws IOException {
+    // Paths are Latin-1 strings whose characters are their bytes, so the natural order of the
+    // strings is the byte order of the paths that build-runfiles sorts by.
+    TreeMap<String, String> entries = new TreeMap<>();
+    long stringsSize = 0;
+    for (Map.Entry<PathFragment, Artifact> entry : symlinkMap.entrySet()) {
+      Artifact artifact = entry.getValue();
+      String target;
+      if (artifact == null) {
+        target = "";
+      } else if (artifact.isSymlink()) {
+        target = artifact.getPath().readSymbolicLink().getPathString();
+      } else {
+        target = artifact.getPath().getPathString();
+      }
+      String path = entry.getKey().getPathString();
+      entries.put(path, target);
+      stringsSize += path.length() + target.length();
+    }
+
+    int headerSize = RUNFILES_INDEX_MAGIC.length + 2 * Integer.BYTES + 2 * Long.BYTES;
+    long stringsOffset = headerSize + (long) entries.size() * 4 * Integer.BYTES;
+    if (stringsOffset + stringsSize > 0xFFFFFFFFL) {
+      throw new IOException("runfiles index would exceed 4 GiB");
+    }
+    FileStatus manifestStatus = outputManifest.stat();
+    ByteBuffer headerAndRecords =
+        ByteBuffer.allocate((int) stringsOffset)
+            .order(ByteOrder.nativeOrder())
+            .put(RUNFILES_INDEX_MAGIC)
+            .putInt(entries.size())
+            .putInt((int) stringsOffset)
+            .putLong(manifestStatus.getSize())
+            .putLong(manifestStatus.getLastModifiedTime());
+    int offset = 0;
+    for (Map.Entry<String, String> entry : entries.entrySet()) {
+      headerAndRecords.putInt(offset).putInt(entry.getKey().length());
+      offset += entry.getKey().length();
+      headerAndRecords.putInt(offset).putInt(entry.getValue().length());
+      offset += entry.getValue().length();
+    }
+
+    Path index =
+        outputManifest.getParentDirectory().getChild(outputManifest.getBaseName() + ".index");
+    Path tempIndex = index.getParentDirectory().getChild(index.getBaseName() + ".tmp");
+    try (OutputStream out = new BufferedOutputStream(tempIndex.getOutputStream())) {
+      out.write(headerAndRecords.array());
+      for (Map.Entry<String, String> entry : entries.entrySet()) {
+        out.write(entry.getKey().getBytes(ISO_8859_1));
+        out.write(entry.getValue().getBytes(ISO_8859_1));
+      }
+    }
+    tempIndex.renameTo(index);
+  }
+
   private void createWorkspaceSubdirectory() throws IOException {
     // Always create the subdirectory corresponding to the workspace (i.e., the main repository).
     // This is required by tests as their working directory, even with --noenable_runfiles. But if
@@ -57,13 +57,22 @@ public final class SymlinkTreeStrategy implements SymlinkTreeActionContext {
   private final Path execRoot;
   private final BinTools binTools;
   private final String workspaceName;
+  private final boolean projectedSymlinkTrees;
+  private final boolean runfilesIndex;
 
   public SymlinkTreeStrategy(
-      OutputService outputService, Path execRoot, BinTools binTools, String workspaceName) {
+      OutputService outputService,
+      Path execRoot,
+      BinTools binTools,
+      String workspaceName,
+      boolean projectedSymlinkTrees,
+      boolean runfilesIndex) {
     this.outputService = outputService;
     this.execRoot = execRoot;
     this.binTools = binTools;
     this.workspaceName = workspaceName;
+    this.projectedSymlinkTrees = projectedSymlinkTrees;
+    this.runfilesIndex = runfilesIndex;
   }
 
   @Override
@@ -95,14 +104,23 @@ public final class SymlinkTreeStrategy implements SymlinkTreeActionContext {
           // Delete symlinks possibly left over by a previous invocation with a different mode.
           // This is required because only the output manifest is considered an action output, so
           // Skyframe does not clear the directory for us.
-          createSymlinkTreeHelper(action).clearRunfilesDirectory();
+          SymlinkTreeHelper helper = createSymlinkTreeHelper(action);
+          helper.clearRunfilesDirectory();
+          maybeWriteRunfilesIndex(action, helper);
         } else if (action.getRunfileSymlinksMode() == RunfileSymlinksMode.INTERNAL) {
           try {
             SymlinkTreeHelper helper = createSymlinkTreeHelper(action);
             if (action.isFilesetTree()) {
-              helper.createFilesetSymlinksDirectly(getFilesetMap(action, actionExecutionContext));
+              Map<PathFragment, PathFragment> symlinks =
+                  getFilesetMap(action, actionExecutionContext);
+              if (!projectedSymlinkTrees || !helper.projectFilesetTree(symlinks)) {
+                helper.createFilesetSymlinksDirectly(symlinks);
+              }
             } else {
-              helper.createRunfilesSymlinksDirectly(getRunfilesMap(action));
+              Map<PathFragment, Artifact> symlinks = getRunfilesMap(action);
+              if (!projectedSymlinkTrees || !helper.projectRunfilesTree(symlinks)) {
+                helper.createRunfilesSymlinksDirectly(symlinks);
+              }
             }
           } catch (IOException e) {
             throw ActionExecutionException.fromExecException(
@@ -111,12 +129,14 @@ public final class SymlinkTreeStrategy implements SymlinkTreeActionContext {
 
           Path inputManifest = actionExecutionContext.getInputPath(action.getInputManifest());
           createOutput(action, actionExecutionContext, inputManifest);
+          maybeWriteRunfilesIndex(action, createSymlinkTreeHelper(action));
         } else {
           Map<String, String> resolvedEnv = new LinkedHashMap<>();
           action.getEnvironment().resolve(resolvedEnv, actionExecutionContext.getClientEnv());
-          createSymlinkTreeHelper(action)
-              .createSymlinksUsingCommand(
-                  binTools, resolvedEnv, actionExecutionContext.getFileOutErr());
+          SymlinkTreeHelper helper = createSymlinkTreeHelper(action);
+          helper.createSymlinksUsingCommand(
+              binTools, resolvedEnv, actionExecutionContext.getFileOutErr());
+          maybeWriteRunfilesIndex(action, helper);
         }
       } catch (ExecException e) {
         throw ActionExecutionException.fromExecException(e, action);
@@ -124,6 +144,19 @@ public final class SymlinkTreeStrategy implements SymlinkTreeActionContext {
     }
   }
 
+  /** Writes the index of a runfiles manifest that is in place, if requested. */
+  private void maybeWriteRunfilesIndex(SymlinkTreeAction action, SymlinkTreeHelper helper)
+      throws ExecException {
+    if (!runfilesIndex || action.isFilesetTree()) {
+      return;
+    }
+    try {
+      helper.writeRunfilesIndex(getRunfilesMap(action));
+    } catch (IOException e) {
+      throw new EnvironmentalExecException(e, Code.SYMLINK_TREE_CREATION_IO_EXCEPTION);
+    }
+  }
+
   private ImmutableMap<PathFragment, PathFragment> getFilesetMap(
       SymlinkTreeAction action, ActionExecutionContext actionExecutionContext) {
     ImmutableList<FilesetOutputSymlink> filesetLinks;
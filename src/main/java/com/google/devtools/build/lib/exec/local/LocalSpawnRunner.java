@@ -52,6 +52,7 @@ import com.google.devtools.build.lib.runtime.ProcessWrapper;
 import com.google.devtools.build.lib.server.FailureDetails;
 import com.google.devtools.build.lib.server.FailureDetails.FailureDetail;
 import com.google.devtools.build.lib.server.FailureDetails.Spawn.Code;
+import com.google.devtools.build.lib.shell.ExecutionStatistics;
 import com.google.devtools.build.lib.shell.Subprocess;
 import com.google.devtools.build.lib.shell.SubprocessBuilder;
 import com.google.devtools.build.lib.shell.TerminationStatus;
@@ -70,6 +71,7 @@ import java.util.ArrayList;
 import java.util.EnumMap;
 import java.util.List;
 import java.util.Map;
+import java.util.Optional;
 import java.util.logging.Level;
 import javax.annotation.Nullable;
 
@@ -412,6 +414,7 @@ public class LocalSpawnRunner implements SpawnRunner {
         spawnResultBuilder.setStartTime(Instant.now());
         Stopwatch executionStopwatch = Stopwatch.createStarted();
         TerminationStatus terminationStatus;
+        Optional<ExecutionStatistics.ResourceUsage> resourceUsage;
         try (SilentCloseable c =
             Profiler.instance()
                 .profile(ProfilerTask.LOCAL_PROCESS_TIME, spawn.getResourceOwner().getMnemonic())) {
@@ -422,6 +425,7 @@ public class LocalSpawnRunner implements SpawnRunner {
             subprocess.waitFor();
             terminationStatus =
                 new TerminationStatus(subprocess.exitValue(), subprocess.timedout());
+            resourceUsage = subprocess.getResourceUsage();
           } catch (InterruptedException | IOException e) {
             subprocess.destroyAndWait();
             throw e;
@@ -470,6 +474,8 @@ public class LocalSpawnRunner implements SpawnRunner {
         }
         if (statisticsPath != null) {
           spawnResultBuilder.setResourceUsageFromProto(statisticsPath);
+        } else {
+          resourceUsage.ifPresent(spawnResultBuilder::setResourceUsage);
         }
         spawnMetrics.setTotalTimeInMs((int) totalTimeStopwatch.elapsed().toMillis());
         spawnResultBuilder.setSpawnMetrics(spawnMetrics.build());
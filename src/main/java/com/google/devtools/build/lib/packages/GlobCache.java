@@ -18,7 +18,11 @@ import static com.google.common.base.Throwables.throwIfUnchecked;
 
 import com.google.common.annotations.VisibleForTesting;
 import com.google.common.base.Preconditions;
+import com.google.common.base.Splitter;
+import com.google.common.collect.ImmutableList;
 import com.google.common.collect.Lists;
+import com.google.common.util.concurrent.Futures;
+import com.google.common.util.concurrent.ListenableFuture;
 import com.google.common.util.concurrent.SettableFuture;
 import com.google.devtools.build.lib.actions.ThreadStateReceiver;
 import com.google.devtools.build.lib.cmdline.IgnoredSubdirectories;
@@ -27,6 +31,8 @@ import com.google.devtools.build.lib.concurrent.ThreadSafety;
 import com.google.devtools.build.lib.packages.Globber.BadGlobException;
 import com.google.devtools.build.lib.profiler.SilentCloseable;
 import com.google.devtools.build.lib.util.Pair;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
+import com.google.devtools.build.lib.vfs.NativeGlobResult;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
 import com.google.devtools.build.lib.vfs.SyscallCache;
@@ -45,6 +51,7 @@ import java.util.concurrent.ExecutionException;
 import java.util.concurrent.Executor;
 import java.util.concurrent.Future;
 import java.util.concurrent.atomic.AtomicBoolean;
+import javax.annotation.Nullable;
 
 /**
  * Caches the results of glob evaluations for a single package. Has lifetime of evaluation of that
@@ -52,6 +59,12 @@ import java.util.concurrent.atomic.AtomicBoolean;
  */
 @ThreadSafety.ThreadCompatible
 public class GlobCache {
+  /** The names of the files that make a directory a package, for {@link #globNatively}. */
+  private static final ImmutableList<String> BUILD_FILE_NAMES =
+      ImmutableList.of(
+          BuildFileName.BUILD_DOT_BAZEL.getFilenameFragment().getPathString(),
+          BuildFileName.BUILD.getFilenameFragment().getPathString());
+
   /**
    * A mapping from glob expressions (e.g. "*.java") to the list of files it matched (in the order
    * returned by VFS) at the time the package was constructed. Required for sound dependency
@@ -74,6 +87,8 @@ public class GlobCache {
 
   private final int maxDirectoriesToEagerlyVisit;
 
+  private final boolean nativeGlobbing;
+
   /** The thread pool for glob evaluation. */
   private final Executor globExecutor;
 
@@ -94,6 +109,9 @@ public class GlobCache {
    *     glob for a given package, in order to warm the filesystem. -1 means do no eager traversal.
    *     See {@link
    *     com.google.devtools.build.lib.pkgcache.PackageOptions#maxDirectoriesToEagerlyVisitInGlobbing}.
+   * @param nativeGlobbing whether to evaluate the globs with {@link FileSystemUtils#globNatively}
+   *     where possible, see {@link
+   *     com.google.devtools.build.lib.pkgcache.PackageOptions#experimentalNativeGlob}.
    */
   public GlobCache(
       final Path packageDirectory,
@@ -103,6 +121,7 @@ public class GlobCache {
       SyscallCache syscallCache,
       Executor globExecutor,
       int maxDirectoriesToEagerlyVisit,
+      boolean nativeGlobbing,
       ThreadStateReceiver threadStateReceiverForMetrics) {
     this.packageDirectory = Preconditions.checkNotNull(packageDirectory);
     this.packageId = Preconditions.checkNotNull(packageId);
@@ -117,6 +136,7 @@ public class GlobCache {
                 });
     this.syscallCache = syscallCache;
     this.maxDirectoriesToEagerlyVisit = maxDirectoriesToEagerlyVisit;
+    this.nativeGlobbing = nativeGlobbing;
 
     Preconditions.checkNotNull(locator);
     this.packageLocator = locator;
@@ -221,6 +241,29 @@ public class GlobCache {
     if (error != null) {
       throw new BadGlobException(error + " (in glob pattern '" + pattern + "')");
     }
+    ImmutableList<PathFragment> prunedDirectories =
+        nativeGlobbing ? getIgnoredDirectoriesBelowPackage() : null;
+    if (prunedDirectories != null) {
+      return Futures.submitAsync(
+          () -> {
+            List<Path> result = globNatively(pattern, globberOperation, prunedDirectories);
+            if (result != null) {
+              return Futures.immediateFuture(result);
+            }
+            try {
+              return unixGlobAsync(pattern, globberOperation);
+            } catch (BadGlobException e) {
+              throw new IllegalStateException("pattern checked above", e);
+            }
+          },
+          globExecutor);
+    }
+    return unixGlobAsync(pattern, globberOperation);
+  }
+
+  private ListenableFuture<List<Path>> unixGlobAsync(
+      String pattern, Globber.Operation globberOperation)
+      throws BadGlobException {
     try {
       return new UnixGlob.Builder(packageDirectory, syscallCache)
           .addPattern(pattern)
@@ -232,6 +275,71 @@ public class GlobCache {
     }
   }
 
+  /**
+   * Returns the ignored directories below the package directory, relative to it, or null if they
+   * are not all given by prefix.
+   */
+  @Nullable
+  private ImmutableList<PathFragment> getIgnoredDirectoriesBelowPackage() {
+    if (!ignoredSubdirectories.patterns().isEmpty()) {
+      return null;
+    }
+    PathFragment packageFragment = packageId.getPackageFragment();
+    ImmutableList.Builder<PathFragment> result = ImmutableList.builder();
+    for (PathFragment prefix : ignoredSubdirectories.prefixes()) {
+      if (packageFragment.startsWith(prefix)) {
+        // Every subdirectory is ignored.
+        return null;
+      }
+      if (prefix.startsWith(packageFragment)) {
+        result.add(prefix.relativeTo(packageFragment));
+      }
+    }
+    return result.build();
+  }
+
+  /**
+   * Evaluates a glob natively, with the directories that hold a build file taken to be the
+   * subpackages. Returns null if the file system cannot, or if the package locator does not agree
+   * that each of the directories not traversed for its build file is a subpackage, e.g. for a
+   * deleted package; {@link UnixGlob} then asks the locator about every directory instead.
+   */
+  @Nullable
+  private List<Path> globNatively(
+      String pattern,
+      Globber.Operation globberOperation,
+      ImmutableList<PathFragment> prunedDirectories) {
+    NativeGlobResult result =
+        FileSystemUtils.globNatively(
+            packageDirectory,
+            Splitter.on('/').splitToList(pattern),
+            BUILD_FILE_NAMES,
+            prunedDirectories);
+    if (result == null) {
+      return null;
+    }
+    for (PathFragment boundary : result.boundaries()) {
+      if (!isSubPackage(packageDirectory.getRelative(boundary))) {
+        return null;
+      }
+    }
+    GlobUnixPathDiscriminator discriminator = new GlobUnixPathDiscriminator(globberOperation);
+    List<Path> paths = new ArrayList<>();
+    for (PathFragment file : result.files()) {
+      Path path = packageDirectory.getRelative(file);
+      if (discriminator.shouldIncludePathInResult(path, /* isDirectory= */ false)) {
+        paths.add(path);
+      }
+    }
+    for (PathFragment directory : result.directories()) {
+      Path path = packageDirectory.getRelative(directory);
+      if (discriminator.shouldIncludePathInResult(path, /* isDirectory= */ true)) {
+        paths.add(path);
+      }
+    }
+    return paths;
+  }
+
   /** Sanitize the future exceptions - the only expected checked exception is IOException. */
   private static List<Path> fromFuture(Future<List<Path>> future)
       throws IOException, InterruptedException {
@@ -88,6 +88,8 @@ public final class PackageFactory {
 
   private int maxDirectoriesToEagerlyVisitInGlobbing;
 
+  private boolean nativeGlobbing;
+
   private final PackageSettings packageSettings;
   private final PackageValidator packageValidator;
   private final PackageOverheadEstimator packageOverheadEstimator;
@@ -202,6 +204,14 @@ public final class PackageFactory {
     this.maxDirectoriesToEagerlyVisitInGlobbing = maxDirectoriesToEagerlyVisitInGlobbing;
   }
 
+  /**
+   * Sets whether globs are evaluated natively where the file system supports it. See {@link
+   * com.google.devtools.build.lib.pkgcache.PackageOptions#experimentalNativeGlob}.
+   */
+  public void setNativeGlobbing(boolean nativeGlobbing) {
+    this.nativeGlobbing = nativeGlobbing;
+  }
+
   /** Returns the {@link RuleClassProvider} of this {@link PackageFactory}. */
   public RuleClassProvider getRuleClassProvider() {
     return ruleClassProvider;
@@ -278,6 +288,7 @@ public final class PackageFactory {
             syscallCache,
             executor,
             maxDirectoriesToEagerlyVisitInGlobbing,
+            nativeGlobbing,
             threadStateReceiverForMetrics));
   }
 
@@ -165,6 +165,17 @@ public class PackageOptions extends OptionsBase {
   )
   public int maxDirectoriesToEagerlyVisitInGlobbing;
 
+  @Option(
+      name = "experimental_native_glob",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.LOADING_AND_ANALYSIS},
+      help =
+          "If enabled, the glob() of a package is evaluated by native code in one go where the "
+              + "file system supports it, rather than with a readdir and a stat per directory and "
+              + "per match. Only takes effect with a single package path entry.")
+  public boolean experimentalNativeGlob;
+
   @Option(
       name = "fetch",
       defaultValue = "true",
@@ -188,6 +199,18 @@ public class PackageOptions extends OptionsBase {
               + "previous run's cache.")
   public boolean checkOutputFiles;
 
+  @Option(
+      name = "experimental_watch_output_tree",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.UNKNOWN},
+      help =
+          "On Linux, watch the local output tree with inotify between builds, so that only the"
+              + " output files that changed since the previous build are checked for modifications,"
+              + " rather than all of them. Changes made to output files while a build runs are"
+              + " not noticed. Takes an inotify watch per output directory.")
+  public boolean watchOutputTree;
+
   /** A converter from strings containing comma-separated names of packages to lists of strings. */
   public static class CommaSeparatedPackageNameListConverter
       extends Converter.Contextless<List<PackageIdentifier>> {
@@ -30,6 +30,7 @@ import com.google.devtools.build.lib.actions.ResourceEstimator;
 import com.google.devtools.build.lib.bugreport.BugReporter;
 import com.google.devtools.build.lib.profiler.Profiler.CounterSeriesCollector;
 import com.google.devtools.build.lib.skyframe.SkyFunctions;
+import com.google.devtools.build.lib.unix.NativeWorkerPool;
 import com.google.devtools.build.lib.unix.ProcMeminfoParser;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.util.ResourceUsage;
@@ -83,6 +84,7 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
 
   private final ResourceEstimator resourceEstimator;
   private final boolean collectPressureStallIndicators;
+  private final boolean collectProcessStats;
 
   private final boolean collectSkyframeCounts;
 
@@ -98,6 +100,7 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
       boolean collectSystemNetworkUsage,
       boolean collectResourceManagerEstimation,
       boolean collectPressureStallIndicators,
+      boolean collectProcessStats,
       boolean collectSkyframeCounts) {
     this.bugReporter = checkNotNull(bugReporter);
     this.collectWorkerDataInProfiler = collectWorkerDataInProfiler;
@@ -107,6 +110,7 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
     this.collectResourceManagerEstimation = collectResourceManagerEstimation;
     this.resourceEstimator = resourceEstimator;
     this.collectPressureStallIndicators = collectPressureStallIndicators;
+    this.collectProcessStats = collectProcessStats;
     this.collector = new Collector();
 
     Preconditions.checkState(
@@ -156,6 +160,15 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
     if (collectPressureStallIndicators && OS.getCurrent() == OS.LINUX) {
       collectors.add(new PressureStallIndicatorCollector());
     }
+    if (collectProcessStats) {
+      ProcessStats.Counters counters = ProcessStats.sample();
+      if (counters != null) {
+        collectors.add(new ProcessStatsCollector(counters));
+      }
+      if (NativeWorkerPool.getStats() != null) {
+        collectors.add(new NativeWorkerPoolCollector());
+      }
+    }
 
     if (collectSkyframeCounts) {
       collectors.add(new SkyframeCountsCollector(graph));
@@ -517,6 +530,107 @@ public class CollectLocalResourceUsage implements LocalResourceCollector {
     }
   }
 
+  private static class ProcessStatsCollector implements CounterSeriesCollector {
+    private static final CounterSeriesTask READ_BYTES =
+        new CounterSeriesTask(
+            "Disk I/O (Bazel)", "read (MB/s)", CounterSeriesTask.Color.THREAD_STATE_IOWAIT);
+    private static final CounterSeriesTask WRITE_BYTES =
+        new CounterSeriesTask(
+            "Disk I/O (Bazel)", "write (MB/s)", CounterSeriesTask.Color.THREAD_STATE_SLEEPING);
+    private static final CounterSeriesTask VOLUNTARY_CONTEXT_SWITCHES =
+        new CounterSeriesTask(
+            "Context switches (Bazel)",
+            "voluntary (per second)",
+            CounterSeriesTask.Color.THREAD_STATE_RUNNABLE);
+    private static final CounterSeriesTask INVOLUNTARY_CONTEXT_SWITCHES =
+        new CounterSeriesTask(
+            "Context switches (Bazel)",
+            "involuntary (per second)",
+            CounterSeriesTask.Color.TERRIBLE);
+    private static final CounterSeriesTask RUN_QUEUE_WAIT =
+        new CounterSeriesTask(
+            "Scheduler wait (Bazel)",
+            "run queue wait (threads)",
+            CounterSeriesTask.Color.THREAD_STATE_UNINTERRUPTIBLE);
+    private static final CounterSeriesTask IO_WAIT =
+        new CounterSeriesTask(
+            "Scheduler wait (Bazel)", "i/o wait (threads)", CounterSeriesTask.Color.YELLOW);
+
+    private ProcessStats.Counters previous;
+
+    private ProcessStatsCollector(ProcessStats.Counters initial) {
+      this.previous = initial;
+    }
+
+    @Override
+    public void collect(double deltaNanos, BiConsumer<CounterSeriesTask, Double> consumer) {
+      ProcessStats.Counters next = ProcessStats.sample();
+      if (next == null) {
+        return;
+      }
+      double deltaSeconds = deltaNanos / 1e9;
+      // The waits are summed over all threads, so per nanosecond they are the average number of
+      // threads waiting, like the CPU usage is the average number of threads running.
+      accept(consumer, READ_BYTES, previous.readBytes(), next.readBytes(), deltaSeconds * 1e6);
+      accept(consumer, WRITE_BYTES, previous.writeBytes(), next.writeBytes(), deltaSeconds * 1e6);
+      accept(
+          consumer,
+          VOLUNTARY_CONTEXT_SWITCHES,
+          previous.voluntaryContextSwitches(),
+          next.voluntaryContextSwitches(),
+          deltaSeconds);
+      accept(
+          consumer,
+          INVOLUNTARY_CONTEXT_SWITCHES,
+          previous.involuntaryContextSwitches(),
+          next.involuntaryContextSwitches(),
+          deltaSeconds);
+      accept(
+          consumer,
+          RUN_QUEUE_WAIT,
+          previous.runQueueWaitNanos(),
+          next.runQueueWaitNanos(),
+          deltaNanos);
+      accept(consumer, IO_WAIT, previous.ioWaitNanos(), next.ioWaitNanos(), deltaNanos);
+      previous = next;
+    }
+
+    private static void accept(
+        BiConsumer<CounterSeriesTask, Double> consumer,
+        CounterSeriesTask type,
+        long previousValue,
+        long nextValue,
+        double divisor) {
+      // Unavailable counters are -1. The per-thread ones shrink when threads exit.
+      if (previousValue < 0 || nextValue < 0) {
+        return;
+      }
+      consumer.accept(type, Math.max(0, nextValue - previousValue) / divisor);
+    }
+  }
+
+  private static class NativeWorkerPoolCollector implements CounterSeriesCollector {
+    private static final CounterSeriesTask ACTIVE =
+        new CounterSeriesTask(
+            "Native worker pool",
+            "active (threads)",
+            CounterSeriesTask.Color.THREAD_STATE_RUNNING);
+    private static final CounterSeriesTask QUEUE_DEPTH =
+        new CounterSeriesTask(
+            "Native worker pool",
+            "queued (calls)",
+            CounterSeriesTask.Color.THREAD_STATE_RUNNABLE);
+
+    @Override
+    public void collect(double deltaNanos, BiConsumer<CounterSeriesTask, Double> consumer) {
+      NativeWorkerPool.Stats stats = NativeWorkerPool.getStats();
+      if (stats != null) {
+        consumer.accept(ACTIVE, (double) stats.active());
+        consumer.accept(QUEUE_DEPTH, (double) stats.queueDepth());
+      }
+    }
+  }
+
   private static class SkyframeCountsCollector implements CounterSeriesCollector {
     private record SkyFunctionProfilerTasks(
         CounterSeriesTask totalCounter, CounterSeriesTask doneCounter) {}
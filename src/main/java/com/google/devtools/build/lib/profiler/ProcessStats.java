@@ -0,0 +1,68 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.profiler;
+
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.build.lib.util.OS;
+import javax.annotation.Nullable;
+
+/** Utility class for querying the I/O and scheduler statistics of the Bazel server process. */
+public class ProcessStats {
+
+  static {
+    JniLoader.loadJni();
+  }
+
+  private ProcessStats() {}
+
+  /**
+   * Cumulative counters of the process since it started. Each is -1 if the platform does not
+   * provide it.
+   *
+   * @param readBytes Number of bytes read from storage.
+   * @param writeBytes Number of bytes written to storage.
+   * @param voluntaryContextSwitches Number of times a thread gave up the CPU, usually to block.
+   * @param involuntaryContextSwitches Number of times a thread was preempted.
+   * @param runQueueWaitNanos Time threads spent runnable but waiting for a CPU, summed over all
+   *     threads.
+   * @param ioWaitNanos Time threads spent waiting for block I/O, summed over all threads.
+   */
+  public record Counters(
+      long readBytes,
+      long writeBytes,
+      long voluntaryContextSwitches,
+      long involuntaryContextSwitches,
+      long runQueueWaitNanos,
+      long ioWaitNanos) {}
+
+  /**
+   * Returns the current counters, or null if they cannot be collected on this platform. Only
+   * makes a single JNI call, so it is cheap enough to call on every profiler sample.
+   */
+  @Nullable
+  public static Counters sample() {
+    if (!JniLoader.isJniAvailable()
+        || (OS.getCurrent() != OS.LINUX && OS.getCurrent() != OS.DARWIN)) {
+      return null;
+    }
+    long[] counters = new long[6];
+    if (!sampleNative(counters)) {
+      return null;
+    }
+    return new Counters(
+        counters[0], counters[1], counters[2], counters[3], counters[4], counters[5]);
+  }
+
+  private static native boolean sampleNative(long[] counters);
+}
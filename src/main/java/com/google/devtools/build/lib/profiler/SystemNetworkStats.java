@@ -16,6 +16,7 @@ package com.google.devtools.build.lib.profiler;
 import static java.nio.charset.StandardCharsets.UTF_8;
 import static java.util.Objects.requireNonNull;
 
+import com.google.common.annotations.VisibleForTesting;
 import com.google.common.base.Splitter;
 import com.google.devtools.build.lib.jni.JniLoader;
 import com.google.devtools.build.lib.util.OS;
@@ -54,18 +55,16 @@ public class SystemNetworkStats {
 
   public static Map<String, NetIoCounter> getNetIoCounters() throws IOException {
     Map<String, NetIoCounter> counters = new HashMap<>();
-    switch (OS.getCurrent()) {
-      case LINUX -> getNetIoCountersLinux(counters);
-      default -> {
-        if (JniLoader.isJniAvailable()) {
-          getNetIoCountersNative(counters);
-        }
-      }
+    if (JniLoader.isJniAvailable()) {
+      getNetIoCountersNative(counters);
+    } else if (OS.getCurrent() == OS.LINUX) {
+      getNetIoCountersLinux(counters);
     }
     return counters;
   }
 
-  private static void getNetIoCountersLinux(Map<String, NetIoCounter> counters) throws IOException {
+  @VisibleForTesting
+  static void getNetIoCountersLinux(Map<String, NetIoCounter> counters) throws IOException {
     List<String> lines = Files.readAllLines(Paths.get("/proc/net/dev"), UTF_8);
 
     // skip table header (first 2 lines)
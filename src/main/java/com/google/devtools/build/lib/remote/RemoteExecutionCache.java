@@ -49,6 +49,7 @@ import com.google.devtools.build.lib.remote.merkletree.MerkleTree.ContentSource;
 import com.google.devtools.build.lib.remote.options.RemoteOptions;
 import com.google.devtools.build.lib.remote.util.DigestUtil;
 import com.google.devtools.build.lib.remote.util.RxUtils.TransferResult;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.protobuf.ByteString;
 import com.google.protobuf.Message;
@@ -64,8 +65,10 @@ import io.reactivex.rxjava3.disposables.Disposable;
 import io.reactivex.rxjava3.subjects.AsyncSubject;
 import java.io.IOException;
 import java.io.InputStream;
+import java.util.ArrayList;
 import java.util.List;
 import java.util.Map;
+import java.util.Set;
 import java.util.concurrent.atomic.AtomicReference;
 import javax.annotation.Nullable;
 
@@ -154,7 +157,7 @@ public class RemoteExecutionCache extends CombinedCache {
                     Flowable.using(
                         () -> result,
                         uploadTasks ->
-                            findMissingBlobs(context, uploadTasks)
+                            findMissingBlobs(context, merkleTree, uploadTasks)
                                 .flatMapPublisher(this::waitForUploadTasks),
                         uploadTasks -> {
                           for (UploadTask uploadTask : uploadTasks) {
@@ -340,8 +343,22 @@ public class RemoteExecutionCache extends CombinedCache {
         });
   }
 
+  /**
+   * Has the local input files that are missing from the cache read ahead, so that the disk reads
+   * for the next ones overlap with uploading the current one.
+   */
+  private static void prefetchMissingFiles(MerkleTree merkleTree, Set<Digest> missingDigests) {
+    List<Path> paths = new ArrayList<>();
+    for (Digest digest : missingDigests) {
+      if (merkleTree.getFileByDigest(digest) instanceof ContentSource.PathSource(Path path)) {
+        paths.add(path);
+      }
+    }
+    FileSystemUtils.prefetchForReading(paths);
+  }
+
   private Single<List<UploadTask>> findMissingBlobs(
-      RemoteActionExecutionContext context, List<UploadTask> uploadTasks) {
+      RemoteActionExecutionContext context, MerkleTree merkleTree, List<UploadTask> uploadTasks) {
     return Single.using(
         () -> Profiler.instance().profile("findMissingDigests"),
         ignored ->
@@ -363,6 +380,7 @@ public class RemoteExecutionCache extends CombinedCache {
                                 directExecutor())
                             .map(
                                 missingDigests -> {
+                                  prefetchMissingFiles(merkleTree, missingDigests);
                                   for (UploadTask uploadTask : uploadTasks) {
                                     if (uploadTask.continuation != null) {
                                       uploadTask.continuation.onSuccess(
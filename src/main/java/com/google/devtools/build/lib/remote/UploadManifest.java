@@ -69,8 +69,10 @@ import com.google.devtools.build.lib.server.FailureDetails.FailureDetail;
 import com.google.devtools.build.lib.server.FailureDetails.RemoteExecution;
 import com.google.devtools.build.lib.server.FailureDetails.RemoteExecution.Code;
 import com.google.devtools.build.lib.util.io.FileOutErr;
+import com.google.devtools.build.lib.vfs.DirectoryMerkleTree;
 import com.google.devtools.build.lib.vfs.Dirent;
 import com.google.devtools.build.lib.vfs.FileStatus;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
 import com.google.devtools.build.lib.vfs.Symlinks;
@@ -544,7 +546,23 @@ public class UploadManifest {
       Tree.getDescriptor().findFieldByName("children").getNumber();
 
   private void addDirectory(Path dir) throws ExecException, IOException, InterruptedException {
-    ByteString treeBlob = new DirectoryBuilder(dir).build();
+    ByteString treeBlob = null;
+    // The native tree is digested with the function of the file system and has the same bytes as
+    // the one DirectoryBuilder builds; anything unusual in the directory is left to the latter.
+    if (dir.getFileSystem().getDigestFunction() == digestUtil.getDigestHashFunction()) {
+      DirectoryMerkleTree tree = FileSystemUtils.computeMerkleTreeNatively(dir);
+      if (tree != null) {
+        for (int i = 0; i < tree.files().length; i++) {
+          digestToFile.put(
+              DigestUtil.buildDigest(tree.getFileDigest(i), tree.fileSizes()[i]),
+              dir.getRelative(tree.files()[i]));
+        }
+        treeBlob = ByteString.copyFrom(tree.tree());
+      }
+    }
+    if (treeBlob == null) {
+      treeBlob = new DirectoryBuilder(dir).build();
+    }
     Digest treeDigest = digestUtil.compute(treeBlob.toByteArray());
 
     result
@@ -61,6 +61,9 @@ import javax.annotation.Nullable;
  * worth the extra complexity; assuming that the collection policy is not overly aggressive, the
  * likelihood of a race condition is fairly small, and an affected build is able to automatically
  * recover by retrying.
+ *
+ * <p>If the garbage collector keeps a {@link DiskCacheIndex} of the cache, the entries stored and
+ * retrieved are recorded in it as well.
  */
 public class DiskCacheClient {
 
@@ -68,8 +71,10 @@ public class DiskCacheClient {
   private static final String CAS_DIR = "cas";
   private static final String TMP_DIR = "tmp";
 
+  private final Path root;
   private final ImmutableMap<Store, Path> storeRootMap;
   private final Path tmpRoot;
+  @Nullable private final DiskCacheIndex index;
 
   private final ListeningExecutorService executorService;
   private final boolean verifyDownloads;
@@ -94,10 +99,13 @@ public class DiskCacheClient {
     this.storeRootMap =
         ImmutableMap.of(Store.AC, fnRoot.getChild(AC_DIR), Store.CAS, fnRoot.getChild(CAS_DIR));
 
+    this.root = root;
     this.tmpRoot = root.getChild(TMP_DIR);
 
     fnRoot.createDirectoryAndParents();
     tmpRoot.createDirectoryAndParents();
+
+    this.index = DiskCacheIndex.open(root);
   }
 
   /**
@@ -120,6 +128,9 @@ public class DiskCacheClient {
     } catch (FileNotFoundException e) {
       return false;
     }
+    if (index != null) {
+      index.touch(path.relativeTo(root).getPathString());
+    }
     return true;
   }
 
@@ -137,8 +148,16 @@ public class DiskCacheClient {
       return;
     }
 
+    long size = index != null ? src.getFileSize() : 0;
     target.getParentDirectory().createDirectoryAndParents();
     src.renameTo(target);
+    recordStored(target, size);
+  }
+
+  private void recordStored(Path path, long size) {
+    if (index != null) {
+      index.record(path.relativeTo(root).getPathString(), size);
+    }
   }
 
   private ListenableFuture<Void> download(Digest digest, OutputStream out, Store store) {
@@ -262,7 +281,11 @@ public class DiskCacheClient {
         });
   }
 
-  public void close() {}
+  public void close() {
+    if (index != null) {
+      index.close();
+    }
+  }
 
   public ListenableFuture<Void> uploadFile(Digest digest, Path file) {
     return executorService.submit(
@@ -315,8 +338,9 @@ public class DiskCacheClient {
     Path temp = getTempPath();
 
     try {
+      long size;
       try (OutputStream out = temp.getOutputStream()) {
-        ByteStreams.copy(in, out);
+        size = ByteStreams.copy(in, out);
         // Fsync temp before we rename it to avoid data loss in the case of machine
         // crashes (the OS may reorder the writes and the rename).
         if (out instanceof FileOutputStream fos) {
@@ -325,6 +349,7 @@ public class DiskCacheClient {
       }
       path.getParentDirectory().createDirectoryAndParents();
       temp.renameTo(path);
+      recordStored(path, size);
     } catch (IOException e) {
       try {
         temp.delete();
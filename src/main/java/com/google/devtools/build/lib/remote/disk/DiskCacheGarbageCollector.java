@@ -37,6 +37,7 @@ import java.util.Optional;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.atomic.AtomicBoolean;
 import java.util.concurrent.atomic.LongAdder;
+import javax.annotation.Nullable;
 
 /**
  * A garbage collector for the disk cache.
@@ -45,10 +46,20 @@ import java.util.concurrent.atomic.LongAdder;
  * candidates for deletion according to a {@link CollectionPolicy}, and deleting them. This process
  * may take a significant amount of time on large disk caches and slow filesystems, and may be
  * interrupted at any time.
+ *
+ * <p>With a {@link DiskCacheIndex}, the candidates are taken from the index instead, and the cache
+ * is only enumerated to build the index, when there is none yet, it has missed entries or it is
+ * older than {@link #FULL_SCAN_INTERVAL}.
  */
 public final class DiskCacheGarbageCollector {
   private static final ImmutableSet<String> EXCLUDED_DIRS = ImmutableSet.of("tmp", "gc");
 
+  /**
+   * How long an index is trusted before the cache is enumerated again, to pick up the entries
+   * stored by processes that do not maintain the index.
+   */
+  private static final Duration FULL_SCAN_INTERVAL = Duration.ofDays(1);
+
   /**
    * Describes a disk cache entry.
    *
@@ -148,6 +159,7 @@ public final class DiskCacheGarbageCollector {
   private final CollectionPolicy policy;
   private final ExecutorService executorService;
   private final ImmutableSet<Path> excludedDirs;
+  private final boolean useIndex;
 
   /**
    * Creates a new garbage collector.
@@ -158,10 +170,25 @@ public final class DiskCacheGarbageCollector {
    */
   public DiskCacheGarbageCollector(
       Path root, ExecutorService executorService, CollectionPolicy policy) {
+    this(root, executorService, policy, /* useIndex= */ false);
+  }
+
+  /**
+   * Creates a new garbage collector.
+   *
+   * @param root the root directory of the disk cache
+   * @param executorService the executor service to schedule I/O operations onto
+   * @param policy the garbage collection policy to use
+   * @param useIndex whether to maintain a {@link DiskCacheIndex} and collect from it; otherwise an
+   *     existing index is deleted, since it would go stale
+   */
+  public DiskCacheGarbageCollector(
+      Path root, ExecutorService executorService, CollectionPolicy policy, boolean useIndex) {
     this.root = root;
     this.policy = policy;
     this.executorService = executorService;
     this.excludedDirs = EXCLUDED_DIRS.stream().map(root::getChild).collect(toImmutableSet());
+    this.useIndex = useIndex && DiskCacheIndex.isSupported();
   }
 
   @VisibleForTesting
@@ -190,22 +217,90 @@ public final class DiskCacheGarbageCollector {
 
   private CollectionStats runUnderLock() throws IOException, InterruptedException {
     Instant startTime = Instant.now();
+    if (!useIndex) {
+      DiskCacheIndex.getIndexPath(root).delete();
+      return collectFromScan(startTime, /* index= */ null);
+    }
+    try (DiskCacheIndex index = DiskCacheIndex.open(root)) {
+      if (index != null
+          && index.isComplete()
+          && Duration.between(Instant.ofEpochMilli(index.getScanTimeMillis()), startTime)
+                  .compareTo(FULL_SCAN_INTERVAL)
+              < 0) {
+        return collectFromIndex(startTime, index);
+      }
+    }
+    return collectFromScan(startTime, root);
+  }
+
+  /**
+   * Collects the entries found by enumerating the cache, first building a new index from them if
+   * {@code indexRoot} is set.
+   */
+  private CollectionStats collectFromScan(Instant startTime, @Nullable Path indexRoot)
+      throws IOException, InterruptedException {
     EntryScanner scanner = new EntryScanner();
-    EntryDeleter deleter = new EntryDeleter();
 
     List<Entry> allEntries = scanner.scan();
-    List<Entry> entriesToDelete = policy.getEntriesToDelete(allEntries);
 
-    for (Entry entry : entriesToDelete) {
-      deleter.delete(entry);
+    DiskCacheIndex index = null;
+    if (indexRoot != null) {
+      String[] paths = new String[allEntries.size()];
+      long[] sizes = new long[paths.length];
+      long[] mtimes = new long[paths.length];
+      for (int i = 0; i < paths.length; i++) {
+        Entry entry = allEntries.get(i);
+        paths[i] = entry.path();
+        sizes[i] = entry.size();
+        mtimes[i] = entry.mtime();
+      }
+      DiskCacheIndex.create(indexRoot, paths, sizes, mtimes, startTime.toEpochMilli());
+      index = DiskCacheIndex.open(indexRoot);
+    }
+
+    try {
+      EntryDeleter deleter = new EntryDeleter(index, /* entriesFromIndex= */ false);
+      List<Entry> entriesToDelete = policy.getEntriesToDelete(allEntries);
+
+      for (Entry entry : entriesToDelete) {
+        deleter.delete(entry);
+      }
+
+      DeletionStats deletionStats = deleter.await();
+      Duration elapsedTime = Duration.between(startTime, Instant.now());
+
+      return new CollectionStats(
+          allEntries.size(),
+          allEntries.stream().mapToLong(Entry::size).sum(),
+          deletionStats.deletedEntries(),
+          deletionStats.deletedBytes(),
+          deletionStats.concurrentUpdate(),
+          elapsedTime);
+    } finally {
+      if (index != null) {
+        index.close();
+      }
+    }
+  }
+
+  /** Collects the entries selected by the index, without enumerating the cache. */
+  private CollectionStats collectFromIndex(Instant startTime, DiskCacheIndex index)
+      throws IOException, InterruptedException {
+    EntryDeleter deleter = new EntryDeleter(index, /* entriesFromIndex= */ true);
+    DiskCacheIndex.Evictions evictions =
+        index.selectEvictions(policy.maxSizeBytes().orElse(-1L), policy.getTimeCutoff());
+
+    for (int i = 0; i < evictions.paths().length; i++) {
+      deleter.delete(
+          new Entry(evictions.paths()[i], evictions.sizes()[i], evictions.mtimes()[i]));
     }
 
     DeletionStats deletionStats = deleter.await();
     Duration elapsedTime = Duration.between(startTime, Instant.now());
 
     return new CollectionStats(
-        allEntries.size(),
-        allEntries.stream().mapToLong(Entry::size).sum(),
+        evictions.totalEntries(),
+        evictions.totalBytes(),
         deletionStats.deletedEntries(),
         deletionStats.deletedBytes(),
         deletionStats.concurrentUpdate(),
@@ -264,18 +359,30 @@ public final class DiskCacheGarbageCollector {
     }
   }
 
-  /** Deletes disk cache entries, performing I/O in parallel. */
+  /**
+   * Deletes disk cache entries, performing I/O in parallel, and removes them from the index if
+   * there is one.
+   */
   private final class EntryDeleter extends AbstractQueueVisitor {
     private final LongAdder deletedEntries = new LongAdder();
     private final LongAdder deletedBytes = new LongAdder();
     private final AtomicBoolean concurrentUpdate = new AtomicBoolean(false);
+    @Nullable private final DiskCacheIndex index;
+    private final boolean entriesFromIndex;
 
-    EntryDeleter() {
+    /**
+     * @param index the index to keep up to date, if any
+     * @param entriesFromIndex whether the entries come from the index rather than from a scan, so
+     *     that their mtime is the last access the index knows of rather than that of the file
+     */
+    EntryDeleter(@Nullable DiskCacheIndex index, boolean entriesFromIndex) {
       super(
           executorService,
           ExecutorOwnership.SHARED,
           ExceptionHandlingMode.FAIL_FAST,
           ErrorClassifier.DEFAULT);
+      this.index = index;
+      this.entriesFromIndex = entriesFromIndex;
     }
 
     /** Enqueues an entry to be deleted. */
@@ -288,13 +395,23 @@ public final class DiskCacheGarbageCollector {
               if (status == null) {
                 // The entry is already gone.
                 concurrentUpdate.set(true);
+                removeFromIndex(entry);
                 return;
               }
-              if (status.getLastModifiedTime() != entry.mtime()) {
+              // The index records an access after the file is touched, and so never has an
+              // earlier time than the file unless a process that does not maintain it touched it.
+              if (entriesFromIndex
+                  ? status.getLastModifiedTime() > entry.mtime()
+                  : status.getLastModifiedTime() != entry.mtime()) {
                 // The entry was likely accessed by a build since we statted it.
                 concurrentUpdate.set(true);
+                if (entriesFromIndex) {
+                  // Don't select it again until it is old enough once more.
+                  index.touch(entry.path());
+                }
                 return;
               }
+              removeFromIndex(entry);
               if (path.delete()) {
                 deletedEntries.increment();
                 deletedBytes.add(entry.size());
@@ -308,6 +425,12 @@ public final class DiskCacheGarbageCollector {
           });
     }
 
+    private void removeFromIndex(Entry entry) {
+      if (index != null) {
+        index.remove(entry.path());
+      }
+    }
+
     /** Waits for all enqueued deletions to complete. */
     DeletionStats await() throws IOException, InterruptedException {
       try {
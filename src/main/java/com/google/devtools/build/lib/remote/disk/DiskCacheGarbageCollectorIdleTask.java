@@ -74,7 +74,10 @@ public final class DiskCacheGarbageCollectorIdleTask implements IdleTask {
     var policy = new CollectionPolicy(maxSizeBytes, maxAge);
     var gc =
         new DiskCacheGarbageCollector(
-            workingDirectory.getRelative(remoteOptions.diskCache), executorService, policy);
+            workingDirectory.getRelative(remoteOptions.diskCache),
+            executorService,
+            policy,
+            remoteOptions.diskCacheGcIndex);
     return new DiskCacheGarbageCollectorIdleTask(delay, gc);
   }
 
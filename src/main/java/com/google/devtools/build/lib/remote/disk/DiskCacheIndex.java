@@ -0,0 +1,227 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.remote.disk;
+
+import static com.google.common.base.Preconditions.checkArgument;
+
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.build.lib.util.OS;
+import com.google.devtools.build.lib.vfs.Path;
+import java.io.IOException;
+import java.util.concurrent.locks.ReadWriteLock;
+import java.util.concurrent.locks.ReentrantReadWriteLock;
+import javax.annotation.Nullable;
+
+/**
+ * An index of the entries of a disk cache, with their sizes and last access times, which lets
+ * {@link DiskCacheGarbageCollector} find the entries to delete without listing and stating every
+ * file of the cache.
+ *
+ * <p>The index is a hash table in a file below the cache root, which the Bazel processes sharing
+ * the cache map into memory and update concurrently in native code. It is built by the garbage
+ * collector from a full scan of the cache, and kept up to date by {@link DiskCacheClient} as long
+ * as it exists. The files remain the source of truth: entries stored by processes that do not
+ * maintain the index are missing from it until the next full scan, and entries that are gone are
+ * found to be so when they are deleted. Not supported on Windows.
+ */
+public final class DiskCacheIndex implements AutoCloseable {
+
+  /** The index file, relative to the cache root; the garbage collector skips its directory. */
+  private static final String INDEX_PATH = "gc/index";
+
+  /**
+   * The entries to delete, as selected by {@link #selectEvictions}, least recently accessed first.
+   *
+   * @param paths the paths of the entries relative to the cache root
+   * @param sizes the sizes of the entries in bytes
+   * @param mtimes the last access times of the entries in milliseconds since the epoch
+   * @param totalEntries the number of entries in the index
+   * @param totalBytes the total size of the entries in the index
+   */
+  record Evictions(
+      String[] paths, long[] sizes, long[] mtimes, long totalEntries, long totalBytes) {}
+
+  private final ReadWriteLock lock = new ReentrantReadWriteLock();
+
+  // Guarded by lock; 0 once closed.
+  private long nativeIndex;
+
+  private DiskCacheIndex(long nativeIndex) {
+    this.nativeIndex = nativeIndex;
+  }
+
+  /** Whether indexes can be used on this platform. */
+  static boolean isSupported() {
+    return OS.getCurrent() != OS.WINDOWS && JniLoader.isJniAvailable();
+  }
+
+  /** Returns the index file of the disk cache at {@code root}. */
+  static Path getIndexPath(Path root) {
+    return root.getRelative(INDEX_PATH);
+  }
+
+  /**
+   * Opens the index of the disk cache at {@code root}, or returns null if it has none or it cannot
+   * be opened.
+   */
+  @Nullable
+  public static DiskCacheIndex open(Path root) {
+    Path indexPath = getIndexPath(root);
+    if (!isSupported() || !indexPath.exists()) {
+      return null;
+    }
+    long nativeIndex = doOpen(indexPath.getPathString());
+    return nativeIndex != 0 ? new DiskCacheIndex(nativeIndex) : null;
+  }
+
+  /**
+   * Replaces the index of the disk cache at {@code root} with one holding the given entries, as
+   * found by a full scan of the cache at {@code scanTimeMillis}. The processes using the previous
+   * index switch to the new one.
+   *
+   * @param paths the paths of the entries relative to {@code root}
+   * @param sizes the sizes of the entries in bytes
+   * @param mtimes the modification times of the entries in milliseconds since the epoch
+   * @throws IOException if the index could not be written
+   */
+  static void create(Path root, String[] paths, long[] sizes, long[] mtimes, long scanTimeMillis)
+      throws IOException {
+    checkArgument(paths.length == sizes.length && paths.length == mtimes.length);
+    Path indexPath = getIndexPath(root);
+    indexPath.getParentDirectory().createDirectoryAndParents();
+    doCreate(indexPath.getPathString(), paths, sizes, mtimes, scanTimeMillis);
+  }
+
+  /**
+   * Records that the entry at {@code path}, relative to the cache root, was stored or retrieved
+   * now, adding it to the index if need be.
+   */
+  public void record(String path, long size) {
+    lock.readLock().lock();
+    try {
+      if (nativeIndex != 0) {
+        doRecord(nativeIndex, path, size);
+      }
+    } finally {
+      lock.readLock().unlock();
+    }
+  }
+
+  /**
+   * Records that the entry at {@code path}, relative to the cache root, was retrieved now, if it
+   * is in the index.
+   */
+  public void touch(String path) {
+    lock.readLock().lock();
+    try {
+      if (nativeIndex != 0) {
+        doTouch(nativeIndex, path);
+      }
+    } finally {
+      lock.readLock().unlock();
+    }
+  }
+
+  /** Removes the entry at {@code path}, relative to the cache root, from the index. */
+  void remove(String path) {
+    lock.readLock().lock();
+    try {
+      if (nativeIndex != 0) {
+        doRemove(nativeIndex, path);
+      }
+    } finally {
+      lock.readLock().unlock();
+    }
+  }
+
+  /**
+   * Returns when the index was last built from a full scan of the cache, in milliseconds since the
+   * epoch.
+   */
+  long getScanTimeMillis() {
+    lock.readLock().lock();
+    try {
+      return nativeIndex != 0 ? doGetScanTime(nativeIndex) : 0;
+    } finally {
+      lock.readLock().unlock();
+    }
+  }
+
+  /**
+   * Returns whether every entry recorded since the last full scan made it into the index, which
+   * has a fixed capacity.
+   */
+  boolean isComplete() {
+    lock.readLock().lock();
+    try {
+      return nativeIndex != 0 && doIsComplete(nativeIndex);
+    } finally {
+      lock.readLock().unlock();
+    }
+  }
+
+  /**
+   * Returns the entries to delete to bring the cache under {@code maxSizeBytes}, unless negative,
+   * and rid it of the entries last accessed before {@code cutoffMillis}, with the same order and
+   * tie breaking as {@link DiskCacheGarbageCollector.CollectionPolicy}.
+   */
+  Evictions selectEvictions(long maxSizeBytes, long cutoffMillis) {
+    lock.readLock().lock();
+    try {
+      if (nativeIndex == 0) {
+        return new Evictions(new String[0], new long[0], new long[0], 0, 0);
+      }
+      Object[] result = doSelectEvictions(nativeIndex, maxSizeBytes, cutoffMillis);
+      long[] totals = (long[]) result[3];
+      return new Evictions(
+          (String[]) result[0], (long[]) result[1], (long[]) result[2], totals[0], totals[1]);
+    } finally {
+      lock.readLock().unlock();
+    }
+  }
+
+  @Override
+  public void close() {
+    lock.writeLock().lock();
+    try {
+      if (nativeIndex != 0) {
+        doClose(nativeIndex);
+        nativeIndex = 0;
+      }
+    } finally {
+      lock.writeLock().unlock();
+    }
+  }
+
+  private static native long doOpen(String path);
+
+  private static native void doClose(long nativeIndex);
+
+  private static native void doCreate(
+      String path, String[] paths, long[] sizes, long[] mtimes, long scanTimeMillis)
+      throws IOException;
+
+  private static native boolean doRecord(long nativeIndex, String path, long size);
+
+  private static native void doTouch(long nativeIndex, String path);
+
+  private static native void doRemove(long nativeIndex, String path);
+
+  private static native long doGetScanTime(long nativeIndex);
+
+  private static native boolean doIsComplete(long nativeIndex);
+
+  private static native Object[] doSelectEvictions(
+      long nativeIndex, long maxSizeBytes, long cutoffMillis);
+}
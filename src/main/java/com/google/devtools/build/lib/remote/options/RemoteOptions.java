@@ -398,6 +398,19 @@ public final class RemoteOptions extends CommonRemoteOptions {
               + " determined by the --experimental_disk_cache_gc_idle_delay flag.")
   public Duration diskCacheGcMaxAge;
 
+  @Option(
+      name = "experimental_disk_cache_gc_index",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.UNCATEGORIZED,
+      effectTags = {OptionEffectTag.UNKNOWN},
+      help =
+          "If enabled, the garbage collection of the disk cache keeps an index of its entries,"
+              + " which Bazel updates as it stores and retrieves them, and selects the entries to"
+              + " delete from the index rather than by listing the whole cache. The cache is"
+              + " still listed once a day, to pick up the entries stored by other processes."
+              + " Not supported on Windows.")
+  public boolean diskCacheGcIndex;
+
   @Option(
       name = "experimental_guard_against_concurrent_changes",
       defaultValue = "false",
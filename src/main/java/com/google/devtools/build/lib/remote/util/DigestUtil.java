@@ -64,6 +64,11 @@ public class DigestUtil {
     return digestFunction;
   }
 
+  /** Returns the hash function of the digests. */
+  public DigestHashFunction getDigestHashFunction() {
+    return hashFn;
+  }
+
   public Digest compute(byte[] blob) {
     return buildDigest(hashFn.getHashFunction().hashBytes(blob).toString(), blob.length);
   }
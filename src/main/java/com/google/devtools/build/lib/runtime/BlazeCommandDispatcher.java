@@ -80,6 +80,7 @@ import java.io.BufferedOutputStream;
 import java.io.IOException;
 import java.io.OutputStream;
 import java.time.Duration;
+import java.util.ArrayDeque;
 import java.util.ArrayList;
 import java.util.HashSet;
 import java.util.List;
@@ -111,6 +112,12 @@ public class BlazeCommandDispatcher implements CommandDispatcher {
   private final BugReporter bugReporter;
   private final Object commandLock;
   private String currentClientDescription = null;
+
+  /**
+   * Clients waiting for {@link #commandLock}, in the order in which they get it. Guarded by {@link
+   * #commandLock}.
+   */
+  private final ArrayDeque<QueuedClient> queuedClients = new ArrayDeque<>();
   private final AtomicReference<String> shutdownReason = new AtomicReference<>();
   private OutputStream logOutputStream = null;
   private final LoadingCache<BlazeCommand, OpaqueOptionsData> optionsDataCache =
@@ -186,48 +193,76 @@ public class BlazeCommandDispatcher implements CommandDispatcher {
           FailureDetails.Command.Code.COMMAND_NOT_FOUND);
     }
 
-    // Take the exclusive server lock.  If we fail, we busy-wait until the lock becomes available.
+    // Take the exclusive server lock. If it is held, queue up behind the other waiting clients so
+    // that the lock is handed over in the order in which the clients arrived, rather than to
+    // whichever waiting client happens to wake up first.
     //
-    // We used to rely on commandLock.wait() to lazy-wait for the lock to become available, which is
-    // theoretically fine, but doing so prevents us from determining if the PID of the server
-    // holding the lock has changed under the hood.  There have been multiple bug reports where
-    // users (especially macOS ones) mention that the Blaze invocation hangs on a non-existent PID.
-    // This should help troubleshoot those scenarios in case there really is a bug somewhere.
+    // Waiting clients are woken up whenever the lock changes hands, so that they can report the
+    // client currently holding the lock and their position in the queue. There have been multiple
+    // bug reports where users (especially macOS ones) mention that the Blaze invocation hangs on a
+    // non-existent PID; reporting every change of the lock holder helps troubleshoot those.
     boolean multipleAttempts = false;
     long clockBefore = BlazeClock.nanoTime();
     String otherClientDescription = "";
     // TODO(ulfjack): Add lock acquisition to the profiler.
     synchronized (commandLock) {
-      while (currentClientDescription != null) {
-        switch (lockingMode) {
-          case WAIT:
-            if (!otherClientDescription.equals(currentClientDescription)) {
-              String serverDescription =
-                  serverPid == UNKNOWN_SERVER_PID ? "" : (" (server_pid=" + serverPid + ")");
-              outErr.printErrLn(
+      QueuedClient self = null;
+      int reportedPosition = 0;
+      try {
+        while (currentClientDescription != null
+            || (!queuedClients.isEmpty() && queuedClients.peekFirst() != self)) {
+          switch (lockingMode) {
+            case WAIT:
+              if (self == null) {
+                self = new QueuedClient(clientDescription);
+                queuedClients.addLast(self);
+              }
+              if (currentClientDescription != null
+                  && !otherClientDescription.equals(currentClientDescription)) {
+                String serverDescription =
+                    serverPid == UNKNOWN_SERVER_PID ? "" : (" (server_pid=" + serverPid + ")");
+                outErr.printErrLn(
+                    String.format(
+                        "Another command (%s) is running. Waiting for it to complete on the"
+                            + " server%s...",
+                        currentClientDescription, serverDescription));
+                otherClientDescription = currentClientDescription;
+              }
+              int position = positionInQueue(self);
+              if (position > 0 && position != reportedPosition) {
+                outErr.printErrLn(
+                    String.format(
+                        "%d other command%s queued ahead of this one.",
+                        position, position == 1 ? " is" : "s are"));
+                reportedPosition = position;
+              }
+              commandLock.wait();
+              break;
+
+            case ERROR_OUT:
+              String message =
                   String.format(
-                      "Another command (%s) is running. Waiting for it to complete on the"
-                          + " server%s...",
-                      currentClientDescription, serverDescription));
-              otherClientDescription = currentClientDescription;
-            }
-            commandLock.wait(500);
-            break;
-
-          case ERROR_OUT:
-            String message =
-                String.format(
-                    "Another command (%s) is running. Exiting immediately.",
-                    currentClientDescription);
-            outErr.printErrLn(message);
-            return createDetailedCommandResult(
-                message, FailureDetails.Command.Code.ANOTHER_COMMAND_RUNNING);
-
-          default:
-            throw new IllegalStateException();
-        }
+                      "Another command (%s) is running. Exiting immediately.",
+                      currentClientDescription != null
+                          ? currentClientDescription
+                          : queuedClients.peekFirst().description);
+              outErr.printErrLn(message);
+              return createDetailedCommandResult(
+                  message, FailureDetails.Command.Code.ANOTHER_COMMAND_RUNNING);
+
+            default:
+              throw new IllegalStateException();
+          }
 
-        multipleAttempts = true;
+          multipleAttempts = true;
+        }
+      } finally {
+        if (self != null) {
+          // Leave the queue, whether we got the lock or were interrupted while waiting for it, and
+          // let the other waiting clients know that their position changed.
+          queuedClients.remove(self);
+          commandLock.notifyAll();
+        }
       }
       currentClientDescription = clientDescription;
     }
@@ -287,11 +322,33 @@ public class BlazeCommandDispatcher implements CommandDispatcher {
     } finally {
       synchronized (commandLock) {
         currentClientDescription = null;
-        commandLock.notify();
+        // All waiting clients are woken up, but only the first one in the queue takes the lock.
+        commandLock.notifyAll();
       }
     }
   }
 
+  /** Returns the number of clients queued ahead of {@code client}. */
+  private int positionInQueue(QueuedClient client) {
+    int position = 0;
+    for (QueuedClient queued : queuedClients) {
+      if (queued == client) {
+        break;
+      }
+      position++;
+    }
+    return position;
+  }
+
+  /** A client waiting for {@link #commandLock}. */
+  private static final class QueuedClient {
+    private final String description;
+
+    QueuedClient(String description) {
+      this.description = description;
+    }
+  }
+
   /**
    * For testing ONLY. Same as {@link CommandDispatcher#exec(InvocationPolicy, List, OutErr,
    * LockingMode, String, long, Optional, List, CommandExtensionReporter)} but automatically uses
@@ -425,7 +482,9 @@ public class BlazeCommandDispatcher implements CommandDispatcher {
             message, FailureDetails.Command.Code.STARLARK_CPU_PROFILE_FILE_INITIALIZATION_FAILURE);
       }
       try {
-        success = Starlark.startCpuProfile(out, Duration.ofMillis(10));
+        success =
+            Starlark.startCpuProfile(
+                out, Duration.ofMillis(10), commonOptions.starlarkCpuProfileWallClock);
       } catch (IllegalStateException ex) { // e.g. SIGPROF in use
         String message = Strings.nullToEmpty(ex.getMessage());
         outErr.printErrLn(message);
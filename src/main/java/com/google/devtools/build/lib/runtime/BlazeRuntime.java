@@ -473,6 +473,7 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
                 commandOptions.collectSystemNetworkUsage,
                 commandOptions.collectResourceEstimation,
                 commandOptions.collectPressureStallIndicators,
+                commandOptions.collectProcessStats,
                 commandOptions.collectSkyframeCounts));
         // Instead of logEvent() we're calling the low level function to pass the timings we took in
         // the launcher. We're setting the INIT phase marker so that it follows immediately the
@@ -693,6 +694,58 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
     return null;
   }
 
+  /**
+   * Writes the values of the info keys that only depend on the startup options to {@code
+   * <output_base>/server/info_cache}, one {@code key=value} line per key, so that the client can
+   * answer {@code info} for them without a round trip to the server. The values are formatted as
+   * {@link InfoItem} prints them.
+   *
+   * <p>The client deletes the file whenever it starts a new server, so it only ever describes the
+   * running server.
+   */
+  private void writeInfoCache() {
+    StringBuilder content = new StringBuilder();
+    content.append("release=").append(BlazeVersionInfo.instance().getReleaseName()).append('\n');
+    if (workspace.getWorkspace() != null) {
+      content.append("workspace=").append(workspace.getWorkspace()).append('\n');
+    }
+    content.append("install_base=").append(workspace.getInstallBase()).append('\n');
+    content.append("output_base=").append(workspace.getOutputBase()).append('\n');
+
+    Path infoCache = getServerDirectory().getChild("info_cache");
+    Path tmp = getServerDirectory().getChild("info_cache.tmp");
+    try {
+      FileSystemUtils.writeContent(tmp, UTF_8, content.toString());
+      tmp.renameTo(infoCache);
+    } catch (IOException e) {
+      logger.atInfo().withCause(e).log("Failed to write %s", infoCache);
+    }
+  }
+
+  /**
+   * Writes the names of the commands annotated as {@link Command#readOnly} to {@code
+   * <output_base>/server/read_only_commands}, one per line, so that the client knows for which
+   * commands a shared lock on the output base is enough. Written before the server accepts
+   * connections; the client deletes the file whenever it starts a new server.
+   */
+  private void writeReadOnlyCommands() {
+    StringBuilder content = new StringBuilder();
+    for (Map.Entry<String, BlazeCommand> entry : commandMap.entrySet()) {
+      if (entry.getValue().getClass().getAnnotation(Command.class).readOnly()) {
+        content.append(entry.getKey()).append('\n');
+      }
+    }
+
+    Path readOnlyCommands = getServerDirectory().getChild("read_only_commands");
+    Path tmp = getServerDirectory().getChild("read_only_commands.tmp");
+    try {
+      FileSystemUtils.writeContent(tmp, UTF_8, content.toString());
+      tmp.renameTo(readOnlyCommands);
+    } catch (IOException e) {
+      logger.atInfo().withCause(e).log("Failed to write %s", readOnlyCommands);
+    }
+  }
+
   /**
    * Hook method called by the BlazeCommandDispatcher after the dispatch of each command. Returns a
    * new exit code in case exceptions were encountered during cleanup.
@@ -710,6 +763,8 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
     // Remove any filters that the command might have added to the reporter.
     env.getReporter().setOutputFilter(OutputFilter.OUTPUT_EVERYTHING);
 
+    writeInfoCache();
+
     DetailedExitCode moduleExitCode = null;
 
     try {
@@ -1151,6 +1206,7 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
 
       ShutdownHooks shutdownHooks = ShutdownHooks.createAndRegister();
       shutdownHooks.deleteAtExit(pidFile);
+      runtime.writeReadOnlyCommands();
 
       BlazeCommandDispatcher dispatcher = new BlazeCommandDispatcher(runtime, serverPid);
       BlazeServerStartupOptions startupOptions =
@@ -1162,6 +1218,7 @@ public final class BlazeRuntime implements BugReport.BlazeRuntimeInterface {
               pidFileWatcher,
               runtime.clock,
               startupOptions.commandPort,
+              startupOptions.commandServerUnixSocket,
               runtime.getServerDirectory(),
               serverPid,
               startupOptions.maxIdleSeconds,
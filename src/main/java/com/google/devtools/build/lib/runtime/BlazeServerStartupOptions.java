@@ -186,6 +186,35 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + " location will be ${OUTPUT_BASE}/failure_detail.rawproto.")
   public PathFragment failureDetailOut;
 
+  @Option(
+      name = "client_trace",
+      defaultValue = "null", // NOTE: purely decorative, the trace is written by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.AFFECTS_OUTPUTS},
+      converter = OptionsUtils.PathFragmentConverter.class,
+      valueHelp = "<path>",
+      help =
+          "If set, the client writes a trace of its own work, such as reading the rc files,"
+              + " starting the server and connecting to it, to this file in the Chrome trace"
+              + " event format. Like the server's JSON profile, it can be loaded in"
+              + " chrome://tracing or Perfetto.")
+  public PathFragment clientTrace;
+
+  @Option(
+      name = "command_file",
+      defaultValue = "null", // NOTE: purely decorative, the commands are read by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.BAZEL_INTERNAL_CONFIGURATION},
+      valueHelp = "<path>",
+      help =
+          "If set, the client runs the commands of this file, one command line per line, one"
+              + " after the other over a single connection to the server instead of a command"
+              + " given on the command line. '-' reads the commands from the standard input as"
+              + " they are written. Empty lines and '#' comments are ignored. The client stops"
+              + " after a command that is interrupted, shuts the server down or runs a binary,"
+              + " and exits with the first non-zero exit code of the commands.")
+  public String commandFile;
+
   @Option(
       name = "workspace_directory",
       defaultValue = "", // NOTE: only for documentation, value is always passed by the client.
@@ -234,6 +263,31 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "server when the system is low on free RAM. Linux only.")
   public boolean shutdownOnLowSysMem;
 
+  @Option(
+      name = "server_class_data_sharing",
+      defaultValue = "true", // Only for documentation; value is set by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.LOSES_INCREMENTAL_STATE},
+      help =
+          "If true, the server JVM creates a class data sharing archive of the classes it loaded"
+              + " when it exits, next to the install base, and maps it when it starts again. This"
+              + " saves most of the class loading of a cold server start. The archive is shared"
+              + " by all the output bases of an install base.")
+  public boolean serverClassDataSharing;
+
+  @Option(
+      name = "experimental_server_aot_cache",
+      defaultValue = "false", // Only for documentation; value is set by the client.
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.LOSES_INCREMENTAL_STATE},
+      help =
+          "If true, a server JVM of JDK 25 or later records an ahead-of-time cache of the classes"
+              + " it loaded and linked and of their profiles when it exits, next to the install"
+              + " base, and starts from it the next time. This saves more of a cold server start"
+              + " than --server_class_data_sharing, which it overrides. Other JVMs start as"
+              + " usual.")
+  public boolean serverAotCache;
+
   @Option(
       name = "batch",
       defaultValue = "false",
@@ -341,6 +395,18 @@ public class BlazeServerStartupOptions extends OptionsBase {
       help = "Port to start up the gRPC command server on. If 0, let the kernel choose.")
   public int commandPort;
 
+  @Option(
+      name = "experimental_command_server_unix_socket",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {OptionEffectTag.LOSES_INCREMENTAL_STATE},
+      help =
+          "If true, the client talks to the build server over a unix domain socket in the server "
+              + "directory instead of a TCP port on localhost, which makes connecting cheaper. "
+              + "Falls back to localhost where unix domain sockets are unsupported, e.g. on "
+              + "Windows, or if the path of the socket would be too long.")
+  public boolean commandServerUnixSocket;
+
   @Option(
       name = "product_name",
       defaultValue = "bazel", // NOTE: only for documentation, value is always passed by the client.
@@ -486,6 +552,21 @@ public class BlazeServerStartupOptions extends OptionsBase {
               + "that it causes a significant number of invocations of the getxattr() system call.")
   public String unixDigestHashAttributeName;
 
+  @Option(
+      name = "experimental_unix_digest_cache_attribute_name",
+      defaultValue = "",
+      documentationCategory = OptionDocumentationCategory.UNDOCUMENTED,
+      effectTags = {OptionEffectTag.LOSES_INCREMENTAL_STATE},
+      metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+      help =
+          "The name of an extended attribute, e.g. user.bazel.digest, in which the digests that "
+              + "Bazel computes are stored on source and output files, together with the size "
+              + "and modification time of the file they are valid for. A later server, or another "
+              + "workspace sharing the files, reads the digest from the attribute instead of "
+              + "hashing the file again as long as both are unchanged. Files modified in the last "
+              + "two seconds are not given the attribute.")
+  public String unixDigestCacheAttributeName;
+
   @Option(
       name = "autodetect_server_javabase",
       defaultValue = "true", // NOTE: only for documentation, value never passed to the server.
@@ -536,7 +617,64 @@ public class BlazeServerStartupOptions extends OptionsBase {
         OptionEffectTag.EXECUTION,
       },
       help =
-          "If true, the Bazel server will be run with systemd-run, and the user will own the"
-              + " cgroup. This flag only takes effect on Linux.")
+          "If true, the Bazel server will be run in a transient systemd scope, and the user will"
+              + " own the cgroup. This flag only takes effect on Linux.")
   public boolean runInUserCgroup;
+
+  /**
+   * Note: This option is only used by the C++ client, never by the Java server. It is included here
+   * to make sure that the option is documented in the help output, which is auto-generated by Java
+   * code. This also helps ensure that the server is killed if the value of this option changes.
+   */
+  @Option(
+      name = "experimental_server_cpus",
+      defaultValue = "null",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.BAZEL_MONITORING,
+        OptionEffectTag.EXECUTION,
+      },
+      valueHelp = "<cpu list>",
+      help =
+          "The CPUs the Bazel server may run on, as a list like 0-7,16-23. This flag only takes"
+              + " effect on Linux.")
+  public String serverCpus;
+
+  /**
+   * Note: This option is only used by the C++ client, never by the Java server. It is included here
+   * to make sure that the option is documented in the help output, which is auto-generated by Java
+   * code. This also helps ensure that the server is killed if the value of this option changes.
+   */
+  @Option(
+      name = "experimental_server_numa_node",
+      defaultValue = "-1",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.BAZEL_MONITORING,
+        OptionEffectTag.EXECUTION,
+      },
+      help =
+          "If not negative, the Bazel server allocates memory only from this NUMA node and runs"
+              + " only on its CPUs (and on those allowed by --experimental_server_cpus). This"
+              + " flag only takes effect on Linux.")
+  public int serverNumaNode;
+
+  /**
+   * Note: This option is only used by the C++ client, never by the Java server. It is included here
+   * to make sure that the option is documented in the help output, which is auto-generated by Java
+   * code. This also helps ensure that the server is killed if the value of this option changes.
+   */
+  @Option(
+      name = "experimental_server_transparent_huge_pages",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.BAZEL_CLIENT_OPTIONS,
+      effectTags = {
+        OptionEffectTag.BAZEL_MONITORING,
+        OptionEffectTag.EXECUTION,
+      },
+      help =
+          "If true, the Bazel server JVM backs its heap with transparent huge pages, which takes"
+              + " effect when the system's transparent huge page mode is 'madvise' or 'always'."
+              + " This flag only takes effect on Linux.")
+  public boolean serverTransparentHugePages;
 }
@@ -36,6 +36,7 @@ import com.google.devtools.build.lib.profiler.AutoProfiler;
 import com.google.devtools.build.lib.profiler.ProfilerTask;
 import com.google.devtools.build.lib.profiler.memory.AllocationTracker;
 import com.google.devtools.build.lib.runtime.proto.InvocationPolicyOuterClass.InvocationPolicy;
+import com.google.devtools.build.lib.skyframe.OutputTreeWatcher;
 import com.google.devtools.build.lib.skyframe.SkyframeExecutor;
 import com.google.devtools.build.lib.skyframe.serialization.FingerprintValueService;
 import com.google.devtools.build.lib.skyframe.serialization.ObjectCodecRegistry;
@@ -92,6 +93,15 @@ public final class BlazeWorkspace {
   /** The execution time range of the previous build command in this server, if any. */
   @Nullable private Range<Long> lastExecutionRange = null;
 
+  /**
+   * Watches the output tree between builds with {@code --experimental_watch_output_tree}. Created
+   * on the first build command that enables it, closed on one that disables it.
+   */
+  @Nullable private OutputTreeWatcher outputTreeWatcher;
+
+  /** Whether the output tree turned out to have too many directories to watch. */
+  private boolean outputTreeTooLargeToWatch;
+
   private final String outputBaseFilesystemTypeName;
   private final boolean allowExternalRepositories;
   @Nullable private final PathPackageLocator virtualPackageLocator;
@@ -213,6 +223,35 @@ public final class BlazeWorkspace {
     return lastExecutionRange;
   }
 
+  /**
+   * Returns the watcher of the output tree at {@code outputPath}, starting it if needed, or null if
+   * {@code enabled} is false or the tree cannot be watched.
+   */
+  @Nullable
+  public synchronized OutputTreeWatcher getOutputTreeWatcher(Path outputPath, boolean enabled) {
+    if (outputTreeWatcher != null
+        && (!enabled || !outputTreeWatcher.getOutputPath().equals(outputPath))) {
+      outputTreeWatcher.close();
+      outputTreeWatcher = null;
+    }
+    if (enabled && outputTreeWatcher == null && !outputTreeTooLargeToWatch) {
+      outputTreeWatcher = OutputTreeWatcher.create(outputPath);
+    }
+    return outputTreeWatcher;
+  }
+
+  /**
+   * Closes the watcher of the output tree for good, as the tree has more directories than can be
+   * watched.
+   */
+  public synchronized void stopWatchingOutputTree() {
+    if (outputTreeWatcher != null) {
+      outputTreeWatcher.close();
+      outputTreeWatcher = null;
+    }
+    outputTreeTooLargeToWatch = true;
+  }
+
   /**
    * Initializes a CommandEnvironment to execute a command in this workspace.
    *
@@ -120,6 +120,14 @@ public @interface Command {
    */
   boolean hidden() default false;
 
+  /**
+   * True if the command leaves the output base as it is, so that the client may take a shared
+   * rather than an exclusive lock on it while it connects to the server, and clients of read-only
+   * commands don't wait for each other. The server still runs one command at a time. Commands that
+   * load packages are not read-only, since loading may fetch repositories into the output base.
+   */
+  boolean readOnly() default false;
+
   /**
    * Specifies whether this command allows a residue after the parsed options.
    * For example, a command might expect a list of targets to build in the
@@ -309,6 +309,18 @@ public class CommonCommandOptions extends OptionsBase {
       help = "Writes into the specified file a pprof profile of CPU usage by all Starlark threads.")
   public String starlarkCpuProfile;
 
+  @Option(
+      name = "experimental_starlark_cpu_profile_wall_clock",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.LOGGING,
+      effectTags = {OptionEffectTag.BAZEL_MONITORING},
+      metadataTags = {OptionMetadataTag.EXPERIMENTAL},
+      help =
+          "If enabled, --starlark_cpu_profile samples Starlark threads on wall-clock time, whether"
+              + " they are running or blocked (e.g. on file I/O or Skyframe), and labels each"
+              + " sample with state=on-cpu or state=off-cpu. Linux only.")
+  public boolean starlarkCpuProfileWallClock;
+
   @Option(
       name = "record_full_profiler_data",
       defaultValue = "false",
@@ -361,6 +373,18 @@ public class CommonCommandOptions extends OptionsBase {
       help = "If enabled, the profiler collects the Linux PSI data.")
   public boolean collectPressureStallIndicators;
 
+  @Option(
+      name = "experimental_collect_process_stats_in_profiler",
+      defaultValue = "false",
+      documentationCategory = OptionDocumentationCategory.LOGGING,
+      effectTags = {OptionEffectTag.BAZEL_MONITORING},
+      help =
+          "If enabled, the profiler collects the Bazel server's disk I/O, context switches and time"
+              + " spent waiting for a CPU or for I/O, and the use of its native worker pool."
+              + " Available on Linux and macOS; the I/O wait is only collected on Linux kernels"
+              + " that let Bazel query its taskstats.")
+  public boolean collectProcessStats;
+
   @Option(
       name = "experimental_collect_skyframe_counts_in_profiler",
       defaultValue = "false",
@@ -57,6 +57,7 @@ import java.util.logging.Level;
 @Command(
     name = "canonicalize-flags",
     buildPhase = NONE,
+    readOnly = true,
     options = {CanonicalizeCommand.Options.class, PackageOptions.class},
     // inherits from build to get proper package loading options and rc flag aliases.
     inheritsOptionsFrom = {BuildCommand.class},
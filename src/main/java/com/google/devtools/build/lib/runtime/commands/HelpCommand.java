@@ -75,6 +75,7 @@ import java.util.stream.Collectors;
 @Command(
     name = "help",
     buildPhase = NONE,
+    readOnly = true,
     options = {HelpCommand.Options.class},
     allowResidue = true,
     mustRunInWorkspace = false,
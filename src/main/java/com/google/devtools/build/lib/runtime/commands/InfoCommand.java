@@ -90,6 +90,7 @@ import java.util.stream.Collectors;
 @Command(
     name = "info",
     buildPhase = NONE,
+    readOnly = true,
     allowResidue = true,
     binaryStdOut = true,
     help = "resource:info.txt",
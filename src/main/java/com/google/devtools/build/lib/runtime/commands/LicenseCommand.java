@@ -36,6 +36,7 @@ import java.nio.file.attribute.BasicFileAttributes;
 @Command(
     name = "license",
     buildPhase = NONE,
+    readOnly = true,
     allowResidue = true,
     mustRunInWorkspace = false,
     shortDescription = "Prints the license of this software.",
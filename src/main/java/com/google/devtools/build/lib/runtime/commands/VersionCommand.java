@@ -38,6 +38,7 @@ import java.util.Optional;
 @Command(
     name = "version",
     buildPhase = NONE,
+    readOnly = true,
     options = {VersionCommand.VersionOptions.class},
     allowResidue = false,
     mustRunInWorkspace = false,
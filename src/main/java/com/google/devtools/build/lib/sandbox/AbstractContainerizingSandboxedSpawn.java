@@ -134,13 +134,25 @@ public abstract class AbstractContainerizingSandboxedSpawn implements SandboxedS
     }
 
     // Finally create what needs creating.
+    createDirectoriesAndInputs(dirsToCreate, inputsToCreate);
+    SandboxStash.setLastModified(sandboxPath, System.currentTimeMillis());
+  }
+
+  /**
+   * Creates the directories and then the inputs that the sandbox still lacks.
+   *
+   * @param dirsToCreate The directories that need to be created, with their parents.
+   * @param inputsToCreate The inputs that need to be created, see {@link #createInputs}.
+   */
+  protected void createDirectoriesAndInputs(
+      Set<PathFragment> dirsToCreate, Set<PathFragment> inputsToCreate)
+      throws IOException, InterruptedException {
     try (SilentCloseable c = Profiler.instance().profile("sandbox.createDirectories")) {
       SandboxHelpers.createDirectories(dirsToCreate, sandboxExecRoot, /* strict= */ true);
     }
     try (SilentCloseable c = Profiler.instance().profile("sandbox.createInputs")) {
       createInputs(inputsToCreate, inputs);
     }
-    SandboxStash.setLastModified(sandboxPath, System.currentTimeMillis());
   }
 
   protected void filterInputsAndDirsToCreate(
@@ -50,8 +50,10 @@ import com.google.devtools.build.lib.vfs.Symlinks;
 import com.google.devtools.common.options.OptionsParsingResult;
 import com.google.errorprone.annotations.CanIgnoreReturnValue;
 import java.io.IOException;
+import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.HashSet;
+import java.util.List;
 import java.util.Map;
 import java.util.Map.Entry;
 import java.util.Optional;
@@ -412,14 +414,30 @@ public final class SandboxHelpers {
   public static void createDirectories(
       Iterable<PathFragment> dirsToCreate, Path dir, boolean strict)
       throws IOException, InterruptedException {
+    for (Path path : listDirectoriesToCreate(dirsToCreate, dir, strict)) {
+      if (Thread.interrupted()) {
+        throw new InterruptedException();
+      }
+      path.createDirectory();
+    }
+  }
+
+  /**
+   * Returns the directories {@link #createDirectories} creates, parents first, without doing any
+   * I/O. Like it, this skips {@code dir}, its parent and its temporary directory, which are known
+   * to exist, and the ancestors of those directories.
+   */
+  public static List<Path> listDirectoriesToCreate(
+      Iterable<PathFragment> dirsToCreate, Path dir, boolean strict) throws InterruptedException {
     Set<Path> knownDirectories = new HashSet<>();
     // Add sandboxExecRoot and it's parent -- all paths must fall under the parent of
     // sandboxExecRoot and we know that sandboxExecRoot exists. This stops the recursion in
-    // createDirectoryAndParentsInSandboxRoot.
+    // addDirectoryAndParents.
     knownDirectories.add(dir);
     knownDirectories.add(dir.getParentDirectory());
     knownDirectories.add(getTmpDirPath(dir));
 
+    List<Path> result = new ArrayList<>();
     for (PathFragment path : dirsToCreate) {
       if (Thread.interrupted()) {
         throw new InterruptedException();
@@ -438,8 +456,31 @@ public final class SandboxHelpers {
         }
       }
 
-      createDirectoryAndParentsInSandboxRoot(dir.getRelative(path), knownDirectories, dir);
+      addDirectoryAndParents(dir.getRelative(path), knownDirectories, dir, result);
+    }
+    return result;
+  }
+
+  /**
+   * Adds the directory and those of its ancestors that are not known directories to {@code
+   * result}, parents first, and makes them all known.
+   */
+  private static void addDirectoryAndParents(
+      Path path, Set<Path> knownDirectories, Path sandboxExecRoot, List<Path> result) {
+    if (knownDirectories.contains(path)) {
+      return;
     }
+    addDirectoryAndParents(
+        checkNotNull(
+            path.getParentDirectory(),
+            "Path %s is not under/siblings of sandboxExecRoot: %s",
+            path,
+            sandboxExecRoot),
+        knownDirectories,
+        sandboxExecRoot,
+        result);
+    result.add(path);
+    knownDirectories.add(path);
   }
 
   static FailureDetail createFailureDetail(String message, Code detailedCode) {
@@ -65,7 +65,15 @@ import io.grpc.StatusRuntimeException;
 import io.grpc.netty.NettyServerBuilder;
 import io.grpc.stub.ServerCallStreamObserver;
 import io.grpc.stub.StreamObserver;
+import io.netty.channel.EventLoopGroup;
+import io.netty.channel.ServerChannel;
 import io.netty.channel.epoll.Epoll;
+import io.netty.channel.epoll.EpollEventLoopGroup;
+import io.netty.channel.epoll.EpollServerDomainSocketChannel;
+import io.netty.channel.kqueue.KQueue;
+import io.netty.channel.kqueue.KQueueEventLoopGroup;
+import io.netty.channel.kqueue.KQueueServerDomainSocketChannel;
+import io.netty.channel.unix.DomainSocketAddress;
 import io.netty.channel.unix.Socket;
 import java.io.IOException;
 import java.io.OutputStream;
@@ -117,6 +125,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
       PidFileWatcher pidFileWatcher,
       Clock clock,
       int port,
+      boolean useUnixSocket,
       Path serverDirectory,
       int serverPid,
       int maxIdleSeconds,
@@ -130,6 +139,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
         pidFileWatcher,
         clock,
         port,
+        useUnixSocket,
         generateCookie(random, 16),
         generateCookie(random, 16),
         serverDirectory,
@@ -305,6 +315,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
 
   // These paths are all relative to the server directory
   private static final String PORT_FILE = "command_port";
+  private static final String SOCKET_FILE = "command.socket";
   private static final String REQUEST_COOKIE_FILE = "request_cookie";
   private static final String RESPONSE_COOKIE_FILE = "response_cookie";
   private static final String SERVER_INFO_FILE = "server_info.rawproto";
@@ -323,6 +334,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
   private final PidFileWatcher pidFileWatcher;
   private final int serverPid;
   private final int port;
+  private final boolean useUnixSocket;
 
   private Server server;
   private boolean serving;
@@ -334,6 +346,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
       PidFileWatcher pidFileWatcher,
       Clock clock,
       int port,
+      boolean useUnixSocket,
       String requestCookie,
       String responseCookie,
       Path serverDirectory,
@@ -348,6 +361,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
 
     this.clock = clock;
     this.port = port;
+    this.useUnixSocket = useUnixSocket;
     this.requestCookie = requestCookie;
     this.responseCookie = responseCookie;
 
@@ -430,13 +444,64 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
     return server;
   }
 
+  /**
+   * Binds the server to a unix domain socket in the server directory, which only the user can
+   * access. Returns the address clients should connect to, or null if unix domain sockets can't be
+   * used here, in which case the server listens on the loopback interface instead.
+   */
+  @Nullable
+  private String bindUnixSocket() {
+    Path socket = serverDirectory.getChild(SOCKET_FILE);
+    String socketPath = socket.getPathString();
+    // The limit of sun_path is 104 bytes on macOS and 108 bytes on Linux, including the null.
+    if (socketPath.length() >= 104) {
+      logger.atInfo().log("Not using a unix domain socket, %s is too long", socketPath);
+      return null;
+    }
+
+    Class<? extends ServerChannel> channelType;
+    EventLoopGroup bossGroup;
+    EventLoopGroup workerGroup;
+    if (Epoll.isAvailable()) {
+      channelType = EpollServerDomainSocketChannel.class;
+      bossGroup = new EpollEventLoopGroup(1);
+      workerGroup = new EpollEventLoopGroup();
+    } else if (KQueue.isAvailable()) {
+      channelType = KQueueServerDomainSocketChannel.class;
+      bossGroup = new KQueueEventLoopGroup(1);
+      workerGroup = new KQueueEventLoopGroup();
+    } else {
+      logger.atInfo().log("Not using a unix domain socket, they are unsupported on this platform");
+      return null;
+    }
+
+    try {
+      // A previous server may have left its socket behind.
+      socket.delete();
+      server =
+          NettyServerBuilder.forAddress(new DomainSocketAddress(socketPath))
+              .channelType(channelType)
+              .bossEventLoopGroup(bossGroup)
+              .workerEventLoopGroup(workerGroup)
+              .addService(this)
+              .directExecutor()
+              .build()
+              .start();
+    } catch (IOException e) {
+      logger.atWarning().withCause(e).log("Failed to bind to %s", socketPath);
+      bossGroup.shutdownGracefully();
+      workerGroup.shutdownGracefully();
+      return null;
+    }
+    shutdownHooks.deleteAtExit(socket);
+    return "unix:" + socketPath;
+  }
+
+  /** Binds the server to the loopback interface and returns the address it listens on. */
   // Suppress ErrorProne warnings for hardcoding "[::1]" and "127.0.0.1" instead of
   // InetAddress.getLoopbackAddress().
   @SuppressWarnings("AddressSelection")
-  @Override
-  public void serve() throws AbruptExitException {
-    Preconditions.checkState(!serving);
-
+  private String bindLoopback() throws AbruptExitException {
     // For reasons only Apple knows, you cannot bind to IPv4-localhost when you run in a sandbox
     // that only allows loopback traffic, but binding to IPv6-localhost works fine. This would
     // however break on systems that don't support IPv6. So what we'll do is to try to bind to IPv6
@@ -474,6 +539,18 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
       }
     }
 
+    return InetAddresses.toUriString(address.getAddress()) + ":" + server.getPort();
+  }
+
+  @Override
+  public void serve() throws AbruptExitException {
+    Preconditions.checkState(!serving);
+
+    String address = useUnixSocket ? bindUnixSocket() : null;
+    if (address == null) {
+      address = bindLoopback();
+    }
+
     if (maxIdleSeconds > 0) {
       Thread timeoutAndMemoryCheckingThread =
           new Thread(
@@ -495,8 +572,7 @@ public class GrpcServerImpl extends CommandServerGrpc.CommandServerImplBase impl
     }
   }
 
-  private void writeServerStatusFiles(InetSocketAddress address) throws AbruptExitException {
-    String addressString = InetAddresses.toUriString(address.getAddress()) + ":" + server.getPort();
+  private void writeServerStatusFiles(String addressString) throws AbruptExitException {
     writeServerFile(PORT_FILE, addressString);
     writeServerFile(REQUEST_COOKIE_FILE, requestCookie);
     writeServerFile(RESPONSE_COOKIE_FILE, responseCookie);
@@ -36,6 +36,9 @@ import java.util.UUID;
  */
 public final class InstallBaseGarbageCollector {
   @VisibleForTesting static final String LOCK_SUFFIX = ".lock";
+  @VisibleForTesting static final String VERIFIED_SUFFIX = ".verified";
+  @VisibleForTesting static final String CDS_ARCHIVE_SUFFIX = ".jsa";
+  @VisibleForTesting static final String AOT_CACHE_SUFFIX = ".aot";
   @VisibleForTesting static final String DELETED_SUFFIX = ".deleted";
 
   private final Path root;
@@ -126,6 +129,11 @@ public final class InstallBaseGarbageCollector {
       // This is done early to avoid leaving the lock file behind if the deletion is interrupted.
       // It's still possible to get interrupted in between the rename and delete, but we accept it.
       lockPath.delete();
+      // The client's stamp recording that the install base was verified and the server's class
+      // data sharing archive and ahead-of-time caches go with it.
+      getVerifiedPath(installBase).delete();
+      getCdsArchivePath(installBase).delete();
+      getAotCachePath(installBase).deleteTree();
     } catch (LockAlreadyHeldException e) {
       // Looks like this install base is currently in use. Back off.
       return;
@@ -139,6 +147,21 @@ public final class InstallBaseGarbageCollector {
     return parent.getChild(installBase.getBaseName() + LOCK_SUFFIX);
   }
 
+  private static Path getVerifiedPath(Path installBase) {
+    Path parent = installBase.getParentDirectory();
+    return parent.getChild(installBase.getBaseName() + VERIFIED_SUFFIX);
+  }
+
+  private static Path getCdsArchivePath(Path installBase) {
+    Path parent = installBase.getParentDirectory();
+    return parent.getChild(installBase.getBaseName() + CDS_ARCHIVE_SUFFIX);
+  }
+
+  private static Path getAotCachePath(Path installBase) {
+    Path parent = installBase.getParentDirectory();
+    return parent.getChild(installBase.getBaseName() + AOT_CACHE_SUFFIX);
+  }
+
   private static Path getDeletedPath(Path installBase) {
     Path parent = installBase.getParentDirectory();
     return parent.getChild(UUID.randomUUID() + DELETED_SUFFIX);
@@ -17,6 +17,7 @@ package com.google.devtools.build.lib.shell;
 import java.io.Closeable;
 import java.io.InputStream;
 import java.io.OutputStream;
+import java.util.Optional;
 import javax.annotation.Nullable;
 
 /** A process started by Bazel. */
@@ -72,6 +73,14 @@ public interface Subprocess extends Closeable {
   /** Returns the PID of the current process. */
   long getProcessId();
 
+  /**
+   * Returns the resources used by the process and its subprocesses, if the implementation accounts
+   * for them. Only meaningful after the process has finished.
+   */
+  default Optional<ExecutionStatistics.ResourceUsage> getResourceUsage() {
+    return Optional.empty();
+  }
+
   /*
    * Terminates the process as thoroughly as the underlying implementation allows and releases
    * native data structures associated with the process.
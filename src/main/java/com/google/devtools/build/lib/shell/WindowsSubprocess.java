@@ -22,6 +22,7 @@ import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
 import java.lang.ref.Cleaner;
+import java.util.Optional;
 import java.util.concurrent.ExecutionException;
 import java.util.concurrent.ExecutorService;
 import java.util.concurrent.Executors;
@@ -338,4 +339,27 @@ public class WindowsSubprocess implements Subprocess {
   public long getProcessId() {
     return nativeState.nativeProcess;
   }
+
+  @Override
+  public synchronized Optional<ExecutionStatistics.ResourceUsage> getResourceUsage() {
+    checkLiveness();
+    long[] usage = new long[WindowsProcesses.RESOURCE_USAGE_SIZE];
+    if (!WindowsProcesses.getResourceUsage(nativeState.nativeProcess, usage)) {
+      // Resource accounting is best-effort; clear the error so that it isn't reported later.
+      WindowsProcesses.processGetLastError(nativeState.nativeProcess);
+      return Optional.empty();
+    }
+    // Times are in 100-nanosecond units. Report the memory in KiB like getrusage(2) on Linux.
+    return Optional.of(
+        new ExecutionStatistics.ResourceUsage(
+            Protos.ResourceUsage.newBuilder()
+                .setUtimeSec(usage[0] / 10_000_000)
+                .setUtimeUsec(usage[0] % 10_000_000 / 10)
+                .setStimeSec(usage[1] / 10_000_000)
+                .setStimeUsec(usage[1] % 10_000_000 / 10)
+                .setMaxrss(usage[2] / 1024)
+                .setInblock(usage[3])
+                .setOublock(usage[4])
+                .build()));
+  }
 }
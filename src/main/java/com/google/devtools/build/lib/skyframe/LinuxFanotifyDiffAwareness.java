@@ -0,0 +1,148 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+
+import com.google.common.base.Preconditions;
+import com.google.common.collect.ImmutableSet;
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.common.options.OptionsProvider;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.concurrent.CountDownLatch;
+
+/**
+ * A {@link DiffAwareness} that uses a fanotify file system mark to watch the filesystem, in lieu of
+ * {@link WatchServiceDiffAwareness}.
+ *
+ * <p>The WatchService registers an inotify watch per directory, which runs into {@code
+ * fs.inotify.max_user_watches} on large source trees. A single fanotify mark covers the whole file
+ * system, but needs {@code CAP_SYS_ADMIN} and {@code CAP_DAC_READ_SEARCH}; {@link #isSupported}
+ * tells whether this process has them, and the WatchService is used otherwise.
+ */
+public final class LinuxFanotifyDiffAwareness extends LocalDiffAwareness {
+  private boolean closed;
+
+  // Keep a pointer to a native structure in the JNI code (the run loop needs that structure).
+  private long nativePointer;
+
+  private boolean opened;
+
+  /** Watch changes on the file system under <code>watchRoot</code>. */
+  LinuxFanotifyDiffAwareness(Path watchRoot) {
+    super(watchRoot);
+  }
+
+  /**
+   * Returns whether the file system of <code>watchRoot</code> can be watched with fanotify by this
+   * process.
+   */
+  static boolean isSupported(Path watchRoot) {
+    return JNI_AVAILABLE && isSupported(watchRoot.toAbsolutePath().toString().getBytes(UTF_8));
+  }
+
+  private static native boolean isSupported(byte[] root);
+
+  /**
+   * Helper function to start the watch of <code>root</code>, which is expected to be a byte array
+   * containing the UTF-8 bytes of the path to watch, called by the constructor.
+   */
+  private native void create(byte[] root);
+
+  /**
+   * Runs the main loop to read the fanotify events.
+   *
+   * @param listening latch that is decremented when the loop has started. The caller must wait
+   *     until this happens before polling for events.
+   */
+  private native void run(CountDownLatch listening);
+
+  private void init() {
+    // The code below is based on the assumption that init() can never fail, which is currently the
+    // case; if you change init(), then you also need to update {@link #getCurrentView}.
+    Preconditions.checkState(!opened);
+    opened = true;
+    create(watchRoot.toAbsolutePath().toString().getBytes(UTF_8));
+
+    CountDownLatch listening = new CountDownLatch(1);
+    new Thread(() -> LinuxFanotifyDiffAwareness.this.run(listening), "linux-fanotify").start();
+    try {
+      listening.await();
+    } catch (InterruptedException e) {
+      Thread.currentThread().interrupt();
+    }
+  }
+
+  /** Close this watch service, this service should not be used any longer after closing. */
+  @Override
+  public void close() {
+    if (opened) {
+      Preconditions.checkState(!closed);
+      closed = true;
+      doClose();
+    }
+  }
+
+  private static final boolean JNI_AVAILABLE;
+
+  /** JNI code stopping the main loop and shutting down the fanotify group. */
+  private native void doClose();
+
+  /**
+   * JNI code returning the list of absolute path modified since last call.
+   *
+   * @return the array of paths (in the form of byte arrays containing the UTF-8 representation)
+   *     modified since the last call, or null if we can't precisely tell what changed
+   */
+  private native byte[][] poll();
+
+  static {
+    boolean loadJniWorked = false;
+    try {
+      JniLoader.loadJni();
+      loadJniWorked = true;
+    } catch (UnsatisfiedLinkError ignored) {
+      // As for MacOSXFsEventsDiffAwareness, the bootstrap binary has no JNI code.
+    }
+    JNI_AVAILABLE = loadJniWorked;
+  }
+
+  @Override
+  public View getCurrentView(OptionsProvider options) throws BrokenDiffAwarenessException {
+    // See WatchServiceDiffAwareness#getCurrentView for an explanation of this logic.
+    boolean watchFs = options.getOptions(Options.class).watchFS;
+    if (watchFs && !opened) {
+      init();
+    } else if (!watchFs && opened) {
+      close();
+      throw new BrokenDiffAwarenessException("Switched off --watchfs again");
+    } else if (!opened) {
+      // init() can never fail, so we don't need to re-check the opened flag after it.
+      return EVERYTHING_MODIFIED;
+    }
+    Preconditions.checkState(!closed);
+    byte[][] polledPaths = poll();
+    if (polledPaths == null) {
+      return EVERYTHING_MODIFIED;
+    } else {
+      ImmutableSet.Builder<Path> paths = ImmutableSet.builder();
+      for (byte[] pathBytes : polledPaths) {
+        paths.add(Paths.get(new String(pathBytes, UTF_8)));
+      }
+      return newView(paths.build());
+    }
+  }
+}
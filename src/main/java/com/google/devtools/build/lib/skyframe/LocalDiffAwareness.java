@@ -15,9 +15,12 @@
 package com.google.devtools.build.lib.skyframe;
 
 
+import static java.nio.charset.StandardCharsets.UTF_8;
+
 import com.google.common.annotations.VisibleForTesting;
 import com.google.common.collect.ImmutableList;
 import com.google.common.collect.ImmutableSet;
+import com.google.common.hash.Hashing;
 import com.google.devtools.build.lib.cmdline.IgnoredSubdirectories;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.util.StringEncoding;
@@ -31,18 +34,23 @@ import com.google.devtools.common.options.OptionEffectTag;
 import com.google.devtools.common.options.OptionsBase;
 import com.google.devtools.common.options.OptionsProvider;
 import java.io.IOException;
+import java.nio.file.Files;
 import java.nio.file.Path;
 import java.util.Set;
 import javax.annotation.Nullable;
 
 /**
  * File system watcher for local filesystems. It's able to provide a list of changed files between
- * two consecutive calls. On Linux, uses the standard Java WatchService, which uses 'inotify' and,
- * on OS X, uses {@link MacOSXFsEventsDiffAwareness}, which use FSEvents.
+ * two consecutive calls. On Linux, uses {@link LinuxFanotifyDiffAwareness} when the process may
+ * mark whole file systems with fanotify, and the standard Java WatchService, which uses 'inotify',
+ * otherwise; on OS X, uses {@link MacOSXFsEventsDiffAwareness}, which use FSEvents; on Windows,
+ * uses {@link WindowsUsnJournalDiffAwareness}, which reads the NTFS change journal, when the root
+ * is on such a volume.
  *
  * <p>
- * This is an abstract class, specialized by {@link MacOSXFsEventsDiffAwareness} and
- * {@link WatchServiceDiffAwareness}.
+ * This is an abstract class, specialized by {@link LinuxFanotifyDiffAwareness},
+ * {@link MacOSXFsEventsDiffAwareness}, {@link WatchServiceDiffAwareness} and
+ * {@link WindowsUsnJournalDiffAwareness}.
  */
 public abstract class LocalDiffAwareness implements DiffAwareness {
   /**
@@ -77,6 +85,7 @@ public abstract class LocalDiffAwareness implements DiffAwareness {
   /** Factory for creating {@link LocalDiffAwareness} instances. */
   public static class Factory implements DiffAwareness.Factory {
     private final ImmutableList<String> excludedNetworkFileSystemsPrefixes;
+    @Nullable private final Path journalDirectory;
 
     /**
      * Creates a new factory; the file system watcher may not work on all file systems, particularly
@@ -84,7 +93,20 @@ public abstract class LocalDiffAwareness implements DiffAwareness {
      * network file systems.
      */
     public Factory(ImmutableList<String> excludedNetworkFileSystemsPrefixes) {
+      this(excludedNetworkFileSystemsPrefixes, null);
+    }
+
+    /**
+     * Creates a new factory whose watchers keep their journal, if they have one, in
+     * <code>journalDirectory</code>, so that the watchers of the next server resume from where
+     * these left off. Only {@link MacOSXFsEventsDiffAwareness} and {@link
+     * WindowsUsnJournalDiffAwareness} have a journal.
+     */
+    public Factory(
+        ImmutableList<String> excludedNetworkFileSystemsPrefixes,
+        @Nullable Path journalDirectory) {
       this.excludedNetworkFileSystemsPrefixes = excludedNetworkFileSystemsPrefixes;
+      this.journalDirectory = journalDirectory;
     }
 
     @Override
@@ -109,13 +131,41 @@ public abstract class LocalDiffAwareness implements DiffAwareness {
           Path.of(StringEncoding.internalToPlatform(resolvedPathEntryFragment.getPathString()));
       // On OSX uses FsEvents due to https://bugs.openjdk.java.net/browse/JDK-7133447
       if (OS.getCurrent() == OS.DARWIN) {
-        return new MacOSXFsEventsDiffAwareness(watchRoot);
+        return new MacOSXFsEventsDiffAwareness(watchRoot, journalFor(journalDirectory, watchRoot));
+      }
+      // A fanotify mark does not run into the inotify watch limit on large trees, but needs
+      // privileges that most processes lack.
+      if (OS.getCurrent() == OS.LINUX && LinuxFanotifyDiffAwareness.isSupported(watchRoot)) {
+        return new LinuxFanotifyDiffAwareness(watchRoot);
+      }
+      // The change journal needs no watch per directory and keeps recording while no server runs.
+      if (OS.getCurrent() == OS.WINDOWS && WindowsUsnJournalDiffAwareness.isSupported(watchRoot)) {
+        return new WindowsUsnJournalDiffAwareness(
+            watchRoot, journalFor(journalDirectory, watchRoot));
       }
 
       return new WatchServiceDiffAwareness(watchRoot, ignoredPaths);
     }
   }
 
+  /**
+   * Returns the journal of the watcher of <code>watchRoot</code>, named after a hash of it, or null
+   * if there is no journal directory or it cannot be created.
+   */
+  @Nullable
+  private static Path journalFor(@Nullable Path journalDirectory, Path watchRoot) {
+    if (journalDirectory == null) {
+      return null;
+    }
+    try {
+      Files.createDirectories(journalDirectory);
+    } catch (IOException e) {
+      return null;
+    }
+    return journalDirectory.resolve(
+        Hashing.sha256().hashString(watchRoot.toString(), UTF_8).toString().substring(0, 32));
+  }
+
   /**
    * A view that results in any subsequent getDiff calls returning
    * {@link ModifiedFileSet#EVERYTHING_MODIFIED}. Use this if --watchFs is disabled.
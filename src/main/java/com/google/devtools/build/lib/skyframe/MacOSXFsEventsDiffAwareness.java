@@ -18,11 +18,13 @@ import static java.nio.charset.StandardCharsets.UTF_8;
 
 import com.google.common.base.Preconditions;
 import com.google.common.collect.ImmutableSet;
+import com.google.common.flogger.GoogleLogger;
 import com.google.devtools.build.lib.jni.JniLoader;
 import com.google.devtools.common.options.OptionsProvider;
 import java.nio.file.Path;
 import java.nio.file.Paths;
 import java.util.concurrent.CountDownLatch;
+import javax.annotation.Nullable;
 
 /**
  * A {@link DiffAwareness} that use fsevents to watch the filesystem to use in lieu of
@@ -30,37 +32,65 @@ import java.util.concurrent.CountDownLatch;
  *
  * <p>On OS X, the local diff awareness cannot work because WatchService is dummy and do polling,
  * which is slow (https://bugs.openjdk.java.net/browse/JDK-7133447).
+ *
+ * <p>Given a journal file, the id of the last event taken into account is saved to it, and the
+ * next instance watching the same root, typically that of the next server, resumes from it. The
+ * first view then holds the changes made while no server was watching, rather than none.
  */
 public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
+  private static final GoogleLogger logger = GoogleLogger.forEnclosingClass();
+
   private final double latency;
 
+  @Nullable private final Path journal;
+
+  // Whether the stream resumed from the event id in the journal.
+  private boolean resumed;
+
   private boolean closed;
 
   // Keep a pointer to a native structure in the JNI code (the FsEvents callback needs that
   // structure).
   private long nativePointer;
 
+  // The result of the last successful poll: the UTF-8 bytes of the modified paths end to end, and
+  // the offset each of them ends at. Set by the JNI code.
+  private byte[] polledPaths;
+  private int[] polledPathEnds;
+
   private boolean opened;
 
   /**
    * Watch changes on the file system under <code>watchRoot</code> with a granularity of <code>delay
    * </code> seconds.
    */
-  MacOSXFsEventsDiffAwareness(Path watchRoot, double latency) {
+  MacOSXFsEventsDiffAwareness(Path watchRoot, double latency, @Nullable Path journal) {
     super(watchRoot);
     this.latency = latency;
+    this.journal = journal;
+  }
+
+  /**
+   * Watch changes on the file system under <code>watchRoot</code> with a granularity of 5ms,
+   * journaling the last event taken into account to <code>journal</code> if not null.
+   */
+  MacOSXFsEventsDiffAwareness(Path watchRoot, @Nullable Path journal) {
+    this(watchRoot, 0.005, journal);
   }
 
   /** Watch changes on the file system under <code>watchRoot</code> with a granularity of 5ms. */
   MacOSXFsEventsDiffAwareness(Path watchRoot) {
-    this(watchRoot, 0.005);
+    this(watchRoot, null);
   }
 
   /**
    * Helper function to start the watch of <code>paths</code>, which is expected to be an array of
    * byte arrays containing the UTF-8 bytes of the paths to watch, called by the constructor.
+   *
+   * @param journalPath the UTF-8 bytes of the journal path, or null not to keep one
+   * @return whether the watch resumed from the event id in the journal
    */
-  private native void create(byte[][] paths, double latency);
+  private native boolean create(byte[][] paths, double latency, @Nullable byte[] journalPath);
 
   /**
    * Runs the main loop to listen for fsevents.
@@ -77,7 +107,11 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
     // TODO(jmmv): This can break if the user interrupts as anywhere in this function.
     Preconditions.checkState(!opened);
     opened = true;
-    create(new byte[][] {watchRoot.toAbsolutePath().toString().getBytes(UTF_8)}, latency);
+    resumed =
+        create(
+            new byte[][] {watchRoot.toAbsolutePath().toString().getBytes(UTF_8)},
+            latency,
+            journal == null ? null : journal.toAbsolutePath().toString().getBytes(UTF_8));
 
     // Start a thread that just contains the OS X run loop.
     CountDownLatch listening = new CountDownLatch(1);
@@ -109,12 +143,12 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
   private native void doClose();
 
   /**
-   * JNI code returning the list of absolute path modified since last call.
+   * JNI code collecting the absolute paths modified since last call into {@link #polledPaths} and
+   * {@link #polledPathEnds}, which it packs them into rather than allocating an array per path.
    *
-   * @return the array of paths (in the form of byte arrays containing the UTF-8 representation)
-   *     modified since the last call, or null if we can't precisely tell what changed
+   * @return false if we can't precisely tell what changed, in which case the fields are left as is
    */
-  private native byte[][] poll();
+  private native boolean poll();
 
   static {
     boolean loadJniWorked = false;
@@ -148,15 +182,23 @@ public final class MacOSXFsEventsDiffAwareness extends LocalDiffAwareness {
       return EVERYTHING_MODIFIED;
     }
     Preconditions.checkState(!closed);
-    byte[][] polledPaths = poll();
-    if (polledPaths == null) {
+    boolean polled = poll();
+    if (resumed && isFirstCall()) {
+      logger.atInfo().log(
+          "Resumed watching %s from the journal, %s changed since",
+          watchRoot, polled ? polledPathEnds.length + " paths" : "everything");
+    }
+    if (!polled) {
       return EVERYTHING_MODIFIED;
-    } else {
-      ImmutableSet.Builder<Path> paths = ImmutableSet.builder();
-      for (byte[] pathBytes : polledPaths) {
-        paths.add(Paths.get(new String(pathBytes, UTF_8)));
-      }
-      return newView(paths.build());
     }
+    ImmutableSet.Builder<Path> paths = ImmutableSet.builderWithExpectedSize(polledPathEnds.length);
+    int start = 0;
+    for (int end : polledPathEnds) {
+      paths.add(Paths.get(new String(polledPaths, start, end - start, UTF_8)));
+      start = end;
+    }
+    polledPaths = null;
+    polledPathEnds = null;
+    return newView(paths.build());
   }
 }
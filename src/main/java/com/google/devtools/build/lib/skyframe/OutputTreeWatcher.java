@@ -0,0 +1,173 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+
+import com.google.common.base.Preconditions;
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.build.lib.util.OS;
+import com.google.devtools.build.lib.vfs.ModifiedFileSet;
+import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.PathFragment;
+import java.util.concurrent.CountDownLatch;
+import javax.annotation.Nullable;
+
+/**
+ * Watches the output tree with inotify between builds, so that only the outputs that changed since
+ * the previous build need to be checked for external modifications at the start of the next one,
+ * rather than all of them.
+ *
+ * <p>The changes made while a build runs are attributed to the build and dropped by {@link
+ * #reset}, since they cannot be told apart from the outputs the build writes. Changing outputs
+ * while the build that produces them runs was never reliable in the first place.
+ *
+ * <p>It takes an inotify watch per directory of the output tree. If {@code
+ * fs.inotify.max_user_watches} does not allow for that many, {@link #reset} returns false and the
+ * watcher is useless.
+ */
+public final class OutputTreeWatcher implements AutoCloseable {
+  private static final boolean JNI_AVAILABLE;
+
+  private final Path outputPath;
+
+  // Keep a pointer to a native structure in the JNI code (the run loop needs that structure).
+  private long nativePointer;
+
+  // Filled in by poll().
+  private byte[] polledPaths;
+  private int[] polledPathEnds;
+
+  private boolean closed;
+
+  private OutputTreeWatcher(Path outputPath) {
+    this.outputPath = outputPath;
+  }
+
+  /**
+   * Starts watching the output tree at {@code outputPath}, or returns null if it cannot be watched
+   * on this platform. The tree need not exist yet.
+   */
+  @Nullable
+  public static OutputTreeWatcher create(Path outputPath) {
+    if (!JNI_AVAILABLE || OS.getCurrent() != OS.LINUX) {
+      return null;
+    }
+    OutputTreeWatcher watcher = new OutputTreeWatcher(outputPath);
+    if (!watcher.create(outputPath.getPathString().getBytes(ISO_8859_1))) {
+      watcher.doClose();
+      return null;
+    }
+    CountDownLatch listening = new CountDownLatch(1);
+    Thread thread = new Thread(() -> watcher.run(listening), "output-tree-watcher");
+    thread.setDaemon(true);
+    thread.start();
+    try {
+      listening.await();
+    } catch (InterruptedException e) {
+      Thread.currentThread().interrupt();
+    }
+    return watcher;
+  }
+
+  public Path getOutputPath() {
+    return outputPath;
+  }
+
+  /**
+   * Returns the exec paths of the files under the output tree that changed since the last {@link
+   * #reset}, or {@link ModifiedFileSet#EVERYTHING_MODIFIED} if they are not known exactly, say
+   * because there was no reset yet.
+   *
+   * <p>Does not forget the changes: the caller may not get to check them.
+   */
+  public synchronized ModifiedFileSet getModifiedFiles(Path execRoot) {
+    Preconditions.checkState(!closed);
+    if (!poll()) {
+      return ModifiedFileSet.EVERYTHING_MODIFIED;
+    }
+    ModifiedFileSet.Builder modified = ModifiedFileSet.builder();
+    PathFragment execRootFragment = execRoot.asFragment();
+    int start = 0;
+    for (int end : polledPathEnds) {
+      PathFragment path =
+          PathFragment.create(new String(polledPaths, start, end - start, ISO_8859_1));
+      if (path.startsWith(execRootFragment)) {
+        modified.modify(path.relativeTo(execRootFragment));
+      }
+      start = end;
+    }
+    polledPaths = null;
+    polledPathEnds = null;
+    return modified.build();
+  }
+
+  /**
+   * Forgets the changes seen so far, which the caller has taken into account or made itself.
+   *
+   * @return false if the output tree has more directories than can be watched, in which case the
+   *     watcher should be closed
+   */
+  public synchronized boolean reset() {
+    Preconditions.checkState(!closed);
+    return doReset();
+  }
+
+  @Override
+  public synchronized void close() {
+    if (!closed) {
+      closed = true;
+      doClose();
+    }
+  }
+
+  /**
+   * Sets up the watch of <code>root</code>, which is expected to be a byte array containing the
+   * bytes of the path to watch. Returns false if inotify is not available.
+   */
+  private native boolean create(byte[] root);
+
+  /**
+   * Runs the main loop to read the inotify events.
+   *
+   * @param listening latch that is decremented when the loop has started
+   */
+  private native void run(CountDownLatch listening);
+
+  /**
+   * JNI code collecting the absolute paths modified since the last reset into {@link #polledPaths}
+   * and {@link #polledPathEnds}.
+   *
+   * @return false if we can't precisely tell what changed, in which case the fields are left as is
+   */
+  private native boolean poll();
+
+  /** JNI code forgetting the changes seen so far. */
+  private native boolean doReset();
+
+  /** JNI code stopping the main loop and the watch. */
+  private native void doClose();
+
+  static {
+    boolean loadJniWorked = false;
+    try {
+      JniLoader.loadJni();
+      loadJniWorked = true;
+    } catch (UnsatisfiedLinkError ignored) {
+      // As for MacOSXFsEventsDiffAwareness, the bootstrap binary has no JNI code.
+    }
+    JNI_AVAILABLE = loadJniWorked;
+  }
+}
@@ -1618,6 +1618,10 @@ public abstract class SkyframeExecutor implements WalkableGraphFactory {
     this.pkgFactory.setGlobbingThreads(executors.globbingParallelism());
     this.pkgFactory.setMaxDirectoriesToEagerlyVisitInGlobbing(
         packageOptions.maxDirectoriesToEagerlyVisitInGlobbing);
+    // With several package path entries, a directory may be a package because of a build file on
+    // another entry, which the native glob would not see.
+    this.pkgFactory.setNativeGlobbing(
+        packageOptions.experimentalNativeGlob && pkgLocator.getPathEntries().size() == 1);
     emittedEventState.clear();
 
     // Clear internal caches used by SkyFunctions used for package loading. If the SkyFunctions
@@ -0,0 +1,165 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import static java.nio.charset.StandardCharsets.UTF_8;
+
+import com.google.common.base.Preconditions;
+import com.google.common.collect.ImmutableSet;
+import com.google.common.flogger.GoogleLogger;
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.common.options.OptionsProvider;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import javax.annotation.Nullable;
+
+/**
+ * A {@link DiffAwareness} that reads the NTFS change journal of the volume of the watched root, in
+ * lieu of {@link WatchServiceDiffAwareness}.
+ *
+ * <p>The journal records every change to the volume whether or not a process is watching, so there
+ * is no thread listening: each poll reads the records since the previous one and keeps those under
+ * the root. Given a journal file, the USN of the first record not taken into account yet is saved
+ * to it, and the next instance watching the same root, typically that of the next server, resumes
+ * from it as long as the records since are still in the change journal.
+ */
+public final class WindowsUsnJournalDiffAwareness extends LocalDiffAwareness {
+  private static final GoogleLogger logger = GoogleLogger.forEnclosingClass();
+
+  @Nullable private final Path journal;
+
+  // Whether the watch resumed from the USN in the journal.
+  private boolean resumed;
+
+  private boolean closed;
+
+  // Keep a pointer to a native structure in the JNI code.
+  private long nativePointer;
+
+  // The result of the last successful poll: the UTF-8 bytes of the modified paths end to end, and
+  // the offset each of them ends at. Set by the JNI code.
+  private byte[] polledPaths;
+  private int[] polledPathEnds;
+
+  private boolean opened;
+
+  /**
+   * Watch changes on the file system under <code>watchRoot</code>, journaling the USN to resume
+   * from to <code>journal</code> if not null.
+   */
+  WindowsUsnJournalDiffAwareness(Path watchRoot, @Nullable Path journal) {
+    super(watchRoot);
+    this.journal = journal;
+  }
+
+  /**
+   * Returns whether <code>watchRoot</code> is on an NTFS volume whose change journal is active.
+   */
+  static boolean isSupported(Path watchRoot) {
+    return JNI_AVAILABLE && isSupported(watchRoot.toAbsolutePath().toString().getBytes(UTF_8));
+  }
+
+  private static native boolean isSupported(byte[] root);
+
+  /**
+   * Helper function to start the watch of <code>root</code>, which is expected to be a byte array
+   * containing the UTF-8 bytes of the path to watch, called by the constructor.
+   *
+   * @param journalPath the UTF-8 bytes of the journal path, or null not to keep one
+   * @return whether the watch resumed from the USN in the journal
+   */
+  private native boolean create(byte[] root, @Nullable byte[] journalPath);
+
+  private void init() {
+    // The code below is based on the assumption that init() can never fail, which is currently the
+    // case; if you change init(), then you also need to update {@link #getCurrentView}.
+    Preconditions.checkState(!opened);
+    opened = true;
+    resumed =
+        create(
+            watchRoot.toAbsolutePath().toString().getBytes(UTF_8),
+            journal == null ? null : journal.toAbsolutePath().toString().getBytes(UTF_8));
+  }
+
+  /** Close this watch service, this service should not be used any longer after closing. */
+  @Override
+  public void close() {
+    if (opened) {
+      Preconditions.checkState(!closed);
+      closed = true;
+      doClose();
+    }
+  }
+
+  private static final boolean JNI_AVAILABLE;
+
+  /** JNI code releasing the native structure. */
+  private native void doClose();
+
+  /**
+   * JNI code reading the change journal since the last call and collecting the absolute paths
+   * modified under the root into {@link #polledPaths} and {@link #polledPathEnds}.
+   *
+   * @return false if we can't precisely tell what changed, in which case the fields are left as is
+   */
+  private native boolean poll();
+
+  static {
+    boolean loadJniWorked = false;
+    try {
+      JniLoader.loadJni();
+      loadJniWorked = true;
+    } catch (UnsatisfiedLinkError ignored) {
+      // As for MacOSXFsEventsDiffAwareness, the bootstrap binary has no JNI code.
+    }
+    JNI_AVAILABLE = loadJniWorked;
+  }
+
+  @Override
+  public View getCurrentView(OptionsProvider options) throws BrokenDiffAwarenessException {
+    // See WatchServiceDiffAwareness#getCurrentView for an explanation of this logic, including the
+    // guard behind --experimental_windows_watchfs.
+    Options watchOptions = options.getOptions(Options.class);
+    boolean watchFs = watchOptions.watchFS && watchOptions.windowsWatchFS;
+    if (watchFs && !opened) {
+      init();
+    } else if (!watchFs && opened) {
+      close();
+      throw new BrokenDiffAwarenessException("Switched off --watchfs again");
+    } else if (!opened) {
+      // init() can never fail, so we don't need to re-check the opened flag after it.
+      return EVERYTHING_MODIFIED;
+    }
+    Preconditions.checkState(!closed);
+    boolean polled = poll();
+    if (resumed && isFirstCall()) {
+      logger.atInfo().log(
+          "Resumed watching %s from the journal, %s changed since",
+          watchRoot, polled ? polledPathEnds.length + " paths" : "everything");
+    }
+    if (!polled) {
+      return EVERYTHING_MODIFIED;
+    }
+    ImmutableSet.Builder<Path> paths = ImmutableSet.builderWithExpectedSize(polledPathEnds.length);
+    int start = 0;
+    for (int end : polledPathEnds) {
+      paths.add(Paths.get(new String(polledPaths, start, end - start, UTF_8)));
+      start = end;
+    }
+    polledPaths = null;
+    polledPathEnds = null;
+    return newView(paths.build());
+  }
+}
@@ -14,6 +14,8 @@
 
 package com.google.devtools.build.lib.unix;
 
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
+
 import com.google.common.annotations.VisibleForTesting;
 import com.google.devtools.build.lib.bugreport.BugReport;
 import com.google.devtools.build.lib.jni.JniLoader;
@@ -21,6 +23,8 @@ import com.google.devtools.build.lib.util.Blocker;
 import com.google.devtools.build.lib.vfs.FileStatus;
 import java.io.FileNotFoundException;
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import javax.annotation.Nullable;
 
 /**
  * Utility methods for access to UNIX filesystem calls not exposed by the Java SDK. Exception
@@ -119,6 +123,98 @@ final class NativePosixFiles {
    */
   private static native FileStatus lstat(String path, char errorHandling) throws IOException;
 
+  /** The fields {@link #statFields} may be asked for, which can be or-ed together. */
+  static final int STAT_FIELD_MODE = 1 << 0; // the file type and permissions
+
+  static final int STAT_FIELD_MTIME = 1 << 1;
+  static final int STAT_FIELD_CTIME = 1 << 2;
+  static final int STAT_FIELD_SIZE = 1 << 3;
+  static final int STAT_FIELD_INO = 1 << 4;
+
+  /**
+   * Like {@link #stat} or {@link #lstat}, but only the given fields of the returned status are
+   * filled in, and the others are zero: e.g. with only {@link #STAT_FIELD_MODE}, {@link
+   * FileStatus#getLastModifiedTime} returns 0. With no fields at all, this only tells whether the
+   * file exists.
+   *
+   * <p>On Linux, this runs statx(2) asking for these fields only, so that the file system may skip
+   * the others. With {@code dontSync}, a networked file system such as NFS may answer from the
+   * attributes it has cached instead of revalidating them with the server, so that the result may
+   * be stale. Elsewhere, this is a plain stat(2) or lstat(2).
+   *
+   * @param path the file to stat.
+   * @param followSymlinks whether to follow a symlink at {@code path}, like stat(2).
+   * @param fields the {@code STAT_FIELD_*} constants or-ed together.
+   * @param dontSync whether cached attributes are good enough.
+   * @param errorHandling how to handle errors.
+   * @throws IOException if the syscall failed.
+   */
+  static FileStatus statFields(
+      String path,
+      boolean followSymlinks,
+      int fields,
+      boolean dontSync,
+      StatErrorHandling errorHandling)
+      throws IOException {
+    return statFields0(path, followSymlinks, fields, dontSync, errorHandling.getCode());
+  }
+
+  private static native FileStatus statFields0(
+      String path, boolean followSymlinks, int fields, boolean dontSync, char errorHandling)
+      throws IOException;
+
+  /** The number of longs {@link #statBatch} stores in {@code results} for each path. */
+  static final int STAT_BATCH_FIELDS = 5;
+
+  /** The offsets of the fields stored by {@link #statBatch} for each path. */
+  static final int STAT_BATCH_MODE = 0;
+  static final int STAT_BATCH_MTIME = 1;
+  static final int STAT_BATCH_CTIME = 2;
+  static final int STAT_BATCH_SIZE = 3;
+  static final int STAT_BATCH_INO = 4;
+
+  /**
+   * Stats several files in a single native call, without allocating a {@link FileStatus} for each
+   * of them.
+   *
+   * <p>The metadata of {@code paths[i]} is stored in {@code results} from index {@code i *
+   * STAT_BATCH_FIELDS}, at the {@code STAT_BATCH_*} offsets, with the times in milliseconds since
+   * the UNIX epoch. {@code errnos[i]} is set to 0 on success, or to the errno of the failed
+   * syscall, in which case the fields are zero.
+   *
+   * <p>On Linux, the syscalls of large batches are submitted through io_uring where available,
+   * which keeps a few hundred of them in flight at once.
+   *
+   * @param paths the files to stat.
+   * @param followSymlinks whether to call stat(2) rather than lstat(2).
+   * @param parallelism the maximum number of threads running the syscalls when io_uring is not
+   *     used; large batches of files on a cold or networked file system benefit from more than one.
+   * @param errnos receives the outcome for each path; must be at least as long as {@code paths}.
+   * @param results receives the metadata; must hold at least {@code paths.length *
+   *     STAT_BATCH_FIELDS} longs.
+   * @throws IllegalArgumentException if an array is too short or a path is null.
+   */
+  static void statBatch(
+      String[] paths, boolean followSymlinks, int parallelism, int[] errnos, long[] results) {
+    if (errnos.length < paths.length || results.length / STAT_BATCH_FIELDS < paths.length) {
+      throw new IllegalArgumentException("result arrays too short for " + paths.length + " paths");
+    }
+    for (String path : paths) {
+      if (path == null) {
+        throw new IllegalArgumentException("null path");
+      }
+    }
+    var comp = Blocker.begin();
+    try {
+      statBatch0(paths, followSymlinks, Math.max(1, parallelism), errnos, results);
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native void statBatch0(
+      String[] paths, boolean followSymlinks, int parallelism, int[] errnos, long[] results);
+
   /**
    * Native wrapper around POSIX utimensat(2) syscall.
    *
@@ -199,6 +295,38 @@ final class NativePosixFiles {
 
   private static native Dirents readdir(String path, char typeCode) throws IOException;
 
+  /**
+   * Reads several directories in a single native call, as {@link #readdir(String, ReadTypes)}
+   * would one by one. The entries whose type is not reported by the directory itself (or, for
+   * {@link ReadTypes#FOLLOW}, which are symlinks) are stat-ed together, through io_uring where
+   * available on Linux, so that a slow file system serves them concurrently.
+   *
+   * @param paths the directories to read.
+   * @param readTypes how to read the types of the entries.
+   * @param errnos receives 0 for each directory that was read, or the errno of the failed
+   *     opendir() or readdir(); must be at least as long as {@code paths}.
+   * @return the entries of each directory, or null for the directories that could not be read.
+   * @throws IllegalArgumentException if {@code errnos} is too short or a path is null.
+   */
+  static Dirents[] readdirBatch(String[] paths, ReadTypes readTypes, int[] errnos) {
+    if (errnos.length < paths.length) {
+      throw new IllegalArgumentException("errnos too short for " + paths.length + " paths");
+    }
+    for (String path : paths) {
+      if (path == null) {
+        throw new IllegalArgumentException("null path");
+      }
+    }
+    var comp = Blocker.begin();
+    try {
+      return readdirBatch0(paths, readTypes.getCode(), errnos);
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native Dirents[] readdirBatch0(String[] paths, char typeCode, int[] errnos);
+
   /**
    * An enum for specifying now the types of the individual entries returned by {@link
    * #readdir(String, ReadTypes)} is to be returned.
@@ -293,6 +421,163 @@ final class NativePosixFiles {
     }
   }
 
+  /**
+   * Like {@link #readdir(String, ReadTypes)}, but returns the names packed into a single byte
+   * array rather than as a String each, and, if {@code statEntries}, the metadata of each entry,
+   * from fstatat(2) calls relative to the open directory so that no full path is resolved.
+   *
+   * @param path the directory to read.
+   * @param readTypes how to read the types of the entries. Unless it is {@link ReadTypes#FOLLOW},
+   *     {@code statEntries} does not follow symlinks.
+   * @param statEntries whether to stat each entry.
+   * @throws IOException if the call to opendir or readdir failed for any reason.
+   */
+  static PackedDirents readdirPacked(String path, ReadTypes readTypes, boolean statEntries)
+      throws IOException {
+    var comp = Blocker.begin();
+    try {
+      return readdirPacked0(path, readTypes.getCode(), statEntries);
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native PackedDirents readdirPacked0(
+      String path, char typeCode, boolean statEntries) throws IOException;
+
+  /**
+   * The entries of a directory as returned by {@link #readdirPacked}, with one array per field
+   * rather than objects per entry.
+   */
+  static final class PackedDirents {
+
+    /** The Latin1 names of the entries, each followed by a NUL. */
+    private final byte[] names;
+
+    /** The offset of each name in {@link #names}, followed by the length of the array. */
+    private final int[] offsets;
+
+    /** The entry types as in {@link Dirents}, or null for {@link ReadTypes#NONE}. */
+    private final byte[] types;
+
+    /** {@link #STAT_BATCH_FIELDS} longs for each entry, as {@link #statBatch} stores them. */
+    private final long[] stats;
+
+    /** The errno of the stat of each entry, or 0 on success. */
+    private final int[] statErrnos;
+
+    /** called from JNI */
+    PackedDirents(byte[] names, int[] offsets, byte[] types, long[] stats, int[] statErrnos) {
+      this.names = names;
+      this.offsets = offsets;
+      this.types = types;
+      this.stats = stats;
+      this.statErrnos = statErrnos;
+    }
+
+    int size() {
+      return offsets.length - 1;
+    }
+
+    String getName(int i) {
+      return new String(names, offsets[i], offsets[i + 1] - offsets[i] - 1, ISO_8859_1);
+    }
+
+    boolean hasTypes() {
+      return types != null;
+    }
+
+    Dirents.Type getType(int i) {
+      return Dirents.Type.forChar((char) types[i]);
+    }
+
+    boolean hasStats() {
+      return stats != null;
+    }
+
+    /** Returns the errno of the stat of the given entry, or 0 if it succeeded. */
+    int getStatErrno(int i) {
+      return statErrnos[i];
+    }
+
+    /** Returns the given field of the metadata of the entry, or 0 if its stat failed. */
+    long getStatField(int i, int field) {
+      return stats[i * STAT_BATCH_FIELDS + field];
+    }
+  }
+
+  /**
+   * Evaluates a glob pattern below the directory {@code base} as {@code UnixGlob} does, in a single
+   * native call: the directories are read and the matching symlinks resolved relative to an open
+   * descriptor of {@code base} by up to {@code parallelism} threads.
+   *
+   * <p>The directories other than {@code base} that hold a regular file, or a symlink to one, named
+   * by one of {@code buildFiles} are not traversed and are reported as {@link #GLOB_BOUNDARY}; the
+   * directories at {@code pruned} are not traversed either.
+   *
+   * @param base the directory to evaluate the pattern below.
+   * @param pattern the segments of the pattern.
+   * @param buildFiles the names of the files that make a directory a boundary.
+   * @param pruned the paths relative to {@code base} of further directories not to traverse.
+   * @param parallelism the maximum number of threads reading directories.
+   * @return the matches and the boundaries, or null if {@code base} or one of the directories to
+   *     read cannot be read, or if a stat fails other than for a missing file.
+   */
+  @Nullable
+  static PackedGlob glob(
+      String base, String[] pattern, String[] buildFiles, String[] pruned, int parallelism) {
+    var comp = Blocker.begin();
+    try {
+      return glob0(base, pattern, buildFiles, pruned, Math.max(1, parallelism));
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native PackedGlob glob0(
+      String base, String[] pattern, String[] buildFiles, String[] pruned, int parallelism);
+
+  /** The bit of a {@link PackedGlob} kind for a match that is a file. */
+  static final byte GLOB_FILE = 1;
+
+  /** The bit of a {@link PackedGlob} kind for a match that is a directory. */
+  static final byte GLOB_DIRECTORY = 2;
+
+  /** The bit of a {@link PackedGlob} kind for a directory not traversed for its build file. */
+  static final byte GLOB_BOUNDARY = 4;
+
+  /** The paths found by {@link #glob}, with one array per field rather than objects per path. */
+  static final class PackedGlob {
+
+    /** The Latin1 paths relative to the base, each followed by a NUL, in sorted order. */
+    private final byte[] paths;
+
+    /** The offset of each path in {@link #paths}, followed by the length of the array. */
+    private final int[] offsets;
+
+    /** The {@code GLOB_*} bits of each path. */
+    private final byte[] kinds;
+
+    /** called from JNI */
+    PackedGlob(byte[] paths, int[] offsets, byte[] kinds) {
+      this.paths = paths;
+      this.offsets = offsets;
+      this.kinds = kinds;
+    }
+
+    int size() {
+      return offsets.length - 1;
+    }
+
+    String getPath(int i) {
+      return new String(paths, offsets[i], offsets[i + 1] - offsets[i] - 1, ISO_8859_1);
+    }
+
+    boolean hasKind(int i, byte kind) {
+      return (kinds[i] & kind) != 0;
+    }
+  }
+
   /**
    * Native wrapper around POSIX rename(2) syscall.
    *
@@ -354,11 +639,230 @@ final class NativePosixFiles {
    * Deletes all directory trees recursively beneath the given path, which is expected to be a
    * directory. Does not remove the top directory.
    *
+   * <p>With a parallelism above 1, the directories are deleted from a work-stealing queue by up to
+   * that many threads, which are only started once the hierarchy turns out to hold more than a
+   * hundred or so directories.
+   *
    * @param dir the directory hierarchy to remove
+   * @param parallelism the maximum number of threads deleting the hierarchy
    * @throws IOException if the hierarchy cannot be removed successfully or if the given path is not
    *     a directory
    */
-  static native void deleteTreesBelow(String dir) throws IOException;
+  static native void deleteTreesBelow(String dir, int parallelism) throws IOException;
+
+  /**
+   * Copies the regular file {@code from} to {@code to}, replacing {@code to} if it exists and
+   * preserving the permissions and the modification time (to the millisecond) of {@code from}.
+   *
+   * <p>The copy is a copy-on-write clone where the file system supports it (FICLONE on Linux, e.g.
+   * on btrfs and XFS, and clonefile(2) on APFS), which takes constant time whatever the size of the
+   * file. Otherwise the kernel copies the contents through copy_file_range(2) where available, and
+   * they are read and written as a last resort.
+   *
+   * @throws IOException if the file could not be copied, in which case no partial copy is left
+   */
+  static native void copyFile(String from, String to) throws IOException;
+
+  /**
+   * Asks the kernel to start reading each of the regular files at {@code paths} into the page
+   * cache in the background (posix_fadvise(POSIX_FADV_WILLNEED) on Linux, F_RDADVISE on macOS), up
+   * to their first 16 MiB, so that reading them one after the other does not wait on the disk for
+   * each of them in turn. Paths that cannot be opened or are not regular files are skipped.
+   *
+   * @throws IllegalArgumentException if a path is null.
+   */
+  static void prefetch(String[] paths) {
+    for (String path : paths) {
+      if (path == null) {
+        throw new IllegalArgumentException("null path");
+      }
+    }
+    var comp = Blocker.begin();
+    try {
+      prefetch0(paths);
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native void prefetch0(String[] paths);
+
+  /** {@link #mmap} advice for no particular access pattern. */
+  static final int MMAP_NORMAL = 0;
+
+  /** {@link #mmap} advice for reading the mapping from start to end, e.g. to hash or upload it. */
+  static final int MMAP_SEQUENTIAL = 1;
+
+  /** {@link #mmap} advice for reading the mapping in no particular order, without readahead. */
+  static final int MMAP_RANDOM = 2;
+
+  /** {@link #mmap} advice for all of the mapping to be read soon, so that it is read ahead now. */
+  static final int MMAP_WILLNEED = 3;
+
+  /**
+   * A read-only memory mapping of part of a file, made by {@link #mmap}. Not thread-safe: the
+   * mapping must only be closed once no thread reads the buffer anymore.
+   */
+  static final class MappedFile implements AutoCloseable {
+    private final ByteBuffer buffer;
+
+    /** The start of the mapping, which is page-aligned and may thus precede the buffer. */
+    private final long mapAddress;
+
+    private final long mapLength;
+    private final long fileSize;
+    private boolean closed;
+
+    /** called from JNI */
+    MappedFile(ByteBuffer buffer, long mapAddress, long mapLength, long fileSize) {
+      // The pages are mapped read-only: writing to them would crash the JVM.
+      this.buffer = buffer.asReadOnlyBuffer();
+      this.mapAddress = mapAddress;
+      this.mapLength = mapLength;
+      this.fileSize = fileSize;
+    }
+
+    /**
+     * Returns the mapped contents, as a read-only direct buffer. Reading it after {@link #close}
+     * crashes the JVM, and so does reading pages that are past the end of the file because it was
+     * truncated after it was mapped.
+     */
+    ByteBuffer buffer() {
+      return buffer;
+    }
+
+    /** The size of the file when it was mapped. */
+    long fileSize() {
+      return fileSize;
+    }
+
+    /** Unmaps the file. */
+    @Override
+    public void close() {
+      if (!closed) {
+        closed = true;
+        munmap0(mapAddress, mapLength);
+      }
+    }
+  }
+
+  /**
+   * Maps up to {@code length} bytes of the regular file {@code path} from {@code offset} into
+   * memory, read-only, so that its contents can be hashed, uploaded or parsed in place rather than
+   * copied into the Java heap. The mapping ends at the end of the file if that comes first; it is
+   * empty if {@code offset} is at or past the end.
+   *
+   * @param length the number of bytes to map, or -1 for the rest of the file.
+   * @param advice one of the {@code MMAP_*} constants, passed on to madvise(2) as a hint.
+   * @throws IOException if the file could not be mapped, e.g. because it is not a regular file or
+   *     the mapping would exceed {@link Integer#MAX_VALUE} bytes, the most a {@link ByteBuffer}
+   *     holds: larger files are mapped piece by piece.
+   * @throws IllegalArgumentException if an argument is out of range or the path is null.
+   */
+  static MappedFile mmap(String path, long offset, int length, int advice) throws IOException {
+    if (path == null) {
+      throw new IllegalArgumentException("null path");
+    }
+    if (offset < 0 || length < -1 || advice < MMAP_NORMAL || advice > MMAP_WILLNEED) {
+      throw new IllegalArgumentException(
+          "offset=%d length=%d advice=%d".formatted(offset, length, advice));
+    }
+    return mmap0(path, offset, length, advice);
+  }
+
+  private static native MappedFile mmap0(String path, long offset, int length, int advice)
+      throws IOException;
+
+  private static native void munmap0(long address, long length);
+
+  /**
+   * Copies several files in a single native call, as {@link #copyFile} would one by one, e.g. the
+   * files of a tree artifact.
+   *
+   * @param from the files to copy.
+   * @param to the copies, element by element.
+   * @param parallelism the maximum number of threads copying files.
+   * @param errnos receives 0 for each file that was copied, or the errno of the failed syscall;
+   *     must be at least as long as {@code from}.
+   * @throws IllegalArgumentException if an array is too short or a path is null.
+   */
+  static void copyFiles(String[] from, String[] to, int parallelism, int[] errnos) {
+    if (to.length < from.length || errnos.length < from.length) {
+      throw new IllegalArgumentException("arrays too short for " + from.length + " paths");
+    }
+    for (int i = 0; i < from.length; i++) {
+      if (from[i] == null || to[i] == null) {
+        throw new IllegalArgumentException("null path");
+      }
+    }
+    var comp = Blocker.begin();
+    try {
+      copyFiles0(from, to, Math.max(1, parallelism), errnos);
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native void copyFiles0(
+      String[] from, String[] to, int parallelism, int[] errnos);
+
+  /** The kind of a {@link #createTree} entry that is a directory. */
+  static final byte TREE_DIRECTORY = 0;
+
+  /** The kind of a {@link #createTree} entry that is a symbolic link to its target. */
+  static final byte TREE_SYMLINK = 1;
+
+  /** The kind of a {@link #createTree} entry that is a hard link to its absolute target. */
+  static final byte TREE_HARD_LINK = 2;
+
+  /**
+   * Creates a tree of directories and links below {@code root} in a single native call, e.g. a
+   * sandbox. The entries are created relative to handles of their directories, each of which is
+   * opened once, rather than by resolving their full paths one by one.
+   *
+   * <p>The directories are created first, in order, so a directory must come after its parent; a
+   * directory that already exists counts as created. The links are created next, possibly
+   * concurrently, and must not exist yet.
+   *
+   * @param root the existing directory the paths are relative to.
+   * @param kinds the kind of each entry, {@link #TREE_DIRECTORY}, {@link #TREE_SYMLINK} or {@link
+   *     #TREE_HARD_LINK}.
+   * @param paths the relative path of each entry.
+   * @param targets the target of each link; ignored for directories.
+   * @param parallelism the maximum number of threads creating links.
+   * @param errnos receives 0 for each entry that was created, or the errno of the failed syscall;
+   *     must be at least as long as {@code paths}.
+   * @throws IOException if {@code root} could not be opened
+   * @throws IllegalArgumentException if an array is too short, a kind is unknown, or a path or a
+   *     link target is null
+   */
+  static void createTree(
+      String root, byte[] kinds, String[] paths, String[] targets, int parallelism, int[] errnos)
+      throws IOException {
+    if (kinds.length < paths.length
+        || targets.length < paths.length
+        || errnos.length < paths.length) {
+      throw new IllegalArgumentException("arrays too short for " + paths.length + " paths");
+    }
+    for (int i = 0; i < paths.length; i++) {
+      if (kinds[i] < TREE_DIRECTORY || kinds[i] > TREE_HARD_LINK) {
+        throw new IllegalArgumentException("unknown kind " + kinds[i]);
+      }
+      if (paths[i] == null || (kinds[i] != TREE_DIRECTORY && targets[i] == null)) {
+        throw new IllegalArgumentException("null path");
+      }
+    }
+    var comp = Blocker.begin();
+    try {
+      createTree0(root, kinds, paths, targets, Math.max(1, parallelism), errnos);
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  private static native void createTree0(
+      String root, byte[] kinds, String[] paths, String[] targets, int parallelism, int[] errnos)
+      throws IOException;
 
   /**
    * Open a file descriptor for writing.
@@ -0,0 +1,84 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.unix;
+
+import com.google.devtools.build.lib.jni.JniLoader;
+import com.google.devtools.build.lib.util.OS;
+import javax.annotation.Nullable;
+
+/**
+ * The native threads on which the bulk operations of {@link NativePosixFiles} and the file digest
+ * JNI libraries run in parallel, e.g. {@code copyFiles}, {@code deleteTreesBelow} and {@code
+ * hashFiles}. They are shared by all of them and sized to the CPUs the server may use, its cgroup
+ * CPU quota included, so that concurrent bulk operations do not add up to more threads than that.
+ * Not available on Windows.
+ */
+public final class NativeWorkerPool {
+
+  static {
+    JniLoader.loadJni();
+  }
+
+  private NativeWorkerPool() {}
+
+  /**
+   * Counters of the pool.
+   *
+   * @param threads the number of threads, 0 until the pool is first used.
+   * @param active the number of calls the threads are running.
+   * @param queueDepth the number of calls waiting for a thread.
+   * @param maxQueueDepth the most calls that ever waited at once.
+   * @param callsRun the number of calls the threads ran.
+   * @param callsStolen the number of those a thread took from the queue of another one.
+   * @param callsDropped the number of calls that were not needed anymore by the time a thread was
+   *     free to run them, because the calling thread had done all the work.
+   */
+  public record Stats(
+      long threads,
+      long active,
+      long queueDepth,
+      long maxQueueDepth,
+      long callsRun,
+      long callsStolen,
+      long callsDropped) {}
+
+  private static boolean isAvailable() {
+    return OS.getCurrent() != OS.WINDOWS && JniLoader.isJniAvailable();
+  }
+
+  /** Returns the current counters of the pool, or null if it is not available. */
+  @Nullable
+  public static Stats getStats() {
+    if (!isAvailable()) {
+      return null;
+    }
+    long[] stats = new long[7];
+    getStats0(stats);
+    return new Stats(stats[0], stats[1], stats[2], stats[3], stats[4], stats[5], stats[6]);
+  }
+
+  /**
+   * Stops the threads of the pool once they are done with their current work. The bulk operations
+   * still work afterwards, on the calling thread only. Called when the server shuts down.
+   */
+  public static void shutdown() {
+    if (isAvailable()) {
+      shutdown0();
+    }
+  }
+
+  private static native void getStats0(long[] stats);
+
+  private static native void shutdown0();
+}
@@ -16,6 +16,7 @@ package com.google.devtools.build.lib.unix;
 import static com.google.devtools.build.lib.util.BazelCleaner.CLEANER;
 
 import com.google.common.base.Preconditions;
+import com.google.common.collect.ImmutableList;
 import com.google.common.collect.Lists;
 import com.google.devtools.build.lib.concurrent.ThreadSafety.ThreadSafe;
 import com.google.devtools.build.lib.profiler.Profiler;
@@ -27,10 +28,15 @@ import com.google.devtools.build.lib.util.Blocker;
 import com.google.devtools.build.lib.util.StringEncoding;
 import com.google.devtools.build.lib.vfs.AbstractFileSystemWithCustomStat;
 import com.google.devtools.build.lib.vfs.DigestHashFunction;
+import com.google.devtools.build.lib.vfs.DirectoryMerkleTree;
 import com.google.devtools.build.lib.vfs.Dirent;
 import com.google.devtools.build.lib.vfs.FileStatus;
+import com.google.devtools.build.lib.vfs.NativeGlobResult;
 import com.google.devtools.build.lib.vfs.Path;
 import com.google.devtools.build.lib.vfs.PathFragment;
+import com.google.devtools.build.lib.vfs.bazel.Blake3HashFunction;
+import com.google.devtools.build.lib.vfs.bazel.Blake3MessageDigest;
+import com.google.devtools.build.lib.vfs.bazel.NativeSha256;
 import java.io.File;
 import java.io.FileInputStream;
 import java.io.FileNotFoundException;
@@ -47,11 +53,47 @@ import javax.annotation.Nullable;
 /** This class implements the FileSystem interface using direct calls to the UNIX filesystem. */
 @ThreadSafe
 public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
+  /**
+   * The number of threads deleting a large tree in {@link #deleteTreesBelow}. Small trees, like most
+   * sandboxes, are deleted by the calling thread alone.
+   */
+  private static final int DELETE_TREES_BELOW_PARALLELISM =
+      Math.min(8, Runtime.getRuntime().availableProcessors());
+
+  /** The number of threads copying the files of a tree in {@link #copyFilesNatively}. */
+  private static final int COPY_FILES_PARALLELISM =
+      Math.min(8, Runtime.getRuntime().availableProcessors());
+
+  /** The number of threads creating the links of a tree. */
+  private static final int CREATE_TREE_PARALLELISM =
+      Math.min(8, Runtime.getRuntime().availableProcessors());
+
+  /** The number of threads digesting the files of a tree in {@link #computeMerkleTreeNatively}. */
+  private static final int MERKLE_TREE_PARALLELISM =
+      Math.min(8, Runtime.getRuntime().availableProcessors());
+
+  /** The number of threads reading the directories of a glob in {@link #globNatively}. */
+  private static final int GLOB_PARALLELISM =
+      Math.min(8, Runtime.getRuntime().availableProcessors());
+
   protected final String hashAttributeName;
 
+  /**
+   * The extended attribute in which the digests computed by {@link #getDigest} are remembered
+   * across server restarts, or null.
+   */
+  @Nullable private final String digestCacheAttributeName;
+
   public UnixFileSystem(DigestHashFunction hashFunction, String hashAttributeName) {
+    this(hashFunction, hashAttributeName, /* digestCacheAttributeName= */ "");
+  }
+
+  public UnixFileSystem(
+      DigestHashFunction hashFunction, String hashAttributeName, String digestCacheAttributeName) {
     super(hashFunction);
     this.hashAttributeName = hashAttributeName;
+    this.digestCacheAttributeName =
+        digestCacheAttributeName.isEmpty() ? null : digestCacheAttributeName;
   }
 
   public static Dirent.Type getDirentFromMode(int mode) {
@@ -164,9 +206,35 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  /**
+   * Like {@link #stat}, but only asks the file system for the given {@code
+   * NativePosixFiles.STAT_FIELD_*} fields, which is cheaper on some file systems, notably NFS. The
+   * other fields of the result are zero.
+   */
+  @Nullable
+  private FileStatus statFields(
+      PathFragment path, boolean followSymlinks, int fields, StatErrorHandling errorHandling)
+      throws IOException {
+    String name = path.getPathString();
+    long startTime = Profiler.nanoTimeMaybe();
+    var comp = Blocker.begin();
+    try {
+      return NativePosixFiles.statFields(
+          name, followSymlinks, fields, /* dontSync= */ false, errorHandling);
+    } finally {
+      Blocker.end(comp);
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_STAT, name);
+    }
+  }
+
   @Override
   protected boolean exists(PathFragment path, boolean followSymlinks) {
-    return statNullable(path, followSymlinks) != null;
+    try {
+      return statFields(path, followSymlinks, /* fields= */ 0, StatErrorHandling.NEVER_THROW)
+          != null;
+    } catch (IOException e) {
+      throw new IllegalStateException("unexpected exception", e);
+    }
   }
 
   /**
@@ -189,19 +257,26 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  private int getPermissions(PathFragment path) throws IOException {
+    return statFields(
+            path, /* followSymlinks= */ true, NativePosixFiles.STAT_FIELD_MODE,
+            StatErrorHandling.ALWAYS_THROW)
+        .getPermissions();
+  }
+
   @Override
   protected boolean isReadable(PathFragment path) throws IOException {
-    return (stat(path, true).getPermissions() & 0400) != 0;
+    return (getPermissions(path) & 0400) != 0;
   }
 
   @Override
   protected boolean isWritable(PathFragment path) throws IOException {
-    return (stat(path, true).getPermissions() & 0200) != 0;
+    return (getPermissions(path) & 0200) != 0;
   }
 
   @Override
   protected boolean isExecutable(PathFragment path) throws IOException {
-    return (stat(path, true).getPermissions() & 0100) != 0;
+    return (getPermissions(path) & 0100) != 0;
   }
 
   /**
@@ -369,7 +444,9 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
 
   @Override
   protected long getLastModifiedTime(PathFragment path, boolean followSymlinks) throws IOException {
-    return stat(path, followSymlinks).getLastModifiedTime();
+    return statFields(
+            path, followSymlinks, NativePosixFiles.STAT_FIELD_MTIME, StatErrorHandling.ALWAYS_THROW)
+        .getLastModifiedTime();
   }
 
   @Override
@@ -416,6 +493,22 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     String name = path.toString();
     long startTime = Profiler.nanoTimeMaybe();
     try {
+      if (getDigestFunction().getHashFunction() instanceof Blake3HashFunction) {
+        var comp = Blocker.begin();
+        try {
+          return Blake3MessageDigest.hashFile(name, digestCacheAttributeName);
+        } finally {
+          Blocker.end(comp);
+        }
+      }
+      if (getDigestFunction() == DigestHashFunction.SHA256) {
+        var comp = Blocker.begin();
+        try {
+          return NativeSha256.hashFile(name, digestCacheAttributeName);
+        } finally {
+          Blocker.end(comp);
+        }
+      }
       return super.getDigest(path);
     } finally {
       profiler.logSimpleTask(startTime, ProfilerTask.VFS_MD5, name);
@@ -433,13 +526,174 @@ public class UnixFileSystem extends AbstractFileSystemWithCustomStat {
     }
   }
 
+  @Override
+  protected boolean copyFilesNatively(List<PathFragment> sourcePaths, List<PathFragment> targetPaths)
+      throws IOException {
+    Preconditions.checkArgument(sourcePaths.size() == targetPaths.size());
+    var comp = Blocker.begin();
+    try {
+      if (sourcePaths.size() == 1) {
+        NativePosixFiles.copyFile(sourcePaths.get(0).toString(), targetPaths.get(0).toString());
+        return true;
+      }
+      String[] from = new String[sourcePaths.size()];
+      String[] to = new String[from.length];
+      for (int i = 0; i < from.length; i++) {
+        from[i] = sourcePaths.get(i).toString();
+        to[i] = targetPaths.get(i).toString();
+      }
+      int[] errnos = new int[from.length];
+      NativePosixFiles.copyFiles(from, to, COPY_FILES_PARALLELISM, errnos);
+      for (int i = 0; i < from.length; i++) {
+        if (errnos[i] != 0) {
+          // Copy the file again to throw the exception that copyFile() maps the error to.
+          NativePosixFiles.copyFile(from[i], to[i]);
+        }
+      }
+      return true;
+    } finally {
+      Blocker.end(comp);
+    }
+  }
+
+  @Override
+  @Nullable
+  protected DirectoryMerkleTree computeMerkleTreeNatively(PathFragment root) {
+    // Digests kept in an extended attribute are to be preferred over reading the files.
+    if (!hashAttributeName.isEmpty()) {
+      return null;
+    }
+    String name = root.toString();
+    Object[] tree;
+    long startTime = Profiler.nanoTimeMaybe();
+    var comp = Blocker.begin();
+    try {
+      if (getDigestFunction().getHashFunction() instanceof Blake3HashFunction) {
+        tree = Blake3MessageDigest.merkleTree(name, MERKLE_TREE_PARALLELISM);
+      } else if (getDigestFunction() == DigestHashFunction.SHA256) {
+        tree = NativeSha256.merkleTree(name, MERKLE_TREE_PARALLELISM);
+      } else {
+        return null;
+      }
+    } finally {
+      Blocker.end(comp);
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_MD5, name);
+    }
+    if (tree == null) {
+      return null;
+    }
+    return new DirectoryMerkleTree(
+        (byte[]) tree[0], (String[]) tree[1], (byte[]) tree[2], (long[]) tree[3]);
+  }
+
+  @Override
+  @Nullable
+  protected NativeGlobResult globNatively(
+      PathFragment base,
+      List<String> pattern,
+      List<String> buildFileNames,
+      List<PathFragment> prunedDirectories) {
+    for (String segment : pattern) {
+      // The native code only sees the low byte of each char.
+      if (!segment.chars().allMatch(c -> c <= 0xff)) {
+        return null;
+      }
+    }
+    String[] pruned = new String[prunedDirectories.size()];
+    for (int i = 0; i < pruned.length; i++) {
+      pruned[i] = prunedDirectories.get(i).getPathString();
+    }
+    String name = base.getPathString();
+    NativePosixFiles.PackedGlob glob;
+    long startTime = Profiler.nanoTimeMaybe();
+    try {
+      glob =
+          NativePosixFiles.glob(
+              name,
+              pattern.toArray(new String[0]),
+              buildFileNames.toArray(new String[0]),
+              pruned,
+              GLOB_PARALLELISM);
+    } finally {
+      profiler.logSimpleTask(startTime, ProfilerTask.VFS_GLOB, name);
+    }
+    if (glob == null) {
+      return null;
+    }
+    ImmutableList.Builder<PathFragment> files = ImmutableList.builder();
+    ImmutableList.Builder<PathFragment> directories = ImmutableList.builder();
+    ImmutableList.Builder<PathFragment> boundaries = ImmutableList.builder();
+    for (int i = 0; i < glob.size(); i++) {
+      PathFragment path = PathFragment.create(glob.getPath(i));
+      if (glob.hasKind(i, NativePosixFiles.GLOB_FILE)) {
+        files.add(path);
+      }
+      if (glob.hasKind(i, NativePosixFiles.GLOB_DIRECTORY)) {
+        directories.add(path);
+      }
+      if (glob.hasKind(i, NativePosixFiles.GLOB_BOUNDARY)) {
+        boundaries.add(path);
+      }
+    }
+    return new NativeGlobResult(files.build(), directories.build(), boundaries.build());
+  }
+
+  @Override
+  protected void prefetchForReading(List<PathFragment> paths) {
+    String[] pathStrings = new String[paths.size()];
+    for (int i = 0; i < pathStrings.length; i++) {
+      pathStrings[i] = paths.get(i).toString();
+    }
+    NativePosixFiles.prefetch(pathStrings);
+  }
+
+  @Override
+  protected boolean createSymbolicLinkTreeNatively(
+      PathFragment root,
+      List<PathFragment> directories,
+      List<PathFragment> symlinks,
+      List<PathFragment> symlinkTargets)
+      throws IOException {
+    Preconditions.checkArgument(symlinks.size() == symlinkTargets.size());
+    int count = directories.size() + symlinks.size();
+    byte[] kinds = new byte[count];
+    String[] paths = new String[count];
+    String[] targets = new String[count];
+    for (int i = 0; i < directories.size(); i++) {
+      kinds[i] = NativePosixFiles.TREE_DIRECTORY;
+      paths[i] = directories.get(i).relativeTo(root).getPathString();
+    }
+    for (int i = 0; i < symlinks.size(); i++) {
+      int j = directories.size() + i;
+      kinds[j] = NativePosixFiles.TREE_SYMLINK;
+      paths[j] = symlinks.get(i).relativeTo(root).getPathString();
+      targets[j] = symlinkTargets.get(i).getSafePathString();
+    }
+    int[] errnos = new int[count];
+    NativePosixFiles.createTree(
+        root.getPathString(), kinds, paths, targets, CREATE_TREE_PARALLELISM, errnos);
+    for (int i = 0; i < count; i++) {
+      if (errnos[i] != 0) {
+        // Create the entry again to throw the exception that the single operation maps the error
+        // to. The directories come first, so a failed one is retried before the links in it.
+        int j = i - directories.size();
+        if (j < 0) {
+          createDirectory(directories.get(i));
+        } else {
+          createSymbolicLink(symlinks.get(j), symlinkTargets.get(j));
+        }
+      }
+    }
+    return true;
+  }
+
   @Override
   protected void deleteTreesBelow(PathFragment dir) throws IOException {
     if (isDirectory(dir, /*followSymlinks=*/ false)) {
       long startTime = Profiler.nanoTimeMaybe();
       var comp = Blocker.begin();
       try {
-        NativePosixFiles.deleteTreesBelow(dir.toString());
+        NativePosixFiles.deleteTreesBelow(dir.toString(), DELETE_TREES_BELOW_PARALLELISM);
       } finally {
         Blocker.end(comp);
         profiler.logSimpleTask(startTime, ProfilerTask.VFS_DELETE, dir.toString());
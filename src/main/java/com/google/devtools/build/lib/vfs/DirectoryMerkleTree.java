@@ -0,0 +1,50 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.vfs;
+
+import static com.google.common.base.Preconditions.checkArgument;
+import static java.util.Objects.requireNonNull;
+
+/**
+ * The Merkle tree of a directory in the format of the remote execution API, as computed by {@link
+ * FileSystemUtils#computeMerkleTreeNatively}.
+ *
+ * @param tree the {@code Tree} message in wire format, with the root directory first and the other
+ *     directories after their parents, each of them once
+ * @param files the paths of the files of the tree relative to its root, symbolic links to files
+ *     included
+ * @param fileDigests the digest of {@code files[i]} at offset {@code i * fileDigests.length /
+ *     files.length}
+ * @param fileSizes the size of {@code files[i]}
+ */
+public record DirectoryMerkleTree(
+    byte[] tree, String[] files, byte[] fileDigests, long[] fileSizes) {
+  public DirectoryMerkleTree {
+    requireNonNull(tree, "tree");
+    requireNonNull(files, "files");
+    requireNonNull(fileDigests, "fileDigests");
+    requireNonNull(fileSizes, "fileSizes");
+    checkArgument(files.length == fileSizes.length);
+    checkArgument(
+        files.length == 0 ? fileDigests.length == 0 : fileDigests.length % files.length == 0);
+  }
+
+  /** Returns the digest of {@code files[i]}. */
+  public byte[] getFileDigest(int i) {
+    int length = fileDigests.length / files.length;
+    byte[] digest = new byte[length];
+    System.arraycopy(fileDigests, i * length, digest, 0, length);
+    return digest;
+  }
+}
@@ -34,6 +34,7 @@ import java.nio.file.FileAlreadyExistsException;
 import java.util.Collection;
 import java.util.Iterator;
 import java.util.List;
+import java.util.Map;
 import javax.annotation.Nullable;
 
 /** This interface models a file system. */
@@ -818,6 +819,97 @@ public abstract class FileSystem {
   protected abstract void createFSDependentHardLink(
       PathFragment linkPath, PathFragment originalPath) throws IOException;
 
+  /**
+   * Copies each of the regular files at "sourcePaths" to the corresponding "targetPaths", replacing
+   * the targets and preserving the permissions and modification times of the sources, without
+   * streaming their contents through the JVM (e.g. as copy-on-write clones). See {@link
+   * FileSystemUtils#copyFile} for the specification.
+   *
+   * <p>Returns false, having copied nothing, if the file system has no such facility; callers must
+   * then copy the files themselves. This default implementation always does.
+   *
+   * @throws IOException if a file could not be copied
+   */
+  protected boolean copyFilesNatively(List<PathFragment> sourcePaths, List<PathFragment> targetPaths)
+      throws IOException {
+    return false;
+  }
+
+  /**
+   * Hints that the regular files at "paths" are about to be read from the start, one after the
+   * other, e.g. to digest or upload them. See {@link FileSystemUtils#prefetchForReading} for the
+   * specification.
+   *
+   * <p>This default implementation does nothing.
+   */
+  protected void prefetchForReading(List<PathFragment> paths) {}
+
+  /**
+   * Computes the Merkle tree of the directory "root", with the digest function of this file system,
+   * in one go rather than listing, stating and digesting each entry separately. See {@link
+   * FileSystemUtils#computeMerkleTreeNatively} for the specification.
+   *
+   * <p>Returns null if the file system has no such facility or cannot compute the tree natively;
+   * callers must then compute it themselves. This default implementation always does.
+   */
+  @Nullable
+  protected DirectoryMerkleTree computeMerkleTreeNatively(PathFragment root) {
+    return null;
+  }
+
+  /**
+   * Evaluates the glob "pattern", split into segments, below the directory "base" in one go rather
+   * than listing each directory and stating each match separately, without traversing the
+   * directories that hold one of the "buildFileNames" or are at one of the "prunedDirectories". See
+   * {@link FileSystemUtils#globNatively} for the specification.
+   *
+   * <p>Returns null if the file system has no such facility or cannot evaluate the pattern
+   * natively; callers must then evaluate it themselves. This default implementation always does.
+   */
+  @Nullable
+  protected NativeGlobResult globNatively(
+      PathFragment base,
+      List<String> pattern,
+      List<String> buildFileNames,
+      List<PathFragment> prunedDirectories) {
+    return null;
+  }
+
+  /**
+   * Creates each of the "directories", in order, and then a symbolic link at each of the
+   * "symlinks" to the corresponding "symlinkTargets", all of them below the directory "root", in one
+   * go rather than resolving each path from the file system root. See {@link
+   * FileSystemUtils#createSymbolicLinkTree} for the specification.
+   *
+   * <p>Returns false, having created nothing, if the file system has no such facility; callers must
+   * then create the entries themselves. This default implementation always does.
+   *
+   * @throws IOException if an entry could not be created
+   */
+  protected boolean createSymbolicLinkTreeNatively(
+      PathFragment root,
+      List<PathFragment> directories,
+      List<PathFragment> symlinks,
+      List<PathFragment> symlinkTargets)
+      throws IOException {
+    return false;
+  }
+
+  /**
+   * Presents the files and directories at the values of "entries", or empty files for null values,
+   * at the corresponding keys relative to the directory "root", without creating them on disk up
+   * front. See {@link FileSystemUtils#createProjectedTree} for the specification.
+   *
+   * <p>Returns false, having created nothing, if the file system has no such facility; callers must
+   * then create the tree themselves. This default implementation always does.
+   *
+   * @throws IOException if the tree could not be created
+   */
+  protected boolean createProjectedTree(
+      PathFragment root, Map<PathFragment, PathFragment> entries) throws IOException {
+    return false;
+  }
+
   /**
    * Prefetch all directories and symlinks within the package rooted at "path". Enter at most
    * "maxDirs" total directories. Specializations for high-latency remote filesystems may wish to
@@ -17,6 +17,7 @@ import static java.nio.charset.StandardCharsets.ISO_8859_1;
 
 import com.google.common.base.Preconditions;
 import com.google.common.collect.ImmutableList;
+import com.google.common.collect.Lists;
 import com.google.common.io.ByteSink;
 import com.google.common.io.ByteSource;
 import com.google.common.io.ByteStreams;
@@ -30,7 +31,9 @@ import java.nio.charset.Charset;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collection;
+import java.util.HashMap;
 import java.util.List;
+import java.util.Map;
 import java.util.function.Predicate;
 import javax.annotation.Nullable;
 
@@ -389,6 +392,12 @@ public class FileSystemUtils {
       throw new IOException("error copying file: "
           + "couldn't delete destination: " + e.getMessage());
     }
+    if (from.getFileSystem() == to.getFileSystem()
+        && from.getFileSystem()
+            .copyFilesNatively(
+                ImmutableList.of(from.asFragment()), ImmutableList.of(to.asFragment()))) {
+      return;
+    }
     try (InputStream in = from.getInputStream();
         OutputStream out = to.getOutputStream()) {
       ByteStreams.copy(in, out);
@@ -400,6 +409,120 @@ public class FileSystemUtils {
     to.setExecutable(from.isExecutable()); // Copy executable bit.
   }
 
+  /**
+   * Hints that the regular files at {@code paths} are about to be read from the start, one after
+   * the other, e.g. to digest or upload them. Where the file system supports it, the kernel starts
+   * reading them all in the background, so that the I/O for the next files overlaps with
+   * processing the current one, which matters on a cold page cache or a network disk.
+   *
+   * <p>This is only a hint: missing files and errors are ignored, and nothing waits for the reads.
+   */
+  @ThreadSafe
+  public static void prefetchForReading(Collection<Path> paths) {
+    if (paths.isEmpty()) {
+      return;
+    }
+    Map<FileSystem, List<PathFragment>> pathsByFileSystem = new HashMap<>();
+    for (Path path : paths) {
+      pathsByFileSystem
+          .computeIfAbsent(path.getFileSystem(), fs -> new ArrayList<>())
+          .add(path.asFragment());
+    }
+    pathsByFileSystem.forEach(FileSystem::prefetchForReading);
+  }
+
+  /**
+   * Computes the Merkle tree of the directory {@code root} in the format of the remote execution
+   * API, with the digest function of its file system: the {@code Tree} message, obeying the
+   * requirements of {@code OutputDirectory.is_topologically_sorted}, and the digests of the files.
+   * Symbolic links with an absolute target are followed, the others are kept as such.
+   *
+   * <p>Where the file system supports it, the directories are listed and the files digested by
+   * native code on a few threads. Returns null otherwise, and whenever the tree holds something
+   * that the caller has to decide on or report, e.g. a special file, a dangling absolute symbolic
+   * link or an unreadable entry; the caller then walks the tree itself.
+   */
+  @Nullable
+  public static DirectoryMerkleTree computeMerkleTreeNatively(Path root) {
+    return root.getFileSystem().computeMerkleTreeNatively(root.asFragment());
+  }
+
+  /**
+   * Evaluates a glob pattern below the directory {@code base} as {@link UnixGlob} does with a
+   * discriminator that does not traverse the directories other than {@code base} that hold a
+   * regular file, or a symbolic link to one, named by one of {@code buildFileNames}, nor those at
+   * {@code prunedDirectories} (relative to {@code base}). The pattern must be valid for {@link
+   * UnixGlob#checkPatternForError} and is given split into its segments.
+   *
+   * <p>The result holds every path that such a glob would offer to {@link
+   * UnixGlobPathDiscriminator#shouldIncludePathInResult}, {@code base} included, and the
+   * directories it did not traverse for their build file, so that the caller can apply its own
+   * notion of what is a package and what goes into the result.
+   *
+   * <p>Where the file system supports it, the directories are read by native code on a few
+   * threads, relative to an open descriptor of {@code base}. Returns null otherwise, and whenever
+   * the glob would fail, e.g. because a directory cannot be read; the caller then evaluates the
+   * pattern itself.
+   */
+  @Nullable
+  public static NativeGlobResult globNatively(
+      Path base,
+      List<String> pattern,
+      List<String> buildFileNames,
+      List<PathFragment> prunedDirectories) {
+    return base.getFileSystem()
+        .globNatively(base.asFragment(), pattern, buildFileNames, prunedDirectories);
+  }
+
+  /**
+   * Creates each of {@code directories}, in order, and then a symbolic link at each of {@code
+   * symlinks} to the corresponding {@code symlinkTargets}, e.g. to set up a sandbox. A directory
+   * must come after its parent and may already exist; the links must not exist yet. All the
+   * directories and links must be below {@code root}.
+   *
+   * <p>Where the file system supports it, the entries are created natively in one go, relative to
+   * the directories they are in, which saves resolving each path anew and crossing into native code
+   * once per entry.
+   */
+  public static void createSymbolicLinkTree(
+      Path root, List<Path> directories, List<Path> symlinks, List<PathFragment> symlinkTargets)
+      throws IOException {
+    Preconditions.checkArgument(symlinks.size() == symlinkTargets.size());
+    if (root.getFileSystem()
+        .createSymbolicLinkTreeNatively(
+            root.asFragment(),
+            Lists.transform(directories, Path::asFragment),
+            Lists.transform(symlinks, Path::asFragment),
+            symlinkTargets)) {
+      return;
+    }
+    for (Path directory : directories) {
+      directory.createDirectory();
+    }
+    for (int i = 0; i < symlinks.size(); i++) {
+      symlinks.get(i).createSymbolicLink(symlinkTargets.get(i));
+    }
+  }
+
+  /**
+   * Presents the files and directories at the values of "entries" at the corresponding keys, which
+   * are relative paths, below the directory "root", in place of a tree of symbolic links to them.
+   * Null values stand for empty files. Anything at "root" is replaced.
+   *
+   * <p>Unlike a symlink tree, the tree is not created on disk up front: the file system presents it
+   * virtually, and only materializes entries as they are accessed. The entries have the contents of
+   * their targets rather than being links to them, and may stop reflecting changes to a target once
+   * they have been read.
+   *
+   * @return false, having created nothing, if the file system of "root" cannot present trees this
+   *     way; the caller must then create the tree itself
+   * @throws IOException if the tree could not be created
+   */
+  public static boolean createProjectedTree(Path root, Map<PathFragment, PathFragment> entries)
+      throws IOException {
+    return root.getFileSystem().createProjectedTree(root.asFragment(), entries);
+  }
+
   /** Describes the behavior of a {@link #moveFile(Path, Path)} operation. */
   public enum MoveResult {
     /** The file was moved at the file system level. */
@@ -575,17 +698,33 @@ public class FileSystemUtils {
     }
 
     Collection<Path> entries = from.getDirectoryEntries();
+    List<Path> files = new ArrayList<>();
+    List<Path> fileTargets = new ArrayList<>();
     for (Path entry : entries) {
       Path toPath = to.getChild(entry.getBaseName());
       if (!followSymlinks.toBoolean() && entry.isSymbolicLink()) {
         FileSystemUtils.ensureSymbolicLink(toPath, entry.readSymbolicLink());
       } else if (entry.isFile()) {
-        copyFile(entry, toPath);
+        files.add(entry);
+        fileTargets.add(toPath);
       } else {
         toPath.createDirectory();
         copyTreesBelow(entry, toPath, followSymlinks);
       }
     }
+    // The files of a directory are copied together, which lets the file system copy them
+    // concurrently.
+    if (files.size() > 1
+        && from.getFileSystem() == to.getFileSystem()
+        && from.getFileSystem()
+            .copyFilesNatively(
+                Lists.transform(files, Path::asFragment),
+                Lists.transform(fileTargets, Path::asFragment))) {
+      return;
+    }
+    for (int i = 0; i < files.size(); i++) {
+      copyFile(files.get(i), fileTargets.get(i));
+    }
   }
 
   /**
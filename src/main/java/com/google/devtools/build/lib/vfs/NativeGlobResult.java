@@ -0,0 +1,39 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.vfs;
+
+import static java.util.Objects.requireNonNull;
+
+import com.google.common.collect.ImmutableList;
+
+/**
+ * The paths found by evaluating a glob pattern below a directory, as computed by {@link
+ * FileSystemUtils#globNatively}. All of them are relative to that directory, which is the empty
+ * fragment.
+ *
+ * @param files the matches that are files, symbolic links to files included
+ * @param directories the matches that are directories, symbolic links to directories included
+ * @param boundaries the directories that were not traversed because they hold a build file, some
+ *     of which may be among {@code directories} as well
+ */
+public record NativeGlobResult(
+    ImmutableList<PathFragment> files,
+    ImmutableList<PathFragment> directories,
+    ImmutableList<PathFragment> boundaries) {
+  public NativeGlobResult {
+    requireNonNull(files, "files");
+    requireNonNull(directories, "directories");
+    requireNonNull(boundaries, "boundaries");
+  }
+}
@@ -109,7 +109,7 @@ public final class UnixGlob {
     return visitor.getNumGlobTasksForTesting();
   }
 
-  private static Future<List<Path>> globAsyncInternal(
+  private static ListenableFuture<List<Path>> globAsyncInternal(
       Path base,
       Collection<String> patterns,
       UnixGlobPathDiscriminator pathDiscriminator,
@@ -394,7 +394,7 @@ public final class UnixGlob {
      * Executes the glob asynchronously. {@link #setExecutor} must have been called already with a
      * non-null argument.
      */
-    public Future<List<Path>> globAsync() throws BadPattern {
+    public ListenableFuture<List<Path>> globAsync() throws BadPattern {
       return globAsyncInternal(base, patterns, pathDiscriminator, syscallCache, executor);
     }
   }
@@ -517,7 +517,7 @@ public final class UnixGlob {
      * Same as {@link #glob}, except does so asynchronously and returns a {@link Future} for the
      * result.
      */
-    Future<List<Path>> globAsync(
+    ListenableFuture<List<Path>> globAsync(
         Path base,
         Collection<String> patterns,
         UnixGlobPathDiscriminator pathDiscriminator,
@@ -14,9 +14,11 @@
 package com.google.devtools.build.lib.vfs.bazel;
 
 import com.google.devtools.build.lib.jni.JniLoader;
+import java.io.IOException;
 import java.nio.ByteBuffer;
 import java.security.DigestException;
 import java.security.MessageDigest;
+import javax.annotation.Nullable;
 
 /** A {@link MessageDigest} for BLAKE3. */
 public final class Blake3MessageDigest extends MessageDigest {
@@ -33,15 +35,93 @@ public final class Blake3MessageDigest extends MessageDigest {
   private static final byte[] INITIAL_STATE = new byte[STATE_SIZE];
 
   static {
-    initialize_hasher(INITIAL_STATE);
+    ByteBuffer initialState = ByteBuffer.allocateDirect(STATE_SIZE);
+    initialize_hasher(initialState);
+    initialState.get(0, INITIAL_STATE);
   }
 
-  private final byte[] hasher = new byte[STATE_SIZE];
+  // A direct buffer, so that the native code does not need to pin it.
+  private final ByteBuffer hasher = ByteBuffer.allocateDirect(STATE_SIZE);
   private final byte[] oneByteArray = new byte[1];
 
   public Blake3MessageDigest() {
     super("BLAKE3");
-    System.arraycopy(INITIAL_STATE, 0, hasher, 0, STATE_SIZE);
+    hasher.put(0, INITIAL_STATE);
+  }
+
+  /**
+   * Returns the BLAKE3 digest of the contents of a file, read by native code rather than copied
+   * through Java arrays. Not supported on Windows.
+   *
+   * @param path the file to hash, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @throws IOException if the file cannot be read.
+   */
+  public static byte[] hashFile(String path) throws IOException {
+    return hashFile(path, null);
+  }
+
+  /**
+   * Returns the BLAKE3 digest of the contents of a file, remembering it in an extended attribute
+   * of the file so that it is not read again, even by another server, as long as its size and
+   * modification time stay the same.
+   *
+   * @param path the file to hash, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @param attributeName the name of the extended attribute, or null to neither read nor write
+   *     one. Failing to write the attribute is not an error.
+   * @throws IOException if the file cannot be read.
+   */
+  public static byte[] hashFile(String path, @Nullable String attributeName) throws IOException {
+    byte[] digest = new byte[OUT_LEN];
+    blake3_hash_file(path, attributeName, digest);
+    return digest;
+  }
+
+  /**
+   * Hashes many files at once on up to {@code parallelism} native threads, which keeps the disk
+   * and the cores busy without a Java thread per file. Not supported on Windows.
+   *
+   * @param paths the files to hash, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @param parallelism the number of threads to use; values below 1 mean 1.
+   * @param digests receives the digest of {@code paths[i]} at offset {@code i * OUT_LEN}; must hold
+   *     at least {@code paths.length * OUT_LEN} bytes.
+   * @param errnos receives 0 for each file that was hashed, or the errno of the failed call; must
+   *     hold at least {@code paths.length} elements.
+   */
+  public static void hashFiles(String[] paths, int parallelism, byte[] digests, int[] errnos) {
+    hashFiles(paths, null, parallelism, digests, errnos);
+  }
+
+  /**
+   * Like {@link #hashFiles(String[], int, byte[], int[])}, remembering the digests in an extended
+   * attribute of the files like {@link #hashFile(String, String)}.
+   */
+  public static void hashFiles(
+      String[] paths,
+      @Nullable String attributeName,
+      int parallelism,
+      byte[] digests,
+      int[] errnos) {
+    if (digests.length / OUT_LEN < paths.length || errnos.length < paths.length) {
+      throw new IllegalArgumentException("output arrays too short for " + paths.length + " paths");
+    }
+    blake3_hash_files(paths, attributeName, parallelism, digests, errnos);
+  }
+
+  /**
+   * Computes the Merkle tree of a directory, in the format of the remote execution API and with
+   * BLAKE3 digests, on up to {@code parallelism} native threads. Absolute symbolic links to files
+   * and directories are followed, the other symbolic links are kept.
+   *
+   * @param root the directory, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @return the {@code Tree} message in wire format, the paths of the files relative to {@code
+   *     root}, their digests, {@code OUT_LEN} bytes each, and their sizes, as a {@code byte[]},
+   *     a {@code String[]}, a {@code byte[]} and a {@code long[]}; or null if the tree has an
+   *     entry that the caller has to deal with, e.g. a special file or a dangling absolute symbolic
+   *     link, or cannot be read.
+   */
+  @Nullable
+  public static Object[] merkleTree(String root, int parallelism) {
+    return blake3_merkle_tree(root, parallelism);
   }
 
   @Override
@@ -57,7 +137,12 @@ public final class Blake3MessageDigest extends MessageDigest {
 
   @Override
   public void engineUpdate(ByteBuffer input) {
-    super.engineUpdate(input);
+    if (input.isDirect()) {
+      blake3_hasher_update_direct(hasher, input, input.position(), input.remaining());
+      input.position(input.limit());
+    } else {
+      super.engineUpdate(input);
+    }
   }
 
   private byte[] getOutput(int outputLength) {
@@ -75,7 +160,7 @@ public final class Blake3MessageDigest extends MessageDigest {
 
   @Override
   public void engineReset() {
-    System.arraycopy(INITIAL_STATE, 0, hasher, 0, STATE_SIZE);
+    hasher.put(0, INITIAL_STATE);
   }
 
   @Override
@@ -104,10 +189,26 @@ public final class Blake3MessageDigest extends MessageDigest {
 
   public static final native int hasher_size();
 
-  public static final native void initialize_hasher(byte[] hasher);
+  public static final native void initialize_hasher(ByteBuffer hasher);
 
   public static final native void blake3_hasher_update(
-      byte[] hasher, byte[] input, int offset, int inputLen);
+      ByteBuffer hasher, byte[] input, int offset, int inputLen);
+
+  public static final native void blake3_hasher_update_direct(
+      ByteBuffer hasher, ByteBuffer input, int offset, int inputLen);
+
+  public static final native void blake3_hasher_finalize(
+      ByteBuffer hasher, byte[] out, int outLen);
+
+  private static native void blake3_hash_file(
+      String path, @Nullable String attribute, byte[] out) throws IOException;
+
+  private static native void blake3_hash_files(
+      String[] paths,
+      @Nullable String attribute,
+      int parallelism,
+      byte[] digests,
+      int[] errnos);
 
-  public static final native void blake3_hasher_finalize(byte[] hasher, byte[] out, int outLen);
+  private static native Object[] blake3_merkle_tree(String root, int parallelism);
 }
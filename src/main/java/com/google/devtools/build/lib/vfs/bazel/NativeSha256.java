@@ -0,0 +1,118 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.vfs.bazel;
+
+import com.google.devtools.build.lib.jni.JniLoader;
+import java.io.IOException;
+import javax.annotation.Nullable;
+
+/**
+ * SHA-256 digests of whole files, read and hashed by native code that uses the SHA extensions of
+ * x86-64 or ARMv8 when the CPU has them. The same as {@link Blake3MessageDigest#hashFile} and
+ * {@link Blake3MessageDigest#hashFiles} for BLAKE3. Not supported on Windows.
+ */
+public final class NativeSha256 {
+  public static final int OUT_LEN = 32;
+
+  static {
+    JniLoader.loadJni();
+  }
+
+  private NativeSha256() {}
+
+  /**
+   * Returns the SHA-256 digest of the contents of a file.
+   *
+   * @param path the file to hash, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @throws IOException if the file cannot be read.
+   */
+  public static byte[] hashFile(String path) throws IOException {
+    return hashFile(path, null);
+  }
+
+  /**
+   * Returns the SHA-256 digest of the contents of a file, remembering it in an extended attribute
+   * of the file so that it is not read again, even by another server, as long as its size and
+   * modification time stay the same.
+   *
+   * @param path the file to hash, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @param attributeName the name of the extended attribute, or null to neither read nor write
+   *     one. Failing to write the attribute is not an error.
+   * @throws IOException if the file cannot be read.
+   */
+  public static byte[] hashFile(String path, @Nullable String attributeName) throws IOException {
+    byte[] digest = new byte[OUT_LEN];
+    sha256_hash_file(path, attributeName, digest);
+    return digest;
+  }
+
+  /**
+   * Hashes many files at once on up to {@code parallelism} native threads.
+   *
+   * @param paths the files to hash, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @param parallelism the number of threads to use; values below 1 mean 1.
+   * @param digests receives the digest of {@code paths[i]} at offset {@code i * OUT_LEN}; must hold
+   *     at least {@code paths.length * OUT_LEN} bytes.
+   * @param errnos receives 0 for each file that was hashed, or the errno of the failed call; must
+   *     hold at least {@code paths.length} elements.
+   */
+  public static void hashFiles(String[] paths, int parallelism, byte[] digests, int[] errnos) {
+    hashFiles(paths, null, parallelism, digests, errnos);
+  }
+
+  /**
+   * Like {@link #hashFiles(String[], int, byte[], int[])}, remembering the digests in an extended
+   * attribute of the files like {@link #hashFile(String, String)}.
+   */
+  public static void hashFiles(
+      String[] paths,
+      @Nullable String attributeName,
+      int parallelism,
+      byte[] digests,
+      int[] errnos) {
+    if (digests.length / OUT_LEN < paths.length || errnos.length < paths.length) {
+      throw new IllegalArgumentException("output arrays too short for " + paths.length + " paths");
+    }
+    sha256_hash_files(paths, attributeName, parallelism, digests, errnos);
+  }
+
+  /**
+   * Computes the Merkle tree of a directory, in the format of the remote execution API and with
+   * SHA-256 digests, on up to {@code parallelism} native threads. Absolute symbolic links to files
+   * and directories are followed, the other symbolic links are kept.
+   *
+   * @param root the directory, Latin1 encoded like the paths of {@code NativePosixFiles}.
+   * @return the {@code Tree} message in wire format, the paths of the files relative to {@code
+   *     root}, their digests, {@code OUT_LEN} bytes each, and their sizes, as a {@code byte[]},
+   *     a {@code String[]}, a {@code byte[]} and a {@code long[]}; or null if the tree has an
+   *     entry that the caller has to deal with, e.g. a special file or a dangling absolute symbolic
+   *     link, or cannot be read.
+   */
+  @Nullable
+  public static Object[] merkleTree(String root, int parallelism) {
+    return sha256_merkle_tree(root, parallelism);
+  }
+
+  private static native void sha256_hash_file(
+      String path, @Nullable String attribute, byte[] out) throws IOException;
+
+  private static native void sha256_hash_files(
+      String[] paths,
+      @Nullable String attribute,
+      int parallelism,
+      byte[] digests,
+      int[] errnos);
+
+  private static native Object[] sha256_merkle_tree(String root, int parallelism);
+}
@@ -18,6 +18,7 @@ import com.google.devtools.build.lib.jni.JniLoader;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.nio.file.AccessDeniedException;
+import java.nio.file.NotDirectoryException;
 
 /** File operations on Windows. */
 public class WindowsFileOperations {
@@ -117,6 +118,18 @@ public class WindowsFileOperations {
   private static final int READ_SYMLINK_OR_JUNCTION_NOT_A_LINK = 4;
   private static final int READ_SYMLINK_OR_JUNCTION_UNKNOWN_LINK_TYPE = 5;
 
+  // Keep READ_DIRECTORY_METADATA_* values in sync with src/main/native/windows/file.h.
+  private static final int READ_DIRECTORY_METADATA_SUCCESS = 0;
+  // READ_DIRECTORY_METADATA_ERROR = 1;
+  private static final int READ_DIRECTORY_METADATA_DOES_NOT_EXIST = 2;
+  private static final int READ_DIRECTORY_METADATA_ACCESS_DENIED = 3;
+  private static final int READ_DIRECTORY_METADATA_NOT_A_DIRECTORY = 4;
+
+  // Keep PROJECT_TREE_* values in sync with src/main/native/windows/projfs.h.
+  private static final int PROJECT_TREE_SUCCESS = 0;
+  // PROJECT_TREE_ERROR = 1;
+  private static final int PROJECT_TREE_UNAVAILABLE = 2;
+
   private static native int nativeIsSymlinkOrJunction(
       String path, boolean[] result, String[] error);
 
@@ -134,6 +147,16 @@ public class WindowsFileOperations {
 
   private static native int nativeDeletePath(String path, String[] error);
 
+  private static native int nativeDeleteTreesBelow(String path, int parallelism, String[] error);
+
+  private static native int nativeReadDirectoryMetadata(
+      String path, String[][] names, long[][] metadata, String[] error);
+
+  private static native int nativeProjectTree(
+      String root, String[] paths, String[] targets, String[] error);
+
+  private static native void nativeRemoveProjectedTrees();
+
   /** Determines whether `path` is a junction point or directory symlink. */
   public static boolean isSymlinkOrJunction(String path) throws IOException {
     boolean[] result = new boolean[] {false};
@@ -171,6 +194,106 @@ public class WindowsFileOperations {
     throw new IOException(String.format("Cannot get last change time of '%s': %s", path, error[0]));
   }
 
+  /** The metadata of the entries of a directory, as read by {@link #readDirectoryMetadata}. */
+  public static final class DirectoryEntries {
+    // The longs nativeReadDirectoryMetadata stores for each entry, in this order.
+    private static final int ATTRIBUTES = 0;
+    private static final int REPARSE_TAG = 1;
+    private static final int CHANGE_TIME = 2;
+    private static final int LAST_WRITE_TIME = 3;
+    private static final int SIZE = 4;
+    private static final int FIELDS = 5;
+
+    public static final int FILE_ATTRIBUTE_READONLY = 0x1;
+    public static final int FILE_ATTRIBUTE_DIRECTORY = 0x10;
+    public static final int FILE_ATTRIBUTE_REPARSE_POINT = 0x400;
+
+    // The number of 100-nanosecond FILETIME intervals between 1601 and the UNIX epoch.
+    private static final long FILETIME_UNIX_EPOCH = 116444736000000000L;
+
+    private final String[] names;
+    private final long[] metadata;
+
+    private DirectoryEntries(String[] names, long[] metadata) {
+      this.names = names;
+      this.metadata = metadata;
+    }
+
+    public int size() {
+      return names.length;
+    }
+
+    public String getName(int i) {
+      return names[i];
+    }
+
+    /** Returns the FILE_ATTRIBUTE_* flags of the entry. */
+    public int getAttributes(int i) {
+      return (int) metadata[i * FIELDS + ATTRIBUTES];
+    }
+
+    /** Returns the reparse tag of the entry if it is a reparse point, else 0. */
+    public int getReparseTag(int i) {
+      return (int) metadata[i * FIELDS + REPARSE_TAG];
+    }
+
+    /** Whether the entry is a junction or symlink, as {@link #isSymlinkOrJunction} tells. */
+    public boolean isSymlinkOrJunction(int i) {
+      return (getAttributes(i) & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    }
+
+    public boolean isDirectory(int i) {
+      return (getAttributes(i) & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    }
+
+    /**
+     * Returns the time at which the entry was last changed, not following reparse points, as
+     * {@link #getLastChangeTime} does.
+     */
+    public long getLastChangeTime(int i) {
+      return metadata[i * FIELDS + CHANGE_TIME];
+    }
+
+    /** Returns the time at which the entry was last modified, in milliseconds since the epoch. */
+    public long getLastModifiedTime(int i) {
+      return (metadata[i * FIELDS + LAST_WRITE_TIME] - FILETIME_UNIX_EPOCH) / 10000;
+    }
+
+    public long getSize(int i) {
+      return metadata[i * FIELDS + SIZE];
+    }
+  }
+
+  /**
+   * Reads the names and metadata of all entries of the directory `path`.
+   *
+   * <p>The directory is listed through a single handle, so this is much faster than calling {@link
+   * #isSymlinkOrJunction} or {@link #getLastChangeTime} for each entry, each of which opens a
+   * handle and may have it scanned by antivirus software.
+   *
+   * @throws IOException if `path` is not found or not a directory, or some other I/O error occurs
+   */
+  public static DirectoryEntries readDirectoryMetadata(String path) throws IOException {
+    String[][] names = new String[][] {null};
+    long[][] metadata = new long[][] {null};
+    String[] error = new String[] {null};
+    switch (nativeReadDirectoryMetadata(asLongPath(path), names, metadata, error)) {
+      case READ_DIRECTORY_METADATA_SUCCESS:
+        return new DirectoryEntries(names[0], metadata[0]);
+      case READ_DIRECTORY_METADATA_DOES_NOT_EXIST:
+        throw new FileNotFoundException(path);
+      case READ_DIRECTORY_METADATA_ACCESS_DENIED:
+        throw new AccessDeniedException(path);
+      case READ_DIRECTORY_METADATA_NOT_A_DIRECTORY:
+        throw new NotDirectoryException(path);
+      default:
+        // This is READ_DIRECTORY_METADATA_ERROR (1). The JNI code puts a custom message in
+        // 'error[0]'.
+        break;
+    }
+    throw new IOException(String.format("Cannot read directory '%s': %s", path, error[0]));
+  }
+
   /**
    * Returns the long path associated with the input `path`.
    *
@@ -310,4 +433,61 @@ public class WindowsFileOperations {
         throw new IOException(String.format("Cannot delete path '%s': %s", path, error[0]));
     }
   }
+
+  /**
+   * Deletes everything below the directory `path`, but not `path` itself.
+   *
+   * <p>Directories are read and deleted by up to `parallelism` threads. Where the file system
+   * supports it, entries are deleted with POSIX semantics, so that their names are gone at once even
+   * if another process still has them open, and their directories need not be retried.
+   *
+   * @throws IOException if an entry could not be deleted; entries already deleted stay deleted
+   */
+  public static void deleteTreesBelow(String path, int parallelism) throws IOException {
+    String[] error = new String[] {null};
+    switch (nativeDeleteTreesBelow(asLongPath(path), parallelism, error)) {
+      case DELETE_PATH_SUCCESS:
+      case DELETE_PATH_DOES_NOT_EXIST:
+        return;
+      case DELETE_PATH_DIRECTORY_NOT_EMPTY:
+        throw new java.nio.file.DirectoryNotEmptyException(path);
+      case DELETE_PATH_ACCESS_DENIED:
+        throw new java.nio.file.AccessDeniedException(path);
+      default:
+        // This is DELETE_PATH_ERROR (1). The JNI code puts a custom message in 'error[0]'.
+        throw new IOException(String.format("Cannot delete trees below '%s': %s", path, error[0]));
+    }
+  }
+
+  /**
+   * Presents the files and directories at {@code targets} at the corresponding {@code paths},
+   * relative to the directory {@code root}, through the Windows Projected File System, with this
+   * process as the provider. Empty targets stand for empty files.
+   *
+   * <p>The tree costs next to nothing to create: entries only come into existence on disk when they
+   * are first accessed, and files only get their contents when they are first read. Unlike
+   * symlinks, this needs no privileges. Anything at {@code root} is deleted first. The tree can
+   * only be read while this process runs; {@link #removeProjectedTrees} deletes all trees.
+   *
+   * @return false, having done nothing, if the Projected File System is not enabled
+   * @throws IOException if the paths conflict with each other or the tree could not be created
+   */
+  public static boolean projectTree(String root, String[] paths, String[] targets)
+      throws IOException {
+    String[] error = new String[] {null};
+    switch (nativeProjectTree(asLongPath(root), paths, targets, error)) {
+      case PROJECT_TREE_SUCCESS:
+        return true;
+      case PROJECT_TREE_UNAVAILABLE:
+        return false;
+      default:
+        // This is PROJECT_TREE_ERROR (1). The JNI code puts a custom message in 'error[0]'.
+        throw new IOException(String.format("Cannot project tree '%s': %s", root, error[0]));
+    }
+  }
+
+  /** Deletes the trees that {@link #projectTree} created, and stops presenting them. */
+  public static void removeProjectedTrees() {
+    nativeRemoveProjectedTrees();
+  }
 }
@@ -112,6 +112,22 @@ public class WindowsProcesses {
    */
   public static native int getExitCode(long process);
 
+  /** The number of elements {@link #getResourceUsage} stores into its array. */
+  public static final int RESOURCE_USAGE_SIZE = 7;
+
+  /**
+   * Retrieves the resources used by the process and all of its subprocesses, as accounted by its
+   * job object. After {@link #waitFor} returned, this is the final usage.
+   *
+   * <p>On success, stores into {@code usage}, which must have at least {@link
+   * #RESOURCE_USAGE_SIZE} elements: the user time and the kernel time in 100-nanosecond units, the
+   * peak committed memory in bytes, the number of read and write operations, and the number of
+   * bytes read and written.
+   *
+   * @return true on success, or false if there was an error; see {@link #processGetLastError}
+   */
+  public static native boolean getResourceUsage(long process, long[] usage);
+
   /** Returns the process ID of the given process or -1 if there was an error. */
   public static native int getProcessPid(long process);
 
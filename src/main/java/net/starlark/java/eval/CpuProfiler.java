@@ -48,26 +48,43 @@ import net.starlark.java.syntax.Location;
 // counter location, or more usefully by the complete stack of
 // program counter locations.
 //
+// On Linux, each Starlark thread instead starts its own timer on its
+// CPU clock with timer_create, which signals that very thread. This
+// measures the CPU time of each thread exactly, rather than charging
+// the process-wide quantum to whichever thread happens to be running.
+//
+// In wall-clock mode (Linux only), the timer of each thread runs on
+// the monotonic clock instead, so a thread is sampled at the same rate
+// whether it is running or blocked, e.g. reading a file or waiting for
+// a Skyframe dependency. The signal handler tags each sample as on-CPU
+// or off-CPU by the CPU time the thread used since its previous sample,
+// and the profile labels the samples accordingly, so that it accounts
+// for latency and not only for CPU cycles.
+//
 // This profiler calls a C++ function to install a SIGPROF handler.
 // Like all handlers for asynchronous signals (that is, signals not
 // caused by the execution of program instructions), it is extremely
 // constrained in what it may do. It cannot acquire locks, allocate
 // memory, or interact with the JVM in any way. Our signal handler
-// simply sends a message into a global pipe; the message records
-// the operating system's identifier (tid) for the signalled thread.
+// simply appends an event to a lock-free queue in native memory;
+// the event records the operating system's identifier (tid) for the
+// signalled thread, whether it was on-CPU, and the time of the signal. The handler then
+// writes a byte into a global pipe, unless a wakeup is already pending.
 //
 // Reading from the other end of the pipe is a Java thread, the router.
-// Its job is to map each OS tid to a StarlarkThread, if the
-// thread is currently executing Starlark code, and increment
-// a volatile counter in that StarlarkThread. If the thread is
-// not executing Starlark code, the router discards the event.
+// Once woken up, it drains the queue in batches. Its job is to map each
+// OS tid to a StarlarkThread, if the thread is currently executing
+// Starlark code, and increment a volatile counter in that StarlarkThread
+// (one for on-CPU and one for off-CPU samples).
+// If the thread is not executing Starlark code, or the event precedes
+// the current profile, the router discards the event.
 // When a Starlark thread enters or leaves a function during profiling,
 // it updates the StarlarkThread-to-OS-thread mapping consulted by the
 // router.
 //
-// If the router does not drain the pipe in a timely manner (on the
-// order of 10s; see signal handler), the signal handler prints a
-// warning and discards the event.
+// If the router does not drain the queue in a timely manner (it holds
+// 16Ki events), the signal handler discards the events, and stop()
+// logs how many were lost.
 //
 // The router may induce a delay between the kernel signal and the
 // thread's stack sampling, during which Starlark execution may have
@@ -98,8 +115,8 @@ final class CpuProfiler {
 
   private final PprofWriter pprof;
 
-  private CpuProfiler(OutputStream out, Duration period) {
-    this.pprof = new PprofWriter(out, period);
+  private CpuProfiler(OutputStream out, Duration period, boolean wallClock) {
+    this.pprof = new PprofWriter(out, period, wallClock);
   }
 
   // The active profiler, if any.
@@ -112,38 +129,62 @@ final class CpuProfiler {
   }
 
   // Maps OS thread ID to StarlarkThread.
-  // The StarlarkThread is needed only for its cpuTicks field.
+  // The StarlarkThread is needed only for its cpuTicks and offCpuTicks fields.
   private static final Map<Integer, StarlarkThread> threads = new ConcurrentHashMap<>();
 
+  // Maps OS thread ID to the CPU timer of that thread, if it has one
+  // (see startThreadTimer). Each entry is only accessed by its own thread.
+  private static final Map<Integer, Long> threadTimers = new ConcurrentHashMap<>();
+
+  // The sampling period of the active profiler.
+  private static volatile long periodMicros;
+
   /**
    * Associates the specified StarlarkThread with the current OS thread. Returns the StarlarkThread
    * previously associated with it, if any.
    */
   @Nullable
   static StarlarkThread setStarlarkThread(StarlarkThread thread) {
+    int tid = gettid();
     if (thread == null) {
-      return threads.remove(gettid());
+      Long timer = threadTimers.remove(tid);
+      if (timer != null) {
+        stopThreadTimer(timer);
+      }
+      return threads.remove(tid);
     } else {
-      return threads.put(gettid(), thread);
+      StarlarkThread prev = threads.put(tid, thread);
+      if (prev == null) {
+        long timer = startThreadTimer(periodMicros);
+        if (timer != -1) {
+          threadTimers.put(tid, timer);
+        }
+      }
+      return prev;
     }
   }
 
-  /** Start the profiler. */
-  static boolean start(OutputStream out, Duration period) {
+  /** Start the profiler, sampling wall-clock time rather than CPU time if {@code wallClock}. */
+  static boolean start(OutputStream out, Duration period, boolean wallClock) {
     if (!supported()) {
       logger.atWarning().log("--starlark_cpu_profile is unsupported on this platform");
       return false;
     }
+    if (wallClock && !supportsWallClock()) {
+      logger.atWarning().log("wall-clock Starlark CPU profiling is unsupported on this platform");
+      return false;
+    }
     if (instance != null) {
       throw new IllegalStateException("profiler started twice without intervening stop");
     }
 
     startRouter();
-    if (!startTimer(period.toNanos() / 1000L)) {
+    periodMicros = period.toNanos() / 1000L;
+    if (!startTimer(periodMicros, wallClock)) {
       throw new IllegalStateException("profile signal handler already in use");
     }
 
-    instance = new CpuProfiler(out, period);
+    instance = new CpuProfiler(out, period, wallClock);
     return true;
   }
 
@@ -158,13 +199,19 @@ final class CpuProfiler {
 
     stopTimer();
 
+    long dropped = droppedEvents();
+    if (dropped > 0) {
+      logger.atWarning().log(
+          "Starlark profile event router thread could not keep up; discarded %d events", dropped);
+    }
+
     // Finish writing the file and fail if there were any I/O errors.
     profiler.pprof.writeEnd();
   }
 
-  /** Records a profile event. */
-  void addEvent(int ticks, ImmutableList<Debug.Frame> stack) {
-    pprof.writeEvent(ticks, stack);
+  /** Records a profile event of on-CPU and off-CPU ticks. */
+  void addEvent(int ticks, int offCpuTicks, ImmutableList<Debug.Frame> stack) {
+    pprof.writeEvent(ticks, offCpuTicks, stack);
   }
 
   // ---- signal router ----
@@ -182,73 +229,83 @@ final class CpuProfiler {
     }
   }
 
-  // The Router thread routes SIGPROF events (from the pipe)
+  // The Router thread routes SIGPROF events (from the native queue)
   // to the relevant StarlarkThread. Once started, it runs forever.
-  //
-  // TODO(adonovan): opt: a more efficient implementation of routing would be
-  // to use, instead of a pipe from the signal handler to the routing thread,
-  // a mapping, maintained in C++, from OS thread ID to cpuTicks pointer.
-  // The {add,remove}Thread operations would update this mapping,
-  // and the signal handler would read it. The mapping would have to
-  // be a lock-free hash table so that it can be safely read in an
-  // async signal handler. The pointer would point to the sole element
-  // of direct memory buffer belonging to the StarlarkThread, allocated
-  // by JNI NewDirectByteBuffer.
-  // In this way, the signal handler could update the StarlarkThread directly,
-  // saving 100 write+read calls per second per core.
-  //
   private static void router() {
-    byte[] buf = new byte[4];
+    byte[] buf = new byte[64];
+    int[] tids = new int[1024];
+    boolean[] onCpu = new boolean[tids.length];
     while (true) {
       try {
-        int n = pipe.read(buf);
-        if (n < 0) {
+        if (pipe.read(buf) < 0) {
           throw new IllegalStateException("pipe closed");
         }
-        if (n != 4) {
-          throw new IllegalStateException("short read");
-        }
       } catch (IOException ex) {
         throw new IllegalStateException("unexpected I/O error", ex);
       }
 
-      int tid = int32be(buf);
-
-      // Record a CPU tick against tid.
-      //
-      // It's not safe to grab the thread's stack here because the thread
-      // may be changing it, so we increment the thread's counter.
-      // When the thread later observes the counter is non-zero,
-      // it gives us the stack by calling addEvent.
-      StarlarkThread thread = threads.get(tid);
-      if (thread != null) {
-        thread.cpuTicks.getAndIncrement();
-      }
+      int n;
+      do {
+        n = readEvents(tids, onCpu);
+        for (int i = 0; i < n; i++) {
+          // Record a CPU tick against tid.
+          //
+          // It's not safe to grab the thread's stack here because the thread
+          // may be changing it, so we increment the thread's counter.
+          // When the thread later observes the counter is non-zero,
+          // it gives us the stack by calling addEvent.
+          StarlarkThread thread = threads.get(tids[i]);
+          if (thread != null) {
+            (onCpu[i] ? thread.cpuTicks : thread.offCpuTicks).getAndIncrement();
+          }
+        }
+      } while (n == tids.length);
     }
   }
 
-  // Decodes a signed 32-bit big-endian integer from b[0:4].
-  private static int int32be(byte[] b) {
-    return b[0] << 24 | (b[1] & 0xff) << 16 | (b[2] & 0xff) << 8 | (b[3] & 0xff);
-  }
-
   // --- native code (see cpu_profiler) ---
 
   // Reports whether the profiler is supported on this platform.
   private static native boolean supported();
 
-  // Returns the read end of a pipe from which profile events may be read.
-  // Each event is an operating system thread ID encoded as uint32be.
+  // Returns the read end of a pipe that becomes readable when profile
+  // events are queued. Its contents are meaningless.
   private static native FileDescriptor createPipe();
 
-  // Starts the operating system's interval timer.
+  // Moves queued profile events of the current profile into tids, as the
+  // operating system thread IDs of the signalled threads, and into onCpu,
+  // as whether each thread was running, and returns their number. Must be
+  // called until it returns less than tids.length after each wakeup read
+  // from the pipe.
+  private static native int readEvents(int[] tids, boolean[] onCpu);
+
+  // Returns and resets the number of events discarded because the queue
+  // was full.
+  private static native long droppedEvents();
+
+  // Reports whether threads can be sampled on wall-clock time.
+  private static native boolean supportsWallClock();
+
+  // Installs the signal handler and, where threads do not have their own
+  // timers, starts the operating system's interval timer.
   // The period must be a positive number of microseconds.
+  // If wallClock, the thread timers started from now on run on wall-clock
+  // rather than CPU time; see supportsWallClock.
   // Returns false if SIGPROF is already in use.
-  private static native boolean startTimer(long periodMicros);
+  private static native boolean startTimer(long periodMicros, boolean wallClock);
 
   // Stops the operating system's interval timer.
   private static native void stopTimer();
 
+  // Starts a timer that signals the calling thread whenever it has used
+  // periodMicros of CPU time (or, in wall-clock mode, whenever periodMicros
+  // have passed), and returns its handle, or -1 if the platform has no such
+  // timers.
+  private static native long startThreadTimer(long periodMicros);
+
+  // Deletes a timer returned by startThreadTimer.
+  private static native void stopThreadTimer(long timer);
+
   // Returns the operating system's identifier for the calling thread.
   private static native int gettid();
 
@@ -259,12 +316,14 @@ final class CpuProfiler {
   private static final class PprofWriter {
 
     private final Duration period;
+    private final boolean wallClock;
     private final long startNano;
     private GZIPOutputStream gz;
     private IOException error; // the first write error, if any; reported during stop()
 
-    PprofWriter(OutputStream out, Duration period) {
+    PprofWriter(OutputStream out, Duration period, boolean wallClock) {
       this.period = period;
+      this.wallClock = wallClock;
       this.startNano = System.nanoTime();
 
       try {
@@ -273,7 +332,7 @@ final class CpuProfiler {
 
         // dimension and unit
         ByteArrayOutputStream unit = new ByteArrayOutputStream();
-        writeLong(unit, VALUETYPE_TYPE, getStringID("CPU"));
+        writeLong(unit, VALUETYPE_TYPE, getStringID(wallClock ? "wall" : "CPU"));
         writeLong(unit, VALUETYPE_UNIT, getStringID("microseconds"));
 
         // informational fields of Profile
@@ -289,21 +348,38 @@ final class CpuProfiler {
       }
     }
 
-    synchronized void writeEvent(int ticks, ImmutableList<Debug.Frame> stack) {
+    synchronized void writeEvent(int ticks, int offCpuTicks, ImmutableList<Debug.Frame> stack) {
       if (this.error == null) {
         try {
-          ByteArrayOutputStream sample = new ByteArrayOutputStream();
-          writeLong(sample, SAMPLE_VALUE, ticks * period.toNanos() / 1000L);
-          for (Debug.Frame fr : stack.reverse()) {
-            writeLong(sample, SAMPLE_LOCATION_ID, getLocationID(fr));
+          if (ticks > 0) {
+            writeSample(ticks, wallClock ? "on-cpu" : null, stack);
+          }
+          if (offCpuTicks > 0) {
+            writeSample(offCpuTicks, "off-cpu", stack);
           }
-          writeByteArray(gz, PROFILE_SAMPLE, sample.toByteArray());
         } catch (IOException ex) {
           this.error = ex;
         }
       }
     }
 
+    // Writes a sample, labelled with the thread state in wall-clock mode.
+    private void writeSample(int ticks, @Nullable String state, ImmutableList<Debug.Frame> stack)
+        throws IOException {
+      ByteArrayOutputStream sample = new ByteArrayOutputStream();
+      writeLong(sample, SAMPLE_VALUE, ticks * period.toNanos() / 1000L);
+      for (Debug.Frame fr : stack.reverse()) {
+        writeLong(sample, SAMPLE_LOCATION_ID, getLocationID(fr));
+      }
+      if (state != null) {
+        ByteArrayOutputStream label = new ByteArrayOutputStream();
+        writeLong(label, LABEL_KEY, getStringID("state"));
+        writeLong(label, LABEL_STR, getStringID(state));
+        writeByteArray(sample, SAMPLE_LABEL, label.toByteArray());
+      }
+      writeByteArray(gz, PROFILE_SAMPLE, sample.toByteArray());
+    }
+
     synchronized void writeEnd() throws IOException {
       long endNano = System.nanoTime();
       try {
@@ -1253,7 +1253,17 @@ public final class Starlark {
    *     operating system's profiling resources for this process are already in use.
    */
   public static boolean startCpuProfile(OutputStream out, Duration period) {
-    return CpuProfiler.start(out, period);
+    return startCpuProfile(out, period, /* wallClock= */ false);
+  }
+
+  /**
+   * Like {@link #startCpuProfile(OutputStream, Duration)}, but if {@code wallClock}, samples every
+   * Starlark thread at intervals of wall-clock time, whether it is running or blocked (e.g. in I/O),
+   * and labels each sample with {@code state=on-cpu} or {@code state=off-cpu}. Wall-clock profiling
+   * is only supported on Linux; elsewhere this returns false.
+   */
+  public static boolean startCpuProfile(OutputStream out, Duration period, boolean wallClock) {
+    return CpuProfiler.start(out, period, wallClock);
   }
 
   /**
@@ -59,6 +59,7 @@ public final class StarlarkThread {
   // the profiler session might start in the middle of a call and/or run beyond
   // the lifetime of this thread.
   final AtomicInteger cpuTicks = new AtomicInteger();
+  final AtomicInteger offCpuTicks = new AtomicInteger(); // wall-clock profiles only
   @Nullable private CpuProfiler profiler;
   private StarlarkThread savedThread; // saved StarlarkThread, when profiling reentrant evaluation
 
@@ -264,6 +265,7 @@ public final class StarlarkThread {
       this.profiler = CpuProfiler.get();
       if (profiler != null) {
         cpuTicks.set(0);
+        offCpuTicks.set(0);
         // Associated current Java thread with this StarlarkThread.
         // (Save the previous association so we can restore it later.)
         this.savedThread = CpuProfiler.setStarlarkThread(this);
@@ -278,8 +280,9 @@ public final class StarlarkThread {
 
     if (profiler != null) {
       int ticks = cpuTicks.getAndSet(0);
-      if (ticks > 0) {
-        profiler.addEvent(ticks, getDebugCallStack());
+      int offTicks = offCpuTicks.getAndSet(0);
+      if (ticks > 0 || offTicks > 0) {
+        profiler.addEvent(ticks, offTicks, getDebugCallStack());
       }
 
       // If this is the final pop in this thread,
@@ -14,23 +14,31 @@
 
 // POSIX support for Starlark CPU profiler.
 
-#include <arpa/inet.h>  // for htonl
 #include <errno.h>
 #include <fcntl.h>
 #include <jni.h>
 #include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #ifdef __linux__
 #include <sys/syscall.h>
 #else  // darwin
 #include <pthread.h>
 #endif
 
+#if defined(__linux__) && !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 namespace cpu_profiler {
 
 // static native boolean supported();
@@ -41,6 +49,62 @@ Java_net_starlark_java_eval_CpuProfiler_supported(JNIEnv *env, jclass clazz) {
 
 static int fd;  // the write end of the profile event pipe
 
+// Profile events are buffered in a bounded lock-free queue, written by the
+// signal handler of any thread and read by the Java router thread. This is
+// the queue of Dmitry Vyukov: each slot carries a sequence number that tells
+// whether it is free for the producer that claimed its position or holds an
+// event for the consumer.
+//
+// The pipe only carries wakeups: the handler writes a byte when the router
+// may be blocked waiting for events, so a full pipe no longer loses events
+// and the sample rate is not limited by the throughput of the pipe.
+struct Event {
+  std::atomic<uint64_t> seq;
+  pid_t tid;
+  bool on_cpu;    // whether the thread was running rather than blocked
+  int64_t nanos;  // CLOCK_MONOTONIC time of the signal
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "the signal handler requires lock-free atomics");
+
+// 16Ki events are 1.6s of samples of 10 cores at 1kHz.
+static constexpr uint64_t kRingSize = 1 << 14;
+static Event ring[kRingSize];
+static std::atomic<uint64_t> ring_head;  // next position to claim
+static uint64_t ring_tail;               // next position to read (router only)
+static std::atomic<uint64_t> dropped;    // events lost to a full queue
+static std::atomic<bool> wakeup_pending;
+// Events of an earlier profile are discarded by the router.
+static std::atomic<int64_t> profile_start_nanos;
+// Whether the thread timers of this profile run on wall-clock time.
+static std::atomic<bool> wall_clock;
+
+static int64_t clock_nanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t now_nanos() { return clock_nanos(CLOCK_MONOTONIC); }
+
+// The timers of the threads, see startThreadTimer. A slot is claimed by the
+// thread that starts the timer, and only that thread's signal handler uses
+// the clock readings, so they need no synchronization.
+//
+// In wall-clock mode a thread is signalled whether or not it runs. The handler
+// tells the two apart by how much CPU time the thread used since the previous
+// signal: a thread that ran for at least half of the interval is on-CPU.
+struct ThreadTimer {
+  std::atomic<bool> used;
+  timer_t timer;
+  int64_t cpu_nanos;   // CLOCK_THREAD_CPUTIME_ID time of the last signal
+  int64_t wall_nanos;  // CLOCK_MONOTONIC time of the last signal
+};
+
+static constexpr int kMaxThreadTimers = 4096;
+static ThreadTimer thread_timers[kMaxThreadTimers];
+
 pid_t gettid(void) {
 #ifdef __linux__
   return (pid_t)syscall(SYS_gettid);
@@ -51,9 +115,36 @@ pid_t gettid(void) {
 #endif
 }
 
+// Appends an event to the queue, or returns false if it is full.
+// Async-signal-safe.
+static bool push_event(pid_t tid, bool on_cpu, int64_t nanos) {
+  uint64_t pos = ring_head.load(std::memory_order_relaxed);
+  Event *e;
+  while (true) {
+    e = &ring[pos & (kRingSize - 1)];
+    uint64_t seq = e->seq.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(seq - pos);
+    if (diff == 0) {
+      if (ring_head.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;  // the router has not read this slot yet
+    } else {
+      pos = ring_head.load(std::memory_order_relaxed);
+    }
+  }
+  e->tid = tid;
+  e->on_cpu = on_cpu;
+  e->nanos = nanos;
+  e->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
 // SIGPROF handler.
 // Warning: asynchronous! See signal-safety(7) for the programming discipline.
-void onsigprof(int sig) {
+void onsigprof(int sig, siginfo_t *info, void *context) {
   int old_errno = errno;
 
   if (fd == 0) {
@@ -62,26 +153,31 @@ void onsigprof(int sig) {
     abort();
   }
 
-  // Send an event containing the int32be-encoded OS thread ID.
-  pid_t tid = gettid();
-  uint32_t tid_be = htonl(tid);
-  int r = write(fd, (void *)&tid_be, sizeof tid_be);
-  if (r < 0) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-      // The Java router thread cannot keep up.
-      //
-      // A busy 12-core machine receives 12 * 100Hz = 1200 signals per second,
-      // and thus writes 4.8KB/s to the pipe. The default pipe buffer
-      // size on Linux is 64KiB, sufficient to buffer ~14s of data.
-      // (It is a quarter of that on Mac OS X.)
-      //
-      // Rather than block in write(2), causing the JVM to deadlock,
-      // we print an error and discard the event.
-      const char *msg =
-          "Starlark profile event router thread cannot keep up; discarding "
-          "events\n";
-      write(2, msg, strlen(msg));
-    } else {
+  int64_t now = now_nanos();
+  bool on_cpu = true;  // CPU timers only fire while the thread runs
+  if (info != nullptr && info->si_code == SI_TIMER &&
+      wall_clock.load(std::memory_order_relaxed)) {
+    int slot = info->si_value.sival_int;
+    if (slot >= 0 && slot < kMaxThreadTimers) {
+      ThreadTimer *t = &thread_timers[slot];
+      int64_t cpu = clock_nanos(CLOCK_THREAD_CPUTIME_ID);
+      on_cpu = (cpu - t->cpu_nanos) * 2 >= now - t->wall_nanos;
+      t->cpu_nanos = cpu;
+      t->wall_nanos = now;
+    }
+  }
+
+  if (!push_event(gettid(), on_cpu, now)) {
+    // The Java router thread cannot keep up. Rather than block, causing the
+    // JVM to deadlock, we discard the event; stop() reports the count.
+    dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Wake up the router unless a wakeup is already pending; the router clears
+  // the flag before it drains the queue.
+  if (!wakeup_pending.exchange(true)) {
+    char b = 0;
+    if (write(fd, &b, 1) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
       // We shouldn't use perror in a signal handler.
       // Strictly, we shouldn't use strerror either,
       // but for all errors returned by write it merely
@@ -97,6 +193,52 @@ void onsigprof(int sig) {
   errno = old_errno;
 }
 
+// static native int readEvents(int[] tids, boolean[] onCpu);
+extern "C" JNIEXPORT jint JNICALL
+Java_net_starlark_java_eval_CpuProfiler_readEvents(JNIEnv *env, jclass clazz,
+                                                   jintArray java_tids,
+                                                   jbooleanArray java_on_cpu) {
+  // Events queued from now on ring the bell again.
+  wakeup_pending.store(false);
+
+  jint max = env->GetArrayLength(java_tids);
+  if (env->GetArrayLength(java_on_cpu) < max) {
+    max = env->GetArrayLength(java_on_cpu);
+  }
+  jint *tids = env->GetIntArrayElements(java_tids, nullptr);
+  if (tids == nullptr) return -1;  // exception
+  jboolean *on_cpu = env->GetBooleanArrayElements(java_on_cpu, nullptr);
+  if (on_cpu == nullptr) {
+    env->ReleaseIntArrayElements(java_tids, tids, JNI_ABORT);
+    return -1;  // exception
+  }
+  int64_t start = profile_start_nanos.load();
+  jint n = 0;
+  while (n < max) {
+    Event *e = &ring[ring_tail & (kRingSize - 1)];
+    if (e->seq.load(std::memory_order_acquire) != ring_tail + 1) {
+      break;  // empty, or the next event is not published yet
+    }
+    if (e->nanos >= start) {
+      tids[n] = e->tid;
+      on_cpu[n] = e->on_cpu ? JNI_TRUE : JNI_FALSE;
+      n++;
+    }
+    e->seq.store(ring_tail + kRingSize, std::memory_order_release);
+    ring_tail++;
+  }
+  env->ReleaseBooleanArrayElements(java_on_cpu, on_cpu, 0);
+  env->ReleaseIntArrayElements(java_tids, tids, 0);
+  return n;
+}
+
+// static native long droppedEvents();
+extern "C" JNIEXPORT jlong JNICALL
+Java_net_starlark_java_eval_CpuProfiler_droppedEvents(JNIEnv *env,
+                                                      jclass clazz) {
+  return dropped.exchange(0);
+}
+
 // static native jint gettid();
 extern "C" JNIEXPORT jint JNICALL
 Java_net_starlark_java_eval_CpuProfiler_gettid(JNIEnv *env, jclass clazz) {
@@ -125,8 +267,10 @@ static jobject makeFD(JNIEnv *env, int fd) {
 // static native FileDescriptor createPipe();
 extern "C" JNIEXPORT jobject JNICALL
 Java_net_starlark_java_eval_CpuProfiler_createPipe(JNIEnv *env, jclass clazz) {
-  // Create a pipe for profile events from the handler to Java.
-  // The default pipe size is 64KiB on Linux and 16KiB on Mac OS X.
+  // Create a pipe for wakeups from the handler to Java.
+  for (uint64_t i = 0; i < kRingSize; i++) {
+    ring[i].seq.store(i);
+  }
   int pipefds[2];
   if (pipe(pipefds) < 0) {
     perror("pipe");
@@ -138,21 +282,34 @@ Java_net_starlark_java_eval_CpuProfiler_createPipe(JNIEnv *env, jclass clazz) {
   // handler can detect overflow (rather than deadlock).
   fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
-  // Return the read end of the event pipe,
+  // Return the read end of the wakeup pipe,
   // wrapped by a java FileDescriptor.
   return makeFD(env, pipefds[0]);
 }
 
-// static native boolean startTimer(long period_micros);
+// static native boolean supportsWallClock();
+extern "C" JNIEXPORT jboolean JNICALL
+Java_net_starlark_java_eval_CpuProfiler_supportsWallClock(JNIEnv *env,
+                                                          jclass clazz) {
+#ifdef __linux__
+  return true;
+#else   // darwin
+  // There are no timers that signal a given thread.
+  return false;
+#endif
+}
+
+// static native boolean startTimer(long period_micros, boolean wall_clock);
 extern "C" JNIEXPORT jboolean JNICALL
 Java_net_starlark_java_eval_CpuProfiler_startTimer(JNIEnv *env, jclass clazz,
-                                                   jlong period_micros) {
+                                                   jlong period_micros,
+                                                   jboolean wall) {
   // Install the signal handler.
   // Use sigaction(2) not signal(2) so that we can correctly
   // restore the previous handler if necessary.
   struct sigaction oldact = {}, act = {};
-  act.sa_handler = onsigprof;
-  act.sa_flags = SA_RESTART;  // the JVM doesn't expect EINTR
+  act.sa_sigaction = onsigprof;
+  act.sa_flags = SA_SIGINFO | SA_RESTART;  // the JVM doesn't expect EINTR
   if (sigaction(SIGPROF, &act, &oldact) < 0) {
     perror("sigaction");
     abort();
@@ -172,7 +329,12 @@ Java_net_starlark_java_eval_CpuProfiler_startTimer(JNIEnv *env, jclass clazz,
     return false;
   }
 
+  wall_clock.store(wall);
+  profile_start_nanos.store(now_nanos());
+
+#ifndef __linux__
   // Start the CPU interval timer.
+  // (On Linux, each Starlark thread starts its own; see startThreadTimer.)
   struct timeval period = {
       .tv_sec = 0,
       .tv_usec = static_cast<suseconds_t>(period_micros),
@@ -182,6 +344,7 @@ Java_net_starlark_java_eval_CpuProfiler_startTimer(JNIEnv *env, jclass clazz,
     perror("setitimer");
     abort();
   }
+#endif
 
   return true;
 }
@@ -198,6 +361,75 @@ Java_net_starlark_java_eval_CpuProfiler_stopTimer(JNIEnv *env, jclass clazz) {
 
   // Uninstall signal handler.
   signal(SIGPROF, SIG_IGN);
+
+  profile_start_nanos.store(INT64_MAX);
+}
+
+// static native long startThreadTimer(long period_micros);
+extern "C" JNIEXPORT jlong JNICALL
+Java_net_starlark_java_eval_CpuProfiler_startThreadTimer(JNIEnv *env,
+                                                         jclass clazz,
+                                                         jlong period_micros) {
+#ifdef __linux__
+  // A timer on the CPU clock of the calling thread that signals this very
+  // thread. Unlike ITIMER_PROF, which signals whichever thread happens to be
+  // running, this measures every thread's CPU time exactly.
+  //
+  // In wall-clock mode, the timer is on the monotonic clock instead, so that
+  // the thread is also sampled while it is blocked.
+  int slot = 0;
+  for (; slot < kMaxThreadTimers; slot++) {
+    bool unused = false;
+    if (thread_timers[slot].used.compare_exchange_strong(unused, true)) {
+      break;
+    }
+  }
+  if (slot == kMaxThreadTimers) {
+    return -1;
+  }
+  ThreadTimer *t = &thread_timers[slot];
+  t->cpu_nanos = clock_nanos(CLOCK_THREAD_CPUTIME_ID);
+  t->wall_nanos = now_nanos();
+
+  struct sigevent sev = {};
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev.sigev_notify_thread_id = gettid();
+  sev.sigev_value.sival_int = slot;
+  clockid_t clock =
+      wall_clock.load() ? CLOCK_MONOTONIC : CLOCK_THREAD_CPUTIME_ID;
+  if (timer_create(clock, &sev, &t->timer) < 0) {
+    t->used.store(false);
+    return -1;
+  }
+  struct timespec period = {
+      .tv_sec = static_cast<time_t>(period_micros / 1000000),
+      .tv_nsec = static_cast<long>(period_micros % 1000000 * 1000),
+  };
+  struct itimerspec spec = {.it_interval = period, .it_value = period};
+  if (timer_settime(t->timer, 0, &spec, nullptr) < 0) {
+    timer_delete(t->timer);
+    t->used.store(false);
+    return -1;
+  }
+  return slot;
+#else   // darwin
+  // The process-wide ITIMER_PROF started by startTimer samples all threads.
+  return -1;
+#endif
+}
+
+// static native void stopThreadTimer(long timer);
+extern "C" JNIEXPORT void JNICALL
+Java_net_starlark_java_eval_CpuProfiler_stopThreadTimer(JNIEnv *env,
+                                                        jclass clazz,
+                                                        jlong timer) {
+#ifdef __linux__
+  // A signal of the deleted timer that is still pending may find the slot
+  // reused by another thread; at worst, it is tagged on- or off-CPU wrongly.
+  timer_delete(thread_timers[timer].timer);
+  thread_timers[timer].used.store(false);
+#endif
 }
 
 }  // namespace cpu_profiler
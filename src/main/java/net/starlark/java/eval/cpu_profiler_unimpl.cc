@@ -34,9 +34,29 @@ Java_net_starlark_java_eval_CpuProfiler_createPipe(JNIEnv *env, jclass clazz) {
   abort();
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_net_starlark_java_eval_CpuProfiler_readEvents(JNIEnv *env, jclass clazz,
+                                                   jintArray tids,
+                                                   jbooleanArray on_cpu) {
+  abort();
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_net_starlark_java_eval_CpuProfiler_droppedEvents(JNIEnv *env,
+                                                      jclass clazz) {
+  abort();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_net_starlark_java_eval_CpuProfiler_supportsWallClock(JNIEnv *env,
+                                                          jclass clazz) {
+  abort();
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_net_starlark_java_eval_CpuProfiler_startTimer(JNIEnv *env, jclass clazz,
-                                                   jlong period_micros) {
+                                                   jlong period_micros,
+                                                   jboolean wall_clock) {
   abort();
 }
 
@@ -45,4 +65,18 @@ Java_net_starlark_java_eval_CpuProfiler_stopTimer(JNIEnv *env, jclass clazz) {
   abort();
 }
 
+extern "C" JNIEXPORT jlong JNICALL
+Java_net_starlark_java_eval_CpuProfiler_startThreadTimer(JNIEnv *env,
+                                                         jclass clazz,
+                                                         jlong period_micros) {
+  abort();
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_net_starlark_java_eval_CpuProfiler_stopThreadTimer(JNIEnv *env,
+                                                        jclass clazz,
+                                                        jlong timer) {
+  abort();
+}
+
 }  // namespace cpu_profiler
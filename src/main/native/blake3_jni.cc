@@ -11,15 +11,24 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
-
+#include <errno.h>
 #include <jni.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include "src/main/native/file_digest.h"
+#include "src/main/native/merkle_tree.h"
+#endif
+
 #include "c/blake3.h"
 
 namespace blaze_jni {
 
+// Inputs up to this size are copied out of their array rather than pinned,
+// which would hold up the garbage collector.
+static const jint kMaxCopiedInput = 4096;
+
 jbyte *get_byte_array(JNIEnv *env, jbyteArray java_array) {
   return (jbyte *)env->GetPrimitiveArrayCritical(java_array, nullptr);
 }
@@ -28,6 +37,11 @@ void release_byte_array(JNIEnv *env, jbyteArray array, jbyte *addr) {
   env->ReleasePrimitiveArrayCritical(array, addr, 0);
 }
 
+// The hasher state lives in a direct ByteBuffer, so it is never pinned.
+static blake3_hasher *get_hasher(JNIEnv *env, jobject jhasher) {
+  return (blake3_hasher *)env->GetDirectBufferAddress(jhasher);
+}
+
 extern "C" JNIEXPORT int JNICALL
 Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_hasher_1size(
     JNIEnv *env, jobject obj) {
@@ -36,38 +50,117 @@ Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_hasher_1size(
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_initialize_1hasher(
-    JNIEnv *env, jobject obj, jbyteArray jhasher) {
-  blake3_hasher *hasher = (blake3_hasher *)get_byte_array(env, jhasher);
+    JNIEnv *env, jobject obj, jobject jhasher) {
+  blake3_hasher *hasher = get_hasher(env, jhasher);
   if (hasher) {
     blake3_hasher_init(hasher);
-    release_byte_array(env, jhasher, (jbyte *)hasher);
   }
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_blake3_1hasher_1update(
-    JNIEnv *env, jobject obj, jbyteArray jhasher, jbyteArray input, jint offset,
+    JNIEnv *env, jobject obj, jobject jhasher, jbyteArray input, jint offset,
     jint input_len) {
-  blake3_hasher *hasher = (blake3_hasher *)get_byte_array(env, jhasher);
+  blake3_hasher *hasher = get_hasher(env, jhasher);
   if (hasher) {
+    if (input_len <= kMaxCopiedInput) {
+      jbyte buf[kMaxCopiedInput];
+      env->GetByteArrayRegion(input, offset, input_len, buf);
+      blake3_hasher_update(hasher, buf, input_len);
+      return;
+    }
     jbyte *input_addr = get_byte_array(env, input);
     blake3_hasher_update(hasher, input_addr + offset, input_len);
     release_byte_array(env, input, input_addr);
-    release_byte_array(env, jhasher, (jbyte *)hasher);
+  }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_blake3_1hasher_1update_1direct(
+    JNIEnv *env, jobject obj, jobject jhasher, jobject input, jint offset,
+    jint input_len) {
+  blake3_hasher *hasher = get_hasher(env, jhasher);
+  jbyte *input_addr = (jbyte *)env->GetDirectBufferAddress(input);
+  if (hasher && input_addr) {
+    blake3_hasher_update(hasher, input_addr + offset, input_len);
   }
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_blake3_1hasher_1finalize(
-    JNIEnv *env, jobject obj, jbyteArray jhasher, jbyteArray out,
+    JNIEnv *env, jobject obj, jobject jhasher, jbyteArray out,
     jint out_len) {
-  blake3_hasher *hasher = (blake3_hasher *)get_byte_array(env, jhasher);
+  blake3_hasher *hasher = get_hasher(env, jhasher);
   if (hasher) {
     jbyte *out_addr = get_byte_array(env, out);
     blake3_hasher_finalize(hasher, (uint8_t *)out_addr, out_len);
     release_byte_array(env, out, out_addr);
-    release_byte_array(env, jhasher, (jbyte *)hasher);
   }
 }
 
+#ifndef _WIN32
+// Adapts blake3_hasher to DigestFile.
+class Blake3 {
+ public:
+  static constexpr size_t kDigestSize = BLAKE3_OUT_LEN;
+  static constexpr char kName[] = "BLAKE3";
+
+  Blake3() { blake3_hasher_init(&hasher_); }
+  void Update(const uint8_t *data, size_t len) {
+    blake3_hasher_update(&hasher_, data, len);
+  }
+  void Finish(uint8_t *digest) {
+    blake3_hasher_finalize(&hasher_, digest, kDigestSize);
+  }
+
+ private:
+  blake3_hasher hasher_;
+};
+#else
+// Posts an UnsupportedOperationException: the file hashing entry points are
+// not implemented on Windows.
+static void PostUnsupportedOnWindows(JNIEnv *env, const char *function) {
+  jclass exception_class =
+      env->FindClass("java/lang/UnsupportedOperationException");
+  if (exception_class != nullptr) {
+    env->ThrowNew(exception_class, function);
+  }
+}
+#endif
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_blake3_1hash_1file(
+    JNIEnv *env, jclass clazz, jstring path, jstring attribute,
+    jbyteArray out) {
+#ifdef _WIN32
+  PostUnsupportedOnWindows(env, "blake3_hash_file");
+#else
+  JniDigestFile<Blake3>(env, path, attribute, out);
+#endif
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_blake3_1hash_1files(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jstring attribute,
+    jint parallelism, jbyteArray digests, jintArray errnos) {
+#ifdef _WIN32
+  PostUnsupportedOnWindows(env, "blake3_hash_files");
+#else
+  JniDigestFiles<Blake3>(env, paths, attribute, parallelism, digests,
+                         errnos);
+#endif
+}
+
+
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_Blake3MessageDigest_blake3_1merkle_1tree(
+    JNIEnv *env, jclass clazz, jstring root, jint parallelism) {
+#ifdef _WIN32
+  PostUnsupportedOnWindows(env, "blake3_merkle_tree");
+  return nullptr;
+#else
+  return JniMerkleTree<Blake3>(env, root, parallelism);
+#endif
+}
+
 }  // namespace blaze_jni
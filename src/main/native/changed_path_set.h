@@ -0,0 +1,98 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// INTERNAL header file for use by C++ code in this package.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_CHANGED_PATH_SET_H_
+#define BAZEL_SRC_MAIN_NATIVE_CHANGED_PATH_SET_H_
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace blaze_jni {
+
+// The distinct paths reported by a file system watcher since the last poll.
+// The paths are packed into large chunks rather than allocated one by one,
+// and the set gives up past a number of paths or bytes, at which point the
+// caller should report that everything changed: a VCS operation touching
+// hundreds of thousands of files is cheaper to handle with a rescan than
+// with as many invalidations. Not thread-safe.
+class ChangedPathSet {
+ public:
+  static constexpr size_t kMaxPaths = 100000;
+  static constexpr size_t kMaxBytes = 32 << 20;
+
+  // Adds path unless it is already in the set. Returns false, clearing the
+  // set, if the path does not fit within the caps.
+  bool Add(std::string_view path) {
+    if (index_.count(path) != 0) {
+      return true;
+    }
+    if (paths_.size() == kMaxPaths || bytes_ + path.size() > kMaxBytes) {
+      Clear();
+      return false;
+    }
+    std::string_view stored = Store(path);
+    index_.insert(stored);
+    paths_.push_back(stored);
+    bytes_ += path.size();
+    return true;
+  }
+
+  // The paths in the order they were first added. Invalidated by Add and
+  // Clear.
+  const std::vector<std::string_view> &paths() const { return paths_; }
+
+  // Empties the set, keeping one chunk for the paths to come.
+  void Clear() {
+    index_.clear();
+    paths_.clear();
+    bytes_ = 0;
+    if (chunks_.size() > 1) {
+      chunks_.resize(1);
+    }
+    chunk_used_ = 0;
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  // Copies path into the current chunk, or a new one if it does not fit.
+  // Every chunk holds at least kChunkSize bytes.
+  std::string_view Store(std::string_view path) {
+    if (chunks_.empty() || chunk_used_ + path.size() > kChunkSize) {
+      chunks_.emplace_back(new char[std::max(kChunkSize, path.size())]);
+      chunk_used_ = 0;
+    }
+    char *copy = chunks_.back().get() + chunk_used_;
+    memcpy(copy, path.data(), path.size());
+    chunk_used_ += path.size();
+    return std::string_view(copy, path.size());
+  }
+
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  size_t chunk_used_ = 0;
+  std::unordered_set<std::string_view> index_;
+  std::vector<std::string_view> paths_;
+  size_t bytes_ = 0;
+};
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_CHANGED_PATH_SET_H_
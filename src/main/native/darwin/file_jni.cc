@@ -14,14 +14,17 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/clonefile.h>
 #include <sys/stat.h>
 #include <sys/sysctl.h>
 #include <sys/syslimits.h>
 #include <sys/types.h>
 #include <sys/xattr.h>
 
+#include <algorithm>
 #include <string>
 
 #include "src/main/native/unix_jni.h"
@@ -77,6 +80,38 @@ int portable_fstatat(int dirfd, char *name, portable_stat_struct *statbuf,
   return r;
 }
 
+int portable_stat_fields(const char *path, bool follow_symlinks, int fields,
+                         bool dont_sync, portable_stat_struct *statbuf) {
+  // Always reads all the fields.
+  return follow_symlinks ? portable_stat(path, statbuf)
+                         : portable_lstat(path, statbuf);
+}
+
+bool portable_fstatat_many(size_t count, const int *dirfds,
+                           const char *const *names, int flags,
+                           portable_stat_struct *stats, int *errnos) {
+  // Currently not implemented.
+  return false;
+}
+
+int portable_clone_file(int from_fd, const char *to) {
+  // Unlike FICLONE, this copies the permissions and times of the source too.
+  return fclonefileat(from_fd, AT_FDCWD, to, 0);
+}
+
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t len) {
+  // Currently not implemented.
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_readahead(int fd, off_t len) {
+  struct radvisory advice;
+  advice.ra_offset = 0;
+  advice.ra_count = static_cast<int>(std::min<off_t>(len, INT_MAX));
+  return fcntl(fd, F_RDADVISE, &advice);
+}
+
 uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
                                StatTimes t) {
   switch (t) {
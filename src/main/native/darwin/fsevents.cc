@@ -14,11 +14,19 @@
 
 #include <CoreServices/CoreServices.h>
 #include <jni.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#include <list>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/changed_path_set.h"
 
 namespace {
 
@@ -33,19 +41,108 @@ struct JNIEventsDiffAwareness {
   // If true, fsevents dropped events so we don't know what changed exactly.
   bool everything_changed;
 
-  // List of paths that have been changed since last polling.
-  std::list<std::string> paths;
+  // Paths that have been changed since last polling. Empty while
+  // everything_changed is set.
+  blaze_jni::ChangedPathSet paths;
+
+  // The paths being handed over by poll, swapped with paths so that the
+  // callback can go on recording while they are copied to Java. Only
+  // accessed by poll, which is never called concurrently.
+  blaze_jni::ChangedPathSet polled_paths;
+
+  // The file the id of the last polled event is saved to, or empty if none.
+  std::string journal_path;
+
+  // The UUID of the FSEvents database of the watched volume, which event ids
+  // are only meaningful for.
+  std::string device_uuid;
+
+  // The id of the latest event received.
+  FSEventStreamEventId latest_event_id;
+
+  // False while the stream is replaying the events since the journaled id.
+  bool history_done;
 
-  // Mutex to protect concurrent accesses to paths and everything_changed.
+  // Signaled when history_done is set.
+  pthread_cond_t history_done_cond;
+
+  // Mutex to protect concurrent accesses to paths, everything_changed,
+  // latest_event_id and history_done.
   pthread_mutex_t mutex;
 
-  JNIEventsDiffAwareness() : everything_changed(false) {
+  JNIEventsDiffAwareness()
+      : everything_changed(false), latest_event_id(0), history_done(true) {
     pthread_mutex_init(&mutex, nullptr);
+    pthread_cond_init(&history_done_cond, nullptr);
   }
 
-  ~JNIEventsDiffAwareness() { pthread_mutex_destroy(&mutex); }
+  ~JNIEventsDiffAwareness() {
+    pthread_cond_destroy(&history_done_cond);
+    pthread_mutex_destroy(&mutex);
+  }
 };
 
+// Returns the UUID of the FSEvents database of the volume holding path, or
+// an empty string if it cannot be told. The database, and the event ids
+// with it, are reset when the volume is reformatted or the database purged.
+std::string DeviceUuid(const char *path) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return "";
+  }
+  CFUUIDRef uuid = FSEventsCopyUUIDForDevice(st.st_dev);
+  if (uuid == nullptr) {
+    return "";
+  }
+  CFStringRef uuid_string = CFUUIDCreateString(nullptr, uuid);
+  CFRelease(uuid);
+  char buffer[64];
+  bool ok = CFStringGetCString(uuid_string, buffer, sizeof(buffer),
+                               kCFStringEncodingUTF8);
+  CFRelease(uuid_string);
+  return ok ? buffer : "";
+}
+
+// Returns the event id saved in the journal, or kFSEventStreamEventIdSinceNow
+// if there is none for the FSEvents database of device_uuid.
+FSEventStreamEventId ReadJournal(const std::string &journal_path,
+                                 const std::string &device_uuid) {
+  if (journal_path.empty() || device_uuid.empty()) {
+    return kFSEventStreamEventIdSinceNow;
+  }
+  FILE *f = fopen(journal_path.c_str(), "r");
+  if (f == nullptr) {
+    return kFSEventStreamEventIdSinceNow;
+  }
+  char uuid[64];
+  unsigned long long event_id;
+  bool ok = fscanf(f, "%63s %llu", uuid, &event_id) == 2 &&
+            device_uuid == uuid && event_id != kFSEventStreamEventIdSinceNow;
+  fclose(f);
+  return ok ? event_id : kFSEventStreamEventIdSinceNow;
+}
+
+// Saves the event id to the journal. The journal is replaced atomically, so
+// that a server dying halfway leaves the previous id behind.
+void WriteJournal(const std::string &journal_path,
+                  const std::string &device_uuid,
+                  FSEventStreamEventId event_id) {
+  if (journal_path.empty() || device_uuid.empty()) {
+    return;
+  }
+  std::string tmp_path = journal_path + ".tmp";
+  FILE *f = fopen(tmp_path.c_str(), "w");
+  if (f == nullptr) {
+    return;
+  }
+  bool ok = fprintf(f, "%s %llu\n", device_uuid.c_str(),
+                    static_cast<unsigned long long>(event_id)) > 0;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), journal_path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+  }
+}
+
 // Callback called when an event is reported by the FSEvents API
 void FsEventsDiffAwarenessCallback(ConstFSEventStreamRef streamRef,
                                    void *clientCallBackInfo, size_t numEvents,
@@ -58,12 +155,21 @@ void FsEventsDiffAwarenessCallback(ConstFSEventStreamRef streamRef,
       static_cast<JNIEventsDiffAwareness *>(clientCallBackInfo);
   pthread_mutex_lock(&(info->mutex));
   for (size_t i = 0; i < numEvents; i++) {
-    if ((eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs) != 0) {
+    if (eventIds[i] > info->latest_event_id) {
+      info->latest_event_id = eventIds[i];
+    }
+    if ((eventFlags[i] & kFSEventStreamEventFlagHistoryDone) != 0) {
+      // Marks the end of the replayed events, it is not about a path.
+      info->history_done = true;
+      pthread_cond_broadcast(&info->history_done_cond);
+    } else if (info->everything_changed) {
+      // Nothing more to record.
+    } else if ((eventFlags[i] & kFSEventStreamEventFlagMustScanSubDirs) !=
+               0) {
       // Either we lost events or they were coalesced. Assume everything changed
       // and give up, which matches the fsevents documentation in that the
       // caller is expected to rescan the directory contents on its own.
       info->everything_changed = true;
-      break;
     } else if ((eventFlags[i] & kFSEventStreamEventFlagItemIsDir) != 0 &&
         (eventFlags[i] & kFSEventStreamEventFlagItemRenamed) != 0) {
       // A directory was renamed. When this happens, fsevents may or may not
@@ -76,18 +182,24 @@ void FsEventsDiffAwarenessCallback(ConstFSEventStreamRef streamRef,
       // using those to guess which files within them moved... but that'd be way
       // too much complexity for this rather-uncommon use case.
       info->everything_changed = true;
-      break;
-    } else {
-      info->paths.push_back(std::string(paths[i]));
+    } else if (!info->paths.Add(paths[i])) {
+      // So many files changed (e.g. on a VCS checkout) that rescanning is
+      // cheaper than invalidating them one by one.
+      info->everything_changed = true;
     }
   }
+  if (info->everything_changed) {
+    // Nothing recorded until the next poll would be used: this callback
+    // keeps being called during large operations, so don't grow the set.
+    info->paths.Clear();
+  }
   pthread_mutex_unlock(&(info->mutex));
 }
 
-extern "C" JNIEXPORT void JNICALL
+extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_create(
     JNIEnv *env, jobject fsEventsDiffAwareness, jobjectArray paths,
-    jdouble latency) {
+    jdouble latency, jbyteArray journalPath) {
   // Create a FSEventStreamContext to pass around (env, fsEventsDiffAwareness)
   JNIEventsDiffAwareness *info = new JNIEventsDiffAwareness();
 
@@ -113,9 +225,34 @@ Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_create(
   CFArrayRef pathsToWatch =
       CFArrayCreate(nullptr, (const void **)pathsArray, length, nullptr);
   delete[] pathsArray;
+
+  // Resume from the last polled event of the previous server, if it was
+  // journaled for the same FSEvents database. Event ids are per volume, so
+  // a journal is only kept when watching a single path.
+  FSEventStreamEventId since_when = kFSEventStreamEventIdSinceNow;
+  if (journalPath != nullptr && length == 1) {
+    jbyte *journalBytes = env->GetByteArrayElements(journalPath, nullptr);
+    info->journal_path.assign(reinterpret_cast<const char *>(journalBytes),
+                              env->GetArrayLength(journalPath));
+    env->ReleaseByteArrayElements(journalPath, journalBytes, JNI_ABORT);
+    char root[PATH_MAX];
+    if (CFStringGetFileSystemRepresentation(
+            static_cast<CFStringRef>(CFArrayGetValueAtIndex(pathsToWatch, 0)),
+            root, sizeof(root))) {
+      info->device_uuid = DeviceUuid(root);
+    }
+    since_when = ReadJournal(info->journal_path, info->device_uuid);
+  }
+  if (since_when == kFSEventStreamEventIdSinceNow) {
+    info->latest_event_id = FSEventsGetCurrentEventId();
+  } else {
+    info->latest_event_id = since_when;
+    info->history_done = false;
+  }
+
   info->stream = FSEventStreamCreate(
       nullptr, &FsEventsDiffAwarenessCallback, &context, pathsToWatch,
-      kFSEventStreamEventIdSinceNow, static_cast<CFAbsoluteTime>(latency),
+      since_when, static_cast<CFAbsoluteTime>(latency),
       kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagFileEvents);
 
   // Save the info pointer to FSEventsDiffAwareness#nativePointer
@@ -125,6 +262,7 @@ Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_create(
   jclass clazz = env->GetObjectClass(fsEventsDiffAwareness);
   jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
   env->SetLongField(fsEventsDiffAwareness, fid, reinterpret_cast<jlong>(info));
+  return since_when != kFSEventStreamEventIdSinceNow;
 }
 
 JNIEventsDiffAwareness *GetInfo(JNIEnv *env, jobject fsEventsDiffAwareness) {
@@ -143,7 +281,15 @@ Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_run(
   info->runLoop = CFRunLoopGetCurrent();
   FSEventStreamScheduleWithRunLoop(info->stream, info->runLoop,
                                    kCFRunLoopDefaultMode);
-  FSEventStreamStart(info->stream);
+  if (!FSEventStreamStart(info->stream)) {
+    // No events will come, the replayed ones included: don't have poll wait
+    // for them.
+    pthread_mutex_lock(&(info->mutex));
+    info->everything_changed = true;
+    info->history_done = true;
+    pthread_cond_broadcast(&info->history_done_cond);
+    pthread_mutex_unlock(&(info->mutex));
+  }
 
   jclass countDownLatchClass = env->GetObjectClass(listening);
   jmethodID countDownMethod =
@@ -152,33 +298,63 @@ Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_run(
   CFRunLoopRun();
 }
 
-extern "C" JNIEXPORT jobjectArray JNICALL
+extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_devtools_build_lib_skyframe_MacOSXFsEventsDiffAwareness_poll(
     JNIEnv *env, jobject fsEventsDiffAwareness) {
   JNIEventsDiffAwareness *info = GetInfo(env, fsEventsDiffAwareness);
   pthread_mutex_lock(&(info->mutex));
-
-  jobjectArray result;
-  if (info->everything_changed) {
-    result = nullptr;
-  } else {
-    jclass classByteArray = env->FindClass("[B");
-    result = env->NewObjectArray(info->paths.size(), classByteArray, nullptr);
-    int i = 0;
-    for (auto it = info->paths.begin(); it != info->paths.end(); it++, i++) {
-      jbyteArray path = env->NewByteArray(it->size());
-      env->SetByteArrayRegion(path, 0, it->size(),
-                              reinterpret_cast<const jbyte *>(it->c_str()));
-      env->SetObjectArrayElement(result, i, path);
-      env->DeleteLocalRef(path);
-    }
+  // The changes since the journaled event are only known once all of them
+  // have been replayed.
+  while (!info->history_done) {
+    pthread_cond_wait(&info->history_done_cond, &info->mutex);
   }
-
+  bool everything_changed = info->everything_changed;
   info->everything_changed = false;
-  info->paths.clear();
-
+  // Hand the recorded paths over and give the callback the spare, empty set:
+  // the Java arrays are made without holding the mutex, which would block
+  // the callback, and thus the run loop, for as long.
+  std::swap(info->paths, info->polled_paths);
+  FSEventStreamEventId latest_event_id = info->latest_event_id;
   pthread_mutex_unlock(&(info->mutex));
-  return result;
+
+  // The caller takes the changes up to here into account, so the next server
+  // only needs the later ones.
+  WriteJournal(info->journal_path, info->device_uuid, latest_event_id);
+
+  const std::vector<std::string_view> &paths = info->polled_paths.paths();
+  if (everything_changed) {
+    info->polled_paths.Clear();
+    return JNI_FALSE;
+  }
+  // One array with all the paths end to end, and one with where each ends,
+  // rather than an array per path.
+  std::vector<jint> ends;
+  ends.reserve(paths.size());
+  jint size = 0;
+  for (std::string_view path : paths) {
+    size += path.size();
+    ends.push_back(size);
+  }
+  jbyteArray bytes = env->NewByteArray(size);
+  jintArray ends_array = env->NewIntArray(ends.size());
+  if (bytes != nullptr && ends_array != nullptr) {
+    jint start = 0;
+    for (std::string_view path : paths) {
+      env->SetByteArrayRegion(bytes, start, path.size(),
+                              reinterpret_cast<const jbyte *>(path.data()));
+      start += path.size();
+    }
+    env->SetIntArrayRegion(ends_array, 0, ends.size(), ends.data());
+    jclass clazz = env->GetObjectClass(fsEventsDiffAwareness);
+    env->SetObjectField(fsEventsDiffAwareness,
+                        env->GetFieldID(clazz, "polledPaths", "[B"), bytes);
+    env->SetObjectField(fsEventsDiffAwareness,
+                        env->GetFieldID(clazz, "polledPathEnds", "[I"),
+                        ends_array);
+  }
+  info->polled_paths.Clear();
+  // On an OutOfMemoryError, pending until the return, the result is ignored.
+  return JNI_TRUE;
 }
 
 extern "C" JNIEXPORT void JNICALL
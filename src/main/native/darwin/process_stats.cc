@@ -0,0 +1,59 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <libproc.h>
+#include <mach/mach_time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "src/main/native/unix_jni.h"
+
+namespace blaze_jni {
+
+bool portable_process_stats(ProcessStats *stats) {
+  bool any = false;
+  // ri_runnable_time, the time spent runnable but not running, came with
+  // RUSAGE_INFO_V4 in macOS 10.15.
+  struct rusage_info_v4 info;
+  if (proc_pid_rusage(getpid(), RUSAGE_INFO_V4,
+                      reinterpret_cast<rusage_info_t *>(&info)) == 0) {
+    static mach_timebase_info_data_t timebase = [] {
+      mach_timebase_info_data_t t;
+      mach_timebase_info(&t);
+      return t;
+    }();
+    stats->read_bytes = info.ri_diskio_bytesread;
+    stats->write_bytes = info.ri_diskio_byteswritten;
+    stats->run_queue_wait_nanos =
+        info.ri_runnable_time * timebase.numer / timebase.denom;
+    any = true;
+  } else {
+    stats->read_bytes = stats->write_bytes = -1;
+    stats->run_queue_wait_nanos = -1;
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    stats->voluntary_context_switches = usage.ru_nvcsw;
+    stats->involuntary_context_switches = usage.ru_nivcsw;
+    any = true;
+  } else {
+    stats->voluntary_context_switches = -1;
+    stats->involuntary_context_switches = -1;
+  }
+  // Not accounted for.
+  stats->io_wait_nanos = -1;
+  return any;
+}
+
+}  // namespace blaze_jni
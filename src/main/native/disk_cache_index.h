@@ -0,0 +1,610 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// INTERNAL header file for use by C++ code in this package.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_DISK_CACHE_INDEX_H_
+#define BAZEL_SRC_MAIN_NATIVE_DISK_CACHE_INDEX_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace blaze_jni {
+
+// An index of the entries of a disk cache, kept next to it in a file that
+// every Bazel process using the cache maps into memory: an open addressing
+// hash table of the paths of the entries relative to the cache root, with
+// their sizes and last access times. The garbage collector reads the entries
+// to evict from the table rather than listing and stating every file of the
+// cache.
+//
+// The files remain the source of truth. The index is only ever short of
+// entries, e.g. those stored by processes that do not maintain it, and its
+// header tells when it was built from a full scan of the cache and whether
+// an entry could not be recorded since, so that the garbage collector knows
+// when to scan again. The table never grows: it is built with room to spare
+// and replaced by the next scan once it fills up.
+//
+// The slots are claimed and updated with atomic operations on the shared
+// mapping, so that processes and threads can use the index concurrently
+// without a lock. A replaced index file is marked as retired, which makes
+// the processes still mapping it switch to its replacement.
+class DiskCacheIndex {
+ public:
+  struct Entry {
+    std::string path;
+    int64_t size;
+    int64_t mtime_ms;
+  };
+
+  DiskCacheIndex(const DiskCacheIndex &) = delete;
+  DiskCacheIndex &operator=(const DiskCacheIndex &) = delete;
+
+  ~DiskCacheIndex() { Unmap(); }
+
+  // Opens the index at path. Returns null, setting errno, if there is none
+  // or it is not a valid index.
+  static std::unique_ptr<DiskCacheIndex> Open(const std::string &path) {
+    std::unique_ptr<DiskCacheIndex> index(new DiskCacheIndex(path));
+    if (!index->Map()) {
+      return nullptr;
+    }
+    return index;
+  }
+
+  // Replaces the index at path with one holding the given entries, as found
+  // by a full scan of the cache at scan_time_ms, and retires the previous
+  // one. Returns false, setting errno, on failure.
+  static bool Create(const std::string &path, const std::vector<Entry> &entries,
+                     int64_t scan_time_ms) {
+    uint64_t capacity = kMinCapacity;
+    while (capacity < entries.size() * 2) {
+      capacity *= 2;
+    }
+    std::string temp_path = path + ".tmp";
+    int fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd < 0) {
+      return false;
+    }
+    size_t size = sizeof(Header) + capacity * sizeof(Slot);
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+      map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+      int saved_errno = errno;
+      close(fd);
+      unlink(temp_path.c_str());
+      errno = saved_errno;
+      return false;
+    }
+    Header *header = static_cast<Header *>(map);
+    memcpy(header->magic, kMagic, sizeof(header->magic));
+    header->version = kVersion;
+    header->slot_size = sizeof(Slot);
+    header->capacity = capacity;
+    header->scan_time_ms = scan_time_ms;
+    Table table{header, reinterpret_cast<Slot *>(header + 1)};
+    for (const Entry &entry : entries) {
+      table.Insert(entry.path, entry.size, entry.mtime_ms);
+    }
+    bool ok = msync(map, size, MS_SYNC) == 0;
+    int saved_errno = errno;
+    munmap(map, size);
+    close(fd);
+    std::unique_ptr<DiskCacheIndex> previous = Open(path);
+    if (ok && rename(temp_path.c_str(), path.c_str()) != 0) {
+      ok = false;
+      saved_errno = errno;
+    }
+    if (!ok) {
+      unlink(temp_path.c_str());
+      errno = saved_errno;
+      return false;
+    }
+    if (previous != nullptr) {
+      __atomic_fetch_or(&previous->table_.header->flags, kRetired,
+                        __ATOMIC_RELEASE);
+    }
+    return true;
+  }
+
+  // Records an access to the entry at path now, adding it with the given
+  // size if it is not in the index yet. Returns false if the entry could
+  // not be recorded.
+  bool Record(std::string_view path, int64_t size) {
+    std::shared_lock<std::shared_mutex> lock(CurrentMapping());
+    return table_.Insert(path, size, NowMs());
+  }
+
+  // Records an access to the entry at path now if it is in the index.
+  void Touch(std::string_view path) {
+    std::shared_lock<std::shared_mutex> lock(CurrentMapping());
+    table_.Touch(path, NowMs());
+  }
+
+  // Removes the entry at path from the index.
+  void Remove(std::string_view path) {
+    std::shared_lock<std::shared_mutex> lock(CurrentMapping());
+    table_.Remove(path);
+  }
+
+  // When the index was built from a full scan of the cache.
+  int64_t scan_time_ms() {
+    std::shared_lock<std::shared_mutex> lock(CurrentMapping());
+    return table_.header->scan_time_ms;
+  }
+
+  // Whether every entry recorded since the scan is in the index.
+  bool complete() {
+    std::shared_lock<std::shared_mutex> lock(CurrentMapping());
+    return (Load(&table_.header->flags) & kIncomplete) == 0;
+  }
+
+  // Returns the entries the garbage collector has to delete to bring the
+  // cache under max_bytes, unless negative, and rid it of the entries last
+  // accessed before cutoff_ms, in that order: least recently accessed
+  // first, ties broken by path. Stores the number of entries in the index
+  // and their total size in total_entries and total_bytes.
+  std::vector<Entry> SelectEvictions(int64_t max_bytes, int64_t cutoff_ms,
+                                     int64_t *total_entries,
+                                     int64_t *total_bytes) {
+    std::shared_lock<std::shared_mutex> lock(CurrentMapping());
+    struct Candidate {
+      int64_t mtime_ms;
+      int64_t size;
+      std::string path;
+    };
+    std::vector<Candidate> candidates;
+    *total_entries = 0;
+    *total_bytes = 0;
+    for (uint64_t i = 0; i < table_.header->capacity; ++i) {
+      Slot *slot = &table_.slots[i];
+      uint64_t key = Load(&slot->key);
+      if (key < kFirstKey) {
+        continue;
+      }
+      Candidate candidate{Load(&slot->mtime_ms), slot->size,
+                          table_.Decode(*slot)};
+      // Skip a slot that was removed while it was read.
+      if (Load(&slot->key) != key) {
+        continue;
+      }
+      ++*total_entries;
+      *total_bytes += candidate.size;
+      candidates.push_back(std::move(candidate));
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate &a, const Candidate &b) {
+                if (a.mtime_ms != b.mtime_ms) {
+                  return a.mtime_ms < b.mtime_ms;
+                }
+                return a.path < b.path;
+              });
+    int64_t excess_bytes = max_bytes < 0 ? 0 : *total_bytes - max_bytes;
+    std::vector<Entry> evictions;
+    for (Candidate &candidate : candidates) {
+      if (excess_bytes <= 0 && candidate.mtime_ms >= cutoff_ms) {
+        break;
+      }
+      excess_bytes -= candidate.size;
+      evictions.push_back(
+          {std::move(candidate.path), candidate.size, candidate.mtime_ms});
+    }
+    return evictions;
+  }
+
+ private:
+  static constexpr char kMagic[8] = {'B', 'Z', 'D', 'C', 'I', 'D', 'X', '\n'};
+  static constexpr uint32_t kVersion = 1;
+  static constexpr uint64_t kMinCapacity = 1 << 16;
+
+  // Header flags.
+  static constexpr uint64_t kRetired = 1;     // Replaced by a newer index.
+  static constexpr uint64_t kIncomplete = 2;  // Short of a recorded entry.
+
+  // Slot keys; the others are hashes of paths.
+  static constexpr uint64_t kEmpty = 0;
+  static constexpr uint64_t kClaimed = 1;  // Being filled in.
+  static constexpr uint64_t kRemoved = 2;
+  static constexpr uint64_t kFirstKey = 3;
+
+  // The directories of the entries, e.g. "cas" or "sha256/ac", are kept
+  // once in the header, and the slots refer to them by number.
+  static constexpr int kMaxDirs = 48;
+  static constexpr int kMaxDirLength = 64;
+
+  // Names of up to this many bytes are kept in the slots, and hexadecimal
+  // names of up to twice that many digits, two to a byte.
+  static constexpr int kMaxName = 36;
+
+  // Slot flags.
+  static constexpr uint8_t kHexName = 1;
+  // The entry is in a subdirectory named after the first two digits of its
+  // name, e.g. "cas/0f/0f12...".
+  static constexpr uint8_t kSharded = 2;
+
+  struct alignas(4096) Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t capacity;
+    int64_t scan_time_ms;
+    uint64_t flags;
+    int64_t entries;
+    int64_t bytes;
+    uint64_t used_slots;
+    // The length of each directory plus one, 0 if the number is free, or
+    // kClaimedDir while the directory is being filled in.
+    uint32_t dir_lengths[kMaxDirs];
+    char dirs[kMaxDirs][kMaxDirLength];
+  };
+  static constexpr uint32_t kClaimedDir = UINT32_MAX;
+
+  struct Slot {
+    uint64_t key;
+    int64_t size;
+    int64_t mtime_ms;
+    uint8_t dir;
+    uint8_t flags;
+    uint8_t name_length;
+    uint8_t reserved;
+    uint8_t name[kMaxName];
+  };
+  static_assert(sizeof(Slot) == 64, "a slot should fill a cache line");
+
+  // The path of an entry as it is kept in a slot.
+  struct EncodedPath {
+    std::string_view dir;
+    uint8_t flags;
+    uint8_t name_length;
+    uint8_t name[kMaxName];
+  };
+
+  template <typename T>
+  static T Load(T *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+  }
+
+  template <typename T>
+  static void Store(T *p, T value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+  }
+
+  template <typename T>
+  static bool CompareAndSwap(T *p, T expected, T desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  }
+
+  template <typename T>
+  static void Add(T *p, T value) {
+    __atomic_fetch_add(p, value, __ATOMIC_RELAXED);
+  }
+
+  static int64_t NowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+  }
+
+  static int HexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    return -1;
+  }
+
+  static uint64_t Hash(std::string_view path) {
+    // FNV-1a, with the final mix of SplitMix64 to spread it over the table.
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : path) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+    hash ^= hash >> 31;
+    return hash < kFirstKey ? hash + kFirstKey : hash;
+  }
+
+  // The mapped table, with the operations on it.
+  struct Table {
+    Header *header;
+    Slot *slots;
+
+    // Encodes path, registering its directory if need be. Returns false if
+    // it does not fit into a slot.
+    bool Encode(std::string_view path, EncodedPath *encoded) {
+      size_t slash = path.rfind('/');
+      std::string_view dir =
+          slash == std::string_view::npos ? "" : path.substr(0, slash);
+      std::string_view name =
+          slash == std::string_view::npos ? path : path.substr(slash + 1);
+      encoded->flags = 0;
+      bool hex = !name.empty() && name.size() % 2 == 0 &&
+                 name.size() <= 2 * kMaxName &&
+                 std::all_of(name.begin(), name.end(),
+                             [](char c) { return HexDigit(c) >= 0; });
+      if (hex) {
+        encoded->flags |= kHexName;
+        encoded->name_length = name.size() / 2;
+        for (size_t i = 0; i < name.size(); i += 2) {
+          encoded->name[i / 2] = HexDigit(name[i]) << 4 | HexDigit(name[i + 1]);
+        }
+        if (dir.size() >= 3 && dir[dir.size() - 3] == '/' &&
+            dir.substr(dir.size() - 2) == name.substr(0, 2)) {
+          encoded->flags |= kSharded;
+          dir.remove_suffix(3);
+        }
+      } else if (name.size() <= kMaxName) {
+        encoded->name_length = name.size();
+        memcpy(encoded->name, name.data(), name.size());
+      } else {
+        return false;
+      }
+      encoded->dir = dir;
+      return dir.size() < kMaxDirLength;
+    }
+
+    // Returns the number of the directory, registering it if need be, or -1
+    // if there is no room left for it.
+    int DirNumber(std::string_view dir, bool add) {
+      for (int i = 0; i < kMaxDirs; ++i) {
+        uint32_t length = Load(&header->dir_lengths[i]);
+        if (length == 0) {
+          if (!add) {
+            return -1;
+          }
+          if (!CompareAndSwap(&header->dir_lengths[i], 0u, kClaimedDir)) {
+            --i;  // Look at the number again once it is filled in.
+            continue;
+          }
+          memcpy(header->dirs[i], dir.data(), dir.size());
+          Store(&header->dir_lengths[i], static_cast<uint32_t>(dir.size() + 1));
+          return i;
+        }
+        if (length == kClaimedDir) {
+          // Skip it rather than wait for a process that may have died.
+          continue;
+        }
+        if (std::string_view(header->dirs[i], length - 1) == dir) {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    bool Matches(const Slot &slot, int dir, const EncodedPath &encoded) {
+      return slot.dir == dir && slot.flags == encoded.flags &&
+             slot.name_length == encoded.name_length &&
+             memcmp(slot.name, encoded.name, encoded.name_length) == 0;
+    }
+
+    // Finds the slot of path, or null if it is not in the index.
+    Slot *Find(std::string_view path) {
+      EncodedPath encoded;
+      int dir;
+      if (!Encode(path, &encoded) || (dir = DirNumber(encoded.dir, false)) < 0) {
+        return nullptr;
+      }
+      uint64_t key = Hash(path);
+      uint64_t mask = header->capacity - 1;
+      for (uint64_t i = 0; i <= mask; ++i) {
+        Slot *slot = &slots[(key + i) & mask];
+        uint64_t slot_key = Load(&slot->key);
+        if (slot_key == kEmpty) {
+          return nullptr;
+        }
+        if (slot_key == key && Matches(*slot, dir, encoded)) {
+          return slot;
+        }
+      }
+      return nullptr;
+    }
+
+    static void Touch(Slot *slot, int64_t mtime_ms) {
+      int64_t current = Load(&slot->mtime_ms);
+      while (current < mtime_ms &&
+             !__atomic_compare_exchange_n(&slot->mtime_ms, &current, mtime_ms,
+                                          false, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE)) {
+      }
+    }
+
+    void Touch(std::string_view path, int64_t mtime_ms) {
+      Slot *slot = Find(path);
+      if (slot != nullptr) {
+        Touch(slot, mtime_ms);
+      }
+    }
+
+    bool Insert(std::string_view path, int64_t size, int64_t mtime_ms) {
+      EncodedPath encoded;
+      int dir;
+      if (!Encode(path, &encoded) || (dir = DirNumber(encoded.dir, true)) < 0) {
+        MarkIncomplete();
+        return false;
+      }
+      uint64_t key = Hash(path);
+      uint64_t mask = header->capacity - 1;
+      for (uint64_t i = 0; i <= mask; ++i) {
+        Slot *slot = &slots[(key + i) & mask];
+        uint64_t slot_key = Load(&slot->key);
+        if (slot_key == key && Matches(*slot, dir, encoded)) {
+          Touch(slot, mtime_ms);
+          return true;
+        }
+        if (slot_key != kEmpty) {
+          continue;
+        }
+        // Keep a quarter of the table free so that the probes stay short.
+        if (Load(&header->used_slots) >= header->capacity / 4 * 3) {
+          break;
+        }
+        if (!CompareAndSwap(&slot->key, kEmpty, kClaimed)) {
+          --i;  // Look at the slot again once it is filled in.
+          continue;
+        }
+        Add(&header->used_slots, uint64_t{1});
+        slot->size = size;
+        slot->mtime_ms = mtime_ms;
+        slot->dir = dir;
+        slot->flags = encoded.flags;
+        slot->name_length = encoded.name_length;
+        memcpy(slot->name, encoded.name, encoded.name_length);
+        Store(&slot->key, key);
+        Add(&header->entries, int64_t{1});
+        Add(&header->bytes, size);
+        return true;
+      }
+      MarkIncomplete();
+      return false;
+    }
+
+    void Remove(std::string_view path) {
+      Slot *slot = Find(path);
+      uint64_t key = slot != nullptr ? Load(&slot->key) : kEmpty;
+      if (key >= kFirstKey && CompareAndSwap(&slot->key, key, kRemoved)) {
+        Add(&header->entries, int64_t{-1});
+        Add(&header->bytes, -slot->size);
+      }
+    }
+
+    std::string Decode(const Slot &slot) {
+      std::string path;
+      if (slot.dir < kMaxDirs) {
+        uint32_t length = Load(&header->dir_lengths[slot.dir]);
+        if (length > 1 && length != kClaimedDir) {
+          path.assign(header->dirs[slot.dir], length - 1);
+          path += '/';
+        }
+      }
+      size_t name_length = std::min<size_t>(slot.name_length, kMaxName);
+      if ((slot.flags & kHexName) == 0) {
+        path.append(reinterpret_cast<const char *>(slot.name), name_length);
+        return path;
+      }
+      static constexpr char kDigits[] = "0123456789abcdef";
+      std::string name;
+      for (size_t i = 0; i < name_length; ++i) {
+        name += kDigits[slot.name[i] >> 4];
+        name += kDigits[slot.name[i] & 0xf];
+      }
+      if ((slot.flags & kSharded) != 0) {
+        path.append(name, 0, 2);
+        path += '/';
+      }
+      return path + name;
+    }
+
+    void MarkIncomplete() {
+      __atomic_fetch_or(&header->flags, kIncomplete, __ATOMIC_RELAXED);
+    }
+  };
+
+  explicit DiskCacheIndex(const std::string &path)
+      : path_(path), table_{nullptr, nullptr}, size_(0) {}
+
+  bool Map() {
+    int fd = open(path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+      map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                 0);
+    }
+    int saved_errno = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+      errno = st.st_size < static_cast<off_t>(sizeof(Header)) ? EINVAL
+                                                               : saved_errno;
+      return false;
+    }
+    Header *header = static_cast<Header *>(map);
+    uint64_t capacity = header->capacity;
+    if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+        header->version != kVersion || header->slot_size != sizeof(Slot) ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        static_cast<uint64_t>(st.st_size) !=
+            sizeof(Header) + capacity * sizeof(Slot)) {
+      munmap(map, st.st_size);
+      errno = EINVAL;
+      return false;
+    }
+    table_ = {header, reinterpret_cast<Slot *>(header + 1)};
+    size_ = st.st_size;
+    return true;
+  }
+
+  void Unmap() {
+    if (table_.header != nullptr) {
+      munmap(table_.header, size_);
+      table_ = {nullptr, nullptr};
+    }
+  }
+
+  // Switches to the index that replaced the mapped one, if any, and returns
+  // the mutex that guards the mapping, for the caller to lock shared. If the
+  // replacement cannot be opened, the retired index stays in use.
+  std::shared_mutex &CurrentMapping() {
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex_);
+      if ((Load(&table_.header->flags) & kRetired) == 0) {
+        return mutex_;
+      }
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if ((Load(&table_.header->flags) & kRetired) != 0) {
+      DiskCacheIndex replacement(path_);
+      if (replacement.Map()) {
+        Unmap();
+        std::swap(table_, replacement.table_);
+        std::swap(size_, replacement.size_);
+      }
+    }
+    return mutex_;
+  }
+
+  const std::string path_;
+  std::shared_mutex mutex_;
+  Table table_;
+  size_t size_;
+};
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_DISK_CACHE_INDEX_H_
@@ -0,0 +1,179 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The JNI side of DiskCacheIndex, see disk_cache_index.h.
+
+#include <errno.h>
+#include <jni.h>
+
+#include <string>
+#include <vector>
+
+#include "src/main/native/disk_cache_index.h"
+#include "src/main/native/latin1_jni_path.h"
+#include "src/main/native/unix_jni.h"
+
+using blaze_jni::DiskCacheIndex;
+using blaze_jni::ScopedLatin1Chars;
+
+namespace {
+
+DiskCacheIndex *GetIndex(jlong index) {
+  return reinterpret_cast<DiskCacheIndex *>(index);
+}
+
+}  // namespace
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doOpen(
+    JNIEnv *env, jclass clazz, jstring path) {
+  ScopedLatin1Chars path_chars(env, path);
+  if (path_chars.get() == nullptr) {
+    return 0;
+  }
+  return reinterpret_cast<jlong>(
+      DiskCacheIndex::Open(path_chars.get()).release());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doClose(
+    JNIEnv *env, jclass clazz, jlong index) {
+  delete GetIndex(index);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doCreate(
+    JNIEnv *env, jclass clazz, jstring path, jobjectArray paths,
+    jlongArray sizes, jlongArray mtimes, jlong scan_time_ms) {
+  jsize count = env->GetArrayLength(paths);
+  std::vector<jlong> size_values(count);
+  std::vector<jlong> mtime_values(count);
+  env->GetLongArrayRegion(sizes, 0, count, size_values.data());
+  env->GetLongArrayRegion(mtimes, 0, count, mtime_values.data());
+  if (env->ExceptionCheck()) {
+    return;
+  }
+  std::vector<DiskCacheIndex::Entry> entries;
+  entries.reserve(count);
+  for (jsize i = 0; i < count; ++i) {
+    jstring entry_path =
+        static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    {
+      ScopedLatin1Chars entry_path_chars(env, entry_path);
+      if (entry_path_chars.get() == nullptr) {
+        return;
+      }
+      entries.push_back({entry_path_chars.get(), size_values[i],
+                         mtime_values[i]});
+    }
+    env->DeleteLocalRef(entry_path);
+  }
+  ScopedLatin1Chars path_chars(env, path);
+  if (path_chars.get() == nullptr) {
+    return;
+  }
+  if (!DiskCacheIndex::Create(path_chars.get(), entries, scan_time_ms)) {
+    blaze_jni::PostException(env, errno, path_chars.get());
+  }
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doRecord(
+    JNIEnv *env, jclass clazz, jlong index, jstring path, jlong size) {
+  ScopedLatin1Chars path_chars(env, path);
+  if (path_chars.get() == nullptr) {
+    return JNI_FALSE;
+  }
+  return GetIndex(index)->Record(path_chars.get(), size) ? JNI_TRUE
+                                                         : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doTouch(
+    JNIEnv *env, jclass clazz, jlong index, jstring path) {
+  ScopedLatin1Chars path_chars(env, path);
+  if (path_chars.get() != nullptr) {
+    GetIndex(index)->Touch(path_chars.get());
+  }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doRemove(
+    JNIEnv *env, jclass clazz, jlong index, jstring path) {
+  ScopedLatin1Chars path_chars(env, path);
+  if (path_chars.get() != nullptr) {
+    GetIndex(index)->Remove(path_chars.get());
+  }
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doGetScanTime(
+    JNIEnv *env, jclass clazz, jlong index) {
+  return GetIndex(index)->scan_time_ms();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doIsComplete(
+    JNIEnv *env, jclass clazz, jlong index) {
+  return GetIndex(index)->complete() ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_remote_disk_DiskCacheIndex_doSelectEvictions(
+    JNIEnv *env, jclass clazz, jlong index, jlong max_bytes,
+    jlong cutoff_ms) {
+  int64_t total_entries;
+  int64_t total_bytes;
+  std::vector<DiskCacheIndex::Entry> evictions = GetIndex(index)->SelectEvictions(
+      max_bytes, cutoff_ms, &total_entries, &total_bytes);
+
+  jclass object_class = env->FindClass("java/lang/Object");
+  jclass string_class = env->FindClass("java/lang/String");
+  if (object_class == nullptr || string_class == nullptr) {
+    return nullptr;
+  }
+  jobjectArray result = env->NewObjectArray(4, object_class, nullptr);
+  jobjectArray paths =
+      env->NewObjectArray(evictions.size(), string_class, nullptr);
+  jlongArray sizes = env->NewLongArray(evictions.size());
+  jlongArray mtimes = env->NewLongArray(evictions.size());
+  jlongArray totals = env->NewLongArray(2);
+  if (result == nullptr || paths == nullptr || sizes == nullptr ||
+      mtimes == nullptr || totals == nullptr) {
+    return nullptr;
+  }
+  std::vector<jlong> size_values;
+  std::vector<jlong> mtime_values;
+  size_values.reserve(evictions.size());
+  mtime_values.reserve(evictions.size());
+  for (size_t i = 0; i < evictions.size(); ++i) {
+    jstring path = blaze_jni::NewStringLatin1(env, evictions[i].path.c_str());
+    if (path == nullptr) {
+      return nullptr;
+    }
+    env->SetObjectArrayElement(paths, i, path);
+    env->DeleteLocalRef(path);
+    size_values.push_back(evictions[i].size);
+    mtime_values.push_back(evictions[i].mtime_ms);
+  }
+  jlong total_values[] = {total_entries, total_bytes};
+  env->SetLongArrayRegion(sizes, 0, size_values.size(), size_values.data());
+  env->SetLongArrayRegion(mtimes, 0, mtime_values.size(), mtime_values.data());
+  env->SetLongArrayRegion(totals, 0, 2, total_values);
+  env->SetObjectArrayElement(result, 0, paths);
+  env->SetObjectArrayElement(result, 1, sizes);
+  env->SetObjectArrayElement(result, 2, mtimes);
+  env->SetObjectArrayElement(result, 3, totals);
+  return result;
+}
@@ -0,0 +1,376 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// INTERNAL header file for use by C++ code in this package.
+//
+// Hashing of whole files on behalf of the digest JNI libraries. A Hasher is a
+// default-constructible class with a kDigestSize constant, a kName string of
+// at most 11 characters and the methods Update(const uint8_t *data, size_t len)
+// and Finish(uint8_t *digest). POSIX only.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_FILE_DIGEST_H_
+#define BAZEL_SRC_MAIN_NATIVE_FILE_DIGEST_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/xattr.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/filesystem_capabilities.h"
+#include "src/main/native/latin1_jni_path.h"
+#include "src/main/native/worker_pool.h"
+
+namespace blaze_jni {
+
+// The size of the reads of DigestFile. Large enough for the SIMD
+// implementations to hash many blocks per call.
+static const size_t kDigestFileBufferSize = 256 * 1024;
+
+// The most threads DigestFiles uses, whatever the requested parallelism.
+static const int kMaxDigestFilesThreads = 16;
+
+// Hashes the contents of the open file fd into digest, reading it through
+// buf, which holds kDigestFileBufferSize bytes, and stores the number of bytes
+// hashed into size. Returns 0, or the errno of the failed call.
+template <typename Hasher>
+int DigestFd(int fd, uint8_t *buf, uint8_t *digest, uint64_t *size) {
+#if defined(POSIX_FADV_SEQUENTIAL)
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  // The file is read rather than mapped: a file truncated while it is mapped
+  // raises SIGBUS, which would take down the whole server.
+  Hasher hasher;
+  uint64_t total = 0;
+  for (;;) {
+    ssize_t r = read(fd, buf, kDigestFileBufferSize);
+    if (r == 0) {
+      break;
+    }
+    if (r == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    hasher.Update(buf, r);
+    total += r;
+  }
+  hasher.Finish(digest);
+  *size = total;
+  return 0;
+}
+
+// The value of the extended attribute in which DigestFile remembers the
+// digest of a file, with the state of the file it is the digest of. The ctime
+// of the file is not part of it, as writing the attribute changes it; the
+// record is only written if the file did not change, ctime included, while it
+// was hashed. The fields are in the byte order of the host, a record written
+// by another one does not match.
+struct DigestAttribute {
+  char magic[4];
+  // Hasher::kName, NUL padded.
+  char function[12];
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  // The first Hasher::kDigestSize bytes are used and stored.
+  uint8_t digest[64];
+};
+
+static const char kDigestAttributeMagic[4] = {'B', 'Z', 'D', '1'};
+
+// Files modified less than this long before they are hashed get no digest
+// attribute: a modification within the granularity of the file system's
+// timestamps could leave both their size and mtime unchanged.
+static const int64_t kDigestAttributeMinAgeSec = 2;
+
+inline void GetMtime(const struct stat &st, int64_t *sec, int64_t *nsec) {
+#if defined(__APPLE__)
+  *sec = st.st_mtimespec.tv_sec;
+  *nsec = st.st_mtimespec.tv_nsec;
+#else
+  *sec = st.st_mtim.tv_sec;
+  *nsec = st.st_mtim.tv_nsec;
+#endif
+}
+
+inline void GetCtime(const struct stat &st, int64_t *sec, int64_t *nsec) {
+#if defined(__APPLE__)
+  *sec = st.st_ctimespec.tv_sec;
+  *nsec = st.st_ctimespec.tv_nsec;
+#else
+  *sec = st.st_ctim.tv_sec;
+  *nsec = st.st_ctim.tv_nsec;
+#endif
+}
+
+inline ssize_t GetFdAttribute(int fd, const char *name, void *value,
+                              size_t size) {
+#if defined(__linux__)
+  return fgetxattr(fd, name, value, size);
+#elif defined(__APPLE__)
+  return fgetxattr(fd, name, value, size, 0, 0);
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+inline int SetFdAttribute(int fd, const char *name, const void *value,
+                          size_t size) {
+#if defined(__linux__)
+  return fsetxattr(fd, name, value, size, 0);
+#elif defined(__APPLE__)
+  return fsetxattr(fd, name, value, size, 0, 0);
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+// Copies the digest recorded in the attribute of fd into digest if it is
+// that of the file as described by st, computed by Hasher.
+template <typename Hasher>
+bool ReadDigestAttribute(int fd, const char *attribute, const struct stat &st,
+                         uint8_t *digest) {
+  static_assert(Hasher::kDigestSize <= sizeof(DigestAttribute::digest),
+                "digest too large for DigestAttribute");
+  const size_t record_size =
+      offsetof(DigestAttribute, digest) + Hasher::kDigestSize;
+  DigestAttribute record;
+  int64_t mtime_sec, mtime_nsec;
+  GetMtime(st, &mtime_sec, &mtime_nsec);
+  if (GetFdAttribute(fd, attribute, &record, sizeof(record)) !=
+          static_cast<ssize_t>(record_size) ||
+      memcmp(record.magic, kDigestAttributeMagic, sizeof(record.magic)) != 0 ||
+      strncmp(record.function, Hasher::kName, sizeof(record.function)) != 0 ||
+      record.size != st.st_size || record.mtime_sec != mtime_sec ||
+      record.mtime_nsec != mtime_nsec) {
+    return false;
+  }
+  memcpy(digest, record.digest, Hasher::kDigestSize);
+  return true;
+}
+
+// Records digest in the attribute of fd if the file did not change since it
+// was described by before, and was not modified too recently for its mtime to
+// tell. Read-only files owned by the process, such as the outputs of actions,
+// are made writable for the time it takes. Failures are ignored, but a file
+// system found not to support extended attributes is remembered in
+// capabilities.
+template <typename Hasher>
+void WriteDigestAttribute(
+    int fd, const char *attribute, const struct stat &before,
+    const uint8_t *digest,
+    const blaze_util::FilesystemCapabilities &capabilities) {
+  struct stat after;
+  if (fstat(fd, &after) == -1 || after.st_size != before.st_size) {
+    return;
+  }
+  int64_t mtime_sec, mtime_nsec, after_mtime_sec, after_mtime_nsec;
+  int64_t ctime_sec, ctime_nsec, after_ctime_sec, after_ctime_nsec;
+  GetMtime(before, &mtime_sec, &mtime_nsec);
+  GetMtime(after, &after_mtime_sec, &after_mtime_nsec);
+  GetCtime(before, &ctime_sec, &ctime_nsec);
+  GetCtime(after, &after_ctime_sec, &after_ctime_nsec);
+  if (mtime_sec != after_mtime_sec || mtime_nsec != after_mtime_nsec ||
+      ctime_sec != after_ctime_sec || ctime_nsec != after_ctime_nsec ||
+      time(nullptr) - mtime_sec < kDigestAttributeMinAgeSec) {
+    return;
+  }
+  DigestAttribute record;
+  memset(&record, 0, sizeof(record));
+  memcpy(record.magic, kDigestAttributeMagic, sizeof(record.magic));
+  strncpy(record.function, Hasher::kName, sizeof(record.function) - 1);
+  record.size = after.st_size;
+  record.mtime_sec = mtime_sec;
+  record.mtime_nsec = mtime_nsec;
+  memcpy(record.digest, digest, Hasher::kDigestSize);
+  const size_t record_size =
+      offsetof(DigestAttribute, digest) + Hasher::kDigestSize;
+  if (SetFdAttribute(fd, attribute, &record, record_size) == 0) {
+    return;
+  }
+  if (errno == ENOTSUP || errno == EOPNOTSUPP) {
+    capabilities.SetUnsupported(blaze_util::kFsExtendedAttributes);
+    return;
+  }
+  if ((errno != EACCES && errno != EPERM) || after.st_uid != geteuid() ||
+      (after.st_mode & S_IWUSR) != 0) {
+    return;
+  }
+  const mode_t mode = after.st_mode & 07777;
+  if (fchmod(fd, mode | S_IWUSR) == 0) {
+    SetFdAttribute(fd, attribute, &record, record_size);
+    fchmod(fd, mode);
+  }
+}
+
+// Hashes the contents of the file at path into digest, reading it through
+// buf, which holds kDigestFileBufferSize bytes, and stores the number of bytes
+// hashed into size unless it is null. Returns 0, or the errno of the failed
+// call.
+//
+// Unless attribute is null, the digest is also remembered in the extended
+// attribute of that name of the file, so that it need not be read again as
+// long as its size and mtime stay the same, even by another process.
+template <typename Hasher>
+int DigestFile(const char *path, uint8_t *buf, uint8_t *digest,
+               uint64_t *size = nullptr, const char *attribute = nullptr) {
+  int fd;
+  while ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 && errno == EINTR) {
+  }
+  if (fd == -1) {
+    return errno;
+  }
+  struct stat st;
+  const blaze_util::FilesystemCapabilities *capabilities = nullptr;
+  if (attribute != nullptr) {
+    if (fstat(fd, &st) == -1) {
+      int error = errno;
+      close(fd);
+      return error;
+    }
+    capabilities = &blaze_util::GetFilesystemCapabilities(fd, st.st_dev);
+    if (!capabilities->Has(blaze_util::kFsExtendedAttributes)) {
+      attribute = nullptr;
+    } else if (S_ISREG(st.st_mode) &&
+               ReadDigestAttribute<Hasher>(fd, attribute, st, digest)) {
+      close(fd);
+      if (size != nullptr) {
+        *size = st.st_size;
+      }
+      return 0;
+    }
+  }
+  uint64_t total;
+  int error = DigestFd<Hasher>(fd, buf, digest, &total);
+  if (error == 0 && attribute != nullptr && S_ISREG(st.st_mode) &&
+      total == static_cast<uint64_t>(st.st_size) &&
+      !capabilities->read_only()) {
+    WriteDigestAttribute<Hasher>(fd, attribute, st, digest, *capabilities);
+  }
+  close(fd);
+  if (error == 0 && size != nullptr) {
+    *size = total;
+  }
+  return error;
+}
+
+// Posts a FileNotFoundException or an IOException for a file DigestFile
+// could not read.
+inline void PostDigestFileException(JNIEnv *env, int error, const char *path) {
+  jclass exception_class = env->FindClass(
+      error == ENOENT ? "java/io/FileNotFoundException" : "java/io/IOException");
+  if (exception_class != nullptr) {
+    std::string message = std::string(path) + " (" + strerror(error) + ")";
+    env->ThrowNew(exception_class, message.c_str());
+  }
+}
+
+// Implements a JNI method (String path, String attribute, byte[] out) that
+// stores the digest of the file at path into out, or throws if the file
+// cannot be read. The digest is remembered in the extended attribute named
+// attribute of the file unless it is null, see DigestFile.
+template <typename Hasher>
+void JniDigestFile(JNIEnv *env, jstring path, jstring attribute,
+                   jbyteArray out) {
+  const char *path_chars = GetStringLatin1Chars(env, path);
+  const char *attribute_chars =
+      attribute != nullptr ? GetStringLatin1Chars(env, attribute) : nullptr;
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[kDigestFileBufferSize]);
+  uint8_t digest[Hasher::kDigestSize];
+  int error = DigestFile<Hasher>(path_chars, buf.get(), digest, nullptr,
+                                 attribute_chars);
+  if (error != 0) {
+    PostDigestFileException(env, error, path_chars);
+  } else {
+    env->SetByteArrayRegion(out, 0, Hasher::kDigestSize, (const jbyte *)digest);
+  }
+  if (attribute_chars != nullptr) {
+    ReleaseStringLatin1Chars(attribute_chars);
+  }
+  ReleaseStringLatin1Chars(path_chars);
+}
+
+// Hashes the files claimed one by one from next until there is none left.
+template <typename Hasher>
+void DigestFilesWorker(const std::vector<char *> &paths, const char *attribute,
+                       std::atomic<size_t> *next, uint8_t *digests,
+                       jint *errors) {
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[kDigestFileBufferSize]);
+  for (size_t i; (i = next->fetch_add(1)) < paths.size();) {
+    errors[i] = DigestFile<Hasher>(paths[i], buf.get(),
+                                   digests + i * Hasher::kDigestSize, nullptr,
+                                   attribute);
+  }
+}
+
+// Implements a JNI method (String[] paths, String attribute, int parallelism,
+// byte[] digests, int[] errnos) that hashes the files on up to parallelism
+// threads, storing the digest of paths[i] at offset i * kDigestSize of digests
+// and the errno of its failure, or 0, into errnos[i]. The digests are
+// remembered in the extended attribute named attribute of the files unless it
+// is null, see DigestFile.
+template <typename Hasher>
+void JniDigestFiles(JNIEnv *env, jobjectArray paths, jstring attribute,
+                    jint parallelism, jbyteArray digests, jintArray errnos) {
+  const jsize count = env->GetArrayLength(paths);
+  std::vector<char *> path_chars(count);
+  for (jsize i = 0; i < count; ++i) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    path_chars[i] = GetStringLatin1Chars(env, path);
+    env->DeleteLocalRef(path);
+  }
+  char *attribute_chars =
+      attribute != nullptr ? GetStringLatin1Chars(env, attribute) : nullptr;
+  // The threads write into native buffers, so that they neither touch the
+  // JNIEnv nor pin the Java arrays while they run.
+  std::vector<uint8_t> digest_buf(count * Hasher::kDigestSize);
+  std::vector<jint> errno_buf(count);
+  std::atomic<size_t> next(0);
+  const int nthreads = std::min<jsize>(
+      std::max(1, std::min(parallelism, kMaxDigestFilesThreads)), count);
+  WorkerPool::Get().Run(nthreads, [&](int) {
+    DigestFilesWorker<Hasher>(path_chars, attribute_chars, &next,
+                              digest_buf.data(), errno_buf.data());
+  });
+  for (char *chars : path_chars) {
+    ReleaseStringLatin1Chars(chars);
+  }
+  if (attribute_chars != nullptr) {
+    ReleaseStringLatin1Chars(attribute_chars);
+  }
+  env->SetByteArrayRegion(digests, 0, digest_buf.size(),
+                          (const jbyte *)digest_buf.data());
+  env->SetIntArrayRegion(errnos, 0, count, errno_buf.data());
+}
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_FILE_DIGEST_H_
@@ -0,0 +1,534 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// INTERNAL header file for use by C++ code in this package.
+//
+// The evaluation of a glob pattern below a directory, on behalf of the glob()
+// of packages. It follows UnixGlob: the same matching of names, the same
+// handling of "**" and of symlinks, and no descent into the directories that
+// the Java discriminator would not traverse, i.e. those holding a build file
+// and the ignored ones. The directories are read with getdents64(2) where
+// available and everything is resolved relative to a descriptor of the base
+// directory, on a few threads of the WorkerPool, rather than with a readdir
+// and a stat JNI call per directory and per matching entry. POSIX only.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_GLOB_H_
+#define BAZEL_SRC_MAIN_NATIVE_GLOB_H_
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/worker_pool.h"
+
+namespace blaze_jni {
+
+// The most threads a glob runs on.
+static const int kMaxGlobThreads = 8;
+
+// The size of the buffer getdents64(2) fills.
+static const size_t kGlobDirentBufferSize = 64 << 10;
+
+// The kinds of the paths of a GlobResult, as bits: a match that is a file, a
+// match that is a directory, and a directory that was not traversed because
+// it holds a build file, which may be a match as well.
+static const uint8_t kGlobFile = 1;
+static const uint8_t kGlobDirectory = 2;
+static const uint8_t kGlobBoundary = 4;
+
+// A segment of a glob pattern, which matches names the way
+// UnixGlob.matches() does, quirks included.
+class GlobSegment {
+ public:
+  explicit GlobSegment(std::string pattern) : pattern_(std::move(pattern)) {
+    const size_t first_star = pattern_.find('*');
+    const size_t last_star = pattern_.rfind('*');
+    if (pattern_ == "*" || pattern_ == "**") {
+      kind_ = kAny;
+    } else if (first_star == 0 && last_star == 0) {
+      kind_ = kSuffix;
+    } else if (!pattern_.empty() && last_star == pattern_.size() - 1 &&
+               first_star == last_star) {
+      kind_ = kPrefix;
+    } else {
+      kind_ = kWildcard;
+      // The regular expression UnixGlob compiles the pattern into drops the
+      // parentheses.
+      for (char c : pattern_) {
+        if (c != '(' && c != ')') {
+          wildcard_.push_back(c);
+        }
+      }
+    }
+  }
+
+  const std::string &pattern() const { return pattern_; }
+
+  bool IsRecursive() const { return pattern_ == "**"; }
+
+  bool HasWildcard() const {
+    return pattern_.find_first_of("*?") != std::string::npos;
+  }
+
+  bool Matches(std::string_view name) const {
+    if (pattern_.empty() || name.empty()) {
+      return false;
+    }
+    if (kind_ == kAny) {
+      return true;
+    }
+    // A leading '.' must be matched explicitly.
+    if (name[0] == '.' && pattern_[0] != '.') {
+      return false;
+    }
+    switch (kind_) {
+      case kSuffix:
+        return name.size() >= pattern_.size() - 1 &&
+               name.substr(name.size() - (pattern_.size() - 1)) ==
+                   std::string_view(pattern_).substr(1);
+      case kPrefix:
+        return name.substr(0, pattern_.size() - 1) ==
+               std::string_view(pattern_).substr(0, pattern_.size() - 1);
+      default:
+        return MatchesWildcard(name);
+    }
+  }
+
+ private:
+  enum Kind { kAny, kSuffix, kPrefix, kWildcard };
+
+  // As in a regular expression without DOTALL, the wildcards do not match
+  // the line terminators.
+  static bool IsLineTerminator(char c) {
+    return c == '\n' || c == '\r' || c == '\x85';
+  }
+
+  bool MatchesWildcard(std::string_view name) const {
+    // matched[j]: whether the pattern so far matches name[0, j).
+    std::vector<bool> matched(name.size() + 1, false);
+    matched[0] = true;
+    for (char p : wildcard_) {
+      std::vector<bool> next(name.size() + 1, false);
+      for (size_t j = 0; j <= name.size(); ++j) {
+        if (p == '*') {
+          next[j] = matched[j] ||
+                    (j > 0 && next[j - 1] && !IsLineTerminator(name[j - 1]));
+        } else if (j > 0 && matched[j - 1]) {
+          next[j] = p == '?' ? !IsLineTerminator(name[j - 1])
+                             : name[j - 1] == p;
+        }
+      }
+      matched.swap(next);
+    }
+    return matched[name.size()];
+  }
+
+  std::string pattern_;
+  Kind kind_;
+  std::string wildcard_;
+};
+
+// The matches of a glob and the build file boundaries it stopped at, with
+// their paths relative to the base directory, the base itself being "".
+struct GlobResult {
+  std::vector<std::string> paths;
+  std::vector<uint8_t> kinds;
+};
+
+// Evaluates a glob pattern below a directory, see Glob::Run.
+class Glob {
+ public:
+  // base_fd: an open descriptor of the base directory, kept open by the
+  // caller. build_files: the names of the files that make a directory other
+  // than the base a package of its own. pruned: the directories relative to
+  // the base that are not to be traversed either.
+  Glob(int base_fd, std::vector<GlobSegment> segments,
+       std::vector<std::string> build_files,
+       std::unordered_set<std::string> pruned)
+      : base_fd_(base_fd),
+        segments_(std::move(segments)),
+        build_files_(std::move(build_files)),
+        pruned_(std::move(pruned)) {}
+
+  Glob(const Glob &) = delete;
+  Glob &operator=(const Glob &) = delete;
+
+  // Runs the glob on up to parallelism threads. Returns false if it has to
+  // be left to the Java code, i.e. if a directory cannot be read or a stat
+  // fails other than for a missing file, which UnixGlob reports as an error.
+  bool Run(int parallelism, GlobResult *result) {
+    Queue("", true, 0);
+    const int nthreads = std::max(1, std::min(parallelism, kMaxGlobThreads));
+    WorkerPool::Get().Run(nthreads, [this](int) { Work(); });
+    if (failed_) {
+      return false;
+    }
+    std::vector<std::pair<std::string, uint8_t>> sorted(results_.begin(),
+                                                        results_.end());
+    std::sort(sorted.begin(), sorted.end());
+    for (auto &entry : sorted) {
+      result->paths.push_back(std::move(entry.first));
+      result->kinds.push_back(entry.second);
+    }
+    return true;
+  }
+
+ private:
+  // A directory entry, with d_type resolved unless it is a symlink.
+  struct Entry {
+    std::string name;
+    unsigned char type;
+  };
+
+  // The entries of a directory, read on first use.
+  struct Listing {
+    std::mutex mutex;
+    bool read = false;
+    bool ok = false;
+    std::vector<Entry> entries;
+  };
+
+  // Whether a directory holds a build file, stat-ed on first use.
+  struct Boundary {
+    std::mutex mutex;
+    bool checked = false;
+    bool ok = false;
+    bool holds_build_file = false;
+  };
+
+  struct Task {
+    std::string path;
+    bool is_dir;
+    size_t idx;
+  };
+
+  static std::string Child(const std::string &parent, std::string_view name) {
+    std::string child = parent;
+    if (!child.empty()) {
+      child.push_back('/');
+    }
+    child.append(name);
+    return child;
+  }
+
+  const char *RelativePath(const std::string &path) const {
+    return path.empty() ? "." : path.c_str();
+  }
+
+  // Queues the evaluation of segments_[idx..] below path once.
+  void Queue(std::string path, bool is_dir, size_t idx) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!queued_.insert(path + '\0' + std::to_string(idx)).second) {
+      return;
+    }
+    tasks_.push_back({std::move(path), is_dir, idx});
+    ++pending_;
+    wake_.notify_one();
+  }
+
+  // Runs the queued tasks until there are none left or running.
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this] { return !tasks_.empty() || pending_ == 0; });
+      if (tasks_.empty()) {
+        return;
+      }
+      Task task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      if (!failed_) {
+        Process(task);
+      }
+      lock.lock();
+      if (--pending_ == 0) {
+        wake_.notify_all();
+      }
+    }
+  }
+
+  void AddResult(const std::string &path, uint8_t kind) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_[path] |= kind;
+  }
+
+  bool AllRemainingRecursive(size_t idx) const {
+    for (size_t i = idx; i < segments_.size(); ++i) {
+      if (!segments_[i].IsRecursive()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Stats path following symlinks. Returns 1 if it exists, 0 if not, and -1
+  // on other errors.
+  int StatIfFound(const std::string &path, struct stat *st) const {
+    if (fstatat(base_fd_, RelativePath(path), st, 0) == 0) {
+      return 1;
+    }
+    return errno == ENOENT || errno == ENOTDIR ? 0 : -1;
+  }
+
+  template <typename T>
+  T *GetState(std::unordered_map<std::string, std::unique_ptr<T>> *states,
+              const std::string &path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<T> &state = (*states)[path];
+    if (state == nullptr) {
+      state = std::make_unique<T>();
+    }
+    return state.get();
+  }
+
+  // Returns whether the directory at path holds a build file, i.e. a regular
+  // file or a symlink to one, as PathPackageLocator decides. Sets failed_ if
+  // that cannot be told.
+  bool HoldsBuildFile(const std::string &path) {
+    Boundary *boundary = GetState(&boundaries_, path);
+    std::lock_guard<std::mutex> lock(boundary->mutex);
+    if (!boundary->checked) {
+      boundary->checked = true;
+      boundary->ok = true;
+      for (const std::string &name : build_files_) {
+        struct stat st;
+        int found = StatIfFound(Child(path, name), &st);
+        if (found < 0) {
+          boundary->ok = false;
+          break;
+        }
+        if (found > 0 && S_ISREG(st.st_mode)) {
+          boundary->holds_build_file = true;
+          break;
+        }
+      }
+    }
+    if (!boundary->ok) {
+      failed_ = true;
+    }
+    return boundary->holds_build_file;
+  }
+
+  // Reads the entries of the open directory fd, except . and .., into
+  // entries. Returns false on failure.
+  static bool ReadEntries(int fd, std::vector<Entry> *entries) {
+#if defined(__linux__)
+    std::unique_ptr<char[]> buf(new char[kGlobDirentBufferSize]);
+    for (;;) {
+      long n = syscall(SYS_getdents64, fd, buf.get(), kGlobDirentBufferSize);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        return false;
+      }
+      if (n == 0) {
+        return true;
+      }
+      for (long offset = 0; offset < n;) {
+        // The layout of struct linux_dirent64: d_ino, d_off, d_reclen,
+        // d_type and d_name.
+        const char *record = buf.get() + offset;
+        unsigned short reclen;
+        memcpy(&reclen, record + 16, sizeof(reclen));
+        const unsigned char type = record[18];
+        const char *name = record + 19;
+        if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+          entries->push_back({name, type});
+        }
+        offset += reclen;
+      }
+    }
+#else
+    DIR *dir = fdopendir(dup(fd));
+    if (dir == nullptr) {
+      return false;
+    }
+    bool ok;
+    for (;;) {
+      errno = 0;
+      struct dirent *entry = readdir(dir);
+      if (entry == nullptr) {
+        ok = errno == 0;
+        break;
+      }
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+        entries->push_back({entry->d_name, entry->d_type});
+      }
+    }
+    closedir(dir);
+    return ok;
+#endif
+  }
+
+  // Returns the entries of the directory at path, or null after setting
+  // failed_ if it cannot be read.
+  const std::vector<Entry> *List(const std::string &path) {
+    Listing *listing = GetState(&listings_, path);
+    std::lock_guard<std::mutex> lock(listing->mutex);
+    if (!listing->read) {
+      listing->read = true;
+      int fd;
+      while ((fd = openat(base_fd_, RelativePath(path),
+                          O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 &&
+             errno == EINTR) {
+      }
+      if (fd != -1) {
+        listing->ok = ReadEntries(fd, &listing->entries);
+        // Resolve the types that d_type does not tell, as UnixGlob's readdir
+        // does: other than for symlinks, without following them.
+        for (Entry &entry : listing->entries) {
+          if (!listing->ok || entry.type != DT_UNKNOWN) {
+            continue;
+          }
+          struct stat st;
+          if (fstatat(fd, entry.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) ==
+              -1) {
+            listing->ok = false;
+          } else {
+            entry.type = IFTODT(st.st_mode);
+          }
+        }
+        close(fd);
+      }
+    }
+    if (!listing->ok) {
+      failed_ = true;
+      return nullptr;
+    }
+    return &listing->entries;
+  }
+
+  // UnixGlob.reallyGlob(): evaluates segments_[idx..] below task.path.
+  void Process(const Task &task) {
+    const std::string &path = task.path;
+    const size_t idx = task.idx;
+    if (idx == segments_.size()) {
+      AddResult(path, task.is_dir ? kGlobDirectory : kGlobFile);
+      return;
+    }
+    if (!task.is_dir) {
+      return;
+    }
+    // The base directory is always traversed.
+    if (!path.empty()) {
+      const bool pruned = pruned_.count(path) > 0;
+      const bool boundary = !pruned && HoldsBuildFile(path);
+      if (failed_) {
+        return;
+      }
+      if (pruned || boundary) {
+        // UnixGlob offers the directory as a match if only "**"s remain.
+        const uint8_t kind = (boundary ? kGlobBoundary : 0) |
+                             (AllRemainingRecursive(idx) ? kGlobDirectory : 0);
+        if (kind != 0) {
+          AddResult(path, kind);
+        }
+        return;
+      }
+    }
+
+    const GlobSegment &segment = segments_[idx];
+    if (segment.IsRecursive()) {
+      Queue(path, true, idx + 1);
+    }
+    if (!segment.HasWildcard()) {
+      std::string child = Child(path, segment.pattern());
+      struct stat st;
+      int found = StatIfFound(child, &st);
+      if (found < 0) {
+        failed_ = true;
+      } else if (found > 0 && (S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
+        Queue(std::move(child), S_ISDIR(st.st_mode), idx + 1);
+      }
+      return;
+    }
+
+    const std::vector<Entry> *entries = List(path);
+    if (entries == nullptr) {
+      return;
+    }
+    for (const Entry &entry : *entries) {
+      // Special files are skipped before matching, as in UnixGlob.
+      if (entry.type != DT_REG && entry.type != DT_DIR &&
+          entry.type != DT_LNK) {
+        continue;
+      }
+      if (!segment.Matches(entry.name)) {
+        continue;
+      }
+      std::string child = Child(path, entry.name);
+      bool is_dir = entry.type == DT_DIR;
+      if (entry.type == DT_LNK) {
+        struct stat st;
+        int found = StatIfFound(child, &st);
+        if (found < 0) {
+          failed_ = true;
+          return;
+        }
+        if (found == 0) {
+          continue;  // dangling
+        }
+        is_dir = S_ISDIR(st.st_mode);
+      }
+      if (is_dir) {
+        Queue(std::move(child), true, idx + (segment.IsRecursive() ? 0 : 1));
+      } else if (idx + 1 == segments_.size()) {
+        AddResult(child, kGlobFile);
+      }
+    }
+  }
+
+  const int base_fd_;
+  const std::vector<GlobSegment> segments_;
+  const std::vector<std::string> build_files_;
+  const std::unordered_set<std::string> pruned_;
+
+  std::atomic<bool> failed_{false};
+
+  // Guards the members below, but not the contents of the states.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<Task> tasks_;
+  // The tasks queued and not done yet.
+  size_t pending_ = 0;
+  std::unordered_set<std::string> queued_;
+  std::unordered_map<std::string, uint8_t> results_;
+  std::unordered_map<std::string, std::unique_ptr<Listing>> listings_;
+  std::unordered_map<std::string, std::unique_ptr<Boundary>> boundaries_;
+};
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_GLOB_H_
@@ -30,8 +30,47 @@ static void LogBadPath(JNIEnv *env, jstring jstr) {
                       NativePosixFiles_logBadPath_method, jstr);
 }
 
+// Returns the package-private String(byte[], byte) constructor, which adopts
+// the array rather than copying it, if strings may be stored as Latin1;
+// otherwise null.
+static jmethodID GetLatin1StringConstructor(JNIEnv *env, jclass String_class) {
+  jfieldID compact_strings_field =
+      env->GetStaticFieldID(String_class, "COMPACT_STRINGS", "Z");
+  jmethodID constructor = env->GetMethodID(String_class, "<init>", "([BB)V");
+  if (compact_strings_field == nullptr || constructor == nullptr) {
+    env->ExceptionClear();
+    return nullptr;
+  }
+  if (!env->GetStaticBooleanField(String_class, compact_strings_field)) {
+    return nullptr;
+  }
+  return constructor;
+}
+
 jstring NewStringLatin1(JNIEnv *env, const char *str) {
+  static const jclass String_class = static_cast<jclass>(
+      env->NewGlobalRef(env->FindClass("java/lang/String")));
+  static const jmethodID String_latin1_constructor =
+      GetLatin1StringConstructor(env, String_class);
+
   int len = strlen(str);
+
+  // Fast path: build the string around a byte array with the Latin1 coder,
+  // which is how the JVM would store it anyway, so the characters are copied
+  // once and not widened to UTF-16 and compressed back.
+  if (String_latin1_constructor != nullptr) {
+    jbyteArray value = env->NewByteArray(len);
+    if (value == nullptr) {
+      return nullptr;
+    }
+    env->SetByteArrayRegion(value, 0, len,
+                            reinterpret_cast<const jbyte *>(str));
+    jstring result = static_cast<jstring>(env->NewObject(
+        String_class, String_latin1_constructor, value, static_cast<jbyte>(0)));
+    env->DeleteLocalRef(value);
+    return result;
+  }
+
   jchar buf[512];
   jchar *str1;
 
@@ -51,7 +90,10 @@ jstring NewStringLatin1(JNIEnv *env, const char *str) {
   return result;
 }
 
-char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
+// Like GetStringLatin1Chars, but returns buf if the string and its nul
+// terminator fit into its buf_size bytes.
+static char *GetStringLatin1CharsInto(JNIEnv *env, jstring jstr, char *buf,
+                                      jint buf_size) {
   static jclass String_class = env->FindClass("java/lang/String");
   static jfieldID String_coder_field =
       env->GetFieldID(String_class, "coder", "B");
@@ -59,15 +101,18 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
       env->GetFieldID(String_class, "value", "[B");
 
   jint len = env->GetStringLength(jstr);
+  char *result = len < buf_size ? buf : new char[len + 1];
 
   // Fast path for strings with a Latin1 coder, which all well-formed path
   // strings in Bazel ought to be.
   if (env->GetByteField(jstr, String_coder_field) == 0) {
-    char *result = new char[len + 1];
     if (jobject jvalue = env->GetObjectField(jstr, String_value_field)) {
       env->GetByteArrayRegion((jbyteArray)jvalue, 0, len, (jbyte *)result);
+      env->DeleteLocalRef(jvalue);
     } else {
-      delete[] result;
+      if (result != buf) {
+        delete[] result;
+      }
       return nullptr;
     }
     result[len] = 0;
@@ -80,9 +125,11 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
   LogBadPath(env, jstr);
   const jchar *str = env->GetStringCritical(jstr, nullptr);
   if (str == nullptr) {
+    if (result != buf) {
+      delete[] result;
+    }
     return nullptr;
   }
-  char *result = new char[len + 1];
   for (int i = 0; i < len; i++) {
     jchar unicode = str[i];  // (unsigned)
     result[i] = unicode <= 0x00ff ? unicode : '?';
@@ -92,10 +139,23 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
   return result;
 }
 
+char *GetStringLatin1Chars(JNIEnv *env, jstring jstr) {
+  return GetStringLatin1CharsInto(env, jstr, nullptr, 0);
+}
+
 /**
  * Release the Latin1 chars returned by a prior call to
  * GetStringLatin1Chars.
  */
 void ReleaseStringLatin1Chars(const char *s) { delete[] s; }
 
+ScopedLatin1Chars::ScopedLatin1Chars(JNIEnv *env, jstring jstr)
+    : chars_(GetStringLatin1CharsInto(env, jstr, inline_, kInlineSize)) {}
+
+ScopedLatin1Chars::~ScopedLatin1Chars() {
+  if (chars_ != inline_) {
+    delete[] chars_;
+  }
+}
+
 }  // namespace blaze_jni
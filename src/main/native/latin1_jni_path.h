@@ -46,6 +46,31 @@ char *GetStringLatin1Chars(JNIEnv *env, jstring jstr);
  */
 void ReleaseStringLatin1Chars(const char *s);
 
+/**
+ * The nul-terminated Latin1-encoded bytes of a Java string, as
+ * GetStringLatin1Chars returns them, for the lifetime of this object. They
+ * are copied into a buffer inside the object rather than into one allocated
+ * on the heap, unless the string is too long for it, so that a path can be
+ * passed to a syscall without any allocation. Null on failure.
+ */
+class ScopedLatin1Chars {
+ public:
+  ScopedLatin1Chars(JNIEnv *env, jstring jstr);
+  ~ScopedLatin1Chars();
+
+  ScopedLatin1Chars(const ScopedLatin1Chars &) = delete;
+  ScopedLatin1Chars &operator=(const ScopedLatin1Chars &) = delete;
+
+  const char *get() const { return chars_; }
+
+ private:
+  // Longer than nearly every path in an output base.
+  static constexpr int kInlineSize = 512;
+
+  char *chars_;
+  char inline_[kInlineSize];
+};
+
 }  // namespace blaze_jni
 
 #endif  // THIRD_PARTY_BAZEL_SRC_MAIN_NATIVE_LATIN1_JNI_PATH_H_
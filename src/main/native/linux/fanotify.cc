@@ -0,0 +1,383 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The Linux counterpart of darwin/fsevents.cc: watches a whole file system
+// with a single fanotify mark, so that the number of watched directories is
+// not limited by fs.inotify.max_user_watches.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/fanotify.h>
+#include <unistd.h>
+
+#include <condition_variable>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/changed_path_set.h"
+
+namespace {
+
+// The most directory handles remembered for resolving the events about
+// directories that no longer exist.
+const size_t kMaxCachedDirectories = 65536;
+
+const uint64_t kEventMask = FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM |
+                            FAN_MOVED_TO | FAN_MODIFY | FAN_ATTRIB |
+                            FAN_DELETE_SELF | FAN_MOVE_SELF | FAN_ONDIR;
+
+// The fanotify state of a LinuxFanotifyDiffAwareness and the paths that
+// changed since the last poll.
+struct JNIFanotifyDiffAwareness {
+  // The watched directory, without a trailing slash.
+  std::string root;
+
+  // The fanotify group, or -1 if it could not be set up.
+  int fanotify_fd = -1;
+
+  // A descriptor of root, the mount for open_by_handle_at.
+  int mount_fd = -1;
+
+  // Written to by doClose to stop the run loop.
+  int stop_fd = -1;
+
+  // Maps directory file handles to their paths, for the events about
+  // directories that were deleted by the time they are read. Only used by
+  // the run thread.
+  std::unordered_map<std::string, std::string> directories;
+
+  // Protects the fields below.
+  std::mutex mutex;
+
+  // If true, events were lost or cannot be attributed to paths, so we don't
+  // know what changed exactly.
+  bool everything_changed = false;
+
+  // Paths that have been changed since last polling. Empty while
+  // everything_changed is set.
+  blaze_jni::ChangedPathSet paths;
+
+  // Whether run is looping; doClose waits for it to exit.
+  bool running = false;
+  std::condition_variable run_exited;
+
+  ~JNIFanotifyDiffAwareness() {
+    if (fanotify_fd != -1) close(fanotify_fd);
+    if (mount_fd != -1) close(mount_fd);
+    if (stop_fd != -1) close(stop_fd);
+  }
+};
+
+// Sets up the fanotify group and mark for info->root. Returns false, leaving
+// the descriptors of info to its destructor, if the file system or the
+// privileges of the process do not allow it.
+bool SetUp(JNIFanotifyDiffAwareness *info) {
+  info->fanotify_fd = fanotify_init(
+      FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK,
+      O_RDONLY | O_CLOEXEC | O_LARGEFILE);
+  if (info->fanotify_fd == -1) {
+    return false;
+  }
+  if (fanotify_mark(info->fanotify_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                    kEventMask, AT_FDCWD, info->root.c_str()) == -1) {
+    return false;
+  }
+  info->mount_fd =
+      open(info->root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (info->mount_fd == -1) {
+    return false;
+  }
+  // The events identify directories by file handle; turning them back into
+  // paths needs CAP_DAC_READ_SEARCH, on top of the CAP_SYS_ADMIN for the
+  // mark. Check it on the root now rather than on the first event.
+  struct {
+    struct file_handle handle;
+    unsigned char bytes[MAX_HANDLE_SZ];
+  } root_handle;
+  root_handle.handle.handle_bytes = MAX_HANDLE_SZ;
+  int mount_id;
+  if (name_to_handle_at(info->mount_fd, "", &root_handle.handle, &mount_id,
+                        AT_EMPTY_PATH) == -1) {
+    return false;
+  }
+  int fd = open_by_handle_at(info->mount_fd, &root_handle.handle, O_PATH);
+  if (fd == -1) {
+    return false;
+  }
+  close(fd);
+  info->stop_fd = eventfd(0, EFD_CLOEXEC);
+  return info->stop_fd != -1;
+}
+
+// Returns the path of the directory identified by handle, or an empty string
+// if it cannot be known.
+std::string ResolveDirectory(JNIFanotifyDiffAwareness *info,
+                             struct file_handle *handle) {
+  std::string key(reinterpret_cast<const char *>(handle),
+                  sizeof(*handle) + handle->handle_bytes);
+  int fd = open_by_handle_at(info->mount_fd, handle, O_PATH);
+  if (fd == -1) {
+    auto it = info->directories.find(key);
+    return it == info->directories.end() ? std::string() : it->second;
+  }
+  char link[64];
+  snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+  char path[PATH_MAX];
+  ssize_t len = readlink(link, path, sizeof(path));
+  close(fd);
+  if (len <= 0 || len == sizeof(path)) {
+    return std::string();
+  }
+  std::string result(path, len);
+  if (info->directories.size() >= kMaxCachedDirectories) {
+    info->directories.clear();
+  }
+  info->directories[key] = result;
+  return result;
+}
+
+bool IsUnderRoot(const std::string &root, const std::string &path) {
+  return root == "/" ||
+         (path.compare(0, root.size(), root) == 0 &&
+          (path.size() == root.size() || path[root.size()] == '/'));
+}
+
+// Adds the paths changed by the events in buf, which holds the len bytes of
+// a read of the fanotify group, to changed. Returns false if some change
+// cannot be attributed to a path. Runs without info->mutex, so that poll is
+// not held up by the file system calls.
+bool HandleEvents(JNIFanotifyDiffAwareness *info, const char *buf,
+                  ssize_t len, std::vector<std::string> *changed) {
+  bool complete = true;
+  const struct fanotify_event_metadata *metadata =
+      reinterpret_cast<const struct fanotify_event_metadata *>(buf);
+  for (; FAN_EVENT_OK(metadata, len); metadata = FAN_EVENT_NEXT(metadata, len)) {
+    if (metadata->vers != FANOTIFY_METADATA_VERSION ||
+        (metadata->mask & FAN_Q_OVERFLOW) != 0) {
+      // Either the kernel speaks a format we don't know or we lost events.
+      complete = false;
+      continue;
+    }
+    if ((metadata->mask & FAN_ONDIR) != 0 &&
+        (metadata->mask & (FAN_MOVED_FROM | FAN_MOVED_TO | FAN_MOVE_SELF)) !=
+            0) {
+      // A directory was renamed. Like on macOS, we cannot tell which files
+      // disappeared from the source of the move, so rescan everything.
+      complete = false;
+      info->directories.clear();
+      continue;
+    }
+    const char *end = reinterpret_cast<const char *>(metadata) +
+                      metadata->event_len;
+    const char *record = reinterpret_cast<const char *>(metadata + 1);
+    while (record + sizeof(struct fanotify_event_info_header) <= end) {
+      const struct fanotify_event_info_fid *fid =
+          reinterpret_cast<const struct fanotify_event_info_fid *>(record);
+      if (fid->hdr.len == 0) {
+        break;
+      }
+      record += fid->hdr.len;
+      if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME &&
+          fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID &&
+          fid->hdr.info_type != FAN_EVENT_INFO_TYPE_FID) {
+        continue;
+      }
+      struct file_handle *handle = reinterpret_cast<struct file_handle *>(
+          const_cast<unsigned char *>(fid->handle));
+      std::string path = ResolveDirectory(info, handle);
+      if (path.empty()) {
+        complete = false;
+        continue;
+      }
+      if (fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+        const char *name =
+            reinterpret_cast<const char *>(handle->f_handle) +
+            handle->handle_bytes;
+        if (strcmp(name, ".") != 0) {
+          path += path == "/" ? "" : "/";
+          path += name;
+        }
+      }
+      // The mark covers the whole file system.
+      if (IsUnderRoot(info->root, path)) {
+        changed->push_back(std::move(path));
+      }
+    }
+  }
+  return complete;
+}
+
+JNIFanotifyDiffAwareness *GetInfo(JNIEnv *env, jobject diffAwareness) {
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  jlong field = env->GetLongField(diffAwareness, fid);
+  return reinterpret_cast<JNIFanotifyDiffAwareness *>(field);
+}
+
+std::string GetPath(JNIEnv *env, jbyteArray path) {
+  jbyte *pathBytes = env->GetByteArrayElements(path, nullptr);
+  std::string result(reinterpret_cast<const char *>(pathBytes),
+                     env->GetArrayLength(path));
+  env->ReleaseByteArrayElements(path, pathBytes, JNI_ABORT);
+  while (result.size() > 1 && result.back() == '/') {
+    result.pop_back();
+  }
+  return result;
+}
+
+}  // namespace
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFanotifyDiffAwareness_isSupported(
+    JNIEnv *env, jclass clazz, jbyteArray root) {
+  JNIFanotifyDiffAwareness info;
+  info.root = GetPath(env, root);
+  return SetUp(&info) ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFanotifyDiffAwareness_create(
+    JNIEnv *env, jobject diffAwareness, jbyteArray root) {
+  JNIFanotifyDiffAwareness *info = new JNIFanotifyDiffAwareness();
+  info->root = GetPath(env, root);
+  if (!SetUp(info)) {
+    // isSupported said otherwise a moment ago; never trust any view.
+    info->everything_changed = true;
+  }
+
+  // Save the info pointer to LinuxFanotifyDiffAwareness#nativePointer
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  env->SetLongField(diffAwareness, fid, reinterpret_cast<jlong>(info));
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFanotifyDiffAwareness_run(
+    JNIEnv *env, jobject diffAwareness, jobject listening) {
+  JNIFanotifyDiffAwareness *info = GetInfo(env, diffAwareness);
+  {
+    std::lock_guard<std::mutex> lock(info->mutex);
+    info->running = true;
+  }
+
+  // The mark is in place since create, so no event is lost between here and
+  // the first read.
+  jclass countDownLatchClass = env->GetObjectClass(listening);
+  jmethodID countDownMethod =
+      env->GetMethodID(countDownLatchClass, "countDown", "()V");
+  env->CallVoidMethod(listening, countDownMethod);
+
+  if (info->stop_fd != -1) {
+    std::unique_ptr<char[]> buf(new char[64 * 1024]);
+    struct pollfd fds[2] = {{info->fanotify_fd, POLLIN, 0},
+                            {info->stop_fd, POLLIN, 0}};
+    std::vector<std::string> changed;
+    for (;;) {
+      if (poll(fds, 2, -1) == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::lock_guard<std::mutex> lock(info->mutex);
+        info->everything_changed = true;
+        break;
+      }
+      if (fds[1].revents != 0) {
+        break;
+      }
+      ssize_t len;
+      while ((len = read(info->fanotify_fd, buf.get(), 64 * 1024)) > 0) {
+        changed.clear();
+        bool complete = HandleEvents(info, buf.get(), len, &changed);
+        std::lock_guard<std::mutex> lock(info->mutex);
+        if (!complete) {
+          info->everything_changed = true;
+        }
+        for (size_t i = 0; i < changed.size() && !info->everything_changed;
+             ++i) {
+          if (!info->paths.Add(changed[i])) {
+            info->everything_changed = true;
+          }
+        }
+        if (info->everything_changed) {
+          info->paths.Clear();
+        }
+      }
+      if (len == -1 && errno != EAGAIN && errno != EINTR) {
+        std::lock_guard<std::mutex> lock(info->mutex);
+        info->everything_changed = true;
+        break;
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(info->mutex);
+  info->running = false;
+  info->run_exited.notify_all();
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFanotifyDiffAwareness_poll(
+    JNIEnv *env, jobject diffAwareness) {
+  JNIFanotifyDiffAwareness *info = GetInfo(env, diffAwareness);
+  std::lock_guard<std::mutex> lock(info->mutex);
+
+  jobjectArray result;
+  if (info->everything_changed || !info->running) {
+    result = nullptr;
+  } else {
+    jclass classByteArray = env->FindClass("[B");
+    const auto &paths = info->paths.paths();
+    result = env->NewObjectArray(paths.size(), classByteArray, nullptr);
+    int i = 0;
+    for (std::string_view changed : paths) {
+      jbyteArray path = env->NewByteArray(changed.size());
+      env->SetByteArrayRegion(path, 0, changed.size(),
+                              reinterpret_cast<const jbyte *>(changed.data()));
+      env->SetObjectArrayElement(result, i++, path);
+      env->DeleteLocalRef(path);
+    }
+  }
+
+  info->everything_changed = false;
+  info->paths.Clear();
+  return result;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_LinuxFanotifyDiffAwareness_doClose(
+    JNIEnv *env, jobject diffAwareness) {
+  JNIFanotifyDiffAwareness *info = GetInfo(env, diffAwareness);
+  if (info->stop_fd != -1) {
+    uint64_t one = 1;
+    while (write(info->stop_fd, &one, sizeof(one)) == -1 && errno == EINTR) {
+    }
+  }
+  {
+    std::unique_lock<std::mutex> lock(info->mutex);
+    info->run_exited.wait(lock, [info] { return !info->running; });
+  }
+  delete info;
+}
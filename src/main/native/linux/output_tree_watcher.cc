@@ -0,0 +1,401 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Watches the output tree with inotify for OutputTreeWatcher, so that the
+// outputs nothing touched since the last build need not be stat()ed at the
+// start of the next one. Unlike linux/fanotify.cc, it needs no privileges,
+// but it takes a watch per directory.
+
+#include <dirent.h>
+#include <errno.h>
+#include <jni.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/changed_path_set.h"
+
+namespace {
+
+const uint32_t kEventMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+                            IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW;
+
+const size_t kBufferSize = 64 * 1024;
+
+// The inotify state of an OutputTreeWatcher and the paths that changed since
+// the last reset.
+struct JNIOutputTreeWatcher {
+  // The watched directory, without a trailing slash.
+  std::string root;
+
+  // The inotify instance, or -1 if it could not be set up.
+  int inotify_fd = -1;
+
+  // Written to by doClose to stop the run loop.
+  int stop_fd = -1;
+
+  // Protects the fields below. The events are read with it held, so that
+  // poll and reset can take the ones queued up to the call into account.
+  std::mutex mutex;
+
+  // Where the events are read into.
+  std::unique_ptr<char[]> buffer{new char[kBufferSize]};
+
+  // The path of each watched directory, by watch descriptor.
+  std::unordered_map<int, std::string> directories;
+
+  // The watch descriptor of root, or -1 if root is not watched.
+  int root_wd = -1;
+
+  // Whether reset was called since root was last watched. The changes before
+  // that are made by the build itself, and cannot be told apart.
+  bool tracking = false;
+
+  // If true, events were lost or cannot be attributed to paths, so we don't
+  // know what changed exactly.
+  bool everything_changed = false;
+
+  // If true, events were lost, so some directories may not be watched yet;
+  // reset walks the tree again.
+  bool rescan = false;
+
+  // If true, a watch could not be added, most likely because of
+  // fs.inotify.max_user_watches, and the tree cannot be watched.
+  bool exhausted = false;
+
+  // Paths that have been changed since the last reset. Meaningless while
+  // everything_changed is set.
+  blaze_jni::ChangedPathSet paths;
+
+  // Whether run is looping; doClose waits for it to exit.
+  bool running = false;
+  std::condition_variable run_exited;
+
+  ~JNIOutputTreeWatcher() {
+    if (inotify_fd != -1) close(inotify_fd);
+    if (stop_fd != -1) close(stop_fd);
+  }
+};
+
+// Records path as changed. Called with info->mutex held.
+void Record(JNIOutputTreeWatcher *info, std::string_view path) {
+  if (!info->everything_changed && !info->paths.Add(path)) {
+    info->everything_changed = true;
+  }
+}
+
+// Watches the directory at path and the ones below it. If report is set,
+// also records everything below it as changed, since it was not watched when
+// that was created. Called with info->mutex held.
+void WatchTree(JNIOutputTreeWatcher *info, const std::string &path,
+               bool report) {
+  std::vector<std::string> pending = {path};
+  while (!pending.empty() && !info->exhausted) {
+    std::string dir = std::move(pending.back());
+    pending.pop_back();
+    int wd = inotify_add_watch(info->inotify_fd, dir.c_str(), kEventMask);
+    if (wd == -1) {
+      // A directory that is gone or was replaced by a file since is reported
+      // by the events of its parent.
+      if (errno != ENOENT && errno != ENOTDIR) {
+        info->exhausted = true;
+      }
+      continue;
+    }
+    // Watching a directory again returns the watch it already has.
+    info->directories[wd] = dir;
+    if (dir == info->root) {
+      info->root_wd = wd;
+    }
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+      if (report && errno != ENOENT) {
+        info->everything_changed = true;
+      }
+      continue;
+    }
+    while (struct dirent *entry = readdir(d)) {
+      if (entry->d_name[0] == '.' &&
+          (entry->d_name[1] == '\0' ||
+           (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
+        continue;
+      }
+      std::string child = dir + "/" + entry->d_name;
+      bool is_dir = entry->d_type == DT_DIR;
+      if (entry->d_type == DT_UNKNOWN) {
+        struct stat st;
+        is_dir = lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+      }
+      if (report) {
+        Record(info, child);
+      }
+      if (is_dir) {
+        pending.push_back(std::move(child));
+      }
+    }
+    closedir(d);
+  }
+}
+
+// Stops watching the directory at path and the ones below it. Called with
+// info->mutex held.
+void UnwatchTree(JNIOutputTreeWatcher *info, const std::string &path) {
+  for (auto it = info->directories.begin(); it != info->directories.end();) {
+    const std::string &dir = it->second;
+    if (dir.compare(0, path.size(), path) == 0 &&
+        (dir.size() == path.size() || dir[path.size()] == '/')) {
+      inotify_rm_watch(info->inotify_fd, it->first);
+      if (it->first == info->root_wd) {
+        info->root_wd = -1;
+      }
+      it = info->directories.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Handles the events in info->buffer, which holds the len bytes of a read of
+// the inotify instance. Called with info->mutex held.
+void HandleEvents(JNIOutputTreeWatcher *info, ssize_t len) {
+  const char *end = info->buffer.get() + len;
+  for (const char *p = info->buffer.get(); p < end;) {
+    const struct inotify_event *event =
+        reinterpret_cast<const struct inotify_event *>(p);
+    p += sizeof(struct inotify_event) + event->len;
+    if ((event->mask & IN_Q_OVERFLOW) != 0) {
+      info->everything_changed = true;
+      info->rescan = true;
+      continue;
+    }
+    if ((event->mask & IN_IGNORED) != 0) {
+      if (info->directories.erase(event->wd) != 0 &&
+          event->wd == info->root_wd) {
+        // Say, the file system of root was unmounted.
+        info->root_wd = -1;
+        info->everything_changed = true;
+        info->rescan = true;
+      }
+      continue;
+    }
+    auto it = info->directories.find(event->wd);
+    if (it == info->directories.end()) {
+      // Already unwatched.
+      continue;
+    }
+    if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) != 0) {
+      // The other directories are reported by the events of their parent.
+      if (event->wd == info->root_wd) {
+        UnwatchTree(info, info->root);
+        info->everything_changed = true;
+        info->rescan = true;
+      }
+      continue;
+    }
+    std::string path = it->second;
+    if (event->len > 0) {
+      path += '/';
+      path += event->name;
+    }
+    Record(info, path);
+    if ((event->mask & IN_ISDIR) != 0) {
+      if ((event->mask & IN_MOVED_FROM) != 0) {
+        // We cannot tell which files disappeared along with the directory.
+        UnwatchTree(info, path);
+        info->everything_changed = true;
+      } else if ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+        WatchTree(info, path, /*report=*/true);
+      }
+    }
+  }
+}
+
+// Handles the events queued up so far. Called with info->mutex held.
+void Drain(JNIOutputTreeWatcher *info) {
+  if (info->inotify_fd == -1) {
+    return;
+  }
+  ssize_t len;
+  while ((len = read(info->inotify_fd, info->buffer.get(), kBufferSize)) > 0) {
+    HandleEvents(info, len);
+  }
+  if (len == -1 && errno != EAGAIN && errno != EINTR) {
+    info->everything_changed = true;
+    info->rescan = true;
+  }
+}
+
+JNIOutputTreeWatcher *GetInfo(JNIEnv *env, jobject watcher) {
+  jclass clazz = env->GetObjectClass(watcher);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  jlong field = env->GetLongField(watcher, fid);
+  return reinterpret_cast<JNIOutputTreeWatcher *>(field);
+}
+
+}  // namespace
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_skyframe_OutputTreeWatcher_create(
+    JNIEnv *env, jobject watcher, jbyteArray root) {
+  JNIOutputTreeWatcher *info = new JNIOutputTreeWatcher();
+  jbyte *root_bytes = env->GetByteArrayElements(root, nullptr);
+  info->root.assign(reinterpret_cast<const char *>(root_bytes),
+                    env->GetArrayLength(root));
+  env->ReleaseByteArrayElements(root, root_bytes, JNI_ABORT);
+  while (info->root.size() > 1 && info->root.back() == '/') {
+    info->root.pop_back();
+  }
+
+  // Save the info pointer to OutputTreeWatcher#nativePointer
+  jclass clazz = env->GetObjectClass(watcher);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  env->SetLongField(watcher, fid, reinterpret_cast<jlong>(info));
+
+  info->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  info->stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (info->inotify_fd == -1 || info->stop_fd == -1) {
+    return JNI_FALSE;
+  }
+  // The tree may not exist before the first build; reset watches it then. If
+  // it has too many directories to watch, reset says so.
+  WatchTree(info, info->root, /*report=*/false);
+  info->rescan = info->root_wd == -1;
+  return JNI_TRUE;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_OutputTreeWatcher_run(
+    JNIEnv *env, jobject watcher, jobject listening) {
+  JNIOutputTreeWatcher *info = GetInfo(env, watcher);
+  {
+    std::lock_guard<std::mutex> lock(info->mutex);
+    info->running = true;
+  }
+
+  jclass countDownLatchClass = env->GetObjectClass(listening);
+  jmethodID countDownMethod =
+      env->GetMethodID(countDownLatchClass, "countDown", "()V");
+  env->CallVoidMethod(listening, countDownMethod);
+
+  // Only keeps the queue from overflowing: poll and reset read what is left
+  // themselves.
+  struct pollfd fds[2] = {{info->inotify_fd, POLLIN, 0},
+                          {info->stop_fd, POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::lock_guard<std::mutex> lock(info->mutex);
+      info->everything_changed = true;
+      info->exhausted = true;
+      break;
+    }
+    if (fds[1].revents != 0) {
+      break;
+    }
+    std::lock_guard<std::mutex> lock(info->mutex);
+    Drain(info);
+  }
+
+  std::lock_guard<std::mutex> lock(info->mutex);
+  info->running = false;
+  info->run_exited.notify_all();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_skyframe_OutputTreeWatcher_poll(
+    JNIEnv *env, jobject watcher) {
+  JNIOutputTreeWatcher *info = GetInfo(env, watcher);
+  std::lock_guard<std::mutex> lock(info->mutex);
+  Drain(info);
+  if (!info->tracking || info->everything_changed || info->exhausted ||
+      !info->running) {
+    return JNI_FALSE;
+  }
+  // Unlike the source watchers, the paths are kept until reset: the build
+  // they are polled for may not get to check them.
+  const std::vector<std::string_view> &paths = info->paths.paths();
+  std::vector<jint> ends;
+  ends.reserve(paths.size());
+  jint size = 0;
+  for (std::string_view path : paths) {
+    size += path.size();
+    ends.push_back(size);
+  }
+  jbyteArray bytes = env->NewByteArray(size);
+  jintArray ends_array = env->NewIntArray(ends.size());
+  if (bytes != nullptr && ends_array != nullptr) {
+    jint start = 0;
+    for (std::string_view path : paths) {
+      env->SetByteArrayRegion(bytes, start, path.size(),
+                              reinterpret_cast<const jbyte *>(path.data()));
+      start += path.size();
+    }
+    env->SetIntArrayRegion(ends_array, 0, ends.size(), ends.data());
+    jclass clazz = env->GetObjectClass(watcher);
+    env->SetObjectField(watcher, env->GetFieldID(clazz, "polledPaths", "[B"),
+                        bytes);
+    env->SetObjectField(watcher,
+                        env->GetFieldID(clazz, "polledPathEnds", "[I"),
+                        ends_array);
+  }
+  // On an OutOfMemoryError, pending until the return, the result is ignored.
+  return JNI_TRUE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_skyframe_OutputTreeWatcher_doReset(
+    JNIEnv *env, jobject watcher) {
+  JNIOutputTreeWatcher *info = GetInfo(env, watcher);
+  std::lock_guard<std::mutex> lock(info->mutex);
+  Drain(info);
+  if (info->rescan && !info->exhausted && info->inotify_fd != -1) {
+    // The changes up to here are dropped anyway, so there is no need to
+    // report what the walk finds.
+    WatchTree(info, info->root, /*report=*/false);
+    info->rescan = info->root_wd == -1;
+  }
+  info->paths.Clear();
+  info->everything_changed = false;
+  info->tracking = !info->rescan;
+  return info->exhausted || !info->running ? JNI_FALSE : JNI_TRUE;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_OutputTreeWatcher_doClose(
+    JNIEnv *env, jobject watcher) {
+  JNIOutputTreeWatcher *info = GetInfo(env, watcher);
+  if (info->stop_fd != -1) {
+    uint64_t one = 1;
+    while (write(info->stop_fd, &one, sizeof(one)) == -1 && errno == EINTR) {
+    }
+    std::unique_lock<std::mutex> lock(info->mutex);
+    info->run_exited.wait(lock, [info] { return !info->running; });
+  }
+  delete info;
+}
@@ -0,0 +1,312 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The Linux counterparts of the darwin/system_*_monitor_jni.cc modules. Linux
+// has no notifications for these, so a single thread samples sysfs, procfs
+// and the file system every few seconds and calls the callbacks when a value
+// changes.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+
+#include "src/main/cpp/util/logging.h"
+#include "src/main/native/unix_jni.h"
+
+namespace blaze_jni {
+
+namespace {
+
+// How often the monitor thread samples. PSI averages over 10s windows and
+// thermal zones and cpufreq limits change slowly, so this may be coarse.
+const std::chrono::seconds kSamplePeriod(5);
+
+// The monitors the thread samples, as started by the portable_start_*
+// functions.
+enum Monitor {
+  kThermalMonitor = 1 << 0,
+  kLoadAdvisoryMonitor = 1 << 1,
+  kDiskSpaceMonitor = 1 << 2,
+  kCpuSpeedMonitor = 1 << 3,
+};
+
+std::atomic<int> g_started_monitors(0);
+
+// The file system watched for low disk space: the one holding the working
+// directory of the server when the monitoring started, i.e. the workspace.
+int g_disk_space_fd = -1;
+
+// Reads the first line of a small sysfs or procfs file into buf. Returns
+// false if the file cannot be read.
+bool ReadLine(const std::string &path, char *buf, size_t size) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  ssize_t len = read(fd, buf, size - 1);
+  close(fd);
+  if (len <= 0) {
+    return false;
+  }
+  buf[len] = '\0';
+  buf[strcspn(buf, "\n")] = '\0';
+  return true;
+}
+
+bool ReadLong(const std::string &path, long *value) {
+  char buf[64];
+  if (!ReadLine(path, buf, sizeof(buf))) {
+    return false;
+  }
+  char *end;
+  *value = strtol(buf, &end, 10);
+  return end != buf;
+}
+
+// Calls visit with the full path of each entry of dir whose name starts with
+// prefix.
+template <typename Visit>
+void ForEachEntry(const char *dir, const char *prefix, Visit visit) {
+  DIR *d = opendir(dir);
+  if (d == nullptr) {
+    return;
+  }
+  size_t prefix_len = strlen(prefix);
+  while (struct dirent *e = readdir(d)) {
+    if (strncmp(e->d_name, prefix, prefix_len) == 0) {
+      visit(std::string(dir) + "/" + e->d_name);
+    }
+  }
+  closedir(d);
+}
+
+// Returns the thermal load of a zone on the 0-100 scale of the macOS thermal
+// pressure levels, from how close its temperature is to its trip points, or
+// -1 if the zone has no usable trip point.
+int ZoneThermalLoad(const std::string &zone) {
+  long temp;
+  if (!ReadLong(zone + "/temp", &temp)) {
+    return -1;
+  }
+  long passive = -1, hot = -1, critical = -1;
+  ForEachEntry(zone.c_str(), "trip_point_", [&](const std::string &path) {
+    size_t suffix = path.rfind("_type");
+    if (suffix == std::string::npos || suffix + 5 != path.size()) {
+      return;
+    }
+    char type[32];
+    long trip;
+    if (!ReadLine(path, type, sizeof(type)) ||
+        !ReadLong(path.substr(0, suffix) + "_temp", &trip) || trip <= 0) {
+      return;
+    }
+    long *slot = strcmp(type, "passive") == 0    ? &passive
+                 : strcmp(type, "hot") == 0      ? &hot
+                 : strcmp(type, "critical") == 0 ? &critical
+                                                 : nullptr;
+    if (slot != nullptr && (*slot == -1 || trip < *slot)) {
+      *slot = trip;
+    }
+  });
+  if (hot == -1 && critical != -1) {
+    // Temperatures are in millidegrees Celsius.
+    hot = critical - 5000;
+  }
+  if (passive == -1 && hot == -1) {
+    return -1;
+  }
+  if (critical != -1 && temp >= critical) {
+    return 100;
+  }
+  if (hot != -1 && temp >= hot) {
+    return 90;
+  }
+  if (passive != -1 && temp >= passive) {
+    // The kernel is throttling the devices cooling this zone.
+    return 50;
+  }
+  if (passive != -1 && temp >= passive - 5000) {
+    return 33;
+  }
+  return 0;
+}
+
+// Returns the "some avg10" CPU pressure, the share of the last 10s in which
+// runnable tasks waited for a CPU, or -1 if pressure stall information is
+// not available.
+double CpuPressure() {
+  char buf[128];
+  if (!ReadLine("/proc/pressure/cpu", buf, sizeof(buf))) {
+    return -1;
+  }
+  const char *avg10 = strstr(buf, "avg10=");
+  return avg10 == nullptr ? -1 : strtod(avg10 + 6, nullptr);
+}
+
+// Returns the disk space level of the watched file system, or -1 if there is
+// plenty of space or it cannot be told.
+int DiskSpaceLevel() {
+  struct statvfs buf;
+  if (g_disk_space_fd < 0 || fstatvfs(g_disk_space_fd, &buf) < 0 ||
+      buf.f_blocks == 0) {
+    return -1;
+  }
+  // Like "low disk space" on macOS, the thresholds scale with the size of
+  // small disks but are absolute on large ones.
+  uint64_t total = static_cast<uint64_t>(buf.f_blocks) * buf.f_frsize;
+  uint64_t available = static_cast<uint64_t>(buf.f_bavail) * buf.f_frsize;
+  uint64_t very_low = std::min<uint64_t>(total / 100, 2ULL << 30);
+  uint64_t low = std::min<uint64_t>(total / 20, 10ULL << 30);
+  if (available < very_low) {
+    return DiskSpaceLevelVeryLow;
+  }
+  if (available < low) {
+    return DiskSpaceLevelLow;
+  }
+  return -1;
+}
+
+void MonitorSystem() {
+  // -2 means not sampled yet, so that the first sample of a monitor only
+  // reports abnormal values, like the macOS notifications do.
+  int thermal_load = -2, load_advisory = -2, disk_space = -2, cpu_speed = -2;
+  for (;;) {
+    int monitors = g_started_monitors;
+    if (monitors & kThermalMonitor) {
+      int value = portable_thermal_load();
+      if (value != thermal_load && (thermal_load != -2 || value != 0)) {
+        BAZEL_LOG(USER) << "thermal pressure (" << value << ") anomaly";
+        thermal_callback(value);
+      }
+      thermal_load = value;
+    }
+    if (monitors & kLoadAdvisoryMonitor) {
+      int value = portable_system_load_advisory();
+      if (value != load_advisory && (load_advisory != -2 || value != 0)) {
+        BAZEL_LOG(USER) << "system load advisory (" << value << ") anomaly";
+        system_load_advisory_callback(value);
+      }
+      load_advisory = value;
+    }
+    if (monitors & kDiskSpaceMonitor) {
+      // Only a worsening is reported, as on macOS.
+      int value = DiskSpaceLevel();
+      if (value != -1 && value > disk_space) {
+        BAZEL_LOG(USER) << (value == DiskSpaceLevelVeryLow
+                                ? "disk space very low anomaly"
+                                : "disk space low anomaly");
+        disk_space_callback(static_cast<blaze_jni::DiskSpaceLevel>(value));
+      }
+      disk_space = value;
+    }
+    if (monitors & kCpuSpeedMonitor) {
+      int value = portable_cpu_speed();
+      if (value != cpu_speed && (cpu_speed != -2 || value != 100) &&
+          value != -1) {
+        BAZEL_LOG(USER) << "cpu speed anomaly: " << value;
+        cpu_speed_callback(value);
+      }
+      cpu_speed = value;
+    }
+    std::this_thread::sleep_for(kSamplePeriod);
+  }
+}
+
+// Adds monitor to the ones sampled by the monitor thread, starting it if
+// needed.
+void StartMonitor(Monitor monitor) {
+  g_started_monitors |= monitor;
+  static std::once_flag once;
+  std::call_once(once, [] { std::thread(MonitorSystem).detach(); });
+}
+
+}  // namespace
+
+void portable_start_thermal_monitoring() { StartMonitor(kThermalMonitor); }
+
+int portable_thermal_load() {
+  int load = 0;
+  ForEachEntry("/sys/class/thermal", "thermal_zone",
+               [&](const std::string &zone) {
+                 load = std::max(load, ZoneThermalLoad(zone));
+               });
+  return load;
+}
+
+void portable_start_system_load_advisory_monitoring() {
+  StartMonitor(kLoadAdvisoryMonitor);
+}
+
+int portable_system_load_advisory() {
+  // The levels of IOSystemLoadAdvisoryLevel: great (0), ok (25), bad (75).
+  double pressure = CpuPressure();
+  if (pressure < 0) {
+    // Older kernels and kernels built without CONFIG_PSI: compare the load
+    // average with the number of CPUs instead.
+    double load;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (getloadavg(&load, 1) != 1 || cpus <= 0) {
+      return 0;
+    }
+    pressure = 100 * (load / cpus - 0.5);
+  }
+  if (pressure < 20) {
+    return 0;
+  }
+  return pressure < 60 ? 25 : 75;
+}
+
+void portable_start_disk_space_monitoring() {
+  static std::once_flag once;
+  std::call_once(once, [] {
+    g_disk_space_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  });
+  StartMonitor(kDiskSpaceMonitor);
+}
+
+void portable_start_cpu_speed_monitoring() { StartMonitor(kCpuSpeedMonitor); }
+
+int portable_cpu_speed() {
+  // The speed limit as a percentage of the maximum, as on macOS: the cpufreq
+  // policies lower scaling_max_freq when the CPUs are thermally or power
+  // capped.
+  long limit_sum = 0, max_sum = 0;
+  ForEachEntry("/sys/devices/system/cpu/cpufreq", "policy",
+               [&](const std::string &policy) {
+                 long limit, max;
+                 if (ReadLong(policy + "/scaling_max_freq", &limit) &&
+                     ReadLong(policy + "/cpuinfo_max_freq", &max) && max > 0) {
+                   limit_sum += std::min(limit, max);
+                   max_sum += max;
+                 }
+               });
+  if (max_sum == 0) {
+    // No cpufreq driver, as in most VMs.
+    return -1;
+  }
+  return static_cast<int>((100 * limit_sum + max_sum / 2) / max_sum);
+}
+
+}  // namespace blaze_jni
@@ -0,0 +1,433 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// INTERNAL header file for use by C++ code in this package.
+//
+// The Merkle trees of directories in the format of the remote execution API,
+// on behalf of the digest JNI libraries, with the Hasher of file_digest.h.
+// The directories are listed and the files hashed on a few threads, and the
+// Directory messages are encoded here, rather than with a JNI call per
+// directory entry and per file. The result is byte for byte what the
+// DirectoryBuilder of UploadManifest produces. POSIX only.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_MERKLE_TREE_H_
+#define BAZEL_SRC_MAIN_NATIVE_MERKLE_TREE_H_
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <jni.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/file_digest.h"
+#include "src/main/native/latin1_jni_path.h"
+#include "src/main/native/worker_pool.h"
+
+namespace blaze_jni {
+
+// The entries of a directory, by name, as the Java code uploads them:
+// absolute symlinks to files and directories are followed, the other
+// symlinks are kept as such.
+struct MerkleTreeListing {
+  std::vector<std::string> files;
+  std::vector<std::string> subdirs;
+  // Names and targets.
+  std::vector<std::pair<std::string, std::string>> symlinks;
+};
+
+// A directory of a MerkleTree. The path is relative to the root of the tree,
+// which has the empty path.
+struct MerkleTreeDirectory {
+  std::string path;
+  MerkleTreeListing listing;
+  // The indices of the subdirectories in MerkleTree::dirs, in the order of
+  // listing.subdirs.
+  std::vector<size_t> subdirs;
+};
+
+struct MerkleTree {
+  std::vector<MerkleTreeDirectory> dirs;
+  // The paths of the files relative to the root, and their digests and sizes.
+  std::vector<std::string> files;
+  std::vector<uint8_t> file_digests;
+  std::vector<uint64_t> file_sizes;
+  // The Tree message.
+  std::string tree;
+};
+
+// Calls work(i, &state) for every i below count on up to parallelism
+// threads of the WorkerPool, each with a State of its own.
+template <typename State, typename Work>
+void ParallelFor(size_t count, int parallelism, const Work &work) {
+  std::atomic<size_t> next(0);
+  const size_t nthreads = std::min<size_t>(
+      std::max(1, std::min(parallelism, kMaxDigestFilesThreads)), count);
+  WorkerPool::Get().Run(nthreads, [&next, count, &work](int) {
+    State state;
+    for (size_t i; (i = next.fetch_add(1)) < count;) {
+      work(i, &state);
+    }
+  });
+}
+
+// Returns whether a relative symlink target is in the normal form of
+// PathFragment, which is what the Java code puts into the tree.
+inline bool IsNormalRelativeTarget(std::string_view target) {
+  bool after_name = false;
+  size_t start = 0;
+  while (start <= target.size()) {
+    size_t end = std::min(target.find('/', start), target.size());
+    std::string_view segment = target.substr(start, end - start);
+    if (segment.empty() || segment == ".") {
+      return false;
+    }
+    if (segment != "..") {
+      after_name = true;
+    } else if (after_name) {
+      return false;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+// Lists the directory at path into listing. Returns false if it cannot be
+// read, or if it has an entry that the Java code rejects or may reject, such
+// as a special file or a dangling absolute symlink, so that the caller can
+// leave the tree to the Java code and its error reporting.
+inline bool ListMerkleTreeDirectory(const std::string &path,
+                                    MerkleTreeListing *listing) {
+  int fd;
+  while ((fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 &&
+         errno == EINTR) {
+  }
+  if (fd == -1) {
+    return false;
+  }
+  DIR *dir = fdopendir(fd);
+  if (dir == nullptr) {
+    close(fd);
+    return false;
+  }
+  bool ok = true;
+  for (;;) {
+    errno = 0;
+    struct dirent *entry = readdir(dir);
+    if (entry == nullptr) {
+      ok = errno == 0;
+      break;
+    }
+    const char *name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      continue;
+    }
+    struct stat st;
+    mode_t type = DTTOIF(entry->d_type);
+    if (entry->d_type == DT_UNKNOWN) {
+      if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+        ok = false;
+        break;
+      }
+      type = st.st_mode & S_IFMT;
+    }
+    if (S_ISLNK(type)) {
+      char target[PATH_MAX];
+      ssize_t length = readlinkat(fd, name, target, sizeof(target));
+      if (length <= 0 || length == sizeof(target)) {
+        ok = false;
+        break;
+      }
+      if (target[0] != '/') {
+        if (!IsNormalRelativeTarget(std::string_view(target, length))) {
+          ok = false;
+          break;
+        }
+        listing->symlinks.emplace_back(name, std::string(target, length));
+        continue;
+      }
+      if (fstatat(fd, name, &st, 0) == -1) {
+        ok = false;
+        break;
+      }
+      type = st.st_mode & S_IFMT;
+    }
+    if (S_ISREG(type)) {
+      listing->files.emplace_back(name);
+    } else if (S_ISDIR(type)) {
+      listing->subdirs.emplace_back(name);
+    } else {
+      ok = false;
+      break;
+    }
+  }
+  closedir(dir);
+  return ok;
+}
+
+// Appends the protocol buffer encoding of a varint.
+inline void AppendVarint(std::string *out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+// Appends a length-delimited field, i.e. a string or a message.
+inline void AppendField(std::string *out, int field, std::string_view value) {
+  out->push_back(static_cast<char>(field << 3 | 2));
+  AppendVarint(out, value.size());
+  out->append(value);
+}
+
+// Appends a string field holding a name from the file system. The Java code
+// puts the Latin1 path strings into the messages as they are, so each byte
+// is encoded as a character of its own.
+inline void AppendNameField(std::string *out, int field,
+                            std::string_view name) {
+  std::string utf8;
+  for (char c : name) {
+    unsigned char b = static_cast<unsigned char>(c);
+    if (b < 0x80) {
+      utf8.push_back(c);
+    } else {
+      utf8.push_back(static_cast<char>(0xc0 | b >> 6));
+      utf8.push_back(static_cast<char>(0x80 | (b & 0x3f)));
+    }
+  }
+  if (!utf8.empty()) {
+    AppendField(out, field, utf8);
+  }
+}
+
+// Returns an encoded Digest message.
+inline std::string EncodeDigest(const uint8_t *hash, size_t hash_size,
+                                uint64_t size) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  std::string hex;
+  for (size_t i = 0; i < hash_size; ++i) {
+    hex.push_back(kHexDigits[hash[i] >> 4]);
+    hex.push_back(kHexDigits[hash[i] & 0xf]);
+  }
+  std::string digest;
+  AppendField(&digest, 1, hex);
+  if (size != 0) {
+    digest.push_back(2 << 3);
+    AppendVarint(&digest, size);
+  }
+  return digest;
+}
+
+inline std::string ChildPath(const std::string &parent,
+                             const std::string &name) {
+  return parent.empty() ? name : parent + "/" + name;
+}
+
+// Computes the Merkle tree of the directory at root on up to parallelism
+// threads. Returns false if the tree has to be left to the Java code, see
+// ListMerkleTreeDirectory, or if a file cannot be read.
+template <typename Hasher>
+bool ComputeMerkleTree(const std::string &root, int parallelism,
+                       MerkleTree *tree) {
+  struct NoState {};
+  struct DigestBuffer {
+    std::unique_ptr<uint8_t[]> data{new uint8_t[kDigestFileBufferSize]};
+  };
+
+  // List the directories level by level, each level on all the threads.
+  tree->dirs.push_back({});
+  std::vector<size_t> level = {0};
+  while (!level.empty()) {
+    std::atomic<bool> ok(true);
+    ParallelFor<NoState>(level.size(), parallelism, [&](size_t i, NoState *) {
+      MerkleTreeDirectory *dir = &tree->dirs[level[i]];
+      std::string path = dir->path.empty() ? root : root + "/" + dir->path;
+      if (!ListMerkleTreeDirectory(path, &dir->listing)) {
+        ok = false;
+      }
+    });
+    if (!ok) {
+      return false;
+    }
+    std::vector<size_t> next_level;
+    // The files and the directories are numbered in the same order.
+    for (size_t d : level) {
+      MerkleTreeListing &listing = tree->dirs[d].listing;
+      std::sort(listing.files.begin(), listing.files.end());
+      std::sort(listing.subdirs.begin(), listing.subdirs.end());
+      std::sort(listing.symlinks.begin(), listing.symlinks.end());
+      for (const std::string &name : listing.files) {
+        tree->files.push_back(ChildPath(tree->dirs[d].path, name));
+      }
+      for (size_t i = 0; i < tree->dirs[d].listing.subdirs.size(); ++i) {
+        MerkleTreeDirectory subdir;
+        subdir.path =
+            ChildPath(tree->dirs[d].path, tree->dirs[d].listing.subdirs[i]);
+        tree->dirs[d].subdirs.push_back(tree->dirs.size());
+        next_level.push_back(tree->dirs.size());
+        tree->dirs.push_back(std::move(subdir));
+      }
+    }
+    level.swap(next_level);
+  }
+
+  // Hash the files.
+  const size_t file_count = tree->files.size();
+  tree->file_digests.resize(file_count * Hasher::kDigestSize);
+  tree->file_sizes.resize(file_count);
+  std::atomic<bool> ok(true);
+  ParallelFor<DigestBuffer>(
+      file_count, parallelism, [&](size_t i, DigestBuffer *buf) {
+        std::string path = root + "/" + tree->files[i];
+        if (DigestFile<Hasher>(path.c_str(), buf->data.get(),
+                               &tree->file_digests[i * Hasher::kDigestSize],
+                               &tree->file_sizes[i]) != 0) {
+          ok = false;
+        }
+      });
+  if (!ok) {
+    return false;
+  }
+
+  // Encode the directories, children before parents: the Java code goes
+  // through them in the reverse order of their paths, keeping the first of
+  // identical messages, and then lists them backwards in the Tree.
+  size_t next_file = 0;
+  std::vector<size_t> first_file(tree->dirs.size());
+  for (size_t d = 0; d < tree->dirs.size(); ++d) {
+    first_file[d] = next_file;
+    next_file += tree->dirs[d].listing.files.size();
+  }
+  std::vector<size_t> order(tree->dirs.size());
+  for (size_t d = 0; d < order.size(); ++d) {
+    order[d] = d;
+  }
+  std::sort(order.begin(), order.end(), [tree](size_t a, size_t b) {
+    return tree->dirs[a].path > tree->dirs[b].path;
+  });
+  std::vector<std::string> dir_digests(tree->dirs.size());
+  std::vector<std::string> blobs;
+  std::unordered_set<std::string> seen;
+  for (size_t d : order) {
+    const MerkleTreeDirectory &dir = tree->dirs[d];
+    std::string blob;
+    for (size_t i = 0; i < dir.listing.files.size(); ++i) {
+      const size_t f = first_file[d] + i;
+      std::string node;
+      AppendNameField(&node, 1, dir.listing.files[i]);
+      AppendField(&node, 2,
+                  EncodeDigest(&tree->file_digests[f * Hasher::kDigestSize],
+                               Hasher::kDigestSize, tree->file_sizes[f]));
+      // is_executable
+      node.push_back(4 << 3);
+      node.push_back(1);
+      AppendField(&blob, 1, node);
+    }
+    for (size_t i = 0; i < dir.subdirs.size(); ++i) {
+      std::string node;
+      AppendNameField(&node, 1, dir.listing.subdirs[i]);
+      AppendField(&node, 2, dir_digests[dir.subdirs[i]]);
+      AppendField(&blob, 2, node);
+    }
+    for (const auto &symlink : dir.listing.symlinks) {
+      std::string node;
+      AppendNameField(&node, 1, symlink.first);
+      AppendNameField(&node, 2, symlink.second);
+      AppendField(&blob, 3, node);
+    }
+    Hasher hasher;
+    hasher.Update(reinterpret_cast<const uint8_t *>(blob.data()), blob.size());
+    uint8_t hash[Hasher::kDigestSize];
+    hasher.Finish(hash);
+    dir_digests[d] = EncodeDigest(hash, Hasher::kDigestSize, blob.size());
+    if (seen.insert(dir_digests[d]).second) {
+      blobs.push_back(std::move(blob));
+    }
+  }
+  int field = 1;  // root, then children
+  for (auto blob = blobs.rbegin(); blob != blobs.rend(); ++blob) {
+    AppendField(&tree->tree, field, *blob);
+    field = 2;
+  }
+  return true;
+}
+
+// Implements a JNI method (String root, int parallelism) that returns the
+// Merkle tree of the directory at root as an Object[] of the Tree message in
+// wire format (byte[]), the paths of its files relative to root (String[]),
+// their digests (byte[], kDigestSize bytes each) and their sizes (long[]).
+// Returns null if the tree has to be left to the Java code.
+template <typename Hasher>
+jobjectArray JniMerkleTree(JNIEnv *env, jstring root, jint parallelism) {
+  MerkleTree tree;
+  {
+    ScopedLatin1Chars root_chars(env, root);
+    if (root_chars.get() == nullptr ||
+        !ComputeMerkleTree<Hasher>(root_chars.get(), parallelism, &tree)) {
+      return nullptr;
+    }
+  }
+  jclass object_class = env->FindClass("java/lang/Object");
+  jclass string_class = env->FindClass("java/lang/String");
+  if (object_class == nullptr || string_class == nullptr) {
+    return nullptr;
+  }
+  jobjectArray result = env->NewObjectArray(4, object_class, nullptr);
+  jbyteArray tree_bytes = env->NewByteArray(tree.tree.size());
+  jobjectArray files =
+      env->NewObjectArray(tree.files.size(), string_class, nullptr);
+  jbyteArray digests = env->NewByteArray(tree.file_digests.size());
+  jlongArray sizes = env->NewLongArray(tree.file_sizes.size());
+  if (result == nullptr || tree_bytes == nullptr || files == nullptr ||
+      digests == nullptr || sizes == nullptr) {
+    return nullptr;
+  }
+  env->SetByteArrayRegion(tree_bytes, 0, tree.tree.size(),
+                          reinterpret_cast<const jbyte *>(tree.tree.data()));
+  for (size_t i = 0; i < tree.files.size(); ++i) {
+    jstring file = NewStringLatin1(env, tree.files[i].c_str());
+    if (file == nullptr) {
+      return nullptr;
+    }
+    env->SetObjectArrayElement(files, i, file);
+    env->DeleteLocalRef(file);
+  }
+  env->SetByteArrayRegion(
+      digests, 0, tree.file_digests.size(),
+      reinterpret_cast<const jbyte *>(tree.file_digests.data()));
+  std::vector<jlong> jsizes(tree.file_sizes.begin(), tree.file_sizes.end());
+  env->SetLongArrayRegion(sizes, 0, jsizes.size(), jsizes.data());
+  env->SetObjectArrayElement(result, 0, tree_bytes);
+  env->SetObjectArrayElement(result, 1, files);
+  env->SetObjectArrayElement(result, 2, digests);
+  env->SetObjectArrayElement(result, 3, sizes);
+  return result;
+}
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_MERKLE_TREE_H_
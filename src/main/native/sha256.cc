@@ -0,0 +1,292 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/native/sha256.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256_X86_SHA 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__linux__) || defined(__APPLE__))
+#define SHA256_ARM_SHA2 1
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+#endif
+
+namespace blaze_jni {
+
+namespace {
+
+const uint32_t kInitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+alignas(16) const uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+// Compresses the blocks 64-byte blocks at data into state.
+typedef void (*BlockFunction)(uint32_t *state, const uint8_t *data,
+                              size_t blocks);
+
+inline uint32_t RotateRight(uint32_t x, int n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t LoadBigEndian32(const uint8_t *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 |
+         (uint32_t)p[3];
+}
+
+void CompressPortable(uint32_t *state, const uint8_t *data, size_t blocks) {
+  for (; blocks > 0; --blocks, data += 64) {
+    uint32_t w[64];
+    for (int t = 0; t < 16; ++t) {
+      w[t] = LoadBigEndian32(data + 4 * t);
+    }
+    for (int t = 16; t < 64; ++t) {
+      uint32_t s0 = RotateRight(w[t - 15], 7) ^ RotateRight(w[t - 15], 18) ^
+                    (w[t - 15] >> 3);
+      uint32_t s1 = RotateRight(w[t - 2], 17) ^ RotateRight(w[t - 2], 19) ^
+                    (w[t - 2] >> 10);
+      w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; ++t) {
+      uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+      uint32_t ch = (e & f) ^ (~e & g);
+      uint32_t t1 = h + s1 + ch + kRoundConstants[t] + w[t];
+      uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+      uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+      uint32_t t2 = s0 + maj;
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#if defined(SHA256_X86_SHA)
+// The SHA extensions keep the state as the ABEF and CDGH halves and do two
+// rounds per sha256rnds2.
+__attribute__((target("sha,sse4.1"))) void CompressX86Sha(
+    uint32_t *state, const uint8_t *data, size_t blocks) {
+  const __m128i byte_swap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i dcba = _mm_loadu_si128((const __m128i *)&state[0]);
+  __m128i hgfe = _mm_loadu_si128((const __m128i *)&state[4]);
+  __m128i cdab = _mm_shuffle_epi32(dcba, 0xB1);
+  __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1B);
+  __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+  __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+  for (; blocks > 0; --blocks, data += 64) {
+    const __m128i abef_saved = abef;
+    const __m128i cdgh_saved = cdgh;
+    // The last four groups of four message words, W[4g .. 4g+3] at [g % 4].
+    __m128i msg[4];
+    for (int g = 0; g < 4; ++g) {
+      msg[g] = _mm_shuffle_epi8(
+          _mm_loadu_si128((const __m128i *)(data + 16 * g)), byte_swap);
+    }
+    for (int g = 0; g < 16; ++g) {
+      if (g >= 4) {
+        __m128i w = _mm_sha256msg1_epu32(msg[g & 3], msg[(g + 1) & 3]);
+        w = _mm_add_epi32(w, _mm_alignr_epi8(msg[(g + 3) & 3],
+                                             msg[(g + 2) & 3], 4));
+        msg[g & 3] = _mm_sha256msg2_epu32(w, msg[(g + 3) & 3]);
+      }
+      __m128i wk = _mm_add_epi32(
+          msg[g & 3],
+          _mm_load_si128((const __m128i *)&kRoundConstants[4 * g]));
+      // Two rounds turn ABEF into the next CDGH, and two more the CDGH
+      // after that into the next ABEF.
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0E));
+    }
+    abef = _mm_add_epi32(abef, abef_saved);
+    cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+  }
+
+  __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+  __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+  _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(feba, dchg, 0xF0));
+  _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+bool HasX86Sha() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+    return false;
+  }
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  return (ebx & bit_SHA) != 0;
+}
+#endif  // SHA256_X86_SHA
+
+#if defined(SHA256_ARM_SHA2)
+#if defined(__ARM_FEATURE_SHA2)
+#define SHA256_ARM_TARGET
+#elif defined(__clang__)
+#define SHA256_ARM_TARGET __attribute__((target("crypto")))
+#else
+#define SHA256_ARM_TARGET __attribute__((target("+crypto")))
+#endif
+
+// The ARMv8 cryptography extensions keep the state as ABCD and EFGH and do
+// four rounds per sha256h/sha256h2 pair.
+SHA256_ARM_TARGET void CompressArmSha2(uint32_t *state, const uint8_t *data,
+                                       size_t blocks) {
+  uint32x4_t abcd = vld1q_u32(&state[0]);
+  uint32x4_t efgh = vld1q_u32(&state[4]);
+
+  for (; blocks > 0; --blocks, data += 64) {
+    const uint32x4_t abcd_saved = abcd;
+    const uint32x4_t efgh_saved = efgh;
+    // The last four groups of four message words, W[4g .. 4g+3] at [g % 4].
+    uint32x4_t msg[4];
+    for (int g = 0; g < 4; ++g) {
+      msg[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * g)));
+    }
+    for (int g = 0; g < 16; ++g) {
+      if (g >= 4) {
+        msg[g & 3] = vsha256su1q_u32(
+            vsha256su0q_u32(msg[g & 3], msg[(g + 1) & 3]), msg[(g + 2) & 3],
+            msg[(g + 3) & 3]);
+      }
+      uint32x4_t wk = vaddq_u32(msg[g & 3], vld1q_u32(&kRoundConstants[4 * g]));
+      uint32x4_t abcd_before = abcd;
+      abcd = vsha256hq_u32(abcd, efgh, wk);
+      efgh = vsha256h2q_u32(efgh, abcd_before, wk);
+    }
+    abcd = vaddq_u32(abcd, abcd_saved);
+    efgh = vaddq_u32(efgh, efgh_saved);
+  }
+
+  vst1q_u32(&state[0], abcd);
+  vst1q_u32(&state[4], efgh);
+}
+
+bool HasArmSha2() {
+#if defined(__APPLE__)
+  // Every 64-bit Apple CPU has the cryptography extensions.
+  return true;
+#else
+  return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#endif
+}
+#endif  // SHA256_ARM_SHA2
+
+BlockFunction SelectBlockFunction() {
+#if defined(SHA256_X86_SHA)
+  if (HasX86Sha()) {
+    return CompressX86Sha;
+  }
+#elif defined(SHA256_ARM_SHA2)
+  if (HasArmSha2()) {
+    return CompressArmSha2;
+  }
+#endif
+  return CompressPortable;
+}
+
+const BlockFunction kCompress = SelectBlockFunction();
+
+}  // namespace
+
+Sha256::Sha256() : buffered_(0), length_(0) {
+  memcpy(state_, kInitialState, sizeof(state_));
+}
+
+void Sha256::Update(const uint8_t *data, size_t len) {
+  length_ += len;
+  if (buffered_ > 0) {
+    size_t n = kBlockSize - buffered_;
+    if (len < n) {
+      memcpy(buffer_ + buffered_, data, len);
+      buffered_ += len;
+      return;
+    }
+    memcpy(buffer_ + buffered_, data, n);
+    kCompress(state_, buffer_, 1);
+    data += n;
+    len -= n;
+    buffered_ = 0;
+  }
+  if (len >= kBlockSize) {
+    kCompress(state_, data, len / kBlockSize);
+    data += len - len % kBlockSize;
+    len %= kBlockSize;
+  }
+  memcpy(buffer_, data, len);
+  buffered_ = len;
+}
+
+void Sha256::Finish(uint8_t *digest) {
+  uint64_t bit_length = length_ * 8;
+  buffer_[buffered_++] = 0x80;
+  if (buffered_ > kBlockSize - 8) {
+    memset(buffer_ + buffered_, 0, kBlockSize - buffered_);
+    kCompress(state_, buffer_, 1);
+    buffered_ = 0;
+  }
+  memset(buffer_ + buffered_, 0, kBlockSize - 8 - buffered_);
+  for (int i = 0; i < 8; ++i) {
+    buffer_[kBlockSize - 1 - i] = (uint8_t)(bit_length >> (8 * i));
+  }
+  kCompress(state_, buffer_, 1);
+  for (int i = 0; i < 8; ++i) {
+    digest[4 * i] = (uint8_t)(state_[i] >> 24);
+    digest[4 * i + 1] = (uint8_t)(state_[i] >> 16);
+    digest[4 * i + 2] = (uint8_t)(state_[i] >> 8);
+    digest[4 * i + 3] = (uint8_t)state_[i];
+  }
+}
+
+}  // namespace blaze_jni
@@ -0,0 +1,52 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// INTERNAL header file for use by C++ code in this package.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_SHA256_H_
+#define BAZEL_SRC_MAIN_NATIVE_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace blaze_jni {
+
+// Incremental SHA-256 (FIPS 180-4). The blocks are compressed with the SHA
+// extensions of x86-64 or the ARMv8 cryptography extensions when the CPU has
+// them, and in portable C++ otherwise.
+class Sha256 {
+ public:
+  static constexpr size_t kDigestSize = 32;
+  static constexpr char kName[] = "SHA-256";
+
+  Sha256();
+
+  void Update(const uint8_t *data, size_t len);
+
+  // Stores the digest of everything passed to Update into digest, which
+  // holds kDigestSize bytes. The object must not be used afterwards.
+  void Finish(uint8_t *digest);
+
+ private:
+  static constexpr size_t kBlockSize = 64;
+
+  uint32_t state_[8];
+  uint8_t buffer_[kBlockSize];
+  size_t buffered_;
+  uint64_t length_;
+};
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_SHA256_H_
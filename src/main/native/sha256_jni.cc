@@ -0,0 +1,71 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <jni.h>
+
+#ifndef _WIN32
+#include "src/main/native/file_digest.h"
+#include "src/main/native/merkle_tree.h"
+#include "src/main/native/sha256.h"
+#endif
+
+namespace blaze_jni {
+
+#ifdef _WIN32
+// Posts an UnsupportedOperationException: the file hashing entry points are
+// not implemented on Windows.
+static void PostUnsupportedOnWindows(JNIEnv *env, const char *function) {
+  jclass exception_class =
+      env->FindClass("java/lang/UnsupportedOperationException");
+  if (exception_class != nullptr) {
+    env->ThrowNew(exception_class, function);
+  }
+}
+#endif
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_NativeSha256_sha256_1hash_1file(
+    JNIEnv *env, jclass clazz, jstring path, jstring attribute,
+    jbyteArray out) {
+#ifdef _WIN32
+  PostUnsupportedOnWindows(env, "sha256_hash_file");
+#else
+  JniDigestFile<Sha256>(env, path, attribute, out);
+#endif
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_NativeSha256_sha256_1hash_1files(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jstring attribute,
+    jint parallelism, jbyteArray digests, jintArray errnos) {
+#ifdef _WIN32
+  PostUnsupportedOnWindows(env, "sha256_hash_files");
+#else
+  JniDigestFiles<Sha256>(env, paths, attribute, parallelism, digests,
+                         errnos);
+#endif
+}
+
+
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_vfs_bazel_NativeSha256_sha256_1merkle_1tree(
+    JNIEnv *env, jclass clazz, jstring root, jint parallelism) {
+#ifdef _WIN32
+  PostUnsupportedOnWindows(env, "sha256_merkle_tree");
+  return nullptr;
+#else
+  return JniMerkleTree<Sha256>(env, root, parallelism);
+#endif
+}
+
+}  // namespace blaze_jni
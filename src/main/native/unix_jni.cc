@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -35,16 +36,27 @@
 #include <unistd.h>
 #include <utime.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
 // Linting disabled for this line because for google code we could use
 // absl::Mutex but we cannot yet because Bazel doesn't depend on absl.
 #include <mutex>  // NOLINT
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#include "src/main/cpp/util/filesystem_capabilities.h"
 #include "src/main/cpp/util/logging.h"
 #include "src/main/cpp/util/port.h"
+#include "src/main/native/glob.h"
 #include "src/main/native/latin1_jni_path.h"
 #include "src/main/native/macros.h"
+#include "src/main/native/worker_pool.h"
 
 #if defined(O_DIRECTORY)
 #define PORTABLE_O_DIRECTORY O_DIRECTORY
@@ -54,11 +66,6 @@
 
 namespace blaze_jni {
 
-struct DIROrError {
-  DIR *dir;
-  int error;
-};
-
 static void PostException(JNIEnv *env, const char *exception_classname,
                           const std::string &message) {
   jclass exception_class = env->FindClass(exception_classname);
@@ -236,6 +243,20 @@ static void PerformIntegerValueCallback(jobject object, const char *callback,
   }
 }
 
+namespace {
+// RAII class for jstring.
+class JStringLatin1Holder {
+  const ScopedLatin1Chars chars;
+
+ public:
+  JStringLatin1Holder(JNIEnv *env, jstring string) : chars(env, string) {}
+
+  operator const char *() const { return chars.get(); }
+
+  operator std::string() const { return chars.get(); }
+};
+}  // namespace
+
 // TODO(bazel-team): split out all the FileSystem class's native methods
 // into a separate source file, fsutils.cc.
 
@@ -243,7 +264,7 @@ extern "C" JNIEXPORT jstring JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_readlink(JNIEnv *env,
                                                      jclass clazz,
                                                      jstring path) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   char target[PATH_MAX] = "";
   jstring r = nullptr;
   if (readlink(path_chars, target, arraysize(target)) == -1) {
@@ -251,7 +272,6 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readlink(JNIEnv *env,
   } else {
     r = NewStringLatin1(env, target);
   }
-  ReleaseStringLatin1Chars(path_chars);
   return r;
 }
 
@@ -260,24 +280,21 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_chmod(JNIEnv *env,
                                                   jclass clazz,
                                                   jstring path,
                                                   jint mode) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   if (chmod(path_chars, static_cast<int>(mode)) == -1) {
     PostException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
 }
 
 static void link_common(JNIEnv *env,
                         jstring oldpath,
                         jstring newpath,
                         int (*link_function)(const char *, const char *)) {
-  const char *oldpath_chars = GetStringLatin1Chars(env, oldpath);
-  const char *newpath_chars = GetStringLatin1Chars(env, newpath);
+  JStringLatin1Holder oldpath_chars(env, oldpath);
+  JStringLatin1Holder newpath_chars(env, newpath);
   if (link_function(oldpath_chars, newpath_chars) == -1) {
     PostException(env, errno, newpath_chars);
   }
-  ReleaseStringLatin1Chars(oldpath_chars);
-  ReleaseStringLatin1Chars(newpath_chars);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -311,39 +328,46 @@ static jmethodID getConstructorID(JNIEnv *env, jclass clazz,
   return method;
 }
 
-static jobject NewUnixFileStatus(JNIEnv *env,
-                                 const portable_stat_struct &stat_ref) {
+static jobject NewUnixFileStatus(JNIEnv *env, jint mode, jlong mtime,
+                                 jlong ctime, jlong size, jlong ino) {
   static const jclass file_status_class =
       makeStaticClass(env, "com/google/devtools/build/lib/unix/UnixFileStatus");
   static const jmethodID file_status_class_ctor =
       getConstructorID(env, file_status_class, "(IJJJJ)V");
-  return env->NewObject(
-      file_status_class, file_status_class_ctor,
-      static_cast<jint>(stat_ref.st_mode),
+  return env->NewObject(file_status_class, file_status_class_ctor, mode, mtime,
+                        ctime, size, ino);
+}
+
+static jobject NewUnixFileStatus(JNIEnv *env,
+                                 const portable_stat_struct &stat_ref) {
+  return NewUnixFileStatus(
+      env, static_cast<jint>(stat_ref.st_mode),
       static_cast<jlong>(StatEpochMilliseconds(stat_ref, STAT_MTIME)),
       static_cast<jlong>(StatEpochMilliseconds(stat_ref, STAT_CTIME)),
       static_cast<jlong>(stat_ref.st_size),
       static_cast<jlong>(stat_ref.st_ino));
 }
 
-// RAII class for jstring.
-class JStringLatin1Holder {
-  const char *const chars;
-
- public:
-  JStringLatin1Holder(JNIEnv *env, jstring string)
-      : chars(GetStringLatin1Chars(env, string)) {}
-
-  ~JStringLatin1Holder() { ReleaseStringLatin1Chars(chars); }
-
-  operator const char *() const { return chars; }
-
-  operator std::string() const { return chars; }
-};
-
 }  // namespace
 
 namespace {
+// Throws the exception for a failed stat of path, if error_handling asks for
+// one.
+static void PostStatException(JNIEnv *env, int saved_errno, const char *path,
+                              char error_handling) {
+  // Throw a RuntimeException if errno suggests a programming error.
+  if (PostRuntimeException(env, saved_errno, path)) {
+    return;
+  }
+
+  // Throw an IOException if requested by the error handling mode.
+  if (error_handling == 'a' ||
+      (error_handling == 'f' && saved_errno != ENOENT &&
+       saved_errno != ENOTDIR)) {
+    PostException(env, saved_errno, path);
+  }
+}
+
 static jobject StatCommon(JNIEnv *env, jstring path,
                           int (*stat_function)(const char *,
                                                portable_stat_struct *),
@@ -353,23 +377,9 @@ static jobject StatCommon(JNIEnv *env, jstring path,
   int r;
   while ((r = stat_function(path_chars, &statbuf)) == -1 && errno == EINTR) { }
   if (r == -1) {
-    // Save errno immediately, before we do any other syscalls.
-    int saved_errno = errno;
-
-    // Throw a RuntimeException if errno suggests a programming error.
-    if (PostRuntimeException(env, saved_errno, path_chars)) {
-      return nullptr;
-    }
-
-    // Throw an IOException if requested by the error handling mode.
-    if (error_handling == 'a' ||
-        (error_handling == 'f' && saved_errno != ENOENT &&
-         saved_errno != ENOTDIR)) {
-      PostException(env, saved_errno, path_chars);
-      return nullptr;
-    }
-
-    // Otherwise, return null.
+    // Save errno immediately, before we do any other syscalls. Unless an
+    // exception is thrown, return null.
+    PostStatException(env, errno, path_chars, error_handling);
     return nullptr;
   }
 
@@ -401,6 +411,160 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_lstat(
   return StatCommon(env, path, portable_lstat, error_handling);
 }
 
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    statFields0
+ * Signature: (Ljava/lang/String;ZIZC)Lcom/google/devtools/build/lib/unix/FileStatus;
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_statFields0(
+    JNIEnv *env, jclass clazz, jstring path, jboolean follow_symlinks,
+    jint fields, jboolean dont_sync, jchar error_handling) {
+  JStringLatin1Holder path_chars(env, path);
+  portable_stat_struct statbuf;
+  int r;
+  while ((r = portable_stat_fields(path_chars, follow_symlinks, fields,
+                                   dont_sync, &statbuf)) == -1 &&
+         errno == EINTR) {
+  }
+  if (r == -1) {
+    PostStatException(env, errno, path_chars, error_handling);
+    return nullptr;
+  }
+  // The other fields are zero, even if the file system filled them in, so
+  // that callers cannot come to depend on what was not asked for.
+  return NewUnixFileStatus(
+      env,
+      (fields & STAT_FIELD_MODE) ? static_cast<jint>(statbuf.st_mode) : 0,
+      (fields & STAT_FIELD_MTIME)
+          ? static_cast<jlong>(StatEpochMilliseconds(statbuf, STAT_MTIME))
+          : 0,
+      (fields & STAT_FIELD_CTIME)
+          ? static_cast<jlong>(StatEpochMilliseconds(statbuf, STAT_CTIME))
+          : 0,
+      (fields & STAT_FIELD_SIZE) ? static_cast<jlong>(statbuf.st_size) : 0,
+      (fields & STAT_FIELD_INO) ? static_cast<jlong>(statbuf.st_ino) : 0);
+}
+
+namespace {
+// The number of longs statBatch0() stores for each path, in the order of the
+// UnixFileStatus constructor arguments.
+static const size_t kStatBatchFields = 5;
+
+// The number of consecutive paths a statBatch0() thread claims at once.
+// Consecutive paths are usually in the same directory, so keeping them on
+// one thread keeps the directory's dentries on one CPU.
+static const size_t kStatBatchChunk = 64;
+
+// Below this number of paths per thread, starting the threads costs more
+// than the syscalls they run concurrently.
+static const size_t kMinStatsPerThread = 256;
+
+static const int kMaxStatBatchThreads = 8;
+
+static void StoreStatBatchFields(const portable_stat_struct &statbuf,
+                                 jlong *out) {
+  out[0] = static_cast<jlong>(statbuf.st_mode);
+  out[1] = static_cast<jlong>(StatEpochMilliseconds(statbuf, STAT_MTIME));
+  out[2] = static_cast<jlong>(StatEpochMilliseconds(statbuf, STAT_CTIME));
+  out[3] = static_cast<jlong>(statbuf.st_size);
+  out[4] = static_cast<jlong>(statbuf.st_ino);
+}
+
+// Stats the paths in chunks claimed from next_chunk until there is none left.
+static void StatBatchWorker(const std::vector<char *> &paths,
+                            bool follow_symlinks,
+                            std::atomic<size_t> *next_chunk, jint *errnos,
+                            jlong *results) {
+  for (;;) {
+    size_t begin = next_chunk->fetch_add(1) * kStatBatchChunk;
+    if (begin >= paths.size()) {
+      return;
+    }
+    size_t end = std::min(paths.size(), begin + kStatBatchChunk);
+    for (size_t i = begin; i < end; ++i) {
+      portable_stat_struct statbuf;
+      int r;
+      while ((r = follow_symlinks ? portable_stat(paths[i], &statbuf)
+                                  : portable_lstat(paths[i], &statbuf)) ==
+                 -1 &&
+             errno == EINTR) {
+      }
+      jlong *out = results + i * kStatBatchFields;
+      if (r == -1) {
+        errnos[i] = errno;
+        std::fill(out, out + kStatBatchFields, 0);
+        continue;
+      }
+      errnos[i] = 0;
+      StoreStatBatchFields(statbuf, out);
+    }
+  }
+}
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    statBatch0
+ * Signature: ([Ljava/lang/String;ZI[I[J)V
+ * Throws:    java.lang.RuntimeException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_statBatch0(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jboolean follow_symlinks,
+    jint parallelism, jintArray errnos, jlongArray results) {
+  const jsize count = env->GetArrayLength(paths);
+  std::vector<char *> path_chars(count);
+  for (jsize i = 0; i < count; ++i) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    path_chars[i] = GetStringLatin1Chars(env, path);
+    env->DeleteLocalRef(path);
+  }
+
+  // The syscalls write into native buffers, so that the threads neither touch
+  // the JNIEnv nor pin the Java arrays while they run.
+  std::vector<jint> errno_buf(count);
+  std::vector<jlong> result_buf(count * kStatBatchFields);
+  std::vector<portable_stat_struct> stats(count);
+  std::vector<int> dirfds(count, AT_FDCWD);
+  if (portable_fstatat_many(count, dirfds.data(), path_chars.data(),
+                            follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW,
+                            stats.data(), errno_buf.data())) {
+    for (jsize i = 0; i < count; ++i) {
+      if (errno_buf[i] == 0) {
+        StoreStatBatchFields(stats[i], &result_buf[i * kStatBatchFields]);
+      }
+    }
+  } else {
+    std::atomic<size_t> next_chunk(0);
+    const size_t nthreads = std::min<size_t>(
+        std::max(1, std::min(parallelism, kMaxStatBatchThreads)),
+        count / kMinStatsPerThread);
+    WorkerPool::Get().Run(nthreads, [&](int) {
+      StatBatchWorker(path_chars, follow_symlinks, &next_chunk,
+                      errno_buf.data(), result_buf.data());
+    });
+  }
+
+  // Throw a RuntimeException if an errno suggests a programming error, like
+  // stat() does; any other failure is only reported through errnos.
+  bool thrown = false;
+  for (jsize i = 0; i < count && !thrown; ++i) {
+    thrown = errno_buf[i] != 0 &&
+             PostRuntimeException(env, errno_buf[i], path_chars[i]);
+  }
+  for (char *chars : path_chars) {
+    ReleaseStringLatin1Chars(chars);
+  }
+  if (thrown) {
+    return;
+  }
+  env->SetIntArrayRegion(errnos, 0, count, errno_buf.data());
+  env->SetLongArrayRegion(results, 0, count * kStatBatchFields,
+                          result_buf.data());
+}
+
 /*
  * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
  * Method:    utimensat
@@ -410,7 +574,7 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_lstat(
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_utimensat(
     JNIEnv *env, jclass clazz, jstring path, jboolean now, jlong millis) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   int64_t sec = millis / 1000;
   int32_t nsec = (millis % 1000) * 1000000;
   struct timespec spec[2] = {
@@ -422,7 +586,6 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_utimensat(
   if (::utimensat(AT_FDCWD, path_chars, spec, 0) == -1) {
     PostException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
 }
 
 /*
@@ -448,7 +611,7 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkdir(JNIEnv *env,
                                                   jclass clazz,
                                                   jstring path,
                                                   jint mode) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   jboolean result = true;
   if (::mkdir(path_chars, mode) == -1) {
     // EACCES ENOENT ELOOP
@@ -462,7 +625,6 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkdir(JNIEnv *env,
       PostException(env, errno, path_chars);
     }
   }
-  ReleaseStringLatin1Chars(path_chars);
   return result;
 }
 
@@ -594,19 +756,62 @@ cleanup:
 }
 
 namespace {
+static jclass DirentsClass(JNIEnv *env) {
+  static const jclass dirents_class = makeStaticClass(
+      env, "com/google/devtools/build/lib/unix/NativePosixFiles$Dirents");
+  return dirents_class;
+}
+
 static jobject NewDirents(JNIEnv *env,
                           jobjectArray names,
                           jbyteArray types) {
-  static const jclass dirents_class = makeStaticClass(
-      env, "com/google/devtools/build/lib/unix/NativePosixFiles$Dirents");
   static const jmethodID dirents_ctor =
-      getConstructorID(env, dirents_class, "([Ljava/lang/String;[B)V");
-  return env->NewObject(dirents_class, dirents_ctor, names, types);
+      getConstructorID(env, DirentsClass(env), "([Ljava/lang/String;[B)V");
+  return env->NewObject(DirentsClass(env), dirents_ctor, names, types);
+}
+
+// Returns a Dirents holding the given entries, and their types unless
+// read_types is 'n', or nullptr if an exception has been posted.
+static jobject NewDirents(JNIEnv *env, const std::vector<std::string> &entries,
+                          const std::vector<jbyte> &types, jchar read_types) {
+  static const jclass jlStringClass = makeStaticClass(env, "java/lang/String");
+  size_t len = entries.size();
+  jobjectArray names_obj = env->NewObjectArray(len, jlStringClass, nullptr);
+  if (names_obj == nullptr && env->ExceptionOccurred()) {
+    return nullptr;  // async exception!
+  }
+
+  for (size_t ii = 0; ii < len; ++ii) {
+    jstring s = NewStringLatin1(env, entries[ii].c_str());
+    if (s == nullptr && env->ExceptionOccurred()) {
+      return nullptr;  // async exception!
+    }
+    env->SetObjectArrayElement(names_obj, ii, s);
+    env->DeleteLocalRef(s);
+  }
+
+  jbyteArray types_obj = nullptr;
+  if (read_types != 'n') {
+    BAZEL_CHECK_EQ(len, types.size());
+    types_obj = env->NewByteArray(len);
+    BAZEL_CHECK_NE(types_obj, nullptr);
+    if (len > 0) {
+      env->SetByteArrayRegion(types_obj, 0, len, &types[0]);
+    }
+  }
+
+  jobject dirents = NewDirents(env, names_obj, types_obj);
+  env->DeleteLocalRef(names_obj);
+  if (types_obj != nullptr) {
+    env->DeleteLocalRef(types_obj);
+  }
+  return dirents;
 }
 
-static char GetDirentType(struct dirent *entry,
-                          int dirfd,
-                          bool follow_symlinks) {
+// Returns the type of the entry if its d_type tells it, or 0 if it takes
+// a stat of the entry, to be passed to DirentTypeFromStat().
+static char DirentTypeFromDType(const struct dirent *entry,
+                                bool follow_symlinks) {
   switch (entry->d_type) {
     case DT_REG:
       return 'f';
@@ -618,17 +823,65 @@ static char GetDirentType(struct dirent *entry,
       }
       FALLTHROUGH_INTENDED;
     case DT_UNKNOWN:
-      portable_stat_struct statbuf;
-      if (portable_fstatat(dirfd, entry->d_name, &statbuf, 0) == 0) {
-        if (S_ISREG(statbuf.st_mode)) return 'f';
-        if (S_ISDIR(statbuf.st_mode)) return 'd';
-      }
-      // stat failed or returned something weird; fall through
-      FALLTHROUGH_INTENDED;
+      return 0;
     default:
       return '?';
   }
 }
+
+// Returns the type of an entry from the outcome of the stat of the entry.
+static char DirentTypeFromStat(int stat_result,
+                               const portable_stat_struct &statbuf) {
+  if (stat_result == 0) {
+    if (S_ISREG(statbuf.st_mode)) return 'f';
+    if (S_ISDIR(statbuf.st_mode)) return 'd';
+    if (S_ISLNK(statbuf.st_mode)) return 's';  // only from an lstat
+  }
+  // stat failed or returned something weird.
+  return '?';
+}
+
+// Calls visit for each entry of an open directory, except . and ..
+// Returns 0, or the errno of the failed readdir().
+template <typename Visit>
+static int ForEachEntry(DIR *dirh, Visit visit) {
+  for (;;) {
+    // Clear errno beforehand.  Because readdir() is not required to clear it at
+    // EOF, this is the only way to reliably distinguish EOF from error.
+    errno = 0;
+    struct dirent *entry = ::readdir(dirh);
+    if (entry == nullptr) {
+      if (errno == 0) return 0;  // EOF
+      // It is unclear whether an error can also skip some records.
+      // That does not appear to happen with glibc, at least.
+      if (errno == EINTR) continue;  // interrupted by a signal
+      if (errno == EIO) continue;  // glibc returns this on transient errors
+      // Otherwise, this is a real error we should report.
+      return errno;
+    }
+    // Omit . and .. from results.
+    if (entry->d_name[0] == '.') {
+      if (entry->d_name[1] == '\0') continue;
+      if (entry->d_name[1] == '.' && entry->d_name[2] == '\0') continue;
+    }
+    visit(entry);
+  }
+}
+
+// Reads the entries of an open directory, except . and .., into entries.
+// Unless dirent_types is null, also stores the type of each entry that
+// DirentTypeFromDType() knows into it, and 0 for the others. Returns 0, or
+// the errno of the failed readdir().
+static int ReadEntries(DIR *dirh, std::vector<std::string> *entries,
+                       std::vector<jbyte> *dirent_types,
+                       bool follow_symlinks) {
+  return ForEachEntry(dirh, [&](const struct dirent *entry) {
+    entries->push_back(entry->d_name);
+    if (dirent_types != nullptr) {
+      dirent_types->push_back(DirentTypeFromDType(entry, follow_symlinks));
+    }
+  });
+}
 }  // namespace
 
 /*
@@ -642,7 +895,7 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdir(JNIEnv *env,
                                                     jclass clazz,
                                                     jstring path,
                                                     jchar read_types) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   DIR *dirh;
   while ((dirh = ::opendir(path_chars)) == nullptr && errno == EINTR) {
   }
@@ -650,39 +903,24 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdir(JNIEnv *env,
     // EACCES EMFILE ENFILE ENOENT ENOTDIR -> IOException
     // ENOMEM                              -> OutOfMemoryError
     PostException(env, errno, path_chars);
-  }
-  ReleaseStringLatin1Chars(path_chars);
-  if (dirh == nullptr) {
     return nullptr;
   }
-  int fd = dirfd(dirh);
 
   std::vector<std::string> entries;
   std::vector<jbyte> types;
-  for (;;) {
-    // Clear errno beforehand.  Because readdir() is not required to clear it at
-    // EOF, this is the only way to reliably distinguish EOF from error.
-    errno = 0;
-    struct dirent *entry = ::readdir(dirh);
-    if (entry == nullptr) {
-      if (errno == 0) break;  // EOF
-      // It is unclear whether an error can also skip some records.
-      // That does not appear to happen with glibc, at least.
-      if (errno == EINTR) continue;  // interrupted by a signal
-      if (errno == EIO) continue;  // glibc returns this on transient errors
-      // Otherwise, this is a real error we should report.
-      PostException(env, errno, path_chars);
-      ::closedir(dirh);
-      return nullptr;
-    }
-    // Omit . and .. from results.
-    if (entry->d_name[0] == '.') {
-      if (entry->d_name[1] == '\0') continue;
-      if (entry->d_name[1] == '.' && entry->d_name[2] == '\0') continue;
-    }
-    entries.push_back(entry->d_name);
-    if (read_types != 'n') {
-      types.push_back(GetDirentType(entry, fd, read_types == 'f'));
+  int error = ReadEntries(dirh, &entries, read_types != 'n' ? &types : nullptr,
+                          read_types == 'f');
+  if (error != 0) {
+    PostException(env, error, path_chars);
+    ::closedir(dirh);
+    return nullptr;
+  }
+  // Stat the entries whose d_type does not tell their type.
+  for (size_t i = 0; i < types.size(); ++i) {
+    if (types[i] == 0) {
+      portable_stat_struct statbuf;
+      int r = portable_fstatat(dirfd(dirh), &entries[i][0], &statbuf, 0);
+      types[i] = DirentTypeFromStat(r, statbuf);
     }
   }
 
@@ -691,71 +929,374 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdir(JNIEnv *env,
     return nullptr;
   }
 
-  size_t len = entries.size();
-  jclass jlStringClass = env->GetObjectClass(path);
-  jobjectArray names_obj = env->NewObjectArray(len, jlStringClass, nullptr);
-  if (names_obj == nullptr && env->ExceptionOccurred()) {
+  return NewDirents(env, entries, types, read_types);
+}
+
+namespace {
+// The number of directories readdirBatch0() keeps open at once.
+static const size_t kReaddirBatchGroup = 64;
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    readdirBatch0
+ * Signature: ([Ljava/lang/String;C[I)[Lcom/google/devtools/build/lib/unix/NativePosixFiles$Dirents;
+ */
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdirBatch0(
+    JNIEnv *env, jclass clazz, jobjectArray paths, jchar read_types,
+    jintArray errnos) {
+  const jsize count = env->GetArrayLength(paths);
+  jobjectArray result = env->NewObjectArray(count, DirentsClass(env), nullptr);
+  if (result == nullptr) {
     return nullptr;  // async exception!
   }
-
-  for (size_t ii = 0; ii < len; ++ii) {
-    jstring s = NewStringLatin1(env, entries[ii].c_str());
-    if (s == nullptr && env->ExceptionOccurred()) {
-      return nullptr;  // async exception!
+  std::vector<jint> errno_buf(count);
+  for (jsize begin = 0; begin < count; begin += kReaddirBatchGroup) {
+    const jsize end =
+        std::min<jsize>(count, begin + static_cast<jsize>(kReaddirBatchGroup));
+    std::vector<DIR *> dirs(end - begin, nullptr);
+    std::vector<std::vector<std::string>> entries(end - begin);
+    std::vector<std::vector<jbyte>> types(end - begin);
+    // The entries whose d_type does not tell their type, which are all stat-ed
+    // together once the directories of the group have been read.
+    std::vector<int> stat_dirfds;
+    std::vector<const char *> stat_names;
+    std::vector<jbyte *> stat_types;
+    for (jsize i = begin; i < end; ++i) {
+      jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+      JStringLatin1Holder path_chars(env, path);
+      env->DeleteLocalRef(path);
+      DIR *dirh;
+      while ((dirh = ::opendir(path_chars)) == nullptr && errno == EINTR) {
+      }
+      if (dirh == nullptr) {
+        errno_buf[i] = errno;
+        continue;
+      }
+      dirs[i - begin] = dirh;
+      errno_buf[i] =
+          ReadEntries(dirh, &entries[i - begin],
+                      read_types != 'n' ? &types[i - begin] : nullptr,
+                      read_types == 'f');
+    }
+    // Only take the addresses once the vectors are not growing anymore.
+    for (jsize i = begin; i < end; ++i) {
+      if (errno_buf[i] != 0) {
+        continue;
+      }
+      std::vector<jbyte> &dir_types = types[i - begin];
+      for (size_t j = 0; j < dir_types.size(); ++j) {
+        if (dir_types[j] == 0) {
+          stat_dirfds.push_back(dirfd(dirs[i - begin]));
+          stat_names.push_back(entries[i - begin][j].c_str());
+          stat_types.push_back(&dir_types[j]);
+        }
+      }
+    }
+    std::vector<portable_stat_struct> stats(stat_names.size());
+    std::vector<int> stat_errnos(stat_names.size());
+    if (!portable_fstatat_many(stat_names.size(), stat_dirfds.data(),
+                               stat_names.data(), 0, stats.data(),
+                               stat_errnos.data())) {
+      for (size_t k = 0; k < stat_names.size(); ++k) {
+        stat_errnos[k] =
+            portable_fstatat(stat_dirfds[k], const_cast<char *>(stat_names[k]),
+                             &stats[k], 0) == 0
+                ? 0
+                : errno;
+      }
+    }
+    for (size_t k = 0; k < stat_names.size(); ++k) {
+      *stat_types[k] = DirentTypeFromStat(stat_errnos[k], stats[k]);
+    }
+    bool failed = false;
+    for (jsize i = begin; i < end; ++i) {
+      if (dirs[i - begin] != nullptr) {
+        ::closedir(dirs[i - begin]);
+      }
+      if (errno_buf[i] != 0 || failed) {
+        continue;
+      }
+      jobject dirents =
+          NewDirents(env, entries[i - begin], types[i - begin], read_types);
+      if (dirents == nullptr) {
+        failed = true;  // async exception!
+        continue;
+      }
+      env->SetObjectArrayElement(result, i, dirents);
+      env->DeleteLocalRef(dirents);
+    }
+    if (failed) {
+      return nullptr;
     }
-    env->SetObjectArrayElement(names_obj, ii, s);
   }
+  env->SetIntArrayRegion(errnos, 0, count, errno_buf.data());
+  return result;
+}
 
+namespace {
+static jobject NewPackedDirents(JNIEnv *env, const std::string &names,
+                                const std::vector<jint> &offsets,
+                                const std::vector<jbyte> &types,
+                                const std::vector<jlong> &stats,
+                                const std::vector<jint> &stat_errnos,
+                                jchar read_types, bool stat_entries) {
+  static const jclass packed_dirents_class = makeStaticClass(
+      env, "com/google/devtools/build/lib/unix/NativePosixFiles$PackedDirents");
+  static const jmethodID packed_dirents_ctor = getConstructorID(
+      env, packed_dirents_class, "([B[I[B[J[I)V");
+  jbyteArray names_obj = env->NewByteArray(names.size());
+  if (names_obj == nullptr) {
+    return nullptr;  // async exception!
+  }
+  env->SetByteArrayRegion(names_obj, 0, names.size(),
+                          reinterpret_cast<const jbyte *>(names.data()));
+  jintArray offsets_obj = env->NewIntArray(offsets.size());
+  if (offsets_obj == nullptr) {
+    return nullptr;  // async exception!
+  }
+  env->SetIntArrayRegion(offsets_obj, 0, offsets.size(), offsets.data());
   jbyteArray types_obj = nullptr;
   if (read_types != 'n') {
-    BAZEL_CHECK_EQ(len, types.size());
-    types_obj = env->NewByteArray(len);
-    BAZEL_CHECK_NE(types_obj, nullptr);
-    if (len > 0) {
-      env->SetByteArrayRegion(types_obj, 0, len, &types[0]);
+    types_obj = env->NewByteArray(types.size());
+    if (types_obj == nullptr) {
+      return nullptr;  // async exception!
     }
+    env->SetByteArrayRegion(types_obj, 0, types.size(), types.data());
+  }
+  jlongArray stats_obj = nullptr;
+  jintArray stat_errnos_obj = nullptr;
+  if (stat_entries) {
+    stats_obj = env->NewLongArray(stats.size());
+    stat_errnos_obj = env->NewIntArray(stat_errnos.size());
+    if (stats_obj == nullptr || stat_errnos_obj == nullptr) {
+      return nullptr;  // async exception!
+    }
+    env->SetLongArrayRegion(stats_obj, 0, stats.size(), stats.data());
+    env->SetIntArrayRegion(stat_errnos_obj, 0, stat_errnos.size(),
+                           stat_errnos.data());
   }
-
-  return NewDirents(env, names_obj, types_obj);
+  return env->NewObject(packed_dirents_class, packed_dirents_ctor, names_obj,
+                        offsets_obj, types_obj, stats_obj, stat_errnos_obj);
 }
+}  // namespace
 
 /*
  * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
- * Method:    rename
- * Signature: (Ljava/lang/String;Ljava/lang/String;)V
+ * Method:    readdirPacked0
+ * Signature: (Ljava/lang/String;CZ)Lcom/google/devtools/build/lib/unix/NativePosixFiles$PackedDirents;
  * Throws:    java.io.IOException
  */
-extern "C" JNIEXPORT void JNICALL
-Java_com_google_devtools_build_lib_unix_NativePosixFiles_rename(JNIEnv *env,
-                                                   jclass clazz,
-                                                   jstring oldpath,
-                                                   jstring newpath) {
-  const char *oldpath_chars = GetStringLatin1Chars(env, oldpath);
-  const char *newpath_chars = GetStringLatin1Chars(env, newpath);
-  if (::rename(oldpath_chars, newpath_chars) == -1) {
-    // EISDIR EXDEV ENOTEMPTY EEXIST EBUSY
-    // EINVAL EMLINK ENOTDIR EACCES EPERM
-    // ENOENT EROFS ELOOP ENOSPC           -> IOException
-    // EFAULT ENAMETOOLONG                 -> RuntimeException
-    // ENOMEM                              -> OutOfMemoryError
-    std::string filename(std::string(oldpath_chars) + " -> " + newpath_chars);
-    PostException(env, errno, filename);
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_readdirPacked0(
+    JNIEnv *env, jclass clazz, jstring path, jchar read_types,
+    jboolean stat_entries) {
+  JStringLatin1Holder path_chars(env, path);
+  DIR *dirh;
+  while ((dirh = ::opendir(path_chars)) == nullptr && errno == EINTR) {
   }
-  ReleaseStringLatin1Chars(oldpath_chars);
-  ReleaseStringLatin1Chars(newpath_chars);
-}
+  if (dirh == nullptr) {
+    PostException(env, errno, path_chars);
+    return nullptr;
+  }
+  int fd = dirfd(dirh);
 
-/*
- * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
- * Method:    remove
- * Signature: (Ljava/lang/String;)V
+  // Each name is followed by a NUL, so that it can be passed to fstatat()
+  // right from the buffer.
+  std::string names;
+  std::vector<jint> offsets = {0};
+  std::vector<jbyte> types;
+  const bool follow_symlinks = read_types == 'f';
+  int error = ForEachEntry(dirh, [&](const struct dirent *entry) {
+    names.append(entry->d_name, strlen(entry->d_name) + 1);
+    offsets.push_back(names.size());
+    if (read_types != 'n') {
+      types.push_back(DirentTypeFromDType(entry, follow_symlinks));
+    }
+  });
+  if (error != 0) {
+    PostException(env, error, path_chars);
+    ::closedir(dirh);
+    return nullptr;
+  }
+  const size_t count = offsets.size() - 1;
+
+  std::vector<jlong> stats;
+  std::vector<jint> stat_errnos;
+  if (stat_entries) {
+    std::vector<const char *> entry_names(count);
+    for (size_t i = 0; i < count; ++i) {
+      entry_names[i] = names.data() + offsets[i];
+    }
+    std::vector<int> dirfds(count, fd);
+    std::vector<portable_stat_struct> statbufs(count);
+    stat_errnos.resize(count);
+    // portable_fstatat() does not take flags on every platform, so the
+    // fallback lstat()s the full path of each entry instead.
+    const int flags = follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+    if (!portable_fstatat_many(count, dirfds.data(), entry_names.data(), flags,
+                               statbufs.data(), stat_errnos.data())) {
+      std::string dir_path = path_chars;
+      dir_path += '/';
+      for (size_t i = 0; i < count; ++i) {
+        int r;
+        if (follow_symlinks) {
+          r = portable_fstatat(fd, const_cast<char *>(entry_names[i]),
+                               &statbufs[i], 0);
+        } else {
+          std::string entry_path = dir_path + entry_names[i];
+          r = portable_lstat(entry_path.c_str(), &statbufs[i]);
+        }
+        stat_errnos[i] = r == 0 ? 0 : errno;
+      }
+    }
+    stats.resize(count * kStatBatchFields);
+    for (size_t i = 0; i < count; ++i) {
+      if (stat_errnos[i] == 0) {
+        StoreStatBatchFields(statbufs[i], &stats[i * kStatBatchFields]);
+        if (!types.empty() && types[i] == 0) {
+          types[i] = DirentTypeFromStat(0, statbufs[i]);
+        }
+      }
+    }
+  }
+  // Stat the entries whose d_type does not tell their type, unless done above.
+  for (size_t i = 0; i < types.size(); ++i) {
+    if (types[i] == 0) {
+      portable_stat_struct statbuf;
+      int r = portable_fstatat(fd, &names[offsets[i]], &statbuf, 0);
+      types[i] = DirentTypeFromStat(r, statbuf);
+    }
+  }
+
+  if (::closedir(dirh) < 0 && errno != EINTR) {
+    PostException(env, errno, path_chars);
+    return nullptr;
+  }
+
+  return NewPackedDirents(env, names, offsets, types, stats, stat_errnos,
+                          read_types, stat_entries);
+}
+
+namespace {
+// Returns the Latin1 strings of a String[].
+static std::vector<std::string> GetStringsLatin1(JNIEnv *env,
+                                                 jobjectArray array) {
+  const jsize count = env->GetArrayLength(array);
+  std::vector<std::string> strings;
+  strings.reserve(count);
+  for (jsize i = 0; i < count; ++i) {
+    jstring str = static_cast<jstring>(env->GetObjectArrayElement(array, i));
+    JStringLatin1Holder chars(env, str);
+    strings.emplace_back(static_cast<std::string>(chars));
+    env->DeleteLocalRef(str);
+  }
+  return strings;
+}
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    glob0
+ * Signature: (Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;I)Lcom/google/devtools/build/lib/unix/NativePosixFiles$PackedGlob;
+ */
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_glob0(
+    JNIEnv *env, jclass clazz, jstring base, jobjectArray pattern,
+    jobjectArray build_files, jobjectArray pruned, jint parallelism) {
+  std::vector<GlobSegment> segments;
+  for (std::string &segment : GetStringsLatin1(env, pattern)) {
+    segments.emplace_back(std::move(segment));
+  }
+  std::vector<std::string> pruned_dirs = GetStringsLatin1(env, pruned);
+  int base_fd;
+  {
+    JStringLatin1Holder base_chars(env, base);
+    while ((base_fd = open(base_chars, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) ==
+               -1 &&
+           errno == EINTR) {
+    }
+  }
+  if (base_fd == -1) {
+    return nullptr;
+  }
+  GlobResult result;
+  bool ok;
+  {
+    Glob glob(base_fd, std::move(segments), GetStringsLatin1(env, build_files),
+              std::unordered_set<std::string>(pruned_dirs.begin(),
+                                              pruned_dirs.end()));
+    ok = glob.Run(parallelism, &result);
+  }
+  close(base_fd);
+  if (!ok) {
+    return nullptr;
+  }
+
+  static const jclass packed_glob_class = makeStaticClass(
+      env, "com/google/devtools/build/lib/unix/NativePosixFiles$PackedGlob");
+  static const jmethodID packed_glob_ctor =
+      getConstructorID(env, packed_glob_class, "([B[I[B)V");
+  // Each path is followed by a NUL, as in PackedDirents.
+  std::string paths;
+  std::vector<jint> offsets = {0};
+  for (const std::string &path : result.paths) {
+    paths.append(path.c_str(), path.size() + 1);
+    offsets.push_back(paths.size());
+  }
+  jbyteArray paths_obj = env->NewByteArray(paths.size());
+  jintArray offsets_obj = env->NewIntArray(offsets.size());
+  jbyteArray kinds_obj = env->NewByteArray(result.kinds.size());
+  if (paths_obj == nullptr || offsets_obj == nullptr || kinds_obj == nullptr) {
+    return nullptr;  // async exception!
+  }
+  env->SetByteArrayRegion(paths_obj, 0, paths.size(),
+                          reinterpret_cast<const jbyte *>(paths.data()));
+  env->SetIntArrayRegion(offsets_obj, 0, offsets.size(), offsets.data());
+  env->SetByteArrayRegion(
+      kinds_obj, 0, result.kinds.size(),
+      reinterpret_cast<const jbyte *>(result.kinds.data()));
+  return env->NewObject(packed_glob_class, packed_glob_ctor, paths_obj,
+                        offsets_obj, kinds_obj);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    rename
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_rename(JNIEnv *env,
+                                                   jclass clazz,
+                                                   jstring oldpath,
+                                                   jstring newpath) {
+  JStringLatin1Holder oldpath_chars(env, oldpath);
+  JStringLatin1Holder newpath_chars(env, newpath);
+  if (::rename(oldpath_chars, newpath_chars) == -1) {
+    // EISDIR EXDEV ENOTEMPTY EEXIST EBUSY
+    // EINVAL EMLINK ENOTDIR EACCES EPERM
+    // ENOENT EROFS ELOOP ENOSPC           -> IOException
+    // EFAULT ENAMETOOLONG                 -> RuntimeException
+    // ENOMEM                              -> OutOfMemoryError
+    std::string filename(std::string(oldpath_chars) + " -> " +
+                         std::string(newpath_chars));
+    PostException(env, errno, filename);
+  }
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    remove
+ * Signature: (Ljava/lang/String;)V
  * Throws:    java.io.IOException
  */
 extern "C" JNIEXPORT bool JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_remove(JNIEnv *env,
                                                    jclass clazz,
                                                    jstring path) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   if (path_chars == nullptr) {
     return false;
   }
@@ -765,7 +1306,6 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_remove(JNIEnv *env,
       PostException(env, errno, path_chars);
     }
   }
-  ReleaseStringLatin1Chars(path_chars);
   return ok;
 }
 
@@ -780,14 +1320,22 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_mkfifo(JNIEnv *env,
                                                    jclass clazz,
                                                    jstring path,
                                                    jint mode) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   if (mkfifo(path_chars, mode) == -1) {
     PostException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
 }
 
 namespace {
+// A system call that failed in one of the DeleteTreesBelow helper functions.
+struct DeleteFailure {
+  int error;
+  const char *function;
+  // Whether the call was on the entry passed to the helper, rather than on
+  // the directory containing it.
+  bool on_entry;
+};
+
 // Posts an exception generated by the DeleteTreesBelow algorithm and its helper
 // functions.
 //
@@ -795,12 +1343,12 @@ namespace {
 // path that caused an error only when necessary, as we keep that path tokenized
 // throughout the deletion process.
 //
-// env is the JNI environment in which to post the exception. error and function
-// capture the errno value and the name of the system function that triggered
-// it. The faulty path is specified by all the components of dir_path and the
-// optional entry subcomponent, which may be NULL.
+// env is the JNI environment in which to post the exception. failure captures
+// the errno value and the name of the system function that triggered it. The
+// faulty path is specified by all the components of dir_path and, if the
+// failure is on it, the entry subcomponent.
 static void PostDeleteTreesBelowException(
-    JNIEnv* env, int error, const char* function,
+    JNIEnv* env, const DeleteFailure& failure,
     const std::vector<std::string>& dir_path, const char* entry) {
   std::vector<std::string>::const_iterator iter = dir_path.begin();
   std::string path;
@@ -810,7 +1358,7 @@ static void PostDeleteTreesBelowException(
       path += "/";
       path += *iter;
     }
-    if (entry != nullptr) {
+    if (failure.on_entry) {
       path += "/";
       path += entry;
     }
@@ -820,7 +1368,8 @@ static void PostDeleteTreesBelowException(
     path = entry;
   }
   BAZEL_CHECK(!env->ExceptionOccurred());
-  PostException(env, errno, std::string(function) + " (" + path + ")");
+  PostException(env, failure.error,
+                std::string(failure.function) + " (" + path + ")");
 }
 
 // Tries to open a directory and, if the first attempt fails, retries after
@@ -828,19 +1377,17 @@ static void PostDeleteTreesBelowException(
 //
 // The directory to open is identified by the open descriptor of the parent
 // directory (dir_fd) and the subpath to resolve within that directory (entry).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
 //
-// Returns a directory handle on success or an errno on error. If the error is
-// other than ENOENT, posts an exception before returning.
-static DIROrError ForceOpendir(JNIEnv *env,
-                               const std::vector<std::string> &dir_path,
-                               const int dir_fd, const char *entry) {
+// Returns a directory handle on success. Returns nullptr on error and fills
+// in failure; its error is ENOENT if the directory does not exist.
+static DIR *ForceOpendir(const int dir_fd, const char *entry,
+                         DeleteFailure *failure) {
   static const int flags = O_RDONLY | O_NOFOLLOW | PORTABLE_O_DIRECTORY;
   int fd = openat(dir_fd, entry, flags);
   if (fd == -1) {
     if (errno == ENOENT) {
-      return {nullptr, errno};
+      *failure = {errno, "opendir", true};
+      return nullptr;
     }
     // If dir_fd is a readable but non-executable directory containing entry, we
     // could have obtained entry by readdir()-ing, but any attempt to open or
@@ -850,236 +1397,1057 @@ static DIROrError ForceOpendir(JNIEnv *env,
     // recursion).
     if (errno == EACCES && dir_fd != AT_FDCWD) {
       if (fchmod(dir_fd, 0700) == -1) {
-        if (errno != ENOENT) {
-          PostDeleteTreesBelowException(env, errno, "fchmod", dir_path,
-                                        nullptr);
+        *failure = {errno, "fchmod", false};
+        return nullptr;
+      }
+    }
+    if (fchmodat(dir_fd, entry, 0700, 0) == -1) {
+      *failure = {errno, "fchmodat", true};
+      return nullptr;
+    }
+    fd = openat(dir_fd, entry, flags);
+    if (fd == -1) {
+      *failure = {errno, "opendir", true};
+      return nullptr;
+    }
+  }
+  DIR* dir = fdopendir(fd);
+  if (dir == nullptr) {
+    *failure = {errno, "fdopendir", true};
+    close(fd);
+    return nullptr;
+  }
+  return dir;
+}
+
+// Tries to delete a file within a directory and, if the first attempt fails,
+// retries after granting extra write permissions to the directory.
+//
+// The file to delete is identified by the open descriptor of the parent
+// directory (dir_fd) and the subpath to resolve within that directory (entry).
+//
+// is_dir indicates whether the entry to delete is a directory or not.
+//
+// Returns 0 when the file doesn't exist or is successfully deleted. Otherwise,
+// returns -1 and fills in failure.
+static int ForceDelete(const int dir_fd, const char* entry, const bool is_dir,
+                       DeleteFailure* failure) {
+  const int flags = is_dir ? AT_REMOVEDIR : 0;
+  if (unlinkat(dir_fd, entry, flags) == -1) {
+    if (errno == ENOENT) {
+      return 0;
+    }
+    if (fchmod(dir_fd, 0700) == -1) {
+      if (errno == ENOENT) {
+        return 0;
+      }
+      *failure = {errno, "fchmod", false};
+      return -1;
+    }
+    if (unlinkat(dir_fd, entry, flags) == -1) {
+      if (errno == ENOENT) {
+        return 0;
+      }
+      *failure = {errno, "unlinkat", true};
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Returns true if the given directory entry represents a subdirectory of dir.
+//
+// The file to check is identified by the open descriptor of the parent
+// directory (dir_fd) and the directory entry within that directory (de).
+//
+// This function prefers to extract the type information from the directory
+// entry itself if available. If not available, issues a stat starting from
+// dir_fd.
+//
+// Returns 0 on success and updates is_dir accordingly. Returns -1 on error and
+// fills in failure.
+static int IsSubdir(const int dir_fd, const struct dirent* de, bool* is_dir,
+                    DeleteFailure* failure) {
+  switch (de->d_type) {
+    case DT_DIR:
+      *is_dir = true;
+      return 0;
+
+    case DT_UNKNOWN: {
+      struct stat st;
+      if (fstatat(dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+        if (errno == ENOENT) {
+          *is_dir = false;
+          return 0;
         }
-        return {nullptr, errno};
+        *failure = {errno, "fstatat", true};
+        return -1;
+      }
+      *is_dir = st.st_mode & S_IFDIR;
+      return 0;
+    }
+
+    default:
+      *is_dir = false;
+      return 0;
+  }
+}
+
+// Reads the names of the entries of an open directory, split into files and
+// subdirectories.
+//
+// On macOS and some other non-Linux OSes, on some filesystems, readdir(dir)
+// may return NULL after an entry in dir is deleted even if not all files have
+// been read yet - see
+// https://pubs.opengroup.org/onlinepubs/9699919799/functions/readdir.html;
+// "If a file is removed from or added to the directory after the most recent
+// call to opendir() or rewinddir(), whether a subsequent call to readdir()
+// returns an entry for that file is unspecified." We thus read all the names
+// of dir's entries before deleting. We don't want to simply use fts(3)
+// because we want to be able to chmod at any point in the directory hierarchy
+// to retry a filesystem operation after hitting an EACCES.
+// If in the future we hit any problems here due to the unspecified behavior
+// of readdir() when a file has been deleted by a different thread we can use
+// some form of locking to make sure the threads don't try to clean up the
+// same directory at the same time; or doing it in a loop until the directory
+// is really empty.
+//
+// Returns 0 on success. Returns -1 on error and fills in failure, with
+// failure_entry pointing to the entry it is on, if any.
+static int ReadDirForDeletion(DIR *dir, std::vector<std::string> *files,
+                              std::vector<std::string> *subdirs,
+                              DeleteFailure *failure,
+                              std::string *failure_entry) {
+  for (;;) {
+    errno = 0;
+    struct dirent* de = readdir(dir);
+    if (de == nullptr) {
+      if (errno != 0 && errno != ENOENT) {
+        *failure = {errno, "readdir", false};
+        return -1;
+      }
+      return 0;
+    }
+
+    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+      continue;
+    }
+
+    bool is_dir;
+    if (IsSubdir(dirfd(dir), de, &is_dir, failure) == -1) {
+      *failure_entry = de->d_name;
+      return -1;
+    }
+    if (is_dir) {
+      subdirs->push_back(de->d_name);
+    } else {
+      files->push_back(de->d_name);
+    }
+  }
+}
+
+// Recursively deletes all trees under the given path.
+//
+// The directory to delete is identified by the open descriptor of the parent
+// directory (dir_fd) and the subpath to resolve within that directory (entry).
+// dir_path contains the path components that were used when opening dir_fd and
+// is only used for error reporting purposes.
+//
+// dir_path is an in/out parameter updated with the path to the directory being
+// processed. This avoids the need to construct unnecessary intermediate paths,
+// as this algorithm works purely on file descriptors: the paths are only used
+// for error reporting purposes, and therefore are only formatted at that
+// point.
+//
+// Returns 0 on success. Returns -1 on error and posts an exception.
+static int DeleteTreesBelow(JNIEnv* env, std::vector<std::string>* dir_path,
+                            const int dir_fd, const char* entry) {
+  DeleteFailure failure;
+  DIR *dir = ForceOpendir(dir_fd, entry, &failure);
+  if (dir == nullptr) {
+    if (failure.error == ENOENT) {
+      return 0;
+    }
+    PostDeleteTreesBelowException(env, failure, *dir_path, entry);
+    return -1;
+  }
+
+  dir_path->push_back(entry);
+  std::vector<std::string> dir_files, dir_subdirs;
+  std::string failure_entry;
+  if (ReadDirForDeletion(dir, &dir_files, &dir_subdirs, &failure,
+                         &failure_entry) == -1) {
+    PostDeleteTreesBelowException(env, failure, *dir_path,
+                                  failure_entry.c_str());
+  }
+  if (env->ExceptionOccurred() == nullptr) {
+    for (const auto &file : dir_files) {
+      if (ForceDelete(dirfd(dir), file.c_str(), false, &failure) == -1) {
+        PostDeleteTreesBelowException(env, failure, *dir_path, file.c_str());
+        break;
+      }
+    }
+    // DeleteTreesBelow is recursive; don't hold on to file names unnecessarily.
+    dir_files.clear();
+  }
+  if (env->ExceptionOccurred() == nullptr) {
+    for (const auto &subdir : dir_subdirs) {
+      if (DeleteTreesBelow(env, dir_path, dirfd(dir), subdir.c_str()) == -1) {
+        BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
+        break;
+      }
+      if (ForceDelete(dirfd(dir), subdir.c_str(), true, &failure) == -1) {
+        PostDeleteTreesBelowException(env, failure, *dir_path, subdir.c_str());
+        break;
+      }
+    }
+  }
+  if (closedir(dir) == -1) {
+    // Prefer reporting the error encountered while processing entries,
+    // not the (unlikely) error on close.
+    if (env->ExceptionOccurred() == nullptr) {
+      PostDeleteTreesBelowException(env, {errno, "closedir", false}, *dir_path,
+                                    nullptr);
+    }
+  }
+  dir_path->pop_back();
+  return env->ExceptionOccurred() == nullptr ? 0 : -1;
+}
+
+// Deletes all trees under a directory like DeleteTreesBelow, on several
+// threads of the WorkerPool.
+//
+// Each directory is a node, which stays open while its subdirectories are
+// deleted, so that they are all opened and deleted relative to it and no path
+// is ever formatted except to report an error. The subdirectories are queued
+// as nodes of their own. Each thread has its own queue, from which it takes
+// the most recent node, which keeps the number of open directories down to
+// about the depth of the tree per thread; when its queue is empty, it steals
+// the oldest node of another queue, which is likely the root of a large
+// subtree. The last subdirectory of a node to be deleted completes its node,
+// which deletes the directory itself.
+//
+// The calling thread starts alone, and only asks the pool for help when the
+// tree turns out not to be small, so that deleting small trees leaves the
+// pool alone.
+class ParallelTreeDeleter {
+ public:
+  explicit ParallelTreeDeleter(int nthreads)
+      : queues_(nthreads), outstanding_(0), aborted_(false) {}
+
+  ParallelTreeDeleter(const ParallelTreeDeleter &) = delete;
+  ParallelTreeDeleter &operator=(const ParallelTreeDeleter &) = delete;
+
+  // Deletes the trees below path. Returns 0 on success. Returns -1 on error
+  // and posts an exception.
+  int DeleteTreesBelow(JNIEnv *env, const char *path) {
+    Push(0, NewNode(nullptr, path));
+    WorkerLoop(0);
+    helpers_.reset();
+    // Only directories on the path to the first failure can still be open.
+    for (DeleteNode &node : nodes_) {
+      if (node.dir != nullptr) {
+        closedir(node.dir);
+      }
+    }
+    if (aborted_) {
+      std::vector<std::string> no_dir_path;
+      PostDeleteTreesBelowException(env, failure_, no_dir_path,
+                                    failure_path_.c_str());
+      return -1;
+    }
+    return 0;
+  }
+
+ private:
+  // The number of directories the calling thread deletes alone before it
+  // asks the pool for help.
+  static const int kDirsBeforeThreads = 128;
+
+  struct DeleteNode {
+    DeleteNode *parent;
+    // The name of the directory in its parent, or its full path.
+    std::string name;
+    // The open directory, while its subdirectories are being deleted.
+    DIR *dir = nullptr;
+    // The number of subdirectories left to delete.
+    std::atomic<size_t> pending{0};
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<DeleteNode *> nodes;
+  };
+
+  DeleteNode *NewNode(DeleteNode *parent, const std::string &name) {
+    std::lock_guard<std::mutex> lock(nodes_mutex_);
+    nodes_.emplace_back();
+    nodes_.back().parent = parent;
+    nodes_.back().name = name;
+    return &nodes_.back();
+  }
+
+  void Push(int worker, DeleteNode *node) {
+    outstanding_.fetch_add(1);
+    {
+      std::lock_guard<std::mutex> lock(queues_[worker].mutex);
+      queues_[worker].nodes.push_back(node);
+    }
+    idle_.notify_one();
+  }
+
+  // Returns the most recent node of the worker's own queue, or else the
+  // oldest one of another queue, or nullptr if all are empty.
+  DeleteNode *Take(int worker) {
+    {
+      Queue &own = queues_[worker];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.nodes.empty()) {
+        DeleteNode *node = own.nodes.back();
+        own.nodes.pop_back();
+        return node;
+      }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+      Queue &victim = queues_[(worker + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.nodes.empty()) {
+        DeleteNode *node = victim.nodes.front();
+        victim.nodes.pop_front();
+        return node;
+      }
+    }
+    return nullptr;
+  }
+
+  void WorkerLoop(int worker) {
+    int processed = 0;
+    while (!aborted_ && outstanding_.load() != 0) {
+      DeleteNode *node = Take(worker);
+      if (node == nullptr) {
+        // Wait for a node to be pushed, or for the last one to be done.
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_.wait_for(lock, std::chrono::milliseconds(1));
+        continue;
+      }
+      Process(worker, node);
+      if (outstanding_.fetch_sub(1) == 1) {
+        idle_.notify_all();
+      }
+      if (worker == 0 && helpers_ == nullptr &&
+          ++processed == kDirsBeforeThreads) {
+        helpers_ = std::make_unique<WorkerPool::Helpers>(
+            &WorkerPool::Get(), 1, queues_.size(),
+            [this](int worker) { WorkerLoop(worker); });
+      }
+    }
+  }
+
+  static int ParentFd(const DeleteNode *node) {
+    return node->parent == nullptr ? AT_FDCWD : dirfd(node->parent->dir);
+  }
+
+  void Process(int worker, DeleteNode *node) {
+    DeleteFailure failure;
+    node->dir = ForceOpendir(ParentFd(node), node->name.c_str(), &failure);
+    if (node->dir == nullptr) {
+      if (failure.error == ENOENT) {
+        Complete(node);
+      } else {
+        Fail(failure, node->parent, node->name);
+      }
+      return;
+    }
+    std::vector<std::string> files, subdirs;
+    std::string failure_entry;
+    if (ReadDirForDeletion(node->dir, &files, &subdirs, &failure,
+                           &failure_entry) == -1) {
+      Fail(failure, node, failure_entry);
+      return;
+    }
+    for (const auto &file : files) {
+      if (ForceDelete(dirfd(node->dir), file.c_str(), false, &failure) == -1) {
+        Fail(failure, node, file);
+        return;
+      }
+    }
+    if (subdirs.empty()) {
+      Complete(node);
+      return;
+    }
+    // Count all the subdirectories before any of them can complete.
+    node->pending = subdirs.size();
+    for (const auto &subdir : subdirs) {
+      Push(worker, NewNode(node, subdir));
+    }
+  }
+
+  // Closes a directory whose subdirectories are all deleted and deletes it,
+  // then completes its parent if it was the last subdirectory left.
+  void Complete(DeleteNode *node) {
+    for (;;) {
+      if (node->dir != nullptr) {
+        DIR *dir = node->dir;
+        node->dir = nullptr;
+        if (closedir(dir) == -1) {
+          Fail({errno, "closedir", false}, node, "");
+          return;
+        }
+      }
+      DeleteNode *parent = node->parent;
+      if (parent == nullptr) {
+        return;  // The top directory is not deleted.
+      }
+      DeleteFailure failure;
+      if (ForceDelete(dirfd(parent->dir), node->name.c_str(), true,
+                      &failure) == -1) {
+        Fail(failure, parent, node->name);
+        return;
+      }
+      if (parent->pending.fetch_sub(1) != 1) {
+        return;
+      }
+      node = parent;
+    }
+  }
+
+  // Records the first failure, with the path of the directory it is in and
+  // of the entry it is on, and stops all the threads.
+  void Fail(const DeleteFailure &failure, const DeleteNode *dir,
+            const std::string &entry) {
+    std::lock_guard<std::mutex> lock(failure_mutex_);
+    if (aborted_) {
+      return;
+    }
+    std::vector<const std::string *> names;
+    for (const DeleteNode *node = dir; node != nullptr; node = node->parent) {
+      names.push_back(&node->name);
+    }
+    std::string path;
+    for (auto it = names.rbegin(); it != names.rend(); ++it) {
+      if (!path.empty()) {
+        path += '/';
+      }
+      path += **it;
+    }
+    if (failure.on_entry) {
+      if (!path.empty()) {
+        path += '/';
+      }
+      path += entry;
+    }
+    failure_ = failure;
+    failure_path_ = path;
+    aborted_ = true;
+    idle_.notify_all();
+  }
+
+  std::vector<Queue> queues_;
+  // The calls of WorkerLoop on the threads of the WorkerPool, once started.
+  std::unique_ptr<WorkerPool::Helpers> helpers_;
+  std::mutex nodes_mutex_;
+  std::deque<DeleteNode> nodes_;
+  // The number of nodes queued or being processed.
+  std::atomic<size_t> outstanding_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_;
+  std::atomic<bool> aborted_;
+  std::mutex failure_mutex_;
+  DeleteFailure failure_;
+  std::string failure_path_;
+};
+}  // namespace
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    deleteTreesBelow
+ * Signature: (Ljava/lang/String;I)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_deleteTreesBelow(
+    JNIEnv *env, jclass clazz, jstring path, jint parallelism) {
+  JStringLatin1Holder path_chars(env, path);
+  if (parallelism > 1) {
+    ParallelTreeDeleter deleter(parallelism);
+    if (deleter.DeleteTreesBelow(env, path_chars) == -1) {
+      BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
+    }
+  } else {
+    std::vector<std::string> dir_path;
+    if (DeleteTreesBelow(env, &dir_path, AT_FDCWD, path_chars) == -1) {
+      BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
+    }
+    BAZEL_CHECK(dir_path.empty());
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// File copies
+
+namespace {
+// The buffer of CopyFile() when the kernel cannot copy the file by itself.
+static const size_t kCopyFileBufferSize = 256 * 1024;
+
+// The number of files a copyFiles0() thread copies before it claims more.
+static const size_t kCopyFilesChunk = 16;
+
+static const int kMaxCopyFilesThreads = 16;
+
+// Returns whether the errno of portable_clone_file() or
+// portable_copy_file_range() only tells that the file system cannot do it.
+static bool IsUnsupportedCopy(int error_number) {
+  return error_number == ENOTSUP || error_number == EOPNOTSUPP ||
+         error_number == EXDEV || error_number == EINVAL ||
+         error_number == ENOTTY || error_number == ENOSYS;
+}
+
+// Copies the contents of from_fd to to_fd, in the kernel if the file system
+// of from_fd, as described by capabilities, can.
+static int CopyFileContents(
+    int from_fd, int to_fd,
+    const blaze_util::FilesystemCapabilities &capabilities) {
+  bool in_kernel = capabilities.Has(blaze_util::kFsCopyFileRange);
+  std::vector<char> buf;
+  for (;;) {
+    ssize_t copied;
+    if (in_kernel) {
+      copied = portable_copy_file_range(from_fd, to_fd, 1 << 30);
+      if (copied == -1 && IsUnsupportedCopy(errno)) {
+        if (errno != EXDEV) {
+          capabilities.SetUnsupported(blaze_util::kFsCopyFileRange);
+        }
+        // The offsets are where the kernel stopped, so go on from there.
+        in_kernel = false;
+        continue;
+      }
+    } else {
+      if (buf.empty()) {
+        buf.resize(kCopyFileBufferSize);
+      }
+      copied = read(from_fd, buf.data(), buf.size());
+      for (ssize_t written = 0, w; copied > 0 && written < copied;
+           written += w) {
+        while ((w = write(to_fd, buf.data() + written, copied - written)) ==
+                   -1 &&
+               errno == EINTR) {
+        }
+        if (w == -1) {
+          return -1;
+        }
+      }
+    }
+    if (copied == 0) {
+      return 0;
+    }
+    if (copied == -1 && errno != EINTR) {
+      return -1;
+    }
+  }
+}
+
+// Copies the regular file from to to, replacing to if it exists and keeping
+// the permissions and the modification time of from. The copy is a
+// copy-on-write clone if the file system supports it. Returns 0 on success,
+// or -1 and sets errno and *failed_path to the path the error is about.
+static int CopyFile(const char *from, const char *to,
+                    const char **failed_path) {
+  *failed_path = from;
+  int from_fd;
+  while ((from_fd = open(from, O_RDONLY | O_CLOEXEC)) == -1 &&
+         errno == EINTR) {
+  }
+  if (from_fd == -1) {
+    return -1;
+  }
+  portable_stat_struct statbuf;
+  int r = portable_fstat(from_fd, &statbuf);
+  if (r == 0 && !S_ISREG(statbuf.st_mode)) {
+    // clonefile(2) would clone a whole directory.
+    errno = S_ISDIR(statbuf.st_mode) ? EISDIR : EINVAL;
+    r = -1;
+  }
+  if (r == 0) {
+    *failed_path = to;
+    r = unlink(to) == -1 && errno != ENOENT ? -1 : 0;
+  }
+  if (r == 0) {
+    // Cloning and copying in the kernel only work within a file system, so
+    // the capabilities of that of the source tell whether to try.
+    const blaze_util::FilesystemCapabilities &capabilities =
+        blaze_util::GetFilesystemCapabilities(from_fd, statbuf.st_dev);
+    bool copy = true;
+    if (capabilities.Has(blaze_util::kFsCloneFile)) {
+      if (portable_clone_file(from_fd, to) == 0) {
+        copy = false;
+      } else if (!IsUnsupportedCopy(errno)) {
+        r = -1;
+        copy = false;
+      } else if (errno != EXDEV) {
+        capabilities.SetUnsupported(blaze_util::kFsCloneFile);
       }
     }
-    if (fchmodat(dir_fd, entry, 0700, 0) == -1) {
-      if (errno != ENOENT) {
-        PostDeleteTreesBelowException(env, errno, "fchmodat", dir_path, entry);
+    if (copy) {
+      int to_fd;
+      while ((to_fd = open(to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                           0600)) == -1 &&
+             errno == EINTR) {
       }
-      return {nullptr, errno};
-    }
-    fd = openat(dir_fd, entry, flags);
-    if (fd == -1) {
-      if (errno != ENOENT) {
-        PostDeleteTreesBelowException(env, errno, "opendir", dir_path, entry);
+      if (to_fd == -1) {
+        r = -1;
+      } else {
+        r = CopyFileContents(from_fd, to_fd, capabilities);
+        int saved_errno = errno;
+        if (close(to_fd) == -1 && r == 0) {
+          r = -1;
+        } else {
+          errno = saved_errno;
+        }
+        if (r == -1) {
+          saved_errno = errno;
+          unlink(to);
+          errno = saved_errno;
+        }
       }
-      return {nullptr, errno};
     }
   }
-  DIR* dir = fdopendir(fd);
-  if (dir == nullptr) {
-    if (errno != ENOENT) {
-      PostDeleteTreesBelowException(env, errno, "fdopendir", dir_path, entry);
+  if (r == 0) {
+    // Like FileSystemUtils.copyFile(), which also preserves the modification
+    // time only to the millisecond.
+    uint64_t mtime = StatEpochMilliseconds(statbuf, STAT_MTIME);
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = mtime / 1000;
+    times[1].tv_nsec = (mtime % 1000) * 1000000;
+    if (chmod(to, statbuf.st_mode & 07777) == -1 ||
+        utimensat(AT_FDCWD, to, times, 0) == -1) {
+      r = -1;
     }
-    close(fd);
-    return {nullptr, errno};
   }
-  return {dir, 0};
+  int saved_errno = errno;
+  close(from_fd);
+  errno = saved_errno;
+  return r;
 }
 
-// Tries to delete a file within a directory and, if the first attempt fails,
-// retries after granting extra write permissions to the directory.
-//
-// The file to delete is identified by the open descriptor of the parent
-// directory (dir_fd) and the subpath to resolve within that directory (entry).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
-//
-// is_dir indicates whether the entry to delete is a directory or not.
-//
-// Returns 0 when the file doesn't exist or is successfully deleted. Otherwise,
-// returns -1 and posts an exception.
-static int ForceDelete(JNIEnv* env, const std::vector<std::string>& dir_path,
-                       const int dir_fd, const char* entry,
-                       const bool is_dir) {
-  const int flags = is_dir ? AT_REMOVEDIR : 0;
-  if (unlinkat(dir_fd, entry, flags) == -1) {
-    if (errno == ENOENT) {
-      return 0;
-    }
-    if (fchmod(dir_fd, 0700) == -1) {
-      if (errno == ENOENT) {
-        return 0;
-      }
-      PostDeleteTreesBelowException(env, errno, "fchmod", dir_path, nullptr);
-      return -1;
+// Copies the files in chunks claimed from next_chunk until there is none left.
+static void CopyFilesWorker(const std::vector<char *> &from,
+                            const std::vector<char *> &to,
+                            std::atomic<size_t> *next_chunk, jint *errnos) {
+  for (;;) {
+    size_t begin = next_chunk->fetch_add(1) * kCopyFilesChunk;
+    if (begin >= from.size()) {
+      return;
     }
-    if (unlinkat(dir_fd, entry, flags) == -1) {
-      if (errno == ENOENT) {
-        return 0;
-      }
-      PostDeleteTreesBelowException(env, errno, "unlinkat", dir_path, entry);
-      return -1;
+    size_t end = std::min(from.size(), begin + kCopyFilesChunk);
+    for (size_t i = begin; i < end; ++i) {
+      const char *failed_path;
+      errnos[i] = CopyFile(from[i], to[i], &failed_path) == 0 ? 0 : errno;
     }
   }
-  return 0;
 }
+}  // namespace
 
-// Returns true if the given directory entry represents a subdirectory of dir.
-//
-// The file to check is identified by the open descriptor of the parent
-// directory (dir_fd) and the directory entry within that directory (de).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
-//
-// This function prefers to extract the type information from the directory
-// entry itself if available. If not available, issues a stat starting from
-// dir_fd.
-//
-// Returns 0 on success and updates is_dir accordingly. Returns -1 on error and
-// posts an exception.
-static int IsSubdir(JNIEnv* env, const std::vector<std::string>& dir_path,
-                    const int dir_fd, const struct dirent* de, bool* is_dir) {
-  switch (de->d_type) {
-    case DT_DIR:
-      *is_dir = true;
-      return 0;
-
-    case DT_UNKNOWN: {
-      struct stat st;
-      if (fstatat(dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
-        if (errno == ENOENT) {
-          *is_dir = false;
-          return 0;
-        }
-        PostDeleteTreesBelowException(env, errno, "fstatat", dir_path,
-                                      de->d_name);
-        return -1;
-      }
-      *is_dir = st.st_mode & S_IFDIR;
-      return 0;
-    }
-
-    default:
-      *is_dir = false;
-      return 0;
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    copyFile
+ * Signature: (Ljava/lang/String;Ljava/lang/String;)V
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_copyFile(
+    JNIEnv *env, jclass clazz, jstring from, jstring to) {
+  JStringLatin1Holder from_chars(env, from);
+  JStringLatin1Holder to_chars(env, to);
+  const char *failed_path;
+  if (CopyFile(from_chars, to_chars, &failed_path) == -1) {
+    PostException(env, errno, failed_path);
   }
 }
 
-// Recursively deletes all trees under the given path.
-//
-// The directory to delete is identified by the open descriptor of the parent
-// directory (dir_fd) and the subpath to resolve within that directory (entry).
-// dir_path contains the path components that were used when opening dir_fd and
-// is only used for error reporting purposes.
-//
-// dir_path is an in/out parameter updated with the path to the directory being
-// processed. This avoids the need to construct unnecessary intermediate paths,
-// as this algorithm works purely on file descriptors: the paths are only used
-// for error reporting purposes, and therefore are only formatted at that
-// point.
-//
-// Returns 0 on success. Returns -1 on error and posts an exception.
-static int DeleteTreesBelow(JNIEnv* env, std::vector<std::string>* dir_path,
-                            const int dir_fd, const char* entry) {
-  DIROrError dir_or_error = ForceOpendir(env, *dir_path, dir_fd, entry);
-  DIR *dir = dir_or_error.dir;
-  if (dir == nullptr) {
-    if (dir_or_error.error == ENOENT) {
-      return 0;
-    }
-    BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-    return -1;
-  }
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    copyFiles0
+ * Signature: ([Ljava/lang/String;[Ljava/lang/String;I[I)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_copyFiles0(
+    JNIEnv *env, jclass clazz, jobjectArray from, jobjectArray to,
+    jint parallelism, jintArray errnos) {
+  const jsize count = env->GetArrayLength(from);
+  std::vector<char *> from_chars(count);
+  std::vector<char *> to_chars(count);
+  for (jsize i = 0; i < count; ++i) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(from, i));
+    from_chars[i] = GetStringLatin1Chars(env, path);
+    env->DeleteLocalRef(path);
+    path = static_cast<jstring>(env->GetObjectArrayElement(to, i));
+    to_chars[i] = GetStringLatin1Chars(env, path);
+    env->DeleteLocalRef(path);
+  }
+
+  std::vector<jint> errno_buf(count);
+  std::atomic<size_t> next_chunk(0);
+  const size_t nthreads = std::min<size_t>(
+      std::max(1, std::min(parallelism, kMaxCopyFilesThreads)),
+      (count + kCopyFilesChunk - 1) / kCopyFilesChunk);
+  WorkerPool::Get().Run(nthreads, [&](int) {
+    CopyFilesWorker(from_chars, to_chars, &next_chunk, errno_buf.data());
+  });
+
+  for (jsize i = 0; i < count; ++i) {
+    ReleaseStringLatin1Chars(from_chars[i]);
+    ReleaseStringLatin1Chars(to_chars[i]);
+  }
+  env->SetIntArrayRegion(errnos, 0, count, errno_buf.data());
+}
 
-  dir_path->push_back(entry);
-  // On macOS and some other non-Linux OSes, on some filesystems, readdir(dir)
-  // may return NULL after an entry in dir is deleted even if not all files have
-  // been read yet - see
-  // https://pubs.opengroup.org/onlinepubs/9699919799/functions/readdir.html;
-  // "If a file is removed from or added to the directory after the most recent
-  // call to opendir() or rewinddir(), whether a subsequent call to readdir()
-  // returns an entry for that file is unspecified." We thus read all the names
-  // of dir's entries before deleting. We don't want to simply use fts(3)
-  // because we want to be able to chmod at any point in the directory hierarchy
-  // to retry a filesystem operation after hitting an EACCES.
-  // If in the future we hit any problems here due to the unspecified behavior
-  // of readdir() when a file has been deleted by a different thread we can use
-  // some form of locking to make sure the threads don't try to clean up the
-  // same directory at the same time; or doing it in a loop until the directory
-  // is really empty.
-  std::vector<std::string> dir_files, dir_subdirs;
-  for (;;) {
-    errno = 0;
-    struct dirent* de = readdir(dir);
-    if (de == nullptr) {
-      if (errno != 0 && errno != ENOENT) {
-        PostDeleteTreesBelowException(env, errno, "readdir", *dir_path,
-                                      nullptr);
-      }
-      break;
-    }
+// The most of a file prefetch0() asks to be read ahead. Past that, the
+// kernel's own readahead keeps up with sequential reads, and asking for more
+// would only crowd out the page cache.
+static const off_t kMaxPrefetchBytes = 16 << 20;
 
-    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    prefetch0
+ * Signature: ([Ljava/lang/String;)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_prefetch0(
+    JNIEnv *env, jclass clazz, jobjectArray paths) {
+  const jsize count = env->GetArrayLength(paths);
+  for (jsize i = 0; i < count; ++i) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    char *path_chars = GetStringLatin1Chars(env, path);
+    env->DeleteLocalRef(path);
+    // Errors are ignored: whoever reads the file next reports them. Opening
+    // a FIFO must not wait for a writer.
+    int fd = open(path_chars, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    ReleaseStringLatin1Chars(path_chars);
+    if (fd == -1) {
       continue;
     }
+    portable_stat_struct statbuf;
+    if (portable_fstat(fd, &statbuf) == 0 && S_ISREG(statbuf.st_mode) &&
+        statbuf.st_size > 0) {
+      // The reads carry on after the file is closed.
+      portable_readahead(fd, std::min<off_t>(statbuf.st_size,
+                                             kMaxPrefetchBytes));
+    }
+    close(fd);
+  }
+}
 
-    bool is_dir;
-    if (IsSubdir(env, *dir_path, dirfd(dir), de, &is_dir) == -1) {
-      BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-      break;
+// The madvise(2) advice for each of the MMAP_* constants of NativePosixFiles.
+static const int kMmapAdvice[] = {MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM,
+                                  MADV_WILLNEED};
+
+// Stands in for the contents of an empty mapping, which mmap(2) cannot make.
+static char empty_mapping;
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    mmap0
+ * Signature: (Ljava/lang/String;JII)Lcom/google/devtools/build/lib/unix/NativePosixFiles$MappedFile;
+ * Throws:    java.io.IOException
+ */
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_mmap0(
+    JNIEnv *env, jclass clazz, jstring path, jlong offset, jint length,
+    jint advice) {
+  JStringLatin1Holder path_chars(env, path);
+  // Opening a FIFO must not wait for a writer.
+  int fd;
+  while ((fd = open(path_chars, O_RDONLY | O_CLOEXEC | O_NONBLOCK)) == -1 &&
+         errno == EINTR) {
+  }
+  if (fd == -1) {
+    PostException(env, errno, path_chars);
+    return nullptr;
+  }
+  portable_stat_struct statbuf;
+  if (portable_fstat(fd, &statbuf) == -1) {
+    PostException(env, errno, path_chars);
+    close(fd);
+    return nullptr;
+  }
+  if (!S_ISREG(statbuf.st_mode)) {
+    PostException(env, S_ISDIR(statbuf.st_mode) ? EISDIR : EINVAL,
+                  path_chars);
+    close(fd);
+    return nullptr;
+  }
+  const int64_t file_size = statbuf.st_size;
+  int64_t size =
+      length < 0 ? std::max<int64_t>(file_size - offset, 0) : length;
+  if (offset + size > file_size) {
+    // Past the end of the file, pages of the mapping raise SIGBUS.
+    size = std::max<int64_t>(file_size - offset, 0);
+  }
+  if (size > INT32_MAX) {
+    // A ByteBuffer cannot hold more; the caller maps the file piece by piece.
+    PostException(env, EFBIG, path_chars);
+    close(fd);
+    return nullptr;
+  }
+
+  // mmap(2) only maps from a multiple of the page size, so the mapping may
+  // start before the offset.
+  static const int64_t page_size = sysconf(_SC_PAGESIZE);
+  const int64_t map_offset = offset - offset % page_size;
+  const int64_t map_size = size == 0 ? 0 : size + (offset - map_offset);
+  void *map_address = nullptr;
+  if (map_size > 0) {
+    map_address = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd,
+                       static_cast<off_t>(map_offset));
+    if (map_address == MAP_FAILED) {
+      PostException(env, errno, path_chars);
+      close(fd);
+      return nullptr;
     }
-    if (is_dir) {
-      dir_subdirs.push_back(de->d_name);
-    } else {
-      dir_files.push_back(de->d_name);
+    // Only a hint: whoever reads the buffer gets the contents either way.
+    (void)madvise(map_address, map_size, kMmapAdvice[advice]);
+  }
+  // The mapping outlives the file descriptor.
+  close(fd);
+
+  char *contents =
+      map_address == nullptr
+          ? &empty_mapping
+          : static_cast<char *>(map_address) + (offset - map_offset);
+  jobject buffer = env->NewDirectByteBuffer(contents, size);
+  if (buffer == nullptr) {
+    if (map_address != nullptr) {
+      munmap(map_address, map_size);
     }
+    return nullptr;  // async exception!
   }
-  if (env->ExceptionOccurred() == nullptr) {
-    for (const auto &file : dir_files) {
-      if (ForceDelete(env, *dir_path, dirfd(dir), file.c_str(), false) == -1) {
-        BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-        break;
+  static const jclass mapped_file_class = makeStaticClass(
+      env, "com/google/devtools/build/lib/unix/NativePosixFiles$MappedFile");
+  static const jmethodID mapped_file_ctor = getConstructorID(
+      env, mapped_file_class, "(Ljava/nio/ByteBuffer;JJJ)V");
+  jobject mapped_file = env->NewObject(
+      mapped_file_class, mapped_file_ctor, buffer,
+      static_cast<jlong>(reinterpret_cast<uintptr_t>(map_address)),
+      static_cast<jlong>(map_size), static_cast<jlong>(file_size));
+  if (mapped_file == nullptr && map_address != nullptr) {
+    munmap(map_address, map_size);
+  }
+  return mapped_file;
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
+ * Method:    munmap0
+ * Signature: (JJ)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_munmap0(
+    JNIEnv *env, jclass clazz, jlong address, jlong length) {
+  // munmap(2) only fails for a range that was never mapped.
+  if (address != 0 && munmap(reinterpret_cast<void *>(address), length) == -1) {
+    PostAssertionError(env, "munmap failed: " + ErrorMessage(errno));
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Tree creation
+
+namespace {
+// The kinds of entries createTree0() creates, as NativePosixFiles defines
+// them.
+static const jbyte kTreeDirectory = 0;
+static const jbyte kTreeSymlink = 1;
+static const jbyte kTreeHardLink = 2;
+
+// The number of links a createTree0() thread creates before it claims more.
+static const size_t kCreateTreeChunk = 256;
+
+static const int kMaxCreateTreeThreads = 8;
+
+// The directories of a tree under construction, opened once each so that
+// the entries in them are created relative to a handle rather than by
+// resolving their whole path again.
+class TreeDirectories {
+ public:
+  explicit TreeDirectories(int root_fd) : root_fd_(root_fd) {}
+
+  ~TreeDirectories() {
+    for (const auto &entry : fds_) {
+      if (entry.second != root_fd_) {
+        close(entry.second);
       }
     }
-    // DeleteTreesBelow is recursive; don't hold on to file names unnecessarily.
-    dir_files.clear();
   }
-  if (env->ExceptionOccurred() == nullptr) {
-    for (const auto &subdir : dir_subdirs) {
-      if (DeleteTreesBelow(env, dir_path, dirfd(dir), subdir.c_str()) == -1) {
-        BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-        break;
+
+  // Splits path, which is relative to the root, into the directory to create
+  // its entry in and the name of the entry in it. If the parent directory
+  // cannot be opened, e.g. because it is missing or there are no file
+  // descriptors left, the entry is created relative to the root instead, so
+  // that the syscall itself fails or succeeds as it would for the full path.
+  void Resolve(const char *path, int *dir_fd, const char **name) {
+    const char *slash = strrchr(path, '/');
+    if (slash == nullptr) {
+      *dir_fd = root_fd_;
+      *name = path;
+      return;
+    }
+    std::string parent(path, slash - path);
+    auto it = fds_.find(parent);
+    if (it == fds_.end()) {
+      int fd;
+      while ((fd = openat(root_fd_, parent.c_str(),
+                          O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 &&
+             errno == EINTR) {
       }
-      if (ForceDelete(env, *dir_path, dirfd(dir), subdir.c_str(), true) == -1) {
-        BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
-        break;
+      if (fd == -1) {
+        *dir_fd = root_fd_;
+        *name = path;
+        return;
       }
+      it = fds_.emplace(std::move(parent), fd).first;
     }
+    *dir_fd = it->second;
+    *name = slash + 1;
   }
-  if (closedir(dir) == -1) {
-    // Prefer reporting the error encountered while processing entries,
-    // not the (unlikely) error on close.
-    if (env->ExceptionOccurred() == nullptr) {
-      PostDeleteTreesBelowException(env, errno, "closedir", *dir_path, nullptr);
+
+ private:
+  const int root_fd_;
+  std::unordered_map<std::string, int> fds_;
+};
+
+// Creates the directory name in dir_fd, which is fine if it already exists.
+static int CreateTreeDirectory(int dir_fd, const char *name) {
+  if (mkdirat(dir_fd, name, 0777) == 0) {
+    return 0;
+  }
+  if (errno != EEXIST) {
+    return errno;
+  }
+  portable_stat_struct statbuf;
+  if (portable_fstatat(dir_fd, const_cast<char *>(name), &statbuf,
+                       AT_SYMLINK_NOFOLLOW) == 0 &&
+      S_ISDIR(statbuf.st_mode)) {
+    return 0;
+  }
+  return EEXIST;
+}
+
+// A link that createTree0() creates, resolved to its directory.
+struct TreeLink {
+  jbyte kind;
+  int dir_fd;
+  const char *name;
+  const char *target;
+};
+
+// Creates the links in chunks claimed from next_chunk until there is none
+// left.
+static void CreateTreeLinksWorker(const std::vector<TreeLink> &links,
+                                  const std::vector<jsize> &indices,
+                                  std::atomic<size_t> *next_chunk,
+                                  jint *errnos) {
+  for (;;) {
+    size_t begin = next_chunk->fetch_add(1) * kCreateTreeChunk;
+    if (begin >= links.size()) {
+      return;
+    }
+    size_t end = std::min(links.size(), begin + kCreateTreeChunk);
+    for (size_t i = begin; i < end; ++i) {
+      const TreeLink &link = links[i];
+      int r = link.kind == kTreeSymlink
+                  ? symlinkat(link.target, link.dir_fd, link.name)
+                  : linkat(AT_FDCWD, link.target, link.dir_fd, link.name, 0);
+      errnos[indices[i]] = r == 0 ? 0 : errno;
     }
   }
-  dir_path->pop_back();
-  return env->ExceptionOccurred() == nullptr ? 0 : -1;
 }
 }  // namespace
 
 /*
  * Class:     com.google.devtools.build.lib.unix.NativePosixFiles
- * Method:    deleteTreesBelow
- * Signature: (Ljava/lang/String;)V
+ * Method:    createTree0
+ * Signature: (Ljava/lang/String;[B[Ljava/lang/String;[Ljava/lang/String;I[I)V
  * Throws:    java.io.IOException
  */
 extern "C" JNIEXPORT void JNICALL
-Java_com_google_devtools_build_lib_unix_NativePosixFiles_deleteTreesBelow(
-    JNIEnv *env, jclass clazz, jstring path) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
-  std::vector<std::string> dir_path;
-  if (DeleteTreesBelow(env, &dir_path, AT_FDCWD, path_chars) == -1) {
-    BAZEL_CHECK_NE(env->ExceptionOccurred(), nullptr);
+Java_com_google_devtools_build_lib_unix_NativePosixFiles_createTree0(
+    JNIEnv *env, jclass clazz, jstring root, jbyteArray kinds,
+    jobjectArray paths, jobjectArray targets, jint parallelism,
+    jintArray errnos) {
+  const char *root_chars = GetStringLatin1Chars(env, root);
+  int root_fd;
+  while ((root_fd = open(root_chars, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) ==
+             -1 &&
+         errno == EINTR) {
+  }
+  if (root_fd == -1) {
+    PostException(env, errno, root_chars);
+    ReleaseStringLatin1Chars(root_chars);
+    return;
   }
-  BAZEL_CHECK(dir_path.empty());
-  ReleaseStringLatin1Chars(path_chars);
+  ReleaseStringLatin1Chars(root_chars);
+
+  const jsize count = env->GetArrayLength(paths);
+  std::vector<jbyte> kind_buf(count);
+  env->GetByteArrayRegion(kinds, 0, count, kind_buf.data());
+  std::vector<char *> path_chars(count);
+  std::vector<char *> target_chars(count, nullptr);
+  for (jsize i = 0; i < count; ++i) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    path_chars[i] = GetStringLatin1Chars(env, path);
+    env->DeleteLocalRef(path);
+    if (kind_buf[i] != kTreeDirectory) {
+      path = static_cast<jstring>(env->GetObjectArrayElement(targets, i));
+      target_chars[i] = GetStringLatin1Chars(env, path);
+      env->DeleteLocalRef(path);
+    }
+  }
+
+  // The directories go first and in order, as later entries may be created
+  // in them. The links only depend on the directories, so they go in
+  // parallel.
+  std::vector<jint> errno_buf(count);
+  std::vector<TreeLink> links;
+  std::vector<jsize> link_indices;
+  {
+    TreeDirectories dirs(root_fd);
+    for (jsize i = 0; i < count; ++i) {
+      if (kind_buf[i] == kTreeDirectory) {
+        int dir_fd;
+        const char *name;
+        dirs.Resolve(path_chars[i], &dir_fd, &name);
+        errno_buf[i] = CreateTreeDirectory(dir_fd, name);
+      }
+    }
+    for (jsize i = 0; i < count; ++i) {
+      if (kind_buf[i] != kTreeDirectory) {
+        TreeLink link = {kind_buf[i], root_fd, nullptr, target_chars[i]};
+        dirs.Resolve(path_chars[i], &link.dir_fd, &link.name);
+        links.push_back(link);
+        link_indices.push_back(i);
+      }
+    }
+
+    std::atomic<size_t> next_chunk(0);
+    const size_t nthreads = std::min<size_t>(
+        std::max(1, std::min(parallelism, kMaxCreateTreeThreads)),
+        (links.size() + kCreateTreeChunk - 1) / kCreateTreeChunk);
+    WorkerPool::Get().Run(nthreads, [&](int) {
+      CreateTreeLinksWorker(links, link_indices, &next_chunk,
+                            errno_buf.data());
+    });
+  }
+  close(root_fd);
+
+  for (jsize i = 0; i < count; ++i) {
+    ReleaseStringLatin1Chars(path_chars[i]);
+    if (target_chars[i] != nullptr) {
+      ReleaseStringLatin1Chars(target_chars[i]);
+    }
+  }
+  env->SetIntArrayRegion(errnos, 0, count, errno_buf.data());
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -1093,8 +2461,8 @@ static jbyteArray getxattr_common(JNIEnv *env,
                                   jstring path,
                                   jstring name,
                                   getxattr_func getxattr) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
-  const char *name_chars = GetStringLatin1Chars(env, name);
+  JStringLatin1Holder path_chars(env, path);
+  JStringLatin1Holder name_chars(env, name);
 
   // TODO(bazel-team): on ERANGE, try again with larger buffer.
   jbyte value[4096];
@@ -1114,8 +2482,6 @@ static jbyteArray getxattr_common(JNIEnv *env,
       env->SetByteArrayRegion(result, 0, size, value);
     }
   }
-  ReleaseStringLatin1Chars(path_chars);
-  ReleaseStringLatin1Chars(name_chars);
   return result;
 }
 }  // namespace
@@ -1139,7 +2505,7 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_lgetxattr(JNIEnv *env,
 extern "C" JNIEXPORT jint JNICALL
 Java_com_google_devtools_build_lib_unix_NativePosixFiles_openWrite(
     JNIEnv *env, jclass clazz, jstring path, jboolean append) {
-  const char *path_chars = GetStringLatin1Chars(env, path);
+  JStringLatin1Holder path_chars(env, path);
   int flags = (O_WRONLY | O_CREAT) | (append ? O_APPEND : O_TRUNC);
   int fd;
   while ((fd = open(path_chars, flags, 0666)) == -1 && errno == EINTR) {
@@ -1147,7 +2513,6 @@ Java_com_google_devtools_build_lib_unix_NativePosixFiles_openWrite(
   if (fd == -1) {
     PostException(env, errno, path_chars);
   }
-  ReleaseStringLatin1Chars(path_chars);
   return fd;
 }
 
@@ -1601,4 +2966,64 @@ Java_com_google_devtools_build_lib_profiler_SystemNetworkStats_getNetIfAddrsNati
   freeifaddrs(ifaddr);
 }
 
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativeWorkerPool
+ * Method:    shutdown0
+ * Signature: ()V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativeWorkerPool_shutdown0(
+    JNIEnv *env, jclass clazz) {
+  WorkerPool::Get().Shutdown();
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.unix.NativeWorkerPool
+ * Method:    getStats0
+ * Signature: ([J)V
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_unix_NativeWorkerPool_getStats0(
+    JNIEnv *env, jclass clazz, jlongArray stats) {
+  WorkerPoolStats pool_stats = WorkerPool::Get().GetStats();
+  // In the order of the fields of NativeWorkerPool.Stats.
+  const jlong values[] = {
+      pool_stats.threads,
+      pool_stats.active,
+      pool_stats.queue_depth,
+      pool_stats.max_queue_depth,
+      pool_stats.calls_run,
+      pool_stats.calls_stolen,
+      pool_stats.calls_dropped,
+  };
+  env->SetLongArrayRegion(stats, 0, sizeof(values) / sizeof(values[0]),
+                          values);
+}
+
+/*
+ * Class:     com.google.devtools.build.lib.profiler.ProcessStats
+ * Method:    sampleNative
+ * Signature: ([J)Z
+ */
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_profiler_ProcessStats_sampleNative(
+    JNIEnv *env, jclass clazz, jlongArray counters) {
+  ProcessStats stats;
+  if (!portable_process_stats(&stats)) {
+    return JNI_FALSE;
+  }
+  // In the order of the fields of ProcessStats.Counters.
+  const jlong values[] = {
+      stats.read_bytes,
+      stats.write_bytes,
+      stats.voluntary_context_switches,
+      stats.involuntary_context_switches,
+      stats.run_queue_wait_nanos,
+      stats.io_wait_nanos,
+  };
+  env->SetLongArrayRegion(counters, 0, sizeof(values) / sizeof(values[0]),
+                          values);
+  return JNI_TRUE;
+}
+
 }  // namespace blaze_jni
@@ -31,10 +31,12 @@ namespace blaze_jni {
 typedef struct stat portable_stat_struct;
 #define portable_stat ::stat
 #define portable_lstat ::lstat
+#define portable_fstat ::fstat
 #else
 typedef struct stat64 portable_stat_struct;
 #define portable_stat ::stat64
 #define portable_lstat ::lstat64
+#define portable_fstat ::fstat64
 #endif
 
 #if !defined(ENODATA)
@@ -59,6 +61,59 @@ extern std::string ErrorMessage(int error_number);
 int portable_fstatat(int dirfd, char *name, portable_stat_struct *statbuf,
                      int flags);
 
+// The fields of a stat(2) result that portable_stat_fields() may be asked
+// for, which can be or-ed together. Keep in sync with the STAT_FIELD_*
+// constants of NativePosixFiles.java.
+enum StatFields {
+  STAT_FIELD_MODE = 1 << 0,  // The file type and permissions.
+  STAT_FIELD_MTIME = 1 << 1,
+  STAT_FIELD_CTIME = 1 << 2,
+  STAT_FIELD_SIZE = 1 << 3,
+  STAT_FIELD_INO = 1 << 4,
+};
+
+// Runs stat(2), or lstat(2) unless follow_symlinks, but only the StatFields in
+// fields are meant to be read from statbuf; with none, it only tells whether
+// the file exists. On Linux this is statx(2) with the matching mask, so that
+// the file system may skip the others, and with dont_sync it may answer from
+// the attributes it has cached rather than revalidate them, which on NFS saves
+// a round trip to the server (AT_STATX_DONT_SYNC). Elsewhere, or if statx(2)
+// is not available, all the fields are read. Returns 0 on success, or -1 and
+// sets errno.
+int portable_stat_fields(const char *path, bool follow_symlinks, int fields,
+                         bool dont_sync, portable_stat_struct *statbuf);
+
+// Runs fstatat(2) on each of the count (dirfds[i], names[i]) pairs, keeping
+// many of them in flight at once so that the latency of a slow (e.g.
+// networked) file system overlaps. Stores the errno of each call into
+// errnos, or 0 and the metadata into stats on success. Returns false if the
+// platform has no such facility or the batch is too small to benefit, in
+// which case the caller should call portable_fstatat() for each pair.
+bool portable_fstatat_many(size_t count, const int *dirfds,
+                           const char *const *names, int flags,
+                           portable_stat_struct *stats, int *errnos);
+
+// Creates to, which must not exist, as a copy-on-write clone of the regular
+// file open as from_fd (FICLONE on Linux, clonefile(2) on macOS). Returns 0
+// on success, or -1 and sets errno; an errno of ENOTSUP, EOPNOTSUPP, EXDEV,
+// EINVAL, ENOTTY or ENOSYS means that the file system cannot clone the file
+// and the caller should copy it instead.
+int portable_clone_file(int from_fd, const char *to);
+
+// Copies up to len bytes from the current offset of from_fd to the current
+// offset of to_fd inside the kernel, as copy_file_range(2). Returns the number
+// of bytes copied, 0 at the end of from_fd, or -1 and sets errno; an errno of
+// ENOSYS, EXDEV, EINVAL, ENOTSUP or EOPNOTSUPP means that the caller should
+// read and write the rest of the file itself.
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t len);
+
+// Asks the kernel to start reading the first len bytes of the regular file
+// open as fd into the page cache in the background, so that reading them
+// afterwards does not wait on the disk (posix_fadvise(POSIX_FADV_WILLNEED) on
+// Linux, F_RDADVISE on macOS). Returns 0 on success, or -1 and sets errno;
+// either way, this is only a hint.
+int portable_readahead(int fd, off_t len);
+
 // Encoding for different timestamps in a struct stat.
 enum StatTimes {
   STAT_ATIME,  // access
@@ -176,6 +231,24 @@ int portable_cpu_speed();
 // monitoring when a cpu speed alert happens.
 extern void cpu_speed_callback(int speed);
 
+// Cumulative resource usage counters of this process, all threads included.
+// A counter the platform does not tell is -1.
+struct ProcessStats {
+  // Bytes read from and written to storage, as opposed to the page cache.
+  int64_t read_bytes;
+  int64_t write_bytes;
+  int64_t voluntary_context_switches;
+  int64_t involuntary_context_switches;
+  // Time the threads were runnable, but waiting for a CPU.
+  int64_t run_queue_wait_nanos;
+  // Time the threads waited for block I/O to complete.
+  int64_t io_wait_nanos;
+};
+
+// Fills stats. Cheap enough to be called several times a second. Returns
+// false if no counter could be read.
+bool portable_process_stats(ProcessStats *stats);
+
 }  // namespace blaze_jni
 
 #endif  // BAZEL_SRC_MAIN_NATIVE_UNIX_JNI_H__
@@ -30,6 +30,7 @@
 # include <sys/extattr.h>
 #endif
 #include <sys/param.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/sysctl.h>
 #include <sys/types.h>
@@ -57,6 +58,46 @@ int portable_fstatat(int dirfd, char *name, portable_stat_struct *statbuf,
   return fstatat(dirfd, name, statbuf, flags);
 }
 
+int portable_stat_fields(const char *path, bool follow_symlinks, int fields,
+                         bool dont_sync, portable_stat_struct *statbuf) {
+  // Always reads all the fields.
+  return follow_symlinks ? portable_stat(path, statbuf)
+                         : portable_lstat(path, statbuf);
+}
+
+bool portable_fstatat_many(size_t count, const int *dirfds,
+                           const char *const *names, int flags,
+                           portable_stat_struct *stats, int *errnos) {
+  // Currently not implemented.
+  return false;
+}
+
+int portable_clone_file(int from_fd, const char *to) {
+  // Currently not implemented.
+  errno = ENOTSUP;
+  return -1;
+}
+
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t len) {
+  // Currently not implemented.
+  errno = ENOSYS;
+  return -1;
+}
+
+int portable_readahead(int fd, off_t len) {
+#if defined(__FreeBSD__)
+  int error = posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
                                StatTimes t) {
   switch (t) {
@@ -154,4 +195,18 @@ int portable_cpu_speed() {
   return -1;
 }
 
+bool portable_process_stats(ProcessStats *stats) {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return false;
+  }
+  // Only the number of blocks is counted, not the bytes.
+  stats->read_bytes = stats->write_bytes = -1;
+  stats->voluntary_context_switches = usage.ru_nvcsw;
+  stats->involuntary_context_switches = usage.ru_nivcsw;
+  stats->run_queue_wait_nanos = -1;
+  stats->io_wait_nanos = -1;
+  return true;
+}
+
 }  // namespace blaze_jni
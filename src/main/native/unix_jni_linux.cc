@@ -12,17 +12,56 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+#include <poll.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/time.h>
 #include <sys/xattr.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
+#include "src/main/cpp/util/logging.h"
 #include "src/main/native/unix_jni.h"
 
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// IORING_OP_STATX arrived in Linux 5.6, together with IORING_FEAT_RW_CUR_POS.
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup)
+#define BAZEL_HAVE_STATX_RING 1
+#endif
+#endif
+
+// statx(2) arrived in Linux 4.11, and in glibc 2.28.
+#if defined(STATX_BASIC_STATS) && defined(__NR_statx)
+#define BAZEL_HAVE_STATX 1
+#if !defined(AT_STATX_DONT_SYNC)
+#define AT_STATX_SYNC_AS_STAT 0x0000
+#define AT_STATX_DONT_SYNC 0x4000
+#endif
+#endif
+
 namespace blaze_jni {
 
 std::string ErrorMessage(int error_number) {
@@ -48,6 +87,35 @@ int portable_fstatat(
   return fstatat64(dirfd, name, statbuf, flags);
 }
 
+int portable_clone_file(int from_fd, const char *to) {
+  int to_fd = open(to, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (to_fd == -1) {
+    return -1;
+  }
+  if (ioctl(to_fd, FICLONE, from_fd) == -1) {
+    int saved_errno = errno;
+    close(to_fd);
+    unlink(to);
+    errno = saved_errno;
+    return -1;
+  }
+  return close(to_fd);
+}
+
+ssize_t portable_copy_file_range(int from_fd, int to_fd, size_t len) {
+  return copy_file_range(from_fd, nullptr, to_fd, nullptr, len, 0);
+}
+
+int portable_readahead(int fd, off_t len) {
+  // Unlike readahead(2), this does not wait for the reads to be submitted.
+  int error = posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
 uint64_t StatEpochMilliseconds(const portable_stat_struct &statbuf,
                                StatTimes t) {
   switch (t) {
@@ -88,51 +156,744 @@ void portable_start_suspend_monitoring() {
   // Currently not implemented.
 }
 
-void portable_start_thermal_monitoring() {
-  // Currently not implemented.
-}
+static std::atomic<MemoryPressureLevel> g_memory_pressure_level(
+    MemoryPressureLevelNormal);
 
-int portable_thermal_load() {
-  // Currently not implemented.
-  return 0;
+// Pressure stall information triggers, see
+// https://docs.kernel.org/accounting/psi.html. A warning is when some tasks
+// were stalled on memory for 10% of a 2s window, a critical level when all
+// non-idle tasks were. The window is 2s because that is the smallest one
+// unprivileged processes may use.
+static const char kMemoryPressureFile[] = "/proc/pressure/memory";
+static const char kWarningTrigger[] = "some 200000 2000000";
+static const char kCriticalTrigger[] = "full 200000 2000000";
+// How long the pressure must stay below the triggers to be normal again, as
+// the kernel only reports when a trigger fires.
+static const int kMemoryPressureSettleMillis = 10000;
+
+// Returns a file descriptor to poll for the trigger, or -1 if pressure stall
+// information is not available.
+static int OpenMemoryPressureTrigger(const char *trigger) {
+  int fd = open(kMemoryPressureFile, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  if (write(fd, trigger, strlen(trigger) + 1) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
 }
 
-void portable_start_system_load_advisory_monitoring() {
-  // Currently not implemented.
+static void SetMemoryPressureLevel(MemoryPressureLevel level) {
+  if (g_memory_pressure_level.exchange(level) == level) {
+    return;
+  }
+  switch (level) {
+    case MemoryPressureLevelNormal:
+      BAZEL_LOG(USER) << "memory pressure normal anomaly";
+      break;
+    case MemoryPressureLevelWarning:
+      BAZEL_LOG(USER) << "memory pressure warning anomaly";
+      break;
+    case MemoryPressureLevelCritical:
+      BAZEL_LOG(USER) << "memory pressure critical anomaly";
+      break;
+  }
+  memory_pressure_callback(level);
 }
 
-int portable_system_load_advisory() {
-  // Currently not implemented.
-  return 0;
+static void MonitorMemoryPressure(int warning_fd, int critical_fd) {
+  struct pollfd fds[2] = {{warning_fd, POLLPRI, 0}, {critical_fd, POLLPRI, 0}};
+  for (;;) {
+    int timeout = g_memory_pressure_level == MemoryPressureLevelNormal
+                      ? -1
+                      : kMemoryPressureSettleMillis;
+    int ready = poll(fds, 2, timeout);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      BAZEL_LOG(WARNING) << "polling " << kMemoryPressureFile
+                         << " failed: " << ErrorMessage(errno);
+      break;
+    }
+    if (ready == 0) {
+      SetMemoryPressureLevel(MemoryPressureLevelNormal);
+    } else if ((fds[0].revents | fds[1].revents) & (POLLERR | POLLNVAL)) {
+      // The monitored cgroup or the file went away.
+      break;
+    } else if (fds[1].revents & POLLPRI) {
+      SetMemoryPressureLevel(MemoryPressureLevelCritical);
+    } else if (fds[0].revents & POLLPRI &&
+               g_memory_pressure_level != MemoryPressureLevelCritical) {
+      SetMemoryPressureLevel(MemoryPressureLevelWarning);
+    }
+  }
+  close(warning_fd);
+  close(critical_fd);
 }
 
 void portable_start_memory_pressure_monitoring() {
-  // Currently not implemented.
-  // https://www.kernel.org/doc/Documentation/cgroup-v1/memory.txt
+  static std::once_flag once;
+  std::call_once(once, [] {
+    int warning_fd = OpenMemoryPressureTrigger(kWarningTrigger);
+    int critical_fd = OpenMemoryPressureTrigger(kCriticalTrigger);
+    if (warning_fd < 0 || critical_fd < 0) {
+      // Older kernels and kernels built without CONFIG_PSI.
+      BAZEL_LOG(INFO) << "memory pressure monitoring unavailable: "
+                      << ErrorMessage(errno);
+      if (warning_fd >= 0) {
+        close(warning_fd);
+      }
+      if (critical_fd >= 0) {
+        close(critical_fd);
+      }
+      return;
+    }
+    std::thread(MonitorMemoryPressure, warning_fd, critical_fd).detach();
+  });
 }
 
 MemoryPressureLevel portable_memory_pressure() {
-  // Currently not implemented.
-  return MemoryPressureLevelNormal;
+  return g_memory_pressure_level;
 }
 
-void portable_start_disk_space_monitoring() {
-  // Currently not implemented.
+// The profiler samples the counters every second or so; keeping the file
+// open saves the path lookup and the allocation of the seq_file on each
+// sample. Each pread from offset 0 regenerates the contents.
+static std::mutex g_net_dev_mutex;
+static int g_net_dev_fd = -1;
+
+// Reads all of /proc/net/dev into contents. Returns 0, or the errno of the
+// failed call.
+static int ReadNetDev(std::string *contents) {
+  std::lock_guard<std::mutex> lock(g_net_dev_mutex);
+  if (g_net_dev_fd == -1) {
+    g_net_dev_fd = open("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+    if (g_net_dev_fd == -1) {
+      return errno;
+    }
+  }
+  char buf[4096];
+  off_t offset = 0;
+  for (;;) {
+    ssize_t r = pread(g_net_dev_fd, buf, sizeof(buf), offset);
+    if (r == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    if (r == 0) {
+      return 0;
+    }
+    contents->append(buf, r);
+    offset += r;
+  }
 }
 
-void portable_start_cpu_speed_monitoring() {
-  // Currently not implemented.
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_profiler_SystemNetworkStats_getNetIoCountersNative(
+    JNIEnv *env, jclass clazz, jobject counters_map) {
+  std::string contents;
+  int error = ReadNetDev(&contents);
+  if (error != 0) {
+    PostException(env, error, "/proc/net/dev");
+    return;
+  }
+
+  jclass map_class = env->GetObjectClass(counters_map);
+  jmethodID map_put = env->GetMethodID(
+      map_class, "put",
+      "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
+
+  jclass counter_class = env->FindClass(
+      "com/google/devtools/build/lib/profiler/SystemNetworkStats$NetIoCounter");
+  jmethodID counter_create =
+      env->GetStaticMethodID(counter_class, "create",
+                             "(JJJJ)Lcom/google/devtools/build/lib/profiler/"
+                             "SystemNetworkStats$NetIoCounter;");
+
+  // After two header lines, one line per interface:
+  //   <name>: <8 receive counters> <8 transmit counters>
+  // where the first two counters of each group are bytes and packets.
+  std::replace(contents.begin(), contents.end(), '\n', '\0');
+  const char *end = contents.c_str() + contents.size();
+  int line = 0;
+  for (const char *p = contents.c_str(); p < end;
+       p += strlen(p) + 1, ++line) {
+    const char *colon = strchr(p, ':');
+    if (line < 2 || colon == nullptr) {
+      continue;
+    }
+    const char *name_start = p + strspn(p, " ");
+    std::string name(name_start, colon - name_start);
+    uint64_t fields[10];
+    const char *q = colon + 1;
+    int n = 0;
+    for (; n < 10; ++n) {
+      char *field_end;
+      fields[n] = strtoull(q, &field_end, 10);
+      if (field_end == q) {
+        break;
+      }
+      q = field_end;
+    }
+    if (n < 10) {
+      continue;
+    }
+
+    jstring jname = env->NewStringUTF(name.c_str());
+    jobject counter = env->CallStaticObjectMethod(
+        counter_class, counter_create, (jlong)fields[8], (jlong)fields[0],
+        (jlong)fields[9], (jlong)fields[1]);
+    env->DeleteLocalRef(env->CallObjectMethod(counters_map, map_put, jname,
+                                              counter));
+    env->DeleteLocalRef(counter);
+    env->DeleteLocalRef(jname);
+  }
 }
 
-int portable_cpu_speed() {
-  // Currently not implemented.
-  return -1;
+namespace {
+#ifdef BAZEL_HAVE_STATX_RING
+// The number of statx requests kept in flight. statx is always punted to the
+// kernel's io-wq workers, so this is also how many of them may block on the
+// file system at once.
+static const unsigned kStatxQueueDepth = 256;
+
+// Below this number of files, setting up a ring costs more than it hides.
+static const size_t kMinStatxBatch = 16;
+
+// A bare io_uring running IORING_OP_STATX requests, without liburing, which
+// Bazel does not depend on.
+class StatxRing {
+ public:
+  StatxRing() = default;
+  StatxRing(const StatxRing &) = delete;
+  StatxRing &operator=(const StatxRing &) = delete;
+
+  ~StatxRing() {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  // Returns false if io_uring is not available or does not support statx
+  // (Linux before 5.6), or is disabled by a seccomp policy or by
+  // kernel.io_uring_disabled.
+  bool Init(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    fd_ = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd_ < 0 || !SupportsStatx()) {
+      return false;
+    }
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(__u32);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      cq_ring_ = sq_ring_;
+    } else {
+      cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cq_ring_ == MAP_FAILED) {
+        return false;
+      }
+    }
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+      return false;
+    }
+    char *sq = static_cast<char *>(sq_ring_);
+    sq_tail_ = reinterpret_cast<__u32 *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<__u32 *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<__u32 *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<__u32 *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<__u32 *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<__u32 *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+    entries_ = params.sq_entries;
+    return true;
+  }
+
+  unsigned entries() const { return entries_; }
+
+  // Queues a statx of name relative to dirfd into buf. The caller never
+  // queues more than entries() requests without reaping their completions.
+  void QueueStatx(int dirfd, const char *name, int flags, struct statx *buf,
+                  __u64 user_data) {
+    __u32 tail = *sq_tail_;
+    __u32 index = tail & sq_mask_;
+    struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = dirfd;
+    sqe->addr = reinterpret_cast<__u64>(name);
+    sqe->len = STATX_BASIC_STATS;
+    sqe->off = reinterpret_cast<__u64>(buf);
+    sqe->statx_flags = flags;
+    sqe->user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++unsubmitted_;
+  }
+
+  // Submits the queued requests and waits until at least one completion is
+  // available, then passes every available completion to done.
+  template <typename Done>
+  void SubmitAndReap(Done done) {
+    for (;;) {
+      int r = syscall(__NR_io_uring_enter, fd_, unsubmitted_, 1,
+                      IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (r >= 0) {
+        unsubmitted_ -= r;
+        break;
+      }
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        // The arguments are all ours: anything else is a bug, and the
+        // kernel may still be writing into the in-flight buffers.
+        BAZEL_LOG(FATAL) << "io_uring_enter failed: " << ErrorMessage(errno);
+      }
+      if (HasCompletion()) {
+        break;
+      }
+    }
+    __u32 head = *cq_head_;
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+      done(cqe.user_data, cqe.res);
+      ++head;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+ private:
+  bool HasCompletion() const {
+    return *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  }
+
+  bool SupportsStatx() const {
+    size_t size = sizeof(struct io_uring_probe) +
+                  (IORING_OP_STATX + 1) * sizeof(struct io_uring_probe_op);
+    std::vector<char> buf(size);
+    struct io_uring_probe *probe =
+        reinterpret_cast<struct io_uring_probe *>(buf.data());
+    return syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe,
+                   IORING_OP_STATX + 1) == 0 &&
+           probe->last_op >= IORING_OP_STATX &&
+           (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  int fd_ = -1;
+  unsigned entries_ = 0;
+  unsigned unsubmitted_ = 0;
+  void *sq_ring_ = MAP_FAILED;
+  void *cq_ring_ = MAP_FAILED;
+  void *sqes_ = MAP_FAILED;
+  size_t sq_ring_size_ = 0;
+  size_t cq_ring_size_ = 0;
+  size_t sqes_size_ = 0;
+  __u32 *sq_tail_ = nullptr;
+  __u32 sq_mask_ = 0;
+  __u32 *sq_array_ = nullptr;
+  __u32 *cq_head_ = nullptr;
+  __u32 *cq_tail_ = nullptr;
+  __u32 cq_mask_ = 0;
+  struct io_uring_cqe *cqes_ = nullptr;
+};
+
+// Set once io_uring turns out to be unusable, to skip the setup next time.
+static std::atomic<bool> g_statx_ring_unavailable(false);
+#endif
+
+#ifdef BAZEL_HAVE_STATX
+static void StatxToStat(const struct statx &stx, portable_stat_struct *st) {
+  memset(st, 0, sizeof(*st));
+  st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+  st->st_ino = stx.stx_ino;
+  st->st_mode = stx.stx_mode;
+  st->st_nlink = stx.stx_nlink;
+  st->st_uid = stx.stx_uid;
+  st->st_gid = stx.stx_gid;
+  st->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+  st->st_size = stx.stx_size;
+  st->st_blksize = stx.stx_blksize;
+  st->st_blocks = stx.stx_blocks;
+  st->st_atim.tv_sec = stx.stx_atime.tv_sec;
+  st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+  st->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+  st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+  st->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+  st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
 }
 
-extern "C" JNIEXPORT void JNICALL
-Java_com_google_devtools_build_lib_profiler_SystemNetworkStats_getNetIoCountersNative(
-    JNIEnv *env, jclass clazz, jobject counters_list) {
-  // Currently not implemented.
+// Set once statx(2) turns out not to be there, e.g. under an old kernel.
+static std::atomic<bool> g_statx_unavailable(false);
+#endif
+}  // namespace
+
+int portable_stat_fields(const char *path, bool follow_symlinks, int fields,
+                         bool dont_sync, portable_stat_struct *statbuf) {
+#ifdef BAZEL_HAVE_STATX
+  if (!g_statx_unavailable.load(std::memory_order_relaxed)) {
+    unsigned int mask = 0;
+    if (fields & STAT_FIELD_MODE) mask |= STATX_TYPE | STATX_MODE;
+    if (fields & STAT_FIELD_MTIME) mask |= STATX_MTIME;
+    if (fields & STAT_FIELD_CTIME) mask |= STATX_CTIME;
+    if (fields & STAT_FIELD_SIZE) mask |= STATX_SIZE;
+    if (fields & STAT_FIELD_INO) mask |= STATX_INO;
+    int flags = (follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW) |
+                (dont_sync ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT);
+    struct statx stx;
+    if (syscall(__NR_statx, AT_FDCWD, path, flags, mask, &stx) == 0) {
+      StatxToStat(stx, statbuf);
+      return 0;
+    }
+    if (errno != ENOSYS) {
+      return -1;
+    }
+    g_statx_unavailable.store(true, std::memory_order_relaxed);
+  }
+#endif
+  return follow_symlinks ? portable_stat(path, statbuf)
+                         : portable_lstat(path, statbuf);
+}
+
+bool portable_fstatat_many(size_t count, const int *dirfds,
+                           const char *const *names, int flags,
+                           portable_stat_struct *stats, int *errnos) {
+#ifdef BAZEL_HAVE_STATX_RING
+  if (count < kMinStatxBatch || g_statx_ring_unavailable.load()) {
+    return false;
+  }
+  StatxRing ring;
+  if (!ring.Init(kStatxQueueDepth)) {
+    g_statx_ring_unavailable = true;
+    return false;
+  }
+  // Each in-flight request owns a slot of bufs, named by its user_data;
+  // entry_of_slot maps it back to the entry.
+  std::vector<struct statx> bufs(ring.entries());
+  std::vector<size_t> entry_of_slot(ring.entries());
+  std::vector<unsigned> free_slots(ring.entries());
+  for (unsigned i = 0; i < ring.entries(); ++i) {
+    free_slots[i] = ring.entries() - 1 - i;
+  }
+  size_t next = 0;
+  size_t completed = 0;
+  while (completed < count) {
+    while (next < count && !free_slots.empty()) {
+      unsigned slot = free_slots.back();
+      free_slots.pop_back();
+      entry_of_slot[slot] = next;
+      ring.QueueStatx(dirfds[next], names[next], flags, &bufs[slot], slot);
+      ++next;
+    }
+    ring.SubmitAndReap([&](__u64 slot, int res) {
+      size_t entry = entry_of_slot[slot];
+      if (res == -EINTR || res == -EAGAIN) {
+        // Not worth another round trip through the ring.
+        int r;
+        while ((r = portable_fstatat(dirfds[entry],
+                                     const_cast<char *>(names[entry]),
+                                     &stats[entry], flags)) == -1 &&
+               errno == EINTR) {
+        }
+        errnos[entry] = r == -1 ? errno : 0;
+      } else if (res < 0) {
+        errnos[entry] = -res;
+      } else {
+        errnos[entry] = 0;
+        StatxToStat(bufs[slot], &stats[entry]);
+      }
+      free_slots.push_back(slot);
+      ++completed;
+    });
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+// The file descriptors portable_process_stats() keeps open between samples,
+// guarded by g_process_stats_mutex. Like /proc/net/dev above, each pread of
+// /proc/self/io from offset 0 regenerates its contents.
+static std::mutex g_process_stats_mutex;
+static int g_proc_self_io_fd = -1;
+// The generic netlink socket for taskstats, -1 before trying to open it and
+// -2 if taskstats cannot be used.
+static int g_taskstats_fd = -1;
+static uint16_t g_taskstats_family = 0;
+
+// Reads the storage bytes of /proc/self/io, which counts the reads and
+// writes that went to the block layer.
+static bool ReadProcSelfIo(int64_t *read_bytes, int64_t *write_bytes) {
+  if (g_proc_self_io_fd == -1) {
+    g_proc_self_io_fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+    if (g_proc_self_io_fd == -1) {
+      return false;
+    }
+  }
+  char buf[512];
+  ssize_t r;
+  while ((r = pread(g_proc_self_io_fd, buf, sizeof(buf) - 1, 0)) == -1 &&
+         errno == EINTR) {
+  }
+  if (r <= 0) {
+    return false;
+  }
+  buf[r] = '\0';
+  const char *read_field = strstr(buf, "\nread_bytes: ");
+  const char *write_field = strstr(buf, "\nwrite_bytes: ");
+  if (read_field == nullptr || write_field == nullptr) {
+    return false;
+  }
+  *read_bytes = strtoll(read_field + strlen("\nread_bytes: "), nullptr, 10);
+  *write_bytes = strtoll(write_field + strlen("\nwrite_bytes: "), nullptr, 10);
+  return true;
+}
+
+// A generic netlink request with room for one small attribute.
+struct GenlRequest {
+  struct nlmsghdr header;
+  struct genlmsghdr genl;
+  char attrs[64];
+};
+
+// Sends a request for cmd on family with a single attribute, and receives
+// the reply into buf. Returns the size of the reply, or -1.
+static ssize_t GenlRoundTrip(int fd, uint16_t family, uint8_t cmd,
+                             uint16_t attr_type, const void *attr_data,
+                             uint16_t attr_size, char *buf, size_t buf_size) {
+  GenlRequest request;
+  memset(&request, 0, sizeof(request));
+  struct nlattr *attr = reinterpret_cast<struct nlattr *>(request.attrs);
+  attr->nla_type = attr_type;
+  attr->nla_len = NLA_HDRLEN + attr_size;
+  memcpy(reinterpret_cast<char *>(attr) + NLA_HDRLEN, attr_data, attr_size);
+  request.header.nlmsg_len =
+      NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(attr->nla_len);
+  request.header.nlmsg_type = family;
+  request.header.nlmsg_flags = NLM_F_REQUEST;
+  request.header.nlmsg_pid = 0;
+  request.genl.cmd = cmd;
+  request.genl.version = 1;
+  if (send(fd, &request, request.header.nlmsg_len, 0) == -1) {
+    return -1;
+  }
+  ssize_t r;
+  while ((r = recv(fd, buf, buf_size, 0)) == -1 && errno == EINTR) {
+  }
+  if (r < static_cast<ssize_t>(NLMSG_LENGTH(GENL_HDRLEN))) {
+    return -1;
+  }
+  const struct nlmsghdr *reply = reinterpret_cast<const struct nlmsghdr *>(buf);
+  if (!NLMSG_OK(reply, static_cast<size_t>(r)) ||
+      reply->nlmsg_type == NLMSG_ERROR) {
+    return -1;
+  }
+  return r;
+}
+
+// Calls visit(attr) for each attribute in [start, end).
+template <typename Visit>
+static void ForEachAttr(const char *start, const char *end, Visit visit) {
+  while (start + NLA_HDRLEN <= end) {
+    const struct nlattr *attr = reinterpret_cast<const struct nlattr *>(start);
+    if (attr->nla_len < NLA_HDRLEN || start + attr->nla_len > end) {
+      return;
+    }
+    visit(attr);
+    start += NLA_ALIGN(attr->nla_len);
+  }
+}
+
+static const char *AttrData(const struct nlattr *attr) {
+  return reinterpret_cast<const char *>(attr) + NLA_HDRLEN;
+}
+
+static const char *GenlAttrs(const char *reply) {
+  return reply + NLMSG_LENGTH(GENL_HDRLEN);
+}
+
+// Opens the taskstats generic netlink family into g_taskstats_fd and
+// g_taskstats_family. Returns false if it is not available.
+static bool OpenTaskstats() {
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+  if (fd == -1) {
+    return false;
+  }
+  struct sockaddr_nl address;
+  memset(&address, 0, sizeof(address));
+  address.nl_family = AF_NETLINK;
+  // Never wait for long on a reply: the profiler thread calls this.
+  struct timeval timeout = {1, 0};
+  char buf[1024];
+  ssize_t r = -1;
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&address),
+           sizeof(address)) == 0 &&
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ==
+          0) {
+    r = GenlRoundTrip(fd, GENL_ID_CTRL, CTRL_CMD_GETFAMILY,
+                      CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME,
+                      sizeof(TASKSTATS_GENL_NAME), buf, sizeof(buf));
+  }
+  uint16_t family = 0;
+  if (r != -1) {
+    ForEachAttr(GenlAttrs(buf), buf + r, [&](const struct nlattr *attr) {
+      if (attr->nla_type == CTRL_ATTR_FAMILY_ID &&
+          attr->nla_len >= NLA_HDRLEN + sizeof(uint16_t)) {
+        memcpy(&family, AttrData(attr), sizeof(family));
+      }
+    });
+  }
+  if (family == 0) {
+    close(fd);
+    return false;
+  }
+  g_taskstats_fd = fd;
+  g_taskstats_family = family;
+  return true;
+}
+
+// Reads the delays taskstats accumulates over all the threads of this
+// process, the exited ones included. Returns false if taskstats cannot be
+// used, or delay accounting is off (the kernel.task_delayacct sysctl).
+static bool ReadTaskstatsDelays(int64_t *cpu_delay_nanos,
+                                int64_t *blkio_delay_nanos) {
+  if (g_taskstats_fd == -2) {
+    return false;
+  }
+  if (g_taskstats_fd == -1 && !OpenTaskstats()) {
+    g_taskstats_fd = -2;
+    return false;
+  }
+  uint32_t tgid = getpid();
+  char buf[1024];
+  ssize_t r = GenlRoundTrip(g_taskstats_fd, g_taskstats_family,
+                            TASKSTATS_CMD_GET, TASKSTATS_CMD_ATTR_TGID, &tgid,
+                            sizeof(tgid), buf, sizeof(buf));
+  if (r == -1) {
+    return false;
+  }
+  struct taskstats stats;
+  memset(&stats, 0, sizeof(stats));
+  bool found = false;
+  ForEachAttr(GenlAttrs(buf), buf + r, [&](const struct nlattr *aggr) {
+    if (aggr->nla_type != TASKSTATS_TYPE_AGGR_TGID) {
+      return;
+    }
+    ForEachAttr(AttrData(aggr), reinterpret_cast<const char *>(aggr) +
+                                    aggr->nla_len,
+                [&](const struct nlattr *attr) {
+                  if (attr->nla_type == TASKSTATS_TYPE_STATS) {
+                    // Older kernels have a shorter struct.
+                    memcpy(&stats, AttrData(attr),
+                           std::min<size_t>(attr->nla_len - NLA_HDRLEN,
+                                            sizeof(stats)));
+                    found = true;
+                  }
+                });
+  });
+  // Without delay accounting, no delay is ever counted.
+  if (!found || stats.cpu_count == 0) {
+    return false;
+  }
+  *cpu_delay_nanos = stats.cpu_delay_total;
+  *blkio_delay_nanos = stats.blkio_delay_total;
+  return true;
+}
+
+// Sums the run queue wait times, the second field of schedstat, of the live
+// threads of this process. Unlike taskstats, this misses the exited threads.
+static bool SumSchedstatWaits(int64_t *wait_nanos) {
+  DIR *dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return false;
+  }
+  int64_t sum = 0;
+  bool any = false;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/schedstat", entry->d_name);
+    int fd = openat(dirfd(dir), path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      // The thread exited meanwhile.
+      continue;
+    }
+    char buf[128];
+    ssize_t r = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    unsigned long long run_nanos, wait_nanos_of_thread;
+    if (r > 0) {
+      buf[r] = '\0';
+      if (sscanf(buf, "%llu %llu", &run_nanos, &wait_nanos_of_thread) == 2) {
+        sum += wait_nanos_of_thread;
+        any = true;
+      }
+    }
+  }
+  closedir(dir);
+  *wait_nanos = sum;
+  return any;
+}
+
+bool portable_process_stats(ProcessStats *stats) {
+  std::lock_guard<std::mutex> lock(g_process_stats_mutex);
+  bool any = false;
+  if (ReadProcSelfIo(&stats->read_bytes, &stats->write_bytes)) {
+    any = true;
+  } else {
+    stats->read_bytes = stats->write_bytes = -1;
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    stats->voluntary_context_switches = usage.ru_nvcsw;
+    stats->involuntary_context_switches = usage.ru_nivcsw;
+    any = true;
+  } else {
+    stats->voluntary_context_switches = -1;
+    stats->involuntary_context_switches = -1;
+  }
+  if (ReadTaskstatsDelays(&stats->run_queue_wait_nanos,
+                          &stats->io_wait_nanos)) {
+    any = true;
+  } else {
+    stats->io_wait_nanos = -1;
+    if (SumSchedstatWaits(&stats->run_queue_wait_nanos)) {
+      any = true;
+    } else {
+      stats->run_queue_wait_nanos = -1;
+    }
+  }
+  return any;
 }
 
 }  // namespace blaze_jni
@@ -21,10 +21,12 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "src/main/native/jni.h"
 #include "src/main/native/windows/file.h"
 #include "src/main/native/windows/jni-util.h"
+#include "src/main/native/windows/projfs.h"
 #include "src/main/native/windows/util.h"
 
 static bool CanReportError(JNIEnv* env, jobjectArray error_msg_holder) {
@@ -85,6 +87,58 @@ Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeGetChange
   return static_cast<jint>(result);
 }
 
+// The number of longs nativeReadDirectoryMetadata stores for each entry.
+static const jsize kDirectoryMetadataFields = 5;
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeReadDirectoryMetadata(
+    JNIEnv* env, jclass clazz, jstring path, jobjectArray names_holder,
+    jobjectArray metadata_holder, jobjectArray error_msg_holder) {
+  std::wstring wpath(bazel::windows::GetJavaWstring(env, path));
+  std::wstring error;
+  std::vector<bazel::windows::DirectoryEntryMetadata> entries;
+  int result =
+      bazel::windows::ReadDirectoryMetadata(wpath.c_str(), &entries, &error);
+  if (result != bazel::windows::ReadDirectoryMetadataResult::kSuccess) {
+    if (!error.empty() && CanReportError(env, error_msg_holder)) {
+      ReportLastError(bazel::windows::MakeErrorMessage(
+                          WSTR(__FILE__), __LINE__,
+                          L"nativeReadDirectoryMetadata", wpath, error),
+                      env, error_msg_holder);
+    }
+    return static_cast<jint>(result);
+  }
+
+  const jsize count = static_cast<jsize>(entries.size());
+  jobjectArray names =
+      env->NewObjectArray(count, env->FindClass("java/lang/String"), nullptr);
+  jlongArray metadata = env->NewLongArray(count * kDirectoryMetadataFields);
+  if (names == nullptr || metadata == nullptr) {
+    return bazel::windows::ReadDirectoryMetadataResult::kError;  // OOME
+  }
+  std::vector<jlong> fields(count * kDirectoryMetadataFields);
+  for (jsize i = 0; i < count; ++i) {
+    const bazel::windows::DirectoryEntryMetadata& entry = entries[i];
+    jstring name = env->NewString(
+        reinterpret_cast<const jchar*>(entry.name.c_str()), entry.name.size());
+    if (name == nullptr) {
+      return bazel::windows::ReadDirectoryMetadataResult::kError;  // OOME
+    }
+    env->SetObjectArrayElement(names, i, name);
+    env->DeleteLocalRef(name);
+    jlong* out = &fields[i * kDirectoryMetadataFields];
+    out[0] = entry.attributes;
+    out[1] = entry.reparse_tag;
+    out[2] = entry.change_time;
+    out[3] = entry.last_write_time;
+    out[4] = entry.size;
+  }
+  env->SetLongArrayRegion(metadata, 0, fields.size(), fields.data());
+  env->SetObjectArrayElement(names_holder, 0, names);
+  env->SetObjectArrayElement(metadata_holder, 0, metadata);
+  return static_cast<jint>(result);
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeGetLongPath(
     JNIEnv* env, jclass clazz, jstring path, jobjectArray result_holder,
@@ -182,3 +236,54 @@ Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeDeletePat
   }
   return result;
 }
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeDeleteTreesBelow(
+    JNIEnv* env, jclass clazz, jstring path, jint parallelism,
+    jobjectArray error_msg_holder) {
+  std::wstring wpath(bazel::windows::GetJavaWstring(env, path));
+  std::wstring error;
+  int result = bazel::windows::DeleteTreesBelow(wpath, parallelism, &error);
+  if (result != bazel::windows::DeletePathResult::kSuccess && !error.empty() &&
+      CanReportError(env, error_msg_holder)) {
+    ReportLastError(bazel::windows::MakeErrorMessage(
+                        WSTR(__FILE__), __LINE__, L"nativeDeleteTreesBelow",
+                        wpath, error),
+                    env, error_msg_holder);
+  }
+  return result;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeProjectTree(
+    JNIEnv* env, jclass clazz, jstring root, jobjectArray paths,
+    jobjectArray targets, jobjectArray error_msg_holder) {
+  std::wstring wroot(bazel::windows::GetJavaWstring(env, root));
+  const jsize count = env->GetArrayLength(paths);
+  std::vector<bazel::windows::ProjectedEntry> entries(count);
+  for (jsize i = 0; i < count; ++i) {
+    jstring path = static_cast<jstring>(env->GetObjectArrayElement(paths, i));
+    jstring target =
+        static_cast<jstring>(env->GetObjectArrayElement(targets, i));
+    entries[i].path = bazel::windows::GetJavaWstring(env, path);
+    entries[i].target = bazel::windows::GetJavaWstring(env, target);
+    env->DeleteLocalRef(path);
+    env->DeleteLocalRef(target);
+  }
+  std::wstring error;
+  int result = bazel::windows::ProjectTree(wroot, entries, &error);
+  if (result == bazel::windows::ProjectTreeResult::kError && !error.empty() &&
+      CanReportError(env, error_msg_holder)) {
+    ReportLastError(
+        bazel::windows::MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                         L"nativeProjectTree", wroot, error),
+        env, error_msg_holder);
+  }
+  return result;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsFileOperations_nativeRemoveProjectedTrees(
+    JNIEnv* env, jclass clazz) {
+  bazel::windows::RemoveProjectedTrees();
+}
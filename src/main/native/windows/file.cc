@@ -24,9 +24,16 @@
 #include <windows.h>
 #include <winioctl.h>
 
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "src/main/native/windows/util.h"
@@ -35,6 +42,13 @@
 #define IO_REPARSE_TAG_PROJFS 0x9000001C
 #endif
 
+// FILE_DISPOSITION_INFO_EX arrived with the Windows 10 1809 SDK.
+#ifndef FILE_DISPOSITION_FLAG_DELETE
+#define FILE_DISPOSITION_FLAG_DELETE 0x00000001
+#define FILE_DISPOSITION_FLAG_POSIX_SEMANTICS 0x00000002
+#define FILE_DISPOSITION_FLAG_IGNORE_READONLY_ATTRIBUTE 0x00000010
+#endif
+
 namespace bazel {
 namespace windows {
 
@@ -168,6 +182,136 @@ int GetChangeTime(const WCHAR* path, bool follow_reparse_points,
   return GetChangeTimeResult::kSuccess;
 }
 
+// Appends the entries of `info`, a buffer of FILE_ID_EXTD_DIR_INFO or
+// FILE_FULL_DIR_INFO records, to `result`.
+template <typename Info>
+static void AppendDirectoryEntries(const uint8_t* info,
+                                   std::vector<DirectoryEntryMetadata>* result,
+                                   DWORD (*reparse_tag)(const Info&)) {
+  for (;;) {
+    const Info& entry = *reinterpret_cast<const Info*>(info);
+    size_t name_len = entry.FileNameLength / sizeof(WCHAR);
+    bool dot_or_dotdot =
+        entry.FileName[0] == L'.' &&
+        (name_len == 1 || (name_len == 2 && entry.FileName[1] == L'.'));
+    if (!dot_or_dotdot) {
+      DirectoryEntryMetadata metadata;
+      metadata.name.assign(entry.FileName, name_len);
+      metadata.attributes = entry.FileAttributes;
+      metadata.reparse_tag =
+          (entry.FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0
+              ? reparse_tag(entry)
+              : 0;
+      metadata.change_time = entry.ChangeTime.QuadPart;
+      metadata.last_write_time = entry.LastWriteTime.QuadPart;
+      metadata.size = entry.EndOfFile.QuadPart;
+      result->push_back(std::move(metadata));
+    }
+    if (entry.NextEntryOffset == 0) {
+      return;
+    }
+    info += entry.NextEntryOffset;
+  }
+}
+
+static DWORD ExtdReparseTag(const FILE_ID_EXTD_DIR_INFO& entry) {
+  return entry.ReparsePointTag;
+}
+
+static DWORD FullReparseTag(const FILE_FULL_DIR_INFO& entry) {
+  // For reparse points the EaSize field holds the reparse tag, as the
+  // dwReserved0 field of WIN32_FIND_DATA does.
+  return entry.EaSize;
+}
+
+// Reads the entries of the directory open as `handle` into `result`. `path`
+// is only used in error messages.
+static int ReadDirectoryEntries(HANDLE handle, const WCHAR* path,
+                                std::vector<DirectoryEntryMetadata>* result,
+                                wstring* error);
+
+int ReadDirectoryMetadata(const WCHAR* path,
+                          std::vector<DirectoryEntryMetadata>* result,
+                          wstring* error) {
+  if (!IsAbsoluteNormalizedWindowsPath(path)) {
+    if (error) {
+      *error =
+          MakeErrorMessage(WSTR(__FILE__), __LINE__, L"ReadDirectoryMetadata",
+                           path, L"expected an absolute Windows path");
+    }
+    return ReadDirectoryMetadataResult::kError;
+  }
+
+  AutoHandle handle(CreateFileW(
+      path, FILE_LIST_DIRECTORY | FILE_READ_ATTRIBUTES,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr));
+  if (!handle.IsValid()) {
+    DWORD err = GetLastError();
+    if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND) {
+      return ReadDirectoryMetadataResult::kDoesNotExist;
+    } else if (err == ERROR_ACCESS_DENIED) {
+      return ReadDirectoryMetadataResult::kAccessDenied;
+    } else if (err == ERROR_DIRECTORY) {
+      return ReadDirectoryMetadataResult::kNotADirectory;
+    }
+    if (error) {
+      *error =
+          MakeErrorMessage(WSTR(__FILE__), __LINE__, L"CreateFileW", path, err);
+    }
+    return ReadDirectoryMetadataResult::kError;
+  }
+  return ReadDirectoryEntries(handle, path, result, error);
+}
+
+static int ReadDirectoryEntries(HANDLE handle, const WCHAR* path,
+                                std::vector<DirectoryEntryMetadata>* result,
+                                wstring* error) {
+  // Large enough for a few hundred entries per call. DWORD-aligned, as the
+  // records must be.
+  std::unique_ptr<DWORD[]> buffer(new DWORD[16 * 1024]);
+  const DWORD buffer_size = 16 * 1024 * sizeof(DWORD);
+  FILE_INFO_BY_HANDLE_CLASS info_class = FileIdExtdDirectoryInfo;
+  result->clear();
+  for (;;) {
+    if (!GetFileInformationByHandleEx(handle, info_class, buffer.get(),
+                                      buffer_size)) {
+      DWORD err = GetLastError();
+      if (err == ERROR_NO_MORE_FILES) {
+        return ReadDirectoryMetadataResult::kSuccess;
+      }
+      if ((err == ERROR_INVALID_PARAMETER || err == ERROR_INVALID_LEVEL ||
+           err == ERROR_NOT_SUPPORTED) &&
+          result->empty()) {
+        // Either a file, or a file system (e.g. FAT or some network shares)
+        // without FileIdExtdDirectoryInfo.
+        FILE_BASIC_INFO basic_info;
+        if (GetFileInformationByHandleEx(handle, FileBasicInfo, &basic_info,
+                                         sizeof(basic_info)) &&
+            (basic_info.FileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+          return ReadDirectoryMetadataResult::kNotADirectory;
+        }
+        if (info_class == FileIdExtdDirectoryInfo) {
+          info_class = FileFullDirectoryInfo;
+          continue;
+        }
+      }
+      if (error) {
+        *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                  L"GetFileInformationByHandleEx", path, err);
+      }
+      return ReadDirectoryMetadataResult::kError;
+    }
+    const uint8_t* info = reinterpret_cast<const uint8_t*>(buffer.get());
+    if (info_class == FileIdExtdDirectoryInfo) {
+      AppendDirectoryEntries<FILE_ID_EXTD_DIR_INFO>(info, result,
+                                                    ExtdReparseTag);
+    } else {
+      AppendDirectoryEntries<FILE_FULL_DIR_INFO>(info, result, FullReparseTag);
+    }
+  }
+}
+
 wstring GetLongPath(const WCHAR* path, unique_ptr<WCHAR[]>* result) {
   if (!IsAbsoluteNormalizedWindowsPath(path)) {
     return MakeErrorMessage(WSTR(__FILE__), __LINE__, L"GetLongPath", path,
@@ -801,6 +945,245 @@ int DeletePath(const wstring& path, wstring* error) {
   return DeletePathResult::kSuccess;
 }
 
+namespace {
+
+// Deletes the trees below a directory, with up to `nthreads` threads reading
+// and deleting directories from a shared queue.
+//
+// Entries are deleted with POSIX semantics where the file system supports
+// them (NTFS since Windows 10 1809): their names disappear as soon as the
+// deleting handle is closed, even if another process (e.g. a virus scanner)
+// still has them open, so their parent directory can be deleted right away
+// instead of after DeletePath's retries.
+class ParallelTreeDeleter {
+ public:
+  explicit ParallelTreeDeleter(int nthreads)
+      : nthreads_(nthreads),
+        posix_semantics_(true),
+        done_(false),
+        result_(DeletePathResult::kSuccess) {}
+
+  ParallelTreeDeleter(const ParallelTreeDeleter&) = delete;
+  ParallelTreeDeleter& operator=(const ParallelTreeDeleter&) = delete;
+
+  int DeleteTreesBelow(const wstring& path, wstring* error) {
+    Push(nullptr, path);
+    WorkerLoop();
+    std::vector<std::thread> threads;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      threads.swap(threads_);
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    if (result_ == DeletePathResult::kError && error) {
+      *error = error_;
+    }
+    return result_;
+  }
+
+ private:
+  struct DeleteNode {
+    DeleteNode* parent;
+    wstring path;
+    // The subdirectories not deleted yet, plus one until the entries of the
+    // directory have all been read.
+    std::atomic<int> pending;
+  };
+
+  void Push(DeleteNode* parent, const wstring& path) {
+    std::lock_guard<std::mutex> lock(mu_);
+    nodes_.emplace_back();
+    DeleteNode* node = &nodes_.back();
+    node->parent = parent;
+    node->path = path;
+    node->pending = 1;
+    queue_.push_back(node);
+    // No thread may start once done_ is set, as DeleteTreesBelow would not
+    // join it.
+    if (!done_ && queue_.size() > 1 && threads_.size() + 1 < nthreads_) {
+      try {
+        threads_.emplace_back(&ParallelTreeDeleter::WorkerLoop, this);
+      } catch (const std::system_error&) {
+        // Out of threads: the ones already started will do.
+        nthreads_ = threads_.size() + 1;
+      }
+    }
+    cv_.notify_one();
+  }
+
+  void WorkerLoop() {
+    for (;;) {
+      DeleteNode* node;
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        cv_.wait(lock, [this] { return done_ || !queue_.empty(); });
+        if (done_) {
+          return;
+        }
+        node = queue_.front();
+        queue_.pop_front();
+      }
+      DeleteEntriesOf(node);
+    }
+  }
+
+  // Deletes the files and links in the directory of `node` and queues its
+  // subdirectories.
+  void DeleteEntriesOf(DeleteNode* node) {
+    AutoHandle handle(CreateFileW(
+        node->path.c_str(), DELETE | FILE_LIST_DIRECTORY | FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT,
+        nullptr));
+    if (!handle.IsValid()) {
+      wstring error;
+      int result = GetResultFromErrorCode(L"CreateFileW", node->path,
+                                          GetLastError(), &error);
+      if (result != DeletePathResult::kDoesNotExist) {
+        Fail(result, error);
+        return;
+      }
+      // Deleted by someone else in the meantime.
+    } else {
+      std::vector<DirectoryEntryMetadata> entries;
+      wstring error;
+      int result =
+          ReadDirectoryEntries(handle, node->path.c_str(), &entries, &error);
+      if (result == ReadDirectoryMetadataResult::kNotADirectory) {
+        error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow",
+                                 node->path, L"not a directory");
+      }
+      if (result != ReadDirectoryMetadataResult::kSuccess) {
+        Fail(DeletePathResult::kError, error);
+        return;
+      }
+      for (const DirectoryEntryMetadata& entry : entries) {
+        wstring child = node->path + L"\\" + entry.name;
+        if ((entry.attributes & FILE_ATTRIBUTE_DIRECTORY) != 0 &&
+            (entry.attributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0) {
+          ++node->pending;
+          Push(node, child);
+          continue;
+        }
+        // Files, and links to files or directories, which are deleted
+        // themselves.
+        AutoHandle no_handle;
+        result = DeleteEntry(child, &no_handle, &error);
+        if (result != DeletePathResult::kSuccess &&
+            result != DeletePathResult::kDoesNotExist) {
+          Fail(result, error);
+          return;
+        }
+      }
+    }
+    Release(node, &handle);
+  }
+
+  // Drops a reference to `node`, deleting its directory (using `handle` if
+  // valid) once all its entries are gone, then its parent's if that was the
+  // last one, and so on. The top directory itself is kept.
+  void Release(DeleteNode* node, AutoHandle* handle) {
+    while (--node->pending == 0) {
+      if (node->parent == nullptr) {
+        std::lock_guard<std::mutex> lock(mu_);
+        done_ = true;
+        cv_.notify_all();
+        return;
+      }
+      wstring error;
+      int result = DeleteEntry(node->path, handle, &error);
+      if (result != DeletePathResult::kSuccess &&
+          result != DeletePathResult::kDoesNotExist) {
+        Fail(result, error);
+        return;
+      }
+      *handle = INVALID_HANDLE_VALUE;
+      node = node->parent;
+    }
+  }
+
+  // Deletes the file, link or empty directory at `path`, which `handle` has
+  // open with DELETE access if valid. Closes `handle`.
+  int DeleteEntry(const wstring& path, AutoHandle* handle, wstring* error) {
+    if (posix_semantics_) {
+      if (!handle->IsValid()) {
+        *handle = CreateFileW(
+            path.c_str(), DELETE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+            OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT,
+            nullptr);
+        if (!handle->IsValid()) {
+          return GetResultFromErrorCode(L"CreateFileW", path, GetLastError(),
+                                        error);
+        }
+      }
+      // The layout of FILE_DISPOSITION_INFO_EX.
+      DWORD flags = FILE_DISPOSITION_FLAG_DELETE |
+                    FILE_DISPOSITION_FLAG_POSIX_SEMANTICS |
+                    FILE_DISPOSITION_FLAG_IGNORE_READONLY_ATTRIBUTE;
+      if (SetFileInformationByHandle(
+              *handle, static_cast<FILE_INFO_BY_HANDLE_CLASS>(21), &flags,
+              sizeof(flags))) {  // FileDispositionInfoEx
+        *handle = INVALID_HANDLE_VALUE;
+        return DeletePathResult::kSuccess;
+      }
+      DWORD err = GetLastError();
+      if (err == ERROR_DIR_NOT_EMPTY) {
+        return DeletePathResult::kDirectoryNotEmpty;
+      }
+      if (err != ERROR_INVALID_PARAMETER && err != ERROR_INVALID_FUNCTION &&
+          err != ERROR_NOT_SUPPORTED) {
+        return GetResultFromErrorCode(L"SetFileInformationByHandle", path, err,
+                                      error);
+      }
+      // An older Windows or another file system: delete the Win32 way.
+      posix_semantics_ = false;
+    }
+    // DeletePath cannot remove a directory we still have open.
+    *handle = INVALID_HANDLE_VALUE;
+    return DeletePath(path, error);
+  }
+
+  void Fail(int result, const wstring& error) {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (result_ == DeletePathResult::kSuccess) {
+      result_ = result;
+      error_ = error;
+    }
+    done_ = true;
+    cv_.notify_all();
+  }
+
+  size_t nthreads_;
+  std::atomic<bool> posix_semantics_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  // Guarded by mu_; nodes_ keeps the addresses of its elements stable.
+  std::deque<DeleteNode> nodes_;
+  std::deque<DeleteNode*> queue_;
+  std::vector<std::thread> threads_;
+  bool done_;
+  int result_;
+  wstring error_;
+};
+
+}  // namespace
+
+int DeleteTreesBelow(const wstring& path, int parallelism, wstring* error) {
+  if (!IsAbsoluteNormalizedWindowsPath(path)) {
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"DeleteTreesBelow",
+                                path, L"expected an absolute Windows path");
+    }
+    return DeletePathResult::kError;
+  }
+  ParallelTreeDeleter deleter(parallelism < 1 ? 1 : parallelism);
+  return deleter.DeleteTreesBelow(AddUncPrefixMaybe(path), error);
+}
+
 template <typename C>
 std::basic_string<C> NormalizeImpl(const std::basic_string<C>& p) {
   if (p.empty()) {
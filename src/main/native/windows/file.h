@@ -26,6 +26,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace bazel {
 namespace windows {
@@ -137,6 +138,29 @@ struct ReadSymlinkOrJunctionResult {
   };
 };
 
+// Keep in sync with j.c.g.devtools.build.lib.windows.WindowsFileOperations
+struct ReadDirectoryMetadataResult {
+  enum {
+    kSuccess = 0,
+    kError = 1,
+    kDoesNotExist = 2,
+    kAccessDenied = 3,
+    kNotADirectory = 4,
+  };
+};
+
+// Metadata of a directory entry, as read by ReadDirectoryMetadata.
+struct DirectoryEntryMetadata {
+  wstring name;
+  DWORD attributes;
+  // The reparse tag if `attributes` has FILE_ATTRIBUTE_REPARSE_POINT, else 0.
+  DWORD reparse_tag;
+  // FILETIMEs, like the result of GetChangeTime.
+  int64_t change_time;
+  int64_t last_write_time;
+  int64_t size;
+};
+
 // Determines whether `path` is a junction (or directory symlink).
 //
 // `path` should be an absolute, normalized, Windows-style path, with "\\?\"
@@ -153,6 +177,23 @@ int IsSymlinkOrJunction(const WCHAR* path, bool* result, wstring* error);
 int GetChangeTime(const WCHAR* path, bool follow_reparse_points,
                   int64_t* result, wstring* error);
 
+// Reads the metadata of all entries of the directory `path`, except "." and
+// "..", into `result`.
+//
+// Unlike calling IsSymlinkOrJunction and GetChangeTime for every entry, which
+// opens (and has antivirus software scan) a handle for each of them, this
+// lists the directory through a single handle with
+// GetFileInformationByHandleEx(FileIdExtdDirectoryInfo), falling back to
+// FileFullDirectoryInfo on file systems that do not support it.
+//
+// `path` should be an absolute, normalized, Windows-style path, with "\\?\"
+// prefix if it's longer than MAX_PATH. Returns a ReadDirectoryMetadataResult;
+// when it is kError and `error` is non-null, `error` receives an error
+// message.
+int ReadDirectoryMetadata(const WCHAR* path,
+                          std::vector<DirectoryEntryMetadata>* result,
+                          wstring* error);
+
 // Computes the long version of `path` if it has any 8dot3 style components.
 // Returns the empty string upon success, or a human-readable error message upon
 // failure.
@@ -205,6 +246,13 @@ int ReadSymlinkOrJunction(const wstring& path, wstring* result, wstring* error);
 // function writes an error message into it.
 int DeletePath(const wstring& path, wstring* error);
 
+// Deletes everything below the directory `path`, but not `path` itself, on up
+// to `parallelism` threads. Returns DeletePathResult::kSuccess, or the result
+// of the first entry that could not be deleted. When that is
+// DeletePathResult::kError and `error` is non-null, `error` receives an error
+// message.
+int DeleteTreesBelow(const wstring& path, int parallelism, wstring* error);
+
 // Returns a normalized form of the input `path`.
 //
 // Normalization:
@@ -20,6 +20,7 @@
 
 #include <versionhelpers.h>
 #include <windows.h>
+#include <psapi.h>
 
 #include <memory>
 #include <sstream>
@@ -171,7 +172,12 @@ bool WaitableProcess::Create(const std::wstring& argv0,
   PROCESS_INFORMATION process_info = {0};
   STARTUPINFOEXW info;
   attr_list->InitStartupInfoExW(&info);
-  if (!CreateProcessW(
+  if (!attr_list->MakeInheritable(&error_msg)) {
+    *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                              L"WaitableProcess::Create", L"", error_msg);
+    return false;
+  }
+  BOOL created = CreateProcessW(
           /* lpApplicationName */ nullptr,
           /* lpCommandLine */ mutable_commandline.get(),
           /* lpProcessAttributes */ nullptr,
@@ -186,9 +192,12 @@ bool WaitableProcess::Create(const std::wstring& argv0,
           /* lpEnvironment */ env,
           /* lpCurrentDirectory */ cwd.empty() ? nullptr : cwd.c_str(),
           /* lpStartupInfo */ &info.StartupInfo,
-          /* lpProcessInformation */ &process_info)) {
-    DWORD err = GetLastError();
-
+          /* lpProcessInformation */ &process_info);
+  DWORD err = GetLastError();
+  // The child has its copies of the handles now, so no other child may get
+  // them.
+  attr_list->RestoreInheritance();
+  if (!created) {
     std::wstring errmsg;
     if (err == ERROR_NO_SYSTEM_RESOURCES && !IsWindows8OrGreater() &&
         attr_list->HasConsoleHandle()) {
@@ -295,7 +304,15 @@ int WaitableProcess::WaitFor(int64_t timeout_msec,
              CompletionCode == JOB_OBJECT_MSG_ACTIVE_PROCESS_ZERO)) {
       // Still waiting...
     }
+  }
 
+  // Record the final resource usage while we still have the handles to query
+  // it. Resource accounting is best-effort, so a failure here is not an error
+  // of the wait.
+  std::wstring usage_error;
+  has_final_usage_ = QueryResourceUsage(&final_usage_, &usage_error);
+
+  if (job_.IsValid()) {
     job_ = INVALID_HANDLE_VALUE;
     ioport_ = INVALID_HANDLE_VALUE;
   }
@@ -325,6 +342,77 @@ int WaitableProcess::GetExitCode(std::wstring* error) {
   return exit_code_;
 }
 
+bool WaitableProcess::GetResourceUsage(ResourceUsage* usage,
+                                       std::wstring* error) {
+  if (has_final_usage_) {
+    *usage = final_usage_;
+    return true;
+  }
+  return QueryResourceUsage(usage, error);
+}
+
+bool WaitableProcess::QueryResourceUsage(ResourceUsage* usage,
+                                         std::wstring* error) {
+  if (job_.IsValid()) {
+    JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting;
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits;
+    if (!QueryInformationJobObject(
+            job_, JobObjectBasicAndIoAccountingInformation, &accounting,
+            sizeof(accounting), nullptr) ||
+        !QueryInformationJobObject(job_, JobObjectExtendedLimitInformation,
+                                   &limits, sizeof(limits), nullptr)) {
+      DWORD err_code = GetLastError();
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                L"WaitableProcess::QueryResourceUsage",
+                                ToString(pid_), err_code);
+      return false;
+    }
+    usage->user_time = accounting.BasicInfo.TotalUserTime.QuadPart;
+    usage->kernel_time = accounting.BasicInfo.TotalKernelTime.QuadPart;
+    usage->peak_memory = limits.PeakJobMemoryUsed;
+    usage->read_operations = accounting.IoInfo.ReadOperationCount;
+    usage->write_operations = accounting.IoInfo.WriteOperationCount;
+    usage->read_bytes = accounting.IoInfo.ReadTransferCount;
+    usage->write_bytes = accounting.IoInfo.WriteTransferCount;
+    return true;
+  }
+
+  // Without a job object (see Create()), only the direct child is accounted
+  // for.
+  if (process_.IsValid()) {
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    IO_COUNTERS io;
+    PROCESS_MEMORY_COUNTERS memory;
+    if (!GetProcessTimes(process_, &creation_time, &exit_time, &kernel_time,
+                         &user_time) ||
+        !GetProcessIoCounters(process_, &io) ||
+        !K32GetProcessMemoryInfo(process_, &memory, sizeof(memory))) {
+      DWORD err_code = GetLastError();
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                L"WaitableProcess::QueryResourceUsage",
+                                ToString(pid_), err_code);
+      return false;
+    }
+    usage->user_time =
+        (static_cast<uint64_t>(user_time.dwHighDateTime) << 32) |
+        user_time.dwLowDateTime;
+    usage->kernel_time =
+        (static_cast<uint64_t>(kernel_time.dwHighDateTime) << 32) |
+        kernel_time.dwLowDateTime;
+    usage->peak_memory = memory.PeakPagefileUsage;
+    usage->read_operations = io.ReadOperationCount;
+    usage->write_operations = io.WriteOperationCount;
+    usage->read_bytes = io.ReadTransferCount;
+    usage->write_bytes = io.WriteTransferCount;
+    return true;
+  }
+
+  *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                            L"WaitableProcess::QueryResourceUsage",
+                            ToString(pid_), L"process is not running");
+  return false;
+}
+
 bool WaitableProcess::Terminate(std::wstring* error) {
   static constexpr UINT exit_code = 130;  // 128 + SIGINT, like on Linux
 
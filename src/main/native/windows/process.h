@@ -28,6 +28,20 @@
 namespace bazel {
 namespace windows {
 
+// Resources used by a process and all of its subprocesses.
+struct ResourceUsage {
+  // CPU time spent in user mode and in kernel mode, in 100-nanosecond units.
+  uint64_t user_time;
+  uint64_t kernel_time;
+  // Peak amount of committed memory of the job, in bytes.
+  uint64_t peak_memory;
+  // Number of I/O operations and bytes transferred.
+  uint64_t read_operations;
+  uint64_t write_operations;
+  uint64_t read_bytes;
+  uint64_t write_bytes;
+};
+
 class WaitableProcess {
  public:
   // These are the possible return values from the WaitFor() method.
@@ -37,7 +51,8 @@ class WaitableProcess {
     kWaitError = 2,
   };
 
-  WaitableProcess() : pid_(0), exit_code_(STILL_ACTIVE) {}
+  WaitableProcess()
+      : pid_(0), exit_code_(STILL_ACTIVE), has_final_usage_(false) {}
 
   bool Create(const std::wstring& argv0, const std::wstring& argv_rest,
               void* env, const std::wstring& wcwd, std::wstring* error);
@@ -54,6 +69,11 @@ class WaitableProcess {
 
   bool Terminate(std::wstring* error);
 
+  // Retrieves the resources used so far by the process and its subprocesses.
+  // Once WaitFor() has returned, this reports the final usage, which WaitFor()
+  // records before it closes the job object.
+  bool GetResourceUsage(ResourceUsage* usage, std::wstring* error);
+
   DWORD GetPid() const { return pid_; }
 
  private:
@@ -63,8 +83,12 @@ class WaitableProcess {
               LARGE_INTEGER* opt_out_start_time, bool create_window,
               bool handle_signals, std::wstring* error);
 
+  bool QueryResourceUsage(ResourceUsage* usage, std::wstring* error);
+
   AutoHandle process_, job_, ioport_;
   DWORD pid_, exit_code_;
+  ResourceUsage final_usage_;
+  bool has_final_usage_;
 };
 
 // Escape a command line argument using Windows escaping syntax.
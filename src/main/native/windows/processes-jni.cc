@@ -21,11 +21,18 @@
 #include <stdint.h>
 #include <wchar.h>
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>  // NOLINT
+#include <deque>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>  // NOLINT
 #include <type_traits>  // static_assert
+#include <vector>
 
 #include "src/main/native/jni.h"
 #include "src/main/native/windows/file.h"
@@ -78,91 +85,207 @@ class JavaByteArray {
   jbyte* ptr_;
 };
 
+// The size of each overlapped read from a child's stdout or stderr.
+static const DWORD kStreamBufferSize = PIPE_SIZE;
+
+// The number of bytes a stream buffers before it stops reading the pipe until
+// Java has consumed some of them, at which point the child blocks on the pipe
+// as it would if nothing read it.
+static const size_t kMaxStreamBufferedBytes = 16 * kStreamBufferSize;
+
+// The number of read buffers kept for reuse once their streams are done with
+// them.
+static const size_t kMaxPooledStreamBuffers = 64;
+
+// Stream buffers, recycled among all streams so that a process with little
+// output doesn't cost an allocation per read.
+class StreamBufferPool {
+ public:
+  static std::unique_ptr<char[]> Get() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        std::unique_ptr<char[]> buffer = std::move(free_.back());
+        free_.pop_back();
+        return buffer;
+      }
+    }
+    return std::unique_ptr<char[]>(new char[kStreamBufferSize]);
+  }
+
+  static void Put(std::unique_ptr<char[]> buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < kMaxPooledStreamBuffers) {
+      free_.push_back(std::move(buffer));
+    }
+  }
+
+ private:
+  static std::mutex mutex_;
+  static std::vector<std::unique_ptr<char[]>> free_;
+};
+
+std::mutex StreamBufferPool::mutex_;
+std::vector<std::unique_ptr<char[]>> StreamBufferPool::free_;
+
+class NativeOutputStream;
+
+// A single I/O completion port, serviced by a single thread, through which
+// the stdout and stderr pipes of all child processes are read. Each stream
+// keeps one overlapped read pending and buffers what it gets, so that no
+// thread is blocked in a ReadFile per pipe and the children don't stall on
+// full pipes while Java is busy elsewhere.
+class StreamCompletionPort {
+ public:
+  // Returns the port, creating it and its thread on the first call. Returns
+  // null and sets *err_code if they could not be created.
+  static StreamCompletionPort* Get(DWORD* err_code);
+
+  // Makes the completions of the overlapped reads of pipe go to stream.
+  bool Associate(HANDLE pipe, NativeOutputStream* stream, DWORD* err_code) {
+    if (CreateIoCompletionPort(pipe, port_,
+                               reinterpret_cast<ULONG_PTR>(stream),
+                               0) == nullptr) {
+      *err_code = GetLastError();
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  explicit StreamCompletionPort(HANDLE port) : port_(port) {}
+
+  void Run();
+
+  const HANDLE port_;
+};
+
 class NativeOutputStream {
  public:
   NativeOutputStream()
-      : handle_(INVALID_HANDLE_VALUE), error_(L""), closed_(false) {}
+      : handle_(INVALID_HANDLE_VALUE),
+        overlapped_(),
+        read_pending_(false),
+        buffered_bytes_(0),
+        eof_(false),
+        err_code_(ERROR_SUCCESS),
+        error_(L""),
+        closed_(false) {}
 
   void Close() {
+    std::unique_lock<std::mutex> lock(mutex_);
     closed_.store(true);
+    cond_.notify_all();
     if (handle_ == INVALID_HANDLE_VALUE) {
       return;
     }
 
+    // The completion of the pending read, if any, refers to this object, so
+    // it must be in before the handle is closed and this object deleted.
+    //
     // CancelIoEx only cancels I/O operations in the current process.
     // https://msdn.microsoft.com/en-us/library/windows/desktop/aa363792(v=vs.85).aspx
     //
     // Therefore if this process bequested `handle_` to a child process, we
     // cannot cancel I/O in the child process.
-    CancelIoEx(handle_, nullptr);
+    if (read_pending_) {
+      CancelIoEx(handle_, &overlapped_);
+      cond_.wait(lock, [this] { return !read_pending_; });
+    }
     CloseHandle(handle_);
     handle_ = INVALID_HANDLE_VALUE;
+    for (Chunk& chunk : chunks_) {
+      StreamBufferPool::Put(std::move(chunk.data));
+    }
+    chunks_.clear();
+    buffered_bytes_ = 0;
   }
 
   void SetHandle(HANDLE handle) { handle_ = handle; }
 
+  // Starts reading the pipe through the completion port, once the process
+  // that writes it is running.
+  void Start() {
+    if (handle_ == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    DWORD err_code;
+    StreamCompletionPort* port = StreamCompletionPort::Get(&err_code);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (port == nullptr || !port->Associate(handle_, this, &err_code)) {
+      err_code_ = err_code;
+      return;
+    }
+    IssueRead();
+  }
+
   jint StreamBytesAvailable(JNIEnv* env) {
+    std::lock_guard<std::mutex> lock(mutex_);
     if (closed_.load() || handle_ == INVALID_HANDLE_VALUE) {
       error_ = L"";
       return 0;
     }
-
-    DWORD avail = 0;
-    if (!::PeekNamedPipe(handle_, nullptr, 0, nullptr, &avail, nullptr)) {
-      // Check if either the other end closed the pipe or we did it with
-      // NativeOutputStream.Close() . In the latter case, we'll get a "system
-      // call interrupted" error.
-      if (GetLastError() == ERROR_BROKEN_PIPE || closed_.load()) {
-        error_ = L"";
-        return 0;
-      } else {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(WSTR(__FILE__), __LINE__,
-                                                  L"nativeStreamBytesAvailable",
-                                                  L"", err_code);
-        return -1;
-      }
-    } else {
-      error_ = L"";
+    if (buffered_bytes_ == 0 && err_code_ != ERROR_SUCCESS) {
+      error_ = bazel::windows::MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                                L"nativeStreamBytesAvailable",
+                                                L"", err_code_);
+      return -1;
     }
-    return avail;
+    error_ = L"";
+    // At most kMaxStreamBufferedBytes plus one read.
+    return static_cast<jint>(buffered_bytes_);
   }
 
   jint ReadStream(JNIEnv* env, jbyteArray java_bytes, jint offset,
                   jint length) {
-    JavaByteArray bytes(env, java_bytes);
-    if (offset < 0 || length <= 0 || offset > bytes.size() - length) {
+    if (java_bytes == nullptr || offset < 0 || length <= 0 ||
+        offset > env->GetArrayLength(java_bytes) - length) {
       error_ = bazel::windows::MakeErrorMessage(WSTR(__FILE__), __LINE__,
                                                 L"nativeReadStream", L"",
                                                 L"Array index out of bounds");
       return -1;
     }
 
-    if (handle_ == INVALID_HANDLE_VALUE || closed_.load()) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] {
+      return buffered_bytes_ > 0 || eof_ || err_code_ != ERROR_SUCCESS ||
+             closed_.load() || handle_ == INVALID_HANDLE_VALUE;
+    });
+    if (closed_.load() || handle_ == INVALID_HANDLE_VALUE) {
       error_ = L"";
       return 0;
     }
-
-    DWORD bytes_read;
-    if (!::ReadFile(handle_, bytes.ptr() + offset, length, &bytes_read,
-                    nullptr)) {
-      // Check if either the other end closed the pipe or we did it with
-      // NativeOutputStream.Close() . In the latter case, we'll get a "system
-      // call interrupted" error.
-      if (GetLastError() == ERROR_BROKEN_PIPE || closed_.load()) {
-        // End of file.
+    if (buffered_bytes_ == 0) {
+      if (eof_) {
         error_ = L"";
-        bytes_read = 0;
-      } else {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeReadStream", L"", err_code);
-        bytes_read = -1;
+        return 0;
       }
-    } else {
-      error_ = L"";
+      error_ = bazel::windows::MakeErrorMessage(
+          WSTR(__FILE__), __LINE__, L"nativeReadStream", L"", err_code_);
+      return -1;
     }
 
+    // Hand over everything that fits, which may span several reads.
+    jint bytes_read = 0;
+    while (bytes_read < length && !chunks_.empty()) {
+      Chunk& chunk = chunks_.front();
+      jint n = static_cast<jint>(
+          std::min<DWORD>(chunk.end - chunk.begin, length - bytes_read));
+      env->SetByteArrayRegion(
+          java_bytes, offset + bytes_read, n,
+          reinterpret_cast<const jbyte*>(chunk.data.get() + chunk.begin));
+      chunk.begin += n;
+      bytes_read += n;
+      if (chunk.begin == chunk.end) {
+        StreamBufferPool::Put(std::move(chunk.data));
+        chunks_.pop_front();
+      }
+    }
+    buffered_bytes_ -= bytes_read;
+    if (!read_pending_ && !eof_ && err_code_ == ERROR_SUCCESS) {
+      IssueRead();
+    }
+    error_ = L"";
     return bytes_read;
   }
 
@@ -175,11 +298,169 @@ class NativeOutputStream {
   }
 
  private:
+  friend class StreamCompletionPort;
+
+  // A buffer the pipe was read into, of which the bytes in [begin, end) are
+  // yet to be handed to Java.
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    DWORD begin;
+    DWORD end;
+  };
+
+  // Starts an overlapped read into a fresh buffer, unless enough is buffered
+  // already. Must be called with mutex_ held.
+  void IssueRead() {
+    if (closed_.load() || buffered_bytes_ >= kMaxStreamBufferedBytes) {
+      return;
+    }
+    if (read_buffer_ == nullptr) {
+      read_buffer_ = StreamBufferPool::Get();
+    }
+    overlapped_ = OVERLAPPED();
+    // The completion is queued to the port even if the read finishes right
+    // away, so it is handled in one place.
+    if (!::ReadFile(handle_, read_buffer_.get(), kStreamBufferSize, nullptr,
+                    &overlapped_) &&
+        GetLastError() != ERROR_IO_PENDING) {
+      OnEndOfReads(GetLastError());
+      return;
+    }
+    read_pending_ = true;
+  }
+
+  // Called by the completion port thread when the pending read is done.
+  void OnReadCompleted(DWORD bytes_read, DWORD err_code) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    read_pending_ = false;
+    if (err_code != ERROR_SUCCESS) {
+      OnEndOfReads(err_code);
+    } else {
+      if (bytes_read > 0) {
+        chunks_.push_back({std::move(read_buffer_), 0, bytes_read});
+        buffered_bytes_ += bytes_read;
+      }
+      IssueRead();
+    }
+    cond_.notify_all();
+  }
+
+  // Records why the pipe cannot be read anymore. Must be called with mutex_
+  // held.
+  void OnEndOfReads(DWORD err_code) {
+    // Check if either the other end closed the pipe or we did it with
+    // NativeOutputStream.Close() . In the latter case, we'll get an "operation
+    // aborted" error.
+    if (err_code == ERROR_BROKEN_PIPE || closed_.load()) {
+      eof_ = true;
+    } else {
+      err_code_ = err_code;
+    }
+  }
+
   HANDLE handle_;
+  OVERLAPPED overlapped_;
+  std::unique_ptr<char[]> read_buffer_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool read_pending_;
+  std::deque<Chunk> chunks_;
+  size_t buffered_bytes_;
+  bool eof_;
+  DWORD err_code_;
   std::wstring error_;
   std::atomic<bool> closed_;
 };
 
+StreamCompletionPort* StreamCompletionPort::Get(DWORD* err_code) {
+  static DWORD create_err_code = ERROR_SUCCESS;
+  static StreamCompletionPort* instance = []() -> StreamCompletionPort* {
+    HANDLE port =
+        CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, /* threads */ 1);
+    if (port == nullptr) {
+      create_err_code = GetLastError();
+      return nullptr;
+    }
+    StreamCompletionPort* result = new StreamCompletionPort(port);
+    try {
+      std::thread(&StreamCompletionPort::Run, result).detach();
+    } catch (const std::system_error&) {
+      create_err_code = ERROR_NOT_ENOUGH_MEMORY;
+      CloseHandle(port);
+      delete result;
+      return nullptr;
+    }
+    return result;
+  }();
+  *err_code = create_err_code;
+  return instance;
+}
+
+void StreamCompletionPort::Run() {
+  // Handle the completions in batches, as several children often write at
+  // once.
+  OVERLAPPED_ENTRY entries[64];
+  for (;;) {
+    ULONG count = 0;
+    if (!GetQueuedCompletionStatusEx(port_, entries, 64, &count, INFINITE,
+                                     FALSE)) {
+      continue;
+    }
+    for (ULONG i = 0; i < count; ++i) {
+      NativeOutputStream* stream =
+          reinterpret_cast<NativeOutputStream*>(entries[i].lpCompletionKey);
+      // The status of the read is in the OVERLAPPED, as an NTSTATUS, so ask
+      // for it as a Win32 error.
+      DWORD bytes_read;
+      DWORD err_code = ERROR_SUCCESS;
+      if (!GetOverlappedResult(stream->handle_, entries[i].lpOverlapped,
+                               &bytes_read, FALSE)) {
+        err_code = GetLastError();
+        bytes_read = 0;
+      }
+      stream->OnReadCompleted(bytes_read, err_code);
+    }
+  }
+}
+
+// Creates a pipe for a child's stdout or stderr. Unlike CreatePipe, the
+// pipe's read end supports overlapped I/O. The write end is created with the
+// security attributes `sa`; the read end is never inheritable.
+static bool CreateOverlappedPipe(SECURITY_ATTRIBUTES* sa, HANDLE* read_h,
+                                 HANDLE* write_h) {
+  static std::atomic<uint64_t> pipe_id(0);
+  std::wstring name = L"\\\\.\\pipe\\bazel-" + ToString(GetCurrentProcessId()) +
+                      L"-" + ToString(pipe_id.fetch_add(1));
+  HANDLE read = CreateNamedPipeW(
+      name.c_str(),
+      PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      /* nMaxInstances */ 1, /* nOutBufferSize */ PIPE_SIZE,
+      /* nInBufferSize */ PIPE_SIZE, /* nDefaultTimeOut */ 0,
+      /* lpSecurityAttributes */ nullptr);
+  if (read == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  HANDLE write = CreateFileW(
+      /* lpFileName */ name.c_str(),
+      /* dwDesiredAccess */ GENERIC_WRITE,
+      /* dwShareMode */ 0,
+      /* lpSecurityAttributes */ sa,
+      /* dwCreationDisposition */ OPEN_EXISTING,
+      /* dwFlagsAndAttributes */ FILE_ATTRIBUTE_NORMAL,
+      /* hTemplateFile */ nullptr);
+  if (write == INVALID_HANDLE_VALUE) {
+    DWORD err_code = GetLastError();
+    CloseHandle(read);
+    SetLastError(err_code);
+    return false;
+  }
+  *read_h = read;
+  *write_h = write;
+  return true;
+}
+
 class NativeProcess {
  public:
   NativeProcess() : stdout_(), stderr_(), error_(L"") {}
@@ -210,9 +491,14 @@ class NativeProcess {
          _wcsnicmp(stderr_redirect.c_str(), stdout_redirect.c_str(),
                    stderr_redirect.size()) == 0);
 
+    // The child's ends of its standard handles are created non-inheritable.
+    // WaitableProcess::Create makes them inheritable only for the duration of
+    // the CreateProcessW call, so that processes created concurrently by
+    // other threads (e.g. by the JVM's ProcessBuilder, which passes no handle
+    // list) do not inherit them and keep the pipes open.
     SECURITY_ATTRIBUTES sa = {0};
     sa.nLength = sizeof(SECURITY_ATTRIBUTES);
-    sa.bInheritHandle = TRUE;
+    sa.bInheritHandle = FALSE;
 
     // Standard file handles are closed even if the process was successfully
     // created. If this was not so, operations on these file handles would not
@@ -253,14 +539,6 @@ class NativeProcess {
       }
       stdin_process = pipe_read_h;
       stdin_ = pipe_write_h;
-
-      // "Our" end of the pipe must not be inherited by the child process
-      if (!SetHandleInformation(pipe_write_h, HANDLE_FLAG_INHERIT, 0)) {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
-        return false;
-      }
     }
 
     if (!stdout_is_stream) {
@@ -293,7 +571,7 @@ class NativeProcess {
       }
     } else {
       HANDLE pipe_read_h, pipe_write_h;
-      if (!CreatePipe(&pipe_read_h, &pipe_write_h, &sa, PIPE_SIZE)) {
+      if (!CreateOverlappedPipe(&sa, &pipe_read_h, &pipe_write_h)) {
         DWORD err_code = GetLastError();
         error_ = bazel::windows::MakeErrorMessage(
             WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
@@ -301,19 +579,12 @@ class NativeProcess {
       }
       stdout_.SetHandle(pipe_read_h);
       stdout_process = pipe_write_h;
-      // "Our" end of the pipe must not be inherited by the child process
-      if (!SetHandleInformation(pipe_read_h, HANDLE_FLAG_INHERIT, 0)) {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
-        return false;
-      }
     }
 
     if (stderr_same_handle_as_stdout) {
       HANDLE stdout_process_dup_h;
       if (!DuplicateHandle(GetCurrentProcess(), stdout_process,
-                           GetCurrentProcess(), &stdout_process_dup_h, 0, TRUE,
+                           GetCurrentProcess(), &stdout_process_dup_h, 0, FALSE,
                            DUPLICATE_SAME_ACCESS)) {
         DWORD err_code = GetLastError();
         error_ = bazel::windows::MakeErrorMessage(
@@ -354,7 +625,7 @@ class NativeProcess {
       }
     } else {
       HANDLE pipe_read_h, pipe_write_h;
-      if (!CreatePipe(&pipe_read_h, &pipe_write_h, &sa, PIPE_SIZE)) {
+      if (!CreateOverlappedPipe(&sa, &pipe_read_h, &pipe_write_h)) {
         DWORD err_code = GetLastError();
         error_ = bazel::windows::MakeErrorMessage(
             WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
@@ -362,18 +633,16 @@ class NativeProcess {
       }
       stderr_.SetHandle(pipe_read_h);
       stderr_process = pipe_write_h;
-      // "Our" end of the pipe must not be inherited by the child process
-      if (!SetHandleInformation(pipe_read_h, HANDLE_FLAG_INHERIT, 0)) {
-        DWORD err_code = GetLastError();
-        error_ = bazel::windows::MakeErrorMessage(
-            WSTR(__FILE__), __LINE__, L"nativeCreateProcess", wpath, err_code);
-        return false;
-      }
     }
-    return proc_.Create(
-        wpath, bazel::windows::GetJavaWstring(env, java_argv_rest),
-        env_map.ptr(), bazel::windows::GetJavaWpath(env, java_cwd),
-        stdin_process, stdout_process, stderr_process, nullptr, &error_);
+    if (!proc_.Create(
+            wpath, bazel::windows::GetJavaWstring(env, java_argv_rest),
+            env_map.ptr(), bazel::windows::GetJavaWpath(env, java_cwd),
+            stdin_process, stdout_process, stderr_process, nullptr, &error_)) {
+      return false;
+    }
+    stdout_.Start();
+    stderr_.Start();
+    return true;
   }
 
   void CloseStdin() {
@@ -393,6 +662,32 @@ class NativeProcess {
 
   DWORD GetPid() const { return proc_.GetPid(); }
 
+  // Stores the resource usage of the process into java_usage in the order
+  // documented by WindowsProcesses.getResourceUsage.
+  bool GetResourceUsage(JNIEnv* env, jlongArray java_usage) {
+    bazel::windows::ResourceUsage usage;
+    if (!proc_.GetResourceUsage(&usage, &error_)) {
+      return false;
+    }
+    const jlong values[] = {static_cast<jlong>(usage.user_time),
+                            static_cast<jlong>(usage.kernel_time),
+                            static_cast<jlong>(usage.peak_memory),
+                            static_cast<jlong>(usage.read_operations),
+                            static_cast<jlong>(usage.write_operations),
+                            static_cast<jlong>(usage.read_bytes),
+                            static_cast<jlong>(usage.write_bytes)};
+    const jsize count = sizeof(values) / sizeof(values[0]);
+    if (env->GetArrayLength(java_usage) < count) {
+      error_ = bazel::windows::MakeErrorMessage(
+          WSTR(__FILE__), __LINE__, L"NativeProcess:GetResourceUsage",
+          ToString(GetPid()), L"Array too short");
+      return false;
+    }
+    env->SetLongArrayRegion(java_usage, 0, count, values);
+    error_ = L"";
+    return true;
+  }
+
   jint WriteStdin(JNIEnv* env, jbyteArray java_bytes, jint offset,
                   jint length) {
     JavaByteArray bytes(env, java_bytes);
@@ -539,6 +834,13 @@ Java_com_google_devtools_build_lib_windows_WindowsProcesses_getProcessPid(
   return static_cast<jint>(process->GetPid());
 }
 
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_windows_WindowsProcesses_getResourceUsage(
+    JNIEnv* env, jclass clazz, jlong process_long, jlongArray java_usage) {
+  NativeProcess* process = reinterpret_cast<NativeProcess*>(process_long);
+  return process->GetResourceUsage(env, java_usage) ? JNI_TRUE : JNI_FALSE;
+}
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_devtools_build_lib_windows_WindowsProcesses_terminate(
     JNIEnv* env, jclass clazz, jlong process_long) {
@@ -0,0 +1,675 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "src/main/native/windows/projfs.h"
+
+#include <windows.h>
+#include <objbase.h>  // CoCreateGuid
+#include <projectedfslib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/windows/file.h"
+#include "src/main/native/windows/util.h"
+
+#ifndef IO_REPARSE_TAG_PROJFS
+#define IO_REPARSE_TAG_PROJFS 0x9000001C
+#endif
+
+namespace bazel {
+namespace windows {
+
+namespace {
+
+// How much of a file GetFileData reads and hands to ProjFS at a time.
+static const UINT32 kFileDataChunkSize = 1024 * 1024;
+
+// The ProjFS functions. ProjFS is an optional Windows feature, so they are
+// looked up at runtime: linking against them would keep this library from
+// loading where the feature is not enabled.
+struct ProjFsApi {
+  decltype(&::PrjStartVirtualizing) StartVirtualizing;
+  decltype(&::PrjStopVirtualizing) StopVirtualizing;
+  decltype(&::PrjMarkDirectoryAsPlaceholder) MarkDirectoryAsPlaceholder;
+  decltype(&::PrjWritePlaceholderInfo) WritePlaceholderInfo;
+  decltype(&::PrjFillDirEntryBuffer) FillDirEntryBuffer;
+  decltype(&::PrjWriteFileData) WriteFileData;
+  decltype(&::PrjAllocateAlignedBuffer) AllocateAlignedBuffer;
+  decltype(&::PrjFreeAlignedBuffer) FreeAlignedBuffer;
+  decltype(&::PrjFileNameCompare) FileNameCompare;
+  decltype(&::PrjFileNameMatch) FileNameMatch;
+};
+
+template <typename F>
+static bool LoadFunction(HMODULE lib, const char* name, F* result) {
+  *result = reinterpret_cast<F>(GetProcAddress(lib, name));
+  return *result != nullptr;
+}
+
+// Returns the ProjFS functions, or null if ProjFS is not enabled.
+static const ProjFsApi* GetProjFsApi() {
+  static const ProjFsApi* api = []() -> const ProjFsApi* {
+    HMODULE lib = LoadLibraryExW(L"ProjectedFSLib.dll", nullptr,
+                                 LOAD_LIBRARY_SEARCH_SYSTEM32);
+    if (lib == nullptr) {
+      return nullptr;
+    }
+    static ProjFsApi result;
+    if (!LoadFunction(lib, "PrjStartVirtualizing", &result.StartVirtualizing) ||
+        !LoadFunction(lib, "PrjStopVirtualizing", &result.StopVirtualizing) ||
+        !LoadFunction(lib, "PrjMarkDirectoryAsPlaceholder",
+                      &result.MarkDirectoryAsPlaceholder) ||
+        !LoadFunction(lib, "PrjWritePlaceholderInfo",
+                      &result.WritePlaceholderInfo) ||
+        !LoadFunction(lib, "PrjFillDirEntryBuffer",
+                      &result.FillDirEntryBuffer) ||
+        !LoadFunction(lib, "PrjWriteFileData", &result.WriteFileData) ||
+        !LoadFunction(lib, "PrjAllocateAlignedBuffer",
+                      &result.AllocateAlignedBuffer) ||
+        !LoadFunction(lib, "PrjFreeAlignedBuffer", &result.FreeAlignedBuffer) ||
+        !LoadFunction(lib, "PrjFileNameCompare", &result.FileNameCompare) ||
+        !LoadFunction(lib, "PrjFileNameMatch", &result.FileNameMatch)) {
+      FreeLibrary(lib);
+      return nullptr;
+    }
+    return &result;
+  }();
+  return api;
+}
+
+// Orders names the way ProjFS expects directory enumerations to be ordered.
+struct FileNameLess {
+  bool operator()(const wstring& a, const wstring& b) const {
+    return GetProjFsApi()->FileNameCompare(a.c_str(), b.c_str()) < 0;
+  }
+};
+
+struct GuidLess {
+  bool operator()(const GUID& a, const GUID& b) const {
+    return memcmp(&a, &b, sizeof(GUID)) < 0;
+  }
+};
+
+static void ToLargeInteger(const FILETIME& time, LARGE_INTEGER* result) {
+  result->LowPart = time.dwLowDateTime;
+  result->HighPart = static_cast<LONG>(time.dwHighDateTime);
+}
+
+static HRESULT FileNotFoundResult(DWORD err) {
+  // ProjFS only takes ERROR_FILE_NOT_FOUND to mean that there is no such
+  // entry.
+  return HRESULT_FROM_WIN32(err == ERROR_PATH_NOT_FOUND ? ERROR_FILE_NOT_FOUND
+                                                        : err);
+}
+
+// Reads what ProjFS needs to know about the file or directory at `path`,
+// following links. An empty `path` stands for an empty file.
+static HRESULT GetFileBasicInfo(const wstring& path,
+                                PRJ_FILE_BASIC_INFO* info) {
+  *info = {};
+  if (path.empty()) {
+    return S_OK;
+  }
+  AutoHandle handle(CreateFileW(
+      AddUncPrefixMaybe(path).c_str(), FILE_READ_ATTRIBUTES,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr));
+  BY_HANDLE_FILE_INFORMATION data;
+  if (!handle.IsValid() || !GetFileInformationByHandle(handle, &data)) {
+    return FileNotFoundResult(GetLastError());
+  }
+  info->IsDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+  if (!info->IsDirectory) {
+    info->FileSize = (static_cast<INT64>(data.nFileSizeHigh) << 32) |
+                     data.nFileSizeLow;
+  }
+  ToLargeInteger(data.ftCreationTime, &info->CreationTime);
+  ToLargeInteger(data.ftLastAccessTime, &info->LastAccessTime);
+  ToLargeInteger(data.ftLastWriteTime, &info->LastWriteTime);
+  ToLargeInteger(data.ftLastWriteTime, &info->ChangeTime);
+  return S_OK;
+}
+
+// Deletes everything below the directory `path`. Unlike DeleteTreesBelow, it
+// descends into ProjFS placeholder directories, which are reparse points.
+static bool DeleteDirectoryContents(const wstring& path, wstring* error) {
+  WIN32_FIND_DATAW data;
+  HANDLE find = FindFirstFileExW(
+      AddUncPrefixMaybe(path + L"\\*").c_str(), FindExInfoBasic, &data,
+      FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+  if (find == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    if (err == ERROR_FILE_NOT_FOUND) {
+      return true;
+    }
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"FindFirstFileExW",
+                                path, err);
+    }
+    return false;
+  }
+  bool ok = true;
+  do {
+    if (wcscmp(data.cFileName, L".") == 0 ||
+        wcscmp(data.cFileName, L"..") == 0) {
+      continue;
+    }
+    wstring child = path + L"\\" + data.cFileName;
+    // Links to directories are deleted themselves; dwReserved0 is the reparse
+    // tag.
+    if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0 &&
+        ((data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0 ||
+         data.dwReserved0 == IO_REPARSE_TAG_PROJFS)) {
+      ok = DeleteDirectoryContents(child, error);
+    }
+    if (ok) {
+      int result = DeletePath(child, error);
+      ok = result == DeletePathResult::kSuccess ||
+           result == DeletePathResult::kDoesNotExist;
+    }
+  } while (ok && FindNextFileW(find, &data));
+  FindClose(find);
+  return ok;
+}
+
+// A tree that this process presents through ProjFS.
+class ProjectedTree {
+ public:
+  ProjectedTree(const ProjFsApi* api, const wstring& root)
+      : api_(api), root_(root), context_(nullptr) {}
+
+  ~ProjectedTree() { Stop(); }
+
+  // Adds `entry` to the tree. Returns false if it conflicts with an entry
+  // added before.
+  bool Add(const ProjectedEntry& entry, wstring* error) {
+    Node* current = &root_node_;
+    size_t start = 0;
+    while (true) {
+      size_t end = entry.path.find(L'\\', start);
+      wstring name = entry.path.substr(
+          start, end == wstring::npos ? wstring::npos : end - start);
+      if (name.empty() || !current->is_directory) {
+        break;
+      }
+      std::unique_ptr<Node>& child = current->children[name];
+      if (end == wstring::npos) {
+        if (child && child->is_directory) {
+          break;
+        }
+        child.reset(new Node());
+        child->is_directory = false;
+        child->target = entry.target;
+        return true;
+      }
+      if (!child) {
+        child.reset(new Node());
+      }
+      current = child.get();
+      start = end + 1;
+    }
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"ProjectTree",
+                                entry.path,
+                                L"invalid path, or a file and a directory "
+                                L"at the same path");
+    }
+    return false;
+  }
+
+  // Starts presenting the tree at its root, which must be a ProjFS
+  // virtualization root.
+  HRESULT Start() {
+    PRJ_CALLBACKS callbacks = {};
+    callbacks.StartDirectoryEnumerationCallback = StartDirectoryEnumerationCb;
+    callbacks.EndDirectoryEnumerationCallback = EndDirectoryEnumerationCb;
+    callbacks.GetDirectoryEnumerationCallback = GetDirectoryEnumerationCb;
+    callbacks.GetPlaceholderInfoCallback = GetPlaceholderInfoCb;
+    callbacks.GetFileDataCallback = GetFileDataCb;
+    return api_->StartVirtualizing(root_.c_str(), &callbacks, this, nullptr,
+                                   &context_);
+  }
+
+  // Stops presenting the tree. What has been accessed so far stays on disk.
+  void Stop() {
+    if (context_ != nullptr) {
+      api_->StopVirtualizing(context_);
+      context_ = nullptr;
+    }
+  }
+
+ private:
+  // A file or directory of the tree.
+  struct Node {
+    // Whether this is one of the directories that the paths of the entries
+    // imply, rather than an entry.
+    bool is_directory = true;
+    // For entries, the file or directory they have the contents of, or empty
+    // for an empty file.
+    wstring target;
+    std::map<wstring, std::unique_ptr<Node>, FileNameLess> children;
+  };
+
+  // A directory listing that ProjFS reads, in parts, through
+  // GetDirectoryEnumeration.
+  struct Enumeration {
+    std::vector<std::pair<wstring, PRJ_FILE_BASIC_INFO>> entries;
+    size_t next = 0;
+    bool has_search_expression = false;
+    wstring search_expression;
+  };
+
+  // Finds what `path`, relative to the root, stands for: a directory of the
+  // tree, which is stored in `*node`, or a file or directory on disk, whose
+  // path is stored in `*disk_path` while `*node` is set to null. Returns false
+  // if there is no such entry.
+  bool Resolve(const wchar_t* path, const Node** node,
+               wstring* disk_path) const {
+    const Node* current = &root_node_;
+    const wchar_t* p = path;
+    while (*p != L'\0') {
+      if (!current->is_directory) {
+        // Below a directory on disk, or an entry that is a file.
+        if (current->target.empty()) {
+          return false;
+        }
+        *node = nullptr;
+        *disk_path = current->target + L"\\" + p;
+        return true;
+      }
+      const wchar_t* end = wcschr(p, L'\\');
+      size_t len = end != nullptr ? end - p : wcslen(p);
+      auto it = current->children.find(wstring(p, len));
+      if (it == current->children.end()) {
+        return false;
+      }
+      current = it->second.get();
+      p = end != nullptr ? end + 1 : p + len;
+    }
+    if (current->is_directory) {
+      *node = current;
+    } else {
+      *node = nullptr;
+      *disk_path = current->target;
+    }
+    return true;
+  }
+
+  HRESULT GetBasicInfo(const wchar_t* path, PRJ_FILE_BASIC_INFO* info) const {
+    const Node* node;
+    wstring disk_path;
+    if (!Resolve(path, &node, &disk_path)) {
+      return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+    if (node != nullptr) {
+      *info = {};
+      info->IsDirectory = TRUE;
+      return S_OK;
+    }
+    return GetFileBasicInfo(disk_path, info);
+  }
+
+  // Lists the directory at `path` into `entries`, in the order of
+  // FileNameLess.
+  HRESULT ListDirectory(
+      const wchar_t* path,
+      std::vector<std::pair<wstring, PRJ_FILE_BASIC_INFO>>* entries) const {
+    const Node* node;
+    wstring disk_path;
+    if (!Resolve(path, &node, &disk_path)) {
+      return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+    PRJ_FILE_BASIC_INFO info;
+    if (node != nullptr) {
+      for (const auto& child : node->children) {
+        if (child.second->is_directory) {
+          info = {};
+          info.IsDirectory = TRUE;
+        } else if (FAILED(GetFileBasicInfo(child.second->target, &info))) {
+          // The target is gone; there is no way to present a dangling
+          // entry.
+          continue;
+        }
+        entries->emplace_back(child.first, info);
+      }
+      return S_OK;
+    }
+
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileExW(
+        AddUncPrefixMaybe(disk_path + L"\\*").c_str(), FindExInfoBasic, &data,
+        FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE) {
+      return FileNotFoundResult(GetLastError());
+    }
+    do {
+      if (wcscmp(data.cFileName, L".") == 0 ||
+          wcscmp(data.cFileName, L"..") == 0) {
+        continue;
+      }
+      if ((data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0) {
+        // Present what links point to.
+        if (FAILED(GetFileBasicInfo(disk_path + L"\\" + data.cFileName,
+                                    &info))) {
+          continue;
+        }
+      } else {
+        info = {};
+        info.IsDirectory =
+            (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        if (!info.IsDirectory) {
+          info.FileSize = (static_cast<INT64>(data.nFileSizeHigh) << 32) |
+                          data.nFileSizeLow;
+        }
+        ToLargeInteger(data.ftCreationTime, &info.CreationTime);
+        ToLargeInteger(data.ftLastAccessTime, &info.LastAccessTime);
+        ToLargeInteger(data.ftLastWriteTime, &info.LastWriteTime);
+        ToLargeInteger(data.ftLastWriteTime, &info.ChangeTime);
+      }
+      entries->emplace_back(data.cFileName, info);
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+    std::sort(entries->begin(), entries->end(),
+              [](const std::pair<wstring, PRJ_FILE_BASIC_INFO>& a,
+                 const std::pair<wstring, PRJ_FILE_BASIC_INFO>& b) {
+                return FileNameLess()(a.first, b.first);
+              });
+    return S_OK;
+  }
+
+  HRESULT StartDirectoryEnumeration(const PRJ_CALLBACK_DATA* data,
+                                    const GUID* enumeration_id) {
+    Enumeration enumeration;
+    HRESULT result = ListDirectory(data->FilePathName, &enumeration.entries);
+    if (FAILED(result)) {
+      return result;
+    }
+    std::lock_guard<std::mutex> lock(mu_);
+    enumerations_[*enumeration_id] = std::move(enumeration);
+    return S_OK;
+  }
+
+  HRESULT EndDirectoryEnumeration(const GUID* enumeration_id) {
+    std::lock_guard<std::mutex> lock(mu_);
+    enumerations_.erase(*enumeration_id);
+    return S_OK;
+  }
+
+  HRESULT GetDirectoryEnumeration(const PRJ_CALLBACK_DATA* data,
+                                  const GUID* enumeration_id,
+                                  PCWSTR search_expression,
+                                  PRJ_DIR_ENTRY_BUFFER_HANDLE buffer) {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = enumerations_.find(*enumeration_id);
+    if (it == enumerations_.end()) {
+      return E_INVALIDARG;
+    }
+    Enumeration& enumeration = it->second;
+    // The search expression of the first call, or of a restarted scan,
+    // applies to all later calls.
+    if ((data->Flags & PRJ_CB_DATA_FLAG_ENUM_RESTART_SCAN) != 0) {
+      enumeration.next = 0;
+      enumeration.has_search_expression = false;
+    }
+    if (!enumeration.has_search_expression) {
+      enumeration.search_expression =
+          search_expression != nullptr ? search_expression : L"*";
+      enumeration.has_search_expression = true;
+    }
+    bool filled = false;
+    for (; enumeration.next < enumeration.entries.size(); ++enumeration.next) {
+      auto& entry = enumeration.entries[enumeration.next];
+      if (!api_->FileNameMatch(entry.first.c_str(),
+                               enumeration.search_expression.c_str())) {
+        continue;
+      }
+      HRESULT result =
+          api_->FillDirEntryBuffer(entry.first.c_str(), &entry.second, buffer);
+      if (FAILED(result)) {
+        // The buffer is full. The rest goes into the next call's.
+        return filled ? S_OK : result;
+      }
+      filled = true;
+      if ((data->Flags & PRJ_CB_DATA_FLAG_ENUM_RETURN_SINGLE_ENTRY) != 0) {
+        ++enumeration.next;
+        break;
+      }
+    }
+    return S_OK;
+  }
+
+  HRESULT GetPlaceholderInfo(const PRJ_CALLBACK_DATA* data) {
+    PRJ_PLACEHOLDER_INFO info = {};
+    HRESULT result = GetBasicInfo(data->FilePathName, &info.FileBasicInfo);
+    if (FAILED(result)) {
+      return result;
+    }
+    return api_->WritePlaceholderInfo(context_, data->FilePathName, &info,
+                                      sizeof(info));
+  }
+
+  HRESULT GetFileData(const PRJ_CALLBACK_DATA* data, UINT64 offset,
+                      UINT32 length) {
+    const Node* node;
+    wstring disk_path;
+    if (!Resolve(data->FilePathName, &node, &disk_path) || node != nullptr) {
+      return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+    if (disk_path.empty() || length == 0) {
+      return S_OK;
+    }
+    AutoHandle file(CreateFileW(AddUncPrefixMaybe(disk_path).c_str(),
+                                GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                                nullptr));
+    if (!file.IsValid()) {
+      return FileNotFoundResult(GetLastError());
+    }
+    UINT32 chunk_size = std::min(length, kFileDataChunkSize);
+    void* chunk = api_->AllocateAlignedBuffer(context_, chunk_size);
+    if (chunk == nullptr) {
+      return E_OUTOFMEMORY;
+    }
+    HRESULT result = S_OK;
+    while (length > 0 && SUCCEEDED(result)) {
+      OVERLAPPED position = {};
+      position.Offset = static_cast<DWORD>(offset);
+      position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+      DWORD read;
+      if (!ReadFile(file, chunk, std::min(length, chunk_size), &read,
+                    &position)) {
+        result = HRESULT_FROM_WIN32(GetLastError());
+      } else if (read == 0) {
+        // The target shrank since its size was presented.
+        result = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+      } else {
+        result =
+            api_->WriteFileData(context_, &data->DataStreamId, chunk, offset,
+                                read);
+        offset += read;
+        length -= read;
+      }
+    }
+    api_->FreeAlignedBuffer(chunk);
+    return result;
+  }
+
+  static ProjectedTree* From(const PRJ_CALLBACK_DATA* data) {
+    return static_cast<ProjectedTree*>(data->InstanceContext);
+  }
+
+  static HRESULT CALLBACK StartDirectoryEnumerationCb(
+      const PRJ_CALLBACK_DATA* data, const GUID* enumeration_id) {
+    return From(data)->StartDirectoryEnumeration(data, enumeration_id);
+  }
+
+  static HRESULT CALLBACK EndDirectoryEnumerationCb(
+      const PRJ_CALLBACK_DATA* data, const GUID* enumeration_id) {
+    return From(data)->EndDirectoryEnumeration(enumeration_id);
+  }
+
+  static HRESULT CALLBACK GetDirectoryEnumerationCb(
+      const PRJ_CALLBACK_DATA* data, const GUID* enumeration_id,
+      PCWSTR search_expression, PRJ_DIR_ENTRY_BUFFER_HANDLE buffer) {
+    return From(data)->GetDirectoryEnumeration(data, enumeration_id,
+                                               search_expression, buffer);
+  }
+
+  static HRESULT CALLBACK GetPlaceholderInfoCb(const PRJ_CALLBACK_DATA* data) {
+    return From(data)->GetPlaceholderInfo(data);
+  }
+
+  static HRESULT CALLBACK GetFileDataCb(const PRJ_CALLBACK_DATA* data,
+                                        UINT64 offset, UINT32 length) {
+    return From(data)->GetFileData(data, offset, length);
+  }
+
+  const ProjFsApi* api_;
+  const wstring root_;
+  // Not modified while the tree is presented, so read without locking.
+  Node root_node_;
+  PRJ_NAMESPACE_VIRTUALIZATION_CONTEXT context_;
+  std::mutex mu_;
+  // Guarded by mu_.
+  std::map<GUID, Enumeration, GuidLess> enumerations_;
+};
+
+// The trees that this process presents, by root.
+static std::mutex trees_mu;
+static std::map<wstring, std::unique_ptr<ProjectedTree>>* trees = nullptr;
+
+// Deletes `root` and everything below it, whatever was there before.
+static bool DeleteRoot(const ProjFsApi* api, const wstring& root,
+                       wstring* error) {
+  DWORD attrs = GetFileAttributesW(AddUncPrefixMaybe(root).c_str());
+  if (attrs == INVALID_FILE_ATTRIBUTES) {
+    DWORD err = GetLastError();
+    if (err == ERROR_FILE_NOT_FOUND || err == ERROR_PATH_NOT_FOUND) {
+      return true;
+    }
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                L"GetFileAttributesW", root, err);
+    }
+    return false;
+  }
+  // The placeholders of a tree that another process presented can only be
+  // listed while a provider runs. One with no entries will do, since ProjFS
+  // lists what is on disk regardless.
+  ProjectedTree empty(api, root);
+  if ((attrs & FILE_ATTRIBUTE_REPARSE_POINT) != 0) {
+    empty.Start();
+  }
+  bool ok = DeleteDirectoryContents(root, error);
+  empty.Stop();
+  if (ok) {
+    int result = DeletePath(root, error);
+    ok = result == DeletePathResult::kSuccess ||
+         result == DeletePathResult::kDoesNotExist;
+  }
+  return ok;
+}
+
+}  // namespace
+
+int ProjectTree(const wstring& root, const std::vector<ProjectedEntry>& entries,
+                wstring* error) {
+  const ProjFsApi* api = GetProjFsApi();
+  if (api == nullptr) {
+    return ProjectTreeResult::kUnavailable;
+  }
+  if (!IsAbsoluteNormalizedWindowsPath(root)) {
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"ProjectTree", root,
+                                L"expected an absolute Windows path");
+    }
+    return ProjectTreeResult::kError;
+  }
+  const wstring path = RemoveUncPrefixMaybe(root);
+  std::unique_ptr<ProjectedTree> tree(new ProjectedTree(api, path));
+  for (const ProjectedEntry& entry : entries) {
+    if (!tree->Add(entry, error)) {
+      return ProjectTreeResult::kError;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(trees_mu);
+  if (trees == nullptr) {
+    trees = new std::map<wstring, std::unique_ptr<ProjectedTree>>();
+  }
+  auto it = trees->find(path);
+  if (it != trees->end()) {
+    // Stops presenting the earlier tree.
+    trees->erase(it);
+  }
+  if (!DeleteRoot(api, path, error)) {
+    return ProjectTreeResult::kError;
+  }
+  if (!CreateDirectoryW(AddUncPrefixMaybe(path).c_str(), nullptr)) {
+    DWORD err = GetLastError();
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"CreateDirectoryW",
+                                path, err);
+    }
+    return ProjectTreeResult::kError;
+  }
+  GUID instance_id;
+  HRESULT result = CoCreateGuid(&instance_id);
+  if (SUCCEEDED(result)) {
+    result = api->MarkDirectoryAsPlaceholder(path.c_str(), nullptr, nullptr,
+                                             &instance_id);
+  }
+  if (SUCCEEDED(result)) {
+    result = tree->Start();
+  }
+  if (FAILED(result)) {
+    if (error) {
+      *error = MakeErrorMessage(WSTR(__FILE__), __LINE__, L"ProjectTree", path,
+                                static_cast<DWORD>(result));
+    }
+    return ProjectTreeResult::kError;
+  }
+  (*trees)[path] = std::move(tree);
+  return ProjectTreeResult::kSuccess;
+}
+
+void RemoveProjectedTrees() {
+  std::lock_guard<std::mutex> lock(trees_mu);
+  if (trees == nullptr) {
+    return;
+  }
+  for (auto& entry : *trees) {
+    // Delete the tree while it is still presented, so that its placeholders
+    // can be listed.
+    DeleteDirectoryContents(entry.first, nullptr);
+    entry.second->Stop();
+    DeletePath(entry.first, nullptr);
+  }
+  trees->clear();
+}
+
+}  // namespace windows
+}  // namespace bazel
@@ -0,0 +1,74 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef BAZEL_SRC_MAIN_NATIVE_WINDOWS_PROJFS_H_
+#define BAZEL_SRC_MAIN_NATIVE_WINDOWS_PROJFS_H_
+
+#include <string>
+#include <vector>
+
+namespace bazel {
+namespace windows {
+
+using std::wstring;
+
+// Keep in sync with j.c.g.devtools.build.lib.windows.WindowsFileOperations
+struct ProjectTreeResult {
+  enum {
+    kSuccess = 0,
+    kError = 1,
+    kUnavailable = 2,
+  };
+};
+
+// An entry of a tree that ProjectTree presents.
+struct ProjectedEntry {
+  // The path of the entry relative to the root of the tree, with "\\" as the
+  // separator.
+  wstring path;
+  // The absolute path of the file or directory the entry has the contents of,
+  // or empty if the entry is an empty file.
+  wstring target;
+};
+
+// Presents `entries` below the directory `root` through the Windows Projected
+// File System (ProjFS), with this process as the provider, instead of creating
+// them on disk.
+//
+// Creating the tree costs next to nothing: the directories the entries' paths
+// imply and the entries themselves only come into existence on disk when they
+// are first accessed, and files only get their contents, read from their
+// targets, when they are first read. Directories that entries have as targets
+// are presented recursively. Unlike symlinks, this needs no privileges.
+//
+// Anything that was at `root` before is deleted first, including a tree that
+// ProjectTree presented there earlier, in this process or another one.
+//
+// The tree can only be read while this process runs. RemoveProjectedTrees
+// deletes all trees when the process shuts down.
+//
+// Returns ProjectTreeResult::kUnavailable, having done nothing, if ProjFS is not
+// enabled on this machine. Returns ProjectTreeResult::kError if the entries
+// conflict with each other or the tree could not be created; when `error` is
+// non-null, it receives an error message.
+int ProjectTree(const wstring& root, const std::vector<ProjectedEntry>& entries,
+                wstring* error);
+
+// Deletes the trees that ProjectTree presented in this process, and stops
+// presenting them.
+void RemoveProjectedTrees();
+
+}  // namespace windows
+}  // namespace bazel
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_WINDOWS_PROJFS_H_
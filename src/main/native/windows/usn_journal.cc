@@ -0,0 +1,522 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <winioctl.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/main/native/changed_path_set.h"
+#include "src/main/native/jni.h"
+#include "src/main/native/windows/file.h"
+#include "src/main/native/windows/util.h"
+
+// Reads the journal with a handle to any file of the volume, without the
+// administrator rights that FSCTL_READ_USN_JOURNAL needs on the volume
+// handle. Windows 10 1709 and later.
+#ifndef FSCTL_READ_UNPRIVILEGED_USN_JOURNAL
+#define FSCTL_READ_UNPRIVILEGED_USN_JOURNAL \
+  CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 234, METHOD_NEITHER, FILE_ANY_ACCESS)
+#endif
+
+namespace {
+
+using bazel::windows::AutoHandle;
+
+// Past this many records read in one poll, most of them from outside the
+// watched root on a busy volume, resolving their paths costs more than a
+// rescan.
+constexpr size_t kMaxRecords = 1000000;
+
+// The directory paths cached across polls, cleared past this many.
+constexpr size_t kMaxCachedDirectories = 100000;
+
+// A journal record, copied out of the read buffer.
+struct Record {
+  DWORDLONG file;
+  DWORDLONG parent;
+  DWORD reason;
+  bool is_directory;
+  std::wstring name;
+};
+
+// The state of a watch of one root. The journal is read by poll, there is
+// no thread listening in the background.
+struct UsnJournalDiffAwareness {
+  // A handle to the watched root, which the journal is read and the files
+  // are opened by id through.
+  AutoHandle root;
+
+  // The final path of the root, e.g. "\\?\C:\src\workspace", which the
+  // resolved paths are compared to.
+  std::wstring root_final_path;
+
+  // The root as given by Java, which the reported paths start with.
+  std::wstring root_path;
+
+  // Whether the journal can be read at all. If not, every poll reports
+  // that everything changed.
+  bool valid;
+
+  // Whether FSCTL_READ_UNPRIVILEGED_USN_JOURNAL is missing, in which case
+  // FSCTL_READ_USN_JOURNAL is tried instead.
+  bool privileged_read;
+
+  DWORD volume_serial;
+
+  // The journal being read: a new one is created when the journal is
+  // deleted, e.g. by "fsutil usn deletejournal", with new USNs.
+  DWORDLONG journal_id;
+
+  // The USN of the first record not taken into account yet.
+  USN next_usn;
+
+  // The paths of the directories seen so far, by file reference number.
+  std::unordered_map<DWORDLONG, std::wstring> directories;
+
+  // The file the journal id and next USN are saved to, or empty if none.
+  std::wstring journal_path;
+
+  UsnJournalDiffAwareness()
+      : valid(false),
+        privileged_read(false),
+        volume_serial(0),
+        journal_id(0),
+        next_usn(0) {}
+};
+
+std::wstring Utf8ToWide(const char *bytes, int length) {
+  if (length == 0) {
+    return L"";
+  }
+  int size = MultiByteToWideChar(CP_UTF8, 0, bytes, length, nullptr, 0);
+  std::wstring result(size, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, bytes, length, &result[0], size);
+  return result;
+}
+
+std::string WideToUtf8(const std::wstring &wide) {
+  if (wide.empty()) {
+    return "";
+  }
+  int size = WideCharToMultiByte(CP_UTF8, 0, wide.data(), wide.size(),
+                                 nullptr, 0, nullptr, nullptr);
+  std::string result(size, '\0');
+  WideCharToMultiByte(CP_UTF8, 0, wide.data(), wide.size(), &result[0], size,
+                      nullptr, nullptr);
+  return result;
+}
+
+std::wstring JavaBytesToWide(JNIEnv *env, jbyteArray array) {
+  jbyte *bytes = env->GetByteArrayElements(array, nullptr);
+  std::wstring result = Utf8ToWide(reinterpret_cast<const char *>(bytes),
+                                   env->GetArrayLength(array));
+  env->ReleaseByteArrayElements(array, bytes, JNI_ABORT);
+  return result;
+}
+
+HANDLE OpenDirectory(const std::wstring &path) {
+  return CreateFileW(
+      bazel::windows::AddUncPrefixMaybe(path).c_str(), GENERIC_READ,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+}
+
+bool FinalPath(HANDLE handle, std::wstring *path) {
+  WCHAR buffer[MAX_PATH];
+  DWORD size = GetFinalPathNameByHandleW(
+      handle, buffer, MAX_PATH, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+  if (size == 0) {
+    return false;
+  }
+  if (size < MAX_PATH) {
+    path->assign(buffer, size);
+    return true;
+  }
+  std::unique_ptr<WCHAR[]> long_buffer(new WCHAR[size]);
+  DWORD long_size =
+      GetFinalPathNameByHandleW(handle, long_buffer.get(), size,
+                                FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+  if (long_size == 0 || long_size >= size) {
+    return false;
+  }
+  path->assign(long_buffer.get(), long_size);
+  return true;
+}
+
+// Returns whether the volume of handle is NTFS with an active journal, and
+// the serial number of the volume.
+bool QueryJournal(HANDLE handle, DWORD *volume_serial,
+                  USN_JOURNAL_DATA_V0 *journal) {
+  WCHAR filesystem[MAX_PATH + 1];
+  if (!GetVolumeInformationByHandleW(handle, nullptr, 0, volume_serial,
+                                     nullptr, nullptr, filesystem,
+                                     MAX_PATH + 1) ||
+      wcscmp(filesystem, L"NTFS") != 0) {
+    return false;
+  }
+  DWORD bytes;
+  return DeviceIoControl(handle, FSCTL_QUERY_USN_JOURNAL, nullptr, 0, journal,
+                         sizeof(*journal), &bytes, nullptr) != 0;
+}
+
+// Returns whether the journal saved in journal_path is for the given journal,
+// in which case next_usn is set to where it left off.
+bool ReadJournal(const std::wstring &journal_path, DWORD volume_serial,
+                 DWORDLONG journal_id, USN *next_usn) {
+  if (journal_path.empty()) {
+    return false;
+  }
+  FILE *f = _wfopen(journal_path.c_str(), L"r");
+  if (f == nullptr) {
+    return false;
+  }
+  unsigned long saved_serial;
+  unsigned long long saved_id;
+  long long saved_usn;
+  bool ok = fscanf(f, "%lx %llx %lld", &saved_serial, &saved_id,
+                   &saved_usn) == 3 &&
+            saved_serial == volume_serial && saved_id == journal_id;
+  fclose(f);
+  if (ok) {
+    *next_usn = saved_usn;
+  }
+  return ok;
+}
+
+// Saves the journal id and the next USN to the journal. The journal is
+// replaced atomically, so that a server dying halfway leaves the previous
+// USN behind.
+void WriteJournal(const UsnJournalDiffAwareness &info) {
+  if (info.journal_path.empty() || !info.valid) {
+    return;
+  }
+  std::wstring tmp_path = info.journal_path + L".tmp";
+  FILE *f = _wfopen(tmp_path.c_str(), L"w");
+  if (f == nullptr) {
+    return;
+  }
+  bool ok = fprintf(f, "%lx %llx %lld\n",
+                    static_cast<unsigned long>(info.volume_serial),
+                    static_cast<unsigned long long>(info.journal_id),
+                    static_cast<long long>(info.next_usn)) > 0;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || !MoveFileExW(tmp_path.c_str(), info.journal_path.c_str(),
+                          MOVEFILE_REPLACE_EXISTING)) {
+    DeleteFileW(tmp_path.c_str());
+  }
+}
+
+// Appends the records from info->next_usn up to end to records. Returns
+// false if they cannot all be read, e.g. because the oldest ones were
+// purged from the journal.
+bool ReadRecords(UsnJournalDiffAwareness *info, USN end,
+                 std::vector<Record> *records) {
+  READ_USN_JOURNAL_DATA_V0 read;
+  read.StartUsn = info->next_usn;
+  read.ReasonMask = 0xFFFFFFFF;
+  read.ReturnOnlyOnClose = FALSE;
+  read.Timeout = 0;
+  read.BytesToWaitFor = 0;
+  read.UsnJournalID = info->journal_id;
+  // USN_RECORD_V2 are 8-byte aligned.
+  std::unique_ptr<DWORDLONG[]> buffer(new DWORDLONG[64 * 1024 / 8]);
+  const DWORD buffer_size = 64 * 1024;
+  while (read.StartUsn < end) {
+    DWORD bytes;
+    BOOL ok = FALSE;
+    if (!info->privileged_read) {
+      ok = DeviceIoControl(info->root, FSCTL_READ_UNPRIVILEGED_USN_JOURNAL,
+                           &read, sizeof(read), buffer.get(), buffer_size,
+                           &bytes, nullptr);
+      if (!ok && GetLastError() == ERROR_INVALID_FUNCTION) {
+        info->privileged_read = true;
+      }
+    }
+    if (info->privileged_read) {
+      ok = DeviceIoControl(info->root, FSCTL_READ_USN_JOURNAL, &read,
+                           sizeof(read), buffer.get(), buffer_size, &bytes,
+                           nullptr);
+    }
+    if (!ok || bytes < sizeof(USN)) {
+      return false;
+    }
+    const char *data = reinterpret_cast<const char *>(buffer.get());
+    USN next = *reinterpret_cast<const USN *>(data);
+    for (DWORD offset = sizeof(USN); offset < bytes;) {
+      const USN_RECORD_V2 *record =
+          reinterpret_cast<const USN_RECORD_V2 *>(data + offset);
+      if (record->RecordLength == 0) {
+        return false;
+      }
+      offset += record->RecordLength;
+      if (record->Usn >= end) {
+        break;
+      }
+      if (record->MajorVersion != 2) {
+        return false;
+      }
+      if (records->size() == kMaxRecords) {
+        return false;
+      }
+      records->push_back(
+          {record->FileReferenceNumber, record->ParentFileReferenceNumber,
+           record->Reason,
+           (record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0,
+           std::wstring(reinterpret_cast<const WCHAR *>(
+                            reinterpret_cast<const char *>(record) +
+                            record->FileNameOffset),
+                        record->FileNameLength / sizeof(WCHAR))});
+    }
+    if (next <= read.StartUsn) {
+      break;
+    }
+    read.StartUsn = next;
+  }
+  return true;
+}
+
+// Resolves the path of the directory with the given file reference number,
+// from the cache, the directory records of the current batch or the file
+// system, in that order: a directory deleted since has no path anymore but
+// may still be in the batch.
+bool ResolveDirectory(
+    UsnJournalDiffAwareness *info, DWORDLONG directory,
+    const std::unordered_map<DWORDLONG, const Record *> &batch,
+    std::wstring *path) {
+  auto cached = info->directories.find(directory);
+  if (cached != info->directories.end()) {
+    *path = cached->second;
+    return true;
+  }
+  auto in_batch = batch.find(directory);
+  if (in_batch != batch.end() && in_batch->second->parent != directory) {
+    if (!ResolveDirectory(info, in_batch->second->parent, batch, path)) {
+      return false;
+    }
+    path->append(L"\\").append(in_batch->second->name);
+  } else {
+    FILE_ID_DESCRIPTOR id;
+    id.dwSize = sizeof(id);
+    id.Type = FileIdType;
+    id.FileId.QuadPart = directory;
+    AutoHandle handle(OpenFileById(
+        info->root, &id, FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        FILE_FLAG_BACKUP_SEMANTICS));
+    if (!handle.IsValid() || !FinalPath(handle, path)) {
+      return false;
+    }
+  }
+  if (info->directories.size() == kMaxCachedDirectories) {
+    info->directories.clear();
+  }
+  info->directories.emplace(directory, *path);
+  return true;
+}
+
+// Returns whether path is the root or under it. Names are compared without
+// regard to case, like NTFS does by default.
+bool IsUnderRoot(const UsnJournalDiffAwareness &info,
+                 const std::wstring &path) {
+  const std::wstring &root = info.root_final_path;
+  return path.size() >= root.size() &&
+         CompareStringOrdinal(path.data(), root.size(), root.data(),
+                              root.size(), TRUE) == CSTR_EQUAL &&
+         (path.size() == root.size() || path[root.size()] == L'\\');
+}
+
+// Adds the paths under the root changed since the last poll to paths.
+// Returns false if it cannot tell precisely what changed.
+bool ReadChanges(UsnJournalDiffAwareness *info,
+                 blaze_jni::ChangedPathSet *paths) {
+  USN_JOURNAL_DATA_V0 journal;
+  DWORD volume_serial;
+  if (!QueryJournal(info->root, &volume_serial, &journal)) {
+    info->valid = false;
+    return false;
+  }
+  if (!info->valid || journal.UsnJournalID != info->journal_id ||
+      info->next_usn < journal.FirstUsn) {
+    // The journal was deleted or the records since the last poll purged:
+    // start over from now.
+    info->valid = true;
+    info->volume_serial = volume_serial;
+    info->journal_id = journal.UsnJournalID;
+    info->next_usn = journal.NextUsn;
+    info->directories.clear();
+    return false;
+  }
+  USN end = journal.NextUsn;
+  std::vector<Record> records;
+  bool ok = ReadRecords(info, end, &records);
+  info->next_usn = end;
+  if (!ok) {
+    return false;
+  }
+
+  std::unordered_map<DWORDLONG, const Record *> batch;
+  for (const Record &record : records) {
+    if (record.is_directory) {
+      batch[record.file] = &record;
+    }
+  }
+  std::wstring parent;
+  for (const Record &record : records) {
+    if (!ResolveDirectory(info, record.parent, batch, &parent)) {
+      // A change somewhere on the volume that may or may not be under the
+      // root.
+      return false;
+    }
+    if (record.is_directory &&
+        (record.reason &
+         (USN_REASON_RENAME_OLD_NAME | USN_REASON_RENAME_NEW_NAME)) != 0) {
+      // The paths of everything below changed.
+      info->directories.clear();
+      if (IsUnderRoot(*info, parent)) {
+        // As with fsevents, what was moved out of the root is unknown.
+        return false;
+      }
+      continue;
+    }
+    if (record.is_directory && (record.reason & USN_REASON_FILE_DELETE) != 0) {
+      info->directories.erase(record.file);
+    }
+    if (!IsUnderRoot(*info, parent)) {
+      continue;
+    }
+    std::wstring path = info->root_path;
+    path.append(parent, info->root_final_path.size(), std::wstring::npos)
+        .append(L"\\")
+        .append(record.name);
+    if (!paths->Add(WideToUtf8(path))) {
+      // So many files changed (e.g. on a VCS checkout) that rescanning is
+      // cheaper than invalidating them one by one.
+      return false;
+    }
+  }
+  return true;
+}
+
+UsnJournalDiffAwareness *GetInfo(JNIEnv *env, jobject diffAwareness) {
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  jlong field = env->GetLongField(diffAwareness, fid);
+  return reinterpret_cast<UsnJournalDiffAwareness *>(field);
+}
+
+}  // namespace
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsUsnJournalDiffAwareness_isSupported(
+    JNIEnv *env, jclass clazz, jbyteArray root) {
+  AutoHandle handle(OpenDirectory(JavaBytesToWide(env, root)));
+  USN_JOURNAL_DATA_V0 journal;
+  DWORD volume_serial;
+  return handle.IsValid() && QueryJournal(handle, &volume_serial, &journal)
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsUsnJournalDiffAwareness_create(
+    JNIEnv *env, jobject diffAwareness, jbyteArray root,
+    jbyteArray journalPath) {
+  UsnJournalDiffAwareness *info = new UsnJournalDiffAwareness();
+  info->root_path = JavaBytesToWide(env, root);
+  if (journalPath != nullptr) {
+    info->journal_path = JavaBytesToWide(env, journalPath);
+  }
+  bool resumed = false;
+  info->root = OpenDirectory(info->root_path);
+  USN_JOURNAL_DATA_V0 journal;
+  if (info->root.IsValid() && FinalPath(info->root, &info->root_final_path) &&
+      QueryJournal(info->root, &info->volume_serial, &journal)) {
+    info->valid = true;
+    info->journal_id = journal.UsnJournalID;
+    // Resume from the last poll of the previous server, if the records
+    // since are still in the journal.
+    resumed = ReadJournal(info->journal_path, info->volume_serial,
+                          journal.UsnJournalID, &info->next_usn) &&
+              info->next_usn >= journal.FirstUsn &&
+              info->next_usn <= journal.NextUsn;
+    if (!resumed) {
+      info->next_usn = journal.NextUsn;
+    }
+  }
+
+  jclass clazz = env->GetObjectClass(diffAwareness);
+  jfieldID fid = env->GetFieldID(clazz, "nativePointer", "J");
+  env->SetLongField(diffAwareness, fid, reinterpret_cast<jlong>(info));
+  return resumed ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsUsnJournalDiffAwareness_poll(
+    JNIEnv *env, jobject diffAwareness) {
+  UsnJournalDiffAwareness *info = GetInfo(env, diffAwareness);
+  blaze_jni::ChangedPathSet paths;
+  bool precise = info->root_final_path.empty() ? false
+                                               : ReadChanges(info, &paths);
+  // The caller takes the changes up to here into account, so the next
+  // server only needs the later ones.
+  WriteJournal(*info);
+  if (!precise) {
+    return JNI_FALSE;
+  }
+  // One array with all the paths end to end, and one with where each ends,
+  // rather than an array per path.
+  std::vector<jint> ends;
+  ends.reserve(paths.paths().size());
+  jint size = 0;
+  for (std::string_view path : paths.paths()) {
+    size += path.size();
+    ends.push_back(size);
+  }
+  jbyteArray bytes = env->NewByteArray(size);
+  jintArray ends_array = env->NewIntArray(ends.size());
+  if (bytes != nullptr && ends_array != nullptr) {
+    jint start = 0;
+    for (std::string_view path : paths.paths()) {
+      env->SetByteArrayRegion(bytes, start, path.size(),
+                              reinterpret_cast<const jbyte *>(path.data()));
+      start += path.size();
+    }
+    env->SetIntArrayRegion(ends_array, 0, ends.size(), ends.data());
+    jclass clazz = env->GetObjectClass(diffAwareness);
+    env->SetObjectField(diffAwareness,
+                        env->GetFieldID(clazz, "polledPaths", "[B"), bytes);
+    env->SetObjectField(diffAwareness,
+                        env->GetFieldID(clazz, "polledPathEnds", "[I"),
+                        ends_array);
+  }
+  // On an OutOfMemoryError, pending until the return, the result is ignored.
+  return JNI_TRUE;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_devtools_build_lib_skyframe_WindowsUsnJournalDiffAwareness_doClose(
+    JNIEnv *env, jobject diffAwareness) {
+  delete GetInfo(env, diffAwareness);
+}
@@ -160,9 +160,46 @@ AutoAttributeList::AutoAttributeList(std::unique_ptr<uint8_t[]>&& data,
     : data_(std::move(data)), handles_(stdin_h, stdout_h, stderr_h) {}
 
 AutoAttributeList::~AutoAttributeList() {
+  RestoreInheritance();
   DeleteProcThreadAttributeList(*this);
 }
 
+bool AutoAttributeList::MakeInheritable(wstring* error_msg) {
+  for (size_t i = 0; i < handles_.ValidHandlesCount(); ++i) {
+    HANDLE handle = handles_.ValidHandles()[i];
+    DWORD flags;
+    if (!GetHandleInformation(handle, &flags)) {
+      if (error_msg) {
+        DWORD err = GetLastError();
+        *error_msg = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                      L"GetHandleInformation", L"", err);
+      }
+      return false;
+    }
+    if (flags & HANDLE_FLAG_INHERIT) {
+      continue;
+    }
+    if (!SetHandleInformation(handle, HANDLE_FLAG_INHERIT,
+                              HANDLE_FLAG_INHERIT)) {
+      if (error_msg) {
+        DWORD err = GetLastError();
+        *error_msg = MakeErrorMessage(WSTR(__FILE__), __LINE__,
+                                      L"SetHandleInformation", L"", err);
+      }
+      return false;
+    }
+    made_inheritable_[made_inheritable_count_++] = handle;
+  }
+  return true;
+}
+
+void AutoAttributeList::RestoreInheritance() {
+  for (size_t i = 0; i < made_inheritable_count_; ++i) {
+    SetHandleInformation(made_inheritable_[i], HANDLE_FLAG_INHERIT, 0);
+  }
+  made_inheritable_count_ = 0;
+}
+
 AutoAttributeList::operator LPPROC_THREAD_ATTRIBUTE_LIST() const {
   return reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(data_.get());
 }
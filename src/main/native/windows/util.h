@@ -81,6 +81,19 @@ class AutoAttributeList {
 
   void InitStartupInfoExW(STARTUPINFOEXW* startup_info) const;
 
+  // Makes the handles in the list inheritable, as CreateProcessW requires of
+  // them, until RestoreInheritance() is called or this object is destroyed.
+  // The handles can thus be created non-inheritable, and only become
+  // inheritable while the child that should get them is being created. A
+  // process that another thread creates at the same time without a handle
+  // list, which inherits all inheritable handles, still gets them, but only
+  // in that window.
+  bool MakeInheritable(std::wstring* error_msg = nullptr);
+
+  // Makes the handles that MakeInheritable() made inheritable non-inheritable
+  // again.
+  void RestoreInheritance();
+
   bool HasConsoleHandle() const { return handles_.HasConsoleHandle(); }
 
  private:
@@ -120,6 +133,10 @@ class AutoAttributeList {
 
   std::unique_ptr<uint8_t[]> data_;
   StdHandles handles_;
+  // The handles that MakeInheritable() made inheritable.
+  HANDLE made_inheritable_[3] = {INVALID_HANDLE_VALUE, INVALID_HANDLE_VALUE,
+                                 INVALID_HANDLE_VALUE};
+  size_t made_inheritable_count_ = 0;
 };
 
 #define WSTR1(x) L##x
@@ -0,0 +1,368 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/native/worker_pool.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace blaze_jni {
+
+namespace {
+
+// The most threads the pool has, however many CPUs there are.
+static const int kMaxWorkerPoolThreads = 64;
+
+// The index of the pool thread running on this thread, or -1.
+thread_local int current_worker = -1;
+
+#if defined(__linux__)
+// Reads the first line of a file, without its newline.
+static bool ReadLine(const std::string &path, std::string *line) {
+  FILE *file = fopen(path.c_str(), "re");
+  if (file == nullptr) {
+    return false;
+  }
+  char buf[256];
+  bool ok = fgets(buf, sizeof(buf), file) != nullptr;
+  fclose(file);
+  if (ok) {
+    *line = buf;
+    if (!line->empty() && line->back() == '\n') {
+      line->pop_back();
+    }
+  }
+  return ok;
+}
+
+// Returns the CPU quota of the cgroup v2 directory dir and of its ancestors
+// up to the root of the hierarchy, the lowest of them, or -1 if none has one.
+static double CgroupV2CpuQuota(std::string dir) {
+  double quota = -1;
+  for (;;) {
+    std::string line;
+    long long max, period;
+    // "max 100000" when there is no quota.
+    if (ReadLine(dir + "/cpu.max", &line) &&
+        sscanf(line.c_str(), "%lld %lld", &max, &period) == 2 && max > 0 &&
+        period > 0) {
+      double cpus = static_cast<double>(max) / period;
+      quota = quota < 0 ? cpus : std::min(quota, cpus);
+    }
+    if (dir == "/sys/fs/cgroup") {
+      return quota;
+    }
+    dir = dir.substr(0, dir.rfind('/'));
+  }
+}
+
+// Returns the CPU quota of the cgroup v1 directory dir, or -1 if it has none.
+static double CgroupV1CpuQuota(const std::string &dir) {
+  std::string line;
+  long long quota, period;
+  // -1 when there is no quota.
+  if (ReadLine(dir + "/cpu.cfs_quota_us", &line) &&
+      sscanf(line.c_str(), "%lld", &quota) == 1 && quota > 0 &&
+      ReadLine(dir + "/cpu.cfs_period_us", &line) &&
+      sscanf(line.c_str(), "%lld", &period) == 1 && period > 0) {
+    return static_cast<double>(quota) / period;
+  }
+  return -1;
+}
+
+// Returns the number of CPUs the cgroup of the process may use, or -1 if it
+// is not limited.
+static double CgroupCpuQuota() {
+  FILE *file = fopen("/proc/self/cgroup", "re");
+  if (file == nullptr) {
+    return -1;
+  }
+  double quota = -1;
+  char buf[4096];
+  while (quota < 0 && fgets(buf, sizeof(buf), file) != nullptr) {
+    // "<id>:<controllers>:<path>", the controllers being empty for v2.
+    std::string line(buf);
+    if (!line.empty() && line.back() == '\n') {
+      line.pop_back();
+    }
+    size_t first = line.find(':');
+    size_t second =
+        first == std::string::npos ? first : line.find(':', first + 1);
+    if (second == std::string::npos) {
+      continue;
+    }
+    std::string controllers = line.substr(first + 1, second - first - 1);
+    std::string path = line.substr(second + 1);
+    if (path == "/") {
+      path.clear();
+    }
+    if (controllers.empty()) {
+      quota = CgroupV2CpuQuota("/sys/fs/cgroup" + path);
+    } else if (("," + controllers + ",").find(",cpu,") != std::string::npos) {
+      // Within a cgroup namespace or a container, the path of the cgroup may
+      // not be visible, in which case it is mounted as the root.
+      quota = CgroupV1CpuQuota("/sys/fs/cgroup/cpu" + path);
+      if (quota < 0 && !path.empty()) {
+        quota = CgroupV1CpuQuota("/sys/fs/cgroup/cpu");
+      }
+    }
+  }
+  fclose(file);
+  return quota;
+}
+#endif
+
+}  // namespace
+
+int UsableCpus() {
+  int cpus = std::thread::hardware_concurrency();
+#if defined(__linux__)
+  cpu_set_t set;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    cpus = CPU_COUNT(&set);
+  }
+  double quota = CgroupCpuQuota();
+  if (quota > 0) {
+    cpus = std::min(cpus, static_cast<int>(std::ceil(quota)));
+  }
+#endif
+  return std::max(1, cpus);
+}
+
+struct WorkerPool::Helpers::Batch {
+  std::function<void(int)> work;
+  std::mutex mutex;
+  std::condition_variable done;
+  // The calls still queued and the calls running, and whether the Helpers
+  // are destroyed, guarded by mutex.
+  int queued = 0;
+  int running = 0;
+  bool closed = false;
+};
+
+WorkerPool::Helpers::Helpers(WorkerPool *pool, int first, int last,
+                             std::function<void(int)> work)
+    : pool_(pool), batch_(std::make_shared<Batch>()) {
+  batch_->work = std::move(work);
+  std::vector<Call> calls;
+  for (int i = first; i < last; ++i) {
+    calls.push_back({batch_, i});
+  }
+  if (!calls.empty() && pool->Enqueue(calls)) {
+    std::lock_guard<std::mutex> lock(batch_->mutex);
+    // Less the calls that were already taken.
+    batch_->queued += calls.size();
+  }
+}
+
+WorkerPool::Helpers::~Helpers() {
+  std::unique_lock<std::mutex> lock(batch_->mutex);
+  batch_->closed = true;
+  if (batch_->queued > 0) {
+    lock.unlock();
+    pool_->Drop(batch_.get());
+    lock.lock();
+  }
+  batch_->done.wait(lock, [this] { return batch_->running == 0; });
+}
+
+WorkerPool &WorkerPool::Get() {
+  // Never destroyed: the threads may still be running at exit.
+  static WorkerPool *pool = new WorkerPool();
+  return *pool;
+}
+
+void WorkerPool::Run(int parallelism, const std::function<void(int)> &work) {
+  Helpers helpers(this, 1, parallelism, work);
+  work(0);
+}
+
+bool WorkerPool::EnsureStarted() {
+  if (!started_ && !stopping_) {
+    started_ = true;
+    const int nthreads = std::min(UsableCpus(), kMaxWorkerPoolThreads);
+    for (int i = 0; i < nthreads; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < nthreads; ++i) {
+      try {
+        threads_.emplace_back(&WorkerPool::WorkerLoop, this, i);
+      } catch (const std::system_error &) {
+        // Out of threads: the queues of the missing ones get stolen from.
+        break;
+      }
+    }
+  }
+  return !stopping_ && !threads_.empty();
+}
+
+bool WorkerPool::Enqueue(const std::vector<Call> &calls) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!EnsureStarted()) {
+    return false;
+  }
+  for (const Call &call : calls) {
+    Queue &queue = current_worker >= 0
+                       ? *queues_[current_worker]
+                       : *queues_[next_queue_++ % queues_.size()];
+    std::lock_guard<std::mutex> queue_lock(queue.mutex);
+    queue.calls.push_back(call);
+  }
+  queued_ += calls.size();
+  max_queued_ = std::max(max_queued_, queued_);
+  if (calls.size() == 1) {
+    wake_.notify_one();
+  } else {
+    wake_.notify_all();
+  }
+  return true;
+}
+
+bool WorkerPool::Take(size_t worker, Call *call, bool *stolen) {
+  {
+    Queue &own = *queues_[worker];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.calls.empty()) {
+      *call = std::move(own.calls.back());
+      own.calls.pop_back();
+      *stolen = false;
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues_.size(); ++i) {
+    Queue &victim = *queues_[(worker + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.calls.empty()) {
+      *call = std::move(victim.calls.front());
+      victim.calls.pop_front();
+      *stolen = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool WorkerPool::RunCall(const Call &call) {
+  Helpers::Batch &batch = *call.batch;
+  {
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    --batch.queued;
+    if (batch.closed) {
+      return false;
+    }
+    ++batch.running;
+  }
+  batch.work(call.index);
+  std::lock_guard<std::mutex> lock(batch.mutex);
+  if (--batch.running == 0) {
+    batch.done.notify_all();
+  }
+  return true;
+}
+
+void WorkerPool::WorkerLoop(size_t worker) {
+  current_worker = worker;
+  for (;;) {
+    Call call;
+    bool stolen;
+    if (Take(worker, &call, &stolen)) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --queued_;
+        if (stopping_) {
+          ++calls_dropped_;
+          return;
+        }
+        ++active_;
+      }
+      bool ran = RunCall(call);
+      call.batch.reset();
+      std::lock_guard<std::mutex> lock(mutex_);
+      --active_;
+      if (ran) {
+        ++calls_run_;
+        calls_stolen_ += stolen;
+      } else {
+        ++calls_dropped_;
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+    if (stopping_) {
+      return;
+    }
+  }
+}
+
+void WorkerPool::Drop(const Helpers::Batch *batch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &queue : queues_) {
+    std::lock_guard<std::mutex> queue_lock(queue->mutex);
+    auto end = std::remove_if(
+        queue->calls.begin(), queue->calls.end(),
+        [batch](const Call &call) { return call.batch.get() == batch; });
+    const int64_t dropped = queue->calls.end() - end;
+    queue->calls.erase(end, queue->calls.end());
+    queued_ -= dropped;
+    calls_dropped_ += dropped;
+  }
+}
+
+void WorkerPool::Shutdown() {
+  std::vector<std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    threads.swap(threads_);
+    wake_.notify_all();
+  }
+  for (std::thread &thread : threads) {
+    if (thread.get_id() == std::this_thread::get_id()) {
+      thread.detach();
+    } else {
+      thread.join();
+    }
+  }
+  // The calls left in the queues belong to Helpers that drop them.
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &queue : queues_) {
+    std::lock_guard<std::mutex> queue_lock(queue->mutex);
+    queued_ -= queue->calls.size();
+    calls_dropped_ += queue->calls.size();
+    queue->calls.clear();
+  }
+}
+
+WorkerPoolStats WorkerPool::GetStats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return {static_cast<int64_t>(threads_.size()),
+          active_,
+          queued_,
+          max_queued_,
+          calls_run_,
+          calls_stolen_,
+          calls_dropped_};
+}
+
+}  // namespace blaze_jni
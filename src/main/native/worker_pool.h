@@ -0,0 +1,154 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// INTERNAL header file for use by C++ code in this package.
+//
+// The threads on which the bulk JNI entry points (batched stats, file copies,
+// tree creation and deletion, file digests and Merkle trees) run in parallel.
+// They are shared by all of them, so that concurrent calls from many Java
+// threads together use no more threads than the server has CPUs, cgroup CPU
+// quota included. POSIX only.
+
+#ifndef BAZEL_SRC_MAIN_NATIVE_WORKER_POOL_H_
+#define BAZEL_SRC_MAIN_NATIVE_WORKER_POOL_H_
+
+#include <stdint.h>
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace blaze_jni {
+
+// Counters of the WorkerPool, for monitoring.
+struct WorkerPoolStats {
+  // The number of threads of the pool, 0 until it is first used.
+  int64_t threads;
+  // The number of calls the pool threads are running.
+  int64_t active;
+  // The number of calls queued for the pool threads and not started yet.
+  int64_t queue_depth;
+  // The most calls ever queued at once.
+  int64_t max_queue_depth;
+  // The number of calls the pool threads ran.
+  int64_t calls_run;
+  // The number of those a thread took from the queue of another one.
+  int64_t calls_stolen;
+  // The number of calls dropped because their caller had done all the work
+  // before a pool thread was free to run them.
+  int64_t calls_dropped;
+};
+
+// A fixed set of threads, each with a queue of calls to make. A thread runs
+// the most recent call of its own queue, or else steals the oldest call of
+// another queue. The calls queued by a pool thread go to its own queue, the
+// others are spread over all of them.
+//
+// The pool never makes a caller wait for a call to start: the calling thread
+// always takes part in the work, and the calls that have not started by the
+// time it is done are dropped. The work must therefore be split so that any
+// number of calls finish it, e.g. by having them claim items from a shared
+// counter. This is also why calls made from pool threads cannot deadlock.
+class WorkerPool {
+ public:
+  // Returns the pool of the process. Its threads start on first use.
+  static WorkerPool &Get();
+
+  // Calls work(i) for every i below parallelism, work(0) on the calling
+  // thread and the others on pool threads as they become free, see
+  // WorkerPool. Returns once work(0) and the calls that started returned.
+  void Run(int parallelism, const std::function<void(int)> &work);
+
+  // Stops the threads of the pool once they are done with their current
+  // call. Later calls of Run only call work(0). Called when the server shuts
+  // down.
+  void Shutdown();
+
+  WorkerPoolStats GetStats();
+
+  // Calls work(first) to work(last - 1) on pool threads as they become free,
+  // until destroyed. Destruction drops the calls that have not started and
+  // waits for the others to return.
+  class Helpers {
+   public:
+    Helpers(WorkerPool *pool, int first, int last,
+            std::function<void(int)> work);
+    ~Helpers();
+
+    Helpers(const Helpers &) = delete;
+    Helpers &operator=(const Helpers &) = delete;
+
+   private:
+    friend class WorkerPool;
+    struct Batch;
+    WorkerPool *pool_;
+    std::shared_ptr<Batch> batch_;
+  };
+
+ private:
+  WorkerPool() = default;
+
+  struct Call {
+    std::shared_ptr<Helpers::Batch> batch;
+    int index;
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Call> calls;
+  };
+
+  // Starts the threads unless they are started or the pool is shut down.
+  // Returns whether there are threads to run calls. Called with mutex_ held.
+  bool EnsureStarted();
+  // Queues the calls, to the queue of the calling thread if it is a pool
+  // thread. Returns false if the pool has no threads to make them.
+  bool Enqueue(const std::vector<Call> &calls);
+  // Takes the most recent call of the queue of worker, or else the oldest
+  // call of another queue. Returns false if all are empty.
+  bool Take(size_t worker, Call *call, bool *stolen);
+  void WorkerLoop(size_t worker);
+  // Makes the call unless its Helpers are destroyed. Returns whether it did.
+  static bool RunCall(const Call &call);
+  // Removes the calls of a destroyed Helpers from the queues.
+  void Drop(const Helpers::Batch *batch);
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool started_ = false;
+  bool stopping_ = false;
+  // The calls queued and not taken yet, guarded by mutex_.
+  int64_t queued_ = 0;
+  int64_t active_ = 0;
+  int64_t max_queued_ = 0;
+  int64_t calls_run_ = 0;
+  int64_t calls_stolen_ = 0;
+  int64_t calls_dropped_ = 0;
+  size_t next_queue_ = 0;
+  // Fixed once started.
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+};
+
+// Returns the number of CPUs the process may use: the CPUs of its affinity
+// mask, and no more than its cgroup CPU quota, rounded up.
+int UsableCpus();
+
+}  // namespace blaze_jni
+
+#endif  // BAZEL_SRC_MAIN_NATIVE_WORKER_POOL_H_
@@ -18,11 +18,15 @@
 #include <string.h>
 #include <windows.h>
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "src/main/cpp/util/file_platform.h"
 #include "src/main/cpp/util/path_platform.h"
@@ -89,6 +93,13 @@ wstring AsAbsoluteWindowsPath(const wchar_t* path) {
   return wpath;
 }
 
+bool DoesFilePathExist(const wchar_t* path) {
+  DWORD dwAttrib = GetFileAttributesW(AsAbsoluteWindowsPath(path).c_str());
+
+  return (dwAttrib != INVALID_FILE_ATTRIBUTES &&
+          !(dwAttrib & FILE_ATTRIBUTE_DIRECTORY));
+}
+
 bool DoesDirectoryPathExist(const wchar_t* path) {
   DWORD dwAttrib = GetFileAttributesW(AsAbsoluteWindowsPath(path).c_str());
 
@@ -175,11 +186,37 @@ class RunfilesCreator {
   }
 
   void ReadManifest(bool allow_relative, bool ignore_metadata) {
+    allow_relative_ = allow_relative;
+    ignore_metadata_ = ignore_metadata;
+    ReadManifestFile(manifest_path_, &manifest_file_map);
+  }
+
+  void CreateRunfiles(bool incremental, int threads) {
+    // The copy of the manifest from the previous run describes the tree, since
+    // it is only written once the tree is complete.
+    wstring applied_manifest = runfiles_output_base_ + L"\\MANIFEST";
+    if (incremental && DoesFilePathExist(applied_manifest.c_str())) {
+      ManifestFileMap applied;
+      ReadManifestFile(applied_manifest, &applied);
+      DeleteFileOrDie(applied_manifest);
+      UpdateTree(applied);
+    } else {
+      ScanTreeAndPrune(runfiles_output_base_);
+    }
+    CreateFiles(threads);
+    CopyManifestFile();
+  }
+
+ private:
+  // Parses a manifest into a map from absolute link paths to absolute target
+  // paths, which are empty for empty files.
+  void ReadManifestFile(const wstring& manifest_path,
+                        ManifestFileMap* entries) {
     ifstream manifest_file(
-        AsAbsoluteWindowsPath(manifest_path_.c_str()).c_str());
+        AsAbsoluteWindowsPath(manifest_path.c_str()).c_str());
 
     if (!manifest_file) {
-      die(L"Couldn't open MANIFEST file: %s", manifest_path_.c_str());
+      die(L"Couldn't open MANIFEST file: %s", manifest_path.c_str());
     }
 
     string line;
@@ -188,7 +225,7 @@ class RunfilesCreator {
       lineno++;
       // Skip metadata lines. They are used solely for
       // dependency checking.
-      if (ignore_metadata && lineno % 2 == 0) {
+      if (ignore_metadata_ && lineno % 2 == 0) {
         continue;
       }
 
@@ -217,7 +254,7 @@ class RunfilesCreator {
       // For example, for python binary, __init__.py is needed under every
       // directory. Storing an entry with an empty target indicates we need to
       // create such a file when creating the runfiles tree.
-      if (!allow_relative && !target.empty() &&
+      if (!allow_relative_ && !target.empty() &&
           !blaze_util::IsAbsolute(target)) {
         die(L"Target cannot be relative path: %hs", line.c_str());
       }
@@ -227,17 +264,10 @@ class RunfilesCreator {
         target = AsAbsoluteWindowsPath(target.c_str());
       }
 
-      manifest_file_map.insert(make_pair(link, target));
+      entries->insert(make_pair(link, target));
     }
   }
 
-  void CreateRunfiles() {
-    ScanTreeAndPrune(runfiles_output_base_);
-    CreateFiles();
-    CopyManifestFile();
-  }
-
- private:
   void SetupOutputBase() {
     if (!DoesDirectoryPathExist(runfiles_output_base_.c_str())) {
       MakeDirectoriesOrDie(runfiles_output_base_);
@@ -253,7 +283,8 @@ class RunfilesCreator {
 
   void RemoveDirectoryOrDie(const wstring& path) {
     if (!RemoveDirectoryW(path.c_str())) {
-      die(L"RemoveDirectoryW failed (%s): %hs", GetLastErrorString().c_str());
+      die(L"RemoveDirectoryW failed (%s): %hs", path.c_str(),
+          GetLastErrorString().c_str());
     }
   }
 
@@ -274,8 +305,12 @@ class RunfilesCreator {
     static const wstring kDot(L".");
     static const wstring kDotDot(L"..");
 
+    // Skip the short names, which are not needed, and fetch the entries in
+    // larger batches.
     WIN32_FIND_DATAW metadata;
-    HANDLE handle = ::FindFirstFileW((path + L"\\*").c_str(), &metadata);
+    HANDLE handle = ::FindFirstFileExW(
+        (path + L"\\*").c_str(), FindExInfoBasic, &metadata,
+        FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
     if (handle == INVALID_HANDLE_VALUE) {
       return;  // directory does not exist or is empty
     }
@@ -337,61 +372,140 @@ class RunfilesCreator {
     ::FindClose(handle);
   }
 
-  void CreateFiles() {
+  // Brings the tree from the state described by the applied manifest to that
+  // of the input manifest. Entries that did not change are erased from
+  // manifest_file_map, so that CreateFiles won't recreate them.
+  void UpdateTree(const ManifestFileMap& applied) {
+    for (const auto& it : applied) {
+      ManifestFileMap::iterator expected = manifest_file_map.find(it.first);
+      if (expected != manifest_file_map.end() &&
+          expected->second == it.second) {
+        manifest_file_map.erase(expected);
+      } else {
+        RemoveIfPresent(it.first);
+        RemoveEmptyParentDirectories(it.first);
+      }
+    }
+    // Something may be left where the applied manifest has nothing, for
+    // example from an interrupted run.
     for (const auto& it : manifest_file_map) {
-      // Ensure the parent directory exists
-      wstring parent_dir = GetParentDirFromPath(it.first);
+      if (applied.find(it.first) == applied.end()) {
+        RemoveIfPresent(it.first);
+      }
+    }
+  }
+
+  void RemoveIfPresent(const wstring& path) {
+    DWORD attributes = GetFileAttributesW(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES) {
+      return;
+    }
+    if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+      RemoveDirectoryOrDie(path);
+    } else {
+      DeleteFileOrDie(path);
+    }
+  }
+
+  // Removes the directories above path up to the runfiles directory, for as
+  // long as they are empty.
+  void RemoveEmptyParentDirectories(const wstring& path) {
+    wstring dir = GetParentDirFromPath(path);
+    while (dir.size() > runfiles_output_base_.size() &&
+           RemoveDirectoryW(dir.c_str())) {
+      dir = GetParentDirFromPath(dir);
+    }
+  }
+
+  // Creates the entries of manifest_file_map with the given number of
+  // threads. Symlink creation is slow on Windows, all the more so with
+  // on-access scanning, so it pays to have several of them in flight.
+  void CreateFiles(int threads) {
+    // Ensure the parent directories exist, so that the entries can then be
+    // created in any order.
+    std::set<wstring> parent_dirs;
+    for (const auto& it : manifest_file_map) {
+      parent_dirs.insert(GetParentDirFromPath(it.first));
+    }
+    for (const wstring& parent_dir : parent_dirs) {
       if (!DoesDirectoryPathExist(parent_dir.c_str())) {
         MakeDirectoriesOrDie(parent_dir);
       }
+    }
 
-      if (it.second.empty()) {
-        // Create an empty file
-        HANDLE h = CreateFileW(it.first.c_str(),  // name of the file
-                               GENERIC_WRITE,     // open for writing
-                               // Must share for reading, otherwise
-                               // symlink-following file existence checks (e.g.
-                               // java.nio.file.Files.exists()) fail.
-                               FILE_SHARE_READ,
-                               0,  // use default security descriptor
-                               CREATE_ALWAYS,  // overwrite if exists
-                               FILE_ATTRIBUTE_NORMAL, 0);
-        if (h != INVALID_HANDLE_VALUE) {
-          CloseHandle(h);
-        } else {
-          die(L"CreateFileW failed (%s): %hs", it.first.c_str(),
-              GetLastErrorString().c_str());
+    std::vector<const ManifestFileMap::value_type*> entries;
+    entries.reserve(manifest_file_map.size());
+    for (const auto& it : manifest_file_map) {
+      entries.push_back(&it);
+    }
+    if (threads <= 1) {
+      for (const ManifestFileMap::value_type* entry : entries) {
+        CreateEntry(*entry);
+      }
+      return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+      workers.emplace_back([this, &entries, &next]() {
+        for (size_t j = next++; j < entries.size(); j = next++) {
+          CreateEntry(*entries[j]);
         }
+      });
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+
+  void CreateEntry(const ManifestFileMap::value_type& it) {
+    if (it.second.empty()) {
+      // Create an empty file
+      HANDLE h = CreateFileW(it.first.c_str(),  // name of the file
+                             GENERIC_WRITE,     // open for writing
+                             // Must share for reading, otherwise
+                             // symlink-following file existence checks (e.g.
+                             // java.nio.file.Files.exists()) fail.
+                             FILE_SHARE_READ,
+                             0,  // use default security descriptor
+                             CREATE_ALWAYS,  // overwrite if exists
+                             FILE_ATTRIBUTE_NORMAL, 0);
+      if (h != INVALID_HANDLE_VALUE) {
+        CloseHandle(h);
       } else {
-        DWORD create_dir = 0;
-        if (blaze_util::IsDirectoryW(it.second.c_str())) {
-          create_dir = SYMBOLIC_LINK_FLAG_DIRECTORY;
-        }
-        if (!CreateSymbolicLinkW(
-                it.first.c_str(), it.second.c_str(),
-                bazel::windows::symlinkPrivilegeFlag | create_dir)) {
-          if (GetLastError() == ERROR_INVALID_PARAMETER) {
-            // We are on a version of Windows that does not support this flag.
-            // Retry without the flag and return to error handling if necessary.
-            if (CreateSymbolicLinkW(it.first.c_str(), it.second.c_str(),
-                                    create_dir)) {
-              return;
-            }
-          }
-          if (GetLastError() == ERROR_PRIVILEGE_NOT_HELD) {
-            die(L"CreateSymbolicLinkW failed:\n%hs\n",
-                "Bazel needs to create symlinks to build the runfiles tree.\n"
-                "Creating symlinks on Windows requires one of the following:\n"
-                "    1. Bazel is run with administrator privileges.\n"
-                "    2. The system version is Windows 10 Creators Update "
-                "(1703) or "
-                "later and developer mode is enabled.",
-                GetLastErrorString().c_str());
-          } else {
-            die(L"CreateSymbolicLinkW failed (%s -> %s): %hs", it.first.c_str(),
-                it.second.c_str(), GetLastErrorString().c_str());
+        die(L"CreateFileW failed (%s): %hs", it.first.c_str(),
+            GetLastErrorString().c_str());
+      }
+    } else {
+      DWORD create_dir = 0;
+      if (blaze_util::IsDirectoryW(it.second.c_str())) {
+        create_dir = SYMBOLIC_LINK_FLAG_DIRECTORY;
+      }
+      if (!CreateSymbolicLinkW(
+              it.first.c_str(), it.second.c_str(),
+              bazel::windows::symlinkPrivilegeFlag | create_dir)) {
+        if (GetLastError() == ERROR_INVALID_PARAMETER) {
+          // We are on a version of Windows that does not support this flag.
+          // Retry without the flag and return to error handling if necessary.
+          if (CreateSymbolicLinkW(it.first.c_str(), it.second.c_str(),
+                                  create_dir)) {
+            return;
           }
         }
+        if (GetLastError() == ERROR_PRIVILEGE_NOT_HELD) {
+          die(L"CreateSymbolicLinkW failed:\n%hs\n",
+              "Bazel needs to create symlinks to build the runfiles tree.\n"
+              "Creating symlinks on Windows requires one of the following:\n"
+              "    1. Bazel is run with administrator privileges.\n"
+              "    2. The system version is Windows 10 Creators Update "
+              "(1703) or "
+              "later and developer mode is enabled.",
+              GetLastErrorString().c_str());
+        } else {
+          die(L"CreateSymbolicLinkW failed (%s -> %s): %hs", it.first.c_str(),
+              it.second.c_str(), GetLastErrorString().c_str());
+        }
       }
     }
   }
@@ -408,6 +522,8 @@ class RunfilesCreator {
  private:
   wstring manifest_path_;
   wstring runfiles_output_base_;
+  bool allow_relative_ = false;
+  bool ignore_metadata_ = false;
   ManifestFileMap manifest_file_map;
 };
 
@@ -416,6 +532,8 @@ int wmain(int argc, wchar_t** argv) {
   argv++;
   bool allow_relative = false;
   bool ignore_metadata = false;
+  bool incremental = false;
+  int threads = 1;
 
   while (argc >= 1) {
     if (wcscmp(argv[0], L"--allow_relative") == 0) {
@@ -428,6 +546,18 @@ int wmain(int argc, wchar_t** argv) {
       ignore_metadata = true;
       argc--;
       argv++;
+    } else if (wcscmp(argv[0], L"--incremental") == 0) {
+      // If --incremental is passed and the runfiles directory has a MANIFEST,
+      // only the entries that differ from it are updated. This is only correct
+      // if nothing else modifies the tree, and if the previous run had the
+      // same --use_metadata setting.
+      incremental = true;
+      argc--;
+      argv++;
+    } else if (wcscmp(argv[0], L"--threads") == 0 && argc >= 2) {
+      threads = _wtoi(argv[1]);
+      argc -= 2;
+      argv += 2;
     } else {
       break;
     }
@@ -435,8 +565,8 @@ int wmain(int argc, wchar_t** argv) {
 
   if (argc != 2) {
     fprintf(stderr,
-            "usage: [--allow_relative] [--use_metadata] "
-            "<manifest_file> <runfiles_base_dir>\n");
+            "usage: [--allow_relative] [--use_metadata] [--incremental] "
+            "[--threads N] <manifest_file> <runfiles_base_dir>\n");
     return 1;
   }
 
@@ -449,7 +579,7 @@ int wmain(int argc, wchar_t** argv) {
   RunfilesCreator runfiles_creator(manifest_absolute_path,
                                    output_base_absolute_path);
   runfiles_creator.ReadManifest(allow_relative, ignore_metadata);
-  runfiles_creator.CreateRunfiles();
+  runfiles_creator.CreateRunfiles(incremental, threads);
 
   return 0;
 }
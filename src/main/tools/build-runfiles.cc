@@ -37,6 +37,36 @@
 // If --use_metadata is supplied, every other line is treated as opaque
 // metadata, and is ignored here.
 //
+// If --threads N is supplied with N > 1, missing files are created by that
+// many threads, one directory at a time each.
+//
+// If --incremental is supplied and RUNFILES/MANIFEST exists, it is taken to
+// describe the current state of the tree, which is then only updated where the
+// input manifest differs from it instead of being scanned in full. This is
+// only correct if nothing else modifies the tree, and if the previous run had
+// the same --use_metadata and --index_only settings.
+//
+// If --index is supplied, RUNFILES/MANIFEST.index is written as well. It maps
+// the same paths to the same targets as the manifest, but can be mapped into
+// memory and searched in place instead of being parsed. All numbers in it are
+// unsigned integers in host byte order, of 32 bits unless noted otherwise:
+//   the magic "RFINDEX2" (8 bytes), the number of entries N, and the offset S
+//   of the string table from the start of the file;
+//   the size of RUNFILES/MANIFEST in bytes and its modification time in
+//   milliseconds since the epoch, of 64 bits each. Readers only use the index
+//   if the manifest still has this size and modification time, and look the
+//   paths up in the manifest otherwise;
+//   N records of four numbers each: the offset and length of the path, and
+//   the offset and length of the target, where an empty target denotes an
+//   empty file. Offsets are relative to S. The records are sorted by the bytes
+//   of their paths, so that a path can be looked up with a binary search;
+//   the string table, which holds the unescaped paths and targets without
+//   separators or terminators.
+//
+// If --index_only is supplied, the index is written but no tree is created:
+// RUNFILES then only contains the manifest and the index, and runfiles have to
+// be looked up in either of them.
+//
 // All output paths must be relative and generally (but not always) begin with
 // <workspace root>. No output path may be equal to another.  No output path may
 // be a path prefix of another.
@@ -47,14 +77,24 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
 
 // program_invocation_short_name is not portable.
 static const char *argv0;
@@ -90,7 +130,8 @@ enum FileType {
 
 struct FileInfo {
   FileType type;
-  std::string symlink_target;
+  // Points into a manifest, or into the unescaped paths of RunfilesCreator.
+  std::string_view symlink_target;
 
   bool operator==(const FileInfo &other) const {
     return type == other.type && symlink_target == other.symlink_target;
@@ -101,10 +142,15 @@ struct FileInfo {
   }
 };
 
-typedef std::map<std::string, FileInfo> FileInfoMap;
+// The paths are views of the manifests, which are mapped into memory and parsed
+// in place, so the maps hold no strings of their own.
+typedef absl::flat_hash_map<std::string_view, FileInfo> FileInfoMap;
+
+// An entry of a FileInfoMap. Used where the entries must be visited in order.
+typedef const FileInfoMap::value_type *FileInfoEntry;
 
 // Replaces \s, \n, and \b with their respective characters.
-std::string Unescape(const std::string &path) {
+std::string Unescape(std::string_view path) {
   std::string result;
   result.reserve(path.size());
   for (size_t i = 0; i < path.size(); ++i) {
@@ -136,12 +182,68 @@ std::string Unescape(const std::string &path) {
   return result;
 }
 
+// A manifest mapped into memory. The entries parsed from it point into the
+// mapping, so it must outlive them.
+class MappedManifest {
+ public:
+  explicit MappedManifest(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      PDIE("opening '%s' for reading", path.c_str());
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      PDIE("stating file '%s'", path.c_str());
+    }
+    size_ = st.st_size;
+    if (size_ > 0) {
+      void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        PDIE("mapping '%s'", path.c_str());
+      }
+      data_ = static_cast<const char *>(data);
+    }
+    close(fd);
+  }
+
+  ~MappedManifest() {
+    if (size_ > 0) {
+      munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  MappedManifest(const MappedManifest &) = delete;
+  MappedManifest &operator=(const MappedManifest &) = delete;
+
+  std::string_view contents() const { return std::string_view(data_, size_); }
+
+ private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Returns the entries of a map sorted by path, which puts every directory
+// before its entries.
+std::vector<FileInfoEntry> SortedEntries(const FileInfoMap &entries) {
+  std::vector<FileInfoEntry> sorted;
+  sorted.reserve(entries.size());
+  for (const FileInfoMap::value_type &entry : entries) {
+    sorted.push_back(&entry);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](FileInfoEntry a, FileInfoEntry b) {
+    return a->first < b->first;
+  });
+  return sorted;
+}
+
 class RunfilesCreator {
  public:
   explicit RunfilesCreator(const std::string &output_base)
       : output_base_(output_base),
         output_filename_("MANIFEST"),
-        temp_filename_(output_filename_ + ".tmp") {
+        temp_filename_(output_filename_ + ".tmp"),
+        index_filename_(output_filename_ + ".index"),
+        index_temp_filename_(index_filename_ + ".tmp") {
     SetupOutputBase();
     if (chdir(output_base_.c_str()) != 0) {
       PDIE("chdir '%s'", output_base_.c_str());
@@ -150,6 +252,9 @@ class RunfilesCreator {
 
   void ReadManifest(const std::string &manifest_file, bool allow_relative,
                     bool use_metadata) {
+    allow_relative_ = allow_relative;
+    use_metadata_ = use_metadata;
+
     // Remove file left over from previous invocation. This ensures that
     // opening succeeds if the existing file is read-only.
     if (unlink(temp_filename_.c_str()) != 0 && errno != ENOENT) {
@@ -161,62 +266,136 @@ class RunfilesCreator {
       PDIE("opening '%s/%s' for writing", output_base_.c_str(),
            temp_filename_.c_str());
     }
-    FILE *infile = fopen(manifest_file.c_str(), "r");
-    if (!infile) {
-      PDIE("opening '%s' for reading", manifest_file.c_str());
+    input_ = std::make_unique<MappedManifest>(manifest_file);
+    const std::string_view contents = input_->contents();
+    if (fwrite(contents.data(), 1, contents.size(), outfile) !=
+            contents.size() ||
+        fclose(outfile) != 0) {
+      PDIE("writing to '%s/%s'", output_base_.c_str(),
+           temp_filename_.c_str());
+    }
+    ParseManifest(contents, &manifest_);
+
+    // Don't delete the temp manifest file.
+    manifest_[temp_filename_].type = FILE_TYPE_REGULAR;
+  }
+
+  void CreateRunfiles(bool incremental, int threads, bool index,
+                      bool index_only) {
+    // The output manifest of the previous run describes the tree, since it is
+    // only moved into place once the tree is complete.
+    std::unique_ptr<MappedManifest> applied_manifest;
+    FileInfoMap applied;
+    const bool update = incremental && !index_only &&
+                        access(output_filename_.c_str(), F_OK) == 0;
+    if (update) {
+      applied_manifest = std::make_unique<MappedManifest>(output_filename_);
+      ParseManifest(applied_manifest->contents(), &applied);
     }
 
-    // read input manifest
-    int lineno = 0;
-    char buf[3 * PATH_MAX];
-    while (fgets(buf, sizeof buf, infile)) {
-      // copy line to output manifest
-      if (fputs(buf, outfile) == EOF) {
-        PDIE("writing to '%s/%s'", output_base_.c_str(),
-             temp_filename_.c_str());
+    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           output_filename_.c_str());
+    }
+    // The index of the previous run is not part of any manifest, so an
+    // incremental update would otherwise leave it behind.
+    if (unlink(index_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
+           index_filename_.c_str());
+    }
+
+    if (index_only) {
+      // Prune everything but the temp manifest file, and keep the entries for
+      // the index.
+      FileInfoMap indexed;
+      indexed.swap(manifest_);
+      manifest_[temp_filename_].type = FILE_TYPE_REGULAR;
+      std::string path;
+      ScanTreeAndPrune(&path);
+      WriteIndex(indexed);
+    } else if (update) {
+      UpdateTree(applied);
+    } else {
+      std::string path;
+      ScanTreeAndPrune(&path);
+      if (threads > 1) {
+        CreateFilesInParallel(threads);
+      } else {
+        CreateFiles();
       }
+    }
+
+    if (index && !index_only) {
+      WriteIndex(manifest_);
+    }
+
+    // rename output file into place
+    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
+      PDIE("renaming '%s/%s' to '%s/%s'",
+           output_base_.c_str(), temp_filename_.c_str(),
+           output_base_.c_str(), output_filename_.c_str());
+    }
+  }
+
+ private:
+  // Parses a manifest into entries, including the directories its paths
+  // imply.
+  void ParseManifest(std::string_view contents, FileInfoMap *entries) {
+    entries->reserve(std::count(contents.begin(), contents.end(), '\n'));
+
+    int lineno = 0;
+    while (!contents.empty()) {
+      const size_t n = contents.find('\n');
+      const std::string_view line = contents.substr(0, n);
+      contents.remove_prefix(n == std::string_view::npos ? contents.size()
+                                                         : n + 1);
 
       // parse line
       ++lineno;
       // Skip metadata lines. They are used solely for
       // dependency checking.
-      if (use_metadata && lineno % 2 == 0) continue;
+      if (use_metadata_ && lineno % 2 == 0) continue;
 
-      int n = strlen(buf)-1;
-      if (!n || buf[n] != '\n') {
-        DIE("missing terminator at line %d: '%s'\n", lineno, buf);
+      const int len = static_cast<int>(line.size());
+      if (line.empty() || n == std::string_view::npos) {
+        DIE("missing terminator at line %d: '%.*s'\n", lineno, len,
+            line.data());
       }
-      buf[n] = '\0';
-      if (buf[0] ==  '/') {
-        DIE("paths must not be absolute: line %d: '%s'\n", lineno, buf);
+      if (line[0] == '/') {
+        DIE("paths must not be absolute: line %d: '%.*s'\n", lineno, len,
+            line.data());
       }
-      std::string link;
-      std::string target;
-      if (buf[0] == ' ') {
+      std::string_view link;
+      std::string_view target;
+      if (line[0] == ' ') {
         // The link path contains escape sequences for spaces and backslashes.
-        char *s = strchr(buf + 1, ' ');
-        if (!s) {
-          DIE("missing field delimiter at line %d: '%s'\n", lineno, buf);
+        const size_t s = line.find(' ', 1);
+        if (s == std::string_view::npos) {
+          DIE("missing field delimiter at line %d: '%.*s'\n", lineno, len,
+              line.data());
         }
-        link = Unescape(std::string(buf + 1, s));
-        target = Unescape(s + 1);
+        link = Unescaped(line.substr(1, s - 1));
+        target = Unescaped(line.substr(s + 1));
       } else {
         // The line is of the form "foo /target/path", with only a single space
         // in the link path.
-        const char *s = strchr(buf, ' ');
-        if (!s) {
-          DIE("missing field delimiter at line %d: '%s'\n", lineno, buf);
+        const size_t s = line.find(' ');
+        if (s == std::string_view::npos) {
+          DIE("missing field delimiter at line %d: '%.*s'\n", lineno, len,
+              line.data());
         }
-        link = std::string(buf, s - buf);
-        target = s + 1;
+        link = line.substr(0, s);
+        target = line.substr(s + 1);
       }
-      if (!allow_relative && target[0] != '\0' && target[0] != '/'
-          && target[1] != ':') {  // Match Windows paths, e.g. C:\foo or C:/foo.
-        DIE("expected absolute path at line %d: '%s'\n", lineno, buf);
+      if (!allow_relative_ && !target.empty() && target[0] != '/' &&
+          (target.size() < 2 || target[1] != ':')) {
+        // Match Windows paths, e.g. C:\foo or C:/foo.
+        DIE("expected absolute path at line %d: '%.*s'\n", lineno, len,
+            line.data());
       }
 
-      FileInfo *info = &manifest_[link];
-      if (target[0] == '\0') {
+      FileInfo *info = &(*entries)[link];
+      if (target.empty()) {
         // No target means an empty file.
         info->type = FILE_TYPE_REGULAR;
       } else {
@@ -228,40 +407,24 @@ class RunfilesCreator {
       parent_info.type = FILE_TYPE_DIRECTORY;
 
       while (true) {
-        int k = link.rfind('/');
-        if (k < 0) break;
-        link.erase(k, std::string::npos);
-        if (!manifest_.insert(std::make_pair(link, parent_info)).second) break;
+        const size_t k = link.rfind('/');
+        if (k == std::string_view::npos) break;
+        link = link.substr(0, k);
+        if (!entries->emplace(link, parent_info).second) break;
       }
     }
-    if (fclose(outfile) != 0) {
-      PDIE("writing to '%s/%s'", output_base_.c_str(),
-           temp_filename_.c_str());
-    }
-    fclose(infile);
-
-    // Don't delete the temp manifest file.
-    manifest_[temp_filename_].type = FILE_TYPE_REGULAR;
   }
 
-  void CreateRunfiles() {
-    if (unlink(output_filename_.c_str()) != 0 && errno != ENOENT) {
-      PDIE("removing previous file at '%s/%s'", output_base_.c_str(),
-           output_filename_.c_str());
-    }
-
-    ScanTreeAndPrune(".");
-    CreateFiles();
-
-    // rename output file into place
-    if (rename(temp_filename_.c_str(), output_filename_.c_str()) != 0) {
-      PDIE("renaming '%s/%s' to '%s/%s'",
-           output_base_.c_str(), temp_filename_.c_str(),
-           output_base_.c_str(), output_filename_.c_str());
+  // Returns the path with its escape sequences replaced, keeping it in
+  // unescaped_ if it had any.
+  std::string_view Unescaped(std::string_view path) {
+    if (path.find('\\') == std::string_view::npos) {
+      return path;
     }
+    unescaped_.push_back(Unescape(path));
+    return unescaped_.back();
   }
 
- private:
   void SetupOutputBase() {
     struct stat st;
     if (stat(output_base_.c_str(), &st) != 0) {
@@ -275,31 +438,42 @@ class RunfilesCreator {
     }
   }
 
-  void ScanTreeAndPrune(const std::string &path) {
+  // Scans the directory at path, which is empty for the output base, and its
+  // subdirectories. Extends path with the names of the entries as it goes, so
+  // that checking an entry against the manifest needs no new string.
+  void ScanTreeAndPrune(std::string *path) {
     // A note on non-empty files:
     // We don't distinguish between empty and non-empty files. That is, if
     // there's a file that has contents, we don't truncate it here, even though
     // the manifest supports creation of empty files, only. Given that
     // .runfiles are *supposed* to be immutable, this shouldn't be a problem.
-    EnsureDirReadAndWritePerms(path);
+    const std::string dir_path = path->empty() ? "." : *path;
+    EnsureDirReadAndWritePerms(dir_path);
 
     struct dirent *entry;
-    DIR *dh = opendir(path.c_str());
+    DIR *dh = opendir(dir_path.c_str());
     if (!dh) {
-      PDIE("opendir '%s'", path.c_str());
+      PDIE("opendir '%s'", dir_path.c_str());
     }
 
     errno = 0;
-    const std::string prefix = (path == "." ? "" : path + "/");
+    if (!path->empty()) {
+      path->push_back('/');
+    }
+    const size_t prefix_size = path->size();
+    std::string link_target;
     while ((entry = readdir(dh)) != nullptr) {
       if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) continue;
 
-      std::string entry_path = prefix + entry->d_name;
+      path->resize(prefix_size);
+      path->append(entry->d_name);
+      const std::string &entry_path = *path;
       FileInfo actual_info;
       actual_info.type = DentryToFileType(entry_path, entry);
 
       if (actual_info.type == FILE_TYPE_SYMLINK) {
-        ReadLinkOrDie(entry_path, &actual_info.symlink_target);
+        ReadLinkOrDie(entry_path, &link_target);
+        actual_info.symlink_target = link_target;
       }
 
       FileInfoMap::iterator expected_it = manifest_.find(entry_path);
@@ -317,47 +491,270 @@ class RunfilesCreator {
       } else {
         manifest_.erase(expected_it);
         if (actual_info.type == FILE_TYPE_DIRECTORY) {
-          ScanTreeAndPrune(entry_path);
+          ScanTreeAndPrune(path);
         }
       }
 
       errno = 0;
     }
     if (errno != 0) {
-      PDIE("reading directory '%s'", path.c_str());
+      PDIE("reading directory '%s'", dir_path.c_str());
     }
     closedir(dh);
+    path->resize(prefix_size > 0 ? prefix_size - 1 : 0);
   }
 
   void CreateFiles() {
-    for (FileInfoMap::const_iterator it = manifest_.begin();
-         it != manifest_.end(); ++it) {
-      const std::string &path = it->first;
-      switch (it->second.type) {
+    for (FileInfoEntry entry : SortedEntries(manifest_)) {
+      CreateFile(std::string(entry->first), entry->second);
+    }
+  }
+
+  void CreateFile(const std::string &path, const FileInfo &info) {
+    switch (info.type) {
+      case FILE_TYPE_DIRECTORY:
+        if (mkdir(path.c_str(), 0777) != 0) {
+          PDIE("mkdir '%s'", path.c_str());
+        }
+        break;
+      case FILE_TYPE_REGULAR:
+        {
+          int fd = open(path.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0555);
+          if (fd < 0) {
+            PDIE("creating empty file '%s'", path.c_str());
+          }
+          close(fd);
+        }
+        break;
+      case FILE_TYPE_SYMLINK:
+        {
+          const std::string target(info.symlink_target);
+          if (symlink(target.c_str(), path.c_str()) != 0) {
+            PDIE("symlinking '%s' -> '%s'", path.c_str(), target.c_str());
+          }
+        }
+        break;
+    }
+  }
+
+  // Creates the missing files with the given number of threads. The entries
+  // are grouped by their directory, and each thread creates all entries of
+  // one directory at a time relative to a file descriptor of it, which saves
+  // the kernel from resolving the full path for each of them. Directories are
+  // processed level by level, so that the subdirectories that a level creates
+  // exist before the next level.
+  void CreateFilesInParallel(int threads) {
+    typedef absl::flat_hash_map<std::string_view, std::vector<FileInfoEntry>>
+        Level;
+    std::vector<Level> levels;
+    for (const FileInfoMap::value_type &entry : manifest_) {
+      const std::string_view path = entry.first;
+      const size_t slash = path.rfind('/');
+      const size_t depth = std::count(path.begin(), path.end(), '/');
+      const std::string_view dir =
+          slash == std::string_view::npos ? "." : path.substr(0, slash);
+      if (levels.size() <= depth) {
+        levels.resize(depth + 1);
+      }
+      levels[depth][dir].push_back(&entry);
+    }
+
+    for (const Level &level : levels) {
+      std::vector<const Level::value_type *> dirs;
+      for (const Level::value_type &dir : level) {
+        dirs.push_back(&dir);
+      }
+      std::atomic<size_t> next(0);
+      auto worker = [this, &dirs, &next]() {
+        for (size_t i = next++; i < dirs.size(); i = next++) {
+          CreateFilesInDirectory(dirs[i]->first, dirs[i]->second);
+        }
+      };
+      std::vector<std::thread> pool;
+      for (int t = 1; t < threads && static_cast<size_t>(t) < dirs.size();
+           ++t) {
+        pool.emplace_back(worker);
+      }
+      worker();
+      for (std::thread &thread : pool) {
+        thread.join();
+      }
+    }
+  }
+
+  void CreateFilesInDirectory(std::string_view dir,
+                              const std::vector<FileInfoEntry> &entries) {
+    const std::string dir_path(dir);
+    int dirfd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) {
+      PDIE("opening directory '%s'", dir_path.c_str());
+    }
+    const size_t prefix = dir == "." ? 0 : dir.size() + 1;
+    // The paths in the manifest are not NUL-terminated.
+    std::string name;
+    std::string target;
+    for (FileInfoEntry entry : entries) {
+      name.assign(entry->first.substr(prefix));
+      switch (entry->second.type) {
         case FILE_TYPE_DIRECTORY:
-          if (mkdir(path.c_str(), 0777) != 0) {
-            PDIE("mkdir '%s'", path.c_str());
+          if (mkdirat(dirfd, name.c_str(), 0777) != 0) {
+            PDIE("mkdir '%s/%s'", dir_path.c_str(), name.c_str());
           }
           break;
         case FILE_TYPE_REGULAR:
           {
-            int fd = open(path.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0555);
+            int fd = openat(dirfd, name.c_str(), O_CREAT|O_EXCL|O_WRONLY, 0555);
             if (fd < 0) {
-              PDIE("creating empty file '%s'", path.c_str());
+              PDIE("creating empty file '%s/%s'", dir_path.c_str(),
+                   name.c_str());
             }
             close(fd);
           }
           break;
         case FILE_TYPE_SYMLINK:
           {
-            const std::string& target = it->second.symlink_target;
-            if (symlink(target.c_str(), path.c_str()) != 0) {
-              PDIE("symlinking '%s' -> '%s'", path.c_str(), target.c_str());
+            target.assign(entry->second.symlink_target);
+            if (symlinkat(target.c_str(), dirfd, name.c_str()) != 0) {
+              PDIE("symlinking '%s/%s' -> '%s'", dir_path.c_str(),
+                   name.c_str(), target.c_str());
             }
           }
           break;
       }
     }
+    close(dirfd);
+  }
+
+  // Brings the tree from the state described by the applied manifest to that
+  // of the input manifest, touching only the entries that differ.
+  void UpdateTree(const FileInfoMap &applied) {
+    // Remove what is gone or changed. Iterating backwards visits the entries
+    // of a directory before the directory itself.
+    const std::vector<FileInfoEntry> sorted_applied = SortedEntries(applied);
+    for (auto it = sorted_applied.rbegin(); it != sorted_applied.rend(); ++it) {
+      FileInfoMap::const_iterator expected_it = manifest_.find((*it)->first);
+      if (expected_it == manifest_.end() ||
+          expected_it->second != (*it)->second) {
+        RemoveIfPresent(std::string((*it)->first));
+      }
+    }
+
+    // Create what is new or changed, directories before their entries.
+    for (FileInfoEntry entry : SortedEntries(manifest_)) {
+      FileInfoMap::const_iterator applied_it = applied.find(entry->first);
+      const bool unchanged =
+          applied_it != applied.end() && applied_it->second == entry->second;
+      if (entry->first == temp_filename_ || unchanged) {
+        continue;
+      }
+      // Something may be left where the applied manifest has nothing, for
+      // example from an interrupted run.
+      const std::string path(entry->first);
+      RemoveIfPresent(path);
+      CreateFile(path, entry->second);
+    }
+  }
+
+  // Writes the index of the given entries, as described at the top of this
+  // file, and moves it into place.
+  void WriteIndex(const FileInfoMap &entries) {
+    std::vector<FileInfoEntry> indexed;
+    indexed.reserve(entries.size());
+    size_t strings_size = 0;
+    for (FileInfoEntry entry : SortedEntries(entries)) {
+      if (entry->second.type == FILE_TYPE_DIRECTORY ||
+          entry->first == temp_filename_) {
+        continue;
+      }
+      indexed.push_back(entry);
+      strings_size += entry->first.size() + entry->second.symlink_target.size();
+    }
+
+    const size_t header_size = 8 + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    const size_t records_size = indexed.size() * 4 * sizeof(uint32_t);
+    if (header_size + records_size + strings_size > UINT32_MAX) {
+      DIE("runfiles index would exceed 4 GiB");
+    }
+
+    // The temp manifest is complete, and renaming it into place keeps its size
+    // and modification time.
+    struct stat manifest_stat;
+    if (stat(temp_filename_.c_str(), &manifest_stat) != 0) {
+      PDIE("stat '%s/%s'", output_base_.c_str(), temp_filename_.c_str());
+    }
+#if defined(__APPLE__)
+    const struct timespec &mtime = manifest_stat.st_mtimespec;
+#else
+    const struct timespec &mtime = manifest_stat.st_mtim;
+#endif
+    const uint64_t manifest_size = manifest_stat.st_size;
+    const uint64_t manifest_mtime_ms =
+        static_cast<uint64_t>(mtime.tv_sec) * 1000 + mtime.tv_nsec / 1000000;
+
+    std::vector<uint32_t> header_and_records;
+    header_and_records.reserve((header_size + records_size) / sizeof(uint32_t));
+    header_and_records.resize(header_size / sizeof(uint32_t));
+    char *header = reinterpret_cast<char *>(header_and_records.data());
+    const uint32_t count = indexed.size();
+    const uint32_t strings_offset = header_size + records_size;
+    memcpy(header, "RFINDEX2", 8);
+    memcpy(header + 8, &count, sizeof(count));
+    memcpy(header + 12, &strings_offset, sizeof(strings_offset));
+    memcpy(header + 16, &manifest_size, sizeof(manifest_size));
+    memcpy(header + 24, &manifest_mtime_ms, sizeof(manifest_mtime_ms));
+    std::string strings;
+    strings.reserve(strings_size);
+    for (FileInfoEntry entry : indexed) {
+      header_and_records.push_back(strings.size());
+      header_and_records.push_back(entry->first.size());
+      strings.append(entry->first);
+      header_and_records.push_back(strings.size());
+      header_and_records.push_back(entry->second.symlink_target.size());
+      strings.append(entry->second.symlink_target);
+    }
+
+    if (unlink(index_temp_filename_.c_str()) != 0 && errno != ENOENT) {
+      PDIE("removing temporary file at '%s/%s'", output_base_.c_str(),
+           index_temp_filename_.c_str());
+    }
+    FILE *outfile = fopen(index_temp_filename_.c_str(), "w");
+    if (!outfile) {
+      PDIE("opening '%s/%s' for writing", output_base_.c_str(),
+           index_temp_filename_.c_str());
+    }
+    if (fwrite(header_and_records.data(), sizeof(uint32_t),
+               header_and_records.size(),
+               outfile) != header_and_records.size() ||
+        fwrite(strings.data(), 1, strings.size(), outfile) != strings.size() ||
+        fclose(outfile) != 0) {
+      PDIE("writing to '%s/%s'", output_base_.c_str(),
+           index_temp_filename_.c_str());
+    }
+    if (rename(index_temp_filename_.c_str(), index_filename_.c_str()) != 0) {
+      PDIE("renaming '%s/%s' to '%s/%s'",
+           output_base_.c_str(), index_temp_filename_.c_str(),
+           output_base_.c_str(), index_filename_.c_str());
+    }
+  }
+
+  void RemoveIfPresent(const std::string &path) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+      if (errno == ENOENT || errno == ENOTDIR) {
+        return;
+      }
+      PDIE("lstating file '%s'", path.c_str());
+    }
+    const std::string::size_type slash = path.rfind('/');
+    EnsureDirReadAndWritePerms(
+        slash == std::string::npos ? "." : path.substr(0, slash));
+    if (S_ISDIR(st.st_mode)) {
+      DelTree(path, FILE_TYPE_DIRECTORY);
+    } else if (S_ISLNK(st.st_mode)) {
+      DelTree(path, FILE_TYPE_SYMLINK);
+    } else {
+      DelTree(path, FILE_TYPE_REGULAR);
+    }
   }
 
   FileType DentryToFileType(const std::string &path, struct dirent *ent) {
@@ -459,7 +856,15 @@ class RunfilesCreator {
   std::string output_base_;
   std::string output_filename_;
   std::string temp_filename_;
-
+  std::string index_filename_;
+  std::string index_temp_filename_;
+  bool allow_relative_;
+  bool use_metadata_;
+
+  std::unique_ptr<MappedManifest> input_;
+  // The paths of the input manifest that had escape sequences. A deque, so
+  // that views of them stay valid.
+  std::deque<std::string> unescaped_;
   FileInfoMap manifest_;
 };
 
@@ -469,6 +874,10 @@ int main(int argc, char **argv) {
   argc--; argv++;
   bool allow_relative = false;
   bool use_metadata = false;
+  bool incremental = false;
+  int threads = 1;
+  bool index = false;
+  bool index_only = false;
 
   while (argc >= 1) {
     if (strcmp(argv[0], "--allow_relative") == 0) {
@@ -477,6 +886,19 @@ int main(int argc, char **argv) {
     } else if (strcmp(argv[0], "--use_metadata") == 0) {
       use_metadata = true;
       argc--; argv++;
+    } else if (strcmp(argv[0], "--incremental") == 0) {
+      incremental = true;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--index") == 0) {
+      index = true;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--index_only") == 0) {
+      index = true;
+      index_only = true;
+      argc--; argv++;
+    } else if (strcmp(argv[0], "--threads") == 0 && argc >= 2) {
+      threads = atoi(argv[1]);
+      argc -= 2; argv += 2;
     } else {
       break;
     }
@@ -484,7 +906,8 @@ int main(int argc, char **argv) {
 
   if (argc != 2) {
     fprintf(stderr, "usage: %s "
-            "[--allow_relative] [--use_metadata] "
+            "[--allow_relative] [--use_metadata] [--incremental] "
+            "[--threads N] [--index] [--index_only] "
             "INPUT RUNFILES\n",
             argv0);
     return 1;
@@ -504,7 +927,7 @@ int main(int argc, char **argv) {
 
   RunfilesCreator runfiles_creator(output_base_dir);
   runfiles_creator.ReadManifest(manifest_file, allow_relative, use_metadata);
-  runfiles_creator.CreateRunfiles();
+  runfiles_creator.CreateRunfiles(incremental, threads, index, index_only);
 
   return 0;
 }
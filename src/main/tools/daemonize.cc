@@ -12,8 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-// daemonize [-a] -l log_path -p pid_path [-c cgroup] [-s systemd_wrapper_path]
-// -- binary_path binary_name [args]
+// daemonize [-a] -l log_path -p pid_path [-c cgroup] [-s] -- binary_path
+// binary_name [args]
 //
 // daemonize spawns a program as a daemon, redirecting all of its output to the
 // given log_path and writing the daemon's PID to pid_path.  binary_path
@@ -21,7 +21,8 @@
 // indicates its display name (aka argv[0], so the optional args do not have to
 // specify it again).  log_path is created/truncated unless the -a (append) flag
 // is specified.  Also note that pid_path is guaranteed to exists when this
-// program terminates successfully.
+// program terminates successfully.  With -s, the program runs in a transient
+// systemd scope of the user, if the systemd user manager is available.
 //
 // Some important details about the implementation of this program:
 //
@@ -46,7 +47,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 #include "src/main/tools/process-tools.h"
@@ -112,131 +117,410 @@ static void WritePidFile(pid_t pid, const char* pid_path, int pid_done_fd) {
   close(pid_done_fd);
 }
 
-static bool ShellEscapeNeeded(const char* arg) {
-  static const char kDontNeedShellEscapeChars[] =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-      "abcdefghijklmnopqrstuvwxyz"
-      "0123456789+-_.=/:,@";
+#ifdef __linux__
+// A minimal client for the D-Bus wire protocol, just enough to ask the systemd
+// user manager for a transient scope unit. This is what
+// `systemd-run --user --scope` does, but asking directly saves starting a
+// shell and two systemd-run processes on every server start.
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static const char kDBusEndian = 'l';
+#else
+static const char kDBusEndian = 'B';
+#endif
 
-  for (int i = 0; arg[i]; i++) {
-    if (strchr(kDontNeedShellEscapeChars, arg[i]) == NULL) {
-      // If any character is not in the list, we need to escape the string.
-      return true;
+enum {
+  kDBusMethodCall = 1,
+  kDBusMethodReturn = 2,
+  kDBusError = 3,
+};
+
+enum {
+  kDBusFieldPath = 1,
+  kDBusFieldInterface = 2,
+  kDBusFieldMember = 3,
+  kDBusFieldReplySerial = 5,
+  kDBusFieldDestination = 6,
+  kDBusFieldSignature = 8,
+};
+
+// Upper bound on the size of messages we are willing to receive.
+static const size_t kDBusMaxMessageSize = 1 << 20;
+
+typedef struct {
+  char* data;
+  size_t len;
+  size_t cap;
+} DBusBuffer;
+
+static void DBusAppend(DBusBuffer* b, const void* data, size_t len) {
+  if (b->len + len > b->cap) {
+    size_t cap = b->cap * 2 > b->len + len ? b->cap * 2 : b->len + len + 64;
+    b->data = (char*)realloc(b->data, cap);
+    if (b->data == NULL) {
+      err(EXIT_FAILURE, "realloc failed");
     }
+    b->cap = cap;
   }
-  return false;
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+static void DBusAlign(DBusBuffer* b, size_t alignment) {
+  static const char kZeros[8] = {0};
+  DBusAppend(b, kZeros, (alignment - b->len % alignment) % alignment);
+}
+
+static void DBusAppendByte(DBusBuffer* b, uint8_t value) {
+  DBusAppend(b, &value, 1);
+}
+
+static void DBusAppendUint32(DBusBuffer* b, uint32_t value) {
+  DBusAlign(b, 4);
+  DBusAppend(b, &value, 4);
+}
+
+static void DBusAppendString(DBusBuffer* b, const char* value) {
+  DBusAppendUint32(b, strlen(value));
+  DBusAppend(b, value, strlen(value) + 1);
+}
+
+static void DBusAppendSignature(DBusBuffer* b, const char* value) {
+  DBusAppendByte(b, strlen(value));
+  DBusAppend(b, value, strlen(value) + 1);
+}
+
+// An array being serialized.
+typedef struct {
+  size_t len_offset;  // where its length goes
+  size_t start;       // where its first element starts
+} DBusArray;
+
+// Starts an array whose elements have the given alignment. Pass the result to
+// DBusEndArray once all elements are added.
+static DBusArray DBusBeginArray(DBusBuffer* b, size_t alignment) {
+  DBusArray array;
+  DBusAppendUint32(b, 0);
+  array.len_offset = b->len - 4;
+  DBusAlign(b, alignment);
+  array.start = b->len;
+  return array;
+}
+
+// Fills in the length of the array, which doesn't include the padding in front
+// of its first element.
+static void DBusEndArray(DBusBuffer* b, DBusArray array) {
+  uint32_t len = b->len - array.start;
+  memcpy(b->data + array.len_offset, &len, 4);
 }
 
-// Similar to what absl::ShellEscape does. We'd like to escape the arguments
-// passed to the shell script, but we cannot use absl::ShellEscape because we
-// want to keep this tool pure C.
-static char* ShellEscape(const char* arg) {
-  if (!arg) {
-    return NULL;
+static void DBusAppendHeaderField(DBusBuffer* b, uint8_t code,
+                                  const char* signature, const char* value) {
+  DBusAlign(b, 8);
+  DBusAppendByte(b, code);
+  DBusAppendSignature(b, signature);
+  if (signature[0] == 'g') {
+    DBusAppendSignature(b, value);
+  } else {
+    DBusAppendString(b, value);
   }
+}
 
-  if (!ShellEscapeNeeded(arg)) {
-    return strdup(arg);
+// Serializes a method call into 'msg'. 'destination' may be NULL on a
+// peer-to-peer connection, and 'body' is marshalled according to 'signature'.
+static void DBusAppendMethodCall(DBusBuffer* msg, uint32_t serial,
+                                 const char* destination, const char* path,
+                                 const char* interface, const char* member,
+                                 const char* signature,
+                                 const DBusBuffer* body) {
+  DBusAppendByte(msg, kDBusEndian);
+  DBusAppendByte(msg, kDBusMethodCall);
+  DBusAppendByte(msg, 0);  // flags
+  DBusAppendByte(msg, 1);  // protocol version
+  DBusAppendUint32(msg, body->len);
+  DBusAppendUint32(msg, serial);
+  DBusArray fields = DBusBeginArray(msg, 8);
+  DBusAppendHeaderField(msg, kDBusFieldPath, "o", path);
+  DBusAppendHeaderField(msg, kDBusFieldInterface, "s", interface);
+  DBusAppendHeaderField(msg, kDBusFieldMember, "s", member);
+  if (destination != NULL) {
+    DBusAppendHeaderField(msg, kDBusFieldDestination, "s", destination);
+  }
+  if (body->len > 0) {
+    DBusAppendHeaderField(msg, kDBusFieldSignature, "g", signature);
   }
+  DBusEndArray(msg, fields);
+  DBusAlign(msg, 8);
+  DBusAppend(msg, body->data, body->len);
+}
 
-  bool has_single_quotes = false;
-  for (size_t i = 0; arg[i]; i++) {
-    if (arg[i] == '\'') {
-      has_single_quotes = true;
-      break;
+static bool DBusWriteAll(int fd, const void* data, size_t len) {
+  const char* p = (const char*)data;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
     }
+    p += n;
+    len -= n;
   }
+  return true;
+}
 
-  if (!has_single_quotes) {
-    // When there are no single quotes, we can just escape the string with
-    // single quotes.
-    char* escaped_string;
-    asprintf(&escaped_string, "'%s'", arg);
-    return escaped_string;
+static bool DBusReadAll(int fd, void* data, size_t len) {
+  char* p = (char*)data;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
   }
+  return true;
+}
 
-  // For all other cases, we wrap everything in double quotes.
-  size_t escaped_len = 0;
+// Returns the REPLY_SERIAL header field of the message in 'msg', or 0 if it
+// has none.
+static uint32_t DBusGetReplySerial(const char* msg, size_t fields_end) {
+  size_t pos = 16;
+  while (pos < fields_end) {
+    pos = (pos + 7) & ~(size_t)7;
+    if (pos + 2 > fields_end) {
+      break;
+    }
+    uint8_t code = msg[pos++];
+    uint8_t signature_len = msg[pos++];
+    if (signature_len != 1 || pos + 2 > fields_end) {
+      break;
+    }
+    char type = msg[pos];
+    pos += 2;
+    uint32_t value;
+    switch (type) {
+      case 'u':
+        pos = (pos + 3) & ~(size_t)3;
+        if (pos + 4 > fields_end) {
+          return 0;
+        }
+        memcpy(&value, msg + pos, 4);
+        if (code == kDBusFieldReplySerial) {
+          return value;
+        }
+        pos += 4;
+        break;
+      case 's':
+      case 'o':
+        pos = (pos + 3) & ~(size_t)3;
+        if (pos + 4 > fields_end) {
+          return 0;
+        }
+        memcpy(&value, msg + pos, 4);
+        pos += 4 + (size_t)value + 1;
+        break;
+      case 'g':
+        pos += 1 + (size_t)(uint8_t)msg[pos] + 1;
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 0;
+}
 
-  for (size_t i = 0; arg[i]; i++) {
-    switch (arg[i]) {
-      case '\\':
-      case '$':
-      case '"':
-      case '`':
-        escaped_len++;
+// Reads messages until the reply to the call with the given serial arrives,
+// skipping everything else (signals, replies to earlier calls).
+// Returns true if the call succeeded, false if it failed or the connection
+// broke.
+static bool DBusWaitForReply(int fd, uint32_t serial) {
+  for (;;) {
+    char fixed[16];
+    if (!DBusReadAll(fd, fixed, sizeof(fixed)) || fixed[0] != kDBusEndian) {
+      return false;
+    }
+    uint32_t body_len, fields_len;
+    memcpy(&body_len, fixed + 4, 4);
+    memcpy(&fields_len, fixed + 12, 4);
+    size_t fields_end = 16 + (size_t)fields_len;
+    size_t total = ((fields_end + 7) & ~(size_t)7) + body_len;
+    if (total > kDBusMaxMessageSize) {
+      return false;
     }
-    escaped_len++;
-  }
-
-  char* escaped_string = (char*)malloc(
-      escaped_len +
-      3);  // +2 for double quotes, and +1 for the null terminator.
-
-  size_t j = 0;
-  escaped_string[j++] = '"';
-  for (size_t i = 0; arg[i]; i++) {
-    switch (arg[i]) {
-      case '\\':
-      case '$':
-      case '"':
-      case '`':
-        escaped_string[j++] = '\\';
+    char* msg = (char*)malloc(total);
+    if (msg == NULL) {
+      err(EXIT_FAILURE, "malloc failed");
     }
-    escaped_string[j++] = arg[i];
+    memcpy(msg, fixed, sizeof(fixed));
+    bool ok = DBusReadAll(fd, msg + sizeof(fixed), total - sizeof(fixed));
+    uint8_t type = fixed[1];
+    uint32_t reply_serial =
+        ok && (type == kDBusMethodReturn || type == kDBusError)
+            ? DBusGetReplySerial(msg, fields_end)
+            : 0;
+    free(msg);
+    if (!ok) {
+      return false;
+    }
+    if (reply_serial == serial) {
+      return type == kDBusMethodReturn;
+    }
+  }
+}
+
+// Connects to the D-Bus socket at 'path' and authenticates as the current
+// user. Returns the socket, or -1 on failure.
+static int DBusConnect(const char* path) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  // Don't hold up the server start for long if systemd doesn't answer.
+  struct timeval timeout = {5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  // The EXTERNAL mechanism authenticates with the peer credentials of the
+  // socket; the client only names the uid, as hex-encoded decimal digits.
+  char uid[16];
+  snprintf(uid, sizeof(uid), "%u", (unsigned)getuid());
+  char auth[64];
+  size_t len = 0;
+  auth[len++] = '\0';
+  len += snprintf(auth + len, sizeof(auth) - len, "AUTH EXTERNAL ");
+  for (size_t i = 0; uid[i]; i++) {
+    len += snprintf(auth + len, sizeof(auth) - len, "%02x", uid[i]);
   }
-  escaped_string[j++] = '"';
-  escaped_string[j] = '\0';
+  len += snprintf(auth + len, sizeof(auth) - len, "\r\n");
+
+  char line[256];
+  size_t line_len = 0;
+  bool ok = DBusWriteAll(fd, auth, len);
+  while (ok && (line_len == 0 || line[line_len - 1] != '\n')) {
+    ok = line_len < sizeof(line) - 1 && DBusReadAll(fd, line + line_len, 1);
+    line_len++;
+  }
+  ok = ok && strncmp(line, "OK ", 3) == 0 &&
+       DBusWriteAll(fd, "BEGIN\r\n", 7);
+  if (!ok) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
 
-  return escaped_string;
+// Returns true once /proc/self/cgroup mentions 'unit', giving up after about a
+// second.
+static bool WaitForCgroup(const char* unit) {
+  for (int i = 0; i < 1000; i++) {
+    FILE* fp = fopen("/proc/self/cgroup", "r");
+    if (fp == NULL) {
+      return false;
+    }
+    char* line = NULL;
+    size_t len = 0;
+    bool found = false;
+    while (!found && getline(&line, &len, fp) != -1) {
+      found = strstr(line, unit) != NULL;
+    }
+    free(line);
+    fclose(fp);
+    if (found) {
+      return true;
+    }
+    usleep(1000);
+  }
+  return false;
 }
 
-// Prepares the shell script for systemd-run to execute.
+// Moves the current process into a new transient scope unit of the systemd
+// user manager, so that the user owns the cgroup of the server and can control
+// its resources without root permission.
 //
-// We wrap everything inside a shell script file for systemd-run in order to
-// create a transient cgroup for the Java server to use. With a user cgroup
-// created like this, we can control the resources without root permission.
-//
-// We cannot do this directly with a command because we'll get a "Filename too
-// long" error, which indicates that the command is too long as we have almost
-// 100 arguments in the list.
-static void WriteSystemdWrapper(const char* systemd_wrapper_path,
-                                const char* exe, char** argv) {
-  FILE* systemd_wrapper_fp = fopen(systemd_wrapper_path, "w");
-  if (systemd_wrapper_fp == NULL) {
-    err(EXIT_FAILURE, "Failed to create %s", systemd_wrapper_path);
-  }
-
-  char* escaped_argv0 = ShellEscape(argv[0]);
-  if (fprintf(systemd_wrapper_fp, "#!/bin/bash\nexec -a %s %s", escaped_argv0,
-              exe) < 0) {
-    err(EXIT_FAILURE, "Failed to write content to %s", systemd_wrapper_path);
-  }
-  free(escaped_argv0);
-
-  int argc = 1;
-  while (argv[argc]) {
-    char* escaped_arg = ShellEscape(argv[argc]);
-    if (fprintf(systemd_wrapper_fp, " %s", escaped_arg) < 0) {
-      err(EXIT_FAILURE, "Failed to write content to %s", systemd_wrapper_path);
-    }
-    free(escaped_arg);
-    argc++;
+// Returns false if that is not possible, e.g. because there's no systemd user
+// instance or no D-Bus available.
+static bool MoveToSystemdScope() {
+  const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir == NULL || runtime_dir[0] == '\0') {
+    return false;
   }
 
-  if (fclose(systemd_wrapper_fp) < 0) {
-    err(EXIT_FAILURE, "Failed to fclose file %s", systemd_wrapper_path);
+  // Like systemd-run, talk to the manager directly over its private socket,
+  // and only go through the user bus if that's not available.
+  char* path;
+  asprintf(&path, "%s/systemd/private", runtime_dir);
+  int fd = DBusConnect(path);
+  free(path);
+  const char* destination = NULL;
+  uint32_t serial = 1;
+  DBusBuffer msg = {NULL, 0, 0};
+  DBusBuffer body = {NULL, 0, 0};
+  if (fd == -1) {
+    asprintf(&path, "%s/bus", runtime_dir);
+    fd = DBusConnect(path);
+    free(path);
+    if (fd == -1) {
+      return false;
+    }
+    // Every connection to a bus has to start with a Hello. Its reply is
+    // skipped by DBusWaitForReply below.
+    destination = "org.freedesktop.systemd1";
+    DBusAppendMethodCall(&msg, serial++, "org.freedesktop.DBus",
+                         "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                         "Hello", "", &body);
   }
-}
 
-static bool IsBinaryExecutable(const char* binary_path) {
-  return access(binary_path, X_OK) == 0;
+  pid_t pid = getpid();
+  char* unit;
+  asprintf(&unit, "bazel-server-%d.scope", pid);
+  DBusAppendString(&body, unit);
+  DBusAppendString(&body, "fail");
+  DBusArray properties = DBusBeginArray(&body, 8);
+  DBusAppendString(&body, "PIDs");
+  DBusAppendSignature(&body, "au");
+  DBusArray pids = DBusBeginArray(&body, 4);
+  DBusAppendUint32(&body, pid);
+  DBusEndArray(&body, pids);
+  DBusEndArray(&body, properties);
+  DBusArray aux = DBusBeginArray(&body, 8);
+  DBusEndArray(&body, aux);
+  DBusAppendMethodCall(&msg, serial, destination, "/org/freedesktop/systemd1",
+                       "org.freedesktop.systemd1.Manager",
+                       "StartTransientUnit", "ssa(sv)a(sa(sv))", &body);
+
+  bool ok =
+      DBusWriteAll(fd, msg.data, msg.len) && DBusWaitForReply(fd, serial);
+  close(fd);
+  free(msg.data);
+  free(body.data);
+  // The reply only means that the job to start the scope was queued, so wait
+  // for it to actually take this process before exec'ing the server.
+  ok = ok && WaitForCgroup(unit);
+  free(unit);
+  return ok;
 }
+#endif
 
 static void ExecAsDaemon(const char* log_path, bool log_append,
-                         const char* systemd_wrapper_path, int pid_done_fd,
-                         const char* exe, char** argv)
-    __attribute__((noreturn));
+                         bool systemd_scope, int pid_done_fd, const char* exe,
+                         char** argv) __attribute__((noreturn));
 
 // Executes the requested binary configuring it to behave as a daemon.
 //
@@ -250,8 +534,8 @@ static void ExecAsDaemon(const char* log_path, bool log_append,
 //
 // This function never returns.
 static void ExecAsDaemon(const char* log_path, bool log_append,
-                         const char* systemd_wrapper_path, int pid_done_fd,
-                         const char* exe, char** argv) {
+                         bool systemd_scope, int pid_done_fd, const char* exe,
+                         char** argv) {
   char dummy;
   if (read(pid_done_fd, &dummy, sizeof(dummy)) == -1) {
     err(EXIT_FAILURE, "Failed to wait for pid file creation");
@@ -269,30 +553,11 @@ static void ExecAsDaemon(const char* log_path, bool log_append,
   SetupStdio(log_path, log_append);
 
 #ifdef __linux__
-  // When it's running on linux, and the systemd wrapper path is provided, we
-  // try to replace the current process with systemd-run. In all other cases,
-  // including the cases when systemd-run is not available, we replace it with
-  // the original exe.
-  const char* systemd_run_path = "/usr/bin/systemd-run";
-  if (systemd_wrapper_path != NULL && IsBinaryExecutable(systemd_run_path)) {
-    // Even if systemd-run is present and executable, we still need to run a
-    // command first to check if we can use it. There are some cases when the
-    // environment is not set up correctly, e.g. no DBUS available.
-    char* systemd_test_command;
-    asprintf(&systemd_test_command, "%s --user --scope -- /bin/true",
-             systemd_run_path);
-    int status = system(systemd_test_command);
-    free(systemd_test_command);
-
-    if (status == 0) {
-      WriteSystemdWrapper(systemd_wrapper_path, exe, argv);
-
-      execl(systemd_run_path, systemd_run_path, "--user", "--scope", "--",
-            "/bin/bash", systemd_wrapper_path, NULL);
-      err(EXIT_FAILURE, "Failed to execute %s with systemd-run.", exe);
-    }
+  // If systemd is not available, run the exe without a scope, like we do on
+  // other platforms.
+  if (systemd_scope && !MoveToSystemdScope()) {
+    warnx("Failed to create a systemd scope, running %s without one", exe);
   }
-
 #endif
 
   execv(exe, argv);
@@ -339,7 +604,7 @@ static void MoveToCgroup(pid_t pid, const char* cgroup_path) {
 // contain the program name (which may or may not match the basename of exe).
 static void Daemonize(const char* log_path, bool log_append,
                       const char* pid_path, const char* cgroup_path,
-                      const char* systemd_wrapper_path, const char* exe,
+                      bool systemd_scope, const char* exe,
                       char** argv) {
   assert(argv[0] != NULL);
 
@@ -358,8 +623,8 @@ static void Daemonize(const char* log_path, bool log_append,
       MoveToCgroup(pid, cgroup_path);
     }
 #endif
-    ExecAsDaemon(log_path, log_append, systemd_wrapper_path, pid_done_fds[0],
-                 exe, argv);
+    ExecAsDaemon(log_path, log_append, systemd_scope, pid_done_fds[0], exe,
+                 argv);
     abort();  // NOLINT Unreachable.
   }
   close(pid_done_fds[0]);
@@ -376,9 +641,9 @@ int main(int argc, char** argv) {
   const char* log_path = NULL;
   const char* pid_path = NULL;
   const char* cgroup_path = NULL;
-  const char* systemd_wrapper_path = NULL;
+  bool systemd_scope = false;
   int opt;
-  while ((opt = getopt(argc, argv, ":al:p:c:s:")) != -1) {
+  while ((opt = getopt(argc, argv, ":al:p:c:s")) != -1) {
     switch (opt) {
       case 'a':
         log_append = true;
@@ -397,7 +662,7 @@ int main(int argc, char** argv) {
         break;
 
       case 's':
-        systemd_wrapper_path = optarg;
+        systemd_scope = true;
         break;
 
       case ':':
@@ -421,7 +686,7 @@ int main(int argc, char** argv) {
   if (argc < 2) {
     errx(EXIT_FAILURE, "Must provide at least an executable name and arg0");
   }
-  Daemonize(log_path, log_append, pid_path, cgroup_path, systemd_wrapper_path,
-            argv[0], argv + 1);
+  Daemonize(log_path, log_append, pid_path, cgroup_path, systemd_scope, argv[0],
+            argv + 1);
   return EXIT_SUCCESS;
 }
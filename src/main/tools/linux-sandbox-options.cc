@@ -15,6 +15,7 @@
 #include "src/main/tools/linux-sandbox-options.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <sched.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -38,6 +39,10 @@ using std::vector;
 
 struct Options opt;
 
+// Whether we are parsing a request in server mode (-z), rather than the command
+// line of linux-sandbox.
+static bool parsing_request = false;
+
 // Print out a usage error. argc and argv are the argument counter and vector,
 // fmt is a format, string for the error message to print.
 static void Usage(char *program_name, const char *fmt, ...) {
@@ -59,6 +64,8 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "SIGTERM first and then as a SIGKILL after the -T timeout\n"
           "  -l <file>  redirect stdout to a file\n"
           "  -L <file>  redirect stderr to a file\n"
+          "  -E  if set, keep stdout and stderr in memory while the command "
+          "runs, and only create their files (-l/-L) if it wrote to them\n"
           "  -w <file>  make a file or directory writable for the sandboxed "
           "process\n"
           "  -e <dir>  mount an empty tmpfs on a directory\n"
@@ -67,11 +74,24 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "mounted readonly.\n"
           "    The -M option specifies which directory to mount, the -m option "
           "specifies where to\n"
+          "  -B <file>  read -M/-m pairs from a file, in which each bind mount "
+          "is a source and a target path, each terminated by a NUL byte\n"
           "  -S <file>  if set, write stats in protobuf format to a file\n"
+          "  -A <file>  if set, write the targets of the -M/-m mounts that the "
+          "command accessed to a file, one per line; all of them if the "
+          "kernel cannot tell\n"
+          "  -r <file>  if set, periodically write samples of the resource "
+          "usage of the command to a file or pipe while it runs, as "
+          "size-delimited ResourceSample protobufs\n"
+          "  -q <seconds>  how often to sample the resource usage for -r "
+          "(default: 1)\n"
           "  -H  if set, make hostname in the sandbox equal to 'localhost'\n"
           "  -n  if set, create a new network namespace\n"
           "  -N  if set, create a new network namespace with loopback\n"
-          "        Only one of -n and -N may be specified.\n"
+          "        Only one of -n, -N and -j may be specified.\n"
+          "  -j <netns>  if set, join this network namespace, such as "
+          "/proc/<pid>/ns/net, instead of creating one; it must be owned by a "
+          "user namespace we can enter, and is used as is\n"
           "  -R  if set, make the uid/gid be root\n"
           "  -U  if set, make the uid/gid be nobody\n"
           "  -P  if set, make the gid be tty and make /dev/pts writable\n"
@@ -79,9 +99,33 @@ static void Usage(char *program_name, const char *fmt, ...) {
           "  -p  if set, the process is persistent and ignores parent thread "
           "death signals\n"
           "  -C <dir> if set, put all subprocesses inside this cgroup.\n"
+          "  -G <dir> if set, create a cgroup v2 for the command inside this "
+          "cgroup, and add its resource usage to the stats (-S)\n"
+          "  -x <bytes> if set with -G, limit the memory of the command\n"
+          "  -y <cpus> if set with -G, limit the CPU time of the command to "
+          "this many CPUs\n"
+          "  -a <cpus>  if set, pin the command to these CPUs, given as in "
+          "cpuset.cpus, e.g. 0-3,8; also written to the cpuset of the -G "
+          "cgroup where that controller is enabled\n"
+          "  -b <node>  if set, have the command allocate memory from this "
+          "NUMA node only\n"
           "  -h <sandbox-dir>  if set, chroot to sandbox-dir and only "
           " mount whats been specified with -M/-m for improved hermeticity. "
           " The working-dir should be a folder inside the sandbox-dir\n"
+          "  -O <dir>  if set with -h, lay sandbox-dir over dir with overlayfs "
+          "instead of populating it with every input; may be repeated, with "
+          "the first one on top\n"
+          "  -o <dir>  the empty work directory for -O, on the same filesystem "
+          "as sandbox-dir\n"
+          "  -I  if set with -h, mount the files among the -M/-m mounts only "
+          "once the command accesses them, instead of all of them up front\n"
+          "  -F <bytes>  if set, keep what the command writes to the working "
+          "directory in a tmpfs of at most this size, laid over it with "
+          "overlayfs\n"
+          "  -Y <file>  if set with -F, an output below the working directory "
+          "to copy to the disk once the command exited; may be repeated\n"
+          "  -z  if set, set up the sandbox once and run the commands of the "
+          "requests read from stdin in it; see linux-sandbox-pid1.cc\n"
           "  @FILE  read newline-separated arguments from FILE\n"
           "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
@@ -94,6 +138,38 @@ static void ValidateIsAbsolutePath(char *path, char *program_name, char flag) {
   }
 }
 
+// Reads the bind mounts of a -B file, which holds NUL-terminated pairs of
+// source and target paths. For actions with thousands of mounts, this is
+// more compact than passing -M/-m pairs.
+static void ReadBindMountsFile(const char *filename, char *program_name) {
+  ifstream f(filename, std::ios::binary);
+  if (!f.is_open()) {
+    DIE("opening bind mounts file %s failed", filename);
+  }
+
+  bool is_source = true;
+  for (std::string path; std::getline(f, path, '\0');) {
+    if (path[0] != '/') {
+      Usage(program_name, "The -B file %s must hold absolute paths only.",
+            filename);
+    }
+    if (is_source) {
+      opt.bind_mount_sources.push_back(path);
+    } else {
+      opt.bind_mount_targets.push_back(path);
+    }
+    is_source = !is_source;
+  }
+
+  if (f.bad()) {
+    DIE("error while reading from bind mounts file %s", filename);
+  }
+  if (!is_source) {
+    Usage(program_name, "The -B file %s has a source without a target.",
+          filename);
+  }
+}
+
 // Parses command line flags from an argv array and puts the results into an
 // Options structure passed in as an argument.
 static void ParseCommandLine(unique_ptr<vector<char *>> args) {
@@ -101,9 +177,13 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
   extern int optind, optopt;
   int c;
   bool source_specified = false;
-  while ((c = getopt(args->size(), args->data(),
-                     ":W:T:t:il:L:w:e:M:m:S:h:pC:HnNRUPD:")) != -1) {
+  while ((c = getopt(
+              args->size(), args->data(),
+              ":W:T:t:il:L:Ew:e:M:m:B:S:A:r:q:h:O:o:IF:Y:pC:G:x:y:a:b:HnNj:RUPD:z")) != -1) {
     if (c != 'M' && c != 'm') source_specified = false;
+    if (parsing_request && strchr("hArqFYpCGxyHnNjRUPDzE", c) != nullptr) {
+      Usage(args->front(), "The -%c option cannot be used in a request.", c);
+    }
     switch (c) {
       case 'W':
         if (opt.working_dir.empty()) {
@@ -148,6 +228,9 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
                 "Cannot redirect stderr to more than one destination.");
         }
         break;
+      case 'E':
+        opt.lazy_outputs = true;
+        break;
       case 'w':
         ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
         opt.writable_files.emplace_back(optarg);
@@ -173,6 +256,9 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
         opt.bind_mount_targets.emplace_back(optarg);
         source_specified = false;
         break;
+      case 'B':
+        ReadBindMountsFile(optarg, args->front());
+        break;
       case 'S':
         if (opt.stats_path.empty()) {
           opt.stats_path.assign(optarg);
@@ -181,6 +267,30 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
                 "Cannot write stats to more than one destination.");
         }
         break;
+      case 'A':
+        if (opt.accessed_inputs_path.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          opt.accessed_inputs_path.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Cannot write accessed inputs to more than one destination.");
+        }
+        break;
+      case 'r':
+        if (opt.resource_samples_path.empty()) {
+          opt.resource_samples_path.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Cannot write resource samples to more than one destination.");
+        }
+        break;
+      case 'q':
+        if (sscanf(optarg, "%lf", &opt.sample_interval_secs) != 1 ||
+            opt.sample_interval_secs <= 0) {
+          Usage(args->front(), "Invalid sample interval (-q) value: %s",
+                optarg);
+        }
+        break;
       case 'h':
         opt.hermetic = true;
         if (opt.sandbox_root.empty()) {
@@ -201,21 +311,55 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
                 "Multiple sandbox roots (-s) specified, expected one.");
         }
         break;
+      case 'O':
+        ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+        opt.overlay_lower_dirs.emplace_back(optarg);
+        break;
+      case 'o':
+        if (opt.overlay_work_dir.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          opt.overlay_work_dir.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Multiple overlay work directories (-o) specified, expected "
+                "one.");
+        }
+        break;
+      case 'I':
+        opt.lazy_inputs = true;
+        break;
+      case 'F':
+        if (sscanf(optarg, "%" SCNd64, &opt.working_dir_tmpfs_size) != 1 ||
+            opt.working_dir_tmpfs_size <= 0) {
+          Usage(args->front(), "Invalid tmpfs size (-F) value: %s", optarg);
+        }
+        break;
+      case 'Y':
+        ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+        opt.tmpfs_outputs.emplace_back(optarg);
+        break;
       case 'H':
         opt.fake_hostname = true;
         break;
       case 'n':
-        if (opt.create_netns == NETNS_WITH_LOOPBACK) {
-          Usage(args->front(), "Only one of -n and -N may be specified.");
+        if (opt.create_netns == NETNS_WITH_LOOPBACK ||
+            !opt.netns_path.empty()) {
+          Usage(args->front(), "Only one of -n, -N and -j may be specified.");
         }
         opt.create_netns = NETNS;
         break;
       case 'N':
-        if (opt.create_netns == NETNS) {
-          Usage(args->front(), "Only one of -n and -N may be specified.");
+        if (opt.create_netns == NETNS || !opt.netns_path.empty()) {
+          Usage(args->front(), "Only one of -n, -N and -j may be specified.");
         }
         opt.create_netns = NETNS_WITH_LOOPBACK;
         break;
+      case 'j':
+        if (opt.create_netns != NO_NETNS || !opt.netns_path.empty()) {
+          Usage(args->front(), "Only one of -n, -N and -j may be specified.");
+        }
+        opt.netns_path.assign(optarg);
+        break;
       case 'R':
         if (opt.fake_username) {
           Usage(args->front(),
@@ -236,9 +380,43 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
         ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
         opt.cgroups_dirs.emplace_back(optarg);
         break;
+      case 'G':
+        if (opt.cgroup_parent.empty()) {
+          ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
+          opt.cgroup_parent.assign(optarg);
+        } else {
+          Usage(args->front(),
+                "Multiple parent cgroups (-G) specified, expected one.");
+        }
+        break;
+      case 'x':
+        if (sscanf(optarg, "%" SCNd64, &opt.cgroup_memory_limit) != 1 ||
+            opt.cgroup_memory_limit <= 0) {
+          Usage(args->front(), "Invalid memory limit (-x) value: %s", optarg);
+        }
+        break;
+      case 'y':
+        if (sscanf(optarg, "%lf", &opt.cgroup_cpu_limit) != 1 ||
+            opt.cgroup_cpu_limit <= 0) {
+          Usage(args->front(), "Invalid CPU limit (-y) value: %s", optarg);
+        }
+        break;
+      case 'a':
+        if (!ParseCpuList(optarg, &opt.cpus)) {
+          Usage(args->front(), "Invalid CPU list (-a) value: %s", optarg);
+        }
+        break;
+      case 'b':
+        if (sscanf(optarg, "%d", &opt.mem_node) != 1 || opt.mem_node < 0) {
+          Usage(args->front(), "Invalid NUMA node (-b) value: %s", optarg);
+        }
+        break;
       case 'P':
         opt.enable_pty = true;
         break;
+      case 'z':
+        opt.server_mode = true;
+        break;
       case 'D':
         if (opt.debug_path.empty()) {
           ValidateIsAbsolutePath(optarg, args->front(), static_cast<char>(c));
@@ -264,6 +442,22 @@ static void ParseCommandLine(unique_ptr<vector<char *>> args) {
           "subdirectory of sandbox-dir %s (-h)",
           opt.working_dir.c_str(), opt.sandbox_root.c_str());
   }
+  if (opt.overlay_lower_dirs.empty() != opt.overlay_work_dir.empty()) {
+    Usage(args->front(), "The -O and -o options must be used together.");
+  }
+  if (opt.cgroup_parent.empty() &&
+      (opt.cgroup_memory_limit > 0 || opt.cgroup_cpu_limit > 0)) {
+    Usage(args->front(), "The -x and -y options can only be used with -G.");
+  }
+  if (!opt.overlay_lower_dirs.empty() && !opt.hermetic) {
+    Usage(args->front(), "The -O option can only be used with -h.");
+  }
+  if (opt.lazy_inputs && !opt.hermetic) {
+    Usage(args->front(), "The -I option can only be used with -h.");
+  }
+  if (!opt.tmpfs_outputs.empty() && opt.working_dir_tmpfs_size == 0) {
+    Usage(args->front(), "The -Y option can only be used with -F.");
+  }
   if (optind < static_cast<int>(args->size())) {
     if (opt.args.empty()) {
       opt.args.assign(args->begin() + optind, args->end());
@@ -318,20 +512,80 @@ static unique_ptr<vector<char *>> ExpandArguments(const vector<char *> &args) {
   return expanded;
 }
 
+// Uses the current directory as the working directory (-W).
+static void UseCurrentWorkingDir() {
+  char *working_dir = getcwd(nullptr, 0);
+  if (working_dir == nullptr) {
+    DIE("getcwd");
+  }
+  opt.working_dir = working_dir;
+  free(working_dir);
+}
+
 void ParseOptions(int argc, char *argv[]) {
   vector<char *> args(argv, argv + argc);
+  opt.sample_interval_secs = 1;
+  opt.mem_node = -1;
   ParseCommandLine(ExpandArguments(args));
 
+  if (opt.server_mode) {
+    // The commands, and the options that only make sense for a single command,
+    // come with the requests.
+    if (!opt.args.empty()) {
+      Usage(args.front(), "The -z option cannot be used with a command.");
+    }
+    if (opt.hermetic || opt.timeout_secs > 0 || opt.kill_delay_secs > 0 ||
+        !opt.stdout_path.empty() || !opt.stderr_path.empty() ||
+        !opt.stats_path.empty() || !opt.accessed_inputs_path.empty() ||
+        !opt.resource_samples_path.empty() || !opt.cgroup_parent.empty() ||
+        opt.working_dir_tmpfs_size > 0 || opt.lazy_outputs) {
+      Usage(args.front(),
+            "The -h, -T, -t, -l, -L, -E, -S, -A, -r, -F and -G options cannot "
+            "be used with -z.");
+    }
+    return;
+  }
+
   if (opt.args.empty()) {
     Usage(args.front(), "No command specified.");
   }
 
   if (opt.working_dir.empty()) {
-    char *working_dir = getcwd(nullptr, 0);
-    if (working_dir == nullptr) {
-      DIE("getcwd");
+    UseCurrentWorkingDir();
+  }
+
+  for (const std::string &output : opt.tmpfs_outputs) {
+    if (output.compare(0, opt.working_dir.size() + 1, opt.working_dir + "/") !=
+        0) {
+      Usage(args.front(),
+            "The output %s (-Y) is not below the working directory %s.",
+            output.c_str(), opt.working_dir.c_str());
+    }
+  }
+}
+
+void ParseRequest(const std::string &request) {
+  vector<char *> args;
+  args.push_back(strdup("linux-sandbox"));
+  size_t start = 0;
+  size_t end;
+  while ((end = request.find('\n', start)) != std::string::npos) {
+    if (end > start) {
+      args.push_back(strdup(request.substr(start, end - start).c_str()));
     }
-    opt.working_dir = working_dir;
-    free(working_dir);
+    start = end + 1;
+  }
+
+  // Restart getopt, which already went through our own command line.
+  optind = 1;
+  parsing_request = true;
+  ParseCommandLine(ExpandArguments(args));
+
+  if (opt.args.empty()) {
+    Usage(args.front(), "No command specified.");
+  }
+
+  if (opt.working_dir.empty()) {
+    UseCurrentWorkingDir();
   }
 }
@@ -17,6 +17,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <string>
 #include <vector>
@@ -39,6 +40,9 @@ struct Options {
   std::string stdout_path;
   // Where to redirect stderr (-L)
   std::string stderr_path;
+  // Whether to only create the stdout and stderr files once the command
+  // exited, if it wrote to them (-E)
+  bool lazy_outputs;
   // Files or directories to make writable for the sandboxed process (-w)
   std::vector<std::string> writable_files;
   // Directories where to mount an empty tmpfs (-e)
@@ -49,10 +53,19 @@ struct Options {
   std::vector<std::string> bind_mount_targets;
   // Where to write stats, in protobuf format (-S)
   std::string stats_path;
+  // Where to write the targets of the -M/-m mounts that the command accessed
+  // (-A)
+  std::string accessed_inputs_path;
+  // Where to write samples of the resource usage while the command runs (-r)
+  std::string resource_samples_path;
+  // How often to sample the resource usage (-q)
+  double sample_interval_secs;
   // Set the hostname inside the sandbox to 'localhost' (-H)
   bool fake_hostname;
   // Create a new network namespace (-n/-N)
   NetNamespaceOption create_netns;
+  // Existing network namespace to join instead of creating one (-j)
+  std::string netns_path;
   // Pretend to be root inside the namespace (-R)
   bool fake_root;
   // Set the username inside the sandbox to 'nobody' (-U)
@@ -66,8 +79,34 @@ struct Options {
   bool hermetic;
   // The sandbox root directory (-s)
   std::string sandbox_root;
+  // Directories to lay the sandbox root directory over with overlayfs (-O)
+  std::vector<std::string> overlay_lower_dirs;
+  // Empty directory on the filesystem of the sandbox root that overlayfs needs
+  // to work in (-o)
+  std::string overlay_work_dir;
+  // Mount the files among the -M/-m mounts only once the command accesses
+  // them (-I)
+  bool lazy_inputs;
+  // Size in bytes of the tmpfs that receives what the command writes to the
+  // working directory, or 0 to write to the disk (-F)
+  int64_t working_dir_tmpfs_size;
+  // Outputs below the working directory to copy from that tmpfs to the disk
+  // once the command exited (-Y)
+  std::vector<std::string> tmpfs_outputs;
   // Directories to use for cgroup control
   std::vector<std::string> cgroups_dirs;
+  // Cgroup v2 directory in which to create a cgroup for the command (-G)
+  std::string cgroup_parent;
+  // Limit for memory.max of that cgroup, in bytes (-x)
+  int64_t cgroup_memory_limit;
+  // Limit for cpu.max of that cgroup, in CPUs (-y)
+  double cgroup_cpu_limit;
+  // The CPUs to pin the command to, or empty to let it run on any (-a)
+  std::vector<int> cpus;
+  // The NUMA node for the command to allocate memory from, or -1 for any (-b)
+  int mem_node;
+  // Serve requests read from stdin in a long-lived sandbox (-z)
+  bool server_mode;
   // Command to run (--)
   std::vector<char *> args;
 };
@@ -77,4 +116,9 @@ extern struct Options opt;
 // Handles parsing all command line flags and populates the global opt struct.
 void ParseOptions(int argc, char *argv[]);
 
+// Parses a request in server mode (-z), which holds newline-separated
+// arguments like an @FILE argument file, on top of the options the server was
+// started with.
+void ParseRequest(const std::string &request);
+
 #endif
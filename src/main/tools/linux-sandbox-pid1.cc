@@ -15,34 +15,82 @@
 /**
  * This is PID 1 inside the sandbox environment and runs in a separate user,
  * mount, UTS, IPC and PID namespace.
+ *
+ * In server mode (-z), it sets up these namespaces and the read-only
+ * filesystem once, and then runs the commands of requests that linux-sandbox
+ * reads from stdin. A request consists of the arguments that linux-sandbox
+ * would take for the command, one per line as in an @FILE argument file,
+ * followed by an empty line. For each request, linux-sandbox writes the exit
+ * code of its command on a line to stdout. Requests are handled one at a time,
+ * and linux-sandbox opens their output files, which are usually outside of
+ * the writable paths, and passes them to us.
+ *
+ * Each command runs below a worker process that has its own mount, PID, IPC
+ * and UTS namespace, and network namespace unless the host network is used,
+ * in which the working directory and the writable paths of the request are
+ * mounted on top of the read-only base. These namespaces go away with the
+ * command, so the next request starts from the same base and sees nothing
+ * that earlier commands left behind, e.g. System V semaphores, a changed
+ * hostname or listening sockets. Only the user namespace is shared by all
+ * requests. As copying the mount namespace and setting up a network namespace
+ * are not free, the next worker is always forked while the current request
+ * runs.
+ *
+ * With lazy inputs (-I), the hermetic sandbox (-h) holds only the directories
+ * of the files among the -M/-m mounts at first. The command runs in a copy of
+ * our mount namespace, in which the mounts of the sandbox are slaves of ours,
+ * with a seccomp filter that notifies us of the system calls that open, stat
+ * or execute a path. When such a path is a file that is yet to be mounted, we
+ * mount it before we let the system call continue, and the mount propagates
+ * to the command. Setting up the sandbox then scales with the inputs that the
+ * command accesses, rather than with all of those it declares.
+ *
+ * With -A, the same notifications tell us which of the -M/-m mounts the
+ * command accessed, so that Bazel can leave out the others next time.
  */
 
 #include "src/main/tools/linux-sandbox-pid1.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <grp.h>
 #include <libgen.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <math.h>
 #include <mntent.h>
 #include <net/if.h>
+#include <poll.h>
 #include <pwd.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #ifndef MS_REC
 // Some systems do not define MS_REC in sys/mount.h. We might be able to grab it
@@ -63,6 +111,47 @@
   })
 #endif  // TEMP_FAILURE_RETRY
 
+// The new mount API: open_tree(2) and move_mount(2) since Linux 5.2,
+// mount_setattr(2) since 5.12. The C library may predate the kernel, so we
+// make the system calls ourselves, and we fall back to mount(2) if they fail
+// with ENOSYS.
+#ifndef SYS_open_tree
+#define SYS_open_tree 428
+#endif
+#ifndef SYS_move_mount
+#define SYS_move_mount 429
+#endif
+#ifndef SYS_mount_setattr
+#define SYS_mount_setattr 442
+#endif
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
+// Lazy inputs (-I) and tracing the accessed inputs (-A) need seccomp user
+// notifications that let the system call continue, which the kernel supports
+// since Linux 5.5. Without them, or on other architectures, we mount all
+// inputs before the command starts, and report all of them as accessed.
+#if defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE) && defined(__x86_64__)
+#define INPUT_ACCESS_NOTIFY_SUPPORTED
+#define INPUT_ACCESS_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE) && defined(__aarch64__)
+#define INPUT_ACCESS_NOTIFY_SUPPORTED
+#define INPUT_ACCESS_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#endif
+
 #include "src/main/tools/linux-sandbox-options.h"
 #include "src/main/tools/linux-sandbox.h"
 #include "src/main/tools/logging.h"
@@ -71,6 +160,69 @@
 
 static int global_child_pid;
 
+// In server mode, the socket over which we receive requests and reply to them.
+static int global_server_socket;
+
+// In a worker, the PID 1 of the namespace of the request, and whether we have
+// yet to ask it politely to exit on timeout.
+static pid_t global_request_pid;
+static bool global_need_polite_sigterm;
+
+// Whether the kernel supports the new mount API; cleared on ENOSYS.
+static bool global_new_mount_api = true;
+
+// With lazy inputs (-I), the sources of the files that are yet to be mounted,
+// by their path in the sandbox.
+static std::unordered_map<std::string, std::string> global_lazy_inputs;
+
+// With lazy inputs (-I) or -A, the seccomp listener through which we learn
+// about the paths that the command accesses, or -1.
+static int global_input_listener = -1;
+
+// Whether we got that listener, so that the accesses are complete.
+static bool global_tracing_accesses = false;
+
+// With -A, the memfd to write the accessed inputs to, the targets of the
+// -M/-m mounts, and those of them that the command accessed so far.
+static int global_accessed_inputs_fd = -1;
+static std::unordered_set<std::string> global_declared_inputs;
+static std::set<std::string> global_accessed_inputs;
+
+// The signal mask to wait for input accesses with, which lets SIGCHLD in.
+static sigset_t global_input_wait_mask;
+
+// With a tmpfs for the working directory (-F), the working directory on disk
+// and the overlay on top of it, between which CopyOutputs copies the outputs.
+static int global_disk_working_dir = -1;
+static int global_tmpfs_working_dir = -1;
+
+// The layout of struct mount_attr of linux/mount.h, which clashes with
+// sys/mount.h on some C libraries.
+struct MountAttr {
+  uint64_t attr_set;
+  uint64_t attr_clr;
+  uint64_t propagation;
+  uint64_t userns_fd;
+};
+
+// Makes the mount at path (relative to dirfd) read-only or writable with
+// mount_setattr(2). Returns -1 and sets errno on failure.
+static int SetMountReadOnly(int dirfd, const char *path, unsigned int flags,
+                            bool read_only) {
+  MountAttr attr = {};
+  if (read_only) {
+    attr.attr_set = MOUNT_ATTR_RDONLY;
+  } else {
+    attr.attr_clr = MOUNT_ATTR_RDONLY;
+  }
+  int result =
+      syscall(SYS_mount_setattr, dirfd, path, flags, &attr, sizeof(attr));
+  if (result < 0 && errno == ENOSYS) {
+    global_new_mount_api = false;
+  }
+  return result;
+}
+
 // Helper methods
 static void CreateFile(const char *path) {
   int handle = open(path, O_CREAT | O_WRONLY | O_EXCL, 0666);
@@ -91,6 +243,10 @@ static void LinkFile(const char *path) {
   }
 }
 
+// Directories that CreateTarget created or found, so that the many bind mounts
+// below the same directories do not stat and create them over and over again.
+static std::unordered_set<std::string> global_known_directories;
+
 // Recursively creates the file or directory specified in "path" and its parent
 // directories.
 // Return -1 on failure and sets errno to:
@@ -104,12 +260,17 @@ static int CreateTarget(const char *path, bool is_directory) {
     return -1;
   }
 
+  if (is_directory && global_known_directories.count(path) > 0) {
+    return 0;
+  }
+
   struct stat sb;
   // If the path already exists...
 
   if (stat(path, &sb) == 0) {
     if (is_directory && S_ISDIR(sb.st_mode)) {
       // and it's a directory and supposed to be a directory, we're done here.
+      global_known_directories.insert(path);
       return 0;
     } else if (!is_directory && S_ISREG(sb.st_mode)) {
       // and it's a regular file and supposed to be one, we're done here.
@@ -145,6 +306,7 @@ static int CreateTarget(const char *path, bool is_directory) {
     if (mkdir(path, 0755) < 0) {
       DIE("mkdir(%s)", path);
     }
+    global_known_directories.insert(path);
   } else {
     LinkFile(path);
   }
@@ -241,6 +403,79 @@ static void SetupUtsNamespace() {
   }
 }
 
+// Lays an overlay over the working directory whose upper directory is on a
+// tmpfs of the size given with -F, so that what the command writes stays in
+// memory. Leaves the working directory alone if the kernel does not let us
+// mount overlayfs (in a user namespace before Linux 5.11).
+static void MountWorkingDirectoryTmpfs() {
+  // The bind mount of the working directory, which stays writable.
+  const int disk =
+      open(opt.working_dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (disk < 0) {
+    DIE("open(%s)", opt.working_dir.c_str());
+  }
+  const std::string size =
+      "size=" + std::to_string(opt.working_dir_tmpfs_size);
+  PRINT_DEBUG("tmpfs working dir: %s", size.c_str());
+  if (mount("tmpfs", opt.working_dir.c_str(), "tmpfs",
+            MS_NOSUID | MS_NODEV | MS_NOATIME, size.c_str()) < 0) {
+    DIE("mount(tmpfs, %s, tmpfs, MS_NOSUID | MS_NODEV | MS_NOATIME, %s)",
+        opt.working_dir.c_str(), size.c_str());
+  }
+  const int tmpfs =
+      open(opt.working_dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  if (tmpfs < 0 || mkdirat(tmpfs, "upper", 0755) < 0 ||
+      mkdirat(tmpfs, "work", 0755) < 0) {
+    DIE("creating the overlay directories in the tmpfs");
+  }
+
+  // The tmpfs hides the working directory on disk, so we refer to both
+  // through our file descriptors.
+  const std::string fds = "/proc/self/fd/";
+  const std::string options =
+      "lowerdir=" + fds + std::to_string(disk) + ",upperdir=" + fds +
+      std::to_string(tmpfs) + "/upper,workdir=" + fds + std::to_string(tmpfs) +
+      "/work";
+  PRINT_DEBUG("overlay: %s", options.c_str());
+  if (mount("overlay", opt.working_dir.c_str(), "overlay", MS_NOSUID,
+            options.c_str()) < 0) {
+    if (errno != EPERM && errno != EINVAL && errno != ENODEV) {
+      DIE("mount(overlay, %s, overlay, MS_NOSUID, %s)",
+          opt.working_dir.c_str(), options.c_str());
+    }
+    PRINT_DEBUG("overlay failed (%m), writing to the disk");
+    if (umount2(opt.working_dir.c_str(), MNT_DETACH) < 0) {
+      DIE("umount2(%s)", opt.working_dir.c_str());
+    }
+    close(disk);
+    close(tmpfs);
+    return;
+  }
+  close(tmpfs);
+
+  global_disk_working_dir = disk;
+  global_tmpfs_working_dir =
+      open(opt.working_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (global_tmpfs_working_dir < 0) {
+    DIE("open(%s)", opt.working_dir.c_str());
+  }
+}
+
+// Makes sure that the working directory is writable (unlike most of the rest
+// of the file system, which is read-only by default). The easiest way to do
+// this is by bind-mounting it upon itself.
+static void MountWorkingDirectory() {
+  PRINT_DEBUG("working dir: %s", opt.working_dir.c_str());
+  if (mount(opt.working_dir.c_str(), opt.working_dir.c_str(), nullptr, MS_BIND,
+            nullptr) < 0) {
+    DIE("mount(%s, %s, nullptr, MS_BIND, nullptr)", opt.working_dir.c_str(),
+        opt.working_dir.c_str());
+  }
+  if (opt.working_dir_tmpfs_size > 0) {
+    MountWorkingDirectoryTmpfs();
+  }
+}
+
 static void MountFilesystems() {
   // An attempt to mount the sandbox in tmpfs will always fail, so this block is
   // slightly redundant with the next mount() check, but dumping the mount()
@@ -293,16 +528,7 @@ static void MountFilesystems() {
     }
   }
 
-  // Make sure that the working directory is writable (unlike most of the rest
-  // of the file system, which is read-only by default). The easiest way to do
-  // this is by bind-mounting it upon itself.
-  PRINT_DEBUG("working dir: %s", opt.working_dir.c_str());
-
-  if (mount(opt.working_dir.c_str(), opt.working_dir.c_str(), nullptr, MS_BIND,
-            nullptr) < 0) {
-    DIE("mount(%s, %s, nullptr, MS_BIND, nullptr)", opt.working_dir.c_str(),
-        opt.working_dir.c_str());
-  }
+  MountWorkingDirectory();
 }
 
 // We later remount everything read-only, except the paths for which this method
@@ -331,9 +557,88 @@ static bool ShouldBeWritable(const std::string &mnt_dir) {
   return false;
 }
 
+// Returns whether the error of a remount can be ignored; see below.
+static bool IsIgnorableRemountError(int error) {
+  // If we get EACCES or EPERM, this might be a mount-point for which we
+  // don't have read access. Not much we can do about this, but it also
+  // won't do any harm, so let's go on. The same goes for EINVAL or ENOENT,
+  // which are fired in case a later mount overlaps an earlier mount, e.g.
+  // consider the case of /proc, /proc/sys/fs/binfmt_misc and /proc, with
+  // the latter /proc being the one that an outer sandbox has mounted on
+  // top of its parent /proc. In that case, we're not allowed to remount
+  // /proc/sys/fs/binfmt_misc, because it is hidden. If we get ESTALE, the
+  // mount is a broken NFS mount. In the ideal case, the user would either
+  // fix or remove that mount, but in cases where that's not possible, we
+  // should just ignore it. Similarly, one can get ENODEV in case of
+  // autofs/automount failure.
+  switch (error) {
+    case EACCES:
+    case EPERM:
+    case EINVAL:
+    case ENOENT:
+    case ESTALE:
+    case ENODEV:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Makes the whole filesystem read-only with a single recursive
+// mount_setattr(2), then makes the paths for which ShouldBeWritable returns
+// true writable again. This avoids one remount per mount entry, which adds
+// up on hosts with hundreds of mounts. Returns false if the kernel does not
+// support this.
+static bool MakeFilesystemMostlyReadOnlyAtOnce() {
+  if (!global_new_mount_api) {
+    return false;
+  }
+  if (SetMountReadOnly(AT_FDCWD, "/", AT_RECURSIVE, true) < 0) {
+    PRINT_DEBUG("mount_setattr(/, AT_RECURSIVE, MOUNT_ATTR_RDONLY) failure (%m)"
+                ", remounting each mount instead");
+    return false;
+  }
+
+  std::vector<std::string> writable = opt.writable_files;
+  if (!opt.working_dir.empty()) {
+    writable.push_back(opt.working_dir);
+  }
+  writable.insert(writable.end(), opt.tmpfs_dirs.begin(),
+                  opt.tmpfs_dirs.end());
+  if (opt.enable_pty) {
+    writable.push_back("/dev/pts");
+  }
+  for (const std::string &path : writable) {
+    PRINT_DEBUG("remount rw: %s", path.c_str());
+    // This fails with EINVAL if path is not a mount point, which is fine:
+    // ShouldBeWritable only applies to mount points.
+    if (SetMountReadOnly(AT_FDCWD, path.c_str(), 0, false) < 0) {
+      if (IsIgnorableRemountError(errno)) {
+        PRINT_DEBUG("mount_setattr(%s, 0, ~MOUNT_ATTR_RDONLY) failure (%m) "
+                    "ignored",
+                    path.c_str());
+      } else {
+        DIE("mount_setattr(%s, 0, ~MOUNT_ATTR_RDONLY)", path.c_str());
+      }
+    }
+  }
+  // The tmpfs of the working directory (-F) hides the bind mount below it,
+  // to which CopyOutputs writes.
+  if (global_disk_working_dir >= 0 &&
+      SetMountReadOnly(global_disk_working_dir, "", AT_EMPTY_PATH, false) < 0) {
+    DIE("mount_setattr(%s, AT_EMPTY_PATH, ~MOUNT_ATTR_RDONLY)",
+        opt.working_dir.c_str());
+  }
+  return true;
+}
+
 // Makes the whole filesystem read-only, except for the paths for which
 // ShouldBeWritable returns true.
 static void MakeFilesystemMostlyReadOnly() {
+  if (MakeFilesystemMostlyReadOnlyAtOnce()) {
+    return;
+  }
+
   FILE *mounts = setmntent("/proc/self/mounts", "r");
   if (mounts == nullptr) {
     DIE("setmntent");
@@ -373,32 +678,13 @@ static void MakeFilesystemMostlyReadOnly() {
     PRINT_DEBUG("remount %s: %s", (mountFlags & MS_RDONLY) ? "ro" : "rw",
                 ent->mnt_dir);
     if (mount(nullptr, ent->mnt_dir, nullptr, mountFlags, nullptr) < 0) {
-      // If we get EACCES or EPERM, this might be a mount-point for which we
-      // don't have read access. Not much we can do about this, but it also
-      // won't do any harm, so let's go on. The same goes for EINVAL or ENOENT,
-      // which are fired in case a later mount overlaps an earlier mount, e.g.
-      // consider the case of /proc, /proc/sys/fs/binfmt_misc and /proc, with
-      // the latter /proc being the one that an outer sandbox has mounted on
-      // top of its parent /proc. In that case, we're not allowed to remount
-      // /proc/sys/fs/binfmt_misc, because it is hidden. If we get ESTALE, the
-      // mount is a broken NFS mount. In the ideal case, the user would either
-      // fix or remove that mount, but in cases where that's not possible, we
-      // should just ignore it. Similarly, one can get ENODEV in case of
-      // autofs/automount failure.
-      switch (errno) {
-        case EACCES:
-        case EPERM:
-        case EINVAL:
-        case ENOENT:
-        case ESTALE:
-        case ENODEV:
-          PRINT_DEBUG(
-              "remount(nullptr, %s, nullptr, %d, nullptr) failure (%m) ignored",
-              ent->mnt_dir, mountFlags);
-          break;
-        default:
-          DIE("remount(nullptr, %s, nullptr, %d, nullptr)", ent->mnt_dir,
-              mountFlags);
+      if (IsIgnorableRemountError(errno)) {
+        PRINT_DEBUG(
+            "remount(nullptr, %s, nullptr, %d, nullptr) failure (%m) ignored",
+            ent->mnt_dir, mountFlags);
+      } else {
+        DIE("remount(nullptr, %s, nullptr, %d, nullptr)", ent->mnt_dir,
+            mountFlags);
       }
     }
   }
@@ -406,13 +692,17 @@ static void MakeFilesystemMostlyReadOnly() {
   endmntent(mounts);
 }
 
-static void MountProcAndSys() {
+static void MountProc() {
   // Mount a new proc on top of the old one, because the old one still refers to
   // our parent PID namespace.
   if (mount("/proc", "/proc", "proc", MS_NODEV | MS_NOEXEC | MS_NOSUID,
             nullptr) < 0) {
     DIE("mount /proc");
   }
+}
+
+static void MountProcAndSys() {
+  MountProc();
 
   if (opt.create_netns == NO_NETNS) {
     return;
@@ -463,102 +753,46 @@ static void SetupNetworking() {
   }
 }
 
-static void EnterWorkingDirectory() {
-  std::string path = opt.working_dir;
-  if (opt.hermetic) {
-    path = path.substr(opt.sandbox_root.size() + 1);
-  }
-
-  if (chdir(path.c_str()) < 0) {
-    DIE("chdir(%s)", path.c_str());
-  }
-}
-
-static void ForwardSignal(int signum) {
-  kill(-global_child_pid, signum);
-}
-
-static void SpawnChild() {
-  PRINT_DEBUG("calling fork...");
-  global_child_pid = fork();
-
-  if (global_child_pid < 0) {
-    DIE("fork()");
-  } else if (global_child_pid == 0) {
-    // Put the child into its own process group.
-    if (setpgid(0, 0) < 0) {
-      DIE("setpgid");
-    }
-
-    // Try to assign our terminal to the child process.
-    if (tcsetpgrp(STDIN_FILENO, getpgrp()) < 0 && errno != ENOTTY) {
-      DIE("tcsetpgrp");
-    }
-
-    // Unblock all signals, restore default handlers.
-    ClearSignalMask();
-
-    // Close the file PRINT_DEBUG writes to.
-    // Must happen late enough so we don't lose any debugging output.
-    if (global_debug) {
-      fclose(global_debug);
-      global_debug = nullptr;
-    }
-
-    // Force umask to include read and execute for everyone, to make output
-    // permissions predictable.
-    umask(022);
-
-    // argv[] passed to execve() must be a null-terminated array.
-    opt.args.push_back(nullptr);
-
-    if (execvp(opt.args[0], opt.args.data()) < 0) {
-      DIE("execvp(%s, %p)", opt.args[0], opt.args.data());
+// Escapes the characters that separate paths and options in the options of
+// overlayfs.
+static std::string EscapeOverlayPath(const std::string &path) {
+  std::string escaped;
+  for (char c : path) {
+    if (c == '\\' || c == ':' || c == ',') {
+      escaped.push_back('\\');
     }
-  } else {
-    PRINT_DEBUG("child started with PID %d", global_child_pid);
+    escaped.push_back(c);
   }
+  return escaped;
 }
 
-static int WaitForChild() {
-  while (true) {
-    // Wait for some process to exit. This includes reparented processes in our
-    // PID namespace.
-    int status;
-    const pid_t pid = TEMP_FAILURE_RETRY(wait(&status));
-
-    if (pid < 0) {
-      // We don't expect any errors besides EINTR. In particular, ECHILD should
-      // be impossible because we haven't yet seen global_child_pid exit.
-      DIE("wait");
-    }
-
-    PRINT_DEBUG("wait returned pid=%d, status=0x%02x", pid, status);
-
-    // If this isn't our child's PID, there's nothing further to do; we've
-    // successfully reaped a zombie.
-    if (pid != global_child_pid) {
-      continue;
-    }
-
-    // If the child exited due to a signal, log that fact and exit with the same
-    // status.
-    if (WIFSIGNALED(status)) {
-      const int signal = WTERMSIG(status);
-      PRINT_DEBUG("child exited due to signal %d", WTERMSIG(status));
-      return 128 + signal;
+// Lays the sandbox root over the lower directories with overlayfs, so that it
+// only needs to hold what differs for this action, and receives what the
+// action writes. Unlike populating the sandbox root file by file, this costs a
+// single mount regardless of the number of inputs.
+static void MountOverlay() {
+  std::string options = "lowerdir=";
+  for (size_t i = 0; i < opt.overlay_lower_dirs.size(); i++) {
+    if (i > 0) {
+      options.push_back(':');
     }
-
-    // Otherwise it must have exited normally.
-    const int exit_code = WEXITSTATUS(status);
-    PRINT_DEBUG("child exited normally with code %d", exit_code);
-    return exit_code;
+    options.append(EscapeOverlayPath(opt.overlay_lower_dirs[i]));
+  }
+  options.append(",upperdir=").append(EscapeOverlayPath(opt.sandbox_root));
+  options.append(",workdir=").append(EscapeOverlayPath(opt.overlay_work_dir));
+  PRINT_DEBUG("overlay: %s", options.c_str());
+  if (mount("overlay", opt.sandbox_root.c_str(), "overlay", MS_NOSUID,
+            options.c_str()) < 0) {
+    DIE("mount(overlay, %s, overlay, MS_NOSUID, %s)", opt.sandbox_root.c_str(),
+        options.c_str());
   }
 }
 
 static void MountSandboxAndGoThere() {
-  if (mount(opt.sandbox_root.c_str(), opt.sandbox_root.c_str(), nullptr,
-            MS_BIND | MS_NOSUID, nullptr) < 0) {
+  if (!opt.overlay_lower_dirs.empty()) {
+    MountOverlay();
+  } else if (mount(opt.sandbox_root.c_str(), opt.sandbox_root.c_str(), nullptr,
+                   MS_BIND | MS_NOSUID, nullptr) < 0) {
     DIE("mount");
   }
   if (chdir(opt.sandbox_root.c_str()) < 0) {
@@ -591,6 +825,49 @@ static void MountDev() {
   }
 }
 
+// Bind mounts source on target, recursively and read-only, by cloning the
+// mount tree with open_tree(2). Unlike MS_BIND, which ignores MS_RDONLY, this
+// makes the new mounts read-only before they become visible. Returns false if
+// the kernel does not support this.
+static bool BindMountReadOnly(const char *source, const char *target) {
+  if (!global_new_mount_api) {
+    return false;
+  }
+  int fd = syscall(SYS_open_tree, AT_FDCWD, source,
+                   OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+  if (fd < 0) {
+    if (errno == ENOSYS) {
+      global_new_mount_api = false;
+      return false;
+    }
+    DIE("open_tree(%s)", source);
+  }
+  if (SetMountReadOnly(fd, "", AT_EMPTY_PATH | AT_RECURSIVE, true) < 0) {
+    if (errno == ENOSYS) {
+      close(fd);
+      return false;
+    }
+    DIE("mount_setattr(%s, AT_RECURSIVE, MOUNT_ATTR_RDONLY)", source);
+  }
+  if (syscall(SYS_move_mount, fd, "", AT_FDCWD, target,
+              MOVE_MOUNT_F_EMPTY_PATH) < 0) {
+    DIE("move_mount(%s, %s)", source, target);
+  }
+  close(fd);
+  return true;
+}
+
+// Bind mounts an input on its target in the sandbox, read-only.
+static void MountInput(const char *source, const char *target) {
+  if (BindMountReadOnly(source, target)) {
+    return;
+  }
+  int result = mount(source, target, NULL, MS_REC | MS_BIND | MS_RDONLY, NULL);
+  if (result != 0) {
+    DIE("mount");
+  }
+}
+
 static void MountAllMounts() {
   for (const std::string &tmpfs_dir : opt.tmpfs_dirs) {
     PRINT_DEBUG("tmpfs: %s", tmpfs_dir.c_str());
@@ -601,14 +878,7 @@ static void MountAllMounts() {
     }
   }
 
-  // Make sure that the working directory is writable (unlike most of the rest
-  // of the file system, which is read-only by default). The easiest way to do
-  // this is by bind-mounting it upon itself.
-  if (mount(opt.working_dir.c_str(), opt.working_dir.c_str(), nullptr, MS_BIND,
-            nullptr) < 0) {
-    DIE("mount(%s, %s, nullptr, MS_BIND, nullptr)", opt.working_dir.c_str(),
-        opt.working_dir.c_str());
-  }
+  MountWorkingDirectory();
 
   for (int i = 0; i < (signed)opt.bind_mount_sources.size(); i++) {
     if (global_debug) {
@@ -635,15 +905,22 @@ static void MountAllMounts() {
       DIE("stat");
     }
     bool IsDirectory = S_ISDIR(sb.st_mode);
+    if (opt.lazy_inputs && !IsDirectory) {
+      // Only create the directory of the file, so that the command can look
+      // up the file, and mount it once the command does so.
+      const std::string dir =
+          full_sandbox_path.substr(0, full_sandbox_path.rfind('/'));
+      if (CreateTarget(dir.c_str(), true) < 0) {
+        DIE("CreateTarget %s", dir.c_str());
+      }
+      global_lazy_inputs[opt.bind_mount_targets[i]] =
+          opt.bind_mount_sources[i];
+      continue;
+    }
     if (CreateTarget(full_sandbox_path.c_str(), IsDirectory) < 0) {
       DIE("CreateTarget %s", full_sandbox_path.c_str());
     }
-    int result =
-        mount(opt.bind_mount_sources[i].c_str(), full_sandbox_path.c_str(),
-              NULL, MS_REC | MS_BIND | MS_RDONLY, NULL);
-    if (result != 0) {
-      DIE("mount");
-    }
+    MountInput(opt.bind_mount_sources[i].c_str(), full_sandbox_path.c_str());
   }
   for (const std::string &writable_file : opt.writable_files) {
     PRINT_DEBUG("writable: %s", writable_file.c_str());
@@ -652,6 +929,13 @@ static void MountAllMounts() {
       DIE("mount(%s, %s, nullptr, MS_BIND | MS_REC, nullptr)",
           writable_file.c_str(), writable_file.c_str());
     }
+    // The bind mount inherits the read-only flag of a read-only bind mount
+    // that contains writable_file.
+    if (global_new_mount_api &&
+        SetMountReadOnly(AT_FDCWD, writable_file.c_str(), 0, false) < 0 &&
+        errno != ENOSYS) {
+      DIE("mount_setattr(%s, 0, ~MOUNT_ATTR_RDONLY)", writable_file.c_str());
+    }
   }
 }
 
@@ -677,38 +961,1038 @@ static void ChangeRoot() {
   }
 }
 
-int Pid1Main(void *args) {
-  PRINT_DEBUG("Pid1Main started");
+// Makes the mount at path writable again after MakeFilesystemMostlyReadOnly
+// made it and the mounts bound from it read-only.
+static void RemountWritable(const std::string &path) {
+  PRINT_DEBUG("remount rw: %s", path.c_str());
+  int result = -1;
+  if (global_new_mount_api) {
+    result = SetMountReadOnly(AT_FDCWD, path.c_str(), 0, false);
+  }
+  if (result < 0 && !global_new_mount_api) {
+    // MS_REMOUNT resets the flags we do not pass, so read them out first, as
+    // in MakeFilesystemMostlyReadOnly.
+    struct statvfs sv;
+    if (statvfs(path.c_str(), &sv) < 0) {
+      DIE("statvfs(%s)", path.c_str());
+    }
+    int mountFlags = MS_BIND | MS_REMOUNT;
+    if (sv.f_flag & ST_NODEV) {
+      mountFlags |= MS_NODEV;
+    }
+    if (sv.f_flag & ST_NOEXEC) {
+      mountFlags |= MS_NOEXEC;
+    }
+    if (sv.f_flag & ST_NOSUID) {
+      mountFlags |= MS_NOSUID;
+    }
+    if (sv.f_flag & ST_NOATIME) {
+      mountFlags |= MS_NOATIME;
+    }
+    if (sv.f_flag & ST_NODIRATIME) {
+      mountFlags |= MS_NODIRATIME;
+    }
+    if (sv.f_flag & ST_RELATIME) {
+      mountFlags |= MS_RELATIME;
+    }
+    result = mount(nullptr, path.c_str(), nullptr, mountFlags, nullptr);
+  }
+  if (result < 0) {
+    if (IsIgnorableRemountError(errno)) {
+      PRINT_DEBUG("remount rw %s failure (%m) ignored", path.c_str());
+    } else {
+      DIE("remount rw %s", path.c_str());
+    }
+  }
+}
 
-  Pid1Args pid1Args = *(static_cast<Pid1Args *>(args));
+static void EnterWorkingDirectory() {
+  std::string path = opt.working_dir;
+  if (opt.hermetic) {
+    path = path.substr(opt.sandbox_root.size() + 1);
+  }
 
-  if (getpid() != 1) {
-    DIE("Using PID namespaces, but we are not PID 1");
+  if (chdir(path.c_str()) < 0) {
+    DIE("chdir(%s)", path.c_str());
   }
+}
 
-  // Before pid1 spawns a child pid2, we want to wait for the parent process to
-  // move pid1 to the cgroup so that pid2 will be created in the same cgroup.
-  WaitPipe(pid1Args.pipe_from_parent);
+// Mounts the lazy input at path in the sandbox, unless the command created or
+// removed something there since.
+static void MaterializeInput(const std::string &path,
+                             const std::string &source) {
+  PRINT_DEBUG("lazy mount: %s", path.c_str());
+  const std::string full_sandbox_path = opt.sandbox_root + path;
+  int fd = open(full_sandbox_path.c_str(),
+                O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    if (errno == EEXIST || errno == ENOENT) {
+      PRINT_DEBUG("lazy mount %s skipped (%m)", path.c_str());
+      return;
+    }
+    DIE("open(%s)", full_sandbox_path.c_str());
+  }
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+  MountInput(source.c_str(), full_sandbox_path.c_str());
+}
 
-  // Start with default signal handlers and an empty signal mask.
-  ClearSignalMask();
+static void MaterializeAllInputs() {
+  for (const auto &input : global_lazy_inputs) {
+    MaterializeInput(input.first, input.second);
+  }
+  global_lazy_inputs.clear();
+}
 
-  SetupSelfDestruction(pid1Args.pipe_to_parent);
+// Makes the mounts of the sandbox shared, so that the mounts of lazy inputs
+// propagate to the copy of the sandbox that the command runs in.
+static void ShareSandboxMounts() {
+  if (mount(nullptr, opt.sandbox_root.c_str(), nullptr, MS_SHARED | MS_REC,
+            nullptr) < 0) {
+    DIE("mount(nullptr, %s, nullptr, MS_SHARED | MS_REC, nullptr)",
+        opt.sandbox_root.c_str());
+  }
+}
 
-  // Sandbox ourselves.
-  SetupMountNamespace();
-  SetupUserNamespace();
-  if (opt.fake_hostname) {
-    SetupUtsNamespace();
+// Runs in the child. Copies our mount namespace, in which pivot_root(2)
+// cannot take shared mounts, and makes the sandbox its root.
+static void EnterSandboxCopy() {
+  if (unshare(CLONE_NEWNS) < 0) {
+    DIE("unshare(CLONE_NEWNS)");
+  }
+  if (mount(nullptr, opt.sandbox_root.c_str(), nullptr, MS_SLAVE | MS_REC,
+            nullptr) < 0) {
+    DIE("mount(nullptr, %s, nullptr, MS_SLAVE | MS_REC, nullptr)",
+        opt.sandbox_root.c_str());
+  }
+  if (chdir(opt.sandbox_root.c_str()) < 0) {
+    DIE("chdir(%s)", opt.sandbox_root.c_str());
   }
+  ChangeRoot();
+  EnterWorkingDirectory();
+}
 
-  if (opt.hermetic) {
-    MountSandboxAndGoThere();
-    CreateEmptyFile();
-    MountDev();
-    MountProcAndSys();
-    MountAllMounts();
-    ChangeRoot();
+#ifdef INPUT_ACCESS_NOTIFY_SUPPORTED
+
+// A system call that accesses a path, and the arguments that hold the path
+// and the directory it is relative to (or -1 for the working directory).
+struct InputAccessSyscall {
+  int nr;
+  int dirfd_arg;
+  int path_arg;
+};
+
+static const InputAccessSyscall kInputAccessSyscalls[] = {
+#ifdef SYS_open
+    {SYS_open, -1, 0},
+#endif
+#ifdef SYS_stat
+    {SYS_stat, -1, 0},
+#endif
+#ifdef SYS_lstat
+    {SYS_lstat, -1, 0},
+#endif
+#ifdef SYS_access
+    {SYS_access, -1, 0},
+#endif
+#ifdef SYS_openat2
+    {SYS_openat2, 0, 1},
+#endif
+#ifdef SYS_faccessat2
+    {SYS_faccessat2, 0, 1},
+#endif
+    {SYS_openat, 0, 1},    {SYS_newfstatat, 0, 1}, {SYS_statx, 0, 1},
+    {SYS_faccessat, 0, 1}, {SYS_execve, -1, 0},    {SYS_execveat, 0, 1},
+};
+
+// Runs in the child. Makes the kernel notify the returned seccomp listener
+// of the system calls in kInputAccessSyscalls of this process and its
+// descendants. Returns -1 and sets errno on failure.
+static int InstallInputAccessFilter() {
+  std::vector<struct sock_filter> filter = {
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, INPUT_ACCESS_AUDIT_ARCH, 1, 0),
+      BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+      BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)),
+  };
+  for (const InputAccessSyscall &entry : kInputAccessSyscalls) {
+    filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                              static_cast<uint32_t>(entry.nr), 0, 1));
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF));
+  }
+  filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+  struct sock_fprog program = {static_cast<unsigned short>(filter.size()),
+                               filter.data()};
+
+  if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
+    return -1;
+  }
+  return syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER,
+                 SECCOMP_FILTER_FLAG_NEW_LISTENER, &program);
+}
+
+// Reads the null-terminated string at address in the memory of process pid.
+static bool ReadProcessString(pid_t pid, uint64_t address,
+                              std::string *result) {
+  const std::string mem_path = "/proc/" + std::to_string(pid) + "/mem";
+  int fd = open(mem_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+  char buf[PATH_MAX];
+  bool terminated = false;
+  result->clear();
+  while (!terminated && result->size() < PATH_MAX) {
+    // Do not read past the page, as the next one may not be mapped.
+    size_t size = std::min<uint64_t>(sizeof(buf),
+                                     page_size - address % page_size);
+    ssize_t n = pread(fd, buf, size, address);
+    if (n <= 0) {
+      break;
+    }
+    size_t length = strnlen(buf, n);
+    result->append(buf, length);
+    terminated = length < static_cast<size_t>(n);
+    address += n;
+  }
+  close(fd);
+  return terminated;
+}
+
+// Resolves "." and ".." in an absolute path lexically, and removes duplicate
+// and trailing slashes.
+static std::string NormalizePath(const std::string &path) {
+  std::vector<std::string> segments;
+  size_t start = 0;
+  while (start < path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    const std::string segment = path.substr(start, end - start);
+    if (segment == "..") {
+      if (!segments.empty()) {
+        segments.pop_back();
+      }
+    } else if (!segment.empty() && segment != ".") {
+      segments.push_back(segment);
+    }
+    start = end + 1;
+  }
+  std::string result;
+  for (const std::string &segment : segments) {
+    result.append("/").append(segment);
+  }
+  return result.empty() ? "/" : result;
+}
+
+// Gets the path in the sandbox that the system call of req accesses. Returns
+// false if it has none, or the process went away.
+static bool GetAccessedPath(const struct seccomp_notif &req,
+                            std::string *path) {
+  const InputAccessSyscall *entry = nullptr;
+  for (const InputAccessSyscall &candidate : kInputAccessSyscalls) {
+    if (candidate.nr == req.data.nr) {
+      entry = &candidate;
+    }
+  }
+  if (entry == nullptr ||
+      !ReadProcessString(req.pid, req.data.args[entry->path_arg], path) ||
+      path->empty()) {
+    return false;
+  }
+  if ((*path)[0] != '/') {
+    // The kernel gives the paths of a process whose root is the root of its
+    // mount namespace relative to that root, which is the sandbox.
+    int dirfd = AT_FDCWD;
+    if (entry->dirfd_arg >= 0) {
+      dirfd = static_cast<int>(req.data.args[entry->dirfd_arg]);
+    }
+    const std::string link =
+        "/proc/" + std::to_string(req.pid) +
+        (dirfd == AT_FDCWD ? "/cwd" : "/fd/" + std::to_string(dirfd));
+    char dir[PATH_MAX];
+    ssize_t length = readlink(link.c_str(), dir, sizeof(dir));
+    if (length <= 0 || length == sizeof(dir) || dir[0] != '/') {
+      return false;
+    }
+    *path = std::string(dir, length) + "/" + *path;
+  }
+  *path = NormalizePath(*path);
+  // The process may have gone away, and its PID been reused, while we read
+  // its memory and file descriptors.
+  return ioctl(global_input_listener, SECCOMP_IOCTL_NOTIF_ID_VALID, &req.id) ==
+         0;
+}
+
+// Records an access to path, or a path below it, if it is the target of one
+// of the -M/-m mounts.
+static void RecordInputAccess(std::string path) {
+  while (!path.empty()) {
+    if (global_declared_inputs.count(path) > 0) {
+      global_accessed_inputs.insert(path);
+      return;
+    }
+    path.resize(path.rfind('/'));
+  }
+}
+
+// Serves a system call of the command that accesses a path, by mounting the
+// lazy input at that path if there is one, recording the access with -A, and
+// letting the system call continue.
+static void ServeInputAccess() {
+  struct seccomp_notif req;
+  memset(&req, 0, sizeof(req));
+  if (ioctl(global_input_listener, SECCOMP_IOCTL_NOTIF_RECV, &req) < 0) {
+    // The system call was interrupted before we got to it.
+    if (errno == ENOENT || errno == EINTR) {
+      return;
+    }
+    DIE("ioctl(SECCOMP_IOCTL_NOTIF_RECV)");
+  }
+
+  std::string path;
+  if (GetAccessedPath(req, &path)) {
+    auto input = global_lazy_inputs.find(path);
+    if (input != global_lazy_inputs.end()) {
+      MaterializeInput(input->first, input->second);
+      global_lazy_inputs.erase(input);
+    }
+    if (global_accessed_inputs_fd >= 0) {
+      RecordInputAccess(path);
+    }
+  }
+
+  // The path may change before the system call continues, but we only have
+  // to mount inputs, not enforce anything.
+  struct seccomp_notif_resp resp;
+  memset(&resp, 0, sizeof(resp));
+  resp.id = req.id;
+  resp.flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+  if (ioctl(global_input_listener, SECCOMP_IOCTL_NOTIF_SEND, &resp) < 0 &&
+      errno != ENOENT) {
+    DIE("ioctl(SECCOMP_IOCTL_NOTIF_SEND)");
+  }
+}
+
+#else  // INPUT_ACCESS_NOTIFY_SUPPORTED
+
+static int InstallInputAccessFilter() {
+  errno = ENOSYS;
+  return -1;
+}
+
+static void ServeInputAccess() {}
+
+#endif  // INPUT_ACCESS_NOTIFY_SUPPORTED
+
+// Runs in the child. Sends the seccomp listener for the accesses to lazy
+// inputs to PID 1 over socket, or, if the kernel does not support it, waits
+// until PID 1 mounted all inputs.
+static void SendInputAccessListener(int socket) {
+  const int listener = InstallInputAccessFilter();
+  char control[CMSG_SPACE(sizeof(int))] = {};
+  char byte = 0;
+  struct iovec iov = {&byte, 1};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (listener >= 0) {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &listener, sizeof(int));
+  }
+  if (TEMP_FAILURE_RETRY(sendmsg(socket, &msg, 0)) < 0) {
+    DIE("sendmsg");
+  }
+  if (listener >= 0) {
+    if (close(listener) < 0) {
+      DIE("close");
+    }
+  } else if (!ReadFully(socket, &byte, 1)) {
+    DIE("read");
+  }
+  if (close(socket) < 0) {
+    DIE("close");
+  }
+}
+
+// Receives the seccomp listener for the accesses to lazy inputs from the
+// child, or mounts all inputs if it did not get one.
+static void ReceiveInputAccessListener(int socket) {
+  char control[CMSG_SPACE(sizeof(int))];
+  char byte;
+  struct iovec iov = {&byte, 1};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  const ssize_t n = TEMP_FAILURE_RETRY(recvmsg(socket, &msg, MSG_CMSG_CLOEXEC));
+  if (n < 0) {
+    DIE("recvmsg");
+  }
+  if (n == 0) {
+    // The child died before it got there.
+    return;
+  }
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg != nullptr && cmsg->cmsg_type == SCM_RIGHTS &&
+      cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+    memcpy(&global_input_listener, CMSG_DATA(cmsg), sizeof(int));
+    global_tracing_accesses = true;
+    PRINT_DEBUG("serving %zu lazy inputs", global_lazy_inputs.size());
+    return;
+  }
+  PRINT_DEBUG("seccomp user notifications not supported, mounting all inputs");
+  MaterializeAllInputs();
+  WriteFully(socket, &byte, 1);
+}
+
+// Whether the command runs with a seccomp filter that notifies us of the
+// paths it accesses, for lazy inputs (-I) or to record the accessed inputs
+// (-A).
+static bool ServesInputAccesses() {
+  return !global_lazy_inputs.empty() || global_accessed_inputs_fd >= 0;
+}
+
+// Writes the inputs that the command accessed for -A to the memfd that
+// linux-sandbox gave us, one per line, and seals it to tell linux-sandbox that
+// the list is complete. Without the seal, linux-sandbox reports all inputs.
+static void WriteAccessedInputs() {
+  if (global_accessed_inputs_fd < 0 || !global_tracing_accesses) {
+    return;
+  }
+  std::string contents;
+  for (const std::string &input : global_accessed_inputs) {
+    contents.append(input).push_back('\n');
+  }
+  WriteFully(global_accessed_inputs_fd, contents.data(), contents.size());
+  if (fcntl(global_accessed_inputs_fd, F_ADD_SEALS,
+            F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+    DIE("fcntl(F_ADD_SEALS)");
+  }
+}
+
+// Copies the contents of the file in to out, with copy_file_range where the
+// filesystems support it, and sendfile otherwise, as between the tmpfs and
+// the disk before Linux 5.3 and since 5.19.
+static void CopyFileContents(int in, int out) {
+  bool use_sendfile = false;
+  for (;;) {
+    const ssize_t n =
+        use_sendfile ? sendfile(out, in, nullptr, 1 << 30)
+                     : copy_file_range(in, nullptr, out, nullptr, 1 << 30, 0);
+    if (n == 0) {
+      return;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (!use_sendfile && (errno == EXDEV || errno == EINVAL ||
+                            errno == ENOSYS || errno == EOPNOTSUPP)) {
+        use_sendfile = true;
+        continue;
+      }
+      DIE("%s", use_sendfile ? "sendfile" : "copy_file_range");
+    }
+  }
+}
+
+// Copies the file, symlink or directory at path, relative to the working
+// directory, from the tmpfs to the disk. Replaces files and symlinks by
+// renaming a copy over them, as the overlay shows us the very file on disk
+// if the command left it alone.
+static void CopyOutput(const std::string &path) {
+  struct stat sb;
+  if (fstatat(global_tmpfs_working_dir, path.c_str(), &sb,
+              AT_SYMLINK_NOFOLLOW) < 0) {
+    if (errno == ENOENT) {
+      // The command did not create the output; Bazel will report that.
+      return;
+    }
+    DIE("fstatat(%s)", path.c_str());
+  }
+
+  if (S_ISDIR(sb.st_mode)) {
+    if (mkdirat(global_disk_working_dir, path.c_str(), sb.st_mode & 07777) <
+            0 &&
+        errno != EEXIST) {
+      DIE("mkdirat(%s)", path.c_str());
+    }
+    const int fd = openat(global_tmpfs_working_dir, path.c_str(),
+                          O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd < 0 ? nullptr : fdopendir(fd);
+    if (dir == nullptr) {
+      DIE("opendir(%s)", path.c_str());
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+        CopyOutput(path + "/" + entry->d_name);
+      }
+    }
+    closedir(dir);
+    return;
+  }
+
+  const std::string copy = path + ".linux-sandbox-copy";
+  unlinkat(global_disk_working_dir, copy.c_str(), 0);
+  if (S_ISLNK(sb.st_mode)) {
+    std::vector<char> target(sb.st_size + 1);
+    const ssize_t size = readlinkat(global_tmpfs_working_dir, path.c_str(),
+                                    target.data(), target.size());
+    if (size < 0 || static_cast<size_t>(size) >= target.size()) {
+      DIE("readlinkat(%s)", path.c_str());
+    }
+    target[size] = '\0';
+    if (symlinkat(target.data(), global_disk_working_dir, copy.c_str()) < 0) {
+      DIE("symlinkat(%s)", copy.c_str());
+    }
+  } else if (S_ISREG(sb.st_mode)) {
+    const int in = openat(global_tmpfs_working_dir, path.c_str(),
+                          O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+      DIE("openat(%s)", path.c_str());
+    }
+    const int out =
+        openat(global_disk_working_dir, copy.c_str(),
+               O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, sb.st_mode & 07777);
+    if (out < 0) {
+      DIE("openat(%s)", copy.c_str());
+    }
+    CopyFileContents(in, out);
+    // The mode passed to openat is subject to the umask.
+    if (fchmod(out, sb.st_mode & 07777) < 0) {
+      DIE("fchmod(%s)", copy.c_str());
+    }
+    close(in);
+    if (close(out) < 0) {
+      DIE("close(%s)", copy.c_str());
+    }
+  } else {
+    PRINT_DEBUG("not copying special file %s", path.c_str());
+    return;
+  }
+  if (renameat(global_disk_working_dir, copy.c_str(), global_disk_working_dir,
+               path.c_str()) < 0) {
+    DIE("renameat(%s, %s)", copy.c_str(), path.c_str());
+  }
+}
+
+// With a tmpfs for the working directory (-F), copies the outputs (-Y) from
+// it to the disk, along with the directories they are in.
+static void CopyOutputs() {
+  if (global_tmpfs_working_dir < 0) {
+    return;
+  }
+  for (const std::string &output : opt.tmpfs_outputs) {
+    const std::string path = output.substr(opt.working_dir.size() + 1);
+    for (size_t slash = path.find('/'); slash != std::string::npos;
+         slash = path.find('/', slash + 1)) {
+      const std::string dir = path.substr(0, slash);
+      if (mkdirat(global_disk_working_dir, dir.c_str(), 0755) < 0 &&
+          errno != EEXIST) {
+        DIE("mkdirat(%s)", dir.c_str());
+      }
+    }
+    CopyOutput(path);
+  }
+}
+
+static void OnSigchld(int) {}
+
+// Waits for some process to exit like wait(2), and serves the accesses of the
+// command to lazy inputs in the meantime.
+static pid_t WaitServingInputAccesses(int *status) {
+  while (global_input_listener >= 0) {
+    const pid_t pid = waitpid(-1, status, WNOHANG);
+    if (pid != 0) {
+      return pid;
+    }
+    struct pollfd fd = {global_input_listener, POLLIN, 0};
+    if (ppoll(&fd, 1, nullptr, &global_input_wait_mask) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("ppoll");
+    }
+    if (fd.revents & POLLIN) {
+      ServeInputAccess();
+    } else if (fd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+      // No process is left that could access inputs.
+      close(global_input_listener);
+      global_input_listener = -1;
+    }
+  }
+  return TEMP_FAILURE_RETRY(wait(status));
+}
+
+static void ForwardSignal(int signum) {
+  kill(-global_child_pid, signum);
+}
+
+// The stack of the child of SpawnChildSharingMemory, which only has to last
+// until it execs.
+static const size_t kSharedMemoryChildStackSize = 256 * 1024;
+
+// Like DIE, for the child of SpawnChildSharingMemory. Neither touches the
+// stdio buffers nor runs the exit handlers, which are the parent's as well.
+static void DieSharingMemory(const char *what, const char *arg) {
+  const char *error = strerror(errno);
+  const char *parts[] = {__FILE__ ": \"", what, "(", arg, ")\": ", error, "\n"};
+  for (const char *part : parts) {
+    if (write(STDERR_FILENO, part, strlen(part)) < 0) {
+      break;
+    }
+  }
+  _exit(EXIT_FAILURE);
+}
+
+// Does what the child forked by SpawnChild does, in the child of
+// SpawnChildSharingMemory. Only makes system calls, and writes no memory
+// besides its stack, as that memory is the parent's.
+static int RunChildSharingMemory(void *) {
+  if (setpgid(0, 0) < 0) {
+    DieSharingMemory("setpgid", "");
+  }
+  if (tcsetpgrp(STDIN_FILENO, getpgrp()) < 0 && errno != ENOTTY) {
+    DieSharingMemory("tcsetpgrp", "");
+  }
+  ClearSignalMask();
+  // The descriptor of the file PRINT_DEBUG writes to is ours, its FILE is
+  // not.
+  if (global_debug) {
+    close(fileno(global_debug));
+  }
+  umask(022);
+  execvp(opt.args[0], opt.args.data());
+  DieSharingMemory("execvp", opt.args[0]);
+  return EXIT_FAILURE;
+}
+
+// Starts the child with clone(CLONE_VM | CLONE_VFORK), like posix_spawn does:
+// the page tables of this process, which the mounts of the sandbox and the
+// arguments of the command make large, are not copied, and we are suspended
+// until the child execs.
+static void SpawnChildSharingMemory() {
+  void *stack = mmap(nullptr, kSharedMemoryChildStackSize,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (stack == MAP_FAILED) {
+    DIE("mmap");
+  }
+  // None of our signal handlers may run in the child before it resets them.
+  sigset_t all_signals;
+  sigset_t saved_signals;
+  if (sigfillset(&all_signals) < 0 ||
+      sigprocmask(SIG_SETMASK, &all_signals, &saved_signals) < 0) {
+    DIE("sigprocmask");
+  }
+  // The stack grows down on all the architectures we support.
+  global_child_pid = clone(
+      RunChildSharingMemory,
+      static_cast<char *>(stack) + kSharedMemoryChildStackSize,
+      CLONE_VM | CLONE_VFORK | SIGCHLD, nullptr);
+  const int clone_errno = errno;
+  if (sigprocmask(SIG_SETMASK, &saved_signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+  if (munmap(stack, kSharedMemoryChildStackSize) < 0) {
+    DIE("munmap");
+  }
+  if (global_child_pid < 0) {
+    errno = clone_errno;
+    DIE("clone");
+  }
+}
+
+static void SpawnChild() {
+  // On ourselves, so that the child inherits it even when it only makes system
+  // calls before exec. We have nothing else to run.
+  if (!SetCpuAffinity(opt.cpus, opt.mem_node)) {
+    DIE("SetCpuAffinity");
+  }
+
+  int input_sockets[2] = {-1, -1};
+  if (ServesInputAccesses()) {
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, input_sockets) <
+        0) {
+      DIE("socketpair");
+    }
+    // Only let SIGCHLD in while WaitServingInputAccesses waits, so that it
+    // cannot miss the exit of the child.
+    sigset_t sigchld;
+    if (sigemptyset(&sigchld) < 0 || sigaddset(&sigchld, SIGCHLD) < 0) {
+      DIE("sigset");
+    }
+    if (sigprocmask(SIG_BLOCK, &sigchld, &global_input_wait_mask) < 0) {
+      DIE("sigprocmask");
+    }
+    if (sigdelset(&global_input_wait_mask, SIGCHLD) < 0) {
+      DIE("sigdelset");
+    }
+    InstallSignalHandler(SIGCHLD, OnSigchld);
+  }
+
+  // argv[] passed to execve() must be a null-terminated array.
+  opt.args.push_back(nullptr);
+
+  // Handing the listener for input accesses over takes more than system
+  // calls in the child.
+  if (input_sockets[0] < 0) {
+    PRINT_DEBUG("calling clone...");
+    SpawnChildSharingMemory();
+    PRINT_DEBUG("child started with PID %d", global_child_pid);
+    return;
+  }
+
+  PRINT_DEBUG("calling fork...");
+  global_child_pid = fork();
+
+  if (global_child_pid < 0) {
+    DIE("fork()");
+  } else if (global_child_pid == 0) {
+    // Put the child into its own process group.
+    if (setpgid(0, 0) < 0) {
+      DIE("setpgid");
+    }
+
+    // Try to assign our terminal to the child process.
+    if (tcsetpgrp(STDIN_FILENO, getpgrp()) < 0 && errno != ENOTTY) {
+      DIE("tcsetpgrp");
+    }
+
+    // Unblock all signals, restore default handlers.
+    ClearSignalMask();
+
+    // Close the file PRINT_DEBUG writes to.
+    // Must happen late enough so we don't lose any debugging output.
+    if (global_debug) {
+      fclose(global_debug);
+      global_debug = nullptr;
+    }
+
+    // Force umask to include read and execute for everyone, to make output
+    // permissions predictable.
+    umask(022);
+
+    if (input_sockets[0] >= 0) {
+      if (opt.hermetic) {
+        EnterSandboxCopy();
+      }
+      SendInputAccessListener(input_sockets[1]);
+    }
+
+    if (execvp(opt.args[0], opt.args.data()) < 0) {
+      DIE("execvp(%s, %p)", opt.args[0], opt.args.data());
+    }
+  } else {
+    PRINT_DEBUG("child started with PID %d", global_child_pid);
+    if (input_sockets[0] >= 0) {
+      if (close(input_sockets[1]) < 0) {
+        DIE("close");
+      }
+      ReceiveInputAccessListener(input_sockets[0]);
+      if (close(input_sockets[0]) < 0) {
+        DIE("close");
+      }
+    }
+  }
+}
+
+static int WaitForChild() {
+  while (true) {
+    // Wait for some process to exit. This includes reparented processes in our
+    // PID namespace.
+    int status;
+    const pid_t pid = WaitServingInputAccesses(&status);
+
+    if (pid < 0) {
+      // We don't expect any errors besides EINTR. In particular, ECHILD should
+      // be impossible because we haven't yet seen global_child_pid exit.
+      DIE("wait");
+    }
+
+    PRINT_DEBUG("wait returned pid=%d, status=0x%02x", pid, status);
+
+    // If this isn't our child's PID, there's nothing further to do; we've
+    // successfully reaped a zombie.
+    if (pid != global_child_pid) {
+      continue;
+    }
+
+    // If the child exited due to a signal, log that fact and exit with the same
+    // status.
+    if (WIFSIGNALED(status)) {
+      const int signal = WTERMSIG(status);
+      PRINT_DEBUG("child exited due to signal %d", WTERMSIG(status));
+      return 128 + signal;
+    }
+
+    // Otherwise it must have exited normally.
+    const int exit_code = WEXITSTATUS(status);
+    PRINT_DEBUG("child exited normally with code %d", exit_code);
+    return exit_code;
+  }
+}
+
+static void OnRequestTimeout(int) {
+  if (!global_need_polite_sigterm) {
+    kill(global_request_pid, SIGKILL);
+    return;
+  }
+  global_need_polite_sigterm = false;
+  kill(global_request_pid, SIGTERM);
+  alarm(opt.kill_delay_secs);
+}
+
+// Receives a request and makes the file descriptors that come with it our
+// stdout and stderr. Returns false if the server is shutting down.
+static bool ReceiveRequest(std::string *request) {
+  RequestHeader header;
+  struct iovec iov = {&header, sizeof(header)};
+  char control[CMSG_SPACE(2 * sizeof(int))];
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  const ssize_t n =
+      TEMP_FAILURE_RETRY(recvmsg(global_server_socket, &msg, MSG_WAITALL));
+  if (n < 0) {
+    DIE("recvmsg");
+  }
+  if (n == 0) {
+    return false;
+  }
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (n != sizeof(header) || cmsg == nullptr ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+    errno = EPROTO;
+    DIE("recvmsg");
+  }
+
+  int fds[2];
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  if (dup2(fds[0], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0) {
+    DIE("dup2");
+  }
+  if (close(fds[0]) < 0 || close(fds[1]) < 0) {
+    DIE("close");
+  }
+
+  request->resize(header.size);
+  if (!ReadFully(global_server_socket, &(*request)[0], header.size)) {
+    errno = EPIPE;
+    DIE("read");
+  }
+  return true;
+}
+
+// Runs in a worker process. Copies the namespaces of the server, waits for a
+// request, and signals taken_fd once it has one so that the server can fork
+// the next worker. Then runs the command of the request in those namespaces
+// like Pid1Main does, and replies with its exit code.
+static int RunRequest(int taken_fd) {
+  if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0) {
+    DIE("prctl");
+  }
+
+  // Copy the read-only base and set up the other namespaces of the request
+  // while the previous request is still running. The new PID namespace only
+  // applies to our children; the new UTS namespace starts with the hostname
+  // that SetupUtsNamespace set.
+  int unshare_flags = CLONE_NEWNS | CLONE_NEWPID | CLONE_NEWIPC;
+  if (opt.fake_hostname) {
+    unshare_flags |= CLONE_NEWUTS;
+  }
+  if (opt.create_netns != NO_NETNS) {
+    unshare_flags |= CLONE_NEWNET;
+  }
+  if (unshare(unshare_flags) < 0) {
+    DIE("unshare");
+  }
+  SetupNetworking();
+
+  std::string request;
+  if (!ReceiveRequest(&request)) {
+    return EXIT_SUCCESS;
+  }
+  WriteFully(taken_fd, "", 1);
+  if (close(taken_fd) < 0) {
+    DIE("close");
+  }
+  ParseRequest(request);
+
+  // Our stdin is the one linux-sandbox reads requests from.
+  int null_fd = open("/dev/null", O_RDONLY);
+  if (null_fd < 0) {
+    DIE("open(/dev/null)");
+  }
+  if (dup2(null_fd, STDIN_FILENO) < 0) {
+    DIE("dup2");
+  }
+  if (close(null_fd) < 0) {
+    DIE("close");
+  }
+
+  global_request_pid = fork();
+  if (global_request_pid < 0) {
+    DIE("fork()");
+  } else if (global_request_pid == 0) {
+    // We are PID 1 of the new PID namespace now.
+    if (prctl(PR_SET_PDEATHSIG, SIGKILL) < 0) {
+      DIE("prctl");
+    }
+    MountFilesystems();
+    RemountWritable(opt.working_dir);
+    for (const std::string &writable_file : opt.writable_files) {
+      RemountWritable(writable_file);
+    }
+    // /sys shows the network namespace of whoever mounted it.
+    MountProcAndSys();
+    EnterWorkingDirectory();
+    SpawnChild();
+    InstallSignalHandler(SIGTERM, ForwardSignal);
+    exit(WaitForChild());
+  }
+  PRINT_DEBUG("request started with PID %d", global_request_pid);
+
+  global_need_polite_sigterm = opt.kill_delay_secs > 0;
+  InstallSignalHandler(SIGALRM, OnRequestTimeout);
+  if (opt.timeout_secs > 0) {
+    alarm(opt.timeout_secs);
+  }
+
+  int status;
+  RequestResult result = {};
+  if (TEMP_FAILURE_RETRY(
+          wait4(global_request_pid, &status, 0, &result.rusage)) < 0) {
+    DIE("wait4");
+  }
+  if (WIFSIGNALED(status)) {
+    result.exit_code = 128 + WTERMSIG(status);
+  } else {
+    result.exit_code = WEXITSTATUS(status);
+  }
+  WriteFully(global_server_socket, &result, sizeof(result));
+  return EXIT_SUCCESS;
+}
+
+// Forks a worker that waits for the next request. Returns false once a worker
+// exits without taking a request, which means that linux-sandbox is done.
+static bool ForkWorker() {
+  int taken_pipe[2];
+  if (pipe(taken_pipe) < 0) {
+    DIE("pipe");
+  }
+
+  const pid_t pid = fork();
+  if (pid < 0) {
+    DIE("fork()");
+  } else if (pid == 0) {
+    if (close(taken_pipe[0]) < 0) {
+      DIE("close");
+    }
+    exit(RunRequest(taken_pipe[1]));
+  }
+  PRINT_DEBUG("worker started with PID %d", pid);
+
+  if (close(taken_pipe[1]) < 0) {
+    DIE("close");
+  }
+  char buf;
+  const bool taken = ReadFully(taken_pipe[0], &buf, 1);
+  if (close(taken_pipe[0]) < 0) {
+    DIE("close");
+  }
+
+  // Reap the workers of earlier requests.
+  while (waitpid(-1, nullptr, WNOHANG) > 0) {
+  }
+  return taken;
+}
+
+static int ServeRequests() {
+  // Set up the base that the workers copy. Each of them sets up the network
+  // of its request.
+  MakeFilesystemMostlyReadOnly();
+  MountProcAndSys();
+
+  IgnoreSignal(SIGTTIN);
+  IgnoreSignal(SIGTTOU);
+
+  while (ForkWorker()) {
+  }
+
+  while (TEMP_FAILURE_RETRY(wait(nullptr)) > 0) {
+  }
+  return EXIT_SUCCESS;
+}
+
+int Pid1Main(void *args) {
+  PRINT_DEBUG("Pid1Main started");
+
+  Pid1Args pid1Args = *(static_cast<Pid1Args *>(args));
+  if (opt.server_mode) {
+    if (close(pid1Args.server_sockets[0]) < 0) {
+      DIE("close");
+    }
+    global_server_socket = pid1Args.server_sockets[1];
+  }
+
+  if (getpid() != 1) {
+    DIE("Using PID namespaces, but we are not PID 1");
+  }
+
+  // Before pid1 spawns a child pid2, we want to wait for the parent process to
+  // move pid1 to the cgroup so that pid2 will be created in the same cgroup.
+  WaitPipe(pid1Args.pipe_from_parent);
+
+  // Start with default signal handlers and an empty signal mask.
+  ClearSignalMask();
+
+  SetupSelfDestruction(pid1Args.pipe_to_parent);
+
+  if (pid1Args.accessed_inputs_fd >= 0) {
+    global_accessed_inputs_fd = pid1Args.accessed_inputs_fd;
+    global_declared_inputs.insert(opt.bind_mount_targets.begin(),
+                                  opt.bind_mount_targets.end());
+  }
+
+  // Sandbox ourselves.
+  SetupMountNamespace();
+  SetupUserNamespace();
+  if (opt.fake_hostname) {
+    SetupUtsNamespace();
+  }
+
+  if (opt.server_mode) {
+    return ServeRequests();
+  }
+
+  if (opt.hermetic) {
+    MountSandboxAndGoThere();
+    CreateEmptyFile();
+    MountDev();
+    MountProcAndSys();
+    MountAllMounts();
+    if (ServesInputAccesses()) {
+      // The child enters a copy of the sandbox in SpawnChild instead, as we
+      // need to stay outside to read its memory through /proc.
+      ShareSandboxMounts();
+    } else {
+      ChangeRoot();
+    }
   } else {
     MountFilesystems();
     MakeFilesystemMostlyReadOnly();
@@ -731,5 +2015,8 @@ int Pid1Main(void *args) {
   // Note that there's no need to kill any remaining descendant processes; they
   // are in our PID namespace and the kernel will send them SIGKILL
   // automatically once we exit.
-  return WaitForChild();
+  const int exit_code = WaitForChild();
+  WriteAccessedInputs();
+  CopyOutputs();
+  return exit_code;
 }
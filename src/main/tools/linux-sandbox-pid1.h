@@ -15,9 +15,29 @@
 #ifndef SRC_MAIN_TOOLS_LINUX_SANDBOX_PID1_H_
 #define SRC_MAIN_TOOLS_LINUX_SANDBOX_PID1_H_
 
+#include <stdint.h>
+#include <sys/resource.h>
+
 struct Pid1Args {
   int *pipe_to_parent;
   int *pipe_from_parent;
+  // In server mode (-z), the socket pair over which requests are passed to us.
+  // We use the second one.
+  int *server_sockets;
+  // With -A, the sealable memfd to write the accessed inputs to, or -1.
+  int accessed_inputs_fd;
+};
+
+// In server mode (-z), precedes a request sent to us. Comes with the file
+// descriptors for the stdout and stderr of the command.
+struct RequestHeader {
+  uint64_t size;
+};
+
+// In server mode (-z), our reply once the command of a request has exited.
+struct RequestResult {
+  int exit_code;
+  struct rusage rusage;
 };
 
 int Pid1Main(void *pid1Args);
@@ -35,6 +35,17 @@
  *  - The hostname and domainname will be set to "sandbox".
  *  - The process runs in its own PID namespace, so other processes on the
  *    system are invisible.
+ *  - If option -G is passed, the process runs in a cgroup v2 of its own, with
+ *    the memory (-x) and CPU (-y) limits given, and the resource usage of that
+ *    cgroup is added to the stats (-S).
+ *  - If option -F is passed, what the process writes to the working directory
+ *    goes to a size-capped tmpfs, and only the outputs given with -Y are
+ *    copied to the disk once it exited.
+ *  - If option -r is passed, the resource usage of the process and its
+ *    children is sampled every -q seconds while they run, and streamed to a
+ *    file or pipe for Bazel to read.
+ *  - If option -z is passed, the sandbox is set up once and then runs the
+ *    commands of the requests read from stdin, see linux-sandbox-pid1.cc.
  */
 
 #include "src/main/tools/linux-sandbox.h"
@@ -50,8 +61,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -59,6 +73,9 @@
 #include <unistd.h>
 
 #include <atomic>
+#include <fstream>
+#include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -67,9 +84,19 @@
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
+#ifndef NS_GET_USERNS
+#define NS_GET_USERNS _IO(0xb7, 0x1)
+#endif
+
 uid_t global_outer_uid;
 gid_t global_outer_gid;
 
+// The cgroup we created for the command (-G), if any.
+static std::string global_action_cgroup;
+
+// The memfd that linux-sandbox-pid1 writes the accessed inputs to (-A), if any.
+static int global_accessed_inputs_fd = -1;
+
 // The PID of our child process, for use in signal handlers.
 static std::atomic<pid_t> global_child_pid{0};
 // Our parent's pid at the outset, to check if the original parent has exited.
@@ -125,6 +152,38 @@ static void CloseFds() {
   }
 }
 
+// Joins the network namespace given with -j, so that linux-sandbox-pid1 does
+// not have to create one. Creating and tearing down network namespaces is
+// slow, because the kernel has to wait for RCU grace periods.
+//
+// Joining a network namespace takes CAP_SYS_ADMIN over the user namespace that
+// owns it, so we first join that user namespace, in which its creator (our
+// user) has all capabilities. The user namespace of linux-sandbox-pid1 then
+// nests inside of it, and maps our uid in there, so the namespace should map
+// our uid to itself as `unshare --map-current-user --net` does.
+static void JoinNetworkNamespace() {
+  const int netns_fd = open(opt.netns_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (netns_fd < 0) {
+    DIE("open(%s)", opt.netns_path.c_str());
+  }
+  const int userns_fd = ioctl(netns_fd, NS_GET_USERNS);
+  if (userns_fd < 0) {
+    DIE("ioctl(NS_GET_USERNS)");
+  }
+  // Joining the user namespace we are already in fails with EINVAL, which is
+  // the case when we run as root and the network namespace is owned by the
+  // initial user namespace.
+  if (setns(userns_fd, CLONE_NEWUSER) < 0 && errno != EINVAL) {
+    DIE("setns(%s owner)", opt.netns_path.c_str());
+  }
+  if (setns(netns_fd, CLONE_NEWNET) < 0) {
+    DIE("setns(%s)", opt.netns_path.c_str());
+  }
+  if (close(userns_fd) < 0 || close(netns_fd) < 0) {
+    DIE("close");
+  }
+}
+
 static void MaybeAddChildProcessToCgroup(const pid_t pid) {
   for (const std::string &cgroups_dir : opt.cgroups_dirs) {
     PRINT_DEBUG("Adding process %d to cgroups dir %s", pid,
@@ -133,6 +192,124 @@ static void MaybeAddChildProcessToCgroup(const pid_t pid) {
   }
 }
 
+// Creates a cgroup for the command below opt.cgroup_parent and applies the
+// requested limits to it. The controllers for these limits must be enabled in
+// the cgroup.subtree_control of the parent.
+static void CreateActionCgroup() {
+  global_action_cgroup =
+      opt.cgroup_parent + "/sandbox_" + std::to_string(getpid());
+  PRINT_DEBUG("Creating cgroup %s", global_action_cgroup.c_str());
+  if (mkdir(global_action_cgroup.c_str(), 0755) < 0 && errno != EEXIST) {
+    DIE("mkdir(%s)", global_action_cgroup.c_str());
+  }
+  if (opt.cgroup_memory_limit > 0) {
+    WriteFile(global_action_cgroup + "/memory.max", "%" PRId64,
+              opt.cgroup_memory_limit);
+  }
+  if (opt.cgroup_cpu_limit > 0) {
+    const int kCpuPeriodUsec = 100000;
+    WriteFile(global_action_cgroup + "/cpu.max", "%lld %d",
+              llround(opt.cgroup_cpu_limit * kCpuPeriodUsec), kCpuPeriodUsec);
+  }
+  // Unlike the limits, pinning works without the cpuset controller, through
+  // the affinity that the command inherits from PID 1. The cpuset also keeps
+  // the command from widening its affinity again.
+  if (access((global_action_cgroup + "/cpuset.cpus").c_str(), W_OK) == 0) {
+    if (!opt.cpus.empty()) {
+      std::string cpus;
+      for (int cpu : opt.cpus) {
+        cpus += (cpus.empty() ? "" : ",") + std::to_string(cpu);
+      }
+      WriteFile(global_action_cgroup + "/cpuset.cpus", "%s", cpus.c_str());
+    }
+    if (opt.mem_node >= 0) {
+      WriteFile(global_action_cgroup + "/cpuset.mems", "%d", opt.mem_node);
+    }
+  }
+  opt.cgroups_dirs.push_back(global_action_cgroup);
+}
+
+// Returns the contents of an interface file of the cgroup of the command, or
+// an empty string if the kernel does not provide it.
+static std::string ReadActionCgroupFile(const std::string &name) {
+  std::ifstream file(global_action_cgroup + "/" + name);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+// Reads the resource usage of the cgroup of the command once it has exited.
+static void GetActionCgroupStatistics(tools::protos::CgroupStatistics *stats) {
+  int64_t value;
+  std::string key;
+  std::string field;
+
+  std::istringstream memory_peak(ReadActionCgroupFile("memory.peak"));
+  if (memory_peak >> value) {
+    stats->set_memory_peak_bytes(value);
+  }
+
+  // Lines of "key value".
+  std::istringstream cpu_stat(ReadActionCgroupFile("cpu.stat"));
+  while (cpu_stat >> key >> value) {
+    if (key == "usage_usec") {
+      stats->set_cpu_usage_usec(value);
+    } else if (key == "user_usec") {
+      stats->set_cpu_user_usec(value);
+    } else if (key == "system_usec") {
+      stats->set_cpu_system_usec(value);
+    } else if (key == "throttled_usec") {
+      stats->set_cpu_throttled_usec(value);
+    }
+  }
+
+  // Lines of "major:minor key=value...", one per device.
+  std::istringstream io_stat(ReadActionCgroupFile("io.stat"));
+  while (io_stat >> field) {
+    if (field.compare(0, 7, "rbytes=") == 0) {
+      stats->set_io_read_bytes(stats->io_read_bytes() +
+                               strtoll(field.c_str() + 7, nullptr, 10));
+    } else if (field.compare(0, 7, "wbytes=") == 0) {
+      stats->set_io_write_bytes(stats->io_write_bytes() +
+                                strtoll(field.c_str() + 7, nullptr, 10));
+    }
+  }
+
+  // Lines of "some|full avg10=... avg60=... avg300=... total=...".
+  std::istringstream memory_pressure(ReadActionCgroupFile("memory.pressure"));
+  std::string line;
+  while (std::getline(memory_pressure, line)) {
+    std::istringstream fields(line);
+    fields >> key;
+    while (fields >> field) {
+      if (field.compare(0, 6, "total=") != 0) {
+        continue;
+      }
+      value = strtoll(field.c_str() + 6, nullptr, 10);
+      if (key == "some") {
+        stats->set_memory_pressure_some_usec(value);
+      } else if (key == "full") {
+        stats->set_memory_pressure_full_usec(value);
+      }
+    }
+  }
+}
+
+static void RemoveActionCgroup() {
+  // All processes of the command are gone once linux-sandbox-pid1 has exited,
+  // but an outer reaper may have taken over before that. Kill whatever is
+  // left at once and wait for the cgroup to be empty, which rmdir needs.
+  if (KillCgroup(global_action_cgroup.c_str()) &&
+      !WaitForCgroupToEmpty(global_action_cgroup)) {
+    PRINT_DEBUG("Cannot wait for cgroup %s to empty",
+                global_action_cgroup.c_str());
+  }
+  if (rmdir(global_action_cgroup.c_str()) < 0) {
+    PRINT_DEBUG("rmdir(%s) failed: %s", global_action_cgroup.c_str(),
+                strerror(errno));
+  }
+}
+
 static void OnTimeoutOrTerm(int) {
   // Find the PID of the child, which main set up before installing us as a
   // signal handler.
@@ -146,6 +323,12 @@ static void OnTimeoutOrTerm(int) {
   // If we're not supposed to ask politely, simply forcibly kill the child.
   if (!need_polite_sigterm) {
     kill(child_pid, SIGKILL);
+    // The processes of the command that escaped the PID namespace, if any,
+    // are still in its cgroup. The string is not modified once we are
+    // installed.
+    if (!global_action_cgroup.empty()) {
+      KillCgroup(global_action_cgroup.c_str());
+    }
     return;
   }
 
@@ -158,7 +341,7 @@ static void OnTimeoutOrTerm(int) {
   alarm(opt.kill_delay_secs);
 }
 
-static pid_t SpawnPid1() {
+static pid_t SpawnPid1(int *server_sockets) {
   const int kStackSize = 1024 * 1024;
   std::vector<char> child_stack(kStackSize);
 
@@ -190,6 +373,8 @@ static pid_t SpawnPid1() {
   Pid1Args pid1Args;
   pid1Args.pipe_to_parent = pipe_from_child;
   pid1Args.pipe_from_parent = pipe_to_child;
+  pid1Args.server_sockets = server_sockets;
+  pid1Args.accessed_inputs_fd = global_accessed_inputs_fd;
   const pid_t child_pid = clone(Pid1Main, child_stack.data() + kStackSize,
                                 clone_flags, &pid1Args);
 
@@ -214,6 +399,182 @@ static pid_t SpawnPid1() {
   return child_pid;
 }
 
+// Runs the command of a request in linux-sandbox-pid1, opening its output
+// files on this side of the sandbox. Returns its exit code.
+static int RunRequest(int server_socket, const std::string &request) {
+  const pid_t pid = fork();
+  if (pid < 0) {
+    DIE("fork");
+  } else if (pid == 0) {
+    ParseRequest(request);
+    // Our stdout is the one we reply on.
+    if (opt.stdout_path.empty()) {
+      if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        DIE("dup2");
+      }
+    } else {
+      Redirect(opt.stdout_path, STDOUT_FILENO);
+    }
+    Redirect(opt.stderr_path, STDERR_FILENO);
+
+    RequestHeader header = {request.size()};
+    struct iovec iov = {&header, sizeof(header)};
+    int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    ssize_t sent;
+    while ((sent = sendmsg(server_socket, &msg, 0)) < 0 && errno == EINTR) {
+    }
+    if (sent != sizeof(header)) {
+      DIE("sendmsg");
+    }
+    WriteFully(server_socket, request.data(), request.size());
+
+    RequestResult result;
+    if (!ReadFully(server_socket, &result, sizeof(result))) {
+      errno = EPIPE;
+      DIE("read");
+    }
+    if (!opt.stats_path.empty()) {
+      WriteStatsToFile(&result.rusage, opt.stats_path);
+    }
+    // Not exit(), which would flush the stdio buffers we share with the
+    // server loop.
+    _exit(result.exit_code);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      DIE("waitpid");
+    }
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WEXITSTATUS(status);
+}
+
+// Reads requests from stdin until its end, and replies to each with the exit
+// code of its command on stdout. Reads with read(2) rather than through stdio,
+// whose buffered input the forked RunRequest children would otherwise share:
+// when stdin is a regular file, a child exiting through exit() seeks it back
+// to the position of the parent's last request.
+static void ServeRequests(int server_socket) {
+  std::string input;
+  std::string request;
+  char buf[4096];
+  ssize_t count;
+  while ((count = read(STDIN_FILENO, buf, sizeof(buf))) != 0) {
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("read");
+    }
+    input.append(buf, count);
+
+    size_t start = 0;
+    size_t end;
+    while ((end = input.find('\n', start)) != std::string::npos) {
+      if (end > start) {
+        request.append(input, start, end - start + 1);
+      } else if (!request.empty()) {
+        printf("%d\n", RunRequest(server_socket, request));
+        fflush(stdout);
+        request.clear();
+      }
+      start = end + 1;
+    }
+    input.erase(0, start);
+  }
+}
+
+// Writes the inputs that the command accessed to the -A file. The list comes
+// from linux-sandbox-pid1, which seals the memfd once it is complete; if it
+// is not, as the accesses could not be traced or linux-sandbox-pid1 did not
+// get to the end, we must assume that the command accessed all inputs.
+static void WriteAccessedInputs() {
+  std::string contents;
+  const int seals = fcntl(global_accessed_inputs_fd, F_GET_SEALS);
+  if (seals >= 0 && (seals & F_SEAL_WRITE) != 0) {
+    char buf[4096];
+    ssize_t n;
+    off_t offset = 0;
+    while ((n = pread(global_accessed_inputs_fd, buf, sizeof(buf), offset)) !=
+           0) {
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        DIE("pread");
+      }
+      contents.append(buf, n);
+      offset += n;
+    }
+  } else {
+    std::set<std::string> inputs(opt.bind_mount_targets.begin(),
+                                 opt.bind_mount_targets.end());
+    for (const std::string &input : inputs) {
+      contents.append(input).push_back('\n');
+    }
+  }
+
+  const int fd = open(opt.accessed_inputs_path.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    DIE("open(%s)", opt.accessed_inputs_path.c_str());
+  }
+  WriteFully(fd, contents.data(), contents.size());
+  if (close(fd) < 0) {
+    DIE("close");
+  }
+}
+
+// Writes the statistics of the exited child, cleans up after it and returns
+// the exit code we should exit with.
+static int ReportPid1Exit(const int child_status,
+                          struct rusage &child_rusage) {
+  StopSamplingResources();
+
+  // If we're supposed to write stats to a file, do so now.
+  if (!opt.stats_path.empty()) {
+    std::unique_ptr<tools::protos::ExecutionStatistics> stats =
+        CreateExecutionStatisticsProto(&child_rusage);
+    if (!global_action_cgroup.empty()) {
+      GetActionCgroupStatistics(stats->mutable_cgroup_statistics());
+    }
+    WriteStatsToFile(*stats, opt.stats_path);
+  }
+  if (global_accessed_inputs_fd >= 0) {
+    WriteAccessedInputs();
+  }
+  if (!global_action_cgroup.empty()) {
+    RemoveActionCgroup();
+  }
+  WriteCapturedOutputs();
+
+  // We want to exit in the same manner as the child.
+  if (WIFSIGNALED(child_status)) {
+    const int signal = WTERMSIG(child_status);
+    PRINT_DEBUG("child exited due to receiving signal: %s", strsignal(signal));
+    return 128 + signal;
+  }
+
+  const int exit_code = WEXITSTATUS(child_status);
+  PRINT_DEBUG("child exited normally with code %d", exit_code);
+  return exit_code;
+}
+
 static int WaitForPid1(const pid_t child_pid) {
   // Wait for the child to exit, obtaining usage information. Restart in the
   // case of a signal interrupting us.
@@ -237,21 +598,7 @@ static int WaitForPid1(const pid_t child_pid) {
     DIE("wait4");
   }
 
-  // If we're supposed to write stats to a file, do so now.
-  if (!opt.stats_path.empty()) {
-    WriteStatsToFile(&child_rusage, opt.stats_path);
-  }
-
-  // We want to exit in the same manner as the child.
-  if (WIFSIGNALED(child_status)) {
-    const int signal = WTERMSIG(child_status);
-    PRINT_DEBUG("child exited due to receiving signal: %s", strsignal(signal));
-    return 128 + signal;
-  }
-
-  const int exit_code = WEXITSTATUS(child_status);
-  PRINT_DEBUG("child exited normally with code %d", exit_code);
-  return exit_code;
+  return ReportPid1Exit(child_status, child_rusage);
 }
 
 int main(int argc, char *argv[]) {
@@ -291,8 +638,17 @@ int main(int argc, char *argv[]) {
   }
 
   // Redirect output as requested.
-  Redirect(opt.stdout_path, STDOUT_FILENO);
-  Redirect(opt.stderr_path, STDERR_FILENO);
+  if (opt.lazy_outputs) {
+    RedirectLazily(opt.stdout_path, STDOUT_FILENO);
+    RedirectLazily(opt.stderr_path, STDERR_FILENO);
+  } else {
+    Redirect(opt.stdout_path, STDOUT_FILENO);
+    Redirect(opt.stderr_path, STDERR_FILENO);
+  }
+
+  if (!opt.netns_path.empty()) {
+    JoinNetworkNamespace();
+  }
 
   // Set up two globals used by the child process.
   global_outer_uid = getuid();
@@ -302,9 +658,61 @@ int main(int argc, char *argv[]) {
   // stdin, stdout, stderr and global_debug.
   CloseFds();
 
+  if (!opt.cgroup_parent.empty()) {
+    CreateActionCgroup();
+  }
+
+  if (!opt.accessed_inputs_path.empty()) {
+    global_accessed_inputs_fd = memfd_create(
+        "accessed_inputs", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (global_accessed_inputs_fd < 0) {
+      DIE("memfd_create");
+    }
+  }
+
+  int server_sockets[2] = {-1, -1};
+  if (opt.server_mode &&
+      socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, server_sockets) < 0) {
+    DIE("socketpair");
+  }
+
+  // Where possible, supervise linux-sandbox-pid1 through a pidfd instead of
+  // signal handlers and alarm(2). The signals we forward are blocked before
+  // spawning it, so none of them can get lost in between.
+  const bool supervise_pid1 = !opt.persistent_process && !opt.server_mode &&
+                              CanSuperviseChildren();
+  std::vector<int> terminating_signals = {SIGTERM};
+  if (opt.sigint_sends_sigterm) {
+    terminating_signals.push_back(SIGINT);
+  }
+  sigset_t terminating_sset;
+  sigemptyset(&terminating_sset);
+  for (int signum : terminating_signals) {
+    sigaddset(&terminating_sset, signum);
+  }
+  if (supervise_pid1 &&
+      sigprocmask(SIG_BLOCK, &terminating_sset, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+
   // Spawn the child that will fork the sandboxed program with fresh
   // namespaces etc.
-  const pid_t child_pid = SpawnPid1();
+  const pid_t child_pid = SpawnPid1(server_sockets);
+
+  if (!opt.resource_samples_path.empty()) {
+    StartSamplingResources(child_pid, global_action_cgroup,
+                           opt.sample_interval_secs,
+                           opt.resource_samples_path);
+  }
+
+  if (supervise_pid1) {
+    std::vector<SupervisedChild> children(1);
+    children[0].pid = child_pid;
+    children[0].timeout_secs = opt.timeout_secs;
+    children[0].kill_delay_secs = opt.kill_delay_secs;
+    SuperviseChildren(&children, terminating_signals);
+    return ReportPid1Exit(children[0].status, children[0].rusage);
+  }
 
   // Let the signal handlers installed below know the PID of the child.
   global_child_pid.store(child_pid, std::memory_order_relaxed);
@@ -337,6 +745,17 @@ int main(int argc, char *argv[]) {
     InstallSignalHandler(SIGINT, OnTimeoutOrTerm);
   }
 
+  if (opt.server_mode) {
+    if (close(server_sockets[1]) < 0) {
+      DIE("close");
+    }
+    ServeRequests(server_sockets[0]);
+    // Let linux-sandbox-pid1 know that there are no more requests.
+    if (close(server_sockets[0]) < 0) {
+      DIE("close");
+    }
+  }
+
   // Wait for the child to exit, returning an appropriate status.
   return WaitForPid1(child_pid);
 }
@@ -14,13 +14,23 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#if defined(__APPLE__)
+#include <libproc.h>
+#include <mach/mach_time.h>
+#endif
+#include <math.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/event.h>
+#include <sys/resource.h>
 #include <sys/sysctl.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
@@ -61,6 +71,75 @@ retry:
   return close(kq);
 }
 
+// Waits for the given processes to exit, in a single kqueue. Processes that
+// are gone already are skipped. Returns -1 on error.
+int WaitForProcessesToTerminate(const std::vector<pid_t> &pids) {
+  int kq;
+  if ((kq = kqueue()) == -1) {
+    return -1;
+  }
+  int watched = 0;
+  for (pid_t pid : pids) {
+    struct kevent kc;
+    EV_SET(&kc, pid, EVFILT_PROC, EV_ADD | EV_ENABLE | EV_ONESHOT, NOTE_EXIT,
+           0, 0);
+    if (kevent(kq, &kc, 1, nullptr, 0, nullptr) == 0) {
+      watched++;
+    } else if (errno != ESRCH) {
+      close(kq);
+      return -1;
+    }
+  }
+  for (int exited = 0; exited < watched;) {
+    struct kevent events[16];
+    int nev = kevent(kq, nullptr, 0, events, 16, nullptr);
+    if (nev == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      close(kq);
+      return -1;
+    }
+    exited += nev;
+  }
+  return close(kq);
+}
+
+// Returns the milliseconds to pass to EVFILT_TIMER for the given delay.
+intptr_t TimerMillis(double secs) {
+  return static_cast<intptr_t>(ceil(secs * 1000));
+}
+
+void ArmTimer(int kq, size_t index, double secs) {
+  struct kevent kc;
+  EV_SET(&kc, index, EVFILT_TIMER, EV_ADD | EV_ENABLE | EV_ONESHOT, 0,
+         TimerMillis(secs), 0);
+  if (kevent(kq, &kc, 1, nullptr, 0, nullptr) == -1) {
+    DIE("kevent(EVFILT_TIMER)");
+  }
+}
+
+struct ChildState {
+  bool running;
+  bool sent_sigterm;
+};
+
+// Sends SIGTERM to the child if it has a kill delay, and SIGKILL if not or if
+// it already got SIGTERM.
+void TerminateChild(int kq, size_t index, const SupervisedChild &child,
+                    ChildState *state) {
+  int signum = SIGKILL;
+  if (child.kill_delay_secs > 0 && !state->sent_sigterm) {
+    state->sent_sigterm = true;
+    signum = SIGTERM;
+    ArmTimer(kq, index, child.kill_delay_secs);
+  }
+  PRINT_DEBUG("sending signal %d to PID %d", signum, child.pid);
+  if (kill(child.pid, signum) < 0 && errno != ESRCH) {
+    DIE("kill");
+  }
+}
+
 }  // namespace
 
 int WaitForProcessToTerminate(pid_t pid) {
@@ -115,6 +194,18 @@ int WaitForProcessGroupToTerminate(pid_t pgid) {
       free(procs);
       return 0;
     }
+
+    std::vector<pid_t> others;
+    for (size_t i = 0; i < nprocs; i++) {
+#if defined(__OpenBSD__)
+      pid_t pid = procs[i].p_pid;
+#else
+      pid_t pid = procs[i].kp_proc.p_pid;
+#endif
+      if (pid != pgid) {
+        others.push_back(pid);
+      }
+    }
     free(procs);
 
     // More than one process left in the process group.  Kill the group
@@ -122,7 +213,14 @@ int WaitForProcessGroupToTerminate(pid_t pgid) {
     // would not allow us to complete quickly.
     kill(-pgid, SIGKILL);
 
-    // And pause a little bit before retrying to avoid burning CPU.
+    // Wait for all of them at once rather than polling the group until they
+    // are gone.
+    if (WaitForProcessesToTerminate(others) == -1) {
+      return -1;
+    }
+
+    // They may still be listed until they are reaped, so pause a little bit
+    // before retrying to avoid burning CPU.
     struct timespec ts;
     ts.tv_sec = 0;
     ts.tv_nsec = 1000000;
@@ -131,3 +229,171 @@ int WaitForProcessGroupToTerminate(pid_t pgid) {
     }
   }
 }
+
+bool GetDarwinResourceUsage(pid_t pid,
+                            tools::protos::DarwinResourceUsage *usage) {
+#if defined(__APPLE__)
+  struct rusage_info_v4 info;
+  if (proc_pid_rusage(pid, RUSAGE_INFO_V4,
+                      reinterpret_cast<rusage_info_t *>(&info)) != 0) {
+    return false;
+  }
+  usage->set_lifetime_max_phys_footprint_bytes(
+      info.ri_lifetime_max_phys_footprint);
+  usage->set_diskio_bytes_read(info.ri_diskio_bytesread);
+  usage->set_diskio_bytes_written(info.ri_diskio_byteswritten);
+  usage->set_logical_writes_bytes(info.ri_logical_writes);
+  usage->set_pageins(info.ri_pageins);
+  usage->set_instructions(info.ri_instructions);
+  usage->set_cycles(info.ri_cycles);
+  usage->set_billed_energy_nj(info.ri_billed_energy);
+  usage->set_serviced_energy_nj(info.ri_serviced_energy);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Only covers the process itself, not its descendants.
+bool SampleResources(pid_t pid, const std::string &cgroup,
+                     tools::protos::ResourceSample *sample) {
+#if defined(__APPLE__)
+  struct rusage_info_v4 info;
+  if (proc_pid_rusage(pid, RUSAGE_INFO_V4,
+                      reinterpret_cast<rusage_info_t *>(&info)) != 0) {
+    return false;
+  }
+  // The CPU times are in Mach absolute time units.
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0) {
+    mach_timebase_info(&timebase);
+  }
+  sample->set_process_count(1);
+  sample->set_rss_bytes(info.ri_resident_size);
+  sample->set_pss_bytes(info.ri_phys_footprint);
+  sample->set_cpu_user_usec(info.ri_user_time * timebase.numer /
+                            timebase.denom / 1000);
+  sample->set_cpu_system_usec(info.ri_system_time * timebase.numer /
+                              timebase.denom / 1000);
+  sample->set_io_read_bytes(info.ri_diskio_bytesread);
+  sample->set_io_write_bytes(info.ri_diskio_byteswritten);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Neither macOS nor OpenBSD lets a process be pinned to CPUs.
+bool SetCpuAffinity(const std::vector<int> &cpus, int mem_node) {
+  errno = ENOSYS;
+  return false;
+}
+
+int CreateMemoryFile(const char *name) { return -1; }
+
+// Darwin has no cgroups.
+bool KillCgroup(const char *cgroup) { return false; }
+
+bool WaitForCgroupToEmpty(const std::string &cgroup) { return false; }
+
+bool CanSuperviseChildren() { return true; }
+
+void SuperviseChildren(std::vector<SupervisedChild> *children,
+                       const std::vector<int> &terminating_signals) {
+  int kq = kqueue();
+  if (kq == -1) {
+    DIE("kqueue");
+  }
+
+  // EVFILT_SIGNAL records signals even if they are ignored, so ignoring them
+  // for the duration of the call leaves the kqueue as the only thing that
+  // handles them.
+  std::vector<struct sigaction> old_actions(terminating_signals.size());
+  for (size_t i = 0; i < terminating_signals.size(); i++) {
+    struct kevent kc;
+    EV_SET(&kc, terminating_signals[i], EVFILT_SIGNAL, EV_ADD | EV_ENABLE, 0,
+           0, 0);
+    if (kevent(kq, &kc, 1, nullptr, 0, nullptr) == -1) {
+      DIE("kevent(EVFILT_SIGNAL)");
+    }
+    struct sigaction sa = {};
+    sa.sa_handler = SIG_IGN;
+    if (sigaction(terminating_signals[i], &sa, &old_actions[i]) < 0) {
+      DIE("sigaction");
+    }
+  }
+
+  std::vector<ChildState> states(children->size(), ChildState{true, false});
+  for (size_t i = 0; i < children->size(); i++) {
+    SupervisedChild &child = (*children)[i];
+    child.timed_out = false;
+    // Registering reports the exit of a child that is gone already, so this
+    // does not race with it.
+    struct kevent kc;
+    EV_SET(&kc, child.pid, EVFILT_PROC, EV_ADD | EV_ENABLE | EV_ONESHOT,
+           NOTE_EXIT, 0, reinterpret_cast<void *>(i));
+    if (kevent(kq, &kc, 1, nullptr, 0, nullptr) == -1) {
+      DIE("kevent(EVFILT_PROC, %d)", child.pid);
+    }
+    if (child.timeout_secs > 0) {
+      ArmTimer(kq, i, child.timeout_secs);
+    }
+  }
+
+  size_t remaining = children->size();
+  while (remaining > 0) {
+    struct kevent events[16];
+    int n = kevent(kq, nullptr, 0, events, 16, nullptr);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("kevent");
+    }
+
+    for (int e = 0; e < n; e++) {
+      switch (events[e].filter) {
+        case EVFILT_SIGNAL:
+          PRINT_DEBUG("received signal %d", static_cast<int>(events[e].ident));
+          for (size_t i = 0; i < children->size(); i++) {
+            if (states[i].running) {
+              TerminateChild(kq, i, (*children)[i], &states[i]);
+            }
+          }
+          break;
+        case EVFILT_TIMER: {
+          const size_t index = events[e].ident;
+          if (!states[index].running) {
+            break;
+          }
+          (*children)[index].timed_out = true;
+          TerminateChild(kq, index, (*children)[index], &states[index]);
+          break;
+        }
+        case EVFILT_PROC: {
+          const size_t index = reinterpret_cast<size_t>(events[e].udata);
+          SupervisedChild &child = (*children)[index];
+          // NOTE_EXIT may be reported slightly before the child can be
+          // reaped, hence the blocking wait.
+          while (wait4(child.pid, &child.status, 0, &child.rusage) == -1) {
+            if (errno != EINTR) {
+              DIE("wait4(%d)", child.pid);
+            }
+          }
+          PRINT_DEBUG("PID %d exited with status 0x%02x", child.pid,
+                      child.status);
+          states[index].running = false;
+          remaining--;
+          break;
+        }
+      }
+    }
+  }
+
+  close(kq);
+  for (size_t i = 0; i < terminating_signals.size(); i++) {
+    if (sigaction(terminating_signals[i], &old_actions[i], nullptr) < 0) {
+      DIE("sigaction");
+    }
+  }
+}
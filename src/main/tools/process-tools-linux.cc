@@ -12,15 +12,47 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/mempolicy.h>
+#include <math.h>
+#include <poll.h>
+#include <sched.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 
+// The C library may predate the kernel, so we make these system calls
+// ourselves.
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+
 int TerminateAndWaitForAll(pid_t pid) {
   kill(-pid, SIGKILL);
 
@@ -53,3 +85,365 @@ int TerminateAndWaitForAll(pid_t pid) {
 
   return 0;
 }
+
+int CreateMemoryFile(const char *name) {
+  return memfd_create(name, MFD_CLOEXEC);
+}
+
+bool KillCgroup(const char *cgroup) {
+  // Only async-signal-safe calls: this runs in signal handlers.
+  static const char kKillFile[] = "/cgroup.kill";
+  char path[PATH_MAX];
+  size_t length = strlen(cgroup);
+  if (length == 0 || length + sizeof(kKillFile) > sizeof(path)) {
+    return false;
+  }
+  memcpy(path, cgroup, length);
+  memcpy(path + length, kKillFile, sizeof(kKillFile));
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  bool killed = write(fd, "1", 1) == 1;
+  close(fd);
+  return killed;
+}
+
+bool WaitForCgroupToEmpty(const std::string &cgroup) {
+  int fd = open((cgroup + "/cgroup.events").c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  // The file is rewritten with a POLLPRI notification whenever "populated"
+  // changes. We time the poll out anyway in case the change happens between
+  // reading the file and polling it.
+  bool empty = false;
+  char events[256];
+  ssize_t n;
+  while ((n = pread(fd, events, sizeof(events) - 1, 0)) > 0) {
+    events[n] = '\0';
+    if (strstr(events, "populated 0") != nullptr) {
+      empty = true;
+      break;
+    }
+    struct pollfd pfd = {fd, POLLPRI, 0};
+    if (poll(&pfd, 1, 100) < 0 && errno != EINTR) {
+      break;
+    }
+  }
+  close(fd);
+  return empty;
+}
+
+namespace {
+
+// Appends pid and the PIDs of all its descendants to pids, as far as they can
+// be found in /proc.
+void CollectProcessTree(pid_t pid, std::vector<pid_t> *pids) {
+  pids->push_back(pid);
+  const std::string task_dir = "/proc/" + std::to_string(pid) + "/task";
+  DIR *dir = opendir(task_dir.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    std::ifstream children(task_dir + "/" + entry->d_name + "/children");
+    pid_t child;
+    while (children >> child) {
+      CollectProcessTree(child, pids);
+    }
+  }
+  closedir(dir);
+}
+
+// For each line of a file in /proc that starts with one of the keys, adds the
+// number that follows the key to the counter of the key.
+void AddProcValues(const std::string &path,
+                   const std::vector<std::pair<std::string, int64_t *>> &keys) {
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string key;
+    int64_t value;
+    if (!(fields >> key >> value)) {
+      continue;
+    }
+    for (const auto &k : keys) {
+      if (k.first == key) {
+        *k.second += value;
+      }
+    }
+  }
+}
+
+// Adds the CPU time of the process pid and of the children it reaped to
+// user_usec and system_usec. Returns false if the process is gone.
+bool AddProcessCpuTime(pid_t pid, int64_t *user_usec, int64_t *system_usec) {
+  std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+  std::string stat;
+  if (!std::getline(file, stat)) {
+    return false;
+  }
+  // The command name in parentheses may contain anything, so start after it,
+  // at the state in the third field.
+  const size_t end_of_comm = stat.rfind(')');
+  if (end_of_comm == std::string::npos) {
+    return false;
+  }
+  std::istringstream fields(stat.substr(end_of_comm + 1));
+  std::string field;
+  for (int i = 3; i < 14; i++) {
+    fields >> field;
+  }
+  int64_t utime, stime, cutime, cstime;
+  if (!(fields >> utime >> stime >> cutime >> cstime)) {
+    return false;
+  }
+  static const int64_t ticks_per_sec = sysconf(_SC_CLK_TCK);
+  *user_usec += (utime + cutime) * 1000000 / ticks_per_sec;
+  *system_usec += (stime + cstime) * 1000000 / ticks_per_sec;
+  return true;
+}
+
+// What an epoll event of SuperviseChildren is about; the index of the child
+// goes in the upper half of the event data.
+enum SupervisorEvent : uint32_t { kChildExited, kChildTimer, kSignal };
+
+struct ChildFds {
+  int pidfd;
+  int timerfd;
+  bool sent_sigterm;
+};
+
+int PidfdOpen(pid_t pid) { return syscall(SYS_pidfd_open, pid, 0); }
+
+void AddToEpoll(int epfd, int fd, SupervisorEvent event, size_t index) {
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = (static_cast<uint64_t>(index) << 32) | event;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    DIE("epoll_ctl");
+  }
+}
+
+void ArmTimer(int timerfd, double secs) {
+  double int_val;
+  double fraction_val = modf(secs, &int_val);
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = static_cast<time_t>(int_val);
+  spec.it_value.tv_nsec = static_cast<long>(fraction_val * 1e9);
+  if (timerfd_settime(timerfd, 0, &spec, nullptr) < 0) {
+    DIE("timerfd_settime");
+  }
+}
+
+// Sends SIGTERM to the child if it has a kill delay, and SIGKILL if not or if
+// it already got SIGTERM.
+void TerminateChild(const SupervisedChild &child, ChildFds *fds) {
+  int signum = SIGKILL;
+  if (child.kill_delay_secs > 0 && !fds->sent_sigterm) {
+    fds->sent_sigterm = true;
+    signum = SIGTERM;
+    ArmTimer(fds->timerfd, child.kill_delay_secs);
+  }
+  PRINT_DEBUG("sending signal %d to PID %d", signum, child.pid);
+  if (syscall(SYS_pidfd_send_signal, fds->pidfd, signum, nullptr, 0) < 0 &&
+      errno != ESRCH) {
+    DIE("pidfd_send_signal");
+  }
+}
+
+}  // namespace
+
+bool SampleResources(pid_t pid, const std::string &cgroup,
+                     tools::protos::ResourceSample *sample) {
+  std::vector<pid_t> pids;
+  CollectProcessTree(pid, &pids);
+
+  int64_t rss_kb = 0, pss_kb = 0, user_usec = 0, system_usec = 0;
+  int64_t read_bytes = 0, write_bytes = 0;
+  int process_count = 0;
+  for (pid_t p : pids) {
+    if (!AddProcessCpuTime(p, &user_usec, &system_usec)) {
+      continue;
+    }
+    process_count++;
+    const std::string proc_dir = "/proc/" + std::to_string(p);
+    AddProcValues(proc_dir + "/smaps_rollup",
+                  {{"Rss:", &rss_kb}, {"Pss:", &pss_kb}});
+    AddProcValues(proc_dir + "/io",
+                  {{"read_bytes:", &read_bytes}, {"write_bytes:", &write_bytes}});
+  }
+  if (process_count == 0) {
+    return false;
+  }
+  sample->set_process_count(process_count);
+  sample->set_rss_bytes(rss_kb * 1024);
+  sample->set_pss_bytes(pss_kb * 1024);
+  sample->set_cpu_user_usec(user_usec);
+  sample->set_cpu_system_usec(system_usec);
+  sample->set_io_read_bytes(read_bytes);
+  sample->set_io_write_bytes(write_bytes);
+
+  if (!cgroup.empty()) {
+    std::ifstream memory_current(cgroup + "/memory.current");
+    int64_t bytes;
+    if (memory_current >> bytes) {
+      sample->set_cgroup_memory_bytes(bytes);
+    }
+  }
+  return true;
+}
+
+bool CanSuperviseChildren() {
+  int pidfd = PidfdOpen(getpid());
+  if (pidfd < 0) {
+    return false;
+  }
+  close(pidfd);
+  return true;
+}
+
+void SuperviseChildren(std::vector<SupervisedChild> *children,
+                       const std::vector<int> &terminating_signals) {
+  sigset_t signals, old_signals;
+  sigemptyset(&signals);
+  for (int signum : terminating_signals) {
+    sigaddset(&signals, signum);
+  }
+  if (sigprocmask(SIG_BLOCK, &signals, &old_signals) < 0) {
+    DIE("sigprocmask");
+  }
+
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    DIE("epoll_create1");
+  }
+  int sigfd = signalfd(-1, &signals, SFD_CLOEXEC);
+  if (sigfd < 0) {
+    DIE("signalfd");
+  }
+  AddToEpoll(epfd, sigfd, kSignal, 0);
+
+  std::vector<ChildFds> fds(children->size());
+  for (size_t i = 0; i < children->size(); i++) {
+    SupervisedChild &child = (*children)[i];
+    fds[i].pidfd = PidfdOpen(child.pid);
+    if (fds[i].pidfd < 0) {
+      DIE("pidfd_open(%d)", child.pid);
+    }
+    fds[i].timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (fds[i].timerfd < 0) {
+      DIE("timerfd_create");
+    }
+    fds[i].sent_sigterm = false;
+    child.timed_out = false;
+    AddToEpoll(epfd, fds[i].pidfd, kChildExited, i);
+    AddToEpoll(epfd, fds[i].timerfd, kChildTimer, i);
+    if (child.timeout_secs > 0) {
+      ArmTimer(fds[i].timerfd, child.timeout_secs);
+    }
+  }
+
+  size_t running = children->size();
+  while (running > 0) {
+    struct epoll_event events[16];
+    int n = epoll_wait(epfd, events, 16, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("epoll_wait");
+    }
+
+    for (int e = 0; e < n; e++) {
+      const size_t index = events[e].data.u64 >> 32;
+      switch (static_cast<SupervisorEvent>(events[e].data.u64 & 0xffffffff)) {
+        case kSignal: {
+          struct signalfd_siginfo info;
+          if (read(sigfd, &info, sizeof(info)) != sizeof(info)) {
+            DIE("read(signalfd)");
+          }
+          PRINT_DEBUG("received signal %d", info.ssi_signo);
+          for (size_t i = 0; i < children->size(); i++) {
+            if (fds[i].pidfd >= 0) {
+              TerminateChild((*children)[i], &fds[i]);
+            }
+          }
+          break;
+        }
+        case kChildTimer: {
+          uint64_t expirations;
+          if (fds[index].pidfd < 0 ||
+              read(fds[index].timerfd, &expirations, sizeof(expirations)) !=
+                  sizeof(expirations)) {
+            break;
+          }
+          (*children)[index].timed_out = true;
+          TerminateChild((*children)[index], &fds[index]);
+          break;
+        }
+        case kChildExited: {
+          SupervisedChild &child = (*children)[index];
+          if (fds[index].pidfd < 0) {
+            break;
+          }
+          if (wait4(child.pid, &child.status, WNOHANG, &child.rusage) !=
+              child.pid) {
+            DIE("wait4(%d)", child.pid);
+          }
+          PRINT_DEBUG("PID %d exited with status 0x%02x", child.pid,
+                      child.status);
+          close(fds[index].pidfd);
+          close(fds[index].timerfd);
+          fds[index].pidfd = -1;
+          running--;
+          break;
+        }
+      }
+    }
+  }
+
+  close(sigfd);
+  close(epfd);
+  if (sigprocmask(SIG_SETMASK, &old_signals, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
+}
+
+bool SetCpuAffinity(const std::vector<int> &cpus, int mem_node) {
+  if (!cpus.empty()) {
+    const int max_cpu = *std::max_element(cpus.begin(), cpus.end());
+    cpu_set_t *set = CPU_ALLOC(max_cpu + 1);
+    if (set == nullptr) {
+      return false;
+    }
+    const size_t size = CPU_ALLOC_SIZE(max_cpu + 1);
+    CPU_ZERO_S(size, set);
+    for (int cpu : cpus) {
+      CPU_SET_S(cpu, size, set);
+    }
+    const int result = sched_setaffinity(0, size, set);
+    CPU_FREE(set);
+    if (result < 0) {
+      return false;
+    }
+  }
+  if (mem_node >= 0) {
+    // Through the system call rather than libnuma, which we don't link. The
+    // kernel reads one bit less than the given number of them.
+    const int kBitsPerLong = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> nodes(mem_node / kBitsPerLong + 1);
+    nodes[mem_node / kBitsPerLong] |= 1UL << (mem_node % kBitsPerLong);
+    if (syscall(SYS_set_mempolicy, MPOL_BIND, nodes.data(),
+                nodes.size() * kBitsPerLong + 1) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -14,11 +14,14 @@
 
 #include "src/main/tools/process-tools.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,12 +32,19 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "src/main/protobuf/execution_statistics.pb.h"
 #include "src/main/tools/logging.h"
 
 static volatile sig_atomic_t child_pid_for_signal = 0;
+static const char *volatile child_cgroup_for_signal = nullptr;
 
 int SwitchToEuid() {
   int uid = getuid();
@@ -83,14 +93,111 @@ void Redirect(const std::string &target_path, int fd) {
   }
 }
 
+// An output captured by RedirectLazily. The file in memory is only open as
+// fd, so that closing the other file descriptors does not lose it.
+struct CapturedOutput {
+  std::string path;
+  int fd;
+};
+
+static std::vector<CapturedOutput> captured_outputs;
+static pid_t capturing_pid = 0;
+
+void RedirectLazily(const std::string &target_path, int fd) {
+  if (target_path.empty() || target_path == "-") {
+    return;
+  }
+  int memory_fd = CreateMemoryFile(fd == STDERR_FILENO ? "stderr" : "stdout");
+  if (memory_fd < 0) {
+    Redirect(target_path, fd);
+    return;
+  }
+  if (memory_fd < 3) {
+    DIE("memfd_create returned a handle that is reserved for stdin / stdout / "
+        "stderr");
+  }
+  if (dup2(memory_fd, fd) < 0) {
+    DIE("dup2");
+  }
+  if (close(memory_fd) < 0) {
+    DIE("close");
+  }
+  if (capturing_pid == 0) {
+    capturing_pid = getpid();
+    atexit(WriteCapturedOutputs);
+  }
+  captured_outputs.push_back({target_path, fd});
+}
+
+void WriteCapturedOutputs() {
+  // Children forked after RedirectLazily share the files in memory, but they
+  // are not the ones to write them out.
+  if (getpid() != capturing_pid) {
+    return;
+  }
+  for (const CapturedOutput &output : captured_outputs) {
+    struct stat st;
+    if (fstat(output.fd, &st) < 0) {
+      st.st_size = 0;
+    }
+    // Like Redirect, a file left over from before is truncated even if there
+    // is nothing to write.
+    int flags = O_WRONLY | O_TRUNC | O_APPEND;
+    if (st.st_size > 0) {
+      flags |= O_CREAT;
+    }
+    int fd_out = open(output.path.c_str(), flags, 0666);
+    if (fd_out < 0) {
+      if (errno != ENOENT) {
+        fprintf(stderr, "open(%s): %s\n", output.path.c_str(),
+                strerror(errno));
+      }
+      continue;
+    }
+    char buffer[64 * 1024];
+    off_t offset = 0;
+    while (offset < st.st_size) {
+      ssize_t n = pread(output.fd, buffer, sizeof(buffer), offset);
+      if (n <= 0) {
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        break;
+      }
+      ssize_t written = 0;
+      while (written < n) {
+        ssize_t w = write(fd_out, buffer + written, n - written);
+        if (w < 0 && errno != EINTR) {
+          break;
+        }
+        written += w > 0 ? w : 0;
+      }
+      if (written < n) {
+        fprintf(stderr, "write(%s): %s\n", output.path.c_str(),
+                strerror(errno));
+        break;
+      }
+      offset += n;
+    }
+    // Anything written from now on goes to the file directly.
+    dup2(fd_out, output.fd);
+    close(fd_out);
+  }
+  captured_outputs.clear();
+}
+
 static void ForciblyKillEverything(int signo) {
   // We don't update the last_signal field tracked in process-wrapper-legacy.cc,
   // which is used to report the signal back to the user, because we want to
   // know (from the caller side) the original signal that caused us to stop.
   kill(-child_pid_for_signal, SIGKILL);
+  if (child_cgroup_for_signal != nullptr) {
+    KillCgroup(child_cgroup_for_signal);
+  }
 }
 
-void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay) {
+void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay,
+                    const char *cgroup) {
   if (gracefully) {
     // TODO(jmmv): If we truly want to offer graceful termination, we should
     // probably only send SIGTERM to the process group leader and allow it to
@@ -103,10 +210,14 @@ void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay) {
     // terminate early because sending a signal to a zombie process succeeds
     // (and we cannot collect the child's exit status here).
     child_pid_for_signal = pgrp;
+    child_cgroup_for_signal = cgroup;
     InstallSignalHandler(SIGALRM, ForciblyKillEverything);
     SetTimeout(graceful_kill_delay);
   } else {
     kill(-pgrp, SIGKILL);
+    if (cgroup != nullptr) {
+      KillCgroup(cgroup);
+    }
   }
 }
 
@@ -148,16 +259,8 @@ void InstallDefaultSignalHandler(int signum) {
 }
 
 void ClearSignalMask() {
-  // Use an empty signal mask for the process.
-  sigset_t empty_sset;
-  if (sigemptyset(&empty_sset) < 0) {
-    DIE("sigemptyset");
-  }
-  if (sigprocmask(SIG_SETMASK, &empty_sset, nullptr) < 0) {
-    DIE("sigprocmask");
-  }
-
-  // Set the default signal handler for all signals.
+  // Set the default signal handler for all signals. This comes first so that
+  // no handler of the parent runs once the signals are unblocked.
   for (int i = 1; i < NSIG; ++i) {
     if (i == SIGKILL || i == SIGSTOP) {
       continue;
@@ -171,6 +274,15 @@ void ClearSignalMask() {
     // handler for certain signals, but we still want to try.
     sigaction(i, &sa, nullptr);
   }
+
+  // Use an empty signal mask for the process.
+  sigset_t empty_sset;
+  if (sigemptyset(&empty_sset) < 0) {
+    DIE("sigemptyset");
+  }
+  if (sigprocmask(SIG_SETMASK, &empty_sset, nullptr) < 0) {
+    DIE("sigprocmask");
+  }
 }
 
 void SetTimeout(double timeout_secs) {
@@ -233,7 +345,7 @@ int WaitChildWithRusage(pid_t pid, struct rusage *rusage,
   return status;
 }
 
-static std::unique_ptr<tools::protos::ExecutionStatistics>
+std::unique_ptr<tools::protos::ExecutionStatistics>
 CreateExecutionStatisticsProto(struct rusage *rusage) {
   std::unique_ptr<tools::protos::ExecutionStatistics> execution_statistics(
       new tools::protos::ExecutionStatistics);
@@ -264,16 +376,16 @@ CreateExecutionStatisticsProto(struct rusage *rusage) {
 }
 
 // Write execution statistics (e.g. resource usage) to a file.
-void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
+void WriteStatsToFile(
+    const tools::protos::ExecutionStatistics &execution_statistics,
+    const std::string &stats_path) {
   const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_APPEND;
   int fd_out = open(stats_path.c_str(), flags, 0666);
   if (fd_out < 0) {
     DIE("open(%s)", stats_path.c_str());
   }
 
-  std::unique_ptr<tools::protos::ExecutionStatistics> execution_statistics =
-      CreateExecutionStatisticsProto(rusage);
-  std::string serialized = execution_statistics->SerializeAsString();
+  std::string serialized = execution_statistics.SerializeAsString();
 
   if (serialized.empty()) {
     DIE("invalid execution statistics message");
@@ -296,7 +408,164 @@ void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
   close(fd_out);
 }
 
+void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path) {
+  WriteStatsToFile(*CreateExecutionStatisticsProto(rusage), stats_path);
+}
+
+// The thread that StartSamplingResources started, and how to stop it.
+static std::thread *resource_sampler = nullptr;
+static std::mutex resource_sampler_mutex;
+static std::condition_variable resource_sampler_stop;
+static bool resource_sampler_stopping = false;
+
+// Writes message to fd, preceded by its size as a varint. Returns false if fd
+// cannot be written to.
+static bool WriteDelimited(int fd, const google::protobuf::MessageLite &message) {
+  std::string data;
+  for (uint64_t size = message.ByteSizeLong(); ; size >>= 7) {
+    if (size < 0x80) {
+      data.push_back(static_cast<char>(size));
+      break;
+    }
+    data.push_back(static_cast<char>((size & 0x7f) | 0x80));
+  }
+  if (!message.AppendToString(&data)) {
+    return false;
+  }
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = write(fd, data.data() + done, data.size() - done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+// Runs in the thread of StartSamplingResources, and writes a sample to
+// samples_path every interval_secs until StopSamplingResources, or until it
+// cannot be written to.
+static void SampleResourcesPeriodically(pid_t pid, std::string cgroup,
+                                        double interval_secs,
+                                        std::string samples_path) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto interval = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(interval_secs));
+  auto next = start;
+  int fd = -1;
+  std::unique_lock<std::mutex> lock(resource_sampler_mutex);
+  while (!resource_sampler_stopping) {
+    lock.unlock();
+    if (fd < 0) {
+      // Opening a pipe without O_NONBLOCK would block until its reader opens
+      // it too, and StopSamplingResources could not stop us. Until then, we
+      // retry every interval.
+      fd = open(samples_path.c_str(),
+                O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NONBLOCK, 0666);
+      if (fd >= 0 && fcntl(fd, F_SETFL, 0) < 0) {
+        DIE("fcntl");
+      }
+      if (fd < 0 && errno != ENXIO) {
+        fprintf(stderr, "Not sampling resources: open(%s): %s\n",
+                samples_path.c_str(), strerror(errno));
+        return;
+      }
+    }
+    if (fd >= 0) {
+      tools::protos::ResourceSample sample;
+      sample.set_elapsed_usec(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start)
+              .count());
+      if (SampleResources(pid, cgroup, &sample) &&
+          !WriteDelimited(fd, sample)) {
+        PRINT_DEBUG("stopped sampling resources: %s", strerror(errno));
+        break;
+      }
+    }
+    next += interval;
+    lock.lock();
+    resource_sampler_stop.wait_until(
+        lock, next, [] { return resource_sampler_stopping; });
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void StartSamplingResources(pid_t pid, const std::string &cgroup,
+                            double interval_secs,
+                            const std::string &samples_path) {
+  // The thread inherits our signal mask. Blocking all signals in it leaves
+  // their handling to us, and turns a SIGPIPE on writing the samples into
+  // EPIPE.
+  sigset_t all_signals, old_signals;
+  sigfillset(&all_signals);
+  if (pthread_sigmask(SIG_BLOCK, &all_signals, &old_signals) != 0) {
+    DIE("pthread_sigmask");
+  }
+  resource_sampler_stopping = false;
+  resource_sampler = new std::thread(SampleResourcesPeriodically, pid, cgroup,
+                                     interval_secs, samples_path);
+  if (pthread_sigmask(SIG_SETMASK, &old_signals, nullptr) != 0) {
+    DIE("pthread_sigmask");
+  }
+}
+
+void StopSamplingResources() {
+  if (resource_sampler == nullptr) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(resource_sampler_mutex);
+    resource_sampler_stopping = true;
+  }
+  resource_sampler_stop.notify_all();
+  resource_sampler->join();
+  delete resource_sampler;
+  resource_sampler = nullptr;
+}
+
 // Write contents to a file.
+bool ParseCpuList(const std::string &cpus, std::vector<int> *result) {
+  result->clear();
+  const char *p = cpus.c_str();
+  while (true) {
+    char *end;
+    if (!isdigit(*p)) {
+      return false;
+    }
+    long first = strtol(p, &end, 10);
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      if (!isdigit(*++p)) {
+        return false;
+      }
+      last = strtol(p, &end, 10);
+      p = end;
+    }
+    // The kernel supports at most 8192 CPUs.
+    if (last < first || last >= 8192) {
+      return false;
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      result->push_back(cpu);
+    }
+    if (*p == '\0') {
+      return true;
+    }
+    if (*p++ != ',') {
+      return false;
+    }
+  }
+}
+
 void WriteFile(const std::string &filename, const char *fmt, ...) {
   FILE *stream = fopen(filename.c_str(), "w");
   if (stream == nullptr) {
@@ -348,3 +617,41 @@ void SignalPipe(int *pipe) {
     DIE("close");
   }
 }
+
+bool ReadFully(int fd, void *buf, size_t size) {
+  char *p = static_cast<char *>(buf);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, p + done, size - done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("read");
+    }
+    if (n == 0) {
+      if (done == 0) {
+        return false;
+      }
+      errno = EPIPE;
+      DIE("read");
+    }
+    done += n;
+  }
+  return true;
+}
+
+void WriteFully(int fd, const void *buf, size_t size) {
+  const char *p = static_cast<const char *>(buf);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = write(fd, p + done, size - done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("write");
+    }
+    done += n;
+  }
+}
@@ -16,8 +16,14 @@
 #define SRC_MAIN_TOOLS_PROCESS_TOOLS_H_
 
 #include <stdbool.h>
+#include <sys/resource.h>
 #include <sys/types.h>
+
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "src/main/protobuf/execution_statistics.pb.h"
 
 // Switch completely to the effective uid.
 // Some programs (notably, bash) ignore the euid and just use the uid. This
@@ -31,11 +37,27 @@ int SwitchToEgid();
 // Redirect fd to the file target_path (but not if target_path is empty or "-").
 void Redirect(const std::string &target_path, int fd);
 
+// Like Redirect, but keeps what is written to fd in memory until
+// WriteCapturedOutputs, which only creates target_path if anything was
+// written. Most commands write little or nothing, and this saves creating and
+// later deleting a file for them. Falls back to Redirect if the output cannot
+// be kept in memory.
+void RedirectLazily(const std::string &target_path, int fd);
+
+// Writes what was captured by RedirectLazily to the files, and redirects the
+// file descriptors to them. Also called at exit by the process that captured
+// the outputs, so that our own error messages are not lost.
+void WriteCapturedOutputs();
+
 // Make sure the process group "pgrp" and all its subprocesses are killed.
 // If "gracefully" is true, sends SIGTERM first and after a timeout of
 // "graceful_kill_delay" seconds, sends SIGKILL.
 // If not, send SIGKILL immediately.
-void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay);
+// If "cgroup" is not null, the processes in that cgroup v2 directory are
+// killed along with the process group, see KillCgroup. The string must
+// outlive the kill delay.
+void KillEverything(pid_t pgrp, bool gracefully, double graceful_kill_delay,
+                    const char *cgroup = nullptr);
 
 // Set up a signal handler for a signal.
 void InstallSignalHandler(int signum, void (*handler)(int));
@@ -63,7 +85,60 @@ int WaitChild(pid_t pid, bool child_subreaper_enabled);
 int WaitChildWithRusage(pid_t pid, struct rusage *rusage,
                         bool child_subreaper_enabled);
 
+// Create execution statistics with the resource usage in "rusage".
+std::unique_ptr<tools::protos::ExecutionStatistics>
+CreateExecutionStatisticsProto(struct rusage *rusage);
+
+// Fills in "usage" with the resource usage of the process "pid", which must
+// have exited but not have been reaped yet. Returns false if the usage is not
+// available.
+//
+// May not be implemented on all platforms.
+bool GetDarwinResourceUsage(pid_t pid,
+                            tools::protos::DarwinResourceUsage *usage);
+
+// Fills in "sample" with the resource usage of the process "pid" and its
+// descendants, and with that of the cgroup v2 directory "cgroup" unless it is
+// empty. Leaves elapsed_usec alone. Returns false if the usage is not
+// available.
+//
+// May not be implemented on all platforms.
+bool SampleResources(pid_t pid, const std::string &cgroup,
+                     tools::protos::ResourceSample *sample);
+
+// Starts a thread that takes a sample with SampleResources right away and
+// then every "interval_secs" seconds, until StopSamplingResources is called.
+// Each sample is written to the file or pipe "samples_path" as a
+// ResourceSample message preceded by its size as a varint, so that it can be
+// read while the process runs. Only warns if "samples_path" cannot be opened,
+// and stops early once the samples can no longer be written, such as when the
+// reader of the pipe is gone.
+void StartSamplingResources(pid_t pid, const std::string &cgroup,
+                            double interval_secs,
+                            const std::string &samples_path);
+
+// Stops the thread that StartSamplingResources started, if any.
+void StopSamplingResources();
+
+// Parses "cpus", a list of CPU numbers and ranges of them separated by commas,
+// such as "0-3,8", as cpuset.cpus of cgroups takes it, into "result". Returns
+// false if it is malformed.
+bool ParseCpuList(const std::string &cpus, std::vector<int> *result);
+
+// Pins the calling process, and the processes it starts from then on, to the
+// CPUs "cpus" unless it is empty, and has them allocate memory from the NUMA
+// node "mem_node" only unless it is negative. Returns false and sets errno if
+// that failed.
+//
+// May not be implemented on all platforms.
+bool SetCpuAffinity(const std::vector<int> &cpus, int mem_node);
+
 // Write execution statistics to a file.
+void WriteStatsToFile(
+    const tools::protos::ExecutionStatistics &execution_statistics,
+    const std::string &stats_path);
+
+// Write execution statistics with the resource usage in "rusage" to a file.
 void WriteStatsToFile(struct rusage *rusage, const std::string &stats_path);
 
 // Write contents to a file.
@@ -99,6 +174,60 @@ int WaitForProcessGroupToTerminate(pid_t pgid);
 // May not be implemented on all platforms.
 int TerminateAndWaitForAll(pid_t pid);
 
+// Creates an anonymous file in memory, with close-on-exec set. Returns -1 if
+// that is not possible.
+//
+// May not be implemented on all platforms.
+int CreateMemoryFile(const char *name);
+
+// Kills all the processes in the cgroup v2 directory "cgroup" at once, even
+// the ones that left the process group or keep forking, by writing to its
+// cgroup.kill file (Linux 5.14). Returns false if the cgroup cannot be
+// killed this way. Async-signal-safe.
+//
+// May not be implemented on all platforms.
+bool KillCgroup(const char *cgroup);
+
+// Waits until no process is left in the cgroup v2 directory "cgroup", as
+// notified through its cgroup.events file. Returns false if that cannot be
+// found out.
+//
+// May not be implemented on all platforms.
+bool WaitForCgroupToEmpty(const std::string &cgroup);
+
+// A child process for SuperviseChildren.
+struct SupervisedChild {
+  pid_t pid;
+  // Seconds after which to terminate the child, or 0 for no timeout.
+  double timeout_secs;
+  // Seconds to wait after SIGTERM before sending SIGKILL when terminating the
+  // child, or 0 to send SIGKILL right away.
+  double kill_delay_secs;
+  // Set once the child has exited.
+  int status;
+  struct rusage rusage;
+  bool timed_out;
+};
+
+// Returns whether SuperviseChildren can be used, which needs pidfds on Linux
+// (5.3) and kqueue elsewhere.
+//
+// May not be implemented on all platforms.
+bool CanSuperviseChildren();
+
+// Waits for all children to exit and collects their status and resource
+// usage. Terminates each child after its timeout, and all remaining children
+// on receipt of any of the signals in terminating_signals, which are blocked
+// (ignored, with kqueue) for the duration of the call. Instead of signal handlers and SIGALRM, this
+// waits on pidfds, a signalfd and timerfds in an epoll loop on Linux, and on
+// process, signal and timer events of a kqueue elsewhere, so that nothing can
+// race with the signal handlers, and several children can be supervised at
+// once. Signals go to the child processes only, not to their process groups.
+//
+// May not be implemented on all platforms.
+void SuperviseChildren(std::vector<SupervisedChild> *children,
+                       const std::vector<int> &terminating_signals);
+
 // Blocks and waits on a pipe for the a signal to proceed from the other process
 // `SignalPipe()`.
 void WaitPipe(int *pipe);
@@ -107,4 +236,11 @@ void WaitPipe(int *pipe);
 // that it can proceed by writing a byte to the pipe.
 void SignalPipe(int *pipe);
 
+// Reads exactly size bytes from fd. Returns false if fd is at its end, and dies
+// if it ends after only part of the bytes.
+bool ReadFully(int fd, void *buf, size_t size);
+
+// Writes all size bytes to fd.
+void WriteFully(int fd, const void *buf, size_t size);
+
 #endif  // PROCESS_TOOLS_H__
@@ -25,10 +25,13 @@
 
 #include <errno.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <memory>
+
 #include "src/main/tools/logging.h"
 #include "src/main/tools/process-tools.h"
 #include "src/main/tools/process-wrapper-options.h"
@@ -42,11 +45,17 @@ static bool child_subreaper_enabled = false;
 #endif
 #endif
 
+extern char **environ;
+
 pid_t LegacyProcessWrapper::child_pid = 0;
 volatile sig_atomic_t LegacyProcessWrapper::last_signal = 0;
 
 void LegacyProcessWrapper::RunCommand() {
   SpawnChild();
+  if (!opt.resource_samples_path.empty()) {
+    StartSamplingResources(child_pid, opt.cgroup, opt.sample_interval_secs,
+                           opt.resource_samples_path);
+  }
   WaitForChild();
 }
 
@@ -61,6 +70,15 @@ void LegacyProcessWrapper::SpawnChild() {
   }
 #endif
 
+#if defined(POSIX_SPAWN_SETSID)
+  // Joining the cgroup and pinning to CPUs take code running in the child
+  // before exec.
+  if (opt.cgroup.empty() && opt.cpus.empty() && opt.mem_node < 0) {
+    child_pid = SpawnChildWithoutFork();
+    return;
+  }
+#endif
+
   child_pid = fork();
   if (child_pid < 0) {
     DIE("fork");
@@ -71,6 +89,15 @@ void LegacyProcessWrapper::SpawnChild() {
     }
     ClearSignalMask();
 
+    // Join the cgroup before exec, so that every descendant starts in it.
+    if (!opt.cgroup.empty()) {
+      WriteFile(opt.cgroup + "/cgroup.procs", "%d", getpid());
+    }
+
+    if (!SetCpuAffinity(opt.cpus, opt.mem_node)) {
+      DIE("SetCpuAffinity");
+    }
+
     // Force umask to include read and execute for everyone, to make output
     // permissions predictable.
     umask(022);
@@ -82,6 +109,48 @@ void LegacyProcessWrapper::SpawnChild() {
   }
 }
 
+#if defined(POSIX_SPAWN_SETSID)
+// Does what the child forked by SpawnChild does through the attributes of
+// posix_spawn, which neither copies the page tables of the process nor
+// makes it wait for the child to exec for longer than vfork would.
+pid_t LegacyProcessWrapper::SpawnChildWithoutFork() {
+  posix_spawnattr_t attr;
+  int err = posix_spawnattr_init(&attr);
+  if (err != 0) {
+    errno = err;
+    DIE("posix_spawnattr_init");
+  }
+  sigset_t no_signals;
+  sigset_t all_signals;
+  if (sigemptyset(&no_signals) < 0 || sigfillset(&all_signals) < 0) {
+    DIE("sigset");
+  }
+  if ((err = posix_spawnattr_setflags(
+           &attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK |
+                      POSIX_SPAWN_SETSIGDEF)) != 0 ||
+      (err = posix_spawnattr_setsigmask(&attr, &no_signals)) != 0 ||
+      (err = posix_spawnattr_setsigdefault(&attr, &all_signals)) != 0) {
+    errno = err;
+    DIE("posix_spawnattr");
+  }
+
+  // There is no attribute for the umask, so the child inherits ours. Force it
+  // to include read and execute for everyone, to make output permissions
+  // predictable.
+  const mode_t saved_umask = umask(022);
+  pid_t pid;
+  err = posix_spawnp(&pid, opt.args[0], nullptr, &attr, opt.args.data(),
+                     environ);
+  umask(saved_umask);
+  posix_spawnattr_destroy(&attr);
+  if (err != 0) {
+    errno = err;
+    DIE("posix_spawnp(%s, ...)", opt.args[0]);
+  }
+  return pid;
+}
+#endif
+
 // Sets up signal handlers to kill all subprocesses when the given signal is
 // triggered. Whether subprocesses are abruptly terminated or not depends on
 // the signal type and the user configuration.
@@ -123,6 +192,12 @@ void LegacyProcessWrapper::WaitForChild() {
   if (WaitForProcessGroupToTerminate(child_pid) == -1) {
     DIE("WaitForProcessGroupToTerminate");
   }
+
+  // ru_maxrss misses compressed memory on macOS, so also record the usage
+  // that the system accounts for, which is gone once the child is reaped.
+  tools::protos::DarwinResourceUsage darwin_usage;
+  const bool has_darwin_usage = !opt.stats_path.empty() &&
+                                GetDarwinResourceUsage(child_pid, &darwin_usage);
 #endif
 
   int status;
@@ -130,13 +205,28 @@ void LegacyProcessWrapper::WaitForChild() {
     struct rusage child_rusage;
     status = WaitChildWithRusage(child_pid, &child_rusage,
                                  child_subreaper_enabled);
-    WriteStatsToFile(&child_rusage, opt.stats_path);
+    std::unique_ptr<tools::protos::ExecutionStatistics> stats =
+        CreateExecutionStatisticsProto(&child_rusage);
+#if defined(__APPLE__)
+    if (has_darwin_usage) {
+      *stats->mutable_darwin_resource_usage() = darwin_usage;
+    }
+#endif
+    WriteStatsToFile(*stats, opt.stats_path);
   } else {
     status = WaitChild(child_pid, child_subreaper_enabled);
   }
+  StopSamplingResources();
 
 #if !defined(__APPLE__) && !defined(__OpenBSD__)
-  if (child_subreaper_enabled) {
+  if (!opt.cgroup.empty() && KillCgroup(opt.cgroup.c_str()) &&
+      WaitForCgroupToEmpty(opt.cgroup)) {
+    // Every descendant is gone at once, wherever it went in the process tree,
+    // without having to look for it in /proc. The ones that were reparented
+    // to us as the subreaper are left to be reaped.
+    while (waitpid(-1, nullptr, WNOHANG) > 0) {
+    }
+  } else if (child_subreaper_enabled) {
     // If we enabled the child subreaper feature (on Linux), now that we have
     // collected the status of the PID we were interested in, terminate the
     // rest of the process group and wait until all the children are gone.
@@ -155,6 +245,9 @@ void LegacyProcessWrapper::WaitForChild() {
   }
 #endif
 
+  // Raising a signal below skips the handlers run at exit.
+  WriteCapturedOutputs();
+
   if (last_signal > 0) {
     // Don't trust the exit code if we got a timeout or signal.
     InstallDefaultSignalHandler(last_signal);
@@ -171,11 +264,13 @@ void LegacyProcessWrapper::WaitForChild() {
 // Called when timeout or signal occurs.
 void LegacyProcessWrapper::OnAbruptSignal(int sig) {
   last_signal = sig;
-  KillEverything(child_pid, false, opt.kill_delay_secs);
+  KillEverything(child_pid, false, opt.kill_delay_secs,
+                 opt.cgroup.empty() ? nullptr : opt.cgroup.c_str());
 }
 
 // Called when timeout or signal occurs.
 void LegacyProcessWrapper::OnGracefulSignal(int sig) {
   last_signal = sig;
-  KillEverything(child_pid, true, opt.kill_delay_secs);
+  KillEverything(child_pid, true, opt.kill_delay_secs,
+                 opt.cgroup.empty() ? nullptr : opt.cgroup.c_str());
 }
@@ -16,6 +16,8 @@
 #define SRC_MAIN_TOOLS_PROCESS_WRAPPER_LEGACY_H_
 
 #include <signal.h>
+#include <sys/types.h>
+
 #include <vector>
 
 // The process-wrapper implementation that was used until and including Bazel
@@ -39,6 +41,7 @@ class LegacyProcessWrapper {
 
  private:
   static void SpawnChild();
+  static pid_t SpawnChildWithoutFork();
   static void SetupSignalHandlers();
   static void WaitForChild();
   static void OnAbruptSignal(int sig);
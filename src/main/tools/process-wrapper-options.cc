@@ -26,6 +26,7 @@
 #include <vector>
 
 #include "src/main/tools/logging.h"
+#include "src/main/tools/process-tools.h"
 
 struct Options opt;
 
@@ -49,8 +50,25 @@ static void Usage(char *program_name, const char *fmt, ...) {
       "before killing the child with SIGKILL\n"
       "  -o/--stdout <file>  redirect stdout to a file\n"
       "  -e/--stderr <file>  redirect stderr to a file\n"
+      "  -l/--lazy_outputs  if set, keep stdout and stderr in memory while "
+      "the command runs, and only create their files (-o/-e) if it wrote to "
+      "them\n"
       "  -s/--stats <file>  if set, write stats in protobuf format to a file\n"
+      "  -r/--resource_samples <file>  if set, periodically write samples of "
+      "the resource usage of the command and its descendants to a file or "
+      "pipe while it runs, as size-delimited ResourceSample protobufs\n"
+      "  -q/--sample_interval <seconds>  how often to sample the resource "
+      "usage for -r (default: 1)\n"
+      "  -C/--cgroup <dir>  an existing cgroup v2 directory for the command "
+      "alone; if set, the command and its descendants are moved into it and "
+      "killed through it at once (Linux only)\n"
+      "  -a/--cpus <list>  pin the command and its descendants to these "
+      "CPUs, given as in cpuset.cpus, e.g. 0-3,8 (Linux only)\n"
+      "  -b/--mem_node <node>  have the command and its descendants allocate "
+      "memory from this NUMA node only (Linux only)\n"
       "  -d/--debug  if set, debug info will be printed\n"
+      "  -z/--server  if set, run the commands of the requests read from "
+      "stdin concurrently; see process-wrapper.cc\n"
       "  --  command to run inside sandbox, followed by arguments\n");
   exit(EXIT_FAILURE);
 }
@@ -64,14 +82,21 @@ static void ParseCommandLine(const std::vector<char *> &args) {
       {"kill_delay", required_argument, 0, 'k'},
       {"stdout", required_argument, 0, 'o'},
       {"stderr", required_argument, 0, 'e'},
+      {"lazy_outputs", no_argument, 0, 'l'},
       {"stats", required_argument, 0, 's'},
+      {"resource_samples", required_argument, 0, 'r'},
+      {"sample_interval", required_argument, 0, 'q'},
+      {"cgroup", required_argument, 0, 'C'},
+      {"cpus", required_argument, 0, 'a'},
+      {"mem_node", required_argument, 0, 'b'},
       {"debug", no_argument, 0, 'd'},
+      {"server", no_argument, 0, 'z'},
       {0, 0, 0, 0}};
   extern char *optarg;
   extern int optind, optopt;
   int c;
 
-  while ((c = getopt_long(args.size(), args.data(), "+:gt:k:o:e:s:d",
+  while ((c = getopt_long(args.size(), args.data(), "+:gt:k:o:e:ls:r:q:C:a:b:dz",
                           long_options, nullptr)) != -1) {
     switch (c) {
       case 'g':
@@ -103,6 +128,9 @@ static void ParseCommandLine(const std::vector<char *> &args) {
                 "Cannot redirect stderr (-e) to more than one destination.");
         }
         break;
+      case 'l':
+        opt.lazy_outputs = true;
+        break;
       case 's':
         if (opt.stats_path.empty()) {
           opt.stats_path.assign(optarg);
@@ -111,9 +139,45 @@ static void ParseCommandLine(const std::vector<char *> &args) {
                 "Cannot write stats (-s) to more than one destination.");
         }
         break;
+      case 'r':
+        if (opt.resource_samples_path.empty()) {
+          opt.resource_samples_path.assign(optarg);
+        } else {
+          Usage(args.front(), "Cannot write resource samples (-r) to more than "
+                              "one destination.");
+        }
+        break;
+      case 'q':
+        if (sscanf(optarg, "%lf", &opt.sample_interval_secs) != 1 ||
+            opt.sample_interval_secs <= 0) {
+          Usage(args.front(), "Invalid sample interval (-q) value: %s",
+                optarg);
+        }
+        break;
+      case 'C':
+        if (opt.cgroup.empty()) {
+          opt.cgroup.assign(optarg);
+        } else {
+          Usage(args.front(), "Cannot run the command in more than one cgroup "
+                              "(-C).");
+        }
+        break;
+      case 'a':
+        if (!ParseCpuList(optarg, &opt.cpus)) {
+          Usage(args.front(), "Invalid CPU list (-a) value: %s", optarg);
+        }
+        break;
+      case 'b':
+        if (sscanf(optarg, "%d", &opt.mem_node) != 1 || opt.mem_node < 0) {
+          Usage(args.front(), "Invalid NUMA node (-b) value: %s", optarg);
+        }
+        break;
       case 'd':
         opt.debug = true;
         break;
+      case 'z':
+        opt.server_mode = true;
+        break;
       case '?':
         Usage(args.front(), "Unrecognized argument: -%c (%d)", optopt, optind);
         break;
@@ -131,8 +195,34 @@ static void ParseCommandLine(const std::vector<char *> &args) {
 void ParseOptions(int argc, char *argv[]) {
   std::vector<char *> args(argv, argv + argc);
 
+  opt.sample_interval_secs = 1;
+  opt.mem_node = -1;
   ParseCommandLine(args);
 
+#if !defined(__linux__)
+  if (!opt.cgroup.empty()) {
+    Usage(args.front(), "The -C option is only supported on Linux.");
+  }
+  if (!opt.cpus.empty() || opt.mem_node >= 0) {
+    Usage(args.front(), "The -a and -b options are only supported on Linux.");
+  }
+#endif
+
+  if (opt.server_mode) {
+    if (!opt.args.empty()) {
+      Usage(args.front(), "No command may be specified with -z.");
+    }
+    if (!opt.stdout_path.empty() || !opt.stats_path.empty() ||
+        !opt.resource_samples_path.empty()) {
+      Usage(args.front(),
+            "The -o, -s and -r options go into the requests of -z.");
+    }
+    if (!opt.cgroup.empty()) {
+      Usage(args.front(), "The -C option cannot be used with -z.");
+    }
+    return;
+  }
+
   if (opt.args.empty()) {
     Usage(args.front(), "No command specified.");
   }
@@ -140,3 +230,44 @@ void ParseOptions(int argc, char *argv[]) {
   // argv[] passed to execve() must be a null-terminated array.
   opt.args.push_back(nullptr);
 }
+
+void ParseRequest(const std::string &request) {
+  std::vector<char *> args;
+  args.push_back(strdup("process-wrapper"));
+  size_t start = 0;
+  size_t end;
+  while ((end = request.find('\n', start)) != std::string::npos) {
+    if (end > start) {
+      args.push_back(strdup(request.substr(start, end - start).c_str()));
+    }
+    start = end + 1;
+  }
+
+  // The flags given to the server are the defaults of every request, except
+  // for where the outputs of its command go.
+  opt.stdout_path.clear();
+  opt.stderr_path.clear();
+  opt.stats_path.clear();
+  opt.resource_samples_path.clear();
+  opt.server_mode = false;
+  opt.args.clear();
+
+  // Restart getopt, which already went through our own command line.
+  optind = 1;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+  optreset = 1;
+#endif
+  ParseCommandLine(args);
+
+  if (opt.server_mode) {
+    Usage(args.front(), "The -z option cannot be used in a request.");
+  }
+  if (!opt.cgroup.empty()) {
+    Usage(args.front(), "The -C option cannot be used in a request.");
+  }
+  if (opt.args.empty()) {
+    Usage(args.front(), "No command specified.");
+  }
+
+  opt.args.push_back(nullptr);
+}
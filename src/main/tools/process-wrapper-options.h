@@ -30,10 +30,25 @@ struct Options {
   std::string stdout_path;
   // Where to redirect stderr (-e)
   std::string stderr_path;
+  // Whether to only create the stdout and stderr files once the command
+  // exited, if it wrote to them (-l)
+  bool lazy_outputs;
   // Whether to print debugging messages (-d)
   bool debug;
   // Where to write stats, in protobuf format (-s)
   std::string stats_path;
+  // Where to write samples of the resource usage while the command runs (-r)
+  std::string resource_samples_path;
+  // How often to sample the resource usage (-q)
+  double sample_interval_secs;
+  // The cgroup v2 directory to run the command in, to kill it as a whole (-C)
+  std::string cgroup;
+  // The CPUs to pin the command to, or empty to let it run on any (-a)
+  std::vector<int> cpus;
+  // The NUMA node for the command to allocate memory from, or -1 for any (-b)
+  int mem_node;
+  // Whether to run the commands of the requests read from stdin (-z)
+  bool server_mode;
   // Command to run (--)
   std::vector<char *> args;
 };
@@ -43,4 +58,8 @@ extern struct Options opt;
 // Handles parsing all command line flags and populates the global opt struct.
 void ParseOptions(int argc, char *argv[]);
 
+// Resets the per-command options and populates them from a server mode
+// request, which holds one argument per line.
+void ParseRequest(const std::string &request);
+
 #endif
@@ -21,11 +21,25 @@
 // unless process-wrapper receives a signal. ie, on SIGTERM this program will
 // die with raise(SIGTERM) even if the child process handles SIGTERM with
 // exit(0).
+//
+// In server mode (-z), process-wrapper instead reads requests from stdin, each
+// of which is a command line of process-wrapper with one argument per line,
+// terminated by an empty line. It runs the command of each request as soon as
+// it has read it, as if it had been exec'd with that command line, so that
+// callers save an exec of process-wrapper per command. Whenever a command
+// finishes, it writes a line with the number of its request, counting from 1
+// in the order they were read, and the exit code to stdout. The commands
+// inherit stderr unless redirected, and their stdout goes to stderr too.
+// SIGTERM and SIGINT are forwarded to all running commands and stop the
+// reading of further requests. process-wrapper exits once stdin is closed and
+// all commands have finished.
 
 #include "src/main/tools/process-wrapper.h"
 
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -35,6 +49,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -43,14 +58,170 @@
 #include "src/main/tools/process-wrapper-legacy.h"
 #include "src/main/tools/process-wrapper-options.h"
 
+// In server mode, the pipe through which signal handlers wake up
+// ServeRequests, passing it the number of the signal.
+static int global_signal_pipe[2];
+
+static void OnServerSignal(int sig) {
+  const int saved_errno = errno;
+  const char signum = sig;
+  // If the pipe is full, ServeRequests has yet to look at earlier signals
+  // anyway.
+  if (write(global_signal_pipe[1], &signum, 1) < 0) {
+  }
+  errno = saved_errno;
+}
+
+// Forks a process that runs the command of a request. Returns its PID.
+static pid_t RunRequest(const std::string &request) {
+  const pid_t pid = fork();
+  if (pid < 0) {
+    DIE("fork");
+  } else if (pid == 0) {
+    close(global_signal_pipe[0]);
+    close(global_signal_pipe[1]);
+    ClearSignalMask();
+    ParseRequest(request);
+
+    // Our stdin and stdout belong to the server.
+    const int null_fd = open("/dev/null", O_RDONLY);
+    if (null_fd < 0 || dup2(null_fd, STDIN_FILENO) < 0) {
+      DIE("open(/dev/null)");
+    }
+    close(null_fd);
+    if (opt.stdout_path.empty()) {
+      if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        DIE("dup2");
+      }
+    } else if (opt.lazy_outputs) {
+      RedirectLazily(opt.stdout_path, STDOUT_FILENO);
+    } else {
+      Redirect(opt.stdout_path, STDOUT_FILENO);
+    }
+    if (opt.lazy_outputs) {
+      RedirectLazily(opt.stderr_path, STDERR_FILENO);
+    } else {
+      Redirect(opt.stderr_path, STDERR_FILENO);
+    }
+
+    // Does not return.
+    LegacyProcessWrapper::RunCommand();
+  }
+  return pid;
+}
+
+// Reads requests from stdin and runs their commands until stdin is closed,
+// replying to each with its exit code on stdout once it has finished.
+static void ServeRequests() {
+  if (pipe(global_signal_pipe) < 0) {
+    DIE("pipe");
+  }
+  for (int fd : global_signal_pipe) {
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) < 0 ||
+        fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+      DIE("fcntl");
+    }
+  }
+  InstallSignalHandler(SIGCHLD, OnServerSignal);
+  InstallSignalHandler(SIGTERM, OnServerSignal);
+  InstallSignalHandler(SIGINT, OnServerSignal);
+
+  // The number of the request of each running command, by PID.
+  std::map<pid_t, int> running;
+  int requests = 0;
+  std::string input;
+  std::string request;
+  bool reading = true;
+  while (reading || !running.empty()) {
+    struct pollfd fds[2] = {{global_signal_pipe[0], POLLIN, 0},
+                            {STDIN_FILENO, POLLIN, 0}};
+    if (poll(fds, reading ? 2 : 1, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DIE("poll");
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char signals[64];
+      const ssize_t count =
+          read(global_signal_pipe[0], signals, sizeof(signals));
+      for (ssize_t i = 0; i < count; i++) {
+        if (signals[i] == SIGCHLD) {
+          continue;
+        }
+        PRINT_DEBUG("forwarding signal %d", signals[i]);
+        for (const auto &child : running) {
+          kill(child.first, signals[i]);
+        }
+        reading = false;
+      }
+
+      int status;
+      pid_t pid;
+      while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        auto child = running.find(pid);
+        if (child == running.end()) {
+          continue;
+        }
+        const int exit_code = WIFSIGNALED(status) ? 128 + WTERMSIG(status)
+                                                  : WEXITSTATUS(status);
+        printf("%d %d\n", child->second, exit_code);
+        fflush(stdout);
+        running.erase(child);
+      }
+    }
+
+    if (reading && (fds[1].revents & (POLLIN | POLLHUP))) {
+      char buf[4096];
+      const ssize_t count = read(STDIN_FILENO, buf, sizeof(buf));
+      if (count < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+          continue;
+        }
+        DIE("read");
+      }
+      if (count == 0) {
+        reading = false;
+        continue;
+      }
+      input.append(buf, count);
+
+      size_t start = 0;
+      size_t end;
+      while ((end = input.find('\n', start)) != std::string::npos) {
+        if (end > start) {
+          request.append(input, start, end - start + 1);
+        } else if (!request.empty()) {
+          running[RunRequest(request)] = ++requests;
+          request.clear();
+        }
+        start = end + 1;
+      }
+      input.erase(0, start);
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   ParseOptions(argc, argv);
 
   SwitchToEuid();
   SwitchToEgid();
 
-  Redirect(opt.stdout_path, STDOUT_FILENO);
-  Redirect(opt.stderr_path, STDERR_FILENO);
+  if (opt.server_mode) {
+    Redirect(opt.stderr_path, STDERR_FILENO);
+    ServeRequests();
+    return 0;
+  }
+
+  if (opt.lazy_outputs) {
+    RedirectLazily(opt.stdout_path, STDOUT_FILENO);
+    RedirectLazily(opt.stderr_path, STDERR_FILENO);
+  } else {
+    Redirect(opt.stdout_path, STDOUT_FILENO);
+    Redirect(opt.stderr_path, STDERR_FILENO);
+  }
 
   LegacyProcessWrapper::RunCommand();
 
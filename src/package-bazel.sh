@@ -104,3 +104,16 @@ else
   ZIP_ARGS="-q9DX@"
 fi
 (cd $PACKAGE_DIR; zip $ZIP_ARGS "$WORKDIR/$OUT") < $FILE_LIST
+
+# Append an index of the archive as its last member, stored, so that it ends
+# right before the central directory, where the client reads it instead of
+# scanning the archive on every startup. It lists the members up to
+# install_base_key and then the install MD5, and ends with a fixed size footer
+# holding the length of that list. See ReadArchiveIndex in archive_utils.cc.
+INDEX_BODY="$ROOT/archive_index.body"
+INDEX="$ROOT/archive_index"
+(sed -e 's|^\./||' < $FILE_LIST; cat $INSTALL_BASE_KEY; echo) > "$INDEX_BODY"
+(cat "$INDEX_BODY"; printf '%010d bazel-archive-index\n' \
+    "$(wc -c < "$INDEX_BODY")") > "$INDEX"
+touch -t 198001010000.00 "$INDEX"
+(cd $ROOT; zip -q0DX "$WORKDIR/$OUT" archive_index)
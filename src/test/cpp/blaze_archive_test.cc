@@ -170,4 +170,38 @@ TEST_F(BlazeArchiveTest, TestNoDataExtractionIfInstallBaseExists) {
                   startup_options, &logging_info);
   ASSERT_FALSE(extraction_time_two.has_value());
 }
+
+TEST_F(BlazeArchiveTest, TestVerifiedStampSkipsFileChecks) {
+  BazelStartupOptions startup_options;
+  set_startup_options(startup_options, blaze_path, output_dir);
+  LoggingInfo logging_info(blaze_path, blaze::GetMillisecondsMonotonic());
+  const blaze_util::Path stamp_path(output_dir + ".verified");
+
+  ASSERT_TRUE(ExtractData(blaze_path, archive_contents, expected_install_md5,
+                          startup_options, &logging_info)
+                  .has_value());
+  EXPECT_FALSE(blaze_util::PathExists(stamp_path));
+
+  // The first run on an existing install base checks the files and records
+  // that it did.
+  ASSERT_FALSE(ExtractData(blaze_path, archive_contents, expected_install_md5,
+                           startup_options, &logging_info)
+                   .has_value());
+  EXPECT_TRUE(blaze_util::PathExists(stamp_path));
+
+  // The later runs trust the stamp and do not look at the files.
+  const blaze_util::Path foo_path(file::JoinPath(output_dir, "foo"));
+  ASSERT_TRUE(blaze_util::SetMtimeToNow(foo_path));
+  ASSERT_FALSE(ExtractData(blaze_path, archive_contents, expected_install_md5,
+                           startup_options, &logging_info)
+                   .has_value());
+
+  // Without the stamp the files are checked again.
+  ASSERT_TRUE(blaze_util::UnlinkPath(stamp_path));
+  EXPECT_EXIT(ExtractData(blaze_path, archive_contents, expected_install_md5,
+                          startup_options, &logging_info),
+              ::testing::ExitedWithCode(
+                  blaze_exit_code::LOCAL_ENVIRONMENTAL_ERROR),
+              "corrupt installation");
+}
 }  // namespace blaze
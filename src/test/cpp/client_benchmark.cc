@@ -0,0 +1,581 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Measures the latency of the client on its own, without a real server.
+ * Usage:
+ *   client_benchmark --bazel PATH [--scenarios rc,extract,launcher]
+ *                    [--rc_depth N,...] [--rc_fanout N] [--iterations N]
+ *                    [--work_dir DIR] [--write_baseline FILE]
+ *                    [--baseline FILE] [--tolerance PERCENT]
+ *
+ * rc:       parses a tree of rc files, in which each file imports
+ *           --rc_fanout others, for each of the given depths, and reads the
+ *           same files back from the rc file cache.
+ * extract:  calls ExtractData on a new install base (cold) and on one that
+ *           has already been extracted and verified (warm).
+ * launcher: runs the client binary given by --bazel, from main through
+ *           RunLauncher, against a stub CommandServer that answers every
+ *           command at once. The stub is this binary itself, which the client
+ *           starts as its server through --server_javabase, so it goes
+ *           through the same checks as the real server. The first run, which
+ *           extracts the install base and starts the stub, is reported as
+ *           "launcher_cold".
+ *
+ * It prints one line per measurement with the 50th and 99th percentiles in
+ * milliseconds. --write_baseline writes the 50th percentiles to a file, and
+ * --baseline compares them against such a file and exits with 1 if one of
+ * them is more than --tolerance percent (default 20) slower.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT (gRPC requires this)
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/archive_utils.h"
+#include "src/main/cpp/bazel_startup_options.h"
+#include "src/main/cpp/rc_file.h"
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/path.h"
+#include "src/main/cpp/util/path_platform.h"
+#include "src/main/cpp/workspace_layout.h"
+#include "src/main/protobuf/command_server.grpc.pb.h"
+#include "grpcpp/security/server_credentials.h"
+#include "grpcpp/server.h"
+#include "grpcpp/server_builder.h"
+#include "grpcpp/server_context.h"
+#include "grpcpp/support/status.h"
+
+namespace {
+
+// Set in the environment of the client, and thus inherited by the server it
+// starts, which is this binary.
+const char kStubServerEnv[] = "CLIENT_BENCHMARK_STUB_SERVER";
+
+int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+double MillisSince(int64_t start_nanos) {
+  return (MonotonicNanos() - start_nanos) / 1e6;
+}
+
+std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  for (std::string item; std::getline(stream, item, ',');) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+void MakeDir(const std::string &path) {
+  if (!blaze_util::MakeDirectories(path, 0755)) {
+    err(1, "mkdir(%s)", path.c_str());
+  }
+}
+
+void WriteFile(const std::string &path, const std::string &contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+  if (!file.good()) {
+    errx(1, "cannot write %s", path.c_str());
+  }
+}
+
+void RemoveTree(const std::string &path) {
+  if (!blaze_util::RemoveRecursively(blaze_util::Path(path))) {
+    err(1, "cannot remove %s", path.c_str());
+  }
+}
+
+double Percentile(std::vector<double> values, double percentile) {
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(std::ceil(percentile * values.size()));
+  return values[std::min(values.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+// The 50th percentiles by measurement name, for --baseline.
+std::map<std::string, double> results;
+
+void Report(const std::string &name, const std::vector<double> &millis) {
+  double p50 = Percentile(millis, 0.5);
+  printf("%-24s %9.2f %9.2f\n", name.c_str(), p50, Percentile(millis, 0.99));
+  fflush(stdout);
+  results[name] = p50;
+}
+
+// Answers every command with exit code 0 right away, and exits after
+// "shutdown".
+class StubCommandServer final
+    : public command_server::CommandServer::Service {
+ public:
+  StubCommandServer(const std::string &request_cookie,
+                    const std::string &response_cookie)
+      : request_cookie_(request_cookie), response_cookie_(response_cookie) {}
+
+  grpc::Status Run(
+      grpc::ServerContext *context, const command_server::RunRequest *request,
+      grpc::ServerWriter<command_server::RunResponse> *writer) override {
+    if (request->cookie() != request_cookie_) {
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "bad cookie");
+    }
+    const bool shutdown =
+        request->arg_size() > 0 && request->arg(0) == "shutdown";
+    command_server::RunResponse response;
+    response.set_cookie(response_cookie_);
+    response.set_command_id("stub");
+    writer->Write(response);
+    response.Clear();
+    response.set_cookie(response_cookie_);
+    response.set_finished(true);
+    response.set_exit_code(0);
+    response.set_termination_expected(shutdown);
+    writer->Write(response);
+    if (shutdown) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+      shutdown_cv_.notify_one();
+    }
+    return grpc::Status::OK;
+  }
+
+  grpc::Status Cancel(grpc::ServerContext *context,
+                      const command_server::CancelRequest *request,
+                      command_server::CancelResponse *response) override {
+    response->set_cookie(response_cookie_);
+    return grpc::Status::OK;
+  }
+
+  grpc::Status Ping(grpc::ServerContext *context,
+                    const command_server::PingRequest *request,
+                    command_server::PingResponse *response) override {
+    if (request->cookie() != request_cookie_) {
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "bad cookie");
+    }
+    response->set_cookie(response_cookie_);
+    return grpc::Status::OK;
+  }
+
+  void AwaitShutdown() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    shutdown_cv_.wait(lock, [this] { return shutdown_; });
+  }
+
+ private:
+  const std::string request_cookie_;
+  const std::string response_cookie_;
+  std::mutex mutex_;
+  std::condition_variable shutdown_cv_;
+  bool shutdown_ = false;
+};
+
+std::string RandomCookie(std::mt19937_64 *random) {
+  char cookie[33];
+  snprintf(cookie, sizeof(cookie), "%016llx%016llx",
+           static_cast<unsigned long long>((*random)()),
+           static_cast<unsigned long long>((*random)()));
+  return cookie;
+}
+
+// Runs as the server the client starts: listens on a local port and
+// publishes it in the server directory, as the real server does.
+int RunStubServer(int argc, char *argv[]) {
+  const std::string output_base_flag = "--output_base=";
+  std::string output_base;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], output_base_flag.c_str(), output_base_flag.size()) ==
+        0) {
+      output_base = argv[i] + output_base_flag.size();
+    }
+  }
+  if (output_base.empty()) {
+    errx(1, "stub server started without --output_base");
+  }
+
+  std::mt19937_64 random(std::random_device{}());
+  const std::string request_cookie = RandomCookie(&random);
+  const std::string response_cookie = RandomCookie(&random);
+  StubCommandServer service(request_cookie, response_cookie);
+  int port = 0;
+  grpc::ServerBuilder builder;
+  builder.AddListeningPort("127.0.0.1:0", grpc::InsecureServerCredentials(),
+                           &port);
+  builder.RegisterService(&service);
+  std::unique_ptr<grpc::Server> server = builder.BuildAndStart();
+  if (server == nullptr || port == 0) {
+    errx(1, "cannot start the stub server");
+  }
+
+  // Written to a temporary file first, so that the client never reads it
+  // half-written.
+  command_server::ServerInfo info;
+  info.set_pid(getpid());
+  info.set_address("127.0.0.1:" + std::to_string(port));
+  info.set_request_cookie(request_cookie);
+  info.set_response_cookie(response_cookie);
+  const std::string server_info = output_base + "/server/server_info.rawproto";
+  WriteFile(server_info + ".tmp", info.SerializeAsString());
+  if (rename((server_info + ".tmp").c_str(), server_info.c_str()) < 0) {
+    err(1, "rename(%s)", server_info.c_str());
+  }
+
+  service.AwaitShutdown();
+  unlink(server_info.c_str());
+  server->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(1));
+  return 0;
+}
+
+// Creates a tree of rc files below `dir`, `depth` levels deep, in which every
+// file has a few options and imports `fanout` files of the next level.
+// Returns the root of the tree.
+std::string CreateRcTree(const std::string &dir, int depth, int fanout) {
+  MakeDir(dir);
+  // Old enough to be cached, see RcFile::WriteCache.
+  struct timeval times[2];
+  gettimeofday(&times[0], nullptr);
+  times[0].tv_sec -= 3600;
+  times[1] = times[0];
+
+  std::vector<std::string> level = {dir + "/0.bazelrc"};
+  int next_id = 1;
+  for (int d = 0; d <= depth; ++d) {
+    std::vector<std::string> next_level;
+    for (const std::string &path : level) {
+      std::string contents;
+      for (int i = 0; i < 10; ++i) {
+        contents += "build --copt=-DOPTION_" + std::to_string(i) + "\n";
+        contents += "test:config" + std::to_string(i) + " --test_arg=" +
+                    std::to_string(i) + "\n";
+      }
+      for (int i = 0; d < depth && i < fanout; ++i) {
+        std::string child = dir + "/" + std::to_string(next_id++) + ".bazelrc";
+        contents += "import " + child + "\n";
+        next_level.push_back(child);
+      }
+      WriteFile(path, contents);
+      if (utimes(path.c_str(), times) < 0) {
+        err(1, "utimes(%s)", path.c_str());
+      }
+    }
+    level = std::move(next_level);
+  }
+  return dir + "/0.bazelrc";
+}
+
+void BenchmarkRcFiles(const std::string &work_dir,
+                      const std::vector<std::string> &depths, int fanout,
+                      int iterations) {
+  const blaze::WorkspaceLayout workspace_layout;
+  for (const std::string &depth : depths) {
+    const std::string dir = work_dir + "/rc_" + depth;
+    RemoveTree(dir);
+    const std::string root = CreateRcTree(dir, atoi(depth.c_str()), fanout);
+    const std::string cache = dir + "/cache";
+
+    std::vector<double> parse_ms;
+    for (int i = 0; i < iterations; ++i) {
+      const int64_t start = MonotonicNanos();
+      blaze::RcFile::ParseError error;
+      std::string error_text;
+      std::unique_ptr<blaze::RcFile> rc_file = blaze::RcFile::Parse(
+          root, &workspace_layout, dir, &error, &error_text);
+      parse_ms.push_back(MillisSince(start));
+      if (rc_file == nullptr) {
+        errx(1, "cannot parse %s: %s", root.c_str(), error_text.c_str());
+      }
+      if (i == 0) {
+        std::vector<std::unique_ptr<blaze::RcFile>> rc_files;
+        rc_files.push_back(std::move(rc_file));
+        blaze::RcFile::WriteCache(cache, rc_files);
+      }
+    }
+    Report("rc_parse_depth_" + depth, parse_ms);
+
+    std::vector<double> cache_ms;
+    for (int i = 0; i < iterations; ++i) {
+      const int64_t start = MonotonicNanos();
+      std::vector<std::unique_ptr<blaze::RcFile>> rc_files;
+      const bool cached = blaze::RcFile::ReadCache(cache, &rc_files);
+      cache_ms.push_back(MillisSince(start));
+      if (!cached) {
+        errx(1, "the rc file cache %s is missing or out of date",
+             cache.c_str());
+      }
+    }
+    Report("rc_cache_depth_" + depth, cache_ms);
+  }
+}
+
+void BenchmarkExtractData(const std::string &work_dir,
+                          const std::string &bazel, int iterations) {
+  std::vector<std::string> archive_contents;
+  std::string install_md5;
+  blaze::DetermineArchiveContents(bazel, &archive_contents, &install_md5);
+  blaze::BazelStartupOptions startup_options;
+  blaze::LoggingInfo logging_info(bazel, 0);
+
+  const std::string dir = work_dir + "/extract";
+  RemoveTree(dir);
+  MakeDir(dir);
+  std::vector<double> cold_ms;
+  for (int i = 0; i < iterations; ++i) {
+    const std::string install_base = dir + "/cold";
+    startup_options.install_base = blaze_util::Path(install_base);
+    const int64_t start = MonotonicNanos();
+    blaze::ExtractData(bazel, archive_contents, install_md5, startup_options,
+                       &logging_info);
+    cold_ms.push_back(MillisSince(start));
+    RemoveTree(install_base);
+    unlink((install_base + ".verified").c_str());
+  }
+  Report("extract_cold", cold_ms);
+
+  // The first call verifies the extracted files, the others find the stamp.
+  startup_options.install_base = blaze_util::Path(dir + "/warm");
+  blaze::ExtractData(bazel, archive_contents, install_md5, startup_options,
+                     &logging_info);
+  std::vector<double> warm_ms;
+  for (int i = 0; i <= iterations; ++i) {
+    const int64_t start = MonotonicNanos();
+    blaze::ExtractData(bazel, archive_contents, install_md5, startup_options,
+                       &logging_info);
+    if (i > 0) {
+      warm_ms.push_back(MillisSince(start));
+    }
+  }
+  Report("extract_warm", warm_ms);
+}
+
+// Runs the client to completion with its output in `log`, and returns how
+// long that took.
+double RunClient(const std::vector<std::string> &args, const std::string &cwd,
+                 const std::string &log) {
+  const int64_t start = MonotonicNanos();
+  const pid_t pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  } else if (pid == 0) {
+    if (chdir(cwd.c_str()) < 0) {
+      err(1, "chdir(%s)", cwd.c_str());
+    }
+    int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+      err(1, "open(%s)", log.c_str());
+    }
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    setenv(kStubServerEnv, "1", 1);
+    std::vector<char *> argv;
+    for (const std::string &arg : args) {
+      argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    err(1, "execv(%s)", argv[0]);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) < 0) {
+    err(1, "waitpid");
+  }
+  const double millis = MillisSince(start);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    errx(1, "%s failed, see %s", args[0].c_str(), log.c_str());
+  }
+  return millis;
+}
+
+void BenchmarkLauncher(const std::string &work_dir, const std::string &bazel,
+                       const std::string &self, int iterations) {
+  const std::string dir = work_dir + "/launcher";
+  RemoveTree(dir);
+  MakeDir(dir + "/workspace");
+  WriteFile(dir + "/workspace/MODULE.bazel", "");
+  MakeDir(dir + "/javabase/bin");
+  if (symlink(self.c_str(), (dir + "/javabase/bin/java").c_str()) < 0) {
+    err(1, "symlink(%s)", self.c_str());
+  }
+  const std::string log = dir + "/client.log";
+
+  std::vector<std::string> args = {
+      bazel,
+      "--ignore_all_rc_files",
+      "--output_base=" + dir + "/output_base",
+      "--install_base=" + dir + "/install_base",
+      "--server_javabase=" + dir + "/javabase",
+      "--max_idle_secs=60",
+      "version",
+  };
+  Report("launcher_cold", {RunClient(args, dir + "/workspace", log)});
+
+  std::vector<double> warm_ms;
+  for (int i = 0; i < iterations; ++i) {
+    warm_ms.push_back(RunClient(args, dir + "/workspace", log));
+  }
+  Report("launcher_warm", warm_ms);
+
+  args.back() = "shutdown";
+  RunClient(args, dir + "/workspace", log);
+}
+
+// Compares the results with the baseline written by an earlier run with
+// --write_baseline. Returns false if one of them regressed.
+bool CheckBaseline(const std::string &baseline, double tolerance) {
+  std::ifstream file(baseline);
+  if (!file.is_open()) {
+    errx(1, "cannot read %s", baseline.c_str());
+  }
+  bool ok = true;
+  std::string name;
+  double expected_p50;
+  while (file >> name >> expected_p50) {
+    auto it = results.find(name);
+    if (it == results.end()) {
+      continue;
+    }
+    double limit = expected_p50 * (1 + tolerance / 100);
+    if (it->second > limit) {
+      fprintf(stderr, "%s regressed: %.2f ms, baseline %.2f ms\n",
+              name.c_str(), it->second, expected_p50);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void WriteBaseline(const std::string &baseline) {
+  std::string contents;
+  for (const auto &[name, p50] : results) {
+    contents += name + " " + std::to_string(p50) + "\n";
+  }
+  WriteFile(baseline, contents);
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage: client_benchmark --bazel PATH [--scenarios "
+          "rc,extract,launcher] [--rc_depth N,...] [--rc_fanout N] "
+          "[--iterations N] [--work_dir DIR] [--write_baseline FILE] "
+          "[--baseline FILE] [--tolerance PERCENT]\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (getenv(kStubServerEnv) != nullptr) {
+    return RunStubServer(argc, argv);
+  }
+
+  std::string bazel;
+  std::string scenarios = "rc,extract,launcher";
+  std::string rc_depth = "0,4,8";
+  int rc_fanout = 2;
+  int iterations = 20;
+  std::string baseline;
+  std::string write_baseline;
+  double tolerance = 20;
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  std::string work_dir = tmpdir ? tmpdir : "/tmp";
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    std::string flag = argv[i];
+    const char *value = argv[++i];
+    if (flag == "--bazel") {
+      bazel = value;
+    } else if (flag == "--scenarios") {
+      scenarios = value;
+    } else if (flag == "--rc_depth") {
+      rc_depth = value;
+    } else if (flag == "--rc_fanout") {
+      rc_fanout = atoi(value);
+    } else if (flag == "--iterations") {
+      iterations = atoi(value);
+    } else if (flag == "--work_dir") {
+      work_dir = value;
+    } else if (flag == "--baseline") {
+      baseline = value;
+    } else if (flag == "--write_baseline") {
+      write_baseline = value;
+    } else if (flag == "--tolerance") {
+      tolerance = atof(value);
+    } else {
+      Usage();
+    }
+  }
+  if (bazel.empty() || iterations < 1 || rc_fanout < 1) {
+    Usage();
+  }
+  // The client and the stub server need absolute paths, as they run in other
+  // directories.
+  bazel = blaze_util::MakeAbsolute(bazel);
+  work_dir = blaze_util::MakeAbsolute(work_dir) + "/client_benchmark";
+  MakeDir(work_dir);
+
+  char self[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (length < 0) {
+    err(1, "readlink(/proc/self/exe)");
+  }
+  self[length] = '\0';
+
+  printf("%-24s %9s %9s\n", "measurement", "p50_ms", "p99_ms");
+  for (const std::string &scenario : Split(scenarios)) {
+    if (scenario == "rc") {
+      BenchmarkRcFiles(work_dir, Split(rc_depth), rc_fanout, iterations);
+    } else if (scenario == "extract") {
+      BenchmarkExtractData(work_dir, bazel, iterations);
+    } else if (scenario == "launcher") {
+      BenchmarkLauncher(work_dir, bazel, self, iterations);
+    } else {
+      Usage();
+    }
+  }
+  RemoveTree(work_dir);
+
+  if (!write_baseline.empty()) {
+    WriteBaseline(write_baseline);
+  }
+  if (!baseline.empty() && !CheckBaseline(baseline, tolerance)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,58 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "src/main/cpp/archive_utils.h"
+#include "src/main/cpp/info_cache.h"
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze {
+
+static const char kCache[] =
+    "release=release 8.0.0\n"
+    "workspace=/home/user/ws\n"
+    "output_base=/tmp/out=base\n";
+
+TEST(InfoCacheTest, SingleKeyPrintsOnlyTheValue) {
+  std::string output;
+  ASSERT_TRUE(AnswerInfoFromCache(kCache, {"workspace"}, &output));
+  EXPECT_EQ("/home/user/ws\n", output);
+}
+
+TEST(InfoCacheTest, SeveralKeysArePrefixedWithTheirName) {
+  std::string output;
+  ASSERT_TRUE(
+      AnswerInfoFromCache(kCache, {"release", "output_base"}, &output));
+  EXPECT_EQ("release: release 8.0.0\noutput_base: /tmp/out=base\n", output);
+}
+
+TEST(InfoCacheTest, FailsIfAnyKeyIsMissing) {
+  std::string output = "unchanged";
+  EXPECT_FALSE(
+      AnswerInfoFromCache(kCache, {"workspace", "execution_root"}, &output));
+  EXPECT_EQ("unchanged", output);
+}
+
+TEST(InfoCacheTest, FailsWithoutKeys) {
+  std::string output;
+  EXPECT_FALSE(AnswerInfoFromCache(kCache, {}, &output));
+}
+
+TEST(InfoCacheTest, FailsOnEmptyCache) {
+  std::string output;
+  EXPECT_FALSE(AnswerInfoFromCache("", {"release"}, &output));
+}
+
+}  // namespace blaze
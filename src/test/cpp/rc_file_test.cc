@@ -936,6 +936,53 @@ TEST_F(BlazercImportTest, TryImportingAFileAndPassingItInCausesAWarning) {
   TestThatImportingAFileAndPassingItInCausesAWarning("try-import");
 }
 
+TEST_F(BlazercImportTest, SeveralImportsMaintainFlagOrdering) {
+  const std::string first_rc_path =
+      blaze_util::JoinPath(workspace_, "firstimportedbazelrc");
+  const std::string second_rc_path =
+      blaze_util::JoinPath(workspace_, "secondimportedbazelrc");
+  const std::string nested_rc_path =
+      blaze_util::JoinPath(workspace_, "nestedimportedbazelrc");
+  ASSERT_TRUE(blaze_util::WriteFile(
+      "startup --max_idle_secs=1\n"
+      "import " + nested_rc_path,
+      first_rc_path, 0755));
+  ASSERT_TRUE(blaze_util::WriteFile("startup --max_idle_secs=2",
+                                    nested_rc_path, 0755));
+  ASSERT_TRUE(blaze_util::WriteFile("startup --io_nice_level=3",
+                                    second_rc_path, 0755));
+
+  std::string workspace_rc;
+  ASSERT_TRUE(SetUpWorkspaceRcFile(
+      "import " + first_rc_path + "\n"
+      "try-import %workspace%/missingbazelrc\n"
+      "import %workspace%/secondimportedbazelrc\n"
+      "startup --io_nice_level=4",
+      &workspace_rc));
+
+  const std::vector<std::string> args = {"bazel", "build"};
+  ParseOptionsAndCheckOutput(args, blaze_exit_code::SUCCESS, "", "");
+
+  EXPECT_EQ(2, option_processor_->GetParsedStartupOptions()->max_idle_secs);
+  EXPECT_EQ(4, option_processor_->GetParsedStartupOptions()->io_nice_level);
+
+  testing::internal::CaptureStderr();
+  option_processor_->PrintStartupOptionsProvenanceMessage();
+  const std::string output = testing::internal::GetCapturedStderr();
+
+  EXPECT_THAT(
+      output,
+      MatchesRegex(
+          "INFO: Reading 'startup' options from .*firstimportedbazelrc: "
+          "--max_idle_secs=1\n"
+          "INFO: Reading 'startup' options from .*nestedimportedbazelrc: "
+          "--max_idle_secs=2\n"
+          "INFO: Reading 'startup' options from .*secondimportedbazelrc: "
+          "--io_nice_level=3\n"
+          "INFO: Reading 'startup' options from .*workspace.*bazelrc: "
+          "--io_nice_level=4\n"));
+}
+
 // TODO(b/112908763): Somehow, in the following tests, we end with a relative
 // path written in the import line on Windows. Figure out what's going on and
 // reinstate these tests
@@ -12,6 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#ifndef _WIN32
+#include <utime.h>
+#endif
+
 #include <cstddef>
 #include <memory>
 #include <string>
@@ -567,5 +571,58 @@ TEST(RemoteFileTest, ParsingRemoteFiles) {
                                                    "--max_idle_secs=123")))))));
 }
 
+TEST_F(RcOptionsTest, CacheSkipsRecentlyModifiedFiles) {
+  WriteRc("recent.bazelrc", "startup --foo");
+  RcFile::ParseError error;
+  std::string error_text;
+  std::vector<std::unique_ptr<RcFile>> rc_files;
+  rc_files.push_back(Parse("recent.bazelrc", &error, &error_text));
+  ASSERT_EQ(error, RcFile::ParseError::NONE);
+
+  // A change within the same second as the parse would go unnoticed.
+  std::string cache_path = blaze_util::JoinPath(test_file_dir_, "cache");
+  RcFile::WriteCache(cache_path, rc_files);
+  std::vector<std::unique_ptr<RcFile>> cached;
+  EXPECT_FALSE(RcFile::ReadCache(cache_path, &cached));
+}
+
+#ifndef _WIN32
+TEST_F(RcOptionsTest, CacheIsInvalidatedByChanges) {
+  WriteRc("main.bazelrc",
+          "try-import %workspace%/missing.bazelrc\n"
+          "import %workspace%/imported.bazelrc\n"
+          "startup --foo");
+  WriteRc("imported.bazelrc", "build --bar");
+  for (const char* name : {"main.bazelrc", "imported.bazelrc"}) {
+    struct utimbuf times = {1000000000, 1000000000};
+    std::string path = blaze_util::JoinPath(test_file_dir_, name);
+    ASSERT_EQ(0, utime(path.c_str(), &times));
+  }
+  RcFile::ParseError error;
+  std::string error_text;
+  std::vector<std::unique_ptr<RcFile>> rc_files;
+  rc_files.push_back(Parse("main.bazelrc", &error, &error_text));
+  ASSERT_EQ(error, RcFile::ParseError::NONE);
+
+  std::string cache_path = blaze_util::JoinPath(test_file_dir_, "cache");
+  RcFile::WriteCache(cache_path, rc_files);
+  std::vector<std::unique_ptr<RcFile>> cached;
+  ASSERT_TRUE(RcFile::ReadCache(cache_path, &cached));
+  ASSERT_EQ(cached.size(), 1);
+  EXPECT_EQ(cached[0]->canonical_source_paths(),
+            rc_files[0]->canonical_source_paths());
+  EXPECT_THAT(cached[0]->options(),
+              UnorderedElementsAre(
+                  Pair("startup", ElementsAre(Field(&RcOption::option,
+                                                    "--foo"))),
+                  Pair("build", ElementsAre(Field(&RcOption::option,
+                                                  "--bar")))));
+
+  // Creating the file that was missing invalidates the cache.
+  WriteRc("missing.bazelrc", "build --baz");
+  EXPECT_FALSE(RcFile::ReadCache(cache_path, &cached));
+}
+#endif  // !_WIN32
+
 }  // namespace
 }  // namespace blaze
@@ -226,4 +226,34 @@ TEST_F(StartupOptionsTest, ProcessArgsWithMultipleArgstest) {
             startup_options_->original_startup_options_[1].value);
 }
 
+#ifdef __linux__
+TEST_F(StartupOptionsTest, ProcessServerPlacementArgsTest) {
+  const std::vector<RcStartupFlag> flags{
+      RcStartupFlag("somewhere", "--experimental_server_cpus=0-7,16-23"),
+      RcStartupFlag("somewhere", "--experimental_server_numa_node=1"),
+      RcStartupFlag("somewhere",
+                    "--experimental_server_transparent_huge_pages")};
+
+  std::string error;
+  const blaze_exit_code::ExitCode ec =
+      startup_options_->ProcessArgs(flags, &error);
+  ASSERT_EQ(ec, blaze_exit_code::SUCCESS)
+      << "ProcessArgs failed with error " << error;
+  EXPECT_EQ("0-7,16-23", startup_options_->server_cpus);
+  EXPECT_EQ(1, startup_options_->server_numa_node);
+  EXPECT_TRUE(startup_options_->server_transparent_huge_pages);
+}
+
+TEST_F(StartupOptionsTest, ProcessIncorrectServerNumaNodeTest) {
+  const std::vector<RcStartupFlag> flags{
+      RcStartupFlag("somewhere", "--experimental_server_numa_node=-2")};
+
+  std::string error;
+  const blaze_exit_code::ExitCode ec =
+      startup_options_->ProcessArgs(flags, &error);
+  ASSERT_EQ(blaze_exit_code::BAD_ARGV, ec)
+      << "ProcessArgs failed with the wrong error " << error;
+}
+#endif
+
 }  // namespace blaze
@@ -18,6 +18,7 @@
 #include <algorithm>
 #include <map>
 #include <memory>
+#include <string>
 #include <thread>  // NOLINT (to silence Google-internal linter)
 #include <vector>
 
@@ -307,6 +308,39 @@ TEST(FilePosixTest, GetAllFilesUnder) {
   EXPECT_TRUE(RemoveRecursively(root));
 }
 
+TEST(FilePosixTest, GetAllFilesUnderWideTree) {
+  const char* tmpdir_cstr = getenv("TEST_TMPDIR");
+  ASSERT_NE(tmpdir_cstr, nullptr);
+  Path tmpdir(tmpdir_cstr);
+  ASSERT_TRUE(PathExists(tmpdir));
+
+  // Enough directories that several threads take part in the walk.
+  Path root = tmpdir.GetRelative("FilePosixTest.GetAllFilesUnderWideTree.root");
+  std::vector<Path> expected;
+  for (int i = 0; i < 20; ++i) {
+    Path dir = root.GetRelative("dir" + std::to_string(i));
+    for (int j = 0; j < 5; ++j) {
+      Path subdir = dir.GetRelative("subdir" + std::to_string(j));
+      ASSERT_TRUE(MakeDirectories(subdir, 0700));
+      Path file = subdir.GetRelative("file");
+      ASSERT_TRUE(WriteFile("", file));
+      expected.push_back(file);
+    }
+    Path file = dir.GetRelative("file");
+    ASSERT_TRUE(WriteFile("", file));
+    expected.push_back(file);
+  }
+  ASSERT_TRUE(MakeDirectories(root.GetRelative("empty"), 0700));
+
+  std::vector<Path> result;
+  GetAllFilesUnder(root, &result);
+  std::sort(result.begin(), result.end());
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(expected, result);
+
+  EXPECT_TRUE(RemoveRecursively(root));
+}
+
 TEST(FileTest, IsDevNullTest) {
   ASSERT_TRUE(IsDevNull("/dev/null"));
   ASSERT_FALSE(IsDevNull("dev/null"));
@@ -0,0 +1,93 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/filesystem_capabilities.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+TEST(FilesystemCapabilitiesTest, CachesByDevice) {
+  const char* tempdir = getenv("TEST_TMPDIR");
+  ASSERT_NE(tempdir, nullptr);
+  std::string path = std::string(tempdir) + "/file";
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  ASSERT_NE(fd, -1);
+
+  const FilesystemCapabilities& of_dir = GetFilesystemCapabilities(tempdir);
+  EXPECT_EQ(&GetFilesystemCapabilities(fd), &of_dir);
+  EXPECT_EQ(&GetFilesystemCapabilities(path.c_str()), &of_dir);
+  EXPECT_FALSE(of_dir.read_only());
+  close(fd);
+}
+
+TEST(FilesystemCapabilitiesTest, ConcurrentLookupsAgree) {
+  const char* tempdir = getenv("TEST_TMPDIR");
+  ASSERT_NE(tempdir, nullptr);
+  std::vector<const FilesystemCapabilities*> found(8);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < found.size(); ++i) {
+    threads.emplace_back([&found, i, tempdir] {
+      found[i] = &GetFilesystemCapabilities(tempdir);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (const FilesystemCapabilities* capabilities : found) {
+    EXPECT_EQ(capabilities, found[0]);
+  }
+}
+
+TEST(FilesystemCapabilitiesTest, MissingFileHasNoCapabilities) {
+  const char* tempdir = getenv("TEST_TMPDIR");
+  ASSERT_NE(tempdir, nullptr);
+  const FilesystemCapabilities& capabilities = GetFilesystemCapabilities(
+      (std::string(tempdir) + "/does/not/exist").c_str());
+  EXPECT_EQ(capabilities.type(), "");
+  EXPECT_FALSE(capabilities.Has(kFsCopyFileRange));
+  EXPECT_FALSE(capabilities.Has(kFsCaseSensitive));
+}
+
+TEST(FilesystemCapabilitiesTest, SetUnsupportedSticks) {
+  const char* tempdir = getenv("TEST_TMPDIR");
+  ASSERT_NE(tempdir, nullptr);
+  const FilesystemCapabilities& capabilities =
+      GetFilesystemCapabilities(tempdir);
+  bool symlinks = capabilities.Has(kFsSymlinks);
+  capabilities.SetUnsupported(kFsCloneFile);
+  EXPECT_FALSE(GetFilesystemCapabilities(tempdir).Has(kFsCloneFile));
+  EXPECT_EQ(GetFilesystemCapabilities(tempdir).Has(kFsSymlinks), symlinks);
+}
+
+#if defined(__linux__)
+TEST(FilesystemCapabilitiesTest, KnowsProc) {
+  const FilesystemCapabilities& capabilities =
+      GetFilesystemCapabilities("/proc/self");
+  EXPECT_EQ(capabilities.type(), "proc");
+  EXPECT_FALSE(capabilities.remote());
+  EXPECT_FALSE(capabilities.Has(kFsCopyFileRange));
+  EXPECT_TRUE(capabilities.Has(kFsCaseSensitive));
+}
+#endif
+
+}  // namespace blaze_util
@@ -14,6 +14,7 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
 
 #include "src/main/cpp/blaze_util_platform.h"
@@ -414,6 +415,71 @@ TEST(LoggingTest, BazelLogHandler_BufferedLogsGetDirectedToCerr) {
   EXPECT_THAT(stderr_output, HasSubstr(teststring));
 }
 
+// Tests for the bounds on the BazelLogHandler's buffers.
+
+TEST(LoggingTest, BazelLogHandler_DropsOldestBufferedLogsWhenFull) {
+  testing::internal::CaptureStderr();
+  std::unique_ptr<blaze_util::BazelLogHandler> handler(
+      new blaze_util::BazelLogHandler(/* max_buffered_bytes= */ 512));
+  blaze_util::SetLogHandler(std::move(handler));
+
+  // Each debug line is at least 100 bytes long, so only the last few fit.
+  for (int i = 0; i < 20; ++i) {
+    BAZEL_LOG(INFO) << "buffered message #" << i << " " << std::string(80, '.');
+  }
+
+  std::unique_ptr<std::stringstream> stringbuf(new std::stringstream());
+  blaze_util::SetLoggingDetail(LOGGINGDETAIL_DEBUG, stringbuf.get());
+  blaze_util::CloseLogging();
+
+  EXPECT_THAT(stringbuf->str(), Not(HasSubstr("buffered message #0 ")));
+  EXPECT_THAT(stringbuf->str(), HasSubstr("buffered message #19 "));
+  EXPECT_THAT(stringbuf->str(),
+              HasSubstr("log message(s) dropped because the log buffer was "
+                        "full"));
+
+  blaze_util::SetLogHandler(nullptr);
+  testing::internal::GetCapturedStderr();
+}
+
+TEST(LoggingTest, BazelLogHandler_KeepsUserLogsWhenBufferIsFull) {
+  testing::internal::CaptureStderr();
+  std::unique_ptr<blaze_util::BazelLogHandler> handler(
+      new blaze_util::BazelLogHandler(/* max_buffered_bytes= */ 512));
+  blaze_util::SetLogHandler(std::move(handler));
+
+  BAZEL_LOG(WARNING) << "warning that must not be dropped";
+  for (int i = 0; i < 20; ++i) {
+    BAZEL_LOG(INFO) << "buffered message #" << i << " " << std::string(80, '.');
+  }
+
+  blaze_util::SetLoggingDetail(LOGGINGDETAIL_USER, nullptr);
+  std::string stderr_output = testing::internal::GetCapturedStderr();
+  EXPECT_THAT(stderr_output,
+              HasSubstr("WARNING: warning that must not be dropped"));
+  EXPECT_THAT(stderr_output, Not(HasSubstr("buffered message")));
+}
+
+TEST(LoggingTest, BazelLogHandler_FlushLoggingWritesQueuedLogs) {
+  std::unique_ptr<blaze_util::BazelLogHandler> handler(
+      new blaze_util::BazelLogHandler());
+  blaze_util::SetLogHandler(std::move(handler));
+
+  std::unique_ptr<std::stringstream> stringbuf(new std::stringstream());
+  blaze_util::SetLoggingDetail(LOGGINGDETAIL_DEBUG, stringbuf.get());
+  for (int i = 0; i < 100; ++i) {
+    BAZEL_LOG(INFO) << "queued message #" << i;
+  }
+
+  // The writer thread is idle after FlushLogging, so the stream can be read
+  // without closing the logging.
+  blaze_util::FlushLogging();
+  EXPECT_THAT(stringbuf->str(), HasSubstr("queued message #0\n"));
+  EXPECT_THAT(stringbuf->str(), HasSubstr("queued message #99\n"));
+
+  blaze_util::SetLogHandler(nullptr);
+}
+
 // We use the LoggingDeathTest test case to make sure that the death tests are
 // run in a single threaded environment, where it is safe to fork. These tests
 // are run before the other tests, which can be run in parallel.
@@ -0,0 +1,144 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/output_forwarder.h"
+
+#include <chrono>  // NOLINT
+#include <future>  // NOLINT
+#include <mutex>   // NOLINT
+#include <string>
+#include <vector>
+
+#include "src/main/cpp/util/file_platform.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+// Records the batches written, optionally blocking the first write until
+// `release` is fulfilled.
+class FakeOutput {
+ public:
+  explicit FakeOutput(bool block = false) : block_(block) {
+    if (!block_) {
+      release.set_value();
+    }
+  }
+
+  OutputForwarder::WriteFn WriteFn() {
+    return [this](const std::vector<std::string> &chunks, bool to_stdout) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!started_set_) {
+          started_set_ = true;
+          started_.set_value();
+        }
+      }
+      release_future_.wait();
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::string batch = to_stdout ? "out:" : "err:";
+      for (const auto &chunk : chunks) {
+        batch += chunk;
+      }
+      batches_.push_back(batch);
+      return to_stdout ? result_ : static_cast<int>(WriteResult::SUCCESS);
+    };
+  }
+
+  std::vector<std::string> batches() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+  }
+
+  void WaitUntilStarted() { started_future_.wait(); }
+
+  void set_stdout_result(int result) { result_ = result; }
+
+  std::promise<void> release;
+
+ private:
+  const bool block_;
+  std::mutex mutex_;
+  std::vector<std::string> batches_;
+  std::promise<void> started_;
+  std::shared_future<void> started_future_ = started_.get_future().share();
+  std::shared_future<void> release_future_ = release.get_future().share();
+  int result_ = WriteResult::SUCCESS;
+  bool started_set_ = false;
+};
+
+TEST(OutputForwarderTest, CoalescesQueuedChunksOfAStream) {
+  FakeOutput fake(/* block= */ true);
+  {
+    OutputForwarder output(OutputForwarder::kMaxPendingBytes, fake.WriteFn());
+    output.Write("a", /* to_stdout= */ true);
+    fake.WaitUntilStarted();
+    // These queue up while "a" is being written.
+    output.Write("b", /* to_stdout= */ true);
+    output.Write("c", /* to_stdout= */ true);
+    output.Write("d", /* to_stdout= */ false);
+    output.Write("e", /* to_stdout= */ true);
+    fake.release.set_value();
+    output.Flush();
+    EXPECT_EQ(nullptr, output.BrokenPipeName());
+  }
+  EXPECT_EQ(fake.batches(), (std::vector<std::string>{"out:a", "out:bc",
+                                                       "err:d", "out:e"}));
+}
+
+TEST(OutputForwarderTest, WritesEverythingBeforeDestruction) {
+  FakeOutput fake;
+  {
+    OutputForwarder output(OutputForwarder::kMaxPendingBytes, fake.WriteFn());
+    for (int i = 0; i < 1000; ++i) {
+      output.Write("x", /* to_stdout= */ true);
+    }
+  }
+  std::string written;
+  for (const auto &batch : fake.batches()) {
+    ASSERT_EQ("out:", batch.substr(0, 4));
+    written += batch.substr(4);
+  }
+  EXPECT_EQ(std::string(1000, 'x'), written);
+}
+
+TEST(OutputForwarderTest, BlocksWhileTooMuchIsPending) {
+  FakeOutput fake(/* block= */ true);
+  OutputForwarder output(/* max_pending_bytes= */ 2, fake.WriteFn());
+  output.Write("ab", /* to_stdout= */ true);
+  fake.WaitUntilStarted();
+  std::future<void> blocked = std::async(std::launch::async, [&output] {
+    output.Write("c", /* to_stdout= */ true);
+  });
+  EXPECT_EQ(std::future_status::timeout,
+            blocked.wait_for(std::chrono::milliseconds(100)));
+  fake.release.set_value();
+  blocked.wait();
+  output.Flush();
+  EXPECT_EQ(fake.batches(), (std::vector<std::string>{"out:ab", "out:c"}));
+}
+
+TEST(OutputForwarderTest, DropsOutputForBrokenPipe) {
+  FakeOutput fake;
+  fake.set_stdout_result(WriteResult::BROKEN_PIPE);
+  OutputForwarder output(OutputForwarder::kMaxPendingBytes, fake.WriteFn());
+  output.Write("a", /* to_stdout= */ true);
+  output.Flush();
+  EXPECT_STREQ("standard output", output.BrokenPipeName());
+  output.Write("b", /* to_stdout= */ true);
+  output.Write("c", /* to_stdout= */ false);
+  output.Flush();
+  EXPECT_EQ(fake.batches(), (std::vector<std::string>{"out:a", "err:c"}));
+}
+
+}  // namespace blaze_util
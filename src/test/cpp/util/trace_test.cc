@@ -0,0 +1,57 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/main/cpp/util/trace.h"
+
+#include <stdlib.h>
+
+#include <string>
+#include <thread>  // NOLINT
+
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/path_platform.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace blaze_util {
+
+TEST(TraceTest, RecordsSpans) {
+  {
+    TraceSpan outer("outer");
+    { TraceSpan inner("inner \"quoted\""); }
+    std::thread([] { TraceSpan span("other thread"); }).join();
+  }
+  std::string json = GetTraceJson();
+  EXPECT_NE(json.find("\"profile_start_ts\":"), std::string::npos);
+  EXPECT_NE(json.find("\"name\":\"outer\",\"cat\":\"client\",\"ph\":\"X\""),
+            std::string::npos);
+  EXPECT_NE(json.find("\"name\":\"inner \\\"quoted\\\"\""), std::string::npos);
+  EXPECT_NE(json.find("\"name\":\"other thread\""), std::string::npos);
+  // The inner span ends first, so it is listed before the outer one.
+  EXPECT_LT(json.find("\"inner"), json.find("\"outer\""));
+}
+
+TEST(TraceTest, WritesTraceFile) {
+  const char* tempdir = getenv("TEST_TMPDIR");
+  ASSERT_NE(tempdir, nullptr);
+  Path path = Path(tempdir).GetRelative("trace.json");
+  { TraceSpan span("written"); }
+  SetTraceFile(path);
+  WriteTrace();
+  std::string content;
+  ASSERT_TRUE(ReadFile(path, &content));
+  EXPECT_EQ(GetTraceJson(), content);
+  EXPECT_NE(content.find("\"written\""), std::string::npos);
+}
+
+}  // namespace blaze_util
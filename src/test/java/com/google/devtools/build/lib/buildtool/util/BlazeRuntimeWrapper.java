@@ -430,6 +430,7 @@ public class BlazeRuntimeWrapper {
                 /* collectSystemNetworkUsage= */ false,
                 /* collectResourceManagerEstimation= */ false,
                 /* collectPressureStallIndicators= */ false,
+                /* collectProcessStats= */ false,
                 /* collectSkyframeCounts= */ false));
 
     StoredEventHandler storedEventHandler = new StoredEventHandler();
@@ -16,6 +16,7 @@ package com.google.devtools.build.lib.exec;
 
 import static com.google.common.truth.Truth.assertThat;
 import static com.google.devtools.build.lib.testutil.TestConstants.WORKSPACE_NAME;
+import static java.nio.charset.StandardCharsets.ISO_8859_1;
 import static java.nio.charset.StandardCharsets.UTF_8;
 
 import com.google.common.collect.ImmutableList;
@@ -27,6 +28,7 @@ import com.google.devtools.build.lib.actions.FilesetOutputSymlink;
 import com.google.devtools.build.lib.actions.util.ActionsTestUtil;
 import com.google.devtools.build.lib.shell.Command;
 import com.google.devtools.build.lib.vfs.DigestHashFunction;
+import com.google.devtools.build.lib.vfs.FileStatus;
 import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.FileSystemUtils;
 import com.google.devtools.build.lib.vfs.Path;
@@ -34,6 +36,8 @@ import com.google.devtools.build.lib.vfs.PathFragment;
 import com.google.devtools.build.lib.vfs.inmemoryfs.InMemoryFileSystem;
 import com.google.testing.junit.testparameterinjector.TestParameter;
 import com.google.testing.junit.testparameterinjector.TestParameterInjector;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.HashMap;
 import java.util.Map;
 import org.junit.Before;
@@ -188,4 +192,57 @@ public final class SymlinkTreeHelperTest {
     assertThat(treeSymlink.readSymbolicLink()).isEqualTo(PathFragment.create("/path/to/target"));
     assertThat(treeMissing.exists()).isFalse();
   }
+
+  @Test
+  public void writeRunfilesIndex() throws Exception {
+    Path treeRoot = execRoot.getRelative("foo.runfiles");
+    Path inputManifestPath = execRoot.getRelative("foo.runfiles_manifest");
+    Path outputManifestPath = execRoot.getRelative("foo.runfiles/MANIFEST");
+    SymlinkTreeHelper helper =
+        new SymlinkTreeHelper(
+            execRoot, inputManifestPath, outputManifestPath, treeRoot, false, WORKSPACE_NAME);
+
+    Artifact file = ActionsTestUtil.createArtifact(outputRoot, "file");
+    Artifact symlink = ActionsTestUtil.createUnresolvedSymlinkArtifact(outputRoot, "symlink");
+    FileSystemUtils.ensureSymbolicLink(symlink.getPath(), "/path/to/target");
+    treeRoot.createDirectoryAndParents();
+    FileSystemUtils.writeContent(outputManifestPath, UTF_8, "manifest contents\n");
+
+    HashMap<PathFragment, Artifact> symlinkMap = new HashMap<>();
+    symlinkMap.put(PathFragment.create("b/symlink"), symlink);
+    symlinkMap.put(PathFragment.create("a/file"), file);
+    symlinkMap.put(PathFragment.create("a/empty"), null);
+
+    helper.writeRunfilesIndex(symlinkMap);
+
+    Path index = treeRoot.getRelative("MANIFEST.index");
+    assertThat(treeRoot.getRelative("MANIFEST.index.tmp").exists()).isFalse();
+    byte[] bytes = FileSystemUtils.readContent(index);
+    ByteBuffer buffer = ByteBuffer.wrap(bytes).order(ByteOrder.nativeOrder());
+    byte[] magic = new byte[8];
+    buffer.get(magic);
+    assertThat(new String(magic, ISO_8859_1)).isEqualTo("RFINDEX2");
+    assertThat(buffer.getInt()).isEqualTo(3);
+    int stringsOffset = buffer.getInt();
+    assertThat(stringsOffset).isEqualTo(32 + 3 * 16);
+    FileStatus manifestStatus = outputManifestPath.stat();
+    assertThat(buffer.getLong()).isEqualTo(manifestStatus.getSize());
+    assertThat(buffer.getLong()).isEqualTo(manifestStatus.getLastModifiedTime());
+
+    String[][] expected = {
+      {"a/empty", ""},
+      {"a/file", file.getPath().getPathString()},
+      {"b/symlink", "/path/to/target"},
+    };
+    for (String[] entry : expected) {
+      int pathOffset = buffer.getInt();
+      int pathLength = buffer.getInt();
+      int targetOffset = buffer.getInt();
+      int targetLength = buffer.getInt();
+      assertThat(new String(bytes, stringsOffset + pathOffset, pathLength, ISO_8859_1))
+          .isEqualTo(entry[0]);
+      assertThat(new String(bytes, stringsOffset + targetOffset, targetLength, ISO_8859_1))
+          .isEqualTo(entry[1]);
+    }
+  }
 }
@@ -67,7 +67,14 @@ public final class SymlinkTreeStrategyTest extends BuildViewTestCase {
     StoredEventHandler eventHandler = new StoredEventHandler();
 
     when(context.getContext(SymlinkTreeActionContext.class))
-        .thenReturn(new SymlinkTreeStrategy(outputService, getExecRoot(), null, "__main__"));
+        .thenReturn(
+            new SymlinkTreeStrategy(
+                outputService,
+                getExecRoot(),
+                null,
+                "__main__",
+                /* projectedSymlinkTrees= */ false,
+                /* runfilesIndex= */ false));
     when(context.getInputPath(any())).thenAnswer((i) -> ((Artifact) i.getArgument(0)).getPath());
     when(context.getPathResolver()).thenReturn(ArtifactPathResolver.IDENTITY);
     when(context.getEventHandler()).thenReturn(eventHandler);
@@ -125,13 +132,30 @@ public final class SymlinkTreeStrategyTest extends BuildViewTestCase {
 
   @Test
   public void inprocessSymlinkCreation() throws Exception {
+    runInprocessSymlinkCreation(/* projectedSymlinkTrees= */ false);
+  }
+
+  @Test
+  public void inprocessSymlinkCreation_fileSystemCannotProject_createsSymlinks() throws Exception {
+    // The in-memory file system cannot present trees virtually, so symlinks are created instead.
+    runInprocessSymlinkCreation(/* projectedSymlinkTrees= */ true);
+  }
+
+  private void runInprocessSymlinkCreation(boolean projectedSymlinkTrees) throws Exception {
     ActionExecutionContext context = mock(ActionExecutionContext.class);
     OutputService outputService = mock(OutputService.class);
     StoredEventHandler eventHandler = new StoredEventHandler();
 
     when(context.getExecRoot()).thenReturn(getExecRoot());
     when(context.getContext(SymlinkTreeActionContext.class))
-        .thenReturn(new SymlinkTreeStrategy(outputService, getExecRoot(), null, "__main__"));
+        .thenReturn(
+            new SymlinkTreeStrategy(
+                outputService,
+                getExecRoot(),
+                null,
+                "__main__",
+                projectedSymlinkTrees,
+                /* runfilesIndex= */ false));
     when(context.getInputPath(any())).thenAnswer((i) -> ((Artifact) i.getArgument(0)).getPath());
     when(context.getEventHandler()).thenReturn(eventHandler);
     when(outputService.canCreateSymlinkTree()).thenReturn(false);
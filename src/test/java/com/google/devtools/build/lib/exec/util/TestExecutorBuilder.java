@@ -73,7 +73,13 @@ public class TestExecutorBuilder {
     addContext(TemplateExpansionContext.class, new LocalTemplateExpansionStrategy());
     addContext(
         SymlinkTreeActionContext.class,
-        new SymlinkTreeStrategy(null, execRoot, binTools, "__main__"));
+        new SymlinkTreeStrategy(
+            null,
+            execRoot,
+            binTools,
+            "__main__",
+            /* projectedSymlinkTrees= */ false,
+            /* runfilesIndex= */ false));
     addContext(SpawnStrategyResolver.class, new SpawnStrategyResolver());
   }
 
@@ -54,6 +54,7 @@ public class GlobCacheTest {
   private Path buildFile;
   private ExecutorService cacheThreadPool;
   private GlobCache cache;
+  private boolean nativeGlobbing = false;
 
   @Before
   public final void createFiles() throws Exception  {
@@ -133,6 +134,7 @@ public class GlobCacheTest {
             SyscallCache.NO_CACHE,
             cacheThreadPool,
             -1,
+            nativeGlobbing,
             ThreadStateReceiver.NULL_INSTANCE);
   }
 
@@ -242,6 +244,16 @@ public class GlobCacheTest {
         "foo/second.js", "bar/second.js");
   }
 
+  @Test
+  public void testNativeGlobbing_fallsBackWithoutNativeSupport() throws Exception {
+    // The in-memory file system of the test has no native glob.
+    nativeGlobbing = true;
+    createCache(PathFragment.create("isolated/foo"));
+    assertThat(cache.getGlobUnsorted("**/*.js"))
+        .containsExactly("first.js", "second.js", "bar/first.js", "bar/second.js");
+    assertThat(cache.getGlobUnsorted("**", Globber.Operation.SUBPACKAGES)).containsExactly("sub");
+  }
+
   @Test
   public void testSingleFileExclude_star() throws Exception {
     assertThat(
@@ -2080,6 +2080,7 @@ my_macro = macro(implementation = _impl)
               SyscallCache.NO_CACHE,
               executorService,
               -1,
+              /* nativeGlobbing= */ false,
               ThreadStateReceiver.NULL_INSTANCE);
       assertThat(globCache.globUnsorted(include, exclude, Globber.Operation.FILES_AND_DIRS, true))
           .containsExactlyElementsIn(expected);
@@ -127,6 +127,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     return buffer;
   }
@@ -156,6 +157,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
   }
 
@@ -270,6 +272,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c = profiler.profile(ProfilerTask.ACTION, "action task")) {
       // Next task takes less than 10 ms but should be recorded anyway.
@@ -368,6 +371,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     metricsCollected.await(10, TimeUnit.SECONDS);
     profiler.stop();
@@ -408,6 +412,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTask(10000, 20000, ProfilerTask.VFS_STAT, "stat");
     // Unlike the VFS_STAT event above, the remote execution event will not be recorded since we
@@ -542,6 +547,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTask(10000, 20000, ProfilerTask.VFS_STAT, "stat");
 
@@ -749,6 +755,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTask(badClock.nanoTime(), ProfilerTask.INFO, "some task");
     profiler.stop();
@@ -804,6 +811,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTaskDuration(
         Profiler.nanoTimeMaybe(), Duration.ofSeconds(10), ProfilerTask.INFO, "foo");
@@ -844,6 +852,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     profiler.logSimpleTaskDuration(
         Profiler.nanoTimeMaybe(), Duration.ofSeconds(10), ProfilerTask.INFO, "foo");
@@ -879,6 +888,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c =
         profiler.profileAction(
@@ -929,6 +939,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c =
         profiler.profileAction(
@@ -979,6 +990,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     try (SilentCloseable c =
         profiler.profileAction(
@@ -1022,6 +1034,7 @@ public final class ProfilerTest {
             /* collectSystemNetworkUsage= */ false,
             /* collectResourceManagerEstimation= */ false,
             /* collectPressureStallIndicators= */ false,
+            /* collectProcessStats= */ false,
             /* collectSkyframeCounts= */ false));
     long curTime = Profiler.nanoTimeMaybe();
     for (int i = 0; i < 100_000; i++) {
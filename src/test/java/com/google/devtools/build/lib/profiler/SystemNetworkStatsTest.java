@@ -13,10 +13,16 @@
 // limitations under the License.
 package com.google.devtools.build.lib.profiler;
 
+import static com.google.common.truth.Truth.assertThat;
+import static com.google.common.truth.TruthJUnit.assume;
 import static com.google.devtools.build.lib.profiler.SystemNetworkStats.getNetIfAddrs;
 import static com.google.devtools.build.lib.profiler.SystemNetworkStats.getNetIoCounters;
 
+import com.google.devtools.build.lib.profiler.SystemNetworkStats.NetIoCounter;
+import com.google.devtools.build.lib.util.OS;
 import java.io.IOException;
+import java.util.HashMap;
+import java.util.Map;
 import org.junit.Test;
 import org.junit.runner.RunWith;
 import org.junit.runners.JUnit4;
@@ -31,6 +37,25 @@ public class SystemNetworkStatsTest {
     getNetIoCounters();
   }
 
+  @Test
+  public void getNetIoCounters_onLinux_matchesProcNetDev() throws IOException {
+    assume().that(OS.getCurrent()).isEqualTo(OS.LINUX);
+    Map<String, NetIoCounter> expected = new HashMap<>();
+    SystemNetworkStats.getNetIoCountersLinux(expected);
+
+    Map<String, NetIoCounter> counters = getNetIoCounters();
+
+    assertThat(counters.keySet()).isEqualTo(expected.keySet());
+    for (Map.Entry<String, NetIoCounter> entry : counters.entrySet()) {
+      // Counters only grow between the two reads.
+      NetIoCounter before = expected.get(entry.getKey());
+      assertThat(entry.getValue().bytesRecv()).isAtLeast(before.bytesRecv());
+      assertThat(entry.getValue().bytesSent()).isAtLeast(before.bytesSent());
+      assertThat(entry.getValue().packetsRecv()).isAtLeast(before.packetsRecv());
+      assertThat(entry.getValue().packetsSent()).isAtLeast(before.packetsSent());
+    }
+  }
+
   @SuppressWarnings("CheckReturnValue")
   @Test
   public void getNetIfAddrs_doesNotCrash() throws IOException {
@@ -16,6 +16,7 @@ package com.google.devtools.build.lib.remote.disk;
 import static com.google.common.truth.Truth.assertThat;
 import static com.google.common.truth.Truth.assertWithMessage;
 import static org.junit.Assert.assertThrows;
+import static org.junit.Assume.assumeTrue;
 
 import com.google.common.util.concurrent.MoreExecutors;
 import com.google.devtools.build.lib.remote.disk.DiskCacheGarbageCollector.CollectionStats;
@@ -181,6 +182,40 @@ public final class DiskCacheGarbageCollectorTest {
     assertFilesExist("gc/foo", "tmp/foo");
   }
 
+  @Test
+  public void index_collectsFromIndexAfterScan() throws Exception {
+    assumeTrue(DiskCacheIndex.isSupported());
+    writeFiles(
+        Entry.of("ac/123", kbytes(1), daysAgo(1)), Entry.of("cas/456", kbytes(1), daysAgo(2)));
+
+    CollectionStats stats =
+        runGarbageCollector(Optional.of(kbytes(2)), Optional.empty(), /* useIndex= */ true);
+
+    assertThat(stats).isEqualTo(new CollectionStats(2, kbytes(2), 0, 0, false, Duration.ZERO));
+    assertFilesExist("gc/index");
+
+    // Not recorded in the index, so only found by the next full scan.
+    writeFiles(Entry.of("cas/789", kbytes(1), daysAgo(3)));
+
+    stats = runGarbageCollector(Optional.of(kbytes(1)), Optional.empty(), /* useIndex= */ true);
+
+    assertThat(stats)
+        .isEqualTo(new CollectionStats(2, kbytes(2), 1, kbytes(1), false, Duration.ZERO));
+    assertFilesExist("ac/123", "cas/789");
+    assertFilesDoNotExist("cas/456");
+  }
+
+  @Test
+  public void index_deletedWhenNotUsed() throws Exception {
+    assumeTrue(DiskCacheIndex.isSupported());
+    writeFiles(Entry.of("ac/123", kbytes(1), daysAgo(1)));
+    runGarbageCollector(Optional.of(kbytes(2)), Optional.empty(), /* useIndex= */ true);
+
+    runGarbageCollector(Optional.of(kbytes(2)), Optional.empty(), /* useIndex= */ false);
+
+    assertFilesDoNotExist("gc/index");
+  }
+
   @Test
   public void failsWhenLockIsAlreadyHeld() throws Exception {
     try (var externalLock = ExternalFileSystemLock.getShared(rootDir.getRelative("gc/lock"))) {
@@ -213,11 +248,18 @@ public final class DiskCacheGarbageCollectorTest {
   private CollectionStats runGarbageCollector(
       Optional<Long> maxSizeBytes, Optional<Duration> maxAge)
       throws IOException, InterruptedException {
+    return runGarbageCollector(maxSizeBytes, maxAge, /* useIndex= */ false);
+  }
+
+  private CollectionStats runGarbageCollector(
+      Optional<Long> maxSizeBytes, Optional<Duration> maxAge, boolean useIndex)
+      throws IOException, InterruptedException {
     var gc =
         new DiskCacheGarbageCollector(
             rootDir,
             executorService,
-            new DiskCacheGarbageCollector.CollectionPolicy(maxSizeBytes, maxAge));
+            new DiskCacheGarbageCollector.CollectionPolicy(maxSizeBytes, maxAge),
+            useIndex);
     CollectionStats resultStats = gc.run();
     return new CollectionStats(
         resultStats.totalEntries(),
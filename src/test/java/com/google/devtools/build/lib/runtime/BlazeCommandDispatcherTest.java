@@ -503,6 +503,65 @@ public final class BlazeCommandDispatcherTest {
     }
   }
 
+  private TestThread execWaitingForLock(
+      BlazeCommandDispatcher dispatch, String clientDescription, RecordingOutErr outErr) {
+    return new TestThread(
+        () ->
+            dispatch.exec(
+                InvocationPolicy.getDefaultInstance(),
+                ImmutableList.of("bar"),
+                outErr,
+                LockingMode.WAIT,
+                UiVerbosity.NORMAL,
+                clientDescription,
+                runtime.getClock().currentTimeMillis(),
+                /* startupOptionsTaggedWithBazelRc= */ Optional.empty(),
+                /* commandExtensions= */ ImmutableList.of(),
+                /* commandExtensionReporter= */ (ext) -> {}));
+  }
+
+  @Test
+  public void testQueuedCommandsReportTheirPosition() throws Exception {
+    BlockCommand blockCommand = new BlockCommand();
+    runtime.overrideCommands(ImmutableList.of(bar, blockCommand));
+    BlazeCommandDispatcher dispatch = new BlazeCommandDispatcher(runtime, /*serverPid=*/ 42);
+
+    Thread blockCommandThread =
+        new TestThread(
+            () ->
+                dispatch.exec(ImmutableList.of("block"), "blocking client", new RecordingOutErr()));
+    RecordingOutErr firstOutErr = new RecordingOutErr();
+    RecordingOutErr secondOutErr = new RecordingOutErr();
+    TestThread firstQueuedThread = execWaitingForLock(dispatch, "first client", firstOutErr);
+    TestThread secondQueuedThread = execWaitingForLock(dispatch, "second client", secondOutErr);
+
+    try {
+      blockCommandThread.start();
+      blockCommand.awaitRunning();
+      firstQueuedThread.start();
+      while (!firstOutErr.errAsLatin1().contains("Another command")) {
+        Thread.sleep(100);
+      }
+      secondQueuedThread.start();
+      while (!secondOutErr.errAsLatin1().contains("queued ahead")) {
+        Thread.sleep(100);
+      }
+
+      assertThat(firstOutErr.errAsLatin1()).doesNotContain("queued ahead");
+      assertThat(secondOutErr.errAsLatin1())
+          .contains("Another command (blocking client) is running.");
+      assertThat(secondOutErr.errAsLatin1())
+          .contains("1 other command is queued ahead of this one.");
+    } finally {
+      blockCommand.unblock();
+      blockCommandThread.join();
+      firstQueuedThread.join();
+      secondQueuedThread.join();
+    }
+    assertThat(firstOutErr.outAsLatin1()).isEqualTo("Hello, bar.\n");
+    assertThat(secondOutErr.outAsLatin1()).isEqualTo("Hello, bar.\n");
+  }
+
   @Test
   public void testDetectsInvalidCommandLineOptions() throws Exception {
     runtime.overrideCommands(ImmutableList.of(foo));
@@ -92,6 +92,7 @@ public final class GrpcServerTest {
             new PidFileWatcher(fileSystem.getPath("/thread-not-running-dont-need"), SERVER_PID),
             new JavaClock(),
             /* port= */ -1,
+            /* useUnixSocket= */ false,
             REQUEST_COOKIE,
             "response-cookie",
             serverDirectory,
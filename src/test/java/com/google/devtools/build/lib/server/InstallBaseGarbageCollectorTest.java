@@ -14,8 +14,11 @@
 package com.google.devtools.build.lib.server;
 
 import static com.google.common.truth.Truth.assertThat;
+import static com.google.devtools.build.lib.server.InstallBaseGarbageCollector.AOT_CACHE_SUFFIX;
+import static com.google.devtools.build.lib.server.InstallBaseGarbageCollector.CDS_ARCHIVE_SUFFIX;
 import static com.google.devtools.build.lib.server.InstallBaseGarbageCollector.DELETED_SUFFIX;
 import static com.google.devtools.build.lib.server.InstallBaseGarbageCollector.LOCK_SUFFIX;
+import static com.google.devtools.build.lib.server.InstallBaseGarbageCollector.VERIFIED_SUFFIX;
 
 import com.google.devtools.build.lib.testutil.ExternalFileSystemLock;
 import com.google.devtools.build.lib.testutil.TestUtils;
@@ -84,6 +87,41 @@ public final class InstallBaseGarbageCollectorTest {
     assertDirectoryContents(OWN_MD5);
   }
 
+  @Test
+  public void otherInstallBase_staleWithVerifiedStamp_collectedWithStamp() throws Exception {
+    Path otherInstallBase = createSubdirectory(OTHER_MD5);
+    setAge(otherInstallBase, Duration.ofDays(3));
+    FileSystemUtils.writeContentAsLatin1(rootDir.getChild(OTHER_MD5 + VERIFIED_SUFFIX), "stamp");
+
+    run(Duration.ofDays(2));
+
+    assertDirectoryContents(OWN_MD5);
+  }
+
+  @Test
+  public void otherInstallBase_staleWithCdsArchive_collectedWithArchive() throws Exception {
+    Path otherInstallBase = createSubdirectory(OTHER_MD5);
+    setAge(otherInstallBase, Duration.ofDays(3));
+    FileSystemUtils.writeContentAsLatin1(
+        rootDir.getChild(OTHER_MD5 + CDS_ARCHIVE_SUFFIX), "archive");
+
+    run(Duration.ofDays(2));
+
+    assertDirectoryContents(OWN_MD5);
+  }
+
+  @Test
+  public void otherInstallBase_staleWithAotCaches_collectedWithCaches() throws Exception {
+    Path otherInstallBase = createSubdirectory(OTHER_MD5);
+    setAge(otherInstallBase, Duration.ofDays(3));
+    Path aotCacheDir = createSubdirectory(OTHER_MD5 + AOT_CACHE_SUFFIX);
+    FileSystemUtils.writeContentAsLatin1(aotCacheDir.getChild("cache"), "cache");
+
+    run(Duration.ofDays(2));
+
+    assertDirectoryContents(OWN_MD5);
+  }
+
   @Test
   public void otherInstallBase_staleAndLocked_notCollected() throws Exception {
     Path otherInstallBase = createSubdirectory(OTHER_MD5);
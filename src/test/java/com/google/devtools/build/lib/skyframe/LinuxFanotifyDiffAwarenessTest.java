@@ -0,0 +1,132 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import static com.google.common.truth.Truth.assertThat;
+import static org.junit.Assume.assumeTrue;
+
+import com.google.common.io.MoreFiles;
+import com.google.common.io.RecursiveDeleteOption;
+import com.google.devtools.build.lib.skyframe.DiffAwareness.View;
+import com.google.devtools.build.lib.testing.common.FakeOptions;
+import com.google.devtools.build.lib.vfs.ModifiedFileSet;
+import com.google.devtools.build.lib.vfs.PathFragment;
+import com.google.devtools.common.options.OptionsProvider;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.HashSet;
+import java.util.Set;
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/**
+ * Tests for {@link LinuxFanotifyDiffAwareness}. Skipped unless the test runs with the privileges
+ * that fanotify file system marks need.
+ */
+@RunWith(JUnit4.class)
+public class LinuxFanotifyDiffAwarenessTest {
+  private LinuxFanotifyDiffAwareness underTest;
+  private Path watchedPath;
+  private OptionsProvider watchFsEnabledProvider;
+
+  @Before
+  public void setUp() throws Exception {
+    watchedPath = Files.createTempDirectory("fanotify").toRealPath();
+    assumeTrue(LinuxFanotifyDiffAwareness.isSupported(watchedPath));
+    underTest = new LinuxFanotifyDiffAwareness(watchedPath);
+    LocalDiffAwareness.Options localDiffOptions = new LocalDiffAwareness.Options();
+    localDiffOptions.watchFS = true;
+    watchFsEnabledProvider = FakeOptions.of(localDiffOptions);
+  }
+
+  @After
+  public void tearDown() throws Exception {
+    if (underTest != null) {
+      underTest.close();
+    }
+    MoreFiles.deleteRecursively(watchedPath, RecursiveDeleteOption.ALLOW_INSECURE);
+  }
+
+  /** Returns the union of the diffs of the views that follow view1 until all paths were seen. */
+  private View assertDiff(View view1, String... rawPaths) throws Exception {
+    Set<PathFragment> expected = new HashSet<>();
+    for (String path : rawPaths) {
+      expected.add(PathFragment.create(path));
+    }
+    Set<PathFragment> seen = new HashSet<>();
+    for (int attempts = 0; attempts < 100; attempts++) {
+      View view2 = underTest.getCurrentView(watchFsEnabledProvider);
+      ModifiedFileSet diff = underTest.getDiff(view1, view2);
+      assertThat(diff).isNotEqualTo(ModifiedFileSet.EVERYTHING_MODIFIED);
+      seen.addAll(diff.modifiedSourceFiles());
+      if (seen.containsAll(expected)) {
+        assertThat(seen).isEqualTo(expected);
+        return view2;
+      }
+      Thread.sleep(50);
+      view1 = view2;
+    }
+    assertThat(seen).isEqualTo(expected);
+    throw new AssertionError("unreachable");
+  }
+
+  @Test
+  public void reportsCreatedModifiedAndDeletedFiles() throws Exception {
+    View view1 = underTest.getCurrentView(watchFsEnabledProvider);
+
+    Files.createDirectories(watchedPath.resolve("a/b"));
+    Files.writeString(watchedPath.resolve("a/b/c"), "first");
+    View view2 = assertDiff(view1, "a", "a/b", "a/b/c");
+
+    Files.writeString(watchedPath.resolve("a/b/c"), "second");
+    View view3 = assertDiff(view2, "a/b/c");
+
+    MoreFiles.deleteRecursively(watchedPath.resolve("a"), RecursiveDeleteOption.ALLOW_INSECURE);
+    assertDiff(view3, "a", "a/b", "a/b/c");
+  }
+
+  @Test
+  public void ignoresChangesOutsideTheRoot() throws Exception {
+    Path outside = Files.createTempFile("fanotify", null);
+    try {
+      View view1 = underTest.getCurrentView(watchFsEnabledProvider);
+      Files.writeString(outside, "outside");
+      Files.writeString(watchedPath.resolve("inside"), "inside");
+      assertDiff(view1, "inside");
+    } finally {
+      Files.delete(outside);
+    }
+  }
+
+  @Test
+  public void directoryRenameModifiesEverything() throws Exception {
+    Files.createDirectories(watchedPath.resolve("dir1"));
+    View view1 = underTest.getCurrentView(watchFsEnabledProvider);
+
+    Files.move(watchedPath.resolve("dir1"), watchedPath.resolve("dir2"));
+    for (int attempts = 0; attempts < 100; attempts++) {
+      View view2 = underTest.getCurrentView(watchFsEnabledProvider);
+      if (underTest.getDiff(view1, view2).equals(ModifiedFileSet.EVERYTHING_MODIFIED)) {
+        return;
+      }
+      Thread.sleep(50);
+      view1 = view2;
+    }
+    throw new AssertionError("Directory rename not reported as everything modified");
+  }
+}
@@ -14,6 +14,7 @@
 
 package com.google.devtools.build.lib.skyframe;
 
+import static com.google.common.truth.Truth.assertThat;
 import static org.junit.Assume.assumeFalse;
 
 import com.google.common.collect.HashMultimap;
@@ -242,4 +243,32 @@ public class MacOSXFsEventsDiffAwarenessTest {
 
     assertDiff(view1, Iterables.concat(dirToFilesToCreate.keySet(), dirToFilesToCreate.values()));
   }
+
+  /** Returns the event id saved to the journal, after the FSEvents database UUID. */
+  private static long journaledEventId(Path journal) throws IOException {
+    String[] fields = Files.readString(journal).trim().split(" ");
+    assertThat(fields).hasLength(2);
+    return Long.parseUnsignedLong(fields[1]);
+  }
+
+  @Test
+  public void testJournalResumesFromLastPoll() throws Exception {
+    Path journal = Files.createTempFile("fsevents", ".journal");
+    Files.delete(journal);
+    try {
+      underTest.close();
+      underTest = new MacOSXFsEventsDiffAwareness(watchedPath, journal);
+      underTest.getCurrentView(watchFsEnabledProvider);
+      long firstEventId = journaledEventId(journal);
+
+      scratchFile("while-no-server-watches");
+      underTest.close();
+      underTest = new MacOSXFsEventsDiffAwareness(watchedPath, journal);
+      // Only returns once the events since the journaled one have been replayed.
+      underTest.getCurrentView(watchFsEnabledProvider);
+      assertThat(journaledEventId(journal)).isAtLeast(firstEventId);
+    } finally {
+      Files.deleteIfExists(journal);
+    }
+  }
 }
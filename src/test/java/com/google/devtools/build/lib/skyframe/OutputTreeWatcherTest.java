@@ -0,0 +1,127 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.skyframe;
+
+import static com.google.common.truth.Truth.assertThat;
+import static org.junit.Assume.assumeNotNull;
+
+import com.google.devtools.build.lib.unix.UnixFileSystem;
+import com.google.devtools.build.lib.vfs.DigestHashFunction;
+import com.google.devtools.build.lib.vfs.FileSystemUtils;
+import com.google.devtools.build.lib.vfs.ModifiedFileSet;
+import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.PathFragment;
+import java.nio.file.Files;
+import java.util.Arrays;
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/** Tests for {@link OutputTreeWatcher}. Skipped where inotify is not available. */
+@RunWith(JUnit4.class)
+public class OutputTreeWatcherTest {
+  private Path execRoot;
+  private Path outputPath;
+  private OutputTreeWatcher underTest;
+
+  @Before
+  public void setUp() throws Exception {
+    UnixFileSystem fs = new UnixFileSystem(DigestHashFunction.SHA256, /* hashAttributeName= */ "");
+    execRoot =
+        fs.getPath(Files.createTempDirectory("output_tree_watcher").toRealPath().toString());
+    outputPath = execRoot.getRelative("bazel-out");
+    outputPath.getRelative("k8/bin/pkg").createDirectoryAndParents();
+    FileSystemUtils.writeContentAsLatin1(outputPath.getRelative("k8/bin/pkg/out"), "built");
+    underTest = OutputTreeWatcher.create(outputPath);
+    assumeNotNull(underTest);
+  }
+
+  @After
+  public void tearDown() throws Exception {
+    if (underTest != null) {
+      underTest.close();
+    }
+    execRoot.deleteTree();
+  }
+
+  private static ModifiedFileSet modified(String... execPaths) {
+    return ModifiedFileSet.builder()
+        .modifyAll(Arrays.stream(execPaths).map(PathFragment::create).toList())
+        .build();
+  }
+
+  @Test
+  public void everythingModifiedUntilReset() throws Exception {
+    assertThat(underTest.getModifiedFiles(execRoot)).isEqualTo(ModifiedFileSet.EVERYTHING_MODIFIED);
+
+    assertThat(underTest.reset()).isTrue();
+
+    assertThat(underTest.getModifiedFiles(execRoot)).isEqualTo(ModifiedFileSet.NOTHING_MODIFIED);
+  }
+
+  @Test
+  public void reportsChangesSinceReset() throws Exception {
+    FileSystemUtils.writeContentAsLatin1(outputPath.getRelative("k8/bin/pkg/out"), "during");
+    assertThat(underTest.reset()).isTrue();
+
+    FileSystemUtils.writeContentAsLatin1(outputPath.getRelative("k8/bin/pkg/out"), "after");
+    outputPath.getRelative("k8/bin/pkg/new/dir").createDirectoryAndParents();
+    FileSystemUtils.writeContentAsLatin1(outputPath.getRelative("k8/bin/pkg/new/dir/file"), "x");
+
+    assertThat(underTest.getModifiedFiles(execRoot))
+        .isEqualTo(
+            modified(
+                "bazel-out/k8/bin/pkg/out",
+                "bazel-out/k8/bin/pkg/new",
+                "bazel-out/k8/bin/pkg/new/dir",
+                "bazel-out/k8/bin/pkg/new/dir/file"));
+    // Still there for a build that did not get to check them.
+    assertThat(underTest.getModifiedFiles(execRoot)).isNotEqualTo(ModifiedFileSet.NOTHING_MODIFIED);
+
+    assertThat(underTest.reset()).isTrue();
+    outputPath.getRelative("k8/bin/pkg/new/dir/file").delete();
+
+    assertThat(underTest.getModifiedFiles(execRoot))
+        .isEqualTo(modified("bazel-out/k8/bin/pkg/new/dir/file"));
+  }
+
+  @Test
+  public void directoryRenameModifiesEverything() throws Exception {
+    assertThat(underTest.reset()).isTrue();
+
+    outputPath.getRelative("k8/bin/pkg").renameTo(outputPath.getRelative("k8/bin/moved"));
+
+    assertThat(underTest.getModifiedFiles(execRoot)).isEqualTo(ModifiedFileSet.EVERYTHING_MODIFIED);
+    assertThat(underTest.reset()).isTrue();
+    FileSystemUtils.writeContentAsLatin1(outputPath.getRelative("k8/bin/moved/out"), "again");
+    assertThat(underTest.getModifiedFiles(execRoot))
+        .isEqualTo(modified("bazel-out/k8/bin/moved/out"));
+  }
+
+  @Test
+  public void watchesOutputTreeAgainAfterItIsDeleted() throws Exception {
+    assertThat(underTest.reset()).isTrue();
+
+    outputPath.deleteTree();
+
+    assertThat(underTest.getModifiedFiles(execRoot)).isEqualTo(ModifiedFileSet.EVERYTHING_MODIFIED);
+    outputPath.getRelative("k8").createDirectoryAndParents();
+    assertThat(underTest.reset()).isTrue();
+    FileSystemUtils.writeContentAsLatin1(outputPath.getRelative("k8/file"), "rebuilt");
+    assertThat(underTest.getModifiedFiles(execRoot)).isEqualTo(modified("bazel-out/k8/file"));
+  }
+}
@@ -0,0 +1,224 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.unix;
+
+import com.google.devtools.build.lib.unix.NativePosixFiles.ReadTypes;
+import com.google.devtools.build.lib.unix.NativePosixFiles.StatErrorHandling;
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.Arrays;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.infra.Blackhole;
+
+/**
+ * Measures the JNI calls of {@link NativePosixFiles} over a synthetic tree of {@link #DIRECTORIES}
+ * directories with {@link #entries} files each.
+ *
+ * <p>Each operation covers the whole tree, once with a call per file or directory and once with
+ * the batched call where there is one, so that the two can be compared directly. Run with {@code
+ * -prof gc} to also get the bytes allocated per operation.
+ */
+@BenchmarkMode(Mode.Throughput)
+@State(Scope.Benchmark)
+public class NativePosixFilesBenchmark {
+
+  private static final int DIRECTORIES = 16;
+
+  /** An attribute that no file has, which is what Bazel asks for in most cases. */
+  private static final String MISSING_XATTR = "user.bazel_benchmark";
+
+  @Param({"10", "1000"})
+  public int entries;
+
+  private Path root;
+  private String[] directories;
+  private String[] files;
+  private int[] errnos;
+  private long[] statResults;
+
+  @Setup(Level.Trial)
+  public void createTree() throws IOException {
+    root = Files.createTempDirectory("native_posix_files_benchmark");
+    directories = new String[DIRECTORIES];
+    files = new String[DIRECTORIES * entries];
+    for (int d = 0; d < DIRECTORIES; d++) {
+      Path directory = Files.createDirectory(root.resolve("d" + d));
+      directories[d] = directory.toString();
+      for (int f = 0; f < entries; f++) {
+        files[d * entries + f] = Files.writeString(directory.resolve("f" + f), "x").toString();
+      }
+    }
+    errnos = new int[files.length];
+    statResults = new long[files.length * NativePosixFiles.STAT_BATCH_FIELDS];
+  }
+
+  @TearDown(Level.Trial)
+  public void deleteTree() throws IOException {
+    NativePosixFiles.deleteTreesBelow(root.toString(), 1);
+    NativePosixFiles.remove(root.toString());
+  }
+
+  @Benchmark
+  public void statEach(Blackhole blackhole) throws IOException {
+    for (String file : files) {
+      blackhole.consume(NativePosixFiles.stat(file, StatErrorHandling.ALWAYS_THROW));
+    }
+  }
+
+  @Benchmark
+  public void lstatEach(Blackhole blackhole) throws IOException {
+    for (String file : files) {
+      blackhole.consume(NativePosixFiles.lstat(file, StatErrorHandling.ALWAYS_THROW));
+    }
+  }
+
+  @Benchmark
+  public long[] statBatch() {
+    NativePosixFiles.statBatch(files, /* followSymlinks= */ true, 1, errnos, statResults);
+    return statResults;
+  }
+
+  @Benchmark
+  public long[] statBatchParallel() {
+    NativePosixFiles.statBatch(
+        files,
+        /* followSymlinks= */ true,
+        Runtime.getRuntime().availableProcessors(),
+        errnos,
+        statResults);
+    return statResults;
+  }
+
+  @Benchmark
+  public void readdirEach(Blackhole blackhole) throws IOException {
+    for (String directory : directories) {
+      blackhole.consume(NativePosixFiles.readdir(directory, ReadTypes.NOFOLLOW));
+    }
+  }
+
+  @Benchmark
+  public Object readdirBatch() {
+    return NativePosixFiles.readdirBatch(directories, ReadTypes.NOFOLLOW, errnos);
+  }
+
+  @Benchmark
+  public void readdirPackedEach(Blackhole blackhole) throws IOException {
+    for (String directory : directories) {
+      blackhole.consume(
+          NativePosixFiles.readdirPacked(directory, ReadTypes.NOFOLLOW, /* statEntries= */ false));
+    }
+  }
+
+  /** Reads the directories and then stats every entry, as a directory listing with metadata. */
+  @Benchmark
+  public void readdirThenStatEach(Blackhole blackhole) throws IOException {
+    for (String directory : directories) {
+      for (String name : NativePosixFiles.readdir(directory)) {
+        blackhole.consume(
+            NativePosixFiles.lstat(directory + "/" + name, StatErrorHandling.ALWAYS_THROW));
+      }
+    }
+  }
+
+  @Benchmark
+  public void readdirPackedWithStat(Blackhole blackhole) throws IOException {
+    for (String directory : directories) {
+      blackhole.consume(
+          NativePosixFiles.readdirPacked(directory, ReadTypes.NOFOLLOW, /* statEntries= */ true));
+    }
+  }
+
+  @Benchmark
+  public void getxattrEach(Blackhole blackhole) throws IOException {
+    for (String file : files) {
+      blackhole.consume(NativePosixFiles.getxattr(file, MISSING_XATTR));
+    }
+  }
+
+  @Benchmark
+  public void lgetxattrEach(Blackhole blackhole) throws IOException {
+    for (String file : files) {
+      blackhole.consume(NativePosixFiles.lgetxattr(file, MISSING_XATTR));
+    }
+  }
+
+  /** A directory for the benchmarks that modify the tree, emptied before each operation. */
+  @State(Scope.Benchmark)
+  public static class Scratch {
+    private String directory;
+    private String[] links;
+    private String[] linkTargets;
+    private byte[] linkKinds;
+    private int[] errnos;
+
+    @Setup(Level.Trial)
+    public void create(NativePosixFilesBenchmark benchmark) throws IOException {
+      directory = Files.createDirectory(benchmark.root.resolve("scratch")).toString();
+      links = new String[benchmark.entries];
+      linkTargets = new String[benchmark.entries];
+      linkKinds = new byte[benchmark.entries];
+      errnos = new int[benchmark.entries];
+      for (int i = 0; i < links.length; i++) {
+        links[i] = "l" + i;
+        linkTargets[i] = benchmark.files[i];
+      }
+      Arrays.fill(linkKinds, NativePosixFiles.TREE_SYMLINK);
+    }
+
+    @Setup(Level.Invocation)
+    public void clear() throws IOException {
+      NativePosixFiles.deleteTreesBelow(directory, 1);
+    }
+
+    void createLinks() throws IOException {
+      NativePosixFiles.createTree(directory, linkKinds, links, linkTargets, 1, errnos);
+    }
+  }
+
+  @Benchmark
+  public void symlinkEach(Scratch scratch) throws IOException {
+    for (int i = 0; i < scratch.links.length; i++) {
+      NativePosixFiles.symlink(
+          scratch.linkTargets[i], scratch.directory + "/" + scratch.links[i]);
+    }
+  }
+
+  @Benchmark
+  public void symlinkBatch(Scratch scratch) throws IOException {
+    scratch.createLinks();
+  }
+
+  @Benchmark
+  public void deleteTreesBelow(Scratch scratch) throws IOException {
+    scratch.createLinks();
+    NativePosixFiles.deleteTreesBelow(scratch.directory, 1);
+  }
+
+  @Benchmark
+  public void deleteTreesBelowParallel(Scratch scratch) throws IOException {
+    scratch.createLinks();
+    NativePosixFiles.deleteTreesBelow(
+        scratch.directory, Runtime.getRuntime().availableProcessors());
+  }
+}
@@ -14,21 +14,33 @@
 package com.google.devtools.build.lib.unix;
 
 import static com.google.common.truth.Truth.assertThat;
+import static com.google.common.truth.Truth.assertWithMessage;
 import static java.nio.charset.StandardCharsets.UTF_8;
 import static org.junit.Assert.assertThrows;
 import static org.junit.Assert.fail;
 import static org.junit.Assume.assumeTrue;
 
 import com.google.devtools.build.lib.testutil.TestUtils;
+import com.google.devtools.build.lib.unix.NativePosixFiles.Dirents;
+import com.google.devtools.build.lib.unix.NativePosixFiles.MappedFile;
+import com.google.devtools.build.lib.unix.NativePosixFiles.PackedDirents;
+import com.google.devtools.build.lib.unix.NativePosixFiles.PackedGlob;
+import com.google.devtools.build.lib.unix.NativePosixFiles.ReadTypes;
 import com.google.devtools.build.lib.unix.NativePosixFiles.StatErrorHandling;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.vfs.DigestHashFunction;
+import com.google.devtools.build.lib.vfs.FileStatus;
 import com.google.devtools.build.lib.vfs.FileSystem;
 import com.google.devtools.build.lib.vfs.Path;
+import com.google.devtools.build.lib.vfs.SyscallCache;
+import com.google.devtools.build.lib.vfs.UnixGlob;
+import com.google.devtools.build.lib.vfs.UnixGlobPathDiscriminator;
 import java.io.File;
 import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.nio.file.Files;
+import java.util.HashSet;
+import java.util.Set;
 import org.junit.Before;
 import org.junit.Test;
 import org.junit.runner.RunWith;
@@ -103,6 +115,502 @@ public class NativePosixFilesTest {
         FileNotFoundException.class, () -> NativePosixFiles.lgetxattr(nonexistentFile, "foo"));
   }
 
+  @Test
+  public void statBatch_matchesStat() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("statbatch");
+    // Enough files for statBatch to use several threads.
+    String[] paths = new String[1001];
+    for (int i = 0; i < paths.length - 1; i++) {
+      java.nio.file.Path file = dir.resolve("file" + i);
+      Files.write(file, new byte[i]);
+      paths[i] = file.toString();
+    }
+    paths[paths.length - 1] = dir.resolve("nonexistent").toString();
+    int[] errnos = new int[paths.length];
+    long[] results = new long[paths.length * NativePosixFiles.STAT_BATCH_FIELDS];
+
+    NativePosixFiles.statBatch(paths, /* followSymlinks= */ true, 4, errnos, results);
+
+    for (int i = 0; i < paths.length - 1; i++) {
+      FileStatus stat = NativePosixFiles.stat(paths[i], StatErrorHandling.ALWAYS_THROW);
+      int base = i * NativePosixFiles.STAT_BATCH_FIELDS;
+      assertThat(errnos[i]).isEqualTo(0);
+      assertThat((int) results[base + NativePosixFiles.STAT_BATCH_MODE] & UnixFileStatus.S_IRWXA)
+          .isEqualTo(stat.getPermissions());
+      assertThat(results[base + NativePosixFiles.STAT_BATCH_MTIME])
+          .isEqualTo(stat.getLastModifiedTime());
+      assertThat(results[base + NativePosixFiles.STAT_BATCH_CTIME])
+          .isEqualTo(stat.getLastChangeTime());
+      assertThat(results[base + NativePosixFiles.STAT_BATCH_SIZE]).isEqualTo((long) i);
+      assertThat(results[base + NativePosixFiles.STAT_BATCH_INO]).isEqualTo(stat.getNodeId());
+    }
+    assertThat(errnos[paths.length - 1]).isEqualTo(2); // ENOENT
+  }
+
+  @Test
+  public void statFields_returnsOnlyRequestedFields() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("statfields");
+    String file = Files.write(dir.resolve("file"), new byte[42]).toString();
+    String link = Files.createSymbolicLink(dir.resolve("link"), dir.resolve("file")).toString();
+    FileStatus stat = NativePosixFiles.stat(file, StatErrorHandling.ALWAYS_THROW);
+
+    FileStatus typeAndSize =
+        NativePosixFiles.statFields(
+            link,
+            /* followSymlinks= */ true,
+            NativePosixFiles.STAT_FIELD_MODE | NativePosixFiles.STAT_FIELD_SIZE,
+            /* dontSync= */ true,
+            StatErrorHandling.ALWAYS_THROW);
+    assertThat(typeAndSize.isFile()).isTrue();
+    assertThat(typeAndSize.getPermissions()).isEqualTo(stat.getPermissions());
+    assertThat(typeAndSize.getSize()).isEqualTo(42);
+    assertThat(typeAndSize.getLastModifiedTime()).isEqualTo(0);
+    assertThat(typeAndSize.getNodeId()).isEqualTo(0);
+
+    FileStatus mtime =
+        NativePosixFiles.statFields(
+            file,
+            /* followSymlinks= */ false,
+            NativePosixFiles.STAT_FIELD_MTIME,
+            /* dontSync= */ false,
+            StatErrorHandling.ALWAYS_THROW);
+    assertThat(mtime.getLastModifiedTime()).isEqualTo(stat.getLastModifiedTime());
+    assertThat(mtime.getSize()).isEqualTo(0);
+
+    FileStatus linkType =
+        NativePosixFiles.statFields(
+            link,
+            /* followSymlinks= */ false,
+            NativePosixFiles.STAT_FIELD_MODE,
+            /* dontSync= */ false,
+            StatErrorHandling.ALWAYS_THROW);
+    assertThat(linkType.isSymbolicLink()).isTrue();
+
+    String missing = dir.resolve("missing").toString();
+    assertThat(
+            NativePosixFiles.statFields(
+                missing, true, 0, false, StatErrorHandling.THROW_UNLESS_NOT_FOUND))
+        .isNull();
+    assertThrows(
+        FileNotFoundException.class,
+        () -> NativePosixFiles.statFields(missing, true, 0, false, StatErrorHandling.ALWAYS_THROW));
+  }
+
+  @Test
+  public void statBatch_rejectsShortArrays() throws Exception {
+    String[] paths = {"/", "/"};
+    assertThrows(
+        IllegalArgumentException.class,
+        () -> NativePosixFiles.statBatch(paths, true, 1, new int[1], new long[10]));
+    assertThrows(
+        IllegalArgumentException.class,
+        () -> NativePosixFiles.statBatch(paths, true, 1, new int[2], new long[9]));
+  }
+
+  @Test
+  public void readdirBatch_matchesReaddir() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("readdirbatch");
+    String[] paths = new String[101];
+    for (int i = 0; i < paths.length - 1; i++) {
+      java.nio.file.Path sub = Files.createDirectory(dir.resolve("dir" + i));
+      Files.createFile(sub.resolve("file"));
+      Files.createDirectory(sub.resolve("subdir"));
+      Files.createSymbolicLink(sub.resolve("link"), sub.resolve("subdir"));
+      paths[i] = sub.toString();
+    }
+    paths[paths.length - 1] = dir.resolve("nonexistent").toString();
+    int[] errnos = new int[paths.length];
+
+    for (ReadTypes readTypes : ReadTypes.values()) {
+      Dirents[] batch = NativePosixFiles.readdirBatch(paths, readTypes, errnos);
+
+      for (int i = 0; i < paths.length - 1; i++) {
+        Dirents dirents = NativePosixFiles.readdir(paths[i], readTypes);
+        assertThat(errnos[i]).isEqualTo(0);
+        assertThat(batch[i].size()).isEqualTo(dirents.size());
+        assertThat(batch[i].hasTypes()).isEqualTo(dirents.hasTypes());
+        for (int j = 0; j < dirents.size(); j++) {
+          assertThat(batch[i].getName(j)).isEqualTo(dirents.getName(j));
+          if (dirents.hasTypes()) {
+            assertThat(batch[i].getType(j)).isEqualTo(dirents.getType(j));
+          }
+        }
+      }
+      assertThat(batch[paths.length - 1]).isNull();
+      assertThat(errnos[paths.length - 1]).isEqualTo(2); // ENOENT
+    }
+  }
+
+  @Test
+  public void readdirPacked_matchesReaddirAndLstat() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("readdirpacked");
+    Files.write(dir.resolve("file"), new byte[3]);
+    Files.createDirectory(dir.resolve("subdir"));
+    Files.createSymbolicLink(dir.resolve("link"), dir.resolve("subdir"));
+    Files.createSymbolicLink(dir.resolve("dangling"), dir.resolve("nonexistent"));
+
+    for (ReadTypes readTypes : ReadTypes.values()) {
+      Dirents dirents = NativePosixFiles.readdir(dir.toString(), readTypes);
+      PackedDirents packed =
+          NativePosixFiles.readdirPacked(dir.toString(), readTypes, /* statEntries= */ true);
+
+      assertThat(packed.size()).isEqualTo(dirents.size());
+      assertThat(packed.hasTypes()).isEqualTo(dirents.hasTypes());
+      assertThat(packed.hasStats()).isTrue();
+      for (int i = 0; i < dirents.size(); i++) {
+        String name = dirents.getName(i);
+        assertThat(packed.getName(i)).isEqualTo(name);
+        if (dirents.hasTypes()) {
+          assertThat(packed.getType(i)).isEqualTo(dirents.getType(i));
+        }
+        String child = dir.resolve(name).toString();
+        FileStatus stat =
+            readTypes == ReadTypes.FOLLOW
+                ? NativePosixFiles.stat(child, StatErrorHandling.NEVER_THROW)
+                : NativePosixFiles.lstat(child, StatErrorHandling.NEVER_THROW);
+        if (stat == null) {
+          assertThat(packed.getStatErrno(i)).isEqualTo(2); // ENOENT
+          continue;
+        }
+        assertThat(packed.getStatErrno(i)).isEqualTo(0);
+        assertThat(packed.getStatField(i, NativePosixFiles.STAT_BATCH_INO))
+            .isEqualTo(stat.getNodeId());
+        assertThat(packed.getStatField(i, NativePosixFiles.STAT_BATCH_SIZE))
+            .isEqualTo(stat.getSize());
+      }
+    }
+
+    assertThat(NativePosixFiles.readdirPacked(dir.toString(), ReadTypes.NONE, false).hasStats())
+        .isFalse();
+  }
+
+  @Test
+  public void glob_matchesUnixGlob() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("glob");
+    for (String subdir : new String[] {"a/b/c", "pkg/x", "ignored", ".hidden", "linked_pkg"}) {
+      Files.createDirectories(dir.resolve(subdir));
+    }
+    for (String file :
+        new String[] {
+          "BUILD", "f.java", "(g).java", ".h.java", "a/i.java", "a/b/c/j.java", "pkg/BUILD",
+          "pkg/x/k.java", "ignored/l.java", ".hidden/m.java"
+        }) {
+      Files.write(dir.resolve(file), new byte[0]);
+    }
+    Files.createSymbolicLink(dir.resolve("link"), dir.resolve("a"));
+    Files.createSymbolicLink(dir.resolve("dangling.java"), dir.resolve("nonexistent"));
+    Files.createSymbolicLink(dir.resolve("linked_pkg/BUILD"), dir.resolve("BUILD"));
+    Path base = workingDir.getRelative(dir.toString());
+    UnixGlobPathDiscriminator discriminator =
+        new UnixGlobPathDiscriminator() {
+          @Override
+          public boolean shouldTraverseDirectory(Path path) {
+            return path.equals(base)
+                || (!path.getChild("BUILD").isFile() && !path.equals(base.getChild("ignored")));
+          }
+        };
+
+    for (String pattern :
+        new String[] {
+          "**", "**/*.java", "*", "*/*/*.java", "a/**/c", "**/b/**/*", "(g).java", "pkg/**", "a/b"
+        }) {
+      PackedGlob glob =
+          NativePosixFiles.glob(
+              dir.toString(),
+              pattern.split("/"),
+              new String[] {"BUILD"},
+              new String[] {"ignored"},
+              /* parallelism= */ 4);
+
+      Set<String> matches = new HashSet<>();
+      Set<String> boundaries = new HashSet<>();
+      for (int i = 0; i < glob.size(); i++) {
+        if (glob.hasKind(i, NativePosixFiles.GLOB_FILE)
+            || glob.hasKind(i, NativePosixFiles.GLOB_DIRECTORY)) {
+          matches.add(glob.getPath(i));
+        }
+        if (glob.hasKind(i, NativePosixFiles.GLOB_BOUNDARY)) {
+          boundaries.add(glob.getPath(i));
+        }
+      }
+      Set<String> expected = new HashSet<>();
+      for (Path path :
+          new UnixGlob.Builder(base, SyscallCache.NO_CACHE)
+              .addPattern(pattern)
+              .setPathDiscriminator(discriminator)
+              .glob()) {
+        expected.add(path.relativeTo(base).getPathString());
+      }
+      assertWithMessage(pattern).that(matches).isEqualTo(expected);
+      assertWithMessage(pattern)
+          .that(Set.of("pkg", "linked_pkg"))
+          .containsAtLeastElementsIn(boundaries);
+    }
+
+    assertThat(
+            NativePosixFiles.glob(
+                dir.resolve("nonexistent").toString(),
+                new String[] {"*"},
+                new String[0],
+                new String[0],
+                1))
+        .isNull();
+  }
+
+  @Test
+  public void deleteTreesBelow_parallel() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("deletetrees");
+    // Enough directories for the other threads to start.
+    for (int i = 0; i < 20; i++) {
+      for (int j = 0; j < 20; j++) {
+        java.nio.file.Path sub = Files.createDirectories(dir.resolve("a" + i).resolve("b" + j));
+        Files.createFile(sub.resolve("file"));
+        Files.createSymbolicLink(sub.resolve("link"), dir);
+      }
+    }
+
+    NativePosixFiles.deleteTreesBelow(dir.toString(), 4);
+
+    assertThat(NativePosixFiles.readdir(dir.toString())).isEmpty();
+    // A missing directory is not an error, but a file is.
+    NativePosixFiles.deleteTreesBelow(dir.resolve("nonexistent").toString(), 4);
+    java.nio.file.Path file = Files.createFile(dir.resolve("file"));
+    assertThrows(IOException.class, () -> NativePosixFiles.deleteTreesBelow(file.toString(), 4));
+  }
+
+  @Test
+  public void copyFile_preservesContentsAndMetadata() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("copyfile");
+    java.nio.file.Path from = dir.resolve("from");
+    byte[] content = new byte[3 << 20];
+    new java.util.Random(42).nextBytes(content);
+    Files.write(from, content);
+    NativePosixFiles.chmod(from.toString(), 0541);
+    NativePosixFiles.utimensat(from.toString(), false, 123456789L);
+    java.nio.file.Path to = Files.writeString(dir.resolve("to"), "old contents");
+    NativePosixFiles.chmod(to.toString(), 0444);
+
+    NativePosixFiles.copyFile(from.toString(), to.toString());
+
+    assertThat(Files.readAllBytes(to)).isEqualTo(content);
+    FileStatus stat = NativePosixFiles.stat(to.toString(), StatErrorHandling.ALWAYS_THROW);
+    assertThat(stat.getPermissions()).isEqualTo(0541);
+    assertThat(stat.getLastModifiedTime()).isEqualTo(123456789L);
+    assertThrows(
+        FileNotFoundException.class,
+        () -> NativePosixFiles.copyFile(dir.resolve("missing").toString(), to.toString()));
+    assertThrows(
+        IOException.class,
+        () -> NativePosixFiles.copyFile(dir.toString(), dir.resolve("dir").toString()));
+  }
+
+  @Test
+  public void copyFiles_matchesCopyFile() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("copyfiles");
+    String[] from = new String[50];
+    String[] to = new String[from.length];
+    for (int i = 0; i < from.length; i++) {
+      from[i] = Files.writeString(dir.resolve("from" + i), "content" + i).toString();
+      to[i] = dir.resolve("to" + i).toString();
+    }
+    from[7] = dir.resolve("missing").toString();
+    int[] errnos = new int[from.length];
+
+    NativePosixFiles.copyFiles(from, to, 4, errnos);
+
+    for (int i = 0; i < from.length; i++) {
+      if (i == 7) {
+        assertThat(errnos[i]).isEqualTo(2); // ENOENT
+        assertThat(Files.exists(java.nio.file.Path.of(to[i]))).isFalse();
+      } else {
+        assertThat(errnos[i]).isEqualTo(0);
+        assertThat(Files.readString(java.nio.file.Path.of(to[i]))).isEqualTo("content" + i);
+      }
+    }
+    assertThrows(
+        IllegalArgumentException.class,
+        () -> NativePosixFiles.copyFiles(from, to, 4, new int[1]));
+  }
+
+  @Test
+  public void copyFiles_concurrentCallsShareWorkerPool() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("copyfiles");
+    String[] from = new String[200];
+    for (int i = 0; i < from.length; i++) {
+      from[i] = Files.writeString(dir.resolve("from" + i), "content" + i).toString();
+    }
+    Thread[] threads = new Thread[4];
+    Throwable[] failures = new Throwable[threads.length];
+    for (int t = 0; t < threads.length; t++) {
+      int thread = t;
+      threads[t] =
+          new Thread(
+              () -> {
+                try {
+                  String[] to = new String[from.length];
+                  for (int i = 0; i < from.length; i++) {
+                    to[i] = dir.resolve("to" + thread + "_" + i).toString();
+                  }
+                  int[] errnos = new int[from.length];
+                  NativePosixFiles.copyFiles(from, to, 8, errnos);
+                  for (int i = 0; i < from.length; i++) {
+                    assertThat(errnos[i]).isEqualTo(0);
+                    assertThat(Files.readString(java.nio.file.Path.of(to[i])))
+                        .isEqualTo("content" + i);
+                  }
+                } catch (Throwable e) {
+                  failures[thread] = e;
+                }
+              });
+      threads[t].start();
+    }
+    for (Thread thread : threads) {
+      thread.join();
+    }
+    assertThat(failures).asList().containsExactlyElementsIn(new Throwable[threads.length]);
+
+    NativeWorkerPool.Stats stats = NativeWorkerPool.getStats();
+    assertThat(stats.threads()).isAtLeast(1);
+    assertThat(stats.active()).isEqualTo(0);
+  }
+
+  @Test
+  public void prefetch_skipsWhatCannotBeRead() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("prefetch");
+    String file = Files.writeString(dir.resolve("file"), "content").toString();
+    String empty = Files.createFile(dir.resolve("empty")).toString();
+    String subdir = Files.createDirectory(dir.resolve("dir")).toString();
+    String missing = dir.resolve("missing").toString();
+
+    NativePosixFiles.prefetch(new String[] {file, empty, subdir, missing});
+
+    assertThat(Files.readString(java.nio.file.Path.of(file))).isEqualTo("content");
+    assertThrows(
+        IllegalArgumentException.class, () -> NativePosixFiles.prefetch(new String[] {null}));
+  }
+
+  @Test
+  public void mmap_mapsContents() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("mmap");
+    byte[] content = new byte[10000];
+    for (int i = 0; i < content.length; i++) {
+      content[i] = (byte) i;
+    }
+    String file = Files.write(dir.resolve("file"), content).toString();
+    String empty = Files.createFile(dir.resolve("empty")).toString();
+
+    try (MappedFile whole =
+        NativePosixFiles.mmap(file, 0, -1, NativePosixFiles.MMAP_SEQUENTIAL)) {
+      assertThat(whole.fileSize()).isEqualTo(content.length);
+      assertThat(whole.buffer().isReadOnly()).isTrue();
+      byte[] read = new byte[whole.buffer().remaining()];
+      whole.buffer().get(read);
+      assertThat(read).isEqualTo(content);
+    }
+    // Not at a page boundary, and past the end of the file.
+    try (MappedFile tail = NativePosixFiles.mmap(file, 9999, 100, NativePosixFiles.MMAP_RANDOM)) {
+      assertThat(tail.buffer().remaining()).isEqualTo(1);
+      assertThat(tail.buffer().get(0)).isEqualTo(content[9999]);
+    }
+    try (MappedFile none = NativePosixFiles.mmap(empty, 0, -1, NativePosixFiles.MMAP_NORMAL)) {
+      assertThat(none.buffer().remaining()).isEqualTo(0);
+    }
+
+    assertThrows(
+        IOException.class,
+        () -> NativePosixFiles.mmap(dir.toString(), 0, -1, NativePosixFiles.MMAP_NORMAL));
+    assertThrows(
+        FileNotFoundException.class,
+        () ->
+            NativePosixFiles.mmap(
+                dir.resolve("missing").toString(), 0, -1, NativePosixFiles.MMAP_NORMAL));
+    assertThrows(IllegalArgumentException.class, () -> NativePosixFiles.mmap(file, -1, -1, 0));
+    assertThrows(IllegalArgumentException.class, () -> NativePosixFiles.mmap(file, 0, -1, 4));
+  }
+
+  @Test
+  public void createTree_createsDirectoriesAndLinks() throws Exception {
+    java.nio.file.Path root = Files.createTempDirectory("createtree");
+    java.nio.file.Path file = Files.writeString(root.resolve("file"), "content");
+    Files.createDirectory(root.resolve("existing"));
+    // Enough links for createTree to use several threads.
+    int links = 1000;
+    byte[] kinds = new byte[4 + links];
+    String[] paths = new String[kinds.length];
+    String[] targets = new String[kinds.length];
+    kinds[0] = NativePosixFiles.TREE_DIRECTORY;
+    paths[0] = "a";
+    kinds[1] = NativePosixFiles.TREE_DIRECTORY;
+    paths[1] = "a/b";
+    kinds[2] = NativePosixFiles.TREE_DIRECTORY;
+    paths[2] = "existing";
+    kinds[3] = NativePosixFiles.TREE_HARD_LINK;
+    paths[3] = "existing/hardlink";
+    targets[3] = file.toString();
+    for (int i = 4; i < kinds.length; i++) {
+      kinds[i] = NativePosixFiles.TREE_SYMLINK;
+      paths[i] = "a/b/link" + i;
+      targets[i] = "target" + i;
+    }
+    paths[7] = "missing/link";
+    int[] errnos = new int[kinds.length];
+
+    NativePosixFiles.createTree(root.toString(), kinds, paths, targets, 4, errnos);
+
+    for (int i = 0; i < kinds.length; i++) {
+      assertThat(errnos[i]).isEqualTo(i == 7 ? 2 : 0); // ENOENT
+    }
+    assertThat(Files.isDirectory(root.resolve("a/b"))).isTrue();
+    assertThat(Files.readString(root.resolve("existing/hardlink"))).isEqualTo("content");
+    assertThat(Files.getAttribute(file, "unix:nlink")).isEqualTo(2);
+    assertThat(Files.readSymbolicLink(root.resolve("a/b/link4")).toString()).isEqualTo("target4");
+    assertThat(Files.readSymbolicLink(root.resolve(paths[kinds.length - 1])).toString())
+        .isEqualTo(targets[kinds.length - 1]);
+
+    // A directory in the way of a directory is fine, anything else is not.
+    NativePosixFiles.createTree(
+        root.toString(),
+        new byte[] {NativePosixFiles.TREE_DIRECTORY, NativePosixFiles.TREE_DIRECTORY},
+        new String[] {"a", "file"},
+        new String[2],
+        1,
+        errnos);
+    assertThat(errnos[0]).isEqualTo(0);
+    assertThat(errnos[1]).isEqualTo(17); // EEXIST
+    assertThrows(
+        FileNotFoundException.class,
+        () ->
+            NativePosixFiles.createTree(
+                root.resolve("missing").toString(),
+                new byte[0],
+                new String[0],
+                new String[0],
+                1,
+                new int[0]));
+    assertThrows(
+        IllegalArgumentException.class,
+        () -> NativePosixFiles.createTree(root.toString(), kinds, paths, targets, 4, new int[1]));
+  }
+
+  @Test
+  public void latin1Paths_roundTrip() throws Exception {
+    java.nio.file.Path dir = Files.createTempDirectory("latin1");
+    // Paths cross JNI in a buffer of their own up to some length, and on the heap beyond it.
+    String shortTarget = "caf\u00e9/\u00ff";
+    String longTarget = "\u00e9".repeat(1000);
+    String shortLink = dir.resolve("short").toString();
+    String longLink = dir.toString() + "/long" + "/x".repeat(300);
+    NativePosixFiles.mkdirs(longLink.substring(0, longLink.lastIndexOf('/')), 0777);
+
+    NativePosixFiles.symlink(shortTarget, shortLink);
+    NativePosixFiles.symlink(longTarget, longLink);
+
+    assertThat(NativePosixFiles.readlink(shortLink)).isEqualTo(shortTarget);
+    assertThat(NativePosixFiles.readlink(longLink)).isEqualTo(longTarget);
+    assertThat(NativePosixFiles.lstat(longLink, StatErrorHandling.ALWAYS_THROW).isSymbolicLink())
+        .isTrue();
+  }
+
   @Test
   public void writing() throws Exception {
     java.nio.file.Path myfile = Files.createTempFile("myfile", null);
@@ -15,8 +15,15 @@
 package com.google.devtools.build.lib.vfs.bazel;
 
 import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertThrows;
 
+import com.google.common.hash.HashCode;
+import java.io.FileNotFoundException;
+import java.nio.ByteBuffer;
 import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.Arrays;
 import org.junit.Test;
 import org.junit.runner.RunWith;
 import org.junit.runners.JUnit4;
@@ -45,4 +52,69 @@ public class Blake3HasherTest {
     assertEquals(
         "d74981efa70a0c880b8d8c1985d075dbcbf679b99a5f9914e5aaf96b831a9e24", h.hash().toString());
   }
+
+  @Test
+  public void directBufferMatchesArray() {
+    byte[] data = new byte[100_000];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte) (i * 31);
+    }
+    ByteBuffer direct = ByteBuffer.allocateDirect(data.length);
+    direct.put(data).flip();
+
+    Blake3Hasher fromArray = new Blake3Hasher(new Blake3MessageDigest());
+    fromArray.putBytes(data, 0, 10);
+    fromArray.putBytes(data, 10, data.length - 10);
+    Blake3Hasher fromDirect = new Blake3Hasher(new Blake3MessageDigest());
+    fromDirect.putBytes(direct);
+
+    assertEquals(fromArray.hash(), fromDirect.hash());
+    assertEquals(data.length, direct.position());
+  }
+
+  @Test
+  public void hashFileMatchesHasher() throws Exception {
+    byte[] data = new byte[1_000_000];
+    for (int i = 0; i < data.length; i++) {
+      data[i] = (byte) (i % 251);
+    }
+    Path file = Files.createTempFile("blake3", null);
+    Files.write(file, data);
+
+    Blake3Hasher h = new Blake3Hasher(new Blake3MessageDigest());
+    h.putBytes(data);
+
+    assertEquals(h.hash(), HashCode.fromBytes(Blake3MessageDigest.hashFile(file.toString())));
+    assertThrows(
+        FileNotFoundException.class,
+        () -> Blake3MessageDigest.hashFile(file.resolveSibling("nonexistent").toString()));
+  }
+
+  @Test
+  public void hashFilesMatchesHashFile() throws Exception {
+    String[] paths = new String[20];
+    for (int i = 0; i < paths.length; i++) {
+      Path file = Files.createTempFile("blake3", null);
+      Files.write(file, new byte[i * 10_000]);
+      paths[i] = file.toString();
+    }
+    paths[7] = paths[7] + ".nonexistent";
+
+    byte[] digests = new byte[paths.length * Blake3MessageDigest.OUT_LEN];
+    int[] errnos = new int[paths.length];
+    Blake3MessageDigest.hashFiles(paths, 4, digests, errnos);
+
+    for (int i = 0; i < paths.length; i++) {
+      if (i == 7) {
+        assertEquals(2, errnos[i]); // ENOENT
+        continue;
+      }
+      assertEquals(0, errnos[i]);
+      assertEquals(
+          HashCode.fromBytes(Blake3MessageDigest.hashFile(paths[i])),
+          HashCode.fromBytes(
+              Arrays.copyOfRange(
+                  digests, i * Blake3MessageDigest.OUT_LEN, (i + 1) * Blake3MessageDigest.OUT_LEN)));
+    }
+  }
 }
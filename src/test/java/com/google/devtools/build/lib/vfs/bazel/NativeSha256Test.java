@@ -0,0 +1,160 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+package com.google.devtools.build.lib.vfs.bazel;
+
+import static com.google.common.truth.Truth.assertThat;
+import static org.junit.Assert.assertArrayEquals;
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertNull;
+import static org.junit.Assert.assertThrows;
+import static org.junit.Assume.assumeTrue;
+
+import com.google.common.hash.Hashing;
+import java.io.FileNotFoundException;
+import java.nio.ByteBuffer;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.attribute.FileTime;
+import java.nio.file.attribute.UserDefinedFileAttributeView;
+import java.time.Duration;
+import java.time.Instant;
+import java.util.Arrays;
+import org.junit.Test;
+import org.junit.runner.RunWith;
+import org.junit.runners.JUnit4;
+
+/** Tests for {@link NativeSha256}. */
+@RunWith(JUnit4.class)
+public class NativeSha256Test {
+  private static byte[] data(int size) {
+    byte[] data = new byte[size];
+    for (int i = 0; i < size; i++) {
+      data[i] = (byte) (i % 251);
+    }
+    return data;
+  }
+
+  @Test
+  public void hashFileMatchesGuava() throws Exception {
+    // Sizes around the padding boundaries of a 64-byte block.
+    for (int size : new int[] {0, 1, 55, 56, 63, 64, 65, 1_000_000}) {
+      byte[] data = data(size);
+      Path file = Files.createTempFile("sha256", null);
+      Files.write(file, data);
+
+      assertArrayEquals(
+          Hashing.sha256().hashBytes(data).asBytes(), NativeSha256.hashFile(file.toString()));
+    }
+  }
+
+  @Test
+  public void hashFileThrowsForMissingFile() throws Exception {
+    Path dir = Files.createTempDirectory("sha256");
+    assertThrows(
+        FileNotFoundException.class,
+        () -> NativeSha256.hashFile(dir.resolve("nonexistent").toString()));
+  }
+
+  @Test
+  public void hashFileRemembersDigestInAttribute() throws Exception {
+    Path file = Files.createTempFile("sha256", null);
+    Files.write(file, data(1000));
+    // Recently modified files do not get the attribute.
+    Files.setLastModifiedTime(file, FileTime.from(Instant.now().minus(Duration.ofHours(1))));
+    UserDefinedFileAttributeView view =
+        Files.getFileAttributeView(file, UserDefinedFileAttributeView.class);
+    assumeTrue(view != null && Files.getFileStore(file).supportsFileAttributeView("user"));
+    byte[] expected = Hashing.sha256().hashBytes(data(1000)).asBytes();
+
+    assertArrayEquals(expected, NativeSha256.hashFile(file.toString(), "user.bazel.digest"));
+    assertThat(view.list()).contains("bazel.digest");
+
+    // The digest is now taken from the attribute rather than the contents.
+    ByteBuffer record = ByteBuffer.allocate(view.size("bazel.digest"));
+    view.read("bazel.digest", record);
+    record.array()[record.limit() - 1] ^= 1;
+    view.write("bazel.digest", record.flip());
+    byte[] fromAttribute = expected.clone();
+    fromAttribute[fromAttribute.length - 1] ^= 1;
+    assertArrayEquals(
+        fromAttribute, NativeSha256.hashFile(file.toString(), "user.bazel.digest"));
+
+    // Not once the file changed.
+    Files.write(file, data(2000));
+    Files.setLastModifiedTime(file, FileTime.from(Instant.now().minus(Duration.ofHours(1))));
+    assertArrayEquals(
+        Hashing.sha256().hashBytes(data(2000)).asBytes(),
+        NativeSha256.hashFile(file.toString(), "user.bazel.digest"));
+  }
+
+  @Test
+  public void hashFilesMatchesHashFile() throws Exception {
+    String[] paths = new String[20];
+    for (int i = 0; i < paths.length; i++) {
+      Path file = Files.createTempFile("sha256", null);
+      Files.write(file, data(i * 10_000));
+      paths[i] = file.toString();
+    }
+    paths[7] = paths[7] + ".nonexistent";
+
+    byte[] digests = new byte[paths.length * NativeSha256.OUT_LEN];
+    int[] errnos = new int[paths.length];
+    NativeSha256.hashFiles(paths, 4, digests, errnos);
+
+    for (int i = 0; i < paths.length; i++) {
+      if (i == 7) {
+        assertEquals(2, errnos[i]); // ENOENT
+        continue;
+      }
+      assertEquals(0, errnos[i]);
+      assertArrayEquals(
+          NativeSha256.hashFile(paths[i]),
+          Arrays.copyOfRange(digests, i * NativeSha256.OUT_LEN, (i + 1) * NativeSha256.OUT_LEN));
+    }
+  }
+
+  @Test
+  public void merkleTreeDigestsFiles() throws Exception {
+    Path dir = Files.createTempDirectory("sha256");
+    Files.createDirectories(dir.resolve("a/b"));
+    Files.write(dir.resolve("a/b/f"), data(100));
+    Files.write(dir.resolve("g"), data(10));
+    Files.createSymbolicLink(dir.resolve("h"), dir.resolve("g"));
+    Files.createSymbolicLink(dir.resolve("r"), Path.of("g"));
+
+    Object[] tree = NativeSha256.merkleTree(dir.toString(), 4);
+
+    String[] files = (String[]) tree[1];
+    byte[] digests = (byte[]) tree[2];
+    long[] sizes = (long[]) tree[3];
+    String[] sortedFiles = files.clone();
+    Arrays.sort(sortedFiles);
+    assertArrayEquals(new String[] {"a/b/f", "g", "h"}, sortedFiles);
+    for (int i = 0; i < files.length; i++) {
+      String path = dir.resolve(files[i]).toString();
+      assertArrayEquals(
+          NativeSha256.hashFile(path),
+          Arrays.copyOfRange(digests, i * NativeSha256.OUT_LEN, (i + 1) * NativeSha256.OUT_LEN));
+      assertEquals(Files.size(Path.of(path)), sizes[i]);
+    }
+  }
+
+  @Test
+  public void merkleTreeReturnsNullForDanglingAbsoluteSymlink() throws Exception {
+    Path dir = Files.createTempDirectory("sha256");
+    Files.createSymbolicLink(dir.resolve("l"), dir.resolve("nonexistent"));
+
+    assertNull(NativeSha256.merkleTree(dir.toString(), 4));
+  }
+}
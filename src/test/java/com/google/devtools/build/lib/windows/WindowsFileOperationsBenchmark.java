@@ -0,0 +1,143 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package com.google.devtools.build.lib.windows;
+
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Level;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.infra.Blackhole;
+
+/**
+ * Measures the JNI calls of {@link WindowsFileOperations} over a synthetic tree of {@link
+ * #DIRECTORIES} directories with {@link #entries} files each, like {@code
+ * NativePosixFilesBenchmark} does on Unix.
+ *
+ * <p>Each operation covers the whole tree, once with a call per file and once with a call per
+ * directory where there is one. Run with {@code -prof gc} to also get the bytes allocated per
+ * operation.
+ */
+@BenchmarkMode(Mode.Throughput)
+@State(Scope.Benchmark)
+public class WindowsFileOperationsBenchmark {
+
+  private static final int DIRECTORIES = 16;
+
+  @Param({"10", "1000"})
+  public int entries;
+
+  private Path root;
+  private String[] directories;
+  private String[] files;
+
+  @Setup(Level.Trial)
+  public void createTree() throws IOException {
+    root = Files.createTempDirectory("windows_file_operations_benchmark");
+    directories = new String[DIRECTORIES];
+    files = new String[DIRECTORIES * entries];
+    for (int d = 0; d < DIRECTORIES; d++) {
+      Path directory = Files.createDirectory(root.resolve("d" + d));
+      directories[d] = directory.toString();
+      for (int f = 0; f < entries; f++) {
+        files[d * entries + f] = Files.writeString(directory.resolve("f" + f), "x").toString();
+      }
+    }
+  }
+
+  @TearDown(Level.Trial)
+  public void deleteTree() throws IOException {
+    WindowsFileOperations.deleteTreesBelow(root.toString(), 1);
+    WindowsFileOperations.deletePath(root.toString());
+  }
+
+  @Benchmark
+  public void getLastChangeTimeEach(Blackhole blackhole) throws IOException {
+    for (String file : files) {
+      blackhole.consume(WindowsFileOperations.getLastChangeTime(file, false));
+    }
+  }
+
+  @Benchmark
+  public void isSymlinkOrJunctionEach(Blackhole blackhole) throws IOException {
+    for (String file : files) {
+      blackhole.consume(WindowsFileOperations.isSymlinkOrJunction(file));
+    }
+  }
+
+  /** Gets the same metadata as the two benchmarks above with a call per directory. */
+  @Benchmark
+  public void readDirectoryMetadataEach(Blackhole blackhole) throws IOException {
+    for (String directory : directories) {
+      blackhole.consume(WindowsFileOperations.readDirectoryMetadata(directory));
+    }
+  }
+
+  /** A directory for the benchmarks that modify the tree, emptied before each operation. */
+  @State(Scope.Benchmark)
+  public static class Scratch {
+    private String directory;
+    private String[] links;
+    private String[] linkTargets;
+
+    @Setup(Level.Trial)
+    public void create(WindowsFileOperationsBenchmark benchmark) throws IOException {
+      directory = Files.createDirectory(benchmark.root.resolve("scratch")).toString();
+      links = new String[benchmark.entries];
+      linkTargets = new String[benchmark.entries];
+      for (int i = 0; i < links.length; i++) {
+        links[i] = directory + "\\l" + i;
+        linkTargets[i] = benchmark.directories[i % DIRECTORIES];
+      }
+    }
+
+    @Setup(Level.Invocation)
+    public void clear() throws IOException {
+      WindowsFileOperations.deleteTreesBelow(directory, 1);
+    }
+
+    // Junctions rather than symlinks, which need the privilege to create them.
+    void createJunctions() throws IOException {
+      for (int i = 0; i < links.length; i++) {
+        WindowsFileOperations.createJunction(links[i], linkTargets[i]);
+      }
+    }
+  }
+
+  @Benchmark
+  public void createJunctionEach(Scratch scratch) throws IOException {
+    scratch.createJunctions();
+  }
+
+  @Benchmark
+  public void deleteTreesBelow(Scratch scratch) throws IOException {
+    scratch.createJunctions();
+    WindowsFileOperations.deleteTreesBelow(scratch.directory, 1);
+  }
+
+  @Benchmark
+  public void deleteTreesBelowParallel(Scratch scratch) throws IOException {
+    scratch.createJunctions();
+    WindowsFileOperations.deleteTreesBelow(
+        scratch.directory, Runtime.getRuntime().availableProcessors());
+  }
+}
@@ -15,6 +15,7 @@
 package com.google.devtools.build.lib.windows;
 
 import static com.google.common.truth.Truth.assertThat;
+import static org.junit.Assert.assertThrows;
 import static org.junit.Assert.fail;
 
 import com.google.common.collect.ImmutableMap;
@@ -22,8 +23,10 @@ import com.google.devtools.build.lib.testutil.TestSpec;
 import com.google.devtools.build.lib.util.OS;
 import com.google.devtools.build.lib.windows.util.WindowsTestUtil;
 import java.io.File;
+import java.io.FileNotFoundException;
 import java.io.IOException;
 import java.nio.file.Files;
+import java.nio.file.NotDirectoryException;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.Map;
@@ -217,6 +220,42 @@ public class WindowsFileOperationsTest {
     assertThat(WindowsFileOperations.isSymlinkOrJunction(shortPath)).isFalse();
   }
 
+  @Test
+  public void testReadDirectoryMetadata() throws Exception {
+    String root = testUtil.scratchDir("dir").toAbsolutePath().toString();
+    File file = testUtil.scratchFile("dir/file.txt", "hello").toAbsolutePath().toFile();
+    testUtil.scratchDir("dir/sub");
+    testUtil.scratchDir("target");
+    testUtil.createJunctions(ImmutableMap.of("dir/junc", "target"));
+
+    WindowsFileOperations.DirectoryEntries entries =
+        WindowsFileOperations.readDirectoryMetadata(root);
+
+    Map<String, Integer> indices = new HashMap<>();
+    for (int i = 0; i < entries.size(); i++) {
+      indices.put(entries.getName(i), i);
+    }
+    assertThat(indices.keySet()).containsExactly("file.txt", "sub", "junc");
+    int f = indices.get("file.txt");
+    assertThat(entries.isDirectory(f)).isFalse();
+    assertThat(entries.isSymlinkOrJunction(f)).isFalse();
+    assertThat(entries.getSize(f)).isEqualTo(5);
+    assertThat(entries.getLastModifiedTime(f)).isEqualTo(file.lastModified());
+    assertThat(entries.getLastChangeTime(f))
+        .isEqualTo(WindowsFileOperations.getLastChangeTime(file.toString(), false));
+    assertThat(entries.isDirectory(indices.get("sub"))).isTrue();
+    int j = indices.get("junc");
+    assertThat(entries.isSymlinkOrJunction(j)).isTrue();
+    assertThat(entries.getReparseTag(j)).isEqualTo(0xA0000003); // IO_REPARSE_TAG_MOUNT_POINT
+
+    assertThrows(
+        FileNotFoundException.class,
+        () -> WindowsFileOperations.readDirectoryMetadata(root + "\\nonexistent"));
+    assertThrows(
+        NotDirectoryException.class,
+        () -> WindowsFileOperations.readDirectoryMetadata(file.toString()));
+  }
+
   @Test
   public void testGetLongPath() throws Exception {
     File foo = testUtil.scratchDir("foo").toAbsolutePath().toFile();
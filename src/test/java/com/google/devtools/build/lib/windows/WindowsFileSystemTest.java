@@ -422,4 +422,25 @@ public class WindowsFileSystemTest {
     fileViaJunction.setWritable(true);
     assertThat(fileViaJunction.isWritable()).isTrue();
   }
+
+  @Test
+  public void testDeleteTreesBelow() throws Exception {
+    testUtil.scratchFile("target\\kept.txt", "hello");
+    // Enough directories for the other threads to start.
+    for (int i = 0; i < 20; i++) {
+      for (int j = 0; j < 5; j++) {
+        testUtil.scratchFile("tree\\a" + i + "\\b" + j + "\\file.txt", "hello");
+      }
+    }
+    testUtil.createJunctions(ImmutableMap.of("tree\\a0\\junc", "target"));
+    Path readOnly = testUtil.createVfsPath(fs, "tree\\a1\\b1\\file.txt");
+    readOnly.setWritable(false);
+    Path tree = testUtil.createVfsPath(fs, "tree");
+
+    tree.deleteTreesBelow();
+
+    assertThat(tree.getDirectoryEntries()).isEmpty();
+    // The junction was deleted, not the directory it points to.
+    assertThat(testUtil.createVfsPath(fs, "target\\kept.txt").exists()).isTrue();
+  }
 }
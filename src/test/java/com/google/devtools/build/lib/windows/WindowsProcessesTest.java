@@ -180,6 +180,24 @@ public class WindowsProcessesTest {
     assertNoProcessError();
   }
 
+  @Test
+  public void testResourceUsage() throws Exception {
+    process = WindowsProcesses.createProcess(mockBinary, mockArgs("X0"), null, null, null, null);
+    assertThat(WindowsProcesses.waitFor(process, -1)).isEqualTo(0);
+    long[] usage = new long[WindowsProcesses.RESOURCE_USAGE_SIZE];
+    assertThat(WindowsProcesses.getResourceUsage(process, usage)).isTrue();
+    assertNoProcessError();
+    // Starting a JVM takes some CPU time, memory and reads.
+    assertThat(usage[0] + usage[1]).isGreaterThan(0L);
+    assertThat(usage[2]).isGreaterThan(0L);
+    assertThat(usage[3]).isGreaterThan(0L);
+
+    // The final usage remains available after the job object was closed.
+    long[] again = new long[WindowsProcesses.RESOURCE_USAGE_SIZE];
+    assertThat(WindowsProcesses.getResourceUsage(process, again)).isTrue();
+    assertThat(again).isEqualTo(usage);
+  }
+
   @Test
   public void testPartialRead() throws Exception {
     process =
@@ -566,6 +566,10 @@ class LauncherTest(test_base.TestBase):
     classpath = stdout[stdout.index('-classpath') + 1]
     self.assertRegex(classpath, r'foo-[A-Za-z0-9]+-classpath.jar$')
 
+    # The classpath jar is cached and reused by later launches.
+    _, stdout, _ = self.RunProgram([binary, '--classpath_limit=0', print_cmd])
+    self.assertEqual(stdout[stdout.index('-classpath') + 1], classpath)
+
   def testWindowsNativeLauncherInNonEnglishPath(self):
     if not self.IsWindows():
       return
@@ -410,6 +410,51 @@ class TestWrapperTest(test_base.TestBase):
     if sorted(index_lines) != ['INDEX=0 TOTAL=2', 'INDEX=1 TOTAL=2']:
       self._FailWithOutput(stderr + stdout)
 
+  def _AssertAllShardsInOneProcess(self, flags):
+    _, stdout, stderr = self.RunBazel(
+        [
+            'test',
+            '//foo:sharded_test',
+            '-t-',
+            '--test_output=all',
+            '--test_env=TEST_WRAPPER_RUN_ALL_SHARDS=1',
+        ]
+        + flags
+    )
+    index_lines = [
+        line for line in stderr + stdout if line.startswith('INDEX=')
+    ]
+    # Each of the two shard actions runs both shards.
+    if sorted(index_lines) != [
+        'INDEX=0 TOTAL=2',
+        'INDEX=0 TOTAL=2',
+        'INDEX=1 TOTAL=2',
+        'INDEX=1 TOTAL=2',
+    ]:
+      self._FailWithOutput(stderr + stdout)
+
+  def _AssertFailingTestAttempts(self, flags):
+    exit_code, stdout, stderr = self.RunBazel(
+        [
+            'test',
+            '//foo:failing_test',
+            '-t-',
+            '--test_output=all',
+            '--test_env=TEST_WRAPPER_ATTEMPTS=3',
+        ]
+        + flags,
+        allow_failure=True,
+    )
+    self.AssertExitCode(exit_code, 3, stderr)
+    attempt_lines = [
+        line for line in stderr + stdout if line.startswith('Test failed with')
+    ]
+    if attempt_lines != [
+        'Test failed with exit code 1, attempt 1 of 3',
+        'Test failed with exit code 1, attempt 2 of 3',
+    ]:
+      self._FailWithOutput(stderr + stdout)
+
   def _AssertUnexportsEnvvars(self, flags):
     _, stdout, stderr = self.RunBazel(
         [
@@ -731,6 +776,8 @@ class TestWrapperTest(test_base.TestBase):
     self._AssertRunfiles(flags)
     self._AssertRunfilesSymlinks(flags)
     self._AssertShardedTest(flags)
+    self._AssertAllShardsInOneProcess(flags)
+    self._AssertFailingTestAttempts(flags)
     self._AssertUnexportsEnvvars(flags)
     self._AssertTestBinaryLocation(flags)
     self._AssertTestArgs(flags)
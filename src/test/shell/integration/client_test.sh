@@ -81,6 +81,30 @@ function test_multiple_requests_same_server() {
   expect_not_log "WARNING.* Running B\\(azel\\|laze\\) server needs to be killed"
 }
 
+function test_command_server_unix_socket() {
+  case "$(uname -s | tr [:upper:] [:lower:])" in
+  msys*|mingw*|cygwin*)
+    # The server listens on localhost on Windows.
+    return ;;
+  esac
+
+  local output_base=$(bazel --experimental_command_server_unix_socket \
+      info output_base 2>$TEST_log)
+  local socket="$output_base/server/command.socket"
+  if [[ "${#socket}" -ge 104 ]]; then
+    echo "Skipping, the socket path $socket is too long"
+    return
+  fi
+  assert_equals "unix:$socket" "$(cat "$output_base/server/command_port")"
+
+  local server_pid1=$(bazel --experimental_command_server_unix_socket \
+      info server_pid 2>$TEST_log)
+  local server_pid2=$(bazel --experimental_command_server_unix_socket \
+      info server_pid 2>$TEST_log)
+  assert_equals "$server_pid1" "$server_pid2"
+  expect_not_log "WARNING.* Running B\\(azel\\|laze\\) server needs to be killed"
+}
+
 function test_no_server_restart_if_options_order_changes() {
   local server_pid1=$(bazel \
                       --host_jvm_args=-Dfoo \
@@ -560,6 +584,17 @@ function test_noblock_for_lock_with_batch() {
       "Exiting because the output base lock is held and --noblock_for_lock was given"
 }
 
+function test_read_only_commands() {
+  bazel info &>"$TEST_log" || fail "Expected success"
+  local -r commands="$(bazel info output_base)/server/read_only_commands"
+
+  assert_contains "^info$" "$commands"
+  assert_contains "^version$" "$commands"
+  assert_not_contains "^query$" "$commands"
+  assert_not_contains "^build$" "$commands"
+  assert_not_contains "^clean$" "$commands"
+}
+
 function test_no_arguments() {
   bazel >&$TEST_log || fail "Expected zero exit"
   expect_log "Usage: b\\(laze\\|azel\\)"
@@ -845,6 +880,66 @@ function test_sigquit() {
   assert_contains "Full thread dump" "$jvm_out"
 }
 
+function test_command_file() {
+  mkdir -p foo
+  echo "filegroup(name='bar')" > foo/BUILD
+  cat > commands <<'EOF'
+# Comments and empty lines are skipped.
+
+query //foo:all
+query //foo:nonexistent
+info server_pid
+EOF
+
+  bazel --client_debug --command_file=commands >stdout 2>"$TEST_log" \
+    && fail "Expected the failing query to fail the client"
+  expect_log "Running command from the command file: query //foo:all"
+  expect_log "Running command from the command file: info server_pid"
+  # The locks are only acquired once for all the commands.
+  assert_equals 1 "$(grep -c 'Acquired the client lock' "$TEST_log")"
+  cp stdout "$TEST_log"
+  expect_log "^//foo:bar$"
+  expect_log "^[0-9]\+$"
+
+  echo "info server_pid" | bazel --command_file=- >"$TEST_log" \
+    || fail "Expected success"
+  expect_log "^[0-9]\+$"
+}
+
+function test_command_file_rejects_command() {
+  echo "info" > commands
+  bazel --command_file=commands info >&"$TEST_log" && fail "Expected failure"
+  expect_log "--command_file cannot be combined with a command"
+}
+
+function test_server_class_data_sharing_archive() {
+  local -r install_base="$(bazel info install_base)"
+  bazel shutdown || fail "Expected shutdown to succeed"
+  [[ -s "${install_base}.jsa" ]] \
+    || fail "Expected the server to create ${install_base}.jsa on exit"
+
+  bazel info server_pid >&"$TEST_log" || fail "Expected info to succeed"
+  bazel --noserver_class_data_sharing info server_pid >&"$TEST_log" \
+    || fail "Expected info to succeed"
+  expect_log "startup options are different"
+}
+
+function test_server_aot_cache() {
+  local -r install_base="$(bazel info install_base)"
+  bazel --experimental_server_aot_cache info server_pid >&"$TEST_log" \
+    || fail "Expected info to succeed"
+  expect_log "startup options are different"
+  [[ -d "${install_base}.aot" ]] \
+    || fail "Expected the client to create ${install_base}.aot"
+
+  # Without a cache the JVM records one, with it the JVM starts from it.
+  # Either way, the server comes up.
+  bazel --experimental_server_aot_cache shutdown \
+    || fail "Expected shutdown to succeed"
+  bazel --experimental_server_aot_cache info server_pid >&"$TEST_log" \
+    || fail "Expected info to succeed"
+}
+
 function scrape_client_pid() {
   sed -nr 's/.*Running \(pid=([0-9]+)\)/\1/p'
 }
@@ -63,3 +63,22 @@ function assert_execution_time_in_range() {
     fail "reported stime of '${stime}' is out of expected range"
   fi
 }
+
+# Decodes the first sample of a resource samples file (-r of process-wrapper
+# and linux-sandbox), in which each ResourceSample is preceded by its size as
+# a varint, to the given output file.
+#
+# This relies on ${protoc_compiler} being set (currently set in testenv.sh)
+#
+function decode_first_resource_sample() {
+  local samples_path="$1"; shift
+  local decoded_path="$1"; shift
+
+  # The size is a single byte for samples this small.
+  local size="$(od -An -tu1 -N1 "${samples_path}" | tr -d ' ')"
+  [[ -n "${size}" ]] || fail "No resource samples in '${samples_path}'"
+  tail -c +2 "${samples_path}" | head -c "${size}" \
+    | "${protoc_compiler}" --proto_path="${STATS_PROTO_DIR}" \
+      --decode tools.protos.ResourceSample execution_statistics.proto \
+      > "${decoded_path}" || fail "Cannot decode '${samples_path}'"
+}
@@ -75,6 +75,20 @@ function test_exit_code() {
   assert_equals 71 "$code"
 }
 
+function test_lazy_outputs() {
+  local -r out="${TEST_TMPDIR}/lazy.out"
+  local -r err="${TEST_TMPDIR}/lazy.err"
+  rm -f "$out" "$err"
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -E -l "$out" -L "$err" -- /bin/true \
+    &> $TEST_log || fail
+  [[ ! -e "$out" && ! -e "$err" ]] || fail "expected no output files"
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -E -l "$out" -L "$err" -- \
+    /bin/bash -c "echo hi there; echo oops >&2" &> $TEST_log || fail
+  assert_equals "hi there" "$(cat "$out")"
+  assert_equals "oops" "$(cat "$err")"
+}
+
 function test_signal_death() {
   $linux_sandbox $SANDBOX_DEFAULT_OPTS -- /bin/bash -c 'kill -ABRT $$' &> $TEST_log || code=$?
   assert_equals 134 "$code" # SIGNAL_BASE + SIGABRT = 128 + 6
@@ -258,6 +272,144 @@ function test_mount_additional_paths_multiple_sources_mount_to_one_target() {
   rm -rf ${MOUNT_TARGET_ROOT}/foo
 }
 
+function test_mount_additional_paths_from_file() {
+  mkdir -p ${TEST_TMPDIR}/foo
+  mkdir -p ${TEST_TMPDIR}/bar
+  mkdir -p ${MOUNT_TARGET_ROOT}/foo
+  printf '%s\0' \
+    ${TEST_TMPDIR}/foo ${MOUNT_TARGET_ROOT}/foo \
+    ${TEST_TMPDIR}/bar ${TEST_TMPDIR}/bar \
+    > ${TEST_TMPDIR}/mounts
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -D /tmp/debug \
+    -B ${TEST_TMPDIR}/mounts \
+    -- /bin/true &> $TEST_log || code=$?
+  assert_contains "bind mount: ${TEST_TMPDIR}/foo -> ${MOUNT_TARGET_ROOT}/foo\$" /tmp/debug
+  assert_contains "bind mount: ${TEST_TMPDIR}/bar -> ${TEST_TMPDIR}/bar\$" /tmp/debug
+  assert_contains "child exited normally with code 0" /tmp/debug
+  rm -rf ${MOUNT_TARGET_ROOT}/foo
+}
+
+function test_mount_additional_paths_from_file_without_target() {
+  printf '%s\0' ${TEST_TMPDIR}/foo > ${TEST_TMPDIR}/mounts
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -B ${TEST_TMPDIR}/mounts \
+    -- /bin/true &> $TEST_log && fail "Expected sandbox run to fail"
+  expect_log "The -B file ${TEST_TMPDIR}/mounts has a source without a target."
+}
+
+function test_hermetic_overlay() {
+  local -r lower="${TEST_TMPDIR}/lower"
+  local -r root="${TEST_TMPDIR}/root"
+  mkdir -p "$lower/execroot/in" "$root/execroot" "${TEST_TMPDIR}/work"
+
+  # Overlayfs can only be mounted in user namespaces since Linux 5.11.
+  mkdir -p "${TEST_TMPDIR}/probe/upper" "${TEST_TMPDIR}/probe/work"
+  if ! unshare -Urm mount -t overlay overlay -o "lowerdir=$lower,upperdir=${TEST_TMPDIR}/probe/upper,workdir=${TEST_TMPDIR}/probe/work" \
+      "${TEST_TMPDIR}/probe/upper" &>/dev/null; then
+    echo "Overlayfs not supported in user namespaces, skipping test"
+    return 0
+  fi
+  echo "input" > "$lower/execroot/in/file"
+
+  local mounts=()
+  for dir in /bin /lib /lib64 /usr; do
+    [[ -d "$dir" ]] && mounts+=(-M "$dir")
+  done
+  $linux_sandbox -h "$root" -W "$root/execroot" -O "$lower" \
+    -o "${TEST_TMPDIR}/work" "${mounts[@]}" -- \
+    /bin/bash -c "cat in/file; echo output > out" &> $TEST_log || fail
+
+  expect_log "input"
+  # Outputs land in the sandbox dir, and the lower directory stays untouched.
+  assert_equals "output" "$(cat "$root/execroot/out")"
+  [[ ! -e "$lower/execroot/out" ]] || fail "output written to lower dir"
+}
+
+function test_hermetic_overlay_requires_work_dir() {
+  $linux_sandbox -h "$SANDBOX_DIR" -O "${TEST_TMPDIR}" -- /bin/true \
+    &> $TEST_log && fail "Expected sandbox run to fail"
+  expect_log "The -O and -o options must be used together."
+}
+
+function test_hermetic_lazy_inputs() {
+  local -r root="${TEST_TMPDIR}/root"
+  mkdir -p "$root/execroot" "${TEST_TMPDIR}/inputs"
+  echo "used" > "${TEST_TMPDIR}/inputs/used"
+  echo "unused" > "${TEST_TMPDIR}/inputs/unused"
+
+  local mounts=()
+  for dir in /bin /lib /lib64 /usr; do
+    [[ -d "$dir" ]] && mounts+=(-M "$dir")
+  done
+  $linux_sandbox -h "$root" -W "$root/execroot" -I "${mounts[@]}" \
+    -M "${TEST_TMPDIR}/inputs/used" -m "/execroot/dir/used" \
+    -M "${TEST_TMPDIR}/inputs/unused" -m "/execroot/dir/unused" -- \
+    /bin/bash -c "cd dir && cat ./used" &> $TEST_log || fail
+
+  expect_log "used"
+  # Only the input that the command accessed was mounted.
+  [[ -e "$root/execroot/dir/used" ]] || fail "used input not mounted"
+  [[ ! -e "$root/execroot/dir/unused" ]] || fail "unused input mounted"
+}
+
+function test_lazy_inputs_require_hermetic() {
+  $linux_sandbox -I -- /bin/true &> $TEST_log \
+    && fail "Expected sandbox run to fail"
+  expect_log "The -I option can only be used with -h."
+}
+
+function test_accessed_inputs() {
+  mkdir -p "${TEST_TMPDIR}/inputs/used" "${TEST_TMPDIR}/inputs/unused" \
+    "${TEST_TMPDIR}/mounts/used" "${TEST_TMPDIR}/mounts/unused"
+  echo "used" > "${TEST_TMPDIR}/inputs/used/file"
+  echo "unused" > "${TEST_TMPDIR}/inputs/unused/file"
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -A "${TEST_TMPDIR}/accessed" \
+    -M "${TEST_TMPDIR}/inputs/used" -m "${TEST_TMPDIR}/mounts/used" \
+    -M "${TEST_TMPDIR}/inputs/unused" -m "${TEST_TMPDIR}/mounts/unused" -- \
+    /bin/cat "${TEST_TMPDIR}/mounts/used/file" &> $TEST_log || fail
+
+  expect_log "used"
+  assert_equals "${TEST_TMPDIR}/mounts/used" "$(cat "${TEST_TMPDIR}/accessed")"
+}
+
+function test_accessed_inputs_not_in_server_mode() {
+  $linux_sandbox -z -A "${TEST_TMPDIR}/accessed" &> $TEST_log \
+    && fail "Expected sandbox run to fail"
+  expect_log "cannot be used with -z"
+}
+
+function test_resource_samples() {
+  local -r samples="${TEST_TMPDIR}/samples"
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -r "${samples}" -q 0.1 \
+    -- /bin/sh -c "sleep 1" &> $TEST_log || fail
+
+  decode_first_resource_sample "${samples}" "${TEST_TMPDIR}/sample.decoded"
+  assert_contains "process_count: " "${TEST_TMPDIR}/sample.decoded"
+}
+
+function test_tmpfs_working_dir() {
+  mkdir -p "$SANDBOX_DIR/out"
+  echo "input" > "$SANDBOX_DIR/input"
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -F 1000000 \
+    -Y "$SANDBOX_DIR/out/file" -Y "$SANDBOX_DIR/out/tree" -- \
+    /bin/sh -c "cat input > out/file && mkdir -p out/tree/dir && \
+      echo tree > out/tree/dir/file && echo scratch > scratch" \
+    &> $TEST_log || fail
+
+  assert_equals "input" "$(cat "$SANDBOX_DIR/out/file")"
+  assert_equals "tree" "$(cat "$SANDBOX_DIR/out/tree/dir/file")"
+  # What is not a declared output stays in the tmpfs.
+  [[ ! -e "$SANDBOX_DIR/scratch" ]] || fail "scratch file written to disk"
+}
+
+function test_tmpfs_working_dir_is_size_capped() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -F 1000000 -- \
+    /bin/sh -c "head -c 2000000 /dev/zero > big" &> $TEST_log \
+    && fail "Expected write to fail"
+  expect_log "No space left on device"
+}
+
 function test_redirect_output() {
   $linux_sandbox $SANDBOX_DEFAULT_OPTS -l $OUT -L $ERR -- /bin/bash -c "echo out; echo err >&2" &> $TEST_log || code=$?
   assert_equals "out" "$(cat $OUT)"
@@ -483,6 +635,140 @@ EOF
   expect_not_log "hi there"
 }
 
+# Tests that linux_sandbox.cc can create a cgroup v2 for the command
+function test_cgroups2_action_cgroup_memory_limit() {
+  if ! grep '^0::' /proc/self/cgroup &>/dev/null; then
+    echo "Not using cgroups v2, skipping test"
+    return 0
+  fi
+  if ! XDG_RUNTIME_DIR=/run/user/$( id -u ) systemd-run --user --scope true; then
+    echo "Not able to use systemd, skipping test"
+    return 0
+  fi
+  cat >${TEST_TMPDIR}/run_sandbox_with_action_cgroup.sh <<EOF
+#!/bin/bash
+set -euo pipefail
+# Runs the sandbox in a cgroup of its own below a delegated cgroup
+cgroups_self=/sys/fs/cgroup\$( cut -d: -f3- /proc/self/cgroup)
+cgroups_parent=\$( dirname "\$cgroups_self" )
+cgroups_base="\$cgroups_parent"/blaze_test
+mkdir -p "\$cgroups_base" || ( echo "Error creating \$cgroups_base"; exit 1 )
+for cgroup in "\$cgroups_parent" "\$cgroups_base"; do
+  if ! grep memory "\$cgroup/cgroup.subtree_control" &>/dev/null ; then
+    echo +memory >"\$cgroup/cgroup.subtree_control" \
+      || ( echo "Error setting subtree control"; exit 1 )
+  fi
+done
+$linux_sandbox $SANDBOX_DEFAULT_OPTS -G "\$cgroups_base" -x \$1 \
+  -S "${TEST_TMPDIR}/stats.out" -- /bin/echo hi there
+EOF
+  chmod +x ${TEST_TMPDIR}/run_sandbox_with_action_cgroup.sh
+
+  XDG_RUNTIME_DIR=/run/user/$( id -u ) systemd-run --user --scope \
+    ${TEST_TMPDIR}/run_sandbox_with_action_cgroup.sh 1000000 &>$TEST_log \
+    || fail "Expected sandbox run to succeed"
+
+  expect_log "hi there"
+  [[ -s "${TEST_TMPDIR}/stats.out" ]] || fail "Expected stats to be written"
+
+  XDG_RUNTIME_DIR=/run/user/$( id -u ) systemd-run --user --scope \
+    ${TEST_TMPDIR}/run_sandbox_with_action_cgroup.sh 1000 &> $TEST_log \
+     && fail "Expected sandbox run to fail"
+
+  expect_not_log "hi there"
+}
+
+function test_cgroup_limits_require_parent_cgroup() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -x 1000000 -- /bin/true \
+    &> $TEST_log && fail "Expected sandbox run to fail"
+  expect_log "The -x and -y options can only be used with -G."
+}
+
+function test_join_network_namespace() {
+  unshare --map-current-user --net sleep 1000 &
+  local netns_pid=$!
+  sleep 1
+  if ! kill -0 "$netns_pid" 2>/dev/null; then
+    echo "Not able to create a network namespace, skipping test"
+    return 0
+  fi
+
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -j "/proc/$netns_pid/ns/net" -- \
+    /bin/readlink /proc/self/ns/net &> $TEST_log || code=$?
+  local netns="$(readlink "/proc/$netns_pid/ns/net")"
+  kill "$netns_pid"
+  assert_equals 0 "${code:-0}"
+  expect_log "^$netns$"
+}
+
+function test_join_network_namespace_excludes_new_one() {
+  $linux_sandbox $SANDBOX_DEFAULT_OPTS -N -j /proc/self/ns/net -- /bin/true \
+    &> $TEST_log && fail "Expected sandbox run to fail"
+  expect_log "Only one of -n, -N and -j may be specified."
+}
+
+function test_server_mode() {
+  local tmpfs="${TEST_TMPDIR}/tmpfs"
+  mkdir -p "$tmpfs"
+  printf '%s\n' \
+    -W "$SANDBOX_DIR" -l "$OUT" -w "$tmpfs" -- \
+      /bin/bash -c "echo out; touch $tmpfs/one" "" \
+    -W "$SANDBOX_DIR" -- /bin/bash -c "exit 71" "" \
+    -W "$SANDBOX_DIR" -L "$ERR" -e "$tmpfs" -- \
+      /bin/bash -c "ls $tmpfs >&2; touch $tmpfs/two; touch /etc/xyz" "" \
+    > "${TEST_TMPDIR}/requests"
+  # Each request runs once whether stdin is a file, which the server must not
+  # seek back, or a pipe.
+  for input in file pipe; do
+    rm -f "$tmpfs/one" "$tmpfs/two" $OUT $ERR
+    if [[ "$input" == file ]]; then
+      $linux_sandbox -z < "${TEST_TMPDIR}/requests" \
+        > "${TEST_TMPDIR}/replies" 2> $TEST_log || fail
+    else
+      cat "${TEST_TMPDIR}/requests" | $linux_sandbox -z \
+        > "${TEST_TMPDIR}/replies" 2> $TEST_log || fail
+    fi
+
+    assert_equals "0 71 1" "$(echo $(cat "${TEST_TMPDIR}/replies"))"
+    assert_equals "out" "$(cat $OUT)"
+    # Each request gets its own mounts on top of the read-only base.
+    assert_contains "Read-only file system" $ERR
+    assert_not_contains "one" $ERR
+    [[ -f "$tmpfs/one" ]] || fail "$tmpfs/one not written"
+    [[ ! -f "$tmpfs/two" ]] || fail "$tmpfs/two leaked out of its tmpfs"
+  done
+}
+
+function test_server_mode_namespaces_per_request() {
+  printf '%s\n' \
+    -W "$SANDBOX_DIR" -- /bin/bash -c "hostname changed" "" \
+    -W "$SANDBOX_DIR" -l "$OUT" -- /bin/bash -c "hostname" "" \
+    > "${TEST_TMPDIR}/requests"
+  $linux_sandbox -z -R -H -N < "${TEST_TMPDIR}/requests" \
+    > "${TEST_TMPDIR}/replies" 2> $TEST_log || fail
+  assert_equals "0 0" "$(echo $(cat "${TEST_TMPDIR}/replies"))"
+  # The hostname set by the first request is gone.
+  assert_equals "localhost" "$(cat $OUT)"
+}
+
+function test_server_mode_timeout() {
+  printf '%s\n' -W "$SANDBOX_DIR" -T 1 -t 10 -- /bin/bash -c \
+    'trap "exit 17" SIGTERM; sleep 10000 & wait' "" \
+    > "${TEST_TMPDIR}/requests"
+  $linux_sandbox -z < "${TEST_TMPDIR}/requests" > "${TEST_TMPDIR}/replies" \
+    2> $TEST_log || fail
+  assert_equals "17" "$(cat "${TEST_TMPDIR}/replies")"
+}
+
+function test_server_mode_rejects_namespace_options_in_requests() {
+  printf '%s\n' -W "$SANDBOX_DIR" -R -- /bin/true "" \
+    > "${TEST_TMPDIR}/requests"
+  $linux_sandbox -z < "${TEST_TMPDIR}/requests" > "${TEST_TMPDIR}/replies" \
+    2> $TEST_log || fail
+  assert_equals "1" "$(cat "${TEST_TMPDIR}/replies")"
+  expect_log "The -R option cannot be used in a request."
+}
+
 # The test shouldn't fail if the environment doesn't support running it.
 [[ "$(uname -s)" = Linux ]] || exit 0
 check_sandbox_allowed || exit 0
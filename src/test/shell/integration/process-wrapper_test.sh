@@ -64,6 +64,20 @@ function test_exit_code() {
   assert_equals 71 "$code"
 }
 
+function test_lazy_outputs() {
+  local code=0
+  $process_wrapper --lazy_outputs --stdout=$OUT --stderr=$ERR /bin/sh -c \
+    "echo hi there; exit 71" &> $TEST_log || code=$?
+  assert_equals 71 "$code"
+  assert_stdout "hi there"
+
+  # Nothing was written, so no file is created.
+  rm -f $OUT $ERR
+  $process_wrapper --lazy_outputs --stdout=$OUT --stderr=$ERR /bin/true \
+    &> $TEST_log || fail
+  [[ ! -e $OUT && ! -e $ERR ]] || fail "expected no output files"
+}
+
 function test_signal_death() {
   local code=0
   $process_wrapper --stdout=$OUT --stderr=$ERR /bin/sh -c 'kill -ABRT $$' &> $TEST_log || code=$?
@@ -223,6 +237,82 @@ function test_execvp_error_message() {
   assert_contains "\"execvp(/bin/notexisting, ...)\": No such file or directory" "$ERR"
 }
 
+function test_server_mode() {
+  printf '%s\n' \
+    --stdout=$OUT /bin/sh -c "sleep 2; echo hi there" "" \
+    /bin/sh -c "exit 71" "" \
+    --stderr=$ERR /bin/sh -c 'kill -ABRT $$' "" \
+    > "${TEST_TMPDIR}/requests"
+  $process_wrapper --server < "${TEST_TMPDIR}/requests" \
+    > "${TEST_TMPDIR}/replies" 2> $TEST_log || fail
+
+  # The commands run concurrently, so the first one finishes last.
+  assert_equals "1 0" "$(tail -n 1 "${TEST_TMPDIR}/replies")"
+  assert_equals "1 0 2 71 3 ${EXIT_STATUS_SIGABRT}" \
+    "$(echo $(sort "${TEST_TMPDIR}/replies"))"
+  assert_stdout "hi there"
+}
+
+function test_server_mode_timeout() {
+  printf '%s\n' --timeout=1 --kill_delay=10 --stdout=$OUT -- /bin/sh -c \
+    'trap "echo later; exit 0" TERM; sleep 10 & wait' "" \
+    > "${TEST_TMPDIR}/requests"
+  $process_wrapper --server < "${TEST_TMPDIR}/requests" \
+    > "${TEST_TMPDIR}/replies" 2> $TEST_log || fail
+  assert_equals "1 ${EXIT_STATUS_SIGALRM}" "$(cat "${TEST_TMPDIR}/replies")"
+  assert_stdout "later"
+}
+
+function test_resource_samples() {
+  local -r samples="${TEST_TMPDIR}/samples"
+  $process_wrapper --resource_samples="${samples}" --sample_interval=0.1 \
+    -- /bin/sh -c "sleep 1" &> $TEST_log || fail
+
+  decode_first_resource_sample "${samples}" "${TEST_TMPDIR}/sample.decoded"
+  assert_contains "process_count: " "${TEST_TMPDIR}/sample.decoded"
+  assert_contains "rss_bytes: " "${TEST_TMPDIR}/sample.decoded"
+  # Sampling every 0.1 seconds for a second yields many samples.
+  [[ "$(wc -c < "${samples}")" -gt 100 ]] || fail "expected more samples"
+}
+
+# Tests that the processes of the command that left its process group are
+# killed through its cgroup once it exits.
+function test_cgroup_kills_escaped_processes() {
+  if ! grep '^0::' /proc/self/cgroup &>/dev/null; then
+    echo "Not using cgroups v2, skipping test"
+    return 0
+  fi
+  local -r cgroup="/sys/fs/cgroup$(grep '^0::' /proc/self/cgroup | cut -d: -f3-)/process_wrapper_test"
+  if ! mkdir -p "${cgroup}" &>/dev/null || [[ ! -f "${cgroup}/cgroup.kill" ]]; then
+    echo "Not able to create a cgroup with cgroup.kill, skipping test"
+    return 0
+  fi
+  $process_wrapper --cgroup="${cgroup}" --stdout=$OUT -- /bin/sh -c \
+    'setsid sleep 1000 & echo $!' &> $TEST_log || fail
+  local -r pid="$(cat $OUT)"
+  kill -0 "${pid}" &>/dev/null && fail "escaped process ${pid} still running"
+  assert_contains "populated 0" "${cgroup}/cgroup.events"
+  rmdir "${cgroup}" || fail "cgroup not empty"
+}
+
+function test_cpus() {
+  if [[ ! -r /proc/self/status ]]; then
+    echo "No /proc/self/status, skipping test"
+    return 0
+  fi
+  # The first of the CPUs we may run on.
+  local -r cpu="$(grep '^Cpus_allowed_list:' /proc/self/status \
+      | sed -e 's/^[^0-9]*\([0-9]*\).*/\1/')"
+  $process_wrapper --cpus="${cpu}" --stdout=$OUT --stderr=$ERR -- /bin/sh -c \
+    "grep '^Cpus_allowed_list:' /proc/self/status" &> $TEST_log || fail
+  assert_contains "^Cpus_allowed_list:[[:space:]]*${cpu}\$" $OUT
+
+  local code=0
+  $process_wrapper --cpus=3-1 /bin/true &> $TEST_log || code=$?
+  assert_equals 1 "$code"
+  expect_log "Invalid CPU list (-a) value: 3-1"
+}
+
 function assert_process_wrapper_exec_time() {
   local user_time_low="$1"; shift
   local user_time_high="$1"; shift
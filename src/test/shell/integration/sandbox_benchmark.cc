@@ -0,0 +1,448 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Measures what it costs to spawn a command through process-wrapper and
+ * linux-sandbox, for every combination of the given mount counts, input
+ * counts, network namespace modes and hermetic modes. Usage:
+ *   sandbox_benchmark --linux_sandbox PATH --process_wrapper PATH
+ *                     [--mounts N,...] [--inputs N,...]
+ *                     [--netns off|new|join,...] [--hermetic off|on,...]
+ *                     [--iterations N] [--strace PATH] [--work_dir DIR]
+ * The command is this binary itself, which prints the time at which its main
+ * function was reached, so the exec latency includes loading it. The mounts
+ * are bind mounts of directories and the inputs bind mounts of files, which
+ * linux-sandbox reads from a -B file. "join" runs linux-sandbox with -j on a
+ * network namespace that is created once up front.
+ *
+ * It prints one line per configuration with the 50th and 99th percentiles of
+ * the latency until exec and until exit. With --strace, it also runs each
+ * configuration once under strace -f -c and prints the number of system calls
+ * and how many of them were mount calls, including those of the new mount API.
+ */
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char kPrintTimeFlag[] = "--print_time";
+
+struct Config {
+  bool sandbox;
+  int mounts;
+  int inputs;
+  std::string netns;
+  bool hermetic;
+};
+
+struct Result {
+  std::vector<double> exec_ms;
+  std::vector<double> exit_ms;
+  int64_t syscalls = -1;
+  int64_t mount_calls = -1;
+};
+
+int64_t MonotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  for (std::string item; std::getline(stream, item, ',');) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+void MakeDir(const std::string &path) {
+  if (mkdir(path.c_str(), 0755) < 0 && errno != EEXIST) {
+    err(1, "mkdir(%s)", path.c_str());
+  }
+}
+
+void WriteFile(const std::string &path, const std::string &contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+  if (!file.good()) {
+    errx(1, "cannot write %s", path.c_str());
+  }
+}
+
+// Creates the directories and files to mount, the -B file listing the inputs
+// and the sandbox roots for one configuration below work_dir.
+void PrepareWorkDir(const Config &config, const std::string &work_dir) {
+  MakeDir(work_dir);
+  MakeDir(work_dir + "/execroot");
+  MakeDir(work_dir + "/sandbox");
+  MakeDir(work_dir + "/sandbox/execroot");
+  MakeDir(work_dir + "/mounts");
+  for (int i = 0; i < config.mounts; ++i) {
+    MakeDir(work_dir + "/mounts/" + std::to_string(i));
+  }
+  MakeDir(work_dir + "/inputs");
+  std::string bind_mounts;
+  for (int i = 0; i < config.inputs; ++i) {
+    std::string input = work_dir + "/inputs/" + std::to_string(i);
+    WriteFile(input, "input\n");
+    bind_mounts.append(input).push_back('\0');
+    bind_mounts.append(input).push_back('\0');
+  }
+  WriteFile(work_dir + "/bind_mounts", bind_mounts);
+}
+
+// Creates a network namespace for "join", owned by a user namespace that maps
+// our uid to itself, and keeps it alive in a child. Returns the child's PID.
+pid_t CreateNetworkNamespace() {
+  int fds[2];
+  if (pipe(fds) < 0) {
+    err(1, "pipe");
+  }
+  const uid_t uid = getuid();
+  const gid_t gid = getgid();
+  const pid_t pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  } else if (pid == 0) {
+    close(fds[0]);
+    if (unshare(CLONE_NEWUSER | CLONE_NEWNET) < 0) {
+      err(1, "unshare");
+    }
+    WriteFile("/proc/self/setgroups", "deny");
+    WriteFile("/proc/self/uid_map", std::to_string(uid) + " " +
+                                        std::to_string(uid) + " 1\n");
+    WriteFile("/proc/self/gid_map", std::to_string(gid) + " " +
+                                        std::to_string(gid) + " 1\n");
+    if (write(fds[1], "x", 1) != 1) {
+      err(1, "write");
+    }
+    pause();
+    _exit(0);
+  }
+  close(fds[1]);
+  char c;
+  if (read(fds[0], &c, 1) != 1) {
+    errx(1, "cannot create a network namespace");
+  }
+  close(fds[0]);
+  return pid;
+}
+
+std::vector<std::string> BuildCommandLine(
+    const Config &config, const std::string &tool,
+    const std::string &work_dir, const std::string &self,
+    pid_t netns_pid) {
+  std::vector<std::string> args = {tool};
+  if (!config.sandbox) {
+    args.push_back("--");
+    args.push_back(self);
+    args.push_back(kPrintTimeFlag);
+    return args;
+  }
+
+  if (config.hermetic) {
+    args.insert(args.end(), {"-h", work_dir + "/sandbox", "-W",
+                             work_dir + "/sandbox/execroot"});
+    // What the command needs to run.
+    for (const char *dir : {"/bin", "/lib", "/lib64", "/usr", "/etc"}) {
+      if (access(dir, F_OK) == 0) {
+        args.insert(args.end(), {"-M", dir});
+      }
+    }
+    args.insert(args.end(), {"-M", self});
+  } else {
+    args.insert(args.end(), {"-W", work_dir + "/execroot"});
+  }
+  for (int i = 0; i < config.mounts; ++i) {
+    args.insert(args.end(), {"-M", work_dir + "/mounts/" + std::to_string(i)});
+  }
+  if (config.inputs > 0) {
+    args.insert(args.end(), {"-B", work_dir + "/bind_mounts"});
+  }
+  if (config.netns == "new") {
+    args.push_back("-N");
+  } else if (config.netns == "join") {
+    args.insert(args.end(),
+                {"-j", "/proc/" + std::to_string(netns_pid) + "/ns/net"});
+  }
+  args.insert(args.end(), {"--", self, kPrintTimeFlag});
+  return args;
+}
+
+// Runs the command line once. Returns the milliseconds until the command
+// printed its time and until the tool exited.
+void RunOnce(const std::vector<std::string> &args, double *exec_ms,
+             double *exit_ms) {
+  std::vector<char *> argv;
+  for (const std::string &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    err(1, "pipe");
+  }
+  const int64_t start = MonotonicNanos();
+  const pid_t pid = fork();
+  if (pid < 0) {
+    err(1, "fork");
+  } else if (pid == 0) {
+    if (dup2(fds[1], STDOUT_FILENO) < 0) {
+      err(1, "dup2");
+    }
+    close(fds[0]);
+    close(fds[1]);
+    execv(argv[0], argv.data());
+    err(1, "execv(%s)", argv[0]);
+  }
+  close(fds[1]);
+  std::string output;
+  char buf[64];
+  ssize_t count;
+  while ((count = read(fds[0], buf, sizeof(buf))) > 0) {
+    output.append(buf, count);
+  }
+  close(fds[0]);
+  int status;
+  if (waitpid(pid, &status, 0) != pid) {
+    err(1, "waitpid");
+  }
+  const int64_t end = MonotonicNanos();
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || output.empty()) {
+    errx(1, "%s failed with status %d", args[0].c_str(), status);
+  }
+  *exec_ms = (std::stoll(output) - start) / 1e6;
+  *exit_ms = (end - start) / 1e6;
+}
+
+// Runs the command line once under strace and counts the system calls of all
+// processes, and the mount calls among them.
+void CountSyscalls(const std::string &strace,
+                   const std::vector<std::string> &args,
+                   const std::string &work_dir, Result *result) {
+  const std::string summary = work_dir + "/strace";
+  std::string command = strace + " -f -qq -c -o " + summary;
+  for (const std::string &arg : args) {
+    command += " '" + arg + "'";
+  }
+  command += " >/dev/null";
+  if (system(command.c_str()) != 0) {
+    errx(1, "%s failed", command.c_str());
+  }
+
+  // Every line of the summary ends with the calls, the optional errors and the
+  // name of the system call.
+  std::ifstream file(summary);
+  result->syscalls = 0;
+  result->mount_calls = 0;
+  for (std::string line; std::getline(file, line);) {
+    std::vector<std::string> columns;
+    std::stringstream stream(line);
+    for (std::string column; stream >> column;) {
+      columns.push_back(column);
+    }
+    if (columns.size() < 5 || !isdigit(columns[0][0])) {
+      continue;
+    }
+    const std::string &name = columns.back();
+    const int64_t calls = std::stoll(columns[3]);
+    if (name == "total") {
+      result->syscalls = calls;
+    } else if (name == "mount" || name == "umount2" || name == "open_tree" ||
+               name == "move_mount" || name == "mount_setattr") {
+      result->mount_calls += calls;
+    }
+  }
+  unlink(summary.c_str());
+}
+
+double Percentile(std::vector<double> values, double percentile) {
+  std::sort(values.begin(), values.end());
+  size_t index = static_cast<size_t>(std::ceil(percentile * values.size()));
+  return values[std::min(values.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+void RemoveTree(const std::string &path) {
+  std::string command = "rm -rf '" + path + "'";
+  if (system(command.c_str()) != 0) {
+    errx(1, "%s failed", command.c_str());
+  }
+}
+
+// linux-sandbox fills the sandbox root of hermetic mode with the mount
+// targets, so every spawn needs a fresh one, as in Bazel.
+void ResetSandboxRoot(const std::string &work_dir) {
+  RemoveTree(work_dir + "/sandbox");
+  MakeDir(work_dir + "/sandbox");
+  MakeDir(work_dir + "/sandbox/execroot");
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage: sandbox_benchmark --linux_sandbox PATH --process_wrapper "
+          "PATH [--mounts N,...] [--inputs N,...] [--netns "
+          "off|new|join,...] [--hermetic off|on,...] [--iterations N] "
+          "[--strace PATH] [--work_dir DIR]\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc == 2 && strcmp(argv[1], kPrintTimeFlag) == 0) {
+    printf("%lld\n", static_cast<long long>(MonotonicNanos()));
+    return 0;
+  }
+
+  std::string linux_sandbox;
+  std::string process_wrapper;
+  std::string mounts = "0,100,1000";
+  std::string inputs = "0,1000";
+  std::string netns = "off,new,join";
+  std::string hermetic = "off,on";
+  std::string strace;
+  int iterations = 100;
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  std::string work_dir = tmpdir ? tmpdir : "/tmp";
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    std::string flag = argv[i];
+    const char *value = argv[++i];
+    if (flag == "--linux_sandbox") {
+      linux_sandbox = value;
+    } else if (flag == "--process_wrapper") {
+      process_wrapper = value;
+    } else if (flag == "--mounts") {
+      mounts = value;
+    } else if (flag == "--inputs") {
+      inputs = value;
+    } else if (flag == "--netns") {
+      netns = value;
+    } else if (flag == "--hermetic") {
+      hermetic = value;
+    } else if (flag == "--iterations") {
+      iterations = atoi(value);
+    } else if (flag == "--strace") {
+      strace = value;
+    } else if (flag == "--work_dir") {
+      work_dir = value;
+    } else {
+      Usage();
+    }
+  }
+  if (linux_sandbox.empty() || process_wrapper.empty() || iterations < 1) {
+    Usage();
+  }
+  work_dir += "/sandbox_benchmark";
+
+  char self[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (length < 0) {
+    err(1, "readlink(/proc/self/exe)");
+  }
+  self[length] = '\0';
+
+  std::vector<Config> configs = {{false, 0, 0, "off", false}};
+  for (const std::string &h : Split(hermetic)) {
+    for (const std::string &n : Split(netns)) {
+      for (const std::string &m : Split(mounts)) {
+        for (const std::string &i : Split(inputs)) {
+          if ((h != "off" && h != "on") ||
+              (n != "off" && n != "new" && n != "join")) {
+            Usage();
+          }
+          configs.push_back({true, atoi(m.c_str()), atoi(i.c_str()), n,
+                             h == "on"});
+        }
+      }
+    }
+  }
+
+  pid_t netns_pid = -1;
+  if (netns.find("join") != std::string::npos) {
+    netns_pid = CreateNetworkNamespace();
+  }
+
+  printf("%-15s %-8s %-5s %6s %6s %9s %9s %9s %9s %8s %6s\n", "tool",
+         "hermetic", "netns", "mounts", "inputs", "exec_p50", "exec_p99",
+         "exit_p50", "exit_p99", "syscalls", "mount");
+  for (const Config &config : configs) {
+    RemoveTree(work_dir);
+    PrepareWorkDir(config, work_dir);
+    const std::vector<std::string> args = BuildCommandLine(
+        config, config.sandbox ? linux_sandbox : process_wrapper, work_dir,
+        self, netns_pid);
+
+    Result result;
+    for (int i = 0; i < iterations; ++i) {
+      if (config.hermetic) {
+        ResetSandboxRoot(work_dir);
+      }
+      double exec_ms, exit_ms;
+      RunOnce(args, &exec_ms, &exit_ms);
+      result.exec_ms.push_back(exec_ms);
+      result.exit_ms.push_back(exit_ms);
+    }
+    if (!strace.empty()) {
+      if (config.hermetic) {
+        ResetSandboxRoot(work_dir);
+      }
+      CountSyscalls(strace, args, work_dir, &result);
+    }
+
+    printf("%-15s %-8s %-5s %6d %6d %9.2f %9.2f %9.2f %9.2f %8lld %6lld\n",
+           config.sandbox ? "linux-sandbox" : "process-wrapper",
+           config.hermetic ? "on" : "off", config.netns.c_str(),
+           config.mounts, config.inputs, Percentile(result.exec_ms, 0.5),
+           Percentile(result.exec_ms, 0.99), Percentile(result.exit_ms, 0.5),
+           Percentile(result.exit_ms, 0.99),
+           static_cast<long long>(result.syscalls),
+           static_cast<long long>(result.mount_calls));
+    fflush(stdout);
+  }
+
+  if (netns_pid > 0) {
+    kill(netns_pid, SIGKILL);
+    waitpid(netns_pid, nullptr, 0);
+  }
+  RemoveTree(work_dir);
+  return 0;
+}
@@ -0,0 +1,307 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how build-runfiles scales with the size of the manifest.
+// Usage:
+//   build-runfiles_benchmark --build_runfiles PATH [--work_dir DIR]
+//                            [--entries N,...] [--fanout N,...]
+//                            [--delta PERCENT] [--iterations N]
+//                            [--config NAME=FLAGS]...
+//
+// For each number of entries and each fan-out, that is the largest number of
+// entries in a directory of the tree, it writes a manifest whose entries are
+// symlinks to a few real files, and runs build-runfiles on it:
+//   cold:  on an empty output directory;
+//   noop:  again on the same manifest, so that nothing changes;
+//   delta: on a manifest in which --delta percent (default 1) of the entries
+//          differ from the tree, half of them with a new target and half with
+//          a new path. Runs alternate between the two manifests, so that every
+//          one of them is a delta.
+// Each --config is run with the given space-separated build-runfiles flags,
+// e.g. --config "index=--incremental --index". By default there are four:
+// full (no flags), incremental, threads (--threads 8) and incremental_threads.
+//
+// It prints one line per measurement with the median and the fastest wall
+// time in milliseconds, and the entries per second of the median.
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/main/cpp/util/file_platform.h"
+#include "src/main/cpp/util/path.h"
+#include "src/main/cpp/util/path_platform.h"
+
+#ifndef _WIN32
+extern char **environ;
+#endif
+
+namespace {
+
+// The number of real files that the symlinks in the manifest point to.
+const int kTargets = 64;
+
+struct Config {
+  std::string name;
+  std::vector<std::string> flags;
+};
+
+[[noreturn]] void Die(const std::string &message) {
+  fprintf(stderr, "build-runfiles_benchmark: %s\n", message.c_str());
+  exit(1);
+}
+
+std::vector<std::string> Split(const std::string &list, char separator) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  for (std::string item; std::getline(stream, item, separator);) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+std::vector<int> SplitInts(const std::string &list) {
+  std::vector<int> values;
+  for (const std::string &item : Split(list, ',')) {
+    values.push_back(atoi(item.c_str()));
+  }
+  return values;
+}
+
+void MakeDir(const std::string &path) {
+  if (!blaze_util::MakeDirectories(blaze_util::Path(path), 0755)) {
+    Die("cannot create " + path);
+  }
+}
+
+void WriteFile(const std::string &path, const std::string &contents) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file << contents;
+  if (!file.good()) {
+    Die("cannot write " + path);
+  }
+}
+
+void RemoveTree(const std::string &path) {
+  if (blaze_util::PathExists(blaze_util::Path(path)) &&
+      !blaze_util::RemoveRecursively(blaze_util::Path(path))) {
+    Die("cannot remove " + path);
+  }
+}
+
+// Returns the path of the given entry in a tree in which no directory has
+// more than `fanout` entries, e.g. "_main/d3/d1/f7".
+std::string EntryPath(int entry, int entries, int fanout) {
+  int levels = 1;
+  for (int64_t capacity = fanout; capacity < entries; capacity *= fanout) {
+    levels++;
+  }
+  std::string path = "f" + std::to_string(entry % fanout);
+  entry /= fanout;
+  for (int level = 1; level < levels; level++) {
+    path = "d" + std::to_string(entry % fanout) + "/" + path;
+    entry /= fanout;
+  }
+  return "_main/" + path;
+}
+
+// Writes the manifest, and returns the other one of the pair, in which
+// `delta` entries differ.
+std::pair<std::string, std::string> Manifests(
+    int entries, int fanout, int delta, const std::vector<std::string> &targets) {
+  std::string base, changed;
+  for (int i = 0; i < entries; i++) {
+    std::string path = EntryPath(i, entries, fanout);
+    const std::string &target = targets[i % targets.size()];
+    base += path + " " + target + "\n";
+    // Spread the changes evenly over the tree.
+    bool change = delta > 0 && (i % (entries / delta)) == 0;
+    if (!change) {
+      changed += path + " " + target + "\n";
+    } else if ((i / (entries / delta)) % 2 == 0) {
+      changed += path + " " + targets[(i + 1) % targets.size()] + "\n";
+    } else {
+      changed += path + "_new " + target + "\n";
+    }
+  }
+  return {base, changed};
+}
+
+// Runs build-runfiles and returns its wall time in milliseconds.
+double Run(const std::string &build_runfiles, const Config &config,
+           const std::string &manifest, const std::string &output) {
+  std::vector<std::string> args = {build_runfiles};
+  args.insert(args.end(), config.flags.begin(), config.flags.end());
+  args.push_back(manifest);
+  args.push_back(output);
+  std::vector<char *> argv;
+  for (std::string &arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+
+  auto start = std::chrono::steady_clock::now();
+#ifdef _WIN32
+  intptr_t status = _spawnv(_P_WAIT, argv[0], argv.data());
+  if (status != 0) {
+    Die(config.name + ": build-runfiles failed on " + manifest);
+  }
+#else
+  pid_t pid;
+  if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) !=
+      0) {
+    Die("cannot run " + build_runfiles);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    Die(config.name + ": build-runfiles failed on " + manifest);
+  }
+#endif
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+void Report(const Config &config, int entries, int fanout,
+            const char *scenario, std::vector<double> millis) {
+  std::sort(millis.begin(), millis.end());
+  double median = millis[millis.size() / 2];
+  printf("%-20s %8d %7d %-6s %10.1f %10.1f %12.0f\n", config.name.c_str(),
+         entries, fanout, scenario, median, millis[0],
+         entries / (median / 1000));
+  fflush(stdout);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string build_runfiles;
+  std::string work_dir;
+  std::vector<int> entry_counts = {1000, 10000, 100000};
+  std::vector<int> fanouts = {10, 1000};
+  double delta_percent = 1;
+  int iterations = 3;
+  std::vector<Config> configs;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      Die("missing value for " + flag);
+    }
+    std::string value = argv[++i];
+    if (flag == "--build_runfiles") {
+      build_runfiles = value;
+    } else if (flag == "--work_dir") {
+      work_dir = value;
+    } else if (flag == "--entries") {
+      entry_counts = SplitInts(value);
+    } else if (flag == "--fanout") {
+      fanouts = SplitInts(value);
+    } else if (flag == "--delta") {
+      delta_percent = atof(value.c_str());
+    } else if (flag == "--iterations") {
+      iterations = std::max(1, atoi(value.c_str()));
+    } else if (flag == "--config") {
+      size_t equals = value.find('=');
+      if (equals == std::string::npos) {
+        Die("--config must be NAME=FLAGS");
+      }
+      configs.push_back({value.substr(0, equals),
+                         Split(value.substr(equals + 1), ' ')});
+    } else {
+      Die("unknown flag " + flag);
+    }
+  }
+  if (build_runfiles.empty()) {
+    Die("--build_runfiles is required");
+  }
+  if (configs.empty()) {
+    configs = {{"full", {}},
+               {"incremental", {"--incremental"}},
+               {"threads", {"--threads", "8"}},
+               {"incremental_threads", {"--incremental", "--threads", "8"}}};
+  }
+  if (work_dir.empty()) {
+    const char *tmpdir = getenv("TEST_TMPDIR");
+    work_dir = blaze_util::JoinPath(tmpdir != nullptr ? tmpdir : ".",
+                                    "build-runfiles_benchmark");
+  }
+  build_runfiles = blaze_util::MakeAbsolute(build_runfiles);
+  work_dir = blaze_util::MakeAbsolute(work_dir);
+  RemoveTree(work_dir);
+  MakeDir(work_dir);
+
+  std::vector<std::string> targets;
+  std::string target_dir = blaze_util::JoinPath(work_dir, "targets");
+  MakeDir(target_dir);
+  for (int i = 0; i < kTargets; i++) {
+    targets.push_back(
+        blaze_util::JoinPath(target_dir, "t" + std::to_string(i)));
+    WriteFile(targets.back(), "x");
+  }
+
+  printf("%-20s %8s %7s %-6s %10s %10s %12s\n", "config", "entries", "fanout",
+         "run", "median_ms", "min_ms", "entries/s");
+  for (int entries : entry_counts) {
+    for (int fanout : fanouts) {
+      int delta = std::max(
+          1, std::min(entries, static_cast<int>(entries * delta_percent / 100)));
+      std::pair<std::string, std::string> contents =
+          Manifests(entries, fanout, delta, targets);
+      std::string manifests[2] = {
+          blaze_util::JoinPath(work_dir, "MANIFEST_a"),
+          blaze_util::JoinPath(work_dir, "MANIFEST_b")};
+      WriteFile(manifests[0], contents.first);
+      WriteFile(manifests[1], contents.second);
+
+      for (const Config &config : configs) {
+        std::string output = blaze_util::JoinPath(work_dir, "runfiles");
+        std::vector<double> cold, noop, changed;
+        for (int i = 0; i < iterations; i++) {
+          RemoveTree(output);
+          cold.push_back(Run(build_runfiles, config, manifests[0], output));
+        }
+        for (int i = 0; i < iterations; i++) {
+          noop.push_back(Run(build_runfiles, config, manifests[0], output));
+        }
+        for (int i = 0; i < iterations; i++) {
+          changed.push_back(
+              Run(build_runfiles, config, manifests[(i + 1) % 2], output));
+        }
+        RemoveTree(output);
+        Report(config, entries, fanout, "cold", cold);
+        Report(config, entries, fanout, "noop", noop);
+        Report(config, entries, fanout, "delta", changed);
+      }
+    }
+  }
+  RemoveTree(work_dir);
+  return 0;
+}
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sched.h>
 #include <signal.h>
 #include <sys/prctl.h>
 #include <sys/types.h>
@@ -109,4 +110,29 @@ TEST_F(TerminateAndWaitForAllTest, TestOutsideOfGroup) {
   }
 }
 
+TEST(SetCpuAffinityTest, PinsToCpu) {
+  cpu_set_t allowed;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  int cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed)) {
+    ++cpu;
+  }
+
+  // In a child, so as not to pin the test itself.
+  const pid_t pid = fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    cpu_set_t pinned;
+    _exit(SetCpuAffinity({cpu}, -1) &&
+                  sched_getaffinity(0, sizeof(pinned), &pinned) == 0 &&
+                  CPU_COUNT(&pinned) == 1 && CPU_ISSET(cpu, &pinned)
+              ? 0
+              : 1);
+  }
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+}
+
 }  // namespace
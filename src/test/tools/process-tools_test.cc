@@ -14,10 +14,32 @@
 
 #include "src/main/tools/process-tools.h"
 
+#include <vector>
+
+#include "googlemock/include/gmock/gmock.h"
+#include "googletest/include/gtest/gtest.h"
+
 namespace {
 
-// Intentionally left empty to allow the test program to exist on any
-// platform we build on. Add tests here and remove this comment once we
-// have any non-platform specific tests.
+using ::testing::ElementsAre;
+
+TEST(ParseCpuListTest, ParsesNumbersAndRanges) {
+  std::vector<int> cpus;
+  ASSERT_TRUE(ParseCpuList("3", &cpus));
+  EXPECT_THAT(cpus, ElementsAre(3));
+  ASSERT_TRUE(ParseCpuList("0-2,8,10-11", &cpus));
+  EXPECT_THAT(cpus, ElementsAre(0, 1, 2, 8, 10, 11));
+}
+
+TEST(ParseCpuListTest, RejectsMalformedLists) {
+  std::vector<int> cpus;
+  EXPECT_FALSE(ParseCpuList("", &cpus));
+  EXPECT_FALSE(ParseCpuList("1,", &cpus));
+  EXPECT_FALSE(ParseCpuList("-1", &cpus));
+  EXPECT_FALSE(ParseCpuList("3-1", &cpus));
+  EXPECT_FALSE(ParseCpuList("1-", &cpus));
+  EXPECT_FALSE(ParseCpuList("1 2", &cpus));
+  EXPECT_FALSE(ParseCpuList("8192", &cpus));
+}
 
 }  // namespace
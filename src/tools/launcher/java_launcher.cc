@@ -14,6 +14,8 @@
 
 #include "src/tools/launcher/java_launcher.h"
 
+#include <cstdint>
+#include <iomanip>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -161,38 +163,43 @@ static void WriteJarClasspath(const wstring& jar_path,
   }
 }
 
-wstring JavaBinaryLauncher::GetJunctionBaseDir() {
+// Returns a hex-encoded 64-bit FNV-1a hash of the classpath, which names the
+// cached classpath jar and junction directory.
+static wstring HashClasspath(const wstring& classpath) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (wchar_t c : classpath) {
+    hash ^= static_cast<uint64_t>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  wostringstream result;
+  result << std::hex << std::setw(16) << std::setfill(L'0') << hash;
+  return result.str();
+}
+
+wstring JavaBinaryLauncher::GetJunctionBaseDir(const wstring& classpath_hash) {
   wstring binary_base_path = GetBinaryPathWithExtension(GetLauncherPath());
   wstring result;
-  if (!NormalizePath(binary_base_path + L".j", &result)) {
+  if (!NormalizePath(binary_base_path + L".j-" + classpath_hash, &result)) {
     die(L"Failed to get normalized junction base directory.");
   }
   return result;
 }
 
-void JavaBinaryLauncher::DeleteJunctionBaseDir() {
-  wstring junction_base_dir_norm = GetJunctionBaseDir();
-  if (!DoesDirectoryPathExist(junction_base_dir_norm.c_str())) {
-    return;
-  }
-  vector<wstring> junctions;
-  blaze_util::GetAllFilesUnderW(junction_base_dir_norm, &junctions);
-  for (const auto& junction : junctions) {
-    if (!DeleteDirectoryByPath(junction.c_str())) {
-      PrintError(L"Failed to delete junction directory: %hs",
-                 GetLastErrorString().c_str());
-    }
-  }
-  if (!DeleteDirectoryByPath(junction_base_dir_norm.c_str())) {
-    PrintError(L"Failed to delete junction directory: %hs",
-               GetLastErrorString().c_str());
-  }
-}
-
 wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
   wstring binary_base_path = GetBinaryPathWithoutExtension(GetLauncherPath());
   wstring abs_manifest_jar_dir_norm = GetManifestJarDir(binary_base_path);
 
+  // The classpath jar and the junctions only depend on the classpath, so they
+  // are kept across launches of the binary instead of being recreated every
+  // time. The jar is renamed into place after the junctions it refers to have
+  // been created, so if it exists, it's complete.
+  wstring classpath_hash = HashClasspath(classpath);
+  wstring manifest_jar_path =
+      binary_base_path + L"-" + classpath_hash + L"-classpath.jar";
+  if (DoesFilePathExist(manifest_jar_path.c_str())) {
+    return manifest_jar_path;
+  }
+
   wostringstream manifest_classpath;
   manifest_classpath << L"Class-Path:";
   wstringstream classpath_ss(classpath);
@@ -201,10 +208,12 @@ wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
   // A set to store all junctions created.
   // The key is the target path, the value is the junction path.
   std::unordered_map<wstring, wstring> jar_dirs;
-  wstring junction_base_dir_norm = GetJunctionBaseDir();
+  wstring junction_base_dir_norm = GetJunctionBaseDir(classpath_hash);
   int junction_count = 0;
-  // Make sure the junction base directory doesn't exist already.
-  DeleteJunctionBaseDir();
+  // Concurrent launches with the same classpath may create the same junctions
+  // at the same time. The junction names only depend on the classpath, and
+  // CreateJunction succeeds if the junction already exists with the same
+  // target.
   blaze_util::MakeDirectoriesW(junction_base_dir_norm, 0755);
 
   while (getline(classpath_ss, path, L';')) {
@@ -272,20 +281,34 @@ wstring JavaBinaryLauncher::CreateClasspathJar(const wstring& classpath) {
   }
 
   // Create the command for generating classpath jar.
-  wstring manifest_jar_path = binary_base_path + rand_id + L"-classpath.jar";
+  wstring tmp_manifest_jar_path =
+      binary_base_path + rand_id + L"-classpath.jar";
   wstring jar_bin = this->Rlocation(this->GetLaunchInfoByKey(JAR_BIN_PATH));
   vector<wstring> arguments;
   arguments.push_back(L"cvfm");
-  arguments.push_back(manifest_jar_path);
+  arguments.push_back(tmp_manifest_jar_path);
   arguments.push_back(jar_manifest_file_path);
 
   if (this->LaunchProcess(jar_bin, arguments, /* suppressOutput */ true) != 0) {
-    die(L"Couldn't create classpath jar: %s", manifest_jar_path.c_str());
+    die(L"Couldn't create classpath jar: %s", tmp_manifest_jar_path.c_str());
   }
 
   // Delete jar_manifest_file after classpath jar is created.
   DeleteFileByPath(jar_manifest_file_path.c_str());
 
+  // If a concurrent launch has moved its jar into place first, the rename
+  // fails and that jar is used instead; it has the same content.
+  wstring from = AsAbsoluteWindowsPath(tmp_manifest_jar_path.c_str());
+  wstring to = AsAbsoluteWindowsPath(manifest_jar_path.c_str());
+  if (!MoveFileExW(from.c_str(), to.c_str(), 0)) {
+    string error = GetLastErrorString();
+    DeleteFileByPath(tmp_manifest_jar_path.c_str());
+    if (!DoesFilePathExist(manifest_jar_path.c_str())) {
+      die(L"Couldn't rename classpath jar to %s: %hs",
+          manifest_jar_path.c_str(), error.c_str());
+    }
+  }
+
   return manifest_jar_path;
 }
 
@@ -381,10 +404,8 @@ ExitCode JavaBinaryLauncher::Launch() {
   // Check if CLASSPATH is over classpath length limit.
   // If it does, then we create a classpath jar to pass CLASSPATH value.
   wstring classpath_str = classpath.str();
-  wstring classpath_jar = L"";
   if (classpath_str.length() > this->classpath_limit) {
-    classpath_jar = CreateClasspathJar(classpath_str);
-    arguments.push_back(classpath_jar);
+    arguments.push_back(CreateClasspathJar(classpath_str));
   } else {
     arguments.push_back(classpath_str);
   }
@@ -418,15 +439,7 @@ ExitCode JavaBinaryLauncher::Launch() {
     escaped_arguments.push_back(bazel::windows::WindowsEscapeArg(arg));
   }
 
-  ExitCode exit_code = this->LaunchProcess(java_bin, escaped_arguments);
-
-  // Delete classpath jar file after execution.
-  if (!classpath_jar.empty()) {
-    DeleteFileByPath(classpath_jar.c_str());
-    DeleteJunctionBaseDir();
-  }
-
-  return exit_code;
+  return this->LaunchProcess(java_bin, escaped_arguments);
 }
 
 }  // namespace launcher
@@ -88,17 +88,15 @@ class JavaBinaryLauncher : public BinaryLauncherBase {
   int classpath_limit;
 
   // Create a classpath jar to pass CLASSPATH value when its length is over
-  // limit.
+  // limit. The jar is cached next to the binary, keyed on the classpath, and
+  // reused by later launches.
   //
-  // Return the path of the classpath jar created.
+  // Return the path of the classpath jar.
   std::wstring CreateClasspathJar(const std::wstring& classpath);
 
-  // Creat a directory based on the binary path, all the junctions will be
-  // generated under this directory.
-  std::wstring GetJunctionBaseDir();
-
-  // Delete all the junction directory and all the junctions under it.
-  void DeleteJunctionBaseDir();
+  // Get the directory based on the binary path and the classpath hash under
+  // which all the junctions of the classpath jar are generated.
+  std::wstring GetJunctionBaseDir(const std::wstring& classpath_hash);
 };
 
 }  // namespace launcher
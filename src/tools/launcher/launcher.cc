@@ -20,7 +20,6 @@
 #include <windows.h>
 
 #include <algorithm>
-#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -35,9 +34,7 @@
 namespace bazel {
 namespace launcher {
 
-using std::ifstream;
 using std::string;
-using std::unordered_map;
 using std::vector;
 using std::wostringstream;
 using std::wstring;
@@ -78,8 +75,14 @@ BinaryLauncherBase::BinaryLauncherBase(
   // Prefer to use the runfiles manifest, if it exists, but otherwise the
   // runfiles directory will be used by default. On Windows, the manifest is
   // used locally, and the runfiles directory is used remotely.
+  // If an index was written for the manifest as it is now, look runfiles up
+  // in it instead of parsing the whole manifest. The manifest is only parsed
+  // if a path is missing from the index.
   if (!manifest_file.empty()) {
-    ParseManifestFile(&manifest_file_map, manifest_file);
+    if (!manifest.Open(manifest_file)) {
+      die(L"Couldn't open MANIFEST file: %s", manifest_file.c_str());
+    }
+    manifest_index.Open(manifest_file + L".index", manifest_file);
   }
 }
 
@@ -137,27 +140,6 @@ wstring BinaryLauncherBase::GetRunfilesPath() const {
   return runfiles_path;
 }
 
-void BinaryLauncherBase::ParseManifestFile(ManifestFileMap* manifest_file_map,
-                                           const wstring& manifest_path) {
-  ifstream manifest_file(AsAbsoluteWindowsPath(manifest_path.c_str()).c_str());
-
-  if (!manifest_file) {
-    die(L"Couldn't open MANIFEST file: %s", manifest_path.c_str());
-  }
-
-  string line;
-  while (getline(manifest_file, line)) {
-    size_t space_pos = line.find_first_of(' ');
-    if (space_pos == string::npos) {
-      die(L"Wrong MANIFEST format at line: %s", line.c_str());
-    }
-    wstring wline = blaze_util::CstringToWstring(line);
-    wstring key = wline.substr(0, space_pos);
-    wstring value = wline.substr(space_pos + 1);
-    manifest_file_map->insert(make_pair(key, value));
-  }
-}
-
 wstring BinaryLauncherBase::Rlocation(wstring path,
                                       bool has_workspace_name) const {
   // No need to do rlocation if the path is absolute.
@@ -175,18 +157,24 @@ wstring BinaryLauncherBase::Rlocation(wstring path,
     path = this->workspace_name + L"/" + path;
   }
 
-  // If the manifest file map is empty, then we're using the runfiles directory
-  // instead.
-  if (manifest_file_map.empty()) {
+  // Only the requested path and its target are converted between UTF-16 and
+  // UTF-8, rather than every entry of the manifest.
+  string target;
+  if (manifest_index.IsOpen() &&
+      manifest_index.Lookup(blaze_util::WstringToCstring(path), &target)) {
+    return blaze_util::CstringToWstring(target);
+  }
+
+  // If the manifest is empty, then we're using the runfiles directory instead.
+  if (manifest.IsEmpty()) {
     return runfiles_dir + L"/" + path;
   }
 
-  auto entry = manifest_file_map.find(path);
-  if (entry == manifest_file_map.end()) {
+  if (!manifest.Lookup(blaze_util::WstringToCstring(path), &target)) {
     die(L"Rlocation failed on %s, path doesn't exist in MANIFEST file",
         path.c_str());
   }
-  return entry->second;
+  return blaze_util::CstringToWstring(target);
 }
 
 wstring BinaryLauncherBase::GetLaunchInfoByKey(const string& key) {
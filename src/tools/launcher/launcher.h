@@ -16,10 +16,10 @@
 #define BAZEL_SRC_TOOLS_LAUNCHER_LAUNCHER_H_
 
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 #include "src/tools/launcher/util/data_parser.h"
+#include "src/tools/launcher/util/runfiles_index.h"
 
 namespace bazel {
 namespace launcher {
@@ -38,8 +38,6 @@ struct CmdLine {
 };
 
 class BinaryLauncherBase {
-  typedef std::unordered_map<std::wstring, std::wstring> ManifestFileMap;
-
  public:
   BinaryLauncherBase(const LaunchDataParser::LaunchInfo& launch_info,
                      const std::wstring& launcher_path, int argc,
@@ -111,8 +109,12 @@ class BinaryLauncherBase {
   // The workspace name of the repository this target belongs to.
   const std::wstring workspace_name;
 
-  // A map to store all entries of the manifest file.
-  ManifestFileMap manifest_file_map;
+  // The manifest file, mapped into memory and parsed on the first lookup.
+  RunfilesManifest manifest;
+
+  // The index next to the manifest file, if one exists and matches it. Paths
+  // are looked up in it first, and in the manifest only if it lacks them.
+  RunfilesIndex manifest_index;
 
   // If symlink runfiles tree is enabled, this value is true.
   const bool symlink_runfiles_enabled;
@@ -139,10 +141,6 @@ class BinaryLauncherBase {
   //    1. <path>/<to>/<binary>/<target_name>.runfiles/MANIFEST
   // or 2. <path>/<to>/<binary>/<target_name>.runfiles_manifest
   static std::wstring FindManifestFile(const wchar_t* launcher_path);
-
-  // Parse manifest file into a map
-  static void ParseManifestFile(ManifestFileMap* manifest_file_map,
-                                const std::wstring& manifest_path);
 };
 
 }  // namespace launcher
@@ -17,11 +17,14 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <set>
 #include <string>
+#include <vector>
 
 #ifdef _WIN32
 #include "src/main/cpp/util/path_platform.h"
 #endif  // _WIN32
+#include "src/tools/launcher/util/launch_data_format.h"
 
 //  This is a replacement for
 //  third_party/bazel/src/main/java/com/google/devtools/build/lib/analysis/actions/LauncherFileWriteAction.java
@@ -32,9 +35,8 @@
 //    3) The path of the output executable
 //
 //  The program copies the launcher executable as is to the output, and then
-//  appends each line of the launch info as a null-terminated string. At the
-//  end, the size of the launch data written is appended as a long value (8
-//  bytes).
+//  appends the "key=value" lines of the launch info in the indexed launch data
+//  format described in src/tools/launcher/util/launch_data_format.h.
 
 #ifdef _WIN32
 
@@ -59,6 +61,65 @@ std::string convert_path(char* path) { return path; }
 
 #endif  // _WIN32
 
+using bazel::launcher::IndexedLaunchDataEntry;
+using bazel::launcher::IndexedLaunchDataTrailer;
+
+// Appends the UTF-8 string `utf8` to `utf16` as UTF-16 code units. Returns
+// false if `utf8` is not valid UTF-8.
+bool AppendUtf16(const std::string& utf8, std::vector<uint16_t>* utf16) {
+  size_t i = 0;
+  while (i < utf8.size()) {
+    uint32_t c = static_cast<unsigned char>(utf8[i++]);
+    int continuation_bytes;
+    uint32_t min_code_point;
+    if (c < 0x80) {
+      continuation_bytes = 0;
+      min_code_point = 0;
+    } else if ((c & 0xE0) == 0xC0) {
+      continuation_bytes = 1;
+      min_code_point = 0x80;
+      c &= 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+      continuation_bytes = 2;
+      min_code_point = 0x800;
+      c &= 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+      continuation_bytes = 3;
+      min_code_point = 0x10000;
+      c &= 0x07;
+    } else {
+      return false;
+    }
+    for (int j = 0; j < continuation_bytes; j++) {
+      if (i == utf8.size() || (utf8[i] & 0xC0) != 0x80) {
+        return false;
+      }
+      c = (c << 6) | (utf8[i++] & 0x3F);
+    }
+    if (c < min_code_point || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+      return false;
+    }
+    if (c < 0x10000) {
+      utf16->push_back(static_cast<uint16_t>(c));
+    } else {
+      c -= 0x10000;
+      utf16->push_back(static_cast<uint16_t>(0xD800 + (c >> 10)));
+      utf16->push_back(static_cast<uint16_t>(0xDC00 + (c & 0x3FF)));
+    }
+  }
+  return true;
+}
+
+void AppendUint16(uint16_t value, std::string* out) {
+  out->push_back(static_cast<char>(value & 0xFF));
+  out->push_back(static_cast<char>(value >> 8));
+}
+
+void AppendUint32(uint32_t value, std::string* out) {
+  AppendUint16(static_cast<uint16_t>(value & 0xFFFF), out);
+  AppendUint16(static_cast<uint16_t>(value >> 16), out);
+}
+
 int main(int argc, char** argv) {
   if (argc < 4) {
     fprintf(stderr, "Expected 3 arguments, got %d\n", argc);
@@ -89,15 +150,76 @@ int main(int argc, char** argv) {
             info_params.c_str(), strerror(errno));
     return 1;
   }
-  int64_t bytes = 0;
+  // Keys and values, laid out after the index.
+  std::string strings;
+  std::vector<IndexedLaunchDataEntry> index;
+  std::set<std::string> keys;
   std::string line;
   while (std::getline(info_file, line)) {
-    dst << line;
-    bytes += line.length();
-    dst << '\0';
-    bytes++;
+    if (line.empty()) {
+      continue;
+    }
+    std::string::size_type equal = line.find('=');
+    if (equal == std::string::npos) {
+      fprintf(stderr, "Cannot find equal symbol in line: %s\n", line.c_str());
+      return 1;
+    }
+    if (equal == 0) {
+      fprintf(stderr, "Key is empty string in line: %s\n", line.c_str());
+      return 1;
+    }
+    std::string key = line.substr(0, equal);
+    if (!keys.insert(key).second) {
+      fprintf(stderr, "Duplicated launch info key: %s\n", key.c_str());
+      return 1;
+    }
+    std::vector<uint16_t> value;
+    if (!AppendUtf16(line.substr(equal + 1), &value)) {
+      fprintf(stderr, "Value is not valid UTF-8 in line: %s\n", line.c_str());
+      return 1;
+    }
+
+    IndexedLaunchDataEntry entry;
+    entry.key_offset = static_cast<uint32_t>(strings.size());
+    entry.key_length = static_cast<uint32_t>(key.size());
+    strings += key;
+    if (strings.size() % 2 != 0) {
+      strings.push_back('\0');
+    }
+    entry.value_offset = static_cast<uint32_t>(strings.size());
+    entry.value_length = static_cast<uint32_t>(value.size());
+    for (uint16_t c : value) {
+      AppendUint16(c, &strings);
+    }
+    index.push_back(entry);
   }
 
-  dst.write(reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+  const uint64_t index_size = index.size() * sizeof(IndexedLaunchDataEntry);
+  if (index_size + strings.size() > UINT32_MAX) {
+    fprintf(stderr, "Launch info is too large\n");
+    return 1;
+  }
+  std::string data;
+  data.reserve(index_size + strings.size() + sizeof(IndexedLaunchDataTrailer));
+  for (const IndexedLaunchDataEntry& entry : index) {
+    // Offsets in the index are relative to the start of the launch data.
+    AppendUint32(static_cast<uint32_t>(entry.key_offset + index_size), &data);
+    AppendUint32(entry.key_length, &data);
+    AppendUint32(static_cast<uint32_t>(entry.value_offset + index_size),
+                 &data);
+    AppendUint32(entry.value_length, &data);
+  }
+  data += strings;
+  AppendUint32(static_cast<uint32_t>(data.size()), &data);
+  AppendUint32(static_cast<uint32_t>(index.size()), &data);
+  AppendUint32(bazel::launcher::kIndexedLaunchDataVersion, &data);
+  AppendUint32(bazel::launcher::kIndexedLaunchDataMagic, &data);
+
+  dst.write(data.data(), data.size());
+  if (!dst.good()) {
+    fprintf(stderr, "Failed to write " STRING_FORMAT ": %s\n",
+            output_path.c_str(), strerror(errno));
+    return 1;
+  }
   return 0;
 }
@@ -12,10 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <fstream>
-#include <memory>
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#include <cstring>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 #include "src/main/cpp/util/path_platform.h"
 #include "src/main/cpp/util/strings.h"
@@ -25,24 +30,98 @@
 namespace bazel {
 namespace launcher {
 
-using std::ifstream;
-using std::ios;
-using std::make_unique;
 using std::string;
-using std::unique_ptr;
 using std::wstring;
 
-int64_t LaunchDataParser::ReadDataSize(ifstream* binary) {
-  int64_t data_size;
-  binary->seekg(0 - sizeof(data_size), ios::end);
-  binary->read(reinterpret_cast<char*>(&data_size), sizeof(data_size));
-  return data_size;
-}
+static_assert(sizeof(wchar_t) == 2, "launch data values are UTF-16");
+
+namespace {
+
+// A read-only view of a whole file.
+class MappedFile {
+ public:
+  MappedFile() : view_(nullptr), size_(0) {}
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (view_ != nullptr) {
+      UnmapViewOfFile(view_);
+    }
+  }
+
+  bool Open(const wstring& path) {
+    HANDLE file = CreateFileW(
+        path.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return false;
+    }
+    LARGE_INTEGER file_size;
+    HANDLE mapping = nullptr;
+    // Empty files cannot be mapped.
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+      mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+    if (mapping == nullptr) {
+      return false;
+    }
+    // The view keeps the mapping alive.
+    view_ = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view_ == nullptr) {
+      return false;
+    }
+    size_ = file_size.QuadPart;
+    return true;
+  }
+
+  const char* data() const { return static_cast<const char*>(view_); }
+  int64_t size() const { return size_; }
+
+ private:
+  void* view_;
+  int64_t size_;
+};
 
-void LaunchDataParser::ReadLaunchData(ifstream* binary, char* launch_data,
-                                      int64_t data_size) {
-  binary->seekg(0 - data_size - sizeof(data_size), ios::end);
-  binary->read(launch_data, data_size);
+}  // namespace
+
+bool LaunchDataParser::ReadIndexedLaunchData(
+    LaunchInfo* launch_info, const char* launch_data,
+    const IndexedLaunchDataTrailer& trailer) {
+  const uint64_t data_size = trailer.data_size;
+  if (uint64_t{trailer.entry_count} * sizeof(IndexedLaunchDataEntry) >
+      data_size) {
+    PrintError(L"Launch data is corrupted");
+    return false;
+  }
+  launch_info->reserve(trailer.entry_count);
+  for (uint32_t i = 0; i < trailer.entry_count; i++) {
+    // The launch data follows the launcher executable, so it is not aligned.
+    IndexedLaunchDataEntry entry;
+    memcpy(&entry, launch_data + i * sizeof(entry), sizeof(entry));
+    if (uint64_t{entry.key_offset} + entry.key_length > data_size ||
+        uint64_t{entry.value_offset} +
+                uint64_t{entry.value_length} * sizeof(wchar_t) >
+            data_size) {
+      PrintError(L"Launch data is corrupted");
+      return false;
+    }
+    string key(launch_data + entry.key_offset, entry.key_length);
+    wstring value(entry.value_length, L'\0');
+    if (entry.value_length > 0) {
+      memcpy(&value[0], launch_data + entry.value_offset,
+             entry.value_length * sizeof(wchar_t));
+    }
+    if (launch_info->find(key) != launch_info->end()) {
+      PrintError(L"Duplicated launch info key: %hs", key.c_str());
+      return false;
+    }
+    launch_info->emplace(std::move(key), std::move(value));
+  }
+  return true;
 }
 
 bool LaunchDataParser::ParseLaunchData(LaunchInfo* launch_info,
@@ -89,24 +168,50 @@ bool LaunchDataParser::ParseLaunchData(LaunchInfo* launch_info,
 
 bool LaunchDataParser::GetLaunchInfo(const wstring& binary_path,
                                      LaunchInfo* launch_info) {
-  unique_ptr<ifstream> binary =
-      make_unique<ifstream>(AsAbsoluteWindowsPath(binary_path.c_str()).c_str(),
-                            ios::binary | ios::in);
-  if (!binary->good()) {
+  MappedFile binary;
+  if (!binary.Open(AsAbsoluteWindowsPath(binary_path.c_str()))) {
     PrintError(L"Cannot open the binary to read launch data");
     return false;
   }
-  int64_t data_size = ReadDataSize(binary.get());
+  const char* binary_end = binary.data() + binary.size();
+
+  IndexedLaunchDataTrailer trailer;
+  if (binary.size() >= static_cast<int64_t>(sizeof(trailer))) {
+    memcpy(&trailer, binary_end - sizeof(trailer), sizeof(trailer));
+    if (trailer.magic == kIndexedLaunchDataMagic) {
+      if (trailer.version != kIndexedLaunchDataVersion) {
+        PrintError(L"Unsupported launch data version: %u", trailer.version);
+        return false;
+      }
+      if (trailer.entry_count == 0) {
+        PrintError(L"No data appended, cannot launch anything!");
+        return false;
+      }
+      if (trailer.data_size > binary.size() - sizeof(trailer)) {
+        PrintError(L"Launch data is corrupted");
+        return false;
+      }
+      return ReadIndexedLaunchData(
+          launch_info, binary_end - sizeof(trailer) - trailer.data_size,
+          trailer);
+    }
+  }
+
+  int64_t data_size = 0;
+  if (binary.size() >= static_cast<int64_t>(sizeof(data_size))) {
+    memcpy(&data_size, binary_end - sizeof(data_size), sizeof(data_size));
+  }
   if (data_size == 0) {
     PrintError(L"No data appended, cannot launch anything!");
     return false;
   }
-  unique_ptr<char[]> launch_data(new char[data_size]);
-  ReadLaunchData(binary.get(), launch_data.get(), data_size);
-  if (!ParseLaunchData(launch_info, launch_data.get(), data_size)) {
+  if (data_size < 0 ||
+      data_size > binary.size() - static_cast<int64_t>(sizeof(data_size))) {
+    PrintError(L"Launch data is corrupted");
     return false;
   }
-  return true;
+  return ParseLaunchData(launch_info,
+                         binary_end - sizeof(data_size) - data_size, data_size);
 }
 
 }  // namespace launcher
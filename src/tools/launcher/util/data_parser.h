@@ -15,11 +15,12 @@
 #ifndef BAZEL_SRC_TOOLS_LAUNCHER_UTIL_DATA_PARSER_H_
 #define BAZEL_SRC_TOOLS_LAUNCHER_UTIL_DATA_PARSER_H_
 
-#include <fstream>
-#include <memory>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 
+#include "src/tools/launcher/util/launch_data_format.h"
+
 namespace bazel {
 namespace launcher {
 
@@ -28,18 +29,20 @@ class LaunchDataParser {
   typedef std::unordered_map<std::string, std::wstring> LaunchInfo;
   LaunchDataParser() = delete;
   ~LaunchDataParser() = delete;
+
+  // Read the launch data appended to the given binary, in either the indexed
+  // or the legacy format (see launch_data_format.h), by mapping the binary
+  // into memory.
   static bool GetLaunchInfo(const std::wstring& binary_path,
                             LaunchInfo* launch_info);
 
  private:
-  // Read the last 64 bit from the given binary to get the data size
-  static int64_t ReadDataSize(std::ifstream* binary);
-
-  // Read launch data at the end of the given binary into a buffer
-  static void ReadLaunchData(std::ifstream* binary, char* launch_data,
-                             int64_t data_size);
+  // Read launch data in the indexed format into a map
+  static bool ReadIndexedLaunchData(LaunchInfo* launch_info,
+                                    const char* launch_data,
+                                    const IndexedLaunchDataTrailer& trailer);
 
-  // Parse the launch data into a map
+  // Parse launch data in the legacy format into a map
   static bool ParseLaunchData(LaunchInfo* launch_info, const char* launch_data,
                               int64_t data_size);
 };
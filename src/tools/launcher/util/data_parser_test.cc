@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdint>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -34,6 +35,7 @@ using std::pair;
 using std::string;
 using std::unique_ptr;
 using std::vector;
+using std::wstring;
 
 class LaunchDataParserTest : public ::testing::Test {
  protected:
@@ -87,6 +89,44 @@ class LaunchDataParserTest : public ::testing::Test {
                              sizeof(data_size));
   }
 
+  static void WriteIndexedBinaryFile(
+      const string& binary_file,
+      const vector<pair<string, wstring>>& launch_info,
+      uint32_t version = kIndexedLaunchDataVersion) {
+    ofstream binary_file_stream(binary_file, ios::out | ios::binary);
+    binary_file_stream << "launcher";
+
+    string strings;
+    vector<IndexedLaunchDataEntry> index;
+    const uint32_t index_size =
+        launch_info.size() * sizeof(IndexedLaunchDataEntry);
+    for (auto const& entry : launch_info) {
+      IndexedLaunchDataEntry index_entry;
+      index_entry.key_offset = index_size + strings.size();
+      index_entry.key_length = entry.first.length();
+      strings += entry.first;
+      if (strings.size() % 2 != 0) {
+        strings.push_back('\0');
+      }
+      index_entry.value_offset = index_size + strings.size();
+      index_entry.value_length = entry.second.length();
+      strings.append(reinterpret_cast<const char*>(entry.second.data()),
+                     entry.second.length() * sizeof(wchar_t));
+      index.push_back(index_entry);
+    }
+
+    IndexedLaunchDataTrailer trailer;
+    trailer.data_size = index_size + strings.size();
+    trailer.entry_count = launch_info.size();
+    trailer.version = version;
+    trailer.magic = kIndexedLaunchDataMagic;
+    binary_file_stream.write(reinterpret_cast<const char*>(index.data()),
+                             index_size);
+    binary_file_stream << strings;
+    binary_file_stream.write(reinterpret_cast<const char*>(&trailer),
+                             sizeof(trailer));
+  }
+
   static bool ParseBinaryFile(
       const string& binary_file,
       LaunchDataParser::LaunchInfo* parsed_launch_info) {
@@ -187,5 +227,39 @@ TEST_F(LaunchDataParserTest, NoEqualSignLaunchInfoTest) {
                "LAUNCHER ERROR: Cannot find equal symbol in line: foo2bar2");
 }
 
+TEST_F(LaunchDataParserTest, GetIndexedLaunchInfoTest) {
+  vector<pair<string, wstring>> launch_info = {
+      {"binary_type", L"Bash"},
+      {"workspace_name", L"__main__"},
+      {"bash_bin_path", L"C:\\foo\\bar\\bash.exe"},
+      {"bash_main_file", L"./bazel-bin/foo/b\u00e4r/bin.sh"},
+      {"empty_value_key", L""},
+  };
+
+  string binary_file = test_tmpdir + "/indexed_binary_file";
+  WriteIndexedBinaryFile(binary_file, launch_info);
+
+  parsed_launch_info = make_unique<LaunchDataParser::LaunchInfo>();
+  ASSERT_TRUE(ParseBinaryFile(binary_file, parsed_launch_info.get()));
+
+  ASSERT_EQ(parsed_launch_info->size(), launch_info.size());
+  for (auto const& entry : launch_info) {
+    ASSERT_EQ(entry.second, parsed_launch_info->at(entry.first));
+  }
+}
+
+TEST_F(LaunchDataParserTest, UnsupportedIndexedLaunchInfoVersionTest) {
+  string binary_file = test_tmpdir + "/unsupported_indexed_binary_file";
+  WriteIndexedBinaryFile(binary_file, {{"foo", L"bar"}},
+                         kIndexedLaunchDataVersion + 1);
+
+  parsed_launch_info = make_unique<LaunchDataParser::LaunchInfo>();
+  // ASSERT_DEATH requires TEMP environment variable to be set.
+  // Otherwise, it will try to write to C:/Windows, then fails.
+  // A workaround in Bazel is to use --action_env to set TEMP.
+  ASSERT_DEATH(ParseBinaryFile(binary_file, parsed_launch_info.get()),
+               "LAUNCHER ERROR: Unsupported launch data version: 2");
+}
+
 }  // namespace launcher
 }  // namespace bazel
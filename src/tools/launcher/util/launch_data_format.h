@@ -0,0 +1,73 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_LAUNCHER_UTIL_LAUNCH_DATA_FORMAT_H_
+#define BAZEL_SRC_TOOLS_LAUNCHER_UTIL_LAUNCH_DATA_FORMAT_H_
+
+#include <cstdint>
+
+namespace bazel {
+namespace launcher {
+
+// The indexed launch data format, which launcher_maker appends to the
+// launcher executable:
+//
+//   <launcher executable>
+//   <launch data, data_size bytes>:
+//     <entry_count IndexedLaunchDataEntry structs>
+//     <keys and values>
+//   <IndexedLaunchDataTrailer>
+//
+// Keys are UTF-8, values are UTF-16LE, neither is null-terminated. All
+// integers are little-endian.
+//
+// The launcher finds the trailer at a fixed offset from the end of the file
+// and the index at a fixed offset from the trailer, so it reads the launch
+// data without scanning or converting it.
+//
+// The legacy format, a sequence of null-terminated UTF-8 "key=value" lines
+// followed by their total size as an int64_t, is told apart by the last 8
+// bytes: read as an int64_t, the trailer's version and magic are far larger
+// than any legacy data size.
+
+constexpr uint32_t kIndexedLaunchDataMagic = 0x4F464E49;  // "INFO"
+constexpr uint32_t kIndexedLaunchDataVersion = 1;
+
+struct IndexedLaunchDataEntry {
+  // Offset of the key from the start of the launch data, and its length in
+  // bytes.
+  uint32_t key_offset;
+  uint32_t key_length;
+  // Offset of the value from the start of the launch data, and its length in
+  // UTF-16 code units.
+  uint32_t value_offset;
+  uint32_t value_length;
+};
+
+struct IndexedLaunchDataTrailer {
+  uint32_t data_size;
+  uint32_t entry_count;
+  uint32_t version;
+  uint32_t magic;
+};
+
+static_assert(sizeof(IndexedLaunchDataEntry) == 16,
+              "IndexedLaunchDataEntry must not be padded");
+static_assert(sizeof(IndexedLaunchDataTrailer) == 16,
+              "IndexedLaunchDataTrailer must not be padded");
+
+}  // namespace launcher
+}  // namespace bazel
+
+#endif  // BAZEL_SRC_TOOLS_LAUNCHER_UTIL_LAUNCH_DATA_FORMAT_H_
@@ -0,0 +1,233 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+#include "src/tools/launcher/util/launcher_util.h"
+#include "src/tools/launcher/util/runfiles_index.h"
+
+namespace bazel {
+namespace launcher {
+
+using std::string;
+using std::string_view;
+using std::wstring;
+
+static constexpr char kMagic[] = "RFINDEX2";
+static constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+static constexpr size_t kHeaderSize =
+    kMagicSize + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+static constexpr size_t kRecordSize = 4 * sizeof(uint32_t);
+
+// The FILETIME of the Unix epoch, in 100-nanosecond intervals.
+static constexpr uint64_t kUnixEpochFileTime = 116444736000000000ULL;
+
+static uint32_t ReadUint32(const char* p) {
+  uint32_t result;
+  memcpy(&result, p, sizeof(result));
+  return result;
+}
+
+static uint64_t ReadUint64(const char* p) {
+  uint64_t result;
+  memcpy(&result, p, sizeof(result));
+  return result;
+}
+
+// Gets the size of the file at the given path, following symlinks, and its
+// modification time in milliseconds since the epoch.
+static bool GetSizeAndMtime(const wstring& path, uint64_t* size,
+                            uint64_t* mtime_ms) {
+  HANDLE file = CreateFileW(AsAbsoluteWindowsPath(path.c_str()).c_str(), 0,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  BY_HANDLE_FILE_INFORMATION info;
+  const bool ok = GetFileInformationByHandle(file, &info);
+  CloseHandle(file);
+  if (!ok) {
+    return false;
+  }
+  *size = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) |
+          info.nFileSizeLow;
+  const uint64_t file_time =
+      (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) |
+      info.ftLastWriteTime.dwLowDateTime;
+  *mtime_ms = (file_time - kUnixEpochFileTime) / 10000;
+  return true;
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_ != nullptr) {
+    CloseHandle(mapping_);
+  }
+  if (file_ != nullptr) {
+    CloseHandle(file_);
+  }
+}
+
+bool MappedFile::Open(const wstring& path) {
+  HANDLE file = CreateFileW(AsAbsoluteWindowsPath(path.c_str()).c_str(),
+                            GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  file_ = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) ||
+      static_cast<ULONGLONG>(size.QuadPart) > SIZE_MAX) {
+    return false;
+  }
+  if (size.QuadPart == 0) {
+    return true;
+  }
+  mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_ == nullptr) {
+    return false;
+  }
+  data_ = static_cast<const char*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (data_ == nullptr) {
+    return false;
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+bool RunfilesIndex::Open(const wstring& path, const wstring& manifest_path) {
+  if (!file_.Open(path) || file_.size() < kHeaderSize ||
+      file_.size() > UINT32_MAX) {
+    return false;
+  }
+  const char* data = file_.data();
+  count_ = ReadUint32(data + kMagicSize);
+  strings_offset_ = ReadUint32(data + kMagicSize + sizeof(uint32_t));
+  if (memcmp(data, kMagic, kMagicSize) != 0 ||
+      strings_offset_ < kHeaderSize || strings_offset_ > file_.size() ||
+      (strings_offset_ - kHeaderSize) / kRecordSize < count_) {
+    return false;
+  }
+  // The manifest may have been rewritten by something that left the index
+  // alone.
+  uint64_t manifest_size;
+  uint64_t manifest_mtime_ms;
+  if (!GetSizeAndMtime(manifest_path, &manifest_size, &manifest_mtime_ms) ||
+      manifest_size != ReadUint64(data + kMagicSize + 2 * sizeof(uint32_t)) ||
+      manifest_mtime_ms !=
+          ReadUint64(data + kMagicSize + 2 * sizeof(uint32_t) +
+                     sizeof(uint64_t))) {
+    return false;
+  }
+  open_ = true;
+  return true;
+}
+
+const char* RunfilesIndex::String(uint32_t offset, uint32_t length) const {
+  const size_t strings_size = file_.size() - strings_offset_;
+  if (offset > strings_size || length > strings_size - offset) {
+    return nullptr;
+  }
+  return file_.data() + strings_offset_ + offset;
+}
+
+bool RunfilesIndex::Lookup(const string& path, string* target) const {
+  // Binary search over the records, which are sorted by the bytes of their
+  // paths.
+  uint32_t low = 0;
+  uint32_t high = count_;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    const char* record = file_.data() + kHeaderSize + mid * kRecordSize;
+    const uint32_t path_length = ReadUint32(record + sizeof(uint32_t));
+    const char* record_path = String(ReadUint32(record), path_length);
+    if (record_path == nullptr) {
+      return false;
+    }
+    int cmp = memcmp(record_path, path.data(),
+                     path_length < path.size() ? path_length : path.size());
+    if (cmp == 0) {
+      cmp = path_length < path.size() ? -1 : path_length > path.size() ? 1 : 0;
+    }
+    if (cmp < 0) {
+      low = mid + 1;
+    } else if (cmp > 0) {
+      high = mid;
+    } else {
+      const uint32_t target_length = ReadUint32(record + 3 * sizeof(uint32_t));
+      const char* record_target =
+          String(ReadUint32(record + 2 * sizeof(uint32_t)), target_length);
+      if (record_target == nullptr) {
+        return false;
+      }
+      target->assign(record_target, target_length);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RunfilesManifest::Open(const wstring& path) { return file_.Open(path); }
+
+void RunfilesManifest::Parse() const {
+  string_view contents(file_.data(), file_.size());
+  entries_.reserve(std::count(contents.begin(), contents.end(), '\n'));
+  while (!contents.empty()) {
+    const size_t n = contents.find('\n');
+    string_view line = contents.substr(0, n);
+    contents.remove_prefix(n == string_view::npos ? contents.size() : n + 1);
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    const size_t space_pos = line.find(' ');
+    if (space_pos == string_view::npos) {
+      die(L"Wrong MANIFEST format at line: %hs", string(line).c_str());
+    }
+    entries_.emplace(line.substr(0, space_pos), line.substr(space_pos + 1));
+  }
+  parsed_ = true;
+}
+
+bool RunfilesManifest::Lookup(const string& path, string* target) const {
+  if (!parsed_) {
+    Parse();
+  }
+  auto entry = entries_.find(path);
+  if (entry == entries_.end()) {
+    return false;
+  }
+  target->assign(entry->second);
+  return true;
+}
+
+}  // namespace launcher
+}  // namespace bazel
@@ -0,0 +1,129 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_LAUNCHER_UTIL_RUNFILES_INDEX_H_
+#define BAZEL_SRC_TOOLS_LAUNCHER_UTIL_RUNFILES_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace bazel {
+namespace launcher {
+
+// A file mapped into memory for reading.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Maps the file at the given path into memory. An empty file is opened
+  // without being mapped, since Windows cannot map it.
+  //
+  // Return false if the file cannot be opened or mapped.
+  bool Open(const std::wstring& path);
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// A runfiles index, as written next to the runfiles manifest by
+// build-runfiles --index or by Bazel with --experimental_runfiles_index (see
+// src/main/tools/build-runfiles.cc for the format). The index is mapped into
+// memory and searched in place, so opening it costs the same no matter how
+// many runfiles there are.
+class RunfilesIndex {
+ public:
+  RunfilesIndex() = default;
+
+  RunfilesIndex(const RunfilesIndex&) = delete;
+  RunfilesIndex& operator=(const RunfilesIndex&) = delete;
+
+  // Maps the index at the given path into memory, if it describes the
+  // manifest at 'manifest_path' as it is now, that is, if the manifest still
+  // has the size and modification time recorded in the index.
+  //
+  // Return false if the file cannot be mapped, is not a runfiles index, or is
+  // stale.
+  bool Open(const std::wstring& path, const std::wstring& manifest_path);
+
+  bool IsOpen() const { return open_; }
+
+  // Look up the target of a runfile path, which is UTF-8 encoded like the
+  // paths in the index.
+  //
+  // Return true if the index has the path, and store its target in 'target'.
+  // The target of an empty file is the empty string.
+  bool Lookup(const std::string& path, std::string* target) const;
+
+ private:
+  // Return the bytes of the string table at the given offset and length, or
+  // nullptr if they are out of bounds.
+  const char* String(uint32_t offset, uint32_t length) const;
+
+  MappedFile file_;
+  bool open_ = false;
+  uint32_t count_ = 0;
+  uint32_t strings_offset_ = 0;
+};
+
+// A runfiles manifest, which is mapped into memory and only parsed when the
+// first runfile is looked up. The parsed entries point into the mapping, so
+// only the looked up paths and targets are ever copied.
+class RunfilesManifest {
+ public:
+  RunfilesManifest() = default;
+
+  RunfilesManifest(const RunfilesManifest&) = delete;
+  RunfilesManifest& operator=(const RunfilesManifest&) = delete;
+
+  // Maps the manifest at the given path into memory.
+  //
+  // Return false if the file cannot be opened or mapped.
+  bool Open(const std::wstring& path);
+
+  // Return true if the manifest has no entries, or was never opened.
+  bool IsEmpty() const { return file_.size() == 0; }
+
+  // Look up the target of a runfile path, which is UTF-8 encoded like the
+  // paths in the manifest. Dies if the manifest is malformed.
+  //
+  // Return true if the manifest has the path, and store its target in
+  // 'target'. The target of an empty file is the empty string.
+  bool Lookup(const std::string& path, std::string* target) const;
+
+ private:
+  void Parse() const;
+
+  MappedFile file_;
+  mutable bool parsed_ = false;
+  mutable std::unordered_map<std::string_view, std::string_view> entries_;
+};
+
+}  // namespace launcher
+}  // namespace bazel
+
+#endif  // BAZEL_SRC_TOOLS_LAUNCHER_UTIL_RUNFILES_INDEX_H_
@@ -0,0 +1,197 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#include <stdint.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/main/cpp/util/strings.h"
+#include "src/tools/launcher/util/runfiles_index.h"
+#include "gtest/gtest.h"
+
+namespace bazel {
+namespace launcher {
+
+using std::getenv;
+using std::ios;
+using std::ofstream;
+using std::pair;
+using std::string;
+using std::vector;
+
+class RunfilesIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char* tmpdir = getenv("TEST_TMPDIR");
+    if (tmpdir == nullptr) {
+      tmpdir = getenv("TEMP");
+      ASSERT_FALSE(tmpdir == nullptr);
+    }
+    test_tmpdir = string(tmpdir);
+  }
+
+  // Writes an index for the given manifest the way build-runfiles --index
+  // does. The entries must be sorted by path.
+  static void WriteIndex(const string& index_file, const string& manifest_file,
+                         const vector<pair<string, string>>& entries) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    ASSERT_TRUE(GetFileAttributesExA(manifest_file.c_str(),
+                                     GetFileExInfoStandard, &attributes));
+    const uint64_t stamp[2] = {
+        (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) |
+            attributes.nFileSizeLow,
+        ((static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime)
+          << 32) |
+         attributes.ftLastWriteTime.dwLowDateTime) /
+                10000 -
+            11644473600000ULL};
+    vector<uint32_t> records;
+    string strings;
+    for (auto const& entry : entries) {
+      records.push_back(strings.size());
+      records.push_back(entry.first.size());
+      strings += entry.first;
+      records.push_back(strings.size());
+      records.push_back(entry.second.size());
+      strings += entry.second;
+    }
+    const uint32_t header[2] = {
+        static_cast<uint32_t>(entries.size()),
+        static_cast<uint32_t>(8 + 2 * sizeof(uint32_t) + sizeof(stamp) +
+                              records.size() * sizeof(uint32_t))};
+
+    ofstream stream(index_file, ios::out | ios::binary);
+    stream.write("RFINDEX2", 8);
+    stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(stamp), sizeof(stamp));
+    stream.write(reinterpret_cast<const char*>(records.data()),
+                 records.size() * sizeof(uint32_t));
+    stream << strings;
+  }
+
+  string test_tmpdir;
+};
+
+TEST_F(RunfilesIndexTest, LookupTest) {
+  vector<pair<string, string>> entries = {
+      {"__main__/a b", "C:/foo/a b"},
+      {"__main__/empty", ""},
+      {"__main__/foo/bar", "C:/foo/bar"},
+      {"__main__/foo/bar.exe", "C:/foo/bar.exe"},
+      {"other/baz", "C:/other/baz"},
+  };
+  string manifest_file = test_tmpdir + "/lookup";
+  ofstream(manifest_file) << "__main__/foo/bar C:/foo/bar\n";
+  string index_file = manifest_file + ".index";
+  WriteIndex(index_file, manifest_file, entries);
+
+  RunfilesIndex index;
+  ASSERT_TRUE(index.Open(blaze_util::CstringToWstring(index_file),
+                         blaze_util::CstringToWstring(manifest_file)));
+  string target;
+  for (auto const& entry : entries) {
+    ASSERT_TRUE(index.Lookup(entry.first, &target));
+    ASSERT_EQ(entry.second, target);
+  }
+  ASSERT_FALSE(index.Lookup("", &target));
+  ASSERT_FALSE(index.Lookup("__main__", &target));
+  ASSERT_FALSE(index.Lookup("__main__/foo/ba", &target));
+  ASSERT_FALSE(index.Lookup("zzz", &target));
+}
+
+TEST_F(RunfilesIndexTest, EmptyIndexTest) {
+  string manifest_file = test_tmpdir + "/empty";
+  ofstream(manifest_file).close();
+  string index_file = manifest_file + ".index";
+  WriteIndex(index_file, manifest_file, {});
+
+  RunfilesIndex index;
+  ASSERT_TRUE(index.Open(blaze_util::CstringToWstring(index_file),
+                         blaze_util::CstringToWstring(manifest_file)));
+  string target;
+  ASSERT_FALSE(index.Lookup("__main__/foo", &target));
+}
+
+TEST_F(RunfilesIndexTest, StaleIndexTest) {
+  string manifest_file = test_tmpdir + "/stale";
+  ofstream(manifest_file) << "__main__/foo/bar C:/foo/bar\n";
+  string index_file = manifest_file + ".index";
+  WriteIndex(index_file, manifest_file, {{"__main__/foo/bar", "C:/foo/bar"}});
+  ofstream(manifest_file) << "__main__/foo/bar C:/foo/bar\n"
+                          << "__main__/foo/baz C:/foo/baz\n";
+
+  RunfilesIndex index;
+  ASSERT_FALSE(index.Open(blaze_util::CstringToWstring(index_file),
+                          blaze_util::CstringToWstring(manifest_file)));
+  ASSERT_FALSE(index.IsOpen());
+}
+
+TEST_F(RunfilesIndexTest, NotAnIndexTest) {
+  string manifest_file = test_tmpdir + "/MANIFEST";
+  ofstream(manifest_file) << "__main__/foo/bar C:/foo/bar\n";
+
+  RunfilesIndex index;
+  ASSERT_FALSE(index.Open(blaze_util::CstringToWstring(manifest_file),
+                          blaze_util::CstringToWstring(manifest_file)));
+  ASSERT_FALSE(index.IsOpen());
+  ASSERT_FALSE(
+      index.Open(blaze_util::CstringToWstring(test_tmpdir + "/missing"),
+                 blaze_util::CstringToWstring(manifest_file)));
+}
+
+TEST_F(RunfilesIndexTest, ManifestLookupTest) {
+  string manifest_file = test_tmpdir + "/lookup_MANIFEST";
+  ofstream(manifest_file, ios::out | ios::binary)
+      << "__main__/foo/bar C:/foo/bar\n"
+      << "__main__/empty \n"
+      << "__main__/crlf C:/foo/crlf\r\n"
+      << "other/baz C:/other dir/baz\n";
+
+  RunfilesManifest manifest;
+  ASSERT_TRUE(manifest.Open(blaze_util::CstringToWstring(manifest_file)));
+  ASSERT_FALSE(manifest.IsEmpty());
+  string target;
+  ASSERT_TRUE(manifest.Lookup("__main__/foo/bar", &target));
+  ASSERT_EQ("C:/foo/bar", target);
+  ASSERT_TRUE(manifest.Lookup("__main__/empty", &target));
+  ASSERT_EQ("", target);
+  ASSERT_TRUE(manifest.Lookup("__main__/crlf", &target));
+  ASSERT_EQ("C:/foo/crlf", target);
+  ASSERT_TRUE(manifest.Lookup("other/baz", &target));
+  ASSERT_EQ("C:/other dir/baz", target);
+  ASSERT_FALSE(manifest.Lookup("__main__/foo", &target));
+}
+
+TEST_F(RunfilesIndexTest, EmptyManifestTest) {
+  string manifest_file = test_tmpdir + "/empty_MANIFEST";
+  ofstream(manifest_file).close();
+
+  RunfilesManifest manifest;
+  ASSERT_TRUE(manifest.Open(blaze_util::CstringToWstring(manifest_file)));
+  ASSERT_TRUE(manifest.IsEmpty());
+  string target;
+  ASSERT_FALSE(manifest.Lookup("__main__/foo", &target));
+}
+
+}  // namespace launcher
+}  // namespace bazel
@@ -14,10 +14,18 @@
 
 #include "src/tools/one_version/allowlist.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
@@ -31,12 +39,64 @@ absl::string_view package_name_from_class_name(absl::string_view class_name) {
   return package_name.substr(0, package_name.find_last_of('/'));
 }
 
+AllowlistIndex::AllowlistIndex(
+    const absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>&
+        allowlist) {
+  std::vector<uint32_t> ids;
+  for (const auto& package : allowlist) {
+    if (package.second.empty()) {
+      continue;
+    }
+    ids.clear();
+    for (const std::string& label : package.second) {
+      auto it = label_ids_.emplace(label, label_ids_.size()).first;
+      ids.push_back(it->second);
+    }
+    auto minmax = std::minmax_element(ids.begin(), ids.end());
+    LabelSet& labels = packages_[package.first];
+    labels.base = *minmax.first;
+    labels.bits.resize((*minmax.second - labels.base) / 64 + 1);
+    for (uint32_t id : ids) {
+      labels.bits[(id - labels.base) / 64] |= uint64_t{1}
+                                              << ((id - labels.base) % 64);
+    }
+  }
+}
+
+const AllowlistIndex::LabelSet* AllowlistIndex::Find(
+    absl::string_view package_name) const {
+  auto it = packages_.find(package_name);
+  return it != packages_.end() ? &it->second : nullptr;
+}
+
+bool AllowlistIndex::Contains(const LabelSet* labels,
+                              absl::string_view label) const {
+  if (labels == nullptr) {
+    return false;
+  }
+  auto it = label_ids_.find(label);
+  if (it == label_ids_.end() || it->second < labels->base) {
+    return false;
+  }
+  uint32_t offset = it->second - labels->base;
+  return offset / 64 < labels->bits.size() &&
+         (labels->bits[offset / 64] >> (offset % 64)) & 1;
+}
+
 std::vector<Violation> Allowlist::Apply(
     absl::Span<const Violation> violations) {
+  const AllowlistIndex* index = Index();
   std::vector<Violation> result;
   for (const Violation& violation : violations) {
-    absl::flat_hash_set<std::string> allowlisted_labels =
-        AllLabels(package_name_from_class_name(violation.class_name()));
+    absl::string_view package_name =
+        package_name_from_class_name(violation.class_name());
+    const AllowlistIndex::LabelSet* indexed_labels = nullptr;
+    absl::flat_hash_set<std::string> allowlisted_labels;
+    if (index != nullptr) {
+      indexed_labels = index->Find(package_name);
+    } else {
+      allowlisted_labels = AllLabels(package_name);
+    }
     std::vector<Version> versions;
     int new_versions = 0;
     for (const Version& version : violation.versions()) {
@@ -44,7 +104,10 @@ std::vector<Violation> Allowlist::Apply(
       bool new_labels = false;
       for (const Label& label : version.labels()) {
         bool allowlisted =
-            allowlisted_labels.find(label.name()) != allowlisted_labels.end();
+            index != nullptr
+                ? index->Contains(indexed_labels, label.name())
+                : allowlisted_labels.find(label.name()) !=
+                      allowlisted_labels.end();
         if (!allowlisted) {
           new_labels = true;
         }
@@ -62,9 +125,34 @@ std::vector<Violation> Allowlist::Apply(
   return result;
 }
 
+std::unique_ptr<MapAllowlist> MapAllowlist::FromFile(const std::string& path,
+                                                     std::string* error) {
+  std::ifstream in(path);
+  if (!in) {
+    *error = absl::StrCat("unable to open allowlist file: ", path);
+    return nullptr;
+  }
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> map;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::vector<std::string> parts =
+        absl::StrSplit(line, absl::MaxSplits(' ', 1));
+    if (parts.size() != 2) {
+      *error = absl::StrCat("expected <package> <label>, got: ", line);
+      return nullptr;
+    }
+    map[parts[0]].insert(parts[1]);
+  }
+  return std::make_unique<MapAllowlist>(std::move(map));
+}
+
 absl::flat_hash_set<std::string> MapAllowlist::AllLabels(
     absl::string_view package_name) {
-  return allowlist_[package_name];
+  auto it = allowlist_.find(package_name);
+  if (it == allowlist_.end()) {
+    return absl::flat_hash_set<std::string>();
+  }
+  return it->second;
 }
 
 }  // namespace one_version
@@ -15,11 +15,13 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ALLOWLIST_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ALLOWLIST_H_
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
@@ -27,6 +29,34 @@
 
 namespace one_version {
 
+// An allowlist compiled for lookups. Every label is interned once, and the
+// allowlisted labels of a package are a bitset over the interned ids, so
+// checking a label doesn't copy or hash any per-package set of strings.
+class AllowlistIndex {
+ public:
+  // A set of interned labels. Covers only the range of ids between the
+  // smallest and the largest label in the set, which tend to be close since
+  // labels are interned package by package.
+  struct LabelSet {
+    uint32_t base = 0;
+    std::vector<uint64_t> bits;
+  };
+
+  explicit AllowlistIndex(
+      const absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>&
+          allowlist);
+
+  // Returns the allowlisted labels of a package, or nullptr if it has none.
+  const LabelSet* Find(absl::string_view package_name) const;
+
+  // Whether `labels`, as returned by Find(), contains `label`.
+  bool Contains(const LabelSet* labels, absl::string_view label) const;
+
+ private:
+  absl::flat_hash_map<std::string, uint32_t> label_ids_;
+  absl::flat_hash_map<std::string, LabelSet> packages_;
+};
+
 // A allowlist of one version violations to ignore.
 class Allowlist {
  public:
@@ -36,6 +66,11 @@ class Allowlist {
       absl::string_view class_name) = 0;
   // Apply the allowlist to the given violations.
   std::vector<Violation> Apply(absl::Span<const Violation> violations);
+
+ protected:
+  // Returns an index of the allowlist, or nullptr if Apply() has to fall back
+  // to AllLabels().
+  virtual const AllowlistIndex* Index() const { return nullptr; }
 };
 
 // A allowlist backed by a map.
@@ -44,13 +79,24 @@ class MapAllowlist : public Allowlist {
   explicit MapAllowlist(
       absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>
           allowlist)
-      : allowlist_(std::move(allowlist)) {}
+      : allowlist_(std::move(allowlist)),
+        index_(std::make_unique<AllowlistIndex>(allowlist_)) {}
+
+  // Reads an allowlist with one "<package> <label>" pair per line. Returns
+  // nullptr and sets `error` if the file can't be read or is malformed.
+  static std::unique_ptr<MapAllowlist> FromFile(const std::string& path,
+                                                std::string* error);
 
   absl::flat_hash_set<std::string> AllLabels(
       absl::string_view package_name) override;
 
+ protected:
+  const AllowlistIndex* Index() const override { return index_.get(); }
+
  private:
   absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> allowlist_;
+  // Built once, since an allowlist can have tens of thousands of entries.
+  std::unique_ptr<AllowlistIndex> index_;
 };
 
 }  // namespace one_version
@@ -14,7 +14,11 @@
 
 #include "src/tools/one_version/allowlist.h"
 
+#include <chrono>
+#include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "googletest/include/gtest/gtest.h"
 #include "absl/container/flat_hash_map.h"
@@ -26,6 +30,27 @@ namespace one_version {
 
 class AllowlistTest : public ::testing::Test {};
 
+// Only implements AllLabels(), so Apply() can't use an index.
+class UnindexedAllowlist : public Allowlist {
+ public:
+  explicit UnindexedAllowlist(
+      absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>
+          allowlist)
+      : allowlist_(std::move(allowlist)) {}
+
+  absl::flat_hash_set<std::string> AllLabels(
+      absl::string_view package_name) override {
+    auto it = allowlist_.find(package_name);
+    if (it == allowlist_.end()) {
+      return absl::flat_hash_set<std::string>();
+    }
+    return it->second;
+  }
+
+ private:
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> allowlist_;
+};
+
 TEST_F(AllowlistTest, Allowlisting) {
   DuplicateClassCollector vc;
   vc.Add("com/google/Foo", 1, Label("//hello:foo", "hello/libfoo.jar"));
@@ -70,4 +95,53 @@ TEST_F(AllowlistTest, Allowlisting) {
   EXPECT_TRUE(allowlist.Apply(vc.Violations()).empty());
 }
 
+// Not so much a test as a benchmark of applying a large allowlist, which also
+// checks that the index agrees with AllLabels().
+TEST_F(AllowlistTest, LargeAllowlist) {
+  constexpr int kPackages = 2000;
+  constexpr int kLabelsPerPackage = 25;
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> map;
+  for (int p = 0; p < kPackages; ++p) {
+    for (int l = 0; l < kLabelsPerPackage; ++l) {
+      // Every fifth label is shared with the next package.
+      int label = l % 5 == 0 ? p + 1 : p * kLabelsPerPackage + l;
+      map[absl::StrCat("com/google/p", p)].insert(
+          absl::StrCat("//lib:l", label));
+    }
+  }
+
+  DuplicateClassCollector vc;
+  for (int p = 0; p < kPackages + 100; ++p) {
+    for (int c = 0; c < 10; ++c) {
+      std::string class_name = absl::StrCat("com/google/p", p, "/C", c);
+      for (int v = 0; v < 3; ++v) {
+        int label = (p + c + v) % 4 == 0 ? p * kLabelsPerPackage + v + 1
+                                         : kPackages * kLabelsPerPackage + v;
+        vc.Add(class_name, v,
+               Label(absl::StrCat("//lib:l", label),
+                     absl::StrCat("lib/libl", label, ".jar")));
+      }
+    }
+  }
+  std::vector<Violation> violations = vc.Violations();
+
+  auto apply = [&](Allowlist* allowlist, const char* name) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Violation> result = allowlist->Apply(violations);
+    std::cerr << name << ": applied " << kPackages * kLabelsPerPackage
+              << " entries to " << violations.size() << " violations in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count()
+              << "us" << std::endl;
+    return DuplicateClassCollector::Report(result);
+  };
+  UnindexedAllowlist unindexed(map);
+  MapAllowlist indexed(std::move(map));
+  std::string unindexed_report = apply(&unindexed, "AllLabels");
+  std::string indexed_report = apply(&indexed, "index");
+  EXPECT_NE(std::string::npos, indexed_report.find("[allowlisted]"));
+  EXPECT_EQ(unindexed_report, indexed_report);
+}
+
 }  // namespace one_version
@@ -15,15 +15,40 @@
 #include "src/tools/one_version/duplicate_class_collector.h"
 
 #include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
+#include "absl/hash/hash.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 namespace one_version {
 
+namespace {
+
+constexpr size_t kShardBits = 6;
+constexpr size_t kNumShards = size_t{1} << kShardBits;
+constexpr size_t kInternBlockSize = 64 * 1024;
+
+// Picks the shard from the top bits of the hash, since the maps themselves
+// use the low bits.
+size_t ShardIndex(absl::string_view class_name) {
+  uint64_t hash = absl::Hash<absl::string_view>()(class_name);
+  return hash >> (64 - kShardBits);
+}
+
+}  // namespace
+
 void DuplicateClassCollector::Add(const std::string& class_name, uint32_t crc32,
                                   const Label& label) {
   auto it = violations_.find(class_name);
@@ -80,6 +105,123 @@ std::vector<Violation> DuplicateClassCollector::Violations() {
   return violations;
 }
 
+struct ShardedDuplicateClassCollector::Worker {
+  Shard shards[kNumShards];
+  // Storage for the interned class names, which the shards refer to.
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char* block = nullptr;
+  size_t block_left = 0;
+
+  absl::string_view Intern(absl::string_view s) {
+    char* p;
+    if (s.size() > kInternBlockSize / 4) {
+      blocks.push_back(std::make_unique<char[]>(s.size()));
+      p = blocks.back().get();
+    } else {
+      if (s.size() > block_left) {
+        blocks.push_back(std::make_unique<char[]>(kInternBlockSize));
+        block = blocks.back().get();
+        block_left = kInternBlockSize;
+      }
+      p = block;
+      block += s.size();
+      block_left -= s.size();
+    }
+    memcpy(p, s.data(), s.size());
+    return absl::string_view(p, s.size());
+  }
+};
+
+ShardedDuplicateClassCollector::ShardedDuplicateClassCollector(
+    int num_workers) {
+  for (int i = 0; i < std::max(num_workers, 1); ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+}
+
+ShardedDuplicateClassCollector::~ShardedDuplicateClassCollector() = default;
+
+void ShardedDuplicateClassCollector::Add(int worker,
+                                         absl::string_view class_name,
+                                         uint32_t crc32, size_t label_index) {
+  Worker* w = workers_[worker].get();
+  Shard& shard = w->shards[ShardIndex(class_name)];
+  auto it = shard.find(class_name);
+  if (it == shard.end()) {
+    it = shard.emplace(w->Intern(class_name), ClassEntries()).first;
+  }
+  it->second.push_back(ClassEntry{crc32, label_index});
+}
+
+std::vector<Violation> ShardedDuplicateClassCollector::Violations(
+    absl::Span<const Label> labels) {
+  // A class lands in the same shard in every worker, so the shards can be
+  // merged independently of each other.
+  std::vector<std::vector<Violation>> shard_violations(kNumShards);
+  std::atomic<size_t> next_shard{0};
+  auto merge_shards = [&]() {
+    size_t s;
+    while ((s = next_shard.fetch_add(1)) < kNumShards) {
+      Shard merged;
+      for (const auto& worker : workers_) {
+        for (const auto& e : worker->shards[s]) {
+          ClassEntries& entries = merged[e.first];
+          entries.insert(entries.end(), e.second.begin(), e.second.end());
+        }
+      }
+      for (auto& e : merged) {
+        ClassEntries& entries = e.second;
+        uint32_t first_crc32 = entries[0].crc32;
+        if (std::all_of(entries.begin(), entries.end(),
+                        [&](const ClassEntry& entry) {
+                          return entry.crc32 == first_crc32;
+                        })) {
+          // We only saw one crc32.
+          continue;
+        }
+        // Sorting by label index last makes the order independent of which
+        // worker saw which entry.
+        std::sort(entries.begin(), entries.end(),
+                  [&](const ClassEntry& a, const ClassEntry& b) {
+                    return std::forward_as_tuple(a.crc32,
+                                                 labels[a.label_index].name(),
+                                                 a.label_index) <
+                           std::forward_as_tuple(b.crc32,
+                                                 labels[b.label_index].name(),
+                                                 b.label_index);
+                  });
+        std::vector<Version> versions;
+        for (const ClassEntry& entry : entries) {
+          if (versions.empty() || versions.back().crc32() != entry.crc32) {
+            versions.push_back(Version(entry.crc32, std::vector<Label>()));
+          }
+          versions.back().Add(labels[entry.label_index]);
+        }
+        shard_violations[s].push_back(
+            Violation(std::string(e.first), std::move(versions)));
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(workers_.size(), kNumShards); ++i) {
+    threads.emplace_back(merge_shards);
+  }
+  merge_shards();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<Violation> violations;
+  for (std::vector<Violation>& v : shard_violations) {
+    std::move(v.begin(), v.end(), std::back_inserter(violations));
+  }
+  std::sort(violations.begin(), violations.end(),
+            [](const Violation& a, const Violation& b) {
+              return a.class_name() < b.class_name();
+            });
+  return violations;
+}
+
 std::string DuplicateClassCollector::Report(
     const std::vector<Violation>& violations) {
   std::string report;
@@ -15,12 +15,17 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_DUPLICATE_CLASS_COLLECTOR_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_DUPLICATE_CLASS_COLLECTOR_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 namespace one_version {
 
@@ -92,6 +97,45 @@ class DuplicateClassCollector {
   absl::flat_hash_map<std::string, Violation> violations_;
 };
 
+// A collector for one version violations that can be fed from several
+// threads at once.
+//
+// Every worker thread adds classes to its own set of maps, partitioned by a
+// hash of the class name, so that workers never contend with each other.
+// Class names are interned in per-worker storage, and the labels of the
+// classpath entries are referred to by their index in a table that is only
+// consulted for the classes that turn out to be violations. Once all workers
+// are done, Violations() merges the partitions and returns the same
+// violations, in the same order, as a DuplicateClassCollector that was fed
+// the same classes.
+class ShardedDuplicateClassCollector {
+ public:
+  explicit ShardedDuplicateClassCollector(int num_workers);
+  ~ShardedDuplicateClassCollector();
+
+  // Records the class name, crc, and label of a classpath entry. Calls with
+  // different worker indices may run concurrently; calls with the same index
+  // must not. `class_name` is copied and needn't outlive the call.
+  void Add(int worker, absl::string_view class_name, uint32_t crc32,
+           size_t label_index);
+
+  // Returns the collection of one version violations, resolving label indices
+  // against `labels`. Must not be called concurrently with Add().
+  std::vector<Violation> Violations(absl::Span<const Label> labels);
+
+ private:
+  struct ClassEntry {
+    uint32_t crc32;
+    size_t label_index;
+  };
+  // Most classes are only defined once on a classpath.
+  using ClassEntries = absl::InlinedVector<ClassEntry, 1>;
+  using Shard = absl::flat_hash_map<absl::string_view, ClassEntries>;
+  struct Worker;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
 }  // namespace one_version
 
 #endif  // THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_DUPLICATE_CLASS_COLLECTOR_H_
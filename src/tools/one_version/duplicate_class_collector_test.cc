@@ -15,6 +15,8 @@
 #include "src/tools/one_version/duplicate_class_collector.h"
 
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "googletest/include/gtest/gtest.h"
 #include "absl/strings/str_cat.h"
@@ -58,4 +60,49 @@ TEST_F(DuplicateClassCollectorTest, Violations) {
   EXPECT_EQ(expected, DuplicateClassCollector::Report(vc.Violations()));
 }
 
+TEST_F(DuplicateClassCollectorTest, ShardedMatchesSequential) {
+  std::vector<Label> labels;
+  for (int i = 0; i < 16; ++i) {
+    labels.push_back(Label(absl::StrCat("//hello:lib", i),
+                           absl::StrCat("hello/lib", i, ".jar")));
+  }
+  DuplicateClassCollector vc;
+  ShardedDuplicateClassCollector sharded(4);
+  std::vector<std::thread> threads;
+  for (int worker = 0; worker < 4; ++worker) {
+    threads.emplace_back([&, worker]() {
+      for (int label = worker; label < 16; label += 4) {
+        for (int i = 0; i < 1000; ++i) {
+          // Every tenth class gets a crc32 that depends on the label.
+          uint32_t crc32 = i % 10 == 0 ? label % 3 : i;
+          sharded.Add(worker, absl::StrCat("com/google/C", i), crc32, label);
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int label = 0; label < 16; ++label) {
+    for (int i = 0; i < 1000; ++i) {
+      uint32_t crc32 = i % 10 == 0 ? label % 3 : i;
+      vc.Add(absl::StrCat("com/google/C", i), crc32, labels[label]);
+    }
+  }
+  std::vector<Violation> violations = sharded.Violations(labels);
+  EXPECT_EQ(100, violations.size());
+  EXPECT_EQ(DuplicateClassCollector::Report(vc.Violations()),
+            DuplicateClassCollector::Report(violations));
+}
+
+TEST_F(DuplicateClassCollectorTest, ShardedNoViolations) {
+  std::vector<Label> labels = {Label("//hello:foo", "hello/libfoo.jar"),
+                               Label("//hello:bar", "hello/libbar.jar")};
+  ShardedDuplicateClassCollector sharded(2);
+  sharded.Add(0, "com/google/Foo", 1, 0);
+  sharded.Add(1, "com/google/Foo", 1, 1);
+  sharded.Add(1, "com/google/Bar", 2, 1);
+  EXPECT_TRUE(sharded.Violations(labels).empty());
+}
+
 }  // namespace one_version
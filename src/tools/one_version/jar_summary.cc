@@ -0,0 +1,191 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/one_version/jar_summary.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "src/tools/singlejar/input_jar.h"
+
+namespace one_version {
+
+namespace {
+
+// Bump the version whenever the format or the set of checked classes changes.
+constexpr char kJarSummaryMagic[8] = {'1', 'V', 'S', 'U', 'M', 'M', '0', '1'};
+
+struct JarSummaryHeader {
+  char magic[8];
+  uint64_t count;
+};
+
+constexpr size_t kShardBits = 8;
+constexpr size_t kNumShards = size_t{1} << kShardBits;
+
+bool ClassSummaryLess(const ClassSummary& a, const ClassSummary& b) {
+  return a.name_hash < b.name_hash ||
+         (a.name_hash == b.name_hash && a.crc32 < b.crc32);
+}
+
+// FNV-1a, followed by the splitmix64 finalizer so that the top bits, which
+// FindConflictingClasses() shards by, are well mixed.
+uint64_t HashBytes(const uint8_t* data, size_t len, uint64_t seed) {
+  uint64_t hash = 0xcbf29ce484222325 ^ seed;
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001b3;
+  }
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+  return hash ^ (hash >> 31);
+}
+
+}  // namespace
+
+uint64_t HashClassName(absl::string_view class_name) {
+  return HashBytes(reinterpret_cast<const uint8_t*>(class_name.data()),
+                   class_name.size(), 0);
+}
+
+std::string JarSummaryPath(const std::string& cache_dir, const InputJar& jar) {
+  // Two independently seeded hashes make for a 128-bit digest without
+  // pulling a cryptographic hash into the java_tools sources.
+  const uint8_t* cdr = jar.central_directory();
+  size_t size = jar.central_directory_size();
+  return absl::StrCat(cache_dir, "/", absl::Hex(HashBytes(cdr, size, 1),
+                                                absl::kZeroPad16),
+                      absl::Hex(HashBytes(cdr, size, 2), absl::kZeroPad16),
+                      "-", size, ".summary");
+}
+
+bool ReadJarSummary(const std::string& path,
+                    std::vector<ClassSummary>* summary) {
+  std::ifstream in(path, std::ios::binary);
+  JarSummaryHeader header;
+  if (!in || !in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      memcmp(header.magic, kJarSummaryMagic, sizeof(header.magic)) != 0) {
+    return false;
+  }
+  std::error_code ec;
+  uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec || size != sizeof(header) + header.count * sizeof(ClassSummary)) {
+    return false;
+  }
+  summary->resize(header.count);
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char*>(summary->data()),
+              header.count * sizeof(ClassSummary)));
+}
+
+bool WriteJarSummary(const std::string& path,
+                     std::vector<ClassSummary>* summary) {
+  std::sort(summary->begin(), summary->end(), ClassSummaryLess);
+  JarSummaryHeader header;
+  memcpy(header.magic, kJarSummaryMagic, sizeof(header.magic));
+  header.count = summary->size();
+
+  std::string temp_path = absl::StrCat(path, ".tmp", std::random_device()());
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(summary->data()),
+              summary->size() * sizeof(ClassSummary));
+    if (!out.flush()) {
+      out.close();
+      std::filesystem::remove(temp_path);
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp_path, ec);
+    return false;
+  }
+  return true;
+}
+
+std::vector<uint64_t> FindConflictingClasses(
+    absl::Span<const std::vector<ClassSummary>> summaries, int num_threads) {
+  // Every summary is sorted, so the classes of a shard, i.e. the hashes with
+  // the same top bits, are a contiguous range in each of them, and the shards
+  // can be searched independently of each other.
+  std::vector<std::vector<uint64_t>> shard_conflicts(kNumShards);
+  std::atomic<size_t> next_shard{0};
+  auto find_conflicts = [&]() {
+    size_t s;
+    while ((s = next_shard.fetch_add(1)) < kNumShards) {
+      uint64_t shard_start = uint64_t{s} << (64 - kShardBits);
+      std::vector<ClassSummary> classes;
+      for (const std::vector<ClassSummary>& summary : summaries) {
+        auto begin = std::lower_bound(
+            summary.begin(), summary.end(), shard_start,
+            [](const ClassSummary& c, uint64_t hash) {
+              return c.name_hash < hash;
+            });
+        auto end = begin;
+        while (end != summary.end() &&
+               end->name_hash >> (64 - kShardBits) == s) {
+          ++end;
+        }
+        classes.insert(classes.end(), begin, end);
+      }
+      std::sort(classes.begin(), classes.end(), ClassSummaryLess);
+      for (size_t i = 0; i < classes.size();) {
+        size_t j = i + 1;
+        bool conflict = false;
+        while (j < classes.size() &&
+               classes[j].name_hash == classes[i].name_hash) {
+          conflict = conflict || classes[j].crc32 != classes[i].crc32;
+          ++j;
+        }
+        if (conflict) {
+          shard_conflicts[s].push_back(classes[i].name_hash);
+        }
+        i = j;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < std::min(num_threads, static_cast<int>(kNumShards));
+       ++i) {
+    threads.emplace_back(find_conflicts);
+  }
+  find_conflicts();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::vector<uint64_t> conflicts;
+  for (std::vector<uint64_t>& c : shard_conflicts) {
+    std::move(c.begin(), c.end(), std::back_inserter(conflicts));
+  }
+  return conflicts;
+}
+
+}  // namespace one_version
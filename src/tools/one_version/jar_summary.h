@@ -0,0 +1,62 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_JAR_SUMMARY_H_
+#define THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_JAR_SUMMARY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "src/tools/singlejar/input_jar.h"
+
+namespace one_version {
+
+// A class file of a jar, reduced to what is needed to tell whether it may
+// conflict with a class file of another jar.
+struct ClassSummary {
+  uint64_t name_hash;
+  uint32_t crc32;
+  uint32_t reserved;
+};
+
+// Hashes a class name. Unlike absl::Hash, the result is the same in every
+// process, so it can be stored in a summary.
+uint64_t HashClassName(absl::string_view class_name);
+
+// Returns the path of the summary of `jar` in the cache directory `cache_dir`.
+// The name of the summary is a digest of the Central Directory of the jar, so
+// a jar that didn't change maps to the same summary, wherever it is.
+std::string JarSummaryPath(const std::string& cache_dir, const InputJar& jar);
+
+// Reads the summary at `path`. Returns false if there is none or if it is
+// corrupt.
+bool ReadJarSummary(const std::string& path,
+                    std::vector<ClassSummary>* summary);
+
+// Sorts `summary` and stores it at `path`, replacing it atomically so that
+// concurrent readers and writers never see a partial summary.
+bool WriteJarSummary(const std::string& path,
+                     std::vector<ClassSummary>* summary);
+
+// Returns the sorted hashes of the class names that appear with more than one
+// crc32 across the sorted `summaries`, using up to `num_threads` threads.
+std::vector<uint64_t> FindConflictingClasses(
+    absl::Span<const std::vector<ClassSummary>> summaries, int num_threads);
+
+}  // namespace one_version
+
+#endif  // THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_JAR_SUMMARY_H_
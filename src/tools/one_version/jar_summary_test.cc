@@ -0,0 +1,80 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/one_version/jar_summary.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace one_version {
+
+class JarSummaryTest : public ::testing::Test {};
+
+TEST_F(JarSummaryTest, RoundTrip) {
+  std::string path = ::testing::TempDir() + "/round_trip.summary";
+  std::vector<ClassSummary> summary = {
+      {HashClassName("com/google/Foo"), 1},
+      {HashClassName("com/google/Bar"), 2},
+      {HashClassName("com/google/Baz"), 3},
+  };
+  ASSERT_TRUE(WriteJarSummary(path, &summary));
+  std::vector<ClassSummary> read;
+  ASSERT_TRUE(ReadJarSummary(path, &read));
+  ASSERT_EQ(3, read.size());
+  for (size_t i = 0; i < read.size(); ++i) {
+    EXPECT_EQ(summary[i].name_hash, read[i].name_hash);
+    EXPECT_EQ(summary[i].crc32, read[i].crc32);
+    if (i > 0) {
+      EXPECT_LT(read[i - 1].name_hash, read[i].name_hash);
+    }
+  }
+}
+
+TEST_F(JarSummaryTest, RejectsMissingAndCorruptSummaries) {
+  std::vector<ClassSummary> read;
+  EXPECT_FALSE(
+      ReadJarSummary(::testing::TempDir() + "/missing.summary", &read));
+
+  std::string path = ::testing::TempDir() + "/corrupt.summary";
+  std::vector<ClassSummary> summary = {{HashClassName("com/google/Foo"), 1}};
+  ASSERT_TRUE(WriteJarSummary(path, &summary));
+  std::ofstream(path, std::ios::binary | std::ios::app) << "x";
+  EXPECT_FALSE(ReadJarSummary(path, &read));
+}
+
+TEST_F(JarSummaryTest, FindConflictingClasses) {
+  std::vector<std::vector<ClassSummary>> summaries = {
+      {{HashClassName("com/google/Foo"), 1},
+       {HashClassName("com/google/Bar"), 2}},
+      {{HashClassName("com/google/Foo"), 1},
+       {HashClassName("com/google/Baz"), 3}},
+      {{HashClassName("com/google/Baz"), 4}},
+  };
+  for (std::vector<ClassSummary>& summary : summaries) {
+    std::sort(summary.begin(), summary.end(),
+              [](const ClassSummary& a, const ClassSummary& b) {
+                return a.name_hash < b.name_hash;
+              });
+  }
+  std::vector<uint64_t> conflicts = FindConflictingClasses(summaries, 4);
+  ASSERT_EQ(1, conflicts.size());
+  EXPECT_EQ(HashClassName("com/google/Baz"), conflicts[0]);
+}
+
+}  // namespace one_version
@@ -14,48 +14,206 @@
 
 #include "src/tools/one_version/one_version.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/die_if_null.h"
 #include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/one_version/jar_summary.h"
+#include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/zip_headers.h"
 
 namespace one_version {
 
+namespace {
+
+// Strips the ".class" suffix from `file_name_of_entry` and returns true if the
+// jar entry is a class file that takes part in the check.
+bool ConsumeCheckedClass(absl::string_view *file_name_of_entry) {
+  return absl::ConsumeSuffix(file_name_of_entry, ".class") &&
+         // module-info.class is a Java 9 Module specifier, and isn't a
+         // normal class. We expect it to be at the top of the jar or under
+         // META-INF/versions/{numeral} in a multi-release JAR.
+         *file_name_of_entry != "module-info" &&
+         !(absl::StartsWith(*file_name_of_entry, "META-INF/versions/") &&
+           absl::EndsWith(*file_name_of_entry, "/module-info")) &&
+         // R.class and R$....class should be removed from analysis as they
+         // are android resources, and are re-processed during the android
+         // binary build.
+         !absl::EndsWith(*file_name_of_entry, "/R") &&
+         !absl::StrContains(*file_name_of_entry, "/R$") &&
+         // BR.class should be removed from analysis as it is a special class
+         // generated by Android databinding, and is re-processed during the
+         // android binary build. Once the depot is migrated to Android
+         // databinding v2 (see b/73782031), this will no longer be necessary.
+         !absl::EndsWith(*file_name_of_entry, "/BR");
+}
+
+// Calls `fn(worker, i)` for every `i` below `n` on up to `num_threads`
+// threads. Indices are handed out one at a time, since the sizes of jars vary
+// a lot.
+void ParallelFor(int num_threads, size_t n,
+                 const std::function<void(int, size_t)> &fn) {
+  std::atomic<size_t> next{0};
+  auto run = [&](int worker) {
+    size_t i;
+    while ((i = next.fetch_add(1)) < n) {
+      fn(worker, i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int worker = 1; static_cast<size_t>(worker) < n && worker < num_threads;
+       ++worker) {
+    threads.emplace_back(run, worker);
+  }
+  run(0);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+// Calls `fn(class_name, crc32)` for every checked class file of `input_jar`.
+template <typename Fn>
+void ScanClasses(InputJar *input_jar, Fn fn) {
+  const CDH *dir_entry;
+  const LH *local_header;
+  while ((dir_entry = input_jar->NextEntry(&local_header))) {
+    absl::string_view file_name(ABSL_DIE_IF_NULL(local_header)->file_name(),
+                                local_header->file_name_length());
+    if (ConsumeCheckedClass(&file_name)) {
+      fn(file_name, dir_entry->crc32());
+    }
+  }
+  input_jar->Close();
+}
+
+}  // namespace
+
 // Record the jar entry (if it's a class file).
 void OneVersion::Add(absl::string_view file_name_of_entry, const CDH *jar_entry,
                      const Label &label) {
-  if (absl::ConsumeSuffix(&file_name_of_entry, ".class")) {
-    if (
-        // module-info.class is a Java 9 Module specifier, and isn't a
-        // normal class. We expect it to be at the top of the jar or under
-        // META-INF/versions/{numeral} in a multi-release JAR.
-        file_name_of_entry != "module-info" &&
-        !(absl::StartsWith(file_name_of_entry, "META-INF/versions/") &&
-          absl::EndsWith(file_name_of_entry, "/module-info")) &&
-        // R.class and R$....class should be removed from analysis as they
-        // are android resources, and are re-processed during the android
-        // binary build.
-        !absl::EndsWith(file_name_of_entry, "/R") &&
-        !absl::StrContains(file_name_of_entry, "/R$") &&
-        // BR.class should be removed from analysis as it is a special class
-        // generated by Android databinding, and is re-processed during the
-        // android binary build. Once the depot is migrated to Android
-        // databinding v2 (see b/73782031), this will no longer be necessary.
-        !absl::EndsWith(file_name_of_entry, "/BR")) {
-      duplicate_class_collector_.Add(std::string(file_name_of_entry),
-                                     ABSL_DIE_IF_NULL(jar_entry)->crc32(),
-                                     label);
+  if (ConsumeCheckedClass(&file_name_of_entry)) {
+    if (labels_.empty() || labels_.back().name() != label.name() ||
+        labels_.back().jar() != label.jar() ||
+        labels_.back().allowlisted() != label.allowlisted()) {
+      labels_.push_back(label);
     }
+    collector_.Add(0, file_name_of_entry, ABSL_DIE_IF_NULL(jar_entry)->crc32(),
+                   labels_.size() - 1);
   }
 }
 
 std::vector<one_version::Violation> OneVersion::Report() {
-  return whitelist_file_->Apply(duplicate_class_collector_.Violations());
+  return whitelist_file_->Apply(collector_.Violations(labels_));
+}
+
+bool ParallelOneVersion::Check(const std::vector<Input> &inputs,
+                               std::string *error) {
+  int num_threads = std::max(
+      1, std::min(num_threads_, static_cast<int>(inputs.size())));
+  labels_.clear();
+  for (const Input &input : inputs) {
+    labels_.push_back(Label(input.label, input.jar, /*allowlisted=*/false));
+  }
+  collector_ = std::make_unique<ShardedDuplicateClassCollector>(num_threads);
+
+  // The index of the first jar that failed to open, so that the error doesn't
+  // depend on scheduling.
+  std::atomic<size_t> failed_input{inputs.size()};
+  auto open = [&](size_t i, InputJar *input_jar) {
+    if (input_jar->Open(inputs[i].jar)) {
+      return true;
+    }
+    size_t failed = failed_input.load();
+    while (i < failed && !failed_input.compare_exchange_weak(failed, i)) {
+    }
+    return false;
+  };
+
+  bool use_cache = !summary_cache_.empty();
+  std::vector<std::vector<ClassSummary>> summaries(use_cache ? inputs.size()
+                                                             : 0);
+  std::vector<char> cached(inputs.size());
+  ParallelFor(num_threads, inputs.size(), [&](int worker, size_t i) {
+    InputJar input_jar;
+    if (!open(i, &input_jar)) {
+      return;
+    }
+    std::string summary_path;
+    if (use_cache) {
+      summary_path = JarSummaryPath(summary_cache_, input_jar);
+      if (ReadJarSummary(summary_path, &summaries[i])) {
+        cached[i] = true;
+        return;
+      }
+    }
+    ScanClasses(&input_jar, [&](absl::string_view class_name, uint32_t crc32) {
+      collector_->Add(worker, class_name, crc32, i);
+      if (use_cache) {
+        summaries[i].push_back(ClassSummary{HashClassName(class_name), crc32});
+      }
+    });
+    if (use_cache) {
+      // The cache is only an optimization, so failing to update it is fine.
+      WriteJarSummary(summary_path, &summaries[i]);
+    }
+  });
+
+  if (use_cache && failed_input.load() == inputs.size()) {
+    // The summaries of the cached jars only hold hashes of the class names.
+    // Rescan the cached jars that define a class that may be a violation to
+    // recover the names. The jars that were scanned above already added all
+    // of their classes to the collector.
+    std::vector<uint64_t> conflicts =
+        FindConflictingClasses(summaries, num_threads);
+    absl::flat_hash_set<uint64_t> conflict_set(conflicts.begin(),
+                                               conflicts.end());
+    std::vector<size_t> rescan;
+    for (size_t i = 0; i < inputs.size() && !conflict_set.empty(); ++i) {
+      if (cached[i] &&
+          std::any_of(summaries[i].begin(), summaries[i].end(),
+                      [&](const ClassSummary &c) {
+                        return conflict_set.contains(c.name_hash);
+                      })) {
+        rescan.push_back(i);
+      }
+    }
+    ParallelFor(num_threads, rescan.size(), [&](int worker, size_t k) {
+      size_t i = rescan[k];
+      InputJar input_jar;
+      if (!open(i, &input_jar)) {
+        return;
+      }
+      ScanClasses(&input_jar,
+                  [&](absl::string_view class_name, uint32_t crc32) {
+                    if (conflict_set.contains(HashClassName(class_name))) {
+                      collector_->Add(worker, class_name, crc32, i);
+                    }
+                  });
+    });
+  }
+
+  if (failed_input.load() < inputs.size()) {
+    *error = absl::StrCat("unable to open: ", inputs[failed_input.load()].jar);
+    return false;
+  }
+  return true;
+}
+
+std::vector<one_version::Violation> ParallelOneVersion::Report() {
+  return allowlist_->Apply(ABSL_DIE_IF_NULL(collector_)->Violations(labels_));
 }
 
 }  // namespace one_version
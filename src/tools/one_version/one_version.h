@@ -34,14 +34,52 @@ class OneVersion {
   explicit OneVersion(std::unique_ptr<one_version::Allowlist> whitelist)
       : whitelist_file_(std::move(whitelist)) {}
 
-  // Record the jar entry (if it's a class file).
+  // Record the jar entry (if it's a class file). The entries of a jar are
+  // expected to be added one after another, so that the label is only
+  // recorded once per jar.
   void Add(absl::string_view file_name_of_entry, const CDH* jar_entry,
            const Label& label);
   std::vector<one_version::Violation> Report();
 
  private:
   std::unique_ptr<one_version::Allowlist> whitelist_file_;
-  one_version::DuplicateClassCollector duplicate_class_collector_;
+  std::vector<one_version::Label> labels_;
+  one_version::ShardedDuplicateClassCollector collector_{1};
+};
+
+// Checks a whole classpath for one version violations, scanning its jars on
+// several threads.
+class ParallelOneVersion {
+ public:
+  // A jar on the classpath and the label of the target that produced it.
+  struct Input {
+    std::string jar;
+    std::string label;
+  };
+
+  // If `summary_cache` is not empty, it is a directory that keeps a summary
+  // of the class files of every jar across runs, so that only the jars that
+  // changed since the last run have to be scanned in full.
+  ParallelOneVersion(std::unique_ptr<one_version::Allowlist> allowlist,
+                     int num_threads, std::string summary_cache = "")
+      : allowlist_(std::move(allowlist)),
+        num_threads_(num_threads),
+        summary_cache_(std::move(summary_cache)) {}
+
+  // Scans the class files of all `inputs`. Returns false and sets `error` if
+  // a jar can't be opened.
+  bool Check(const std::vector<Input>& inputs, std::string* error);
+
+  // Returns the violations found by Check(), in the same order as
+  // OneVersion::Report() would for the same jars.
+  std::vector<one_version::Violation> Report();
+
+ private:
+  std::unique_ptr<one_version::Allowlist> allowlist_;
+  int num_threads_;
+  std::string summary_cache_;
+  std::vector<one_version::Label> labels_;
+  std::unique_ptr<one_version::ShardedDuplicateClassCollector> collector_;
 };
 
 }  // namespace one_version
@@ -12,33 +12,36 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <ostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
-#include "absl/log/die_if_null.h"
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "src/tools/one_version/allowlist.h"
 #include "src/tools/one_version/duplicate_class_collector.h"
 #include "src/tools/one_version/one_version.h"
-#include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/token_stream.h"
-#include "src/tools/singlejar/zip_headers.h"
 
 // Scans a classpath and reports one version violations.
 //
 // usage: --output <file to touch>
 //        --inputs <jar1,label1 jar2,label2 ... jarN,labelN>
+//        [--threads <number of jars to scan concurrently>]
+//        [--summary_cache <directory keeping per-jar summaries across runs>]
 int main(int argc, char *argv[]) {
   std::string output_file;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
   bool succeed_on_found_violations = false;
   std::string allowlist_file;
+  std::string summary_cache;
   std::vector<std::string> inputs;
   ArgTokenStream tokens(argc - 1, argv + 1);
   while (!tokens.AtEnd()) {
@@ -46,7 +49,9 @@ int main(int argc, char *argv[]) {
         tokens.MatchAndSet("--succeed_on_found_violations",
                            &succeed_on_found_violations) ||
         tokens.MatchAndSet("--allowlist", &allowlist_file) ||
-        tokens.MatchAndSet("--inputs", &inputs)) {
+        tokens.MatchAndSet("--inputs", &inputs) ||
+        tokens.MatchAndSet("--threads", &threads) ||
+        tokens.MatchAndSet("--summary_cache", &summary_cache)) {
     } else {
       std::cerr << "error: bad command line argument " << tokens.token()
                 << std::endl;
@@ -59,28 +64,15 @@ int main(int argc, char *argv[]) {
     allowlist = std::make_unique<one_version::MapAllowlist>(
         absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>>());
   } else {
-    std::ifstream in(allowlist_file);
-    if (!in) {
-      std::cerr << "error: unable to open allowlist file: " << allowlist_file
-                << std::endl;
+    std::string error;
+    allowlist = one_version::MapAllowlist::FromFile(allowlist_file, &error);
+    if (!allowlist) {
+      std::cerr << "error: " << error << std::endl;
       return 1;
     }
-    absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> map;
-    std::string line;
-    while (std::getline(in, line)) {
-      std::vector<std::string> parts =
-          absl::StrSplit(line, absl::MaxSplits(' ', 1));
-      if (parts.size() != 2) {
-        std::cerr << "error: expected <package> <label>, got: " << line
-                  << std::endl;
-        return 1;
-      }
-      map[parts[0]].insert(parts[1]);
-    }
-    allowlist = std::make_unique<one_version::MapAllowlist>(std::move(map));
   }
-  one_version::OneVersion one_version(std::move(allowlist));
 
+  std::vector<one_version::ParallelOneVersion::Input> jars;
   for (const std::string &input : inputs) {
     std::vector<std::string> pieces = absl::StrSplit(input, ',');
     if (pieces.size() != 2) {
@@ -88,22 +80,15 @@ int main(int argc, char *argv[]) {
                 << std::endl;
       return 1;
     }
-    std::string jar = pieces[0];
-    std::string label = pieces[1];
-    InputJar input_jar;
-    if (!input_jar.Open(jar)) {
-      std::cerr << "error: unable to open: " << jar << std::endl;
-      return 1;
-    }
-    const CDH *dir_entry;
-    const LH *local_header;
-    while ((dir_entry = input_jar.NextEntry(&local_header))) {
-      absl::string_view file_name(ABSL_DIE_IF_NULL(local_header)->file_name(),
-                                  local_header->file_name_length());
-      one_version.Add(file_name, dir_entry,
-                      one_version::Label(label, jar, /*allowlisted=*/false));
-    }
-    input_jar.Close();
+    jars.push_back({pieces[0], pieces[1]});
+  }
+
+  one_version::ParallelOneVersion one_version(std::move(allowlist), threads,
+                                              summary_cache);
+  std::string error;
+  if (!one_version.Check(jars, &error)) {
+    std::cerr << "error: " << error << std::endl;
+    return 1;
   }
 
   std::vector<one_version::Violation> violations = one_version.Report();
@@ -0,0 +1,52 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/one_version/one_version_output_jar.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/singlejar/zip_headers.h"
+
+namespace one_version {
+
+void OneVersionOutputJar::ExtraHandler(const std::string& input_jar_path,
+                                       const CDH* entry,
+                                       const std::string* input_jar_aux_label) {
+  if (&input_jar_path != label_jar_) {
+    label_jar_ = &input_jar_path;
+    label_ = Label(input_jar_aux_label ? *input_jar_aux_label : "",
+                   input_jar_path);
+  }
+  // The name comes from the Central Directory, which singlejar has already
+  // read, rather than from the local header.
+  one_version_.Add(
+      absl::string_view(entry->file_name(), entry->file_name_length()), entry,
+      label_);
+}
+
+bool OneVersionOutputJar::ReportViolations(std::ostream* out) {
+  std::vector<Violation> violations = one_version_.Report();
+  if (violations.empty()) {
+    return true;
+  }
+  *out << "Found one definition violations on the runtime classpath:\n"
+       << DuplicateClassCollector::Report(violations);
+  return false;
+}
+
+}  // namespace one_version
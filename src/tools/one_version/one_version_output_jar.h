@@ -0,0 +1,55 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ONE_VERSION_OUTPUT_JAR_H_
+#define THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ONE_VERSION_OUTPUT_JAR_H_
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "src/tools/one_version/allowlist.h"
+#include "src/tools/one_version/duplicate_class_collector.h"
+#include "src/tools/one_version/one_version.h"
+#include "src/tools/singlejar/output_jar.h"
+#include "src/tools/singlejar/zip_headers.h"
+
+namespace one_version {
+
+// An output jar that checks its input jars for one version violations as it
+// adds them, so that linking a deploy jar and checking it read the Central
+// Directories of the inputs only once.
+class OneVersionOutputJar : public OutputJar {
+ public:
+  explicit OneVersionOutputJar(std::unique_ptr<Allowlist> allowlist)
+      : one_version_(std::move(allowlist)) {}
+
+  void ExtraHandler(const std::string& input_jar_path, const CDH* entry,
+                    const std::string* input_jar_aux_label) override;
+
+  // Writes the violations found among the jars added by Doit() to `out`.
+  // Returns false if there are any.
+  bool ReportViolations(std::ostream* out);
+
+ private:
+  OneVersion one_version_;
+  // The label of the jar whose entries are being added. Rebuilt only when
+  // the jar changes, since ExtraHandler() is called for every entry.
+  const std::string* label_jar_ = nullptr;
+  Label label_{"", ""};
+};
+
+}  // namespace one_version
+
+#endif  // THIRD_PARTY_BAZEL_SRC_TOOLS_ONE_VERSION_ONE_VERSION_OUTPUT_JAR_H_
@@ -14,65 +14,521 @@
 
 #include "src/tools/remote/src/main/cpp/testonly_output_service/bazel_output_service_impl.h"
 
+#include <errno.h>
+#include <ftw.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <utility>
 
+#include "src/main/protobuf/bazel_output_service_rev2.pb.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_file_system.h"
 #include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/output_tree.h"
 #include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/worker_pool.h"
 #include "grpcpp/security/server_credentials.h"
 #include "grpcpp/server_builder.h"
 #include "grpcpp/server_context.h"
+#include "grpcpp/support/server_callback.h"
 #include "grpcpp/support/status.h"
 
+static Str8 Str8FromString(const std::string& str) {
+  Str8 result = {(uint8_t*)str.data(), str.size()};
+  return result;
+}
+
+static grpc::Status ErrorStatus(grpc::StatusCode code, Str8 message) {
+  return grpc::Status(code, std::string((char*)message.ptr, message.len));
+}
+
+// Creates the directory `path` and all its missing parents.
+static bool CreateDirectories(Arena* arena, Str8 path) {
+  TemporaryMemory scratch = BeginScratch(arena);
+  Str8 copy = PushStr8(scratch.arena, path);
+  bool result = true;
+  for (size_t i = 1; result && i <= copy.len; ++i) {
+    if (i == copy.len || copy.ptr[i] == '/') {
+      uint8_t ch = copy.ptr[i];
+      copy.ptr[i] = 0;
+      if (mkdir((char*)copy.ptr, 0755) != 0 && errno != EEXIST) {
+        result = false;
+      }
+      copy.ptr[i] = ch;
+    }
+  }
+  EndScratch(scratch);
+  return result;
+}
+
+// Returns whether `path` names an entry below the root of the output tree.
+static bool IsPathWithinOutputTree(Str8 path) {
+  int64_t depth = 0;
+  size_t begin = 0;
+  while (depth >= 0 && begin < path.len) {
+    size_t end = begin;
+    while (end < path.len && path.ptr[end] != '/') {
+      ++end;
+    }
+    Str8 name = {path.ptr + begin, end - begin};
+    begin = end + 1;
+    if (name.len == 2 && name.ptr[0] == '.' && name.ptr[1] == '.') {
+      --depth;
+    } else if (name.len > 0 && !(name.len == 1 && name.ptr[0] == '.')) {
+      ++depth;
+    }
+  }
+  return depth > 0;
+}
+
+static int RemoveTreeEntry(const char* path, const struct stat* st, int type,
+                           struct FTW* ftw) {
+  return remove(path);
+}
+
+static bool RemoveTree(Str8 path) {
+  bool result =
+      nftw((char*)path.ptr, RemoveTreeEntry, 64, FTW_DEPTH | FTW_PHYS) == 0 ||
+      errno == ENOENT;
+  return result;
+}
+
+// Records `locator` for the file at `path`. The locator is kept in its
+// serialized form and only parsed again when the file is stat-ed.
+static bool PutArtifact(OutputTree* tree, const std::string& path,
+                        const google::protobuf::Any& locator) {
+  TemporaryMemory scratch = BeginScratch(0);
+  size_t size = locator.ByteSizeLong();
+  Str8 serialized = {PushArray(scratch.arena, uint8_t, size + 1), size};
+  locator.SerializeWithCachedSizesToArray(serialized.ptr);
+  bool result = PutOutputFile(tree, Str8FromString(path), serialized);
+  EndScratch(scratch);
+  return result;
+}
+
+// Fills `stat` with the status of a file that was created in the output tree
+// by Bazel itself rather than staged through this service. Returns false if
+// the path doesn't exist or is a special file.
+static bool StatLocalFile(Str8 output_path, const std::string& path,
+                          bazel_output_service::BatchStatResponse::Stat* stat) {
+  TemporaryMemory scratch = BeginScratch(0);
+  Str8 full_path =
+      PushStr8F(scratch.arena, "%s/%s", output_path.ptr, path.c_str());
+  struct stat st;
+  bool result = false;
+  if (lstat((char*)full_path.ptr, &st) == 0) {
+    if (S_ISREG(st.st_mode)) {
+      stat->mutable_file();
+      result = true;
+    } else if (S_ISDIR(st.st_mode)) {
+      stat->mutable_directory();
+      result = true;
+    } else if (S_ISLNK(st.st_mode)) {
+      size_t cap = st.st_size + 1;
+      char* target = PushArray(scratch.arena, char, cap);
+      ssize_t len = readlink((char*)full_path.ptr, target, cap);
+      if (len >= 0 && (size_t)len < cap) {
+        stat->mutable_symlink()->set_target(target, len);
+        result = true;
+      }
+    }
+  }
+  EndScratch(scratch);
+  return result;
+}
+
+BazelOutputServiceImpl::BazelOutputServiceImpl()
+    : arena_(AllocArena()),
+      first_output_base_(0),
+      cas_(),
+      cache_arena_(0),
+      cache_(0),
+      fs_(0),
+      fuse_mount_(),
+      workers_(StartWorkerPool(arena_, 0)) {}
+
+BazelOutputServiceImpl::~BazelOutputServiceImpl() {
+  StopWorkerPool(workers_);
+  OutputBase* base = first_output_base_;
+  while (base) {
+    OutputBase* next = base->next;
+    FreeOutputTree(&base->tree);
+    base->~OutputBase();
+    base = next;
+  }
+  if (fs_) {
+    UnmountCasFileSystem(fs_);
+  }
+  if (cache_) {
+    cache_->~CasChunkCache();
+    FreeArena(cache_arena_);
+  }
+  FreeArena(arena_);
+}
+
+Str8 BazelOutputServiceImpl::EnableMaterialization(Str8 cas, Str8 fuse_mount,
+                                                   size_t chunk_cache_size) {
+  Str8 error = {};
+  cas_.root = PushStr8(arena_, cas);
+  if (!IsEmptyStr8(fuse_mount)) {
+    cache_arena_ = AllocArena(chunk_cache_size + MiB(16));
+    cache_ = new (PushArray(cache_arena_, CasChunkCache, 1)) CasChunkCache();
+    InitCasChunkCache(cache_, cache_arena_, &cas_, chunk_cache_size);
+    fuse_mount_ = PushStr8(arena_, fuse_mount);
+    fs_ = MountCasFileSystem(arena_, fuse_mount_, cache_, &error);
+  }
+  return error;
+}
+
+// Makes a staged artifact readable at its path in the output tree on disk,
+// either by copying the blob or by pointing a symlink into the CAS file
+// system, which fetches the blob when it is first read.
+grpc::Status BazelOutputServiceImpl::MaterializeArtifact(
+    OutputBase* base,
+    const bazel_output_service::StageArtifactsRequest::Artifact& artifact) {
+  bazel_output_service_rev2::FileArtifactLocator locator;
+  if (!artifact.locator().UnpackTo(&locator)) {
+    return grpc::Status(
+        grpc::StatusCode::INVALID_ARGUMENT,
+        "Unsupported locator: " + artifact.locator().type_url());
+  }
+  CasDigest digest = {Str8FromString(locator.digest().hash()),
+                      locator.digest().size_bytes()};
+  if (!IsValidCasHash(digest.hash) || digest.size < 0) {
+    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                        "Invalid digest: " + locator.digest().hash());
+  }
+  if (!CasContains(&cas_, digest)) {
+    return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                        "Blob not found: " + locator.digest().hash());
+  }
+
+  TemporaryMemory scratch = BeginScratch(0);
+  Str8 path = PushStr8F(scratch.arena, "%s/%s", base->output_path.ptr,
+                        artifact.path().c_str());
+  size_t slash = path.len;
+  while (path.ptr[slash - 1] != '/') {
+    --slash;
+  }
+  Str8 parent = PushSubStr8(scratch.arena, path, 0, slash - 1);
+  bool ok = CreateDirectories(scratch.arena, parent) && RemoveTree(path);
+  if (ok) {
+    if (fs_) {
+      Str8 target =
+          PushStr8F(scratch.arena, "%s/%s-%lld", fuse_mount_.ptr,
+                    digest.hash.ptr, (long long)digest.size);
+      ok = symlink((char*)target.ptr, (char*)path.ptr) == 0;
+    } else {
+      ok = CopyCasBlob(&cas_, digest, path);
+    }
+  }
+  grpc::Status status = grpc::Status::OK;
+  if (!ok) {
+    status = ErrorStatus(
+        grpc::StatusCode::INTERNAL,
+        PushStr8F(scratch.arena, "Failed to materialize %s: %s", path.ptr,
+                  strerror(errno)));
+  }
+  EndScratch(scratch);
+  return status;
+}
+
+OutputBase* BazelOutputServiceImpl::FindOutputBase(Str8 output_base_id) {
+  OutputBase* result = first_output_base_;
+  while (result && !EqualsStr8(result->output_base_id, output_base_id)) {
+    result = result->next;
+  }
+  return result;
+}
+
+OutputBase* BazelOutputServiceImpl::FindBuild(Str8 build_id) {
+  OutputBase* result = 0;
+  if (!IsEmptyStr8(build_id)) {
+    result = first_output_base_;
+    while (result && !EqualsStr8(result->build_id, build_id)) {
+      result = result->next;
+    }
+  }
+  return result;
+}
+
 grpc::Status BazelOutputServiceImpl::Clean(
     grpc::ServerContext* context,
     const bazel_output_service::CleanRequest* request,
     bazel_output_service::CleanResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  OutputBase* base = FindOutputBase(Str8FromString(request->output_base_id()));
+  if (base) {
+    ResetOutputTree(&base->tree);
+    if (!RemoveTree(base->output_path)) {
+      TemporaryMemory scratch = BeginScratch(0);
+      grpc::Status status =
+          ErrorStatus(grpc::StatusCode::INTERNAL,
+                      PushStr8F(scratch.arena, "Failed to remove %s: %s",
+                                base->output_path.ptr, strerror(errno)));
+      EndScratch(scratch);
+      return status;
+    }
+  }
+  return grpc::Status::OK;
 }
 
 grpc::Status BazelOutputServiceImpl::StartBuild(
     grpc::ServerContext* context,
     const bazel_output_service::StartBuildRequest* request,
     bazel_output_service::StartBuildResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+  TemporaryMemory scratch = BeginScratch(arena_);
+  Str8 output_base_id = Str8FromString(request->output_base_id());
+  Str8 output_path_prefix = Str8FromString(request->output_path_prefix());
+  Str8 error = {};
+  if (request->version() != 1) {
+    error = PushStr8F(scratch.arena, "Unsupported version: %d",
+                      request->version());
+  } else if (IsEmptyStr8(output_base_id) || output_base_id.ptr[0] == '.' ||
+             memchr(output_base_id.ptr, '/', output_base_id.len)) {
+    error = PushStr8F(scratch.arena, "Invalid output_base_id: '%s'",
+                      output_base_id.ptr);
+  } else if (request->build_id().empty()) {
+    error = Str8FromCStr("build_id must be set");
+  } else if (IsEmptyStr8(output_path_prefix)) {
+    error = Str8FromCStr("output_path_prefix must be set");
+  }
+  if (!IsEmptyStr8(error)) {
+    grpc::Status status =
+        ErrorStatus(grpc::StatusCode::INVALID_ARGUMENT, error);
+    EndScratch(scratch);
+    return status;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  OutputBase* base = FindOutputBase(output_base_id);
+  if (!base) {
+    base = new (PushArray(arena_, OutputBase, 1)) OutputBase();
+    base->output_base_id = PushStr8(arena_, output_base_id);
+    InitOutputTree(&base->tree);
+    base->next = first_output_base_;
+    first_output_base_ = base;
+  }
+
+  Str8 output_path = PushStr8F(scratch.arena, "%s/%s", output_path_prefix.ptr,
+                               output_base_id.ptr);
+  if (!EqualsStr8(base->output_path, output_path)) {
+    base->output_path = PushStr8(arena_, output_path);
+  }
+  if (!CreateDirectories(arena_, base->output_path)) {
+    grpc::Status status =
+        ErrorStatus(grpc::StatusCode::INTERNAL,
+                    PushStr8F(scratch.arena, "Failed to create %s: %s",
+                              base->output_path.ptr, strerror(errno)));
+    EndScratch(scratch);
+    return status;
+  }
+
+  // Starting a build implicitly finalizes the previous one. Modifications
+  // are not tracked, so initial_output_path_contents is left unset.
+  base->build_id = PushStr8(arena_, Str8FromString(request->build_id()));
+  response->set_output_path_suffix((char*)output_base_id.ptr,
+                                   output_base_id.len);
+  EndScratch(scratch);
+  return grpc::Status::OK;
+}
+
+static grpc::Status UnknownBuild(const std::string& build_id) {
+  return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                      "Unknown build: " + build_id);
 }
 
 grpc::Status BazelOutputServiceImpl::StageArtifacts(
     grpc::ServerContext* context,
     const bazel_output_service::StageArtifactsRequest* request,
     bazel_output_service::StageArtifactsResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  OutputBase* base = FindBuild(Str8FromString(request->build_id()));
+  if (!base) {
+    return UnknownBuild(request->build_id());
+  }
+
+  // Without a CAS, artifacts are only recorded as placeholders, which keeps
+  // staging independent of the size of the blobs.
+  bool materialize = !IsEmptyStr8(cas_.root);
+  for (const auto& artifact : request->artifacts()) {
+    auto* status = response->add_responses()->mutable_status();
+    grpc::Status result = grpc::Status::OK;
+    if (!IsPathWithinOutputTree(Str8FromString(artifact.path()))) {
+      result = grpc::Status(
+          grpc::StatusCode::INVALID_ARGUMENT,
+          "Path is outside of the output tree: " + artifact.path());
+    } else if (materialize) {
+      result = MaterializeArtifact(base, artifact);
+    }
+    if (result.ok()) {
+      PutArtifact(&base->tree, artifact.path(), artifact.locator());
+    } else {
+      status->set_code(result.error_code());
+      status->set_message(result.error_message());
+    }
+  }
+  return grpc::Status::OK;
 }
 
-grpc::Status BazelOutputServiceImpl::FinalizeArtifacts(
-    grpc::ServerContext* context,
+// The artifacts of a FinalizeArtifactsRequest are processed in chunks of this
+// many by the tasks of a job.
+constexpr int kFinalizeChunkSize = 256;
+
+// A FinalizeArtifacts call in progress. Its tasks run on the worker pool and
+// claim chunks of artifacts until none are left; the last task to finish
+// acknowledges the call.
+struct FinalizeArtifactsJob {
+  const bazel_output_service::FinalizeArtifactsRequest* request;
+  grpc::ServerUnaryReactor* reactor;
+  std::atomic<int> next_chunk;
+  std::atomic<int> running_tasks;
+  // The first error, if any.
+  std::mutex mutex;
+  grpc::Status status;
+};
+
+static void SetJobError(FinalizeArtifactsJob* job, grpc::Status status) {
+  std::lock_guard<std::mutex> lock(job->mutex);
+  if (job->status.ok()) {
+    job->status = std::move(status);
+  }
+}
+
+void BazelOutputServiceImpl::RunFinalizeArtifactsTask(
+    FinalizeArtifactsJob* job) {
+  const auto& artifacts = job->request->artifacts();
+  {
+    // Each task takes the lock by itself, as a shared lock can't be handed
+    // over between threads. Builds may have switched in the meantime.
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    OutputBase* base = FindBuild(Str8FromString(job->request->build_id()));
+    if (!base) {
+      SetJobError(job, UnknownBuild(job->request->build_id()));
+    }
+    while (base) {
+      int begin = job->next_chunk.fetch_add(1) * kFinalizeChunkSize;
+      if (begin >= artifacts.size()) {
+        break;
+      }
+      int end = std::min(begin + kFinalizeChunkSize, artifacts.size());
+      // Remember the digests of outputs created by Bazel so that BatchStat
+      // can report them without hashing the files.
+      for (int i = begin; i < end; ++i) {
+        const auto& artifact = artifacts[i];
+        if (!PutArtifact(&base->tree, artifact.path(), artifact.locator())) {
+          SetJobError(job, grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                                        "Path is outside of the output tree: " +
+                                            artifact.path()));
+        }
+      }
+    }
+  }
+  if (job->running_tasks.fetch_sub(1) == 1) {
+    job->reactor->Finish(job->status);
+    delete job;
+  }
+}
+
+grpc::ServerUnaryReactor* BazelOutputServiceImpl::FinalizeArtifacts(
+    grpc::CallbackServerContext* context,
     const bazel_output_service::FinalizeArtifactsRequest* request,
     bazel_output_service::FinalizeArtifactsResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+  FinalizeArtifactsJob* job = new FinalizeArtifactsJob();
+  job->request = request;
+  job->reactor = context->DefaultReactor();
+  int chunks = (request->artifacts_size() + kFinalizeChunkSize - 1) /
+               kFinalizeChunkSize;
+  int tasks = std::max(1, std::min(chunks, GetWorkerCount(workers_)));
+  job->next_chunk = 0;
+  job->running_tasks = tasks;
+  grpc::ServerUnaryReactor* reactor = job->reactor;
+  for (int i = 0; i < tasks; ++i) {
+    SubmitWork(workers_, [this, job] { RunFinalizeArtifactsTask(job); });
+  }
+  return reactor;
 }
 
-grpc::Status BazelOutputServiceImpl::FinalizeBuild(
-    grpc::ServerContext* context,
+grpc::ServerUnaryReactor* BazelOutputServiceImpl::FinalizeBuild(
+    grpc::CallbackServerContext* context,
     const bazel_output_service::FinalizeBuildRequest* request,
     bazel_output_service::FinalizeBuildResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+  grpc::ServerUnaryReactor* reactor = context->DefaultReactor();
+  // Queued behind the FinalizeArtifacts tasks submitted before, and waits for
+  // those that still run to release the lock.
+  SubmitWork(workers_, [this, request, reactor] {
+    grpc::Status status = grpc::Status::OK;
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      OutputBase* base = FindBuild(Str8FromString(request->build_id()));
+      if (base) {
+        base->build_id = {};
+      } else {
+        status = UnknownBuild(request->build_id());
+      }
+    }
+    reactor->Finish(status);
+  });
+  return reactor;
 }
 
 grpc::Status BazelOutputServiceImpl::BatchStat(
     grpc::ServerContext* context,
     const bazel_output_service::BatchStatRequest* request,
     bazel_output_service::BatchStatResponse* response) {
-  return grpc::Status(grpc::StatusCode::UNIMPLEMENTED, "");
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  OutputBase* base = FindBuild(Str8FromString(request->build_id()));
+  if (!base) {
+    return UnknownBuild(request->build_id());
+  }
+
+  response->mutable_responses()->Reserve(request->paths_size());
+  for (const std::string& path : request->paths()) {
+    auto* stat_response = response->add_responses();
+    const OutputValue* value =
+        LookupOutputValue(&base->tree, Str8FromString(path));
+    if (value) {
+      auto* stat = stat_response->mutable_stat();
+      if (value->kind == kOutputNodeDirectory) {
+        stat->mutable_directory();
+      } else if (IsEmptyStr8(value->locator)) {
+        stat->mutable_file();
+      } else {
+        stat->mutable_file()->mutable_locator()->ParseFromArray(
+            value->locator.ptr, value->locator.len);
+      }
+    } else {
+      bazel_output_service::BatchStatResponse::Stat stat;
+      if (StatLocalFile(base->output_path, path, &stat)) {
+        *stat_response->mutable_stat() = std::move(stat);
+      }
+    }
+  }
+  return grpc::Status::OK;
 }
 
 constexpr uint16_t kDefaultPort = 8080;
 
+constexpr size_t kDefaultChunkCacheSizeMiB = 256;
+
 struct ParsedCommandLine {
   Str8 error;
   uint16_t port;
+  Str8 disk_cache;
+  Str8 fuse_mount;
+  size_t chunk_cache_size;
 };
 
 static ParsedCommandLine* ParseCommandLine(Arena* arena, int argc,
@@ -80,7 +536,11 @@ static ParsedCommandLine* ParseCommandLine(Arena* arena, int argc,
   TemporaryMemory scratch = BeginScratch(arena);
   ParsedCommandLine* result = PushArray(arena, ParsedCommandLine, 1);
   result->port = kDefaultPort;
+  result->chunk_cache_size = MiB(kDefaultChunkCacheSizeMiB);
   Str8 port_prefix = Str8FromCStr("--port=");
+  Str8 disk_cache_prefix = Str8FromCStr("--disk_cache=");
+  Str8 fuse_mount_prefix = Str8FromCStr("--fuse_mount=");
+  Str8 chunk_cache_prefix = Str8FromCStr("--chunk_cache_mb=");
   for (int i = 1; i < argc; ++i) {
     Str8 arg = Str8FromCStr(argv[i]);
     if (StartsWithStr8(arg, port_prefix)) {
@@ -92,11 +552,29 @@ static ParsedCommandLine* ParseCommandLine(Arena* arena, int argc,
         result->error = PushStr8F(arena, "Not a valid port: %s", port_str.ptr);
         break;
       }
+    } else if (StartsWithStr8(arg, disk_cache_prefix)) {
+      result->disk_cache = PushSubStr8(arena, arg, disk_cache_prefix.len);
+    } else if (StartsWithStr8(arg, fuse_mount_prefix)) {
+      result->fuse_mount = PushSubStr8(arena, arg, fuse_mount_prefix.len);
+    } else if (StartsWithStr8(arg, chunk_cache_prefix)) {
+      Str8 size_str = PushSubStr8(scratch.arena, arg, chunk_cache_prefix.len);
+      ParsedUInt32 size = ParseUInt32(size_str);
+      if (size.valid && size.value) {
+        result->chunk_cache_size = MiB(size.value);
+      } else {
+        result->error =
+            PushStr8F(arena, "Not a valid chunk cache size: %s", size_str.ptr);
+        break;
+      }
     } else {
       result->error = PushStr8F(arena, "Unknown command line: %s", arg.ptr);
       break;
     }
   }
+  if (IsEmptyStr8(result->error) && !IsEmptyStr8(result->fuse_mount) &&
+      IsEmptyStr8(result->disk_cache)) {
+    result->error = Str8FromCStr("--fuse_mount requires --disk_cache");
+  }
   EndScratch(scratch);
   return result;
 }
@@ -105,11 +583,27 @@ int RunServer(int argc, char** argv) {
   int exit_code = 0;
   TemporaryMemory scratch = BeginScratch(0);
   ParsedCommandLine* command_line = ParseCommandLine(scratch.arena, argc, argv);
+  BazelOutputServiceImpl service;
+  if (IsEmptyStr8(command_line->error) &&
+      !IsEmptyStr8(command_line->disk_cache)) {
+    command_line->error = service.EnableMaterialization(
+        command_line->disk_cache, command_line->fuse_mount,
+        command_line->chunk_cache_size);
+  }
   if (IsEmptyStr8(command_line->error)) {
-    BazelOutputServiceImpl service;
 
     Str8 address = PushStr8F(scratch.arena, "0.0.0.0:%d", command_line->port);
+    // Let the sync server poll a completion queue per core so that concurrent
+    // BatchStat calls are handled in parallel.
+    int num_cqs = std::thread::hardware_concurrency();
+    if (num_cqs < 1) {
+      num_cqs = 1;
+    }
     grpc::ServerBuilder builder;
+    builder.SetSyncServerOption(grpc::ServerBuilder::SyncServerOption::NUM_CQS,
+                                num_cqs);
+    builder.SetSyncServerOption(
+        grpc::ServerBuilder::SyncServerOption::MAX_POLLERS, num_cqs);
     builder.AddListeningPort((char*)address.ptr,
                              grpc::InsecureServerCredentials());
     builder.RegisterService(&service);
@@ -15,12 +15,67 @@
 #ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_OUTPUT_SERVICE_BAZEL_OUTPUT_SERVICE_IMPL_H_
 #define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_OUTPUT_SERVICE_BAZEL_OUTPUT_SERVICE_IMPL_H_
 
+#include <shared_mutex>
+
 #include "src/main/protobuf/bazel_output_service.grpc.pb.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_file_system.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/output_tree.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/worker_pool.h"
 #include "grpcpp/server_context.h"
+#include "grpcpp/support/server_callback.h"
 #include "grpcpp/support/status.h"
 
+// The output tree of a single output base, identified by
+// StartBuildRequest.output_base_id.
+struct OutputBase {
+  OutputBase* next;
+  Str8 output_base_id;
+  // Absolute path of the output tree on the local file system.
+  Str8 output_path;
+  // The build currently using this output base, or empty if none.
+  Str8 build_id;
+  OutputTree tree;
+};
+
+struct FinalizeArtifactsJob;
+
+// A reference implementation of the Bazel output service.
+//
+// Artifacts staged or finalized by Bazel are recorded in an in-memory output
+// tree together with their locators. BatchStat is answered from that tree and
+// falls back to the local file system for outputs created by Bazel itself.
+//
+// By default staged artifacts are not materialized at all. With a CAS
+// configured, they are either copied into the output tree when staged, or
+// turned into symlinks into a CAS file system that fetches the bytes on the
+// first read.
+//
+// FinalizeArtifacts and FinalizeBuild use the callback API: the artifacts of
+// a request are processed in parallel on a worker pool, and the call is
+// acknowledged once they are done, without holding a gRPC thread meanwhile.
 class BazelOutputServiceImpl
-    : public bazel_output_service::BazelOutputService::Service {
+    : public bazel_output_service::BazelOutputService::
+          WithCallbackMethod_FinalizeArtifacts<
+              bazel_output_service::BazelOutputService::
+                  WithCallbackMethod_FinalizeBuild<
+                      bazel_output_service::BazelOutputService::Service>> {
+ public:
+  BazelOutputServiceImpl();
+  ~BazelOutputServiceImpl() override;
+
+  // Materializes staged artifacts from `cas`, a directory with the layout of
+  // Bazel's --disk_cache. If `fuse_mount` is not empty, the CAS file system is
+  // mounted there and artifacts are materialized lazily. Returns an error
+  // message, or an empty string on success.
+  Str8 EnableMaterialization(Str8 cas, Str8 fuse_mount,
+                             size_t chunk_cache_size);
+
+  CasChunkCache* chunk_cache() { return cache_; }
+
+ private:
   grpc::Status Clean(grpc::ServerContext* context,
                      const bazel_output_service::CleanRequest* request,
                      bazel_output_service::CleanResponse* response) override;
@@ -35,13 +90,13 @@ class BazelOutputServiceImpl
       const bazel_output_service::StageArtifactsRequest* request,
       bazel_output_service::StageArtifactsResponse* response) override;
 
-  grpc::Status FinalizeArtifacts(
-      grpc::ServerContext* context,
+  grpc::ServerUnaryReactor* FinalizeArtifacts(
+      grpc::CallbackServerContext* context,
       const bazel_output_service::FinalizeArtifactsRequest* request,
       bazel_output_service::FinalizeArtifactsResponse* response) override;
 
-  grpc::Status FinalizeBuild(
-      grpc::ServerContext* context,
+  grpc::ServerUnaryReactor* FinalizeBuild(
+      grpc::CallbackServerContext* context,
       const bazel_output_service::FinalizeBuildRequest* request,
       bazel_output_service::FinalizeBuildResponse* response) override;
 
@@ -49,6 +104,29 @@ class BazelOutputServiceImpl
       grpc::ServerContext* context,
       const bazel_output_service::BatchStatRequest* request,
       bazel_output_service::BatchStatResponse* response) override;
+
+  OutputBase* FindOutputBase(Str8 output_base_id);
+  OutputBase* FindBuild(Str8 build_id);
+  grpc::Status MaterializeArtifact(
+      OutputBase* base,
+      const bazel_output_service::StageArtifactsRequest::Artifact& artifact);
+  void RunFinalizeArtifactsTask(FinalizeArtifactsJob* job);
+
+  // Guards the list of output bases and their build ids. Requests that only
+  // read or stage into an output tree take it shared, so they run
+  // concurrently; Clean and switching builds take it exclusively, which also
+  // guarantees that no reader still walks an output tree when it is reset.
+  std::shared_mutex mutex_;
+  // Holds the OutputBase records, which live as long as the service.
+  Arena* arena_;
+  OutputBase* first_output_base_;
+
+  Cas cas_;
+  Arena* cache_arena_;
+  CasChunkCache* cache_;
+  CasFileSystem* fs_;
+  Str8 fuse_mount_;
+  WorkerPool* workers_;
 };
 
 int RunServer(int argc, char** argv);
@@ -0,0 +1,285 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+bool IsValidCasHash(Str8 hash) {
+  bool result = hash.len > 0 && hash.len <= kMaxCasHashLength;
+  for (size_t i = 0; result && i < hash.len; ++i) {
+    uint8_t ch = hash.ptr[i];
+    result = (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f');
+  }
+  return result;
+}
+
+bool ParseCasDigest(Str8 str, CasDigest *digest) {
+  size_t dash = str.len;
+  while (dash > 0 && str.ptr[dash - 1] != '-') {
+    --dash;
+  }
+  if (dash == 0 || dash == str.len) {
+    return false;
+  }
+
+  Str8 hash = {str.ptr, dash - 1};
+  int64_t size = 0;
+  for (size_t i = dash; i < str.len; ++i) {
+    uint8_t ch = str.ptr[i];
+    if (ch < '0' || ch > '9' || size > (INT64_MAX - 9) / 10) {
+      return false;
+    }
+    size = size * 10 + ch - '0';
+  }
+  if (!IsValidCasHash(hash)) {
+    return false;
+  }
+
+  digest->hash = hash;
+  digest->size = size;
+  return true;
+}
+
+Str8 PushCasBlobPath(Arena *arena, Cas *cas, Str8 hash) {
+  Str8 result = PushStr8F(arena, "%s/cas/%.2s/%.*s", cas->root.ptr, hash.ptr,
+                          (int)hash.len, hash.ptr);
+  return result;
+}
+
+bool CasContains(Cas *cas, CasDigest digest) {
+  TemporaryMemory scratch = BeginScratch(0);
+  Str8 path = PushCasBlobPath(scratch.arena, cas, digest.hash);
+  struct stat st;
+  bool result = stat((char *)path.ptr, &st) == 0 && S_ISREG(st.st_mode) &&
+                st.st_size == digest.size;
+  EndScratch(scratch);
+  return result;
+}
+
+bool CopyCasBlob(Cas *cas, CasDigest digest, Str8 path) {
+  TemporaryMemory scratch = BeginScratch(0);
+  Str8 blob_path = PushCasBlobPath(scratch.arena, cas, digest.hash);
+  Str8 temp_path = PushStr8F(scratch.arena, "%s.XXXXXX", path.ptr);
+  bool result = false;
+  int in = open((char *)blob_path.ptr, O_RDONLY | O_CLOEXEC);
+  if (in >= 0) {
+    int out = mkstemp((char *)temp_path.ptr);
+    if (out >= 0) {
+      size_t buffer_size = kCasChunkSize;
+      uint8_t *buffer = PushArray(scratch.arena, uint8_t, buffer_size);
+      int64_t copied = 0;
+      ssize_t n;
+      while ((n = read(in, buffer, buffer_size)) > 0) {
+        if (write(out, buffer, n) != n) {
+          break;
+        }
+        copied += n;
+      }
+      result = n == 0 && copied == digest.size && fchmod(out, 0555) == 0;
+      result = close(out) == 0 && result;
+      result = result && rename((char *)temp_path.ptr, (char *)path.ptr) == 0;
+      if (!result) {
+        unlink((char *)temp_path.ptr);
+      }
+    }
+    close(in);
+  }
+  EndScratch(scratch);
+  return result;
+}
+
+static uint64_t HashCasChunk(Str8 hash, uint64_t index) {
+  uint64_t result = HashStr8(hash) ^ (index * 0x9e3779b97f4a7c15);
+  return result;
+}
+
+void InitCasChunkCache(CasChunkCache *cache, Arena *arena, Cas *cas,
+                       size_t capacity) {
+  cache->cas = cas;
+  cache->chunk_count = capacity / kCasChunkSize;
+  if (cache->chunk_count == 0) {
+    cache->chunk_count = 1;
+  }
+  cache->chunks = PushArray(arena, CasChunk, cache->chunk_count);
+  cache->data = PushArray(arena, uint8_t, cache->chunk_count * kCasChunkSize);
+  cache->bucket_count = cache->chunk_count * 2;
+  cache->buckets = PushArray(arena, int32_t, cache->bucket_count);
+  for (size_t i = 0; i < cache->bucket_count; ++i) {
+    cache->buckets[i] = -1;
+  }
+  for (size_t i = 0; i < cache->chunk_count; ++i) {
+    cache->chunks[i].next = -1;
+  }
+}
+
+static int32_t *GetCasChunkBucket(CasChunkCache *cache, Str8 hash,
+                                  uint64_t index) {
+  int32_t *result =
+      &cache->buckets[HashCasChunk(hash, index) % cache->bucket_count];
+  return result;
+}
+
+static Str8 GetCasChunkHash(CasChunk *chunk) {
+  Str8 result = {(uint8_t *)chunk->hash, chunk->hash_len};
+  return result;
+}
+
+static CasChunk *FindCasChunk(CasChunkCache *cache, Str8 hash,
+                              uint64_t index) {
+  int32_t i = *GetCasChunkBucket(cache, hash, index);
+  while (i >= 0) {
+    CasChunk *chunk = &cache->chunks[i];
+    if (chunk->index == index && EqualsStr8(GetCasChunkHash(chunk), hash)) {
+      return chunk;
+    }
+    i = chunk->next;
+  }
+  return 0;
+}
+
+static CasChunk *EvictCasChunk(CasChunkCache *cache) {
+  CasChunk *result = 0;
+  while (!result) {
+    CasChunk *chunk = &cache->chunks[cache->clock_hand];
+    cache->clock_hand = (cache->clock_hand + 1) % cache->chunk_count;
+    if (chunk->valid && chunk->referenced) {
+      chunk->referenced = false;
+    } else {
+      result = chunk;
+    }
+  }
+
+  if (result->valid) {
+    int32_t *link =
+        GetCasChunkBucket(cache, GetCasChunkHash(result), result->index);
+    int32_t self = (int32_t)(result - cache->chunks);
+    while (*link != self) {
+      link = &cache->chunks[*link].next;
+    }
+    *link = result->next;
+    result->next = -1;
+    result->valid = false;
+  }
+  return result;
+}
+
+static bool FetchCasChunk(Cas *cas, Str8 hash, uint64_t offset, size_t len,
+                          uint8_t *buffer) {
+  TemporaryMemory scratch = BeginScratch(0);
+  Str8 path = PushCasBlobPath(scratch.arena, cas, hash);
+  bool result = false;
+  int fd = open((char *)path.ptr, O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    size_t done = 0;
+    while (done < len) {
+      ssize_t n = pread(fd, buffer + done, len - done, offset + done);
+      if (n <= 0) {
+        break;
+      }
+      done += n;
+    }
+    result = done == len;
+    close(fd);
+  }
+  EndScratch(scratch);
+  return result;
+}
+
+int64_t ReadCasBlob(CasChunkCache *cache, CasDigest digest, uint64_t offset,
+                    size_t size, uint8_t *buffer) {
+  if (digest.hash.len > kMaxCasHashLength) {
+    return -1;
+  }
+  if (offset >= (uint64_t)digest.size) {
+    return 0;
+  }
+  if (size > digest.size - offset) {
+    size = digest.size - offset;
+  }
+
+  TemporaryMemory scratch = BeginScratch(0);
+  uint8_t *fetched = 0;
+  size_t done = 0;
+  while (done < size) {
+    uint64_t index = (offset + done) / kCasChunkSize;
+    size_t chunk_offset = (offset + done) % kCasChunkSize;
+    size_t chunk_len = kCasChunkSize;
+    if (digest.size - index * kCasChunkSize < chunk_len) {
+      chunk_len = digest.size - index * kCasChunkSize;
+    }
+    size_t n = chunk_len - chunk_offset;
+    if (n > size - done) {
+      n = size - done;
+    }
+
+    bool hit = false;
+    {
+      std::lock_guard<std::mutex> lock(cache->mutex);
+      CasChunk *chunk = FindCasChunk(cache, digest.hash, index);
+      if (chunk) {
+        uint8_t *data = cache->data + (chunk - cache->chunks) * kCasChunkSize;
+        memcpy(buffer + done, data + chunk_offset, n);
+        chunk->referenced = true;
+        ++cache->hits;
+        hit = true;
+      } else {
+        ++cache->misses;
+      }
+    }
+
+    if (!hit) {
+      // Fetch without holding the lock so that other readers aren't blocked
+      // on the CAS.
+      if (!fetched) {
+        fetched = PushArray(scratch.arena, uint8_t, kCasChunkSize);
+      }
+      if (!FetchCasChunk(cache->cas, digest.hash, index * kCasChunkSize,
+                         chunk_len, fetched)) {
+        EndScratch(scratch);
+        return -1;
+      }
+      memcpy(buffer + done, fetched + chunk_offset, n);
+
+      std::lock_guard<std::mutex> lock(cache->mutex);
+      if (!FindCasChunk(cache, digest.hash, index)) {
+        CasChunk *chunk = EvictCasChunk(cache);
+        memcpy(chunk->hash, digest.hash.ptr, digest.hash.len);
+        chunk->hash_len = digest.hash.len;
+        chunk->index = index;
+        chunk->valid = true;
+        chunk->referenced = true;
+        int32_t *bucket = GetCasChunkBucket(cache, digest.hash, index);
+        chunk->next = *bucket;
+        *bucket = (int32_t)(chunk - cache->chunks);
+        memcpy(cache->data + (chunk - cache->chunks) * kCasChunkSize, fetched,
+               chunk_len);
+      }
+    }
+    done += n;
+  }
+  EndScratch(scratch);
+  return done;
+}
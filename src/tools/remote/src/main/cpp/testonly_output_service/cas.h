@@ -0,0 +1,96 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+// Long enough for the hex encoding of any digest function of REv2.
+constexpr size_t kMaxCasHashLength = 128;
+
+struct CasDigest {
+  Str8 hash;
+  int64_t size;
+};
+
+// Returns whether `hash` is a lowercase hex string that is safe to use as a
+// file name.
+bool IsValidCasHash(Str8 hash);
+
+// Parses a digest in the form "<hash>-<size>", which is also the name of a
+// blob in the CAS file system.
+bool ParseCasDigest(Str8 str, CasDigest *digest);
+
+// A content addressable storage backed by a directory with the layout of
+// Bazel's --disk_cache, i.e. blobs are stored at <root>/cas/<hh>/<hash> where
+// <hh> are the first two characters of the hash.
+struct Cas {
+  Str8 root;
+};
+
+Str8 PushCasBlobPath(Arena *arena, Cas *cas, Str8 hash);
+
+// Returns whether the blob exists and has the expected size.
+bool CasContains(Cas *cas, CasDigest digest);
+
+// Copies the blob to `path`, replacing any file that is already there.
+bool CopyCasBlob(Cas *cas, CasDigest digest, Str8 path);
+
+constexpr size_t kCasChunkSize = 1024 * 1024;
+
+struct CasChunk {
+  char hash[kMaxCasHashLength];
+  uint32_t hash_len;
+  uint64_t index;
+  // Next chunk in the same bucket, or -1.
+  int32_t next;
+  bool valid;
+  bool referenced;
+};
+
+// A fixed size cache of blob chunks, evicted with the CLOCK algorithm.
+//
+// Reads of a blob go through the cache in units of kCasChunkSize, so reading
+// a small part of a large blob only fetches the chunks it touches, and
+// re-reading it doesn't go back to the CAS.
+struct CasChunkCache {
+  std::mutex mutex;
+  Cas *cas;
+  size_t chunk_count;
+  CasChunk *chunks;
+  uint8_t *data;
+  size_t bucket_count;
+  int32_t *buckets;
+  size_t clock_hand;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+// Allocates a cache holding up to `capacity` bytes from `arena`.
+void InitCasChunkCache(CasChunkCache *cache, Arena *arena, Cas *cas,
+                       size_t capacity);
+
+// Reads up to `size` bytes of the blob at `offset` into `buffer`. Returns the
+// number of bytes read, or -1 if the blob can't be read.
+int64_t ReadCasBlob(CasChunkCache *cache, CasDigest digest, uint64_t offset,
+                    size_t size, uint8_t *buffer);
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_H_
@@ -0,0 +1,41 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_FILE_SYSTEM_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_FILE_SYSTEM_H_
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+// A read-only FUSE file system that exposes every blob of a CAS as a file
+// named "<hash>-<size>" in its root directory. The root directory can't be
+// listed; a blob appears once it is looked up by name.
+//
+// Nothing is downloaded up front: the bytes of a blob are read through the
+// chunk cache on the first read() of the file, so the output service can
+// stage artifacts as symlinks into this file system and only pay for the
+// artifacts that are actually read.
+struct CasFileSystem;
+
+// Mounts the file system at `mount_point`, which must be an existing
+// directory, and starts serving requests on background threads. Returns null
+// and sets `error` if the file system can't be mounted, e.g. because FUSE is
+// unavailable or the process lacks the privileges to mount it.
+CasFileSystem *MountCasFileSystem(Arena *arena, Str8 mount_point,
+                                  CasChunkCache *cache, Str8 *error);
+
+void UnmountCasFileSystem(CasFileSystem *fs);
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_CAS_FILE_SYSTEM_H_
@@ -0,0 +1,326 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Speaks the FUSE kernel protocol directly on /dev/fuse rather than going
+// through libfuse. The file system is small enough that the handful of
+// requests it has to answer are simpler to handle here than to adapt to the
+// libfuse callbacks, and it avoids a new third-party dependency.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fuse.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <new>
+#include <thread>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_file_system.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/output_tree.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+constexpr int kCasFileSystemThreadCount = 4;
+// Blobs are immutable, so the kernel may cache names and attributes for as
+// long as it likes.
+constexpr uint64_t kCasFileSystemTimeout = 24 * 60 * 60;
+constexpr size_t kFuseRequestBufferSize = 64 * 1024;
+constexpr uint32_t kFuseMaxWrite = 4096;
+
+struct CasFileSystem {
+  Str8 mount_point;
+  int fd;
+  CasChunkCache *cache;
+  // The blobs that have been looked up, keyed by name. The address of the
+  // value is handed to the kernel as the node id, so no separate inode table
+  // is needed.
+  OutputTree blobs;
+  std::thread threads[kCasFileSystemThreadCount];
+};
+
+static void ReplyFuse(int fd, uint64_t unique, int error, const void *data,
+                      size_t len) {
+  struct fuse_out_header header = {};
+  header.len = sizeof(header) + len;
+  header.error = -error;
+  header.unique = unique;
+  struct iovec iov[2] = {{&header, sizeof(header)}, {(void *)data, len}};
+  // Fails with ENOENT if the request was interrupted in the meantime, which
+  // is fine.
+  writev(fd, iov, len ? 2 : 1);
+}
+
+static void FillRootAttr(struct fuse_attr *attr) {
+  attr->ino = FUSE_ROOT_ID;
+  attr->mode = S_IFDIR | 0555;
+  attr->nlink = 2;
+  attr->uid = getuid();
+  attr->gid = getgid();
+  attr->blksize = 4096;
+}
+
+static void FillBlobAttr(struct fuse_attr *attr, uint64_t nodeid,
+                         CasDigest digest) {
+  attr->ino = nodeid;
+  attr->size = digest.size;
+  attr->blocks = (digest.size + 511) / 512;
+  attr->mode = S_IFREG | 0555;
+  attr->nlink = 1;
+  attr->uid = getuid();
+  attr->gid = getgid();
+  attr->blksize = 4096;
+}
+
+static bool GetBlobDigest(uint64_t nodeid, CasDigest *digest) {
+  bool result = false;
+  if (nodeid != FUSE_ROOT_ID) {
+    const OutputValue *value = (const OutputValue *)(uintptr_t)nodeid;
+    result = ParseCasDigest(value->locator, digest);
+  }
+  return result;
+}
+
+static uint64_t LookupBlob(CasFileSystem *fs, Str8 name) {
+  CasDigest digest;
+  const OutputValue *value = 0;
+  if (ParseCasDigest(name, &digest)) {
+    value = LookupOutputValue(&fs->blobs, name);
+    if (!value && CasContains(fs->cache->cas, digest)) {
+      PutOutputFile(&fs->blobs, name, name);
+      value = LookupOutputValue(&fs->blobs, name);
+    }
+  }
+  return (uint64_t)(uintptr_t)value;
+}
+
+static void HandleFuseInit(CasFileSystem *fs, struct fuse_in_header *header,
+                           struct fuse_init_in *in) {
+  if (in->major != FUSE_KERNEL_VERSION) {
+    ReplyFuse(fs->fd, header->unique, EPROTO, 0, 0);
+    return;
+  }
+
+  struct fuse_init_out out = {};
+  out.major = FUSE_KERNEL_VERSION;
+  out.minor = FUSE_KERNEL_MINOR_VERSION;
+  out.max_readahead = in->max_readahead;
+  out.flags = FUSE_ASYNC_READ;
+  out.max_background = 16;
+  out.congestion_threshold = 12;
+  out.max_write = kFuseMaxWrite;
+  out.time_gran = 1;
+#ifdef FUSE_MAX_PAGES
+  // Let the kernel read a whole chunk per request.
+  if (in->flags & FUSE_MAX_PAGES) {
+    out.flags |= FUSE_MAX_PAGES;
+    out.max_pages = kCasChunkSize / 4096;
+  }
+#endif
+  size_t len = in->minor < 23 ? FUSE_COMPAT_22_INIT_OUT_SIZE : sizeof(out);
+  ReplyFuse(fs->fd, header->unique, 0, &out, len);
+}
+
+// Handles a single request. Returns false once the kernel asks the file
+// system to shut down.
+static bool HandleFuseRequest(CasFileSystem *fs, uint8_t *in, size_t in_len,
+                              uint8_t *out, size_t out_cap) {
+  struct fuse_in_header *header = (struct fuse_in_header *)in;
+  uint8_t *body = in + sizeof(*header);
+  size_t body_len = in_len - sizeof(*header);
+  int fd = fs->fd;
+  uint64_t unique = header->unique;
+  CasDigest digest;
+
+  switch (header->opcode) {
+    case FUSE_INIT:
+      HandleFuseInit(fs, header, (struct fuse_init_in *)body);
+      break;
+
+    case FUSE_DESTROY:
+      ReplyFuse(fd, unique, 0, 0, 0);
+      return false;
+
+    case FUSE_FORGET:
+    case FUSE_BATCH_FORGET:
+    case FUSE_INTERRUPT:
+      // No reply. Node ids stay valid for the lifetime of the file system.
+      break;
+
+    case FUSE_LOOKUP: {
+      Str8 name = {body, strnlen((char *)body, body_len)};
+      uint64_t nodeid = 0;
+      if (header->nodeid == FUSE_ROOT_ID) {
+        nodeid = LookupBlob(fs, name);
+      }
+      if (nodeid && GetBlobDigest(nodeid, &digest)) {
+        struct fuse_entry_out entry = {};
+        entry.nodeid = nodeid;
+        entry.entry_valid = kCasFileSystemTimeout;
+        entry.attr_valid = kCasFileSystemTimeout;
+        FillBlobAttr(&entry.attr, nodeid, digest);
+        ReplyFuse(fd, unique, 0, &entry, sizeof(entry));
+      } else {
+        ReplyFuse(fd, unique, ENOENT, 0, 0);
+      }
+      break;
+    }
+
+    case FUSE_GETATTR: {
+      struct fuse_attr_out attr = {};
+      attr.attr_valid = kCasFileSystemTimeout;
+      if (header->nodeid == FUSE_ROOT_ID) {
+        FillRootAttr(&attr.attr);
+      } else if (GetBlobDigest(header->nodeid, &digest)) {
+        FillBlobAttr(&attr.attr, header->nodeid, digest);
+      } else {
+        ReplyFuse(fd, unique, ENOENT, 0, 0);
+        break;
+      }
+      ReplyFuse(fd, unique, 0, &attr, sizeof(attr));
+      break;
+    }
+
+    case FUSE_OPEN: {
+      struct fuse_open_in *open_in = (struct fuse_open_in *)body;
+      if ((open_in->flags & O_ACCMODE) != O_RDONLY) {
+        ReplyFuse(fd, unique, EROFS, 0, 0);
+      } else {
+        struct fuse_open_out open_out = {};
+        open_out.open_flags = FOPEN_KEEP_CACHE;
+        ReplyFuse(fd, unique, 0, &open_out, sizeof(open_out));
+      }
+      break;
+    }
+
+    case FUSE_READ: {
+      struct fuse_read_in *read_in = (struct fuse_read_in *)body;
+      size_t size = read_in->size < out_cap ? read_in->size : out_cap;
+      int64_t n = -1;
+      if (GetBlobDigest(header->nodeid, &digest)) {
+        n = ReadCasBlob(fs->cache, digest, read_in->offset, size, out);
+      }
+      if (n < 0) {
+        ReplyFuse(fd, unique, EIO, 0, 0);
+      } else {
+        ReplyFuse(fd, unique, 0, out, n);
+      }
+      break;
+    }
+
+    case FUSE_OPENDIR: {
+      struct fuse_open_out open_out = {};
+      ReplyFuse(fd, unique, 0, &open_out, sizeof(open_out));
+      break;
+    }
+
+    case FUSE_READDIR:
+      // The set of blobs is unbounded, so the root directory lists as empty.
+      ReplyFuse(fd, unique, 0, 0, 0);
+      break;
+
+    case FUSE_RELEASE:
+    case FUSE_RELEASEDIR:
+    case FUSE_FLUSH:
+      ReplyFuse(fd, unique, 0, 0, 0);
+      break;
+
+    case FUSE_STATFS: {
+      struct fuse_statfs_out statfs = {};
+      statfs.st.bsize = 4096;
+      statfs.st.frsize = 4096;
+      statfs.st.namelen = 255;
+      ReplyFuse(fd, unique, 0, &statfs, sizeof(statfs));
+      break;
+    }
+
+    default:
+      ReplyFuse(fd, unique, ENOSYS, 0, 0);
+      break;
+  }
+  return true;
+}
+
+static void ServeCasFileSystem(CasFileSystem *fs) {
+  Arena *arena = AllocArena(MiB(4));
+  uint8_t *in = PushArray(arena, uint8_t, kFuseRequestBufferSize);
+  uint8_t *out = PushArray(arena, uint8_t, kCasChunkSize);
+  for (;;) {
+    ssize_t n = read(fs->fd, in, kFuseRequestBufferSize);
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == ENOENT) {
+        continue;
+      }
+      // ENODEV once the file system has been unmounted.
+      break;
+    }
+    if ((size_t)n < sizeof(struct fuse_in_header) ||
+        !HandleFuseRequest(fs, in, n, out, kCasChunkSize)) {
+      break;
+    }
+  }
+  FreeArena(arena);
+}
+
+CasFileSystem *MountCasFileSystem(Arena *arena, Str8 mount_point,
+                                  CasChunkCache *cache, Str8 *error) {
+  int fd = open("/dev/fuse", O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    *error = PushStr8F(arena, "Failed to open /dev/fuse: %s", strerror(errno));
+    return 0;
+  }
+
+  TemporaryMemory scratch = BeginScratch(arena);
+  Str8 options =
+      PushStr8F(scratch.arena, "fd=%d,rootmode=%o,user_id=%d,group_id=%d", fd,
+                S_IFDIR, getuid(), getgid());
+  int result = mount("testonly_output_service", (char *)mount_point.ptr,
+                     "fuse.testonly_output_service",
+                     MS_NOSUID | MS_NODEV | MS_RDONLY, options.ptr);
+  EndScratch(scratch);
+  if (result != 0) {
+    *error = PushStr8F(arena, "Failed to mount %s: %s", mount_point.ptr,
+                       strerror(errno));
+    close(fd);
+    return 0;
+  }
+
+  CasFileSystem *fs =
+      new (PushArray(arena, CasFileSystem, 1)) CasFileSystem();
+  fs->mount_point = PushStr8(arena, mount_point);
+  fs->fd = fd;
+  fs->cache = cache;
+  InitOutputTree(&fs->blobs);
+  for (int i = 0; i < kCasFileSystemThreadCount; ++i) {
+    fs->threads[i] = std::thread(ServeCasFileSystem, fs);
+  }
+  return fs;
+}
+
+void UnmountCasFileSystem(CasFileSystem *fs) {
+  // Detaching aborts the connection, which makes the pending reads fail with
+  // ENODEV and the threads exit.
+  umount2((char *)fs->mount_point.ptr, MNT_DETACH);
+  for (int i = 0; i < kCasFileSystemThreadCount; ++i) {
+    fs->threads[i].join();
+  }
+  close(fs->fd);
+  FreeOutputTree(&fs->blobs);
+  fs->~CasFileSystem();
+}
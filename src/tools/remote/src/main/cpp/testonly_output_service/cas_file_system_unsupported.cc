@@ -0,0 +1,26 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas_file_system.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+CasFileSystem *MountCasFileSystem(Arena *arena, Str8 mount_point,
+                                  CasChunkCache *cache, Str8 *error) {
+  *error = Str8FromCStr("The CAS file system is only supported on Linux");
+  return 0;
+}
+
+void UnmountCasFileSystem(CasFileSystem *fs) {}
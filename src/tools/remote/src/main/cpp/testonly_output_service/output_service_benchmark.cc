@@ -0,0 +1,251 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compares materializing staged artifacts eagerly, i.e. copying every blob
+// into the output tree, with materializing them lazily through the CAS file
+// system, for a build that only reads a fraction of its outputs.
+//
+// Usage:
+//   output_service_benchmark --work_dir=DIR [--fuse_mount=DIR] [--files=N]
+//       [--file_size_kb=N] [--read_percent=N]
+//
+// The lazy mode is only run if --fuse_mount is given, which requires the
+// privileges to mount a FUSE file system.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "src/main/protobuf/bazel_output_service_rev2.pb.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/bazel_output_service_impl.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/cas.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+#include "grpcpp/server_context.h"
+
+struct BenchmarkOptions {
+  Str8 error;
+  Str8 work_dir;
+  Str8 fuse_mount;
+  uint32_t files;
+  uint32_t file_size;
+  uint32_t read_percent;
+};
+
+static BenchmarkOptions ParseBenchmarkOptions(Arena *arena, int argc,
+                                              char **argv) {
+  BenchmarkOptions result = {};
+  result.files = 1000;
+  result.file_size = KiB(1024);
+  result.read_percent = 10;
+  for (int i = 1; i < argc && IsEmptyStr8(result.error); ++i) {
+    Str8 arg = Str8FromCStr(argv[i]);
+    Str8 work_dir_prefix = Str8FromCStr("--work_dir=");
+    Str8 fuse_mount_prefix = Str8FromCStr("--fuse_mount=");
+    Str8 files_prefix = Str8FromCStr("--files=");
+    Str8 file_size_prefix = Str8FromCStr("--file_size_kb=");
+    Str8 read_percent_prefix = Str8FromCStr("--read_percent=");
+    if (StartsWithStr8(arg, work_dir_prefix)) {
+      result.work_dir = PushSubStr8(arena, arg, work_dir_prefix.len);
+    } else if (StartsWithStr8(arg, fuse_mount_prefix)) {
+      result.fuse_mount = PushSubStr8(arena, arg, fuse_mount_prefix.len);
+    } else if (StartsWithStr8(arg, files_prefix)) {
+      result.files =
+          ParseUInt32(PushSubStr8(arena, arg, files_prefix.len)).value;
+    } else if (StartsWithStr8(arg, file_size_prefix)) {
+      result.file_size = KiB(
+          ParseUInt32(PushSubStr8(arena, arg, file_size_prefix.len)).value);
+    } else if (StartsWithStr8(arg, read_percent_prefix)) {
+      result.read_percent =
+          ParseUInt32(PushSubStr8(arena, arg, read_percent_prefix.len)).value;
+    } else {
+      result.error = PushStr8F(arena, "Unknown command line: %s", arg.ptr);
+    }
+  }
+  if (IsEmptyStr8(result.error) && IsEmptyStr8(result.work_dir)) {
+    result.error = Str8FromCStr("--work_dir is required");
+  }
+  return result;
+}
+
+static double NowMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// The benchmark doesn't verify digests, so any distinct hex string will do.
+static Str8 PushBlobHash(Arena *arena, uint32_t index) {
+  Str8 result = PushStr8F(arena, "%064x", index + 1);
+  return result;
+}
+
+static bool CreateCas(Arena *arena, BenchmarkOptions *options,
+                      Str8 disk_cache) {
+  TemporaryMemory scratch = BeginScratch(arena);
+  uint8_t *data = PushArray(scratch.arena, uint8_t, options->file_size);
+  mkdir((char *)disk_cache.ptr, 0755);
+  mkdir((char *)PushStr8F(scratch.arena, "%s/cas", disk_cache.ptr).ptr, 0755);
+  bool result = true;
+  for (uint32_t i = 0; result && i < options->files; ++i) {
+    TemporaryMemory temp = BeginTemporaryMemory(scratch.arena);
+    Str8 hash = PushBlobHash(temp.arena, i);
+    Str8 dir = PushStr8F(temp.arena, "%s/cas/%.2s", disk_cache.ptr, hash.ptr);
+    mkdir((char *)dir.ptr, 0755);
+    Str8 path = PushStr8F(temp.arena, "%s/%s", dir.ptr, hash.ptr);
+    for (uint32_t j = 0; j < options->file_size; ++j) {
+      data[j] = (uint8_t)(i + j);
+    }
+    int fd = open((char *)path.ptr, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    result = fd >= 0 && write(fd, data, options->file_size) ==
+                            (ssize_t)options->file_size;
+    if (fd >= 0) {
+      close(fd);
+    }
+    EndTemporaryMempory(temp);
+  }
+  EndScratch(scratch);
+  return result;
+}
+
+struct BenchmarkResult {
+  bool ok;
+  double stage_ms;
+  double read_ms;
+  uint64_t bytes_read;
+};
+
+static BenchmarkResult RunBenchmark(Arena *arena, BenchmarkOptions *options,
+                                    Str8 disk_cache, Str8 fuse_mount,
+                                    Str8 name) {
+  BenchmarkResult result = {};
+  TemporaryMemory scratch = BeginScratch(arena);
+  BazelOutputServiceImpl impl;
+  bazel_output_service::BazelOutputService::Service *service = &impl;
+  grpc::ServerContext context;
+
+  Str8 error = impl.EnableMaterialization(disk_cache, fuse_mount, MiB(256));
+  if (!IsEmptyStr8(error)) {
+    fprintf(stderr, "%s\n", error.ptr);
+    EndScratch(scratch);
+    return result;
+  }
+
+  bazel_output_service::StartBuildRequest start_request;
+  bazel_output_service::StartBuildResponse start_response;
+  start_request.set_version(1);
+  start_request.set_output_base_id((char *)name.ptr);
+  start_request.set_build_id("benchmark");
+  start_request.set_output_path_prefix(
+      (char *)PushStr8F(scratch.arena, "%s/out", options->work_dir.ptr).ptr);
+  if (!service->StartBuild(&context, &start_request, &start_response).ok()) {
+    EndScratch(scratch);
+    return result;
+  }
+
+  double start = NowMs();
+  bazel_output_service::StageArtifactsRequest stage_request;
+  bazel_output_service::StageArtifactsResponse stage_response;
+  stage_request.set_build_id("benchmark");
+  for (uint32_t i = 0; i < options->files; ++i) {
+    bazel_output_service_rev2::FileArtifactLocator locator;
+    locator.mutable_digest()->set_hash(
+        (char *)PushBlobHash(scratch.arena, i).ptr);
+    locator.mutable_digest()->set_size_bytes(options->file_size);
+    auto *artifact = stage_request.add_artifacts();
+    artifact->set_path(
+        (char *)PushStr8F(scratch.arena, "bin/%u/out%u", i % 100, i).ptr);
+    artifact->mutable_locator()->PackFrom(locator);
+  }
+  result.ok =
+      service->StageArtifacts(&context, &stage_request, &stage_response).ok();
+  for (const auto &response : stage_response.responses()) {
+    result.ok = result.ok && response.status().code() == 0;
+  }
+  result.stage_ms = NowMs() - start;
+
+  start = NowMs();
+  uint8_t *buffer = PushArray(scratch.arena, uint8_t, MiB(1));
+  uint32_t step = options->read_percent ? 100 / options->read_percent : 0;
+  for (uint32_t i = 0; result.ok && step && i < options->files; i += step) {
+    Str8 path = PushStr8F(scratch.arena, "%s/out/%s/bin/%u/out%u",
+                          options->work_dir.ptr, name.ptr, i % 100, i);
+    int fd = open((char *)path.ptr, O_RDONLY);
+    ssize_t n = 0;
+    while (fd >= 0 && (n = read(fd, buffer, MiB(1))) > 0) {
+      result.bytes_read += n;
+    }
+    result.ok = fd >= 0 && n == 0;
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  result.read_ms = NowMs() - start;
+
+  bazel_output_service::CleanRequest clean_request;
+  bazel_output_service::CleanResponse clean_response;
+  clean_request.set_output_base_id((char *)name.ptr);
+  service->Clean(&context, &clean_request, &clean_response);
+  EndScratch(scratch);
+  return result;
+}
+
+static void PrintBenchmarkResult(const char *name, BenchmarkResult result) {
+  if (result.ok) {
+    printf("%-6s stage %10.1f ms  read %10.1f ms  total %10.1f ms  (%llu "
+           "bytes read)\n",
+           name, result.stage_ms, result.read_ms,
+           result.stage_ms + result.read_ms,
+           (unsigned long long)result.bytes_read);
+  } else {
+    printf("%-6s failed\n", name);
+  }
+}
+
+int main(int argc, char **argv) {
+  TemporaryMemory scratch = BeginScratch(0);
+  BenchmarkOptions options = ParseBenchmarkOptions(scratch.arena, argc, argv);
+  if (!IsEmptyStr8(options.error)) {
+    fprintf(stderr, "%s\n", options.error.ptr);
+    EndScratch(scratch);
+    return 1;
+  }
+
+  Str8 disk_cache =
+      PushStr8F(scratch.arena, "%s/disk_cache", options.work_dir.ptr);
+  if (!CreateCas(scratch.arena, &options, disk_cache)) {
+    fprintf(stderr, "Failed to populate %s\n", disk_cache.ptr);
+    EndScratch(scratch);
+    return 1;
+  }
+  printf("%u files of %u KiB, reading %u%% of them\n", options.files,
+         options.file_size / 1024, options.read_percent);
+
+  BenchmarkResult eager = RunBenchmark(scratch.arena, &options, disk_cache, {},
+                                       Str8FromCStr("eager"));
+  PrintBenchmarkResult("eager", eager);
+  bool ok = eager.ok;
+  if (!IsEmptyStr8(options.fuse_mount)) {
+    BenchmarkResult lazy =
+        RunBenchmark(scratch.arena, &options, disk_cache, options.fuse_mount,
+                     Str8FromCStr("lazy"));
+    PrintBenchmarkResult("lazy", lazy);
+    ok = ok && lazy.ok;
+  }
+  EndScratch(scratch);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,592 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Puts load on a running output service over gRPC, like several Bazel servers
+// building at once would, and reports the latency of each method and the
+// memory used by the service.
+//
+// Usage:
+//   output_service_load_generator --output_path_prefix=DIR
+//       [--server=HOST:PORT] [--server_pid=PID] [--trace=FILE]
+//       [--paths=N] [--staged_percent=N] [--batch_size=N] [--clients=N]
+//       [--builds=N]
+//
+// Each of the --clients threads runs --builds builds one after another in an
+// output base of its own: StartBuild, the requests of the trace, and
+// FinalizeBuild. The trace is read from --trace, a file with one
+// "stage|stat|finalize <path>" line per artifact, in which consecutive lines
+// of the same kind are sent in requests of up to --batch_size paths. Without
+// it, a trace of --paths outputs is made up: the outputs of each batch of
+// actions are stat-ed, then --staged_percent of them are staged, as if they
+// were built remotely, and the others are finalized.
+//
+// Unless the service runs with --disk_cache, it only records staged artifacts,
+// so any digest will do. With --server_pid, the resident memory of the service is
+// sampled during the run, which is only supported on Linux.
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/main/protobuf/bazel_output_service.grpc.pb.h"
+#include "src/main/protobuf/bazel_output_service_rev2.pb.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+#include "grpcpp/channel.h"
+#include "grpcpp/client_context.h"
+#include "grpcpp/create_channel.h"
+#include "grpcpp/security/credentials.h"
+
+enum Method {
+  kMethodStartBuild,
+  kMethodStageArtifacts,
+  kMethodBatchStat,
+  kMethodFinalizeArtifacts,
+  kMethodFinalizeBuild,
+  kMethodCount,
+};
+
+static const char *kMethodNames[kMethodCount] = {
+    "StartBuild",        "StageArtifacts", "BatchStat",
+    "FinalizeArtifacts", "FinalizeBuild",
+};
+
+struct TraceOp {
+  Method method;
+  Str8 path;
+};
+
+// Consecutive ops of the same method, sent in a single request.
+struct TraceBatch {
+  Method method;
+  uint32_t first;
+  uint32_t count;
+};
+
+struct Trace {
+  TraceOp *ops;
+  uint32_t op_count;
+  TraceBatch *batches;
+  uint32_t batch_count;
+};
+
+struct LoadOptions {
+  Str8 error;
+  Str8 server;
+  Str8 output_path_prefix;
+  Str8 trace;
+  uint32_t server_pid;
+  uint32_t paths;
+  uint32_t staged_percent;
+  uint32_t batch_size;
+  uint32_t clients;
+  uint32_t builds;
+};
+
+static LoadOptions ParseLoadOptions(Arena *arena, int argc, char **argv) {
+  LoadOptions result = {};
+  result.server = Str8FromCStr("localhost:8080");
+  result.paths = 1000000;
+  result.staged_percent = 80;
+  result.batch_size = 1000;
+  result.clients = 4;
+  result.builds = 3;
+  struct {
+    const char *prefix;
+    uint32_t *value;
+  } numbers[] = {
+      {"--server_pid=", &result.server_pid},
+      {"--paths=", &result.paths},
+      {"--staged_percent=", &result.staged_percent},
+      {"--batch_size=", &result.batch_size},
+      {"--clients=", &result.clients},
+      {"--builds=", &result.builds},
+  };
+  for (int i = 1; i < argc && IsEmptyStr8(result.error); ++i) {
+    Str8 arg = Str8FromCStr(argv[i]);
+    Str8 server_prefix = Str8FromCStr("--server=");
+    Str8 output_path_prefix_prefix = Str8FromCStr("--output_path_prefix=");
+    Str8 trace_prefix = Str8FromCStr("--trace=");
+    bool matched = false;
+    for (auto &number : numbers) {
+      Str8 prefix = Str8FromCStr(number.prefix);
+      if (StartsWithStr8(arg, prefix)) {
+        ParsedUInt32 value = ParseUInt32(PushSubStr8(arena, arg, prefix.len));
+        if (!value.valid) {
+          result.error = PushStr8F(arena, "Not a number: %s", arg.ptr);
+        }
+        *number.value = value.value;
+        matched = true;
+      }
+    }
+    if (matched) {
+      continue;
+    } else if (StartsWithStr8(arg, server_prefix)) {
+      result.server = PushSubStr8(arena, arg, server_prefix.len);
+    } else if (StartsWithStr8(arg, output_path_prefix_prefix)) {
+      result.output_path_prefix =
+          PushSubStr8(arena, arg, output_path_prefix_prefix.len);
+    } else if (StartsWithStr8(arg, trace_prefix)) {
+      result.trace = PushSubStr8(arena, arg, trace_prefix.len);
+    } else {
+      result.error = PushStr8F(arena, "Unknown command line: %s", arg.ptr);
+    }
+  }
+  if (!IsEmptyStr8(result.error)) {
+  } else if (IsEmptyStr8(result.output_path_prefix)) {
+    result.error = Str8FromCStr("--output_path_prefix is required");
+  } else if (result.staged_percent > 100) {
+    result.error = Str8FromCStr("--staged_percent must be at most 100");
+  } else if (!result.batch_size || !result.clients || !result.builds) {
+    result.error =
+        Str8FromCStr("--batch_size, --clients and --builds must be positive");
+  }
+  return result;
+}
+
+static uint64_t NowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+// Makes up the trace of a build of `paths` outputs, in packages of 100.
+static void MakeTrace(Arena *arena, LoadOptions *options, Trace *trace) {
+  trace->op_count = options->paths * 2;
+  trace->ops = PushArray(arena, TraceOp, trace->op_count);
+  uint32_t op = 0;
+  for (uint32_t begin = 0; begin < options->paths;
+       begin += options->batch_size) {
+    uint32_t end = std::min(options->paths, begin + options->batch_size);
+    for (uint32_t i = begin; i < end; ++i) {
+      trace->ops[op].method = kMethodBatchStat;
+      trace->ops[op].path =
+          PushStr8F(arena, "k8-fastbuild/bin/pkg%u/out%u", i / 100, i);
+      ++op;
+    }
+    // Pick the staged outputs evenly over the batch, and send them in one
+    // request and the finalized ones in another.
+    TraceOp *stats = trace->ops + op - (end - begin);
+    for (int pass = 0; pass < 2; ++pass) {
+      Method method = pass == 0 ? kMethodStageArtifacts
+                                : kMethodFinalizeArtifacts;
+      for (uint32_t i = begin; i < end; ++i) {
+        bool staged = (uint64_t)i * options->staged_percent / 100 !=
+                      (uint64_t)(i + 1) * options->staged_percent / 100;
+        if (staged == (pass == 0)) {
+          trace->ops[op].method = method;
+          trace->ops[op].path = stats[i - begin].path;
+          ++op;
+        }
+      }
+    }
+  }
+}
+
+// Reads the trace from `path`. Returns false if it cannot be read or has an
+// unknown line.
+static bool ReadTrace(Arena *ops_arena, Arena *paths_arena, Str8 path,
+                      Trace *trace) {
+  FILE *file = fopen((char *)path.ptr, "r");
+  if (!file) {
+    fprintf(stderr, "Failed to open %s: %s\n", path.ptr, strerror(errno));
+    return false;
+  }
+  // The ops are pushed one after another onto an arena of their own, so that
+  // they form an array.
+  trace->ops = 0;
+  trace->op_count = 0;
+  bool result = true;
+  char *line = 0;
+  size_t cap = 0;
+  ssize_t len;
+  while (result && (len = getline(&line, &cap, file)) > 0) {
+    Str8 str = {(uint8_t *)line, (size_t)len};
+    if (str.ptr[str.len - 1] == '\n') {
+      str.ptr[--str.len] = 0;
+    }
+    if (IsEmptyStr8(str) || str.ptr[0] == '#') {
+      continue;
+    }
+    Str8 prefixes[] = {Str8FromCStr("stage "), Str8FromCStr("stat "),
+                       Str8FromCStr("finalize ")};
+    Method methods[] = {kMethodStageArtifacts, kMethodBatchStat,
+                        kMethodFinalizeArtifacts};
+    result = false;
+    for (int i = 0; i < 3 && !result; ++i) {
+      if (StartsWithStr8(str, prefixes[i]) && str.len > prefixes[i].len) {
+        TraceOp *op = PushArray(ops_arena, TraceOp, 1);
+        if (!trace->ops) {
+          trace->ops = op;
+        }
+        op->method = methods[i];
+        op->path = PushSubStr8(paths_arena, str, prefixes[i].len);
+        ++trace->op_count;
+        result = true;
+      }
+    }
+    if (!result) {
+      fprintf(stderr, "Unknown line in %s: %s\n", path.ptr, str.ptr);
+    }
+  }
+  free(line);
+  fclose(file);
+  return result;
+}
+
+static void BatchTrace(Arena *arena, uint32_t batch_size, Trace *trace) {
+  trace->batches = PushArray(arena, TraceBatch, trace->op_count);
+  trace->batch_count = 0;
+  for (uint32_t i = 0; i < trace->op_count; ++i) {
+    TraceBatch *last = trace->batch_count
+                           ? &trace->batches[trace->batch_count - 1]
+                           : 0;
+    if (last && last->method == trace->ops[i].method &&
+        last->count < batch_size) {
+      ++last->count;
+    } else {
+      TraceBatch *batch = &trace->batches[trace->batch_count++];
+      batch->method = trace->ops[i].method;
+      batch->first = i;
+      batch->count = 1;
+    }
+  }
+}
+
+// The service doesn't verify digests unless it materializes the artifacts, so
+// a hash of the path will do.
+static void SetLocator(Str8 path, google::protobuf::Any *any) {
+  bazel_output_service_rev2::FileArtifactLocator locator;
+  char hash[65];
+  snprintf(hash, sizeof(hash), "%064llx",
+           (unsigned long long)HashStr8(path));
+  locator.mutable_digest()->set_hash(hash);
+  locator.mutable_digest()->set_size_bytes(path.len);
+  any->PackFrom(locator);
+}
+
+// The latencies of the calls made by a client, in microseconds.
+struct ClientResult {
+  uint32_t *latencies[kMethodCount];
+  uint32_t latency_count[kMethodCount];
+  uint64_t paths[kMethodCount];
+  // The artifacts the service could not stage, and the failed calls.
+  uint64_t artifact_errors;
+  uint64_t call_errors;
+  Str8 first_error;
+};
+
+static void RecordCall(Arena *arena, ClientResult *result, Method method,
+                       uint64_t start, uint32_t paths,
+                       const grpc::Status &status) {
+  result->latencies[method][result->latency_count[method]++] =
+      (uint32_t)std::min<uint64_t>(NowUs() - start, UINT32_MAX);
+  result->paths[method] += paths;
+  if (!status.ok()) {
+    if (!result->call_errors) {
+      result->first_error = PushStr8F(arena, "%s: %s", kMethodNames[method],
+                                      status.error_message().c_str());
+    }
+    ++result->call_errors;
+  }
+}
+
+static void RunClient(Arena *arena, LoadOptions *options, Trace *trace,
+                      uint32_t client, ClientResult *result) {
+  uint32_t calls[kMethodCount] = {};
+  calls[kMethodStartBuild] = options->builds;
+  calls[kMethodFinalizeBuild] = options->builds;
+  for (uint32_t i = 0; i < trace->batch_count; ++i) {
+    calls[trace->batches[i].method] += options->builds;
+  }
+  for (int i = 0; i < kMethodCount; ++i) {
+    result->latencies[i] = PushArray(arena, uint32_t, calls[i]);
+  }
+
+  grpc::ChannelArguments channel_args;
+  channel_args.SetMaxReceiveMessageSize(-1);
+  channel_args.SetMaxSendMessageSize(-1);
+  std::unique_ptr<bazel_output_service::BazelOutputService::Stub> stub =
+      bazel_output_service::BazelOutputService::NewStub(
+          grpc::CreateCustomChannel((char *)options->server.ptr,
+                                    grpc::InsecureChannelCredentials(),
+                                    channel_args));
+
+  Str8 output_base_id = PushStr8F(arena, "load%u", client);
+  for (uint32_t build = 0; build < options->builds; ++build) {
+    std::string build_id = std::string((char *)output_base_id.ptr) + "-" +
+                           std::to_string(build);
+
+    bazel_output_service::StartBuildRequest start_request;
+    bazel_output_service::StartBuildResponse start_response;
+    start_request.set_version(1);
+    start_request.set_output_base_id((char *)output_base_id.ptr);
+    start_request.set_build_id(build_id);
+    start_request.set_output_path_prefix(
+        (char *)options->output_path_prefix.ptr);
+    grpc::ClientContext start_context;
+    uint64_t start = NowUs();
+    grpc::Status status =
+        stub->StartBuild(&start_context, start_request, &start_response);
+    RecordCall(arena, result, kMethodStartBuild, start, 0, status);
+    if (!status.ok()) {
+      break;
+    }
+
+    for (uint32_t i = 0; i < trace->batch_count; ++i) {
+      const TraceBatch &batch = trace->batches[i];
+      const TraceOp *ops = trace->ops + batch.first;
+      grpc::ClientContext context;
+      // Only the call itself is timed, not building the request.
+      switch (batch.method) {
+        case kMethodStageArtifacts: {
+          bazel_output_service::StageArtifactsRequest request;
+          bazel_output_service::StageArtifactsResponse response;
+          request.set_build_id(build_id);
+          for (uint32_t j = 0; j < batch.count; ++j) {
+            auto *artifact = request.add_artifacts();
+            artifact->set_path((char *)ops[j].path.ptr, ops[j].path.len);
+            SetLocator(ops[j].path, artifact->mutable_locator());
+          }
+          start = NowUs();
+          status = stub->StageArtifacts(&context, request, &response);
+          for (const auto &r : response.responses()) {
+            result->artifact_errors += r.status().code() != 0;
+          }
+          break;
+        }
+        case kMethodBatchStat: {
+          bazel_output_service::BatchStatRequest request;
+          bazel_output_service::BatchStatResponse response;
+          request.set_build_id(build_id);
+          for (uint32_t j = 0; j < batch.count; ++j) {
+            request.add_paths((char *)ops[j].path.ptr, ops[j].path.len);
+          }
+          start = NowUs();
+          status = stub->BatchStat(&context, request, &response);
+          break;
+        }
+        case kMethodFinalizeArtifacts: {
+          bazel_output_service::FinalizeArtifactsRequest request;
+          bazel_output_service::FinalizeArtifactsResponse response;
+          request.set_build_id(build_id);
+          for (uint32_t j = 0; j < batch.count; ++j) {
+            auto *artifact = request.add_artifacts();
+            artifact->set_path((char *)ops[j].path.ptr, ops[j].path.len);
+            SetLocator(ops[j].path, artifact->mutable_locator());
+          }
+          start = NowUs();
+          status = stub->FinalizeArtifacts(&context, request, &response);
+          break;
+        }
+        default:
+          break;
+      }
+      RecordCall(arena, result, batch.method, start, batch.count, status);
+    }
+
+    bazel_output_service::FinalizeBuildRequest finalize_request;
+    bazel_output_service::FinalizeBuildResponse finalize_response;
+    finalize_request.set_build_id(build_id);
+    finalize_request.set_build_successful(true);
+    grpc::ClientContext finalize_context;
+    start = NowUs();
+    status = stub->FinalizeBuild(&finalize_context, finalize_request,
+                                 &finalize_response);
+    RecordCall(arena, result, kMethodFinalizeBuild, start, 0, status);
+  }
+}
+
+// Returns the resident memory of process `pid` in KiB as given by the
+// `field` line of /proc/<pid>/status, e.g. "VmRSS:", or 0 if unknown.
+static uint64_t ReadProcessMemoryKiB(uint32_t pid, const char *field) {
+  uint64_t result = 0;
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%u/status", pid);
+  FILE *file = fopen(path, "r");
+  if (file) {
+    char line[256];
+    size_t field_len = strlen(field);
+    while (fgets(line, sizeof(line), file)) {
+      if (strncmp(line, field, field_len) == 0) {
+        result = strtoull(line + field_len, 0, 10);
+        break;
+      }
+    }
+    fclose(file);
+  }
+  return result;
+}
+
+static uint32_t Percentile(uint32_t *sorted, uint32_t count, double p) {
+  uint32_t result = 0;
+  if (count) {
+    uint32_t index = (uint32_t)(p / 100.0 * (count - 1) + 0.5);
+    result = sorted[index];
+  }
+  return result;
+}
+
+static void PrintResults(Arena *arena, LoadOptions *options,
+                         ClientResult *results, double wall_ms) {
+  TemporaryMemory scratch = BeginScratch(arena);
+  printf("%-18s %9s %11s %9s %9s %9s %9s %9s %12s\n", "method", "calls",
+         "paths", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms",
+         "paths/s");
+  for (int method = 0; method < kMethodCount; ++method) {
+    uint32_t count = 0;
+    uint64_t paths = 0;
+    for (uint32_t c = 0; c < options->clients; ++c) {
+      count += results[c].latency_count[method];
+      paths += results[c].paths[method];
+    }
+    if (!count) {
+      continue;
+    }
+    uint32_t *all = PushArray(scratch.arena, uint32_t, count);
+    uint32_t n = 0;
+    uint64_t total_us = 0;
+    for (uint32_t c = 0; c < options->clients; ++c) {
+      for (uint32_t i = 0; i < results[c].latency_count[method]; ++i) {
+        all[n++] = results[c].latencies[method][i];
+        total_us += results[c].latencies[method][i];
+      }
+    }
+    std::sort(all, all + count);
+    // The throughput of one client, as the calls of a client are sequential.
+    double paths_per_second =
+        total_us ? paths * 1e6 / total_us * options->clients : 0;
+    printf("%-18s %9u %11llu %9.2f %9.2f %9.2f %9.2f %9.2f %12.0f\n",
+           kMethodNames[method], count, (unsigned long long)paths,
+           Percentile(all, count, 50) / 1000.0,
+           Percentile(all, count, 90) / 1000.0,
+           Percentile(all, count, 99) / 1000.0,
+           Percentile(all, count, 99.9) / 1000.0, all[count - 1] / 1000.0,
+           paths_per_second);
+  }
+  printf("wall time %.1f s\n", wall_ms / 1000.0);
+  EndScratch(scratch);
+}
+
+int main(int argc, char **argv) {
+  TemporaryMemory scratch = BeginScratch(0);
+  LoadOptions options = ParseLoadOptions(scratch.arena, argc, argv);
+  if (!IsEmptyStr8(options.error)) {
+    fprintf(stderr, "%s\n", options.error.ptr);
+    EndScratch(scratch);
+    return 1;
+  }
+
+  // Millions of paths don't fit the scratch arenas.
+  Arena *ops_arena = AllocArena(GiB(64));
+  Arena *paths_arena = AllocArena(GiB(64));
+  Trace trace = {};
+  if (IsEmptyStr8(options.trace)) {
+    MakeTrace(paths_arena, &options, &trace);
+  } else if (!ReadTrace(ops_arena, paths_arena, options.trace, &trace)) {
+    FreeArena(paths_arena);
+    FreeArena(ops_arena);
+    EndScratch(scratch);
+    return 1;
+  }
+  BatchTrace(paths_arena, options.batch_size, &trace);
+  printf("%u clients running %u builds of %u path operations in %u requests "
+         "each\n",
+         options.clients, options.builds, trace.op_count, trace.batch_count);
+
+  uint64_t rss_before = 0;
+  if (options.server_pid) {
+    rss_before = ReadProcessMemoryKiB(options.server_pid, "VmRSS:");
+    if (!rss_before) {
+      fprintf(stderr, "Cannot read the memory of process %u\n",
+              options.server_pid);
+    }
+  }
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> rss_peak(rss_before);
+  std::thread sampler;
+  if (rss_before) {
+    // VmHWM would include the memory used before the run.
+    sampler = std::thread([&options, &done, &rss_peak] {
+      while (!done.load()) {
+        uint64_t rss = ReadProcessMemoryKiB(options.server_pid, "VmRSS:");
+        if (rss > rss_peak.load()) {
+          rss_peak = rss;
+        }
+        usleep(100 * 1000);
+      }
+    });
+  }
+
+  Arena **client_arenas = PushArray(scratch.arena, Arena *, options.clients);
+  ClientResult *results =
+      PushArray(scratch.arena, ClientResult, options.clients);
+  std::vector<std::thread> clients;
+  uint64_t start = NowUs();
+  for (uint32_t c = 0; c < options.clients; ++c) {
+    client_arenas[c] = AllocArena();
+    clients.emplace_back([&options, &trace, client_arenas, results, c] {
+      RunClient(client_arenas[c], &options, &trace, c, &results[c]);
+    });
+  }
+  for (std::thread &client : clients) {
+    client.join();
+  }
+  double wall_ms = (NowUs() - start) / 1000.0;
+  done = true;
+  if (sampler.joinable()) {
+    sampler.join();
+  }
+
+  PrintResults(scratch.arena, &options, results, wall_ms);
+  if (rss_before) {
+    uint64_t rss_after = ReadProcessMemoryKiB(options.server_pid, "VmRSS:");
+    printf("server RSS before %.1f MiB, peak %.1f MiB, after %.1f MiB\n",
+           rss_before / 1024.0, rss_peak.load() / 1024.0,
+           rss_after / 1024.0);
+  }
+  uint64_t artifact_errors = 0;
+  uint64_t call_errors = 0;
+  for (uint32_t c = 0; c < options.clients; ++c) {
+    artifact_errors += results[c].artifact_errors;
+    call_errors += results[c].call_errors;
+    if (results[c].call_errors) {
+      fprintf(stderr, "client %u: %s\n", c, results[c].first_error.ptr);
+    }
+  }
+  if (artifact_errors || call_errors) {
+    printf("%llu failed calls, %llu artifacts not staged\n",
+           (unsigned long long)call_errors,
+           (unsigned long long)artifact_errors);
+  }
+
+  for (uint32_t c = 0; c < options.clients; ++c) {
+    FreeArena(client_arenas[c]);
+  }
+  FreeArena(paths_arena);
+  FreeArena(ops_arena);
+  EndScratch(scratch);
+  return call_errors ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/output_tree.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+static OutputValue *PushOutputValue(Arena *arena, OutputNodeKind kind,
+                                    Str8 locator) {
+  OutputValue *result = PushArray(arena, OutputValue, 1);
+  result->kind = kind;
+  if (!IsEmptyStr8(locator)) {
+    result->locator = PushSubStr8(arena, locator, 0, locator.len);
+  }
+  return result;
+}
+
+static void InitOutputRoot(OutputTree *tree) {
+  OutputValue *value =
+      PushOutputValue(tree->shards[0].arena, kOutputNodeDirectory, {});
+  tree->root.value.store(value, std::memory_order_release);
+}
+
+void InitOutputTree(OutputTree *tree) {
+  for (size_t i = 0; i < kOutputTreeShardCount; ++i) {
+    tree->shards[i].arena = AllocArena();
+  }
+  InitOutputRoot(tree);
+}
+
+void ResetOutputTree(OutputTree *tree) {
+  FreeOutputTree(tree);
+  InitOutputTree(tree);
+}
+
+void FreeOutputTree(OutputTree *tree) {
+  for (size_t i = 0; i < kOutputTreeShardCount; ++i) {
+    FreeArena(tree->shards[i].arena);
+    tree->shards[i].arena = 0;
+  }
+  tree->root.value.store(0, std::memory_order_relaxed);
+}
+
+// Finds the entry `name` in directory `dir`. If it doesn't exist and `arena`
+// is not null, a new entry is allocated from `arena` and inserted. The new
+// entry holds `value`, or an empty directory if `value` is null.
+static OutputNode *FindOutputEntry(Arena *arena, OutputNode *parent,
+                                   OutputValue *dir, Str8 name,
+                                   OutputValue *value) {
+  std::atomic<OutputNode *> *slot = &dir->entries;
+  OutputNode *fresh = 0;
+  uint64_t hash = HashStr8(name);
+  for (;;) {
+    OutputNode *node = slot->load(std::memory_order_acquire);
+    if (!node) {
+      if (!arena) {
+        break;
+      }
+      if (!fresh) {
+        fresh = PushArray(arena, OutputNode, 1);
+        fresh->parent = parent;
+        fresh->name = PushSubStr8(arena, name, 0, name.len);
+        if (!value) {
+          value = PushOutputValue(arena, kOutputNodeDirectory, {});
+        }
+        fresh->value.store(value, std::memory_order_relaxed);
+      }
+      if (slot->compare_exchange_strong(node, fresh,
+                                        std::memory_order_acq_rel)) {
+        return fresh;
+      }
+      // Lost the race against another writer: `node` now holds the winner,
+      // which may or may not be the entry we're looking for.
+    }
+    if (EqualsStr8(node->name, name)) {
+      return node;
+    }
+    slot = &node->child[hash >> 62];
+    hash <<= 2;
+  }
+  return 0;
+}
+
+// Walks `path` component by component starting at the root. If `arena` is not
+// null, missing entries are created, and files in the middle of the path are
+// turned into directories. A missing last component is created with `last`
+// so that readers never observe it as a directory first.
+static OutputNode *WalkOutputPath(Arena *arena, OutputNode *root, Str8 path,
+                                  OutputValue *last) {
+  OutputNode *node = root;
+  size_t begin = 0;
+  while (node && begin < path.len) {
+    size_t end = begin;
+    while (end < path.len && path.ptr[end] != '/') {
+      ++end;
+    }
+    Str8 name = {path.ptr + begin, end - begin};
+    begin = end + 1;
+
+    if (name.len == 0 || (name.len == 1 && name.ptr[0] == '.')) {
+      continue;
+    }
+    if (name.len == 2 && name.ptr[0] == '.' && name.ptr[1] == '.') {
+      node = node->parent;
+      continue;
+    }
+
+    OutputValue *value = node->value.load(std::memory_order_acquire);
+    if (value->kind != kOutputNodeDirectory) {
+      if (!arena) {
+        node = 0;
+        break;
+      }
+      OutputValue *dir = PushOutputValue(arena, kOutputNodeDirectory, {});
+      while (value->kind != kOutputNodeDirectory) {
+        if (node->value.compare_exchange_weak(value, dir,
+                                              std::memory_order_acq_rel)) {
+          value = dir;
+        }
+      }
+    }
+    node = FindOutputEntry(arena, node, value, name,
+                           begin >= path.len ? last : 0);
+  }
+  return node;
+}
+
+bool PutOutputFile(OutputTree *tree, Str8 path, Str8 locator) {
+  OutputTreeShard *shard =
+      &tree->shards[HashStr8(path) % kOutputTreeShardCount];
+  std::lock_guard<std::mutex> lock(shard->mutex);
+  OutputValue *file = PushOutputValue(shard->arena, kOutputNodeFile, locator);
+  OutputNode *node = WalkOutputPath(shard->arena, &tree->root, path, file);
+  bool result = node && node != &tree->root;
+  if (result) {
+    node->value.store(file, std::memory_order_release);
+  }
+  return result;
+}
+
+const OutputValue *LookupOutputValue(OutputTree *tree, Str8 path) {
+  OutputNode *node = WalkOutputPath(0, &tree->root, path, 0);
+  const OutputValue *result =
+      node ? node->value.load(std::memory_order_acquire) : 0;
+  return result;
+}
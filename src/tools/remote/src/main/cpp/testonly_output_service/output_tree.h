@@ -0,0 +1,97 @@
+// Copyright 2024 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_OUTPUT_TREE_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_OUTPUT_TREE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+#include "src/tools/remote/src/main/cpp/testonly_output_service/string.h"
+
+enum OutputNodeKind : uint8_t {
+  kOutputNodeDirectory,
+  kOutputNodeFile,
+};
+
+struct OutputNode;
+
+// The contents of a node. Values are immutable once published, except for
+// the entries of a directory, so a node is modified by swapping its value.
+struct OutputValue {
+  OutputNodeKind kind;
+  // The serialized google.protobuf.Any locator of a file. May be empty if the
+  // digest of the file is unknown.
+  Str8 locator;
+  // Root of the hash trie holding the entries of a directory.
+  std::atomic<OutputNode *> entries;
+};
+
+// A node in the in-memory output tree.
+//
+// The entries of a directory are stored in a 4-ary hash trie keyed by the
+// hash of the entry name: lookup and insertion walk down `child` using two
+// bits of the hash per level. This needs no rehashing and no deletion, so
+// nodes can be allocated from an arena and are never moved or freed
+// individually.
+//
+// Nodes are published with a single compare-and-swap on an empty slot and
+// are never unlinked, so lookups take no locks and never wait for writers.
+struct OutputNode {
+  std::atomic<OutputNode *> child[4];
+  OutputNode *parent;
+  Str8 name;
+  std::atomic<OutputValue *> value;
+};
+
+constexpr size_t kOutputTreeShardCount = 16;
+
+// Writers allocate from the shard picked by the hash of the path they write,
+// so writers to different shards don't contend on a lock.
+struct OutputTreeShard {
+  std::mutex mutex;
+  Arena *arena;
+};
+
+// An output tree holding the artifacts staged by Bazel. Files are
+// placeholders that only record their locator, i.e. the digest of the blob
+// in the CAS, so staging is cheap regardless of the file size.
+//
+// PutOutputFile and LookupOutputValue may be called concurrently. All memory
+// is owned by the shard arenas and released at once by ResetOutputTree and
+// FreeOutputTree, which must not run concurrently with any other access.
+struct OutputTree {
+  OutputNode root;
+  OutputTreeShard shards[kOutputTreeShardCount];
+};
+
+void InitOutputTree(OutputTree *tree);
+void ResetOutputTree(OutputTree *tree);
+void FreeOutputTree(OutputTree *tree);
+
+// Creates or replaces the file at `path`, which is relative to the root of the
+// output tree. Missing parent directories are created, and a file standing in
+// the way of a parent directory is replaced with a directory. Returns false if
+// the path doesn't stay within the output tree.
+bool PutOutputFile(OutputTree *tree, Str8 path, Str8 locator);
+
+// Returns the current value of the node at `path`, or null if no such node
+// exists or the path doesn't stay within the output tree.
+const OutputValue *LookupOutputValue(OutputTree *tree, Str8 path);
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_OUTPUT_TREE_H_
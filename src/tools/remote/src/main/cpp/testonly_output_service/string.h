@@ -42,6 +42,11 @@ static inline Str8 Str8FromCStr(const char *str) {
 }
 
 // Returns true if the string starts with the given prefix.
+static inline bool EqualsStr8(Str8 a, Str8 b) {
+  bool result = a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+  return result;
+}
+
 static inline bool StartsWithStr8(Str8 str, Str8 prefix) {
   bool result =
       str.len >= prefix.len && memcmp(str.ptr, prefix.ptr, prefix.len) == 0;
@@ -50,6 +55,16 @@ static inline bool StartsWithStr8(Str8 str, Str8 prefix) {
 
 // The result of parsing an unsigned 32-bit integer from a string. The `value`
 // is only valid if `valid` is true.
+static inline uint64_t HashStr8(Str8 str) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < str.len; ++i) {
+    hash ^= str.ptr[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
 struct ParsedUInt32 {
   bool valid;
   uint32_t value;
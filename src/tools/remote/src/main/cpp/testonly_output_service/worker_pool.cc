@@ -0,0 +1,91 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/worker_pool.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+
+struct WorkerPool {
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::deque<std::function<void()>> queue;
+  bool stopping;
+  int thread_count;
+  std::thread *threads;
+};
+
+static void RunWorker(WorkerPool *pool) {
+  while (true) {
+    std::function<void()> work;
+    {
+      std::unique_lock<std::mutex> lock(pool->mutex);
+      pool->work_available.wait(
+          lock, [pool] { return !pool->queue.empty() || pool->stopping; });
+      if (pool->queue.empty()) {
+        return;
+      }
+      work = std::move(pool->queue.front());
+      pool->queue.pop_front();
+    }
+    work();
+  }
+}
+
+WorkerPool *StartWorkerPool(Arena *arena, int thread_count) {
+  if (thread_count <= 0) {
+    thread_count = std::thread::hardware_concurrency();
+    if (thread_count < 1) {
+      thread_count = 1;
+    }
+  }
+  WorkerPool *pool = new (PushArray(arena, WorkerPool, 1)) WorkerPool();
+  pool->stopping = false;
+  pool->thread_count = thread_count;
+  pool->threads = PushArray(arena, std::thread, thread_count);
+  for (int i = 0; i < thread_count; ++i) {
+    new (&pool->threads[i]) std::thread(RunWorker, pool);
+  }
+  return pool;
+}
+
+void StopWorkerPool(WorkerPool *pool) {
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stopping = true;
+  }
+  pool->work_available.notify_all();
+  for (int i = 0; i < pool->thread_count; ++i) {
+    pool->threads[i].join();
+    pool->threads[i].~thread();
+  }
+  pool->~WorkerPool();
+}
+
+int GetWorkerCount(WorkerPool *pool) { return pool->thread_count; }
+
+void SubmitWork(WorkerPool *pool, std::function<void()> work) {
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->queue.push_back(std::move(work));
+  }
+  pool->work_available.notify_one();
+}
@@ -0,0 +1,38 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_WORKER_POOL_H_
+#define BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_WORKER_POOL_H_
+
+#include <functional>
+
+#include "src/tools/remote/src/main/cpp/testonly_output_service/memory.h"
+
+// A fixed set of threads that run work in the order it was submitted. Each
+// thread has its own scratch arenas (see GetScratchArena), so work can use
+// BeginScratch without contending with other threads.
+struct WorkerPool;
+
+// Starts `thread_count` threads, or one per core if `thread_count` is 0.
+WorkerPool *StartWorkerPool(Arena *arena, int thread_count);
+
+// Runs the work submitted so far, then stops the threads.
+void StopWorkerPool(WorkerPool *pool);
+
+int GetWorkerCount(WorkerPool *pool);
+
+// Runs `work` on one of the threads of the pool. Never blocks.
+void SubmitWork(WorkerPool *pool, std::function<void()> work);
+
+#endif  // BAZEL_SRC_TOOLS_REMOTE_SRC_MAIN_CPP_TESTONLY_OUTPUT_SERVICE_WORKER_POOL_H_
@@ -0,0 +1,114 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/class_load_order.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "src/tools/singlejar/mapped_file.h"
+
+static bool IsBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool ClassLoadOrder::Load(const std::string &path) {
+  MappedFile profile;
+  if (!profile.Open(path)) {
+    return false;
+  }
+  Parse(reinterpret_cast<const char *>(profile.start()), profile.size());
+  profile.Close();
+  return true;
+}
+
+void ClassLoadOrder::Parse(const char *data, size_t size) {
+  const char *const data_end = data + size;
+  while (data < data_end) {
+    const char *line_end =
+        static_cast<const char *>(memchr(data, '\n', data_end - data));
+    if (line_end == nullptr) {
+      line_end = data_end;
+    }
+    ParseLine(data, line_end);
+    data = line_end + 1;
+  }
+}
+
+void ClassLoadOrder::ParseLine(const char *line, const char *end) {
+  while (line < end && IsBlank(*line)) {
+    ++line;
+  }
+  if (line == end || *line == '#') {
+    return;
+  }
+  static constexpr std::string_view kLoaded = "[Loaded ";
+  const char *name_end_chars = " \t\r";
+  if (std::string_view(line, end - line).substr(0, kLoaded.size()) ==
+      kLoaded) {
+    line += kLoaded.size();
+    name_end_chars = " \t\r]";
+  } else if (*line == '[') {
+    // Unified logging: skip the decorations, one of which has to be the
+    // tag set of the class loading messages.
+    bool class_load = false;
+    while (line < end && *line == '[') {
+      const char *close =
+          static_cast<const char *>(memchr(line, ']', end - line));
+      if (close == nullptr) {
+        return;
+      }
+      std::string_view tags(line + 1, close - line - 1);
+      // The tag sets are padded to the same width.
+      while (!tags.empty() && tags.back() == ' ') {
+        tags.remove_suffix(1);
+      }
+      class_load |= tags == "class,load";
+      line = close + 1;
+    }
+    if (!class_load) {
+      return;
+    }
+    while (line < end && IsBlank(*line)) {
+      ++line;
+    }
+  }
+  const char *name_end = std::find_first_of(
+      line, end, name_end_chars, name_end_chars + strlen(name_end_chars));
+  std::string_view name(line, name_end - line);
+  if (name.empty()) {
+    return;
+  }
+
+  std::string entry_name;
+  static constexpr std::string_view kClassSuffix = ".class";
+  if (name.size() > kClassSuffix.size() &&
+      name.substr(name.size() - kClassSuffix.size()) == kClassSuffix) {
+    entry_name = std::string(name);
+  } else if (name.find('/') == std::string_view::npos) {
+    entry_name = std::string(name);
+    std::replace(entry_name.begin(), entry_name.end(), '.', '/');
+    entry_name += kClassSuffix;
+  } else {
+    // A hidden class, e.g. "com.foo.Bar$$Lambda/0x0123", has no entry.
+    return;
+  }
+  if (ranks_.Emplace(entry_name, entries_.size()).second) {
+    entries_.push_back(std::move(entry_name));
+  }
+}
@@ -0,0 +1,73 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_CLASS_LOAD_ORDER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_CLASS_LOAD_ORDER_H_ 1
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/name_map.h"
+
+/*
+ * The order in which a JVM loaded the classes of an application, used to lay
+ * the entries of the classes out in that order at the front of the output
+ * jar, so that starting the application reads the jar sequentially.
+ *
+ * Each line of the profile names one class, in any of these forms:
+ *   [0.021s][info][class,load] com.foo.Bar source: file:/app.jar
+ *       (the output of -Xlog:class+load, any decorations)
+ *   [Loaded com.foo.Bar from file:/app.jar]
+ *       (the output of -verbose:class before JDK 9)
+ *   com.foo.Bar
+ *   com/foo/Bar.class
+ * The other lines, including the ones logged with other tags, empty lines
+ * and the lines starting with '#', are ignored, and so are the repeated
+ * classes.
+ */
+class ClassLoadOrder {
+ public:
+  ClassLoadOrder() {}
+
+  ClassLoadOrder(const ClassLoadOrder &) = delete;
+  ClassLoadOrder &operator=(const ClassLoadOrder &) = delete;
+
+  // Reads the profile from the given file. Returns false if it cannot be
+  // read.
+  bool Load(const std::string &path);
+
+  // Adds the classes named by the given profile contents.
+  void Parse(const char *data, size_t size);
+
+  // The entry names of the classes, e.g. "com/foo/Bar.class", in load order.
+  const std::vector<std::string> &entries() const { return entries_; }
+
+  // Returns the position of the entry with the given name in load order,
+  // or -1 if the profile does not name it.
+  ptrdiff_t Rank(const char *name, size_t length) {
+    const size_t *rank = ranks_.Find(name, length);
+    return rank != nullptr ? static_cast<ptrdiff_t>(*rank) : -1;
+  }
+
+ private:
+  // Adds the class named by the line unless the line is to be ignored.
+  void ParseLine(const char *line, const char *end);
+
+  std::vector<std::string> entries_;
+  NameMap<size_t> ranks_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_CLASS_LOAD_ORDER_H_
@@ -0,0 +1,73 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/class_load_order.h"
+
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using Entries = std::vector<std::string>;
+
+Entries Parse(const std::string &profile) {
+  ClassLoadOrder order;
+  order.Parse(profile.data(), profile.size());
+  return order.entries();
+}
+
+TEST(ClassLoadOrderTest, UnifiedLogging) {
+  EXPECT_EQ(
+      Entries({"java/lang/Object.class", "com/foo/Bar$Inner.class"}),
+      Parse("[0.005s][info][class,load] java.lang.Object source: jrt:/java.base\n"
+            "[0.006s][info][class,init] java.lang.String\n"
+            "[0.007s][info][class,load      ] com.foo.Bar$Inner source: "
+            "file:/app.jar\r\n"
+            "[0.008s][info][class,load,cause] com.foo.Baz\n"
+            "[0.009s][info][class,load] com.foo.Bar$$Lambda/0x0000 source: "
+            "com.foo.Bar\n"));
+}
+
+TEST(ClassLoadOrderTest, VerboseClass) {
+  EXPECT_EQ(Entries({"java/lang/Object.class", "com/foo/Bar.class"}),
+            Parse("[Opened /jre/lib/rt.jar]\n"
+                  "[Loaded java.lang.Object from /jre/lib/rt.jar]\n"
+                  "[Loaded com.foo.Bar from file:/app.jar]\n"));
+}
+
+TEST(ClassLoadOrderTest, PlainNames) {
+  EXPECT_EQ(Entries({"com/foo/Bar.class", "com/foo/Baz.class", "Main.class"}),
+            Parse("# Startup classes.\n"
+                  "com.foo.Bar\n"
+                  "\n"
+                  "  com/foo/Baz.class\n"
+                  "com/foo/Bar.class\n"
+                  "Main"));
+}
+
+TEST(ClassLoadOrderTest, Rank) {
+  std::string path = singlejar_test_util::CreateTextFile(
+      "classes.txt", "com.foo.Bar\ncom.foo.Baz\ncom.foo.Bar\n");
+  ClassLoadOrder order;
+  ASSERT_TRUE(order.Load(path));
+  EXPECT_EQ(0, order.Rank("com/foo/Bar.class", 17));
+  EXPECT_EQ(1, order.Rank("com/foo/Baz.class", 17));
+  EXPECT_EQ(-1, order.Rank("com/foo/Qux.class", 17));
+  EXPECT_FALSE(order.Load(path + ".missing"));
+}
+
+}  // namespace
@@ -14,6 +14,7 @@
 
 #include "src/tools/singlejar/combiners.h"
 
+#include <algorithm>
 #include <cctype>
 #include <iostream>
 #include <iterator>
@@ -21,14 +22,14 @@
 #include <string>
 
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/fast_crc32.h"
 
 Combiner::~Combiner() {}
 
 Concatenator::~Concatenator() {}
 
 bool Concatenator::Merge(const CDH *cdh, const LH *lh) {
-  if (insert_newlines_ && buffer_.get() && buffer_->data_size() &&
-      '\n' != buffer_->last_byte()) {
+  if (insert_newlines_ && data_size() && '\n' != last_byte()) {
     Append("\n", 1);
   }
   CreateBuffer();
@@ -39,32 +40,53 @@ bool Concatenator::Merge(const CDH *cdh, const LH *lh) {
       inflater_.reset(new Inflater());
     }
     buffer_->DecompressEntryContents(cdh, lh, inflater_.get());
+  } else if (kZstdMethod == lh->compression_method()) {
+    if (!zstd_decompressor_) {
+      zstd_decompressor_.reset(new ZstdDecompressor());
+    }
+    buffer_->DecompressZstdEntryContents(cdh, lh, zstd_decompressor_.get());
   } else {
     diag_errx(2, "%s is neither stored nor deflated", filename_.c_str());
   }
+  MaybeStream();
   return true;
 }
 
-void *Concatenator::OutputEntry(bool compress) {
-  if (!buffer_) {
-    return nullptr;
+void Concatenator::Stream(int flush) {
+  if (!deflater_) {
+    deflater_.reset(new Deflater());
+    deflated_.reset(new TransientBytes());
   }
+  uint64_t to_stream = buffer_ ? buffer_->data_size() : 0;
+  if (to_stream) {
+    streamed_last_byte_ = buffer_->last_byte();
+    streamed_size_ += to_stream;
+    buffer_->stream_out([&](const void *chunk, uint64_t chunk_size) {
+      const uint8_t *data = reinterpret_cast<const uint8_t *>(chunk);
+      streamed_crc_ = FastCrc32(streamed_crc_, data, chunk_size);
+      to_stream -= chunk_size;
+      deflated_->AppendDeflated(data, chunk_size,
+                                to_stream ? Z_NO_FLUSH : flush,
+                                deflater_.get());
+    });
+    buffer_.reset();
+  } else if (flush != Z_NO_FLUSH) {
+    deflated_->AppendDeflated(nullptr, 0, flush, deflater_.get());
+  }
+}
 
-  // Allocate a contiguous buffer for the local file header and
-  // deflated data. We assume that deflate decreases the size, so if
-  //  the deflater reports overflow, we just save original data.
-  size_t deflated_buffer_size =
-      sizeof(LH) + filename_.size() + buffer_->data_size();
-
+LH *Concatenator::AllocateEntry(uint64_t data_size,
+                                uint64_t payload_size) const {
   // Huge entry (>4GB) needs Zip64 extension field with 64-bit original
   // and compressed size values.
   uint8_t
       zip64_extension_buffer[sizeof(Zip64ExtraField) + 2 * sizeof(uint64_t)];
-  bool huge_buffer = ziph::zfield_needs_ext64(buffer_->data_size());
+  bool huge_buffer = ziph::zfield_needs_ext64(data_size);
+  size_t entry_size = sizeof(LH) + filename_.size() + payload_size;
   if (huge_buffer) {
-    deflated_buffer_size += sizeof(zip64_extension_buffer);
+    entry_size += sizeof(zip64_extension_buffer);
   }
-  LH *lh = reinterpret_cast<LH *>(malloc(deflated_buffer_size));
+  LH *lh = reinterpret_cast<LH *>(malloc(entry_size));
   if (lh == nullptr) {
     return nullptr;
   }
@@ -84,26 +106,18 @@ void *Concatenator::OutputEntry(bool compress) {
         reinterpret_cast<Zip64ExtraField *>(zip64_extension_buffer);
     z64->signature();
     z64->payload_size(2 * sizeof(uint64_t));
-    z64->attr64(0, buffer_->data_size());
+    z64->attr64(0, data_size);
     lh->extra_fields(reinterpret_cast<uint8_t *>(z64), z64->size());
   } else {
-    lh->uncompressed_file_size32(buffer_->data_size());
+    lh->uncompressed_file_size32(data_size);
     lh->extra_fields(nullptr, 0);
   }
+  return lh;
+}
 
-  uint32_t checksum;
-  uint64_t compressed_size;
-  uint16_t method;
-  if (compress) {
-    method = buffer_->CompressOut(lh->data(), &checksum, &compressed_size);
-  } else {
-    buffer_->CopyOut(lh->data(), &checksum);
-    method = Z_NO_COMPRESSION;
-    compressed_size = buffer_->data_size();
-  }
-  lh->crc32(checksum);
-  lh->compression_method(method);
-  if (huge_buffer) {
+// Sets the compressed size of the entry created by AllocateEntry().
+static void SetCompressedSize(LH *lh, uint64_t compressed_size) {
+  if (lh->uncompressed_file_size32() == 0xFFFFFFFF) {
     lh->compressed_file_size32(ziph::zfield_needs_ext64(compressed_size)
                                    ? 0xFFFFFFFF
                                    : compressed_size);
@@ -115,9 +129,133 @@ void *Concatenator::OutputEntry(bool compress) {
     // If original data is <4GB, the compressed one is, too.
     lh->compressed_file_size32(compressed_size);
   }
+}
+
+void *Concatenator::OutputEntry(bool compress) {
+  if (deflater_) {
+    return StreamedOutputEntry(compress);
+  }
+  if (!buffer_) {
+    return nullptr;
+  }
+
+  // Allocate a contiguous buffer for the local file header and
+  // deflated data. We assume that deflate decreases the size, so if
+  //  the deflater reports overflow, we just save original data.
+  LH *lh = AllocateEntry(buffer_->data_size(), buffer_->data_size());
+  if (lh == nullptr) {
+    return nullptr;
+  }
+
+  uint32_t checksum;
+  uint64_t compressed_size;
+  uint16_t method;
+  if (compress && zstd_) {
+    method = buffer_->ZstdCompressOut(lh->data(), &checksum, &compressed_size);
+  } else if (compress) {
+    method = buffer_->CompressOut(lh->data(), &checksum, &compressed_size,
+                                  deflate_backend_);
+  } else {
+    buffer_->CopyOut(lh->data(), &checksum);
+    method = Z_NO_COMPRESSION;
+    compressed_size = buffer_->data_size();
+  }
+  lh->crc32(checksum);
+  lh->compression_method(method);
+  SetCompressedSize(lh, compressed_size);
+  return reinterpret_cast<void *>(lh);
+}
+
+void *Concatenator::OutputLocalHeader(bool compress) {
+  if (!deflater_) {
+    return nullptr;
+  }
+  return AllocateStreamedEntry(compress, false);
+}
+
+void *Concatenator::StreamedOutputEntry(bool compress) {
+  LH *lh = AllocateStreamedEntry(compress, true);
+  if (lh == nullptr) {
+    return nullptr;
+  }
+  uint8_t *out = lh->data();
+  WritePayload([&out](const void *chunk, uint64_t chunk_size) {
+    memcpy(out, chunk, chunk_size);
+    out += chunk_size;
+    return true;
+  });
   return reinterpret_cast<void *>(lh);
 }
 
+LH *Concatenator::AllocateStreamedEntry(bool compress, bool payload) {
+  if (!stream_finished_) {
+    Stream(Z_FINISH);
+    stream_finished_ = true;
+  }
+  // As in TransientBytes::CompressOut, store the data if deflating does not
+  // make it smaller.
+  const uint64_t compressed_size = deflated_->data_size();
+  stream_stored_ = !compress || compressed_size > streamed_size_;
+  const uint64_t payload_size =
+      stream_stored_ ? streamed_size_ : compressed_size;
+  LH *lh = AllocateEntry(streamed_size_, payload ? payload_size : 0);
+  if (lh == nullptr) {
+    return nullptr;
+  }
+  lh->crc32(streamed_crc_);
+  lh->compression_method(stream_stored_ ? Z_NO_COMPRESSION : Z_DEFLATED);
+  SetCompressedSize(lh, payload_size);
+  return lh;
+}
+
+bool Concatenator::WritePayload(
+    const std::function<bool(const void *, uint64_t)> &write) {
+  if (!stream_finished_) {
+    diag_errx(2, "%s:%d: %s: the output entry has not been created", __FILE__,
+              __LINE__, filename_.c_str());
+  }
+  bool ok = true;
+  if (!stream_stored_) {
+    deflated_->stream_out([&](const void *chunk, uint64_t chunk_size) {
+      ok = ok && write(chunk, chunk_size);
+    });
+    return ok;
+  }
+  // Inflate the compressed stream back, one output chunk at a time.
+  static constexpr uint32_t kChunkSize = 0x40000;
+  std::unique_ptr<uint8_t[]> out(new uint8_t[kChunkSize]);
+  Inflater inflater;
+  uint64_t out_left = streamed_size_;
+  deflated_->stream_out([&](const void *chunk, uint64_t chunk_size) {
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(chunk);
+    inflater.DataToInflate(data, chunk_size);
+    int ret;
+    do {
+      uint32_t out_size = static_cast<uint32_t>(
+          std::min(out_left, static_cast<uint64_t>(kChunkSize)));
+      ret = inflater.Inflate(out.get(), out_size);
+      uint32_t inflated = out_size - inflater.available_out();
+      if (inflated) {
+        ok = ok && write(out.get(), inflated);
+        out_left -= inflated;
+      }
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        diag_errx(2, "%s:%d: Internal error inflating %s: %d (%s)", __FILE__,
+                  __LINE__, filename_.c_str(), ret, inflater.error_message());
+      }
+      // The output chunk may have filled up before the input was consumed,
+      // or with more output pending.
+    } while (ret == Z_OK && (inflater.next_in() < data + chunk_size ||
+                             !inflater.available_out()));
+  });
+  if (out_left) {
+    diag_errx(2, "%s:%d: Internal error inflating %s: %" PRIu64
+              " bytes missing", __FILE__, __LINE__, filename_.c_str(),
+              out_left);
+  }
+  return ok;
+}
+
 NullCombiner::~NullCombiner() {}
 
 bool NullCombiner::Merge(const CDH * /*cdh*/, const LH * /*lh*/) {
@@ -131,6 +269,7 @@ XmlCombiner::~XmlCombiner() {}
 bool XmlCombiner::Merge(const CDH *cdh, const LH *lh) {
   if (!concatenator_) {
     concatenator_.reset(new Concatenator(filename_, false));
+    concatenator_->set_streaming_threshold(streaming_threshold_);
     concatenator_->Append(start_tag_);
     concatenator_->Append("\n");
   }
@@ -144,6 +283,11 @@ bool XmlCombiner::Merge(const CDH *cdh, const LH *lh) {
       inflater_.reset(new Inflater());
     }
     bytes_.DecompressEntryContents(cdh, lh, inflater_.get());
+  } else if (kZstdMethod == lh->compression_method()) {
+    if (!zstd_decompressor_) {
+      zstd_decompressor_.reset(new ZstdDecompressor());
+    }
+    bytes_.DecompressZstdEntryContents(cdh, lh, zstd_decompressor_.get());
   } else {
     diag_errx(2, "%s is neither stored nor deflated", filename_.c_str());
   }
@@ -178,6 +322,20 @@ void *XmlCombiner::OutputEntry(bool compress) {
   return concatenator_->OutputEntry(compress);
 }
 
+void *XmlCombiner::OutputLocalHeader(bool compress) {
+  if (!concatenator_ || !concatenator_->streaming()) {
+    return nullptr;
+  }
+  concatenator_->Append(end_tag_);
+  concatenator_->Append("\n");
+  return concatenator_->OutputLocalHeader(compress);
+}
+
+bool XmlCombiner::WritePayload(
+    const std::function<bool(const void *, uint64_t)> &write) {
+  return concatenator_->WritePayload(write);
+}
+
 PropertyCombiner::~PropertyCombiner() {}
 
 bool PropertyCombiner::Merge(const CDH * /*cdh*/, const LH * /*lh*/) {
@@ -248,7 +406,7 @@ void ManifestCombiner::AppendLine(const std::string &line) {
   }
 }
 
-bool ManifestCombiner::Merge(const CDH *cdh, const LH *lh) {
+bool ManifestCombiner::Merge(const CDH * /*cdh*/, const LH * /*lh*/) {
   // Ignore Multi-Release attributes in inputs: we write the manifest first,
   // before inputs are processed, so we reply on  deploy_manifest_lines to
   // create Multi-Release jars instead of doing it automatically based on
@@ -15,14 +15,19 @@
 #ifndef SRC_TOOLS_SINGLEJAR_COMBINERS_H_
 #define SRC_TOOLS_SINGLEJAR_COMBINERS_H_ 1
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "src/tools/singlejar/deflate_backend.h"
+#include "src/tools/singlejar/diag.h"
 #include "src/tools/singlejar/transient_bytes.h"
 #include "src/tools/singlejar/zip_headers.h"
+#include "src/tools/singlejar/zlib_interface.h"
+#include "src/tools/singlejar/zstd_interface.h"
 
 // An interface for combining the files.
 class Combiner {
@@ -36,14 +41,43 @@ class Combiner {
   // Otherwise the payload is compressed, provided that the compressed data
   // is smaller than the original.
   virtual void *OutputEntry(bool compress) = 0;
+  // Same as OutputEntry(), for a payload too large to be held in memory:
+  // the buffer contains the Local Header only, and WritePayload() passes the
+  // payload to `write' in chunks afterwards. Returns nullptr if the payload
+  // is not that large, in which case OutputEntry() is to be called instead.
+  virtual void *OutputLocalHeader(bool /*compress*/) { return nullptr; }
+  // Writes the payload of the entry created by OutputLocalHeader(), stopping
+  // at the first chunk `write' fails to write. Returns false if it did.
+  virtual bool WritePayload(
+      const std::function<bool(const void *, uint64_t)> & /*write*/) {
+    return false;
+  }
 };
 
 // An output jar entry consisting of a concatenation of the input jar
 // entries. Byte sequences can be appended to it, too.
+// Once the concatenated contents exceed the streaming threshold, or start
+// spilling to disk, they are deflated as they are merged, so that at most the
+// threshold amount of uncompressed bytes are kept in memory, along with the
+// compressed stream (which spills to disk, too). Such an entry is output by
+// OutputLocalHeader() and WritePayload(), which keep the memory bounded:
+// OutputEntry() allocates the whole payload. The output is the same either
+// way: if it has to be stored, the compressed stream is inflated back.
 class Concatenator : public Combiner {
  public:
+  static constexpr uint64_t kDefaultStreamingThreshold = 64 * 1024 * 1024;
+
   Concatenator(const std::string &filename, bool insert_newlines = true)
-      : filename_(filename), insert_newlines_(insert_newlines) {}
+      : filename_(filename),
+        insert_newlines_(insert_newlines),
+        streaming_threshold_(kDefaultStreamingThreshold),
+        zstd_(false),
+        deflate_backend_(DeflateBackend::kZlib),
+        streamed_size_(0),
+        streamed_crc_(0),
+        streamed_last_byte_(0),
+        stream_finished_(false),
+        stream_stored_(false) {}
 
   ~Concatenator() override;
 
@@ -51,9 +85,15 @@ class Concatenator : public Combiner {
 
   void *OutputEntry(bool compress) override;
 
+  void *OutputLocalHeader(bool compress) override;
+
+  bool WritePayload(
+      const std::function<bool(const void *, uint64_t)> &write) override;
+
   void Append(const char *s, size_t n) {
     CreateBuffer();
     buffer_->Append(reinterpret_cast<const uint8_t *>(s), n);
+    MaybeStream();
   }
 
   void Append(const char *s) { Append(s, strlen(s)); }
@@ -62,16 +102,77 @@ class Concatenator : public Combiner {
 
   const std::string &filename() const { return filename_; }
 
+  // Sets the amount of uncompressed bytes kept in memory.
+  void set_streaming_threshold(uint64_t threshold) {
+    streaming_threshold_ = threshold;
+  }
+
+  // True if the contents are being deflated as they are merged.
+  bool streaming() const { return deflater_ != nullptr; }
+
+  // Makes OutputEntry(true) compress with Zstandard rather than deflate,
+  // unless the contents are already being streamed.
+  void set_zstd(bool zstd) { zstd_ = zstd; }
+
+  // Sets the backend OutputEntry(true) deflates the buffered contents with,
+  // zlib by default. The streamed contents are always deflated by zlib.
+  void set_deflate_backend(DeflateBackend backend) {
+    deflate_backend_ = backend;
+  }
+
  private:
   void CreateBuffer() {
+    if (stream_finished_) {
+      diag_errx(2, "%s:%d: %s: cannot append after the output entry is created",
+                __FILE__, __LINE__, filename_.c_str());
+    }
     if (!buffer_) {
       buffer_.reset(new TransientBytes());
     }
   }
+  // Streams the buffered bytes if there are too many of them, or if they
+  // no longer fit in memory.
+  void MaybeStream() {
+    if (buffer_->data_size() >= streaming_threshold_ || buffer_->spilled()) {
+      Stream(Z_NO_FLUSH);
+    }
+  }
+  // Deflates the buffered bytes into the compressed stream.
+  void Stream(int flush);
+  void *StreamedOutputEntry(bool compress);
+  // Finishes the compressed stream and allocates its output entry, with room
+  // for `payload' if set. Decides whether the contents are stored.
+  LH *AllocateStreamedEntry(bool compress, bool payload);
+  // The total number of the concatenated bytes and the last one of them.
+  uint64_t data_size() const {
+    return streamed_size_ + (buffer_ ? buffer_->data_size() : 0);
+  }
+  uint8_t last_byte() const {
+    return buffer_ && buffer_->data_size() ? buffer_->last_byte()
+                                            : streamed_last_byte_;
+  }
+  // Allocates an output entry for the payload of the given size and fills
+  // its Local Header, except for the checksum, the compression method and
+  // the compressed size.
+  LH *AllocateEntry(uint64_t data_size, uint64_t payload_size) const;
+
   const std::string filename_;
   std::unique_ptr<TransientBytes> buffer_;
   std::unique_ptr<Inflater> inflater_;
+  std::unique_ptr<ZstdDecompressor> zstd_decompressor_;
   bool insert_newlines_;
+  uint64_t streaming_threshold_;
+  bool zstd_;
+  DeflateBackend deflate_backend_;
+  // The compressed stream, and the size and checksum of its contents.
+  std::unique_ptr<Deflater> deflater_;
+  std::unique_ptr<TransientBytes> deflated_;
+  uint64_t streamed_size_;
+  uint32_t streamed_crc_;
+  uint8_t streamed_last_byte_;
+  bool stream_finished_;
+  // Whether the streamed output entry has the contents stored or deflated.
+  bool stream_stored_;
 };
 
 // The combiner that does nothing. Useful to represent for instance directory
@@ -91,21 +192,34 @@ class XmlCombiner : public Combiner {
   XmlCombiner(const std::string &filename, const std::string &xml_tag)
       : filename_(filename),
         start_tag_("<" + xml_tag + ">"),
-        end_tag_("</" + xml_tag + ">") {}
+        end_tag_("</" + xml_tag + ">"),
+        streaming_threshold_(Concatenator::kDefaultStreamingThreshold) {}
   ~XmlCombiner() override;
 
   bool Merge(const CDH *cdh, const LH *lh) override;
 
   void *OutputEntry(bool compress) override;
 
+  void *OutputLocalHeader(bool compress) override;
+
+  bool WritePayload(
+      const std::function<bool(const void *, uint64_t)> &write) override;
+
   const std::string filename() const { return filename_; }
 
+  // See Concatenator::set_streaming_threshold().
+  void set_streaming_threshold(uint64_t threshold) {
+    streaming_threshold_ = threshold;
+  }
+
  private:
   const std::string filename_;
   const std::string start_tag_;
   const std::string end_tag_;
+  uint64_t streaming_threshold_;
   std::unique_ptr<Concatenator> concatenator_;
   std::unique_ptr<Inflater> inflater_;
+  std::unique_ptr<ZstdDecompressor> zstd_decompressor_;
 };
 
 // A wrapper around Concatenator allowing to append
@@ -14,6 +14,12 @@
 
 #include "src/tools/singlejar/combiners.h"
 
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <string>
+
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/test_util.h"
 #include "src/tools/singlejar/zip_headers.h"
@@ -113,6 +119,152 @@ TEST_F(CombinersTest, ConcatenatorSmall) {
   free(reinterpret_cast<void *>(entry));
 }
 
+// Returns the size of the given output entry: Local Header plus payload.
+static size_t EntrySize(const void *entry) {
+  const LH *lh = reinterpret_cast<const LH *>(entry);
+  return lh->size() + lh->in_zip_size();
+}
+
+// Verifies that the given combiners produce identical output entries.
+static void ExpectSameEntries(Combiner *expected, Combiner *actual,
+                              bool compress) {
+  void *expected_entry = expected->OutputEntry(compress);
+  void *actual_entry = actual->OutputEntry(compress);
+  ASSERT_NE(nullptr, expected_entry);
+  ASSERT_NE(nullptr, actual_entry);
+  ASSERT_EQ(EntrySize(expected_entry), EntrySize(actual_entry));
+  EXPECT_EQ(0, memcmp(expected_entry, actual_entry, EntrySize(actual_entry)));
+  free(expected_entry);
+  free(actual_entry);
+}
+
+// Expects the entry written in chunks by `actual' to be the same as the one
+// `expected' outputs as a whole.
+static void ExpectSameChunkedEntry(Combiner *expected, Combiner *actual,
+                                   bool compress) {
+  void *expected_entry = expected->OutputEntry(compress);
+  LH *actual_lh = reinterpret_cast<LH *>(actual->OutputLocalHeader(compress));
+  ASSERT_NE(nullptr, expected_entry);
+  ASSERT_NE(nullptr, actual_lh);
+  std::string actual_entry(reinterpret_cast<char *>(actual_lh),
+                           actual_lh->size());
+  free(actual_lh);
+  ASSERT_TRUE(actual->WritePayload([&](const void *chunk, uint64_t size) {
+    actual_entry.append(reinterpret_cast<const char *>(chunk), size);
+    return true;
+  }));
+  ASSERT_EQ(EntrySize(expected_entry), actual_entry.size());
+  EXPECT_EQ(0, memcmp(expected_entry, actual_entry.data(),
+                      actual_entry.size()));
+  free(expected_entry);
+}
+
+// Test that the Concatenator which deflates its contents as they arrive
+// creates the same output as the one which keeps them in memory.
+TEST_F(CombinersTest, ConcatenatorStreaming) {
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open("combiners.zip"));
+  Concatenator buffered("concat");
+  Concatenator streamed("concat");
+  streamed.set_streaming_threshold(1000);
+  uint32_t seed = 1;
+  for (int i = 0; i < 300; ++i) {
+    // Mix compressible and incompressible data.
+    char chunk[500];
+    for (size_t j = 0; j < sizeof(chunk); ++j) {
+      seed = seed * 1103515245 + 12345;
+      chunk[j] = i % 2 ? 'a' + j % 3 : static_cast<char>(seed >> 16);
+    }
+    buffered.Append(chunk, sizeof(chunk));
+    streamed.Append(chunk, sizeof(chunk));
+    const LH *lh;
+    const CDH *cdh;
+    while ((cdh = input_jar.NextEntry(&lh))) {
+      ASSERT_TRUE(buffered.Merge(cdh, lh));
+      ASSERT_TRUE(streamed.Merge(cdh, lh));
+    }
+    ASSERT_TRUE(input_jar.Close());
+    ASSERT_TRUE(input_jar.Open("combiners.zip"));
+  }
+  EXPECT_FALSE(buffered.streaming());
+  EXPECT_TRUE(streamed.streaming());
+  ExpectSameEntries(&buffered, &streamed, true);
+  ExpectSameEntries(&buffered, &streamed, false);
+  EXPECT_EQ(nullptr, buffered.OutputLocalHeader(true));
+  ExpectSameChunkedEntry(&buffered, &streamed, true);
+  ExpectSameChunkedEntry(&buffered, &streamed, false);
+}
+
+// Test that the streaming Concatenator stores the contents which do not
+// compress, as the buffering one does.
+TEST_F(CombinersTest, ConcatenatorStreamingIncompressible) {
+  Concatenator buffered("random");
+  Concatenator streamed("random");
+  streamed.set_streaming_threshold(4096);
+  uint32_t seed = 1;
+  for (int i = 0; i < 100000; ++i) {
+    seed = seed * 1103515245 + 12345;
+    char c = static_cast<char>(seed >> 16);
+    buffered.Append(&c, 1);
+    streamed.Append(&c, 1);
+  }
+  EXPECT_TRUE(streamed.streaming());
+  void *entry = streamed.OutputEntry(true);
+  ASSERT_NE(nullptr, entry);
+  EXPECT_EQ(Z_NO_COMPRESSION,
+            reinterpret_cast<LH *>(entry)->compression_method());
+  free(entry);
+  ExpectSameEntries(&buffered, &streamed, true);
+  ExpectSameChunkedEntry(&buffered, &streamed, true);
+}
+
+// Test that a Concatenator spilling to disk streams its contents, and that
+// writing them in chunks keeps the memory in use well below their size.
+TEST_F(CombinersTest, ConcatenatorSpilledBoundedMemory) {
+#ifdef __linux__
+  const uint64_t kSize = 256 << 20;
+  TransientBytes::set_memory_limit(4 << 20);
+  struct rusage usage;
+  ASSERT_EQ(0, getrusage(RUSAGE_SELF, &usage));
+  const long initial_max_rss_kb = usage.ru_maxrss;
+
+  Concatenator concatenator("random");
+  // Incompressible data, so that the compressed stream is inflated back.
+  std::unique_ptr<char[]> chunk(new char[1 << 20]);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < (1 << 20); ++i) {
+    seed = seed * 1103515245 + 12345;
+    chunk[i] = static_cast<char>(seed >> 16);
+  }
+  for (uint64_t appended = 0; appended < kSize; appended += 1 << 20) {
+    concatenator.Append(chunk.get(), 1 << 20);
+  }
+  EXPECT_TRUE(concatenator.streaming());
+
+  LH *lh = reinterpret_cast<LH *>(concatenator.OutputLocalHeader(true));
+  ASSERT_NE(nullptr, lh);
+  EXPECT_EQ(Z_NO_COMPRESSION, lh->compression_method());
+  EXPECT_EQ(kSize, lh->uncompressed_file_size());
+  EXPECT_EQ(kSize, lh->compressed_file_size());
+  uint64_t written = 0;
+  uint32_t crc = 0;
+  ASSERT_TRUE(concatenator.WritePayload([&](const void *data, uint64_t size) {
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(data), size);
+    written += size;
+    return true;
+  }));
+  EXPECT_EQ(kSize, written);
+  EXPECT_EQ(lh->crc32(), crc);
+  free(lh);
+  TransientBytes::set_memory_limit(0);
+
+  ASSERT_EQ(0, getrusage(RUSAGE_SELF, &usage));
+  EXPECT_LT(usage.ru_maxrss - initial_max_rss_kb, (kSize >> 10) / 4);
+#else
+  GTEST_SKIP() << "the maximum resident set size is only checked on Linux";
+#endif
+}
+
 // Tests that Concatenator creates huge (>4GB original/compressed sizes)
 // correctly. This test is slow.
 TEST_F(CombinersTest, ConcatenatorHuge) {
@@ -200,6 +352,26 @@ TEST_F(CombinersTest, XmlCombiner) {
   free(reinterpret_cast<void *>(entry));
 }
 
+// Test that the XmlCombiner output does not change once its contents are
+// streamed.
+TEST_F(CombinersTest, XmlCombinerStreaming) {
+  InputJar input_jar;
+  XmlCombiner buffered("combined.xml", "toplevel");
+  XmlCombiner streamed("combined.xml", "toplevel");
+  streamed.set_streaming_threshold(16);
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(input_jar.Open("combiners.zip"));
+    const LH *lh;
+    const CDH *cdh;
+    while ((cdh = input_jar.NextEntry(&lh))) {
+      ASSERT_TRUE(buffered.Merge(cdh, lh));
+      ASSERT_TRUE(streamed.Merge(cdh, lh));
+    }
+    ASSERT_TRUE(input_jar.Close());
+  }
+  ExpectSameEntries(&buffered, &streamed, true);
+}
+
 // Test PropertyCombiner.
 TEST_F(CombinersTest, PropertyCombiner) {
   static char kProperties[] =
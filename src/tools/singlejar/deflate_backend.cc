@@ -0,0 +1,263 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/deflate_backend.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include <algorithm>
+
+#include "src/tools/singlejar/diag.h"
+#include <zlib.h>
+
+namespace {
+
+// The bits of libdeflate.h we use, all of them stable since libdeflate 1.0.
+enum { LIBDEFLATE_SUCCESS = 0 };
+
+struct LibdeflateLibrary {
+  void *(*allocCompressor)(int level);
+  size_t (*compress)(void *compressor, const void *in, size_t in_nbytes,
+                     void *out, size_t out_nbytes_avail);
+  void (*freeCompressor)(void *compressor);
+  void *(*allocDecompressor)();
+  int (*decompress)(void *decompressor, const void *in, size_t in_nbytes,
+                    void *out, size_t out_nbytes_avail,
+                    size_t *actual_out_nbytes_ret);
+  void (*freeDecompressor)(void *decompressor);
+};
+
+// The level matching zlib's Z_DEFAULT_COMPRESSION.
+const int kCompressionLevel = 6;
+
+// The largest amount zlib takes in or puts out in one go.
+const size_t kMaxZlibChunk = 0xFFFFFFFF;
+
+void *OpenLibrary() {
+#ifdef _WIN32
+  return LoadLibraryA("libdeflate.dll");
+#else
+#ifdef __APPLE__
+  static const char *const kNames[] = {"libdeflate.0.dylib",
+                                       "libdeflate.dylib"};
+#else
+  static const char *const kNames[] = {"libdeflate.so.0", "libdeflate.so"};
+#endif
+  for (const char *name : kNames) {
+    void *handle = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+    if (handle != nullptr) {
+      return handle;
+    }
+  }
+  return nullptr;
+#endif
+}
+
+template <typename Function>
+bool Resolve(void *library, const char *name, Function *function) {
+#ifdef _WIN32
+  *function = reinterpret_cast<Function>(
+      GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+  *function = reinterpret_cast<Function>(dlsym(library, name));
+#endif
+  return *function != nullptr;
+}
+
+// Returns libdeflate, or nullptr if it cannot be loaded. It is never
+// unloaded.
+const LibdeflateLibrary *Library() {
+  static LibdeflateLibrary library;
+  static const bool loaded = [] {
+    void *handle = OpenLibrary();
+    return handle != nullptr &&
+           Resolve(handle, "libdeflate_alloc_compressor",
+                   &library.allocCompressor) &&
+           Resolve(handle, "libdeflate_deflate_compress", &library.compress) &&
+           Resolve(handle, "libdeflate_free_compressor",
+                   &library.freeCompressor) &&
+           Resolve(handle, "libdeflate_alloc_decompressor",
+                   &library.allocDecompressor) &&
+           Resolve(handle, "libdeflate_deflate_decompress",
+                   &library.decompress) &&
+           Resolve(handle, "libdeflate_free_decompressor",
+                   &library.freeDecompressor);
+  }();
+  return loaded ? &library : nullptr;
+}
+
+const LibdeflateLibrary *RequireLibrary() {
+  const LibdeflateLibrary *library = Library();
+  if (library == nullptr) {
+    diag_errx(1, "%s:%d: libdeflate cannot be loaded", __FILE__, __LINE__);
+  }
+  return library;
+}
+
+// The compressor and decompressor of a thread. Allocating them is not
+// cheap, the compressor alone takes hundreds of kilobytes, so each thread
+// keeps its own for all the entries.
+class LibdeflateState {
+ public:
+  explicit LibdeflateState(const LibdeflateLibrary *library)
+      : library_(library), compressor_(nullptr), decompressor_(nullptr) {}
+
+  ~LibdeflateState() {
+    if (compressor_ != nullptr) {
+      library_->freeCompressor(compressor_);
+    }
+    if (decompressor_ != nullptr) {
+      library_->freeDecompressor(decompressor_);
+    }
+  }
+
+  LibdeflateState(const LibdeflateState &) = delete;
+  LibdeflateState &operator=(const LibdeflateState &) = delete;
+
+  void *compressor() {
+    if (compressor_ == nullptr) {
+      compressor_ = library_->allocCompressor(kCompressionLevel);
+      if (compressor_ == nullptr) {
+        diag_errx(2, "%s:%d: libdeflate_alloc_compressor failed", __FILE__,
+                  __LINE__);
+      }
+    }
+    return compressor_;
+  }
+
+  void *decompressor() {
+    if (decompressor_ == nullptr) {
+      decompressor_ = library_->allocDecompressor();
+      if (decompressor_ == nullptr) {
+        diag_errx(2, "%s:%d: libdeflate_alloc_decompressor failed", __FILE__,
+                  __LINE__);
+      }
+    }
+    return decompressor_;
+  }
+
+ private:
+  const LibdeflateLibrary *library_;
+  void *compressor_;
+  void *decompressor_;
+};
+
+LibdeflateState *ThreadState() {
+  static thread_local LibdeflateState state(RequireLibrary());
+  return &state;
+}
+
+bool ZlibInflate(const uint8_t *in, size_t in_size, uint8_t *out,
+                 size_t out_size) {
+  z_stream stream = {};
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    return false;
+  }
+  int ret;
+  do {
+    // Only ever hand zlib more input or output once it has run out of it.
+    if (stream.avail_in == 0) {
+      stream.next_in = const_cast<uint8_t *>(in);
+      stream.avail_in = std::min(in_size, kMaxZlibChunk);
+      in += stream.avail_in;
+      in_size -= stream.avail_in;
+    }
+    if (stream.avail_out == 0) {
+      stream.next_out = out;
+      stream.avail_out = std::min(out_size, kMaxZlibChunk);
+      out += stream.avail_out;
+      out_size -= stream.avail_out;
+    }
+    ret = inflate(&stream, Z_FINISH);
+  } while (ret == Z_BUF_ERROR &&
+           ((stream.avail_in == 0 && in_size) ||
+            (stream.avail_out == 0 && out_size)));
+  // All the output space has to be used up, and nothing more produced.
+  bool ok = ret == Z_STREAM_END && stream.avail_out == 0 && out_size == 0;
+  inflateEnd(&stream);
+  return ok;
+}
+
+size_t ZlibDeflate(const uint8_t *in, size_t in_size, uint8_t *out,
+                   size_t out_capacity) {
+  z_stream stream = {};
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    diag_errx(2, "%s:%d: deflateInit2 failed", __FILE__, __LINE__);
+  }
+  size_t produced = 0;
+  int ret = Z_OK;
+  do {
+    if (stream.avail_in == 0) {
+      stream.next_in = const_cast<uint8_t *>(in);
+      stream.avail_in = std::min(in_size, kMaxZlibChunk);
+      in += stream.avail_in;
+      in_size -= stream.avail_in;
+    }
+    if (stream.avail_out == 0) {
+      if (produced == out_capacity) {
+        break;
+      }
+      stream.next_out = out + produced;
+      stream.avail_out = std::min(out_capacity - produced, kMaxZlibChunk);
+    }
+    uInt avail_out = stream.avail_out;
+    ret = deflate(&stream, in_size ? Z_NO_FLUSH : Z_FINISH);
+    produced += avail_out - stream.avail_out;
+    if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END) {
+      diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
+                stream.msg);
+    }
+  } while (ret != Z_STREAM_END);
+  deflateEnd(&stream);
+  return ret == Z_STREAM_END ? produced : 0;
+}
+
+}  // namespace
+
+bool LibdeflateAvailable() { return Library() != nullptr; }
+
+DeflateBackend InflateBackend() {
+  return LibdeflateAvailable() ? DeflateBackend::kLibdeflate
+                               : DeflateBackend::kZlib;
+}
+
+bool InflateBuffer(DeflateBackend backend, const uint8_t *in, size_t in_size,
+                   uint8_t *out, size_t out_size) {
+  if (backend == DeflateBackend::kZlib) {
+    return ZlibInflate(in, in_size, out, out_size);
+  }
+  const LibdeflateLibrary *library = RequireLibrary();
+  // Without the actual size to return, libdeflate fails unless the data
+  // inflate to exactly out_size bytes.
+  return library->decompress(ThreadState()->decompressor(), in, in_size, out,
+                             out_size, nullptr) == LIBDEFLATE_SUCCESS;
+}
+
+size_t DeflateBuffer(DeflateBackend backend, const uint8_t *in, size_t in_size,
+                     uint8_t *out, size_t out_capacity) {
+  if (backend == DeflateBackend::kZlib) {
+    return ZlibDeflate(in, in_size, out, out_capacity);
+  }
+  const LibdeflateLibrary *library = RequireLibrary();
+  return library->compress(ThreadState()->compressor(), in, in_size, out,
+                           out_capacity);
+}
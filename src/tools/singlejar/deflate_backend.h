@@ -0,0 +1,52 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_DEFLATE_BACKEND_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_DEFLATE_BACKEND_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Deflate and inflate whole buffers at once, as opposed to the Deflater and
+// Inflater of zlib_interface.h, which stream. This is the common case:
+// the input entries are mmapped, and their sizes are known up front.
+//
+// Either zlib or libdeflate does the work. libdeflate is a few times faster,
+// but it is loaded at run time rather than linked in. It inflates to the
+// same bytes as zlib, so it is used for that whenever it is available. It
+// deflates to different bytes than zlib though, so it is only used for that
+// when asked to, lest the output depend on the machine.
+enum class DeflateBackend { kZlib, kLibdeflate };
+
+// Whether libdeflate is available.
+bool LibdeflateAvailable();
+
+// The backend inflating is done with: libdeflate if available, zlib
+// otherwise.
+DeflateBackend InflateBackend();
+
+// Inflates the raw deflate data 'in' into exactly 'out_size' bytes at 'out'.
+// Returns false if the data are corrupt or inflate to another size.
+// Exits if the backend is libdeflate and it is not available.
+bool InflateBuffer(DeflateBackend backend, const uint8_t *in, size_t in_size,
+                   uint8_t *out, size_t out_size);
+
+// Deflates 'in' at the default compression level into 'out', which is
+// 'out_capacity' bytes long. Returns the compressed size, or 0 if it would
+// exceed out_capacity. Exits if the backend is libdeflate and it is not
+// available.
+size_t DeflateBuffer(DeflateBackend backend, const uint8_t *in, size_t in_size,
+                     uint8_t *out, size_t out_capacity);
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_DEFLATE_BACKEND_H_
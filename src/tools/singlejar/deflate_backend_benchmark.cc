@@ -0,0 +1,188 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Compares the whole-buffer deflate backends on the contents of the given
+ * jars' entries, or without jars, on generated entries that compress about
+ * as well as class files. Usage:
+ *   deflate_backend_benchmark [--iterations N] [jar...]
+ * For each backend, it prints the median time to deflate and to inflate all
+ * the entries, and the compressed size.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "src/tools/singlejar/deflate_backend.h"
+#include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/zip_headers.h"
+#include <zlib.h>
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+// Appends the uncompressed contents of the file entries of the jar.
+void ReadJar(const char *jar_path, std::vector<Bytes> *entries) {
+  InputJar input_jar;
+  if (!input_jar.Open(jar_path)) {
+    diag_errx(1, "%s:%d: Cannot open %s", __FILE__, __LINE__, jar_path);
+  }
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    Bytes contents(cdh->uncompressed_file_size());
+    if (contents.empty()) {
+      continue;
+    }
+    if (cdh->compression_method() == Z_NO_COMPRESSION) {
+      memcpy(contents.data(), lh->data(), contents.size());
+    } else if (cdh->compression_method() != Z_DEFLATED ||
+               !InflateBuffer(DeflateBackend::kZlib, lh->data(),
+                              cdh->compressed_file_size(), contents.data(),
+                              contents.size())) {
+      continue;
+    }
+    entries->push_back(std::move(contents));
+  }
+}
+
+// Generates entries of a few kilobytes made of a limited vocabulary.
+void GenerateEntries(std::vector<Bytes> *entries) {
+  static const char *const kWords[] = {
+      "java/lang/Object", "<init>",     "()V",    "Code",
+      "LineNumberTable",  "this",       "get",    "Ljava/lang/String;",
+      "java/util/List",   "SourceFile", "value",  "set"};
+  uint32_t seed = 1;
+  for (int i = 0; i < 4000; ++i) {
+    Bytes entry;
+    size_t size = 1000 + (i * 7919) % 12000;
+    while (entry.size() < size) {
+      seed = seed * 1103515245 + 12345;
+      const char *word = kWords[(seed >> 16) % (sizeof(kWords) /
+                                                sizeof(kWords[0]))];
+      entry.insert(entry.end(), word, word + strlen(word));
+      entry.push_back(static_cast<uint8_t>(seed >> 24));
+    }
+    entries->push_back(std::move(entry));
+  }
+}
+
+double Median(std::vector<double> *samples) {
+  std::sort(samples->begin(), samples->end());
+  return (*samples)[samples->size() / 2];
+}
+
+void Run(const char *name, DeflateBackend backend,
+         const std::vector<Bytes> &entries, int iterations) {
+  std::vector<Bytes> compressed(entries.size());
+  std::vector<Bytes> inflated(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    // Room for the entries that deflating makes larger.
+    compressed[i].resize(entries[i].size() + entries[i].size() / 100 + 64);
+    inflated[i].resize(entries[i].size());
+  }
+  std::vector<double> deflate_seconds;
+  std::vector<double> inflate_seconds;
+  uint64_t total_compressed = 0;
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    total_compressed = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < entries.size(); ++i) {
+      size_t size =
+          DeflateBuffer(backend, entries[i].data(), entries[i].size(),
+                        compressed[i].data(), compressed[i].size());
+      if (size == 0) {
+        diag_errx(1, "%s:%d: %s cannot deflate entry %zu", __FILE__,
+                  __LINE__, name, i);
+      }
+      compressed[i].resize(size);
+      total_compressed += size;
+    }
+    auto deflated = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (!InflateBuffer(backend, compressed[i].data(), compressed[i].size(),
+                         inflated[i].data(), inflated[i].size())) {
+        diag_errx(1, "%s:%d: %s cannot inflate entry %zu", __FILE__,
+                  __LINE__, name, i);
+      }
+    }
+    auto end = std::chrono::steady_clock::now();
+    deflate_seconds.push_back(
+        std::chrono::duration<double>(deflated - start).count());
+    inflate_seconds.push_back(
+        std::chrono::duration<double>(end - deflated).count());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      if (inflated[i] != entries[i]) {
+        diag_errx(1, "%s:%d: %s does not round trip entry %zu", __FILE__,
+                  __LINE__, name, i);
+      }
+      compressed[i].resize(entries[i].size() + entries[i].size() / 100 + 64);
+    }
+  }
+  printf("%-10s deflate %8.3f ms  inflate %8.3f ms  compressed %" PRIu64
+         " bytes\n",
+         name, Median(&deflate_seconds) * 1e3, Median(&inflate_seconds) * 1e3,
+         total_compressed);
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage: deflate_backend_benchmark [--iterations N] [jar...]\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int iterations = 11;
+  std::vector<Bytes> entries;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+    } else if (argv[i][0] == '-') {
+      Usage();
+    } else {
+      ReadJar(argv[i], &entries);
+    }
+  }
+  if (iterations <= 0) {
+    Usage();
+  }
+  if (entries.empty()) {
+    GenerateEntries(&entries);
+  }
+  uint64_t total = 0;
+  for (const Bytes &entry : entries) {
+    total += entry.size();
+  }
+  printf("%zu entries, %" PRIu64 " bytes, median of %d runs\n",
+         entries.size(), total, iterations);
+  Run("zlib", DeflateBackend::kZlib, entries, iterations);
+  if (LibdeflateAvailable()) {
+    Run("libdeflate", DeflateBackend::kLibdeflate, entries, iterations);
+  } else {
+    printf("libdeflate cannot be loaded\n");
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/deflate_backend.h"
+
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+class DeflateBackendTest : public ::testing::TestWithParam<DeflateBackend> {
+ protected:
+  void SetUp() override {
+    if (GetParam() == DeflateBackend::kLibdeflate && !LibdeflateAvailable()) {
+      GTEST_SKIP() << "libdeflate is not available";
+    }
+    for (size_t i = 0; i < 100000; ++i) {
+      data_.push_back(static_cast<uint8_t>((i * i) % 251));
+    }
+  }
+
+  std::vector<uint8_t> data_;
+};
+
+TEST_P(DeflateBackendTest, RoundTrip) {
+  std::vector<uint8_t> compressed(data_.size());
+  size_t size = DeflateBuffer(GetParam(), data_.data(), data_.size(),
+                              compressed.data(), compressed.size());
+  ASSERT_LT(0UL, size);
+  EXPECT_LT(size, data_.size());
+  std::vector<uint8_t> out(data_.size());
+  ASSERT_TRUE(InflateBuffer(GetParam(), compressed.data(), size, out.data(),
+                            out.size()));
+  EXPECT_EQ(data_, out);
+}
+
+// Each backend inflates what the other one deflated.
+TEST_P(DeflateBackendTest, InflatesTheOtherBackend) {
+  if (!LibdeflateAvailable()) {
+    GTEST_SKIP() << "libdeflate is not available";
+  }
+  DeflateBackend other = GetParam() == DeflateBackend::kZlib
+                             ? DeflateBackend::kLibdeflate
+                             : DeflateBackend::kZlib;
+  std::vector<uint8_t> compressed(data_.size());
+  size_t size = DeflateBuffer(other, data_.data(), data_.size(),
+                              compressed.data(), compressed.size());
+  ASSERT_LT(0UL, size);
+  std::vector<uint8_t> out(data_.size());
+  ASSERT_TRUE(InflateBuffer(GetParam(), compressed.data(), size, out.data(),
+                            out.size()));
+  EXPECT_EQ(data_, out);
+}
+
+TEST_P(DeflateBackendTest, DoesNotFit) {
+  std::vector<uint8_t> compressed(16);
+  EXPECT_EQ(0UL, DeflateBuffer(GetParam(), data_.data(), data_.size(),
+                               compressed.data(), compressed.size()));
+}
+
+// The data have to inflate to exactly the given size.
+TEST_P(DeflateBackendTest, WrongSize) {
+  std::vector<uint8_t> compressed(data_.size());
+  size_t size = DeflateBuffer(GetParam(), data_.data(), data_.size(),
+                              compressed.data(), compressed.size());
+  ASSERT_LT(0UL, size);
+  std::vector<uint8_t> out(data_.size() + 1);
+  EXPECT_FALSE(InflateBuffer(GetParam(), compressed.data(), size, out.data(),
+                             data_.size() - 1));
+  EXPECT_FALSE(InflateBuffer(GetParam(), compressed.data(), size, out.data(),
+                             data_.size() + 1));
+}
+
+TEST_P(DeflateBackendTest, Corrupt) {
+  const uint8_t garbage[] = {0xff, 0xff, 0xff, 0xff};
+  uint8_t out[16];
+  EXPECT_FALSE(
+      InflateBuffer(GetParam(), garbage, sizeof(garbage), out, sizeof(out)));
+}
+
+TEST_P(DeflateBackendTest, Empty) {
+  uint8_t compressed[16];
+  size_t size =
+      DeflateBuffer(GetParam(), nullptr, 0, compressed, sizeof(compressed));
+  ASSERT_LT(0UL, size);
+  uint8_t out[1];
+  EXPECT_TRUE(InflateBuffer(GetParam(), compressed, size, out, 0));
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, DeflateBackendTest,
+                         ::testing::Values(DeflateBackend::kZlib,
+                                           DeflateBackend::kLibdeflate));
+
+}  // namespace
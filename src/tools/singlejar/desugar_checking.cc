@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "src/tools/singlejar/desugar_checking.h"
+
+#include <algorithm>
+
 #include "src/tools/singlejar/diag.h"
 #include "src/main/protobuf/desugar_deps.pb.h"
 
@@ -26,6 +29,11 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
       inflater_.reset(new Inflater());
     }
     buffer_->DecompressEntryContents(cdh, lh, inflater_.get());
+  } else if (kZstdMethod == lh->compression_method()) {
+    if (!zstd_decompressor_) {
+      zstd_decompressor_.reset(new ZstdDecompressor());
+    }
+    buffer_->DecompressZstdEntryContents(cdh, lh, zstd_decompressor_.get());
   } else {
     diag_errx(2, "META-INF/desugar_deps is neither stored nor deflated");
   }
@@ -38,6 +46,15 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
   buffer_->CopyOut(reinterpret_cast<uint8_t *>(buf), &checksum);
   buffer_.reset();  // release buffer eagerly
 
+  if (indexer_) {
+    indexer_->Submit<void>([this, buf, data_size] { Index(buf, data_size); });
+  } else {
+    Index(buf, data_size);
+  }
+  return true;
+}
+
+void Java8DesugarDepsChecker::Index(uint8_t *buf, size_t data_size) {
   bazel::tools::desugar::DesugarDepsInfo deps_info;
   google::protobuf::io::CodedInputStream content(buf, data_size);
   if (!deps_info.ParseFromCodedStream(&content)) {
@@ -51,30 +68,39 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
   for (const auto &assume_present : deps_info.assume_present()) {
     // This means we need file named <target>.class in the output.  Remember
     // the first origin of this requirement for error messages, drop others.
-    needed_deps_.emplace(assume_present.target().binary_name() + ".class",
-                         assume_present.origin().binary_name());
+    uint32_t origin = Intern(assume_present.origin().binary_name());
+    uint32_t target = Intern(assume_present.target().binary_name());
+    if (classes_[target].needed_by == kNone) {
+      classes_[target].needed_by = origin;
+    }
   }
 
   for (const auto &missing : deps_info.missing_interface()) {
     // Remember the first origin of this requirement for error messages, drop
     // subsequent ones.
-    missing_interfaces_.emplace(missing.target().binary_name(),
-                                missing.origin().binary_name());
+    uint32_t origin = Intern(missing.origin().binary_name());
+    uint32_t target = Intern(missing.target().binary_name());
+    if (classes_[target].missed_by == kNone) {
+      classes_[target].missed_by = origin;
+    }
   }
 
   for (const auto &extends : deps_info.interface_with_supertypes()) {
     // Remember interface hierarchy the first time we see this interface, drop
     // subsequent ones for consistency with how singlejar will keep the first
     // occurrence of the file defining the interface.  We'll lazily derive
-    // whether missing_interfaces_ inherit default methods with this data later.
+    // whether missing interfaces inherit default methods with this data later.
     if (extends.extended_interface_size() > 0) {
-      std::vector<std::string> extended;
-      extended.reserve(extends.extended_interface_size());
+      uint32_t origin = Intern(extends.origin().binary_name());
+      if (classes_[origin].extended_begin != classes_[origin].extended_end) {
+        continue;
+      }
+      uint32_t begin = extended_.size();
       for (const auto &itf : extends.extended_interface()) {
-        extended.push_back(itf.binary_name());
+        extended_.push_back(Intern(itf.binary_name()));
       }
-      extended_interfaces_.emplace(extends.origin().binary_name(),
-                                   std::move(extended));
+      classes_[origin].extended_begin = begin;
+      classes_[origin].extended_end = extended_.size();
     }
   }
 
@@ -83,21 +109,53 @@ bool Java8DesugarDepsChecker::Merge(const CDH *cdh, const LH *lh) {
     // For all other interfaces we'll transitively check extended interfaces
     // in HasDefaultMethods.
     if (companion.num_default_methods() > 0) {
-      has_default_methods_[companion.origin().binary_name()] = true;
+      classes_[Intern(companion.origin().binary_name())].resolution =
+          kDefaultMethods;
     }
   }
-  return true;
+}
+
+uint32_t Java8DesugarDepsChecker::Intern(const std::string &name) {
+  auto inserted = ids_.Emplace(name, static_cast<uint32_t>(names_.size()));
+  if (inserted.second) {
+    names_.push_back(name);
+    classes_.emplace_back();
+  }
+  return *inserted.first;
 }
 
 void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
+  // Wait for the pending Index() calls.
+  indexer_.reset();
+
+  // Go through the names in order so that the first error is deterministic.
+  std::vector<std::pair<std::string, uint32_t>> needed_deps;
+  std::vector<uint32_t> missing_interfaces;
+  size_t sub_interfaces = 0;
+  size_t with_default_methods = 0;
+  for (uint32_t id = 0; id < classes_.size(); ++id) {
+    const ClassInfo &info = classes_[id];
+    if (info.needed_by != kNone) {
+      needed_deps.emplace_back(names_[id] + ".class", info.needed_by);
+    }
+    if (info.missed_by != kNone) {
+      missing_interfaces.push_back(id);
+    }
+    sub_interfaces += info.extended_begin != info.extended_end;
+    with_default_methods += info.resolution == kDefaultMethods;
+  }
+  std::sort(needed_deps.begin(), needed_deps.end());
+  std::sort(missing_interfaces.begin(), missing_interfaces.end(),
+            [this](uint32_t a, uint32_t b) { return names_[a] < names_[b]; });
+
   if (verbose_) {
-    fprintf(stderr, "Needed deps: %zu\n", needed_deps_.size());
-    fprintf(stderr, "Interfaces to check: %zu\n", missing_interfaces_.size());
-    fprintf(stderr, "Sub-interfaces: %zu\n", extended_interfaces_.size());
+    fprintf(stderr, "Needed deps: %zu\n", needed_deps.size());
+    fprintf(stderr, "Interfaces to check: %zu\n", missing_interfaces.size());
+    fprintf(stderr, "Sub-interfaces: %zu\n", sub_interfaces);
     fprintf(stderr, "Interfaces w/ default methods: %zu\n",
-            has_default_methods_.size());
+            with_default_methods);
   }
-  for (const auto &needed : needed_deps_) {
+  for (const auto &needed : needed_deps) {
     if (verbose_) {
       fprintf(stderr, "Looking for %s\n", needed.first.c_str());
     }
@@ -106,24 +164,24 @@ void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
         diag_errx(2,
                   "%s referenced by %s but not found.  Is the former defined"
                   " in a neverlink library?",
-                  needed.first.c_str(), needed.second.c_str());
+                  needed.first.c_str(), names_[needed.second].c_str());
       } else {
         error_ = true;
       }
     }
   }
 
-  for (const auto &missing : missing_interfaces_) {
+  for (uint32_t id : missing_interfaces) {
     if (verbose_) {
-      fprintf(stderr, "Checking %s\n", missing.first.c_str());
+      fprintf(stderr, "Checking %s\n", names_[id].c_str());
     }
-    if (HasDefaultMethods(missing.first)) {
+    if (HasDefaultMethods(id)) {
       if (fail_on_error_) {
         diag_errx(
             2,
             "%s needed on the classpath for desugaring %s.  Please add"
             " the missing dependency to the target containing the latter.",
-            missing.first.c_str(), missing.second.c_str());
+            names_[id].c_str(), names_[classes_[id].missed_by].c_str());
       } else {
         error_ = true;
       }
@@ -134,23 +192,21 @@ void *Java8DesugarDepsChecker::OutputEntry(bool compress) {
   return nullptr;
 }
 
-bool Java8DesugarDepsChecker::HasDefaultMethods(
-    const std::string &interface_name) {
-  auto cached = has_default_methods_.find(interface_name);
-  if (cached != has_default_methods_.end()) {
-    return cached->second;
+bool Java8DesugarDepsChecker::HasDefaultMethods(uint32_t id) {
+  if (classes_[id].resolution != kUnknown) {
+    return classes_[id].resolution == kDefaultMethods;
   }
 
   // Prime with false in case there's a cycle.  We'll update with the true value
   // (ignoring the cycle) below.
-  has_default_methods_.emplace(interface_name, false);
+  classes_[id].resolution = kNoDefaultMethods;
 
-  for (const std::string &extended : extended_interfaces_[interface_name]) {
-    if (HasDefaultMethods(extended)) {
-      has_default_methods_[interface_name] = true;
+  for (uint32_t i = classes_[id].extended_begin; i < classes_[id].extended_end;
+       ++i) {
+    if (HasDefaultMethods(extended_[i])) {
+      classes_[id].resolution = kDefaultMethods;
       return true;
     }
   }
-  has_default_methods_[interface_name] = false;
   return false;
 }
@@ -15,14 +15,18 @@
 #ifndef SRC_TOOLS_SINGLEJAR_DESUGAR_CHECKING_H_
 #define SRC_TOOLS_SINGLEJAR_DESUGAR_CHECKING_H_ 1
 
+#include <stdint.h>
+
 #include <functional>
-#include <map>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/name_map.h"
 #include "src/tools/singlejar/transient_bytes.h"
+#include "src/tools/singlejar/worker_pool.h"
 #include "src/tools/singlejar/zip_headers.h"
 
 // Combiner that checks META-INF/desugar_deps files (b/65645388) to ensure
@@ -36,12 +40,20 @@
 //    that interfaces that couldn't be found don't declare or inherit default
 //    methods.  Desugar emits extra metadata to avoid us having to open up and
 //    parse .class files for this purpose.
+// The class names are interned: everything known about a class is kept in a
+// flat array indexed by its id.
 class Java8DesugarDepsChecker : public Combiner {
  public:
+  // With `background', the metadata are parsed and indexed on a separate
+  // thread while the caller goes on copying the entries. The checks
+  // themselves run in OutputEntry() on the calling thread, as known_member
+  // may not be thread-safe.
   Java8DesugarDepsChecker(std::function<bool (const std::string&)> known_member,
-                          bool verbose)
-      : Java8DesugarDepsChecker(std::move(known_member), verbose, true) {}
-  ~Java8DesugarDepsChecker() override {}
+                          bool verbose, bool background = false)
+      : Java8DesugarDepsChecker(std::move(known_member), verbose, background,
+                                true) {}
+  // Waits for the pending indexing, which uses the other members.
+  ~Java8DesugarDepsChecker() override { indexer_.reset(); }
 
   bool Merge(const CDH *cdh, const LH *lh) override;
 
@@ -49,15 +61,44 @@ class Java8DesugarDepsChecker : public Combiner {
 
  private:
   Java8DesugarDepsChecker(std::function<bool (const std::string&)> known_member,
-                          bool verbose, bool fail_on_error)
+                          bool verbose, bool background, bool fail_on_error)
       : known_member_(std::move(known_member)),
         verbose_(verbose),
         fail_on_error_(fail_on_error),
+        indexer_(background ? new WorkerPool(1) : nullptr),
         error_(false) {}
+
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  enum Resolution : uint8_t { kUnknown, kNoDefaultMethods, kDefaultMethods };
+
+  // What the desugar_deps files say about a class.
+  struct ClassInfo {
+    // The first class that needs this one, or kNone.
+    uint32_t needed_by = kNone;
+    // The first class that could not find this interface, or kNone.
+    uint32_t missed_by = kNone;
+    // The interfaces this interface extends, a range of extended_.
+    uint32_t extended_begin = 0;
+    uint32_t extended_end = 0;
+    // Whether it defines or inherits default methods, if known yet.
+    Resolution resolution = kUnknown;
+  };
+
+  // Parses a desugar_deps file and adds its contents to the index. Takes
+  // the ownership of the malloc()ed buffer.
+  void Index(uint8_t *buf, size_t data_size);
+
+  /// Returns the id of the class with the given name, adding it if needed.
+  uint32_t Intern(const std::string &name);
+
   /// Computes and caches whether the given interface has default methods.
   /// \param interface_name interface name as it would appear in bytecode, e.g.,
   ///        "java/lang/Runnable"
-  bool HasDefaultMethods(const std::string &interface_name);
+  bool HasDefaultMethods(const std::string &interface_name) {
+    return HasDefaultMethods(Intern(interface_name));
+  }
+  bool HasDefaultMethods(uint32_t id);
 
   const std::function<bool (const std::string&)> known_member_;
   const bool verbose_;
@@ -65,18 +106,17 @@ class Java8DesugarDepsChecker : public Combiner {
 
   std::unique_ptr<TransientBytes> buffer_;
   std::unique_ptr<Inflater> inflater_;
-  /// Reverse mapping from needed dependencies to one of the users.
-  std::map<std::string, std::string> needed_deps_;
-  /// Reverse mapping from missing interfaces to one of the classes that missed
-  /// them.
-  std::map<std::string, std::string> missing_interfaces_;
-  std::unordered_map<std::string, std::vector<std::string> >
-      extended_interfaces_;
-  /// Cache of interfaces known to definitely define or inherit default methods
-  /// or definitely not define and not inherit default methods.  Merge()
-  /// populates initial entries and HasDefaultMethods() adds to the cache as
-  /// needed.
-  std::unordered_map<std::string, bool> has_default_methods_;
+  std::unique_ptr<ZstdDecompressor> zstd_decompressor_;
+  // Runs Index() in the background mode. Only that thread touches the
+  // index until OutputEntry() has waited for it.
+  std::unique_ptr<WorkerPool> indexer_;
+  /// Interned class names: ids_ maps a name to its id, names_ and classes_
+  /// are indexed by it.
+  NameMap<uint32_t> ids_;
+  std::vector<std::string> names_;
+  std::vector<ClassInfo> classes_;
+  /// The ids of the interfaces extended by each interface, see ClassInfo.
+  std::vector<uint32_t> extended_;
   bool error_;
 
   friend class Java8DesugarDepsCheckerTest;
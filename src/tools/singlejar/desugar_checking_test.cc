@@ -14,24 +14,86 @@
 
 #include "src/tools/singlejar/desugar_checking.h"
 
+#include <string.h>
+
+#include <string>
+#include <vector>
+
 #include "src/tools/singlejar/input_jar.h"
 #include "src/tools/singlejar/zip_headers.h"
 #include "src/tools/singlejar/zlib_interface.h"
+#include "src/main/protobuf/desugar_deps.pb.h"
 #include "googletest/include/gtest/gtest.h"
 
 // A test fixture is used because friend access to class under test is needed.
 // Tests are instance methods to avoid gUnit dep in .h file.
 class Java8DesugarDepsCheckerTest : public ::testing::Test {
  protected:
+  static void SetDefaultMethods(Java8DesugarDepsChecker *checker,
+                                const std::string &name) {
+    checker->classes_[checker->Intern(name)].resolution =
+        Java8DesugarDepsChecker::kDefaultMethods;
+  }
+
+  static void SetExtended(Java8DesugarDepsChecker *checker,
+                          const std::string &name,
+                          const std::vector<std::string> &extended) {
+    uint32_t id = checker->Intern(name);
+    uint32_t begin = checker->extended_.size();
+    for (const auto &itf : extended) {
+      checker->extended_.push_back(checker->Intern(itf));
+    }
+    checker->classes_[id].extended_begin = begin;
+    checker->classes_[id].extended_end = checker->extended_.size();
+  }
+
+  static void SetNeeded(Java8DesugarDepsChecker *checker,
+                        const std::string &name, const std::string &origin) {
+    uint32_t origin_id = checker->Intern(origin);
+    checker->classes_[checker->Intern(name)].needed_by = origin_id;
+  }
+
+  static void SetMissing(Java8DesugarDepsChecker *checker,
+                         const std::string &name, const std::string &origin) {
+    uint32_t origin_id = checker->Intern(origin);
+    checker->classes_[checker->Intern(name)].missed_by = origin_id;
+  }
+
+  static bool CachedNoDefaultMethods(Java8DesugarDepsChecker *checker,
+                                     const std::string &name) {
+    uint32_t *id = checker->ids_.Find(name.data(), name.size());
+    return id != nullptr && checker->classes_[*id].resolution ==
+                                Java8DesugarDepsChecker::kNoDefaultMethods;
+  }
+
+  // Returns a stored META-INF/desugar_deps entry with the given contents.
+  static std::vector<uint8_t> DesugarDepsEntry(
+      const bazel::tools::desugar::DesugarDepsInfo &deps_info) {
+    static const char kName[] = "META-INF/desugar_deps";
+    std::string contents = deps_info.SerializeAsString();
+    std::vector<uint8_t> entry(sizeof(LH) + sizeof(kName) - 1 +
+                               contents.size());
+    LH *lh = reinterpret_cast<LH *>(entry.data());
+    lh->signature();
+    lh->bit_flag(0);
+    lh->compression_method(Z_NO_COMPRESSION);
+    lh->compressed_file_size32(contents.size());
+    lh->uncompressed_file_size32(contents.size());
+    lh->file_name(kName, sizeof(kName) - 1);
+    lh->extra_fields(nullptr, 0);
+    memcpy(lh->data(), contents.data(), contents.size());
+    return entry;
+  }
+
   static void TestHasDefaultMethods() {
     Java8DesugarDepsChecker checker([](const std::string &) { return false; },
                                     /*verbose=*/false);
-    checker.has_default_methods_["a"] = true;
-    checker.extended_interfaces_["c"] = {"b", "a"};
+    SetDefaultMethods(&checker, "a");
+    SetExtended(&checker, "c", {"b", "a"});
 
     // Induce cycle (shouldn't happen but make sure we don't crash)
-    checker.extended_interfaces_["d"] = {"e"};
-    checker.extended_interfaces_["e"] = {"d", "a"};
+    SetExtended(&checker, "d", {"e"});
+    SetExtended(&checker, "e", {"d", "a"});
 
     EXPECT_TRUE(checker.HasDefaultMethods("a"));
     EXPECT_FALSE(checker.HasDefaultMethods("b"));
@@ -48,41 +110,91 @@ class Java8DesugarDepsCheckerTest : public ::testing::Test {
           return binary_name == "a$$CC.class";
         },
         /*verbose=*/false);
-    checker.has_default_methods_["a"] = true;
-    checker.extended_interfaces_["b"] = {"c", "d"};
-    checker.extended_interfaces_["c"] = {"e"};
-    checker.needed_deps_["a$$CC.class"] = "f";
-    checker.missing_interfaces_["b"] = "g";
+    SetDefaultMethods(&checker, "a");
+    SetExtended(&checker, "b", {"c", "d"});
+    SetExtended(&checker, "c", {"e"});
+    SetNeeded(&checker, "a$$CC", "f");
+    SetMissing(&checker, "b", "g");
     EXPECT_EQ(nullptr, checker.OutputEntry(/*compress=*/true));
     EXPECT_TRUE(checkedA);
 
     // Make sure we checked b and its extended interfaces for default methods
-    EXPECT_FALSE(checker.has_default_methods_.at("b"));  // should be cached
-    EXPECT_FALSE(checker.has_default_methods_.at("c"));  // should be cached
-    EXPECT_FALSE(checker.has_default_methods_.at("d"));  // should be cached
-    EXPECT_FALSE(checker.has_default_methods_.at("e"));  // should be cached
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "b"));
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "c"));
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "d"));
+    EXPECT_TRUE(CachedNoDefaultMethods(&checker, "e"));
     EXPECT_FALSE(checker.error_);
   }
 
   static void TestNeededDepMissing() {
     Java8DesugarDepsChecker checker([](const std::string &) { return false; },
-                                    /*verbose=*/false,
+                                    /*verbose=*/false, /*background=*/false,
                                     /*fail_on_error=*/false);
-    checker.needed_deps_["a$$CC.class"] = "b";
+    SetNeeded(&checker, "a$$CC", "b");
     EXPECT_EQ(nullptr, checker.OutputEntry(/*compress=*/true));
     EXPECT_TRUE(checker.error_);
   }
 
   static void TestMissedDefaultMethods() {
     Java8DesugarDepsChecker checker([](const std::string &) { return true; },
-                                    /*verbose=*/false,
+                                    /*verbose=*/false, /*background=*/false,
                                     /*fail_on_error=*/false);
-    checker.has_default_methods_["b"] = true;
-    checker.extended_interfaces_["a"] = {"b", "a"};
-    checker.missing_interfaces_["a"] = "g";
+    SetDefaultMethods(&checker, "b");
+    SetExtended(&checker, "a", {"b", "a"});
+    SetMissing(&checker, "a", "g");
     EXPECT_EQ(nullptr, checker.OutputEntry(/*compress=*/true));
     EXPECT_TRUE(checker.error_);
   }
+
+  // Merges two desugar_deps files, the second one redefining the interface
+  // hierarchy, which must be ignored.
+  static void TestMerge(bool background) {
+    std::vector<std::string> looked_for;
+    Java8DesugarDepsChecker checker(
+        [&looked_for](const std::string &binary_name) {
+          looked_for.push_back(binary_name);
+          return true;
+        },
+        /*verbose=*/false, background, /*fail_on_error=*/false);
+    CDH cdh;
+    memset(&cdh, 0, sizeof(cdh));
+
+    bazel::tools::desugar::DesugarDepsInfo first;
+    auto *assume_present = first.add_assume_present();
+    assume_present->mutable_origin()->set_binary_name("x");
+    assume_present->mutable_target()->set_binary_name("y$$CC");
+    auto *missing = first.add_missing_interface();
+    missing->mutable_origin()->set_binary_name("x");
+    missing->mutable_target()->set_binary_name("b");
+    auto *supertypes = first.add_interface_with_supertypes();
+    supertypes->mutable_origin()->set_binary_name("b");
+    supertypes->add_extended_interface()->set_binary_name("c");
+    std::vector<uint8_t> first_entry = DesugarDepsEntry(first);
+    EXPECT_TRUE(checker.Merge(
+        &cdh, reinterpret_cast<const LH *>(first_entry.data())));
+
+    bazel::tools::desugar::DesugarDepsInfo second;
+    assume_present = second.add_assume_present();
+    assume_present->mutable_origin()->set_binary_name("z");
+    assume_present->mutable_target()->set_binary_name("w$$CC");
+    supertypes = second.add_interface_with_supertypes();
+    supertypes->mutable_origin()->set_binary_name("b");
+    supertypes->add_extended_interface()->set_binary_name("a");
+    auto *companion = second.add_interface_with_companion();
+    companion->mutable_origin()->set_binary_name("a");
+    companion->set_num_default_methods(1);
+    std::vector<uint8_t> second_entry = DesugarDepsEntry(second);
+    EXPECT_TRUE(checker.Merge(
+        &cdh, reinterpret_cast<const LH *>(second_entry.data())));
+
+    EXPECT_EQ(nullptr, checker.OutputEntry(/*compress=*/true));
+    EXPECT_EQ((std::vector<std::string>{"w$$CC.class", "y$$CC.class"}),
+              looked_for);
+    // b extends c, not a.
+    EXPECT_FALSE(checker.error_);
+    EXPECT_TRUE(checker.HasDefaultMethods("a"));
+    EXPECT_FALSE(checker.HasDefaultMethods("b"));
+  }
 };
 
 TEST_F(Java8DesugarDepsCheckerTest, HasDefaultMethods) {
@@ -100,3 +212,11 @@ TEST_F(Java8DesugarDepsCheckerTest, NeededDepMissing) {
 TEST_F(Java8DesugarDepsCheckerTest, MissingDefaultMethods) {
   TestMissedDefaultMethods();
 }
+
+TEST_F(Java8DesugarDepsCheckerTest, Merge) {
+  TestMerge(/*background=*/false);
+}
+
+TEST_F(Java8DesugarDepsCheckerTest, MergeInBackground) {
+  TestMerge(/*background=*/true);
+}
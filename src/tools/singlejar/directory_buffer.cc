@@ -0,0 +1,66 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/directory_buffer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "src/tools/singlejar/diag.h"
+
+uint8_t *DirectoryBuffer::Reserve(size_t size) {
+  if (chunks_.empty() ||
+      chunks_.back().capacity - chunks_.back().used < size) {
+    Chunk chunk;
+    chunk.used = 0;
+    chunk.capacity = size > kChunkSize ? size : kChunkSize;
+#ifdef _WIN32
+    chunk.data = static_cast<uint8_t *>(VirtualAlloc(
+        nullptr, chunk.capacity, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (chunk.data == nullptr) {
+      diag_errx(1, "%s:%d: Cannot allocate %zu bytes for the directory",
+                __FILE__, __LINE__, chunk.capacity);
+    }
+#else
+    void *data = mmap(nullptr, chunk.capacity, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      diag_err(1, "%s:%d: Cannot allocate %zu bytes for the directory",
+               __FILE__, __LINE__, chunk.capacity);
+    }
+    chunk.data = static_cast<uint8_t *>(data);
+#endif
+    chunks_.push_back(chunk);
+  }
+  Chunk &chunk = chunks_.back();
+  uint8_t *result = chunk.data + chunk.used;
+  chunk.used += size;
+  size_ += size;
+  return result;
+}
+
+void DirectoryBuffer::Clear() {
+  for (const Chunk &chunk : chunks_) {
+#ifdef _WIN32
+    VirtualFree(chunk.data, 0, MEM_RELEASE);
+#else
+    munmap(chunk.data, chunk.capacity);
+#endif
+  }
+  chunks_.clear();
+  size_ = 0;
+}
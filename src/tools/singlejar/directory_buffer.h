@@ -0,0 +1,71 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_DIRECTORY_BUFFER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_DIRECTORY_BUFFER_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/*
+ * Accumulates the Central Directory of the output jar. The directory is kept
+ * in a list of chunks mapped from anonymous memory, so growing it never
+ * copies what has already been written, and the pages of a chunk are only
+ * committed when they are touched. A record never straddles two chunks.
+ */
+class DirectoryBuffer {
+ public:
+  // The size of a chunk, unless a single record is larger than that.
+  static constexpr size_t kChunkSize = 64 << 20;
+
+  DirectoryBuffer() : size_(0) {}
+  ~DirectoryBuffer() { Clear(); }
+  DirectoryBuffer(const DirectoryBuffer &) = delete;
+  DirectoryBuffer &operator=(const DirectoryBuffer &) = delete;
+
+  // Returns 'size' bytes of contiguous space at the end of the buffer.
+  uint8_t *Reserve(size_t size);
+
+  // The total number of bytes reserved so far.
+  uint64_t size() const { return size_; }
+
+  // Calls write(data, length) for each chunk in order and returns false as
+  // soon as a call returns false.
+  template <class Writer>
+  bool WriteTo(Writer write) const {
+    for (const Chunk &chunk : chunks_) {
+      if (chunk.used > 0 && !write(chunk.data, chunk.used)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Releases all the memory.
+  void Clear();
+
+ private:
+  struct Chunk {
+    uint8_t *data;
+    size_t used;
+    size_t capacity;
+  };
+
+  std::vector<Chunk> chunks_;
+  uint64_t size_;
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_DIRECTORY_BUFFER_H_
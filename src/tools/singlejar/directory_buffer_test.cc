@@ -0,0 +1,87 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/directory_buffer.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+std::string Contents(const DirectoryBuffer &buffer) {
+  std::string result;
+  EXPECT_TRUE(buffer.WriteTo([&result](const uint8_t *data, size_t size) {
+    result.append(reinterpret_cast<const char *>(data), size);
+    return true;
+  }));
+  return result;
+}
+
+TEST(DirectoryBufferTest, Empty) {
+  DirectoryBuffer buffer;
+  EXPECT_EQ(0UL, buffer.size());
+  EXPECT_EQ("", Contents(buffer));
+}
+
+TEST(DirectoryBufferTest, SpansChunks) {
+  DirectoryBuffer buffer;
+  const size_t kRecordSize = 1000;
+  const int kRecords = 2 * DirectoryBuffer::kChunkSize / kRecordSize;
+  std::string expected;
+  for (int i = 0; i < kRecords; ++i) {
+    uint8_t *record = buffer.Reserve(kRecordSize);
+    memset(record, 'a' + i % 26, kRecordSize);
+    expected.append(kRecordSize, 'a' + i % 26);
+  }
+  EXPECT_EQ(expected.size(), buffer.size());
+  EXPECT_EQ(expected, Contents(buffer));
+}
+
+TEST(DirectoryBufferTest, LargeRecord) {
+  DirectoryBuffer buffer;
+  memset(buffer.Reserve(10), 'a', 10);
+  const size_t kLargeSize = DirectoryBuffer::kChunkSize + 10;
+  memset(buffer.Reserve(kLargeSize), 'b', kLargeSize);
+  memset(buffer.Reserve(10), 'c', 10);
+  EXPECT_EQ(kLargeSize + 20, buffer.size());
+  EXPECT_EQ(std::string(10, 'a') + std::string(kLargeSize, 'b') +
+                std::string(10, 'c'),
+            Contents(buffer));
+}
+
+TEST(DirectoryBufferTest, WriteFailure) {
+  DirectoryBuffer buffer;
+  buffer.Reserve(DirectoryBuffer::kChunkSize);
+  buffer.Reserve(1);
+  int calls = 0;
+  EXPECT_FALSE(buffer.WriteTo([&calls](const uint8_t *data, size_t size) {
+    ++calls;
+    return false;
+  }));
+  EXPECT_EQ(1, calls);
+}
+
+TEST(DirectoryBufferTest, Clear) {
+  DirectoryBuffer buffer;
+  memset(buffer.Reserve(100), 'a', 100);
+  buffer.Clear();
+  EXPECT_EQ(0UL, buffer.size());
+  memset(buffer.Reserve(5), 'b', 5);
+  EXPECT_EQ("bbbbb", Contents(buffer));
+}
+
+}  // namespace
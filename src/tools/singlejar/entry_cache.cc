@@ -0,0 +1,110 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/entry_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+
+// Must be included before <io.h> (on Windows) and <fcntl.h>.
+#include "src/tools/singlejar/port.h"
+// Need newline so clang-format won't alpha-sort with other headers.
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/md5.h"
+#include "src/tools/singlejar/diag.h"
+
+// Bump this if the format of the cached entries or of the key ever changes.
+static const char kCacheFormat[] = "singlejar-entry-cache-1";
+
+static size_t EntrySize(const LH *lh) {
+  return lh->size() + lh->in_zip_size();
+}
+
+std::string EntryCache::Key(const CDH *cdh, const LH *lh,
+                            bool output_compressed, bool zstd,
+                            bool libdeflate) {
+  blaze_util::Md5Digest digest;
+  digest.Update(kCacheFormat, sizeof(kCacheFormat));
+  uint16_t name_length = cdh->file_name_length();
+  digest.Update(&name_length, sizeof(name_length));
+  digest.Update(cdh->file_name(), name_length);
+  uint16_t method = cdh->compression_method();
+  digest.Update(&method, sizeof(method));
+  // The deflated and stored outputs keep the keys they had before --zstd and
+  // --libdeflate.
+  uint8_t compressed = output_compressed ? (zstd ? 2 : libdeflate ? 3 : 1) : 0;
+  digest.Update(&compressed, sizeof(compressed));
+  const uint8_t *data = lh->data();
+  for (size_t remaining = cdh->compressed_file_size(); remaining;) {
+    unsigned int chunk = remaining > 0x40000000 ? 0x40000000 : remaining;
+    digest.Update(data, chunk);
+    data += chunk;
+    remaining -= chunk;
+  }
+  unsigned char md5[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(md5);
+  return digest.String();
+}
+
+void *EntryCache::Get(const std::string &key) {
+  std::string contents;
+  if (!blaze_util::ReadFile(Path(key), &contents)) {
+    ++misses_;
+    return nullptr;
+  }
+  // Do not trust the file to be intact, it could have been truncated.
+  const LH *lh = reinterpret_cast<const LH *>(contents.data());
+  if (contents.size() < sizeof(LH) || !lh->is() ||
+      contents.size() < lh->size() || EntrySize(lh) != contents.size()) {
+    diag_warnx("%s:%d: Ignoring corrupt cache entry %s", __FILE__, __LINE__,
+               Path(key).c_str());
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  void *entry = malloc(contents.size());
+  if (entry == nullptr) {
+    diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
+  }
+  memcpy(entry, contents.data(), contents.size());
+  return entry;
+}
+
+void EntryCache::Put(const std::string &key, const void *entry) const {
+  static std::atomic<unsigned> counter(0);
+  const LH *lh = reinterpret_cast<const LH *>(entry);
+  std::string tmp_path = Path(key) + ".tmp." + std::to_string(getpid()) +
+                         "." + std::to_string(counter++);
+  if (!blaze_util::WriteFile(entry, EntrySize(lh), tmp_path, 0644)) {
+    diag_warn("%s:%d: Cannot write cache entry %s", __FILE__, __LINE__,
+              tmp_path.c_str());
+    blaze_util::UnlinkPath(tmp_path);
+    return;
+  }
+  // Another process may have stored the same entry meanwhile, which is fine.
+  if (rename(tmp_path.c_str(), Path(key).c_str())) {
+    blaze_util::UnlinkPath(tmp_path);
+  }
+}
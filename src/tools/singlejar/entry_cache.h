@@ -0,0 +1,63 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_CACHE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_CACHE_H_ 1
+
+#include <atomic>
+#include <string>
+
+#include "src/tools/singlejar/zip_headers.h"
+
+/*
+ * An on-disk cache of the output entries that are expensive to produce,
+ * i.e., the ones whose compression is changed on the way from the input jar
+ * to the output jar. Each cached blob is the Local Header followed by the
+ * payload, as returned by Combiner::OutputEntry(). The key is the digest of
+ * the input entry's name, compression method and payload, and of the output
+ * compression, so that one cache directory can be shared by different output
+ * jars and by concurrently running singlejar processes. The blobs are
+ * written to a temporary file first and then renamed into place.
+ */
+class EntryCache {
+ public:
+  explicit EntryCache(const std::string &dir)
+      : dir_(dir), hits_(0), misses_(0) {}
+
+  // Returns the cache key for the given input entry. The output is meant to
+  // be compressed with Zstandard if both output_compressed and zstd are set,
+  // and deflated by libdeflate rather than zlib if libdeflate is set.
+  static std::string Key(const CDH *cdh, const LH *lh, bool output_compressed,
+                         bool zstd = false, bool libdeflate = false);
+
+  // Returns the cached output entry in a buffer allocated with malloc(), or
+  // nullptr if there is none. Safe to call from multiple threads.
+  void *Get(const std::string &key);
+
+  // Saves the given output entry. Failures are not fatal, the entry just
+  // is not cached. Safe to call from multiple threads.
+  void Put(const std::string &key, const void *entry) const;
+
+  int hits() const { return hits_; }
+  int misses() const { return misses_; }
+
+ private:
+  std::string Path(const std::string &key) const { return dir_ + "/" + key; }
+
+  const std::string dir_;
+  std::atomic<int> hits_;
+  std::atomic<int> misses_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_ENTRY_CACHE_H_
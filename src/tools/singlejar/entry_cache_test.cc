@@ -0,0 +1,101 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/entry_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "src/main/cpp/util/file.h"
+#include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using rules_cc::cc::runfiles::Runfiles;
+using singlejar_test_util::OutputFilePath;
+
+const char kPathLibTest1[] = "io_bazel/src/tools/singlejar/libtest1.jar";
+
+class EntryCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    runfiles.reset(Runfiles::CreateForTest());
+    cache_dir = OutputFilePath(
+        std::string("entry_cache_") +
+        ::testing::UnitTest::GetInstance()->current_test_info()->name());
+    ASSERT_TRUE(blaze_util::MakeDirectories(cache_dir, 0777));
+    ASSERT_TRUE(input_jar.Open(runfiles->Rlocation(kPathLibTest1)));
+    ASSERT_NE(nullptr, cdh = input_jar.NextEntry(&lh));
+  }
+
+  std::unique_ptr<Runfiles> runfiles;
+  std::string cache_dir;
+  InputJar input_jar;
+  const CDH *cdh;
+  const LH *lh;
+};
+
+TEST_F(EntryCacheTest, Key) {
+  std::string key = EntryCache::Key(cdh, lh, true);
+  EXPECT_EQ(32UL, key.size());
+  EXPECT_EQ(key, EntryCache::Key(cdh, lh, true));
+  EXPECT_NE(key, EntryCache::Key(cdh, lh, false));
+  const LH *lh2;
+  const CDH *cdh2 = input_jar.NextEntry(&lh2);
+  ASSERT_NE(nullptr, cdh2);
+  EXPECT_NE(key, EntryCache::Key(cdh2, lh2, true));
+}
+
+TEST_F(EntryCacheTest, PutGet) {
+  EntryCache cache(cache_dir);
+  std::string key = EntryCache::Key(cdh, lh, true);
+  EXPECT_EQ(nullptr, cache.Get(key));
+
+  Concatenator concatenator(cdh->file_name_string());
+  ASSERT_TRUE(concatenator.Merge(cdh, lh));
+  LH *entry = reinterpret_cast<LH *>(concatenator.OutputEntry(true));
+  ASSERT_NE(nullptr, entry);
+  size_t entry_size = entry->size() + entry->in_zip_size();
+  cache.Put(key, entry);
+
+  LH *cached = reinterpret_cast<LH *>(cache.Get(key));
+  ASSERT_NE(nullptr, cached);
+  EXPECT_EQ(0, memcmp(entry, cached, entry_size));
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  free(cached);
+  free(entry);
+}
+
+// A truncated cache file is not returned.
+TEST_F(EntryCacheTest, Corrupt) {
+  EntryCache cache(cache_dir);
+  std::string key = EntryCache::Key(cdh, lh, true);
+  Concatenator concatenator(cdh->file_name_string());
+  ASSERT_TRUE(concatenator.Merge(cdh, lh));
+  LH *entry = reinterpret_cast<LH *>(concatenator.OutputEntry(true));
+  ASSERT_NE(nullptr, entry);
+  ASSERT_TRUE(blaze_util::WriteFile(entry, entry->size() + 1,
+                                    cache_dir + "/" + key, 0644));
+  EXPECT_EQ(nullptr, cache.Get(key));
+  free(entry);
+}
+
+}  // namespace
@@ -0,0 +1,149 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/fast_crc32.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zlib.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SINGLEJAR_CRC32_PCLMUL 1
+#include <immintrin.h>
+#endif
+
+#ifdef SINGLEJAR_CRC32_PCLMUL
+
+// The number of bytes a single call to Crc32Pclmul() processes at least.
+static const size_t kPclmulMinSize = 64;
+
+// Computes the CRC32 of the data whose size is a multiple of 16 and is at
+// least kPclmulMinSize, by folding 4x128-bit lanes, then reducing to 32
+// bits. See "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+// Instruction" by Gopal et al., Intel, 2009. Takes and returns the CRC
+// without the pre and post inversion.
+__attribute__((target("pclmul,sse4.1"))) static uint32_t Crc32Pclmul(
+    uint32_t crc, const uint8_t *data, size_t size) {
+  // The constants for the bit-reflected CRC32 polynomial 0x04C11DB7.
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+  __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16));
+  __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 32));
+  __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 48));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+  data += 64;
+  size -= 64;
+
+  // Fold 64 bytes at a time.
+  while (size >= 64) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+    __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+    __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+    __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+    x1 = _mm_xor_si128(
+        _mm_xor_si128(x1, x5),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+    x2 = _mm_xor_si128(
+        _mm_xor_si128(x2, x6),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16)));
+    x3 = _mm_xor_si128(
+        _mm_xor_si128(x3, x7),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 32)));
+    x4 = _mm_xor_si128(
+        _mm_xor_si128(x4, x8),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 48)));
+    data += 64;
+    size -= 64;
+  }
+
+  // Fold the four lanes into one.
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+  __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  // Fold the remaining 16 byte blocks.
+  while (size >= 16) {
+    x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(
+        _mm_xor_si128(x1, _mm_loadu_si128(
+                              reinterpret_cast<const __m128i *>(data))),
+        x5);
+    data += 16;
+    size -= 16;
+  }
+
+  // Fold 128 bits to 64 bits.
+  x5 = _mm_clmulepi64_si128(x1, k, 0x10);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x5);
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+  x5 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_xor_si128(x1, x5);
+
+  // Barrett reduction to 32 bits.
+  k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+  x5 = _mm_and_si128(x1, mask32);
+  x5 = _mm_clmulepi64_si128(x5, k, 0x10);
+  x5 = _mm_and_si128(x5, mask32);
+  x5 = _mm_clmulepi64_si128(x5, k, 0x00);
+  x1 = _mm_xor_si128(x1, x5);
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+static bool HasPclmul() {
+  static const bool has_pclmul =
+      __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+  return has_pclmul;
+}
+
+#endif  // SINGLEJAR_CRC32_PCLMUL
+
+uint32_t FastCrc32(uint32_t crc, const uint8_t *data, size_t size) {
+#ifdef SINGLEJAR_CRC32_PCLMUL
+  if (size >= kPclmulMinSize && HasPclmul()) {
+    size_t bulk_size = size & ~static_cast<size_t>(15);
+    crc = ~Crc32Pclmul(~crc, data, bulk_size);
+    data += bulk_size;
+    size -= bulk_size;
+  }
+#endif
+  // zlib takes a 32-bit size on some platforms.
+  while (size > 0) {
+    uInt chunk_size = size > 0x40000000 ? 0x40000000 : static_cast<uInt>(size);
+    crc = crc32(crc, data, chunk_size);
+    data += chunk_size;
+    size -= chunk_size;
+  }
+  return crc;
+}
@@ -0,0 +1,27 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_FAST_CRC32_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_FAST_CRC32_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Same as zlib's crc32(crc, data, size), but folds the bulk of the data with
+// the carry-less multiplication instructions on x86-64 CPUs supporting them.
+// Falls back to zlib elsewhere (zlib itself uses the CRC32 instructions on
+// ARMv8 when built for a CPU that has them).
+uint32_t FastCrc32(uint32_t crc, const uint8_t *data, size_t size);
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_FAST_CRC32_H_
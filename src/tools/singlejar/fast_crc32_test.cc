@@ -0,0 +1,61 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/fast_crc32.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+#include <zlib.h>
+
+namespace {
+
+// FastCrc32 has to agree with zlib for any size, alignment and initial CRC.
+TEST(FastCrc32Test, MatchesZlib) {
+  std::vector<uint8_t> data(70000);
+  uint32_t seed = 1;
+  for (auto &byte : data) {
+    seed = seed * 1103515245 + 12345;
+    byte = static_cast<uint8_t>(seed >> 16);
+  }
+  for (size_t offset = 0; offset < 16; ++offset) {
+    for (size_t size = 0; size < 300; ++size) {
+      ASSERT_EQ(crc32(0, data.data() + offset, size),
+                FastCrc32(0, data.data() + offset, size))
+          << "offset " << offset << " size " << size;
+    }
+  }
+  for (size_t size : {1000, 4096, 65536, 69999}) {
+    EXPECT_EQ(crc32(0, data.data(), size), FastCrc32(0, data.data(), size));
+  }
+}
+
+// The CRC of the data can be computed piecewise.
+TEST(FastCrc32Test, Continuation) {
+  std::vector<uint8_t> data(10000, 'a');
+  for (size_t ix = 0; ix < data.size(); ix += 7) {
+    data[ix] = static_cast<uint8_t>(ix);
+  }
+  uint32_t crc = 0;
+  for (size_t pos = 0, chunk = 1; pos < data.size(); pos += chunk, chunk *= 2) {
+    size_t size = std::min(chunk, data.size() - pos);
+    crc = FastCrc32(crc, data.data() + pos, size);
+  }
+  EXPECT_EQ(crc32(0, data.data(), data.size()), crc);
+}
+
+}  // namespace
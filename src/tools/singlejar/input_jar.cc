@@ -14,17 +14,19 @@
 
 #include "src/tools/singlejar/input_jar.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <string>
 
 #include "src/tools/singlejar/diag.h"
 
-bool InputJar::Open(const std::string &path) {
+bool InputJar::Open(const std::string &path, bool read_into_memory) {
   if (!path_.empty()) {
     diag_errx(1, "%s:%d: This instance is already handling %s\n", __FILE__,
               __LINE__, path_.c_str());
   }
-  if (!mapped_file_.Open(path)) {
+  if (!(read_into_memory ? mapped_file_.Read(path)
+                         : mapped_file_.Open(path))) {
     diag_warn("%s:%d: Cannot open input jar %s", __FILE__, __LINE__,
               path.c_str());
     mapped_file_.Close();
@@ -38,7 +40,15 @@ bool InputJar::Open(const std::string &path) {
     mapped_file_.Close();
     return false;
   }
-  return LocateCentralDirectory(path);
+  if (!LocateCentralDirectory(path)) {
+    return false;
+  }
+  // NextEntry() is about to walk the Central Directory, which is at the end
+  // of the file, so do not wait for the faults to bring it in page by page.
+  cdr_offset_ = mapped_file_.offset(cdh_);
+  mapped_file_.Advise(cdr_offset_, mapped_file_.size() - cdr_offset_,
+                      MappedFile::kWillNeed);
+  return true;
 }
 
 bool InputJar::Open(const std::string &path, unsigned char *data,
@@ -47,7 +57,11 @@ bool InputJar::Open(const std::string &path, unsigned char *data,
     diag_errx(1, "%s:%d: A non-empty path is required\n", __FILE__, __LINE__);
   }
   mapped_file_.MapExisting(data, data + length);
-  return LocateCentralDirectory(path);
+  if (!LocateCentralDirectory(path)) {
+    return false;
+  }
+  cdr_offset_ = mapped_file_.offset(cdh_);
+  return true;
 }
 
 bool InputJar::LocateCentralDirectory(const std::string &path) {
@@ -166,6 +180,16 @@ bool InputJar::LocateCentralDirectory(const std::string &path) {
   return true;
 }
 
+void InputJar::PrefetchEntries() const {
+  // Start reading in the entries that precede the Central Directory. Huge
+  // jars only get their beginning prefetched, beyond that the sequential
+  // read-ahead keeps up with the copying.
+  static constexpr size_t kMaxPrefetchBytes = 64 * 1024 * 1024;
+  mapped_file_.Advise(0, cdr_offset_, MappedFile::kSequential);
+  mapped_file_.Advise(0, std::min<size_t>(cdr_offset_, kMaxPrefetchBytes),
+                      MappedFile::kWillNeed);
+}
+
 bool InputJar::Close() {
   mapped_file_.Close();
   path_.clear();
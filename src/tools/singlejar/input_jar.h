@@ -52,8 +52,10 @@ class InputJar {
   int fd() const { return mapped_file_.fd(); }
 #endif
 
-  // Opens the file, memory maps it and locates Central Directory.
-  bool Open(const std::string &path);
+  // Opens the file, memory maps it and locates Central Directory. Given
+  // read_into_memory, the file is read into memory rather than mapped, see
+  // MappedFile::Read().
+  bool Open(const std::string &path, bool read_into_memory = false);
 
   // Creates an input jar from data that's already in memory.
   // Requires a non-empty path for use in diagnostics.
@@ -86,6 +88,11 @@ class InputJar {
   // Closes the file.
   bool Close();
 
+  // Hints the kernel that the entries are going to be read shortly, in the
+  // Central Directory order. Only has an effect on the jars opened from a
+  // path.
+  void PrefetchEntries() const;
+
   uint64_t CentralDirectoryRecordOffset(const void *cdr) const {
     return mapped_file_.offset(cdr);
   }
@@ -103,12 +110,26 @@ class InputJar {
     return mapped_file_.address(0);
   }
 
+  size_t mapped_size() const { return mapped_file_.size(); }
+
+  // The Central Directory and the records following it, up to the end of the
+  // file. It lists the name and crc32 of every entry, so it changes whenever
+  // the contents of the jar do.
+  const uint8_t *central_directory() const {
+    return mapped_file_.address(cdr_offset_);
+  }
+  size_t central_directory_size() const {
+    return mapped_file_.size() - cdr_offset_;
+  }
+
  private:
   bool LocateCentralDirectory(const std::string &path);
 
+
   std::string path_;
   MappedFile mapped_file_;
   const CDH *cdh_;  // current directory entry
+  uint64_t cdr_offset_ = 0;  // Where the Central Directory starts.
   uint64_t preamble_size_;  // Bytes before the Zip proper.
 };
 
@@ -0,0 +1,219 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/input_jar_scanner.h"
+
+#include <utility>
+
+// The number of jars each worker may scan ahead of the consumer. Every
+// scanned jar holds an open file descriptor and a mapping, so this has to
+// stay well below the descriptor limit.
+static constexpr size_t kJarsPerThread = 4;
+
+std::shared_ptr<ScannedJar> ScannedJarCache::Get(const std::string &path,
+                                                 const std::string &digest) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(path);
+  if (it == index_.end()) {
+    ++misses_;
+    return nullptr;
+  }
+  if (it->second->digest != digest) {
+    // The file has changed, the cached jar is of no use anymore.
+    items_.erase(it->second);
+    index_.erase(it);
+    ++misses_;
+    return nullptr;
+  }
+  items_.splice(items_.begin(), items_, it->second);
+  ++hits_;
+  return it->second->jar;
+}
+
+void ScannedJarCache::Put(const std::string &path, const std::string &digest,
+                          std::shared_ptr<ScannedJar> jar) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(path);
+  if (it != index_.end()) {
+    items_.erase(it->second);
+    index_.erase(it);
+  }
+  items_.push_front({path, digest, std::move(jar)});
+  index_[path] = items_.begin();
+  while (items_.size() > capacity_) {
+    index_.erase(items_.back().path);
+    items_.pop_back();
+  }
+}
+
+std::shared_ptr<ScannedJar> ScannedJarCache::GetOrScan(
+    const std::string &path, const std::string &digest,
+    const std::function<std::shared_ptr<ScannedJar>()> &scan) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    scanned_.wait(lock, [this, &path] { return !scanning_.count(path); });
+    auto it = index_.find(path);
+    if (it != index_.end() && it->second->digest == digest) {
+      items_.splice(items_.begin(), items_, it->second);
+      ++hits_;
+      return it->second->jar;
+    }
+    ++misses_;
+    scanning_.insert(path);
+  }
+  std::shared_ptr<ScannedJar> jar = scan();
+  if (jar->ok) {
+    Put(path, digest, jar);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    scanning_.erase(path);
+  }
+  scanned_.notify_all();
+  return jar;
+}
+
+size_t ScannedJarCache::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return items_.size();
+}
+
+InputJarScanner::InputJarScanner(const std::vector<std::string> &paths,
+                                 int nthreads, ScannedJarCache *cache,
+                                 const std::vector<std::string> &digests,
+                                 bool read_into_memory)
+    : paths_(paths),
+      cache_(cache),
+      digests_(digests),
+      window_(nthreads > 1 ? nthreads * kJarsPerThread : 0),
+      read_into_memory_(read_into_memory),
+      slots_(paths.size()),
+      next_to_scan_(0),
+      next_to_consume_(0),
+      shutdown_(false) {
+  if (nthreads < 2) {
+    return;
+  }
+  size_t nworkers = static_cast<size_t>(nthreads);
+  if (nworkers > paths_.size()) {
+    nworkers = paths_.size();
+  }
+  for (size_t i = 0; i < nworkers; ++i) {
+    workers_.emplace_back(&InputJarScanner::WorkerLoop, this);
+  }
+}
+
+InputJarScanner::~InputJarScanner() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  consumed_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+std::shared_ptr<ScannedJar> InputJarScanner::Next() {
+  if (next_to_consume_ >= paths_.size()) {
+    return nullptr;
+  }
+  if (workers_.empty()) {
+    // Open the following jar right away, so that its entries are read in
+    // while the caller is busy with this one.
+    const size_t ix = next_to_consume_;
+    std::shared_ptr<ScannedJar> jar =
+        ahead_ ? std::move(ahead_) : OpenJar(ix);
+    if (++next_to_consume_ < paths_.size()) {
+      ahead_ = OpenJar(next_to_consume_);
+    }
+    WalkJar(jar);
+    return jar;
+  }
+  std::shared_ptr<ScannedJar> jar;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    scanned_.wait(lock, [this] { return slots_[next_to_consume_] != nullptr; });
+    jar = std::move(slots_[next_to_consume_++]);
+  }
+  consumed_.notify_all();
+  return jar;
+}
+
+void InputJarScanner::WorkerLoop() {
+  for (;;) {
+    size_t ix;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      consumed_.wait(lock, [this] {
+        return shutdown_ || next_to_scan_ >= paths_.size() ||
+               next_to_scan_ < next_to_consume_ + window_;
+      });
+      if (shutdown_ || next_to_scan_ >= paths_.size()) {
+        return;
+      }
+      ix = next_to_scan_++;
+    }
+    std::shared_ptr<ScannedJar> jar = Scan(ix);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      slots_[ix] = std::move(jar);
+    }
+    scanned_.notify_all();
+  }
+}
+
+std::shared_ptr<ScannedJar> InputJarScanner::Scan(size_t ix) {
+  std::shared_ptr<ScannedJar> jar = OpenJar(ix);
+  WalkJar(jar);
+  return jar;
+}
+
+std::shared_ptr<ScannedJar> InputJarScanner::OpenJar(size_t ix) {
+  if (Cacheable(ix)) {
+    return cache_->GetOrScan(paths_[ix], digests_[ix], [this, ix] {
+      std::shared_ptr<ScannedJar> jar = OpenUncachedJar(ix);
+      WalkJar(jar);
+      return jar;
+    });
+  }
+  return OpenUncachedJar(ix);
+}
+
+std::shared_ptr<ScannedJar> InputJarScanner::OpenUncachedJar(size_t ix) {
+  std::shared_ptr<ScannedJar> jar = std::make_shared<ScannedJar>();
+  if (jar->input_jar.Open(paths_[ix], read_into_memory_)) {
+    jar->input_jar.PrefetchEntries();
+    jar->ok = true;
+  }
+  return jar;
+}
+
+void InputJarScanner::WalkJar(const std::shared_ptr<ScannedJar> &jar) {
+  if (!jar->ok || jar->walked) {
+    return;
+  }
+  const CDH *cdh;
+  const LH *lh;
+  const size_t mapped_size = jar->input_jar.mapped_size();
+  while ((cdh = jar->input_jar.NextEntry(&lh))) {
+    jar->entries.push_back({cdh, lh});
+    // Fault in the page holding the local header while we are off the
+    // writer's thread; the writer is going to read it anyway.
+    if (jar->input_jar.LocalHeaderOffset(lh) + sizeof(LH) <= mapped_size) {
+      (void)*reinterpret_cast<const volatile uint8_t *>(lh);
+    }
+  }
+  jar->walked = true;
+}
@@ -0,0 +1,168 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_SCANNER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_SCANNER_H_ 1
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/zip_headers.h"
+
+/*
+ * An input jar that has been opened and whose Central Directory has been
+ * walked. The entries are in the Central Directory order.
+ */
+struct ScannedJar {
+  struct Entry {
+    const CDH *cdh;
+    const LH *lh;
+  };
+
+  InputJar input_jar;
+  // False if the jar could not be opened (the reason has been reported).
+  bool ok = false;
+  // True once all the entries have been collected.
+  bool walked = false;
+  std::vector<Entry> entries;
+};
+
+/*
+ * The scanned jars kept across the requests of a persistent worker, or
+ * shared by the outputs of a multi-output invocation, keyed by the path.
+ * A jar is only reused if the digest of the file, as reported by Bazel,
+ * has not changed since it was scanned. Every cached jar keeps its file open
+ * and mapped, so the least recently used ones are evicted once there are
+ * more than 'capacity'.
+ */
+class ScannedJarCache {
+ public:
+  explicit ScannedJarCache(size_t capacity)
+      : capacity_(capacity), hits_(0), misses_(0) {}
+
+  // Returns the jar scanned from the given path when the file had the given
+  // digest, or nullptr. Safe to call from multiple threads.
+  std::shared_ptr<ScannedJar> Get(const std::string &path,
+                                  const std::string &digest);
+
+  // Caches the jar scanned from the given path. Safe to call from multiple
+  // threads.
+  void Put(const std::string &path, const std::string &digest,
+           std::shared_ptr<ScannedJar> jar);
+
+  // Same as Get(), but if the jar is not cached, scans it by calling 'scan'
+  // and caches the result if it could be opened. If another thread is
+  // scanning the jar already, waits for that instead of scanning it again.
+  // Safe to call from multiple threads.
+  std::shared_ptr<ScannedJar> GetOrScan(
+      const std::string &path, const std::string &digest,
+      const std::function<std::shared_ptr<ScannedJar>()> &scan);
+
+  size_t size();
+  int hits() const { return hits_; }
+  int misses() const { return misses_; }
+
+ private:
+  struct Item {
+    std::string path;
+    std::string digest;
+    std::shared_ptr<ScannedJar> jar;
+  };
+
+  const size_t capacity_;
+  std::mutex mutex_;
+  // The most recently used item first.
+  std::list<Item> items_;
+  std::unordered_map<std::string, std::list<Item>::iterator> index_;
+  // The paths of the jars being scanned by GetOrScan().
+  std::unordered_set<std::string> scanning_;
+  std::condition_variable scanned_;
+  std::atomic<int> hits_;
+  std::atomic<int> misses_;
+};
+
+/*
+ * Opens the input jars and scans their Central Directories on a pool of
+ * worker threads, handing them out in the original order. The usage pattern:
+ *   InputJarScanner scanner(paths, nthreads);
+ *   for (size_t ix = 0; ix < paths.size(); ++ix) {
+ *     std::shared_ptr<ScannedJar> jar = scanner.Next();
+ *     // process jar->entries in order.
+ *   }
+ * Only a bounded number of jars are kept open ahead of the consumer. With
+ * fewer than two threads no workers are started and each jar is scanned
+ * by Next() on the calling thread, which also opens the following jar so
+ * that the kernel can read it ahead.
+ * Given a cache and the digests of the jars (in the same order as the paths,
+ * empty if unknown), the jars found in the cache are not scanned again, and
+ * the newly scanned ones are added to it. A jar that is cached is scanned
+ * as soon as it is opened, so that the other scanners sharing the cache
+ * never wait for a jar that is only opened.
+ * Given read_into_memory, the jars are read into memory rather than mapped.
+ */
+class InputJarScanner {
+ public:
+  InputJarScanner(const std::vector<std::string> &paths, int nthreads,
+                  ScannedJarCache *cache = nullptr,
+                  const std::vector<std::string> &digests = {},
+                  bool read_into_memory = false);
+
+  ~InputJarScanner();
+
+  // Returns the next jar in order, waiting for it to be scanned if needed.
+  // Returns nullptr after all the jars have been handed out.
+  std::shared_ptr<ScannedJar> Next();
+
+ private:
+  std::shared_ptr<ScannedJar> Scan(size_t ix);
+  // Returns the cached jar, or opens the jar and starts prefetching it.
+  std::shared_ptr<ScannedJar> OpenJar(size_t ix);
+  // Opens the jar and starts prefetching it, bypassing the cache.
+  std::shared_ptr<ScannedJar> OpenUncachedJar(size_t ix);
+  // Collects the entries of an opened jar, unless it has been walked.
+  static void WalkJar(const std::shared_ptr<ScannedJar> &jar);
+  void WorkerLoop();
+  bool Cacheable(size_t ix) const {
+    return cache_ && ix < digests_.size() && !digests_[ix].empty();
+  }
+
+  const std::vector<std::string> paths_;
+  ScannedJarCache *const cache_;
+  const std::vector<std::string> digests_;
+  const size_t window_;
+  const bool read_into_memory_;
+  std::vector<std::shared_ptr<ScannedJar>> slots_;
+  std::vector<std::thread> workers_;
+  // Without workers, the jar following the last one handed out.
+  std::shared_ptr<ScannedJar> ahead_;
+  std::mutex mutex_;
+  std::condition_variable scanned_;
+  std::condition_variable consumed_;
+  size_t next_to_scan_;
+  size_t next_to_consume_;
+  bool shutdown_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_INPUT_JAR_SCANNER_H_
@@ -0,0 +1,223 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/input_jar_scanner.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+using rules_cc::cc::runfiles::Runfiles;
+
+const char kPathLibTest1[] = "io_bazel/src/tools/singlejar/libtest1.jar";
+const char kPathLibTest2[] = "io_bazel/src/tools/singlejar/libtest2.jar";
+
+// Returns the names of the entries of the given jar, in the Central
+// Directory order.
+std::vector<std::string> EntryNames(const std::string &path) {
+  std::vector<std::string> names;
+  InputJar input_jar;
+  EXPECT_TRUE(input_jar.Open(path));
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    names.push_back(cdh->file_name_string());
+  }
+  input_jar.Close();
+  return names;
+}
+
+class InputJarScannerTest : public ::testing::TestWithParam<int> {
+ protected:
+  void SetUp() override { runfiles.reset(Runfiles::CreateForTest()); }
+
+  std::unique_ptr<Runfiles> runfiles;
+};
+
+// Jars are handed out in the input order with all their entries, whatever
+// the number of threads is.
+TEST_P(InputJarScannerTest, PreservesOrder) {
+  std::vector<std::string> paths;
+  for (int i = 0; i < 25; ++i) {
+    paths.push_back(runfiles->Rlocation(i % 2 ? kPathLibTest2 : kPathLibTest1));
+  }
+  InputJarScanner scanner(paths, GetParam());
+  for (auto &path : paths) {
+    std::shared_ptr<ScannedJar> jar = scanner.Next();
+    ASSERT_NE(nullptr, jar);
+    ASSERT_TRUE(jar->ok);
+    std::vector<std::string> names;
+    for (auto &entry : jar->entries) {
+      ASSERT_TRUE(entry.cdh->is());
+      ASSERT_TRUE(entry.lh->is());
+      EXPECT_EQ(entry.cdh->file_name_string(), entry.lh->file_name_string());
+      names.push_back(entry.cdh->file_name_string());
+    }
+    EXPECT_EQ(EntryNames(path), names);
+  }
+  EXPECT_EQ(nullptr, scanner.Next());
+}
+
+// A jar that cannot be opened is reported in its turn and does not prevent
+// the other jars from being scanned.
+TEST_P(InputJarScannerTest, BadJar) {
+  std::vector<std::string> paths = {
+      runfiles->Rlocation(kPathLibTest1),
+      singlejar_test_util::OutputFilePath("no_such.jar"),
+      runfiles->Rlocation(kPathLibTest2)};
+  InputJarScanner scanner(paths, GetParam());
+  std::shared_ptr<ScannedJar> jar = scanner.Next();
+  ASSERT_NE(nullptr, jar);
+  EXPECT_TRUE(jar->ok);
+  jar = scanner.Next();
+  ASSERT_NE(nullptr, jar);
+  EXPECT_FALSE(jar->ok);
+  jar = scanner.Next();
+  ASSERT_NE(nullptr, jar);
+  EXPECT_TRUE(jar->ok);
+  EXPECT_EQ(nullptr, scanner.Next());
+}
+
+// There is no jar to open ahead of the last one.
+TEST_P(InputJarScannerTest, SingleJar) {
+  std::string path = runfiles->Rlocation(kPathLibTest1);
+  InputJarScanner scanner({path}, GetParam());
+  std::shared_ptr<ScannedJar> jar = scanner.Next();
+  ASSERT_NE(nullptr, jar);
+  ASSERT_TRUE(jar->ok);
+  EXPECT_EQ(EntryNames(path).size(), jar->entries.size());
+  EXPECT_EQ(nullptr, scanner.Next());
+}
+
+// Destroying the scanner before all the jars have been consumed must not
+// hang or leak the worker threads.
+TEST_P(InputJarScannerTest, EarlyDestruction) {
+  std::vector<std::string> paths(100, runfiles->Rlocation(kPathLibTest1));
+  InputJarScanner scanner(paths, GetParam());
+  ASSERT_NE(nullptr, scanner.Next());
+}
+
+// A jar whose digest has not changed is taken from the cache rather than
+// scanned again.
+TEST_P(InputJarScannerTest, Cache) {
+  std::vector<std::string> paths = {runfiles->Rlocation(kPathLibTest1),
+                                    runfiles->Rlocation(kPathLibTest2)};
+  ScannedJarCache cache(10);
+  std::shared_ptr<ScannedJar> first;
+  {
+    InputJarScanner scanner(paths, GetParam(), &cache, {"d1", "d2"});
+    first = scanner.Next();
+    ASSERT_NE(nullptr, scanner.Next());
+  }
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_EQ(0, cache.hits());
+
+  InputJarScanner scanner(paths, GetParam(), &cache, {"d1", "changed"});
+  std::shared_ptr<ScannedJar> jar = scanner.Next();
+  EXPECT_EQ(first, jar);
+  EXPECT_EQ(EntryNames(paths[0]).size(), jar->entries.size());
+  jar = scanner.Next();
+  ASSERT_NE(nullptr, jar);
+  EXPECT_TRUE(jar->ok);
+  EXPECT_EQ(EntryNames(paths[1]).size(), jar->entries.size());
+  EXPECT_EQ(1, cache.hits());
+}
+
+// Jars without a digest are not cached.
+TEST_P(InputJarScannerTest, CacheNeedsDigest) {
+  std::vector<std::string> paths = {runfiles->Rlocation(kPathLibTest1),
+                                    runfiles->Rlocation(kPathLibTest2)};
+  ScannedJarCache cache(10);
+  InputJarScanner scanner(paths, GetParam(), &cache, {"", "d2"});
+  ASSERT_NE(nullptr, scanner.Next());
+  ASSERT_NE(nullptr, scanner.Next());
+  EXPECT_EQ(1u, cache.size());
+  EXPECT_NE(nullptr, cache.Get(paths[1], "d2"));
+}
+
+INSTANTIATE_TEST_SUITE_P(Threads, InputJarScannerTest,
+                         ::testing::Values(1, 2, 8));
+
+// The least recently used jar is evicted first.
+TEST(ScannedJarCacheTest, Eviction) {
+  ScannedJarCache cache(2);
+  std::shared_ptr<ScannedJar> a = std::make_shared<ScannedJar>();
+  std::shared_ptr<ScannedJar> b = std::make_shared<ScannedJar>();
+  std::shared_ptr<ScannedJar> c = std::make_shared<ScannedJar>();
+  cache.Put("a", "1", a);
+  cache.Put("b", "1", b);
+  EXPECT_EQ(a, cache.Get("a", "1"));
+  cache.Put("c", "1", c);
+  EXPECT_EQ(2u, cache.size());
+  EXPECT_EQ(a, cache.Get("a", "1"));
+  EXPECT_EQ(nullptr, cache.Get("b", "1"));
+  EXPECT_EQ(c, cache.Get("c", "1"));
+}
+
+// A stale jar is dropped as soon as its digest is found to differ.
+TEST(ScannedJarCacheTest, DigestMismatch) {
+  ScannedJarCache cache(2);
+  cache.Put("a", "1", std::make_shared<ScannedJar>());
+  EXPECT_EQ(nullptr, cache.Get("a", "2"));
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_EQ(nullptr, cache.Get("a", "1"));
+  EXPECT_EQ(0, cache.hits());
+  EXPECT_EQ(2, cache.misses());
+}
+
+// Concurrent requests for the same jar scan it once and share the result.
+TEST(ScannedJarCacheTest, GetOrScanOnce) {
+  ScannedJarCache cache(2);
+  std::atomic<int> scans(0);
+  auto scan = [&scans] {
+    ++scans;
+    std::shared_ptr<ScannedJar> jar = std::make_shared<ScannedJar>();
+    jar->ok = true;
+    return jar;
+  };
+  std::vector<std::shared_ptr<ScannedJar>> jars(4);
+  std::vector<std::thread> threads;
+  for (auto &jar : jars) {
+    threads.emplace_back([&cache, &scan, &jar] {
+      jar = cache.GetOrScan("a", "1", scan);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(1, scans.load());
+  for (const auto &jar : jars) {
+    EXPECT_EQ(jars[0], jar);
+  }
+  EXPECT_EQ(3, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+}
+
+// A jar that cannot be opened is not cached.
+TEST(ScannedJarCacheTest, GetOrScanFailure) {
+  ScannedJarCache cache(2);
+  auto scan = [] { return std::make_shared<ScannedJar>(); };
+  EXPECT_FALSE(cache.GetOrScan("a", "1", scan)->ok);
+  EXPECT_EQ(0u, cache.size());
+}
+
+}  // namespace
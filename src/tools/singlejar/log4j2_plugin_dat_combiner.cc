@@ -12,10 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstdint>
-#include <map>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "src/tools/singlejar/diag.h"
@@ -48,26 +48,65 @@ inline static T swapByteOrder(const T &val) {
   return swapped;
 }
 
-bool readBool(std::istringstream &stream) {
-  bool value;
-  stream.read(reinterpret_cast<char *>(&value), sizeof(value));
-  return value;
-}
+namespace {
 
-uint32_t readInt(std::istringstream &stream) {
-  uint32_t value;
-  stream.read(reinterpret_cast<char *>(&value), sizeof(value));
-  return swapByteOrder(value);
-}
+// Reads the values of a Log4j2 plugin cache file, see swapByteOrder above.
+// Once the data run out, all the reads return zero values and ok() is
+// false.
+class PluginCacheReader {
+ public:
+  PluginCacheReader(const uint8_t *data, size_t size)
+      : next_(data), end_(data + size), ok_(true) {}
 
-std::string readUTFString(std::istringstream &stream) {
-  uint16_t length;
-  stream.read(reinterpret_cast<char *>(&length), sizeof(length));
-  length = swapByteOrder(length);  // Convert to host byte order
-  std::string result(length, '\0');
-  stream.read(&result[0], length);
-  return result;
-}
+  bool ok() const { return ok_; }
+
+  bool ReadBool() {
+    const uint8_t *p = Take(1);
+    return p != nullptr && *p != 0;
+  }
+
+  uint32_t ReadInt() {
+    uint32_t value = 0;
+    const uint8_t *p = Take(sizeof(value));
+    if (p != nullptr) {
+      memcpy(&value, p, sizeof(value));
+    }
+    return swapByteOrder(value);
+  }
+
+  // The result points into the data.
+  std::string_view ReadUTFString() {
+    uint16_t length = 0;
+    const uint8_t *p = Take(sizeof(length));
+    if (p == nullptr) {
+      return std::string_view();
+    }
+    memcpy(&length, p, sizeof(length));
+    length = swapByteOrder(length);
+    p = Take(length);
+    if (p == nullptr) {
+      return std::string_view();
+    }
+    return std::string_view(reinterpret_cast<const char *>(p), length);
+  }
+
+ private:
+  const uint8_t *Take(size_t n) {
+    if (!ok_ || static_cast<size_t>(end_ - next_) < n) {
+      ok_ = false;
+      return nullptr;
+    }
+    const uint8_t *result = next_;
+    next_ += n;
+    return result;
+  }
+
+  const uint8_t *next_;
+  const uint8_t *end_;
+  bool ok_;
+};
+
+}  // namespace
 
 void writeBoolean(std::vector<uint8_t> &buffer, bool value) {
   uint8_t byte = value ? 1 : 0;
@@ -80,70 +119,121 @@ void writeInt(std::vector<uint8_t> &buffer, int value) {
   buffer.insert(buffer.end(), data, data + sizeof(value));
 }
 
-void writeUTFString(std::vector<uint8_t> &buffer, const std::string &str) {
+void writeUTFString(std::vector<uint8_t> &buffer, std::string_view str) {
   uint16_t length = swapByteOrder(static_cast<uint16_t>(str.size()));
   const uint8_t *lengthData = reinterpret_cast<const uint8_t *>(&length);
   buffer.insert(buffer.end(), lengthData, lengthData + sizeof(length));
   buffer.insert(buffer.end(), str.begin(), str.end());
 }
 
-// Write Log4j2 plugin cache file.
-//
-// Modeled after the Java canonical implementation here:
-// https://github.com/apache/logging-log4j2/blob/8573ef778d2fad2bbec50a687955dccd2a616cc5/log4j-core/src/main/java/org/apache/logging/log4j/core/config/plugins/processor/PluginCache.java#L66-L85
-std::vector<uint8_t> writeLog4j2PluginCacheFile(
-    const std::map<std::string, std::map<std::string, PluginEntry>>
-        &categories) {
-  std::vector<uint8_t> buffer;
-  writeInt(buffer, static_cast<int>(categories.size()));
-  for (const auto &categoryPair : categories) {
-    writeUTFString(buffer, categoryPair.first);
-    writeInt(buffer, static_cast<int>(categoryPair.second.size()));
-    for (const auto &pluginPair : categoryPair.second) {
-      const PluginEntry &plugin = pluginPair.second;
-      writeUTFString(buffer, plugin.key);
-      writeUTFString(buffer, plugin.className);
-      writeUTFString(buffer, plugin.name);
-      writeBoolean(buffer, plugin.printable);
-      writeBoolean(buffer, plugin.defer);
-    }
-  }
+Log4J2PluginDatCombiner::~Log4J2PluginDatCombiner() {}
 
-  return buffer;
+uint32_t Log4J2PluginDatCombiner::Intern(std::string_view s) {
+  auto it = string_ids_.find(s);
+  if (it != string_ids_.end()) {
+    return it->second;
+  }
+  if (s.size() > string_block_free_) {
+    string_blocks_.emplace_back(new char[kStringBlockSize]);
+    string_block_free_ = kStringBlockSize;
+  }
+  char *chars = string_blocks_.back().get() + kStringBlockSize -
+                string_block_free_;
+  memcpy(chars, s.data(), s.size());
+  string_block_free_ -= s.size();
+  uint32_t id = strings_.size();
+  strings_.emplace_back(chars, s.size());
+  string_ids_.emplace(strings_.back(), id);
+  return id;
 }
 
 // Load Log4j2 plugin .cache file.
 //
 // Modeled after the Java canonical implementation here:
 // https://github.com/apache/logging-log4j2/blob/8573ef778d2fad2bbec50a687955dccd2a616cc5/log4j-core/src/main/java/org/apache/logging/log4j/core/config/plugins/processor/PluginCache.java#L93-L124
-std::map<std::string, std::map<std::string, PluginEntry>>
-loadLog4j2PluginCacheFile(TransientBytes &transientBytes) {
-  uint64_t data_size = transientBytes.data_size();
-  std::vector<uint8_t> byteData(data_size);
-  uint32_t checksum = 0;
-  transientBytes.CopyOut(byteData.data(), &checksum);
-  std::istringstream buffer(std::string(byteData.begin(), byteData.end()));
-
-  std::map<std::string, std::map<std::string, PluginEntry>> categories;
-  uint32_t categoriesCount = readInt(buffer);
-  for (uint32_t i = 0; i < categoriesCount; ++i) {
-    std::string category = readUTFString(buffer);
-    uint32_t entries = readInt(buffer);
-    for (uint32_t j = 0; j < entries; ++j) {
-      std::string key = readUTFString(buffer);
-      std::string className = readUTFString(buffer);
-      std::string name = readUTFString(buffer);
-      bool printable = readBool(buffer);
-      bool defer = readBool(buffer);
-      PluginEntry entry(key, className, name, printable, defer, category);
-      categories[category].insert({key, entry});
+void Log4J2PluginDatCombiner::Load(const uint8_t *data, size_t size) {
+  PluginCacheReader reader(data, size);
+  uint32_t categoriesCount = reader.ReadInt();
+  for (uint32_t i = 0; i < categoriesCount && reader.ok(); ++i) {
+    uint32_t category = Intern(reader.ReadUTFString());
+    uint32_t entries = reader.ReadInt();
+    for (uint32_t j = 0; j < entries && reader.ok(); ++j) {
+      Plugin plugin;
+      plugin.category = category;
+      plugin.key = Intern(reader.ReadUTFString());
+      plugin.class_name = Intern(reader.ReadUTFString());
+      plugin.name = Intern(reader.ReadUTFString());
+      plugin.printable = reader.ReadBool();
+      plugin.defer = reader.ReadBool();
+      if (!reader.ok()) {
+        break;
+      }
+      auto origin = plugin_origins_.emplace(
+          static_cast<uint64_t>(plugin.category) << 32 | plugin.key, merges_);
+      if (!origin.second) {
+        // Duplicates within a single file are not an error.
+        if (no_duplicates_ && origin.first->second != merges_) {
+          const std::string_view category = strings_[plugin.category];
+          const std::string_view key = strings_[plugin.key];
+          diag_errx(1,
+                    "%s:%d: Log4J2 plugin %.*s.%.*s is present in multiple "
+                    "jars",
+                    __FILE__, __LINE__, static_cast<int>(category.size()),
+                    category.data(), static_cast<int>(key.size()), key.data());
+        }
+        continue;
+      }
+      plugins_.push_back(plugin);
     }
   }
+  if (!reader.ok()) {
+    diag_errx(1, "%s:%d: %s is truncated", __FILE__, __LINE__,
+              filename_.c_str());
+  }
+}
 
-  return categories;
+// Write Log4j2 plugin cache file.
+//
+// Modeled after the Java canonical implementation here:
+// https://github.com/apache/logging-log4j2/blob/8573ef778d2fad2bbec50a687955dccd2a616cc5/log4j-core/src/main/java/org/apache/logging/log4j/core/config/plugins/processor/PluginCache.java#L66-L85
+// The plugins have to be sorted by category and key.
+std::vector<uint8_t> Log4J2PluginDatCombiner::Write() const {
+  // Size the buffer up front, it is going to be large for a deploy jar.
+  int categories = 0;
+  size_t size = sizeof(int32_t);
+  for (size_t i = 0; i < plugins_.size(); ++i) {
+    const Plugin &plugin = plugins_[i];
+    if (i == 0 || plugin.category != plugins_[i - 1].category) {
+      ++categories;
+      size += sizeof(uint16_t) + strings_[plugin.category].size() +
+              sizeof(int32_t);
+    }
+    size += 3 * sizeof(uint16_t) + strings_[plugin.key].size() +
+            strings_[plugin.class_name].size() + strings_[plugin.name].size() +
+            2;
+  }
+  std::vector<uint8_t> buffer;
+  buffer.reserve(size);
+  writeInt(buffer, categories);
+  for (size_t begin = 0, end; begin < plugins_.size(); begin = end) {
+    const uint32_t category = plugins_[begin].category;
+    for (end = begin + 1;
+         end < plugins_.size() && plugins_[end].category == category; ++end) {
+    }
+    writeUTFString(buffer, strings_[category]);
+    writeInt(buffer, static_cast<int>(end - begin));
+    for (size_t i = begin; i < end; ++i) {
+      const Plugin &plugin = plugins_[i];
+      writeUTFString(buffer, strings_[plugin.key]);
+      writeUTFString(buffer, strings_[plugin.class_name]);
+      writeUTFString(buffer, strings_[plugin.name]);
+      writeBoolean(buffer, plugin.printable);
+      writeBoolean(buffer, plugin.defer);
+    }
+  }
+  return buffer;
 }
 
-Log4J2PluginDatCombiner::~Log4J2PluginDatCombiner() {}
 
 bool Log4J2PluginDatCombiner::Merge(const CDH *cdh, const LH *lh) {
   TransientBytes bytes_;
@@ -154,44 +244,36 @@ bool Log4J2PluginDatCombiner::Merge(const CDH *cdh, const LH *lh) {
       inflater_.reset(new Inflater());
     }
     bytes_.DecompressEntryContents(cdh, lh, inflater_.get());
+  } else if (lh->compression_method() == kZstdMethod) {
+    if (!zstd_decompressor_) {
+      zstd_decompressor_.reset(new ZstdDecompressor());
+    }
+    bytes_.DecompressZstdEntryContents(cdh, lh, zstd_decompressor_.get());
   } else {
     diag_errx(2, "neither stored nor deflated");
   }
 
-  auto newCategories = loadLog4j2PluginCacheFile(bytes_);
-  for (const auto &newCategoryPair : newCategories) {
-    auto newCategoryId = newCategoryPair.first;
-    auto newPlugins = newCategoryPair.second;
-
-    auto existingCategoryPair = categories_.find(newCategoryId);
-    if (existingCategoryPair != categories_.end()) {
-      for (const auto &pluginPair : newPlugins) {
-        auto newPluginKey = pluginPair.first;
-        auto newPlugin = pluginPair.second;
-
-        auto existingPluginKey = categories_[newCategoryId].find(newPluginKey);
-        if (existingPluginKey != categories_[newCategoryId].end() &&
-            no_duplicates_) {
-          diag_errx(1, "%s:%d: Log4J2 plugin %s.%s is present in multiple jars",
-                    __FILE__, __LINE__, newCategoryId.c_str(),
-                    newPluginKey.c_str());
-        }
-
-        categories_[newCategoryId].insert(pluginPair);
-      }
-    } else {
-      categories_[newCategoryId] = newPlugins;
-    }
-  }
-
+  std::vector<uint8_t> data(bytes_.data_size());
+  uint32_t checksum = 0;
+  bytes_.CopyOut(data.data(), &checksum);
+  Load(data.data(), data.size());
+  ++merges_;
   return true;
 }
 
 void *Log4J2PluginDatCombiner::OutputEntry(bool compress) {
-  if (categories_.empty()) {
+  if (plugins_.empty()) {
     return nullptr;
   }
-  auto buffer = writeLog4j2PluginCacheFile(categories_);
+  // Category and key pairs are unique, so the order is total.
+  std::sort(plugins_.begin(), plugins_.end(),
+            [this](const Plugin &a, const Plugin &b) {
+              if (a.category != b.category) {
+                return strings_[a.category] < strings_[b.category];
+              }
+              return strings_[a.key] < strings_[b.key];
+            });
+  auto buffer = Write();
   concatenator_->Append(reinterpret_cast<const char *>(buffer.data()),
                         buffer.size());
   return concatenator_->OutputEntry(compress);
@@ -15,36 +15,29 @@
 #ifndef SRC_TOOLS_SINGLEJAR_LOG4J2_PLUGIN_DAT_COMBINER_H_
 #define SRC_TOOLS_SINGLEJAR_LOG4J2_PLUGIN_DAT_COMBINER_H_ 1
 
-#include <map>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "src/tools/singlejar/combiners.h"
 
-class PluginEntry {
- public:
-  PluginEntry(const std::string &key, const std::string &className,
-              const std::string &name, bool printable, bool defer,
-              const std::string &category)
-      : key(key),
-        className(className),
-        name(name),
-        printable(printable),
-        defer(defer),
-        category(category) {}
-
-  std::string key;
-  std::string className;
-  std::string name;
-  bool printable;
-  bool defer;
-  std::string category;
-};
-
+/*
+ * Merges Log4j2 plugin cache files (Log4j2Plugins.dat). All the strings of
+ * the merged plugins are interned, the plugins themselves are kept in a flat
+ * vector in the order they are merged, and they are sorted by category and
+ * key only once, when the output is written. If several plugins have the
+ * same category and key, the first one wins.
+ */
 class Log4J2PluginDatCombiner : public Combiner {
  public:
   Log4J2PluginDatCombiner(const std::string &filename, const bool no_duplicates)
-      : filename_(filename), no_duplicates_(no_duplicates) {
+      : filename_(filename),
+        no_duplicates_(no_duplicates),
+        string_block_free_(0),
+        merges_(0) {
     concatenator_.reset(new Concatenator(filename_, false));
   }
   ~Log4J2PluginDatCombiner() override;
@@ -52,11 +45,41 @@ class Log4J2PluginDatCombiner : public Combiner {
   void *OutputEntry(bool compress) override;
 
  private:
+  struct Plugin {
+    // Interned strings.
+    uint32_t category;
+    uint32_t key;
+    uint32_t class_name;
+    uint32_t name;
+    bool printable;
+    bool defer;
+  };
+
+  // Returns the id of the given string, interning it if it is new.
+  uint32_t Intern(std::string_view s);
+  // Parses a plugin cache file and adds its plugins.
+  void Load(const uint8_t *data, size_t size);
+  std::vector<uint8_t> Write() const;
+
   std::unique_ptr<Concatenator> concatenator_;
   const std::string filename_;
   const bool no_duplicates_;
   std::unique_ptr<Inflater> inflater_;
-  std::map<std::string, std::map<std::string, PluginEntry>> categories_;
+  std::unique_ptr<ZstdDecompressor> zstd_decompressor_;
+  // Larger than any string in a plugin cache file.
+  static constexpr size_t kStringBlockSize = 1 << 20;
+
+  // Interned strings, indexed by id. Their characters are packed in blocks
+  // that are never reallocated.
+  std::vector<std::string_view> strings_;
+  std::vector<std::unique_ptr<char[]>> string_blocks_;
+  size_t string_block_free_;
+  std::unordered_map<std::string_view, uint32_t> string_ids_;
+  std::vector<Plugin> plugins_;
+  // Maps the category and key ids of each plugin to the number of the
+  // Merge() call it came from.
+  std::unordered_map<uint64_t, int> plugin_origins_;
+  int merges_;
 };
 
 #endif  // SRC_TOOLS_SINGLEJAR_LOG4J2_PLUGIN_DAT_COMBINER_H_
@@ -0,0 +1,263 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Measures Log4J2PluginDatCombiner on a deploy jar with many libraries that
+ * ship a Log4j2Plugins.dat. The plugin cache files of the test data jars are
+ * the templates: library N contributes a copy of each of them whose plugin
+ * keys and class names carry the suffix N, and the unchanged template, which
+ * duplicates the plugins of every other library. Usage:
+ *   log4j2_plugin_dat_combiner_benchmark [--libraries N] [--iterations N]
+ * It prints the median merge and output times, and by how much the peak RSS
+ * grows past the one of the generated input.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/log4j2_plugin_dat_combiner.h"
+#include "src/tools/singlejar/transient_bytes.h"
+#include "src/tools/singlejar/zip_headers.h"
+#include "src/tools/singlejar/zlib_interface.h"
+#include "rules_cc/cc/runfiles/runfiles.h"
+
+namespace {
+
+using rules_cc::cc::runfiles::Runfiles;
+
+const char kPluginsCachePath[] =
+    "META-INF/org/apache/logging/log4j/core/config/plugins/Log4j2Plugins.dat";
+
+const char *const kTemplateJars[] = {
+    "io_bazel/src/tools/singlejar/data/log4j2_plugins_set_1.jar",
+    "io_bazel/src/tools/singlejar/data/log4j2_plugins_set_2.jar",
+};
+
+// Returns the uncompressed plugin cache file of the given jar.
+std::string ReadPluginsCache(const std::string &jar_path) {
+  InputJar input_jar;
+  if (!input_jar.Open(jar_path)) {
+    diag_errx(1, "%s:%d: Cannot open %s", __FILE__, __LINE__,
+              jar_path.c_str());
+  }
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    if (!cdh->file_name_is(kPluginsCachePath)) {
+      continue;
+    }
+    TransientBytes bytes;
+    if (lh->compression_method() == Z_NO_COMPRESSION) {
+      bytes.ReadEntryContents(cdh, lh);
+    } else {
+      Inflater inflater;
+      bytes.DecompressEntryContents(cdh, lh, &inflater);
+    }
+    std::string result(bytes.data_size(), '\0');
+    uint32_t checksum = 0;
+    bytes.CopyOut(reinterpret_cast<uint8_t *>(&result[0]), &checksum);
+    return result;
+  }
+  diag_errx(1, "%s:%d: %s has no %s", __FILE__, __LINE__, jar_path.c_str(),
+            kPluginsCachePath);
+}
+
+// Copies the big-endian values of a plugin cache file, appending the suffix
+// to the plugin keys and class names.
+class PluginsCacheRewriter {
+ public:
+  PluginsCacheRewriter(const std::string &in, const std::string &suffix)
+      : in_(in), pos_(0), suffix_(suffix) {}
+
+  std::string Rewrite() {
+    uint32_t categories = CopyInt();
+    for (uint32_t i = 0; i < categories; ++i) {
+      CopyString("");
+      uint32_t plugins = CopyInt();
+      for (uint32_t j = 0; j < plugins; ++j) {
+        CopyString(suffix_);  // Key.
+        CopyString(suffix_);  // Class name.
+        CopyString("");       // Name.
+        Copy(2);              // Printable and defer.
+      }
+    }
+    return out_;
+  }
+
+ private:
+  uint32_t CopyInt() {
+    const uint8_t *p = Copy(4);
+    return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+  }
+
+  void CopyString(const std::string &suffix) {
+    const uint8_t *p = Take(2);
+    size_t length = p[0] << 8 | p[1];
+    size_t new_length = length + suffix.size();
+    out_.push_back(static_cast<char>(new_length >> 8));
+    out_.push_back(static_cast<char>(new_length));
+    Copy(length);
+    out_.append(suffix);
+  }
+
+  const uint8_t *Copy(size_t n) {
+    const uint8_t *result = Take(n);
+    out_.append(reinterpret_cast<const char *>(result), n);
+    return result;
+  }
+
+  const uint8_t *Take(size_t n) {
+    if (pos_ + n > in_.size()) {
+      diag_errx(1, "%s:%d: Truncated plugin cache file", __FILE__, __LINE__);
+    }
+    const uint8_t *result =
+        reinterpret_cast<const uint8_t *>(in_.data()) + pos_;
+    pos_ += n;
+    return result;
+  }
+
+  const std::string &in_;
+  size_t pos_;
+  const std::string suffix_;
+  std::string out_;
+};
+
+// Returns a stored entry with the given contents, as InputJar would.
+std::unique_ptr<LH, decltype(&free)> StoredEntry(const std::string &data) {
+  Concatenator concatenator(kPluginsCachePath, false);
+  concatenator.Append(data);
+  return std::unique_ptr<LH, decltype(&free)>(
+      reinterpret_cast<LH *>(concatenator.OutputEntry(false)), &free);
+}
+
+struct Sample {
+  double merge_seconds;
+  double output_seconds;
+};
+
+Sample RunOnce(const std::vector<std::unique_ptr<LH, decltype(&free)>> &entries,
+               size_t *output_size) {
+  // The combiner only looks at the CDH for the sizes of entries that have a
+  // data descriptor.
+  CDH cdh;
+  memset(&cdh, 0, sizeof(cdh));
+  Log4J2PluginDatCombiner combiner(kPluginsCachePath, false);
+  auto start = std::chrono::steady_clock::now();
+  for (const auto &entry : entries) {
+    combiner.Merge(&cdh, entry.get());
+  }
+  auto merged = std::chrono::steady_clock::now();
+  LH *output = reinterpret_cast<LH *>(combiner.OutputEntry(false));
+  auto end = std::chrono::steady_clock::now();
+  *output_size = output->uncompressed_file_size();
+  free(output);
+  Sample sample;
+  sample.merge_seconds = std::chrono::duration<double>(merged - start).count();
+  sample.output_seconds = std::chrono::duration<double>(end - merged).count();
+  return sample;
+}
+
+long MaxRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // Bytes there.
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage: log4j2_plugin_dat_combiner_benchmark [--libraries N] "
+          "[--iterations N]\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  int libraries = 20000;
+  int iterations = 3;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    std::string flag = argv[i];
+    const char *value = argv[++i];
+    if (flag == "--libraries") {
+      libraries = atoi(value);
+    } else if (flag == "--iterations") {
+      iterations = atoi(value);
+    } else {
+      Usage();
+    }
+  }
+  if (libraries < 1 || iterations < 1) {
+    Usage();
+  }
+
+  std::string error;
+  std::unique_ptr<Runfiles> runfiles(Runfiles::Create(argv[0], &error));
+  if (runfiles == nullptr) {
+    diag_errx(1, "%s:%d: %s", __FILE__, __LINE__, error.c_str());
+  }
+  std::vector<std::string> templates;
+  for (const char *jar : kTemplateJars) {
+    templates.push_back(ReadPluginsCache(runfiles->Rlocation(jar)));
+  }
+  std::vector<std::unique_ptr<LH, decltype(&free)>> entries;
+  size_t input_size = 0;
+  for (int i = 0; i < libraries; ++i) {
+    for (const std::string &plugins_cache : templates) {
+      std::string rewritten =
+          PluginsCacheRewriter(plugins_cache, "$" + std::to_string(i))
+              .Rewrite();
+      input_size += rewritten.size() + plugins_cache.size();
+      entries.push_back(StoredEntry(rewritten));
+      entries.push_back(StoredEntry(plugins_cache));
+    }
+  }
+
+  const long input_rss_kb = MaxRssKb();
+  std::vector<Sample> samples;
+  size_t output_size = 0;
+  for (int i = 0; i < iterations; ++i) {
+    samples.push_back(RunOnce(entries, &output_size));
+  }
+  std::sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) {
+    return a.merge_seconds + a.output_seconds <
+           b.merge_seconds + b.output_seconds;
+  });
+  const Sample &median = samples[samples.size() / 2];
+  const double mb = 1024.0 * 1024.0;
+  printf("%8s %9s %9s %9s %9s %8s\n", "entries", "in_MB", "out_MB",
+         "merge_s", "output_s", "+rss_MB");
+  printf("%8zu %9.1f %9.1f %9.3f %9.3f %8.1f\n", entries.size(),
+         input_size / mb, output_size / mb, median.merge_seconds,
+         median.output_seconds, (MaxRssKb() - input_rss_kb) / 1024.0);
+  return 0;
+}
@@ -37,6 +37,14 @@ class MappedFile {
 
   bool Open(const std::string &path);
 
+  // Same as Open(), but reads the file into memory rather than mapping it.
+  // On network filesystems such as FUSE or NFS, the page faults that bring
+  // a mapping in are synchronous and serialized. Instead the file is read
+  // with large reads, many of them in flight at once (through io_uring on
+  // Linux, if the kernel allows it). The memory is not backed by the file,
+  // so Advise() does nothing for it. On Windows the file is mapped.
+  bool Read(const std::string &path);
+
   bool MapExisting(unsigned char *mapped_start, unsigned char *mapped_end) {
     mapped_start_ = mapped_start;
     mapped_end_ = mapped_end;
@@ -68,6 +76,18 @@ class MappedFile {
 
   size_t size() const { return mapped_end_ - mapped_start_; }
 
+  // How a range of the mapping is going to be accessed.
+  enum Advice {
+    kSequential,  // Front to back, so aggressive read-ahead pays off.
+    kWillNeed,    // Soon, so start reading it in the background now.
+    kDontNeed,    // Not any more, so its pages can be dropped from memory.
+  };
+
+  // Passes an access hint for a range of the mapping to the kernel. It is
+  // only a hint: failures are ignored, and it does nothing on Windows or
+  // for memory handed to MapExisting().
+  void Advise(off64_t offset, size_t size, Advice advice) const;
+
  private:
   bool is_open() const;
 
@@ -78,6 +98,8 @@ class MappedFile {
   /* HANDLE */ void *hMapFile_;
 #else
   int fd_;
+  // Whether the file has been read rather than mapped.
+  bool read_;
 #endif
 };
 
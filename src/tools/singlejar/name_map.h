@@ -0,0 +1,176 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_NAME_MAP_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_NAME_MAP_H_ 1
+
+#include <stddef.h>
+#include <string.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * A hash map from entry names to values, for the millions of lookups a
+ * large output jar needs. It uses open addressing with linear probing, so
+ * a lookup hits one contiguous array, and copies the key bytes into an
+ * arena, so neither a lookup nor an insertion allocates a std::string.
+ * The keys are only copied on insertion, so the callers may pass names
+ * pointing into the mapped input jars.
+ *
+ * The values must be default constructible and copyable. The pointers
+ * returned by Emplace() and Find() are invalidated by the next insertion.
+ */
+template <typename Value>
+class NameMap {
+ public:
+  NameMap() : size_(0), arena_free_(0), probes_(0) {}
+
+  NameMap(const NameMap &) = delete;
+  NameMap &operator=(const NameMap &) = delete;
+
+  // Inserts the key with the given value unless it is already present.
+  // Returns the value for the key and whether it has been inserted.
+  std::pair<Value *, bool> Emplace(const char *key, size_t length,
+                                   const Value &value) {
+    if (2 * (size_ + 1) > slots_.size()) {
+      Rehash(slots_.empty() ? kMinCapacity : 2 * slots_.size());
+    }
+    size_t hash = Hash(key, length);
+    Slot *slot = Probe(key, length, hash);
+    if (slot->key != nullptr) {
+      return {&slot->value, false};
+    }
+    slot->key = CopyKey(key, length);
+    slot->length = length;
+    slot->hash = hash;
+    slot->value = value;
+    ++size_;
+    return {&slot->value, true};
+  }
+
+  std::pair<Value *, bool> Emplace(const std::string &key,
+                                   const Value &value) {
+    return Emplace(key.data(), key.size(), value);
+  }
+
+  // Returns the value for the key, or nullptr if it is not present.
+  Value *Find(const char *key, size_t length) {
+    if (size_ == 0) {
+      return nullptr;
+    }
+    Slot *slot = Probe(key, length, Hash(key, length));
+    return slot->key == nullptr ? nullptr : &slot->value;
+  }
+
+  bool Contains(const char *key, size_t length) {
+    return Find(key, length) != nullptr;
+  }
+
+  bool Contains(const std::string &key) {
+    return Contains(key.data(), key.size());
+  }
+
+  // Makes room for the given number of keys without rehashing.
+  void Reserve(size_t count) {
+    size_t capacity = slots_.empty() ? kMinCapacity : slots_.size();
+    while (capacity < 2 * count) {
+      capacity *= 2;
+    }
+    if (capacity > slots_.size()) {
+      Rehash(capacity);
+    }
+  }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return slots_.size(); }
+  // The total number of slots examined by the lookups and insertions.
+  size_t probes() const { return probes_; }
+
+ private:
+  struct Slot {
+    const char *key = nullptr;
+    size_t length = 0;
+    size_t hash = 0;
+    Value value;
+  };
+
+  static constexpr size_t kMinCapacity = 1024;
+  static constexpr size_t kArenaBlockSize = 256 * 1024;
+
+  static size_t Hash(const char *key, size_t length) {
+    return std::hash<std::string_view>()(std::string_view(key, length));
+  }
+
+  // Returns the slot holding the key, or the empty slot where it belongs.
+  Slot *Probe(const char *key, size_t length, size_t hash) {
+    const size_t mask = slots_.size() - 1;
+    for (size_t ix = hash & mask;; ix = (ix + 1) & mask) {
+      ++probes_;
+      Slot *slot = &slots_[ix];
+      if (slot->key == nullptr ||
+          (slot->hash == hash && slot->length == length &&
+           !memcmp(slot->key, key, length))) {
+        return slot;
+      }
+    }
+  }
+
+  void Rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+    const size_t mask = capacity - 1;
+    for (auto &old_slot : old_slots) {
+      if (old_slot.key == nullptr) {
+        continue;
+      }
+      size_t ix = old_slot.hash & mask;
+      while (slots_[ix].key != nullptr) {
+        ix = (ix + 1) & mask;
+      }
+      slots_[ix] = old_slot;
+    }
+  }
+
+  const char *CopyKey(const char *key, size_t length) {
+    char *copy;
+    if (length > kArenaBlockSize) {
+      // Too long to share a block, give it its own.
+      arena_.emplace_back(new char[length]);
+      arena_free_ = 0;
+      copy = arena_.back().get();
+    } else {
+      if (arena_.empty() || length > arena_free_) {
+        arena_.emplace_back(new char[kArenaBlockSize]);
+        arena_free_ = kArenaBlockSize;
+      }
+      copy = arena_.back().get() + kArenaBlockSize - arena_free_;
+      arena_free_ -= length;
+    }
+    memcpy(copy, key, length);
+    return copy;
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_;
+  std::vector<std::unique_ptr<char[]>> arena_;
+  size_t arena_free_;
+  size_t probes_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_NAME_MAP_H_
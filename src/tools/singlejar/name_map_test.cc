@@ -0,0 +1,82 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/name_map.h"
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+TEST(NameMapTest, EmplaceAndFind) {
+  NameMap<int> map;
+  EXPECT_EQ(nullptr, map.Find("a", 1));
+  auto got = map.Emplace("a/b", 3, 1);
+  ASSERT_TRUE(got.second);
+  EXPECT_EQ(1, *got.first);
+  got = map.Emplace(std::string("a/b"), 2);
+  EXPECT_FALSE(got.second);
+  EXPECT_EQ(1, *got.first);
+  EXPECT_EQ(1UL, map.size());
+  // Keys are compared by length too.
+  EXPECT_FALSE(map.Contains("a/", 2));
+  EXPECT_FALSE(map.Contains("a/bc", 4));
+  EXPECT_TRUE(map.Contains("a/bc", 3));
+}
+
+// The keys are copied, the caller's buffer can be reused.
+TEST(NameMapTest, CopiesKeys) {
+  NameMap<int> map;
+  char buffer[] = "name";
+  map.Emplace(buffer, 4, 1);
+  buffer[0] = 'g';
+  EXPECT_TRUE(map.Contains("name"));
+  EXPECT_FALSE(map.Contains("game"));
+}
+
+// The entries survive the table growth, including the keys longer than an
+// arena block.
+TEST(NameMapTest, Growth) {
+  NameMap<int> map;
+  const std::string long_name(1024 * 1024, 'x');
+  map.Emplace(long_name, -1);
+  for (int i = 0; i < 100000; ++i) {
+    std::string name = "dir/file" + std::to_string(i);
+    ASSERT_TRUE(map.Emplace(name, i).second);
+  }
+  EXPECT_EQ(100001UL, map.size());
+  EXPECT_LE(2 * map.size(), map.capacity());
+  for (int i = 0; i < 100000; ++i) {
+    std::string name = "dir/file" + std::to_string(i);
+    int *value = map.Find(name.data(), name.size());
+    ASSERT_NE(nullptr, value);
+    EXPECT_EQ(i, *value);
+  }
+  ASSERT_TRUE(map.Contains(long_name));
+  EXPECT_EQ(-1, *map.Find(long_name.data(), long_name.size()));
+}
+
+TEST(NameMapTest, Reserve) {
+  NameMap<int> map;
+  map.Reserve(5000);
+  size_t capacity = map.capacity();
+  EXPECT_LE(10000UL, capacity);
+  for (int i = 0; i < 5000; ++i) {
+    map.Emplace(std::to_string(i), i);
+  }
+  EXPECT_EQ(capacity, map.capacity());
+}
+
+}  // namespace
@@ -0,0 +1,39 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/name_matcher.h"
+
+#include <string>
+
+void NameMatcher::Add(const std::string &pattern) {
+  uint32_t node = 0;
+  for (size_t ix = 0; ix < pattern.size(); ++ix) {
+    uint8_t c = static_cast<uint8_t>(
+        pattern[kind_ == kPrefix ? ix : pattern.size() - 1 - ix]);
+    uint32_t next = 0;
+    for (auto &edge : nodes_[node].edges) {
+      if (edge.first == c) {
+        next = edge.second;
+        break;
+      }
+    }
+    if (next == 0) {
+      next = static_cast<uint32_t>(nodes_.size());
+      nodes_[node].edges.emplace_back(c, next);
+      nodes_.emplace_back();
+    }
+    node = next;
+  }
+  nodes_[node].terminal = true;
+}
@@ -0,0 +1,90 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_NAME_MATCHER_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_NAME_MATCHER_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Matches entry names against a set of prefixes (or suffixes) in a single
+ * pass over the name, however many patterns there are: the patterns are
+ * compiled into a trie, which is walked from the start (or the end) of
+ * the name. An empty pattern matches any name.
+ */
+class NameMatcher {
+ public:
+  enum Kind { kPrefix, kSuffix };
+
+  explicit NameMatcher(Kind kind) : kind_(kind), nodes_(1) {}
+
+  void Add(const std::string &pattern);
+
+  void Add(const std::vector<std::string> &patterns) {
+    for (auto &pattern : patterns) {
+      Add(pattern);
+    }
+  }
+
+  // True if the name begins (or ends) with one of the patterns.
+  bool Matches(const char *name, size_t length) const {
+    const Node *node = &nodes_[0];
+    for (size_t ix = 0;; ++ix) {
+      if (node->terminal) {
+        return true;
+      }
+      if (ix == length) {
+        return false;
+      }
+      uint8_t c = static_cast<uint8_t>(
+          name[kind_ == kPrefix ? ix : length - 1 - ix]);
+      const Node *next = nullptr;
+      for (auto &edge : node->edges) {
+        if (edge.first == c) {
+          next = &nodes_[edge.second];
+          break;
+        }
+      }
+      if (next == nullptr) {
+        return false;
+      }
+      node = next;
+    }
+  }
+
+  bool Matches(const std::string &name) const {
+    return Matches(name.data(), name.size());
+  }
+
+  // True if no pattern has been added.
+  bool empty() const { return nodes_.size() == 1 && !nodes_[0].terminal; }
+
+ private:
+  struct Node {
+    // A pattern ends here.
+    bool terminal = false;
+    // The (byte, node index) pairs.
+    std::vector<std::pair<uint8_t, uint32_t>> edges;
+  };
+
+  Kind kind_;
+  std::vector<Node> nodes_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_NAME_MATCHER_H_
@@ -0,0 +1,60 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/name_matcher.h"
+
+#include <string>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+TEST(NameMatcherTest, Suffixes) {
+  NameMatcher matcher(NameMatcher::kSuffix);
+  EXPECT_TRUE(matcher.empty());
+  EXPECT_FALSE(matcher.Matches("a.png"));
+  matcher.Add({".png", ".jpg", "g.gif", ".gif"});
+  EXPECT_FALSE(matcher.empty());
+  EXPECT_TRUE(matcher.Matches("a.png"));
+  EXPECT_TRUE(matcher.Matches(".jpg"));
+  EXPECT_TRUE(matcher.Matches("dir/x.gif"));
+  EXPECT_TRUE(matcher.Matches("dir/g.gif"));
+  EXPECT_FALSE(matcher.Matches("a.pn"));
+  EXPECT_FALSE(matcher.Matches("png"));
+  EXPECT_FALSE(matcher.Matches("a.png/"));
+  EXPECT_FALSE(matcher.Matches(""));
+  // Only the given number of bytes is looked at.
+  EXPECT_TRUE(matcher.Matches("a.pngxyz", 5));
+}
+
+TEST(NameMatcherTest, Prefixes) {
+  NameMatcher matcher(NameMatcher::kPrefix);
+  matcher.Add({"com/google/", "com/goo", "org/"});
+  EXPECT_TRUE(matcher.Matches("com/google/Foo.class"));
+  EXPECT_TRUE(matcher.Matches("com/goofy"));
+  EXPECT_TRUE(matcher.Matches("org/"));
+  EXPECT_FALSE(matcher.Matches("org"));
+  EXPECT_FALSE(matcher.Matches("com/go"));
+  EXPECT_FALSE(matcher.Matches("net/org/"));
+}
+
+TEST(NameMatcherTest, EmptyPattern) {
+  NameMatcher matcher(NameMatcher::kPrefix);
+  matcher.Add("");
+  EXPECT_FALSE(matcher.empty());
+  EXPECT_TRUE(matcher.Matches(""));
+  EXPECT_TRUE(matcher.Matches("anything"));
+}
+
+}  // namespace
@@ -14,20 +14,42 @@
 
 #include "src/tools/singlejar/options.h"
 
+#include <set>
+
 #include "src/tools/singlejar/diag.h"
 
 void Options::ParseCommandLine(int argc, const char *const argv[]) {
   ArgTokenStream tokens(argc, argv);
-  std::string optarg;
+  Options *options = this;
+  bool next_output = false;
   while (!tokens.AtEnd()) {
-    if (ParseToken(&tokens)) {
+    if (tokens.MatchAndSet("--next_output", &next_output)) {
+      options->PostValidateOptions();
+      next_outputs.push_back(NewOptions());
+      options = next_outputs.back().get();
+    } else if (options->ParseToken(&tokens)) {
       continue;
     } else {
       diag_errx(1, "Bad command line argument %s", tokens.token().c_str());
     }
   }
+  options->PostValidateOptions();
 
-  PostValidateOptions();
+  // The outputs are built concurrently, by the same process.
+  std::set<std::string> output_jars = {output_jar};
+  for (const auto &other : next_outputs) {
+    if (!output_jars.insert(other->output_jar).second) {
+      diag_errx(1, "%s is given as the --output of more than one output",
+                other->output_jar.c_str());
+    }
+    if (other->memory_limit_mb != memory_limit_mb ||
+        other->libdeflate != libdeflate) {
+      diag_errx(1,
+                "--memory_limit_mb and --libdeflate apply to all the outputs, "
+                "they cannot differ for %s",
+                other->output_jar.c_str());
+    }
+  }
 }
 
 bool Options::ParseToken(ArgTokenStream *tokens) {
@@ -61,7 +83,22 @@ bool Options::ParseToken(ArgTokenStream *tokens) {
       tokens->MatchAndSet("--add_exports", &add_exports) ||
       tokens->MatchAndSet("--add_opens", &add_opens) ||
       tokens->MatchAndSet("--output_jar_creator", &output_jar_creator) ||
-      tokens->MatchAndSet("--no_strip_module_info", &no_strip_module_info)) {
+      tokens->MatchAndSet("--no_strip_module_info", &no_strip_module_info) ||
+      tokens->MatchAndSet("--zstd", &zstd) ||
+      tokens->MatchAndSet("--libdeflate", &libdeflate) ||
+      tokens->MatchAndSet("--check_one_version", &check_one_version) ||
+      tokens->MatchAndSet("--one_version_allowlist", &one_version_allowlist) ||
+      tokens->MatchAndSet("--threads", &threads) ||
+      tokens->MatchAndSet("--memory_limit_mb", &memory_limit_mb) ||
+      tokens->MatchAndSet("--entry_cache", &entry_cache) ||
+      tokens->MatchAndSet("--previous_output", &previous_output) ||
+      tokens->MatchAndSet("--changed_inputs", &changed_inputs) ||
+      tokens->MatchAndSet("--profile_json", &profile_json) ||
+      tokens->MatchAndSet("--align_stored_suffixes",
+                          &align_stored_suffixes) ||
+      tokens->MatchAndSet("--stored_alignment", &stored_alignment) ||
+      tokens->MatchAndSet("--class_load_order", &class_load_order) ||
+      tokens->MatchAndSet("--read_input_jars", &read_input_jars)) {
     return true;
   } else if (tokens->MatchAndSet("--build_info_file", &optarg)) {
     build_info_files.push_back(optarg);
@@ -83,4 +120,24 @@ void Options::PostValidateOptions() {
         1,
         "--compression and --dont_change_compression are mutually exclusive");
   }
+  if (!changed_inputs.empty() && previous_output.empty()) {
+    diag_errx(1, "--changed_inputs requires --previous_output");
+  }
+  if (threads < 1) {
+    diag_errx(1, "--threads requires a positive number, got %d", threads);
+  }
+  if (memory_limit_mb < 0) {
+    diag_errx(1, "--memory_limit_mb cannot be negative, got %d",
+              memory_limit_mb);
+  }
+  // The alignment is recorded in a 16-bit field.
+  if (stored_alignment < 1 || stored_alignment > 32768 ||
+      (stored_alignment & (stored_alignment - 1))) {
+    diag_errx(1,
+              "--stored_alignment requires a power of two up to 32768, got %d",
+              stored_alignment);
+  }
+  include_prefix_matcher.Add(include_prefixes);
+  nocompress_suffix_matcher.Add(nocompress_suffixes);
+  align_stored_suffix_matcher.Add(align_stored_suffixes);
 }
@@ -15,9 +15,11 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_OPTIONS_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_OPTIONS_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "src/tools/singlejar/name_matcher.h"
 #include "src/tools/singlejar/token_stream.h"
 
 /* Command line options. */
@@ -37,7 +39,17 @@ class Options {
         warn_duplicate_resources(false),
         check_desugar_deps(false),
         multi_release(false),
-        no_strip_module_info(false) {}
+        no_strip_module_info(false),
+        zstd(false),
+        libdeflate(false),
+        check_one_version(false),
+        threads(1),
+        memory_limit_mb(0),
+        stored_alignment(4096),
+        read_input_jars(false),
+        include_prefix_matcher(NameMatcher::kPrefix),
+        nocompress_suffix_matcher(NameMatcher::kSuffix),
+        align_stored_suffix_matcher(NameMatcher::kSuffix) {}
 
   virtual ~Options() {}
 
@@ -71,11 +83,68 @@ class Options {
   bool check_desugar_deps;
   bool multi_release;
   bool no_strip_module_info;
+  // Whether the entries that get compressed use Zstandard rather than
+  // deflate. Only Bazel's own tools can read such a jar.
+  bool zstd;
+  // Whether the entries that get deflated are deflated by libdeflate rather
+  // than zlib. It is faster, but its output differs from zlib's.
+  bool libdeflate;
+  // Whether to check the input jars for one version violations while they are
+  // being added, see src/tools/one_version. Only supported by the singlejar
+  // binary that links in the checker.
+  bool check_one_version;
+  // The allowlist of one version violations to ignore, if any.
+  std::string one_version_allowlist;
+  // The number of threads to use for scanning the input jars and for
+  // recompressing the entries. With more than one, the desugar_deps files
+  // are also indexed in the background.
+  int threads;
+  // The memory, in MiB, the buffered entry contents may take before they get
+  // spilled to temporary files. Zero means no limit.
+  int memory_limit_mb;
   std::string hermetic_java_home;
+  // The directory caching the recompressed entries, if set.
+  std::string entry_cache;
+  // The output of the previous run, which is reused as far as the new output
+  // is identical to it. May be the same file as the output jar.
+  std::string previous_output;
+  // The input jars that have changed since the previous output was created.
+  std::vector<std::string> changed_inputs;
+  // The file to write the timings and counters to, as JSON.
+  std::string profile_json;
+  // The uncompressed entries with one of these suffixes get padded so that
+  // their data start at a multiple of stored_alignment bytes, and can be
+  // mapped straight from the output jar.
+  std::vector<std::string> align_stored_suffixes;
+  int stored_alignment;
+  // The order in which the JVM loads the classes, e.g. the output of
+  // -Xlog:class+load. The entries of these classes come first in the output,
+  // in that order. See class_load_order.h for the format.
+  std::string class_load_order;
+  // Whether to read the input jars into memory rather than mapping them,
+  // which is faster on network filesystems, see MappedFile::Read().
+  bool read_input_jars;
+
+  // Matchers for include_prefixes and nocompress_suffixes, built by
+  // PostValidateOptions() so that each entry name is scanned just once.
+  NameMatcher include_prefix_matcher;
+  NameMatcher nocompress_suffix_matcher;
+  NameMatcher align_stored_suffix_matcher;
   std::vector<std::string> add_exports;
   std::vector<std::string> add_opens;
 
+  // The options of the other output jars to build in the same invocation.
+  // On the command line, --next_output separates the options of each output
+  // from those of the previous one. Each output has its own inputs, filters
+  // and combiners; the input jars they share are only scanned once.
+  std::vector<std::unique_ptr<Options>> next_outputs;
+
  protected:
+  // Returns a new instance to parse the options of the next output into.
+  virtual std::unique_ptr<Options> NewOptions() const {
+    return std::make_unique<Options>();
+  }
+
   /*
    * Given the token stream, consume one notional flag from the input stream and
    * return true if the flag was recognized and fully consumed. This notional
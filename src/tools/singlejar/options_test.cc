@@ -89,6 +89,84 @@ TEST(OptionsTest, SingleOptargs) {
   EXPECT_EQ("modules", options.jdk_lib_modules);
 }
 
+TEST(OptionsTest, Threads) {
+  {
+    const char *args[] = {"--output", "output_jar"};
+    Options options;
+    options.ParseCommandLine(arraysize(args), args);
+    EXPECT_EQ(1, options.threads);
+  }
+  {
+    const char *args[] = {"--output", "output_jar", "--threads", "16"};
+    Options options;
+    options.ParseCommandLine(arraysize(args), args);
+    EXPECT_EQ(16, options.threads);
+  }
+}
+
+TEST(OptionsTest, OneVersion) {
+  const char *args[] = {"--output", "output_jar", "--check_one_version",
+                        "--one_version_allowlist", "allowlist.txt"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_TRUE(options.check_one_version);
+  EXPECT_EQ("allowlist.txt", options.one_version_allowlist);
+}
+
+TEST(OptionsTest, MemoryLimit) {
+  const char *args[] = {"--output", "output_jar", "--memory_limit_mb", "512"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ(512, options.memory_limit_mb);
+}
+
+TEST(OptionsTest, PreviousOutput) {
+  const char *args[] = {"--output", "output_jar",
+                        "--previous_output", "previous_jar",
+                        "--changed_inputs", "jar2", "jar3"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ("previous_jar", options.previous_output);
+  ASSERT_EQ(2UL, options.changed_inputs.size());
+  EXPECT_EQ("jar2", options.changed_inputs[0]);
+  EXPECT_EQ("jar3", options.changed_inputs[1]);
+}
+
+TEST(OptionsTest, ProfileJson) {
+  const char *args[] = {"--output", "output_jar", "--profile_json",
+                        "profile.json"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ("profile.json", options.profile_json);
+}
+
+TEST(OptionsTest, AlignStored) {
+  const char *args[] = {"--output", "output_jar", "--align_stored_suffixes",
+                        ".so", ".arsc", "--stored_alignment", "16384"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  ASSERT_EQ(2UL, options.align_stored_suffixes.size());
+  EXPECT_EQ(".so", options.align_stored_suffixes[0]);
+  EXPECT_EQ(".arsc", options.align_stored_suffixes[1]);
+  EXPECT_EQ(16384, options.stored_alignment);
+  EXPECT_TRUE(options.align_stored_suffix_matcher.Matches("lib/libfoo.so", 13));
+}
+
+TEST(OptionsTest, ClassLoadOrder) {
+  const char *args[] = {"--output", "output_jar", "--class_load_order",
+                        "classes.txt"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_EQ("classes.txt", options.class_load_order);
+}
+
+TEST(OptionsTest, ReadInputJars) {
+  const char *args[] = {"--output", "output_jar", "--read_input_jars"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+  EXPECT_TRUE(options.read_input_jars);
+}
+
 TEST(OptionsTest, MultiOptargs) {
   const char *args[] = {"--output",
                         "output_file",
@@ -173,3 +251,44 @@ TEST(OptionTest, DefaultCreatedBy) {
   options.ParseCommandLine(arraysize(args), args);
   EXPECT_EQ("singlejar", options.output_jar_creator);
 }
+
+TEST(OptionsTest, NextOutput) {
+  const char *args[] = {"--output", "output1", "--sources", "jar1",
+                        "--next_output",
+                        "--output", "output2", "--sources", "jar1", "jar2",
+                        "--exclude_build_data",
+                        "--next_output",
+                        "--output", "output3"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+
+  EXPECT_EQ("output1", options.output_jar);
+  EXPECT_EQ(1UL, options.input_jars.size());
+  EXPECT_FALSE(options.exclude_build_data);
+  ASSERT_EQ(2UL, options.next_outputs.size());
+  EXPECT_EQ("output2", options.next_outputs[0]->output_jar);
+  EXPECT_EQ(2UL, options.next_outputs[0]->input_jars.size());
+  EXPECT_TRUE(options.next_outputs[0]->exclude_build_data);
+  EXPECT_EQ("output3", options.next_outputs[1]->output_jar);
+  EXPECT_TRUE(options.next_outputs[1]->input_jars.empty());
+  EXPECT_TRUE(options.next_outputs[1]->next_outputs.empty());
+}
+
+TEST(OptionsTest, NextOutputSameOutput) {
+  const char *args[] = {"--output", "output", "--next_output",
+                        "--output", "output"};
+  Options options;
+  EXPECT_EXIT(options.ParseCommandLine(arraysize(args), args),
+              ::testing::ExitedWithCode(1), "more than one output");
+}
+
+TEST(OptionsTest, NextOutputReadInputJars) {
+  const char *args[] = {"--output", "output1", "--read_input_jars",
+                        "--next_output", "--output", "output2"};
+  Options options;
+  options.ParseCommandLine(arraysize(args), args);
+
+  EXPECT_TRUE(options.read_input_jars);
+  ASSERT_EQ(1UL, options.next_outputs.size());
+  EXPECT_FALSE(options.next_outputs[0]->read_input_jars);
+}
@@ -0,0 +1,92 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_OUTPUT_FILE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_OUTPUT_FILE_H_ 1
+
+#include <stdio.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "src/tools/singlejar/port.h"
+
+/*
+ * A buffered output file.
+ *
+ * On Unix it is a stdio stream with a large buffer. On Windows it bypasses
+ * the C runtime: the data is collected in two large page-aligned buffers, and
+ * one of them is written with an overlapped WriteFile while the other is
+ * being filled.
+ *
+ * The methods return false on failure; on Unix errno tells why.
+ */
+class OutputFile {
+ public:
+  OutputFile();
+
+  ~OutputFile();
+
+  // Opens the file for writing, creating it if necessary. Unless `truncate`
+  // is false, its previous contents are discarded. The writing starts at
+  // offset 0 either way.
+  bool Open(const std::string &path, bool truncate);
+
+  bool is_open() const;
+
+  // Appends `count` bytes at the current position.
+  bool Write(const void *data, size_t count);
+
+  // Writes out the buffered data and moves the current position to `offset`.
+  bool Seek(off64_t offset);
+
+  // Writes out the buffered data.
+  bool Flush();
+
+  // Writes out the buffered data and sets the file size to `size`.
+  bool Truncate(off64_t size);
+
+  // Writes out the buffered data and closes the file. Does nothing if it
+  // is not open.
+  bool Close();
+
+#ifndef _WIN32
+  // The descriptor of the file, for writing to it directly after Flush().
+  // There is none on Windows.
+  int fd() const;
+#endif
+
+ private:
+#ifdef _WIN32
+  struct Buffer;
+
+  // Starts writing the buffer being filled, then switches to the other one
+  // once its own write has completed.
+  bool Submit();
+
+  // Waits for the write of the buffer, if any, and empties it.
+  bool Wait(Buffer *buffer);
+
+  /* HANDLE */ void *handle_;
+  std::unique_ptr<Buffer[]> buffers_;
+  int current_;
+  off64_t position_;
+#else
+  FILE *file_;
+  std::unique_ptr<char[]> buffer_;
+#endif
+};
+
+#endif  // BAZEL_SRC_TOOLS_SINGLEJAR_OUTPUT_FILE_H_
@@ -0,0 +1,89 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/output_file.h"
+
+#include <stdio.h>
+
+#include <string>
+
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+std::string ReadFile(const std::string &path) {
+  std::string contents;
+  FILE *fp = fopen(path.c_str(), "rb");
+  EXPECT_NE(nullptr, fp);
+  if (fp != nullptr) {
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+      contents.append(buffer, n);
+    }
+    fclose(fp);
+  }
+  return contents;
+}
+
+// More than the buffers can hold, so that some of it is written while the
+// rest is still being buffered.
+std::string Pattern(size_t size) {
+  std::string pattern(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    pattern[i] = static_cast<char>(i * 7 + i / 251);
+  }
+  return pattern;
+}
+
+TEST(OutputFileTest, Write) {
+  std::string path = singlejar_test_util::OutputFilePath("write");
+  std::string expected = Pattern(5 << 20) + "tail";
+  OutputFile file;
+  ASSERT_TRUE(file.Open(path, true));
+  ASSERT_TRUE(file.is_open());
+  // Both small and large writes.
+  ASSERT_TRUE(file.Write(expected.data(), 3));
+  ASSERT_TRUE(file.Write(expected.data() + 3, (3 << 20) - 3));
+  ASSERT_TRUE(file.Flush());
+  ASSERT_TRUE(file.Write(expected.data() + (3 << 20),
+                         expected.size() - (3 << 20)));
+  ASSERT_TRUE(file.Close());
+  EXPECT_FALSE(file.is_open());
+  EXPECT_EQ(expected, ReadFile(path));
+  // Closing twice is fine.
+  EXPECT_TRUE(file.Close());
+}
+
+TEST(OutputFileTest, SeekAndTruncate) {
+  std::string path =
+      singlejar_test_util::CreateTextFile("seek", "0123456789abcdef");
+  OutputFile file;
+  // Without truncation, the contents are kept until they are overwritten.
+  ASSERT_TRUE(file.Open(path, false));
+  ASSERT_TRUE(file.Write("AB", 2));
+  ASSERT_TRUE(file.Seek(8));
+  ASSERT_TRUE(file.Write("XYZ", 3));
+  ASSERT_TRUE(file.Truncate(12));
+  ASSERT_TRUE(file.Close());
+  EXPECT_EQ("AB234567XYZb", ReadFile(path));
+
+  ASSERT_TRUE(file.Open(path, true));
+  ASSERT_TRUE(file.Write("new", 3));
+  ASSERT_TRUE(file.Close());
+  EXPECT_EQ("new", ReadFile(path));
+}
+
+}  // namespace
@@ -24,10 +24,19 @@
 #include <sys/stat.h>
 #include <time.h>
 
+#include <algorithm>
 #include <cstring>
+#include <functional>
+#include <future>
+#include <utility>
 
 #ifndef _WIN32
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif  // __linux__
 #else
 
 #ifndef WIN32_LEAN_AND_MEAN
@@ -37,42 +46,52 @@
 
 #endif  // _WIN32
 
+#include "src/main/cpp/util/file.h"
+#include "src/main/cpp/util/filesystem_capabilities.h"
 #include "src/main/cpp/util/path_platform.h"
+#include "src/tools/singlejar/class_load_order.h"
 #include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/deflate_backend.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/fast_crc32.h"
 #include "src/tools/singlejar/input_jar.h"
+#include "src/tools/singlejar/input_jar_scanner.h"
 #include "src/tools/singlejar/mapped_file.h"
+#include "src/tools/singlejar/name_matcher.h"
 #include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/transient_bytes.h"
 #include "src/tools/singlejar/zip_headers.h"
+#include "src/tools/singlejar/zstd_interface.h"
 
 #include <zlib.h>
 
-#define TODO(cond, msg)                                              \
-  if (!(cond)) {                                                     \
-    diag_errx(2, "%s:%d: TODO(asmundak): " msg, __FILE__, __LINE__); \
-  }
+struct OutputJar::MappedResource {
+  MappedFile file;
+  // The deflated contents, or nullptr if they are stored.
+  std::unique_ptr<TransientBytes> deflated;
+};
 
 OutputJar::OutputJar()
     : options_(nullptr),
-      file_(nullptr),
       outpos_(0),
-      buffer_(nullptr),
       entries_(0),
       duplicate_entries_(0),
-      cen_(nullptr),
-      cen_size_(0),
-      cen_capacity_(0),
       spring_handlers_("META-INF/spring.handlers"),
       spring_schemas_("META-INF/spring.schemas"),
       protobuf_meta_handler_("protobuf.meta", false),
       manifest_("META-INF/MANIFEST.MF"),
-      build_properties_("build-data.properties") {
-  known_members_.emplace(spring_handlers_.filename(),
+      build_properties_("build-data.properties"),
+      replaying_(false),
+      in_place_(false),
+      first_changed_input_(0),
+      replayed_bytes_(0),
+      scanned_jar_cache_(nullptr) {
+  known_members_.Emplace(spring_handlers_.filename(),
                          EntryInfo{&spring_handlers_});
-  known_members_.emplace(spring_schemas_.filename(),
+  known_members_.Emplace(spring_schemas_.filename(),
                          EntryInfo{&spring_schemas_});
-  known_members_.emplace(manifest_.filename(), EntryInfo{&manifest_});
-  known_members_.emplace(protobuf_meta_handler_.filename(),
+  known_members_.Emplace(manifest_.filename(), EntryInfo{&manifest_});
+  known_members_.Emplace(protobuf_meta_handler_.filename(),
                          EntryInfo{&protobuf_meta_handler_});
 }
 
@@ -90,12 +109,22 @@ int OutputJar::Doit(Options *options) {
     diag_errx(1, "%s:%d: Doit() can be called only once.", __FILE__, __LINE__);
   }
   options_ = options;
+  if (!options_->profile_json.empty()) {
+    profile_.reset(new Profile());
+  }
+  TransientBytes::set_memory_limit(
+      static_cast<uint64_t>(options_->memory_limit_mb) << 20);
+  if (options_->libdeflate && !LibdeflateAvailable()) {
+    diag_errx(1,
+              "%s:%d: --libdeflate requires libdeflate, which cannot be loaded",
+              __FILE__, __LINE__);
+  }
 
   // Register the handler for the build-data.properties file unless
   // --exclude_build_data is present. Otherwise we do not generate this file,
   // and it will be copied from the first source archive containing it.
   if (!options_->exclude_build_data) {
-    known_members_.emplace(build_properties_.filename(),
+    known_members_.Emplace(build_properties_.filename(),
                            EntryInfo{&build_properties_});
   }
 
@@ -121,6 +150,7 @@ int OutputJar::Doit(Options *options) {
     fprintf(stderr, "%zu manifest lines\n", options_->manifest_lines.size());
   }
 
+  Profile::Timer open_timer(profile_.get(), Profile::kOpen);
   if (!Open()) {
     exit(1);
   }
@@ -129,6 +159,7 @@ int OutputJar::Doit(Options *options) {
   if (!options_->java_launcher.empty()) {
     AppendFile(options_, options_->java_launcher.c_str());
   }
+  open_timer.Stop();
 
   if (!options_->main_class.empty()) {
     build_properties_.AddProperty("main.class", options_->main_class);
@@ -221,6 +252,7 @@ int OutputJar::Doit(Options *options) {
     }
   }
 
+  Profile::Timer resources_timer(profile_.get(), Profile::kResources);
   // Ready to write zip entries. Decide whether created entries should be
   // compressed.
   bool compress = options_->force_compression || options_->preserve_compression;
@@ -232,48 +264,169 @@ int OutputJar::Doit(Options *options) {
     WriteEntry(build_properties_.OutputEntry(compress));
   }
 
-  // Then classpath resources.
-  for (auto &classpath_resource : classpath_resources_) {
-    bool do_compress = compress;
-    if (do_compress && !options_->nocompress_suffixes.empty()) {
-      for (auto &suffix : options_->nocompress_suffixes) {
-        auto entry_name = classpath_resource->filename();
-        if (entry_name.length() >= suffix.size() &&
-            !entry_name.compare(entry_name.length() - suffix.size(),
-                                suffix.size(), suffix)) {
-          do_compress = false;
-          break;
-        }
-      }
+  if (options_->threads > 1) {
+    compression_pool_.reset(new WorkerPool(options_->threads));
+  }
+  if (!options_->entry_cache.empty()) {
+    if (!blaze_util::MakeDirectories(options_->entry_cache, 0777)) {
+      diag_err(1, "%s:%d: Cannot create entry cache directory %s", __FILE__,
+               __LINE__, options_->entry_cache.c_str());
     }
+    entry_cache_.reset(new EntryCache(options_->entry_cache));
+  }
 
+  // Then classpath resources. Their output entries do not depend on each
+  // other, so they are compressed up front on the worker threads, if any.
+  std::vector<std::future<void *>> classpath_resource_entries;
+  std::vector<std::unique_ptr<MappedResource>> mapped_resources(
+      classpath_resources_.size());
+  for (size_t ix = 0; ix < classpath_resources_.size(); ++ix) {
+    Concatenator *resource = classpath_resources_[ix].get();
+    const std::string &entry_name = resource->filename();
+    bool do_compress = compress;
+    if (do_compress && !options_->nocompress_suffix_matcher.empty()) {
+      do_compress =
+          !HasNoCompressSuffix(entry_name.c_str(), entry_name.length());
+    }
+    std::function<void *()> output_entry = [resource, do_compress] {
+      return resource->OutputEntry(do_compress);
+    };
+    const std::string &path = classpath_resource_paths_[ix];
+    if (!path.empty()) {
+      MappedResource *mapped = new MappedResource();
+      mapped_resources[ix].reset(mapped);
+      output_entry = [&entry_name, &path, do_compress, mapped] {
+        return PrepareMappedResource(entry_name, path, do_compress, mapped);
+      };
+    }
+    if (compression_pool_) {
+      classpath_resource_entries.push_back(
+          compression_pool_->Submit(output_entry));
+    } else {
+      std::promise<void *> entry;
+      entry.set_value(output_entry());
+      classpath_resource_entries.push_back(entry.get_future());
+    }
+  }
+  for (size_t ix = 0; ix < classpath_resources_.size(); ++ix) {
+    const std::string &filename = classpath_resources_[ix]->filename();
     // Add parent directory entries.
-    size_t pos = classpath_resource->filename().find('/');
-    while (pos != std::string::npos) {
-      std::string dir(classpath_resource->filename(), 0, pos + 1);
-      if (NewEntry(dir)) {
-        WriteDirEntry(dir, nullptr, 0);
+    AddMissingDirectories(filename.data(), filename.size());
+
+    if (mapped_resources[ix]) {
+      WriteMappedResource(classpath_resource_entries[ix].get(),
+                          mapped_resources[ix].get());
+    } else {
+      WriteEntry(classpath_resource_entries[ix].get());
+    }
+  }
+  resources_timer.Stop();
+
+  // Then copy source files' contents. The input jars are opened and their
+  // Central Directories are walked on the worker threads, but they are merged
+  // strictly in the command line order so that the output does not depend on
+  // the number of threads.
+  std::vector<std::string> input_jar_paths;
+  input_jar_paths.reserve(options_->input_jars.size());
+  for (auto &input_jar : options_->input_jars) {
+    input_jar_paths.push_back(input_jar.first);
+  }
+  first_changed_input_ = input_jar_paths.size();
+  for (size_t ix = 0; ix < input_jar_paths.size(); ++ix) {
+    for (auto &changed_input : options_->changed_inputs) {
+      if (changed_input == input_jar_paths[ix] &&
+          ix < first_changed_input_) {
+        first_changed_input_ = ix;
       }
-      pos = classpath_resource->filename().find('/', pos + 1);
     }
-
-    WriteEntry(classpath_resource->OutputEntry(do_compress));
   }
-
-  // Then copy source files' contents.
+  if (options_->changed_inputs.empty()) {
+    // Nothing is known about the inputs, do not trust the previous output.
+    first_changed_input_ = 0;
+  }
+  std::vector<std::string> input_jar_digests;
+  if (scanned_jar_cache_) {
+    for (auto &path : input_jar_paths) {
+      auto it = input_digests_.find(path);
+      input_jar_digests.push_back(it == input_digests_.end() ? std::string()
+                                                             : it->second);
+    }
+  }
+  const int cache_hits_before =
+      scanned_jar_cache_ ? scanned_jar_cache_->hits() : 0;
+  // The classes the application loads first come first, so that starting
+  // it reads the output jar sequentially. The jars they are taken from are
+  // kept open, and their other entries follow in order.
+  std::vector<ProfiledJar> profiled_jars(input_jar_paths.size());
+  if (!options_->class_load_order.empty()) {
+    profiled_jars = AddProfiledClasses(input_jar_paths, input_jar_digests);
+  }
+  std::vector<std::string> scanned_paths;
+  std::vector<std::string> scanned_digests;
+  for (size_t ix = 0; ix < input_jar_paths.size(); ++ix) {
+    if (!profiled_jars[ix].jar) {
+      scanned_paths.push_back(input_jar_paths[ix]);
+      if (!input_jar_digests.empty()) {
+        scanned_digests.push_back(input_jar_digests[ix]);
+      }
+    }
+  }
+  InputJarScanner scanner(scanned_paths, options_->threads, scanned_jar_cache_,
+                          scanned_digests, options_->read_input_jars);
   for (size_t ix = 0; ix < options_->input_jars.size(); ++ix) {
-    if (!AddJar(ix)) {
+    ProfiledJar &profiled = profiled_jars[ix];
+    if (!profiled.jar) {
+      if (!AddJar(ix, scanner.Next().get())) {
+        exit(1);
+      }
+      continue;
+    }
+    AddJarEntries(ix, profiled.jar.get(), profiled.remaining_entries,
+                  profiled.jar_stats);
+    if (!scanned_jar_cache_ && !profiled.jar->input_jar.Close()) {
       exit(1);
     }
+    profiled.jar.reset();
+  }
+  if (profile_ && scanned_jar_cache_) {
+    profile_->SetCounter("scanned_jar_cache_hits",
+                         scanned_jar_cache_->hits() - cache_hits_before);
   }
 
   // All entries written, write Central Directory and close.
+  Profile::Timer close_timer(profile_.get(), Profile::kClose);
   Close();
+  close_timer.Stop();
+  if (profile_) {
+    WriteProfile();
+  }
   return 0;
 }
 
+void OutputJar::WriteProfile() {
+  profile_->SetCounter("entries", entries_);
+  profile_->SetCounter("duplicate_entries", duplicate_entries_);
+  profile_->SetCounter("output_bytes", outpos_);
+  profile_->SetCounter("threads", options_->threads);
+  profile_->SetCounter("known_members_size", known_members_.size());
+  profile_->SetCounter("known_members_capacity", known_members_.capacity());
+  profile_->SetCounter("known_members_probes", known_members_.probes());
+  profile_->SetCounter("spilled_bytes", TransientBytes::spilled_bytes());
+  if (entry_cache_) {
+    profile_->SetCounter("entry_cache_hits", entry_cache_->hits());
+    profile_->SetCounter("entry_cache_misses", entry_cache_->misses());
+  }
+  if (!options_->previous_output.empty()) {
+    profile_->SetCounter("reused_bytes", replayed_bytes_);
+  }
+  if (!profile_->Write(options_->profile_json)) {
+    diag_err(1, "%s:%d: Cannot write %s", __FILE__, __LINE__,
+             options_->profile_json.c_str());
+  }
+}
+
 OutputJar::~OutputJar() {
-  if (file_) {
+  if (file_.is_open()) {
     diag_warnx("%s:%d: Close() should be called first", __FILE__, __LINE__);
   }
 }
@@ -282,55 +435,34 @@ OutputJar::~OutputJar() {
 // (128KB is the default max request size for fuse filesystems.)
 static constexpr size_t kBufferSize = 128 << 10;
 
-bool OutputJar::Open() {
-  if (file_) {
-    diag_errx(1, "%s:%d: Cannot open output archive twice", __FILE__, __LINE__);
-  }
+// The number of entries per worker thread that can be recompressed ahead of
+// the writer.
+static constexpr size_t kRecompressionWindow = 4;
 
-  int mode = O_CREAT | O_WRONLY | O_TRUNC;
+// Classpath resource files at least this large are not loaded into memory,
+// see PrepareMappedResource().
+static constexpr size_t kMappedResourceThreshold = 1 << 20;
 
-#ifdef _WIN32
-  std::wstring wpath;
-  std::string error;
-  if (!blaze_util::AsAbsoluteWindowsPath(path(), &wpath, &error)) {
-    diag_warn("%s:%d: AsAbsoluteWindowsPath failed: %s", __FILE__, __LINE__,
-              error.c_str());
-    return false;
-  }
+// Input jar entries at least this large are copied by the kernel if possible.
+// Smaller ones are not worth flushing the output buffer for.
+static constexpr size_t kKernelCopyThreshold = 64 << 10;
 
-  HANDLE hFile =
-      CreateFileW(wpath.c_str(), GENERIC_READ | GENERIC_WRITE,
-                  // Must share for reading, otherwise
-                  // symlink-following file existence checks (e.g.
-                  // java.nio.file.Files.exists()) fail.
-                  FILE_SHARE_READ, nullptr, CREATE_ALWAYS, 0, nullptr);
-  if (hFile == INVALID_HANDLE_VALUE) {
-    diag_warn("%s:%d: CreateFileW failed for %S", __FILE__, __LINE__,
-              wpath.c_str());
-    return false;
+bool OutputJar::Open() {
+  if (file_.is_open()) {
+    diag_errx(1, "%s:%d: Cannot open output archive twice", __FILE__, __LINE__);
   }
 
-  // Make sure output file is in binary mode, or \r\n will be converted to \n.
-  mode |= _O_BINARY;
-  int fd = _open_osfhandle(reinterpret_cast<intptr_t>(hFile), mode);
-#else
-  // Set execute bits since we may produce an executable output file.
-  int fd = open(path(), mode, 0777);
-#endif
-
-  if (fd < 0) {
-    diag_warn("%s:%d: %s", __FILE__, __LINE__, path());
-    return false;
+  if (!options_->previous_output.empty()) {
+    if (!OpenPreviousOutput(&in_place_)) {
+      return false;
+    }
   }
-  file_ = fdopen(fd, "w");
-  if (file_ == nullptr) {
-    diag_warn("%s:%d: fdopen of %s", __FILE__, __LINE__, path());
-    close(fd);
+
+  if (!file_.Open(path(), !in_place_)) {
     return false;
   }
   outpos_ = 0;
-  buffer_.reset(new char[kBufferSize]);
-  setvbuf(file_, buffer_.get(), _IOFBF, kBufferSize);
+  replaying_ = previous_output_.size() > 0;
   if (options_->verbose) {
     fprintf(stderr, "Writing to %s\n", path());
   }
@@ -340,19 +472,175 @@ bool OutputJar::Open() {
 // January 1, 2010 as a DOS date
 static const uint16_t kDefaultDate = 30 << 9 | 1 << 5 | 1;
 
-bool OutputJar::AddJar(int jar_path_index) {
+// Matches the signature files, which are not copied to the output.
+static const NameMatcher &SignatureFileMatcher() {
+  static const NameMatcher *matcher = [] {
+    NameMatcher *signature_files = new NameMatcher(NameMatcher::kSuffix);
+    signature_files->Add({".SF", ".RSA", ".DSA"});
+    return signature_files;
+  }();
+  return *matcher;
+}
+
+std::vector<OutputJar::ProfiledJar> OutputJar::AddProfiledClasses(
+    const std::vector<std::string> &input_jar_paths,
+    const std::vector<std::string> &input_jar_digests) {
+  ClassLoadOrder load_order;
+  if (!load_order.Load(options_->class_load_order)) {
+    diag_errx(1, "%s:%d: Cannot read class load order %s", __FILE__, __LINE__,
+              options_->class_load_order.c_str());
+  }
+
+  // Find the first occurrence of each class. Every entry is still added
+  // exactly once, so the duplicates and the combined entries come out as
+  // they would otherwise: the filters only depend on the entry names, and
+  // the first occurrence is the one that gets written.
+  struct Source {
+    int jar_path_index = -1;
+    ScannedJar::Entry entry;
+  };
+  std::vector<Source> sources(load_order.entries().size());
+  std::vector<ProfiledJar> profiled_jars(input_jar_paths.size());
+  InputJarScanner scanner(input_jar_paths, options_->threads,
+                          scanned_jar_cache_, input_jar_digests);
+  for (size_t ix = 0; ix < input_jar_paths.size(); ++ix) {
+    std::shared_ptr<ScannedJar> scanned_jar = scanner.Next();
+    if (!scanned_jar->ok) {
+      exit(1);
+    }
+    std::vector<ScannedJar::Entry> remaining_entries;
+    bool profiled = false;
+    for (const ScannedJar::Entry &entry : scanned_jar->entries) {
+      ptrdiff_t rank = load_order.Rank(entry.cdh->file_name(),
+                                       entry.cdh->file_name_length());
+      if (rank >= 0 && sources[rank].jar_path_index < 0) {
+        sources[rank].jar_path_index = ix;
+        sources[rank].entry = entry;
+        profiled = true;
+      } else {
+        remaining_entries.push_back(entry);
+      }
+    }
+    if (profiled) {
+      ProfiledJar &profiled_jar = profiled_jars[ix];
+      profiled_jar.jar = std::move(scanned_jar);
+      profiled_jar.remaining_entries = std::move(remaining_entries);
+      if (profile_) {
+        profiled_jar.jar_stats = profile_->AddJar(input_jar_paths[ix]);
+      }
+    } else if (!scanned_jar_cache_) {
+      scanned_jar->input_jar.Close();
+    }
+  }
+
+  // Add them in load order, in runs of the classes coming from the same jar.
+  int profiled_classes = 0;
+  std::vector<ScannedJar::Entry> run;
+  for (size_t rank = 0; rank < sources.size();) {
+    const int jar_path_index = sources[rank].jar_path_index;
+    if (jar_path_index < 0) {
+      ++rank;
+      continue;
+    }
+    run.clear();
+    for (; rank < sources.size() &&
+           (sources[rank].jar_path_index == jar_path_index ||
+            sources[rank].jar_path_index < 0);
+         ++rank) {
+      if (sources[rank].jar_path_index == jar_path_index) {
+        run.push_back(sources[rank].entry);
+      }
+    }
+    ProfiledJar &profiled_jar = profiled_jars[jar_path_index];
+    AddJarEntries(jar_path_index, profiled_jar.jar.get(), run,
+                  profiled_jar.jar_stats);
+    profiled_classes += run.size();
+  }
+  if (profile_) {
+    profile_->SetCounter("profiled_classes", profiled_classes);
+  }
+  return profiled_jars;
+}
+
+bool OutputJar::AddJar(int jar_path_index, ScannedJar *scanned_jar) {
+  if (!scanned_jar->ok) {
+    return false;
+  }
+  Profile::JarStats *jar_stats =
+      profile_ ? profile_->AddJar(options_->input_jars[jar_path_index].first)
+               : nullptr;
+  AddJarEntries(jar_path_index, scanned_jar, scanned_jar->entries, jar_stats);
+  // With the cache, the jar may be reused by the following requests; it is
+  // closed once it is evicted.
+  return scanned_jar_cache_ || scanned_jar->input_jar.Close();
+}
+
+void OutputJar::AddJarEntries(int jar_path_index, ScannedJar *scanned_jar,
+                              const std::vector<ScannedJar::Entry> &entries,
+                              Profile::JarStats *jar_stats) {
   const std::string &input_jar_path =
       options_->input_jars[jar_path_index].first;
   const std::string &input_jar_aux_label =
       options_->input_jars[jar_path_index].second;
 
-  InputJar input_jar;
-  if (!input_jar.Open(input_jar_path)) {
-    return false;
-  }
-  const CDH *jar_entry;
-  const LH *lh;
-  while ((jar_entry = input_jar.NextEntry(&lh))) {
+  InputJar &input_jar = scanned_jar->input_jar;
+  Profile::Timer timer(profile_.get(), Profile::kAddJar, jar_stats);
+  const int entries_before = entries_;
+  const int duplicates_before = duplicate_entries_;
+  // Most entries are new, so grow the table once per jar rather than while
+  // adding them.
+  known_members_.Reserve(known_members_.size() + entries.size());
+
+  // With the worker threads available, the entries that are going to be
+  // recompressed are inflated and deflated ahead of the writer, at most
+  // kRecompressionWindow entries per thread. The writer consumes the results
+  // in order. The result for an entry that turns out to be skipped (e.g.,
+  // a duplicate) is discarded.
+  // The jars preceding the first changed one are replayed: the entries
+  // which are recompressed are taken from the previous output.
+  const bool unchanged_input =
+      static_cast<size_t>(jar_path_index) < first_changed_input_;
+  std::vector<std::future<void *>> recompressed(
+      compression_pool_ ? entries.size() : 0);
+  // The large entries being copied by the worker threads, which read the
+  // input jar until they are done.
+  std::vector<std::future<bool>> parallel_copies;
+  size_t next_to_dispatch = 0;
+  size_t in_flight = 0;
+  const size_t max_in_flight =
+      compression_pool_ ? compression_pool_->size() * kRecompressionWindow : 0;
+
+  for (size_t entry_ix = 0; entry_ix < entries.size(); ++entry_ix) {
+    const CDH *jar_entry = entries[entry_ix].cdh;
+    const LH *lh = entries[entry_ix].lh;
+    RecompressedEntry precompressed;
+    if (compression_pool_ && !(unchanged_input && replaying_)) {
+      if (recompressed[entry_ix].valid()) {
+        precompressed.result = std::move(recompressed[entry_ix]);
+        --in_flight;
+      }
+      for (next_to_dispatch = std::max(next_to_dispatch, entry_ix + 1);
+           next_to_dispatch < entries.size() && in_flight < max_in_flight;
+           ++next_to_dispatch) {
+        const CDH *cdh = entries[next_to_dispatch].cdh;
+        const LH *next_lh = entries[next_to_dispatch].lh;
+        bool output_compressed;
+        if (NeedsRecompression(cdh, &output_compressed) &&
+            !IsLargeEntry(cdh)) {
+          EntryCache *cache = entry_cache_.get();
+          const bool zstd = options_->zstd;
+          const bool libdeflate = options_->libdeflate;
+          std::function<void *()> job = [cdh, next_lh, output_compressed,
+                                         zstd, libdeflate, cache] {
+            return RecompressEntry(cdh, next_lh, output_compressed, zstd,
+                                   libdeflate, cache);
+          };
+          recompressed[next_to_dispatch] = compression_pool_->Submit(job);
+          ++in_flight;
+        }
+      }
+    }
+
     const char *file_name = jar_entry->file_name();
     auto file_name_length = jar_entry->file_name_length();
     if (!file_name_length) {
@@ -365,9 +653,7 @@ bool OutputJar::AddJar(int jar_path_index) {
     // * ignore *.SF, *.RSA, *.DSA
     //   (TODO(asmundak): should this be done only in META-INF?
     //
-    if (ends_with(file_name, file_name_length, ".SF") ||
-        ends_with(file_name, file_name_length, ".RSA") ||
-        ends_with(file_name, file_name_length, ".DSA")) {
+    if (SignatureFileMatcher().Matches(file_name, file_name_length)) {
       continue;
     }
 
@@ -381,17 +667,9 @@ bool OutputJar::AddJar(int jar_path_index) {
       continue;
     }
 
-    bool include_entry = true;
-    if (!options_->include_prefixes.empty()) {
-      for (auto &prefix : options_->include_prefixes) {
-        if ((include_entry =
-                 (prefix.size() <= file_name_length &&
-                  0 == strncmp(file_name, prefix.c_str(), prefix.size())))) {
-          break;
-        }
-      }
-    }
-    if (!include_entry) {
+    if (!options_->include_prefix_matcher.empty() &&
+        !options_->include_prefix_matcher.Matches(file_name,
+                                                  file_name_length)) {
       continue;
     }
 
@@ -406,7 +684,7 @@ bool OutputJar::AddJar(int jar_path_index) {
         // The call to Merge() below will then take care of the rest.
         Concatenator *service_handler = new Concatenator(service_path);
         service_handlers_.emplace_back(service_handler);
-        known_members_.emplace(service_path, EntryInfo{service_handler});
+        known_members_.Emplace(service_path, EntryInfo{service_handler});
       }
     } else {
       ExtraHandler(input_jar_path, jar_entry, &input_jar_aux_label);
@@ -424,12 +702,12 @@ bool OutputJar::AddJar(int jar_path_index) {
     // will add either a directory entry whose handler will ignore subsequent
     // duplicates, or an ordinary plain entry, for which we save the index of
     // the first input jar (in order to provide diagnostics on duplicate).
-    auto got =
-        known_members_.emplace(std::string(file_name, file_name_length),
-                               EntryInfo{is_file ? nullptr : &null_combiner_,
-                                         is_file ? jar_path_index : -1});
+    auto got = known_members_.Emplace(
+        file_name, file_name_length,
+        EntryInfo{is_file ? nullptr : &null_combiner_,
+                  is_file ? jar_path_index : -1});
     if (!got.second) {
-      auto &entry_info = got.first->second;
+      auto &entry_info = *got.first;
       // Handle special entries (the ones that have a combiner).
       if (entry_info.combiner_ != nullptr) {
         // TODO(kmb,asmundak): Should be checking Merge() return value but fails
@@ -456,44 +734,30 @@ bool OutputJar::AddJar(int jar_path_index) {
 
     // Add any missing parent directory entries (first) if requested.
     if (options_->add_missing_directories) {
-      // Ignore very last character in case this entry is a directory itself.
-      for (size_t pos = 0; pos < static_cast<size_t>(file_name_length - 1);
-           ++pos) {
-        if (file_name[pos] == '/') {
-          std::string dir(file_name, 0, pos + 1);
-          if (NewEntry(dir)) {
-            WriteDirEntry(dir, nullptr, 0);
-          }
-        }
-      }
+      AddMissingDirectories(file_name, file_name_length);
     }
 
     // For the file entries, decide whether output should be compressed.
-    if (is_file) {
-      bool input_compressed =
-          jar_entry->compression_method() != Z_NO_COMPRESSION;
-      bool output_compressed =
-          options_->force_compression ||
-          (options_->preserve_compression && input_compressed);
-      if (output_compressed && !options_->nocompress_suffixes.empty()) {
-        for (auto &suffix : options_->nocompress_suffixes) {
-          if (file_name_length >= suffix.size() &&
-              !strncmp(file_name + file_name_length - suffix.size(),
-                       suffix.c_str(), suffix.size())) {
-            output_compressed = false;
-            break;
-          }
-        }
+    bool output_compressed;
+    if (is_file && NeedsRecompression(jar_entry, &output_compressed)) {
+      Profile::Timer recompress_timer(profile_.get(), Profile::kRecompress);
+      if (jar_stats) {
+        jar_stats->recompressed_bytes += jar_entry->compressed_file_size();
       }
-      if (input_compressed != output_compressed) {
-        Concatenator combiner(jar_entry->file_name_string());
-        if (!combiner.Merge(jar_entry, lh)) {
-          diag_err(1, "%s:%d: cannot add %.*s", __FILE__, __LINE__,
-                   jar_entry->file_name_length(), jar_entry->file_name());
-        }
-        WriteEntry(combiner.OutputEntry(output_compressed));
-        continue;
+      void *previous_entry = nullptr;
+      if (unchanged_input && replaying_ &&
+          (previous_entry = PreviousEntry(jar_entry, output_compressed))) {
+        WriteEntry(previous_entry);
+      } else if (precompressed.result.valid()) {
+        WriteEntry(precompressed.result.get());
+      } else if (IsLargeEntry(jar_entry)) {
+        WriteLargeRecompressedEntry(jar_entry, lh, output_compressed);
+      } else {
+        WriteEntry(RecompressEntry(jar_entry, lh, output_compressed,
+                                   options_->zstd, options_->libdeflate,
+                                   entry_cache_.get()));
       }
+      continue;
     }
 
     // Now we have to copy:
@@ -514,6 +778,9 @@ bool OutputJar::AddJar(int jar_path_index) {
       num_bytes += lh->compressed_file_size();
     }
     off64_t local_header_offset = Position();
+    if (jar_stats) {
+      jar_stats->copied_bytes += num_bytes;
+    }
 
     // When normalize_timestamps is set, entry's timestamp is to be set to
     // 01/01/2010 00:00:00 (or to 01/01/2010 00:00:02, if an entry is a .class
@@ -532,7 +799,8 @@ bool OutputJar::AddJar(int jar_path_index) {
                       jar_entry->last_mod_file_time() != normalized_time ||
                       lh_field_to_remove != nullptr;
     }
-    if (fix_timestamp) {
+    const bool align = NeedsAlignment(lh);
+    if (fix_timestamp || align) {
       uint8_t lh_buffer[512];
       size_t lh_size = lh->size();
       LH *lh_new = lh_size > sizeof(lh_buffer)
@@ -555,10 +823,16 @@ bool OutputJar::AddJar(int jar_path_index) {
       } else {
         memcpy(lh_new, lh, lh_size);
       }
-      lh_new->last_mod_file_date(kDefaultDate);
-      lh_new->last_mod_file_time(normalized_time);
+      if (fix_timestamp) {
+        lh_new->last_mod_file_date(kDefaultDate);
+        lh_new->last_mod_file_time(normalized_time);
+      }
+      // The padding follows the header rather than being copied into it.
+      const size_t lh_new_size = lh_new->size();
+      const uint16_t padding = align ? AlignmentPadding(lh_new) : 0;
+      lh_new->extra_fields_length(lh_new->extra_fields_length() + padding);
       // Now write these few bytes and adjust read/write positions accordingly.
-      if (!WriteBytes(lh_new, lh_new->size())) {
+      if (!WriteBytes(lh_new, lh_new_size) || !WriteAlignmentField(padding)) {
         diag_err(1, "%s:%d: Cannot copy modified local header for %.*s",
                  __FILE__, __LINE__, file_name_length, file_name);
       }
@@ -570,6 +844,20 @@ bool OutputJar::AddJar(int jar_path_index) {
     }
 
     // Do the actual copy.
+#ifndef _WIN32
+    if (num_bytes >= kKernelCopyThreshold && input_jar.fd() >= 0 &&
+        !replaying_) {
+      if (compression_pool_) {
+        parallel_copies.push_back(
+            CopyDataInParallel(input_jar.fd(), copy_from, num_bytes));
+      } else if (CopyAppendData(input_jar.fd(), copy_from, num_bytes) !=
+                 static_cast<ssize_t>(num_bytes)) {
+        diag_err(1, "%s:%d: Cannot write %zu bytes of %.*s from %s", __FILE__,
+                 __LINE__, num_bytes, file_name_length, file_name,
+                 input_jar_path.c_str());
+      }
+    } else
+#endif
     if (!WriteBytes(input_jar.mapped_start() + copy_from, num_bytes)) {
       diag_err(1, "%s:%d: Cannot write %zu bytes of %.*s from %s", __FILE__,
                __LINE__, num_bytes, file_name_length, file_name,
@@ -580,11 +868,142 @@ bool OutputJar::AddJar(int jar_path_index) {
                             fix_timestamp);
     ++entries_;
   }
-  return input_jar.Close();
+  for (auto &copy : parallel_copies) {
+    if (!copy.get()) {
+      diag_err(1, "%s:%d: Cannot copy entries from %s", __FILE__, __LINE__,
+               input_jar_path.c_str());
+    }
+  }
+  if (jar_stats) {
+    jar_stats->entries += entries_ - entries_before;
+    jar_stats->duplicates += duplicate_entries_ - duplicates_before;
+  }
+}
+
+bool OutputJar::HasNoCompressSuffix(const char *file_name,
+                                    size_t file_name_length) const {
+  return options_->nocompress_suffix_matcher.Matches(file_name,
+                                                     file_name_length);
+}
+
+bool OutputJar::NeedsRecompression(const CDH *jar_entry,
+                                   bool *output_compressed) const {
+  const char *file_name = jar_entry->file_name();
+  auto file_name_length = jar_entry->file_name_length();
+  if (!file_name_length || file_name[file_name_length - 1] == '/') {
+    return false;
+  }
+  const uint16_t input_method = jar_entry->compression_method();
+  bool input_compressed = input_method != Z_NO_COMPRESSION;
+  *output_compressed = options_->force_compression ||
+                       (options_->preserve_compression && input_compressed);
+  if (*output_compressed && HasNoCompressSuffix(file_name, file_name_length)) {
+    *output_compressed = false;
+  }
+  // A compressed entry is also recompressed if it is compressed the wrong
+  // way: Zstandard without --zstd, or deflate with it.
+  return input_compressed != *output_compressed ||
+         (input_compressed && (input_method == kZstdMethod) != options_->zstd);
+}
+
+void *OutputJar::RecompressEntry(const CDH *jar_entry, const LH *lh,
+                                 bool output_compressed, bool zstd,
+                                 bool libdeflate, EntryCache *cache) {
+  std::string key;
+  if (cache != nullptr) {
+    key = EntryCache::Key(jar_entry, lh, output_compressed, zstd, libdeflate);
+    void *entry = cache->Get(key);
+    if (entry != nullptr) {
+      return entry;
+    }
+  }
+  Concatenator combiner(jar_entry->file_name_string());
+  combiner.set_zstd(zstd);
+  combiner.set_deflate_backend(libdeflate ? DeflateBackend::kLibdeflate
+                                          : DeflateBackend::kZlib);
+  if (!combiner.Merge(jar_entry, lh)) {
+    diag_err(1, "%s:%d: cannot add %.*s", __FILE__, __LINE__,
+             jar_entry->file_name_length(), jar_entry->file_name());
+  }
+  void *entry = combiner.OutputEntry(output_compressed);
+  if (cache != nullptr) {
+    cache->Put(key, entry);
+  }
+  return entry;
+}
+
+bool OutputJar::IsLargeEntry(const CDH *jar_entry) {
+  return jar_entry->uncompressed_file_size() >=
+         Concatenator::kDefaultStreamingThreshold;
+}
+
+void OutputJar::WriteLargeRecompressedEntry(const CDH *jar_entry,
+                                            const LH *lh,
+                                            bool output_compressed) {
+  Concatenator combiner(jar_entry->file_name_string());
+  combiner.set_zstd(options_->zstd);
+  combiner.set_deflate_backend(options_->libdeflate
+                                   ? DeflateBackend::kLibdeflate
+                                   : DeflateBackend::kZlib);
+  if (!combiner.Merge(jar_entry, lh)) {
+    diag_err(1, "%s:%d: cannot add %.*s", __FILE__, __LINE__,
+             jar_entry->file_name_length(), jar_entry->file_name());
+  }
+  WriteCombinedEntry(&combiner, output_compressed);
+}
+
+bool OutputJar::NeedsAlignment(const LH *lh) const {
+  return !options_->align_stored_suffix_matcher.empty() &&
+         lh->compression_method() == Z_NO_COMPRESSION &&
+         options_->align_stored_suffix_matcher.Matches(lh->file_name(),
+                                                       lh->file_name_length());
+}
+
+uint16_t OutputJar::AlignmentPadding(const LH *lh) {
+  if (!NeedsAlignment(lh)) {
+    return 0;
+  }
+  const size_t alignment = options_->stored_alignment;
+  const size_t misalignment = (Position() + lh->size()) % alignment;
+  if (misalignment == 0) {
+    return 0;
+  }
+  size_t padding = alignment - misalignment;
+  while (padding < AlignmentExtraField::kMinSize) {
+    padding += alignment;
+  }
+  if (lh->extra_fields_length() + padding > UINT16_MAX) {
+    diag_warnx("%s:%d: Cannot align %.*s: its extra fields are too long",
+               __FILE__, __LINE__, lh->file_name_length(), lh->file_name());
+    return 0;
+  }
+  return padding;
+}
+
+bool OutputJar::WriteAlignmentField(uint16_t size) {
+  if (size == 0) {
+    return true;
+  }
+  static const uint8_t kZeroes[4096] = {};
+  AlignmentExtraField field;
+  field.signature();
+  field.payload_size(size - sizeof(ExtraField));
+  field.alignment(options_->stored_alignment);
+  if (!WriteBytes(&field, sizeof(field))) {
+    return false;
+  }
+  for (size_t left = size - sizeof(field); left > 0;) {
+    const size_t chunk = std::min(left, sizeof(kZeroes));
+    if (!WriteBytes(kZeroes, chunk)) {
+      return false;
+    }
+    left -= chunk;
+  }
+  return true;
 }
 
 off64_t OutputJar::Position() {
-  if (file_ == nullptr) {
+  if (!file_.is_open()) {
     diag_err(1, "%s:%d: output file is not open", __FILE__, __LINE__);
   }
   // You'd think this could be "return ftell(file_);", but that
@@ -593,13 +1012,29 @@ off64_t OutputJar::Position() {
   return outpos_;
 }
 
+void OutputJar::WriteCombinedEntry(Combiner *combiner, bool compress) {
+  void *local_header = combiner->OutputLocalHeader(compress);
+  if (local_header == nullptr) {
+    WriteEntry(combiner->OutputEntry(compress));
+    return;
+  }
+  WriteEntry(local_header, [this, combiner] {
+    return combiner->WritePayload(
+        [this](const void *chunk, uint64_t chunk_size) {
+          return WriteBytes(chunk, chunk_size);
+        });
+  });
+}
+
 // Writes an entry. The argument is the pointer to the contiguous block of
 // memory containing Local Header for the entry, immediately followed by
 // the data. The memory is freed after the data has been written.
-void OutputJar::WriteEntry(void *buffer) {
+void OutputJar::WriteEntry(void *buffer,
+                           const std::function<bool()> &write_payload) {
   if (buffer == nullptr) {
     return;
   }
+  Profile::Timer timer(profile_.get(), Profile::kWriteEntry);
   LH *entry = reinterpret_cast<LH *>(buffer);
   if (options_->verbose) {
     fprintf(stderr, "%-.*s combiner has %zu bytes, %s to %zu\n",
@@ -636,19 +1071,49 @@ void OutputJar::WriteEntry(void *buffer) {
 
   uint8_t *data = reinterpret_cast<uint8_t *>(entry);
   off64_t output_position = Position();
-  if (!WriteBytes(data, entry->data() + entry->in_zip_size() - data)) {
+  const uint16_t padding = AlignmentPadding(entry);
+  if (padding) {
+    // Only the Local Header gets the padding, the CDH is built from the
+    // original extra fields below.
+    const size_t lh_size = entry->size();
+    const uint16_t extra_fields_length = entry->extra_fields_length();
+    entry->extra_fields_length(extra_fields_length + padding);
+    bool ok = WriteBytes(data, lh_size);
+    entry->extra_fields_length(extra_fields_length);
+    if (!ok || !WriteAlignmentField(padding) ||
+        !(write_payload ? write_payload()
+                        : WriteBytes(entry->data(), entry->in_zip_size()))) {
+      diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+    }
+  } else if (write_payload) {
+    if (!WriteBytes(data, entry->size()) || !write_payload()) {
+      diag_err(1, "%s:%d: write", __FILE__, __LINE__);
+    }
+  } else if (!WriteBytes(data, entry->data() + entry->in_zip_size() - data)) {
     diag_err(1, "%s:%d: write", __FILE__, __LINE__);
   }
   // Data written, allocate CDH space and populate CDH.
-  // Space needed for the CDH varies depending on whether output position field
-  // fits into 32 bits (we do not handle compressed/uncompressed entry sizes
-  // exceeding 32 bits at the moment).
-  uint16_t zip64_size = ziph::zfield_needs_ext64(output_position)
-                            ? Zip64ExtraField::space_needed(1)
-                            : 0;
+  // The CDH gets a Zip64 extra field holding those of the uncompressed size,
+  // compressed size and Local Header offset (in this order) that do not fit
+  // into 32 bits. A Zip64 extra field the entry may have already is dropped.
+  const uint64_t uncompressed_size = entry->uncompressed_file_size();
+  const uint64_t compressed_size = entry->compressed_file_size();
+  const bool uncompressed_size_needs64 =
+      ziph::zfield_needs_ext64(uncompressed_size);
+  const bool compressed_size_needs64 = ziph::zfield_needs_ext64(compressed_size);
+  const bool lh_pos_needs64 = ziph::zfield_needs_ext64(output_position);
+  const int zip64_attr_count = uncompressed_size_needs64 +
+                               compressed_size_needs64 + lh_pos_needs64;
+  const uint16_t zip64_size =
+      zip64_attr_count > 0 ? Zip64ExtraField::space_needed(zip64_attr_count)
+                           : 0;
+  const ExtraField *entry_zip64_ef = entry->zip64_extra_field();
+  const uint16_t entry_zip64_size =
+      entry_zip64_ef == nullptr ? 0 : entry_zip64_ef->size();
+  const uint16_t out_ef_size =
+      entry->extra_fields_length() - entry_zip64_size + zip64_size;
   CDH *cdh = reinterpret_cast<CDH *>(
-      ReserveCdh(sizeof(CDH) + entry->file_name_length() +
-                 entry->extra_fields_length() + zip64_size));
+      ReserveCdh(sizeof(CDH) + entry->file_name_length() + out_ef_size));
   cdh->signature();
   // Note: do not set the version to Unix 3.0 spec, otherwise
   // unzip will think that 'external_attributes' field contains access mode
@@ -659,26 +1124,41 @@ void OutputJar::WriteEntry(void *buffer) {
   cdh->last_mod_file_time(entry->last_mod_file_time());
   cdh->last_mod_file_date(entry->last_mod_file_date());
   cdh->crc32(entry->crc32());
-  TODO(entry->compressed_file_size32() != 0xFFFFFFFF, "Handle Zip64");
-  cdh->compressed_file_size32(entry->compressed_file_size32());
-  TODO(entry->uncompressed_file_size32() != 0xFFFFFFFF, "Handle Zip64");
-  cdh->uncompressed_file_size32(entry->uncompressed_file_size32());
+  cdh->compressed_file_size32(compressed_size_needs64 ? 0xFFFFFFFF
+                                                      : compressed_size);
+  cdh->uncompressed_file_size32(uncompressed_size_needs64 ? 0xFFFFFFFF
+                                                          : uncompressed_size);
+  cdh->local_header_offset32(lh_pos_needs64 ? 0xFFFFFFFF : output_position);
   cdh->file_name(entry->file_name(), entry->file_name_length());
-  cdh->extra_fields(entry->extra_fields(), entry->extra_fields_length());
+  // Copy the extra fields but the Zip64 one, then append ours.
+  uint8_t *out_ef = const_cast<uint8_t *>(cdh->extra_fields());
+  auto ef_end = reinterpret_cast<const ExtraField *>(
+      entry->extra_fields() + entry->extra_fields_length());
+  for (auto ef = reinterpret_cast<const ExtraField *>(entry->extra_fields());
+       ef < ef_end; ef = ef->next()) {
+    if (!ef->is_zip64()) {
+      memcpy(out_ef, ef, ef->size());
+      out_ef += ef->size();
+    }
+  }
   if (zip64_size > 0) {
-    Zip64ExtraField *zip64_ef = reinterpret_cast<Zip64ExtraField *>(
-        cdh->extra_fields() + cdh->extra_fields_length());
+    Zip64ExtraField *zip64_ef = reinterpret_cast<Zip64ExtraField *>(out_ef);
     zip64_ef->signature();
-    zip64_ef->attr_count(1);
-    zip64_ef->attr64(0, output_position);
-    cdh->local_header_offset32(0xFFFFFFFF);
-    // Field address argument points to the already existing field,
-    // so the call just updates the length.
-    cdh->extra_fields(cdh->extra_fields(),
-                      cdh->extra_fields_length() + zip64_size);
-  } else {
-    cdh->local_header_offset32(output_position);
+    zip64_ef->attr_count(zip64_attr_count);
+    int attr = 0;
+    if (uncompressed_size_needs64) {
+      zip64_ef->attr64(attr++, uncompressed_size);
+    }
+    if (compressed_size_needs64) {
+      zip64_ef->attr64(attr++, compressed_size);
+    }
+    if (lh_pos_needs64) {
+      zip64_ef->attr64(attr++, output_position);
+    }
   }
+  // Field address argument points to the already existing field,
+  // so the call just updates the length.
+  cdh->extra_fields(cdh->extra_fields(), out_ef_size);
   cdh->comment_length(0);
   cdh->start_disk_nr(0);
   cdh->internal_attributes(0);
@@ -715,10 +1195,20 @@ void OutputJar::WriteDirEntry(const std::string &name,
   lh->uncompressed_file_size32(0);
   lh->file_name(name.c_str(), name.size());
   lh->extra_fields(extra_fields, n_extra_fields);
-  known_members_.emplace(name, EntryInfo{&null_combiner_});
+  known_members_.Emplace(name, EntryInfo{&null_combiner_});
   WriteEntry(lh);
 }
 
+// Writes the directory entries for the parents of the given entry that are
+// not in the output yet.
+void OutputJar::AddMissingDirectories(const char *name, size_t length) {
+  parent_directories_.AddParents(name, length, [this, name](size_t dir_length) {
+    if (NewEntry(name, dir_length)) {
+      WriteDirEntry(std::string(name, dir_length), nullptr, 0);
+    }
+  });
+}
+
 // Create output Central Directory entry for the input jar entry.
 void OutputJar::AppendToDirectoryBuffer(const CDH *cdh, off64_t lh_pos,
                                         uint16_t normalized_time,
@@ -828,17 +1318,7 @@ void OutputJar::AppendToDirectoryBuffer(const CDH *cdh, off64_t lh_pos,
 }
 
 uint8_t *OutputJar::ReserveCdr(size_t chunk_size) {
-  if (cen_size_ + chunk_size > cen_capacity_) {
-    cen_capacity_ += 1000000;
-    cen_ = reinterpret_cast<uint8_t *>(realloc(cen_, cen_capacity_));
-    if (!cen_) {
-      diag_errx(1, "%s:%d: Cannot allocate %zu bytes for the directory",
-                __FILE__, __LINE__, cen_capacity_);
-    }
-  }
-  uint8_t *entry = cen_ + cen_size_;
-  cen_size_ += chunk_size;
-  return entry;
+  return cen_.Reserve(chunk_size);
 }
 
 uint8_t *OutputJar::ReserveCdh(size_t size) {
@@ -847,25 +1327,28 @@ uint8_t *OutputJar::ReserveCdh(size_t size) {
 
 // Write out combined jar.
 bool OutputJar::Close() {
-  if (file_ == nullptr) {
+  if (!file_.is_open()) {
     return true;
   }
 
+  Profile::Timer combiners_timer(profile_.get(), Profile::kCombiners);
   for (auto &service_handler : service_handlers_) {
-    WriteEntry(service_handler->OutputEntry(options_->force_compression));
+    WriteCombinedEntry(service_handler.get(), options_->force_compression);
   }
   for (auto &extra_combiner : extra_combiners_) {
-    WriteEntry(extra_combiner->OutputEntry(options_->force_compression));
+    WriteCombinedEntry(extra_combiner.get(), options_->force_compression);
   }
-  WriteEntry(spring_handlers_.OutputEntry(options_->force_compression));
-  WriteEntry(spring_schemas_.OutputEntry(options_->force_compression));
-  WriteEntry(protobuf_meta_handler_.OutputEntry(options_->force_compression));
+  WriteCombinedEntry(&spring_handlers_, options_->force_compression);
+  WriteCombinedEntry(&spring_schemas_, options_->force_compression);
+  WriteCombinedEntry(&protobuf_meta_handler_, options_->force_compression);
+  combiners_timer.Stop();
+  compression_pool_.reset();
   // TODO(asmundak): handle manifest;
   off64_t output_position = Position();
   bool write_zip64_ecd = output_position >= 0xFFFFFFFF || entries_ >= 0xFFFF ||
-                         cen_size_ >= 0xFFFFFFFF;
+                         cen_.size() >= 0xFFFFFFFF;
 
-  size_t cen_size = cen_size_;  // Save it before ReserveCdh updates it.
+  uint64_t cen_size = cen_.size();  // Save it before ReserveCdh updates it.
   if (write_zip64_ecd) {
     {
       ECD64 *ecd64 = reinterpret_cast<ECD64 *>(ReserveCdh(sizeof(ECD64)));
@@ -903,24 +1386,42 @@ bool OutputJar::Close() {
   }
 
   // Save Central Directory and wrap up.
-  if (!WriteBytes(cen_, cen_size_)) {
+  if (!cen_.WriteTo([this](const uint8_t *data, size_t size) {
+        return WriteBytes(data, size);
+      })) {
     diag_err(1, "%s:%d: Cannot write central directory", __FILE__, __LINE__);
   }
-  free(cen_);
+  cen_.Clear();
+  if (replaying_) {
+    // The output is the same as the previous one.
+    StopReplay();
+  }
+  previous_output_.Close();
+  if (in_place_) {
+    // The previous output may have been longer.
+    if (!file_.Truncate(outpos_)) {
+      diag_err(1, "%s:%d: Cannot truncate %s", __FILE__, __LINE__, path());
+    }
+  }
 
-  if (fclose(file_)) {
+  if (!file_.Close()) {
     diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path());
   }
-  file_ = nullptr;
-  // Free the buffer only after fclose(); stdio may flush data from the
-  // buffer on close.
-  buffer_.reset();
 
   if (options_->verbose) {
     fprintf(stderr, "Wrote %s with %d entries", path(), entries_);
     if (duplicate_entries_) {
       fprintf(stderr, ", skipped %d entries", duplicate_entries_);
     }
+    if (entry_cache_) {
+      fprintf(stderr, ", %d entry cache hits, %d misses", entry_cache_->hits(),
+              entry_cache_->misses());
+    }
+    if (!options_->previous_output.empty()) {
+      fprintf(stderr, ", reused %" PRIu64 " bytes of %s",
+              static_cast<uint64_t>(replayed_bytes_),
+              options_->previous_output.c_str());
+    }
     fprintf(stderr, "\n");
   }
   return true;
@@ -937,7 +1438,7 @@ bool IsDir(const std::string &path) {
 
 void OutputJar::ClasspathResource(const std::string &resource_name,
                                   const std::string &resource_path) {
-  if (known_members_.count(resource_name)) {
+  if (known_members_.Contains(resource_name)) {
     if (options_->warn_duplicate_resources) {
       diag_warnx(
           "%s:%d: Duplicate resource name %s in the --classpath_resource or "
@@ -952,30 +1453,259 @@ void OutputJar::ClasspathResource(const std::string &resource_name,
   MappedFile mapped_file;
   if (mapped_file.Open(resource_path)) {
     Concatenator *classpath_resource = new Concatenator(resource_name);
-    classpath_resource->Append(
-        reinterpret_cast<const char *>(mapped_file.start()),
-        mapped_file.size());
+    if (mapped_file.size() < kMappedResourceThreshold) {
+      classpath_resource->Append(
+          reinterpret_cast<const char *>(mapped_file.start()),
+          mapped_file.size());
+      classpath_resource_paths_.emplace_back();
+    } else {
+      // The concatenator stays empty, the entry is written straight from
+      // the file.
+      classpath_resource_paths_.push_back(resource_path);
+    }
     classpath_resources_.emplace_back(classpath_resource);
-    known_members_.emplace(resource_name, EntryInfo{classpath_resource});
+    known_members_.Emplace(resource_name, EntryInfo{classpath_resource});
   } else if (IsDir(resource_path)) {
     // add an empty entry for the directory so its path ends up in the
     // manifest
     classpath_resources_.emplace_back(new Concatenator(resource_name + "/"));
-    known_members_.emplace(resource_name, EntryInfo{&null_combiner_});
+    classpath_resource_paths_.emplace_back();
+    known_members_.Emplace(resource_name, EntryInfo{&null_combiner_});
   } else {
     diag_err(1, "%s:%d: %s", __FILE__, __LINE__, resource_path.c_str());
   }
 }
 
+void *OutputJar::PrepareMappedResource(const std::string &name,
+                                       const std::string &path, bool compress,
+                                       MappedResource *resource) {
+  if (!resource->file.Open(path)) {
+    diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path.c_str());
+  }
+  resource->file.Advise(0, resource->file.size(), MappedFile::kSequential);
+  const uint8_t *data = resource->file.start();
+  const uint64_t size = resource->file.size();
+  // The file is read a block at a time, and the pages of each block are
+  // dropped once it is done, so that only the deflated bytes are held, and
+  // even those may be spilled to disk. The stored data are copied from the
+  // file rather than from the mapping.
+  uint32_t checksum = 0;
+  std::unique_ptr<Deflater> deflater;
+  if (compress) {
+    deflater.reset(new Deflater());
+    resource->deflated.reset(new TransientBytes());
+  }
+  for (uint64_t offset = 0; offset < size;) {
+    const uint32_t chunk_size = static_cast<uint32_t>(
+        std::min(size - offset, static_cast<uint64_t>(kBufferSize)));
+    const uint8_t *chunk = data + offset;
+    checksum = FastCrc32(checksum, chunk, chunk_size);
+    offset += chunk_size;
+    if (compress) {
+      resource->deflated->AppendDeflated(
+          chunk, chunk_size, offset < size ? Z_NO_FLUSH : Z_FINISH,
+          deflater.get());
+    }
+    resource->file.Advise(offset - chunk_size, chunk_size,
+                          MappedFile::kDontNeed);
+  }
+  // As in TransientBytes::CompressOut, store the data if deflating does not
+  // make it smaller.
+  if (compress && resource->deflated->data_size() > size) {
+    resource->deflated.reset();
+  }
+  const uint64_t in_zip_size =
+      resource->deflated ? resource->deflated->data_size() : size;
+
+  // Like Concatenator::AllocateEntry, but without room for the payload.
+  uint8_t zip64_buffer[sizeof(Zip64ExtraField) + 2 * sizeof(uint64_t)];
+  const bool huge = ziph::zfield_needs_ext64(size);
+  LH *lh = reinterpret_cast<LH *>(
+      malloc(sizeof(LH) + name.size() + (huge ? sizeof(zip64_buffer) : 0)));
+  if (lh == nullptr) {
+    diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
+  }
+  lh->signature();
+  lh->version(20);
+  lh->bit_flag(0x0);
+  lh->last_mod_file_time(1);                     // 00:00:01
+  lh->last_mod_file_date(30 << 9 | 1 << 5 | 1);  // 2010-01-01
+  lh->crc32(checksum);
+  lh->compression_method(resource->deflated ? Z_DEFLATED : Z_NO_COMPRESSION);
+  lh->file_name(name.c_str(), name.size());
+  if (huge) {
+    lh->uncompressed_file_size32(0xFFFFFFFF);
+    lh->compressed_file_size32(
+        ziph::zfield_needs_ext64(in_zip_size) ? 0xFFFFFFFF : in_zip_size);
+    Zip64ExtraField *z64 = reinterpret_cast<Zip64ExtraField *>(zip64_buffer);
+    z64->signature();
+    z64->payload_size(2 * sizeof(uint64_t));
+    z64->attr64(0, size);
+    z64->attr64(1, in_zip_size);
+    lh->extra_fields(zip64_buffer, z64->size());
+  } else {
+    lh->uncompressed_file_size32(size);
+    lh->compressed_file_size32(in_zip_size);
+    lh->extra_fields(nullptr, 0);
+  }
+  return lh;
+}
+
+void OutputJar::WriteMappedResource(void *local_header,
+                                    MappedResource *resource) {
+  WriteEntry(local_header, [this, resource] {
+    if (resource->deflated) {
+      bool ok = true;
+      resource->deflated->stream_out(
+          [this, &ok](const void *chunk, uint64_t chunk_size) {
+            ok = ok && WriteBytes(chunk, chunk_size);
+          });
+      return ok;
+    }
+    const uint64_t size = resource->file.size();
+#ifdef _WIN32
+    return WriteBytes(resource->file.start(), size);
+#else
+    // Let the kernel copy the stored data if it can.
+    return CopyAppendData(resource->file.fd(), 0, size) ==
+           static_cast<ssize_t>(size);
+#endif
+  });
+  resource->deflated.reset();
+  resource->file.Close();
+}
+
+ssize_t OutputJar::KernelCopyAppendData(int in_fd, off64_t offset,
+                                        size_t count) {
+#if defined(__linux__) && defined(SYS_copy_file_range)
+  // copy_file_range() lets the filesystem share the extents (XFS, btrfs) or
+  // do the copy server-side (NFS), and otherwise copies within the kernel.
+  // It is not supported between different filesystems on older kernels and
+  // by some filesystems at all; then we fall back to the user-space copy.
+  int out_fd = file_.fd();
+  const blaze_util::FilesystemCapabilities &capabilities =
+      blaze_util::GetFilesystemCapabilities(out_fd);
+  if (!capabilities.Has(blaze_util::kFsCopyFileRange)) {
+    return 0;
+  }
+  // It writes to the descriptor at its current position, so the data
+  // buffered by stdio has to go out first.
+  if (!file_.Flush()) {
+    return -1;
+  }
+  off64_t in_offset = offset;
+  ssize_t total_copied = 0;
+  while (static_cast<size_t>(total_copied) < count) {
+    ssize_t n_copied = syscall(SYS_copy_file_range, in_fd, &in_offset, out_fd,
+                               nullptr, count - total_copied, 0);
+    if (n_copied > 0) {
+      total_copied += n_copied;
+      outpos_ += n_copied;
+    } else if (n_copied == 0) {
+      break;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (total_copied == 0 &&
+               (errno == ENOSYS || errno == EXDEV || errno == EINVAL ||
+                errno == EOPNOTSUPP || errno == EBADF || errno == EPERM)) {
+      if (errno != EXDEV) {
+        capabilities.SetUnsupported(blaze_util::kFsCopyFileRange);
+      }
+      return 0;
+    } else {
+      return -1;
+    }
+  }
+  return total_copied;
+#else
+  return 0;
+#endif
+}
+
+ssize_t OutputJar::CloneAppendData(int in_fd, off64_t offset, size_t count) {
+#if defined(__linux__) && defined(FICLONERANGE)
+  // Unlike copy_file_range(), which may still copy, FICLONERANGE always
+  // shares the extents, so that the JDK lib/modules image embedded in many
+  // deploy jars is stored once. Only whole blocks can be shared: the files
+  // appended at a page boundary are, the rest is copied.
+  static const size_t pagesize = sysconf(_SC_PAGESIZE);
+  const size_t length = count & ~(pagesize - 1);
+  if (length == 0 || offset % pagesize != 0 || outpos_ % pagesize != 0) {
+    return 0;
+  }
+  if (!file_.Flush()) {
+    return -1;
+  }
+  if (CloneRange(file_.fd(), in_fd, offset, outpos_, length) != 0) {
+    return 0;
+  }
+  // The clone leaves the file position where it was.
+  if (!file_.Seek(outpos_ + length)) {
+    return -1;
+  }
+  outpos_ += length;
+  return length;
+#else
+  return 0;
+#endif
+}
+
+int OutputJar::CloneRange(int out_fd, int in_fd, off64_t in_offset,
+                          off64_t out_offset, size_t length) {
+#if defined(__linux__) && defined(FICLONERANGE)
+  const blaze_util::FilesystemCapabilities &capabilities =
+      blaze_util::GetFilesystemCapabilities(out_fd);
+  if (!capabilities.Has(blaze_util::kFsCloneFile)) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  struct file_clone_range range;
+  range.src_fd = in_fd;
+  range.src_offset = in_offset;
+  range.src_length = length;
+  range.dest_offset = out_offset;
+  if (ioctl(out_fd, FICLONERANGE, &range) != 0) {
+    // EXDEV and EINVAL are about these files: on different filesystems, or
+    // not aligned on the blocks of the filesystem.
+    if (errno == EOPNOTSUPP || errno == ENOTTY || errno == ENOSYS) {
+      capabilities.SetUnsupported(blaze_util::kFsCloneFile);
+    }
+    return -1;
+  }
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
 ssize_t OutputJar::CopyAppendData(int in_fd, off64_t offset, size_t count) {
   if (count == 0) {
     return 0;
   }
+  ssize_t total_written = 0;
+#ifndef _WIN32
+  // While replaying, the data has to go through WriteBytes to be compared.
+  if (!replaying_) {
+    total_written = CloneAppendData(in_fd, offset, count);
+    if (total_written >= 0 && static_cast<size_t>(total_written) < count) {
+      ssize_t n_copied = KernelCopyAppendData(
+          in_fd, offset + total_written, count - total_written);
+      total_written = n_copied < 0 ? -1 : total_written + n_copied;
+    }
+  }
+  if (total_written < 0) {
+    return -1;
+  }
+  if (static_cast<size_t>(total_written) == count) {
+    return total_written;
+  }
+#endif  // _WIN32
+
   std::unique_ptr<void, decltype(free) *> buffer(malloc(kBufferSize), free);
   if (buffer == nullptr) {
     diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
   }
-  ssize_t total_written = 0;
 
 #ifdef _WIN32
   HANDLE hFile = reinterpret_cast<HANDLE>(_get_osfhandle(in_fd));
@@ -1013,15 +1743,91 @@ ssize_t OutputJar::CopyAppendData(int in_fd, off64_t offset, size_t count) {
   return total_written;
 }
 
+#ifndef _WIN32
+std::future<bool> OutputJar::CopyDataInParallel(int in_fd, off64_t offset,
+                                                size_t count) {
+  const off64_t out_offset = outpos_;
+  // Seeking past the hole flushes the data buffered by stdio before it.
+  if (!file_.Seek(out_offset + count)) {
+    diag_err(1, "%s:%d: Cannot seek %s", __FILE__, __LINE__, path());
+  }
+  outpos_ += count;
+  const int out_fd = file_.fd();
+  std::function<bool()> job = [in_fd, offset, out_fd, out_offset, count] {
+    return CopyDataAt(in_fd, offset, out_fd, out_offset, count);
+  };
+  return compression_pool_->Submit(job);
+}
+
+bool OutputJar::CopyDataAt(int in_fd, off64_t in_offset, int out_fd,
+                           off64_t out_offset, size_t count) {
+  size_t copied = 0;
+#if defined(__linux__) && defined(SYS_copy_file_range)
+  const blaze_util::FilesystemCapabilities &capabilities =
+      blaze_util::GetFilesystemCapabilities(out_fd);
+  while (copied < count && capabilities.Has(blaze_util::kFsCopyFileRange)) {
+    off64_t from = in_offset + copied;
+    off64_t to = out_offset + copied;
+    ssize_t n_copied = syscall(SYS_copy_file_range, in_fd, &from, out_fd, &to,
+                               count - copied, 0);
+    if (n_copied > 0) {
+      copied += n_copied;
+    } else if (n_copied < 0 && errno == EINTR) {
+      continue;
+    } else {
+      // Not supported here; copy the rest through the user space.
+      if (n_copied < 0 && copied == 0 &&
+          (errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+        capabilities.SetUnsupported(blaze_util::kFsCopyFileRange);
+      }
+      break;
+    }
+  }
+#endif
+  std::unique_ptr<uint8_t[]> buffer;
+  while (copied < count) {
+    if (buffer == nullptr) {
+      buffer.reset(new uint8_t[kBufferSize]);
+    }
+    size_t len = std::min(kBufferSize, count - copied);
+    ssize_t n_read = pread(in_fd, buffer.get(), len, in_offset + copied);
+    if (n_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n_read <= 0) {
+      return false;
+    }
+    for (ssize_t written = 0; written < n_read;) {
+      ssize_t n_written = pwrite(out_fd, buffer.get() + written,
+                                 n_read - written,
+                                 out_offset + copied + written);
+      if (n_written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      written += n_written;
+    }
+    copied += n_read;
+  }
+  return true;
+}
+#endif  // _WIN32
+
 size_t OutputJar::AppendFile(Options *options, const char *const file_path) {
+#ifdef _WIN32
+  // The file is read front to back, see CopyAppendData.
+  int in_fd = open(file_path, O_RDONLY | _O_BINARY | _O_SEQUENTIAL);
+#else
   int in_fd = open(file_path, O_RDONLY);
+#endif
   struct stat statbuf;
   if (fstat(in_fd, &statbuf)) {
     diag_err(1, "%s", file_path);
   }
-  // TODO(asmundak):  Consider going back to sendfile() or reflink
-  // (BTRFS_IOC_CLONE/XFS_IOC_CLONE) here.  The launcher preamble can
-  // be very large for targets with many native deps.
+  // The launcher preamble can be very large for targets with many native
+  // deps, CopyAppendData lets the kernel copy (or reflink) it if it can.
   ssize_t byte_count = CopyAppendData(in_fd, 0, statbuf.st_size);
   if (byte_count < 0) {
     diag_err(1, "%s:%d: Cannot copy %s to %s", __FILE__, __LINE__,
@@ -1052,19 +1858,20 @@ off64_t OutputJar::PageAlignedAppendFile(const std::string &file_path,
 #endif
   off64_t aligned_offset = (cur_offset + (pagesize - 1)) & ~(pagesize - 1);
   size_t gap = aligned_offset - cur_offset;
-  size_t written;
   if (gap > 0) {
     char *zeros = (char *)malloc(gap);
     if (zeros == nullptr) {
       diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
     }
     memset(zeros, 0, gap);
-    written = fwrite(zeros, 1, gap, file_);
-    outpos_ += written;
+    if (!WriteBytes(zeros, gap)) {
+      diag_err(1, "%s:%d: Cannot write %zu bytes", __FILE__, __LINE__, gap);
+    }
     free(zeros);
   }
 
-  // Copy file
+  // Copy file, sharing its pages with the output where the filesystem can
+  // clone them, see CloneAppendData.
   *file_size = AppendFile(options_, file_path.c_str());
 
   return aligned_offset;
@@ -1108,14 +1915,107 @@ void OutputJar::AppendPageAlignedFile(
 void OutputJar::ExtraCombiner(const std::string &entry_name,
                               Combiner *combiner) {
   extra_combiners_.emplace_back(combiner);
-  known_members_.emplace(entry_name, EntryInfo{combiner});
+  known_members_.Emplace(entry_name, EntryInfo{combiner});
+}
+
+void OutputJar::UseScannedJarCache(
+    ScannedJarCache *cache,
+    std::unordered_map<std::string, std::string> input_digests) {
+  scanned_jar_cache_ = cache;
+  input_digests_ = std::move(input_digests);
 }
 
 bool OutputJar::WriteBytes(const void *buffer, size_t count) {
-  size_t written = fwrite(buffer, 1, count, file_);
-  outpos_ += written;
-  return written == count;
+  if (replaying_) {
+    if (static_cast<size_t>(outpos_) + count <= previous_output_.size() &&
+        !memcmp(previous_output_.address(outpos_), buffer, count)) {
+      outpos_ += count;
+      return true;
+    }
+    StopReplay();
+  }
+  if (!file_.Write(buffer, count)) {
+    return false;
+  }
+  outpos_ += count;
+  return true;
+}
+
+bool OutputJar::OpenPreviousOutput(bool *in_place) {
+  struct stat previous_stat;
+  if (stat(options_->previous_output.c_str(), &previous_stat)) {
+    // There is nothing to reuse.
+    if (options_->verbose) {
+      fprintf(stderr, "Previous output %s does not exist\n",
+              options_->previous_output.c_str());
+    }
+    return true;
+  }
+  struct stat output_stat;
+  *in_place = !stat(path(), &output_stat) &&
+              output_stat.st_dev == previous_stat.st_dev &&
+              output_stat.st_ino == previous_stat.st_ino;
+#ifdef _WIN32
+  // st_ino is always 0 on Windows.
+  *in_place = *in_place && options_->previous_output == options_->output_jar;
+#endif
+  if (!previous_output_.Open(options_->previous_output)) {
+    return false;
+  }
+  return true;
+}
+
+void OutputJar::StopReplay() {
+  replaying_ = false;
+  replayed_bytes_ = outpos_;
+  if (in_place_) {
+    // The replayed bytes are already in the file.
+    if (!file_.Seek(outpos_)) {
+      diag_err(1, "%s:%d: Cannot seek %s", __FILE__, __LINE__, path());
+    }
+    return;
+  }
+  off64_t count = outpos_;
+  outpos_ = 0;
+  if (!WriteBytes(previous_output_.start(), count)) {
+    diag_err(1, "%s:%d: Cannot copy %" PRIu64 " bytes from %s", __FILE__,
+             __LINE__, static_cast<uint64_t>(count),
+             options_->previous_output.c_str());
+  }
+}
+
+void *OutputJar::PreviousEntry(const CDH *jar_entry, bool output_compressed) {
+  const size_t previous_size = previous_output_.size();
+  if (static_cast<size_t>(outpos_) + sizeof(LH) > previous_size) {
+    return nullptr;
+  }
+  const LH *lh = reinterpret_cast<const LH *>(previous_output_.address(outpos_));
+  // The uncompressed contents are identified by their size and CRC, which do
+  // not depend on the compression. The compression is checked separately:
+  // an entry the previous run stored is not reused when this run compresses,
+  // and vice versa. An entry the previous run stored because it did not
+  // shrink is recompressed again.
+  const uint16_t expected_method =
+      output_compressed ? (options_->zstd ? kZstdMethod : Z_DEFLATED)
+                        : Z_NO_COMPRESSION;
+  if (!lh->is() || outpos_ + lh->size() > previous_size ||
+      outpos_ + lh->size() + lh->in_zip_size() > previous_size ||
+      lh->file_name_length() != jar_entry->file_name_length() ||
+      memcmp(lh->file_name(), jar_entry->file_name(),
+             jar_entry->file_name_length()) ||
+      lh->crc32() != jar_entry->crc32() ||
+      lh->uncompressed_file_size() != jar_entry->uncompressed_file_size() ||
+      lh->compression_method() != expected_method) {
+    return nullptr;
+  }
+  size_t entry_size = lh->size() + lh->in_zip_size();
+  void *entry = malloc(entry_size);
+  if (entry == nullptr) {
+    diag_err(1, "%s:%d: malloc", __FILE__, __LINE__);
+  }
+  memcpy(entry, lh, entry_size);
+  return entry;
 }
 
-void OutputJar::ExtraHandler(const std::string &input_jar_path, const CDH *,
+void OutputJar::ExtraHandler(const std::string &, const CDH *,
                              const std::string *) {}
@@ -19,6 +19,9 @@
 
 #include <cinttypes>
 #include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -29,7 +32,16 @@
 // Need newline so clang-format won't alpha-sort with other headers.
 
 #include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/directory_buffer.h"
+#include "src/tools/singlejar/entry_cache.h"
+#include "src/tools/singlejar/input_jar_scanner.h"
+#include "src/tools/singlejar/mapped_file.h"
+#include "src/tools/singlejar/name_map.h"
 #include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/output_file.h"
+#include "src/tools/singlejar/path_trie.h"
+#include "src/tools/singlejar/profile.h"
+#include "src/tools/singlejar/worker_pool.h"
 
 /*
  * Jar file we are writing.
@@ -42,17 +54,33 @@ class OutputJar {
   int Doit(Options *options);
   // Destructor.
   virtual ~OutputJar();
+  // Take the input jars from the given cache, which outlives this instance,
+  // and add the ones that get scanned to it. INPUT_DIGESTS maps the input
+  // jar paths to the digests of their contents; the jars without a digest
+  // are not cached. Used by the persistent worker.
+  void UseScannedJarCache(
+      ScannedJarCache *cache,
+      std::unordered_map<std::string, std::string> input_digests);
   // Add a combiner to handle the entries with given name. OutputJar will
   // own the instance of the combiner and will delete it on self destruction.
   void ExtraCombiner(const std::string& entry_name, Combiner *combiner);
   // Additional file handler to be redefined by a subclass.
   virtual void ExtraHandler(const std::string &input_jar_path, const CDH *entry,
                             const std::string *input_jar_aux_label);
+  // Clone 'length' bytes starting at 'in_offset' from the file in_fd to
+  // 'out_offset' of the output file out_fd with FICLONERANGE, if the output
+  // filesystem can. Returns 0 on success, or -1 and sets errno. Redefined by
+  // the tests, which run on filesystems that cannot clone.
+  virtual int CloneRange(int out_fd, int in_fd, off64_t in_offset,
+                         off64_t out_offset, size_t length);
   // Return jar path.
   const char *path() const { return options_->output_jar.c_str(); }
   // True if an entry with given name have not been added to this archive.
   bool NewEntry(const std::string& entry_name) {
-    return known_members_.count(entry_name) == 0;
+    return !known_members_.Contains(entry_name);
+  }
+  bool NewEntry(const char *entry_name, size_t entry_name_length) {
+    return !known_members_.Contains(entry_name, entry_name_length);
   }
 
  protected:
@@ -72,17 +100,80 @@ class OutputJar {
  private:
   // Open output jar.
   bool Open();
-  // Add the contents of the given input jar.
-  bool AddJar(int jar_path_index);
+  // Add the contents of the given input jar, which has been already opened
+  // and scanned.
+  bool AddJar(int jar_path_index, ScannedJar *scanned_jar);
+  // Add the given entries of the input jar, in order. The jar stays open.
+  void AddJarEntries(int jar_path_index, ScannedJar *scanned_jar,
+                     const std::vector<ScannedJar::Entry> &entries,
+                     Profile::JarStats *jar_stats);
+  // An input jar some of whose entries have been added ahead of the others.
+  struct ProfiledJar {
+    std::shared_ptr<ScannedJar> jar;
+    // The entries yet to be added, in order.
+    std::vector<ScannedJar::Entry> remaining_entries;
+    Profile::JarStats *jar_stats = nullptr;
+  };
+  // Add the entries of the classes named by the --class_load_order profile,
+  // in load order, each taken from the first input jar that has it. Returns
+  // the jars the entries have been taken from, indexed like the input jars;
+  // the other items are empty.
+  std::vector<ProfiledJar> AddProfiledClasses(
+      const std::vector<std::string> &input_jar_paths,
+      const std::vector<std::string> &input_jar_digests);
+  // True if the entry name has one of the --nocompress_suffixes.
+  bool HasNoCompressSuffix(const char *file_name,
+                           size_t file_name_length) const;
+  // True if the given input file entry has to be inflated or deflated on the
+  // way to the output; sets OUTPUT_COMPRESSED to the output compression.
+  bool NeedsRecompression(const CDH *jar_entry, bool *output_compressed) const;
+  // Returns the output entry (Local Header followed by the payload) for the
+  // given input entry with the compression changed, consulting the entry
+  // cache if there is one. Safe to call from the worker threads.
+  static void *RecompressEntry(const CDH *jar_entry, const LH *lh,
+                               bool output_compressed, bool zstd,
+                               bool libdeflate, EntryCache *cache);
+  // True if the entry is too large for RecompressEntry(), which holds its
+  // contents in memory twice. WriteLargeRecompressedEntry() streams them.
+  static bool IsLargeEntry(const CDH *jar_entry);
+  // Writes the given input entry with the compression changed, passing the
+  // payload to the output in chunks.
+  void WriteLargeRecompressedEntry(const CDH *jar_entry, const LH *lh,
+                                   bool output_compressed);
+  // True if the data of the entry are to start at --stored_alignment.
+  bool NeedsAlignment(const LH *lh) const;
+  // Returns the size of the AlignmentExtraField to add to the given Local
+  // Header, about to be written at the current position, for its data to
+  // start at --stored_alignment. Returns 0 if it is already aligned or does
+  // not need to be.
+  uint16_t AlignmentPadding(const LH *lh);
+  // Writes an AlignmentExtraField of the given size.
+  bool WriteAlignmentField(uint16_t size);
   // Returns the current output position.
   off64_t Position();
-  // Write Jar entry.
-  void WriteEntry(void *local_header_and_payload);
+  // Write Jar entry. If `write_payload` is given, the buffer holds only the
+  // Local Header, and write_payload() writes the data that follow it.
+  void WriteEntry(void *local_header_and_payload,
+                  const std::function<bool()> &write_payload = nullptr);
+  // Write the entry of the given combiner, if any. A payload too large to be
+  // held in memory is written in chunks, see Combiner::OutputLocalHeader().
+  void WriteCombinedEntry(Combiner *combiner, bool compress);
   // Write META_INF/ entry (the first entry on output).
   void WriteMetaInf();
   // Write a directory entry.
   void WriteDirEntry(const std::string &name, const uint8_t *extra_fields,
                      const uint16_t n_extra_fields);
+  // Write the missing parent directory entries of the given entry.
+  void AddMissingDirectories(const char *name, size_t length);
+  // A classpath resource file that is too large to be loaded into memory.
+  struct MappedResource;
+  // Maps the file of the given resource, and deflates it if `compress` is
+  // true and that makes it smaller. Returns the Local Header of its entry.
+  static void *PrepareMappedResource(const std::string &name,
+                                     const std::string &path, bool compress,
+                                     MappedResource *resource);
+  // Writes the entry of the resource prepared by PrepareMappedResource().
+  void WriteMappedResource(void *local_header, MappedResource *resource);
   // Create output Central Directory Header for the given input entry and
   // append it to CEN (Central Directory) buffer.
   void AppendToDirectoryBuffer(const CDH *cdh, off64_t lh_pos,
@@ -107,26 +198,68 @@ class OutputJar {
   size_t AppendFile(Options *options, const char *file_path);
   // Copy 'count' bytes starting at 'offset' from the given file.
   ssize_t CopyAppendData(int in_fd, off64_t offset, size_t count);
+  // Try to have the kernel append 'count' bytes starting at 'offset' from
+  // the given file without copying them through the user space. Returns the
+  // number of bytes copied, which is 0 if the platform or the filesystem does
+  // not support it, or -1 on error.
+  ssize_t KernelCopyAppendData(int in_fd, off64_t offset, size_t count);
+  // Try to append the whole pages of the 'count' bytes starting at 'offset'
+  // from the given file by cloning them, so that both files share the
+  // extents. Returns the number of bytes cloned, which is 0 if the ranges
+  // are not page-aligned or the filesystem cannot clone them, or -1 on error.
+  ssize_t CloneAppendData(int in_fd, off64_t offset, size_t count);
+  // Leaves a hole of 'count' bytes at the current output position and has a
+  // worker thread copy 'count' bytes starting at 'offset' from the given file
+  // into it. The output layout is decided in order as before, only the copy
+  // is concurrent. The file has to stay open until the result is ready.
+  // Not available on Windows.
+  std::future<bool> CopyDataInParallel(int in_fd, off64_t offset,
+                                       size_t count);
+  // Copy 'count' bytes starting at 'in_offset' from the given file to the
+  // output file at 'out_offset'. Safe to call from the worker threads.
+  static bool CopyDataAt(int in_fd, off64_t in_offset, int out_fd,
+                         off64_t out_offset, size_t count);
   // Write bytes to the output file, return true on success.
   bool WriteBytes(const void *buffer, size_t count);
+  // Write the --profile_json file.
+  void WriteProfile();
+  // Open the --previous_output and start replaying it.
+  bool OpenPreviousOutput(bool *in_place);
+  // Stop replaying the previous output: from now on the output differs from
+  // it. Makes the output file contain the replayed prefix.
+  void StopReplay();
+  // While replaying an input jar that has not changed, returns a copy of the
+  // entry at the current output position in the previous output, provided it
+  // is the recompressed version of the given input entry, or nullptr.
+  void *PreviousEntry(const CDH *jar_entry, bool output_compressed);
+
+  // The result of RecompressEntry() computed on a worker thread. The result
+  // is freed unless it has been taken.
+  struct RecompressedEntry {
+    ~RecompressedEntry() {
+      if (result.valid()) {
+        free(result.get());
+      }
+    }
+    std::future<void *> result;
+  };
 
   Options *options_;
   struct EntryInfo {
-    EntryInfo(Combiner *combiner, int index = -1)
+    EntryInfo(Combiner *combiner = nullptr, int index = -1)
         : combiner_(combiner), input_jar_index_(index) {}
     Combiner *combiner_;
     int input_jar_index_;  // Input jar index for the plain entry or -1.
   };
 
-  std::unordered_map<std::string, struct EntryInfo> known_members_;
-  FILE *file_;
+  NameMap<EntryInfo> known_members_;
+  // The parent directories already added by AddMissingDirectories().
+  PathTrie parent_directories_;
+  OutputFile file_;
   off64_t outpos_;
-  std::unique_ptr<char[]> buffer_;
   int entries_;
   int duplicate_entries_;
-  uint8_t *cen_;
-  size_t cen_size_;
-  size_t cen_capacity_;
+  DirectoryBuffer cen_;
   Concatenator spring_handlers_;
   Concatenator spring_schemas_;
   Concatenator protobuf_meta_handler_;
@@ -135,7 +268,30 @@ class OutputJar {
   NullCombiner null_combiner_;
   std::vector<std::unique_ptr<Concatenator> > service_handlers_;
   std::vector<std::unique_ptr<Concatenator> > classpath_resources_;
+  // The files of the classpath_resources_ that are too large to be loaded
+  // into memory, or empty strings for the others.
+  std::vector<std::string> classpath_resource_paths_;
   std::vector<std::unique_ptr<Combiner> > extra_combiners_;
+  // Threads compressing the entries ahead of the writer, if --threads > 1.
+  std::unique_ptr<WorkerPool> compression_pool_;
+  // Recompressed entries cache, if --entry_cache is set.
+  std::unique_ptr<EntryCache> entry_cache_;
+  // With --previous_output, the output is "replayed" against the previous
+  // output: as long as the bytes to write are the same as the ones already
+  // there, nothing is written and only the position advances.
+  MappedFile previous_output_;
+  bool replaying_;
+  // True if the previous output is the output file itself.
+  bool in_place_;
+  // The index of the first changed input jar. The entries which would be
+  // recompressed are taken from the previous output for the jars before it.
+  size_t first_changed_input_;
+  off64_t replayed_bytes_;
+  // Timings and counters, if --profile_json is set.
+  std::unique_ptr<Profile> profile_;
+  // The input jars scanned by the previous requests, in the worker mode.
+  ScannedJarCache *scanned_jar_cache_;
+  std::unordered_map<std::string, std::string> input_digests_;
 };
 
 #endif  //   SRC_TOOLS_SINGLEJAR_COMBINED_JAR_H_
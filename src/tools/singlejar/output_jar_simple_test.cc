@@ -15,6 +15,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
 // Must be included before anything else.
 #include "src/tools/singlejar/port.h"
 
@@ -87,6 +89,41 @@ class CustomOutputJar : public OutputJar {
   }
 };
 
+#ifdef __linux__
+// A subclass of the OutputJar which stands in for a filesystem that clones:
+// it "clones" by copying, or fails to clone with the given errno, so that the
+// clone path runs on any filesystem.
+class CloningOutputJar : public OutputJar {
+ public:
+  explicit CloningOutputJar(int clone_errno) : clone_errno_(clone_errno) {}
+  ~CloningOutputJar() override {}
+  int CloneRange(int out_fd, int in_fd, off64_t in_offset, off64_t out_offset,
+                 size_t length) override {
+    ++clone_calls_;
+    if (clone_errno_ != 0) {
+      errno = clone_errno_;
+      return -1;
+    }
+    string data(length, '\0');
+    if (pread(in_fd, &data[0], length, in_offset) !=
+            static_cast<ssize_t>(length) ||
+        pwrite(out_fd, data.data(), length, out_offset) !=
+            static_cast<ssize_t>(length)) {
+      return -1;
+    }
+    cloned_bytes_ += length;
+    return 0;
+  }
+  int clone_calls() const { return clone_calls_; }
+  size_t cloned_bytes() const { return cloned_bytes_; }
+
+ private:
+  const int clone_errno_;
+  int clone_calls_ = 0;
+  size_t cloned_bytes_ = 0;
+};
+#endif  // __linux__
+
 class OutputJarSimpleTest : public ::testing::Test {
  protected:
   void SetUp() override { runfiles.reset(Runfiles::CreateForTest()); }
@@ -257,6 +294,171 @@ TEST_F(OutputJarSimpleTest, Source) {
   input_jar.Close();
 }
 
+// Scanning the input jars on several threads does not change the output.
+TEST_F(OutputJarSimpleTest, Threads) {
+  std::vector<string> sources = {"--sources"};
+  for (int i = 0; i < 10; ++i) {
+    sources.push_back(runfiles->Rlocation(
+        i % 2 ? "io_bazel/src/tools/singlejar/libtest2.jar"
+              : "io_bazel/src/tools/singlejar/libtest1.jar"));
+    sources.push_back(runfiles->Rlocation(kPathLibData1));
+  }
+  string serial_path = OutputFilePath("serial.jar");
+  std::vector<string> args = {"--normalize"};
+  args.insert(args.end(), sources.begin(), sources.end());
+  CreateOutput(serial_path, args);
+
+  string parallel_path = OutputFilePath("parallel.jar");
+  std::vector<const char *> parallel_args = {
+      "--output", parallel_path.c_str(), "--build_target", "//some/target",
+      "--normalize", "--threads", "4"};
+  for (auto &arg : sources) {
+    parallel_args.push_back(arg.c_str());
+  }
+  Options options;
+  options.ParseCommandLine(parallel_args.size(), parallel_args.data());
+  OutputJar output_jar;
+  ASSERT_EQ(0, output_jar.Doit(&options));
+
+  string serial_contents;
+  string parallel_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(serial_path, &serial_contents));
+  ASSERT_TRUE(blaze_util::ReadFile(parallel_path, &parallel_contents));
+  EXPECT_EQ(serial_contents, parallel_contents);
+}
+
+// Reading the input jars into memory does not change the output.
+TEST_F(OutputJarSimpleTest, ReadInputJars) {
+  string jar1 = runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar");
+  string jar2 = runfiles->Rlocation(kPathLibData1);
+  string mapped_path = OutputFilePath("mapped.jar");
+  CreateOutput(mapped_path, {"--normalize", "--sources", jar1, jar2});
+
+  string read_path = OutputFilePath("read.jar");
+  std::vector<const char *> read_args = {
+      "--output", read_path.c_str(), "--build_target", "//some/target",
+      "--normalize", "--read_input_jars", "--threads", "2", "--sources",
+      jar1.c_str(), jar2.c_str()};
+  Options options;
+  options.ParseCommandLine(read_args.size(), read_args.data());
+  OutputJar output_jar;
+  ASSERT_EQ(0, output_jar.Doit(&options));
+
+  string mapped_contents;
+  string read_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(mapped_path, &mapped_contents));
+  ASSERT_TRUE(blaze_util::ReadFile(read_path, &read_contents));
+  EXPECT_EQ(mapped_contents, read_contents);
+}
+
+// Verify that --previous_output produces the same output as a full rebuild,
+// whether the previous output is a separate file or the output itself.
+TEST_F(OutputJarSimpleTest, PreviousOutput) {
+  auto copy_input = [this](const char *from, const string &to) {
+    string contents;
+    ASSERT_TRUE(blaze_util::ReadFile(runfiles->Rlocation(from), &contents));
+    ASSERT_TRUE(blaze_util::WriteFile(contents, to));
+  };
+  auto create_output = [](const string &out_path,
+                          std::vector<const char *> args) {
+    args.insert(args.begin(), {"--output", out_path.c_str(), "--build_target",
+                               "//some/target", "--compression"});
+    Options options;
+    options.ParseCommandLine(args.size(), args.data());
+    OutputJar output_jar;
+    ASSERT_EQ(0, output_jar.Doit(&options));
+    EXPECT_EQ(0, VerifyZip(out_path));
+  };
+  string jar1 = OutputFilePath("jar1.jar");
+  string jar2 = OutputFilePath("jar2.jar");
+  copy_input("io_bazel/src/tools/singlejar/libtest1.jar", jar1);
+  copy_input(kPathLibData1, jar2);
+  string previous_path = OutputFilePath("previous.jar");
+  create_output(previous_path, {"--sources", jar1.c_str(), jar2.c_str()});
+
+  // Change the second input and rebuild from scratch.
+  copy_input(kPathLibData2, jar2);
+  string full_path = OutputFilePath("full.jar");
+  create_output(full_path, {"--sources", jar1.c_str(), jar2.c_str()});
+  string full_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(full_path, &full_contents));
+
+  string out_path = OutputFilePath("out.jar");
+  create_output(out_path, {"--sources", jar1.c_str(), jar2.c_str(),
+                           "--previous_output", previous_path.c_str(),
+                           "--changed_inputs", jar2.c_str()});
+  string out_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(out_path, &out_contents));
+  EXPECT_EQ(full_contents, out_contents);
+
+  create_output(previous_path, {"--sources", jar1.c_str(), jar2.c_str(),
+                                "--previous_output", previous_path.c_str(),
+                                "--changed_inputs", jar2.c_str()});
+  ASSERT_TRUE(blaze_util::ReadFile(previous_path, &out_contents));
+  EXPECT_EQ(full_contents, out_contents);
+}
+
+// Verify that --previous_output does not reuse entries compressed differently
+// when --compression is flipped between two runs.
+TEST_F(OutputJarSimpleTest, PreviousOutputCompressionChanged) {
+  auto create_output = [](const string &out_path, bool compress,
+                          std::vector<const char *> args) {
+    // Build data comes first and would differ between the two runs, ending
+    // the replay before any entry could be reused.
+    args.insert(args.begin(), {"--output", out_path.c_str(), "--normalize",
+                               "--exclude_build_data"});
+    if (compress) {
+      args.push_back("--compression");
+    }
+    Options options;
+    options.ParseCommandLine(args.size(), args.data());
+    OutputJar output_jar;
+    ASSERT_EQ(0, output_jar.Doit(&options));
+    EXPECT_EQ(0, VerifyZip(out_path));
+  };
+  // The entries of stored.jar are recompressed exactly when --compression is
+  // given.
+  string jar1 = runfiles->Rlocation("io_bazel/src/tools/singlejar/stored.jar");
+  string jar2 = runfiles->Rlocation(kPathLibData1);
+
+  for (bool compress : {true, false}) {
+    string previous_path = OutputFilePath("previous.jar");
+    create_output(previous_path, !compress,
+                  {"--sources", jar1.c_str(), jar2.c_str()});
+    string full_path = OutputFilePath("full.jar");
+    create_output(full_path, compress,
+                  {"--sources", jar1.c_str(), jar2.c_str()});
+    string out_path = OutputFilePath("out.jar");
+    create_output(out_path, compress,
+                  {"--sources", jar1.c_str(), jar2.c_str(),
+                   "--previous_output", previous_path.c_str(),
+                   "--changed_inputs", jar2.c_str()});
+
+    string full_contents;
+    string out_contents;
+    ASSERT_TRUE(blaze_util::ReadFile(full_path, &full_contents));
+    ASSERT_TRUE(blaze_util::ReadFile(out_path, &out_contents));
+    EXPECT_EQ(full_contents, out_contents) << "compress=" << compress;
+  }
+}
+
+// Verify --profile_json argument.
+TEST_F(OutputJarSimpleTest, ProfileJson) {
+  string out_path = OutputFilePath("out.jar");
+  string profile_path = OutputFilePath("profile.json");
+  string input_path =
+      runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar");
+  CreateOutput(out_path, {"--sources", input_path, "--compression",
+                          "--profile_json", profile_path});
+  string profile;
+  ASSERT_TRUE(blaze_util::ReadFile(profile_path, &profile));
+  EXPECT_EQ('{', profile.front()) << profile;
+  EXPECT_NE(string::npos, profile.find("\"phases_us\": {")) << profile;
+  EXPECT_NE(string::npos, profile.find("\"add_jar\": ")) << profile;
+  EXPECT_NE(string::npos, profile.find("\"known_members_size\": ")) << profile;
+  EXPECT_NE(string::npos, profile.find(Profile::Quote(input_path))) << profile;
+}
+
 // Verify --java_launcher argument
 TEST_F(OutputJarSimpleTest, JavaLauncher) {
   string out_path = OutputFilePath("out.jar");
@@ -400,6 +602,54 @@ TEST_F(OutputJarSimpleTest, CDSAndJDKLibModules) {
   fclose(fp);
 }
 
+#ifdef __linux__
+// Cloning the whole pages of the page-aligned files into the output, or
+// failing to clone them, does not change the output.
+TEST_F(OutputJarSimpleTest, CloneAppendData) {
+  const size_t pagesize = sysconf(_SC_PAGESIZE);
+  string modules_data;
+  for (size_t i = 0; i < 3 * pagesize + 100; ++i) {
+    modules_data.push_back('a' + i % 26);
+  }
+  string launcher_path = CreateTextFile("launcher", "Dummy");
+  string cds_archive_path =
+      CreateTextFile("classes.jsa", string(pagesize, 'c').c_str());
+  string jdk_lib_modules_path =
+      CreateTextFile("modules", modules_data.c_str());
+  const std::vector<string> args = {
+      "--normalize",     "--exclude_build_data", "--java_launcher",
+      launcher_path,     "--cds_archive",        cds_archive_path,
+      "--jdk_lib_modules", jdk_lib_modules_path};
+  string copied_path = OutputFilePath("copied.jar");
+  CreateOutput(copied_path, args);
+  string copied_contents;
+  ASSERT_TRUE(blaze_util::ReadFile(copied_path, &copied_contents));
+
+  for (int clone_errno : {0, EXDEV, EOPNOTSUPP}) {
+    string cloned_path = OutputFilePath("cloned.jar");
+    std::vector<const char *> cloned_args = {"--output", cloned_path.c_str(),
+                                             "--build_target",
+                                             "//some/target"};
+    for (auto &arg : args) {
+      cloned_args.push_back(arg.c_str());
+    }
+    Options options;
+    options.ParseCommandLine(cloned_args.size(), cloned_args.data());
+    CloningOutputJar output_jar(clone_errno);
+    ASSERT_EQ(0, output_jar.Doit(&options));
+    EXPECT_EQ(0, VerifyZip(cloned_path));
+
+    // The launcher is shorter than a page, the CDS archive and the whole
+    // pages of the modules image are cloned.
+    EXPECT_EQ(2, output_jar.clone_calls());
+    EXPECT_EQ(clone_errno == 0 ? 4 * pagesize : 0, output_jar.cloned_bytes());
+    string cloned_contents;
+    ASSERT_TRUE(blaze_util::ReadFile(cloned_path, &cloned_contents));
+    EXPECT_EQ(copied_contents, cloned_contents) << "errno " << clone_errno;
+  }
+}
+#endif  // __linux__
+
 // --main_class option.
 TEST_F(OutputJarSimpleTest, MainClass) {
   string out_path = OutputFilePath("out.jar");
@@ -558,6 +808,23 @@ TEST_F(OutputJarSimpleTest, ClasspathResources) {
   EXPECT_EQ("line1\nline2\n", res);
 }
 
+// Resource files too large to be loaded into memory are written straight
+// from the file, stored or deflated.
+TEST_F(OutputJarSimpleTest, LargeResources) {
+  string contents;
+  for (int i = 0; contents.size() < (3u << 20); ++i) {
+    contents += "line " + std::to_string(i) + "\n";
+  }
+  string res_path = OutputFilePath("large_res");
+  ASSERT_TRUE(blaze_util::WriteFile(contents, res_path));
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(out_path, {"--compression", "--nocompress_suffixes", ".stored",
+                          "--resources", res_path + ":the/large_res",
+                          res_path + ":the/large_res.stored"});
+  EXPECT_EQ(contents, GetEntryContents(out_path, "the/large_res"));
+  EXPECT_EQ(contents, GetEntryContents(out_path, "the/large_res.stored"));
+}
+
 // Duplicate entries for --resources or --classpath_resources
 TEST_F(OutputJarSimpleTest, DuplicateResources) {
   string cp_res_path = CreateTextFile("cp_res", "line1\nline2\n");
@@ -642,6 +909,52 @@ TEST_F(OutputJarSimpleTest, IncludeHeaders) {
   EXPECT_EQ(expected_entries, jar_entries);
 }
 
+// --class_load_order
+TEST_F(OutputJarSimpleTest, ClassLoadOrder) {
+  string class_path = CreateTextFile("Class.class", "class");
+  string first = class_path + ":a/First.class";
+  string second = class_path + ":a/Second.class";
+  string third = class_path + ":b/Third.class";
+  string classes_path = OutputFilePath("classes.jar");
+  const std::vector<const char *> classes_args = {
+      "--output",    classes_path.c_str(), "--resources", first.c_str(),
+      second.c_str(), third.c_str()};
+  Options classes_options;
+  classes_options.ParseCommandLine(classes_args.size(), classes_args.data());
+  OutputJar classes_jar;
+  ASSERT_EQ(0, classes_jar.Doit(&classes_options));
+
+  string profile_path = CreateTextFile(
+      "classes.txt",
+      "[0.010s][info][class,load] b.Third source: file:/classes.jar\n"
+      "[0.011s][info][class,load] java.lang.Object source: jrt:/java.base\n"
+      "[0.012s][info][class,load] a.First source: file:/classes.jar\n");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(
+      out_path,
+      {"--sources",
+       runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar"),
+       classes_path, "--class_load_order", profile_path});
+  std::vector<string> jar_entries;
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    jar_entries.push_back(cdh->file_name_string());
+  }
+  input_jar.Close();
+  // The profiled classes right after the entries singlejar creates, the
+  // others in the input order.
+  ASSERT_LE(6u, jar_entries.size());
+  EXPECT_EQ("build-data.properties", jar_entries[2]);
+  EXPECT_EQ("b/Third.class", jar_entries[3]);
+  EXPECT_EQ("a/First.class", jar_entries[4]);
+  EXPECT_EQ(1, std::count(jar_entries.begin() + 5, jar_entries.end(),
+                          "a/Second.class"));
+  EXPECT_EQ("class", GetEntryContents(out_path, "b/Third.class"));
+}
+
 // --normalize
 TEST_F(OutputJarSimpleTest, Normalize) {
   // Creates output jar containing entries from all possible sources:
@@ -995,6 +1308,57 @@ TEST_F(OutputJarSimpleTest, Nocompress) {
   input_jar.Close();
 }
 
+// Test that the uncompressed entries with suffixes in --align_stored_suffixes
+// start at a multiple of --stored_alignment, both the ones copied from the
+// source archives and the ones written anew.
+TEST_F(OutputJarSimpleTest, AlignStored) {
+  string res1_path =
+      CreateTextFile("resource.foo", "line1\nline2\nline3\nline4\n");
+  string res2_path =
+      CreateTextFile("resource.bar", "line1\nline2\nline3\nline4\n");
+  string out_path = OutputFilePath("out.jar");
+  CreateOutput(
+      out_path,
+      {"--sources",
+       runfiles->Rlocation("io_bazel/src/tools/singlejar/libtest1.jar"),
+       runfiles->Rlocation("io_bazel/src/tools/singlejar/stored.jar"),
+       "--resources", res1_path, res2_path, "--nocompress_suffixes", ".foo",
+       ".bar", "--align_stored_suffixes", ".cc", ".foo", "--stored_alignment",
+       "8192"});
+  InputJar input_jar;
+  ASSERT_TRUE(input_jar.Open(out_path));
+  const LH *lh;
+  const CDH *cdh;
+  int aligned = 0;
+  while ((cdh = input_jar.NextEntry(&lh))) {
+    const string name = lh->file_name_string();
+    const size_t data_offset = lh->data() - input_jar.mapped_start();
+    if (lh->compression_method() == Z_NO_COMPRESSION &&
+        (EndsWith(name, ".cc") || EndsWith(name, ".foo"))) {
+      EXPECT_EQ(0, data_offset % 8192) << name << " is not aligned";
+      EXPECT_NE(nullptr, AlignmentExtraField::find(
+                             lh->extra_fields(),
+                             lh->extra_fields() + lh->extra_fields_length()))
+          << name << " has no alignment field";
+      EXPECT_EQ(nullptr, AlignmentExtraField::find(
+                             cdh->extra_fields(),
+                             cdh->extra_fields() + cdh->extra_fields_length()))
+          << name << " has the alignment field in the central directory";
+      ++aligned;
+    } else {
+      EXPECT_EQ(nullptr, AlignmentExtraField::find(
+                             lh->extra_fields(),
+                             lh->extra_fields() + lh->extra_fields_length()))
+          << name << " is padded";
+    }
+  }
+  input_jar.Close();
+  // output_jar.cc from stored.jar and resource.foo.
+  EXPECT_EQ(2, aligned);
+  EXPECT_EQ("line1\nline2\nline3\nline4\n",
+            GetEntryContents(out_path, res1_path));
+}
+
 // --multi_release option.
 TEST_F(OutputJarSimpleTest, MultiRelease) {
   string out_path = OutputFilePath("out.jar");
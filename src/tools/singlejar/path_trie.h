@@ -0,0 +1,82 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_PATH_TRIE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_PATH_TRIE_H_ 1
+
+#include <stddef.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/*
+ * The parent directories of entry names that have been dealt with, as a
+ * trie of path components.
+ *
+ * Looking the directories of a name up in a hash map one prefix at a time
+ * hashes the leading components over and over again. The trie walks the
+ * name once instead, and allocates only for the directories it has not seen
+ * before, which are few: the entries of a jar share their packages.
+ */
+class PathTrie {
+ public:
+  PathTrie() : size_(0) {}
+
+  PathTrie(const PathTrie &) = delete;
+  PathTrie &operator=(const PathTrie &) = delete;
+
+  // Calls `visit` with the length of every parent directory of the name,
+  // that is every prefix ending with '/', which has not been visited
+  // before, outermost first. The trailing '/' of a directory name does not
+  // count: "a/b/" has the single parent "a/". The directories are
+  // remembered once `visit` returns.
+  template <typename Visit>
+  void AddParents(const char *name, size_t length, Visit visit) {
+    Node *node = &root_;
+    size_t start = 0;
+    for (size_t pos = 0; pos + 1 < length; ++pos) {
+      if (name[pos] != '/') {
+        continue;
+      }
+      std::string_view component(name + start, pos - start);
+      auto child = node->children.find(component);
+      if (child == node->children.end()) {
+        visit(pos + 1);
+        child = node->children
+                    .emplace(std::string(component), std::make_unique<Node>())
+                    .first;
+        ++size_;
+      }
+      node = child->second.get();
+      start = pos + 1;
+    }
+  }
+
+  // The number of directories visited so far.
+  size_t size() const { return size_; }
+
+ private:
+  struct Node {
+    // std::less<> looks the components up without copying them.
+    std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+  };
+
+  Node root_;
+  size_t size_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_PATH_TRIE_H_
@@ -0,0 +1,66 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/path_trie.h"
+
+#include <string>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+// Returns the parent directories of the name that are new to the trie.
+std::vector<std::string> NewParents(PathTrie *trie, const std::string &name) {
+  std::vector<std::string> parents;
+  trie->AddParents(name.data(), name.size(), [&](size_t length) {
+    parents.push_back(name.substr(0, length));
+  });
+  return parents;
+}
+
+TEST(PathTrieTest, AddParents) {
+  PathTrie trie;
+  EXPECT_EQ(std::vector<std::string>({"a/", "a/b/", "a/b/c/"}),
+            NewParents(&trie, "a/b/c/D.class"));
+  EXPECT_EQ(std::vector<std::string>(), NewParents(&trie, "a/b/c/E.class"));
+  EXPECT_EQ(std::vector<std::string>({"a/x/"}),
+            NewParents(&trie, "a/x/F.class"));
+  EXPECT_EQ(4UL, trie.size());
+}
+
+// A directory name is not its own parent.
+TEST(PathTrieTest, DirectoryNames) {
+  PathTrie trie;
+  EXPECT_EQ(std::vector<std::string>({"a/"}), NewParents(&trie, "a/b/"));
+  EXPECT_EQ(std::vector<std::string>(), NewParents(&trie, "a/"));
+  EXPECT_EQ(std::vector<std::string>({"a/b/"}), NewParents(&trie, "a/b/c"));
+}
+
+TEST(PathTrieTest, TopLevelNames) {
+  PathTrie trie;
+  EXPECT_EQ(std::vector<std::string>(), NewParents(&trie, "A.class"));
+  EXPECT_EQ(std::vector<std::string>(), NewParents(&trie, ""));
+  EXPECT_EQ(0UL, trie.size());
+}
+
+// Components are compared whole, "ab/" is not under "a/".
+TEST(PathTrieTest, SharedPrefixes) {
+  PathTrie trie;
+  EXPECT_EQ(std::vector<std::string>({"a/"}), NewParents(&trie, "a/X"));
+  EXPECT_EQ(std::vector<std::string>({"ab/"}), NewParents(&trie, "ab/X"));
+  EXPECT_EQ(std::vector<std::string>({"ab/a/"}), NewParents(&trie, "ab/a/X"));
+}
+
+}  // namespace
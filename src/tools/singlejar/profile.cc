@@ -0,0 +1,82 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/profile.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <string>
+
+static const char *const kPhaseNames[] = {
+    "open", "resources", "add_jar", "recompress",
+    "write_entry", "combiners", "close",
+};
+static_assert(sizeof(kPhaseNames) / sizeof(kPhaseNames[0]) ==
+                  Profile::kPhaseCount,
+              "kPhaseNames does not match Profile::Phase");
+
+static uint64_t Microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+      .count();
+}
+
+std::string Profile::Quote(const std::string &str) {
+  std::string quoted("\"");
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  quoted += '"';
+  return quoted;
+}
+
+bool Profile::Write(const std::string &path) const {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fprintf(file, "{\n  \"phases_us\": {");
+  for (int phase = 0; phase < kPhaseCount; ++phase) {
+    fprintf(file, "%s\n    \"%s\": %" PRIu64, phase ? "," : "",
+            kPhaseNames[phase], Microseconds(phases_[phase]));
+  }
+  fprintf(file, "\n  },\n  \"counters\": {");
+  for (size_t ix = 0; ix < counters_.size(); ++ix) {
+    fprintf(file, "%s\n    %s: %" PRIu64, ix ? "," : "",
+            Quote(counters_[ix].first).c_str(), counters_[ix].second);
+  }
+  fprintf(file, "\n  },\n  \"inputs\": [");
+  for (size_t ix = 0; ix < jars_.size(); ++ix) {
+    const JarStats &jar = jars_[ix];
+    fprintf(file,
+            "%s\n    {\"path\": %s, \"entries\": %d, \"duplicates\": %d, "
+            "\"copied_bytes\": %" PRIu64 ", \"recompressed_bytes\": %" PRIu64
+            ", \"time_us\": %" PRIu64 "}",
+            ix ? "," : "", Quote(jar.path).c_str(), jar.entries,
+            jar.duplicates, jar.copied_bytes, jar.recompressed_bytes,
+            Microseconds(jar.time));
+  }
+  fprintf(file, "\n  ]\n}\n");
+  return fclose(file) == 0;
+}
@@ -0,0 +1,114 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_PROFILE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_PROFILE_H_ 1
+
+#include <stdint.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Collects the time spent in each phase of building the output jar and
+ * the per input jar counters, and writes them out as JSON for --profile_json.
+ * The phases nest: e.g., the time spent in WriteEntry is also counted by the
+ * phase that called it. Only used on the writer's thread.
+ */
+class Profile {
+ public:
+  enum Phase {
+    kOpen,
+    kResources,
+    kAddJar,
+    kRecompress,
+    kWriteEntry,
+    kCombiners,
+    kClose,
+    kPhaseCount
+  };
+
+  struct JarStats {
+    explicit JarStats(const std::string &path) : path(path) {}
+    std::string path;
+    int entries = 0;
+    int duplicates = 0;
+    // The input bytes copied as is and the ones inflated or deflated.
+    uint64_t copied_bytes = 0;
+    uint64_t recompressed_bytes = 0;
+    std::chrono::steady_clock::duration time{0};
+  };
+
+  // Accounts the lifetime of the instance to the given phase and, if set,
+  // to the given input jar. Does nothing if the profile is null, so that it
+  // can be used unconditionally.
+  class Timer {
+   public:
+    Timer(Profile *profile, Phase phase, JarStats *jar = nullptr)
+        : profile_(profile), phase_(phase), jar_(jar) {
+      if (profile_) {
+        start_ = std::chrono::steady_clock::now();
+      }
+    }
+    ~Timer() { Stop(); }
+
+    // Ends the timing before the end of the scope.
+    void Stop() {
+      if (profile_) {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        profile_->phases_[phase_] += elapsed;
+        if (jar_) {
+          jar_->time += elapsed;
+        }
+        profile_ = nullptr;
+      }
+    }
+
+   private:
+    Profile *profile_;
+    Phase phase_;
+    JarStats *jar_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  Profile() : phases_(kPhaseCount, std::chrono::steady_clock::duration(0)) {}
+
+  // Starts the counters for the next input jar. The returned pointer stays
+  // valid for the lifetime of the profile.
+  JarStats *AddJar(const std::string &path) {
+    jars_.emplace_back(path);
+    return &jars_.back();
+  }
+
+  // Records a global counter. Counters are written in the order they are set.
+  void SetCounter(const char *name, uint64_t value) {
+    counters_.emplace_back(name, value);
+  }
+
+  // Writes the profile to the given file. Returns false on failure.
+  bool Write(const std::string &path) const;
+
+  // Returns the JSON string literal for the given string.
+  static std::string Quote(const std::string &str);
+
+ private:
+  std::vector<std::chrono::steady_clock::duration> phases_;
+  std::deque<JarStats> jars_;
+  std::vector<std::pair<std::string, uint64_t>> counters_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_PROFILE_H_
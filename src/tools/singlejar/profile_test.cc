@@ -0,0 +1,64 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/profile.h"
+
+#include <string>
+
+#include "src/main/cpp/util/file.h"
+#include "src/tools/singlejar/test_util.h"
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+TEST(ProfileTest, Quote) {
+  EXPECT_EQ("\"a/b.jar\"", Profile::Quote("a/b.jar"));
+  EXPECT_EQ("\"C:\\\\x \\\"y\\\"\"", Profile::Quote("C:\\x \"y\""));
+  EXPECT_EQ("\"\\u000a\\u0001\"", Profile::Quote("\n\x01"));
+}
+
+TEST(ProfileTest, Write) {
+  Profile profile;
+  {
+    Profile::JarStats *jar = profile.AddJar("in.jar");
+    Profile::Timer timer(&profile, Profile::kAddJar, jar);
+    jar->entries = 3;
+    jar->duplicates = 1;
+    jar->copied_bytes = 100;
+    jar->recompressed_bytes = 200;
+  }
+  // A null profile is ignored.
+  { Profile::Timer timer(nullptr, Profile::kClose); }
+  profile.SetCounter("entries", 3);
+  profile.SetCounter("output_bytes", 1234);
+
+  std::string path = singlejar_test_util::OutputFilePath("profile.json");
+  ASSERT_TRUE(profile.Write(path));
+  std::string json;
+  ASSERT_TRUE(blaze_util::ReadFile(path, &json));
+  EXPECT_NE(std::string::npos, json.find("\"phases_us\": {\n    \"open\": 0,"))
+      << json;
+  EXPECT_NE(std::string::npos, json.find("\"close\": 0\n  },")) << json;
+  EXPECT_NE(std::string::npos,
+            json.find("\"counters\": {\n    \"entries\": 3,\n"
+                      "    \"output_bytes\": 1234\n  },"))
+      << json;
+  EXPECT_NE(std::string::npos,
+            json.find("{\"path\": \"in.jar\", \"entries\": 3, "
+                      "\"duplicates\": 1, \"copied_bytes\": 100, "
+                      "\"recompressed_bytes\": 200, \"time_us\": "))
+      << json;
+}
+
+}  // namespace
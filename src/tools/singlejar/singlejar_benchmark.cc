@@ -0,0 +1,476 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Generates synthetic jar corpora and measures how OutputJar::Doit fares on
+ * them with several option combinations. Each run happens in a forked child,
+ * so that its peak RSS is not polluted by the corpus generation or by the
+ * previous runs. Usage:
+ *   singlejar_benchmark [--corpus NAME] [--config NAME] [--scale N]
+ *                       [--iterations N] [--work_dir DIR]
+ * It prints one line per corpus and configuration with the median of the
+ * iterations; the throughput is that of the uncompressed input. The corpora
+ * are generated in subdirectories of the work directory, which must exist.
+ * The read and write call counts come from /proc/self/io and are only
+ * available on Linux.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/tools/singlejar/combiners.h"
+#include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/options.h"
+#include "src/tools/singlejar/output_jar.h"
+#include "src/tools/singlejar/zip_headers.h"
+#include "src/tools/singlejar/zlib_interface.h"
+
+namespace {
+
+// What goes into the entries of a synthetic jar.
+enum class Payload {
+  kText,    // Compresses about 4:1, like class files and resources.
+  kRandom,  // Does not compress at all, like embedded archives.
+};
+
+struct CorpusSpec {
+  const char *name;
+  int jars;
+  int entries_per_jar;
+  size_t entry_size;
+  // Every n-th entry is stored rather than deflated; 0 means never.
+  int stored_every;
+  // Every n-th entry holds random bytes; 0 means never.
+  int random_every;
+  // Whether all the jars have the same entry names.
+  bool duplicate_names;
+};
+
+// The sizes are for --scale 1, which takes a few seconds per run.
+const CorpusSpec kCorpora[] = {
+    {"many_small", 2000, 40, 2048, 0, 0, false},
+    {"few_huge", 4, 256, 256 * 1024, 0, 8, false},
+    {"duplicates", 400, 200, 1024, 0, 0, true},
+    {"mixed", 200, 200, 8192, 3, 5, false},
+};
+
+struct ConfigSpec {
+  const char *name;
+  std::vector<const char *> args;
+};
+
+const ConfigSpec kConfigs[] = {
+    {"default", {}},
+    {"compression", {"--compression"}},
+    {"dont_change_compression", {"--dont_change_compression"}},
+    {"normalize", {"--normalize", "--exclude_build_data"}},
+    {"threads4", {"--compression", "--threads", "4"}},
+};
+
+// A deterministic generator, so that the corpora are identical across runs.
+class Random {
+ public:
+  explicit Random(uint64_t seed) : state_(seed | 1) {}
+
+  uint64_t Next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_;
+  }
+
+ private:
+  uint64_t state_;
+};
+
+void FillPayload(Payload payload, Random *random, std::string *data,
+                 size_t size) {
+  static const char *const kWords[] = {
+      "java/lang/Object", "<init>", "Code", "LineNumberTable", "this",
+      "java/util/List", "()V", "SourceFile", "StackMapTable", "value",
+      "com/example/", "Ljava/lang/String;", "toString", "hashCode"};
+  data->clear();
+  data->reserve(size);
+  if (payload == Payload::kRandom) {
+    while (data->size() < size) {
+      data->push_back(static_cast<char>(random->Next()));
+    }
+    return;
+  }
+  while (data->size() < size) {
+    uint64_t r = random->Next();
+    data->append(kWords[r % (sizeof(kWords) / sizeof(kWords[0]))]);
+    data->push_back(static_cast<char>(r >> 32));
+  }
+  data->resize(size);
+}
+
+// Writes a jar with a single pass, entry by entry like zip(1) would.
+class JarWriter {
+ public:
+  explicit JarWriter(const std::string &path) : path_(path), offset_(0) {
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path.c_str());
+    }
+  }
+
+  void AddEntry(const std::string &name, const std::string &data,
+                bool deflate) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data());
+    uint32_t crc = crc32(0, bytes, data.size());
+    if (deflate) {
+      deflated_.resize(deflateBound(&deflater_, data.size()));
+      deflater_.next_out = deflated_.data();
+      deflater_.avail_out = deflated_.size();
+      if (deflater_.Deflate(bytes, data.size(), Z_FINISH) != Z_STREAM_END) {
+        diag_errx(1, "%s:%d: cannot deflate %s", __FILE__, __LINE__,
+                  name.c_str());
+      }
+      deflated_.resize(deflater_.total_out);
+      deflateReset(&deflater_);
+      bytes = deflated_.data();
+    }
+    const size_t compressed_size = deflate ? deflated_.size() : data.size();
+
+    std::vector<uint8_t> buffer(sizeof(LH) + name.size());
+    LH *lh = reinterpret_cast<LH *>(buffer.data());
+    lh->signature();
+    lh->version(20);
+    lh->bit_flag(0);
+    lh->compression_method(deflate ? Z_DEFLATED : Z_NO_COMPRESSION);
+    lh->last_mod_file_time(0);
+    lh->last_mod_file_date(0x21);
+    lh->crc32(crc);
+    lh->compressed_file_size32(compressed_size);
+    lh->uncompressed_file_size32(data.size());
+    lh->file_name(name.data(), name.size());
+    lh->extra_fields(nullptr, 0);
+
+    size_t cdh_offset = cdr_.size();
+    cdr_.resize(cdh_offset + sizeof(CDH) + name.size());
+    CDH *cdh = reinterpret_cast<CDH *>(cdr_.data() + cdh_offset);
+    cdh->signature();
+    cdh->version(20);
+    cdh->version_to_extract(20);
+    cdh->bit_flag(0);
+    cdh->compression_method(lh->compression_method());
+    cdh->last_mod_file_time(0);
+    cdh->last_mod_file_date(0x21);
+    cdh->crc32(crc);
+    cdh->compressed_file_size32(compressed_size);
+    cdh->uncompressed_file_size32(data.size());
+    cdh->file_name(name.data(), name.size());
+    cdh->extra_fields(nullptr, 0);
+    cdh->comment_length(0);
+    cdh->start_disk_nr(0);
+    cdh->internal_attributes(0);
+    cdh->external_attributes(0);
+    cdh->local_header_offset32(offset_);
+    ++entries_;
+
+    Write(buffer.data(), buffer.size());
+    Write(bytes, compressed_size);
+  }
+
+  void Close() {
+    ECD ecd;
+    ecd.signature();
+    ecd.this_disk_nr(0);
+    ecd.cen_disk_nr(0);
+    ecd.this_disk_entries16(entries_);
+    ecd.total_entries16(entries_);
+    ecd.cen_size32(cdr_.size());
+    ecd.cen_offset32(offset_);
+    ecd.comment(nullptr, 0);
+    Write(cdr_.data(), cdr_.size());
+    Write(&ecd, sizeof(ecd));
+    if (fclose(file_)) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path_.c_str());
+    }
+  }
+
+ private:
+  void Write(const void *data, size_t size) {
+    if (fwrite(data, 1, size, file_) != size) {
+      diag_err(1, "%s:%d: %s", __FILE__, __LINE__, path_.c_str());
+    }
+    offset_ += size;
+  }
+
+  const std::string path_;
+  FILE *file_;
+  uint64_t offset_;
+  uint16_t entries_ = 0;
+  Deflater deflater_;
+  std::vector<uint8_t> deflated_;
+  std::vector<uint8_t> cdr_;
+};
+
+struct Corpus {
+  std::vector<std::string> jars;
+  uint64_t input_bytes = 0;
+  uint64_t entries = 0;
+};
+
+Corpus GenerateCorpus(const CorpusSpec &spec, int scale,
+                      const std::string &dir) {
+  Corpus corpus;
+  Random random(0x5eed);
+  std::string data;
+  mkdir(dir.c_str(), 0755);
+  const int jars = spec.jars * scale;
+  for (int jar = 0; jar < jars; ++jar) {
+    std::string path = dir + "/in" + std::to_string(jar) + ".jar";
+    JarWriter writer(path);
+    for (int entry = 0; entry < spec.entries_per_jar; ++entry) {
+      int n = jar * spec.entries_per_jar + entry;
+      std::string name = "com/example/p" +
+                         std::to_string(spec.duplicate_names ? 0 : jar) +
+                         "/C" + std::to_string(entry) + ".class";
+      bool random_bytes = spec.random_every && n % spec.random_every == 0;
+      FillPayload(random_bytes ? Payload::kRandom : Payload::kText, &random,
+                  &data, spec.entry_size);
+      bool stored = spec.stored_every && n % spec.stored_every == 0;
+      writer.AddEntry(name, data, !stored);
+      corpus.input_bytes += data.size();
+    }
+    // One service file per jar, so that the Concatenator has some work.
+    writer.AddEntry("META-INF/services/com.example.Service",
+                    "com.example.p" + std::to_string(jar) + ".Impl\n", true);
+    writer.Close();
+    corpus.entries += spec.entries_per_jar + 1;
+    corpus.jars.push_back(path);
+  }
+  return corpus;
+}
+
+struct Sample {
+  double seconds = 0;
+  double user_seconds = 0;
+  double system_seconds = 0;
+  long max_rss_kb = 0;
+  int64_t read_calls = -1;
+  int64_t write_calls = -1;
+  int64_t output_bytes = 0;
+};
+
+// Returns the read and write call counts of this process, or -1 where
+// they are not available.
+void ReadIoCounters(int64_t *read_calls, int64_t *write_calls) {
+  *read_calls = *write_calls = -1;
+  FILE *io = fopen("/proc/self/io", "r");
+  if (io == nullptr) {
+    return;
+  }
+  char line[128];
+  while (fgets(line, sizeof(line), io)) {
+    long long value;
+    if (sscanf(line, "syscr: %lld", &value) == 1) {
+      *read_calls = value;
+    } else if (sscanf(line, "syscw: %lld", &value) == 1) {
+      *write_calls = value;
+    }
+  }
+  fclose(io);
+}
+
+// Runs singlejar in a child process, which reports its read and write call
+// counts through a pipe.
+Sample RunOnce(const Corpus &corpus, const ConfigSpec &config,
+               const std::string &output) {
+  std::vector<std::string> args = {"--output", output, "--sources"};
+  args.insert(args.end(), corpus.jars.begin(), corpus.jars.end());
+  args.insert(args.end(), config.args.begin(), config.args.end());
+  std::vector<const char *> argv;
+  for (auto &arg : args) {
+    argv.push_back(arg.c_str());
+  }
+
+  int fds[2];
+  if (pipe(fds)) {
+    diag_err(1, "%s:%d: pipe", __FILE__, __LINE__);
+  }
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    diag_err(1, "%s:%d: fork", __FILE__, __LINE__);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    int64_t counters[4];
+    ReadIoCounters(&counters[0], &counters[1]);
+    Options options;
+    options.ParseCommandLine(argv.size(), argv.data());
+    OutputJar output_jar;
+    output_jar.ExtraCombiner("reference.conf",
+                             new Concatenator("reference.conf"));
+    int rc = output_jar.Doit(&options);
+    ReadIoCounters(&counters[2], &counters[3]);
+    if (write(fds[1], counters, sizeof(counters)) != sizeof(counters)) {
+      rc = 1;
+    }
+    _exit(rc);
+  }
+  close(fds[1]);
+  int64_t counters[4] = {-1, -1, -1, -1};
+  if (read(fds[0], counters, sizeof(counters)) != sizeof(counters)) {
+    counters[0] = counters[1] = counters[2] = counters[3] = -1;
+  }
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid) {
+    diag_err(1, "%s:%d: wait4", __FILE__, __LINE__);
+  }
+  auto end = std::chrono::steady_clock::now();
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    diag_errx(1, "%s:%d: singlejar failed on %s", __FILE__, __LINE__,
+              config.name);
+  }
+
+  Sample sample;
+  sample.seconds = std::chrono::duration<double>(end - start).count();
+  sample.user_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+  sample.system_seconds =
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+  sample.max_rss_kb = usage.ru_maxrss / 1024;  // Bytes there.
+#else
+  sample.max_rss_kb = usage.ru_maxrss;
+#endif
+  if (counters[0] >= 0 && counters[2] >= 0) {
+    sample.read_calls = counters[2] - counters[0];
+    sample.write_calls = counters[3] - counters[1];
+  }
+  struct stat st;
+  if (stat(output.c_str(), &st) == 0) {
+    sample.output_bytes = st.st_size;
+  }
+  return sample;
+}
+
+// Returns the sample with the median wall time.
+Sample Median(std::vector<Sample> samples) {
+  std::sort(samples.begin(), samples.end(),
+            [](const Sample &a, const Sample &b) {
+              return a.seconds < b.seconds;
+            });
+  return samples[samples.size() / 2];
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage: singlejar_benchmark [--corpus NAME] [--config NAME] "
+          "[--scale N] [--iterations N] [--work_dir DIR]\nCorpora:");
+  for (auto &corpus : kCorpora) {
+    fprintf(stderr, " %s", corpus.name);
+  }
+  fprintf(stderr, "\nConfigurations:");
+  for (auto &config : kConfigs) {
+    fprintf(stderr, " %s", config.name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::string corpus_filter;
+  std::string config_filter;
+  int scale = 1;
+  int iterations = 3;
+  const char *tmpdir = getenv("TEST_TMPDIR");
+  std::string work_dir = tmpdir ? tmpdir : "/tmp";
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    std::string flag = argv[i];
+    const char *value = argv[++i];
+    if (flag == "--corpus") {
+      corpus_filter = value;
+    } else if (flag == "--config") {
+      config_filter = value;
+    } else if (flag == "--scale") {
+      scale = atoi(value);
+    } else if (flag == "--iterations") {
+      iterations = atoi(value);
+    } else if (flag == "--work_dir") {
+      work_dir = value;
+    } else {
+      Usage();
+    }
+  }
+  if (scale < 1 || iterations < 1) {
+    Usage();
+  }
+
+  printf("%-12s %-24s %8s %9s %9s %8s %8s %7s %8s %9s %9s\n", "corpus",
+         "config", "entries", "in_MB", "out_MB", "wall_s", "cpu_s", "MB/s",
+         "rss_MB", "reads", "writes");
+  bool matched = false;
+  for (auto &corpus_spec : kCorpora) {
+    if (!corpus_filter.empty() && corpus_filter != corpus_spec.name) {
+      continue;
+    }
+    std::string dir = work_dir + "/singlejar_benchmark_" + corpus_spec.name;
+    Corpus corpus = GenerateCorpus(corpus_spec, scale, dir);
+    for (auto &config : kConfigs) {
+      if (!config_filter.empty() && config_filter != config.name) {
+        continue;
+      }
+      matched = true;
+      std::vector<Sample> samples;
+      for (int i = 0; i < iterations; ++i) {
+        samples.push_back(RunOnce(corpus, config, dir + "/out.jar"));
+      }
+      Sample median = Median(samples);
+      const double mb = 1024.0 * 1024.0;
+      printf("%-12s %-24s %8llu %9.1f %9.1f %8.3f %8.3f %7.1f %8.1f %9lld "
+             "%9lld\n",
+             corpus_spec.name, config.name,
+             static_cast<unsigned long long>(corpus.entries),
+             corpus.input_bytes / mb, median.output_bytes / mb, median.seconds,
+             median.user_seconds + median.system_seconds,
+             corpus.input_bytes / mb / median.seconds,
+             median.max_rss_kb / 1024.0,
+             static_cast<long long>(median.read_calls),
+             static_cast<long long>(median.write_calls));
+      fflush(stdout);
+    }
+    unlink((dir + "/out.jar").c_str());
+    for (auto &jar : corpus.jars) {
+      unlink(jar.c_str());
+    }
+    rmdir(dir.c_str());
+  }
+  if (!matched) {
+    Usage();
+  }
+  return 0;
+}
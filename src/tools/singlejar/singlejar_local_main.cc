@@ -22,6 +22,10 @@
 int main(int argc, char *argv[]) {
   Options options;
   options.ParseCommandLine(argc - 1, argv + 1);
+  if (options.check_one_version) {
+    diag_errx(1, "%s:%d: One version checking is not supported here.",
+              __FILE__, __LINE__);
+  }
   OutputJar output_jar;
   // Process or drop Java 8 desugaring metadata, see b/65645388.  We don't want
   // or need these files afterwards so make sure we drop them either way.
@@ -31,7 +35,7 @@ int main(int argc, char *argv[]) {
                 [&output_jar](const std::string &filename) {
                   return !output_jar.NewEntry(filename);
                 },
-                options.verbose)
+                options.verbose, /*background=*/options.threads > 1)
           : static_cast<Combiner *>(new NullCombiner());
   output_jar.ExtraCombiner("META-INF/desugar_deps", desugar_checker);
   output_jar.ExtraCombiner(
@@ -12,29 +12,227 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+// Must be included before <io.h> (on Windows) and <fcntl.h>.
+#include "src/tools/singlejar/port.h"
+// Need newline so clang-format won't alpha-sort with other headers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "src/main/protobuf/worker_protocol.pb.h"
+#include "src/tools/one_version/allowlist.h"
+#include "src/tools/one_version/one_version_output_jar.h"
 #include "src/tools/singlejar/combiners.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/input_jar_scanner.h"
 #include "src/tools/singlejar/log4j2_plugin_dat_combiner.h"
 #include "src/tools/singlejar/options.h"
 #include "src/tools/singlejar/output_jar.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/util/delimited_message_util.h"
 
-int main(int argc, char *argv[]) {
-  Options options;
-  options.ParseCommandLine(argc - 1, argv + 1);
-  OutputJar output_jar;
+// The number of scanned input jars the persistent worker keeps between the
+// requests. Each of them holds an open file descriptor.
+static constexpr size_t kScannedJarCacheCapacity = 512;
+
+// Builds the output jar. With a cache, the input jars are taken from it
+// when their digests match.
+static int RunSingleJar(
+    Options *options, ScannedJarCache *cache,
+    std::unordered_map<std::string, std::string> input_digests) {
+  std::unique_ptr<OutputJar> output_jar;
+  one_version::OneVersionOutputJar *one_version_jar = nullptr;
+  if (options->check_one_version) {
+    std::unique_ptr<one_version::Allowlist> allowlist;
+    if (options->one_version_allowlist.empty()) {
+      allowlist = std::make_unique<one_version::MapAllowlist>(
+          absl::flat_hash_map<std::string,
+                              absl::flat_hash_set<std::string>>());
+    } else {
+      std::string error;
+      allowlist = one_version::MapAllowlist::FromFile(
+          options->one_version_allowlist, &error);
+      if (!allowlist) {
+        diag_errx(1, "%s:%d: %s", __FILE__, __LINE__, error.c_str());
+      }
+    }
+    one_version_jar =
+        new one_version::OneVersionOutputJar(std::move(allowlist));
+    output_jar.reset(one_version_jar);
+  } else {
+    output_jar = std::make_unique<OutputJar>();
+  }
   // TODO(b/67733424): support desugar deps checking in Bazel
-  if (options.check_desugar_deps) {
+  if (options->check_desugar_deps) {
     diag_errx(1, "%s:%d: Desugar checking not currently supported in Bazel.",
                  __FILE__, __LINE__);
   } else {
-    output_jar.ExtraCombiner("META-INF/desugar_deps", new NullCombiner());
+    output_jar->ExtraCombiner("META-INF/desugar_deps", new NullCombiner());
   }
-  output_jar.ExtraCombiner(
+  output_jar->ExtraCombiner(
       "META-INF/org/apache/logging/log4j/core/config/plugins/Log4j2Plugins.dat",
       new Log4J2PluginDatCombiner("META-INF/org/apache/logging/log4j/core/"
                                   "config/plugins/Log4j2Plugins.dat",
-                                  options.no_duplicates));
-  output_jar.ExtraCombiner("reference.conf",
-                           new Concatenator("reference.conf"));
-  return output_jar.Doit(&options);
+                                  options->no_duplicates));
+  output_jar->ExtraCombiner("reference.conf",
+                            new Concatenator("reference.conf"));
+  if (cache) {
+    output_jar->UseScannedJarCache(cache, std::move(input_digests));
+  }
+  int result = output_jar->Doit(options);
+  if (result == 0 && one_version_jar &&
+      !one_version_jar->ReportViolations(&std::cerr)) {
+    result = 1;
+  }
+  return result;
+}
+
+// Builds the output jar and those of the --next_output options. The outputs
+// are built concurrently, sharing the scanned input jars: each input jar
+// they have in common is opened and scanned once. Without a cache, that of
+// the persistent worker, a cache lasting for the invocation is used, in which
+// the input jars are expected not to change.
+static int RunSingleJars(
+    Options *options, ScannedJarCache *cache,
+    std::unordered_map<std::string, std::string> input_digests) {
+  if (options->next_outputs.empty()) {
+    return RunSingleJar(options, cache, std::move(input_digests));
+  }
+  std::vector<Options *> outputs = {options};
+  for (auto &next_output : options->next_outputs) {
+    outputs.push_back(next_output.get());
+  }
+  std::unique_ptr<ScannedJarCache> invocation_cache;
+  if (!cache) {
+    invocation_cache.reset(new ScannedJarCache(kScannedJarCacheCapacity));
+    cache = invocation_cache.get();
+    for (Options *output : outputs) {
+      for (auto &input_jar : output->input_jars) {
+        input_digests[input_jar.first] = "unchanged";
+      }
+    }
+  }
+  std::vector<int> results(outputs.size());
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    threads.emplace_back([&outputs, &results, cache, &input_digests, i] {
+      results[i] = RunSingleJar(outputs[i], cache, input_digests);
+    });
+  }
+  int result = 0;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    threads[i].join();
+    if (results[i] != 0) {
+      result = results[i];
+    }
+  }
+  return result;
+}
+
+// While the persistent worker handles a request, stderr is redirected to
+// this file. Errors make singlejar exit right away, so the file is copied
+// to the original stderr on exit, for the worker log.
+static FILE *captured_stderr = nullptr;
+static int original_stderr = -1;
+
+static void CopyCapturedStderr(std::string *output) {
+  fflush(stderr);
+  rewind(captured_stderr);
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), captured_stderr)) > 0) {
+    output->append(buffer, n);
+  }
+}
+
+static void ReleaseStderrAtExit() {
+  if (captured_stderr) {
+    std::string output;
+    CopyCapturedStderr(&output);
+    dup2(original_stderr, fileno(stderr));
+    fwrite(output.data(), 1, output.size(), stderr);
+  }
+}
+
+// Serves the persistent worker requests (see
+// src/main/protobuf/worker_protocol.proto) read from the standard input
+// until it is closed. The input jars scanned by a request stay open and are
+// reused by the following requests as long as their digests do not change.
+// The diagnostics written to stderr while a request is being handled are
+// returned as the output of its response.
+static int RunPersistentWorker() {
+#ifdef _WIN32
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  ScannedJarCache cache(kScannedJarCacheCapacity);
+  google::protobuf::io::FileInputStream input(fileno(stdin));
+  google::protobuf::io::FileOutputStream output(fileno(stdout));
+  original_stderr = dup(fileno(stderr));
+  atexit(ReleaseStderrAtExit);
+  for (;;) {
+    blaze::worker::WorkRequest request;
+    bool clean_eof = false;
+    if (!google::protobuf::util::ParseDelimitedFromZeroCopyStream(
+            &request, &input, &clean_eof)) {
+      return clean_eof ? 0 : 1;
+    }
+    std::vector<const char *> args;
+    for (const std::string &arg : request.arguments()) {
+      args.push_back(arg.c_str());
+    }
+    std::unordered_map<std::string, std::string> input_digests;
+    for (const blaze::worker::Input &input_file : request.inputs()) {
+      input_digests[input_file.path()] = input_file.digest();
+    }
+
+    fflush(stderr);
+    captured_stderr = tmpfile();
+    if (captured_stderr) {
+      dup2(fileno(captured_stderr), fileno(stderr));
+    }
+    Options options;
+    options.ParseCommandLine(args.size(), args.data());
+    int exit_code = RunSingleJars(&options, &cache, std::move(input_digests));
+    std::cerr.flush();
+
+    blaze::worker::WorkResponse response;
+    response.set_exit_code(exit_code);
+    response.set_request_id(request.request_id());
+    if (captured_stderr) {
+      CopyCapturedStderr(response.mutable_output());
+      dup2(original_stderr, fileno(stderr));
+      fclose(captured_stderr);
+      captured_stderr = nullptr;
+    }
+    if (!google::protobuf::util::SerializeDelimitedToZeroCopyStream(
+            response, &output) ||
+        !output.Flush()) {
+      return 1;
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--persistent_worker") {
+      return RunPersistentWorker();
+    }
+  }
+  Options options;
+  options.ParseCommandLine(argc - 1, argv + 1);
+  return RunSingleJars(&options, nullptr, {});
 }
@@ -15,6 +15,8 @@
 #ifndef THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_TOKEN_STREAM_H_
 #define THIRD_PARTY_BAZEL_SRC_TOOLS_SINGLEJAR_TOKEN_STREAM_H_ 1
 
+#include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,8 +26,8 @@
 #include <utility>
 #include <vector>
 
-#include "src/main/cpp/util/path_platform.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/mapped_file.h"
 
 /*
  * Tokenize command line containing indirect command line arguments.
@@ -55,136 +57,161 @@ class ArgTokenStream {
    */
 
  private:
-  // Internal class to handle indirect command files.
+  // Internal class to handle indirect command files. The file is mapped
+  // and the tokens are cut out of it a run of characters at a time: the
+  // param files of the large binaries list thousands of jars and resources.
   class FileTokenStream {
    public:
     FileTokenStream(const char *filename) {
-#ifdef _WIN32
-      std::wstring wpath;
-      std::string error;
-      if (!blaze_util::AsAbsoluteWindowsPath(filename, &wpath, &error)) {
-        diag_err(1, "%s:%d: AsAbsoluteWindowsPath failed: %s", __FILE__,
-                 __LINE__, error.c_str());
-      }
-      fp_ = _wfopen(wpath.c_str(), L"r");
-#else
-      fp_ = fopen(filename, "r");
-#endif
-
-      if (!fp_) {
-        diag_err(1, "%s", filename);
+      if (!file_.Open(filename)) {
+        diag_errx(1, "%s:%d: Cannot read %s", __FILE__, __LINE__, filename);
       }
       filename_ = filename;
-      next_char();
+      pos_ = reinterpret_cast<const char *>(file_.start());
+      end_ = reinterpret_cast<const char *>(file_.end());
+      file_.Advise(0, file_.size(), MappedFile::kSequential);
+      normalize();
     }
 
     ~FileTokenStream() { close(); }
 
     // Assign next token to TOKEN, return true on success, false on EOF.
     bool next_token(std::string *token) {
-      if (!fp_) {
+      if (!pos_) {
         return false;
       }
-      *token = "";
-      while (current_char_ != EOF && isspace(current_char_)) {
-        next_char();
+      token->clear();
+      while (pos_ < end_ && is_space(*pos_)) {
+        ++pos_;
       }
-      if (current_char_ == EOF) {
+      if (pos_ == end_) {
         close();
         return false;
       }
       for (;;) {
-        if (current_char_ == '\'' || current_char_ == '"') {
-          process_quoted(token);
-          if (isspace(current_char_)) {
-            next_char();
-            return true;
-          } else {
-            next_char();
-          }
-        } else if (current_char_ == '\\') {
-          next_char();
-          if ((current_char_ != EOF)) {
-            token->push_back(current_char_);
-            next_char();
+        // Usually the whole token is a single run of ordinary characters.
+        const char *run = pos_;
+        while (pos_ < end_ && is_ordinary(*pos_)) {
+          ++pos_;
+        }
+        token->append(run, pos_ - run);
+        if (pos_ == end_) {
+          return true;
+        }
+        const char c = *pos_++;
+        if (c == '\'' || c == '"') {
+          process_quoted(c, token);
+        } else if (c == '\\') {
+          if (pos_ < end_) {
+            token->push_back(*pos_++);
           } else {
             diag_errx(1, "Expected character after \\, got EOF in %s",
                       filename_.c_str());
           }
-        } else if (current_char_ == EOF || isspace(current_char_)) {
-          next_char();
-          return true;
         } else {
-          token->push_back(current_char_);
-          next_char();
+          // Whitespace ends the token.
+          return true;
         }
       }
     }
 
    private:
     void close() {
-      if (fp_) {
-        fclose(fp_);
-        fp_ = nullptr;
-      }
+      file_.Close();
+      normalized_.clear();
+      pos_ = end_ = nullptr;
       filename_.clear();
     }
 
-    // Append the quoted string to the TOKEN. The quote character (which can be
-    // single or double quote) is in the current character. Everything up to the
-    // matching quote character is appended.
-    void process_quoted(std::string *token) {
-      char quote = current_char_;
-      next_char();
-      while (current_char_ != quote) {
-        if (current_char_ == '\\' && quote == '"') {
-          // In the "-quoted token, \" stands for ", and \x
-          // is copied literally for any other x.
-          next_char();
-          if (current_char_ == '"') {
-            token->push_back('"');
-            next_char();
-          } else if (current_char_ != EOF) {
-            token->push_back('\\');
-            token->push_back(current_char_);
-            next_char();
-          } else {
-            diag_errx(1, "No closing %c in %s", quote, filename_.c_str());
+    static bool is_space(char c) {
+      return isspace(static_cast<unsigned char>(c));
+    }
+
+    // True if the character stands for itself outside of the quotes.
+    static bool is_ordinary(char c) {
+      return !is_space(c) && c != '\'' && c != '"' && c != '\\';
+    }
+
+    // Append the quoted string to the TOKEN. The opening QUOTE character
+    // (which can be single or double quote) has been consumed. Everything up
+    // to the matching quote character is appended, and the latter is
+    // consumed.
+    void process_quoted(char quote, std::string *token) {
+      for (;;) {
+        const char *run = pos_;
+        if (quote == '"') {
+          while (pos_ < end_ && *pos_ != '"' && *pos_ != '\\') {
+            ++pos_;
           }
-        } else if (current_char_ != EOF) {
-          token->push_back(current_char_);
-          next_char();
         } else {
+          const void *found = memchr(pos_, quote, end_ - pos_);
+          pos_ = found ? static_cast<const char *>(found) : end_;
+        }
+        token->append(run, pos_ - run);
+        if (pos_ == end_) {
+          diag_errx(1, "No closing %c in %s", quote, filename_.c_str());
+        }
+        if (*pos_++ == quote) {
+          return;
+        }
+        // In the "-quoted token, \" stands for ", and \x
+        // is copied literally for any other x.
+        if (pos_ == end_) {
           diag_errx(1, "No closing %c in %s", quote, filename_.c_str());
         }
+        if (*pos_ != '"') {
+          token->push_back('\\');
+        }
+        token->push_back(*pos_++);
       }
     }
 
-    // Get the next character from the input stream. Skip backslash followed
-    // by the newline.
-    void next_char() {
-      if (feof(fp_)) {
-        current_char_ = EOF;
+    // Backslash followed by the newline is treated as empty string wherever
+    // it is, even in the middle of a quoted token. If there is any, the tokens
+    // are taken from a copy of the file without them. On Windows, the file
+    // used to be read in the text mode, so "\r\n" is taken for "\n" too.
+    void normalize() {
+#ifdef _WIN32
+      const bool crlf = true;
+#else
+      const bool crlf = false;
+#endif
+      bool found = false;
+      for (const char *p = pos_; !found && p < end_; ++p) {
+        p = static_cast<const char *>(memchr(p, '\n', end_ - p));
+        if (!p) {
+          break;
+        }
+        found = p > pos_ && (p[-1] == '\\' || (crlf && p[-1] == '\r'));
+      }
+      if (!found) {
         return;
       }
-      current_char_ = getc(fp_);
-      // Eat "\\\n" sequence.
-      while (current_char_ == '\\') {
-        int c = getc(fp_);
-        if (c == '\n') {
-          current_char_ = getc(fp_);
-        } else {
-          if (c != EOF) {
-            ungetc(c, fp_);
-          }
-          break;
+      normalized_.reserve(end_ - pos_);
+      // The characters before this position are not part of any sequence
+      // that is left to remove.
+      size_t kept = 0;
+      for (const char *p = pos_; p < end_; ++p) {
+        if (crlf && *p == '\r' && p + 1 < end_ && p[1] == '\n') {
+          continue;
+        }
+        normalized_.push_back(*p);
+        const size_t n = normalized_.size();
+        if (*p == '\n' && n >= kept + 2 && normalized_[n - 2] == '\\') {
+          normalized_.resize(n - 2);
+          kept = n - 2;
         }
       }
+      pos_ = normalized_.data();
+      end_ = pos_ + normalized_.size();
     }
 
-    FILE *fp_;
+    MappedFile file_;
+    std::string normalized_;
     std::string filename_;
-    int current_char_;
+    // The contents left to tokenize.
+    const char *pos_;
+    const char *end_;
   };
 
  public:
@@ -222,6 +249,29 @@ class ArgTokenStream {
     return true;
   }
 
+  // Process --OPTION NUMBER
+  // If the current token is --OPTION, parse the next token as a decimal
+  // integer into OPTARG, proceed to the next token after it and return true.
+  bool MatchAndSet(const char *option, int *optarg) {
+    if (token_.compare(option) != 0) {
+      return false;
+    }
+    next();
+    if (AtEnd()) {
+      diag_errx(1, "%s requires argument", option);
+    }
+    char *end;
+    long value = strtol(token_.c_str(), &end, 10);
+    if (token_.empty() || *end != '\0' || value < INT_MIN ||
+        value > INT_MAX) {
+      diag_errx(1, "%s requires an integer argument, got %s", option,
+                token_.c_str());
+    }
+    *optarg = static_cast<int>(value);
+    next();
+    return true;
+  }
+
   // Process --OPTION OPTARG1 OPTARG2 ...
   // If a current token is --OPTION, push_back all subsequent tokens up to the
   // next option to the OPTARGS array, proceed to the next option and return
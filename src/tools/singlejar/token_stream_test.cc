@@ -83,6 +83,49 @@ TEST(TokenStreamTest, CommandFile) {
   EXPECT_TRUE(token_stream.AtEnd());
 }
 
+// Backslash-newline is dropped inside the quotes, too, while the tokens
+// without anything to unquote are taken as they are.
+TEST(TokenStreamTest, CommandFileContinuedQuotes) {
+  std::string command_file_path =
+      singlejar_test_util::OutputFilePath("quoted_tokens");
+  FILE *fp = fopen(command_file_path.c_str(), "w");
+  ASSERT_NE(nullptr, fp);
+  fputs("plain/path.jar 'a b\\\nc' \"d\\\ne\\\\\\\nf\"\n\t\\\n g", fp);
+  fclose(fp);
+
+  std::string command_file_arg = std::string("@") + command_file_path;
+  const char *args[] = {command_file_arg.c_str()};
+  ArgTokenStream token_stream(ARRAY_SIZE(args), args);
+  EXPECT_EQ("plain/path.jar", token_stream.token());
+  token_stream.next();
+  EXPECT_EQ("a bc", token_stream.token());
+  token_stream.next();
+  EXPECT_EQ("de\\\\f", token_stream.token());
+  token_stream.next();
+  EXPECT_EQ("g", token_stream.token());
+  token_stream.next();
+  EXPECT_TRUE(token_stream.AtEnd());
+}
+
+// An empty command file contributes no tokens.
+TEST(TokenStreamTest, EmptyCommandFile) {
+  std::string command_file_path =
+      singlejar_test_util::OutputFilePath("no_tokens");
+  FILE *fp = fopen(command_file_path.c_str(), "w");
+  ASSERT_NE(nullptr, fp);
+  fclose(fp);
+
+  std::string command_file_arg = std::string("@") + command_file_path;
+  const char *args[] = {"-before_file", command_file_arg.c_str(),
+                        "-after_file"};
+  ArgTokenStream token_stream(ARRAY_SIZE(args), args);
+  EXPECT_EQ("-before_file", token_stream.token());
+  token_stream.next();
+  EXPECT_EQ("-after_file", token_stream.token());
+  token_stream.next();
+  EXPECT_TRUE(token_stream.AtEnd());
+}
+
 #ifdef _WIN32
 // '-foo @commandfile -bar' command line.
 TEST(TokenStreamTest, CommandFileLongPath) {
@@ -154,6 +197,19 @@ TEST(TokenStreamTest, OptargOne) {
   EXPECT_TRUE(token_stream.AtEnd());
 }
 
+// '--arg1 42 --arg2 -1' command line.
+TEST(TokenStreamTest, OptargInt) {
+  const char *args[] = {"--arg1", "42", "--arg2", "-1"};
+  ArgTokenStream token_stream(ARRAY_SIZE(args), args);
+  int optval = 0;
+  EXPECT_FALSE(token_stream.MatchAndSet("--foo", &optval));
+  ASSERT_TRUE(token_stream.MatchAndSet("--arg1", &optval));
+  EXPECT_EQ(42, optval);
+  ASSERT_TRUE(token_stream.MatchAndSet("--arg2", &optval));
+  EXPECT_EQ(-1, optval);
+  EXPECT_TRUE(token_stream.AtEnd());
+}
+
 // '--arg1 value1 value2 --arg2' command line.
 TEST(TokenStreamTest, OptargMulti) {
   const char *args[] = {"--arg1", "value11", "value12",
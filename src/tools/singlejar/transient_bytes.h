@@ -19,12 +19,23 @@
 #endif
 
 #include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <ostream>
+#include <string>
 
+#include "src/tools/singlejar/deflate_backend.h"
 #include "src/tools/singlejar/diag.h"
+#include "src/tools/singlejar/fast_crc32.h"
 #include "src/tools/singlejar/zip_headers.h"
 #include "src/tools/singlejar/zlib_interface.h"
+#include "src/tools/singlejar/zstd_interface.h"
 
 /*
  * An instance of this class holds decompressed data in a list of chunks,
@@ -34,6 +45,10 @@
  * Use Append() to append a sequence of bytes or a string.
  * Use Write() to write out the contents, it will compress the entry if
  * necessary.
+ * Past the limit set by set_memory_limit(), the full chunks are moved to a
+ * temporary file and read back one at a time when the contents are written
+ * out. Only stream_out() then keeps the memory bounded: CompressOut() and
+ * CopyOut() need an output buffer as large as the contents.
  */
 class TransientBytes {
  public:
@@ -41,17 +56,40 @@ class TransientBytes {
       : allocated_(0),
         data_size_(0),
         first_block_(nullptr),
-        last_block_(nullptr) {}
+        last_block_(nullptr),
+        last_spilled_block_(nullptr),
+        spill_file_(nullptr),
+        spill_size_(0) {}
 
   ~TransientBytes() {
     while (first_block_) {
       auto block = first_block_;
       first_block_ = first_block_->next_block_;
+      if (block->data_) {
+        memory_in_use_ -= kBlockSize;
+      }
       delete block;
     }
     last_block_ = nullptr;
+    if (spill_file_) {
+      fclose(spill_file_);
+    }
   }
 
+  TransientBytes(const TransientBytes &) = delete;
+  TransientBytes &operator=(const TransientBytes &) = delete;
+
+  // Sets the memory all the instances may hold together before they start
+  // spilling to temporary files. Zero, the default, means no limit. Set it
+  // before any instance is created.
+  static void set_memory_limit(uint64_t limit) { memory_limit_ = limit; }
+
+  // The number of bytes held in memory by all the instances.
+  static uint64_t memory_in_use() { return memory_in_use_; }
+
+  // The number of bytes all the instances have spilled so far.
+  static uint64_t spilled_bytes() { return spilled_bytes_; }
+
   // Appends raw bytes.
   void Append(const uint8_t *data, uint64_t data_size) {
     uint64_t chunk_size;
@@ -96,6 +134,22 @@ class TransientBytes {
       out_bytes = lh->uncompressed_file_size();
     }
 
+    // An entry fitting the space left in the last block is inflated in one
+    // go, which libdeflate does much faster than zlib streams it.
+    if (InflateBackend() == DeflateBackend::kLibdeflate &&
+        out_bytes <= ensure_space()) {
+      if (!InflateBuffer(DeflateBackend::kLibdeflate, data, in_bytes,
+                         append_position(), out_bytes)) {
+        diag_errx(2,
+                  "%s:%d: Internal error inflating %.*s: the data are corrupt "
+                  "or do not inflate to %" PRIu64 " bytes",
+                  __FILE__, __LINE__, lh->file_name_length(), lh->file_name(),
+                  out_bytes);
+      }
+      advance(out_bytes);
+      return;
+    }
+
     while (in_bytes > 0) {
       // A single region to inflate cannot exceed 4GB-1.
       uint32_t in_bytes_chunk = 0xFFFFFFFF;
@@ -156,12 +210,81 @@ class TransientBytes {
     inflater->reset();
   }
 
+  // Appends the contents of the Zstandard compressed Zip entry. Resets the
+  // decompressor used.
+  void DecompressZstdEntryContents(const CDH *cdh, const LH *lh,
+                                   ZstdDecompressor *decompressor) {
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    if (cdh->no_size_in_local_header()) {
+      in_bytes = cdh->compressed_file_size();
+      out_bytes = cdh->uncompressed_file_size();
+    } else {
+      in_bytes = lh->compressed_file_size();
+      out_bytes = lh->uncompressed_file_size();
+    }
+    const uint64_t old_data_size = data_size();
+    decompressor->DataToDecompress(lh->data(), in_bytes);
+    for (;;) {
+      uint64_t available_out = ensure_space();
+      size_t produced;
+      bool done =
+          decompressor->Decompress(append_position(), available_out, &produced);
+      advance(produced);
+      if (done) {
+        break;
+      }
+      if (produced < available_out && !decompressor->available_in()) {
+        diag_errx(2, "%s:%d: %.*s is truncated", __FILE__, __LINE__,
+                  lh->file_name_length(), lh->file_name());
+      }
+    }
+    if (data_size() - old_data_size != out_bytes) {
+      diag_errx(2,
+                "%s:%d: Internal error decompressing %.*s: got %" PRIu64
+                " bytes, but the uncompressed entry should be %" PRIu64
+                " bytes long",
+                __FILE__, __LINE__, lh->file_name_length(), lh->file_name(),
+                data_size() - old_data_size, out_bytes);
+    }
+    decompressor->reset();
+  }
+
+  // Appends the given data compressed by the given deflater. Pass Z_FINISH
+  // as `flush' with the last chunk of data to complete the compressed stream.
+  void AppendDeflated(const uint8_t *data, uint32_t data_size, int flush,
+                      Deflater *deflater) {
+    deflater->next_in = const_cast<uint8_t *>(data);
+    deflater->avail_in = data_size;
+    for (;;) {
+      uint32_t available_out = static_cast<uint32_t>(
+          std::min(ensure_space(), static_cast<uint64_t>(0xFFFFFFFF)));
+      deflater->next_out = append_position();
+      deflater->avail_out = available_out;
+      int ret = deflate(deflater, flush);
+      advance(available_out - deflater->avail_out);
+      if (ret == Z_STREAM_END) {
+        return;
+      }
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        diag_errx(2, "%s:%d: deflate error %d(%s)", __FILE__, __LINE__, ret,
+                  deflater->msg);
+      }
+      // Unless finishing, we are done once the deflater has consumed all the
+      // input without running out of the output space.
+      if (flush == Z_NO_FLUSH && !deflater->avail_in && deflater->avail_out) {
+        return;
+      }
+    }
+  }
+
   // Writes the contents bytes to the given buffer in an optimal way, i.e., the
-  // shorter of compressed or uncompressed. Sets the checksum and number of
-  // bytes written and returns Z_DEFLATED if compression took place or
-  // Z_NO_COMPRESSION otherwise.
+  // shorter of compressed or uncompressed, deflating them with backend. Sets
+  // the checksum and number of bytes written and returns Z_DEFLATED if
+  // compression took place or Z_NO_COMPRESSION otherwise.
   uint16_t CompressOut(uint8_t *buffer, uint32_t *checksum,
-                       uint64_t *bytes_written) {
+                       uint64_t *bytes_written,
+                       DeflateBackend backend = DeflateBackend::kZlib) {
     *checksum = 0;
     uint64_t to_compress = data_size();
     if (to_compress == 0) {
@@ -169,6 +292,10 @@ class TransientBytes {
       return Z_NO_COMPRESSION;
     }
 
+    if (backend != DeflateBackend::kZlib && !spill_file_) {
+      return CompressOutWhole(buffer, checksum, bytes_written, backend);
+    }
+
     Deflater deflater;
     deflater.next_out = buffer;
     uint16_t compression_method = Z_DEFLATED;
@@ -184,12 +311,13 @@ class TransientBytes {
                                     static_cast<uint64_t>(0xFFFFFFFF));
       // Out of the total number of bytes that remain to be compressed, we
       // can compress no more than this block.
-      uint32_t chunk_size = static_cast<uint32_t>(std::min(
-          static_cast<uint64_t>(sizeof(data_block->data_)), to_compress));
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
+      uint32_t chunk_size = static_cast<uint32_t>(
+          std::min(static_cast<uint64_t>(kBlockSize), to_compress));
+      const uint8_t *data = block_data(data_block);
+      *checksum = FastCrc32(*checksum, data, chunk_size);
       deflater.avail_in = chunk_size;
       to_compress -= chunk_size;
-      int ret = deflater.Deflate(data_block->data_, chunk_size,
+      int ret = deflater.Deflate(data, chunk_size,
                                  to_compress ? Z_NO_FLUSH : Z_FINISH);
       if (ret == Z_OK) {
         if (!deflater.avail_out) {
@@ -223,6 +351,72 @@ class TransientBytes {
     return Z_NO_COMPRESSION;
   }
 
+  // Same as CompressOut(), but deflates all the bytes in one go with
+  // backend. They are gathered into a contiguous buffer first unless they fit
+  // a single block.
+  uint16_t CompressOutWhole(uint8_t *buffer, uint32_t *checksum,
+                            uint64_t *bytes_written, DeflateBackend backend) {
+    const uint64_t size = data_size();
+    std::unique_ptr<uint8_t[]> gathered;
+    const uint8_t *data;
+    if (first_block_ == last_block_) {
+      data = block_data(first_block_);
+      *checksum = FastCrc32(0, data, size);
+    } else {
+      gathered.reset(new uint8_t[size]);
+      CopyOut(gathered.get(), checksum);
+      data = gathered.get();
+    }
+    *bytes_written = DeflateBuffer(backend, data, size, buffer, size);
+    if (*bytes_written) {
+      return Z_DEFLATED;
+    }
+    // Compression does not help, just copy the bytes to the output buffer.
+    memcpy(buffer, data, size);
+    *bytes_written = size;
+    return Z_NO_COMPRESSION;
+  }
+
+  // Same as CompressOut(), but compresses with Zstandard and returns
+  // kZstdMethod if that took place.
+  uint16_t ZstdCompressOut(uint8_t *buffer, uint32_t *checksum,
+                           uint64_t *bytes_written) {
+    *checksum = 0;
+    uint64_t to_compress = data_size();
+    if (to_compress == 0) {
+      *bytes_written = 0;
+      return Z_NO_COMPRESSION;
+    }
+
+    ZstdCompressor compressor;
+    uint8_t *out = buffer;
+    uint64_t out_left = data_size();
+    for (auto data_block = first_block_; data_block && to_compress;
+         data_block = data_block->next_block_) {
+      size_t chunk_size = static_cast<size_t>(
+          std::min(static_cast<uint64_t>(kBlockSize), to_compress));
+      const uint8_t *data = block_data(data_block);
+      *checksum = FastCrc32(*checksum, data, chunk_size);
+      to_compress -= chunk_size;
+      compressor.DataToCompress(data, chunk_size, !to_compress);
+      size_t produced;
+      bool done;
+      do {
+        done = compressor.Compress(out, out_left, &produced);
+        out += produced;
+        out_left -= produced;
+      } while (!done && out_left);
+      if (!done) {
+        // The compressed data would not be smaller, just copy the bytes.
+        CopyOut(buffer, checksum);
+        *bytes_written = data_size();
+        return Z_NO_COMPRESSION;
+      }
+    }
+    *bytes_written = compressor.total_out();
+    return kZstdMethod;
+  }
+
   // Copies the bytes to the buffer and sets the checksum.
   void CopyOut(uint8_t *buffer, uint32_t *checksum) {
     uint64_t to_copy = data_size();
@@ -231,9 +425,10 @@ class TransientBytes {
     for (auto data_block = first_block_; data_block;
          data_block = data_block->next_block_) {
       size_t chunk_size =
-          std::min(static_cast<uint64_t>(sizeof(data_block->data_)), to_copy);
-      *checksum = crc32(*checksum, data_block->data_, chunk_size);
-      memcpy(buffer_end - to_copy, data_block->data_, chunk_size);
+          std::min(static_cast<uint64_t>(kBlockSize), to_copy);
+      const uint8_t *data = block_data(data_block);
+      *checksum = FastCrc32(*checksum, data, chunk_size);
+      memcpy(buffer_end - to_copy, data, chunk_size);
       to_copy -= chunk_size;
     }
   }
@@ -241,6 +436,9 @@ class TransientBytes {
   // Number of data bytes.
   uint64_t data_size() const { return data_size_; }
 
+  // True if some of the bytes have been moved to the spill file.
+  bool spilled() const { return spill_file_ != nullptr; }
+
   // This is mostly for testing: stream out contents to a Sink instance.
   // The class Sink has to have
   //     void operator()(const void *chunk, uint64_t chunk_size) const;
@@ -250,11 +448,11 @@ class TransientBytes {
     uint64_t to_copy = data_size();
     for (auto data_block = first_block_; data_block;
          data_block = data_block->next_block_) {
-      uint64_t chunk_size = sizeof(data_block->data_);
+      uint64_t chunk_size = kBlockSize;
       if (chunk_size > to_copy) {
         chunk_size = to_copy;
       }
-      sink.operator()(data_block->data_, chunk_size);
+      sink.operator()(block_data(data_block), chunk_size);
       to_copy -= chunk_size;
     }
   }
@@ -264,7 +462,7 @@ class TransientBytes {
       diag_errx(1, "%s:%d: last_char() cannot be called if buffer is empty",
                 __FILE__, __LINE__);
     }
-    if (free_size() >= sizeof(last_block_->data_)) {
+    if (free_size() >= kBlockSize) {
       diag_errx(1, "%s:%d: internal error: the last data block is empty",
                 __FILE__, __LINE__);
     }
@@ -272,9 +470,27 @@ class TransientBytes {
   }
 
  private:
+  static constexpr size_t kBlockSize = 0x40000;
+
+  // The bytes are kept in an linked list of the DataBlock instances.
+  struct DataBlock {
+    struct DataBlock *next_block_;
+    // The bytes, or nullptr once they have been spilled to spill_offset_.
+    uint8_t *data_;
+    uint64_t spill_offset_;
+    DataBlock()
+        : next_block_(nullptr), data_(new uint8_t[kBlockSize]),
+          spill_offset_(0) {}
+    ~DataBlock() { delete[] data_; }
+    uint8_t *End() { return data_ + kBlockSize; }
+  };
+
   // Ensures there is some space to write to, returns the amount available.
   uint64_t ensure_space() {
     if (!free_size()) {
+      if (memory_limit_ && memory_in_use_ + kBlockSize > memory_limit_) {
+        Spill();
+      }
       auto *data_block = new DataBlock();
       if (last_block_) {
         last_block_->next_block_ = data_block;
@@ -283,11 +499,87 @@ class TransientBytes {
       if (!first_block_) {
         first_block_ = data_block;
       }
-      allocated_ += sizeof(data_block->data_);
+      allocated_ += kBlockSize;
+      memory_in_use_ += kBlockSize;
     }
     return free_size();
   }
 
+  // Moves the blocks still in memory to the spill file. Called when the
+  // last block is full, so all of them are.
+  void Spill() {
+    auto block = last_spilled_block_ ? last_spilled_block_->next_block_
+                                     : first_block_;
+    if (!block) {
+      return;
+    }
+    if (!spill_file_) {
+      OpenSpillFile();
+    }
+    for (; block; block = block->next_block_) {
+      SeekSpillFile(spill_size_);
+      if (fwrite(block->data_, 1, kBlockSize, spill_file_) != kBlockSize) {
+        diag_err(1, "%s:%d: cannot write to the spill file", __FILE__,
+                 __LINE__);
+      }
+      block->spill_offset_ = spill_size_;
+      spill_size_ += kBlockSize;
+      delete[] block->data_;
+      block->data_ = nullptr;
+      memory_in_use_ -= kBlockSize;
+      spilled_bytes_ += kBlockSize;
+      last_spilled_block_ = block;
+    }
+  }
+
+  // Creates an anonymous temporary file in $TMPDIR.
+  void OpenSpillFile() {
+#ifdef _WIN32
+    spill_file_ = tmpfile();
+#else
+    const char *tmpdir = getenv("TMPDIR");
+    std::string path = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") +
+                       "/singlejar_spill_XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd >= 0) {
+      unlink(path.c_str());
+      spill_file_ = fdopen(fd, "w+b");
+    }
+#endif
+    if (!spill_file_) {
+      diag_err(1, "%s:%d: cannot create a spill file", __FILE__, __LINE__);
+    }
+  }
+
+  void SeekSpillFile(uint64_t offset) const {
+#ifdef _WIN32
+    int rc = _fseeki64(spill_file_, offset, SEEK_SET);
+#else
+    int rc = fseeko(spill_file_, offset, SEEK_SET);
+#endif
+    if (rc) {
+      diag_err(1, "%s:%d: cannot seek the spill file", __FILE__, __LINE__);
+    }
+  }
+
+  // Returns the bytes of the block. The bytes of a spilled block are read
+  // back into a buffer shared by all the blocks, which is only valid until
+  // the next call.
+  const uint8_t *block_data(const DataBlock *block) const {
+    if (block->data_) {
+      return block->data_;
+    }
+    if (!read_back_buffer_) {
+      read_back_buffer_.reset(new uint8_t[kBlockSize]);
+    }
+    SeekSpillFile(block->spill_offset_);
+    if (fread(read_back_buffer_.get(), 1, kBlockSize, spill_file_) !=
+        kBlockSize) {
+      diag_err(1, "%s:%d: cannot read the spill file", __FILE__, __LINE__);
+    }
+    return read_back_buffer_.get();
+  }
+
   // Records that given amount of bytes is to be appended to the buffer.
   // Returns the old write position.
   uint8_t *advance(size_t amount) {
@@ -312,19 +604,19 @@ class TransientBytes {
   // Returns the amount of free space.
   uint64_t free_size() const { return allocated_ - data_size_; }
 
-  // The bytes are kept in an linked list of the DataBlock instances.
-  // TODO(asmundak): perhaps use mmap to allocate these?
-  struct DataBlock {
-    struct DataBlock *next_block_;
-    uint8_t data_[0x40000 - 8];
-    DataBlock() : next_block_(nullptr) {}
-    uint8_t *End() { return data_ + sizeof(data_); }
-  };
+  static inline uint64_t memory_limit_ = 0;
+  static inline std::atomic<uint64_t> memory_in_use_{0};
+  static inline std::atomic<uint64_t> spilled_bytes_{0};
 
   uint64_t allocated_;
   uint64_t data_size_;
   struct DataBlock *first_block_;
   struct DataBlock *last_block_;
+  // The blocks up to this one have been spilled.
+  struct DataBlock *last_spilled_block_;
+  FILE *spill_file_;
+  uint64_t spill_size_;
+  mutable std::unique_ptr<uint8_t[]> read_back_buffer_;
 };
 
 #endif  // SRC_TOOLS_SINGLEJAR_TRANSIENT_BYTES_H_
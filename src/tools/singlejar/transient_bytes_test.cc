@@ -342,4 +342,45 @@ TEST_F(TransientBytesTest, CopyOut) {
   ASSERT_EQ(0xE8B7BE43, crc32);
 }
 
+// Past the memory limit, the contents move to a spill file and are read back
+// intact by CopyOut() and CompressOut().
+TEST_F(TransientBytesTest, Spill) {
+  const uint64_t kSize = 16 << 20;
+  TransientBytes::set_memory_limit(1 << 20);
+  uint64_t spilled_before = TransientBytes::spilled_bytes();
+  std::unique_ptr<uint8_t[]> chunk(new uint8_t[4096]);
+  uint64_t max_memory_in_use = 0;
+  for (uint64_t offset = 0; offset < kSize; offset += 4096) {
+    for (uint64_t i = 0; i < 4096; ++i) {
+      chunk[i] = file_byte_at((offset + i) * 7);
+    }
+    transient_bytes_->Append(chunk.get(), 4096);
+    max_memory_in_use =
+        std::max(max_memory_in_use, TransientBytes::memory_in_use());
+  }
+  TransientBytes::set_memory_limit(0);
+  EXPECT_LE(max_memory_in_use, 1UL << 20);
+  EXPECT_LT(spilled_before + kSize / 2, TransientBytes::spilled_bytes());
+
+  std::unique_ptr<uint8_t[]> copied(new uint8_t[kSize]);
+  uint32_t copied_crc32;
+  transient_bytes_->CopyOut(copied.get(), &copied_crc32);
+  for (uint64_t i = 0; i < kSize; ++i) {
+    ASSERT_EQ(file_byte_at(i * 7), copied[i]) << "at " << i;
+  }
+
+  std::unique_ptr<uint8_t[]> compressed(new uint8_t[kSize]);
+  uint32_t compressed_crc32;
+  uint64_t bytes_written;
+  ASSERT_EQ(Z_DEFLATED, transient_bytes_->CompressOut(
+                            compressed.get(), &compressed_crc32,
+                            &bytes_written));
+  EXPECT_EQ(copied_crc32, compressed_crc32);
+  Inflater inflater;
+  inflater.DataToInflate(compressed.get(), bytes_written);
+  std::unique_ptr<uint8_t[]> inflated(new uint8_t[kSize]);
+  ASSERT_EQ(Z_STREAM_END, inflater.Inflate(inflated.get(), kSize));
+  EXPECT_EQ(0, memcmp(copied.get(), inflated.get(), kSize));
+}
+
 }  // namespace
@@ -0,0 +1,95 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_WORKER_POOL_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_WORKER_POOL_H_ 1
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed set of threads running the submitted jobs in FIFO order.
+ *   WorkerPool pool(4);
+ *   std::future<int> result = pool.Submit<int>([] { return 42; });
+ *   ...
+ *   int value = result.get();
+ * The destructor waits for all the submitted jobs to finish.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(int nthreads) : shutdown_(false) {
+    for (int i = 0; i < nthreads; ++i) {
+      workers_.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    queued_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  template <typename Result>
+  std::future<Result> Submit(std::function<Result()> job) {
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+    std::future<Result> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.emplace_back([task] { (*task)(); });
+    }
+    queued_.notify_one();
+    return result;
+  }
+
+  size_t size() const { return workers_.size(); }
+
+ private:
+  void WorkerLoop() {
+    for (;;) {
+      std::function<void()> job;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queued_.wait(lock, [this] { return shutdown_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+          return;
+        }
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+      job();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> jobs_;
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  bool shutdown_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_WORKER_POOL_H_
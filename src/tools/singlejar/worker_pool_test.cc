@@ -0,0 +1,49 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/worker_pool.h"
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+TEST(WorkerPoolTest, Results) {
+  WorkerPool pool(4);
+  EXPECT_EQ(4UL, pool.size());
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 100; ++i) {
+    results.push_back(pool.Submit<int>([i] { return i * i; }));
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(i * i, results[i].get());
+  }
+}
+
+// The destructor runs the jobs that are still queued.
+TEST(WorkerPoolTest, DestructorDrainsQueue) {
+  std::atomic<int> count(0);
+  {
+    WorkerPool pool(2);
+    for (int i = 0; i < 1000; ++i) {
+      pool.Submit<void>([&count] { ++count; });
+    }
+  }
+  EXPECT_EQ(1000, count.load());
+}
+
+}  // namespace
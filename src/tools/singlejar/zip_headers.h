@@ -206,6 +206,33 @@ class UnixTimeExtraField : public ExtraField {
 static_assert(5 == sizeof(UnixTimeExtraField),
               "UnixTimeExtraField layout is incorrect");
 
+/* Alignment Extra Field, as written by Android's zipalign. It pads a Local
+ * Header so that the entry data start at the given boundary. Its payload is:
+ *  alignment     2 bytes
+ *  padding       (zeroes) variable
+ */
+class AlignmentExtraField : public ExtraField {
+ public:
+  static const AlignmentExtraField *find(const uint8_t *start,
+                                         const uint8_t *end) {
+    return reinterpret_cast<const AlignmentExtraField *>(
+        ExtraField::find(0xD935, start, end));
+  }
+  bool is() const { return ExtraField::is(0xD935); }
+  void signature() { ExtraField::signature(0xD935); }
+
+  uint16_t alignment() const { return le16toh(alignment_); }
+  void alignment(uint16_t v) { alignment_ = htole16(v); }
+
+  // The smallest field.
+  static constexpr uint16_t kMinSize = 6;
+
+ private:
+  uint16_t alignment_;
+} attr_packed;
+static_assert(AlignmentExtraField::kMinSize == sizeof(AlignmentExtraField),
+              "AlignmentExtraField layout is incorrect");
+
 /* Local Header precedes each archive file data (section 4.3.7).  */
 class LH {
  public:
@@ -278,6 +305,8 @@ class LH {
   }
 
   uint16_t extra_fields_length() const { return le16toh(extra_fields_length_); }
+  // Only changes the length, e.g., to cover the fields written separately.
+  void extra_fields_length(uint16_t v) { extra_fields_length_ = htole16(v); }
   const uint8_t *extra_fields() const {
     return ziph::byte_ptr(file_name_ + file_name_length());
   }
@@ -0,0 +1,90 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/zstd_interface.h"
+
+#include <zstd.h>
+
+#include "src/tools/singlejar/diag.h"
+
+ZstdDecompressor::ZstdDecompressor()
+    : in_(nullptr), in_size_(0), in_pos_(0) {
+  dctx_ = ZSTD_createDCtx();
+  if (dctx_ == nullptr) {
+    diag_errx(2, "%s:%d: ZSTD_createDCtx failed", __FILE__, __LINE__);
+  }
+}
+
+ZstdDecompressor::~ZstdDecompressor() { ZSTD_freeDCtx(dctx_); }
+
+void ZstdDecompressor::reset() {
+  ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only);
+  in_ = nullptr;
+  in_size_ = in_pos_ = 0;
+}
+
+void ZstdDecompressor::DataToDecompress(const uint8_t *data,
+                                        size_t data_size) {
+  in_ = data;
+  in_size_ = data_size;
+  in_pos_ = 0;
+}
+
+bool ZstdDecompressor::Decompress(uint8_t *out, size_t out_size,
+                                  size_t *produced) {
+  ZSTD_inBuffer input = {in_, in_size_, in_pos_};
+  ZSTD_outBuffer output = {out, out_size, 0};
+  size_t ret = ZSTD_decompressStream(dctx_, &output, &input);
+  if (ZSTD_isError(ret)) {
+    diag_errx(2, "%s:%d: Zstandard decompression failed: %s", __FILE__,
+              __LINE__, ZSTD_getErrorName(ret));
+  }
+  in_pos_ = input.pos;
+  *produced = output.pos;
+  return ret == 0;
+}
+
+ZstdCompressor::ZstdCompressor()
+    : in_(nullptr), in_size_(0), in_pos_(0), last_(false), total_out_(0) {
+  cctx_ = ZSTD_createCCtx();
+  if (cctx_ == nullptr) {
+    diag_errx(2, "%s:%d: ZSTD_createCCtx failed", __FILE__, __LINE__);
+  }
+}
+
+ZstdCompressor::~ZstdCompressor() { ZSTD_freeCCtx(cctx_); }
+
+void ZstdCompressor::DataToCompress(const uint8_t *data, size_t data_size,
+                                    bool last) {
+  in_ = data;
+  in_size_ = data_size;
+  in_pos_ = 0;
+  last_ = last;
+}
+
+bool ZstdCompressor::Compress(uint8_t *out, size_t out_size,
+                              size_t *produced) {
+  ZSTD_inBuffer input = {in_, in_size_, in_pos_};
+  ZSTD_outBuffer output = {out, out_size, 0};
+  size_t ret = ZSTD_compressStream2(cctx_, &output, &input,
+                                    last_ ? ZSTD_e_end : ZSTD_e_continue);
+  if (ZSTD_isError(ret)) {
+    diag_errx(2, "%s:%d: Zstandard compression failed: %s", __FILE__,
+              __LINE__, ZSTD_getErrorName(ret));
+  }
+  in_pos_ = input.pos;
+  *produced = output.pos;
+  total_out_ += output.pos;
+  return last_ ? ret == 0 : input.pos == input.size;
+}
@@ -0,0 +1,100 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_SRC_TOOLS_SINGLEJAR_ZSTD_INTERFACE_H_
+#define BAZEL_SRC_TOOLS_SINGLEJAR_ZSTD_INTERFACE_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_DCtx_s;
+
+// The Zip compression method number of Zstandard (APPNOTE.TXT 4.4.5).
+// Zstandard entries are only meant for the jars Bazel's own tools read:
+// the JDK cannot read them.
+static constexpr uint16_t kZstdMethod = 93;
+
+// Decompresses a Zstandard frame, possibly fed in several chunks. Usage:
+//   ZstdDecompressor decompressor;
+//   decompressor.DataToDecompress(data, data_size);
+//   for (;;) {
+//     size_t produced;
+//     if (decompressor.Decompress(out, out_size, &produced)) {
+//       break;  // The frame is complete.
+//     }
+//     // Consume 'produced' bytes of the output buffer.
+//   }
+//   decompressor.reset();
+// Exits if the data are corrupt.
+class ZstdDecompressor {
+ public:
+  ZstdDecompressor();
+  ~ZstdDecompressor();
+
+  ZstdDecompressor(const ZstdDecompressor &) = delete;
+  ZstdDecompressor &operator=(const ZstdDecompressor &) = delete;
+
+  void reset();
+
+  void DataToDecompress(const uint8_t *data, size_t data_size);
+
+  // Fills the output buffer as far as possible. Returns true if the end of
+  // the frame has been reached.
+  bool Decompress(uint8_t *out, size_t out_size, size_t *produced);
+
+  // The number of input bytes not consumed yet.
+  size_t available_in() const { return in_size_ - in_pos_; }
+
+ private:
+  ZSTD_DCtx_s *dctx_;
+  const uint8_t *in_;
+  size_t in_size_;
+  size_t in_pos_;
+};
+
+// Compresses data into a single Zstandard frame, possibly fed in several
+// chunks. Usage:
+//   ZstdCompressor compressor;
+//   compressor.DataToCompress(chunk, chunk_size, is_last_chunk);
+//   while (!compressor.Compress(out, out_size, &produced)) {
+//     // Consume 'produced' bytes of the output buffer.
+//   }
+class ZstdCompressor {
+ public:
+  ZstdCompressor();
+  ~ZstdCompressor();
+
+  ZstdCompressor(const ZstdCompressor &) = delete;
+  ZstdCompressor &operator=(const ZstdCompressor &) = delete;
+
+  void DataToCompress(const uint8_t *data, size_t data_size, bool last);
+
+  // Writes as much output as fits the buffer. Returns true when the chunk
+  // has been consumed, and for the last chunk, the frame has been finished.
+  bool Compress(uint8_t *out, size_t out_size, size_t *produced);
+
+  // The total number of bytes output.
+  uint64_t total_out() const { return total_out_; }
+
+ private:
+  ZSTD_CCtx_s *cctx_;
+  const uint8_t *in_;
+  size_t in_size_;
+  size_t in_pos_;
+  bool last_;
+  uint64_t total_out_;
+};
+
+#endif  //  BAZEL_SRC_TOOLS_SINGLEJAR_ZSTD_INTERFACE_H_
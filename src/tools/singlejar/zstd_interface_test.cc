@@ -0,0 +1,118 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/tools/singlejar/zstd_interface.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "googletest/include/gtest/gtest.h"
+
+namespace {
+
+class ZstdInterfaceTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (size_t i = 0; i < 100000; ++i) {
+      data_.push_back(static_cast<uint8_t>((i * i) % 251));
+    }
+  }
+
+  // Compresses data_ in chunks of the given size, draining the output
+  // through a buffer of the given size.
+  std::vector<uint8_t> Compress(size_t chunk_size, size_t out_size) {
+    ZstdCompressor compressor;
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> out(out_size);
+    for (size_t pos = 0; pos < data_.size(); pos += chunk_size) {
+      size_t size = std::min(chunk_size, data_.size() - pos);
+      compressor.DataToCompress(data_.data() + pos, size,
+                                pos + size == data_.size());
+      bool done;
+      do {
+        size_t produced;
+        done = compressor.Compress(out.data(), out.size(), &produced);
+        compressed.insert(compressed.end(), out.data(),
+                          out.data() + produced);
+      } while (!done);
+    }
+    EXPECT_EQ(compressed.size(), compressor.total_out());
+    return compressed;
+  }
+
+  std::vector<uint8_t> Decompress(const std::vector<uint8_t> &compressed,
+                                  size_t out_size) {
+    ZstdDecompressor decompressor;
+    decompressor.DataToDecompress(compressed.data(), compressed.size());
+    std::vector<uint8_t> decompressed;
+    std::vector<uint8_t> out(out_size);
+    bool done;
+    do {
+      size_t produced;
+      done = decompressor.Decompress(out.data(), out.size(), &produced);
+      decompressed.insert(decompressed.end(), out.data(),
+                          out.data() + produced);
+    } while (!done);
+    EXPECT_EQ(0UL, decompressor.available_in());
+    return decompressed;
+  }
+
+  std::vector<uint8_t> data_;
+};
+
+TEST_F(ZstdInterfaceTest, RoundTrip) {
+  std::vector<uint8_t> compressed = Compress(data_.size(), 1 << 20);
+  EXPECT_LT(compressed.size(), data_.size());
+  EXPECT_EQ(data_, Decompress(compressed, 1 << 20));
+}
+
+TEST_F(ZstdInterfaceTest, RoundTripInChunks) {
+  std::vector<uint8_t> compressed = Compress(4096, 100);
+  EXPECT_EQ(data_, Decompress(compressed, 100));
+}
+
+// A decompressor can be reused for another frame after reset().
+TEST_F(ZstdInterfaceTest, Reset) {
+  std::vector<uint8_t> compressed = Compress(data_.size(), 1 << 20);
+  ZstdDecompressor decompressor;
+  std::vector<uint8_t> out(data_.size());
+  for (int i = 0; i < 2; ++i) {
+    decompressor.reset();
+    decompressor.DataToDecompress(compressed.data(), compressed.size());
+    size_t produced;
+    EXPECT_TRUE(decompressor.Decompress(out.data(), out.size(), &produced));
+    EXPECT_EQ(data_.size(), produced);
+    EXPECT_EQ(data_, out);
+  }
+}
+
+TEST_F(ZstdInterfaceTest, EmptyInput) {
+  data_.clear();
+  ZstdCompressor compressor;
+  compressor.DataToCompress(nullptr, 0, true);
+  uint8_t out[64];
+  size_t produced;
+  EXPECT_TRUE(compressor.Compress(out, sizeof(out), &produced));
+  EXPECT_LT(0UL, produced);
+  ZstdDecompressor decompressor;
+  decompressor.DataToDecompress(out, produced);
+  uint8_t decompressed[16];
+  EXPECT_TRUE(decompressor.Decompress(decompressed, sizeof(decompressed),
+                                      &produced));
+  EXPECT_EQ(0UL, produced);
+}
+
+}  // namespace
@@ -29,6 +29,20 @@ class DefParser{
   // This will cause a "LIBRARY <DLLName>" entry in the output DEF file.
   void SetDLLName(const std::string& filename);
 
+  // Add a single symbol to final result.
+  void AddSymbol(const std::string& symbol, bool is_data) {
+    (is_data ? DataSymbols : Symbols).insert(symbol);
+  }
+
+  const std::set<std::string>& GetSymbols() const { return Symbols; }
+  const std::set<std::string>& GetDataSymbols() const { return DataSymbols; }
+
+  // Merge all symbols found by another parser into final result.
+  void MergeSymbols(const DefParser& other) {
+    Symbols.insert(other.Symbols.begin(), other.Symbols.end());
+    DataSymbols.insert(other.DataSymbols.begin(), other.DataSymbols.end());
+  }
+
   // Write all symbols found into the output DEF file.
   void WriteFile(FILE* file);
 
@@ -1,12 +1,23 @@
 /* Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
    file Copyright.txt or https://cmake.org/licensing for details.  */
 
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "third_party/def_parser/def_parser.h"
 
+#include <windows.h>
+
 static const char* ws = " \t\n\r\f\v";
 
 inline void trim(std::string *str) {
@@ -16,9 +27,156 @@ inline void trim(std::string *str) {
   str->erase(str->find_last_not_of(ws) + 1);
 }
 
+// Returns a string that changes whenever the file is modified, made of its
+// size and last write time.
+static bool GetFileStamp(const std::string& file, std::string* stamp) {
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExW(AsAbsoluteWindowsPath(file).c_str(),
+                            GetFileExInfoStandard, &data)) {
+    return false;
+  }
+  unsigned long long size =
+      (static_cast<unsigned long long>(data.nFileSizeHigh) << 32) |
+      data.nFileSizeLow;
+  unsigned long long mtime =
+      (static_cast<unsigned long long>(data.ftLastWriteTime.dwHighDateTime)
+       << 32) |
+      data.ftLastWriteTime.dwLowDateTime;
+  *stamp = std::to_string(size) + " " + std::to_string(mtime);
+  return true;
+}
+
+struct CachedFile {
+  std::string stamp;
+  DefParser symbols;
+};
+
+// The symbol cache lists, for every input file, a "<stamp>\t<file>" line
+// followed by one "S\t<symbol>" or "D\t<symbol>" line per symbol found in it.
+static void ReadSymbolCache(const std::string& path,
+                            std::map<std::string, CachedFile>* cache) {
+  std::ifstream in(AsAbsoluteWindowsPath(path).c_str(),
+                   std::ios::in | std::ios::binary);
+  std::string line;
+  CachedFile* current = nullptr;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.size() > 2 && (line[0] == 'S' || line[0] == 'D') &&
+        line[1] == '\t') {
+      if (current != nullptr) {
+        current->symbols.AddSymbol(line.substr(2), line[0] == 'D');
+      }
+      continue;
+    }
+    size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      current = nullptr;
+      continue;
+    }
+    current = &(*cache)[line.substr(tab + 1)];
+    current->stamp = line.substr(0, tab);
+    current->symbols = DefParser();
+  }
+}
+
+static void WriteSymbolCache(const std::string& path,
+                             const std::vector<std::string>& files,
+                             const std::vector<std::string>& stamps,
+                             const std::vector<DefParser>& parsers) {
+  std::ofstream out(AsAbsoluteWindowsPath(path).c_str(),
+                    std::ios::out | std::ios::binary | std::ios::trunc);
+  for (size_t i = 0; i < files.size(); i++) {
+    if (stamps[i].empty()) {
+      continue;
+    }
+    out << stamps[i] << "\t" << files[i] << "\n";
+    for (const std::string& symbol : parsers[i].GetSymbols()) {
+      out << "S\t" << symbol << "\n";
+    }
+    for (const std::string& symbol : parsers[i].GetDataSymbols()) {
+      out << "D\t" << symbol << "\n";
+    }
+  }
+  if (!out) {
+    std::cerr << "Could not write symbol cache: " << path << "\n";
+  }
+}
+
+// Parses the files on one thread per core into one DefParser per file, which
+// are merged into deffile at the end. Symbols are kept in sorted sets, so the
+// output doesn't depend on which thread parsed which file.
+//
+// If symbol_cache is not empty, the symbols of files whose size and last write
+// time match the cache are taken from there instead of parsing the files again,
+// and the cache is rewritten afterwards.
+static bool AddFiles(const std::vector<std::string>& files,
+                     const std::string& symbol_cache, DefParser* deffile) {
+  std::vector<DefParser> parsers(files.size());
+  std::vector<std::string> stamps(files.size());
+  std::vector<size_t> to_parse;
+  if (symbol_cache.empty()) {
+    for (size_t i = 0; i < files.size(); i++) {
+      to_parse.push_back(i);
+    }
+  } else {
+    std::map<std::string, CachedFile> cache;
+    ReadSymbolCache(symbol_cache, &cache);
+    for (size_t i = 0; i < files.size(); i++) {
+      if (!GetFileStamp(files[i], &stamps[i])) {
+        stamps[i].clear();
+      }
+      auto it = cache.find(files[i]);
+      if (!stamps[i].empty() && it != cache.end() &&
+          it->second.stamp == stamps[i]) {
+        parsers[i] = std::move(it->second.symbols);
+      } else {
+        to_parse.push_back(i);
+      }
+    }
+  }
+
+  size_t num_threads = std::min<size_t>(
+      std::max(std::thread::hardware_concurrency(), 1u), to_parse.size());
+  std::atomic<size_t> next_file(0);
+  std::atomic<bool> failed(false);
+  auto parse = [&]() {
+    size_t index;
+    while (!failed && (index = next_file++) < to_parse.size()) {
+      size_t file = to_parse[index];
+      if (!parsers[file].AddFile(files[file])) {
+        failed = true;
+      }
+    }
+  };
+  if (num_threads <= 1) {
+    parse();
+  } else {
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back(parse);
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+  if (failed) {
+    return false;
+  }
+
+  if (!symbol_cache.empty()) {
+    WriteSymbolCache(symbol_cache, files, stamps, parsers);
+  }
+  for (const DefParser& parser : parsers) {
+    deffile->MergeSymbols(parser);
+  }
+  return true;
+}
+
 int main(int argc, char* argv[]) {
   if (argc < 4) {
-    std::cerr << "Usage: output_def_file dllname [objfile ...] [input_deffile ...] [@paramfile ...]\n";
+    std::cerr << "Usage: output_def_file dllname [--symbol_cache=<file>] [objfile ...] [input_deffile ...] [@paramfile ...]\n";
     std::cerr << "output_deffile: the output DEF file\n";
     std::cerr << "\n";
     std::cerr << "dllname: the DLL name this DEF file is used for, if dllname is not empty\n";
@@ -34,6 +192,10 @@ int main(int argc, char* argv[]) {
     std::cerr << "\n";
     std::cerr << "@paramfile: a parameter file that can contain objfile and input_deffile.\n";
     std::cerr << "            Can appear multiple time.\n";
+    std::cerr << "\n";
+    std::cerr << "--symbol_cache: a file that records the symbols found in each input file.\n";
+    std::cerr << "                Input files whose size and modification time haven't\n";
+    std::cerr << "                changed since the last run are not parsed again.\n";
     return 1;
   }
 
@@ -48,7 +210,15 @@ int main(int argc, char* argv[]) {
 
   deffile.SetDLLName(argv[2]);
 
+  static const std::string kSymbolCacheFlag = "--symbol_cache=";
+  std::string symbol_cache;
+  std::vector<std::string> files;
   for (int i = 3; i < argc; i++) {
+    if (std::string(argv[i]).compare(0, kSymbolCacheFlag.size(),
+                                     kSymbolCacheFlag) == 0) {
+      symbol_cache = argv[i] + kSymbolCacheFlag.size();
+      continue;
+    }
     // If the argument starts with @, then treat it as a parameter file.
     if (argv[i][0] == '@') {
       filenameW = AsAbsoluteWindowsPath(argv[i] + 1);
@@ -60,19 +230,19 @@ int main(int argc, char* argv[]) {
       std::string file;
       while (std::getline(paramfile, file)) {
         trim(&file);
-        if (!deffile.AddFile(file)) {
-          return 1;
-        }
+        files.push_back(file);
       }
     } else {
       std::string file(argv[i]);
       trim(&file);
-      if (!deffile.AddFile(argv[i])) {
-        return 1;
-      }
+      files.push_back(file);
     }
   }
 
+  if (!AddFiles(files, symbol_cache, &deffile)) {
+    return 1;
+  }
+
   deffile.WriteFile(fout);
   fclose(fout);
   return 0;
@@ -32,6 +32,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
@@ -113,20 +115,86 @@ enum TARGET_TYPE {
 struct Constant;
 
 // TODO(adonovan) these globals are unfortunate
-static std::vector<Constant *> const_pool_in;   // input constant pool
-static std::vector<Constant *> const_pool_out;  // output constant_pool
-static std::set<std::string> used_class_names;
-static Constant *class_name;
+// They are per thread, so that StripClass() can run on several at once.
+static thread_local std::vector<Constant *> const_pool_in;   // input pool
+// Where each constant of the input pool starts, at its tag. The constants are
+// only decoded when constant() is first called on them, since most of them are
+// only used by the code and the private members that are dropped.
+static thread_local std::vector<const u1 *> const_pool_entries;
+static thread_local std::vector<Constant *> const_pool_out;  // output pool
+static thread_local std::set<std::string> used_class_names;
+static thread_local Constant *class_name;
+// Shared by all the threads, guarded by unknown_attributes_mutex.
 static std::unordered_set<std::string> unknown_attributes;
+static std::mutex unknown_attributes_mutex;
+
+// A bump allocator for the objects read from the class being stripped, so
+// that the millions of small allocations of a large jar cost a pointer bump
+// each. The objects are still deleted, for their destructors to release
+// what they own, but their memory is only reclaimed all at once by Reset()
+// at the end of the class.
+class Arena {
+ public:
+  void *Allocate(size_t size) {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    if (size > kBlockSize / 4) {
+      large_.emplace_back(new char[size]);
+      return large_.back().get();
+    }
+    if (size > kBlockSize - used_) {
+      if (blocks_in_use_ == blocks_.size()) {
+        blocks_.emplace_back(new char[kBlockSize]);
+      }
+      block_ = blocks_[blocks_in_use_++].get();
+      used_ = 0;
+    }
+    void *result = block_ + used_;
+    used_ += size;
+    return result;
+  }
+
+  // Reclaims all the memory allocated so far. The blocks are kept for the
+  // next class.
+  void Reset() {
+    large_.clear();
+    blocks_in_use_ = 0;
+    block_ = nullptr;
+    used_ = kBlockSize;
+  }
+
+ private:
+  static constexpr size_t kAlignment = alignof(max_align_t);
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  std::vector<std::unique_ptr<char[]>> large_;
+  size_t blocks_in_use_ = 0;
+  // The block being filled, and how much of it is used.
+  char *block_ = nullptr;
+  size_t used_ = kBlockSize;
+};
+
+static thread_local Arena arena;
+
+// The base of the objects allocated in the arena.
+struct ArenaObject {
+  static void *operator new(size_t size) { return arena.Allocate(size); }
+  static void operator delete(void * /*ptr*/) {}
+};
 
 // Returns the Constant object, given an index into the input constant pool.
 // Note: constant(0) == NULL; this invariant is exploited by the
 // InnerClassesAttribute, inter alia.
+static Constant *DecodeConstant(const u1 *p);
+
 inline Constant *constant(int idx) {
   if (idx < 0 || (unsigned)idx >= const_pool_in.size()) {
     fprintf(stderr, "Illegal constant pool index: %d\n", idx);
     abort();
   }
+  if (const_pool_in[idx] == NULL && const_pool_entries[idx] != NULL) {
+    const_pool_in[idx] = DecodeConstant(const_pool_entries[idx]);
+  }
   return const_pool_in[idx];
 }
 
@@ -137,7 +205,7 @@ inline Constant *constant(int idx) {
  **********************************************************************/
 
 // See sec.4.4 of JVM spec.
-struct Constant {
+struct Constant : ArenaObject {
 
   Constant(u1 tag) :
       slot_(0),
@@ -443,7 +511,7 @@ struct Constant_InvokeDynamic : Constant {
  **********************************************************************/
 
 // See sec.4.7 of JVM spec.
-struct Attribute {
+struct Attribute : ArenaObject {
 
   virtual ~Attribute() {}
   virtual void Write(u1 *&p) = 0;
@@ -458,7 +526,7 @@ struct Attribute {
   Constant *attribute_name_;
 };
 
-struct HasAttrs {
+struct HasAttrs : ArenaObject {
   std::vector<Attribute*> attributes;
 
   void WriteAttrs(u1 *&p);
@@ -504,7 +572,7 @@ struct ExceptionsAttribute : Attribute {
 // See sec.4.7.6 of JVM spec.
 struct InnerClassesAttribute : Attribute {
 
-  struct Entry {
+  struct Entry : ArenaObject {
     Constant *inner_class_info;
     Constant *outer_class_info;
     Constant *inner_name;
@@ -621,138 +689,84 @@ struct EnclosingMethodAttribute : Attribute {
   Constant *method_;
 };
 
-// See sec.4.7.16.1 of JVM spec.
-// Used by AnnotationDefault and other attributes.
-struct ElementValue {
-  virtual ~ElementValue() {}
-  virtual void Write(u1 *&p) = 0;
-  virtual void ExtractClassNames() {}
-  static ElementValue* Read(const u1 *&p);
-  u1 tag_;
-  u4 length_;
-};
+// A run of bytes of the input class that is copied to the output as it is,
+// except for the constant pool indices in it, which are renumbered. Most of
+// what ijar keeps of a heavily annotated class is annotations, and copying
+// them this way saves decoding each one into objects just to encode it again.
+struct RetainedBytes {
+  void Begin(const u1 *p) { start_ = p; }
 
-struct BaseTypeElementValue : ElementValue {
-  void Write(u1 *&p) {
-    put_u1(p, tag_);
-    put_u2be(p, const_value_->slot());
-  }
-  static BaseTypeElementValue *Read(const u1 *&p) {
-    BaseTypeElementValue *value = new BaseTypeElementValue;
-    value->const_value_ = constant(get_u2be(p));
-    return value;
-  }
-  Constant *const_value_;
-};
+  void End(const u1 *p) { length_ = p - start_; }
 
-struct EnumTypeElementValue : ElementValue {
-  void Write(u1 *&p) {
-    put_u1(p, tag_);
-    put_u2be(p, type_name_->slot());
-    put_u2be(p, const_name_->slot());
+  // Reads a constant pool index, and records where it is to renumber it.
+  Constant *ReadIndex(const u1 *&p) {
+    indices_.push_back(p - start_);
+    return constant(get_u2be(p));
   }
-  static EnumTypeElementValue *Read(const u1 *&p) {
-    EnumTypeElementValue *value = new EnumTypeElementValue;
-    value->type_name_ = constant(get_u2be(p));
-    value->const_name_ = constant(get_u2be(p));
-    return value;
-  }
-  Constant *type_name_;
-  Constant *const_name_;
-};
-
-struct ClassTypeElementValue : ElementValue {
-  void Write(u1 *&p) {
-    put_u1(p, tag_);
-    put_u2be(p, class_info_->slot());
-  }
-
-  virtual void ExtractClassNames() {
-    size_t idx = 0;
-    devtools_ijar::ExtractClassNames(class_info_->Display(), &idx);
-  }
-
-  static ClassTypeElementValue *Read(const u1 *&p) {
-    ClassTypeElementValue *value = new ClassTypeElementValue;
-    value->class_info_ = constant(get_u2be(p));
-    return value;
-  }
-  Constant *class_info_;
-};
 
-struct ArrayTypeElementValue : ElementValue {
-  virtual ~ArrayTypeElementValue() {
-    for (const auto *value : values_) {
-      delete value;
-    }
-  }
-
-  virtual void ExtractClassNames() {
-    for (auto *value : values_) {
-      value->ExtractClassNames();
+  void ExtractClassNames() {
+    for (Constant *class_value : class_values_) {
+      size_t idx = 0;
+      devtools_ijar::ExtractClassNames(class_value->Display(), &idx);
     }
   }
 
   void Write(u1 *&p) {
-    put_u1(p, tag_);
-    put_u2be(p, values_.size());
-    for (auto *value : values_) {
-      value->Write(p);
+    put_n(p, start_, length_);
+    // The indices are in the order in which they would have been written
+    // one by one, so the output constant pool is the same.
+    u1 *out = p - length_;
+    for (u4 offset : indices_) {
+      const u1 *in = start_ + offset;
+      u1 *q = out + offset;
+      put_u2be(q, constant(get_u2be(in))->slot());
     }
   }
-  static ArrayTypeElementValue *Read(const u1 *&p) {
-    ArrayTypeElementValue *value = new ArrayTypeElementValue;
-    u2 num_values = get_u2be(p);
-    for (int ii = 0; ii < num_values; ++ii) {
-      value->values_.push_back(ElementValue::Read(p));
-    }
-    return value;
-  }
-  std::vector<ElementValue*> values_;
+
+  const u1 *start_;
+  u4 length_;
+  // The offsets of the constant pool indices from start_.
+  std::vector<u4> indices_;
+  // The classes of the class element values, e.g. in @Foo(Bar.class).
+  std::vector<Constant *> class_values_;
 };
 
-// See sec.4.7.16 of JVM spec.
-struct Annotation {
-  virtual ~Annotation() {
-    for (size_t i = 0; i < element_value_pairs_.size(); i++) {
-      delete element_value_pairs_[i]->element_value_;
-      delete element_value_pairs_[i];
-    }
-  }
+static Constant *ReadAnnotation(const u1 *&p, RetainedBytes *bytes);
 
-  void ExtractClassNames() {
-    for (size_t i = 0; i < element_value_pairs_.size(); i++) {
-      element_value_pairs_[i]->element_value_->ExtractClassNames();
+// See sec.4.7.16.1 of JVM spec.
+// Used by AnnotationDefault and other attributes.
+static void ReadElementValue(const u1 *&p, RetainedBytes *bytes) {
+  u1 tag = get_u1(p);
+  if (tag != 0 && strchr("BCDFIJSZs", (char) tag) != NULL) {
+    bytes->ReadIndex(p);  // const_value_index
+  } else if ((char) tag == 'e') {
+    bytes->ReadIndex(p);  // type_name_index
+    bytes->ReadIndex(p);  // const_name_index
+  } else if ((char) tag == 'c') {
+    bytes->class_values_.push_back(bytes->ReadIndex(p));
+  } else if ((char) tag == '[') {
+    u2 num_values = get_u2be(p);
+    for (int ii = 0; ii < num_values; ++ii) {
+      ReadElementValue(p, bytes);
     }
+  } else if ((char) tag == '@') {
+    ReadAnnotation(p, bytes);
+  } else {
+    fprintf(stderr, "Illegal element_value::tag: %d\n", tag);
+    abort();
   }
+}
 
-  void Write(u1 *&p) {
-    put_u2be(p, type_->slot());
-    put_u2be(p, element_value_pairs_.size());
-    for (size_t ii = 0; ii < element_value_pairs_.size(); ++ii) {
-      put_u2be(p, element_value_pairs_[ii]->element_name_->slot());
-      element_value_pairs_[ii]->element_value_->Write(p);
-    }
-  }
-  static Annotation *Read(const u1 *&p) {
-    Annotation *value = new Annotation;
-    value->type_ = constant(get_u2be(p));
-    u2 num_element_value_pairs = get_u2be(p);
-    for (int ii = 0; ii < num_element_value_pairs; ++ii) {
-      ElementValuePair *pair = new ElementValuePair;
-      pair->element_name_ = constant(get_u2be(p));
-      pair->element_value_ = ElementValue::Read(p);
-      value->element_value_pairs_.push_back(pair);
-    }
-    return value;
+// See sec.4.7.16 of JVM spec. Returns the type of the annotation.
+static Constant *ReadAnnotation(const u1 *&p, RetainedBytes *bytes) {
+  Constant *type = bytes->ReadIndex(p);
+  u2 num_element_value_pairs = get_u2be(p);
+  for (int ii = 0; ii < num_element_value_pairs; ++ii) {
+    bytes->ReadIndex(p);  // element_name_index
+    ReadElementValue(p, bytes);
   }
-  Constant *type_;
-  struct ElementValuePair {
-    Constant *element_name_;
-    ElementValue *element_value_;
-  };
-  std::vector<ElementValuePair*> element_value_pairs_;
-};
+  return type;
+}
 
 // See sec 4.7.20 of Java 8 JVM Spec
 //
@@ -784,231 +798,66 @@ struct Annotation {
 //   element_value_pairs[num_element_value_pairs];
 // }
 //
-struct TypeAnnotation {
-  virtual ~TypeAnnotation() {
-    delete target_info_;
-    delete type_path_;
-    delete annotation_;
-  }
-
-  void ExtractClassNames() {
-    annotation_->ExtractClassNames();
-  }
-
-  void Write(u1 *&p) {
-    put_u1(p, target_type_);
-    target_info_->Write(p);
-    type_path_->Write(p);
-    annotation_->Write(p);
-  }
-
-  static TypeAnnotation *Read(const u1 *&p) {
-    TypeAnnotation *value = new TypeAnnotation;
-    value->target_type_ = get_u1(p);
-    value->target_info_ = ReadTargetInfo(p, value->target_type_);
-    value->type_path_ = TypePath::Read(p);
-    value->annotation_ = Annotation::Read(p);
-    return value;
-  }
-
-  struct TargetInfo {
-    virtual ~TargetInfo() {}
-    virtual void Write(u1 *&p) = 0;
-  };
-
-  struct TypeParameterTargetInfo : TargetInfo {
-    void Write(u1 *&p) {
-      put_u1(p, type_parameter_index_);
-    }
-    static TypeParameterTargetInfo *Read(const u1 *&p) {
-      TypeParameterTargetInfo *value = new TypeParameterTargetInfo;
-      value->type_parameter_index_ = get_u1(p);
-      return value;
-    }
-    u1 type_parameter_index_;
-  };
-
-  struct ClassExtendsInfo : TargetInfo {
-    void Write(u1 *&p) {
-      put_u2be(p, supertype_index_);
-    }
-    static ClassExtendsInfo *Read(const u1 *&p) {
-      ClassExtendsInfo *value = new ClassExtendsInfo;
-      value->supertype_index_ = get_u2be(p);
-      return value;
-    }
-    u2 supertype_index_;
-  };
-
-  struct TypeParameterBoundInfo : TargetInfo {
-    void Write(u1 *&p) {
-      put_u1(p, type_parameter_index_);
-      put_u1(p, bound_index_);
-    }
-    static TypeParameterBoundInfo *Read(const u1 *&p) {
-      TypeParameterBoundInfo *value = new TypeParameterBoundInfo;
-      value->type_parameter_index_ = get_u1(p);
-      value->bound_index_ = get_u1(p);
-      return value;
-    }
-    u1 type_parameter_index_;
-    u1 bound_index_;
-  };
-
-  struct EmptyInfo : TargetInfo {
-    void Write(u1 *& /*p*/) {}
-    static EmptyInfo *Read(const u1 *& /*p*/) { return new EmptyInfo; }
-  };
-
-  struct MethodFormalParameterInfo : TargetInfo {
-    void Write(u1 *&p) {
-      put_u1(p, method_formal_parameter_index_);
-    }
-    static MethodFormalParameterInfo *Read(const u1 *&p) {
-      MethodFormalParameterInfo *value = new MethodFormalParameterInfo;
-      value->method_formal_parameter_index_ = get_u1(p);
-      return value;
-    }
-    u1 method_formal_parameter_index_;
-  };
-
-  struct ThrowsTypeInfo : TargetInfo {
-    void Write(u1 *&p) {
-      put_u2be(p, throws_type_index_);
-    }
-    static ThrowsTypeInfo *Read(const u1 *&p) {
-      ThrowsTypeInfo *value = new ThrowsTypeInfo;
-      value->throws_type_index_ = get_u2be(p);
-      return value;
-    }
-    u2 throws_type_index_;
-  };
-
-  static TargetInfo *ReadTargetInfo(const u1 *&p, u1 target_type) {
-    switch (target_type) {
-      case CLASS_TYPE_PARAMETER:
-      case METHOD_TYPE_PARAMETER:
-        return TypeParameterTargetInfo::Read(p);
-      case CLASS_EXTENDS:
-        return ClassExtendsInfo::Read(p);
-      case CLASS_TYPE_PARAMETER_BOUND:
-      case METHOD_TYPE_PARAMETER_BOUND:
-        return TypeParameterBoundInfo::Read(p);
-      case FIELD:
-      case METHOD_RETURN:
-      case METHOD_RECEIVER:
-        return new EmptyInfo;
-      case METHOD_FORMAL_PARAMETER:
-        return MethodFormalParameterInfo::Read(p);
-      case THROWS:
-        return ThrowsTypeInfo::Read(p);
-      default:
-        fprintf(stderr, "Illegal type annotation target type: %d\n",
-                target_type);
-        abort();
-    }
-  }
-
-  struct TypePath {
-    void Write(u1 *&p) {
-      put_u1(p, path_.size());
-      for (TypePathEntry entry : path_) {
-        put_u1(p, entry.type_path_kind_);
-        put_u1(p, entry.type_argument_index_);
-      }
-    }
-    static TypePath *Read(const u1 *&p) {
-      TypePath *value = new TypePath;
-      u1 path_length = get_u1(p);
-      for (int ii = 0; ii < path_length; ++ii) {
-        TypePathEntry entry;
-        entry.type_path_kind_ = get_u1(p);
-        entry.type_argument_index_ = get_u1(p);
-        value->path_.push_back(entry);
-      }
-      return value;
-    }
-
-    struct TypePathEntry {
-      u1 type_path_kind_;
-      u1 type_argument_index_;
-    };
-    std::vector<TypePathEntry> path_;
-  };
-
-  u1 target_type_;
-  TargetInfo *target_info_;
-  TypePath *type_path_;
-  Annotation *annotation_;
-};
-
-struct AnnotationTypeElementValue : ElementValue {
-  virtual ~AnnotationTypeElementValue() {
-    delete annotation_;
-  }
-
-  void Write(u1 *&p) {
-    put_u1(p, tag_);
-    annotation_->Write(p);
-  }
-  static AnnotationTypeElementValue *Read(const u1 *&p) {
-    AnnotationTypeElementValue *value = new AnnotationTypeElementValue;
-    value->annotation_ = Annotation::Read(p);
-    return value;
-  }
-
-  Annotation *annotation_;
-};
-
-ElementValue* ElementValue::Read(const u1 *&p) {
-  const u1* start = p;
-  ElementValue *result;
-  u1 tag = get_u1(p);
-  if (tag != 0 && strchr("BCDFIJSZs", (char) tag) != NULL) {
-    result = BaseTypeElementValue::Read(p);
-  } else if ((char) tag == 'e') {
-    result = EnumTypeElementValue::Read(p);
-  } else if ((char) tag == 'c') {
-    result = ClassTypeElementValue::Read(p);
-  } else if ((char) tag == '[') {
-    result = ArrayTypeElementValue::Read(p);
-  } else if ((char) tag == '@') {
-    result = AnnotationTypeElementValue::Read(p);
-  } else {
-    fprintf(stderr, "Illegal element_value::tag: %d\n", tag);
-    abort();
+// None of the targets that ijar keeps refers to the constant pool.
+static void ReadTypeAnnotation(const u1 *&p, RetainedBytes *bytes) {
+  u1 target_type = get_u1(p);
+  switch (target_type) {
+    case CLASS_TYPE_PARAMETER:
+    case METHOD_TYPE_PARAMETER:
+      p += 1;  // type_parameter_index
+      break;
+    case CLASS_EXTENDS:
+      p += 2;  // supertype_index, into the interfaces of the class
+      break;
+    case CLASS_TYPE_PARAMETER_BOUND:
+    case METHOD_TYPE_PARAMETER_BOUND:
+      p += 2;  // type_parameter_index, bound_index
+      break;
+    case FIELD:
+    case METHOD_RETURN:
+    case METHOD_RECEIVER:
+      break;
+    case METHOD_FORMAL_PARAMETER:
+      p += 1;  // formal_parameter_index
+      break;
+    case THROWS:
+      p += 2;  // throws_type_index, into the Exceptions attribute
+      break;
+    default:
+      fprintf(stderr, "Illegal type annotation target type: %d\n",
+              target_type);
+      abort();
   }
-  result->tag_ = tag;
-  result->length_ = p - start;
-  return result;
+  u1 path_length = get_u1(p);
+  p += 2 * path_length;  // type_path_kind, type_argument_index
+  ReadAnnotation(p, bytes);
 }
 
 // See sec.4.7.20 of JVM spec.
 // We preserve AnnotationDefault attributes because they are required
 // in order to make use of an annotation in new code.
 struct AnnotationDefaultAttribute : Attribute {
-  virtual ~AnnotationDefaultAttribute() {
-    delete default_value_;
-  }
 
   static AnnotationDefaultAttribute* Read(const u1 *&p,
                                           Constant *attribute_name) {
     AnnotationDefaultAttribute *attr = new AnnotationDefaultAttribute;
     attr->attribute_name_ = attribute_name;
-    attr->default_value_ = ElementValue::Read(p);
+    attr->default_value_.Begin(p);
+    ReadElementValue(p, &attr->default_value_);
+    attr->default_value_.End(p);
     return attr;
   }
 
   void Write(u1 *&p) {
-    WriteProlog(p, default_value_->length_);
-    default_value_->Write(p);
+    WriteProlog(p, default_value_.length_);
+    default_value_.Write(p);
   }
 
   virtual void ExtractClassNames() {
-    default_value_->ExtractClassNames();
+    default_value_.ExtractClassNames();
   }
 
-  ElementValue *default_value_;
+  RetainedBytes default_value_;
 };
 
 // See sec.4.7.2 of JVM spec.
@@ -1077,32 +926,26 @@ struct DeprecatedAttribute : Attribute {
 //
 // We preserve all annotations.
 struct AnnotationsAttribute : Attribute {
-  virtual ~AnnotationsAttribute() {
-    for (size_t i = 0; i < annotations_.size(); i++) {
-      delete annotations_[i];
-    }
-  }
 
   static AnnotationsAttribute* Read(const u1 *&p, Constant *attribute_name) {
     AnnotationsAttribute *attr = new AnnotationsAttribute;
     attr->attribute_name_ = attribute_name;
+    attr->annotations_.Begin(p);
     u2 num_annotations = get_u2be(p);
     for (int ii = 0; ii < num_annotations; ++ii) {
-      Annotation *annotation = Annotation::Read(p);
-      attr->annotations_.push_back(annotation);
+      attr->types_.push_back(ReadAnnotation(p, &attr->annotations_));
     }
+    attr->annotations_.End(p);
     return attr;
   }
 
   virtual void ExtractClassNames() {
-    for (auto *annotation : annotations_) {
-      annotation->ExtractClassNames();
-    }
+    annotations_.ExtractClassNames();
   }
 
   virtual bool KeepForCompile() const {
-    for (auto *annotation : annotations_) {
-      if (annotation->type_->Display() == "Lkotlin/Metadata;") {
+    for (auto *type : types_) {
+      if (type->Display() == "Lkotlin/Metadata;") {
         return true;
       }
     }
@@ -1110,16 +953,12 @@ struct AnnotationsAttribute : Attribute {
   }
 
   void Write(u1 *&p) {
-    WriteProlog(p, -1);
-    u1 *payload_start = p - 4;
-    put_u2be(p, annotations_.size());
-    for (auto *annotation : annotations_) {
-      annotation->Write(p);
-    }
-    put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
+    WriteProlog(p, annotations_.length_);
+    annotations_.Write(p);
   }
 
-  std::vector<Annotation*> annotations_;
+  RetainedBytes annotations_;
+  std::vector<Constant*> types_;
 };
 
 // See sec.4.7.18-19 of JVM spec.  Includes RuntimeVisible and
@@ -1132,43 +971,28 @@ struct ParameterAnnotationsAttribute : Attribute {
                                              Constant *attribute_name) {
     ParameterAnnotationsAttribute *attr = new ParameterAnnotationsAttribute;
     attr->attribute_name_ = attribute_name;
+    attr->parameter_annotations_.Begin(p);
     u1 num_parameters = get_u1(p);
     for (int ii = 0; ii < num_parameters; ++ii) {
-      std::vector<Annotation*> annotations;
       u2 num_annotations = get_u2be(p);
       for (int ii = 0; ii < num_annotations; ++ii) {
-        Annotation *annotation = Annotation::Read(p);
-        annotations.push_back(annotation);
+        ReadAnnotation(p, &attr->parameter_annotations_);
       }
-      attr->parameter_annotations_.push_back(annotations);
     }
+    attr->parameter_annotations_.End(p);
     return attr;
   }
 
   virtual void ExtractClassNames() {
-    for (size_t i = 0; i < parameter_annotations_.size(); i++) {
-      const std::vector<Annotation*>& annotations = parameter_annotations_[i];
-      for (size_t j = 0; j < annotations.size(); j++) {
-        annotations[j]->ExtractClassNames();
-      }
-    }
+    parameter_annotations_.ExtractClassNames();
   }
 
   void Write(u1 *&p) {
-    WriteProlog(p, -1);
-    u1 *payload_start = p - 4;
-    put_u1(p, parameter_annotations_.size());
-    for (size_t ii = 0; ii < parameter_annotations_.size(); ++ii) {
-      std::vector<Annotation *> &annotations = parameter_annotations_[ii];
-      put_u2be(p, annotations.size());
-      for (size_t jj = 0; jj < annotations.size(); ++jj) {
-        annotations[jj]->Write(p);
-      }
-    }
-    put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
+    WriteProlog(p, parameter_annotations_.length_);
+    parameter_annotations_.Write(p);
   }
 
-  std::vector<std::vector<Annotation*> > parameter_annotations_;
+  RetainedBytes parameter_annotations_;
 };
 
 // See sec.4.7.20 of Java 8 JVM spec. Includes RuntimeVisibleTypeAnnotations
@@ -1178,31 +1002,25 @@ struct TypeAnnotationsAttribute : Attribute {
                                         u4 /*attribute_length*/) {
     auto attr = new TypeAnnotationsAttribute;
     attr->attribute_name_ = attribute_name;
+    attr->type_annotations_.Begin(p);
     u2 num_annotations = get_u2be(p);
     for (int ii = 0; ii < num_annotations; ++ii) {
-      TypeAnnotation *annotation = TypeAnnotation::Read(p);
-      attr->type_annotations_.push_back(annotation);
+      ReadTypeAnnotation(p, &attr->type_annotations_);
     }
+    attr->type_annotations_.End(p);
     return attr;
   }
 
   virtual void ExtractClassNames() {
-    for (auto *type_annotation : type_annotations_) {
-      type_annotation->ExtractClassNames();
-    }
+    type_annotations_.ExtractClassNames();
   }
 
   void Write(u1 *&p) {
-    WriteProlog(p, -1);
-    u1 *payload_start = p - 4;
-    put_u2be(p, type_annotations_.size());
-    for (TypeAnnotation *annotation : type_annotations_) {
-      annotation->Write(p);
-    }
-    put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
+    WriteProlog(p, type_annotations_.length_);
+    type_annotations_.Write(p);
   }
 
-  std::vector<TypeAnnotation*> type_annotations_;
+  RetainedBytes type_annotations_;
 };
 
 // See JVMS §4.7.24
@@ -1233,7 +1051,7 @@ struct MethodParametersAttribute : Attribute {
     put_u4be(payload_start, p - 4 - payload_start);  // backpatch length
   }
 
-  struct MethodParameter {
+  struct MethodParameter : ArenaObject {
     Constant *name_;
     u2 access_flags_;
   };
@@ -1594,6 +1412,7 @@ void HasAttrs::ReadAttrs(const u1 *&p) {
       if (attr_name != "com.android.tools.r8.SynthesizedClass" &&
           attr_name != "com.android.tools.r8.SynthesizedClassV2") {
         // Only warn about the first occurrence of each unknown attribute.
+        std::lock_guard<std::mutex> lock(unknown_attributes_mutex);
         if (unknown_attributes.insert(attr_name).second) {
           fprintf(stderr, "ijar: skipping unknown attribute: \"%s\".\n",
                   attr_name.c_str());
@@ -1621,13 +1440,80 @@ void HasAttrs::WriteAttrs(u1 *&p) {
 }
 
 // See sec.4.4 of JVM spec.
-bool ClassFile::ReadConstantPool(const u1 *&p) {
+static Constant *DecodeConstant(const u1 *p) {
+  u1 tag = get_u1(p);
+  switch (tag) {
+    case CONSTANT_Class: {
+      u2 name_index = get_u2be(p);
+      return new Constant_Class(name_index);
+    }
+    case CONSTANT_FieldRef:
+    case CONSTANT_Methodref:
+    case CONSTANT_Interfacemethodref: {
+      u2 class_index = get_u2be(p);
+      u2 nti = get_u2be(p);
+      return new Constant_FMIref(tag, class_index, nti);
+    }
+    case CONSTANT_String: {
+      u2 string_index = get_u2be(p);
+      return new Constant_String(string_index);
+    }
+    case CONSTANT_NameAndType: {
+      u2 name_index = get_u2be(p);
+      u2 descriptor_index = get_u2be(p);
+      return new Constant_NameAndType(name_index, descriptor_index);
+    }
+    case CONSTANT_Utf8: {
+      u2 length = get_u2be(p);
+      return new Constant_Utf8(length, p);
+    }
+    case CONSTANT_Integer:
+    case CONSTANT_Float: {
+      u4 bytes = get_u4be(p);
+      return new Constant_IntegerOrFloat(tag, bytes);
+    }
+    case CONSTANT_Long:
+    case CONSTANT_Double: {
+      u4 high_bytes = get_u4be(p);
+      u4 low_bytes = get_u4be(p);
+      return new Constant_LongOrDouble(tag, high_bytes, low_bytes);
+    }
+    case CONSTANT_MethodHandle: {
+      u1 reference_kind = get_u1(p);
+      u2 reference_index = get_u2be(p);
+      return new Constant_MethodHandle(reference_kind, reference_index);
+    }
+    case CONSTANT_MethodType: {
+      u2 descriptor_index = get_u2be(p);
+      return new Constant_MethodType(descriptor_index);
+    }
+    case CONSTANT_Dynamic: {
+      u2 bootstrap_method_attr = get_u2be(p);
+      u2 name_name_type_index = get_u2be(p);
+      return new Constant_Dynamic(bootstrap_method_attr, name_name_type_index);
+    }
+    case CONSTANT_InvokeDynamic: {
+      u2 bootstrap_method_attr = get_u2be(p);
+      u2 name_name_type_index = get_u2be(p);
+      return new Constant_InvokeDynamic(bootstrap_method_attr,
+                                        name_name_type_index);
+    }
+    default:
+      // ReadConstantPool() has already rejected the class.
+      fprintf(stderr, "Unknown constant: %hhu.\n", tag);
+      abort();
+  }
+}
 
-  const_pool_in.clear();
-  const_pool_in.push_back(NULL); // dummy first item
+// Only finds where each constant starts; see const_pool_entries.
+bool ClassFile::ReadConstantPool(const u1 *&p) {
 
   u2 cp_count = get_u2be(p);
+  // Item zero is a dummy, and stays NULL.
+  const_pool_in.assign(cp_count > 0 ? cp_count : 1, NULL);
+  const_pool_entries.assign(const_pool_in.size(), NULL);
   for (int ii = 1; ii < cp_count; ++ii) {
+    const_pool_entries[ii] = p;
     u1 tag = get_u1(p);
 
     if (devtools_ijar::verbose) {
@@ -1635,87 +1521,41 @@ bool ClassFile::ReadConstantPool(const u1 *&p) {
     }
 
     switch(tag) {
-      case CONSTANT_Class: {
-        u2 name_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_Class(name_index));
+      case CONSTANT_Class:
+      case CONSTANT_String:
+      case CONSTANT_MethodType:
+        p += 2;
+        break;
+      case CONSTANT_MethodHandle:
+        p += 3;
         break;
-      }
       case CONSTANT_FieldRef:
       case CONSTANT_Methodref:
-      case CONSTANT_Interfacemethodref: {
-        u2 class_index = get_u2be(p);
-        u2 nti = get_u2be(p);
-        const_pool_in.push_back(new Constant_FMIref(tag, class_index, nti));
-        break;
-      }
-      case CONSTANT_String: {
-        u2 string_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_String(string_index));
-        break;
-      }
-      case CONSTANT_NameAndType: {
-        u2 name_index = get_u2be(p);
-        u2 descriptor_index = get_u2be(p);
-        const_pool_in.push_back(
-            new Constant_NameAndType(name_index, descriptor_index));
+      case CONSTANT_Interfacemethodref:
+      case CONSTANT_NameAndType:
+      case CONSTANT_Integer:
+      case CONSTANT_Float:
+      case CONSTANT_Dynamic:
+      case CONSTANT_InvokeDynamic:
+        p += 4;
         break;
-      }
       case CONSTANT_Utf8: {
         u2 length = get_u2be(p);
         if (devtools_ijar::verbose) {
           fprintf(stderr, "Utf8: \"%s\" (%d)\n",
                   std::string((const char*) p, length).c_str(), length);
         }
-
-        const_pool_in.push_back(new Constant_Utf8(length, p));
         p += length;
         break;
       }
-      case CONSTANT_Integer:
-      case CONSTANT_Float: {
-        u4 bytes = get_u4be(p);
-        const_pool_in.push_back(new Constant_IntegerOrFloat(tag, bytes));
-        break;
-      }
       case CONSTANT_Long:
-      case CONSTANT_Double: {
-        u4 high_bytes = get_u4be(p);
-        u4 low_bytes = get_u4be(p);
-        const_pool_in.push_back(
-            new Constant_LongOrDouble(tag, high_bytes, low_bytes));
+      case CONSTANT_Double:
+        p += 8;
         // Longs and doubles occupy two constant pool slots.
         // ("In retrospect, making 8-byte constants take two "constant
         // pool entries was a poor choice." --JVM Spec.)
-        const_pool_in.push_back(NULL);
         ii++;
         break;
-      }
-      case CONSTANT_MethodHandle: {
-        u1 reference_kind = get_u1(p);
-        u2 reference_index = get_u2be(p);
-        const_pool_in.push_back(
-            new Constant_MethodHandle(reference_kind, reference_index));
-        break;
-      }
-      case CONSTANT_MethodType: {
-        u2 descriptor_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_MethodType(descriptor_index));
-        break;
-      }
-      case CONSTANT_Dynamic: {
-        u2 bootstrap_method_attr = get_u2be(p);
-        u2 name_name_type_index = get_u2be(p);
-        const_pool_in.push_back(
-            new Constant_Dynamic(bootstrap_method_attr, name_name_type_index));
-        break;
-      }
-      case CONSTANT_InvokeDynamic: {
-        u2 bootstrap_method_attr = get_u2be(p);
-        u2 name_name_type_index = get_u2be(p);
-        const_pool_in.push_back(new Constant_InvokeDynamic(
-            bootstrap_method_attr, name_name_type_index));
-        break;
-      }
       default: {
         fprintf(stderr, "Unknown constant: %hhu. Passing class through.\n",
                 tag);
@@ -2023,7 +1863,9 @@ bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length) {
   }
 
   const_pool_in.clear();
+  const_pool_entries.clear();
   const_pool_out.clear();
+  arena.Reset();
   return keep;
 }
 
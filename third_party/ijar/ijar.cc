@@ -16,23 +16,60 @@
 //
 
 #include <errno.h>
-#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <memory>
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "third_party/ijar/ijar.h"
+#include "third_party/ijar/mapped_file.h"
+#include "third_party/ijar/strip_cache.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
+#include "third_party/ijar/zstd_client.h"
 
 namespace devtools_ijar {
 
 bool verbose = false;
+bool zstd = false;
+int threads = 1;
+std::unique_ptr<StripCache> strip_cache;
+bool keep_unchanged_output = false;
 
 // Reads a JVM class from classdata_in (of the specified length), and
 // writes out a simplified class to classdata_out, advancing the
 // pointer. Returns true if the class should be kept.
 bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length);
 
+// Like StripClass(), but writes the simplified class to *out and goes
+// through strip_cache if there is one.
+static bool StripClassToVector(const u1 *data, const size_t size,
+                               std::vector<u1> *out) {
+  std::string key;
+  bool keep;
+  if (strip_cache) {
+    key = StripCache::Key(data, size);
+    if (strip_cache->Get(key, &keep, out)) {
+      return keep;
+    }
+  }
+  out->resize(size);
+  u1 *classdata_out = out->data();
+  keep = StripClass(classdata_out, data, size);
+  out->resize(classdata_out - out->data());
+  if (strip_cache) {
+    strip_cache->Put(key, keep, out->data(), out->size());
+  }
+  return keep;
+}
+
 const char *CLASS_EXTENSION = ".class";
 const size_t CLASS_EXTENSION_LENGTH = strlen(CLASS_EXTENSION);
 const char *TRANSITIVE_PREFIX = "META-INF/TRANSITIVE/";
@@ -74,6 +111,9 @@ class JarExtractorProcessor : public ZipExtractorProcessor {
   void SetZipBuilder(ZipBuilder *builder) { this->builder_ = builder; }
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind) = 0;
+  // Writes out the files still being processed, if any. Called once all the
+  // input files have been handed to the processor.
+  virtual void Finish() {}
 
  protected:
   // Not owned by JarStripperProcessor, see SetZipBuilder().
@@ -83,17 +123,61 @@ class JarExtractorProcessor : public ZipExtractorProcessor {
 // ZipExtractorProcessor that select only .class file and use
 // StripClass to generate an interface class, storing as a new file
 // in the specified ZipBuilder.
+// With more than one thread, the files are decompressed and stripped on
+// a pool of threads, and written out in the input order as they complete,
+// so that the output does not depend on the scheduling.
 class JarStripperProcessor : public JarExtractorProcessor {
  public:
-  JarStripperProcessor() {}
-  virtual ~JarStripperProcessor() {}
+  explicit JarStripperProcessor(int threads);
+  virtual ~JarStripperProcessor();
 
   virtual void Process(const char *filename, u4 attr, const u1 *data,
                        size_t size);
   virtual bool Accept(const char *filename, u4 attr);
+  virtual bool WantsCompressed() { return !workers_.empty(); }
+  virtual void ProcessCompressed(const char *filename, u4 attr,
+                                 const u1 *data, size_t compressed_size,
+                                 size_t uncompressed_size, bool zstd);
 
   virtual void WriteManifest(const char *target_label,
                              const char *injecting_rule_kind);
+  virtual void Finish();
+
+ private:
+  // A file being processed by the pool.
+  struct Job {
+    enum Method { kStored, kDeflated, kZstd };
+    std::string filename;
+    Method method;
+    // The file as it is stored in the input jar.
+    std::vector<u1> input;
+    size_t uncompressed_size;
+    // The output file, if it is kept, once done is set.
+    std::vector<u1> output;
+    bool keep;
+    bool done;
+  };
+
+  // With more files than that in flight, Submit() waits for the oldest one.
+  static constexpr size_t kMaxJobsPerThread = 16;
+
+  void Submit(const char *filename, Job::Method method, const u1 *data,
+              size_t size, size_t uncompressed_size);
+  void WorkerLoop();
+  // Writes out the done files at the head of jobs_; if wait is true, waits
+  // for the head file to be done first.
+  void WriteDone(std::unique_lock<std::mutex> &lock, bool wait);
+  void Write(const char *filename, const u1 *data, size_t size);
+
+  std::vector<std::thread> workers_;
+  // All the files not written out yet, in the input order.
+  std::deque<std::unique_ptr<Job>> jobs_;
+  // The files not picked by a worker yet.
+  std::deque<Job *> queue_;
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::condition_variable done_;
+  bool shutdown_;
 };
 
 static bool StartsWith(const char *str, const size_t str_len,
@@ -152,29 +236,155 @@ static bool IsModuleInfo(const char *filename) {
   return strcmp(slash, "module-info.class") == 0;
 }
 
+// Whether the file is copied as it is rather than stripped.
+static bool IsCopied(const char *filename) {
+  return IsModuleInfo(filename) || IsKotlinModule(filename, strlen(filename)) ||
+         IsScalaTasty(filename, strlen(filename));
+}
+
+JarStripperProcessor::JarStripperProcessor(int threads) : shutdown_(false) {
+  if (threads > 1) {
+    for (int i = 0; i < threads; ++i) {
+      workers_.emplace_back(&JarStripperProcessor::WorkerLoop, this);
+    }
+  }
+}
+
+JarStripperProcessor::~JarStripperProcessor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  queued_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
 void JarStripperProcessor::Process(const char *filename, const u4 /*attr*/,
                                    const u1 *data, const size_t size) {
   if (verbose) {
     fprintf(stderr, "INFO: StripClass: %s\n", filename);
   }
-  if (IsModuleInfo(filename) || IsKotlinModule(filename, strlen(filename)) ||
-      IsScalaTasty(filename, strlen(filename))) {
-    u1 *q = builder_->NewFile(filename, 0);
-    memcpy(q, data, size);
-    builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
+  if (!workers_.empty()) {
+    Submit(filename, Job::kStored, data, size, size);
+  } else if (IsCopied(filename)) {
+    Write(filename, data, size);
   } else {
-    u1 *buf = reinterpret_cast<u1 *>(malloc(size));
-    u1 *classdata_out = buf;
-    if (!StripClass(buf, data, size)) {
-      free(classdata_out);
-      return;
+    std::vector<u1> out;
+    if (StripClassToVector(data, size, &out)) {
+      Write(filename, out.data(), out.size());
     }
-    u1 *q = builder_->NewFile(filename, 0);
-    size_t out_length = buf - classdata_out;
-    memcpy(q, classdata_out, out_length);
-    builder_->FinishFile(out_length, /* compress: */ false,
-                         /* compute_crc: */ true);
-    free(classdata_out);
+  }
+}
+
+void JarStripperProcessor::ProcessCompressed(const char *filename,
+                                             const u4 /*attr*/,
+                                             const u1 *data,
+                                             const size_t compressed_size,
+                                             const size_t uncompressed_size,
+                                             bool zstd) {
+  if (verbose) {
+    fprintf(stderr, "INFO: StripClass: %s\n", filename);
+  }
+  Submit(filename, zstd ? Job::kZstd : Job::kDeflated, data, compressed_size,
+         uncompressed_size);
+}
+
+void JarStripperProcessor::Write(const char *filename, const u1 *data,
+                                 const size_t size) {
+  u1 *q = builder_->NewFile(filename, 0);
+  memcpy(q, data, size);
+  builder_->FinishFile(size, /* compress: */ zstd, /* compute_crc: */ true);
+}
+
+void JarStripperProcessor::Submit(const char *filename, Job::Method method,
+                                  const u1 *data, const size_t size,
+                                  const size_t uncompressed_size) {
+  // The data only live during the Process*() call, hence the copy.
+  std::unique_ptr<Job> job(new Job());
+  job->filename = filename;
+  job->method = method;
+  job->input.assign(data, data + size);
+  job->uncompressed_size = uncompressed_size;
+  job->keep = false;
+  job->done = false;
+  std::unique_lock<std::mutex> lock(mutex_);
+  queue_.push_back(job.get());
+  jobs_.push_back(std::move(job));
+  queued_.notify_one();
+  WriteDone(lock, jobs_.size() > kMaxJobsPerThread * workers_.size());
+}
+
+void JarStripperProcessor::Finish() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!jobs_.empty()) {
+    WriteDone(lock, true);
+  }
+}
+
+void JarStripperProcessor::WriteDone(std::unique_lock<std::mutex> &lock,
+                                     bool wait) {
+  if (wait) {
+    done_.wait(lock, [this] { return jobs_.front()->done; });
+  }
+  while (!jobs_.empty() && jobs_.front()->done) {
+    std::unique_ptr<Job> job = std::move(jobs_.front());
+    jobs_.pop_front();
+    // The workers do not touch the done jobs, the output can be written
+    // without holding the lock.
+    lock.unlock();
+    if (job->keep) {
+      Write(job->filename.c_str(), job->output.data(), job->output.size());
+    }
+    lock.lock();
+  }
+}
+
+void JarStripperProcessor::WorkerLoop() {
+  // The decompressors reuse their buffers, so each thread has its own.
+  Decompressor inflater;
+  ZstdDecompressor zstd_decompressor;
+  for (;;) {
+    Job *job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.wait(lock, [this] { return shutdown_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      job = queue_.front();
+      queue_.pop_front();
+    }
+    const u1 *data = job->input.data();
+    size_t size = job->input.size();
+    if (job->method != Job::kStored) {
+      DecompressedFile *decompressed =
+          job->method == Job::kZstd
+              ? zstd_decompressor.UncompressFile(data, size,
+                                                 job->uncompressed_size)
+              : inflater.UncompressFile(data, size);
+      if (decompressed == NULL) {
+        fprintf(stderr, "%s: %s\n", job->filename.c_str(),
+                job->method == Job::kZstd ? zstd_decompressor.GetError()
+                                          : inflater.GetError());
+        abort();
+      }
+      data = decompressed->uncompressed_data;
+      size = decompressed->uncompressed_size;
+      free(decompressed);
+    }
+    if (IsCopied(job->filename.c_str())) {
+      job->output.assign(data, data + size);
+      job->keep = true;
+    } else {
+      job->keep = StripClassToVector(data, size, &job->output);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job->done = true;
+    }
+    done_.notify_one();
   }
 }
 
@@ -216,7 +426,11 @@ void JarStripperProcessor::WriteManifest(const char *target_label,
 
 class JarCopierProcessor : public JarExtractorProcessor {
  public:
-  JarCopierProcessor(const char *jar) : jar_(jar) {}
+  JarCopierProcessor(const char *jar)
+      : jar_(jar), jar_data_(NULL), jar_size_(0) {}
+  // Reads the manifest from the jar held in memory rather than from a file.
+  JarCopierProcessor(const u1 *jar_data, size_t jar_size)
+      : jar_(NULL), jar_data_(jar_data), jar_size_(jar_size) {}
   virtual ~JarCopierProcessor() {}
 
   virtual void Process(const char *filename, u4 /*attr*/, const u1 *data,
@@ -248,6 +462,8 @@ class JarCopierProcessor : public JarExtractorProcessor {
   };
 
   const char *jar_;
+  const u1 *jar_data_;
+  size_t jar_size_;
 
   u1 *AppendTargetLabelToManifest(u1 *buf, const u1 *manifest_data, size_t size,
                                   const char *target_label,
@@ -266,7 +482,7 @@ void JarCopierProcessor::Process(const char *filename, const u4 /*attr*/,
   }
   u1 *q = builder_->NewFile(filename, 0);
   memcpy(q, data, size);
-  builder_->FinishFile(size, /* compress: */ false, /* compute_crc: */ true);
+  builder_->FinishFile(size, /* compress: */ zstd, /* compute_crc: */ true);
 }
 
 bool JarCopierProcessor::Accept(const char * /*filename*/, const u4 /*attr*/) {
@@ -277,7 +493,9 @@ void JarCopierProcessor::WriteManifest(const char *target_label,
                                        const char *injecting_rule_kind) {
   ManifestLocator manifest_locator;
   std::unique_ptr<ZipExtractor> in(
-      ZipExtractor::Create(jar_, &manifest_locator));
+      jar_ != NULL
+          ? ZipExtractor::Create(jar_, &manifest_locator)
+          : ZipExtractor::Create(jar_data_, jar_size_, &manifest_locator));
   in->ProcessAll();
 
   bool wants_manifest =
@@ -377,47 +595,50 @@ static size_t EstimateManifestOutputSize(const char *target_label,
   return length;
 }
 
-// Opens "file_in" (a .jar file) for reading, and writes an interface
-// .jar to "file_out".
-static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
-                                   bool strip_jar, const char *target_label,
-                                   const char *injecting_rule_kind) {
-  std::unique_ptr<JarExtractorProcessor> processor;
+// Creates the processor writing the interface jar of the given input jar,
+// which is either the file "file_in" or the "jar_size" bytes at "jar".
+static std::unique_ptr<JarExtractorProcessor> NewProcessor(
+    bool strip_jar, const char *file_in, const u1 *jar, size_t jar_size) {
   if (strip_jar) {
-    processor =
-        std::unique_ptr<JarExtractorProcessor>(new JarStripperProcessor());
+    return std::unique_ptr<JarExtractorProcessor>(
+        new JarStripperProcessor(threads));
+  } else if (file_in != NULL) {
+    return std::unique_ptr<JarExtractorProcessor>(
+        new JarCopierProcessor(file_in));
   } else {
-    processor =
-        std::unique_ptr<JarExtractorProcessor>(new JarCopierProcessor(file_in));
-  }
-  std::unique_ptr<ZipExtractor> in(
-      ZipExtractor::Create(file_in, processor.get()));
-  if (in == NULL) {
-    fprintf(stderr, "Unable to open Zip file %s: %s\n", file_in,
-            strerror(errno));
-    abort();
+    return std::unique_ptr<JarExtractorProcessor>(
+        new JarCopierProcessor(jar, jar_size));
   }
+}
+
+// Returns the size the interface jar of "in" may grow to.
+static u8 EstimateOutputLength(ZipExtractor *in, const char *target_label,
+                               const char *injecting_rule_kind) {
   u8 output_length = in->CalculateOutputLength();
   if (output_length < JAR_WITH_DUMMY_FILE_SIZE) {
     output_length = JAR_WITH_DUMMY_FILE_SIZE;
   }
-  output_length +=
-      EstimateManifestOutputSize(target_label, injecting_rule_kind);
+  return output_length +
+         EstimateManifestOutputSize(target_label, injecting_rule_kind);
+}
 
-  std::unique_ptr<ZipBuilder> out(ZipBuilder::Create(file_out, output_length));
-  if (out == NULL) {
-    fprintf(stderr, "Unable to open output file %s: %s\n", file_out,
-            strerror(errno));
-    abort();
+// Writes the interface jar of "in", which feeds "processor", to "out".
+// Returns false and sets *error on failure.
+static bool ProcessJar(ZipExtractor *in, JarExtractorProcessor *processor,
+                       ZipBuilder *out, const char *target_label,
+                       const char *injecting_rule_kind, std::string *error) {
+  if (zstd) {
+    out->UseZstd();
   }
-  processor->SetZipBuilder(out.get());
+  processor->SetZipBuilder(out);
   processor->WriteManifest(target_label, injecting_rule_kind);
 
   // Process all files in the zip
   if (in->ProcessAll() < 0) {
-    fprintf(stderr, "%s\n", in->GetError());
-    abort();
+    *error = in->GetError();
+    return false;
   }
+  processor->Finish();
 
   // Add dummy file, since javac doesn't like truly empty jars.
   if (out->GetNumberFiles() == 0) {
@@ -425,90 +646,128 @@ static void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
   }
   // Finish writing the output file
   if (out->Finish() < 0) {
-    fprintf(stderr, "%s\n", out->GetError());
+    *error = out->GetError();
+    return false;
+  }
+  return true;
+}
+
+// Returns true if the file at "path" consists of the "size" bytes at "data".
+static bool FileHasContents(const char *path, const u1 *data, size_t size) {
+  MappedInputFile file(path);
+  if (!file.Opened()) {
+    return false;
+  }
+  bool result =
+      file.Length() == size && memcmp(file.Buffer(), data, size) == 0;
+  file.Close();
+  return result;
+}
+
+void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
+                            bool strip_jar, const char *target_label,
+                            const char *injecting_rule_kind) {
+  std::unique_ptr<JarExtractorProcessor> processor =
+      NewProcessor(strip_jar, file_in, NULL, 0);
+  std::unique_ptr<ZipExtractor> in(
+      ZipExtractor::Create(file_in, processor.get()));
+  if (in == NULL) {
+    fprintf(stderr, "Unable to open Zip file %s: %s\n", file_in,
+            strerror(errno));
+    abort();
+  }
+  u8 output_length =
+      EstimateOutputLength(in.get(), target_label, injecting_rule_kind);
+
+  // With --keep_unchanged_output, the interface jar is built in memory and
+  // only written once it is known to differ from the existing output.
+  std::unique_ptr<u1[]> buffer;
+  std::unique_ptr<ZipBuilder> out;
+  if (keep_unchanged_output) {
+    buffer.reset(new u1[output_length]);
+    out.reset(ZipBuilder::Create(buffer.get(), output_length));
+  } else {
+    out.reset(ZipBuilder::Create(file_out, output_length));
+  }
+  if (out == NULL) {
+    fprintf(stderr, "Unable to open output file %s: %s\n", file_out,
+            strerror(errno));
+    abort();
+  }
+  std::string error;
+  if (!ProcessJar(in.get(), processor.get(), out.get(), target_label,
+                  injecting_rule_kind, &error)) {
+    fprintf(stderr, "%s\n", error.c_str());
     abort();
   }
   // Get all file size
   size_t in_length = in->GetSize();
   size_t out_length = out->GetSize();
+  if (keep_unchanged_output) {
+    if (FileHasContents(file_out, buffer.get(), out_length)) {
+      if (verbose) {
+        fprintf(stderr, "INFO: interface jar %s is unchanged.\n", file_out);
+      }
+      return;
+    }
+    MappedOutputFile output_file(file_out, out_length);
+    if (!output_file.Opened()) {
+      fprintf(stderr, "Unable to open output file %s: %s\n", file_out,
+              output_file.Error());
+      abort();
+    }
+    memcpy(output_file.Buffer(), buffer.get(), out_length);
+    if (output_file.Close(out_length) < 0) {
+      fprintf(stderr, "Unable to write output file %s: %s\n", file_out,
+              output_file.Error());
+      abort();
+    }
+  }
   if (verbose) {
     fprintf(stderr, "INFO: produced interface jar: %s -> %s (%d%%).\n", file_in,
             file_out, static_cast<int>(100.0 * out_length / in_length));
   }
 }
-}  // namespace devtools_ijar
 
-//
-// main method
-//
-static void usage() {
-  fprintf(stderr,
-          "Usage: ijar "
-          "[-v] [--[no]strip_jar] "
-          "[--target label label] [--injecting_rule_kind kind] "
-          "x.jar [x_interface.jar>]\n");
-  fprintf(stderr, "Creates an interface jar from the specified jar file.\n");
-  exit(1);
-}
-
-int main(int argc, char **argv) {
-  bool strip_jar = true;
-  const char *target_label = NULL;
-  const char *injecting_rule_kind = NULL;
-  const char *filename_in = NULL;
-  const char *filename_out = NULL;
-
-  for (int ii = 1; ii < argc; ++ii) {
-    if (strcmp(argv[ii], "-v") == 0) {
-      devtools_ijar::verbose = true;
-    } else if (strcmp(argv[ii], "--strip_jar") == 0) {
-      strip_jar = true;
-    } else if (strcmp(argv[ii], "--nostrip_jar") == 0) {
-      strip_jar = false;
-    } else if (strcmp(argv[ii], "--target_label") == 0) {
-      if (++ii >= argc) {
-        usage();
-      }
-      target_label = argv[ii];
-    } else if (strcmp(argv[ii], "--injecting_rule_kind") == 0) {
-      if (++ii >= argc) {
-        usage();
-      }
-      injecting_rule_kind = argv[ii];
-    } else if (filename_in == NULL) {
-      filename_in = argv[ii];
-    } else if (filename_out == NULL) {
-      filename_out = argv[ii];
-    } else {
-      usage();
-    }
+bool ProcessJarInMemory(const u1 *jar, size_t jar_size, bool strip_jar,
+                        const char *target_label,
+                        const char *injecting_rule_kind, u1 *out,
+                        size_t out_capacity, size_t *out_size,
+                        std::string *error) {
+  std::unique_ptr<JarExtractorProcessor> processor =
+      NewProcessor(strip_jar, NULL, jar, jar_size);
+  std::unique_ptr<ZipExtractor> in(
+      ZipExtractor::Create(jar, jar_size, processor.get()));
+  if (in == NULL) {
+    *error = "Unable to read the input jar";
+    return false;
   }
-
-  if (filename_in == NULL) {
-    usage();
+  u8 output_length =
+      EstimateOutputLength(in.get(), target_label, injecting_rule_kind);
+
+  // The builder relies on the estimate not to overflow its buffer, so a
+  // caller's buffer smaller than that is only written once the interface
+  // jar is known to fit.
+  std::vector<u1> scratch;
+  u1 *buffer = out;
+  if (output_length > out_capacity) {
+    scratch.resize(output_length);
+    buffer = scratch.data();
   }
-
-  // Guess output filename from input:
-  char filename_out_buf[PATH_MAX];
-  if (filename_out == NULL) {
-    size_t len = strlen(filename_in);
-    if (len > 4 && strncmp(filename_in + len - 4, ".jar", 4) == 0) {
-      strcpy(filename_out_buf, filename_in);
-      strcpy(filename_out_buf + len - 4, "-interface.jar");
-      filename_out = filename_out_buf;
-    } else {
-      fprintf(stderr,
-              "Can't determine output filename since input filename "
-              "doesn't end with '.jar'.\n");
-      return 1;
-    }
+  std::unique_ptr<ZipBuilder> builder(ZipBuilder::Create(buffer, output_length));
+  if (!ProcessJar(in.get(), processor.get(), builder.get(), target_label,
+                  injecting_rule_kind, error)) {
+    return false;
   }
-
-  if (devtools_ijar::verbose) {
-    fprintf(stderr, "INFO: writing to '%s'.\n", filename_out);
+  *out_size = builder->GetSize();
+  if (*out_size > out_capacity) {
+    *error = "The interface jar does not fit in the output buffer";
+    return false;
   }
-
-  devtools_ijar::OpenFilesAndProcessJar(filename_out, filename_in, strip_jar,
-                                        target_label, injecting_rule_kind);
-  return 0;
+  if (buffer != out) {
+    memcpy(out, buffer, *out_size);
+  }
+  return true;
 }
+
+}  // namespace devtools_ijar
@@ -0,0 +1,62 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_IJAR_IJAR_H_
+#define THIRD_PARTY_IJAR_IJAR_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/strip_cache.h"
+
+namespace devtools_ijar {
+
+// The settings of all the jars processed, set from the flags by main().
+extern bool verbose;
+// Whether the entries of the output are compressed with Zstandard.
+extern bool zstd;
+// The number of threads stripping the classes.
+extern int threads;
+// The cache of the stripped classes, if any.
+extern std::unique_ptr<StripCache> strip_cache;
+// Whether an existing output that already has the contents of the interface
+// jar is left alone rather than rewritten, so that its timestamp does not
+// change and the actions depending on it need not digest it again.
+extern bool keep_unchanged_output;
+
+// Opens "file_in" (a .jar file) for reading, and writes an interface
+// .jar to "file_out". Aborts on error.
+void OpenFilesAndProcessJar(const char *file_out, const char *file_in,
+                            bool strip_jar, const char *target_label,
+                            const char *injecting_rule_kind);
+
+// Writes the interface jar of the "jar_size" bytes at "jar" to the
+// "out_capacity" bytes at "out", without going through files, for callers
+// such as persistent workers. The other arguments are as above.
+// Returns true on success, setting *out_size to the length of the
+// interface jar. Otherwise returns false and sets *error; if the interface
+// jar does not fit, *out_size is set to its length, for the call to be
+// retried with a large enough buffer. A malformed class file still aborts.
+bool ProcessJarInMemory(const u1 *jar, size_t jar_size, bool strip_jar,
+                        const char *target_label,
+                        const char *injecting_rule_kind, u1 *out,
+                        size_t out_capacity, size_t *out_size,
+                        std::string *error);
+
+}  // namespace devtools_ijar
+
+#endif  // THIRD_PARTY_IJAR_IJAR_H_
@@ -0,0 +1,116 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// ijar_main.cc -- the command line of the ijar tool, see ijar.h.
+//
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "third_party/ijar/ijar.h"
+#include "third_party/ijar/strip_cache.h"
+
+static void usage() {
+  fprintf(stderr,
+          "Usage: ijar "
+          "[-v] [--[no]strip_jar] [--zstd] [--threads n] [--cache_dir dir] "
+          "[--keep_unchanged_output] [--target label label] "
+          "[--injecting_rule_kind kind] "
+          "x.jar [x_interface.jar>]\n");
+  fprintf(stderr, "Creates an interface jar from the specified jar file.\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  bool strip_jar = true;
+  const char *target_label = NULL;
+  const char *injecting_rule_kind = NULL;
+  const char *filename_in = NULL;
+  const char *filename_out = NULL;
+
+  for (int ii = 1; ii < argc; ++ii) {
+    if (strcmp(argv[ii], "-v") == 0) {
+      devtools_ijar::verbose = true;
+    } else if (strcmp(argv[ii], "--strip_jar") == 0) {
+      strip_jar = true;
+    } else if (strcmp(argv[ii], "--nostrip_jar") == 0) {
+      strip_jar = false;
+    } else if (strcmp(argv[ii], "--zstd") == 0) {
+      devtools_ijar::zstd = true;
+    } else if (strcmp(argv[ii], "--threads") == 0) {
+      if (++ii >= argc) {
+        usage();
+      }
+      devtools_ijar::threads = atoi(argv[ii]);
+      if (devtools_ijar::threads < 1) {
+        usage();
+      }
+    } else if (strcmp(argv[ii], "--cache_dir") == 0) {
+      if (++ii >= argc) {
+        usage();
+      }
+      devtools_ijar::strip_cache.reset(
+          new devtools_ijar::StripCache(argv[ii]));
+    } else if (strcmp(argv[ii], "--keep_unchanged_output") == 0) {
+      devtools_ijar::keep_unchanged_output = true;
+    } else if (strcmp(argv[ii], "--target_label") == 0) {
+      if (++ii >= argc) {
+        usage();
+      }
+      target_label = argv[ii];
+    } else if (strcmp(argv[ii], "--injecting_rule_kind") == 0) {
+      if (++ii >= argc) {
+        usage();
+      }
+      injecting_rule_kind = argv[ii];
+    } else if (filename_in == NULL) {
+      filename_in = argv[ii];
+    } else if (filename_out == NULL) {
+      filename_out = argv[ii];
+    } else {
+      usage();
+    }
+  }
+
+  if (filename_in == NULL) {
+    usage();
+  }
+
+  // Guess output filename from input:
+  char filename_out_buf[PATH_MAX];
+  if (filename_out == NULL) {
+    size_t len = strlen(filename_in);
+    if (len > 4 && strncmp(filename_in + len - 4, ".jar", 4) == 0) {
+      strcpy(filename_out_buf, filename_in);
+      strcpy(filename_out_buf + len - 4, "-interface.jar");
+      filename_out = filename_out_buf;
+    } else {
+      fprintf(stderr,
+              "Can't determine output filename since input filename "
+              "doesn't end with '.jar'.\n");
+      return 1;
+    }
+  }
+
+  if (devtools_ijar::verbose) {
+    fprintf(stderr, "INFO: writing to '%s'.\n", filename_out);
+  }
+
+  devtools_ijar::OpenFilesAndProcessJar(filename_out, filename_in, strip_jar,
+                                        target_label, injecting_rule_kind);
+  return 0;
+}
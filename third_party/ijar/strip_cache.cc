@@ -0,0 +1,110 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "third_party/ijar/strip_cache.h"
+
+#include <stdio.h>
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "src/main/cpp/util/md5.h"
+#include "third_party/ijar/platform_utils.h"
+
+namespace devtools_ijar {
+
+// Part of the keys, to be changed whenever the output of StripClass()
+// changes, so that the results of an older ijar are not reused.
+static const char kCacheVersion[] = "ijar-strip-1";
+
+// The first byte of a cache file, followed by the stripped class if it is
+// kept.
+static const u1 kKeep = 'K';
+static const u1 kDrop = 'D';
+
+StripCache::StripCache(const char *dir) : dir_(dir) {
+  if (dir_.empty() || (dir_.back() != '/' && dir_.back() != '\\')) {
+    dir_ += '/';
+  }
+  // Any failure shows as a miss for every class. make_dirs() needs the parent
+  // of a relative single segment path spelled out.
+  bool absolute = dir_[0] == '/' || dir_[0] == '\\' ||
+                  (dir_.size() > 1 && dir_[1] == ':');
+  make_dirs((absolute ? dir_ : "./" + dir_).c_str(), 0755);
+}
+
+std::string StripCache::Key(const u1 *data, size_t size) {
+  blaze_util::Md5Digest digest;
+  digest.Update(kCacheVersion, sizeof(kCacheVersion));
+  digest.Update(data, size);
+  unsigned char result[blaze_util::Md5Digest::kDigestLength];
+  digest.Finish(result);
+  return digest.String();
+}
+
+bool StripCache::Get(const std::string &key, bool *keep,
+                     std::vector<u1> *out) const {
+  FILE *fp = fopen((dir_ + key).c_str(), "rb");
+  if (fp == NULL) {
+    return false;
+  }
+  std::vector<u1> contents;
+  u1 buf[16384];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    contents.insert(contents.end(), buf, buf + n);
+  }
+  bool ok = !ferror(fp) && !contents.empty() &&
+            (contents[0] == kKeep || (contents[0] == kDrop &&
+                                      contents.size() == 1));
+  fclose(fp);
+  if (!ok) {
+    return false;
+  }
+  *keep = contents[0] == kKeep;
+  out->assign(contents.begin() + 1, contents.end());
+  return true;
+}
+
+void StripCache::Put(const std::string &key, bool keep, const u1 *data,
+                     size_t size) const {
+  static std::atomic<int> counter(0);
+#ifdef _WIN32
+  int pid = _getpid();
+#else
+  int pid = getpid();
+#endif
+  std::string path = dir_ + key;
+  std::string tmp_path = path + ".tmp" + std::to_string(pid) + "_" +
+                         std::to_string(counter++);
+  FILE *fp = fopen(tmp_path.c_str(), "wb");
+  if (fp == NULL) {
+    return;
+  }
+  u1 tag = keep ? kKeep : kDrop;
+  bool ok = fwrite(&tag, 1, 1, fp) == 1 &&
+            (!keep || fwrite(data, 1, size, fp) == size);
+  ok = fclose(fp) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    // Another process may have just stored the same result.
+    remove(tmp_path.c_str());
+  }
+}
+
+}  // namespace devtools_ijar
@@ -0,0 +1,56 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_IJAR_STRIP_CACHE_H_
+#define THIRD_PARTY_IJAR_STRIP_CACHE_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "third_party/ijar/common.h"
+
+namespace devtools_ijar {
+
+// A local content-addressed cache of StripClass() results, so that the
+// classes unchanged since a previous run of ijar, whatever jar they came
+// from, are not parsed again. Each result is a file of the cache directory
+// named after the digest of the class file. The files are written to a
+// temporary name first and then renamed, so that concurrent ijar processes
+// may share the directory. The methods may be called from several threads.
+class StripCache {
+ public:
+  explicit StripCache(const char *dir);
+
+  // Returns the key of the given class file.
+  static std::string Key(const u1 *data, size_t size);
+
+  // Looks the result of stripping the class with the given key up. Returns
+  // true if it is found, setting *keep to the StripClass() return value and
+  // *out to the stripped class.
+  bool Get(const std::string &key, bool *keep, std::vector<u1> *out) const;
+
+  // Stores the result of stripping the class with the given key. Failures
+  // are ignored, other than making the next Get() miss.
+  void Put(const std::string &key, bool keep, const u1 *data,
+           size_t size) const;
+
+ private:
+  std::string dir_;
+};
+
+}  // namespace devtools_ijar
+
+#endif  // THIRD_PARTY_IJAR_STRIP_CACHE_H_
@@ -0,0 +1,517 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how fast ijar strips classes, on its own and as part of the whole
+// jar to interface jar pipeline. Usage:
+//   ijar_benchmark [--corpora tiny,huge,annotated,kotlin] [--jar PATH]...
+//                  [--threads N,...] [--scale N] [--iterations N]
+//
+// The corpora are jars generated in memory, shaped like real ones:
+//   tiny:      many small classes, a third of their methods private.
+//   huge:      a few generated classes with thousands of long methods.
+//   annotated: classes, fields and methods with several annotations each.
+//   kotlin:    classes with kotlin.Metadata annotations and a .kotlin_module.
+// --jar adds a jar from disk, and --scale multiplies the number of classes in
+// the generated jars.
+//
+// For each jar, it prints how many classes and megabytes of classes per
+// second StripClass() processes, and then ProcessJarInMemory() for each
+// number of --threads, along with the number of operator new calls and
+// allocated bytes per class.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/ijar.h"
+#include "third_party/ijar/zip.h"
+
+namespace devtools_ijar {
+bool StripClass(u1 *&classdata_out, const u1 *classdata_in, size_t in_length);
+}  // namespace devtools_ijar
+
+// Counts the allocations, which ijar makes with operator new only.
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> allocated_bytes(0);
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete[](void *p) noexcept { free(p); }
+
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+using devtools_ijar::u1;
+using devtools_ijar::u2;
+using devtools_ijar::u4;
+
+double MonotonicSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+std::vector<std::string> Split(const std::string &list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  for (std::string item; std::getline(stream, item, ',');) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+void Put1(std::string *out, u1 value) { out->push_back(value); }
+
+void Put2(std::string *out, u2 value) {
+  out->push_back(value >> 8);
+  out->push_back(value & 0xff);
+}
+
+void Put4(std::string *out, u4 value) {
+  Put2(out, value >> 16);
+  Put2(out, value & 0xffff);
+}
+
+// Writes a class file with the constant pool entries it needs, and Code and
+// RuntimeVisibleAnnotations attributes.
+class ClassWriter {
+ public:
+  struct Annotation {
+    std::string type;
+    // Element name and its value, which is an int if it only has digits, an
+    // array of strings if it contains '\n' (each one ending with it) and a
+    // string otherwise.
+    std::vector<std::pair<std::string, std::string>> elements;
+  };
+
+  ClassWriter(const std::string &name, const std::string &super_name)
+      : this_class_(Class(name)), super_class_(Class(super_name)) {}
+
+  void AddField(u2 access, const std::string &name,
+                const std::string &descriptor,
+                const std::vector<Annotation> &annotations) {
+    Put2(&fields_, access);
+    Put2(&fields_, Utf8(name));
+    Put2(&fields_, Utf8(descriptor));
+    Put2(&fields_, annotations.empty() ? 0 : 1);
+    AppendAnnotations(annotations, &fields_);
+    ++field_count_;
+  }
+
+  void AddMethod(u2 access, const std::string &name,
+                 const std::string &descriptor, size_t code_length,
+                 const std::vector<Annotation> &annotations) {
+    Put2(&methods_, access);
+    Put2(&methods_, Utf8(name));
+    Put2(&methods_, Utf8(descriptor));
+    Put2(&methods_, annotations.empty() ? 1 : 2);
+    Put2(&methods_, Utf8("Code"));
+    Put4(&methods_, 12 + code_length);
+    Put2(&methods_, 2);  // max_stack
+    Put2(&methods_, 4);  // max_locals
+    Put4(&methods_, code_length);
+    // iconst_0, then nops, then ireturn.
+    Put1(&methods_, 0x03);
+    methods_.append(code_length - 2, '\0');
+    Put1(&methods_, 0xac);
+    Put2(&methods_, 0);  // exception_table_length
+    Put2(&methods_, 0);  // attributes_count
+    AppendAnnotations(annotations, &methods_);
+    ++method_count_;
+  }
+
+  void AddClassAnnotations(const std::vector<Annotation> &annotations) {
+    class_annotations_ = annotations;
+  }
+
+  std::string Finish() {
+    std::string attributes;
+    AppendAnnotations(class_annotations_, &attributes);
+
+    std::string out;
+    Put4(&out, 0xcafebabe);
+    Put2(&out, 0);
+    Put2(&out, 52);
+    Put2(&out, constant_count_);
+    out += constant_pool_;
+    Put2(&out, 0x0021);  // ACC_PUBLIC | ACC_SUPER
+    Put2(&out, this_class_);
+    Put2(&out, super_class_);
+    Put2(&out, 0);  // interfaces_count
+    Put2(&out, field_count_);
+    out += fields_;
+    Put2(&out, method_count_);
+    out += methods_;
+    Put2(&out, class_annotations_.empty() ? 0 : 1);
+    out += attributes;
+    return out;
+  }
+
+ private:
+  u2 Utf8(const std::string &value) {
+    auto it = utf8_.find(value);
+    if (it != utf8_.end()) {
+      return it->second;
+    }
+    Put1(&constant_pool_, 1);
+    Put2(&constant_pool_, value.size());
+    constant_pool_ += value;
+    return utf8_[value] = constant_count_++;
+  }
+
+  u2 Class(const std::string &name) {
+    u2 name_index = Utf8(name);
+    Put1(&constant_pool_, 7);
+    Put2(&constant_pool_, name_index);
+    return constant_count_++;
+  }
+
+  u2 Integer(u4 value) {
+    Put1(&constant_pool_, 3);
+    Put4(&constant_pool_, value);
+    return constant_count_++;
+  }
+
+  void AppendElementValue(const std::string &value, std::string *out) {
+    if (value.find('\n') != std::string::npos) {
+      std::vector<std::string> strings;
+      std::stringstream stream(value);
+      for (std::string s; std::getline(stream, s);) {
+        strings.push_back(s);
+      }
+      Put1(out, '[');
+      Put2(out, strings.size());
+      for (const std::string &s : strings) {
+        Put1(out, 's');
+        Put2(out, Utf8(s));
+      }
+    } else if (!value.empty() &&
+               value.find_first_not_of("0123456789") == std::string::npos) {
+      Put1(out, 'I');
+      Put2(out, Integer(atoi(value.c_str())));
+    } else {
+      Put1(out, 's');
+      Put2(out, Utf8(value));
+    }
+  }
+
+  void AppendAnnotations(const std::vector<Annotation> &annotations,
+                         std::string *out) {
+    if (annotations.empty()) {
+      return;
+    }
+    std::string attribute;
+    Put2(&attribute, annotations.size());
+    for (const Annotation &annotation : annotations) {
+      Put2(&attribute, Utf8(annotation.type));
+      Put2(&attribute, annotation.elements.size());
+      for (const auto &[name, value] : annotation.elements) {
+        Put2(&attribute, Utf8(name));
+        AppendElementValue(value, &attribute);
+      }
+    }
+    Put2(out, Utf8("RuntimeVisibleAnnotations"));
+    Put4(out, attribute.size());
+    *out += attribute;
+  }
+
+  std::string constant_pool_;
+  u2 constant_count_ = 1;
+  std::map<std::string, u2> utf8_;
+  const u2 this_class_;
+  const u2 super_class_;
+  std::string fields_;
+  u2 field_count_ = 0;
+  std::string methods_;
+  u2 method_count_ = 0;
+  std::vector<Annotation> class_annotations_;
+};
+
+struct Jar {
+  std::string name;
+  std::vector<u1> data;
+  // The class files in it, for StripClass().
+  std::vector<std::string> classes;
+};
+
+std::string GenerateClass(const std::string &corpus, const std::string &name,
+                          int index) {
+  ClassWriter writer(name, "java/lang/Object");
+  if (corpus == "tiny") {
+    writer.AddField(0x0001, "value", "I", {});
+    writer.AddField(0x0002, "cache", "Ljava/lang/String;", {});
+    writer.AddMethod(0x0001, "get", "()I", 16, {});
+    writer.AddMethod(0x0001, "set", "(I)I", 16, {});
+    writer.AddMethod(0x0002, "compute", "(II)I", 32, {});
+  } else if (corpus == "huge") {
+    for (int i = 0; i < 2000; ++i) {
+      writer.AddMethod(i % 4 == 0 ? 0x0002 : 0x0001,
+                       "generated" + std::to_string(i), "(IJLjava/lang/Object;)I",
+                       500, {});
+    }
+  } else if (corpus == "annotated") {
+    const std::vector<ClassWriter::Annotation> annotations = {
+        {"Ljavax/inject/Inject;", {}},
+        {"Lcom/google/errorprone/annotations/CanIgnoreReturnValue;", {}},
+        {"Lcom/example/Config;",
+         {{"name", "value" + std::to_string(index)},
+          {"priority", std::to_string(index % 10)},
+          {"tags", "alpha\nbeta\ngamma\n"}}},
+    };
+    writer.AddClassAnnotations(annotations);
+    for (int i = 0; i < 4; ++i) {
+      writer.AddField(0x0001, "field" + std::to_string(i), "Ljava/util/List;",
+                      {annotations[2]});
+    }
+    for (int i = 0; i < 10; ++i) {
+      writer.AddMethod(0x0001, "method" + std::to_string(i),
+                       "(Ljava/lang/String;)I", 64, annotations);
+    }
+  } else if (corpus == "kotlin") {
+    std::string d1;
+    for (int i = 0; i < 8; ++i) {
+      d1 += std::string(256, 'a' + (index + i) % 26) + "\n";
+    }
+    writer.AddClassAnnotations({{"Lkotlin/Metadata;",
+                                 {{"mv", "1\n9\n0\n"},
+                                  {"k", "1"},
+                                  {"xi", "48"},
+                                  {"d1", d1},
+                                  {"d2", "L" + name + ";\nget\nset\n"}}}});
+    for (int i = 0; i < 5; ++i) {
+      writer.AddMethod(0x0011, "component" + std::to_string(i), "()I", 24,
+                       {{"Lorg/jetbrains/annotations/NotNull;", {}}});
+    }
+  } else {
+    fprintf(stderr, "Unknown corpus %s\n", corpus.c_str());
+    exit(1);
+  }
+  return writer.Finish();
+}
+
+Jar GenerateJar(const std::string &corpus, int scale) {
+  int count = corpus == "huge" ? 20 : corpus == "tiny" ? 10000 : 3000;
+  Jar jar;
+  jar.name = corpus;
+  size_t capacity = 1 << 20;
+  for (int i = 0; i < count * scale; ++i) {
+    jar.classes.push_back(GenerateClass(
+        corpus, "com/example/" + corpus + "/C" + std::to_string(i), i));
+    capacity += jar.classes.back().size() + 256;
+  }
+
+  jar.data.resize(capacity);
+  std::unique_ptr<devtools_ijar::ZipBuilder> builder(
+      devtools_ijar::ZipBuilder::Create(jar.data.data(), capacity));
+  auto add = [&](const std::string &path, const std::string &contents) {
+    u1 *buffer = builder->NewFile(path.c_str(), 0);
+    memcpy(buffer, contents.data(), contents.size());
+    if (builder->FinishFile(contents.size(), /* compress= */ true) < 0) {
+      fprintf(stderr, "Cannot write %s: %s\n", path.c_str(),
+              builder->GetError());
+      exit(1);
+    }
+  };
+  for (size_t i = 0; i < jar.classes.size(); ++i) {
+    add("com/example/" + corpus + "/C" + std::to_string(i) + ".class",
+        jar.classes[i]);
+  }
+  if (corpus == "kotlin") {
+    add("META-INF/main.kotlin_module", std::string(64, '\x01'));
+  }
+  if (builder->Finish() < 0) {
+    fprintf(stderr, "Cannot write the %s jar: %s\n", corpus.c_str(),
+            builder->GetError());
+    exit(1);
+  }
+  jar.data.resize(builder->GetSize());
+  return jar;
+}
+
+// Collects the class files of a jar.
+class ClassCollector : public devtools_ijar::ZipExtractorProcessor {
+ public:
+  explicit ClassCollector(std::vector<std::string> *classes)
+      : classes_(classes) {}
+
+  bool Accept(const char *filename, const u4 attr) override {
+    size_t length = strlen(filename);
+    return length > 6 && strcmp(filename + length - 6, ".class") == 0;
+  }
+
+  void Process(const char *filename, const u4 attr, const u1 *data,
+               const size_t size) override {
+    classes_->emplace_back(reinterpret_cast<const char *>(data), size);
+  }
+
+ private:
+  std::vector<std::string> *classes_;
+};
+
+Jar ReadJar(const std::string &path) {
+  Jar jar;
+  jar.name = path;
+  std::ifstream file(path, std::ios::binary);
+  jar.data.assign(std::istreambuf_iterator<char>(file),
+                  std::istreambuf_iterator<char>());
+  if (!file.good() && !file.eof()) {
+    fprintf(stderr, "Cannot read %s\n", path.c_str());
+    exit(1);
+  }
+  ClassCollector collector(&jar.classes);
+  std::unique_ptr<devtools_ijar::ZipExtractor> extractor(
+      devtools_ijar::ZipExtractor::Create(jar.data.data(), jar.data.size(),
+                                          &collector));
+  if (extractor == nullptr || extractor->ProcessAll() < 0) {
+    fprintf(stderr, "Cannot read the classes of %s\n", path.c_str());
+    exit(1);
+  }
+  return jar;
+}
+
+void PrintResult(const Jar &jar, const std::string &what, double seconds,
+                 int iterations, size_t class_bytes, uint64_t allocs,
+                 uint64_t alloc_bytes) {
+  double classes = static_cast<double>(jar.classes.size()) * iterations;
+  printf("%-12s %-12s %12.0f %10.1f %12.2f %14.0f\n", jar.name.c_str(),
+         what.c_str(), classes / seconds,
+         class_bytes * iterations / seconds / 1e6, allocs / classes,
+         alloc_bytes / classes);
+  fflush(stdout);
+}
+
+void Benchmark(const Jar &jar, const std::vector<std::string> &threads,
+               int iterations) {
+  size_t class_bytes = 0;
+  size_t largest_class = 0;
+  for (const std::string &c : jar.classes) {
+    class_bytes += c.size();
+    largest_class = std::max(largest_class, c.size());
+  }
+
+  std::vector<u1> stripped(largest_class);
+  uint64_t allocs = allocations, bytes = allocated_bytes;
+  double start = MonotonicSeconds();
+  for (int i = 0; i < iterations; ++i) {
+    for (const std::string &c : jar.classes) {
+      u1 *out = stripped.data();
+      devtools_ijar::StripClass(out, reinterpret_cast<const u1 *>(c.data()),
+                                c.size());
+    }
+  }
+  PrintResult(jar, "StripClass", MonotonicSeconds() - start, iterations,
+              class_bytes, allocations - allocs, allocated_bytes - bytes);
+
+  // The interface jar stores the stripped classes uncompressed.
+  std::vector<u1> out(jar.data.size() + class_bytes + (1 << 20));
+  for (const std::string &t : threads) {
+    devtools_ijar::threads = atoi(t.c_str());
+    allocs = allocations;
+    bytes = allocated_bytes;
+    start = MonotonicSeconds();
+    for (int i = 0; i < iterations; ++i) {
+      size_t out_size;
+      std::string error;
+      if (!devtools_ijar::ProcessJarInMemory(
+              jar.data.data(), jar.data.size(), /* strip_jar= */ true,
+              "//benchmark", "java_library", out.data(), out.size(),
+              &out_size, &error)) {
+        fprintf(stderr, "Cannot process %s: %s\n", jar.name.c_str(),
+                error.c_str());
+        exit(1);
+      }
+    }
+    PrintResult(jar, "jar_t" + t, MonotonicSeconds() - start, iterations,
+                class_bytes, allocations - allocs, allocated_bytes - bytes);
+  }
+}
+
+void Usage() {
+  fprintf(stderr,
+          "Usage: ijar_benchmark [--corpora tiny,huge,annotated,kotlin] "
+          "[--jar PATH]... [--threads N,...] [--scale N] [--iterations N]\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::string corpora = "tiny,huge,annotated,kotlin";
+  std::vector<std::string> jar_paths;
+  std::string threads = "1,4";
+  int scale = 1;
+  int iterations = 5;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    std::string flag = argv[i];
+    const char *value = argv[++i];
+    if (flag == "--corpora") {
+      corpora = value;
+    } else if (flag == "--jar") {
+      jar_paths.push_back(value);
+    } else if (flag == "--threads") {
+      threads = value;
+    } else if (flag == "--scale") {
+      scale = atoi(value);
+    } else if (flag == "--iterations") {
+      iterations = atoi(value);
+    } else {
+      Usage();
+    }
+  }
+  if (scale < 1 || iterations < 1) {
+    Usage();
+  }
+
+  printf("%-12s %-12s %12s %10s %12s %14s\n", "jar", "operation",
+         "classes/s", "MB/s", "allocs/class", "alloc_B/class");
+  for (const std::string &corpus : Split(corpora)) {
+    Benchmark(GenerateJar(corpus, scale), Split(threads), iterations);
+  }
+  for (const std::string &path : jar_paths) {
+    Benchmark(ReadJar(path), Split(threads), iterations);
+  }
+  return 0;
+}
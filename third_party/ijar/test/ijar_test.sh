@@ -611,6 +611,57 @@ function test_keep_for_compile() {
   check_eq 2 $lines "Output jar should have kept method body"
 }
 
+function test_threads() {
+  # Check that the output does not depend on the number of threads
+  $IJAR $NESTMATES_JAR $TEST_TMPDIR/serial.jar || fail "ijar failed"
+  $IJAR --threads 4 $NESTMATES_JAR $TEST_TMPDIR/parallel.jar \
+    || fail "ijar --threads failed"
+  cmp $TEST_TMPDIR/serial.jar $TEST_TMPDIR/parallel.jar \
+    || fail "--threads changed the output"
+
+  # Check that unsupported attribute warnings are still only emitted once
+  $IJAR --threads 4 $DUPLICATEDUNSUPPORTEDATTRIBUTE_JAR \
+    $DUPLICATEDUNSUPPORTEDATTRIBUTE_IJAR >& $TEST_log || fail "ijar failed"
+  expect_log_once 'skipping unknown attribute: "some_unknown_type"'
+}
+
+function test_cache_dir() {
+  # Check that the cached results give the same output
+  $IJAR $NESTMATES_JAR $TEST_TMPDIR/uncached.jar || fail "ijar failed"
+  $IJAR --cache_dir $TEST_TMPDIR/cache $NESTMATES_JAR $TEST_TMPDIR/cold.jar \
+    || fail "ijar --cache_dir failed"
+  [[ -n "$(ls $TEST_TMPDIR/cache)" ]] || fail "nothing cached"
+  $IJAR --cache_dir $TEST_TMPDIR/cache $NESTMATES_JAR $TEST_TMPDIR/warm.jar \
+    || fail "ijar --cache_dir failed"
+  cmp $TEST_TMPDIR/uncached.jar $TEST_TMPDIR/cold.jar \
+    || fail "--cache_dir changed the output"
+  cmp $TEST_TMPDIR/uncached.jar $TEST_TMPDIR/warm.jar \
+    || fail "the cached classes changed the output"
+}
+
+function test_keep_unchanged_output() {
+  local -r out=$TEST_TMPDIR/kept.jar
+  $IJAR $NESTMATES_JAR $TEST_TMPDIR/expected.jar || fail "ijar failed"
+
+  # A missing or different output is written.
+  rm -f $out
+  $IJAR --keep_unchanged_output $NESTMATES_JAR $out \
+    || fail "ijar --keep_unchanged_output failed"
+  cmp $TEST_TMPDIR/expected.jar $out || fail "wrong output"
+  echo "garbage" > $out
+  $IJAR --keep_unchanged_output $NESTMATES_JAR $out \
+    || fail "ijar --keep_unchanged_output failed"
+  cmp $TEST_TMPDIR/expected.jar $out || fail "the output was not rewritten"
+
+  # An identical output is left alone.
+  touch -t 200001010000 $out
+  $IJAR -v --keep_unchanged_output $NESTMATES_JAR $out >& $TEST_log \
+    || fail "ijar --keep_unchanged_output failed"
+  expect_log "is unchanged"
+  [[ -z "$(find $out -newermt 2000-01-02)" ]] || fail "the output was rewritten"
+  cmp $TEST_TMPDIR/expected.jar $out || fail "wrong output"
+}
+
 function test_central_dir_largest_regular() {
   $IJAR $CENTRAL_DIR_LARGEST_REGULAR $TEST_TMPDIR/ijar.jar || fail "ijar failed"
   $ZIP_COUNT $TEST_TMPDIR/ijar.jar 65535 || fail
@@ -168,6 +168,56 @@ function test_zipper_compression() {
       || fail "Unzip after zipper output differ"
 }
 
+function test_zipper_many_files() {
+  local -r test_dir="${TEST_TMPDIR}/${FUNCNAME[0]}"
+  mkdir -p ${test_dir}/in
+  for i in $(seq 1 200); do
+    mkdir -p ${test_dir}/in/dir$((i % 10))
+    seq 1 $((i * 10)) > ${test_dir}/in/dir$((i % 10))/file$i
+  done
+  local filelist="$(cd ${test_dir} && find in -type f)"
+
+  (cd ${test_dir} && ${ZIPPER} cC ${test_dir}/output.zip ${filelist})
+  $UNZIP -Z1 ${test_dir}/output.zip > ${test_dir}/entries
+  echo "${filelist}" | diff - ${test_dir}/entries &> $TEST_log \
+      || fail "Zip entries are not in the input order"
+
+  mkdir -p ${test_dir}/out
+  (cd ${test_dir}/out && ${ZIPPER} x ${test_dir}/output.zip)
+  diff -r ${test_dir}/in ${test_dir}/out/in &> $TEST_log \
+      || fail "Unzip using zipper after zipper output differ"
+}
+
+function test_zipper_index() {
+  local -r test_dir="${TEST_TMPDIR}/${FUNCNAME[0]}"
+  mkdir -p ${test_dir}/in/a ${test_dir}/in/b
+  echo "toto" > ${test_dir}/in/a/toto
+  echo "titi" > ${test_dir}/in/b/titi
+  echo "tata" > ${test_dir}/in/tata
+
+  (cd ${test_dir} && ${ZIPPER} cCi ${test_dir}/output.zip in/tata in/b/titi \
+      in/a/toto)
+  test -f ${test_dir}/output.zip.idx || fail "Index was not written"
+  ${ZIPPER} v ${test_dir}/output.zip > ${test_dir}/with_index
+  mv ${test_dir}/output.zip.idx ${test_dir}/index
+  ${ZIPPER} v ${test_dir}/output.zip > ${test_dir}/without_index
+  diff ${test_dir}/with_index ${test_dir}/without_index &> $TEST_log \
+      || fail "Listing with an index differs"
+
+  mv ${test_dir}/index ${test_dir}/output.zip.idx
+  mkdir -p ${test_dir}/out
+  (cd ${test_dir}/out && ${ZIPPER} x ${test_dir}/output.zip in/a/toto in/tata)
+  diff ${test_dir}/in/a/toto ${test_dir}/out/in/a/toto &> $TEST_log \
+      || fail "in/a/toto differs"
+  diff ${test_dir}/in/tata ${test_dir}/out/in/tata &> $TEST_log \
+      || fail "in/tata differs"
+  test -e ${test_dir}/out/in/b/titi && fail "in/b/titi should not be extracted"
+
+  (cd ${test_dir} && ${ZIPPER} c ${test_dir}/output.zip in/tata)
+  test -e ${test_dir}/output.zip.idx && fail "Stale index was not removed"
+  true
+}
+
 function test_zipper_specify_path() {
   mkdir -p ${TEST_TMPDIR}/files
   echo "toto" > ${TEST_TMPDIR}/files/a.txt
@@ -31,13 +31,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <algorithm>
 #include <limits>
+#include <string>
 #include <vector>
 
 #include "third_party/ijar/mapped_file.h"
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
 #include "third_party/ijar/zlib_client.h"
+#include "third_party/ijar/zstd_client.h"
 
 #define LOCAL_FILE_HEADER_SIGNATURE   0x04034b50
 #define CENTRAL_FILE_HEADER_SIGNATURE 0x02014b50
@@ -49,6 +52,17 @@
 #define DATA_DESCRIPTOR_SIGNATURE     0x08074b50
 #define ZIP64_EXTRA_FIELD_TAG 0x0001
 
+// The ZipIndex file starts with a header: magic, version, size of the ZIP
+// file and number of entries. It is followed by the entries in the order of
+// the ZIP file: offset of the local header, compressed size, uncompressed size,
+// crc32, external attributes, offset in the names and length of the name. Then
+// come the indices of the entries sorted by name, and the null-terminated
+// names of the entries.
+#define ZIP_INDEX_MAGIC 0x5844495a  // "ZIDX"
+#define ZIP_INDEX_VERSION 1
+#define ZIP_INDEX_HEADER_SIZE 24
+#define ZIP_INDEX_ENTRY_SIZE 40
+
 #define U2_MAX 0xffff
 #define U4_MAX 0xffffffffUL
 
@@ -61,6 +75,7 @@
 #define ZIP_VERSION_TO_EXTRACT                10
 #define COMPRESSION_METHOD_STORED             0   // no compression
 #define COMPRESSION_METHOD_DEFLATED           8
+#define COMPRESSION_METHOD_ZSTD              93
 
 #define GENERAL_PURPOSE_BIT_FLAG_COMPRESSED (1 << 3)
 #define GENERAL_PURPOSE_BIT_FLAG_UTF8_ENCODED (1 << 11)
@@ -95,10 +110,13 @@ class InputZipFile : public ZipExtractor {
   }
 
   bool Open();
+  // Reads the zip file from memory rather than mapping filename.
+  bool Open(const u1 *zipdata, size_t length);
   virtual bool ProcessNext();
+  virtual bool ProcessEntry(const ZipIndexEntry &entry);
   virtual void Reset();
   virtual size_t GetSize() {
-    return input_file_->Length();
+    return zipdata_length_;
   }
 
   virtual u8 CalculateOutputLength();
@@ -111,12 +129,14 @@ class InputZipFile : public ZipExtractor {
  private:
   ZipExtractorProcessor *processor;
   const char* filename_;
+  // Null if the zip file is read from memory.
   MappedInputFile *input_file_;
 
   // InputZipFile is responsible for maintaining the following
   // pointers. They are allocated by the Create() method before
   // the object is actually created using mmap.
   const u1 * zipdata_in_;   // start of input file mmap
+  size_t zipdata_length_;   // length of the input file
   size_t bytes_unmapped_;         // bytes that have already been unmapped
   const u1 * central_dir_;  // central directory in input file
 
@@ -158,6 +178,8 @@ class InputZipFile : public ZipExtractor {
   char errmsg[4*PATH_MAX];
 
   Decompressor *decompressor_;
+  // Created on the first Zstandard entry.
+  ZstdDecompressor *zstd_decompressor_;
 
   int error(const char *fmt, ...) {
     va_list ap;
@@ -172,7 +194,7 @@ class InputZipFile : public ZipExtractor {
   // we're about to read, for diagnostics.
   int EnsureRemaining(size_t n, const char *state) {
     size_t in_offset = p - zipdata_in_;
-    size_t remaining = input_file_->Length() - in_offset;
+    size_t remaining = zipdata_length_ - in_offset;
     if (n > remaining) {
       return error("Premature end of file (at offset %zd, state=%s); "
                    "expected %zd more bytes but found %zd.\n",
@@ -181,10 +203,14 @@ class InputZipFile : public ZipExtractor {
     return 0;
   }
 
+  // Process the entry whose local file header is at "offset", with the sizes
+  // from the central directory.
+  bool ProcessLocalFileAt(u8 offset, u8 compressed_size, u8 uncompressed_size);
+
   // Read one entry from input zip file
   int ProcessLocalFileEntry(size_t compressed_size, size_t uncompressed_size);
 
-  // Uncompress a file from the archive using zlib. The pointer returned
+  // Uncompress a file from the archive using zlib or zstd. The pointer returned
   // is owned by InputZipFile, so it must not be freed. Advances the input
   // cursor to the first byte after the compressed data.
   u1* UncompressFile();
@@ -205,8 +231,21 @@ class OutputZipFile : public ZipBuilder {
       : output_file_(NULL),
         filename_(filename),
         estimated_size_(estimated_size),
-        finished_(false) {
+        finished_(false),
+        zstd_(false) {
+    errmsg[0] = 0;
+  }
+
+  // Writes the zip file to the given buffer rather than to filename.
+  OutputZipFile(u1 *buffer, size_t capacity)
+      : output_file_(NULL),
+        filename_(NULL),
+        estimated_size_(capacity),
+        finished_(false),
+        zstd_(false) {
     errmsg[0] = 0;
+    q = buffer;
+    zipdata_out_ = buffer;
   }
 
   virtual const char* GetError() {
@@ -220,13 +259,18 @@ class OutputZipFile : public ZipBuilder {
   virtual u1 *NewFile(const char *filename, u4 attr);
   virtual int FinishFile(size_t filelength, bool compress = false,
                          bool compute_crc = false);
+  virtual int WriteCompressedFile(const char *filename, const u4 attr,
+                                  const u1 *data, size_t compressed_length,
+                                  size_t uncompressed_length, u4 crc);
   virtual int WriteEmptyFile(const char *filename);
+  virtual void UseZstd() { zstd_ = true; }
   virtual size_t GetSize() {
     return Offset(q);
   }
   virtual int GetNumberFiles() {
     return entries_.size();
   }
+  virtual int WriteIndex(const char *index_file);
   virtual int Finish();
   bool Open();
 
@@ -257,10 +301,13 @@ class OutputZipFile : public ZipBuilder {
     u2 extra_field_length;
   };
 
+  // Null if the zip file is written to memory.
   MappedOutputFile* output_file_;
   const char* filename_;
   size_t estimated_size_;
   bool finished_;
+  // Whether FinishFile() compresses with zstd rather than deflate.
+  bool zstd_;
 
   // OutputZipFile is responsible for maintaining the following
   // pointers. They are allocated by the Create() method before
@@ -319,6 +366,40 @@ bool InputZipFile::ProcessNext() {
     return false;
   }
 
+  return ProcessLocalFileAt(offset, compressed, uncompressed);
+}
+
+bool InputZipFile::ProcessEntry(const ZipIndexEntry &entry) {
+  size_t name_length = strlen(entry.name);
+  if (name_length >= PATH_MAX) {
+    error("file name too long in index: %s\n", entry.name);
+    return false;
+  }
+  memcpy(filename, entry.name, name_length + 1);
+  attr = entry.attr;
+
+  // Check that the index was written for this zip file before trusting it.
+  const size_t kNameOffset = 26;
+  if (in_offset_ + entry.local_header_offset > zipdata_length_) {
+    error("index entry %s is out of the zip file\n", filename);
+    return false;
+  }
+  p = zipdata_in_ + in_offset_ + entry.local_header_offset;
+  if (EnsureRemaining(kNameOffset + 4 + name_length, "index entry") < 0) {
+    return false;
+  }
+  const u1 *header = p + kNameOffset;
+  if (get_u2le(header) != name_length ||
+      memcmp(header + 2, entry.name, name_length) != 0) {
+    error("index entry %s does not match the zip file\n", filename);
+    return false;
+  }
+  return ProcessLocalFileAt(entry.local_header_offset, entry.compressed_size,
+                            entry.uncompressed_size);
+}
+
+bool InputZipFile::ProcessLocalFileAt(u8 offset, u8 compressed,
+                                      u8 uncompressed) {
   // There might be an offset specified in the central directory that does
   // not match the file offset, so always update our pointer.
   p = zipdata_in_ + in_offset_ + offset;
@@ -355,6 +436,7 @@ int InputZipFile::ProcessLocalFileEntry(
   compression_method_ = get_u2le(p);
 
   if (compression_method_ != COMPRESSION_METHOD_DEFLATED &&
+      compression_method_ != COMPRESSION_METHOD_ZSTD &&
       compression_method_ != COMPRESSION_METHOD_STORED) {
     return error("Unsupported compression method (%d).\n",
                  compression_method_);
@@ -379,7 +461,7 @@ int InputZipFile::ProcessLocalFileEntry(
   extra_field_ = p;
   p += extra_field_length_;
 
-  bool is_compressed = compression_method_ == COMPRESSION_METHOD_DEFLATED;
+  bool is_compressed = compression_method_ != COMPRESSION_METHOD_STORED;
 
   // If the zip is compressed, compressed and uncompressed size members are
   // zero in the local file header. If not, check that they are the same as the
@@ -425,7 +507,8 @@ int InputZipFile::ProcessLocalFileEntry(
   }
 
   size_t bytes_processed = p - zipdata_in_;
-  if (bytes_processed > bytes_unmapped_ + MAX_MAPPED_REGION) {
+  if (input_file_ != NULL &&
+      bytes_processed > bytes_unmapped_ + MAX_MAPPED_REGION) {
     input_file_->Discard(MAX_MAPPED_REGION);
     bytes_unmapped_ += MAX_MAPPED_REGION;
   }
@@ -451,13 +534,28 @@ int InputZipFile::SkipFile(const bool compressed) {
 }
 
 u1* InputZipFile::UncompressFile() {
-  size_t in_offset = p - zipdata_in_;
-  size_t remaining = input_file_->Length() - in_offset;
-  DecompressedFile *decompressed_file =
-      decompressor_->UncompressFile(p, remaining);
+  DecompressedFile *decompressed_file;
+  char *decompressor_error;
+  if (compression_method_ == COMPRESSION_METHOD_ZSTD) {
+    if (EnsureRemaining(compressed_size_, "file_data") < 0) {
+      return NULL;
+    }
+    if (zstd_decompressor_ == NULL) {
+      zstd_decompressor_ = new ZstdDecompressor();
+    }
+    decompressed_file = zstd_decompressor_->UncompressFile(
+        p, compressed_size_, uncompressed_size_);
+    decompressor_error = zstd_decompressor_->GetError();
+  } else {
+    size_t in_offset = p - zipdata_in_;
+    size_t remaining = zipdata_length_ - in_offset;
+    decompressed_file =
+        decompressor_->UncompressFile(p, remaining, uncompressed_size_);
+    decompressor_error = decompressor_->GetError();
+  }
   if (decompressed_file == NULL) {
-    if (decompressor_->GetError() != NULL) {
-      error(decompressor_->GetError());
+    if (decompressor_error != NULL) {
+      error("%s", decompressor_error);
     }
     return NULL;
   } else {
@@ -472,6 +570,16 @@ u1* InputZipFile::UncompressFile() {
 
 int InputZipFile::ProcessFile(const bool compressed) {
   const u1 *file_data;
+  if (compressed && processor->WantsCompressed()) {
+    if (EnsureRemaining(compressed_size_, "file_data") < 0) {
+      return -1;
+    }
+    processor->ProcessCompressed(
+        filename, attr, p, compressed_size_, uncompressed_size_,
+        compression_method_ == COMPRESSION_METHOD_ZSTD);
+    p += compressed_size_;
+    return 0;
+  }
   if (compressed) {
     file_data = UncompressFile();
     if (file_data == NULL) {
@@ -592,7 +700,7 @@ u8 InputZipFile::CalculateOutputLength() {
   // The worst case is when the output is simply the input uncompressed. The
   // metadata in the zip file will stay the same, so the file will grow by the
   // difference between the compressed and uncompressed sizes.
-  return (u8) input_file_->Length() - skipped_compressed_size
+  return (u8) zipdata_length_ - skipped_compressed_size
       + (uncompressed_size - compressed_size);
 }
 
@@ -814,6 +922,18 @@ ZipExtractor* ZipExtractor::Create(const char* filename,
   return result;
 }
 
+ZipExtractor* ZipExtractor::Create(const u1* zipdata, size_t length,
+                                   ZipExtractorProcessor *processor) {
+  InputZipFile* result = new InputZipFile(processor, "<memory>");
+  if (!result->Open(zipdata, length)) {
+    fprintf(stderr, "Opening zip in memory: %s\n", result->GetError());
+    delete result;
+    return NULL;
+  }
+
+  return result;
+}
+
 // zipdata_in_, in_offset_, p, central_dir_current_
 
 InputZipFile::InputZipFile(ZipExtractorProcessor *processor,
@@ -821,6 +941,7 @@ InputZipFile::InputZipFile(ZipExtractorProcessor *processor,
     : processor(processor), filename_(filename), input_file_(NULL),
       bytes_unmapped_(0) {
   decompressor_ = new Decompressor();
+  zstd_decompressor_ = NULL;
   errmsg[0] = 0;
 }
 
@@ -831,26 +952,30 @@ bool InputZipFile::Open() {
     delete input_file;
     return false;
   }
+  if (!Open(input_file->Buffer(), input_file->Length())) {
+    delete input_file;
+    return false;
+  }
+  input_file_ = input_file;
+  return true;
+}
 
-  void *zipdata_in = input_file->Buffer();
+bool InputZipFile::Open(const u1 *zipdata, size_t length) {
   u8 central_dir_offset;
   const u1 *central_dir = NULL;
 
   if (!devtools_ijar::FindZipCentralDirectory(
-          static_cast<const u1*>(zipdata_in), input_file->Length(),
-          &central_dir_offset, &central_dir)) {
+          zipdata, length, &central_dir_offset, &central_dir)) {
     errno = EIO;  // we don't really have a good error number
     error("Cannot find central directory");
-    delete input_file;
     return false;
   }
-  const u1 *zipdata_start = static_cast<const u1*>(zipdata_in);
-  in_offset_ = - static_cast<off_t>(zipdata_start
+  in_offset_ = - static_cast<off_t>(zipdata
                                     + central_dir_offset
                                     - central_dir);
 
-  input_file_ = input_file;
-  zipdata_in_ = zipdata_start;
+  zipdata_in_ = zipdata;
+  zipdata_length_ = length;
   central_dir_ = central_dir;
   central_dir_current_ = central_dir;
   p = zipdata_in_ + in_offset_;
@@ -860,6 +985,7 @@ bool InputZipFile::Open() {
 
 InputZipFile::~InputZipFile() {
   delete decompressor_;
+  delete zstd_decompressor_;
   if (input_file_ != NULL) {
     input_file_->Close();
     delete input_file_;
@@ -1026,11 +1152,13 @@ size_t OutputZipFile::WriteFileSizeInLocalFileHeader(u1 *header_ptr,
                                                      const u4 crc) {
   size_t compressed_size = out_length;
   if (compress) {
-    compressed_size = TryDeflate(q, out_length);
+    compressed_size =
+        zstd_ ? TryZstdCompress(q, out_length) : TryDeflate(q, out_length);
   }
   // compression method
   if (compressed_size < out_length) {
-    put_u2le(header_ptr, COMPRESSION_METHOD_DEFLATED);
+    put_u2le(header_ptr, zstd_ ? COMPRESSION_METHOD_ZSTD
+                               : COMPRESSION_METHOD_DEFLATED);
   } else {
     put_u2le(header_ptr, COMPRESSION_METHOD_STORED);
   }
@@ -1048,6 +1176,12 @@ int OutputZipFile::Finish() {
 
   finished_ = true;
   WriteCentralDirectory();
+  if (output_file_ == NULL) {
+    if (GetSize() > estimated_size_) {
+      return error("size %zu > buffer size %zu", GetSize(), estimated_size_);
+    }
+    return 0;
+  }
   if (output_file_->Close(GetSize()) < 0) {
     return error("%s", output_file_->Error());
   }
@@ -1056,6 +1190,55 @@ int OutputZipFile::Finish() {
   return 0;
 }
 
+int OutputZipFile::WriteIndex(const char *index_file) {
+  if (!finished_) {
+    return error("WriteIndex() called before Finish()");
+  }
+  std::vector<std::string> names;
+  size_t names_length = 0;
+  for (const LocalFileEntry *entry : entries_) {
+    names.emplace_back(reinterpret_cast<const char *>(entry->file_name),
+                       entry->file_name_length);
+    names_length += entry->file_name_length + 1;
+  }
+  std::vector<u4> sorted(entries_.size());
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    sorted[i] = i;
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [&names](u4 a, u4 b) { return names[a] < names[b]; });
+
+  std::vector<u1> index(ZIP_INDEX_HEADER_SIZE +
+                        entries_.size() * (ZIP_INDEX_ENTRY_SIZE + 4) +
+                        names_length);
+  u1 *w = index.data();
+  put_u4le(w, ZIP_INDEX_MAGIC);
+  put_u4le(w, ZIP_INDEX_VERSION);
+  put_u8le(w, GetSize());
+  put_u8le(w, entries_.size());
+  u4 name_offset = 0;
+  for (const LocalFileEntry *entry : entries_) {
+    put_u8le(w, entry->local_header_offset);
+    put_u8le(w, entry->compressed_length);
+    put_u8le(w, entry->uncompressed_length);
+    put_u4le(w, entry->crc32);
+    put_u4le(w, entry->external_attr);
+    put_u4le(w, name_offset);
+    put_u4le(w, entry->file_name_length);
+    name_offset += entry->file_name_length + 1;
+  }
+  for (u4 i : sorted) {
+    put_u4le(w, i);
+  }
+  for (const std::string &name : names) {
+    put_n(w, reinterpret_cast<const u1 *>(name.c_str()), name.size() + 1);
+  }
+  if (!write_file(index_file, 0644, index.data(), index.size())) {
+    return error("cannot write index %s", index_file);
+  }
+  return 0;
+}
+
 u1* OutputZipFile::NewFile(const char* filename, const u4 attr) {
   header_ptr = WriteLocalFileHeader(filename, attr);
   return q;
@@ -1084,7 +1267,8 @@ int OutputZipFile::FinishFile(size_t filelength, bool compress,
   entries_.back()->compressed_length = compressed_size;
   entries_.back()->uncompressed_length = filelength;
   if (compressed_size < filelength) {
-    entries_.back()->compression_method = COMPRESSION_METHOD_DEFLATED;
+    entries_.back()->compression_method =
+        zstd_ ? COMPRESSION_METHOD_ZSTD : COMPRESSION_METHOD_DEFLATED;
   } else {
     entries_.back()->compression_method = COMPRESSION_METHOD_STORED;
   }
@@ -1092,6 +1276,34 @@ int OutputZipFile::FinishFile(size_t filelength, bool compress,
   return 0;
 }
 
+int OutputZipFile::WriteCompressedFile(const char *filename, const u4 attr,
+                                       const u1 *data,
+                                       size_t compressed_length,
+                                       size_t uncompressed_length,
+                                       const u4 crc) {
+  if (compressed_length > uncompressed_length) {
+    return error("compressed length %zu > uncompressed length %zu of %s",
+                 compressed_length, uncompressed_length, filename);
+  }
+  u1 *header_ptr = WriteLocalFileHeader(filename, attr);
+  const u2 compression_method = compressed_length < uncompressed_length
+                                    ? COMPRESSION_METHOD_DEFLATED
+                                    : COMPRESSION_METHOD_STORED;
+  put_u2le(header_ptr, compression_method);
+  header_ptr += 4;
+  put_u4le(header_ptr, crc);                  // crc32
+  put_u4le(header_ptr, compressed_length);    // compressed_size
+  put_u4le(header_ptr, uncompressed_length);  // uncompressed_size
+  memcpy(q, data, compressed_length);
+  q += compressed_length;
+
+  entries_.back()->crc32 = crc;
+  entries_.back()->compressed_length = compressed_length;
+  entries_.back()->uncompressed_length = uncompressed_length;
+  entries_.back()->compression_method = compression_method;
+  return 0;
+}
+
 bool OutputZipFile::Open() {
   if (estimated_size_ > kMaximumOutputSize) {
     fprintf(stderr,
@@ -1127,6 +1339,93 @@ ZipBuilder *ZipBuilder::Create(const char *zip_file, size_t estimated_size) {
   return result;
 }
 
+ZipBuilder *ZipBuilder::Create(u1 *buffer, size_t capacity) {
+  return new OutputZipFile(buffer, capacity);
+}
+
+ZipIndex::~ZipIndex() {
+  file_->Close();
+  delete file_;
+}
+
+void ZipIndex::Get(size_t i, ZipIndexEntry *entry) const {
+  const u1 *r = entries_ + i * ZIP_INDEX_ENTRY_SIZE;
+  entry->local_header_offset = get_u8le(r);
+  entry->compressed_size = get_u8le(r);
+  entry->uncompressed_size = get_u8le(r);
+  entry->crc = get_u4le(r);
+  entry->attr = get_u4le(r);
+  entry->name = names_ + get_u4le(r);
+}
+
+bool ZipIndex::Find(const char *name, ZipIndexEntry *entry) const {
+  size_t lo = 0;
+  size_t hi = count_;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const u1 *r = sorted_ + mid * 4;
+    Get(get_u4le(r), entry);
+    int cmp = strcmp(entry->name, name);
+    if (cmp == 0) {
+      return true;
+    } else if (cmp < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return false;
+}
+
+ZipIndex *ZipIndex::Open(const char *index_file, u8 zip_size) {
+  MappedInputFile *file = new MappedInputFile(index_file);
+  if (!file->Opened()) {
+    delete file;
+    return NULL;
+  }
+  ZipIndex *index = new ZipIndex();
+  index->file_ = file;
+  if (file->Length() < ZIP_INDEX_HEADER_SIZE) {
+    delete index;
+    return NULL;
+  }
+  const u1 *r = file->Buffer();
+  u4 magic = get_u4le(r);
+  u4 version = get_u4le(r);
+  u8 indexed_zip_size = get_u8le(r);
+  u8 count = get_u8le(r);
+  size_t entries_length = ZIP_INDEX_HEADER_SIZE +
+                          count * (ZIP_INDEX_ENTRY_SIZE + 4);
+  if (magic != ZIP_INDEX_MAGIC || version != ZIP_INDEX_VERSION ||
+      indexed_zip_size != zip_size ||
+      count > file->Length() / (ZIP_INDEX_ENTRY_SIZE + 4) ||
+      entries_length > file->Length()) {
+    delete index;
+    return NULL;
+  }
+
+  index->count_ = count;
+  index->entries_ = r;
+  index->sorted_ = r + count * ZIP_INDEX_ENTRY_SIZE;
+  index->names_ = reinterpret_cast<const char *>(file->Buffer()) +
+                  entries_length;
+  index->names_length_ = file->Length() - entries_length;
+  // Check the names once, so that Get() can trust them.
+  for (size_t i = 0; i < count; ++i) {
+    const u1 *e = index->entries_ + i * ZIP_INDEX_ENTRY_SIZE + 32;
+    u4 name_offset = get_u4le(e);
+    u4 name_length = get_u4le(e);
+    const u1 *s = index->sorted_ + i * 4;
+    if (get_u4le(s) >= count || name_offset >= index->names_length_ ||
+        name_length >= index->names_length_ - name_offset ||
+        index->names_[name_offset + name_length] != 0) {
+      delete index;
+      return NULL;
+    }
+  }
+  return index;
+}
+
 u8 ZipBuilder::EstimateSize(char const* const* files,
                             char const* const* zip_paths,
                             int nb_entries) {
@@ -65,12 +65,26 @@ class ZipBuilder {
                          bool compress = false,
                          bool compute_crc = false) = 0;
 
+  // Add a file whose data was compressed ahead of time, so that several files
+  // can be compressed in parallel before being added in order. "data" holds
+  // "compressed_length" bytes, which TryDeflate() made out of
+  // "uncompressed_length" bytes with the CRC32 checksum "crc". The data are
+  // stored as they are if both lengths are equal.
+  // On failure, returns -1 and GetError() will return an non-empty message.
+  virtual int WriteCompressedFile(const char* filename, const u4 attr,
+                                  const u1* data, size_t compressed_length,
+                                  size_t uncompressed_length, u4 crc) = 0;
+
   // Write an empty file, it is equivalent to:
   //   NewFile(filename, 0);
   //   FinishFile(0);
   // On failure, returns -1 and GetError() will return an non-empty message.
   virtual int WriteEmptyFile(const char* filename) = 0;
 
+  // Makes FinishFile() compress with Zstandard rather than deflate. Only
+  // Bazel's own tools can read such entries.
+  virtual void UseZstd() = 0;
+
   // Finish writing the ZIP file. This method can be called only once
   // (subsequent calls will do nothing) and none of
   // NewFile/FinishFile/WriteEmptyFile should be called after calling Finish. If
@@ -88,6 +102,11 @@ class ZipBuilder {
   // Returns the current number of files stored in the ZIP.
   virtual int GetNumberFiles() = 0;
 
+  // Write a ZipIndex of the ZIP file to "index_file". Can only be called once
+  // Finish() has succeeded.
+  // On failure, returns -1 and GetError() will return an non-empty message.
+  virtual int WriteIndex(const char* index_file) = 0;
+
   // Create a new ZipBuilder writing the file zip_file and the size of the
   // output will be at most estimated_size. Use ZipBuilder::EstimateSize() or
   // ZipExtractor::CalculateOuputLength() to have an estimated_size depending on
@@ -95,6 +114,12 @@ class ZipBuilder {
   // On failure, returns NULL. Refer to errno for error code.
   static ZipBuilder* Create(const char* zip_file, size_t estimated_size);
 
+  // Create a new ZipBuilder writing to the "capacity" bytes at "buffer",
+  // which must outlive it. Unlike a file, the buffer is not guarded against
+  // overflows, so the capacity must be estimated as above. GetSize() is the
+  // length of the zip file once Finish() has succeeded.
+  static ZipBuilder* Create(u1* buffer, size_t capacity);
+
   // Estimate the maximum size of the ZIP files containing files in the "files"
   // null-terminated array.
   // Returns 0 on error.
@@ -102,6 +127,56 @@ class ZipBuilder {
                          int nb_entries);
 };
 
+// An entry of a ZipIndex.
+struct ZipIndexEntry {
+  // Null-terminated, owned by the ZipIndex.
+  const char* name;
+  u8 local_header_offset;
+  u8 compressed_size;
+  u8 uncompressed_size;
+  u4 crc;
+  u4 attr;
+};
+
+class MappedInputFile;
+
+//
+// An index of the entries of a ZIP file, written next to it by
+// ZipBuilder::WriteIndex(). It is mapped rather than parsed, and lets a tool
+// list the entries of a ZIP file or find an entry by name with a binary search,
+// without walking the central directory and the local file headers.
+//
+class ZipIndex {
+ public:
+  ~ZipIndex();
+
+  // Returns the number of entries.
+  size_t Size() const { return count_; }
+
+  // Get the i-th entry in the order of the ZIP file.
+  void Get(size_t i, ZipIndexEntry* entry) const;
+
+  // Find the entry named "name". Returns false if there is none.
+  bool Find(const char* name, ZipIndexEntry* entry) const;
+
+  // Open the index "index_file" of a ZIP file of "zip_size" bytes. Returns
+  // null if the index can't be read or was written for a ZIP file of another
+  // size, in which case the ZIP file should be read instead.
+  static ZipIndex* Open(const char* index_file, u8 zip_size);
+
+ private:
+  ZipIndex() {}
+
+  MappedInputFile* file_;
+  size_t count_;
+  // The entries in the order of the ZIP file.
+  const u1* entries_;
+  // The indices of the entries, sorted by name.
+  const u1* sorted_;
+  const char* names_;
+  size_t names_length_;
+};
+
 //
 // An abstract class to process data from a ZipExtractor.
 // Derive from this class if you wish to process data from a ZipExtractor.
@@ -121,6 +196,18 @@ class ZipExtractorProcessor {
   // in the buffer pointed by "data".
   virtual void Process(const char* filename, const u4 attr,
                        const u1* data, const size_t size) = 0;
+
+  // Whether the compressed files accepted by Accept are to be handed to
+  // ProcessCompressed() as they are, rather than decompressed and handed to
+  // Process(). This lets a processor decompress them on other threads.
+  virtual bool WantsCompressed() { return false; }
+
+  // Process a compressed file accepted by Accept, see WantsCompressed().
+  // "data" holds the "compressed_size" bytes of the file, deflated or, if
+  // "zstd" is true, in the Zstandard format. It is only valid during the call.
+  virtual void ProcessCompressed(const char* filename, const u4 attr,
+                                 const u1* data, const size_t compressed_size,
+                                 const size_t uncompressed_size, bool zstd) {}
 };
 
 //
@@ -143,6 +230,11 @@ class ZipExtractor {
   // on error).
   virtual int ProcessAll();
 
+  // Process the file of a ZipIndex entry of this ZIP file, like ProcessNext()
+  // does for the next file. Returns false on error, check the return value of
+  // GetError(). The entries must be processed in the order of the ZIP file.
+  virtual bool ProcessEntry(const ZipIndexEntry& entry) = 0;
+
   // Reset the file pointer to the beginning.
   virtual void Reset() = 0;
 
@@ -162,6 +254,12 @@ class ZipExtractor {
   // checked.
   static ZipExtractor* Create(const char* filename,
                               ZipExtractorProcessor *processor);
+
+  // Create a ZipExtractor that extract the zip file held in the "length"
+  // bytes at "zipdata", which must outlive it, and process it with
+  // "processor". On error, a null pointer is returned.
+  static ZipExtractor* Create(const u1* zipdata, size_t length,
+                              ZipExtractorProcessor *processor);
 };
 
 }  // namespace devtools_ijar
@@ -27,15 +27,40 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
+#include "third_party/ijar/zstd_client.h"
 
 namespace devtools_ijar {
 
+// Files are read and compressed, or decompressed and written, on up to that
+// many threads.
+static const unsigned kMaxThreads = 8;
+
+// The threads stay at most that many files per thread ahead of the thread
+// reading the zip file or writing it, which bounds the memory held by files
+// in flight.
+static const size_t kMaxFilesPerThread = 4;
+
+// The suffix of the ZipIndex written next to the zip file.
+static const char kIndexSuffix[] = ".idx";
+
+static size_t thread_count() {
+  return std::max(1u, std::min(std::thread::hardware_concurrency(),
+                               kMaxThreads));
+}
+
 //
 // A ZipExtractorProcessor that extract files in the ZIP file.
 //
@@ -44,23 +69,35 @@ class UnzipProcessor : public ZipExtractorProcessor {
   // Create a processor who will extract the given files (or all files if NULL)
   // into output_root if "extract" is set to true and will print the list of
   // files and their unix modes if "verbose" is set to true.
+  // Files are written on "threads" threads if it is more than one.
   UnzipProcessor(const char *output_root, char **files, bool verbose,
-                 bool extract, bool flatten)
+                 bool extract, bool flatten, size_t threads)
       : output_root_(output_root),
         verbose_(verbose),
         extract_(extract),
-        flatten_(flatten) {
+        flatten_(flatten),
+        in_flight_(0),
+        shutdown_(false) {
     if (files != NULL) {
       for (int i = 0; files[i] != NULL; i++) {
         file_names.insert(std::string(files[i]));
       }
     }
+    if (extract && threads > 1) {
+      for (size_t i = 0; i < threads; i++) {
+        workers_.emplace_back(&UnzipProcessor::WorkerLoop, this);
+      }
+    }
   }
 
-  virtual ~UnzipProcessor() {}
+  virtual ~UnzipProcessor() { Finish(); }
 
   virtual void Process(const char *filename, u4 attr, const u1 *data,
                        size_t size);
+  virtual bool WantsCompressed() { return !workers_.empty(); }
+  virtual void ProcessCompressed(const char *filename, const u4 attr,
+                                 const u1 *data, const size_t compressed_size,
+                                 const size_t uncompressed_size, bool zstd);
   virtual bool Accept(const char* filename, const u4 attr) {
     // All entry files are accepted by default.
     if (file_names.empty()) {
@@ -71,12 +108,43 @@ class UnzipProcessor : public ZipExtractorProcessor {
     }
   }
 
+  // Waits for all the files to be written.
+  void Finish();
+
  private:
+  // A file to be written by the pool.
+  struct Job {
+    enum Method { kStored, kDeflated, kZstd };
+    std::string path;
+    mode_t perm;
+    Method method;
+    // The file as it is stored in the zip file.
+    std::vector<u1> data;
+    size_t uncompressed_size;
+  };
+
+  // Returns the path of the entry in the output directory, or an empty string
+  // if it is skipped. Sets perm and isdir.
+  std::string OutputPath(const char *filename, const u4 attr, mode_t *perm,
+                         bool *isdir);
+  void Submit(const std::string &path, mode_t perm, Job::Method method,
+              const u1 *data, size_t size, size_t uncompressed_size);
+  void WorkerLoop();
+
   const char *output_root_;
   const bool verbose_;
   const bool extract_;
   const bool flatten_;
   std::set<std::string> file_names;
+
+  std::vector<std::thread> workers_;
+  std::deque<std::unique_ptr<Job>> queue_;
+  // The files submitted but not written yet.
+  size_t in_flight_;
+  std::mutex mutex_;
+  std::condition_variable queued_;
+  std::condition_variable written_;
+  bool shutdown_;
 };
 
 // Concatene 2 path, path1 and path2, using / as a directory separator and
@@ -102,20 +170,20 @@ bool concat_path(char *out, const size_t size, const char *path1,
   return true;
 }
 
-void UnzipProcessor::Process(const char* filename, const u4 attr,
-                             const u1* data, const size_t size) {
-  mode_t perm = zipattr_to_perm(attr);
-  bool isdir = zipattr_is_dir(attr);
+std::string UnzipProcessor::OutputPath(const char *filename, const u4 attr,
+                                       mode_t *perm, bool *isdir) {
+  *perm = zipattr_to_perm(attr);
+  *isdir = zipattr_is_dir(attr);
   const char *output_file_name = filename;
   if (attr == 0) {
     // Fallback when the external attribute is not set.
-    isdir = filename[strlen(filename)-1] == '/';
-    perm = 0777;
+    *isdir = filename[strlen(filename)-1] == '/';
+    *perm = 0777;
   }
 
   if (flatten_) {
-    if (isdir) {
-      return;
+    if (*isdir) {
+      return std::string();
     }
     const char *p = strrchr(filename, '/');
     if (p != NULL) {
@@ -124,15 +192,130 @@ void UnzipProcessor::Process(const char* filename, const u4 attr,
   }
 
   if (verbose_) {
-    printf("%c %o %s\n", isdir ? 'd' : 'f', perm, output_file_name);
+    printf("%c %o %s\n", *isdir ? 'd' : 'f', *perm, output_file_name);
+  }
+  if (!extract_) {
+    return std::string();
+  }
+  char path[PATH_MAX];
+  if (!concat_path(path, sizeof(path), output_root_, output_file_name)) {
+    abort();
+  }
+  return path;
+}
+
+void UnzipProcessor::Process(const char* filename, const u4 attr,
+                             const u1* data, const size_t size) {
+  mode_t perm;
+  bool isdir;
+  std::string path = OutputPath(filename, attr, &perm, &isdir);
+  if (path.empty()) {
+    return;
+  }
+  if (isdir || workers_.empty()) {
+    if (!make_dirs(path.c_str(), perm) ||
+        (!isdir && !write_file(path.c_str(), perm, data, size))) {
+      abort();
+    }
+  } else {
+    Submit(path, perm, Job::kStored, data, size, size);
   }
-  if (extract_) {
-    char path[PATH_MAX];
-    if (!concat_path(path, sizeof(path), output_root_, output_file_name) ||
-        !make_dirs(path, perm) ||
-        (!isdir && !write_file(path, perm, data, size))) {
+}
+
+void UnzipProcessor::ProcessCompressed(const char *filename, const u4 attr,
+                                       const u1 *data,
+                                       const size_t compressed_size,
+                                       const size_t uncompressed_size,
+                                       bool zstd) {
+  mode_t perm;
+  bool isdir;
+  std::string path = OutputPath(filename, attr, &perm, &isdir);
+  if (path.empty()) {
+    return;
+  }
+  if (isdir) {
+    if (!make_dirs(path.c_str(), perm)) {
       abort();
     }
+  } else {
+    Submit(path, perm, zstd ? Job::kZstd : Job::kDeflated, data,
+           compressed_size, uncompressed_size);
+  }
+}
+
+void UnzipProcessor::Submit(const std::string &path, mode_t perm,
+                            Job::Method method, const u1 *data, size_t size,
+                            size_t uncompressed_size) {
+  // The data only live during the Process*() call, hence the copy.
+  std::unique_ptr<Job> job(new Job());
+  job->path = path;
+  job->perm = perm;
+  job->method = method;
+  job->data.assign(data, data + size);
+  job->uncompressed_size = uncompressed_size;
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_.wait(lock, [this] {
+    return in_flight_ < kMaxFilesPerThread * workers_.size();
+  });
+  in_flight_++;
+  queue_.push_back(std::move(job));
+  queued_.notify_one();
+}
+
+void UnzipProcessor::Finish() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  queued_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+}
+
+void UnzipProcessor::WorkerLoop() {
+  // The decompressors reuse their buffers, so each thread has its own.
+  Decompressor inflater;
+  ZstdDecompressor zstd_decompressor;
+  for (;;) {
+    std::unique_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.wait(lock, [this] { return shutdown_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    const u1 *data = job->data.data();
+    size_t size = job->data.size();
+    if (job->method != Job::kStored) {
+      DecompressedFile *decompressed =
+          job->method == Job::kZstd
+              ? zstd_decompressor.UncompressFile(data, size,
+                                                 job->uncompressed_size)
+              : inflater.UncompressFile(data, size, job->uncompressed_size);
+      if (decompressed == NULL) {
+        fprintf(stderr, "%s: %s\n", job->path.c_str(),
+                job->method == Job::kZstd ? zstd_decompressor.GetError()
+                                          : inflater.GetError());
+        abort();
+      }
+      data = decompressed->uncompressed_data;
+      size = decompressed->uncompressed_size;
+      free(decompressed);
+    }
+    if (!make_dirs(job->path.c_str(), job->perm) ||
+        !write_file(job->path.c_str(), job->perm, data, size)) {
+      abort();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      in_flight_--;
+    }
+    written_.notify_one();
   }
 }
 
@@ -169,7 +352,28 @@ int extract(char *zipfile, char *exdir, char **files, bool verbose,
     memcpy(output_root, cwd.c_str(), cwd.length() + 1);
   }
 
-  UnzipProcessor processor(output_root, files, verbose, extract, flatten);
+  UnzipProcessor processor(output_root, files, verbose, extract, flatten,
+                           thread_count());
+
+  // An index, if there is one, saves walking the whole zip file to list it or
+  // to find a few files in it.
+  std::unique_ptr<ZipIndex> index;
+  Stat zip_stat;
+  if ((!extract || files != NULL) && stat_file(zipfile, &zip_stat)) {
+    std::string index_file = std::string(zipfile) + kIndexSuffix;
+    index.reset(ZipIndex::Open(index_file.c_str(), zip_stat.total_size));
+  }
+  if (index != NULL && !extract) {
+    ZipIndexEntry entry;
+    for (size_t i = 0; i < index->Size(); i++) {
+      index->Get(i, &entry);
+      if (processor.Accept(entry.name, entry.attr)) {
+        processor.Process(entry.name, entry.attr, NULL, 0);
+      }
+    }
+    return 0;
+  }
+
   std::unique_ptr<ZipExtractor> extractor(ZipExtractor::Create(zipfile,
                                                                &processor));
   if (extractor == NULL) {
@@ -178,26 +382,66 @@ int extract(char *zipfile, char *exdir, char **files, bool verbose,
     return -1;
   }
 
-  if (extractor->ProcessAll() < 0) {
+  if (index != NULL) {
+    std::vector<ZipIndexEntry> entries;
+    ZipIndexEntry entry;
+    for (int i = 0; files[i] != NULL; i++) {
+      if (index->Find(files[i], &entry)) {
+        entries.push_back(entry);
+      }
+    }
+    // The extractor needs the files in the order of the zip file.
+    std::sort(entries.begin(), entries.end(),
+              [](const ZipIndexEntry &a, const ZipIndexEntry &b) {
+                return a.local_header_offset < b.local_header_offset;
+              });
+    entries.erase(
+        std::unique(entries.begin(), entries.end(),
+                    [](const ZipIndexEntry &a, const ZipIndexEntry &b) {
+                      return a.local_header_offset == b.local_header_offset;
+                    }),
+        entries.end());
+    for (const ZipIndexEntry &entry : entries) {
+      if (!extractor->ProcessEntry(entry)) {
+        fprintf(stderr, "%s.\n", extractor->GetError());
+        return -1;
+      }
+    }
+  } else if (extractor->ProcessAll() < 0) {
     fprintf(stderr, "%s.\n", extractor->GetError());
     return -1;
   }
+  processor.Finish();
   return 0;
 }
 
-// add a file to the zip
-int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
-             char *zip_path, bool flatten, bool verbose, bool compress) {
-  Stat file_stat = {0, 0666, false};
+// A file to add to the zip. It is read, and compressed if requested, ahead of
+// being added.
+struct ZipEntry {
+  char *file;
+  std::string path;
+  Stat stat;
+  std::unique_ptr<u1[]> data;
+  size_t compressed_size = 0;
+  u4 crc = 0;
+  bool done = false;
+  bool ok = false;
+};
+
+// Computes the path of the file in the zip. Returns -1 on error, 0 if the file
+// is skipped and 1 otherwise.
+int prepare_entry(char *file, char *zip_path, bool flatten, ZipEntry *entry) {
+  entry->file = file;
+  entry->stat = {0, 0666, false};
   if (file != NULL) {
-    if (!stat_file(file, &file_stat)) {
+    if (!stat_file(file, &entry->stat)) {
       fprintf(stderr, "Cannot stat file %s: %s\n", file, strerror(errno));
       return -1;
     }
   }
   char *final_path = zip_path != NULL ? zip_path : file;
 
-  bool isdir = file_stat.is_directory;
+  bool isdir = entry->stat.is_directory;
 
   if (flatten && isdir) {
     return 0;
@@ -221,21 +465,48 @@ int add_file(std::unique_ptr<ZipBuilder> const &builder, char *file,
       path[len + 1] = 0;
     }
   }
+  entry->path = path;
+  return 1;
+}
+
+// Reads the file of the entry, computes its CRC and compresses it if
+// requested.
+bool read_entry(ZipEntry *entry, bool compress) {
+  size_t size = entry->stat.total_size;
+  if (entry->stat.is_directory || size == 0) {
+    return true;
+  }
+  entry->data.reset(new u1[size]);
+  if (!read_file(entry->file, entry->data.get(), size)) {
+    return false;
+  }
+  entry->crc = ComputeCrcChecksum(entry->data.get(), size);
+  entry->compressed_size =
+      compress ? TryDeflate(entry->data.get(), size) : size;
+  return true;
+}
 
+// Adds a read entry to the zip.
+int add_entry(std::unique_ptr<ZipBuilder> const &builder, ZipEntry *entry,
+              bool verbose) {
+  const Stat &file_stat = entry->stat;
+  const char *path = entry->path.c_str();
   if (verbose) {
     mode_t perm = file_stat.file_mode & 0777;
-    printf("%c %o %s\n", isdir ? 'd' : 'f', perm, path);
+    printf("%c %o %s\n", file_stat.is_directory ? 'd' : 'f', perm, path);
   }
 
-  u1 *buffer = builder->NewFile(path, stat_to_zipattr(file_stat));
-  if (isdir || file_stat.total_size == 0) {
+  if (file_stat.is_directory || file_stat.total_size == 0) {
+    builder->NewFile(path, stat_to_zipattr(file_stat));
     builder->FinishFile(0);
-  } else {
-    if (!read_file(file, buffer, file_stat.total_size)) {
-      return -1;
-    }
-    builder->FinishFile(file_stat.total_size, compress, true);
+  } else if (builder->WriteCompressedFile(
+                 path, stat_to_zipattr(file_stat), entry->data.get(),
+                 entry->compressed_size, file_stat.total_size,
+                 entry->crc) < 0) {
+    fprintf(stderr, "%s\n", builder->GetError());
+    return -1;
   }
+  entry->data.reset();
   return 0;
 }
 
@@ -325,7 +596,7 @@ char **parse_filelist(char *zipfile, char **file_entries, int nb_entries,
 
 // Execute the create operation
 int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
-           bool compress) {
+           bool compress, bool write_index) {
   int nb_entries = 0;
   while (file_entries[nb_entries] != NULL) {
     nb_entries++;
@@ -347,16 +618,99 @@ int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
     return -1;
   }
 
+  std::vector<ZipEntry> entries(nb_entries);
   for (int i = 0; i < nb_entries; i++) {
-    if (add_file(builder, files[i], zip_paths[i], flatten, verbose, compress) <
-        0) {
+    int result = prepare_entry(files[i], zip_paths[i], flatten, &entries[i]);
+    if (result < 0) {
       return -1;
     }
+    // Skipped entries are done already.
+    entries[i].done = result == 0;
+    entries[i].ok = true;
+  }
+
+  // Worker threads read and compress the files, while this thread adds them
+  // to the zip in order.
+  const size_t threads = thread_count();
+  const size_t window = kMaxFilesPerThread * threads;
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t next = 0;
+  size_t written = 0;
+  bool stop = false;
+
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      for (;;) {
+        size_t i;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() {
+            return stop || next >= entries.size() || next < written + window;
+          });
+          while (next < entries.size() && entries[next].done) {
+            next++;
+          }
+          if (stop || next >= entries.size()) {
+            return;
+          }
+          i = next++;
+        }
+        bool ok = read_entry(&entries[i], compress);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          entries[i].ok = ok;
+          entries[i].done = true;
+        }
+        cond.notify_all();
+      }
+    });
+  }
+
+  int result = 0;
+  for (size_t i = 0; result == 0 && i < entries.size(); i++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]() { return entries[i].done; });
+    }
+    if (!entries[i].ok) {
+      result = -1;
+    } else if (!entries[i].path.empty()) {
+      result = add_entry(builder, &entries[i], verbose);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      written = i + 1;
+    }
+    cond.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
   }
+  cond.notify_all();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  if (result < 0) {
+    return -1;
+  }
+
   if (builder->Finish() < 0) {
     fprintf(stderr, "%s\n", builder->GetError());
     return -1;
   }
+  std::string index_file = std::string(zipfile) + kIndexSuffix;
+  if (write_index) {
+    if (builder->WriteIndex(index_file.c_str()) < 0) {
+      fprintf(stderr, "%s\n", builder->GetError());
+      return -1;
+    }
+  } else {
+    // Don't leave the index of a previous zip file around.
+    remove(index_file.c_str());
+  }
   return 0;
 }
 
@@ -367,7 +721,7 @@ int create(char *zipfile, char **file_entries, bool flatten, bool verbose,
 //
 static void usage(char *progname) {
   fprintf(stderr,
-          "Usage: %s [vxc[fC]] x.zip [-d exdir] [[zip_path1=]file1 ... "
+          "Usage: %s [vxc[fCi]] x.zip [-d exdir] [[zip_path1=]file1 ... "
           "[zip_pathn=]filen]\n",
           progname);
   fprintf(stderr, "  v verbose - list all file in x.zip\n");
@@ -381,6 +735,10 @@ static void usage(char *progname) {
           "extract operation\n");
   fprintf(stderr,
           "  C compress - compress files when using the create operation\n");
+  fprintf(stderr,
+          "  i index - with the create operation, also write an index of "
+          "x.zip to x.zip.idx, which speeds up listing x.zip or extracting "
+          "some of its files\n");
   fprintf(stderr, "x and c cannot be used in the same command-line.\n");
   fprintf(stderr,
           "\nFor every file, a path in the zip can be specified. Examples:\n");
@@ -402,6 +760,7 @@ int main(int argc, char **argv) {
   bool create = false;
   bool compress = false;
   bool flatten = false;
+  bool write_index = false;
 
   if (argc < 3) {
     usage(argv[0]);
@@ -424,6 +783,9 @@ int main(int argc, char **argv) {
     case 'C':
       compress = true;
       break;
+    case 'i':
+      write_index = true;
+      break;
     default:
       usage(argv[0]);
     }
@@ -468,7 +830,8 @@ int main(int argc, char **argv) {
 
   if (create) {
     // Create a zip
-    return devtools_ijar::create(argv[2], filelist, flatten, verbose, compress);
+    return devtools_ijar::create(argv[2], filelist, flatten, verbose, compress,
+                                 write_index);
   } else {
     char* exdir = NULL;
     if (argc > 3 && strcmp(argv[3], "-d") == 0) {
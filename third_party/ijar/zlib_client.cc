@@ -16,12 +16,86 @@
 #include <algorithm>
 #include <cstdio>
 
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
 #include "third_party/ijar/common.h"
 #include "third_party/ijar/zlib_client.h"
 #include <zlib.h>
 
 namespace devtools_ijar {
 
+namespace {
+
+// The bits of libdeflate we use, all of them part of its stable API.
+enum { LIBDEFLATE_SUCCESS = 0 };
+
+struct LibdeflateLibrary {
+  void* (*allocDecompressor)();
+  int (*decompress)(void* decompressor, const void* in, size_t in_nbytes,
+                    void* out, size_t out_nbytes_avail,
+                    size_t* actual_in_nbytes_ret,
+                    size_t* actual_out_nbytes_ret);
+  void (*freeDecompressor)(void* decompressor);
+};
+
+void* OpenLibrary() {
+#ifdef _WIN32
+  return LoadLibraryA("libdeflate.dll");
+#else
+#ifdef __APPLE__
+  static const char* const kNames[] = {"libdeflate.0.dylib",
+                                       "libdeflate.dylib"};
+#else
+  static const char* const kNames[] = {"libdeflate.so.0", "libdeflate.so"};
+#endif
+  for (const char* name : kNames) {
+    void* handle = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+    if (handle != NULL) {
+      return handle;
+    }
+  }
+  return NULL;
+#endif
+}
+
+template <typename Function>
+bool Resolve(void* library, const char* name, Function* function) {
+#ifdef _WIN32
+  *function = reinterpret_cast<Function>(
+      GetProcAddress(static_cast<HMODULE>(library), name));
+#else
+  *function = reinterpret_cast<Function>(dlsym(library, name));
+#endif
+  return *function != NULL;
+}
+
+// Returns libdeflate, or NULL if it cannot be loaded. It is never unloaded.
+const LibdeflateLibrary* Library() {
+  static LibdeflateLibrary library;
+  static const bool loaded = [] {
+    void* handle = OpenLibrary();
+    return handle != NULL &&
+           Resolve(handle, "libdeflate_alloc_decompressor",
+                   &library.allocDecompressor) &&
+           Resolve(handle, "libdeflate_deflate_decompress_ex",
+                   &library.decompress) &&
+           Resolve(handle, "libdeflate_free_decompressor",
+                   &library.freeDecompressor);
+  }();
+  return loaded ? &library : NULL;
+}
+
+}  // namespace
+
+bool LibdeflateAvailable() { return Library() != NULL; }
+
 u4 ComputeCrcChecksum(u1 *buf, size_t length) {
   return crc32(0, buf, length);
 }
@@ -62,13 +136,55 @@ size_t TryDeflate(u1 *buf, size_t length) {
   return length;
 }
 
-Decompressor::Decompressor() {
+Decompressor::Decompressor() : libdeflate_decompressor_(NULL) {
   uncompressed_data_allocated_ = INITIAL_BUFFER_SIZE;
   uncompressed_data_ =
       reinterpret_cast<u1 *>(malloc(uncompressed_data_allocated_));
 }
 
-Decompressor::~Decompressor() { free(uncompressed_data_); }
+Decompressor::~Decompressor() {
+  free(uncompressed_data_);
+  if (libdeflate_decompressor_ != NULL) {
+    Library()->freeDecompressor(libdeflate_decompressor_);
+  }
+}
+
+DecompressedFile *Decompressor::UncompressFile(const u1 *buffer,
+                                               size_t bytes_avail,
+                                               size_t uncompressed_size) {
+  const LibdeflateLibrary *library = Library();
+  if (library == NULL || uncompressed_size > MAX_BUFFER_SIZE) {
+    return UncompressFile(buffer, bytes_avail);
+  }
+  if (libdeflate_decompressor_ == NULL) {
+    libdeflate_decompressor_ = library->allocDecompressor();
+    if (libdeflate_decompressor_ == NULL) {
+      return UncompressFile(buffer, bytes_avail);
+    }
+  }
+  if (uncompressed_size > uncompressed_data_allocated_) {
+    uncompressed_data_allocated_ = uncompressed_size;
+    uncompressed_data_ = reinterpret_cast<u1 *>(
+        realloc(uncompressed_data_, uncompressed_data_allocated_));
+  }
+  size_t compressed_size;
+  size_t actual_size;
+  if (library->decompress(libdeflate_decompressor_, buffer, bytes_avail,
+                          uncompressed_data_, uncompressed_size,
+                          &compressed_size,
+                          &actual_size) != LIBDEFLATE_SUCCESS ||
+      actual_size != uncompressed_size) {
+    // The size the caller has may be wrong, and zlib reports the errors
+    // better.
+    return UncompressFile(buffer, bytes_avail);
+  }
+  DecompressedFile *decompressed_file =
+      reinterpret_cast<DecompressedFile *>(malloc(sizeof(DecompressedFile)));
+  decompressed_file->compressed_size = compressed_size;
+  decompressed_file->uncompressed_size = uncompressed_size;
+  decompressed_file->uncompressed_data = uncompressed_data_;
+  return decompressed_file;
+}
 
 DecompressedFile *Decompressor::UncompressFile(const u1 *buffer,
                                                size_t bytes_avail) {
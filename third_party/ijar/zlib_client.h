@@ -31,6 +31,13 @@ size_t TryDeflate(u1* buf, size_t length);
 
 u4 ComputeCrcChecksum(u1* buf, size_t length);
 
+// Whether libdeflate is available. It is loaded on first use rather than
+// linked in. When it is, Decompressor inflates the entries whose size is
+// known in one go with it, which is a few times faster than zlib. The entries
+// are still deflated by zlib, whose output differs from libdeflate's, so that
+// the output does not depend on the machine.
+bool LibdeflateAvailable();
+
 struct DecompressedFile {
   u1* uncompressed_data;
   u4 uncompressed_size;
@@ -42,6 +49,10 @@ class Decompressor {
   Decompressor();
   ~Decompressor();
   DecompressedFile* UncompressFile(const u1* buffer, size_t bytes_avail);
+  // Same, but given the uncompressed size of the entry, e.g. from the central
+  // directory, which lets libdeflate inflate it if available.
+  DecompressedFile* UncompressFile(const u1* buffer, size_t bytes_avail,
+                                   size_t uncompressed_size);
   char* GetError();
 
  private:
@@ -51,6 +62,8 @@ class Decompressor {
   // can call realloc.
   u1* uncompressed_data_;
   size_t uncompressed_data_allocated_;
+  // The libdeflate decompressor, allocated on first use.
+  void* libdeflate_decompressor_;
   // last error
   char errmsg[4 * PATH_MAX];
 
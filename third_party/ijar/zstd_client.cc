@@ -0,0 +1,96 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "third_party/ijar/zstd_client.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zstd.h>
+
+namespace devtools_ijar {
+
+// zstd's default compression level.
+static const int kCompressionLevel = 3;
+
+size_t TryZstdCompress(u1* buf, size_t length) {
+  if (length == 0) {
+    return length;
+  }
+  size_t bound = ZSTD_compressBound(length);
+  u1* outbuf = reinterpret_cast<u1*>(malloc(bound));
+  size_t compressed_size =
+      ZSTD_compress(outbuf, bound, buf, length, kCompressionLevel);
+  if (!ZSTD_isError(compressed_size) && compressed_size < length) {
+    memcpy(buf, outbuf, compressed_size);
+    length = compressed_size;
+  }
+  free(outbuf);
+  return length;
+}
+
+ZstdDecompressor::ZstdDecompressor()
+    : uncompressed_data_(NULL), uncompressed_data_allocated_(0) {
+  errmsg[0] = 0;
+}
+
+ZstdDecompressor::~ZstdDecompressor() { free(uncompressed_data_); }
+
+DecompressedFile* ZstdDecompressor::UncompressFile(const u1* buffer,
+                                                   size_t compressed_size,
+                                                   size_t uncompressed_size) {
+  if (uncompressed_data_ == NULL ||
+      uncompressed_size > uncompressed_data_allocated_) {
+    // Never ask realloc() for 0 bytes, it may free the buffer.
+    uncompressed_data_allocated_ = uncompressed_size + 1;
+    uncompressed_data_ = reinterpret_cast<u1*>(
+        realloc(uncompressed_data_, uncompressed_data_allocated_));
+  }
+  size_t ret = ZSTD_decompress(uncompressed_data_, uncompressed_size, buffer,
+                               compressed_size);
+  if (ZSTD_isError(ret)) {
+    error("Zstandard decompression failed: %s\n", ZSTD_getErrorName(ret));
+    return NULL;
+  }
+  if (ret != uncompressed_size) {
+    error("Zstandard entry is %zu bytes long, expected %zu.\n", ret,
+          uncompressed_size);
+    return NULL;
+  }
+  DecompressedFile* decompressed_file =
+      reinterpret_cast<DecompressedFile*>(malloc(sizeof(DecompressedFile)));
+  decompressed_file->compressed_size = compressed_size;
+  decompressed_file->uncompressed_size = uncompressed_size;
+  decompressed_file->uncompressed_data = uncompressed_data_;
+  return decompressed_file;
+}
+
+char* ZstdDecompressor::GetError() {
+  if (errmsg[0] == 0) {
+    return NULL;
+  }
+  return errmsg;
+}
+
+int ZstdDecompressor::error(const char* fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(errmsg, 4 * PATH_MAX, fmt, ap);
+  va_end(ap);
+  return -1;
+}
+
+}  // namespace devtools_ijar
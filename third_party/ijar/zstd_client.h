@@ -0,0 +1,51 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_IJAR_ZSTD_CLIENT_H_
+#define THIRD_PARTY_IJAR_ZSTD_CLIENT_H_
+
+#include <limits.h>
+
+#include "third_party/ijar/common.h"
+#include "third_party/ijar/zlib_client.h"
+
+namespace devtools_ijar {
+
+// Try to compress a file entry in memory using Zstandard. Same contract as
+// TryDeflate(): buf is left alone unless the compressed data are smaller,
+// and the final size is returned.
+size_t TryZstdCompress(u1* buf, size_t length);
+
+// Decompresses Zstandard entries. Each entry is decompressed in one call,
+// so unlike Decompressor it needs the entry sizes from the central directory.
+class ZstdDecompressor {
+ public:
+  ZstdDecompressor();
+  ~ZstdDecompressor();
+  DecompressedFile* UncompressFile(const u1* buffer, size_t compressed_size,
+                                   size_t uncompressed_size);
+  char* GetError();
+
+ private:
+  // The buffer for the decompressed data, reused across the entries.
+  u1* uncompressed_data_;
+  size_t uncompressed_data_allocated_;
+  // last error
+  char errmsg[4 * PATH_MAX];
+
+  int error(const char* fmt, ...);
+};
+}  // namespace devtools_ijar
+
+#endif  // THIRD_PARTY_IJAR_ZSTD_CLIENT_H_
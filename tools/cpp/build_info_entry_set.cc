@@ -14,8 +14,11 @@
 
 #include "tools/cpp/build_info_entry_set.h"
 
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <string>
+#include <utility>
 
 namespace bazel {
 namespace tools {
@@ -44,12 +47,20 @@ bool BuildInfoEntrySet::GetKeyValue(
 }
 
 void BuildInfoEntrySet::AddSlashes(std::string& key) {
-  for (std::string::iterator it = key.begin(); it != key.end(); it++) {
-    if (*it == ':') {
-      it = key.insert(it, '\\');
-      it++;
+  size_t colons = std::count(key.begin(), key.end(), ':');
+  if (colons == 0) {
+    return;
+  }
+  // Escape in one pass, rather than inserting before each colon in place.
+  std::string escaped;
+  escaped.reserve(key.size() + colons);
+  for (char c : key) {
+    if (c == ':') {
+      escaped.push_back('\\');
     }
+    escaped.push_back(c);
   }
+  key = std::move(escaped);
 }
 
 std::map<std::string, BuildInfoEntrySet::BuildInfoEntry>
@@ -57,17 +68,23 @@ BuildInfoEntrySet::TranslateKeys(
     const std::map<std::string, std::string>& translation_keys,
     std::unordered_map<std::string, KeyDescription>& keys,
     std::unordered_map<std::string, std::string>& values) {
-  std::map<std::string, BuildInfoEntrySet::BuildInfoEntry> translated_keys =
-      std::map<std::string, BuildInfoEntrySet::BuildInfoEntry>();
+  std::map<std::string, BuildInfoEntrySet::BuildInfoEntry> translated_keys;
   for (const auto& [translation, key] : translation_keys) {
-    std::string key_value;
-    if (GetKeyValue(key, keys, values, key_value) &&
-        keys.find(key) != keys.end()) {
-      AddSlashes(key_value);
-      translated_keys.emplace(
-          translation,
-          BuildInfoEntrySet::BuildInfoEntry(key_value, keys.at(key).key_type));
+    // Only the described keys are translated: look the key up once in each
+    // map, rather than through GetKeyValue and again for its type.
+    auto key_description = keys.find(key);
+    if (key_description == keys.end()) {
+      continue;
     }
+    auto value = values.find(key);
+    std::string key_value = value != values.end()
+                                ? value->second
+                                : key_description->second.default_value;
+    AddSlashes(key_value);
+    translated_keys.emplace_hint(
+        translated_keys.end(), translation,
+        BuildInfoEntrySet::BuildInfoEntry(key_value,
+                                          key_description->second.key_type));
   }
   return translated_keys;
 }
@@ -16,7 +16,8 @@
 #include <string>
 #include <unordered_map>
 
-#include "absl/strings/str_split.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 
 namespace bazel {
 namespace tools {
@@ -29,23 +30,33 @@ const absl::Status BuildInfoTranslationHelper::ParseFile(
     return absl::Status(absl::StatusCode::kNotFound,
                         absl::StrCat("Could not open file: ", file_path));
   }
-  std::string line;
+  // Workspace status files can be large, and there is one per stamped
+  // binary: read the file in one go and split it in a single pass, rather
+  // than copying each line and its parts around.
+  std::string contents;
+  char chunk[64 * 1024];
+  while (file_reader.read(chunk, sizeof(chunk)) || file_reader.gcount() > 0) {
+    contents.append(chunk, file_reader.gcount());
+  }
   // Split the line on the first separator, in case there is
   // no separator found return a non-zero exit code.
-  constexpr static char kKeyValueSeparator[] = " ";
-  while (std::getline(file_reader, line)) {
-    if (absl::StrContains(line, kKeyValueSeparator)) {
-      std::vector<std::string> key_and_value =
-          absl::StrSplit(line, absl::MaxSplits(kKeyValueSeparator, 1));
-      std::string key = key_and_value[0];
-      std::string value = key_and_value[1];
-      if (file_map.find(key) != file_map.end()) {
+  constexpr static char kKeyValueSeparator = ' ';
+  absl::string_view rest(contents);
+  while (!rest.empty()) {
+    size_t newline = rest.find('\n');
+    absl::string_view line = rest.substr(0, newline);
+    rest = newline == absl::string_view::npos ? absl::string_view()
+                                              : rest.substr(newline + 1);
+    size_t separator = line.find(kKeyValueSeparator);
+    if (separator != absl::string_view::npos) {
+      absl::string_view key = line.substr(0, separator);
+      if (!file_map.try_emplace(std::string(key), line.substr(separator + 1))
+               .second) {
         return absl::Status(absl::StatusCode::kFailedPrecondition,
                             absl::StrCat(key, " is duplicated in the file."));
       }
-      file_map.insert({key_and_value[0], key_and_value[1]});
     } else {
-      file_map.insert({line, ""});
+      file_map.try_emplace(std::string(line));
     }
   }
 
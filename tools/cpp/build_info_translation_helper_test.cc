@@ -99,6 +99,23 @@ TEST_F(BuildInfoTranslationHelperTest, MissingSeparator) {
                                    std::make_pair("key2value3", "")));
 }
 
+TEST_F(BuildInfoTranslationHelperTest, EmptyLinesAndTrailingNewline) {
+  std::string file_path =
+      absl::StrCat(FLAGS_test_tmpdir, "/", "empty_lines.txt");
+  std::ofstream(file_path) << "key1 value1\n\nkey2  two spaces\nkey3 \n";
+  BuildInfoTranslationHelper helper(file_path, "");
+
+  std::unordered_map<std::string, std::string> actual_info_file_map;
+  absl::Status actual_info_status = helper.ParseInfoFile(actual_info_file_map);
+
+  EXPECT_EQ(actual_info_status, absl::OkStatus());
+  EXPECT_THAT(actual_info_file_map,
+              UnorderedElementsAre(std::make_pair("key1", "value1"),
+                                   std::make_pair("", ""),
+                                   std::make_pair("key2", " two spaces"),
+                                   std::make_pair("key3", "")));
+}
+
 TEST_F(BuildInfoTranslationHelperTest, WriteFileWorksCorrectly) {
   std::vector<std::string> expected_entries({"aaa", "bbb", "ccc", "ddd"});
   WriteFile(expected_entries,
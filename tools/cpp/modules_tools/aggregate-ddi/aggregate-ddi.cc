@@ -14,11 +14,15 @@
 
 #include "tools/cpp/modules_tools/aggregate-ddi/aggregate-ddi.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -40,3 +44,80 @@ void write_output(std::ostream &output, const Cpp20ModulesInfo &info) {
   obj["usages"] = usages;
   output << to_json(obj);
 }
+
+static void append_u32(std::string &out, size_t value) {
+  if (value > std::numeric_limits<uint32_t>::max()) {
+    die("ERROR: module info too large for the binary format");
+  }
+  for (int i = 0; i < 4; i++) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+void write_binary_output(std::ostream &output, const Cpp20ModulesInfo &info) {
+  // Sort by name so that the output doesn't depend on the iteration order of
+  // the hash maps.
+  std::vector<const std::string *> module_names;
+  for (const auto &item : info.modules) {
+    module_names.push_back(&item.first);
+  }
+  std::vector<const std::string *> usage_names;
+  for (const auto &item : info.usages) {
+    usage_names.push_back(&item.first);
+  }
+  auto less = [](const std::string *a, const std::string *b) {
+    return *a < *b;
+  };
+  std::sort(module_names.begin(), module_names.end(), less);
+  std::sort(usage_names.begin(), usage_names.end(), less);
+
+  std::unordered_map<std::string_view, uint32_t> ids;
+  std::vector<std::string_view> strings;
+  auto intern = [&](const std::string &s) {
+    auto it = ids.emplace(s, static_cast<uint32_t>(strings.size())).first;
+    if (it->second == strings.size()) {
+      strings.push_back(s);
+    }
+    return it->second;
+  };
+
+  std::string modules;
+  for (const std::string *name : module_names) {
+    append_u32(modules, intern(*name));
+    append_u32(modules, intern(info.modules.at(*name)));
+  }
+  std::string usage_name_section;
+  std::string usage_offsets;
+  std::string edges;
+  size_t edge_count = 0;
+  append_u32(usage_offsets, 0);
+  for (const std::string *name : usage_names) {
+    append_u32(usage_name_section, intern(*name));
+    for (const auto &require_item : info.usages.at(*name)) {
+      append_u32(edges, intern(require_item));
+      edge_count++;
+    }
+    append_u32(usage_offsets, edge_count);
+  }
+  std::string string_offsets;
+  std::string string_data;
+  append_u32(string_offsets, 0);
+  for (std::string_view s : strings) {
+    string_data.append(s);
+    append_u32(string_offsets, string_data.size());
+  }
+  string_data.resize((string_data.size() + 3) & ~size_t{3}, '\0');
+
+  std::string header(kBinaryInfoMagic);
+  append_u32(header, kBinaryInfoVersion);
+  append_u32(header, strings.size());
+  append_u32(header, string_data.size());
+  append_u32(header, module_names.size());
+  append_u32(header, usage_names.size());
+  append_u32(header, edge_count);
+  for (const std::string *section :
+       {&header, &string_offsets, &string_data, &modules, &usage_name_section,
+        &usage_offsets, &edges}) {
+    output.write(section->data(), section->size());
+  }
+}
@@ -22,5 +22,8 @@
 #include "common/common.h"
 
 void write_output(std::ostream &output, const Cpp20ModulesInfo &info);
+// Writes the binary encoding described in common.h, which parse_info reads
+// much faster than the JSON.
+void write_binary_output(std::ostream &output, const Cpp20ModulesInfo &info);
 
 #endif  // BAZEL_TOOLS_CPP_MODULE_TOOLS_AGGREGATE_DDI_H_
@@ -29,3 +29,57 @@ TEST(WriteOutputTest, BasicFunctionality) {
       R"({"modules":{"module1":"/path/to/module1","module2":"/path/to/module2"},"usages":{"module1":["module2"]}})";
   EXPECT_EQ(output_stream.str(), expected_output);
 }
+
+TEST(WriteBinaryOutputTest, RoundTrip) {
+  Cpp20ModulesInfo info;
+  info.modules["module1"] = "/path/to/module1";
+  info.modules["module2"] = "/path/to/module2";
+  info.modules["module3"] = "/path/to/module3";
+  info.usages["module1"].push_back("module2");
+  info.usages["module1"].push_back("module3");
+  info.usages["module2"];
+  info.usages["external"].push_back("module1");
+
+  std::ostringstream output_stream;
+  write_binary_output(output_stream, info);
+  std::string output = output_stream.str();
+  EXPECT_EQ(output.substr(0, 4), kBinaryInfoMagic);
+  EXPECT_EQ(output.size() % 4, 0);
+
+  std::istringstream input_stream(output);
+  Cpp20ModulesInfo parsed = parse_info(input_stream);
+  EXPECT_EQ(parsed.modules, info.modules);
+  EXPECT_EQ(parsed.usages, info.usages);
+}
+
+TEST(WriteBinaryOutputTest, Empty) {
+  Cpp20ModulesInfo info;
+  std::ostringstream output_stream;
+  write_binary_output(output_stream, info);
+
+  std::istringstream input_stream(output_stream.str());
+  Cpp20ModulesInfo parsed = parse_info(input_stream);
+  EXPECT_TRUE(parsed.modules.empty());
+  EXPECT_TRUE(parsed.usages.empty());
+}
+
+TEST(WriteBinaryOutputTest, Deterministic) {
+  Cpp20ModulesInfo info1;
+  Cpp20ModulesInfo info2;
+  for (int i = 0; i < 100; i++) {
+    std::string name = "module" + std::to_string(i);
+    info1.modules[name] = "/path/to/" + name;
+    info1.usages[name].push_back("module" + std::to_string((i + 1) % 100));
+  }
+  for (int i = 99; i >= 0; i--) {
+    std::string name = "module" + std::to_string(i);
+    info2.modules[name] = "/path/to/" + name;
+    info2.usages[name].push_back("module" + std::to_string((i + 1) % 100));
+  }
+
+  std::ostringstream output_stream1;
+  std::ostringstream output_stream2;
+  write_binary_output(output_stream1, info1);
+  write_binary_output(output_stream2, info2);
+  EXPECT_EQ(output_stream1.str(), output_stream2.str());
+}
@@ -14,42 +14,62 @@
 
 #include <fstream>
 #include <iostream>
+#include <memory>
 
 #include "tools/cpp/modules_tools/aggregate-ddi/aggregate-ddi.h"
+#include "tools/cpp/modules_tools/common/worker.h"
 
-// Main function
-int main(int argc, char *argv[]) {
+// The most parsed info files a persistent worker keeps. The info files of
+// the dependencies of a target are the inputs of the aggregation of every
+// target depending on it.
+static const size_t kMaxCachedInfos = 64;
+
+using InfoCache = InputCache<Cpp20ModulesInfo>;
+
+static int aggregate(InfoCache &cache, const WorkRequest &request,
+                     std::ostream &out) {
+  const std::vector<std::string> &args = request.arguments;
   std::vector<std::string> cpp20modules_info;
   std::vector<std::string> ddi;
   std::vector<std::string> module_file;
   std::string output;
-  for (int i = 1; i < argc; ++i) {
-    std::string arg = argv[i];
-    if (arg == "-m" && i + 1 < argc) {
-      cpp20modules_info.emplace_back(argv[++i]);
-    } else if (arg == "-d" && i + 2 < argc) {
-      ddi.emplace_back(argv[++i]);
-      module_file.emplace_back(argv[++i]);
-    } else if (arg == "-o" && i + 1 < argc) {
-      output = argv[++i];
+  std::string binary_output;
+  for (size_t i = 0; i < args.size(); ++i) {
+    const std::string &arg = args[i];
+    if (arg == "-m" && i + 1 < args.size()) {
+      cpp20modules_info.emplace_back(args[++i]);
+    } else if (arg == "-d" && i + 2 < args.size()) {
+      ddi.emplace_back(args[++i]);
+      module_file.emplace_back(args[++i]);
+    } else if (arg == "-o" && i + 1 < args.size()) {
+      output = args[++i];
+    } else if (arg == "-b" && i + 1 < args.size()) {
+      binary_output = args[++i];
     } else {
-      std::cerr << "ERROR: Unknown or incomplete argument: " << arg
-                << std::endl;
-      std::exit(1);
+      out << "ERROR: Unknown or incomplete argument: " << arg << std::endl;
+      return 1;
     }
   }
   if (output.empty()) {
-    std::cerr << "ERROR: output not specified" << std::endl;
-    std::exit(1);
+    out << "ERROR: output not specified" << std::endl;
+    return 1;
   }
 
   Cpp20ModulesInfo full_info{};
 
   // Process cpp20modules_info files
   for (const auto &info_filename : cpp20modules_info) {
-    std::ifstream info_stream(info_filename);
-    auto info = parse_info(info_stream);
-    full_info.merge(info);
+    auto info = cache.get(
+        info_filename, request.digest(info_filename),
+        [](const std::string &path) {
+          std::ifstream info_stream(path, std::ios::binary);
+          if (!info_stream.is_open()) {
+            die("ERROR: Failed to open the file " + path);
+          }
+          return std::make_shared<const Cpp20ModulesInfo>(
+              parse_info(info_stream));
+        });
+    full_info.merge(*info);
   }
 
   // Process ddi files
@@ -67,10 +87,28 @@ int main(int argc, char *argv[]) {
   // Write final output to file
   std::ofstream of(output);
   if (!of.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << output << "\n";
-    std::exit(1);
+    die("ERROR: Failed to open the file " + output);
   }
   write_output(of, full_info);
 
+  if (!binary_output.empty()) {
+    std::ofstream bf(binary_output, std::ios::binary);
+    if (!bf.is_open()) {
+      die("ERROR: Failed to open the file " + binary_output);
+    }
+    write_binary_output(bf, full_info);
+  }
+
   return 0;
 }
+
+int main(int argc, char *argv[]) {
+  InfoCache cache(kMaxCachedInfos);
+  auto handler = [&cache](const WorkRequest &request, std::ostream &out) {
+    return aggregate(cache, request, out);
+  };
+  if (is_persistent_worker(argc, argv)) {
+    return run_worker(std::cin, std::cout, handler);
+  }
+  return run_once(argc, argv, handler);
+}
@@ -14,159 +14,527 @@
 
 #include "tools/cpp/modules_tools/common/common.h"
 
+#include <cctype>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
-#include "json.hpp"
+[[noreturn]] void die(const std::string &msg) { throw ToolError(msg); }
 
-void die(const std::string &msg) {
-  std::cerr << msg << std::endl;
-  std::exit(1);
+namespace {
+
+// Reads JSON straight out of the input buffer into the caller's structures,
+// without building a JsonValue tree first. Module info files of large targets
+// run to many MB, and the tree of std::map and std::variant nodes costs
+// several times the size of the input.
+//
+// The callbacks of read_object() and read_array() are called with the reader
+// positioned at the value of the member or element and must consume it.
+class JsonReader {
+ public:
+  explicit JsonReader(std::string_view s) : s_(s), i_(0) {}
+
+  // Returns the first character of the next value, or '\0' at the end of the
+  // input.
+  char peek() {
+    while (i_ < s_.size() && std::isspace(static_cast<unsigned char>(s_[i_]))) {
+      i_++;
+    }
+    return i_ < s_.size() ? s_[i_] : '\0';
+  }
+
+  void expect_end() {
+    peek();
+    if (i_ < s_.size()) {
+      fail("unexpected character after value");
+    }
+  }
+
+  // Reads a string. Strings without escapes are returned as a view into the
+  // input; others are decoded into a buffer that is reused by the next call.
+  std::string_view read_string() {
+    expect('"');
+    size_t start = i_;
+    while (i_ < s_.size() && s_[i_] != '"' && s_[i_] != '\\') {
+      i_++;
+    }
+    if (i_ < s_.size() && s_[i_] == '"') {
+      return s_.substr(start, i_++ - start);
+    }
+    scratch_.assign(s_.data() + start, i_ - start);
+    while (i_ < s_.size()) {
+      char c = s_[i_++];
+      if (c == '"') {
+        return scratch_;
+      }
+      if (c != '\\') {
+        scratch_.push_back(c);
+        continue;
+      }
+      if (i_ == s_.size()) {
+        break;
+      }
+      c = s_[i_++];
+      switch (c) {
+        case 'b':
+          scratch_.push_back('\b');
+          break;
+        case 'f':
+          scratch_.push_back('\f');
+          break;
+        case 'n':
+          scratch_.push_back('\n');
+          break;
+        case 'r':
+          scratch_.push_back('\r');
+          break;
+        case 't':
+          scratch_.push_back('\t');
+          break;
+        case 'u':
+          append_utf8(read_code_point());
+          break;
+        default:
+          scratch_.push_back(c);
+      }
+    }
+    fail("unclosed string literal");
+  }
+
+  // Skips a value and returns its text.
+  std::string_view skip_value() {
+    char c = peek();
+    size_t start = i_;
+    switch (c) {
+      case '"':
+        read_string();
+        break;
+      case '{':
+        read_object([this](std::string_view) { skip_value(); });
+        break;
+      case '[':
+        read_array([this]() { skip_value(); });
+        break;
+      case 't':
+        skip_literal("true");
+        break;
+      case 'f':
+        skip_literal("false");
+        break;
+      case 'n':
+        skip_literal("null");
+        break;
+      default:
+        if (i_ == s_.size()) {
+          fail("unexpected end of input");
+        }
+        if (!std::isdigit(static_cast<unsigned char>(c)) && c != '-') {
+          fail("unexpected character");
+        }
+        while (i_ < s_.size() &&
+               (std::isdigit(static_cast<unsigned char>(s_[i_])) ||
+                s_[i_] == '-' || s_[i_] == '+' || s_[i_] == '.' ||
+                s_[i_] == 'e' || s_[i_] == 'E')) {
+          i_++;
+        }
+    }
+    return s_.substr(start, i_ - start);
+  }
+
+  template <typename F>
+  void read_object(F f) {
+    expect('{');
+    if (peek() == '}') {
+      i_++;
+      return;
+    }
+    while (true) {
+      if (peek() != '"') {
+        fail("expected string key");
+      }
+      std::string_view key = read_string();
+      expect(':');
+      f(key);
+      char c = peek();
+      i_++;
+      if (c == '}') {
+        return;
+      }
+      if (c != ',') {
+        fail("expected ',' or '}'");
+      }
+    }
+  }
+
+  template <typename F>
+  void read_array(F f) {
+    expect('[');
+    if (peek() == ']') {
+      i_++;
+      return;
+    }
+    while (true) {
+      f();
+      char c = peek();
+      i_++;
+      if (c == ']') {
+        return;
+      }
+      if (c != ',') {
+        fail("expected ',' or ']'");
+      }
+    }
+  }
+
+ private:
+  [[noreturn]] void fail(const std::string &msg) {
+    die("invalid JSON at offset " + std::to_string(i_) + ": " + msg);
+  }
+
+  void expect(char c) {
+    if (peek() != c) {
+      fail(std::string("expected '") + c + "'");
+    }
+    i_++;
+  }
+
+  void skip_literal(std::string_view literal) {
+    if (s_.substr(i_, literal.size()) != literal) {
+      fail("unexpected character");
+    }
+    i_ += literal.size();
+  }
+
+  unsigned read_hex4() {
+    if (s_.size() - i_ < 4) {
+      fail("truncated \\u escape");
+    }
+    unsigned result = 0;
+    for (int k = 0; k < 4; k++) {
+      char c = s_[i_++];
+      result <<= 4;
+      if (c >= '0' && c <= '9') {
+        result |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        result |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        result |= c - 'A' + 10;
+      } else {
+        fail("invalid \\u escape");
+      }
+    }
+    return result;
+  }
+
+  unsigned read_code_point() {
+    unsigned result = read_hex4();
+    if (result >= 0xd800 && result < 0xdc00 && s_.substr(i_, 2) == "\\u") {
+      size_t backup = i_;
+      i_ += 2;
+      unsigned low = read_hex4();
+      if (low >= 0xdc00 && low < 0xe000) {
+        return 0x10000 + ((result - 0xd800) << 10) + (low - 0xdc00);
+      }
+      i_ = backup;
+    }
+    return result;
+  }
+
+  void append_utf8(unsigned code_point) {
+    if (code_point < 0x80) {
+      scratch_.push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      scratch_.push_back(static_cast<char>(0xc0 | (code_point >> 6)));
+      scratch_.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else if (code_point < 0x10000) {
+      scratch_.push_back(static_cast<char>(0xe0 | (code_point >> 12)));
+      scratch_.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+      scratch_.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    } else {
+      scratch_.push_back(static_cast<char>(0xf0 | (code_point >> 18)));
+      scratch_.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3f)));
+      scratch_.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3f)));
+      scratch_.push_back(static_cast<char>(0x80 | (code_point & 0x3f)));
+    }
+  }
+
+  std::string_view s_;
+  size_t i_;
+  std::string scratch_;
+};
+
+std::string read_stream(std::istream &stream) {
+  std::string result;
+  char buffer[64 * 1024];
+  while (stream.read(buffer, sizeof(buffer)) || stream.gcount() > 0) {
+    result.append(buffer, stream.gcount());
+  }
+  return result;
 }
 
-void parse_provides(const JsonValue &provides_data, ModuleDep &dep) {
-  if (provides_data.is_null()) {
+void parse_provides(JsonReader &reader, ModuleDep &dep) {
+  dep.gen_bmi = false;
+  dep.name.clear();
+  if (reader.peek() == 'n') {
+    reader.skip_value();
     return;
   }
-  if (!provides_data.is_array()) {
+  if (reader.peek() != '[') {
     die("require ddi content 'rules[0][\"provides\"]' is JSON array");
   }
   // Only 1 provide in rule
   // In C++20 Modules, one TU provide only one module.
   // Fortran can provide more than one module per TU.
   // This check is fine for C++20 Modules.
-  auto provides = provides_data.as_array();
-  if (provides.size() > 1) {
-    die("require ddi content 'rules[0][\"provides\"]' has only 1 provide");
-  }
-  if (provides.size() == 1) {
-    auto provide_data = provides[0];
-    if (!provide_data.is_object()) {
+  int count = 0;
+  reader.read_array([&]() {
+    if (++count > 1) {
+      die("require ddi content 'rules[0][\"provides\"]' has only 1 provide");
+    }
+    if (reader.peek() != '{') {
       die("require ddi content 'rules[0][\"provides\"][0]' is JSON object");
     }
-    auto provide_obj = provide_data.as_object();
-    if (provide_obj.find("logical-name") == provide_obj.end()) {
+    bool has_name = false;
+    reader.read_object([&](std::string_view key) {
+      if (key != "logical-name") {
+        reader.skip_value();
+        return;
+      }
+      if (reader.peek() != '"') {
+        die("require ddi content 'rules[0][\"provides\"][0][\"logical-name\"]' "
+            "is JSON string");
+      }
+      has_name = true;
+      dep.name = reader.read_string();
+    });
+    if (!has_name) {
       die("require 'logical-name' in 'rules[0][\"provides\"][0]'");
     }
-    auto name_data = provide_obj.at("logical-name");
-    if (!name_data.is_string()) {
-      die("require ddi content 'rules[0][\"provides\"][0][\"logical-name\"]' "
-          "is JSON string");
-    }
     dep.gen_bmi = true;
-    dep.name = name_data.as_string();
-  }
+  });
 }
 
-void parse_requires(const JsonValue &requires_data, ModuleDep &dep) {
-  if (requires_data.is_null()) {
+void parse_requires(JsonReader &reader, ModuleDep &dep) {
+  dep.require_list.clear();
+  if (reader.peek() == 'n') {
+    reader.skip_value();
     return;
   }
-  if (!requires_data.is_array()) {
+  if (reader.peek() != '[') {
     die("require ddi content 'rules[0][\"requires\"]' is JSON array");
   }
-  for (const auto &item_data : requires_data.as_array()) {
-    if (!item_data.is_object()) {
-      die("require JSON object, but got " + item_data.dump());
+  reader.read_array([&]() {
+    if (reader.peek() != '{') {
+      die("require JSON object, but got " + std::string(reader.skip_value()));
     }
-    auto item_obj = item_data.as_object();
-    if (item_obj.find("logical-name") == item_obj.end()) {
+    bool has_name = false;
+    reader.read_object([&](std::string_view key) {
+      if (key != "logical-name") {
+        reader.skip_value();
+        return;
+      }
+      if (reader.peek() != '"') {
+        die("require JSON string, but got " +
+            std::string(reader.skip_value()));
+      }
+      has_name = true;
+      dep.require_list.emplace_back(reader.read_string());
+    });
+    if (!has_name) {
       die("requrie 'logical-name' in 'rules[0][\"requires\"]' item");
     }
-    auto name_data = item_obj.at("logical-name");
-    if (!name_data.is_string()) {
-      die("require JSON string, but got " + name_data.dump());
-    }
-    dep.require_list.push_back(name_data.as_string());
+  });
+}
+
+void parse_rule(JsonReader &reader, ModuleDep &dep) {
+  if (reader.peek() != '{') {
+    die("require ddi content 'rules[0]' is JSON object");
   }
+  reader.read_object([&](std::string_view key) {
+    if (key == "provides") {
+      parse_provides(reader, dep);
+    } else if (key == "requires") {
+      parse_requires(reader, dep);
+    } else {
+      reader.skip_value();
+    }
+  });
 }
 
-ModuleDep parse_ddi(std::istream &ddi_stream) {
-  ModuleDep dep{};
-  std::string ddi_string((std::istreambuf_iterator<char>(ddi_stream)),
-                         std::istreambuf_iterator<char>());
-  JsonValue data = parse_json(ddi_string);
-  if (!data.is_object()) {
-    die("require ddi content is JSON object");
+[[noreturn]] void die_corrupt_binary_info() {
+  die("corrupt binary module info");
+}
+
+uint32_t load_u32(std::string_view data, uint64_t offset) {
+  const unsigned char *p =
+      reinterpret_cast<const unsigned char *>(data.data()) + offset;
+  return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+Cpp20ModulesInfo parse_binary_info(std::string_view data) {
+  const uint64_t header_size = kBinaryInfoMagic.size() + 6 * 4;
+  if (data.size() < header_size) {
+    die_corrupt_binary_info();
+  }
+  uint32_t version = load_u32(data, 4);
+  if (version != kBinaryInfoVersion) {
+    die("unsupported binary module info version " + std::to_string(version));
+  }
+  uint64_t string_count = load_u32(data, 8);
+  uint64_t string_bytes = load_u32(data, 12);
+  uint64_t module_count = load_u32(data, 16);
+  uint64_t usage_count = load_u32(data, 20);
+  uint64_t edge_count = load_u32(data, 24);
+  uint64_t string_offsets = header_size;
+  uint64_t strings = string_offsets + 4 * (string_count + 1);
+  uint64_t modules = strings + string_bytes;
+  uint64_t usage_names = modules + 8 * module_count;
+  uint64_t usage_offsets = usage_names + 4 * usage_count;
+  uint64_t edges = usage_offsets + 4 * (usage_count + 1);
+  if (string_bytes % 4 != 0 || edges + 4 * edge_count != data.size()) {
+    die_corrupt_binary_info();
   }
 
-  auto data_obj = data.as_object();
-  if (data_obj.find("rules") == data_obj.end()) {
-    die("require 'rules' in ddi content");
+  std::vector<std::string_view> table(string_count);
+  for (uint64_t i = 0; i < string_count; i++) {
+    uint32_t begin = load_u32(data, string_offsets + 4 * i);
+    uint32_t end = load_u32(data, string_offsets + 4 * (i + 1));
+    if (begin > end || end > string_bytes) {
+      die_corrupt_binary_info();
+    }
+    table[i] = data.substr(strings + begin, end - begin);
   }
+  auto string_at = [&](uint64_t offset) {
+    uint32_t index = load_u32(data, offset);
+    if (index >= string_count) {
+      die_corrupt_binary_info();
+    }
+    return table[index];
+  };
 
-  auto rules_data = data.as_object().at("rules");
-  if (!rules_data.is_array()) {
-    die("require ddi content 'rules' is JSON array");
+  Cpp20ModulesInfo info;
+  info.modules.reserve(module_count);
+  for (uint64_t i = 0; i < module_count; i++) {
+    info.modules[std::string(string_at(modules + 8 * i))] =
+        string_at(modules + 8 * i + 4);
   }
-  auto rules = rules_data.as_array();
-  // Only 1 rule in DDI file
-  // DDI files can contain multiple rules (in general).
-  // bazel does per-TU scanning rather than batch scanning.
-  // Therefore, report error if multiple rules here
-  if (rules.size() > 1) {
-    die("require ddi content 'rules' has only 1 rule");
+  info.usages.reserve(usage_count);
+  for (uint64_t i = 0; i < usage_count; i++) {
+    uint32_t begin = load_u32(data, usage_offsets + 4 * i);
+    uint32_t end = load_u32(data, usage_offsets + 4 * (i + 1));
+    if (begin > end || end > edge_count) {
+      die_corrupt_binary_info();
+    }
+    std::vector<std::string> &require_list =
+        info.usages[std::string(string_at(usage_names + 4 * i))];
+    require_list.clear();
+    require_list.reserve(end - begin);
+    for (uint32_t e = begin; e < end; e++) {
+      require_list.emplace_back(string_at(edges + 4 * e));
+    }
   }
-  if (rules.empty()) {
-    return dep;
+  return info;
+}
+
+}  // namespace
+
+ModuleDep parse_ddi(std::istream &ddi_stream) {
+  ModuleDep dep{};
+  std::string ddi_string = read_stream(ddi_stream);
+  JsonReader reader(ddi_string);
+  if (reader.peek() != '{') {
+    die("require ddi content is JSON object");
   }
-  auto rule_data = rules[0];
-  if (!rule_data.is_object()) {
-    die("require ddi content 'rules[0]' is JSON object");
+  bool has_rules = false;
+  reader.read_object([&](std::string_view key) {
+    if (key != "rules") {
+      reader.skip_value();
+      return;
+    }
+    if (reader.peek() != '[') {
+      die("require ddi content 'rules' is JSON array");
+    }
+    has_rules = true;
+    dep = ModuleDep{};
+    // Only 1 rule in DDI file
+    // DDI files can contain multiple rules (in general).
+    // bazel does per-TU scanning rather than batch scanning.
+    // Therefore, report error if multiple rules here
+    int count = 0;
+    reader.read_array([&]() {
+      if (++count > 1) {
+        die("require ddi content 'rules' has only 1 rule");
+      }
+      parse_rule(reader, dep);
+    });
+  });
+  reader.expect_end();
+  if (!has_rules) {
+    die("require 'rules' in ddi content");
   }
-  auto rule = rule_data.as_object();
-  auto provides_data = rule["provides"];
-  auto requires_data = rule["requires"];
-  parse_provides(provides_data, dep);
-  parse_requires(requires_data, dep);
   return dep;
 }
 
 Cpp20ModulesInfo parse_info(std::istream &info_stream) {
-  std::string info_string((std::istreambuf_iterator<char>(info_stream)),
-                          std::istreambuf_iterator<char>());
-  JsonValue data = parse_json(info_string);
-  if (!data.is_object()) {
-    die("require content is JSON object");
+  std::string info_string = read_stream(info_stream);
+  if (std::string_view(info_string).substr(0, kBinaryInfoMagic.size()) ==
+      kBinaryInfoMagic) {
+    return parse_binary_info(info_string);
   }
-  auto data_obj = data.as_object();
-  if (data_obj.find("modules") == data_obj.end()) {
-    die("require 'modules' in JSON object");
-  }
-  auto modules_data = data_obj.at("modules");
-  if (!modules_data.is_object()) {
-    die("require 'modules' is JSON object");
-  }
-  if (data_obj.find("usages") == data_obj.end()) {
-    die("require 'usages' in JSON object");
-  }
-  auto usages_data = data_obj.at("usages");
-  if (!usages_data.is_object()) {
-    die("require 'usages' is JSON object");
+  JsonReader reader(info_string);
+  if (reader.peek() != '{') {
+    die("require content is JSON object");
   }
   Cpp20ModulesInfo info;
-  for (const auto &item_data : modules_data.as_object()) {
-    auto name = item_data.first;
-    auto bmi_data = item_data.second;
-    if (!bmi_data.is_string()) {
-      die("require JSON string, but got " + bmi_data.dump());
-    }
-    info.modules[name] = bmi_data.as_string();
-  }
-  for (const auto &item_data : usages_data.as_object()) {
-    auto name = item_data.first;
-    auto require_list_data = item_data.second;
-    if (!require_list_data.is_array()) {
-      die("require JSON array");
-    }
-    std::vector<std::string> require_list;
-    for (const auto &require_item_data : require_list_data.as_array()) {
-      if (!require_item_data.is_string()) {
-        die("require JSON string, but got " + require_item_data.dump());
+  bool has_modules = false;
+  bool has_usages = false;
+  reader.read_object([&](std::string_view key) {
+    if (key == "modules") {
+      if (reader.peek() != '{') {
+        die("require 'modules' is JSON object");
+      }
+      has_modules = true;
+      info.modules.clear();
+      reader.read_object([&](std::string_view name) {
+        std::string &bmi = info.modules[std::string(name)];
+        if (reader.peek() != '"') {
+          die("require JSON string, but got " +
+              std::string(reader.skip_value()));
+        }
+        bmi = reader.read_string();
+      });
+    } else if (key == "usages") {
+      if (reader.peek() != '{') {
+        die("require 'usages' is JSON object");
       }
-      require_list.push_back(require_item_data.as_string());
+      has_usages = true;
+      info.usages.clear();
+      reader.read_object([&](std::string_view name) {
+        std::vector<std::string> &require_list =
+            info.usages[std::string(name)];
+        require_list.clear();
+        if (reader.peek() != '[') {
+          die("require JSON array");
+        }
+        reader.read_array([&]() {
+          if (reader.peek() != '"') {
+            die("require JSON string, but got " +
+                std::string(reader.skip_value()));
+          }
+          require_list.emplace_back(reader.read_string());
+        });
+      });
+    } else {
+      reader.skip_value();
     }
-    info.usages[name] = require_list;
+  });
+  reader.expect_end();
+  if (!has_modules) {
+    die("require 'modules' in JSON object");
+  }
+  if (!has_usages) {
+    die("require 'usages' in JSON object");
   }
   return info;
 }
-
@@ -15,12 +15,26 @@
 #ifndef BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_H_
 #define BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_H_
 
+#include <cstdint>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
 #include "json.hpp"
 
+// Thrown on invalid input and on I/O errors. A one-shot invocation of the
+// tools prints the message and exits with 1, a persistent worker fails the
+// request and goes on with the next one.
+class ToolError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// Throws a ToolError with msg.
+[[noreturn]] void die(const std::string &msg);
+
 struct Cpp20ModulesInfo {
   std::unordered_map<std::string, std::string> modules;
   std::unordered_map<std::string, std::vector<std::string>> usages;
@@ -41,7 +55,31 @@ struct ModuleDep {
   std::vector<std::string> require_list;
 };
 
+// The binary encoding of Cpp20ModulesInfo written by aggregate-ddi. All
+// integers are 32-bit little-endian and every section is 4-byte aligned, so
+// the file can be used in place once it is in memory:
+//
+//   char     magic[4]                  "CMI\0"
+//   uint32_t version                   kBinaryInfoVersion
+//   uint32_t string_count
+//   uint32_t string_bytes              padded to a multiple of 4
+//   uint32_t module_count
+//   uint32_t usage_count
+//   uint32_t edge_count
+//   uint32_t string_offsets[string_count + 1]
+//   char     strings[string_bytes]
+//   uint32_t modules[module_count][2]  name, BMI path as string indices
+//   uint32_t usage_names[usage_count]  string indices
+//   uint32_t usage_offsets[usage_count + 1]
+//   uint32_t edges[edge_count]         string indices
+//
+// The usages of usage_names[i] are edges[usage_offsets[i]] to
+// edges[usage_offsets[i + 1]].
+constexpr std::string_view kBinaryInfoMagic("CMI\0", 4);
+constexpr uint32_t kBinaryInfoVersion = 1;
+
 ModuleDep parse_ddi(std::istream &ddi_stream);
+// Accepts both the JSON and the binary encoding.
 Cpp20ModulesInfo parse_info(std::istream &info_stream);
 
 #endif  // BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_H_
@@ -153,3 +153,82 @@ TEST(DdiTest, EmptyProvides) {
   EXPECT_EQ(ddi.gen_bmi, false);
   EXPECT_EQ(ddi.require_list, std::vector<std::string>{"bar"});
 }
+
+TEST(DdiTest, SkipsUnknownMembers) {
+  std::string ddi_content = R"({
+        "revision": 0,
+        "rules": [{
+            "primary-output": "foo.pcm",
+            "requires": [{
+                "logical-name": "bar",
+                "lookup-method": "by-name",
+                "extra": {"nested": [1, -2.5e3, true, false, null, "]}"]}
+            }],
+            "provides": [{
+                "is-interface": true,
+                "logical-name": "foo",
+                "source-path": "foo.cppm"
+            }]
+        }],
+        "version": 1
+    })";
+
+  std::istringstream ddi_stream(ddi_content);
+  auto ddi = parse_ddi(ddi_stream);
+  EXPECT_EQ(ddi.name, "foo");
+  EXPECT_EQ(ddi.gen_bmi, true);
+  EXPECT_EQ(ddi.require_list, std::vector<std::string>{"bar"});
+}
+
+TEST(DdiTest, NullProvidesAndRequires) {
+  std::string ddi_content = R"({
+        "rules": [{
+            "provides": null,
+            "requires": null
+        }]
+    })";
+
+  std::istringstream ddi_stream(ddi_content);
+  auto ddi = parse_ddi(ddi_stream);
+  EXPECT_EQ(ddi.name, "");
+  EXPECT_EQ(ddi.gen_bmi, false);
+  EXPECT_TRUE(ddi.require_list.empty());
+}
+
+TEST(DdiTest, EscapedNames) {
+  std::string ddi_content = R"({
+        "rules": [{
+            "provides": [{
+                "logical-name": "foo\"bar\\baz"
+            }],
+            "requires": [{
+                "logical-name": "caf\u00e9"
+            }, {
+                "logical-name": "\ud83d\ude00"
+            }]
+        }]
+    })";
+
+  std::istringstream ddi_stream(ddi_content);
+  auto ddi = parse_ddi(ddi_stream);
+  EXPECT_EQ(ddi.name, "foo\"bar\\baz");
+  EXPECT_EQ(ddi.require_list,
+            (std::vector<std::string>{"caf\xc3\xa9", "\xf0\x9f\x98\x80"}));
+}
+
+TEST(Cpp20ModulesInfoTest, EscapedKeys) {
+  std::string info_content = R"({
+        "usages": {
+            "a\u002eb": ["c\td"]
+        },
+        "modules": {
+            "a.b": "/path/to/a.b"
+        }
+    })";
+
+  std::istringstream info_stream(info_content);
+  Cpp20ModulesInfo info = parse_info(info_stream);
+
+  EXPECT_EQ(info.modules["a.b"], "/path/to/a.b");
+  EXPECT_EQ(info.usages["a.b"], std::vector<std::string>{"c\td"});
+}
@@ -0,0 +1,163 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tools/cpp/modules_tools/common/worker.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "tools/cpp/modules_tools/common/common.h"
+
+std::string WorkRequest::digest(const std::string &path) const {
+  auto it = digests.find(path);
+  return it != digests.end() ? it->second : std::string();
+}
+
+bool is_persistent_worker(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--persistent_worker") {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<std::string> expand_params_files(
+    const std::vector<std::string> &args) {
+  std::vector<std::string> result;
+  for (const auto &arg : args) {
+    if (arg.size() < 2 || arg[0] != '@') {
+      result.push_back(arg);
+      continue;
+    }
+    std::ifstream params(arg.substr(1));
+    if (!params.is_open()) {
+      die("ERROR: Failed to open the file " + arg.substr(1));
+    }
+    std::string line;
+    while (std::getline(params, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      result.push_back(line);
+    }
+  }
+  return result;
+}
+
+WorkRequest parse_work_request(const std::string &line) {
+  JsonValue json;
+  try {
+    json = parse_json(line);
+  } catch (const std::runtime_error &e) {
+    die(std::string("invalid work request: ") + e.what());
+  }
+  if (!json.is_object()) {
+    die("invalid work request: require JSON object");
+  }
+  // The fields with default values are omitted.
+  WorkRequest request;
+  const auto &obj = json.as_object();
+  auto it = obj.find("arguments");
+  if (it != obj.end()) {
+    if (!it->second.is_array()) {
+      die("invalid work request: require 'arguments' is JSON array");
+    }
+    for (const auto &arg : it->second.as_array()) {
+      if (!arg.is_string()) {
+        die("invalid work request: require JSON string, but got " +
+            arg.dump());
+      }
+      request.arguments.push_back(arg.as_string());
+    }
+  }
+  it = obj.find("inputs");
+  if (it != obj.end()) {
+    if (!it->second.is_array()) {
+      die("invalid work request: require 'inputs' is JSON array");
+    }
+    for (const auto &input : it->second.as_array()) {
+      if (!input.is_object()) {
+        die("invalid work request: require JSON object, but got " +
+            input.dump());
+      }
+      auto path = input.as_object().find("path");
+      auto digest = input.as_object().find("digest");
+      if (path != input.as_object().end() && path->second.is_string() &&
+          digest != input.as_object().end() && digest->second.is_string()) {
+        request.digests[path->second.as_string()] = digest->second.as_string();
+      }
+    }
+  }
+  it = obj.find("requestId");
+  if (it != obj.end()) {
+    if (!it->second.is_long()) {
+      die("invalid work request: require 'requestId' is JSON integer");
+    }
+    request.request_id = it->second.as_long();
+  }
+  return request;
+}
+
+std::string format_work_response(int exit_code, const std::string &output,
+                                 long request_id) {
+  JsonValue::ObjectType obj;
+  obj["exitCode"] = exit_code;
+  obj["output"] = output;
+  obj["requestId"] = request_id;
+  return to_json(obj);
+}
+
+// Handles one request, expanding its params files. Returns its exit code.
+static int handle(WorkRequest request, std::ostream &output,
+                  const WorkHandler &handler) {
+  try {
+    request.arguments = expand_params_files(request.arguments);
+    return handler(request, output);
+  } catch (const ToolError &e) {
+    output << e.what() << std::endl;
+    return 1;
+  }
+}
+
+int run_worker(std::istream &in, std::ostream &out,
+               const WorkHandler &handler) {
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    WorkRequest request;
+    try {
+      request = parse_work_request(line);
+    } catch (const ToolError &e) {
+      // Bazel cannot tell which request this answers: give up on the worker.
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    std::ostringstream output;
+    int exit_code = handle(request, output, handler);
+    out << format_work_response(exit_code, output.str(), request.request_id)
+        << std::endl;
+  }
+  return 0;
+}
+
+int run_once(int argc, char *argv[], const WorkHandler &handler) {
+  WorkRequest request;
+  request.arguments.assign(argv + 1, argv + argc);
+  return handle(std::move(request), std::cerr, handler);
+}
@@ -0,0 +1,122 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_WORKER_H_
+#define BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_WORKER_H_
+
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Support for running the tools as Bazel persistent workers with the JSON
+// worker protocol: started with --persistent_worker, a worker reads one
+// WorkRequest per line from stdin and answers each with a WorkResponse on
+// stdout, one request at a time.
+
+struct WorkRequest {
+  // The arguments of the action, with the params files expanded.
+  std::vector<std::string> arguments;
+  // The digests of the inputs of the action by path, as given by Bazel.
+  std::unordered_map<std::string, std::string> digests;
+  long request_id = 0;
+
+  // Returns the digest of the input at path, or an empty string if unknown.
+  std::string digest(const std::string &path) const;
+};
+
+// Handles a request, writing its diagnostics to output, and returns its exit
+// code. A ToolError it throws fails the request with its message.
+using WorkHandler =
+    std::function<int(const WorkRequest &request, std::ostream &output)>;
+
+// Returns whether the tool was started as a persistent worker.
+bool is_persistent_worker(int argc, char *argv[]);
+
+// Replaces the @<file> arguments by the lines of file, as written by Bazel
+// for the params files of the "multiline" format.
+std::vector<std::string> expand_params_files(
+    const std::vector<std::string> &args);
+
+// Parses a WorkRequest encoded as JSON.
+WorkRequest parse_work_request(const std::string &line);
+
+// Encodes a WorkResponse as JSON, without the trailing newline.
+std::string format_work_response(int exit_code, const std::string &output,
+                                 long request_id);
+
+// Handles the requests read from in until it ends, writing the responses to
+// out. Returns the exit code of the worker.
+int run_worker(std::istream &in, std::ostream &out, const WorkHandler &handler);
+
+// Handles the request of a one-shot invocation with the arguments of argv,
+// writing the diagnostics to stderr. Returns the exit code of the tool.
+int run_once(int argc, char *argv[], const WorkHandler &handler);
+
+// Values computed from the contents of input files, such as parsed C++20
+// modules information, kept across the requests of a persistent worker. They
+// are keyed by the digest of the file, so that the file shared by many
+// actions is read once, and evicted least recently used first.
+template <typename T>
+class InputCache {
+ public:
+  using Loader = std::function<std::shared_ptr<const T>(const std::string &)>;
+
+  explicit InputCache(size_t capacity) : capacity_(capacity) {}
+
+  // Returns load(path), or the value loaded for a file with the same digest
+  // before. An empty digest means the contents are unknown: the value is
+  // loaded and not cached.
+  std::shared_ptr<const T> get(const std::string &path,
+                               const std::string &digest, const Loader &load) {
+    if (digest.empty() || capacity_ == 0) {
+      return load(path);
+    }
+    auto it = index_.find(digest);
+    if (it != index_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      ++hits_;
+      return it->second->second;
+    }
+    std::shared_ptr<const T> value = load(path);
+    ++misses_;
+    entries_.emplace_front(digest, value);
+    index_[digest] = entries_.begin();
+    if (entries_.size() > capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+    return value;
+  }
+
+  size_t size() const { return entries_.size(); }
+  size_t hits() const { return hits_; }
+  size_t misses() const { return misses_; }
+
+ private:
+  using Entry = std::pair<std::string, std::shared_ptr<const T>>;
+
+  size_t capacity_;
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, typename std::list<Entry>::iterator> index_;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
+#endif  // BAZEL_TOOLS_CPP_MODULE_TOOLS_COMMON_WORKER_H_
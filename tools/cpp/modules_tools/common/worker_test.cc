@@ -0,0 +1,115 @@
+// Copyright 2026 The Bazel Authors. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tools/cpp/modules_tools/common/worker.h"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+#include "tools/cpp/modules_tools/common/common.h"
+
+TEST(WorkerTest, ParseWorkRequest) {
+  WorkRequest request = parse_work_request(
+      R"({"arguments":["a.ddi","a.CXXModules.json","a.modmap","clang"],)"
+      R"("inputs":[{"path":"a.ddi","digest":"AAAA"},)"
+      R"({"path":"a.CXXModules.json","digest":"BBBB"}],"requestId":3})");
+
+  std::vector<std::string> expected_arguments{"a.ddi", "a.CXXModules.json",
+                                              "a.modmap", "clang"};
+  EXPECT_EQ(request.arguments, expected_arguments);
+  EXPECT_EQ(request.digest("a.CXXModules.json"), "BBBB");
+  EXPECT_EQ(request.digest("b.CXXModules.json"), "");
+  EXPECT_EQ(request.request_id, 3);
+}
+
+TEST(WorkerTest, ParseWorkRequestWithDefaults) {
+  WorkRequest request = parse_work_request("{}");
+
+  EXPECT_TRUE(request.arguments.empty());
+  EXPECT_TRUE(request.digests.empty());
+  EXPECT_EQ(request.request_id, 0);
+}
+
+TEST(WorkerTest, ParseInvalidWorkRequest) {
+  EXPECT_THROW(parse_work_request("[]"), ToolError);
+  EXPECT_THROW(parse_work_request(R"({"arguments":[1]})"), ToolError);
+  EXPECT_THROW(parse_work_request("{"), ToolError);
+}
+
+TEST(WorkerTest, RunWorker) {
+  std::istringstream in(R"({"arguments":["ok"],"requestId":1})"
+                        "\n"
+                        R"({"arguments":["fail"],"requestId":2})"
+                        "\n");
+  std::ostringstream out;
+  int exit_code =
+      run_worker(in, out, [](const WorkRequest &request, std::ostream &output) {
+        if (request.arguments[0] == "fail") {
+          die("ERROR: Module not found: foo");
+        }
+        output << "done";
+        return 0;
+      });
+
+  EXPECT_EQ(exit_code, 0);
+  EXPECT_EQ(out.str(),
+            R"({"exitCode":0,"output":"done","requestId":1})"
+            "\n"
+            R"({"exitCode":1,"output":"ERROR: Module not found: foo\n","requestId":2})"
+            "\n");
+}
+
+TEST(WorkerTest, InputCacheReusesValuesWithSameDigest) {
+  InputCache<std::string> cache(2);
+  int loads = 0;
+  auto load = [&loads](const std::string &path) {
+    ++loads;
+    return std::make_shared<const std::string>(path);
+  };
+
+  EXPECT_EQ(*cache.get("a", "digest-a", load), "a");
+  // Another path with the same contents.
+  EXPECT_EQ(*cache.get("b", "digest-a", load), "a");
+  EXPECT_EQ(loads, 1);
+  EXPECT_EQ(cache.hits(), 1);
+
+  // Without a digest, nothing is cached.
+  EXPECT_EQ(*cache.get("c", "", load), "c");
+  EXPECT_EQ(*cache.get("c", "", load), "c");
+  EXPECT_EQ(loads, 3);
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(WorkerTest, InputCacheEvictsLeastRecentlyUsed) {
+  InputCache<std::string> cache(2);
+  int loads = 0;
+  auto load = [&loads](const std::string &path) {
+    ++loads;
+    return std::make_shared<const std::string>(path);
+  };
+
+  cache.get("a", "digest-a", load);
+  cache.get("b", "digest-b", load);
+  cache.get("a", "digest-a", load);
+  cache.get("c", "digest-c", load);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(loads, 3);
+
+  // b was evicted, a was not.
+  cache.get("a", "digest-a", load);
+  EXPECT_EQ(loads, 3);
+  cache.get("b", "digest-b", load);
+  EXPECT_EQ(loads, 4);
+}
@@ -14,6 +14,8 @@
 
 #include "tools/cpp/modules_tools/generate-modmap/generate-modmap.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <queue>
 #include <sstream>
@@ -57,8 +59,7 @@ void write_modmap(std::ostream &modmap_file_stream,
       modmap_file_stream << "/reference " << item.name << "=" << item.path
                          << "\n";
     } else {
-      std::cerr << "bad compiler: " << compiler << std::endl;
-      std::exit(1);
+      die("bad compiler: " + compiler);
     }
     modmap_file_dot_input_stream << item.path << "\n";
   }
@@ -94,10 +95,148 @@ std::unordered_set<ModmapItem> process(const ModuleDep &dep,
   for (const auto &name : s) {
     auto it = info.modules.find(name);
     if (it == info.modules.end()) {
-      std::cerr << "ERROR: Module not found: " << name << std::endl;
-      std::exit(1);
+      die("ERROR: Module not found: " + name);
     }
     modmap.insert(ModmapItem{name, it->second});
   }
   return modmap;
 }
+
+ModuleGraph::ModuleGraph(const Cpp20ModulesInfo &info) {
+  for (const auto &item : info.modules) {
+    intern(item.first);
+  }
+  for (const auto &item : info.usages) {
+    int id = intern(item.first);
+    for (const auto &dep : item.second) {
+      int dep_id = intern(dep);
+      edges_[id].push_back(dep_id);
+    }
+  }
+  paths_.assign(names_.size(), nullptr);
+  for (const auto &item : info.modules) {
+    paths_[ids_.at(item.first)] = &item.second;
+  }
+  compute_closures();
+}
+
+int ModuleGraph::intern(const std::string &name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  int id = names_.size();
+  ids_.emplace(name, id);
+  names_.push_back(name);
+  edges_.emplace_back();
+  return id;
+}
+
+// Tarjan's algorithm, without recursion since module chains can be long.
+// It finds the components in reverse topological order, so the closures of
+// the components a component depends on are always known by the time its
+// own closure is computed.
+void ModuleGraph::compute_closures() {
+  int n = names_.size();
+  size_t words = (n + 63) / 64;
+  std::vector<int> index(n, -1);
+  std::vector<int> low(n, 0);
+  std::vector<bool> on_stack(n, false);
+  std::vector<int> stack;
+  std::vector<std::pair<int, size_t>> call_stack;
+  std::vector<int> members;
+  int next_index = 0;
+  components_.assign(n, -1);
+
+  auto visit = [&](int v) {
+    index[v] = low[v] = next_index++;
+    stack.push_back(v);
+    on_stack[v] = true;
+    call_stack.emplace_back(v, 0);
+  };
+  for (int root = 0; root < n; ++root) {
+    if (index[root] != -1) {
+      continue;
+    }
+    visit(root);
+    while (!call_stack.empty()) {
+      int v = call_stack.back().first;
+      size_t &next_edge = call_stack.back().second;
+      if (next_edge < edges_[v].size()) {
+        int w = edges_[v][next_edge++];
+        if (index[w] == -1) {
+          visit(w);
+        } else if (on_stack[w]) {
+          low[v] = std::min(low[v], index[w]);
+        }
+        continue;
+      }
+
+      if (low[v] == index[v]) {
+        int component = closures_.size();
+        members.clear();
+        int w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          on_stack[w] = false;
+          components_[w] = component;
+          members.push_back(w);
+        } while (w != v);
+        std::vector<uint64_t> closure(words, 0);
+        for (int member : members) {
+          closure[member / 64] |= uint64_t{1} << (member % 64);
+          for (int dep : edges_[member]) {
+            if (components_[dep] == component) {
+              continue;
+            }
+            const std::vector<uint64_t> &dep_closure =
+                closures_[components_[dep]];
+            for (size_t i = 0; i < words; ++i) {
+              closure[i] |= dep_closure[i];
+            }
+          }
+        }
+        closures_.push_back(std::move(closure));
+      }
+      call_stack.pop_back();
+      if (!call_stack.empty()) {
+        int parent = call_stack.back().first;
+        low[parent] = std::min(low[parent], low[v]);
+      }
+    }
+  }
+}
+
+std::unordered_set<ModmapItem> ModuleGraph::process(
+    const ModuleDep &dep) const {
+  size_t words = (names_.size() + 63) / 64;
+  std::vector<uint64_t> required(words, 0);
+  for (const auto &name : dep.require_list) {
+    auto it = ids_.find(name);
+    if (it == ids_.end()) {
+      die("ERROR: Module not found: " + name);
+    }
+    const std::vector<uint64_t> &closure =
+        closures_[components_[it->second]];
+    for (size_t i = 0; i < words; ++i) {
+      required[i] |= closure[i];
+    }
+  }
+
+  // Construct modmap
+  std::unordered_set<ModmapItem> modmap;
+  for (size_t i = 0; i < words; ++i) {
+    for (int bit = 0; bit < 64 && required[i] >> bit != 0; ++bit) {
+      if (((required[i] >> bit) & 1) == 0) {
+        continue;
+      }
+      int id = i * 64 + bit;
+      if (paths_[id] == nullptr) {
+        die("ERROR: Module not found: " + names_[id]);
+      }
+      modmap.insert(ModmapItem{names_[id], *paths_[id]});
+    }
+  }
+  return modmap;
+}
@@ -15,8 +15,13 @@
 #ifndef BAZEL_TOOLS_CPP_MODULE_TOOLS_GENERATE_MODMAP_GENERATE_MODMAP_H_
 #define BAZEL_TOOLS_CPP_MODULE_TOOLS_GENERATE_MODMAP_GENERATE_MODMAP_H_
 
+#include <cstdint>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "common/common.h"
 
@@ -42,6 +47,32 @@ struct hash<ModmapItem> {
 }  // namespace std
 std::unordered_set<ModmapItem> process(const ModuleDep &dep,
                                        const Cpp20ModulesInfo &info);
+
+// The modules of a Cpp20ModulesInfo with the transitive closure of every
+// module computed once up front, for generating the modmaps of many compile
+// actions against the same info. Modules are interned to dense ids, and each
+// closure is a bitset over them, shared by all modules of a cycle.
+class ModuleGraph {
+ public:
+  explicit ModuleGraph(const Cpp20ModulesInfo &info);
+
+  // Returns the same modmap as process(dep, info).
+  std::unordered_set<ModmapItem> process(const ModuleDep &dep) const;
+
+ private:
+  int intern(const std::string &name);
+  void compute_closures();
+
+  std::vector<std::string> names_;
+  std::unordered_map<std::string, int> ids_;
+  // The BMI of each module, or nullptr if it is only known as a usage.
+  std::vector<const std::string *> paths_;
+  std::vector<std::vector<int>> edges_;
+  // The strongly connected component of each module.
+  std::vector<int> components_;
+  std::vector<std::vector<uint64_t>> closures_;
+};
+
 void write_modmap(std::ostream &modmap_file_stream,
                   std::ostream &modmap_file_dot_input_stream,
                   const std::unordered_set<ModmapItem> &modmap,
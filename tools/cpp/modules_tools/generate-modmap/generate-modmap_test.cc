@@ -88,3 +88,80 @@ TEST(ModmapTest, BasicFunctionality3) {
       {"module4", "/path/to/module4"}};
   EXPECT_EQ(modmap, expected_modmap);
 }
+
+TEST(ModmapTest, ModuleGraphMatchesProcess) {
+  Cpp20ModulesInfo info{};
+  info.modules["module1"] = "/path/to/module1";
+  info.modules["module2"] = "/path/to/module2";
+  info.modules["module3"] = "/path/to/module3";
+  info.modules["module4"] = "/path/to/module4";
+  info.modules["module5"] = "/path/to/module5";
+
+  // A diamond: module1 -> {module2, module3} -> module4.
+  info.usages["module1"].push_back("module2");
+  info.usages["module1"].push_back("module3");
+  info.usages["module2"].push_back("module4");
+  info.usages["module3"].push_back("module4");
+
+  ModuleGraph graph(info);
+  for (const auto &name :
+       {"module1", "module2", "module3", "module4", "module5"}) {
+    ModuleDep dep{};
+    dep.require_list.push_back(name);
+    EXPECT_EQ(graph.process(dep), process(dep, info)) << name;
+  }
+
+  ModuleDep dep{};
+  dep.require_list.push_back("module2");
+  dep.require_list.push_back("module5");
+  std::unordered_set<ModmapItem> expected_modmap = {
+      {"module2", "/path/to/module2"},
+      {"module4", "/path/to/module4"},
+      {"module5", "/path/to/module5"}};
+  EXPECT_EQ(graph.process(dep), expected_modmap);
+}
+
+TEST(ModmapTest, ModuleGraphCycle) {
+  Cpp20ModulesInfo info{};
+  info.modules["module1"] = "/path/to/module1";
+  info.modules["module2"] = "/path/to/module2";
+  info.modules["module3"] = "/path/to/module3";
+  info.modules["module4"] = "/path/to/module4";
+
+  info.usages["module1"].push_back("module2");
+  info.usages["module2"].push_back("module3");
+  info.usages["module3"].push_back("module1");
+  info.usages["module3"].push_back("module4");
+
+  ModuleGraph graph(info);
+  ModuleDep dep{};
+  dep.require_list.push_back("module2");
+  std::unordered_set<ModmapItem> expected_modmap = {
+      {"module1", "/path/to/module1"},
+      {"module2", "/path/to/module2"},
+      {"module3", "/path/to/module3"},
+      {"module4", "/path/to/module4"}};
+  EXPECT_EQ(graph.process(dep), expected_modmap);
+  EXPECT_EQ(graph.process(dep), process(dep, info));
+}
+
+TEST(ModmapTest, ModuleGraphManyModules) {
+  // More than 64 modules, so that the closures span several words.
+  Cpp20ModulesInfo info{};
+  for (int i = 0; i < 200; ++i) {
+    std::string name = "module" + std::to_string(i);
+    info.modules[name] = "/path/to/" + name;
+    if (i + 1 < 200) {
+      info.usages[name].push_back("module" + std::to_string(i + 1));
+    }
+  }
+
+  ModuleGraph graph(info);
+  for (int i : {0, 63, 64, 150, 199}) {
+    ModuleDep dep{};
+    dep.require_list.push_back("module" + std::to_string(i));
+    auto modmap = graph.process(dep);
+    EXPECT_EQ(modmap.size(), 200 - i);
+    EXPECT_EQ(modmap, process(dep, info));
+  }
+}
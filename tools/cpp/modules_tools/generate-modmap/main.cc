@@ -13,63 +13,156 @@
 // limitations under the License.
 
 #include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
 
+#include "tools/cpp/modules_tools/common/worker.h"
 #include "tools/cpp/modules_tools/generate-modmap/generate-modmap.h"
 
-int main(int argc, char *argv[]) {
-  if (argc != 5) {
-    std::cerr << "Usage: generate-modmap <ddi-file> <cpp20modules-info-file> "
-                 "<output> <compiler>"
-              << std::endl;
-    std::exit(1);
-  }
+// The most parsed info files a persistent worker keeps.
+static const size_t kMaxCachedInfos = 16;
 
-  // Retrieve the values of the flags
-  std::string ddi_filename = argv[1];
-  std::string info_filename = argv[2];
-  std::string output = argv[3];
-  std::string compiler = argv[4];
+// A parsed info file with the closures of its modules, as kept by a
+// persistent worker.
+struct LoadedInfo {
+  explicit LoadedInfo(Cpp20ModulesInfo parsed)
+      : info(std::move(parsed)), graph(info) {}
 
-  std::ifstream info_stream(info_filename);
-  if (!info_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << info_filename
-              << std::endl;
-    std::exit(1);
-  }
-  std::ifstream ddi_stream(ddi_filename);
-  if (!ddi_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << ddi_filename << std::endl;
-    std::exit(1);
-  }
-  auto dep = parse_ddi(ddi_stream);
-  auto info = parse_info(info_stream);
-  auto modmap = process(dep, info);
+  Cpp20ModulesInfo info;
+  // Refers to info.
+  ModuleGraph graph;
+};
+
+using InfoCache = InputCache<LoadedInfo>;
 
+// Writes the modmap of `dep` and its .input file to `output`.
+static void write_modmap_files(const std::string &output,
+                               const std::string &compiler,
+                               const ModuleDep &dep,
+                               const Cpp20ModulesInfo &info,
+                               const std::unordered_set<ModmapItem> &modmap) {
   std::string modmap_filename = output;
   std::string modmap_dot_input_filename = modmap_filename + ".input";
   std::ofstream modmap_file_stream(modmap_filename);
   std::ofstream modmap_file_dot_input_stream(modmap_dot_input_filename);
   if (!modmap_file_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << modmap_filename
-              << std::endl;
-    std::exit(1);
+    die("ERROR: Failed to open the file " + modmap_filename);
   }
   if (!modmap_file_dot_input_stream.is_open()) {
-    std::cerr << "ERROR: Failed to open the file " << modmap_dot_input_filename
-              << std::endl;
-    std::exit(1);
+    die("ERROR: Failed to open the file " + modmap_dot_input_filename);
   }
   std::optional<ModmapItem> generated;
   if (dep.gen_bmi) {
     ModmapItem item;
     item.name = dep.name;
-    item.path = info.modules[dep.name];
+    auto it = info.modules.find(dep.name);
+    if (it != info.modules.end()) {
+      item.path = it->second;
+    }
     generated = item;
   }
   write_modmap(modmap_file_stream, modmap_file_dot_input_stream, modmap,
                compiler, generated);
   modmap_file_stream.close();
   modmap_file_dot_input_stream.close();
+}
+
+static Cpp20ModulesInfo read_info(const std::string &info_filename) {
+  std::ifstream info_stream(info_filename, std::ios::binary);
+  if (!info_stream.is_open()) {
+    die("ERROR: Failed to open the file " + info_filename);
+  }
+  return parse_info(info_stream);
+}
+
+// Returns the info of the action, parsed by an earlier request of the worker
+// if it had the same digest.
+static std::shared_ptr<const LoadedInfo> load_info(
+    InfoCache &cache, const WorkRequest &request,
+    const std::string &info_filename) {
+  return cache.get(info_filename, request.digest(info_filename),
+                   [](const std::string &path) {
+                     return std::make_shared<const LoadedInfo>(
+                         read_info(path));
+                   });
+}
+
+static ModuleDep read_ddi(const std::string &ddi_filename) {
+  std::ifstream ddi_stream(ddi_filename);
+  if (!ddi_stream.is_open()) {
+    die("ERROR: Failed to open the file " + ddi_filename);
+  }
+  return parse_ddi(ddi_stream);
+}
+
+// Generates the modmaps of all the compile actions listed in `batch_filename`
+// against the same info, which is usually the output of aggregate-ddi. The
+// transitive closures of the modules are computed once rather than once per
+// compile action.
+static int generate_batch(InfoCache &cache, const WorkRequest &request,
+                          const std::string &info_filename,
+                          const std::string &compiler,
+                          const std::string &batch_filename) {
+  std::shared_ptr<const LoadedInfo> loaded =
+      load_info(cache, request, info_filename);
+  std::ifstream batch_stream(batch_filename);
+  if (!batch_stream.is_open()) {
+    die("ERROR: Failed to open the file " + batch_filename);
+  }
+  std::string ddi_filename;
+  std::string output;
+  while (batch_stream >> ddi_filename >> output) {
+    ModuleDep dep = read_ddi(ddi_filename);
+    write_modmap_files(output, compiler, dep, loaded->info,
+                       loaded->graph.process(dep));
+  }
+  return 0;
+}
+
+static int generate(InfoCache &cache, const WorkRequest &request,
+                    std::ostream &out) {
+  const std::vector<std::string> &args = request.arguments;
+  if (args.size() == 4 && args[0] == "--batch") {
+    return generate_batch(cache, request, args[1], args[2], args[3]);
+  }
+  if (args.size() != 4) {
+    out << "Usage: generate-modmap <ddi-file> <cpp20modules-info-file> "
+           "<output> <compiler>\n"
+           "       generate-modmap --batch <cpp20modules-info-file> "
+           "<compiler> <batch-file>"
+        << std::endl;
+    return 1;
+  }
 
+  // Retrieve the values of the flags
+  std::string ddi_filename = args[0];
+  std::string info_filename = args[1];
+  std::string output = args[2];
+  std::string compiler = args[3];
+
+  auto dep = read_ddi(ddi_filename);
+  if (request.digest(info_filename).empty()) {
+    // Computing the closures of all the modules does not pay off for a
+    // single modmap.
+    auto info = read_info(info_filename);
+    auto modmap = process(dep, info);
+    write_modmap_files(output, compiler, dep, info, modmap);
+  } else {
+    auto loaded = load_info(cache, request, info_filename);
+    write_modmap_files(output, compiler, dep, loaded->info,
+                       loaded->graph.process(dep));
+  }
   return 0;
 }
+
+int main(int argc, char *argv[]) {
+  InfoCache cache(kMaxCachedInfos);
+  auto handler = [&cache](const WorkRequest &request, std::ostream &out) {
+    return generate(cache, request, out);
+  };
+  if (is_persistent_worker(argc, argv)) {
+    return run_worker(std::cin, std::cout, handler);
+  }
+  return run_once(argc, argv, handler);
+}
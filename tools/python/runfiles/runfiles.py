@@ -61,6 +61,7 @@ USAGE:
 import inspect
 import os
 import posixpath
+import struct
 import sys
 
 from ._runfiles_constants import MAIN_REPOSITORY_RUNFILES_DIRECTORY
@@ -83,9 +84,11 @@ def Create(env=None):
     path
 
   If `env` contains "RUNFILES_MANIFEST_FILE" with non-empty value, this method
-  returns a manifest-based implementation. The object eagerly reads and caches
-  the whole manifest file upon instantiation; this may be relevant for
-  performance consideration.
+  returns a manifest-based implementation. If there is an up-to-date index
+  next to the manifest, the object reads the index and searches it on every
+  lookup, and only reads the manifest for paths the index doesn't have;
+  otherwise it eagerly reads and caches the whole manifest file upon
+  instantiation; this may be relevant for performance consideration.
 
   Otherwise, if `env` contains "RUNFILES_DIR" with non-empty value (checked in
   this priority order), this method returns a directory-based implementation.
@@ -243,11 +246,27 @@ class _ManifestBased(object):
     if not isinstance(path, str):
       raise TypeError()
     self._path = path
-    self._runfiles = _ManifestBased._LoadRunfiles(path)
+    # The Windows launcher looks runfiles up in the same index, so a launched
+    # py_binary doesn't parse the manifest either.
+    self._index = _RunfilesIndex.Load(path + ".index", path)
+    self._runfiles = None
+    if self._index is None:
+      self._runfiles = _ManifestBased._LoadRunfiles(path)
+
+  def _Lookup(self, path):
+    """Returns the target of `path`, or None if the manifest doesn't have it."""
+    if self._index is not None:
+      target = self._index.get(path)
+      if target is not None:
+        return target
+    # The index is missing, stale, or doesn't have the path: scan the manifest.
+    if self._runfiles is None:
+      self._runfiles = _ManifestBased._LoadRunfiles(self._path)
+    return self._runfiles.get(path)
 
   def RlocationChecked(self, path):
     """Returns the runtime path of a runfile."""
-    exact_match = self._runfiles.get(path)
+    exact_match = self._Lookup(path)
     if exact_match:
       return exact_match
     # If path references a runfile that lies under a directory that itself is a
@@ -259,7 +278,7 @@ class _ManifestBased(object):
       prefix_end = path.rfind("/", 0, prefix_end - 1)
       if prefix_end == -1:
         return None
-      prefix_match = self._runfiles.get(path[0:prefix_end])
+      prefix_match = self._Lookup(path[0:prefix_end])
       if prefix_match:
         return prefix_match + "/" + path[prefix_end + 1:]
 
@@ -297,6 +316,80 @@ class _ManifestBased(object):
     }
 
 
+class _RunfilesIndex(object):
+  """A runfiles index, as written next to the manifest by Bazel.
+
+  See src/main/tools/build-runfiles.cc for the format. The records are sorted
+  by path, so a lookup is a binary search and nothing is parsed up front. The
+  header records the size and modification time of the manifest the index was
+  built from, so that an index that no longer matches its manifest is ignored.
+  """
+
+  _MAGIC = b"RFINDEX2"
+  _HEADER = struct.Struct("=8sIIQQ")
+  _RECORD = struct.Struct("=IIII")
+
+  def __init__(self, data, count, strings_offset):
+    self._data = data
+    self._count = count
+    self._strings_offset = strings_offset
+
+  @staticmethod
+  def Load(path, manifest_path):
+    """Returns the index at `path`, or None if there is no valid index.
+
+    The index is only valid if `manifest_path` still has the size and
+    modification time (in milliseconds) that the index was stamped with.
+    """
+    try:
+      # Read rather than map the index, so that it can still be replaced on
+      # Windows while this process is running.
+      with open(path, "rb") as f:
+        data = f.read()
+      manifest_stat = os.stat(manifest_path)
+    except (IOError, OSError):
+      return None
+    header = _RunfilesIndex._HEADER
+    if len(data) < header.size:
+      return None
+    magic, count, strings_offset, manifest_size, manifest_mtime_ms = (
+        header.unpack_from(data, 0))
+    if (magic != _RunfilesIndex._MAGIC or
+        manifest_size != manifest_stat.st_size or
+        manifest_mtime_ms != manifest_stat.st_mtime_ns // 1000000 or
+        strings_offset < header.size or
+        strings_offset > len(data) or
+        (strings_offset - header.size) // _RunfilesIndex._RECORD.size < count):
+      return None
+    return _RunfilesIndex(data, count, strings_offset)
+
+  def _String(self, offset, length):
+    start = self._strings_offset + offset
+    return self._data[start:start + length]
+
+  def get(self, path):
+    """Returns the target of `path`, or None if the index doesn't have it."""
+    key = path.encode("utf-8")
+    low = 0
+    high = self._count
+    while low < high:
+      mid = (low + high) // 2
+      path_offset, path_length, target_offset, target_length = (
+          _RunfilesIndex._RECORD.unpack_from(
+              self._data,
+              _RunfilesIndex._HEADER.size + mid * _RunfilesIndex._RECORD.size))
+      record_path = self._String(path_offset, path_length)
+      if record_path < key:
+        low = mid + 1
+      elif record_path > key:
+        high = mid
+      else:
+        target = self._String(target_offset, target_length).decode("utf-8")
+        # Like a manifest line without a target, an empty file maps to itself.
+        return target or path
+    return None
+
+
 class _DirectoryBased(object):
   """`Runfiles` strategy that appends runfiles paths to the runfiles root."""
 
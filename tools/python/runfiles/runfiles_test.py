@@ -14,6 +14,7 @@
 # limitations under the License.
 
 import os
+import struct
 import tempfile
 import unittest
 
@@ -163,6 +164,69 @@ class RunfilesTest(unittest.TestCase):
       else:
         self.assertEqual(r.Rlocation("/foo"), "/foo")
 
+  def testManifestBasedRlocationWithIndex(self):
+    with _MockFile(contents=["Foo/runfile1 C:/manifest/runfile1"]) as mf:
+      index = mf.Path() + ".index"
+      _WriteIndex(index, mf.Path(), [
+          ("Foo/runfile1", "C:/index/runfile1"),
+          ("Foo/runfile2", ""),
+          ("Foo/Bar/Dir", "E:\\Actual Path\\Directory"),
+          ("Foo/Bar/runfile3", "D:\\the path\\run file 3.txt"),
+      ])
+      try:
+        r = runfiles.CreateManifestBased(mf.Path())
+        self.assertEqual(r.Rlocation("Foo/runfile1"), "C:/index/runfile1")
+        self.assertEqual(r.Rlocation("Foo/runfile2"), "Foo/runfile2")
+        self.assertEqual(
+            r.Rlocation("Foo/Bar/runfile3"), "D:\\the path\\run file 3.txt")
+        self.assertEqual(
+            r.Rlocation("Foo/Bar/Dir/Deeply/Nested/runfile4"),
+            "E:\\Actual Path\\Directory/Deeply/Nested/runfile4")
+        self.assertIsNone(r.Rlocation("Foo/Bar"))
+        self.assertIsNone(r.Rlocation("Foo/runfile0"))
+        self.assertIsNone(r.Rlocation("unknown"))
+      finally:
+        os.remove(index)
+
+  def testManifestBasedRlocationIgnoresInvalidIndex(self):
+    with _MockFile(contents=["Foo/runfile1 C:/manifest/runfile1"]) as mf:
+      index = mf.Path() + ".index"
+      with open(index, "wb") as f:
+        f.write(b"RFINDEX2" + struct.pack("=IIQQ", 1000, 32, 0, 0))
+      try:
+        r = runfiles.CreateManifestBased(mf.Path())
+        self.assertEqual(r.Rlocation("Foo/runfile1"), "C:/manifest/runfile1")
+      finally:
+        os.remove(index)
+
+  def testManifestBasedRlocationIgnoresStaleIndex(self):
+    with _MockFile(contents=["Foo/runfile1 C:/manifest/runfile1"]) as mf:
+      index = mf.Path() + ".index"
+      _WriteIndex(index, mf.Path(), [("Foo/runfile1", "C:/index/runfile1")])
+      with open(mf.Path(), "a") as f:
+        f.write("Foo/runfile2 C:/manifest/runfile2\n")
+      try:
+        r = runfiles.CreateManifestBased(mf.Path())
+        self.assertEqual(r.Rlocation("Foo/runfile1"), "C:/manifest/runfile1")
+        self.assertEqual(r.Rlocation("Foo/runfile2"), "C:/manifest/runfile2")
+      finally:
+        os.remove(index)
+
+  def testManifestBasedRlocationFallsBackToManifest(self):
+    with _MockFile(contents=[
+        "Foo/runfile1 C:/manifest/runfile1",
+        "Foo/runfile2 C:/manifest/runfile2",
+    ]) as mf:
+      index = mf.Path() + ".index"
+      _WriteIndex(index, mf.Path(), [("Foo/runfile1", "C:/index/runfile1")])
+      try:
+        r = runfiles.CreateManifestBased(mf.Path())
+        self.assertEqual(r.Rlocation("Foo/runfile1"), "C:/index/runfile1")
+        self.assertEqual(r.Rlocation("Foo/runfile2"), "C:/manifest/runfile2")
+        self.assertIsNone(r.Rlocation("Foo/runfile3"))
+      finally:
+        os.remove(index)
+
   def testDirectoryBasedRlocation(self):
     # The _DirectoryBased strategy simply joins the runfiles directory and the
     # runfile's path on a "/". This strategy does not perform any normalization,
@@ -271,6 +335,24 @@ class RunfilesTest(unittest.TestCase):
     return os.name == "nt"
 
 
+def _WriteIndex(path, manifest_path, entries):
+  """Writes a runfiles index of `manifest_path` in the format of Bazel."""
+  records = b""
+  strings = b""
+  for runfile, target in sorted(
+      (p.encode("utf-8"), t.encode("utf-8")) for p, t in entries):
+    records += struct.pack("=IIII", len(strings), len(runfile),
+                           len(strings) + len(runfile), len(target))
+    strings += runfile + target
+  manifest_stat = os.stat(manifest_path)
+  with open(path, "wb") as f:
+    f.write(b"RFINDEX2" +
+            struct.pack("=IIQQ", len(entries), 32 + len(records),
+                        manifest_stat.st_size,
+                        manifest_stat.st_mtime_ns // 1000000) +
+            records + strings)
+
+
 class _MockFile(object):
 
   def __init__(self, name=None, contents=None):
@@ -29,14 +29,21 @@
 #include <wchar.h>
 #include <windows.h>
 
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <algorithm>
+#include <condition_variable>
 #include <cstdio>
 #include <fstream>
 #include <functional>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "rules_cc/cc/runfiles/runfiles.h"
@@ -49,6 +56,7 @@
 #include "third_party/ijar/common.h"
 #include "third_party/ijar/platform_utils.h"
 #include "third_party/ijar/zip.h"
+#include "third_party/ijar/zlib_client.h"
 
 namespace bazel {
 namespace tools {
@@ -72,6 +80,32 @@ class Defer {
 
 const std::function<void()> Defer::kEmpty = []() {};
 
+// Encodes octets for a CDATA section exactly like CdataEscape, but as they
+// arrive in chunks rather than from an IFStream. The octets at the end of a
+// chunk that can only be encoded along with the start of the next one are held
+// back until then.
+class CdataEncoder {
+ public:
+  CdataEncoder() : pending_size_(0) {}
+
+  // Appends to 'out' the encoding of the octets of 'data' and of those held
+  // back before, except for the (at most 3) octets it now holds back.
+  void Encode(const uint8_t* data, size_t n, std::string* out);
+
+  // Appends to 'out' the encoding of the octets held back, which end the
+  // stream.
+  void Finish(std::string* out);
+
+ private:
+  // Encodes the octets of 'data' up to the first one whose encoding depends on
+  // octets after 'data', unless 'at_end'. Returns the number encoded.
+  static size_t EncodePrefix(const uint8_t* data, size_t n, bool at_end,
+                             std::string* out);
+
+  uint8_t pending_[3];
+  size_t pending_size_;
+};
+
 // Streams data from an input to two outputs.
 // Inspired by tee(1) in the GNU coreutils.
 class TeeImpl : Tee {
@@ -81,26 +115,51 @@ class TeeImpl : Tee {
   // the reading end of a pipe and the writing end is closed) or when WriteFile
   // fails on one of the outputs (e.g. the same output handle is closed
   // elsewhere).
+  //
+  // Unless `cdata` is null, the data is also written to it encoded for a CDATA
+  // section of the test XML, so that the XML need not be made from the test
+  // log afterwards. A failure to write `cdata` does not stop the outputs.
   static bool Create(bazel::windows::AutoHandle* input,
                      bazel::windows::AutoHandle* output1,
                      bazel::windows::AutoHandle* output2,
+                     bazel::windows::AutoHandle* cdata,
                      std::unique_ptr<Tee>* result);
 
+  bool Finish(DWORD timeout_ms) override;
+  bool CdataComplete() const override;
+
  private:
   static DWORD WINAPI ThreadFunc(LPVOID lpParam);
 
   TeeImpl(bazel::windows::AutoHandle* input,
           bazel::windows::AutoHandle* output1,
-          bazel::windows::AutoHandle* output2)
-      : input_(input), output1_(output1), output2_(output2) {}
+          bazel::windows::AutoHandle* output2,
+          bazel::windows::AutoHandle* cdata)
+      : input_(input),
+        output1_(output1),
+        output2_(output2),
+        cdata_(cdata),
+        cdata_failed_(!cdata_.IsValid()),
+        result_(false) {}
   TeeImpl(const TeeImpl&) = delete;
   TeeImpl& operator=(const TeeImpl&) = delete;
 
-  bool MainFunc() const;
+  bool MainFunc();
+
+  // Writes the encoding of 'data' to cdata_, and if 'at_end', of the octets
+  // held back. Gives up on cdata_ once a write fails.
+  void WriteCdata(const uint8_t* data, size_t size, bool at_end);
 
   bazel::windows::AutoHandle input_;
   bazel::windows::AutoHandle output1_;
   bazel::windows::AutoHandle output2_;
+  bazel::windows::AutoHandle cdata_;
+  CdataEncoder encoder_;
+  std::string encoded_;
+  bool cdata_failed_;
+  bazel::windows::AutoHandle thread_;
+  // What MainFunc returned, once thread_ is done.
+  bool result_;
 };
 
 // Buffered input stream (based on a Windows HANDLE) with peek-ahead support.
@@ -128,6 +187,8 @@ class IFStreamImpl : IFStream {
 
   int Get() override;
   DWORD Peek(DWORD n, uint8_t* out) const override;
+  const uint8_t* Buffered(DWORD* n) const override;
+  bool Skip(DWORD n) override;
 
  private:
   HANDLE handle_;
@@ -188,9 +249,35 @@ struct Duration {
   bool FromString(const wchar_t* str);
 };
 
+// The outcome of running the test binary once (for one shard, if sharded).
+struct TestRun {
+  // The shard this run was for, or -1 if that's up to TEST_SHARD_INDEX.
+  int shard_index;
+  // The file that captured the test's stdout and stderr.
+  Path outerr;
+  Duration duration;
+  int exit_code;
+  // The XML log of the run but for its header and footer, with the contents
+  // of 'outerr' encoded as they were written, or empty if there is none. The
+  // first 'cdata_offset' bytes are left for the header.
+  Path cdata;
+  DWORD cdata_offset;
+  // Whether 'cdata' has all of the contents of 'outerr'.
+  bool cdata_complete;
+};
+
 enum class MainType { kTestWrapperMain, kXmlWriterMain };
 enum class DeleteAfterwards { kEnabled, kDisabled };
 
+// The XML log around the <testsuite> elements.
+const char kXmlLogHeader[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<testsuites>\n";
+const char kXmlLogFooter[] = "</testsuites>\n";
+
+// The end of a <testsuite> element, after the test log.
+const char kXmlTestSuiteFooter[] = "]]></system-out>\n</testsuite>\n";
+
 void WriteStdout(const std::string& s) {
   DWORD written;
   WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), s.c_str(), s.size(), &written,
@@ -999,6 +1086,119 @@ bool GetZipEntryPtr(devtools_ijar::ZipBuilder* zip_builder,
   return true;
 }
 
+// Files from this size on are read without going through the file cache, since
+// they are only read once. Unbuffered reads must cover whole sectors, and 4 KiB
+// is a multiple of the sector size of all common disks.
+static constexpr size_t kUnbufferedReadMinSize = 1 << 20;
+static constexpr size_t kUnbufferedReadAlignment = 4096;
+static constexpr DWORD kMaxReadSize = 64 << 20;
+
+struct AlignedFree {
+  void operator()(devtools_ijar::u1* p) const { _aligned_free(p); }
+};
+
+// A file that was read, and compressed unless that is pointless, ahead of
+// being added to the zip.
+struct PreparedZipEntry {
+  std::unique_ptr<devtools_ijar::u1[], AlignedFree> data;
+  size_t compressed_size = 0;
+  devtools_ijar::u4 crc = 0;
+  bool done = false;
+  bool ok = false;
+};
+
+// Returns true if files of this MIME type are compressed already, so that
+// deflating them again would only cost time.
+bool IsCompressedMimeType(const std::string& mime_type) {
+  static constexpr const char* kCompressedTypes[] = {
+      "application/gzip",
+      "application/x-7z-compressed",
+      "application/x-compressed",
+      "application/x-gzip",
+      "application/x-zip-compressed",
+      "application/zip",
+      "image/gif",
+      "image/jpeg",
+      "image/png",
+      "image/webp",
+  };
+  if (mime_type.rfind("audio/", 0) == 0 || mime_type.rfind("video/", 0) == 0) {
+    return true;
+  }
+  return std::find(std::begin(kCompressedTypes), std::end(kCompressedTypes),
+                   mime_type) != std::end(kCompressedTypes);
+}
+
+// Reads the whole file into a newly allocated buffer. Large files are read
+// unbuffered, in large chunks.
+bool ReadFileForZip(const Path& path, const size_t size,
+                    PreparedZipEntry* result) {
+  const bool unbuffered = size >= kUnbufferedReadMinSize;
+  const size_t capacity =
+      std::max<size_t>(1, (size + kUnbufferedReadAlignment - 1) /
+                              kUnbufferedReadAlignment *
+                              kUnbufferedReadAlignment);
+  result->data.reset(static_cast<devtools_ijar::u1*>(
+      _aligned_malloc(capacity, kUnbufferedReadAlignment)));
+  if (!result->data) {
+    LogErrorWithArg(__LINE__, "Failed to allocate buffer for file", path.Get());
+    return false;
+  }
+
+  bazel::windows::AutoHandle handle(CreateFileW(
+      AddUncPrefixMaybe(path).c_str(), GENERIC_READ,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+      OPEN_EXISTING,
+      FILE_FLAG_SEQUENTIAL_SCAN | (unbuffered ? FILE_FLAG_NO_BUFFERING : 0),
+      nullptr));
+  if (!handle.IsValid()) {
+    DWORD err = GetLastError();
+    LogErrorWithArgAndValue(__LINE__, "Failed to open file", path.Get(), err);
+    return false;
+  }
+
+  size_t total_read = 0;
+  while (total_read < size) {
+    // Unbuffered reads must be a multiple of the sector size, even the last
+    // one, which is why the buffer is rounded up.
+    const DWORD to_read = static_cast<DWORD>(
+        std::min<size_t>(capacity - total_read, kMaxReadSize));
+    DWORD read = 0;
+    if (!ReadFile(handle, result->data.get() + total_read, to_read, &read,
+                  nullptr)) {
+      DWORD err = GetLastError();
+      LogErrorWithArgAndValue(__LINE__, "Failed to read file", path.Get(), err);
+      return false;
+    }
+    if (read == 0) {
+      // The file shrank since it was listed. Keep the zip deterministic.
+      memset(result->data.get() + total_read, 0, size - total_read);
+      break;
+    }
+    total_read += read;
+  }
+  return true;
+}
+
+// Reads the file and compresses it, unless its MIME type says that it is
+// compressed already.
+bool PrepareZipEntry(const Path& path, const FileInfo& info,
+                     const char* entry_name, PreparedZipEntry* result) {
+  if (info.IsDirectory() || info.Size() == 0) {
+    return true;
+  }
+  if (!ReadFileForZip(path, info.Size(), result)) {
+    return false;
+  }
+  result->crc = devtools_ijar::ComputeCrcChecksum(result->data.get(),
+                                                  info.Size());
+  result->compressed_size =
+      IsCompressedMimeType(GetMimeType(entry_name))
+          ? info.Size()
+          : devtools_ijar::TryDeflate(result->data.get(), info.Size());
+  return true;
+}
+
 bool CreateZip(const Path& root, const std::vector<FileInfo>& files,
                const Path& abs_zip) {
   bool restore_oem_api = false;
@@ -1026,31 +1226,97 @@ bool CreateZip(const Path& root, const std::vector<FileInfo>& files,
     return false;
   }
 
+  // Worker threads read and compress the files, while this thread adds them
+  // to the zip in order. The workers stay at most `window` files ahead of
+  // this thread, which bounds the memory held by prepared files.
+  const size_t threads =
+      std::max<size_t>(1, std::min(std::thread::hardware_concurrency(), 8u));
+  const size_t window = 2 * threads;
+  std::vector<PreparedZipEntry> prepared(files.size());
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t next = 0;
+  size_t written = 0;
+  bool failed = false;
+
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&]() {
+      while (true) {
+        size_t i;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          cond.wait(lock, [&]() {
+            return failed || next >= files.size() || next < written + window;
+          });
+          if (failed || next >= files.size()) {
+            return;
+          }
+          i = next++;
+        }
+        Path path;
+        bool ok = path.Set(root.Get() + L"\\" + files[i].RelativePath()) &&
+                  PrepareZipEntry(path, files[i],
+                                  zip_entry_paths.EntryPathPtrs()[i],
+                                  &prepared[i]);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          prepared[i].ok = ok;
+          prepared[i].done = true;
+        }
+        cond.notify_all();
+      }
+    });
+  }
+  Defer join_workers([&]() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      failed = true;
+    }
+    cond.notify_all();
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  });
+
   for (size_t i = 0; i < files.size(); ++i) {
-    bazel::windows::AutoHandle handle;
-    Path path;
-    if (!path.Set(root.Get() + L"\\" + files[i].RelativePath()) ||
-        (!files[i].IsDirectory() && !OpenExistingFileForRead(path, &handle))) {
-      LogErrorWithArg(__LINE__, "Failed to open file for reading", path.Get());
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]() { return prepared[i].done; });
+    }
+    const char* entry_name = zip_entry_paths.EntryPathPtrs()[i];
+    if (!prepared[i].ok) {
+      LogErrorWithArg(__LINE__, "Failed to dump file into zip", entry_name);
       return false;
     }
 
-    devtools_ijar::u1* dest;
-    if (!GetZipEntryPtr(zip_builder.get(), zip_entry_paths.EntryPathPtrs()[i],
-                        GetZipAttr(files[i]), &dest) ||
-        (!files[i].IsDirectory() &&
-         !ReadFromFile(handle, dest, files[i].Size()))) {
-      LogErrorWithArg(__LINE__, "Failed to dump file into zip", path.Get());
+    if (files[i].IsDirectory() || files[i].Size() == 0) {
+      devtools_ijar::u1* dest;
+      if (!GetZipEntryPtr(zip_builder.get(), entry_name, GetZipAttr(files[i]),
+                          &dest) ||
+          zip_builder->FinishFile(0, /* compress */ false,
+                                  /* compute_crc */ true) == -1) {
+        LogErrorWithArg(__LINE__, "Failed to finish writing file to zip",
+                        entry_name);
+        return false;
+      }
+    } else if (zip_builder->WriteCompressedFile(
+                   entry_name, GetZipAttr(files[i]), prepared[i].data.get(),
+                   prepared[i].compressed_size, files[i].Size(),
+                   prepared[i].crc) == -1) {
+      LogErrorWithArg2(__LINE__, "Failed to add file to zip", entry_name,
+                       zip_builder->GetError());
       return false;
     }
+    prepared[i].data.reset();
 
-    if (zip_builder->FinishFile(files[i].Size(), /* compress */ false,
-                                /* compute_crc */ true) == -1) {
-      LogErrorWithArg(__LINE__, "Failed to finish writing file to zip",
-                      path.Get());
-      return false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      written = i + 1;
     }
+    cond.notify_all();
   }
+  join_workers.DoNow();
 
   if (zip_builder->Finish() == -1) {
     LogErrorWithArg(__LINE__, "Failed to add file to zip",
@@ -1224,8 +1490,50 @@ bool CreateCommandLine(const Path& path, const std::wstring& args,
   return true;
 }
 
+// Creates a pipe whose reading end supports overlapped I/O, which anonymous
+// pipes don't, and whose buffer is large enough that a chatty subprocess
+// rarely blocks on it. Only the writing end is inheritable.
+bool CreateOverlappedPipe(SECURITY_ATTRIBUTES* inheritable_handle_sa,
+                          bazel::windows::AutoHandle* read,
+                          bazel::windows::AutoHandle* write) {
+  static constexpr DWORD kPipeBufferSize = 1024 * 1024;
+  static LONG pipe_count = 0;
+  std::wstringstream name;
+  name << L"\\\\.\\pipe\\bazel-tw-" << GetCurrentProcessId() << L"-"
+       << InterlockedIncrement(&pipe_count);
+
+  HANDLE read_h = CreateNamedPipeW(
+      name.str().c_str(),
+      PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+          FILE_FLAG_FIRST_PIPE_INSTANCE,
+      PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT |
+          PIPE_REJECT_REMOTE_CLIENTS,
+      1, kPipeBufferSize, kPipeBufferSize, 0, nullptr);
+  if (read_h == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    LogErrorWithValue(__LINE__, "CreateNamedPipeW", err);
+    return false;
+  }
+  *read = read_h;
+
+  HANDLE write_h =
+      CreateFileW(name.str().c_str(), GENERIC_WRITE, 0, inheritable_handle_sa,
+                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (write_h == INVALID_HANDLE_VALUE) {
+    DWORD err = GetLastError();
+    LogErrorWithValue(__LINE__, "CreateFileW", err);
+    return false;
+  }
+  *write = write_h;
+  return true;
+}
+
+// Starts the test binary, with its stdout and stderr tee'd to 'outerr' and
+// to this process's stdout. Unless 'cdata' is empty, the tee also writes the
+// output, encoded for the test XML, to 'cdata' from offset 'cdata_offset'.
 bool StartSubprocess(const Path& path, const std::wstring& args,
-                     const Path& outerr, std::unique_ptr<Tee>* tee,
+                     const Path& outerr, const Path& cdata,
+                     DWORD cdata_offset, std::unique_ptr<Tee>* tee,
                      LARGE_INTEGER* start_time,
                      bazel::windows::WaitableProcess* process) {
   SECURITY_ATTRIBUTES inheritable_handle_sa = {sizeof(SECURITY_ATTRIBUTES),
@@ -1236,13 +1544,10 @@ bool StartSubprocess(const Path& path, const std::wstring& args,
   // for stderr). This process closes its copies of the handles.
   // This process keeps the reading end and streams data from the pipe to the
   // test log and to stdout.
-  HANDLE pipe_read_h, pipe_write_h;
-  if (!CreatePipe(&pipe_read_h, &pipe_write_h, &inheritable_handle_sa, 0)) {
-    DWORD err = GetLastError();
-    LogErrorWithValue(__LINE__, "CreatePipe", err);
+  bazel::windows::AutoHandle pipe_read, pipe_write;
+  if (!CreateOverlappedPipe(&inheritable_handle_sa, &pipe_read, &pipe_write)) {
     return false;
   }
-  bazel::windows::AutoHandle pipe_read(pipe_read_h), pipe_write(pipe_write_h);
 
   // Duplicate the write end of the pipe.
   // The original will be connected to the stdout of the process, the duplicate
@@ -1288,9 +1593,21 @@ bool StartSubprocess(const Path& path, const std::wstring& args,
   }
   bazel::windows::AutoHandle stdout_dup(stdout_dup_h);
 
+  // Open the XML log fragment, past the room for the XML header. The XML log
+  // can do without it, so failing to open it is not an error.
+  bazel::windows::AutoHandle test_cdata;
+  if (!cdata.Get().empty() && OpenFileForWriting(cdata, &test_cdata)) {
+    LARGE_INTEGER offset;
+    offset.QuadPart = cdata_offset;
+    if (!SetFilePointerEx(test_cdata, offset, nullptr, FILE_BEGIN)) {
+      test_cdata = INVALID_HANDLE_VALUE;
+    }
+  }
+
   // Create the tee thread, and transfer ownerships of the `pipe_read`,
-  // `test_outerr`, and `stdout_dup` handles.
-  if (!TeeImpl::Create(&pipe_read, &test_outerr, &stdout_dup, tee)) {
+  // `test_outerr`, `stdout_dup`, and `test_cdata` handles.
+  if (!TeeImpl::Create(&pipe_read, &test_outerr, &stdout_dup, &test_cdata,
+                       tee)) {
     LogError(__LINE__);
     return false;
   }
@@ -1440,11 +1757,13 @@ bool ParseXmlWriterArgs(int argc, wchar_t** argv, const Path& cwd,
 bool TeeImpl::Create(bazel::windows::AutoHandle* input,
                      bazel::windows::AutoHandle* output1,
                      bazel::windows::AutoHandle* output2,
+                     bazel::windows::AutoHandle* cdata,
                      std::unique_ptr<Tee>* result) {
-  std::unique_ptr<TeeImpl> tee(new TeeImpl(input, output1, output2));
-  bazel::windows::AutoHandle thread(
-      CreateThread(nullptr, 0, ThreadFunc, tee.get(), 0, nullptr));
-  if (!thread.IsValid()) {
+  bazel::windows::AutoHandle no_cdata;
+  std::unique_ptr<TeeImpl> tee(new TeeImpl(
+      input, output1, output2, cdata != nullptr ? cdata : &no_cdata));
+  tee->thread_ = CreateThread(nullptr, 0, ThreadFunc, tee.get(), 0, nullptr);
+  if (!tee->thread_.IsValid()) {
     return false;
   }
   result->reset(tee.release());
@@ -1452,32 +1771,133 @@ bool TeeImpl::Create(bazel::windows::AutoHandle* input,
 }
 
 DWORD WINAPI TeeImpl::ThreadFunc(LPVOID lpParam) {
-  return reinterpret_cast<TeeImpl*>(lpParam)->MainFunc() ? 0 : 1;
+  TeeImpl* tee = reinterpret_cast<TeeImpl*>(lpParam);
+  tee->result_ = tee->MainFunc();
+  return tee->result_ ? 0 : 1;
 }
 
-bool TeeImpl::MainFunc() const {
-  static constexpr size_t kBufferSize = 0x10000;
-  DWORD read;
-  uint8_t content[kBufferSize];
-  while (ReadFile(input_, content, kBufferSize, &read, nullptr)) {
-    DWORD written;
-    if (read > 0 && (!WriteFile(output1_, content, read, &written, nullptr) ||
-                     !WriteFile(output2_, content, read, &written, nullptr))) {
-      return false;
+bool TeeImpl::Finish(DWORD timeout_ms) {
+  // Once the thread is done, result_ and cdata_failed_ are final.
+  return WaitForSingleObject(thread_, timeout_ms) == WAIT_OBJECT_0;
+}
+
+bool TeeImpl::CdataComplete() const { return result_ && !cdata_failed_; }
+
+void TeeImpl::WriteCdata(const uint8_t* data, size_t size, bool at_end) {
+  if (cdata_failed_) {
+    return;
+  }
+  encoded_.clear();
+  encoder_.Encode(data, size, &encoded_);
+  if (at_end) {
+    encoder_.Finish(&encoded_);
+  }
+  if (!encoded_.empty() &&
+      !WriteToFile(cdata_, encoded_.data(), encoded_.size())) {
+    cdata_failed_ = true;
+  }
+}
+
+bool TeeImpl::MainFunc() {
+  // The input is read into a ring buffer with overlapped I/O, so that the next
+  // read is already pending while the data from the previous ones are written
+  // to the outputs. Whatever accumulated in the meantime is written in one
+  // batch. If the input was not opened for overlapped I/O, reads simply
+  // complete synchronously.
+  static constexpr size_t kRingSize = 4 * 1024 * 1024;
+  static constexpr DWORD kMaxReadSize = 1024 * 1024;
+  std::unique_ptr<uint8_t[]> ring(new uint8_t[kRingSize]);
+  size_t head = 0;  // the start of the data to write
+  size_t size = 0;  // the size of the data to write
+
+  bazel::windows::AutoHandle event(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+  if (!event.IsValid()) {
+    return false;
+  }
+  OVERLAPPED overlapped;
+  bool read_pending = false;
+  bool eof = false;
+
+  while (true) {
+    if (!read_pending && !eof && size < kRingSize) {
+      // Read into the free space after the data, up to the end of the ring.
+      const size_t tail = (head + size) % kRingSize;
+      const DWORD to_read = static_cast<DWORD>(std::min<size_t>(
+          std::min(kRingSize - size, kRingSize - tail), kMaxReadSize));
+      memset(&overlapped, 0, sizeof(overlapped));
+      overlapped.hEvent = event;
+      DWORD read = 0;
+      if (ReadFile(input_, ring.get() + tail, to_read, &read, &overlapped)) {
+        size += read;
+      } else if (GetLastError() == ERROR_IO_PENDING) {
+        read_pending = true;
+      } else {
+        // The writing end of the pipe was closed, or the input failed.
+        eof = true;
+      }
+    }
+
+    if (read_pending) {
+      // Only block for the read if there is nothing to write meanwhile.
+      DWORD read = 0;
+      if (GetOverlappedResult(input_, &overlapped, &read, size == 0)) {
+        read_pending = false;
+        size += read;
+      } else if (GetLastError() != ERROR_IO_INCOMPLETE) {
+        read_pending = false;
+        eof = true;
+      }
+    }
+
+    if (size > 0) {
+      // Write everything up to the end of the ring; the rest follows in the
+      // next round.
+      const size_t batch = std::min(size, kRingSize - head);
+      if (!WriteToFile(output1_, ring.get() + head, batch) ||
+          !WriteToFile(output2_, ring.get() + head, batch)) {
+        if (read_pending) {
+          CancelIoEx(input_, &overlapped);
+          DWORD read;
+          GetOverlappedResult(input_, &overlapped, &read, TRUE);
+        }
+        return false;
+      }
+      WriteCdata(ring.get() + head, batch, false);
+      head = (head + batch) % kRingSize;
+      size -= batch;
+    } else if (eof && !read_pending) {
+      WriteCdata(nullptr, 0, true);
+      return true;
     }
   }
-  return true;
 }
 
+// Runs the test binary once, with its output in 'run->outerr' (and in
+// 'run->cdata', if not empty). Sets the duration and whether 'run->cdata' is
+// complete, and returns the exit code.
 int RunSubprocess(const Path& test_path, const std::wstring& args,
-                  const Path& test_outerr, Duration* test_duration) {
+                  TestRun* run) {
+  // How long to wait for the tee to drain the pipe after the test exited.
+  static constexpr DWORD kTeeTimeoutMs = 1000;
+
   std::unique_ptr<Tee> tee;
   bazel::windows::WaitableProcess process;
   LARGE_INTEGER start, end, freq;
-  if (!StartSubprocess(test_path, args, test_outerr, &tee, &start, &process)) {
+  run->cdata_complete = false;
+  if (!StartSubprocess(test_path, args, run->outerr, run->cdata,
+                       run->cdata_offset, &tee, &start, &process)) {
     LogErrorWithArg(__LINE__, "Failed to start test process", test_path.Get());
     return 1;
   }
+  Defer finish_tee([&tee, run]() {
+    if (tee->Finish(kTeeTimeoutMs)) {
+      run->cdata_complete = tee->CdataComplete();
+    } else {
+      // A process that the test started still holds the pipe open. The tee
+      // thread goes on running, so it must keep its state.
+      (void)tee.release();
+    }
+  });
 
   std::wstring werror;
   int wait_res = process.WaitFor(-1, &end, &werror);
@@ -1502,11 +1922,140 @@ int RunSubprocess(const Path& test_path, const std::wstring& args,
   if ((end.QuadPart - seconds * freq.QuadPart) * 2 >= freq.QuadPart) {
     seconds += 1;
   }
-  test_duration->seconds =
+  run->duration.seconds =
       (seconds > Duration::kMax) ? Duration::kMax : seconds;
   return result;
 }
 
+bool ShouldCreateXml(const Path& xml_log, const MainType main_type,
+                     bool* result);
+bool GetAcpTestName(int shard_index, std::string* result);
+std::string XmlTestSuiteHeader(const std::string& acp_test_name,
+                               const TestRun& run);
+
+// Runs the test, and appends the outcome to 'runs'.
+//
+// Normally this runs the test binary once. If TEST_WRAPPER_RUN_ALL_SHARDS is
+// "1" and the test is sharded, then this runs every shard in turn, so the
+// environment and runfiles setup of this process is shared by all of them.
+// Each shard writes its own outerr file, named after 'test_outerr'.
+// If TEST_WRAPPER_ATTEMPTS is N > 1, then a failing run is retried until it
+// passes or it has been attempted N times.
+//
+// If the test runs only once and the wrapper is to write 'xml_log', then the
+// output is also encoded for the XML log as the test writes it, into a
+// fragment of the XML log that CreateXmlLog completes; see TestRun::cdata.
+//
+// Returns false if the runs could not be set up; a failing test still returns
+// true, with its exit code in 'runs'.
+bool RunTest(const Path& test_path, const std::wstring& args,
+             const Path& test_outerr, const Path& xml_log,
+             std::vector<TestRun>* runs) {
+  std::wstring run_all_shards, attempts_str, total_shards_str;
+  int attempts = 0, total_shards = 0;
+  if (!GetEnv(L"TEST_WRAPPER_RUN_ALL_SHARDS", &run_all_shards) ||
+      !GetIntEnv(L"TEST_WRAPPER_ATTEMPTS", &attempts_str, &attempts) ||
+      !GetIntEnv(L"TEST_TOTAL_SHARDS", &total_shards_str, &total_shards)) {
+    LogError(__LINE__);
+    return false;
+  }
+
+  // -1 stands for "run the test as the environment says".
+  std::vector<int> shards;
+  if (run_all_shards == L"1" && total_shards > 0) {
+    for (int i = 0; i < total_shards; ++i) {
+      shards.push_back(i);
+    }
+  } else {
+    shards.push_back(-1);
+  }
+
+  bool should_create_xml = false;
+  std::string acp_test_name;
+  const bool stream_xml =
+      shards.size() == 1 &&
+      ShouldCreateXml(xml_log, MainType::kTestWrapperMain,
+                      &should_create_xml) &&
+      should_create_xml && GetAcpTestName(shards[0], &acp_test_name);
+
+  for (int shard : shards) {
+    TestRun run;
+    run.shard_index = shard;
+    run.outerr = test_outerr;
+    run.cdata_offset = 0;
+    run.cdata_complete = false;
+    if (stream_xml) {
+      // Leave room for the longest header the run may need.
+      TestRun longest = run;
+      longest.duration.seconds = Duration::kMax;
+      longest.exit_code = INT_MIN;
+      run.cdata_offset =
+          static_cast<DWORD>(strlen(kXmlLogHeader) +
+                             XmlTestSuiteHeader(acp_test_name, longest).size());
+      if (!run.cdata.Set(xml_log.Get() + L".part")) {
+        LogError(__LINE__);
+        return false;
+      }
+    }
+    if (shard >= 0) {
+      std::wstring index = std::to_wstring(shard);
+      if (!SetEnv(L"TEST_SHARD_INDEX", index) ||
+          !SetEnv(L"GTEST_SHARD_INDEX", index) ||
+          !run.outerr.Set(test_outerr.Get() + L"." + index)) {
+        LogError(__LINE__);
+        return false;
+      }
+    }
+    for (int attempt = 1;; ++attempt) {
+      run.duration.seconds = 0;
+      run.exit_code = RunSubprocess(test_path, args, &run);
+      if (run.exit_code == 0 || attempt >= attempts) {
+        break;
+      }
+      std::stringstream ss;
+      ss << "Test failed with exit code " << run.exit_code << ", attempt "
+         << attempt << " of " << attempts << std::endl;
+      WriteStdout(ss.str());
+    }
+    runs->push_back(run);
+  }
+  return true;
+}
+
+// Returns the length of the prefix of 'data[0..n)' that consists of legal
+// single octets other than ']', i.e. octets that CdataEscape can copy as-is
+// without looking at their neighbours.
+DWORD CountPlainOctets(const uint8_t* data, DWORD n) {
+  DWORD i = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+  const __m128i ctl_min = _mm_set1_epi8(0x1F);
+  const __m128i bracket = _mm_set1_epi8(']');
+  const __m128i tab = _mm_set1_epi8(0x9);
+  const __m128i lf = _mm_set1_epi8(0xA);
+  const __m128i cr = _mm_set1_epi8(0xD);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    // Signed comparison, so this is true for exactly 0x20..0x7F.
+    __m128i plain = _mm_andnot_si128(_mm_cmpeq_epi8(v, bracket),
+                                     _mm_cmpgt_epi8(v, ctl_min));
+    plain = _mm_or_si128(plain, _mm_cmpeq_epi8(v, tab));
+    plain = _mm_or_si128(plain, _mm_cmpeq_epi8(v, lf));
+    plain = _mm_or_si128(plain, _mm_cmpeq_epi8(v, cr));
+    if (_mm_movemask_epi8(plain) != 0xFFFF) {
+      break;  // the scalar loop below finds the exact position
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    uint8_t c = data[i];
+    if (!((c >= 0x20 && c <= 0x7F && c != ']') || c == 0x9 || c == 0xA ||
+          c == 0xD)) {
+      break;
+    }
+  }
+  return i;
+}
+
 // Replace invalid XML characters and locate invalid CDATA sequences.
 //
 // The legal Unicode code points and ranges are U+0009, U+000A, U+000D,
@@ -1528,9 +2077,29 @@ int RunSubprocess(const Path& test_path, const std::wstring& args,
 // Every octet-sequence matching one of these regexps will be left alone, all
 // other octet-sequences will be replaced by '?' characters.
 bool CdataEscape(IFStream* in, std::basic_ostream<char>* out) {
-  int c0 = in->Get();
+  int c0;
   uint8_t p[3];
-  for (; c0 < 256; c0 = in->Get()) {
+  while (true) {
+    // Copy the run of plain octets (which is most of a typical test log) in
+    // one write, straight from the input buffer.
+    DWORD n;
+    const uint8_t* run = in->Buffered(&n);
+    n = CountPlainOctets(run, n);
+    if (n > 0) {
+      out->write(reinterpret_cast<const char*>(run), n);
+      if (!out->good()) {
+        return false;
+      }
+      if (!in->Skip(n)) {
+        return false;
+      }
+      continue;
+    }
+
+    c0 = in->Get();
+    if (c0 >= 256) {
+      break;
+    }
     if (c0 == ']' && in->Peek(2, p) == 2 && p[0] == ']' && p[1] == '>') {
       *out << "]]>]]<![CDATA[>";
       if (!out->good()) {
@@ -1592,7 +2161,105 @@ bool CdataEscape(IFStream* in, std::basic_ostream<char>* out) {
   return c0 == IFStream::kIFStreamErrorEOF;
 }
 
-bool GetTestName(std::wstring* result) {
+size_t CdataEncoder::EncodePrefix(const uint8_t* data, size_t n, bool at_end,
+                                  std::string* out) {
+  // This follows CdataEscape step by step, see there.
+  size_t i = 0;
+  while (i < n) {
+    // The Tee encodes at most a ring buffer's worth at a time.
+    const size_t plain =
+        CountPlainOctets(data + i, static_cast<DWORD>(n - i));
+    if (plain > 0) {
+      out->append(reinterpret_cast<const char*>(data + i), plain);
+      i += plain;
+      continue;
+    }
+
+    const uint8_t c0 = data[i];
+    const uint8_t* p = data + i + 1;
+    const size_t avail = n - i - 1;
+    // The number of octets after c0 that CdataEscape may look at.
+    size_t lookahead = 0;
+    if (c0 == ']' || (c0 >= 0xE0 && c0 <= 0xEF)) {
+      lookahead = 2;
+    } else if (c0 >= 0xC0 && c0 <= 0xDF) {
+      lookahead = 1;
+    } else if (c0 >= 0xF0 && c0 <= 0xF7) {
+      lookahead = 3;
+    }
+    if (avail < lookahead && !at_end) {
+      break;
+    }
+
+    if (c0 == ']' && avail >= 2 && p[0] == ']' && p[1] == '>') {
+      out->append("]]>]]<![CDATA[>");
+      i += 3;
+    } else if (c0 == 0x9 || c0 == 0xA || c0 == 0xD ||
+               (c0 >= 0x20 && c0 <= 0x7F)) {
+      out->push_back(static_cast<char>(c0));
+      i += 1;
+    } else if (c0 >= 0xC0 && c0 <= 0xDF && avail >= 1 && p[0] >= 0x80 &&
+               p[0] <= 0xBF) {
+      out->append(reinterpret_cast<const char*>(data + i), 2);
+      i += 2;
+    } else if (avail >= 2 &&
+               ((c0 >= 0xE0 && c0 <= 0xEC && p[0] >= 0x80 && p[0] <= 0xBF &&
+                 p[1] >= 0x80 && p[1] <= 0xBF) ||
+                (c0 == 0xED && p[0] >= 0x80 && p[0] <= 0x9F && p[1] >= 0x80 &&
+                 p[1] <= 0xBF) ||
+                (c0 == 0xEE && p[0] >= 0x80 && p[0] <= 0xBF && p[1] >= 0x80 &&
+                 p[1] <= 0xBF) ||
+                (c0 == 0xEF && p[0] >= 0x80 && p[0] <= 0xBE && p[1] >= 0x80 &&
+                 p[1] <= 0xBF) ||
+                (c0 == 0xEF && p[0] == 0xBF && p[1] >= 0x80 && p[1] <= 0xBD))) {
+      out->append(reinterpret_cast<const char*>(data + i), 3);
+      i += 3;
+    } else if (avail >= 3 && c0 >= 0xF0 && c0 <= 0xF7 && p[0] >= 0x80 &&
+               p[0] <= 0xBF && p[1] >= 0x80 && p[1] <= 0xBF && p[2] >= 0x80 &&
+               p[2] <= 0xBF) {
+      out->append(reinterpret_cast<const char*>(data + i), 4);
+      i += 4;
+    } else {
+      out->push_back('?');
+      i += 1;
+    }
+  }
+  return i;
+}
+
+void CdataEncoder::Encode(const uint8_t* data, size_t n, std::string* out) {
+  if (pending_size_ > 0) {
+    // The octets held back need at most 3 more to be encoded.
+    uint8_t joined[sizeof(pending_) + 3];
+    const size_t taken = std::min<size_t>(n, 3);
+    memcpy(joined, pending_, pending_size_);
+    memcpy(joined + pending_size_, data, taken);
+    const size_t joined_size = pending_size_ + taken;
+    const size_t done = EncodePrefix(joined, joined_size, false, out);
+    if (done < pending_size_) {
+      // Only possible if all of 'data' is in 'joined'.
+      memmove(pending_, joined + done, joined_size - done);
+      pending_size_ = joined_size - done;
+      return;
+    }
+    data += done - pending_size_;
+    n -= done - pending_size_;
+    pending_size_ = 0;
+  }
+  const size_t done = EncodePrefix(data, n, false, out);
+  memcpy(pending_, data + done, n - done);
+  pending_size_ = n - done;
+}
+
+void CdataEncoder::Finish(std::string* out) {
+  EncodePrefix(pending_, pending_size_, true, out);
+  pending_size_ = 0;
+}
+
+// Gets the test's name for the XML log.
+// 'shard_index' is the index of the shard the test ran as, or -1 to take that
+// from TEST_SHARD_INDEX.
+bool GetTestName(int shard_index, std::wstring* result) {
   if (!GetEnv(L"TEST_BINARY", result) || result->empty()) {
     LogError(__LINE__, L"Failed to get test name");
     return false;
@@ -1607,18 +2274,20 @@ bool GetTestName(std::wstring* result) {
   // Ensure that test shards have unique names in the xml output, by including
   // the shard index in the test name.
   std::wstring total_shards_str;
-  int total_shards = 0, shard_index = 0;
+  int total_shards = 0;
   if (!GetIntEnv(L"TEST_TOTAL_SHARDS", &total_shards_str, &total_shards)) {
     LogError(__LINE__);
     return false;
   }
-  if (total_shards > 0) {
+  if (total_shards > 0 && shard_index < 0) {
     std::wstring shard_index_str;
     if (!GetIntEnv(L"TEST_SHARD_INDEX", &shard_index_str, &shard_index) ||
         shard_index_str.empty()) {
       LogError(__LINE__);
       return false;
     }
+  }
+  if (total_shards > 0) {
     std::wstringstream stm;
     stm << *result << L"_shard_" << (shard_index + 1) << L"/"
         << total_shards_str;
@@ -1671,87 +2340,178 @@ bool ShouldCreateXml(const Path& xml_log, const MainType main_type,
   return true;
 }
 
-bool CreateXmlLog(const Path& output, const Path& test_outerr,
-                  const Duration duration, const int exit_code,
-                  const DeleteAfterwards delete_afterwards,
-                  const MainType main_type) {
-  bool should_create_xml;
-  if (!ShouldCreateXml(output, main_type, &should_create_xml)) {
-    LogErrorWithArg(__LINE__, "Failed to decide if XML log is needed",
-                    output.Get());
-    return false;
-  }
-  if (!should_create_xml) {
-    return true;
-  }
-
-  Defer delete_test_outerr([test_outerr, delete_afterwards]() {
-    // Delete the test's outerr file after we have the XML file.
-    // We don't care if this succeeds or not, because the outerr file is not a
-    // declared output.
-    if (delete_afterwards == DeleteAfterwards::kEnabled) {
-      DeleteFileW(test_outerr.Get().c_str());
-    }
-  });
-
+// Gets the test's name for the XML log, in the ANSI code page.
+bool GetAcpTestName(int shard_index, std::string* result) {
   std::wstring test_name;
-  int errors = (exit_code == 0) ? 0 : 1;
-  std::string error_msg = CreateErrorTag(exit_code);
-  if (!GetTestName(&test_name)) {
+  if (!GetTestName(shard_index, &test_name)) {
     LogError(__LINE__);
     return false;
   }
+  if (!WcsToAcp(test_name, result)) {
+    LogError(__LINE__, test_name.c_str());
+    return false;
+  }
+  return true;
+}
 
+// Returns the start of the <testsuite> element of 'run', up to the test log.
+std::string XmlTestSuiteHeader(const std::string& acp_test_name,
+                               const TestRun& run) {
+  int errors = (run.exit_code == 0) ? 0 : 1;
+  std::stringstream ss;
+  ss << "<testsuite name=\"" << acp_test_name
+     << "\" tests=\"1\" failures=\"0\" errors=\"" << errors
+     << "\">\n"
+        "<testcase name=\""
+     << acp_test_name << "\" status=\"run\" duration=\""
+     << run.duration.seconds << "\" time=\"" << run.duration.seconds << "\">"
+     << CreateErrorTag(run.exit_code)
+     << "</testcase>\n"
+        "<system-out><![CDATA[";
+  return ss.str();
+}
+
+// Writes one <testsuite> element with the results and the log of 'run'.
+bool WriteXmlTestSuite(const TestRun& run, std::ofstream* ostm) {
   std::string acp_test_name;
-  if (!WcsToAcp(test_name, &acp_test_name)) {
-    LogError(__LINE__, test_name.c_str());
+  if (!GetAcpTestName(run.shard_index, &acp_test_name)) {
     return false;
   }
 
   bazel::windows::AutoHandle test_log;
-  if (!OpenExistingFileForRead(test_outerr, &test_log)) {
-    LogError(__LINE__, test_outerr.Get().c_str());
+  if (!OpenExistingFileForRead(run.outerr, &test_log)) {
+    LogError(__LINE__, run.outerr.Get().c_str());
     return false;
   }
 
   std::unique_ptr<IFStream> istm(IFStreamImpl::Create(test_log));
   if (istm == nullptr) {
-    LogError(__LINE__, test_outerr.Get().c_str());
+    LogError(__LINE__, run.outerr.Get().c_str());
     return false;
   }
 
-  std::ofstream ostm(
-      AddUncPrefixMaybe(output).c_str(),
-      std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
-  if (!ostm.is_open() || !ostm.good()) {
-    LogError(__LINE__, output.Get().c_str());
+  *ostm << XmlTestSuiteHeader(acp_test_name, run);
+  if (!ostm->good()) {
     return false;
   }
 
-  // Create XML file stub.
-  ostm << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-          "<testsuites>\n"
-          "<testsuite name=\""
-       << acp_test_name << "\" tests=\"1\" failures=\"0\" errors=\"" << errors
-       << "\">\n"
-          "<testcase name=\""
-       << acp_test_name << "\" status=\"run\" duration=\"" << duration.seconds
-       << "\" time=\"" << duration.seconds << "\">" << error_msg
-       << "</testcase>\n"
-          "<system-out><![CDATA[";
-  if (!ostm.good()) {
-    LogError(__LINE__, output.Get().c_str());
+  // Encode test log to make it embeddable in CDATA.
+  if (!CdataEscape(istm.get(), ostm)) {
     return false;
   }
 
-  // Encode test log to make it embeddable in CDATA.
-  if (!CdataEscape(istm.get(), &ostm)) {
+  // Append CDATA end and closing tag.
+  *ostm << kXmlTestSuiteFooter;
+  return ostm->good();
+}
+
+// Completes the XML log fragment of 'run' (see TestRun::cdata) with the header
+// and the footer, and moves it to 'output'. This does not read the test log
+// again: the tee encoded it already.
+bool CompleteXmlLog(const TestRun& run, const Path& output) {
+  std::string acp_test_name;
+  if (!GetAcpTestName(run.shard_index, &acp_test_name)) {
+    return false;
+  }
+
+  // The header fills the room left for it; the padding goes between elements,
+  // where whitespace is insignificant.
+  const std::string suite_header = XmlTestSuiteHeader(acp_test_name, run);
+  std::string header(kXmlLogHeader);
+  if (header.size() + suite_header.size() > run.cdata_offset) {
+    LogError(__LINE__, run.cdata.Get().c_str());
+    return false;
+  }
+  header.append(run.cdata_offset - header.size() - suite_header.size(), ' ');
+  header += suite_header;
+  const std::string footer = std::string(kXmlTestSuiteFooter) + kXmlLogFooter;
+
+  {
+    bazel::windows::AutoHandle handle(CreateFileW(
+        AddUncPrefixMaybe(run.cdata).c_str(), GENERIC_WRITE, 0, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    LARGE_INTEGER zero;
+    zero.QuadPart = 0;
+    if (!handle.IsValid() ||
+        !WriteToFile(handle, header.data(), header.size()) ||
+        !SetFilePointerEx(handle, zero, nullptr, FILE_END) ||
+        !WriteToFile(handle, footer.data(), footer.size())) {
+      LogError(__LINE__, run.cdata.Get().c_str());
+      return false;
+    }
+  }
+
+  if (!MoveFileExW(AddUncPrefixMaybe(run.cdata).c_str(),
+                   AddUncPrefixMaybe(output).c_str(),
+                   MOVEFILE_REPLACE_EXISTING)) {
+    DWORD err = GetLastError();
+    LogErrorWithArgAndValue(__LINE__, "Failed to move file", run.cdata.Get(),
+                            err);
+    return false;
+  }
+  return true;
+}
+
+bool CreateXmlLog(const Path& output, const std::vector<TestRun>& runs,
+                  const DeleteAfterwards delete_afterwards,
+                  const MainType main_type) {
+  Defer delete_cdata([&runs]() {
+    // Delete what is left of the XML log fragments. They are not declared
+    // outputs either.
+    for (const auto& run : runs) {
+      if (!run.cdata.Get().empty()) {
+        DeleteFileW(AddUncPrefixMaybe(run.cdata).c_str());
+      }
+    }
+  });
+
+  bool should_create_xml;
+  if (!ShouldCreateXml(output, main_type, &should_create_xml)) {
+    LogErrorWithArg(__LINE__, "Failed to decide if XML log is needed",
+                    output.Get());
+    return false;
+  }
+  if (!should_create_xml) {
+    return true;
+  }
+
+  Defer delete_test_outerr([&runs, delete_afterwards]() {
+    // Delete the test's outerr files after we have the XML file.
+    // We don't care if this succeeds or not, because the outerr files are not
+    // declared outputs.
+    if (delete_afterwards == DeleteAfterwards::kEnabled) {
+      for (const auto& run : runs) {
+        DeleteFileW(run.outerr.Get().c_str());
+      }
+    }
+  });
+
+  // If the tee wrote the XML log of the only run already, complete that;
+  // otherwise encode the test logs now.
+  if (runs.size() == 1 && runs[0].cdata_complete &&
+      CompleteXmlLog(runs[0], output)) {
+    return true;
+  }
+
+  std::ofstream ostm(
+      AddUncPrefixMaybe(output).c_str(),
+      std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+  if (!ostm.is_open() || !ostm.good()) {
     LogError(__LINE__, output.Get().c_str());
     return false;
   }
 
-  // Append CDATA end and closing tags.
-  ostm << "]]></system-out>\n</testsuite>\n</testsuites>\n";
+  // Create XML file stub, with one test suite per run.
+  ostm << kXmlLogHeader;
+  for (const auto& run : runs) {
+    if (!WriteXmlTestSuite(run, &ostm)) {
+      LogError(__LINE__, output.Get().c_str());
+      return false;
+    }
+  }
+
+  // Append closing tag.
+  ostm << kXmlLogFooter;
   if (!ostm.good()) {
     LogError(__LINE__, output.Get().c_str());
     return false;
@@ -1843,6 +2603,17 @@ int IFStreamImpl::Get() {
   return result;
 }
 
+const uint8_t* IFStreamImpl::Buffered(DWORD* n) const {
+  *n = end_ - pos_;
+  return pages_.get() + pos_;
+}
+
+bool IFStreamImpl::Skip(DWORD n) {
+  // Let Get() consume the last byte, so it loads the next page if needed.
+  pos_ += n - 1;
+  return Get() != kIFStreamErrorIO;
+}
+
 DWORD IFStreamImpl::Peek(DWORD n, uint8_t* out) const {
   if (pos_ == end_) {
     return 0;
@@ -1946,10 +2717,18 @@ int TestWrapperMain(int argc, wchar_t** argv) {
     return 1;
   }
 
-  Duration test_duration;
-  int result = RunSubprocess(test_path, args, test_outerr, &test_duration);
-  if (!CreateXmlLog(xml_log, test_outerr, test_duration, result,
-                    DeleteAfterwards::kEnabled, MainType::kTestWrapperMain) ||
+  std::vector<TestRun> runs;
+  if (!RunTest(test_path, args, test_outerr, xml_log, &runs)) {
+    return 1;
+  }
+  int result = 0;
+  for (const auto& run : runs) {
+    if (result == 0) {
+      result = run.exit_code;
+    }
+  }
+  if (!CreateXmlLog(xml_log, runs, DeleteAfterwards::kEnabled,
+                    MainType::kTestWrapperMain) ||
       !ArchiveUndeclaredOutputs(undecl) ||
       !CreateUndeclaredOutputsAnnotations(undecl.annotations_dir,
                                           undecl.annotations)) {
@@ -1959,15 +2738,18 @@ int TestWrapperMain(int argc, wchar_t** argv) {
 }
 
 int XmlWriterMain(int argc, wchar_t** argv) {
-  Path cwd, test_outerr, test_xml_log;
-  Duration duration;
-  int exit_code = 0;
+  Path cwd, test_xml_log;
+  std::vector<TestRun> runs(1);
+  runs[0].shard_index = -1;
+  runs[0].exit_code = 0;
+  runs[0].cdata_offset = 0;
+  runs[0].cdata_complete = false;
 
   if (!GetCwd(&cwd) ||
-      !ParseXmlWriterArgs(argc, argv, cwd, &test_outerr, &test_xml_log,
-                          &duration, &exit_code) ||
-      !CreateXmlLog(test_xml_log, test_outerr, duration, exit_code,
-                    DeleteAfterwards::kDisabled, MainType::kXmlWriterMain)) {
+      !ParseXmlWriterArgs(argc, argv, cwd, &runs[0].outerr, &test_xml_log,
+                          &runs[0].duration, &runs[0].exit_code) ||
+      !CreateXmlLog(test_xml_log, runs, DeleteAfterwards::kDisabled,
+                    MainType::kXmlWriterMain)) {
     return 1;
   }
 
@@ -2030,14 +2812,26 @@ bool TestOnly_AsMixedPath(const std::wstring& path, std::string* result) {
 bool TestOnly_CreateTee(bazel::windows::AutoHandle* input,
                         bazel::windows::AutoHandle* output1,
                         bazel::windows::AutoHandle* output2,
-                        std::unique_ptr<Tee>* result) {
-  return TeeImpl::Create(input, output1, output2, result);
+                        std::unique_ptr<Tee>* result,
+                        bazel::windows::AutoHandle* cdata) {
+  return TeeImpl::Create(input, output1, output2, cdata, result);
 }
 
 bool TestOnly_CdataEncode(IFStream* in_stm, std::basic_ostream<char>* out_stm) {
   return CdataEscape(in_stm, out_stm);
 }
 
+std::string TestOnly_CdataEncodeChunks(const std::vector<std::string>& chunks) {
+  CdataEncoder encoder;
+  std::string result;
+  for (const std::string& chunk : chunks) {
+    encoder.Encode(reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size(),
+                   &result);
+  }
+  encoder.Finish(&result);
+  return result;
+}
+
 IFStream* TestOnly_CreateIFStream(HANDLE handle, DWORD page_size) {
   return IFStreamImpl::Create(handle, page_size);
 }
@@ -106,6 +106,16 @@ class Tee {
  public:
   virtual ~Tee() {}
 
+  // Waits up to 'timeout_ms' for the input to end and for all of it to be
+  // written out. Returns false if that takes longer, e.g. because a process
+  // that outlived the test still holds the writing end of the pipe; the Tee
+  // then must be leaked rather than destroyed.
+  virtual bool Finish(DWORD timeout_ms) = 0;
+
+  // Whether the whole input was written, encoded, to the CDATA output. Only
+  // meaningful after Finish returned true.
+  virtual bool CdataComplete() const = 0;
+
  protected:
   Tee() {}
   Tee(const Tee&) = delete;
@@ -135,6 +145,16 @@ class IFStream {
   //   0..n: the number of successfully peeked bytes
   virtual DWORD Peek(DWORD n, uint8_t* out) const = 0;
 
+  // Returns the bytes that are buffered contiguously from the current cursor
+  // position, without moving the cursor. Writes their number into 'n'; that is
+  // 0 only at EOF.
+  virtual const uint8_t* Buffered(DWORD* n) const = 0;
+
+  // Moves the cursor ahead by 'n' bytes, where 'n' is 1..the number of bytes
+  // returned by Buffered().
+  // Returns false upon an I/O error.
+  virtual bool Skip(DWORD n) = 0;
+
  protected:
   IFStream() {}
 
@@ -189,13 +209,20 @@ bool TestOnly_CreateUndeclaredOutputsAnnotations(
 bool TestOnly_AsMixedPath(const std::wstring& path, std::string* result);
 
 // Creates a Tee object. See the Tee class declaration for more info.
+// Unless 'cdata' is null, the Tee also writes the input encoded for CDATA to
+// it.
 bool TestOnly_CreateTee(bazel::windows::AutoHandle* input,
                         bazel::windows::AutoHandle* output1,
                         bazel::windows::AutoHandle* output2,
-                        std::unique_ptr<Tee>* result);
+                        std::unique_ptr<Tee>* result,
+                        bazel::windows::AutoHandle* cdata = nullptr);
 
 bool TestOnly_CdataEncode(IFStream* in_stm, std::basic_ostream<char>* out_stm);
 
+// Encodes the concatenation of 'chunks' like TestOnly_CdataEncode, but one
+// chunk at a time, as the Tee does.
+std::string TestOnly_CdataEncodeChunks(const std::vector<std::string>& chunks);
+
 IFStream* TestOnly_CreateIFStream(HANDLE handle, DWORD page_size);
 
 }  // namespace testing
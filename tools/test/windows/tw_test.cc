@@ -17,6 +17,9 @@
 #include <windows.h>
 
 #include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -39,6 +42,7 @@ using bazel::tools::test_wrapper::IFStream;
 using bazel::tools::test_wrapper::ZipEntryPaths;
 using bazel::tools::test_wrapper::testing::TestOnly_AsMixedPath;
 using bazel::tools::test_wrapper::testing::TestOnly_CdataEncode;
+using bazel::tools::test_wrapper::testing::TestOnly_CdataEncodeChunks;
 using bazel::tools::test_wrapper::testing::TestOnly_CreateIFStream;
 using bazel::tools::test_wrapper::testing::TestOnly_CreateTee;
 using bazel::tools::test_wrapper::testing::
@@ -378,6 +382,52 @@ TEST_F(TestWrapperWindowsTest, TestCreateZip) {
   EXPECT_EQ(memcmp(extracted[8].data.get(), "hello", 5), 0);
 }
 
+TEST_F(TestWrapperWindowsTest, TestCreateZipWithLargeFiles) {
+  std::wstring tmpdir;
+  GET_TEST_TMPDIR(&tmpdir);
+
+  // Files of 1 MiB and more are read unbuffered, and compressible ones are
+  // deflated unless their MIME type is that of compressed data.
+  std::wstring root = tmpdir + L"\\tmp" + WLINE;
+  EXPECT_TRUE(CreateDirectoryW(root.c_str(), nullptr));
+  const std::string large(3 * 1024 * 1024 + 17, 'x');
+  std::string random(64 * 1024, '\0');
+  for (size_t i = 0; i < random.size(); ++i) {
+    random[i] = static_cast<char>((i * 7919) ^ (i >> 3));
+  }
+  EXPECT_TRUE(blaze_util::CreateDummyFile(root + L"\\large.txt", large));
+  EXPECT_TRUE(blaze_util::CreateDummyFile(root + L"\\large.png", large));
+  EXPECT_TRUE(blaze_util::CreateDummyFile(root + L"\\random.bin", random));
+
+  std::vector<FileInfo> file_list = {
+      FileInfo(L"large.txt", large.size()),
+      FileInfo(L"large.png", large.size()),
+      FileInfo(L"random.bin", random.size())};
+
+  ASSERT_TRUE(TestOnly_CreateZip(root, file_list, root + L"\\x.zip"));
+
+  std::string zip_path;
+  EXPECT_TRUE(TestOnly_AsMixedPath(root + L"\\x.zip", &zip_path));
+
+  std::vector<InMemoryExtractor::ExtractedFile> extracted;
+  InMemoryExtractor extractor(&extracted);
+  std::unique_ptr<devtools_ijar::ZipExtractor> zip(
+      devtools_ijar::ZipExtractor::Create(zip_path.c_str(), &extractor));
+  EXPECT_NE(zip.get(), nullptr);
+  EXPECT_EQ(zip->ProcessAll(), 0);
+
+  ASSERT_EQ(extracted.size(), 3);
+  EXPECT_EQ(extracted[0].path, std::string("large.txt"));
+  EXPECT_EQ(extracted[1].path, std::string("large.png"));
+  EXPECT_EQ(extracted[2].path, std::string("random.bin"));
+  ASSERT_EQ(extracted[0].size, large.size());
+  ASSERT_EQ(extracted[1].size, large.size());
+  ASSERT_EQ(extracted[2].size, random.size());
+  EXPECT_EQ(memcmp(extracted[0].data.get(), large.data(), large.size()), 0);
+  EXPECT_EQ(memcmp(extracted[1].data.get(), large.data(), large.size()), 0);
+  EXPECT_EQ(memcmp(extracted[2].data.get(), random.data(), random.size()), 0);
+}
+
 TEST_F(TestWrapperWindowsTest, TestGetMimeType) {
   // As of 2018-11-08, TestOnly_GetMimeType looks up the MIME type from the
   // registry under `HKCR\<extension>\Content Type`, e.g.
@@ -475,6 +525,95 @@ TEST_F(TestWrapperWindowsTest, TestTee) {
   write1 = INVALID_HANDLE_VALUE;  // closes handle so the Tee thread can exit
 }
 
+TEST_F(TestWrapperWindowsTest, TestTeeLargeOutput) {
+  HANDLE read1_h, write1_h;
+  EXPECT_TRUE(CreatePipe(&read1_h, &write1_h, nullptr, 0));
+  bazel::windows::AutoHandle read1(read1_h), write1(write1_h);
+  HANDLE read2_h, write2_h;
+  EXPECT_TRUE(CreatePipe(&read2_h, &write2_h, nullptr, 0));
+  bazel::windows::AutoHandle read2(read2_h), write2(write2_h);
+  HANDLE read3_h, write3_h;
+  EXPECT_TRUE(CreatePipe(&read3_h, &write3_h, nullptr, 0));
+  bazel::windows::AutoHandle read3(read3_h), write3(write3_h);
+
+  std::unique_ptr<bazel::tools::test_wrapper::Tee> tee;
+  EXPECT_TRUE(TestOnly_CreateTee(&read1, &write2, &write3, &tee));
+
+  // Write more than the Tee buffers at once, so that its buffer wraps around.
+  std::string content(9 * 1024 * 1024 + 123, '\0');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = static_cast<char>('a' + i % 23);
+  }
+  auto drain = [&content](HANDLE h, std::string* result) {
+    std::unique_ptr<char[]> buf(new char[65536]);
+    DWORD read;
+    while (result->size() < content.size() &&
+           ReadFile(h, buf.get(), 65536, &read, nullptr)) {
+      result->append(buf.get(), read);
+    }
+  };
+  std::string output2, output3;
+  std::thread drain2(drain, static_cast<HANDLE>(read2), &output2);
+  std::thread drain3(drain, static_cast<HANDLE>(read3), &output3);
+
+  for (size_t offset = 0; offset < content.size(); offset += 100000) {
+    DWORD size = std::min<size_t>(100000, content.size() - offset);
+    DWORD written;
+    EXPECT_TRUE(
+        WriteFile(write1, content.data() + offset, size, &written, nullptr));
+    EXPECT_EQ(written, size);
+  }
+  write1 = INVALID_HANDLE_VALUE;  // closes handle so the Tee thread can exit
+
+  drain2.join();
+  drain3.join();
+  EXPECT_EQ(output2, content);
+  EXPECT_EQ(output3, content);
+}
+
+TEST_F(TestWrapperWindowsTest, TestTeeCdata) {
+  HANDLE read1_h, write1_h;
+  EXPECT_TRUE(CreatePipe(&read1_h, &write1_h, nullptr, 0));
+  bazel::windows::AutoHandle read1(read1_h), write1(write1_h);
+  HANDLE read2_h, write2_h;
+  EXPECT_TRUE(CreatePipe(&read2_h, &write2_h, nullptr, 0));
+  bazel::windows::AutoHandle read2(read2_h), write2(write2_h);
+  HANDLE read3_h, write3_h;
+  EXPECT_TRUE(CreatePipe(&read3_h, &write3_h, nullptr, 0));
+  bazel::windows::AutoHandle read3(read3_h), write3(write3_h);
+  HANDLE read4_h, write4_h;
+  EXPECT_TRUE(CreatePipe(&read4_h, &write4_h, nullptr, 0));
+  bazel::windows::AutoHandle read4(read4_h), write4(write4_h);
+
+  std::unique_ptr<bazel::tools::test_wrapper::Tee> tee;
+  EXPECT_TRUE(TestOnly_CreateTee(&read1, &write2, &write3, &tee, &write4));
+
+  DWORD written, read;
+  char content[100];
+
+  // The CDATA end and the double-octet sequence are split across writes.
+  EXPECT_TRUE(WriteFile(write1, "a]]", 3, &written, nullptr));
+  EXPECT_TRUE(ReadFile(read2, content, 100, &read, nullptr));
+  EXPECT_TRUE(ReadFile(read3, content, 100, &read, nullptr));
+  EXPECT_TRUE(WriteFile(write1, ">\xC0", 2, &written, nullptr));
+  EXPECT_TRUE(ReadFile(read2, content, 100, &read, nullptr));
+  EXPECT_TRUE(ReadFile(read3, content, 100, &read, nullptr));
+  EXPECT_TRUE(WriteFile(write1, "\x80x]", 3, &written, nullptr));
+  EXPECT_TRUE(ReadFile(read2, content, 100, &read, nullptr));
+  EXPECT_TRUE(ReadFile(read3, content, 100, &read, nullptr));
+  write1 = INVALID_HANDLE_VALUE;  // closes handle so the Tee thread can exit
+
+  EXPECT_TRUE(tee->Finish(INFINITE));
+  EXPECT_TRUE(tee->CdataComplete());
+  tee.reset();  // closes the writing end of the CDATA pipe
+
+  std::string cdata;
+  while (ReadFile(read4, content, 100, &read, nullptr) && read > 0) {
+    cdata.append(content, read);
+  }
+  EXPECT_EQ(cdata, "a]]>]]<![CDATA[>\xC0\x80x]");
+}
+
 void AssertCdataEncodeBuffer(const wchar_t* wline, const char* input,
                              DWORD size, const char* expected_output) {
   bazel::windows::AutoHandle h(FopenContents(wline, input, size));
@@ -597,6 +736,44 @@ TEST_F(TestWrapperWindowsTest, TestCdataEscapeAndAppend) {
                           "]]>]]<![CDATA[>");
 }
 
+TEST_F(TestWrapperWindowsTest, TestCdataEscapeLongRuns) {
+  // Plain octets are copied in runs; make sure the runs span page boundaries
+  // and end correctly at octets that need a closer look.
+  std::string input, expected;
+  for (int i = 0; i < 50; ++i) {
+    input += std::string(i, 'a') + "\t\r\n" + std::string(i, '~');
+    expected += std::string(i, 'a') + "\t\r\n" + std::string(i, '~');
+    input += "]]>\xC0\x80\x1F\xFF";
+    expected += "]]>]]<![CDATA[>\xC0\x80??";
+  }
+
+  bazel::windows::AutoHandle h(
+      FopenContents(WLINE, input.c_str(), input.size()));
+  std::unique_ptr<IFStream> istm(
+      TestOnly_CreateIFStream(h, /* page_size */ 37));
+  std::stringstream out_stm;
+  ASSERT_TRUE(TestOnly_CdataEncode(istm.get(), &out_stm));
+  ASSERT_EQ(expected, out_stm.str());
+}
+
+TEST_F(TestWrapperWindowsTest, TestCdataEncodeChunks) {
+  // Whichever way the input is split, the output is what CdataEscape makes of
+  // all of it.
+  const std::string input =
+      "]]>\xC0\x80\xED\x9F\xBF\xEF\xBF\xB0\xF7\xB0\x80\x81]]]>\xF0\x80\xE0]";
+  const std::string expected =
+      "]]>]]<![CDATA[>\xC0\x80\xED\x9F\xBF\xEF\xBF\xB0\xF7\xB0\x80\x81"
+      "]]]>]]<![CDATA[>???]";
+  for (size_t i = 0; i <= input.size(); ++i) {
+    for (size_t j = i; j <= input.size(); ++j) {
+      ASSERT_EQ(expected, TestOnly_CdataEncodeChunks(
+                              {input.substr(0, i), input.substr(i, j - i),
+                               input.substr(j)}))
+          << "split at " << i << " and " << j;
+    }
+  }
+}
+
 TEST_F(TestWrapperWindowsTest, TestIFStreamNoData) {
   bazel::windows::AutoHandle h(FopenContents(WLINE, ""));
   std::unique_ptr<IFStream> s(TestOnly_CreateIFStream(h, 6));